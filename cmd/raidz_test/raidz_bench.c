@@ -40,40 +40,199 @@
 #define	MIN_CS_SHIFT		BENCH_ASHIFT
 #define	MAX_CS_SHIFT		SPA_MAXBLOCKSHIFT
 
-static zio_t zio_bench;
-static raidz_map_t *rm_bench;
-static size_t max_data_size = SPA_MAXBLOCKSIZE;
+/*
+ * Per thread benchmark state. Every thread works on its own copy of the
+ * data and its own raidz map, so reconstruction (which writes into the
+ * data columns) does not share any memory between threads.
+ */
+typedef struct bench_thread {
+	zio_t		bt_zio;
+	raidz_map_t	*bt_rm;
+	const int	*bt_tgt;
+	int		bt_nbad;
+	boolean_t	bt_rec;
+	uint64_t	bt_iters;
+} bench_thread_t;
+
+static bench_thread_t *bench_threads;
+static size_t bench_nthreads;
+static size_t max_data_size;
+
+static kmutex_t bench_mtx;
+static kcondvar_t bench_cv;
+static boolean_t bench_go;
+static size_t bench_running;
+
+static boolean_t bench_first_result;
+
+static const char *
+bench_layout_name(void)
+{
+	if (rto_opts.rto_draid)
+		return ("draid");
+	if (rto_opts.rto_expand)
+		return ("raidz_expanded");
+	return ("raidz");
+}
 
 static void
 bench_init_raidz_map(void)
 {
-	zio_bench.io_offset = 0;
-	zio_bench.io_size = max_data_size;
-
 	/*
-	 * To permit larger column sizes these have to be done
-	 * allocated using aligned alloc instead of zio_abd_buf_alloc
+	 * dRAID maps are always padded to a full stripe, so leave room
+	 * for rounding the largest block up to a multiple of the stripe.
 	 */
-	zio_bench.io_abd = raidz_alloc(max_data_size);
+	max_data_size = SPA_MAXBLOCKSIZE + (rto_opts.rto_dcols << BENCH_ASHIFT);
+
+	bench_nthreads = MAX(rto_opts.rto_bench_threads, 1);
+	bench_threads = umem_zalloc(bench_nthreads * sizeof (bench_thread_t),
+	    UMEM_NOFAIL);
+
+	for (size_t t = 0; t < bench_nthreads; t++) {
+		zio_t *zio = &bench_threads[t].bt_zio;
+
+		zio->io_offset = 0;
+		zio->io_size = max_data_size;
+
+		/*
+		 * To permit larger column sizes these have to be done
+		 * allocated using aligned alloc instead of zio_abd_buf_alloc
+		 */
+		zio->io_abd = raidz_alloc(max_data_size);
 
-	init_zio_abd(&zio_bench);
+		init_zio_abd(zio);
+	}
+
+	mutex_init(&bench_mtx, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&bench_cv, NULL, CV_DEFAULT, NULL);
 }
 
 static void
 bench_fini_raidz_maps(void)
 {
-	/* tear down golden zio */
-	raidz_free(zio_bench.io_abd, max_data_size);
-	memset(&zio_bench, 0, sizeof (zio_t));
+	/* tear down golden zios */
+	for (size_t t = 0; t < bench_nthreads; t++)
+		raidz_free(bench_threads[t].bt_zio.io_abd, max_data_size);
+	umem_free(bench_threads, bench_nthreads * sizeof (bench_thread_t));
+	bench_threads = NULL;
+
+	mutex_destroy(&bench_mtx);
+	cv_destroy(&bench_cv);
+}
+
+/*
+ * Allocate a raidz map with the benchmarked layout. dRAID stores every
+ * block as full width rows, which is modeled by padding the block to a
+ * multiple of the stripe width so that all columns are the same size.
+ */
+static raidz_map_t *
+bench_map_alloc(zio_t *zio, uint64_t size, uint64_t ashift, int ncols,
+    int nparity)
+{
+	if (rto_opts.rto_draid) {
+		uint64_t stripe = (uint64_t)(ncols - nparity) << ashift;
+
+		zio->io_size = roundup(size, stripe);
+		return (vdev_raidz_map_alloc(zio, ashift, ncols, nparity));
+	}
+
+	zio->io_size = size;
+	if (rto_opts.rto_expand) {
+		return (vdev_raidz_map_alloc_expanded(zio, ashift, ncols + 1,
+		    ncols, nparity, rto_opts.rto_expand_offset, 0, B_FALSE));
+	}
+
+	return (vdev_raidz_map_alloc(zio, ashift, ncols, nparity));
+}
+
+static __attribute__((noreturn)) void
+bench_thread(void *arg)
+{
+	bench_thread_t *bt = arg;
+
+	mutex_enter(&bench_mtx);
+	while (!bench_go)
+		cv_wait(&bench_cv, &bench_mtx);
+	mutex_exit(&bench_mtx);
+
+	for (uint64_t iter = 0; iter < bt->bt_iters; iter++) {
+		if (bt->bt_rec)
+			vdev_raidz_reconstruct(bt->bt_rm, bt->bt_tgt,
+			    bt->bt_nbad);
+		else
+			vdev_raidz_generate_parity(bt->bt_rm);
+	}
+
+	mutex_enter(&bench_mtx);
+	bench_running--;
+	cv_broadcast(&bench_cv);
+	mutex_exit(&bench_mtx);
+
+	thread_exit();
+}
+
+/*
+ * Run the prepared maps of the first nthreads bench threads concurrently
+ * and return the wall time in seconds it took for all of them to finish.
+ */
+static double
+bench_run_threads(size_t nthreads)
+{
+	hrtime_t start;
+
+	bench_go = B_FALSE;
+	bench_running = nthreads;
+	for (size_t t = 0; t < nthreads; t++) {
+		VERIFY3P(thread_create(NULL, 0, bench_thread, &bench_threads[t],
+		    0, NULL, TS_RUN, defclsyspri), !=, NULL);
+	}
+
+	mutex_enter(&bench_mtx);
+	start = gethrtime();
+	bench_go = B_TRUE;
+	cv_broadcast(&bench_cv);
+	while (bench_running > 0)
+		cv_wait(&bench_cv, &bench_mtx);
+	mutex_exit(&bench_mtx);
+
+	return (NSEC2SEC((double)(gethrtime() - start)));
+}
+
+static void
+bench_report(const char *impl, const char *op, const char *math,
+    uint64_t iosize, size_t nthreads, double d_bw, double t_bw,
+    uint64_t iter_cnt)
+{
+	if (!rto_opts.rto_json) {
+		LOG(D_ALL, "%10s, %8s, %zu, %10llu, %lf, %lf, %u, %zu\n",
+		    impl,
+		    math,
+		    rto_opts.rto_dcols,
+		    (u_longlong_t)iosize,
+		    d_bw,
+		    t_bw,
+		    (unsigned)iter_cnt,
+		    nthreads);
+		return;
+	}
+
+	(void) printf("%s\n    {\"impl\": \"%s\", \"op\": \"%s\", "
+	    "\"math\": \"%s\", \"iosize\": %llu, \"threads\": %zu, "
+	    "\"disk_bw\": %.3f, \"total_bw\": %.3f, \"iter\": %llu}",
+	    bench_first_result ? "" : ",", impl, op, math,
+	    (u_longlong_t)iosize, nthreads, d_bw, t_bw,
+	    (u_longlong_t)iter_cnt);
+	bench_first_result = B_FALSE;
 }
 
 static inline void
-run_gen_bench_impl(const char *impl)
+run_gen_bench_impl(const char *impl, size_t nthreads)
 {
 	int fn, ncols;
-	uint64_t ds, iter_cnt, iter, disksize;
-	hrtime_t start;
+	uint64_t ds, iter_cnt, disksize;
 	double elapsed, d_bw;
+	uint64_t ashift = rto_opts.rto_expand ? rto_opts.rto_ashift :
+	    BENCH_ASHIFT;
 
 	/* Benchmark generate functions */
 	for (fn = 0; fn < RAIDZ_GEN_NUM; fn++) {
@@ -81,53 +240,50 @@ run_gen_bench_impl(const char *impl)
 		for (ds = MIN_CS_SHIFT; ds <= MAX_CS_SHIFT; ds++) {
 			/* create suitable raidz_map */
 			ncols = rto_opts.rto_dcols + fn + 1;
-			zio_bench.io_size = 1ULL << ds;
-
-			if (rto_opts.rto_expand) {
-				rm_bench = vdev_raidz_map_alloc_expanded(
-				    &zio_bench,
-				    rto_opts.rto_ashift, ncols+1, ncols,
-				    fn+1, rto_opts.rto_expand_offset,
-				    0, B_FALSE);
-			} else {
-				rm_bench = vdev_raidz_map_alloc(&zio_bench,
-				    BENCH_ASHIFT, ncols, fn+1);
-			}
 
-			/* estimate iteration count */
+			/* estimate iteration count, split over the threads */
 			iter_cnt = GEN_BENCH_MEMORY;
-			iter_cnt /= zio_bench.io_size;
+			iter_cnt /= (1ULL << ds) * nthreads;
+			iter_cnt = MAX(iter_cnt, 1);
 
-			start = gethrtime();
-			for (iter = 0; iter < iter_cnt; iter++)
-				vdev_raidz_generate_parity(rm_bench);
-			elapsed = NSEC2SEC((double)(gethrtime() - start));
+			for (size_t t = 0; t < nthreads; t++) {
+				bench_thread_t *bt = &bench_threads[t];
 
-			disksize = (1ULL << ds) / rto_opts.rto_dcols;
-			d_bw = (double)iter_cnt * (double)disksize;
+				bt->bt_rm = bench_map_alloc(&bt->bt_zio,
+				    1ULL << ds, ashift, ncols, fn + 1);
+				bt->bt_rec = B_FALSE;
+				bt->bt_iters = iter_cnt;
+			}
+
+			elapsed = bench_run_threads(nthreads);
+
+			disksize = bench_threads[0].bt_zio.io_size /
+			    rto_opts.rto_dcols;
+			d_bw = (double)iter_cnt * (double)nthreads *
+			    (double)disksize;
 			d_bw /= (1024.0 * 1024.0 * elapsed);
 
-			LOG(D_ALL, "%10s, %8s, %zu, %10llu, %lf, %lf, %u\n",
-			    impl,
-			    raidz_gen_name[fn],
-			    rto_opts.rto_dcols,
-			    (1ULL<<ds),
-			    d_bw,
-			    d_bw * (double)(ncols),
-			    (unsigned)iter_cnt);
+			bench_report(impl, "generate", raidz_gen_name[fn],
+			    1ULL << ds, nthreads, d_bw, d_bw * (double)ncols,
+			    iter_cnt * nthreads);
 
-			vdev_raidz_map_free(rm_bench);
+			for (size_t t = 0; t < nthreads; t++)
+				vdev_raidz_map_free(bench_threads[t].bt_rm);
 		}
 	}
 }
 
 static void
-run_gen_bench(void)
+run_gen_bench(size_t nthreads)
 {
 	char **impl_name;
 
-	LOG(D_INFO, DBLSEP "\nBenchmarking parity generation...\n\n");
-	LOG(D_ALL, "impl, math, dcols, iosize, disk_bw, total_bw, iter\n");
+	LOG(D_INFO, DBLSEP "\nBenchmarking parity generation "
+	    "(%zu threads)...\n\n", nthreads);
+	if (!rto_opts.rto_json) {
+		LOG(D_ALL, "impl, math, dcols, iosize, disk_bw, total_bw, "
+		    "iter, threads\n");
+	}
 
 	for (impl_name = (char **)raidz_impl_names; *impl_name != NULL;
 	    impl_name++) {
@@ -135,16 +291,15 @@ run_gen_bench(void)
 		if (vdev_raidz_impl_set(*impl_name) != 0)
 			continue;
 
-		run_gen_bench_impl(*impl_name);
+		run_gen_bench_impl(*impl_name, nthreads);
 	}
 }
 
 static void
-run_rec_bench_impl(const char *impl)
+run_rec_bench_impl(const char *impl, size_t nthreads)
 {
 	int fn, ncols, nbad;
-	uint64_t ds, iter_cnt, iter, disksize;
-	hrtime_t start;
+	uint64_t ds, iter_cnt, disksize;
 	double elapsed, d_bw;
 	static const int tgt[7][3] = {
 		{1, 2, 3},	/* rec_p:   bad QR & D[0]	*/
@@ -161,65 +316,66 @@ run_rec_bench_impl(const char *impl)
 
 			/* create suitable raidz_map */
 			ncols = rto_opts.rto_dcols + PARITY_PQR;
-			zio_bench.io_size = 1ULL << ds;
 
 			/*
 			 * raidz block is too short to test
 			 * the requested method
 			 */
-			if (zio_bench.io_size / rto_opts.rto_dcols <
+			if ((1ULL << ds) / rto_opts.rto_dcols <
 			    (1ULL << BENCH_ASHIFT))
 				continue;
 
-			if (rto_opts.rto_expand) {
-				rm_bench = vdev_raidz_map_alloc_expanded(
-				    &zio_bench,
-				    BENCH_ASHIFT, ncols+1, ncols,
-				    PARITY_PQR,
-				    rto_opts.rto_expand_offset, 0, B_FALSE);
-			} else {
-				rm_bench = vdev_raidz_map_alloc(&zio_bench,
-				    BENCH_ASHIFT, ncols, PARITY_PQR);
-			}
-
-			/* estimate iteration count */
+			/* estimate iteration count, split over the threads */
 			iter_cnt = (REC_BENCH_MEMORY);
-			iter_cnt /= zio_bench.io_size;
+			iter_cnt /= (1ULL << ds) * nthreads;
+			iter_cnt = MAX(iter_cnt, 1);
+
+			for (size_t t = 0; t < nthreads; t++) {
+				bench_thread_t *bt = &bench_threads[t];
 
-			/* calculate how many bad columns there are */
-			nbad = MIN(3, raidz_ncols(rm_bench) -
-			    raidz_parity(rm_bench));
+				bt->bt_rm = bench_map_alloc(&bt->bt_zio,
+				    1ULL << ds, BENCH_ASHIFT, ncols,
+				    PARITY_PQR);
 
-			start = gethrtime();
-			for (iter = 0; iter < iter_cnt; iter++)
-				vdev_raidz_reconstruct(rm_bench, tgt[fn], nbad);
-			elapsed = NSEC2SEC((double)(gethrtime() - start));
+				/* calculate how many bad columns there are */
+				nbad = MIN(3, raidz_ncols(bt->bt_rm) -
+				    raidz_parity(bt->bt_rm));
 
-			disksize = (1ULL << ds) / rto_opts.rto_dcols;
-			d_bw = (double)iter_cnt * (double)(disksize);
+				bt->bt_rec = B_TRUE;
+				bt->bt_tgt = tgt[fn];
+				bt->bt_nbad = nbad;
+				bt->bt_iters = iter_cnt;
+			}
+
+			elapsed = bench_run_threads(nthreads);
+
+			disksize = bench_threads[0].bt_zio.io_size /
+			    rto_opts.rto_dcols;
+			d_bw = (double)iter_cnt * (double)nthreads *
+			    (double)disksize;
 			d_bw /= (1024.0 * 1024.0 * elapsed);
 
-			LOG(D_ALL, "%10s, %8s, %zu, %10llu, %lf, %lf, %u\n",
-			    impl,
-			    raidz_rec_name[fn],
-			    rto_opts.rto_dcols,
-			    (1ULL<<ds),
-			    d_bw,
-			    d_bw * (double)ncols,
-			    (unsigned)iter_cnt);
+			bench_report(impl, "reconstruct", raidz_rec_name[fn],
+			    1ULL << ds, nthreads, d_bw, d_bw * (double)ncols,
+			    iter_cnt * nthreads);
 
-			vdev_raidz_map_free(rm_bench);
+			for (size_t t = 0; t < nthreads; t++)
+				vdev_raidz_map_free(bench_threads[t].bt_rm);
 		}
 	}
 }
 
 static void
-run_rec_bench(void)
+run_rec_bench(size_t nthreads)
 {
 	char **impl_name;
 
-	LOG(D_INFO, DBLSEP "\nBenchmarking data reconstruction...\n\n");
-	LOG(D_ALL, "impl, math, dcols, iosize, disk_bw, total_bw, iter\n");
+	LOG(D_INFO, DBLSEP "\nBenchmarking data reconstruction "
+	    "(%zu threads)...\n\n", nthreads);
+	if (!rto_opts.rto_json) {
+		LOG(D_ALL, "impl, math, dcols, iosize, disk_bw, total_bw, "
+		    "iter, threads\n");
+	}
 
 	for (impl_name = (char **)raidz_impl_names; *impl_name != NULL;
 	    impl_name++) {
@@ -227,17 +383,43 @@ run_rec_bench(void)
 		if (vdev_raidz_impl_set(*impl_name) != 0)
 			continue;
 
-		run_rec_bench_impl(*impl_name);
+		run_rec_bench_impl(*impl_name, nthreads);
 	}
 }
 
+/*
+ * The benchmark is repeated for 1, 2, 4, ... threads up to the number of
+ * threads requested with -n, which shows how the implementations scale
+ * with the number of cores. Results are either printed as CSV lines or,
+ * with -j, as a single JSON document suitable for comparing runs.
+ */
 void
 run_raidz_benchmark(void)
 {
+	size_t nthreads;
+
 	bench_init_raidz_map();
 
-	run_gen_bench();
-	run_rec_bench();
+	if (rto_opts.rto_json) {
+		(void) printf("{\n  \"layout\": \"%s\",\n  \"dcols\": %zu,\n",
+		    bench_layout_name(), rto_opts.rto_dcols);
+		if (rto_opts.rto_expand) {
+			(void) printf("  \"reflow_offset\": %llu,\n",
+			    (u_longlong_t)rto_opts.rto_expand_offset);
+		}
+		(void) printf("  \"results\": [");
+		bench_first_result = B_TRUE;
+	}
+
+	for (nthreads = 1; ; nthreads = MIN(nthreads * 2, bench_nthreads)) {
+		run_gen_bench(nthreads);
+		run_rec_bench(nthreads);
+		if (nthreads == bench_nthreads)
+			break;
+	}
+
+	if (rto_opts.rto_json)
+		(void) printf("\n  ]\n}\n");
 
 	bench_fini_raidz_maps();
 }
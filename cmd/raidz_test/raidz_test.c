@@ -119,6 +119,9 @@ static void usage(boolean_t requested)
 	    "\t[-S parameter sweep (default: %s)]\n"
 	    "\t[-t timeout for parameter sweep test]\n"
 	    "\t[-B benchmark all raidz implementations]\n"
+	    "\t[-n benchmark threads, doubled from 1 up to n (default: %zu)]\n"
+	    "\t[-j print benchmark results as JSON]\n"
+	    "\t[-g benchmark full width dRAID stripes]\n"
 	    "\t[-e use expanded raidz map (default: %s)]\n"
 	    "\t[-r expanded raidz map reflow offset (default: %llx)]\n"
 	    "\t[-v increase verbosity (default: %d)]\n"
@@ -131,6 +134,7 @@ static void usage(boolean_t requested)
 	    o->rto_dcols,				/* -d */
 	    ilog2(o->rto_dsize),			/* -s */
 	    rto_opts.rto_sweep ? "yes" : "no",		/* -S */
+	    o->rto_bench_threads,			/* -n */
 	    rto_opts.rto_expand ? "yes" : "no",		/* -e */
 	    (u_longlong_t)o->rto_expand_offset,		/* -r */
 	    o->rto_v);					/* -v */
@@ -146,7 +150,7 @@ static void process_options(int argc, char **argv)
 
 	memcpy(o, &rto_opts_defaults, sizeof (*o));
 
-	while ((opt = getopt(argc, argv, "TDBSvha:er:o:d:s:t:")) != -1) {
+	while ((opt = getopt(argc, argv, "TDBSvhjga:er:o:d:s:t:n:")) != -1) {
 		switch (opt) {
 		case 'a':
 			value = strtoull(optarg, NULL, 0);
@@ -184,6 +188,16 @@ static void process_options(int argc, char **argv)
 		case 'B':
 			o->rto_benchmark = 1;
 			break;
+		case 'n':
+			value = strtoull(optarg, NULL, 0);
+			o->rto_bench_threads = MIN(1024, MAX(1, value));
+			break;
+		case 'j':
+			o->rto_json = 1;
+			break;
+		case 'g':
+			o->rto_draid = 1;
+			break;
 		case 'D':
 			o->rto_gdb = 1;
 			break;
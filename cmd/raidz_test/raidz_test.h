@@ -37,6 +37,7 @@ static const char *const raidz_impl_names[] = {
 	"avx2",
 	"avx512f",
 	"avx512bw",
+	"avx512gfni",
 	"aarch64_neon",
 	"aarch64_neonx2",
 	"powerpc_altivec",
@@ -58,6 +59,9 @@ typedef struct raidz_test_opts {
 	size_t rto_sweep;
 	size_t rto_sweep_timeout;
 	size_t rto_benchmark;
+	size_t rto_bench_threads;
+	size_t rto_json;
+	size_t rto_draid;
 	size_t rto_expand;
 	uint64_t rto_expand_offset;
 	size_t rto_sanity;
@@ -78,6 +82,9 @@ static const raidz_test_opts_t rto_opts_defaults = {
 	.rto_v = D_ALL,
 	.rto_sweep = 0,
 	.rto_benchmark = 0,
+	.rto_bench_threads = 1,
+	.rto_json = 0,
+	.rto_draid = 0,
 	.rto_expand = 0,
 	.rto_expand_offset = -1ULL,
 	.rto_sanity = 0,
@@ -43,6 +43,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <math.h>
 #include <openssl/evp.h>
 #include <sys/zfs_context.h>
 #include <sys/spa.h>
@@ -122,6 +123,8 @@ static int flagbits[256];
 
 
 static uint64_t max_inflight_bytes = 256 * 1024 * 1024; /* 256MB */
+static uint_t zdb_traverse_threads = 1;
+static uint_t zdb_ddt_sample_shift = 0;
 static int leaked_objects = 0;
 static zfs_range_tree_t *mos_refd_objs;
 static spa_t *spa;
@@ -701,10 +704,10 @@ static void
 usage(void)
 {
 	(void) fprintf(stderr,
-	    "Usage:\t%s [-AbcdDFGhikLMPsvXy] [-e [-V] [-p <path> ...]] "
+	    "Usage:\t%s [-AbcdDFGhijkLMPsvXy] [-e [-V] [-p <path> ...]] "
 	    "[-I <inflight I/Os>]\n"
 	    "\t\t[-o <var>=<value>]... [-t <txg>] [-U <cache>] [-x <dumpdir>]\n"
-	    "\t\t[-K <key>]\n"
+	    "\t\t[-K <key>] [-W <threads>] [-H <sample shift>]\n"
 	    "\t\t[<poolname>[/<dataset | objset id>] [<object | range> ...]]\n"
 	    "\t%s [-AdiPv] [-e [-V] [-p <path> ...]] [-U <cache>] [-K <key>]\n"
 	    "\t\t[<poolname>[/<dataset | objset id>] [<object | range> ...]\n"
@@ -764,6 +767,8 @@ usage(void)
 	    "pool history\n");
 	(void) fprintf(stderr, "        -i --intent-logs             "
 	    "intent logs\n");
+	(void) fprintf(stderr, "        -j --spacemap-compaction     "
+	    "space map sizes with compact (spacemap_v3) encoding\n");
 	(void) fprintf(stderr, "        -l --label                   "
 	    "read label contents\n");
 	(void) fprintf(stderr, "        -k --checkpointed-state      "
@@ -801,6 +806,8 @@ usage(void)
 	    "groups\n");
 	(void) fprintf(stderr, "        -G --dump-debug-msg          "
 	    "dump zfs_dbgmsg buffer before exiting\n");
+	(void) fprintf(stderr, "        -H --dedup-sample=INTEGER    "
+	    "with -S, sample 1 in 2^INTEGER unique blocks\n");
 	(void) fprintf(stderr, "        -I --inflight=INTEGER        "
 	    "specify the maximum number of checksumming I/Os "
 	    "[default is 200]\n");
@@ -824,6 +831,8 @@ usage(void)
 	    "use alternate cachefile\n");
 	(void) fprintf(stderr, "        -V --verbatim                "
 	    "do verbatim import\n");
+	(void) fprintf(stderr, "        -W --threads=INTEGER         "
+	    "number of threads traversing datasets for -b, -c and -S\n");
 	(void) fprintf(stderr, "        -x --dump-blocks=PATH        "
 	    "dump all read blocks into specified directory\n");
 	(void) fprintf(stderr, "        -X --extreme-rewind          "
@@ -1589,6 +1598,65 @@ dump_spacemap(objset_t *os, space_map_t *sm)
 		char entry_type;
 		uint64_t entry_off, entry_run, entry_vdev;
 
+		if (sm_entry_is_compact(word)) {
+			uint64_t nbytes = SM3_NBYTES_DECODE(word);
+			uint64_t nwords = howmany(nbytes, sizeof (uint64_t));
+			uint64_t payload[SM3_RECORD_MAX_BYTES /
+			    sizeof (uint64_t)];
+
+			ASSERT3U(nbytes, <=, SM3_RECORD_MAX_BYTES);
+			ASSERT3U(offset + nwords * sizeof (uint64_t), <,
+			    space_map_length(sm));
+			VERIFY0(dmu_read(os, space_map_object(sm),
+			    offset + sizeof (word), nwords * sizeof (uint64_t),
+			    payload, DMU_READ_PREFETCH));
+			offset += nwords * sizeof (uint64_t);
+
+			entry_type = (SM3_TYPE_DECODE(word) == SM_ALLOC) ?
+			    'A' : 'F';
+			entry_vdev = SM3_VDEV_DECODE(word);
+			boolean_t show = (zopt_metaslab_args == 0 ||
+			    entry_vdev == SM_NO_VDEVID ||
+			    zopt_metaslab[0] == entry_vdev);
+			if (show) {
+				(void) printf("\t    [%6llu] %c record: "
+				    "%llu bytes vdev: %lld\n",
+				    (u_longlong_t)entry_id, entry_type,
+				    (u_longlong_t)nbytes,
+				    entry_vdev == SM_NO_VDEVID ?
+				    -1LL : (longlong_t)entry_vdev);
+			}
+
+			uint64_t pos = 0, cursor = 0;
+			while (pos < nbytes) {
+				uint64_t raw_off = cursor +
+				    sm_compact_decode(payload, nbytes, &pos);
+				uint64_t raw_run = sm_compact_decode(payload,
+				    nbytes, &pos) + 1;
+				cursor = raw_off + raw_run;
+
+				entry_off = (raw_off << mapshift) +
+				    sm->sm_start;
+				entry_run = raw_run << mapshift;
+				if (show) {
+					(void) printf("\t\t     %c range: "
+					    "%012llx-%012llx size: %08llx\n",
+					    entry_type,
+					    (u_longlong_t)entry_off,
+					    (u_longlong_t)(entry_off +
+					    entry_run - 1),
+					    (u_longlong_t)entry_run);
+				}
+
+				if (entry_type == 'A')
+					alloc += entry_run;
+				else
+					alloc -= entry_run;
+			}
+			entry_id++;
+			continue;
+		}
+
 		if (sm_entry_is_single_word(word)) {
 			entry_type = (SM_TYPE_DECODE(word) == SM_ALLOC) ?
 			    'A' : 'F';
@@ -1916,6 +1984,96 @@ dump_metaslabs(spa_t *spa)
 	}
 }
 
+static void
+print_spacemap_compaction(const char *what, uint64_t count, uint64_t before,
+    uint64_t after)
+{
+	char beforebuf[32], afterbuf[32];
+
+	zdb_nicebytes(before, beforebuf, sizeof (beforebuf));
+	zdb_nicebytes(after, afterbuf, sizeof (afterbuf));
+
+	(void) printf("\t%-24s %8llu   %10s   %10s   %5llu%%\n", what,
+	    (u_longlong_t)count, beforebuf, afterbuf,
+	    (u_longlong_t)(before == 0 ? 100 : after * 100 / before));
+}
+
+/*
+ * Report the current size of the pool's space maps next to the size they
+ * would have if they were written as compact (spacemap_v3) records.
+ */
+static void
+dump_spacemap_compaction(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+	uint64_t pool_count = 0, pool_before = 0, pool_after = 0;
+	char what[32];
+
+	(void) printf("\nSpace map compaction (spacemap_v3 %s):\n",
+	    spa_feature_is_active(spa, SPA_FEATURE_SPACEMAP_V3) ?
+	    "active" : "inactive");
+	(void) printf("\t%-24s %8s   %10s   %10s   %6s\n", "space maps",
+	    "count", "current", "compact", "ratio");
+
+	for (uint64_t c = 0; c < rvd->vdev_children; c++) {
+		vdev_t *vd = rvd->vdev_child[c];
+		uint64_t count = 0, before = 0, after = 0;
+
+		for (uint64_t m = 0; m < vd->vdev_ms_count; m++) {
+			space_map_t *sm = vd->vdev_ms[m]->ms_sm;
+			uint64_t size;
+
+			if (sm == NULL)
+				continue;
+			VERIFY0(space_map_compact_size(sm, &size));
+
+			if (dump_opt['j'] > 1) {
+				(void) snprintf(what, sizeof (what),
+				    "  metaslab %llu", (u_longlong_t)m);
+				print_spacemap_compaction(what, 1,
+				    space_map_length(sm), size);
+			}
+			count++;
+			before += space_map_length(sm);
+			after += size;
+		}
+		if (count == 0)
+			continue;
+
+		(void) snprintf(what, sizeof (what), "vdev %llu",
+		    (u_longlong_t)vd->vdev_id);
+		print_spacemap_compaction(what, count, before, after);
+		pool_count += count;
+		pool_before += before;
+		pool_after += after;
+	}
+
+	if (spa_feature_is_active(spa, SPA_FEATURE_LOG_SPACEMAP)) {
+		uint64_t count = 0, before = 0, after = 0;
+
+		for (spa_log_sm_t *sls = avl_first(&spa->spa_sm_logs_by_txg);
+		    sls; sls = AVL_NEXT(&spa->spa_sm_logs_by_txg, sls)) {
+			space_map_t *sm = NULL;
+			uint64_t size;
+
+			VERIFY0(space_map_open(&sm, spa_meta_objset(spa),
+			    sls->sls_sm_obj, 0, UINT64_MAX, SPA_MINBLOCKSHIFT));
+			VERIFY0(space_map_compact_size(sm, &size));
+			count++;
+			before += space_map_length(sm);
+			after += size;
+			space_map_close(sm);
+		}
+		print_spacemap_compaction("log", count, before, after);
+		pool_count += count;
+		pool_before += before;
+		pool_after += after;
+	}
+
+	print_spacemap_compaction("pool total", pool_count, pool_before,
+	    pool_after);
+}
+
 static void
 dump_log_spacemaps(spa_t *spa)
 {
@@ -5682,9 +5840,32 @@ typedef struct zdb_cb {
 	spa_t		*zcb_spa;
 	uint32_t	**zcb_vd_obsolete_counts;
 	avl_tree_t	zcb_brt;
+	kmutex_t	zcb_brt_lock;
 	boolean_t	zcb_brt_is_active;
+	struct zdb_cb	*zcb_parent;
+	struct zdb_cb	**zcb_workers;
+	int		zcb_nworkers;
 } zdb_cb_t;
 
+/*
+ * State shared by the threads of a parallel block traversal (-W). The MOS
+ * is traversed first by the main thread. Each worker then repeatedly takes
+ * the next dataset from zt_objs, largest first, and traverses it passing
+ * its own entry of zt_args to zt_func, so that the callbacks can keep
+ * their results per thread and merge them once the traversal is done.
+ */
+typedef struct zdb_traverse {
+	spa_t		*zt_spa;
+	int		zt_flags;
+	blkptr_cb_t	*zt_func;
+	void		**zt_args;
+	uint32_t	zt_nstarted;
+	uint64_t	*zt_objs;
+	uint64_t	zt_nobjs;
+	uint64_t	zt_next;
+	uint32_t	zt_err;
+} zdb_traverse_t;
+
 /* test if two DVA offsets from same vdev are within the same metaslab */
 static boolean_t
 same_metaslab(spa_t *spa, uint64_t vdev, uint64_t off1, uint64_t off2)
@@ -5997,11 +6178,14 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 		 * normal. If we see the block again, we count it as a clone
 		 * and then give it no further consideration.
 		 */
+		zdb_cb_t *bzcb = (zcb->zcb_parent != NULL) ?
+		    zcb->zcb_parent : zcb;
 		zdb_brt_entry_t zbre_search, *zbre;
 		avl_index_t where;
 
+		mutex_enter(&bzcb->zcb_brt_lock);
 		zbre_search.zbre_dva = bp->blk_dva[0];
-		zbre = avl_find(&zcb->zcb_brt, &zbre_search, &where);
+		zbre = avl_find(&bzcb->zcb_brt, &zbre_search, &where);
 		if (zbre == NULL) {
 			/* Not seen before; track it */
 			uint64_t refcnt =
@@ -6011,7 +6195,7 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 				    UMEM_NOFAIL);
 				zbre->zbre_dva = bp->blk_dva[0];
 				zbre->zbre_refcount = refcnt;
-				avl_insert(&zcb->zcb_brt, zbre, where);
+				avl_insert(&bzcb->zcb_brt, zbre, where);
 			}
 		} else  {
 			/*
@@ -6023,13 +6207,14 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 
 			zbre->zbre_refcount--;
 			if (zbre->zbre_refcount == 0) {
-				avl_remove(&zcb->zcb_brt, zbre);
+				avl_remove(&bzcb->zcb_brt, zbre);
 				umem_free(zbre, sizeof (zdb_brt_entry_t));
 			}
 
 			/* Already claimed, don't do it again. */
 			do_claim = B_FALSE;
 		}
+		mutex_exit(&bzcb->zcb_brt_lock);
 	}
 
 skipped:
@@ -6244,10 +6429,19 @@ zdb_blkptr_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 	else
 		return (0);
 
+	/* progress is reported for all threads of a parallel traversal */
+	if (zcb->zcb_parent != NULL)
+		zcb = zcb->zcb_parent;
+
 	if (dump_opt['b'] < 5 && gethrtime() > zcb->zcb_lastprint + NANOSEC) {
 		uint64_t now = gethrtime();
 		char buf[10];
 		uint64_t bytes = zcb->zcb_type[ZB_TOTAL][ZDB_OT_TOTAL].zb_asize;
+
+		for (int w = 0; w < zcb->zcb_nworkers; w++) {
+			bytes += zcb->zcb_workers[w]->
+			    zcb_type[ZB_TOTAL][ZDB_OT_TOTAL].zb_asize;
+		}
 		uint64_t kb_per_sec =
 		    1 + bytes / (1 + ((now - zcb->zcb_start) / 1000 / 1000));
 		uint64_t sec_remaining =
@@ -7094,6 +7288,262 @@ zdb_brt_entry_compare(const void *zcn1, const void *zcn2)
 	return (cmp);
 }
 
+static void
+zdb_traverse_worker(void *arg)
+{
+	zdb_traverse_t *zt = arg;
+	void *warg = zt->zt_args[atomic_inc_32_nv(&zt->zt_nstarted) - 1];
+	dsl_pool_t *dp = spa_get_dsl(zt->zt_spa);
+	uint64_t i;
+
+	while ((i = atomic_inc_64_nv(&zt->zt_next) - 1) < zt->zt_nobjs &&
+	    atomic_load_32(&zt->zt_err) == 0) {
+		dsl_dataset_t *ds;
+		uint64_t txg = 0;
+		int err;
+
+		dsl_pool_config_enter(dp, FTAG);
+		err = dsl_dataset_hold_obj(dp, zt->zt_objs[i], FTAG, &ds);
+		dsl_pool_config_exit(dp, FTAG);
+		if (err != 0)
+			continue;
+
+		if (dsl_dataset_phys(ds)->ds_prev_snap_txg > txg)
+			txg = dsl_dataset_phys(ds)->ds_prev_snap_txg;
+		err = traverse_dataset(ds, txg, zt->zt_flags, zt->zt_func,
+		    warg);
+		dsl_dataset_rele(ds, FTAG);
+		if (err != 0)
+			(void) atomic_cas_32(&zt->zt_err, 0, err);
+	}
+}
+
+typedef struct zdb_traverse_ds {
+	uint64_t	ztd_obj;
+	uint64_t	ztd_bytes;
+} zdb_traverse_ds_t;
+
+static int
+zdb_traverse_ds_compare(const void *l, const void *r)
+{
+	const zdb_traverse_ds_t *zl = l;
+	const zdb_traverse_ds_t *zr = r;
+
+	/* largest first, so the last datasets to finish are small ones */
+	return (TREE_CMP(zr->ztd_bytes, zl->ztd_bytes));
+}
+
+/*
+ * Build the list of datasets for the workers, the same ones traverse_pool()
+ * would visit after the MOS.
+ */
+static int
+zdb_traverse_collect(spa_t *spa, zdb_traverse_t *zt)
+{
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	objset_t *mos = dp->dp_meta_objset;
+	zdb_traverse_ds_t *dss = NULL;
+	uint64_t nalloc = 0, n = 0;
+	int err = 0;
+
+	for (uint64_t obj = 1; err == 0;
+	    err = dmu_object_next(mos, &obj, B_FALSE, 0)) {
+		dmu_object_info_t doi;
+		dsl_dataset_t *ds;
+
+		if (dmu_object_info(mos, obj, &doi) != 0 ||
+		    doi.doi_bonus_type != DMU_OT_DSL_DATASET)
+			continue;
+
+		dsl_pool_config_enter(dp, FTAG);
+		if (dsl_dataset_hold_obj(dp, obj, FTAG, &ds) != 0) {
+			dsl_pool_config_exit(dp, FTAG);
+			continue;
+		}
+
+		if (n == nalloc) {
+			uint64_t newalloc = MAX(nalloc * 2, 64);
+			zdb_traverse_ds_t *tmp = umem_alloc(newalloc *
+			    sizeof (zdb_traverse_ds_t), UMEM_NOFAIL);
+			if (dss != NULL) {
+				memcpy(tmp, dss, n * sizeof (*dss));
+				umem_free(dss, nalloc * sizeof (*dss));
+			}
+			dss = tmp;
+			nalloc = newalloc;
+		}
+		dss[n].ztd_obj = obj;
+		dss[n].ztd_bytes = dsl_dataset_phys(ds)->ds_unique_bytes;
+		n++;
+
+		dsl_dataset_rele(ds, FTAG);
+		dsl_pool_config_exit(dp, FTAG);
+	}
+	if (err == ESRCH)
+		err = 0;
+
+	if (n > 0) {
+		qsort(dss, n, sizeof (*dss), zdb_traverse_ds_compare);
+		zt->zt_objs = umem_alloc(n * sizeof (uint64_t), UMEM_NOFAIL);
+		for (uint64_t i = 0; i < n; i++)
+			zt->zt_objs[i] = dss[i].ztd_obj;
+	}
+	zt->zt_nobjs = n;
+
+	if (dss != NULL)
+		umem_free(dss, nalloc * sizeof (*dss));
+
+	return (err);
+}
+
+/*
+ * Traverse the MOS, passing arg to func, and then every dataset with up to
+ * nworkers threads, where worker i passes wargs[i] to func. Datasets are
+ * the unit of work, since each one can be traversed independently.
+ */
+static int
+zdb_traverse_parallel(spa_t *spa, int flags, blkptr_cb_t *func, void *arg,
+    void **wargs, int nworkers)
+{
+	zdb_traverse_t *zt;
+	taskq_t *tq;
+	int err, n;
+
+	err = traverse_mos(spa, 0, flags, func, arg);
+	if (err != 0)
+		return (err);
+
+	zt = umem_zalloc(sizeof (zdb_traverse_t), UMEM_NOFAIL);
+	zt->zt_spa = spa;
+	zt->zt_flags = flags;
+	zt->zt_func = func;
+	zt->zt_args = wargs;
+	err = zdb_traverse_collect(spa, zt);
+	if (err != 0 || zt->zt_nobjs == 0)
+		goto out;
+
+	n = MIN(nworkers, zt->zt_nobjs);
+	tq = taskq_create("z_zdb_traverse", n, defclsyspri, n, n,
+	    TASKQ_PREPOPULATE);
+	for (int w = 0; w < n; w++) {
+		VERIFY3U(taskq_dispatch(tq, zdb_traverse_worker, zt,
+		    TQ_SLEEP), !=, TASKQID_INVALID);
+	}
+	taskq_wait(tq);
+	taskq_destroy(tq);
+
+	err = zt->zt_err;
+out:
+	if (zt->zt_nobjs > 0)
+		umem_free(zt->zt_objs, zt->zt_nobjs * sizeof (uint64_t));
+	umem_free(zt, sizeof (zdb_traverse_t));
+
+	return (err);
+}
+
+/*
+ * Traverse the whole pool for block statistics, with zdb_traverse_threads
+ * threads if more than one was requested. Each worker counts blocks into
+ * its own zdb_cb_t. The BRT tree and the metaslab trees used for leak
+ * detection are shared and protected by their own locks. When this
+ * returns the workers are done issuing reads, but the caller must wait for
+ * outstanding I/O before calling zdb_traverse_merge().
+ */
+static int
+zdb_traverse_pool(spa_t *spa, int flags, zdb_cb_t *zcb)
+{
+	int n = zdb_traverse_threads;
+
+	if (n <= 1)
+		return (traverse_pool(spa, 0, flags, zdb_blkptr_cb, zcb));
+
+	zcb->zcb_workers = umem_zalloc(n * sizeof (zdb_cb_t *), UMEM_NOFAIL);
+	for (int w = 0; w < n; w++) {
+		zdb_cb_t *wzcb = umem_zalloc(sizeof (zdb_cb_t), UMEM_NOFAIL);
+
+		wzcb->zcb_spa = spa;
+		wzcb->zcb_brt_is_active = zcb->zcb_brt_is_active;
+		wzcb->zcb_parent = zcb;
+		zcb->zcb_workers[w] = wzcb;
+	}
+	zcb->zcb_nworkers = n;
+
+	return (zdb_traverse_parallel(spa, flags, zdb_blkptr_cb, zcb,
+	    (void **)zcb->zcb_workers, n));
+}
+
+static void
+zdb_blkstats_merge(zdb_blkstats_t *dst, const zdb_blkstats_t *src)
+{
+	dst->zb_asize += src->zb_asize;
+	dst->zb_lsize += src->zb_lsize;
+	dst->zb_psize += src->zb_psize;
+	dst->zb_count += src->zb_count;
+	dst->zb_gangs += src->zb_gangs;
+	dst->zb_ditto_samevdev += src->zb_ditto_samevdev;
+	dst->zb_ditto_same_ms += src->zb_ditto_same_ms;
+	for (int i = 0; i < PSIZE_HISTO_SIZE; i++)
+		dst->zb_psize_histogram[i] += src->zb_psize_histogram[i];
+}
+
+/*
+ * Fold the statistics of the workers of a parallel traversal back into
+ * the main zdb_cb_t and free them.
+ */
+static void
+zdb_traverse_merge(zdb_cb_t *zcb)
+{
+	for (int w = 0; w < zcb->zcb_nworkers; w++) {
+		zdb_cb_t *wzcb = zcb->zcb_workers[w];
+
+		for (int l = 0; l <= ZB_TOTAL; l++) {
+			for (int t = 0; t <= ZDB_OT_TOTAL; t++) {
+				zdb_blkstats_merge(&zcb->zcb_type[l][t],
+				    &wzcb->zcb_type[l][t]);
+			}
+		}
+
+		zcb->zcb_dedup_asize += wzcb->zcb_dedup_asize;
+		zcb->zcb_dedup_blocks += wzcb->zcb_dedup_blocks;
+		zcb->zcb_clone_asize += wzcb->zcb_clone_asize;
+		zcb->zcb_clone_blocks += wzcb->zcb_clone_blocks;
+
+		for (int i = 0; i < SPA_MAX_FOR_16M; i++) {
+			zcb->zcb_psize_count[i] += wzcb->zcb_psize_count[i];
+			zcb->zcb_lsize_count[i] += wzcb->zcb_lsize_count[i];
+			zcb->zcb_asize_count[i] += wzcb->zcb_asize_count[i];
+			zcb->zcb_psize_len[i] += wzcb->zcb_psize_len[i];
+			zcb->zcb_lsize_len[i] += wzcb->zcb_lsize_len[i];
+			zcb->zcb_asize_len[i] += wzcb->zcb_asize_len[i];
+		}
+		zcb->zcb_psize_total += wzcb->zcb_psize_total;
+		zcb->zcb_lsize_total += wzcb->zcb_lsize_total;
+		zcb->zcb_asize_total += wzcb->zcb_asize_total;
+
+		for (int i = 0; i < NUM_BP_EMBEDDED_TYPES; i++) {
+			zcb->zcb_embedded_blocks[i] +=
+			    wzcb->zcb_embedded_blocks[i];
+			for (int j = 0; j <= BPE_PAYLOAD_SIZE; j++) {
+				zcb->zcb_embedded_histogram[i][j] +=
+				    wzcb->zcb_embedded_histogram[i][j];
+			}
+		}
+
+		for (int e = 0; e < 256; e++)
+			zcb->zcb_errors[e] += wzcb->zcb_errors[e];
+		zcb->zcb_haderrors |= wzcb->zcb_haderrors;
+
+		umem_free(wzcb, sizeof (zdb_cb_t));
+	}
+
+	if (zcb->zcb_nworkers > 0) {
+		umem_free(zcb->zcb_workers,
+		    zcb->zcb_nworkers * sizeof (zdb_cb_t *));
+	}
+	zcb->zcb_workers = NULL;
+	zcb->zcb_nworkers = 0;
+}
+
 static int
 dump_block_stats(spa_t *spa)
 {
@@ -7114,6 +7564,7 @@ dump_block_stats(spa_t *spa)
 		avl_create(&zcb->zcb_brt, zdb_brt_entry_compare,
 		    sizeof (zdb_brt_entry_t),
 		    offsetof(zdb_brt_entry_t, zbre_node));
+		mutex_init(&zcb->zcb_brt_lock, NULL, MUTEX_DEFAULT, NULL);
 		zcb->zcb_brt_is_active = B_TRUE;
 	}
 
@@ -7170,7 +7621,7 @@ dump_block_stats(spa_t *spa)
 	zcb->zcb_totalasize +=
 	    metaslab_class_get_alloc(spa_special_embedded_log_class(spa));
 	zcb->zcb_start = zcb->zcb_lastprint = gethrtime();
-	err = traverse_pool(spa, 0, flags, zdb_blkptr_cb, zcb);
+	err = zdb_traverse_pool(spa, flags, zcb);
 
 	/*
 	 * If we've traversed the data blocks then we need to wait for those
@@ -7191,6 +7642,7 @@ dump_block_stats(spa_t *spa)
 	 * Done after zio_wait() since zcb_haderrors is modified in
 	 * zdb_blkptr_done()
 	 */
+	zdb_traverse_merge(zcb);
 	zcb->zcb_haderrors |= err;
 
 	if (zcb->zcb_haderrors) {
@@ -7517,6 +7969,29 @@ typedef struct zdb_ddt_entry {
 	avl_node_t	zdde_node;
 } zdb_ddt_entry_t;
 
+/*
+ * Mix all words of the checksum into a well distributed hash, so that
+ * sampling by hash prefix is uniform even for weaker checksums. Copies of
+ * the same block have the same key and thus are either all sampled or all
+ * skipped, which keeps the sampled dedup ratio an unbiased estimate.
+ */
+static uint64_t
+zdb_ddt_key_hash(const ddt_key_t *ddk)
+{
+	uint64_t h = 0;
+
+	for (int i = 0; i < 4; i++) {
+		h ^= ddk->ddk_cksum.zc_word[i];
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+	}
+
+	return (h);
+}
+
 static int
 zdb_ddt_add_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
     const zbookmark_phys_t *zb, const dnode_phys_t *dnp, void *arg)
@@ -7544,6 +8019,12 @@ zdb_ddt_add_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 
 	ddt_key_fill(&zdde_search.zdde_key, bp);
 
+	/* Only keep the blocks whose hash starts with sample_shift zeroes */
+	if (zdb_ddt_sample_shift != 0 &&
+	    (zdb_ddt_key_hash(&zdde_search.zdde_key) >>
+	    (64 - zdb_ddt_sample_shift)) != 0)
+		return (0);
+
 	zdde = avl_find(t, &zdde_search, &where);
 
 	if (zdde == NULL) {
@@ -7560,6 +8041,40 @@ zdb_ddt_add_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 	return (0);
 }
 
+/*
+ * Move all entries of the simulated DDT src into dst.
+ */
+static void
+zdb_ddt_merge(avl_tree_t *dst, avl_tree_t *src)
+{
+	void *cookie = NULL;
+	zdb_ddt_entry_t *zdde, *found;
+	avl_index_t where;
+
+	while ((zdde = avl_destroy_nodes(src, &cookie)) != NULL) {
+		found = avl_find(dst, zdde, &where);
+		if (found == NULL) {
+			avl_insert(dst, zdde, where);
+			continue;
+		}
+
+		found->zdde_ref_blocks += zdde->zdde_ref_blocks;
+		found->zdde_ref_lsize += zdde->zdde_ref_lsize;
+		found->zdde_ref_psize += zdde->zdde_ref_psize;
+		found->zdde_ref_dsize += zdde->zdde_ref_dsize;
+		umem_free(zdde, sizeof (*zdde));
+	}
+	avl_destroy(src);
+}
+
+/*
+ * The number of independent subsamples the confidence interval of a
+ * sampled dedup ratio is computed from, and the matching two sided 95%
+ * quantile of Student's t distribution (15 degrees of freedom).
+ */
+#define	ZDB_DDT_SAMPLE_BUCKETS	16
+#define	ZDB_DDT_SAMPLE_T95	2.131
+
 static void
 dump_simulated_ddt(spa_t *spa)
 {
@@ -7568,14 +8083,42 @@ dump_simulated_ddt(spa_t *spa)
 	zdb_ddt_entry_t *zdde;
 	ddt_histogram_t ddh_total = {{{0}}};
 	ddt_stat_t dds_total = {0};
+	double bucket_dsize[ZDB_DDT_SAMPLE_BUCKETS] = {0};
+	double bucket_ref_dsize[ZDB_DDT_SAMPLE_BUCKETS] = {0};
+	int flags = TRAVERSE_PRE | TRAVERSE_PREFETCH_METADATA |
+	    TRAVERSE_NO_DECRYPT;
+	int n = zdb_traverse_threads;
 
 	avl_create(&t, ddt_key_compare,
 	    sizeof (zdb_ddt_entry_t), offsetof(zdb_ddt_entry_t, zdde_node));
 
 	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
 
-	(void) traverse_pool(spa, 0, TRAVERSE_PRE | TRAVERSE_PREFETCH_METADATA |
-	    TRAVERSE_NO_DECRYPT, zdb_ddt_add_cb, &t);
+	if (n <= 1) {
+		(void) traverse_pool(spa, 0, flags, zdb_ddt_add_cb, &t);
+	} else {
+		/* Each thread builds its own tree, merged afterwards */
+		avl_tree_t *wt = umem_alloc(n * sizeof (avl_tree_t),
+		    UMEM_NOFAIL);
+		avl_tree_t **wargs = umem_alloc(n * sizeof (avl_tree_t *),
+		    UMEM_NOFAIL);
+
+		for (int w = 0; w < n; w++) {
+			avl_create(&wt[w], ddt_key_compare,
+			    sizeof (zdb_ddt_entry_t),
+			    offsetof(zdb_ddt_entry_t, zdde_node));
+			wargs[w] = &wt[w];
+		}
+
+		(void) zdb_traverse_parallel(spa, flags, zdb_ddt_add_cb, &t,
+		    (void **)wargs, n);
+
+		for (int w = 0; w < n; w++)
+			zdb_ddt_merge(&t, &wt[w]);
+
+		umem_free(wargs, n * sizeof (avl_tree_t *));
+		umem_free(wt, n * sizeof (avl_tree_t));
+	}
 
 	spa_config_exit(spa, SCL_CONFIG, FTAG);
 
@@ -7595,18 +8138,81 @@ dump_simulated_ddt(spa_t *spa)
 		dds->dds_ref_psize += zdde->zdde_ref_psize;
 		dds->dds_ref_dsize += zdde->zdde_ref_dsize;
 
+		if (zdb_ddt_sample_shift != 0) {
+			int b = zdb_ddt_key_hash(&zdde->zdde_key) &
+			    (ZDB_DDT_SAMPLE_BUCKETS - 1);
+
+			bucket_dsize[b] += zdde->zdde_ref_dsize / refcnt;
+			bucket_ref_dsize[b] += zdde->zdde_ref_dsize;
+		}
+
 		umem_free(zdde, sizeof (*zdde));
 	}
 
 	avl_destroy(&t);
 
+	/* Scale the sampled histogram up to an estimate for the pool */
+	if (zdb_ddt_sample_shift != 0) {
+		for (int h = 0; h < 64; h++) {
+			ddt_stat_t *dds = &ddh_total.ddh_stat[h];
+
+			dds->dds_blocks <<= zdb_ddt_sample_shift;
+			dds->dds_lsize <<= zdb_ddt_sample_shift;
+			dds->dds_psize <<= zdb_ddt_sample_shift;
+			dds->dds_dsize <<= zdb_ddt_sample_shift;
+			dds->dds_ref_blocks <<= zdb_ddt_sample_shift;
+			dds->dds_ref_lsize <<= zdb_ddt_sample_shift;
+			dds->dds_ref_psize <<= zdb_ddt_sample_shift;
+			dds->dds_ref_dsize <<= zdb_ddt_sample_shift;
+		}
+	}
+
 	ddt_histogram_total(&dds_total, &ddh_total);
 
-	(void) printf("Simulated DDT histogram:\n");
+	if (zdb_ddt_sample_shift != 0) {
+		(void) printf("Simulated DDT histogram (estimated from 1 in "
+		    "%llu unique blocks):\n",
+		    (u_longlong_t)1ULL << zdb_ddt_sample_shift);
+	} else {
+		(void) printf("Simulated DDT histogram:\n");
+	}
 
 	zpool_dump_ddt(&dds_total, &ddh_total);
 
 	dump_dedup_ratio(&dds_total);
+
+	if (zdb_ddt_sample_shift != 0 && dds_total.dds_dsize != 0) {
+		/*
+		 * Every bucket is an independent hash sample of the pool
+		 * itself, so the spread of the per bucket ratios gives the
+		 * standard error of the overall estimate.
+		 */
+		double dedup = (double)dds_total.dds_ref_dsize /
+		    (double)dds_total.dds_dsize;
+		double sum = 0, sumsq = 0, se;
+		int nb = 0;
+
+		for (int b = 0; b < ZDB_DDT_SAMPLE_BUCKETS; b++) {
+			if (bucket_dsize[b] == 0)
+				continue;
+			double r = bucket_ref_dsize[b] / bucket_dsize[b];
+			sum += r;
+			sumsq += r * r;
+			nb++;
+		}
+
+		if (nb > 1) {
+			double var = (sumsq - sum * sum / nb) / (nb - 1);
+			se = sqrt(MAX(var, 0) / nb);
+			(void) printf("dedup 95%% confidence interval = "
+			    "[%.2f, %.2f]\n\n",
+			    MAX(dedup - ZDB_DDT_SAMPLE_T95 * se, 1.0),
+			    dedup + ZDB_DDT_SAMPLE_T95 * se);
+		} else {
+			(void) printf("too few sampled blocks for a "
+			    "confidence interval\n\n");
+		}
+	}
 }
 
 static int
@@ -8285,6 +8891,7 @@ dump_mos_leaks(spa_t *spa)
 	mos_obj_refd(spa->spa_dsl_pool->dp_bptree_obj);
 	mos_obj_refd(spa->spa_dsl_pool->dp_tmp_userrefs_obj);
 	mos_obj_refd(spa->spa_dsl_pool->dp_scan->scn_phys.scn_queue_obj);
+	mos_obj_refd(spa->spa_dsl_pool->dp_scan->scn_spill_obj);
 	bpobj_count_refd(&spa->spa_deferred_bpobj);
 	mos_obj_refd(dp->dp_empty_bpobj);
 	bpobj_count_refd(&dp->dp_obsolete_bpobj);
@@ -8345,9 +8952,11 @@ dump_mos_leaks(spa_t *spa)
 			}
 		}
 
-		/* FDT container */
-		if (ddt->ddt_version == DDT_VERSION_FDT)
+		/* FDT container and membership filter */
+		if (ddt->ddt_version == DDT_VERSION_FDT) {
 			mos_obj_refd(ddt->ddt_dir_object);
+			mos_obj_refd(ddt_filter_object(ddt));
+		}
 
 		/* FDT log objects */
 		if (ddt->ddt_flags & DDT_FLAG_LOG) {
@@ -8511,6 +9120,8 @@ dump_zpool(spa_t *spa)
 		dump_log_spacemaps(spa);
 		dump_log_spacemap_obsolete_stats(spa);
 	}
+	if (dump_opt['j'])
+		dump_spacemap_compaction(spa);
 
 	if (dump_opt['d'] || dump_opt['i']) {
 		spa_feature_t f;
@@ -9346,8 +9957,10 @@ main(int argc, char **argv)
 		{"automatic-rewind",	no_argument,		NULL, 'F'},
 		{"dump-debug-msg",	no_argument,		NULL, 'G'},
 		{"history",		no_argument,		NULL, 'h'},
+		{"dedup-sample",	required_argument,	NULL, 'H'},
 		{"intent-logs",		no_argument,		NULL, 'i'},
 		{"inflight",		required_argument,	NULL, 'I'},
+		{"spacemap-compaction",	no_argument,		NULL, 'j'},
 		{"checkpointed-state",	no_argument,		NULL, 'k'},
 		{"key",			required_argument,	NULL, 'K'},
 		{"label",		no_argument,		NULL, 'l'},
@@ -9370,6 +9983,7 @@ main(int argc, char **argv)
 		{"cachefile",		required_argument,	NULL, 'U'},
 		{"verbose",		no_argument,		NULL, 'v'},
 		{"verbatim",		no_argument,		NULL, 'V'},
+		{"threads",		required_argument,	NULL, 'W'},
 		{"dump-blocks",		required_argument,	NULL, 'x'},
 		{"extreme-rewind",	no_argument,		NULL, 'X'},
 		{"all-reconstruction",	no_argument,		NULL, 'Y'},
@@ -9379,7 +9993,7 @@ main(int argc, char **argv)
 	};
 
 	while ((c = getopt_long(argc, argv,
-	    "AbBcCdDeEFGhiI:kK:lLmMNo:Op:PqrRsSt:TuU:vVx:XYyZ",
+	    "AbBcCdDeEFGhH:iI:jkK:lLmMNo:Op:PqrRsSt:TuU:vVW:x:XYyZ",
 	    long_options, NULL)) != -1) {
 		switch (c) {
 		case 'b':
@@ -9392,6 +10006,7 @@ main(int argc, char **argv)
 		case 'G':
 		case 'h':
 		case 'i':
+		case 'j':
 		case 'l':
 		case 'm':
 		case 'M':
@@ -9423,6 +10038,14 @@ main(int argc, char **argv)
 			zfs_deadman_enabled = 0;
 			break;
 		/* NB: Sort single match options below. */
+		case 'H':
+			zdb_ddt_sample_shift = strtoul(optarg, NULL, 0);
+			if (zdb_ddt_sample_shift > 32) {
+				(void) fprintf(stderr, "dedup sample shift "
+				    "must be at most 32\n");
+				usage();
+			}
+			break;
 		case 'I':
 			max_inflight_bytes = strtoull(optarg, NULL, 0);
 			if (max_inflight_bytes == 0) {
@@ -9484,6 +10107,14 @@ main(int argc, char **argv)
 		case 'V':
 			flags = ZFS_IMPORT_VERBATIM;
 			break;
+		case 'W':
+			zdb_traverse_threads = strtoul(optarg, NULL, 0);
+			if (zdb_traverse_threads == 0) {
+				(void) fprintf(stderr, "number of threads "
+				    "must be greater than 0\n");
+				usage();
+			}
+			break;
 		case 'x':
 			vn_dumpdir = optarg;
 			break;
@@ -9533,7 +10164,7 @@ main(int argc, char **argv)
 		verbose = MAX(verbose, 1);
 
 	for (c = 0; c < 256; c++) {
-		if (dump_all && strchr("ABeEFkKlLNOPrRSXy", c) == NULL)
+		if (dump_all && strchr("ABeEFjkKlLNOPrRSXy", c) == NULL)
 			dump_opt[c] = 1;
 		if (dump_opt[c])
 			dump_opt[c] += verbose;
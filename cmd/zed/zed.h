@@ -26,6 +26,12 @@
  */
 #define	ZED_STATE_FILE		RUNSTATEDIR "/zed.state"
 
+/*
+ * Maximum number of zevents processed before the state file is synced while
+ * more zevents are still queued.
+ */
+#define	ZED_STATE_BATCH		64
+
 /*
  * Absolute path for the default zed zedlet directory.
  */
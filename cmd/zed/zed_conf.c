@@ -719,3 +719,18 @@ zed_conf_write_state(struct zed_conf *zcp, uint64_t eid, int64_t etime[])
 	}
 	return (0);
 }
+
+/*
+ * Write the eid and time of the last zevent processed to the state file,
+ * if they have not been written yet.
+ * Return 0 on success, or -1 on error.
+ */
+int
+zed_conf_flush_state(struct zed_conf *zcp)
+{
+	if (zcp->state_pending == 0)
+		return (0);
+
+	zcp->state_pending = 0;
+	return (zed_conf_write_state(zcp, zcp->state_eid, zcp->state_etime));
+}
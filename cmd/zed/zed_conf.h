@@ -32,6 +32,9 @@ struct zed_conf {
 	int		pid_fd;			/* fd to pid file for lock */
 	int		state_fd;		/* fd to state file */
 	int		zevent_fd;		/* fd for access to zevents */
+	int		state_pending;		/* zevents not in state file */
+	uint64_t	state_eid;		/* last zevent processed */
+	int64_t		state_etime[2];		/* time of state_eid */
 
 	int16_t max_jobs;		/* max zedlets to run at one time */
 	int32_t max_zevent_buf_len;	/* max size of kernel event list */
@@ -56,5 +59,6 @@ int zed_conf_write_pid(struct zed_conf *zcp);
 int zed_conf_open_state(struct zed_conf *zcp);
 int zed_conf_read_state(struct zed_conf *zcp, uint64_t *eidp, int64_t etime[]);
 int zed_conf_write_state(struct zed_conf *zcp, uint64_t eid, int64_t etime[]);
+int zed_conf_flush_state(struct zed_conf *zcp);
 
 #endif	/* !ZED_CONF_H */
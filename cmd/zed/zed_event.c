@@ -89,6 +89,8 @@ zed_event_fini(struct zed_conf *zcp)
 	if (!zcp)
 		zed_log_die("Failed zed_event_fini: %s", strerror(EINVAL));
 
+	(void) zed_conf_flush_state(zcp);
+
 	zed_disk_event_fini();
 	zfs_agent_fini();
 
@@ -966,8 +968,21 @@ zed_event_service(struct zed_conf *zcp)
 		    strerror(errno));
 		return (EINVAL);
 	}
-	rv = zpool_events_next(zcp->zfs_hdl, &nvl, &n_dropped, ZEVENT_NONE,
+	/*
+	 * Rather than syncing the state file after every zevent, which
+	 * limits how fast a burst of zevents can be drained, it is written
+	 * once no more zevents are queued, or every ZED_STATE_BATCH zevents.
+	 * A zevent processed since then may be processed again should the
+	 * daemon be killed.
+	 */
+	rv = zpool_events_next(zcp->zfs_hdl, &nvl, &n_dropped,
+	    (zcp->state_pending > 0) ? ZEVENT_NONBLOCK : ZEVENT_NONE,
 	    zcp->zevent_fd);
+	if (rv == 0 && !nvl && zcp->state_pending > 0) {
+		(void) zed_conf_flush_state(zcp);
+		rv = zpool_events_next(zcp->zfs_hdl, &nvl, &n_dropped,
+		    ZEVENT_NONE, zcp->zevent_fd);
+	}
 
 	if ((rv != 0) || !nvl)
 		return (errno);
@@ -1025,7 +1040,11 @@ zed_event_service(struct zed_conf *zcp)
 
 		zed_exec_process(eid, class, subclass, zcp, zsp);
 
-		zed_conf_write_state(zcp, eid, etime);
+		zcp->state_eid = eid;
+		zcp->state_etime[0] = etime[0];
+		zcp->state_etime[1] = etime[1];
+		if (++zcp->state_pending >= ZED_STATE_BATCH)
+			(void) zed_conf_flush_state(zcp);
 
 		zed_strings_destroy(zsp);
 	}
@@ -29,10 +29,13 @@
 
 #include <libintl.h>
 #include <libuutil.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread_pool.h>
+#include <unistd.h>
 
 #include <libzfs.h>
 
@@ -47,6 +50,10 @@
  * AVL tree.  We report errors for any explicitly specified datasets
  * that we couldn't open.
  *
+ * When recursing, the children of each filesystem are listed by a separate
+ * task on a thread pool, so that independent subtrees are walked in parallel.
+ * The AVL tree keeps the final ordering the same as a serial walk.
+ *
  * When finished, we have an AVL tree of ZFS handles.  We go through and execute
  * the provided callback for each one, passing whatever data the user supplied.
  */
@@ -63,10 +70,27 @@ typedef struct callback_data {
 	zfs_sort_column_t	*cb_sortcol;
 	zprop_list_t		**cb_proplist;
 	int			cb_depth_limit;
-	int			cb_depth;
 	uint8_t			cb_props_table[ZFS_NUM_PROPS];
+	tpool_t			*cb_tpool;
+	pthread_mutex_t		cb_lock;	/* protects cb_avl */
 } callback_data_t;
 
+/*
+ * Argument to zfs_callback() for the datasets found at a given depth.
+ */
+typedef struct callback_arg {
+	callback_data_t		*ca_cb;
+	int			ca_depth;
+} callback_arg_t;
+
+typedef struct callback_task {
+	zfs_handle_t		*ct_zhp;
+	callback_arg_t		ct_arg;		/* for zhp's children */
+	boolean_t		ct_snaps;
+	boolean_t		ct_bmarks;
+	boolean_t		ct_close;
+} callback_task_t;
+
 uu_avl_pool_t *avl_pool;
 
 /*
@@ -85,6 +109,55 @@ zfs_include_snapshots(zfs_handle_t *zhp, callback_data_t *cb)
 	return (zpool_get_prop_int(zph, ZPOOL_PROP_LISTSNAPS, NULL));
 }
 
+static int zfs_callback(zfs_handle_t *, void *);
+
+/*
+ * Iterate over the children of zhp, which are at depth ca->ca_depth.
+ */
+static void
+zfs_callback_children(zfs_handle_t *zhp, callback_arg_t *ca,
+    boolean_t include_snaps, boolean_t include_bmarks)
+{
+	callback_data_t *cb = ca->ca_cb;
+
+	/*
+	 * If we are not looking for filesystems, we don't need to
+	 * recurse into filesystems when we are at our depth limit.
+	 */
+	if ((ca->ca_depth < cb->cb_depth_limit ||
+	    (cb->cb_flags & ZFS_ITER_DEPTH_LIMIT) == 0 ||
+	    (cb->cb_types &
+	    (ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME))) &&
+	    zfs_get_type(zhp) == ZFS_TYPE_FILESYSTEM) {
+		(void) zfs_iter_filesystems_v2(zhp, cb->cb_flags,
+		    zfs_callback, ca);
+	}
+
+	if (((zfs_get_type(zhp) & (ZFS_TYPE_SNAPSHOT |
+	    ZFS_TYPE_BOOKMARK)) == 0) && include_snaps) {
+		(void) zfs_iter_snapshots_v2(zhp, cb->cb_flags,
+		    zfs_callback, ca, 0, 0);
+	}
+
+	if (((zfs_get_type(zhp) & (ZFS_TYPE_SNAPSHOT |
+	    ZFS_TYPE_BOOKMARK)) == 0) && include_bmarks) {
+		(void) zfs_iter_bookmarks_v2(zhp, cb->cb_flags,
+		    zfs_callback, ca);
+	}
+}
+
+static void
+zfs_callback_task(void *arg)
+{
+	callback_task_t *ct = arg;
+
+	zfs_callback_children(ct->ct_zhp, &ct->ct_arg, ct->ct_snaps,
+	    ct->ct_bmarks);
+	if (ct->ct_close)
+		zfs_close(ct->ct_zhp);
+	free(ct);
+}
+
 /*
  * Called for each dataset.  If the object is of an appropriate type,
  * add it to the avl tree and recurse over any children as necessary.
@@ -92,11 +165,19 @@ zfs_include_snapshots(zfs_handle_t *zhp, callback_data_t *cb)
 static int
 zfs_callback(zfs_handle_t *zhp, void *data)
 {
-	callback_data_t *cb = data;
+	callback_arg_t *ca = data;
+	callback_data_t *cb = ca->ca_cb;
 	boolean_t should_close = B_TRUE;
-	boolean_t include_snaps = zfs_include_snapshots(zhp, cb);
+	boolean_t include_snaps;
 	boolean_t include_bmarks = (cb->cb_types & ZFS_TYPE_BOOKMARK);
 
+	/*
+	 * The pool handle, the proplist and the tree are shared by all of
+	 * the iteration tasks.
+	 */
+	pthread_mutex_lock(&cb->cb_lock);
+	include_snaps = zfs_include_snapshots(zhp, cb);
+
 	if ((zfs_get_type(zhp) & cb->cb_types) ||
 	    ((zfs_get_type(zhp) == ZFS_TYPE_SNAPSHOT) && include_snaps)) {
 		uu_avl_index_t idx;
@@ -116,6 +197,7 @@ zfs_callback(zfs_handle_t *zhp, void *data)
 				    (cb->cb_flags & ZFS_ITER_RECVD_PROPS),
 				    (cb->cb_flags & ZFS_ITER_LITERAL_PROPS))
 				    != 0) {
+					pthread_mutex_unlock(&cb->cb_lock);
 					free(node);
 					return (-1);
 				}
@@ -126,41 +208,36 @@ zfs_callback(zfs_handle_t *zhp, void *data)
 			free(node);
 		}
 	}
+	pthread_mutex_unlock(&cb->cb_lock);
 
 	/*
-	 * Recurse if necessary.
+	 * Recurse if necessary.  Snapshots and bookmarks have no children.
 	 */
 	if (cb->cb_flags & ZFS_ITER_RECURSE &&
 	    ((cb->cb_flags & ZFS_ITER_DEPTH_LIMIT) == 0 ||
-	    cb->cb_depth < cb->cb_depth_limit)) {
-		cb->cb_depth++;
-
-		/*
-		 * If we are not looking for filesystems, we don't need to
-		 * recurse into filesystems when we are at our depth limit.
-		 */
-		if ((cb->cb_depth < cb->cb_depth_limit ||
-		    (cb->cb_flags & ZFS_ITER_DEPTH_LIMIT) == 0 ||
-		    (cb->cb_types &
-		    (ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME))) &&
-		    zfs_get_type(zhp) == ZFS_TYPE_FILESYSTEM) {
-			(void) zfs_iter_filesystems_v2(zhp, cb->cb_flags,
-			    zfs_callback, data);
+	    ca->ca_depth < cb->cb_depth_limit) &&
+	    (zfs_get_type(zhp) & (ZFS_TYPE_SNAPSHOT | ZFS_TYPE_BOOKMARK)) == 0) {
+		if (cb->cb_tpool != NULL) {
+			callback_task_t *ct = safe_malloc(sizeof (*ct));
+
+			ct->ct_zhp = zhp;
+			ct->ct_arg.ca_cb = cb;
+			ct->ct_arg.ca_depth = ca->ca_depth + 1;
+			ct->ct_snaps = include_snaps;
+			ct->ct_bmarks = include_bmarks;
+			ct->ct_close = should_close;
+			if (tpool_dispatch(cb->cb_tpool, zfs_callback_task,
+			    ct) == 0)
+				return (0);
+			free(ct);
 		}
 
-		if (((zfs_get_type(zhp) & (ZFS_TYPE_SNAPSHOT |
-		    ZFS_TYPE_BOOKMARK)) == 0) && include_snaps) {
-			(void) zfs_iter_snapshots_v2(zhp, cb->cb_flags,
-			    zfs_callback, data, 0, 0);
-		}
-
-		if (((zfs_get_type(zhp) & (ZFS_TYPE_SNAPSHOT |
-		    ZFS_TYPE_BOOKMARK)) == 0) && include_bmarks) {
-			(void) zfs_iter_bookmarks_v2(zhp, cb->cb_flags,
-			    zfs_callback, data);
-		}
-
-		cb->cb_depth--;
+		callback_arg_t child = {
+			.ca_cb = cb,
+			.ca_depth = ca->ca_depth + 1,
+		};
+		zfs_callback_children(zhp, &child, include_snaps,
+		    include_bmarks);
 	}
 
 	if (should_close)
@@ -436,6 +513,7 @@ zfs_for_each(int argc, char **argv, int flags, zfs_type_t types,
     zfs_iter_f callback, void *data)
 {
 	callback_data_t cb = {0};
+	callback_arg_t ca = { .ca_cb = &cb, .ca_depth = 0 };
 	int ret = 0;
 	zfs_node_t *node;
 	uu_avl_walk_t *walk;
@@ -491,13 +569,25 @@ zfs_for_each(int argc, char **argv, int flags, zfs_type_t types,
 
 	if ((cb.cb_avl = uu_avl_create(avl_pool, NULL, UU_DEFAULT)) == NULL)
 		nomem();
+	pthread_mutex_init(&cb.cb_lock, NULL);
+
+	/*
+	 * Walk the children of different datasets in parallel when recursing.
+	 * The ZFS_SERIAL_ITER environment variable is an undocumented variable
+	 * that can be used to compare against a serial walk.
+	 */
+	if ((argc == 0 || (flags & ZFS_ITER_RECURSE)) &&
+	    getenv("ZFS_SERIAL_ITER") == NULL) {
+		cb.cb_tpool = tpool_create(1,
+		    2 * sysconf(_SC_NPROCESSORS_ONLN), 0, NULL);
+	}
 
 	if (argc == 0) {
 		/*
 		 * If given no arguments, iterate over all datasets.
 		 */
 		cb.cb_flags |= ZFS_ITER_RECURSE;
-		ret = zfs_iter_root(g_zfs, zfs_callback, &cb);
+		ret = zfs_iter_root(g_zfs, zfs_callback, &ca);
 	} else {
 		zfs_handle_t *zhp = NULL;
 		zfs_type_t argtype = types;
@@ -521,12 +611,18 @@ zfs_for_each(int argc, char **argv, int flags, zfs_type_t types,
 				zhp = zfs_open(g_zfs, argv[i], argtype);
 			}
 			if (zhp != NULL)
-				ret |= zfs_callback(zhp, &cb);
+				ret |= zfs_callback(zhp, &ca);
 			else
 				ret = 1;
 		}
 	}
 
+	if (cb.cb_tpool != NULL) {
+		tpool_wait(cb.cb_tpool);
+		tpool_destroy(cb.cb_tpool);
+	}
+	pthread_mutex_destroy(&cb.cb_lock);
+
 	/*
 	 * At this point we've got our AVL tree full of zfs handles, so iterate
 	 * over each one and execute the real user callback.
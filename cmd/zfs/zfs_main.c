@@ -68,6 +68,7 @@
 #include <sys/types.h>
 #include <time.h>
 #include <sys/zfs_project.h>
+#include <thread_pool.h>
 
 #include <libzfs.h>
 #include <libzfs_core.h>
@@ -138,7 +139,8 @@ static int zfs_do_unzone(int argc, char **argv);
 static int zfs_do_help(int argc, char **argv);
 
 enum zfs_options {
-	ZFS_OPTION_JSON_NUMS_AS_INT = 1024
+	ZFS_OPTION_JSON_NUMS_AS_INT = 1024,
+	ZFS_OPTION_SEND_PART
 };
 
 /*
@@ -353,7 +355,9 @@ get_usage(zfs_help_t idx)
 		    "\tsend [-DnPpVvLec] [-i bookmark|snapshot] "
 		    "--redact <bookmark> <snapshot>\n"
 		    "\tsend [-nVvPe] -t <receive_resume_token>\n"
-		    "\tsend [-PnVv] --saved filesystem\n"));
+		    "\tsend [-PnVv] --saved filesystem\n"
+		    "\tsend [-nVvPLecw] [-i snapshot|bookmark] "
+		    "--part <part>/<parts> <snapshot>\n"));
 	case HELP_SET:
 		return (gettext("\tset [-u] <property=value> ... "
 		    "<filesystem|volume|snapshot> ...\n"));
@@ -440,8 +444,9 @@ get_usage(zfs_help_t idx)
 		return (gettext("\tredact <snapshot> <bookmark> "
 		    "<redaction_snapshot> ...\n"));
 	case HELP_REWRITE:
-		return (gettext("\trewrite [-Prvx] [-o <offset>] [-l <length>] "
-		    "<directory|file ...>\n"));
+		return (gettext("\trewrite [-HPrvx] [-b <rate>] [-j <jobs>] "
+		    "[-o <offset>] [-l <length>]\n"
+		    "\t    <directory|file ...>\n"));
 	case HELP_JAIL:
 		return (gettext("\tjail <jailid|jailname> <filesystem>\n"));
 	case HELP_UNJAIL:
@@ -4756,6 +4761,8 @@ zfs_do_send(int argc, char **argv)
 		{"holds",	no_argument,		NULL, 'h'},
 		{"saved",	no_argument,		NULL, 'S'},
 		{"exclude",	required_argument,	NULL, 'X'},
+		{"part",	required_argument,	NULL,
+		    ZFS_OPTION_SEND_PART},
 		{0, 0, 0, 0}
 	};
 
@@ -4763,6 +4770,23 @@ zfs_do_send(int argc, char **argv)
 	while ((c = getopt_long(argc, argv, ":i:I:RsDpVvnPLeht:cwbd:SX:",
 	    long_options, NULL)) != -1) {
 		switch (c) {
+		case ZFS_OPTION_SEND_PART: {
+			char *end;
+			unsigned long part = strtoul(optarg, &end, 10);
+			unsigned long nparts = 0;
+			if (*end == '/')
+				nparts = strtoul(end + 1, &end, 10);
+			if (*end != '\0' || part < 1 || part > nparts ||
+			    nparts > INT_MAX) {
+				(void) fprintf(stderr, gettext("invalid part "
+				    "'%s', must be <part>/<parts>\n"), optarg);
+				free(excludes.list);
+				usage(B_FALSE);
+			}
+			flags.part = part - 1;
+			flags.nparts = nparts;
+			break;
+		}
 		case 'X':
 			for (char *ds; (ds = strsep(&optarg, ",")) != NULL; ) {
 				if (!zfs_name_valid(ds, ZFS_TYPE_DATASET) ||
@@ -4904,7 +4928,7 @@ zfs_do_send(int argc, char **argv)
 
 	if (resume_token != NULL) {
 		if (fromname != NULL || flags.replicate || flags.props ||
-		    flags.backup || flags.holds ||
+		    flags.backup || flags.holds || flags.nparts != 0 ||
 		    flags.saved || redactbook != NULL) {
 			free(excludes.list);
 			(void) fprintf(stderr,
@@ -4934,7 +4958,8 @@ zfs_do_send(int argc, char **argv)
 		if (fromname != NULL || flags.replicate || flags.props ||
 		    flags.doall || flags.backup ||
 		    flags.holds || flags.largeblock || flags.embed_data ||
-		    flags.compress || flags.raw || redactbook != NULL) {
+		    flags.compress || flags.raw || flags.nparts != 0 ||
+		    redactbook != NULL) {
 			free(excludes.list);
 
 			(void) fprintf(stderr, gettext("incompatible flags "
@@ -4992,6 +5017,15 @@ zfs_do_send(int argc, char **argv)
 		usage(B_FALSE);
 	}
 
+	if (flags.nparts != 0 && (flags.replicate || flags.doall ||
+	    flags.props || flags.backup || flags.holds ||
+	    strchr(argv[0], '@') == NULL)) {
+		free(excludes.list);
+		(void) fprintf(stderr, gettext("--part can only be used to "
+		    "send a single snapshot, without -R, -I, -p, -b or -h\n"));
+		usage(B_FALSE);
+	}
+
 	/*
 	 * For everything except -R and -I, use the new, cleaner code path.
 	 */
@@ -7579,17 +7613,20 @@ share_mount(int op, int argc, char **argv)
 		share_mount_state.sm_total = cb.cb_used;
 		pthread_mutex_init(&share_mount_state.sm_lock, NULL);
 
-		/* For a 'zfs share -a' operation start with a clean slate. */
-		if (op == OP_SHARE)
+		/*
+		 * For a 'zfs share -a' operation start with a clean slate, and
+		 * collect the shares to commit them all at once.
+		 */
+		if (op == OP_SHARE) {
 			zfs_truncate_shares(NULL);
+			zfs_begin_shares(NULL);
+		}
 
 		/*
-		 * libshare isn't mt-safe, so only do the operation in parallel
-		 * if we're mounting. Additionally, the key-loading option must
-		 * be serialized so that we can prompt the user for their keys
-		 * in a consistent manner.
+		 * The key-loading option must be serialized so that we can
+		 * prompt the user for their keys in a consistent manner.
 		 */
-		nthr = op == OP_MOUNT && !(flags & MS_CRYPT) ? mount_nthr : 1;
+		nthr = !(flags & MS_CRYPT) ? mount_nthr : 1;
 		zfs_foreach_mountpoint(g_zfs, cb.cb_handles, cb.cb_used,
 		    share_mount_one_cb, &share_mount_state, nthr);
 		zfs_commit_shares(NULL);
@@ -9043,8 +9080,35 @@ zfs_do_project(int argc, char **argv)
 	return (ret);
 }
 
+/*
+ * Files larger than this are split into ranges of this size, which are
+ * rewritten in parallel when running more than one job.
+ */
+#define	REWRITE_JOB_SIZE	(1ULL << 30)
+
+typedef struct rewrite_cbdata {
+	zfs_rewrite_args_t	rc_args;
+	boolean_t		rc_verbose;
+	tpool_t			*rc_tpool;
+	pthread_mutex_t		rc_lock;	/* protects the below */
+	int			rc_err;
+} rewrite_cbdata_t;
+
+typedef struct rewrite_file {
+	rewrite_cbdata_t	*rf_cb;
+	char			*rf_path;
+	uint_t			rf_pending;	/* ranges not done yet */
+	int			rf_err;
+} rewrite_file_t;
+
+typedef struct rewrite_job {
+	rewrite_file_t		*rj_file;
+	uint64_t		rj_off;
+	uint64_t		rj_len;
+} rewrite_job_t;
+
 static int
-zfs_rewrite_file(const char *path, boolean_t verbose, zfs_rewrite_args_t *args)
+zfs_rewrite_range(const char *path, zfs_rewrite_args_t *args)
 {
 	int fd, ret = 0;
 
@@ -9060,17 +9124,113 @@ zfs_rewrite_file(const char *path, boolean_t verbose, zfs_rewrite_args_t *args)
 		ret = errno;
 		(void) fprintf(stderr, gettext("failed to rewrite %s: %s\n"),
 		    path, strerror(errno));
-	} else if (verbose) {
-		printf("%s\n", path);
 	}
 
 	close(fd);
 	return (ret);
 }
 
+/*
+ * Account for the completion of one range of the file, and report the
+ * file once all of them are done.
+ */
+static void
+zfs_rewrite_file_done(rewrite_file_t *rf, int err)
+{
+	rewrite_cbdata_t *cb = rf->rf_cb;
+
+	pthread_mutex_lock(&cb->rc_lock);
+	if (err)
+		rf->rf_err = err;
+	boolean_t done = (--rf->rf_pending == 0);
+	if (done) {
+		if (rf->rf_err)
+			cb->rc_err = rf->rf_err;
+		else if (cb->rc_verbose)
+			printf("%s\n", rf->rf_path);
+	}
+	pthread_mutex_unlock(&cb->rc_lock);
+
+	if (done) {
+		free(rf->rf_path);
+		free(rf);
+	}
+}
+
+static void
+zfs_rewrite_job(void *arg)
+{
+	rewrite_job_t *rj = arg;
+	rewrite_file_t *rf = rj->rj_file;
+	zfs_rewrite_args_t args = rf->rf_cb->rc_args;
+
+	args.off = rj->rj_off;
+	args.len = rj->rj_len;
+	free(rj);
+
+	zfs_rewrite_file_done(rf, zfs_rewrite_range(rf->rf_path, &args));
+}
+
+/*
+ * Rewrite the file or, when running jobs, queue it for rewrite in ranges
+ * of at most REWRITE_JOB_SIZE.  Errors of queued rewrites are collected
+ * in rc_err as they complete.
+ */
+static int
+zfs_rewrite_file(const char *path, rewrite_cbdata_t *cb)
+{
+	int ret;
+
+	if (cb->rc_tpool == NULL) {
+		ret = zfs_rewrite_range(path, &cb->rc_args);
+		if (ret == 0 && cb->rc_verbose)
+			printf("%s\n", path);
+		return (ret);
+	}
+
+	struct stat st;
+	uint64_t size = (stat(path, &st) == 0) ? st.st_size : 0;
+	uint64_t off = cb->rc_args.off;
+	uint64_t len = cb->rc_args.len;
+
+	/*
+	 * Hold an extra pending count while dispatching, so the file is not
+	 * freed by ranges completing before the last one is queued.
+	 */
+	rewrite_file_t *rf = safe_malloc(sizeof (rewrite_file_t));
+	rf->rf_cb = cb;
+	rf->rf_path = safe_strdup(path);
+	rf->rf_pending = 1;
+	rf->rf_err = 0;
+
+	boolean_t last;
+	do {
+		rewrite_job_t *rj = safe_malloc(sizeof (rewrite_job_t));
+
+		last = (off >= size || size - off <= REWRITE_JOB_SIZE ||
+		    (len != 0 && len <= REWRITE_JOB_SIZE));
+		rj->rj_file = rf;
+		rj->rj_off = off;
+		rj->rj_len = last ? len : REWRITE_JOB_SIZE;
+		if (!last) {
+			off += REWRITE_JOB_SIZE;
+			if (len != 0)
+				len -= REWRITE_JOB_SIZE;
+		}
+
+		pthread_mutex_lock(&cb->rc_lock);
+		rf->rf_pending++;
+		pthread_mutex_unlock(&cb->rc_lock);
+		VERIFY0(tpool_dispatch(cb->rc_tpool, zfs_rewrite_job, rj));
+	} while (!last);
+
+	zfs_rewrite_file_done(rf, 0);
+	return (0);
+}
+
 static int
-zfs_rewrite_dir(const char *path, boolean_t verbose, boolean_t xdev, dev_t dev,
-    zfs_rewrite_args_t *args, nvlist_t *dirs)
+zfs_rewrite_dir(const char *path, boolean_t xdev, dev_t dev,
+    rewrite_cbdata_t *cb, nvlist_t *dirs)
 {
 	struct dirent *ent;
 	DIR *dir;
@@ -9128,7 +9288,7 @@ zfs_rewrite_dir(const char *path, boolean_t verbose, boolean_t xdev, dev_t dev,
 		}
 
 		if (ent->d_type == DT_REG) {
-			err = zfs_rewrite_file(fullname, verbose, args);
+			err = zfs_rewrite_file(fullname, cb);
 			if (err)
 				ret = err;
 		} else { /* DT_DIR */
@@ -9143,8 +9303,8 @@ zfs_rewrite_dir(const char *path, boolean_t verbose, boolean_t xdev, dev_t dev,
 }
 
 static int
-zfs_rewrite_path(const char *path, boolean_t verbose, boolean_t recurse,
-    boolean_t xdev, zfs_rewrite_args_t *args, nvlist_t *dirs)
+zfs_rewrite_path(const char *path, boolean_t recurse, boolean_t xdev,
+    rewrite_cbdata_t *cb, nvlist_t *dirs)
 {
 	struct stat st;
 	int ret = 0;
@@ -9157,10 +9317,9 @@ zfs_rewrite_path(const char *path, boolean_t verbose, boolean_t recurse,
 	}
 
 	if (S_ISREG(st.st_mode)) {
-		ret = zfs_rewrite_file(path, verbose, args);
+		ret = zfs_rewrite_file(path, cb);
 	} else if (S_ISDIR(st.st_mode) && recurse) {
-		ret = zfs_rewrite_dir(path, verbose, xdev, st.st_dev, args,
-		    dirs);
+		ret = zfs_rewrite_dir(path, xdev, st.st_dev, cb, dirs);
 	}
 	return (ret);
 }
@@ -9169,30 +9328,54 @@ static int
 zfs_do_rewrite(int argc, char **argv)
 {
 	int ret = 0, err, c;
-	boolean_t recurse = B_FALSE, verbose = B_FALSE, xdev = B_FALSE;
+	boolean_t recurse = B_FALSE, xdev = B_FALSE;
+	uint_t jobs = 1;
+	char *endp;
 
 	if (argc < 2)
 		usage(B_FALSE);
 
-	zfs_rewrite_args_t args;
-	memset(&args, 0, sizeof (args));
+	rewrite_cbdata_t cb;
+	memset(&cb, 0, sizeof (cb));
+	zfs_rewrite_args_t *args = &cb.rc_args;
 
-	while ((c = getopt(argc, argv, "Pl:o:rvx")) != -1) {
+	while ((c = getopt(argc, argv, "HPb:j:l:o:rvx")) != -1) {
 		switch (c) {
+		case 'H':
+			args->flags |= ZFS_REWRITE_HOT;
+			break;
+		case 'b':
+			if (zfs_nicestrtonum(g_zfs, optarg, &args->arg) != 0) {
+				(void) fprintf(stderr, gettext("bad rate '%s': "
+				    "%s\n"), optarg,
+				    libzfs_error_description(g_zfs));
+				usage(B_FALSE);
+			}
+			break;
+		case 'j':
+			errno = 0;
+			jobs = strtoul(optarg, &endp, 0);
+			if (errno != 0 || *endp != '\0' || jobs == 0) {
+				(void) fprintf(stderr,
+				    gettext("invalid number of jobs '%s'\n"),
+				    optarg);
+				usage(B_FALSE);
+			}
+			break;
 		case 'P':
-			args.flags |= ZFS_REWRITE_PHYSICAL;
+			args->flags |= ZFS_REWRITE_PHYSICAL;
 			break;
 		case 'l':
-			args.len = strtoll(optarg, NULL, 0);
+			args->len = strtoll(optarg, NULL, 0);
 			break;
 		case 'o':
-			args.off = strtoll(optarg, NULL, 0);
+			args->off = strtoll(optarg, NULL, 0);
 			break;
 		case 'r':
 			recurse = B_TRUE;
 			break;
 		case 'v':
-			verbose = B_TRUE;
+			cb.rc_verbose = B_TRUE;
 			break;
 		case 'x':
 			xdev = B_TRUE;
@@ -9212,23 +9395,43 @@ zfs_do_rewrite(int argc, char **argv)
 		usage(B_FALSE);
 	}
 
+	/*
+	 * Each job has at most one rewrite in flight, so share the rate
+	 * evenly between them.
+	 */
+	if (jobs > 1) {
+		cb.rc_tpool = tpool_create(1, jobs, 0, NULL);
+		if (cb.rc_tpool == NULL)
+			nomem();
+		VERIFY0(pthread_mutex_init(&cb.rc_lock, NULL));
+		if (args->arg != 0)
+			args->arg = MAX(args->arg / jobs, 1);
+	}
+
 	nvlist_t *dirs = fnvlist_alloc();
 	for (int i = 0; i < argc; i++) {
-		err = zfs_rewrite_path(argv[i], verbose, recurse, xdev, &args,
-		    dirs);
+		err = zfs_rewrite_path(argv[i], recurse, xdev, &cb, dirs);
 		if (err)
 			ret = err;
 	}
 	nvpair_t *dir;
 	while ((dir = nvlist_next_nvpair(dirs, NULL)) != NULL) {
-		err = zfs_rewrite_dir(nvpair_name(dir), verbose, xdev,
-		    fnvpair_value_uint64(dir), &args, dirs);
+		err = zfs_rewrite_dir(nvpair_name(dir), xdev,
+		    fnvpair_value_uint64(dir), &cb, dirs);
 		if (err)
 			ret = err;
 		fnvlist_remove_nvpair(dirs, dir);
 	}
 	fnvlist_free(dirs);
 
+	if (cb.rc_tpool != NULL) {
+		tpool_wait(cb.rc_tpool);
+		tpool_destroy(cb.rc_tpool);
+		VERIFY0(pthread_mutex_destroy(&cb.rc_lock));
+		if (cb.rc_err)
+			ret = cb.rc_err;
+	}
+
 	return (ret);
 }
 
@@ -215,6 +215,7 @@ enum iostat_type {
 	IOS_QUEUES = 2,
 	IOS_L_HISTO = 3,
 	IOS_RQ_HISTO = 4,
+	IOS_S_HISTO = 5,
 	IOS_COUNT,	/* always last element */
 };
 
@@ -224,9 +225,10 @@ enum iostat_type {
 #define	IOS_QUEUES_M	(1ULL << IOS_QUEUES)
 #define	IOS_L_HISTO_M	(1ULL << IOS_L_HISTO)
 #define	IOS_RQ_HISTO_M	(1ULL << IOS_RQ_HISTO)
+#define	IOS_S_HISTO_M	(1ULL << IOS_S_HISTO)
 
 /* Mask of all the histo bits */
-#define	IOS_ANYHISTO_M (IOS_L_HISTO_M | IOS_RQ_HISTO_M)
+#define	IOS_ANYHISTO_M (IOS_L_HISTO_M | IOS_RQ_HISTO_M | IOS_S_HISTO_M)
 
 /*
  * Lookup table for iostat flags to nvlist names.  Basically a list
@@ -263,6 +265,13 @@ static const char *vsx_type_to_nvlist[IOS_COUNT][15] = {
 	    ZPOOL_CONFIG_VDEV_SCRUB_ACTIVE_QUEUE,
 	    ZPOOL_CONFIG_VDEV_TRIM_ACTIVE_QUEUE,
 	    ZPOOL_CONFIG_VDEV_REBUILD_ACTIVE_QUEUE,
+	    ZPOOL_CONFIG_VDEV_SYNC_R_MAX_ACTIVE,
+	    ZPOOL_CONFIG_VDEV_SYNC_W_MAX_ACTIVE,
+	    ZPOOL_CONFIG_VDEV_ASYNC_R_MAX_ACTIVE,
+	    ZPOOL_CONFIG_VDEV_ASYNC_W_MAX_ACTIVE,
+	    ZPOOL_CONFIG_VDEV_SCRUB_MAX_ACTIVE,
+	    ZPOOL_CONFIG_VDEV_TRIM_MAX_ACTIVE,
+	    ZPOOL_CONFIG_VDEV_REBUILD_MAX_ACTIVE,
 	    NULL},
 	[IOS_RQ_HISTO] = {
 	    ZPOOL_CONFIG_VDEV_SYNC_IND_R_HISTO,
@@ -280,6 +289,15 @@ static const char *vsx_type_to_nvlist[IOS_COUNT][15] = {
 	    ZPOOL_CONFIG_VDEV_IND_REBUILD_HISTO,
 	    ZPOOL_CONFIG_VDEV_AGG_REBUILD_HISTO,
 	    NULL},
+	[IOS_S_HISTO] = {
+	    ZPOOL_CONFIG_VDEV_COMPRESS_STAGE_HISTO,
+	    ZPOOL_CONFIG_VDEV_CKSUM_GEN_STAGE_HISTO,
+	    ZPOOL_CONFIG_VDEV_ALLOC_STAGE_HISTO,
+	    ZPOOL_CONFIG_VDEV_QUEUE_STAGE_HISTO,
+	    ZPOOL_CONFIG_VDEV_DISK_STAGE_HISTO,
+	    ZPOOL_CONFIG_VDEV_CKSUM_VERIFY_STAGE_HISTO,
+	    ZPOOL_CONFIG_VDEV_DECOMPRESS_STAGE_HISTO,
+	    NULL},
 };
 
 static const char *pool_scan_func_str[] = {
@@ -484,7 +502,7 @@ get_usage(zpool_help_t idx)
 		    "\t    [--rewind-to-checkpoint] <pool | id> [newpool]\n"));
 	case HELP_IOSTAT:
 		return (gettext("\tiostat [[[-c [script1,script2,...]"
-		    "[-lq]]|[-rw]] [-T d | u] [-ghHLpPvy]\n"
+		    "[-lq]]|[-rsw]] [-T d | u] [-ghHLpPvy]\n"
 		    "\t    [[pool ...]|[pool vdev ...]|[vdev ...]]"
 		    " [[-n] interval [count]]\n"));
 	case HELP_LABELCLEAR:
@@ -514,7 +532,8 @@ get_usage(zpool_help_t idx)
 		    "[<device> ...]>\n"));
 	case HELP_SCRUB:
 		return (gettext("\tscrub [-e | -s | -p | -C | -E | -S] [-w] "
-		    "<-a | <pool> [<pool> ...]>\n"));
+		    "[-B <rate>] [-L <latency>]\n"
+		    "\t    <-a | <pool> [<pool> ...]>\n"));
 	case HELP_RESILVER:
 		return (gettext("\tresilver <pool> ...\n"));
 	case HELP_TRIM:
@@ -4711,7 +4730,7 @@ typedef struct name_and_columns {
 	unsigned int columns;	/* Center name to this number of columns */
 } name_and_columns_t;
 
-#define	IOSTAT_MAX_LABELS	15	/* Max number of labels on one line */
+#define	IOSTAT_MAX_LABELS	22	/* Max number of labels on one line */
 
 static const name_and_columns_t iostat_top_labels[][IOSTAT_MAX_LABELS] =
 {
@@ -4720,14 +4739,15 @@ static const name_and_columns_t iostat_top_labels[][IOSTAT_MAX_LABELS] =
 	[IOS_LATENCY] = {{"total_wait", 2}, {"disk_wait", 2}, {"syncq_wait", 2},
 	    {"asyncq_wait", 2}, {"scrub", 1}, {"trim", 1}, {"rebuild", 1},
 	    {NULL}},
-	[IOS_QUEUES] = {{"syncq_read", 2}, {"syncq_write", 2},
-	    {"asyncq_read", 2}, {"asyncq_write", 2}, {"scrubq_read", 2},
-	    {"trimq_write", 2}, {"rebuildq_write", 2}, {NULL}},
+	[IOS_QUEUES] = {{"syncq_read", 3}, {"syncq_write", 3},
+	    {"asyncq_read", 3}, {"asyncq_write", 3}, {"scrubq_read", 3},
+	    {"trimq_write", 3}, {"rebuildq_write", 3}, {NULL}},
 	[IOS_L_HISTO] = {{"total_wait", 2}, {"disk_wait", 2}, {"syncq_wait", 2},
 	    {"asyncq_wait", 2}, {NULL}},
 	[IOS_RQ_HISTO] = {{"sync_read", 2}, {"sync_write", 2},
 	    {"async_read", 2}, {"async_write", 2}, {"scrub", 2},
 	    {"trim", 2}, {"rebuild", 2}, {NULL}},
+	[IOS_S_HISTO] = {{"write", 3}, {"vdev", 2}, {"read", 2}, {NULL}},
 };
 
 /* Shorthand - if "columns" field not set, default to 1 column */
@@ -4738,20 +4758,24 @@ static const name_and_columns_t iostat_bottom_labels[][IOSTAT_MAX_LABELS] =
 	[IOS_LATENCY] = {{"read"}, {"write"}, {"read"}, {"write"}, {"read"},
 	    {"write"}, {"read"}, {"write"}, {"wait"}, {"wait"}, {"wait"},
 	    {NULL}},
-	[IOS_QUEUES] = {{"pend"}, {"activ"}, {"pend"}, {"activ"}, {"pend"},
-	    {"activ"}, {"pend"}, {"activ"}, {"pend"}, {"activ"},
-	    {"pend"}, {"activ"}, {"pend"}, {"activ"}, {NULL}},
+	[IOS_QUEUES] = {{"pend"}, {"activ"}, {"max"}, {"pend"}, {"activ"},
+	    {"max"}, {"pend"}, {"activ"}, {"max"}, {"pend"}, {"activ"},
+	    {"max"}, {"pend"}, {"activ"}, {"max"}, {"pend"}, {"activ"},
+	    {"max"}, {"pend"}, {"activ"}, {"max"}, {NULL}},
 	[IOS_L_HISTO] = {{"read"}, {"write"}, {"read"}, {"write"}, {"read"},
 	    {"write"}, {"read"}, {"write"}, {"scrub"}, {"trim"}, {"rebuild"},
 	    {NULL}},
 	[IOS_RQ_HISTO] = {{"ind"}, {"agg"}, {"ind"}, {"agg"}, {"ind"}, {"agg"},
 	    {"ind"}, {"agg"}, {"ind"}, {"agg"}, {"ind"}, {"agg"},
 	    {"ind"}, {"agg"}, {NULL}},
+	[IOS_S_HISTO] = {{"comp"}, {"cksum"}, {"alloc"}, {"queue"}, {"disk"},
+	    {"cksum"}, {"dcomp"}, {NULL}},
 };
 
 static const char *histo_to_title[] = {
 	[IOS_L_HISTO] = "latency",
 	[IOS_RQ_HISTO] = "req_size",
+	[IOS_S_HISTO] = "stage",
 };
 
 /*
@@ -4807,6 +4831,7 @@ default_column_width(iostat_cbdata_t *cb, enum iostat_type type)
 		[IOS_QUEUES] = 6,   /* 1M queue entries */
 		[IOS_L_HISTO] = 10, /* 1B ns = 10sec */
 		[IOS_RQ_HISTO] = 6, /* 1M queue entries */
+		[IOS_S_HISTO] = 10, /* 1B ns = 10sec */
 	};
 
 	if (cb->cb_literal)
@@ -5275,7 +5300,7 @@ print_iostat_histo(struct stat_array *nva, unsigned int len,
 
 	for (j = start_bucket; j < buckets; j++) {
 		/* Print histogram bucket label */
-		if (cb->cb_flags & IOS_L_HISTO_M) {
+		if (cb->cb_flags & (IOS_L_HISTO_M | IOS_S_HISTO_M)) {
 			/* Ending range of this bucket */
 			val = (1UL << (j + 1)) - 1;
 			zfs_nicetime(val, buf, sizeof (buf));
@@ -5400,18 +5425,25 @@ print_iostat_queues(iostat_cbdata_t *cb, nvlist_t *newnv)
 	const char *names[] = {
 		ZPOOL_CONFIG_VDEV_SYNC_R_PEND_QUEUE,
 		ZPOOL_CONFIG_VDEV_SYNC_R_ACTIVE_QUEUE,
+		ZPOOL_CONFIG_VDEV_SYNC_R_MAX_ACTIVE,
 		ZPOOL_CONFIG_VDEV_SYNC_W_PEND_QUEUE,
 		ZPOOL_CONFIG_VDEV_SYNC_W_ACTIVE_QUEUE,
+		ZPOOL_CONFIG_VDEV_SYNC_W_MAX_ACTIVE,
 		ZPOOL_CONFIG_VDEV_ASYNC_R_PEND_QUEUE,
 		ZPOOL_CONFIG_VDEV_ASYNC_R_ACTIVE_QUEUE,
+		ZPOOL_CONFIG_VDEV_ASYNC_R_MAX_ACTIVE,
 		ZPOOL_CONFIG_VDEV_ASYNC_W_PEND_QUEUE,
 		ZPOOL_CONFIG_VDEV_ASYNC_W_ACTIVE_QUEUE,
+		ZPOOL_CONFIG_VDEV_ASYNC_W_MAX_ACTIVE,
 		ZPOOL_CONFIG_VDEV_SCRUB_PEND_QUEUE,
 		ZPOOL_CONFIG_VDEV_SCRUB_ACTIVE_QUEUE,
+		ZPOOL_CONFIG_VDEV_SCRUB_MAX_ACTIVE,
 		ZPOOL_CONFIG_VDEV_TRIM_PEND_QUEUE,
 		ZPOOL_CONFIG_VDEV_TRIM_ACTIVE_QUEUE,
+		ZPOOL_CONFIG_VDEV_TRIM_MAX_ACTIVE,
 		ZPOOL_CONFIG_VDEV_REBUILD_PEND_QUEUE,
 		ZPOOL_CONFIG_VDEV_REBUILD_ACTIVE_QUEUE,
+		ZPOOL_CONFIG_VDEV_REBUILD_MAX_ACTIVE,
 	};
 
 	struct stat_array *nva;
@@ -6336,7 +6368,7 @@ get_namewidth_iostat(zpool_handle_t *zhp, void *data)
 }
 
 /*
- * zpool iostat [[-c [script1,script2,...]] [-lq]|[-rw]] [-ghHLpPvy] [-n name]
+ * zpool iostat [[-c [script1,script2,...]] [-lq]|[-rsw]] [-ghHLpPvy] [-n name]
  *              [-T d|u] [[ pool ...]|[pool vdev ...]|[vdev ...]]
  *              [interval [count]]
  *
@@ -6353,6 +6385,7 @@ get_namewidth_iostat(zpool_handle_t *zhp, void *data)
  *	-q	Display queue depths
  *	-w	Display latency histograms
  *	-r	Display request size histogram
+ *	-s	Display zio pipeline stage histograms
  *	-T	Display a timestamp in date(1) or Unix format
  *	-n	Only print headers once
  *
@@ -6373,6 +6406,7 @@ zpool_do_iostat(int argc, char **argv)
 	zpool_list_t *list;
 	boolean_t verbose = B_FALSE;
 	boolean_t latency = B_FALSE, l_histo = B_FALSE, rq_histo = B_FALSE;
+	boolean_t s_histo = B_FALSE;
 	boolean_t queues = B_FALSE, parsable = B_FALSE, scripted = B_FALSE;
 	boolean_t omit_since_boot = B_FALSE;
 	boolean_t guid = B_FALSE;
@@ -6384,12 +6418,12 @@ zpool_do_iostat(int argc, char **argv)
 
 	/* Used for printing error message */
 	const char flag_to_arg[] = {[IOS_LATENCY] = 'l', [IOS_QUEUES] = 'q',
-	    [IOS_L_HISTO] = 'w', [IOS_RQ_HISTO] = 'r'};
+	    [IOS_L_HISTO] = 'w', [IOS_RQ_HISTO] = 'r', [IOS_S_HISTO] = 's'};
 
 	uint64_t unsupported_flags;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "c:gLPT:vyhplqrwnH")) != -1) {
+	while ((c = getopt(argc, argv, "c:gLPT:vyhplqrswnH")) != -1) {
 		switch (c) {
 		case 'c':
 			if (cmd != NULL) {
@@ -6449,6 +6483,9 @@ zpool_do_iostat(int argc, char **argv)
 		case 'r':
 			rq_histo = B_TRUE;
 			break;
+		case 's':
+			s_histo = B_TRUE;
+			break;
 		case 'y':
 			omit_since_boot = B_TRUE;
 			break;
@@ -6558,18 +6595,19 @@ zpool_do_iostat(int argc, char **argv)
 		return (1);
 	}
 
-	if ((l_histo || rq_histo) && (cmd != NULL || latency || queues)) {
+	if ((l_histo || rq_histo || s_histo) &&
+	    (cmd != NULL || latency || queues)) {
 		pool_list_free(list);
 		(void) fprintf(stderr,
-		    gettext("[-r|-w] isn't allowed with [-c|-l|-q]\n"));
+		    gettext("[-r|-s|-w] isn't allowed with [-c|-l|-q]\n"));
 		usage(B_FALSE);
 		return (1);
 	}
 
-	if (l_histo && rq_histo) {
+	if (l_histo + rq_histo + s_histo > 1) {
 		pool_list_free(list);
 		(void) fprintf(stderr,
-		    gettext("Only one of [-r|-w] can be passed at a time\n"));
+		    gettext("Only one of [-r|-s|-w] can be passed at a time\n"));
 		usage(B_FALSE);
 		return (1);
 	}
@@ -6588,6 +6626,8 @@ zpool_do_iostat(int argc, char **argv)
 		cb.cb_flags = IOS_L_HISTO_M;
 	} else if (rq_histo) {
 		cb.cb_flags = IOS_RQ_HISTO_M;
+	} else if (s_histo) {
+		cb.cb_flags = IOS_S_HISTO_M;
 	} else {
 		cb.cb_flags = IOS_DEFAULT_M;
 		if (latency)
@@ -8362,6 +8402,8 @@ typedef struct scrub_cbdata {
 	pool_scrub_cmd_t cb_scrub_cmd;
 	time_t	cb_date_start;
 	time_t	cb_date_end;
+	uint64_t cb_rate;
+	uint64_t cb_latency;
 } scrub_cbdata_t;
 
 static boolean_t
@@ -8390,6 +8432,25 @@ zpool_has_checkpoint(zpool_handle_t *zhp)
 	return (B_FALSE);
 }
 
+static boolean_t
+zpool_is_scanning(zpool_handle_t *zhp)
+{
+	nvlist_t *config, *nvroot;
+	pool_scan_stat_t *ps = NULL;
+	uint_t c;
+
+	config = zpool_get_config(zhp, NULL);
+	if (config == NULL)
+		return (B_FALSE);
+
+	nvroot = fnvlist_lookup_nvlist(config, ZPOOL_CONFIG_VDEV_TREE);
+	(void) nvlist_lookup_uint64_array(nvroot,
+	    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&ps, &c);
+
+	return (ps != NULL && ps->pss_state == DSS_SCANNING &&
+	    ps->pss_pass_scrub_pause == 0);
+}
+
 static int
 scrub_callback(zpool_handle_t *zhp, void *data)
 {
@@ -8405,6 +8466,17 @@ scrub_callback(zpool_handle_t *zhp, void *data)
 		return (1);
 	}
 
+	/*
+	 * Apply new scan throttle limits first. If a scan is already
+	 * running, that is all there is to do.
+	 */
+	if (cb->cb_rate != UINT64_MAX || cb->cb_latency != UINT64_MAX) {
+		if (zpool_scan_throttle(zhp, cb->cb_rate, cb->cb_latency) != 0)
+			return (1);
+		if (zpool_is_scanning(zhp))
+			return (0);
+	}
+
 	err = zpool_scan_range(zhp, cb->cb_type, cb->cb_scrub_cmd,
 	    cb->cb_date_start, cb->cb_date_end);
 	if (err == 0 && zpool_has_checkpoint(zhp) &&
@@ -8447,9 +8519,14 @@ date_string_to_sec(const char *timestr, boolean_t rounding)
 }
 
 /*
- * zpool scrub [-e | -s | -p | -C | -E | -S] [-w] [-a | <pool> ...]
+ * zpool scrub [-e | -s | -p | -C | -E | -S] [-w] [-B <rate>] [-L <latency>]
+ *     [-a | <pool> ...]
  *
  *	-a	Scrub all pools.
+ *	-B	Limit scrubs and resilvers to this many bytes/s per top-level
+ *		vdev.
+ *	-L	Limit the latency scrubs and resilvers add to foreground reads
+ *		and writes to this many milliseconds.
  *	-e	Only scrub blocks in the error log.
  *	-E	End date of scrub.
  *	-S	Start date of scrub.
@@ -8469,6 +8546,7 @@ zpool_do_scrub(int argc, char **argv)
 	cb.cb_type = POOL_SCAN_SCRUB;
 	cb.cb_scrub_cmd = POOL_SCRUB_NORMAL;
 	cb.cb_date_start = cb.cb_date_end = 0;
+	cb.cb_rate = cb.cb_latency = UINT64_MAX;
 
 	boolean_t is_error_scrub = B_FALSE;
 	boolean_t is_pause = B_FALSE;
@@ -8477,11 +8555,41 @@ zpool_do_scrub(int argc, char **argv)
 	boolean_t scrub_all = B_FALSE;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "aspweCE:S:")) != -1) {
+	while ((c = getopt(argc, argv, "aspweB:CE:L:S:")) != -1) {
 		switch (c) {
 		case 'a':
 			scrub_all = B_TRUE;
 			break;
+		case 'B':
+			if (strcmp(optarg, "none") == 0) {
+				cb.cb_rate = 0;
+			} else if (zfs_nicestrtonum(g_zfs, optarg,
+			    &cb.cb_rate) == -1 || cb.cb_rate == UINT64_MAX) {
+				(void) fprintf(stderr, "%s: %s\n",
+				    gettext("invalid value for rate"),
+				    libzfs_error_description(g_zfs));
+				usage(B_FALSE);
+			}
+			break;
+		case 'L': {
+			char *end;
+			double ms;
+
+			if (strcmp(optarg, "none") == 0) {
+				cb.cb_latency = 0;
+				break;
+			}
+			errno = 0;
+			ms = strtod(optarg, &end);
+			if (errno != 0 || *end != '\0' || ms <= 0 ||
+			    ms * 1000 >= (double)UINT32_MAX) {
+				(void) fprintf(stderr, gettext("invalid value "
+				    "for latency: %s\n"), optarg);
+				usage(B_FALSE);
+			}
+			cb.cb_latency = MAX((uint64_t)(ms * 1000), 1);
+			break;
+		}
 		case 'e':
 			is_error_scrub = B_TRUE;
 			break;
@@ -8558,6 +8666,14 @@ zpool_do_scrub(int argc, char **argv)
 		usage(B_FALSE);
 	}
 
+	if ((cb.cb_rate != UINT64_MAX || cb.cb_latency != UINT64_MAX) &&
+	    (cb.cb_type != POOL_SCAN_SCRUB ||
+	    cb.cb_scrub_cmd == POOL_SCRUB_PAUSE)) {
+		(void) fprintf(stderr, gettext("invalid option combination: "
+		    "-B and -L cannot be used with -e, -p or -s\n"));
+		usage(B_FALSE);
+	}
+
 	if (wait && (cb.cb_type == POOL_SCAN_NONE ||
 	    cb.cb_scrub_cmd == POOL_SCRUB_PAUSE)) {
 		(void) fprintf(stderr, gettext("invalid option combination: "
@@ -8599,6 +8715,7 @@ zpool_do_resilver(int argc, char **argv)
 	cb.cb_type = POOL_SCAN_RESILVER;
 	cb.cb_scrub_cmd = POOL_SCRUB_NORMAL;
 	cb.cb_date_start = cb.cb_date_end = 0;
+	cb.cb_rate = cb.cb_latency = UINT64_MAX;
 
 	/* check options */
 	while ((c = getopt(argc, argv, "")) != -1) {
@@ -9014,6 +9131,85 @@ print_scan_scrub_resilver_status(pool_scan_stat_t *ps)
 	}
 }
 
+/*
+ * Print the metadata pass results of a metadata-first scrub. Older kernel
+ * modules don't report them, so check the size of the stats array first.
+ */
+static void
+print_scan_metadata_status(pool_scan_stat_t *ps, uint_t c)
+{
+	time_t start, end;
+	char examined_buf[7], time_buf[32];
+
+	if (c <= offsetof(pool_scan_stat_t, pss_meta_errors) / 8 ||
+	    ps->pss_func != POOL_SCAN_SCRUB ||
+	    ps->pss_state == DSS_CANCELED ||
+	    ps->pss_meta_phase == POOL_SCAN_META_NONE)
+		return;
+
+	if (ps->pss_meta_phase == POOL_SCAN_META_METADATA) {
+		(void) printf(gettext("	metadata pass in progress, "
+		    "data pass pending\n"));
+		return;
+	}
+
+	start = ps->pss_start_time;
+	end = ps->pss_meta_end_time;
+	secs_to_dhms(end - start, time_buf);
+	zfs_nicebytes(ps->pss_meta_examined, examined_buf,
+	    sizeof (examined_buf));
+
+	(void) printf(gettext("	metadata pass scanned %s in %s with %llu "
+	    "errors on %s"), examined_buf, time_buf,
+	    (u_longlong_t)ps->pss_meta_errors, ctime(&end));
+	if (ps->pss_state == DSS_SCANNING)
+		(void) printf(gettext("	data pass in progress\n"));
+}
+
+/*
+ * Note when a scrub only verifies blocks born after a given txg, as with
+ * "zpool scrub -C" or a start date.
+ */
+static void
+print_scan_range_status(pool_scan_stat_t *ps, uint_t c)
+{
+	if (c <= offsetof(pool_scan_stat_t, pss_max_txg) / 8 ||
+	    ps->pss_func != POOL_SCAN_SCRUB ||
+	    ps->pss_state == DSS_CANCELED || ps->pss_min_txg == 0)
+		return;
+
+	(void) printf(gettext("	incremental, only blocks born after "
+	    "txg %llu\n"), (u_longlong_t)ps->pss_min_txg);
+}
+
+/*
+ * Print the issue limits of an in-progress scrub or resilver, if the pool
+ * has any.
+ */
+static void
+print_scan_throttle_status(pool_scan_stat_t *ps, uint_t c)
+{
+	char rate_buf[7];
+
+	if (c <= offsetof(pool_scan_stat_t, pss_throttle_latency) / 8 ||
+	    ps->pss_state != DSS_SCANNING ||
+	    (ps->pss_throttle_rate == 0 && ps->pss_throttle_latency == 0))
+		return;
+
+	(void) printf(gettext("\tthrottled to"));
+	if (ps->pss_throttle_rate != 0) {
+		zfs_nicebytes(ps->pss_throttle_rate, rate_buf,
+		    sizeof (rate_buf));
+		(void) printf(gettext(" %s/s per vdev"), rate_buf);
+	}
+	if (ps->pss_throttle_latency != 0) {
+		(void) printf(gettext("%s %.3g ms added latency"),
+		    ps->pss_throttle_rate != 0 ? "," : "",
+		    (double)ps->pss_throttle_latency / 1000);
+	}
+	(void) printf("\n");
+}
+
 static void
 print_rebuild_status_impl(vdev_rebuild_stat_t *vrs, uint_t c, char *vdev_name)
 {
@@ -9930,6 +10126,37 @@ scan_status_nvlist(zpool_handle_t *zhp, status_cbdata_t *cb,
 			    ps->pss_pass_error_scrub_pause,
 			    B_TRUE, cb->cb_json_as_int, ZFS_NICENUM_1024);
 		}
+		if (c > offsetof(pool_scan_stat_t, pss_meta_errors) / 8 &&
+		    ps->pss_meta_phase != POOL_SCAN_META_NONE) {
+			fnvlist_add_string(scan, "metadata_pass",
+			    ps->pss_meta_phase == POOL_SCAN_META_METADATA ?
+			    "scanning" : "finished");
+			nice_num_str_nvlist(scan, "metadata_end_time",
+			    ps->pss_meta_end_time, cb->cb_literal,
+			    cb->cb_json_as_int, ZFS_NICE_TIMESTAMP);
+			nice_num_str_nvlist(scan, "metadata_examined",
+			    ps->pss_meta_examined, cb->cb_literal,
+			    cb->cb_json_as_int, ZFS_NICENUM_BYTES);
+			nice_num_str_nvlist(scan, "metadata_errors",
+			    ps->pss_meta_errors, cb->cb_literal,
+			    cb->cb_json_as_int, ZFS_NICENUM_1024);
+		}
+		if (c > offsetof(pool_scan_stat_t, pss_throttle_latency) / 8) {
+			nice_num_str_nvlist(scan, "throttle_rate",
+			    ps->pss_throttle_rate, cb->cb_literal,
+			    cb->cb_json_as_int, ZFS_NICENUM_BYTES);
+			nice_num_str_nvlist(scan, "throttle_latency_us",
+			    ps->pss_throttle_latency, B_TRUE,
+			    cb->cb_json_as_int, ZFS_NICENUM_1024);
+		}
+		if (c > offsetof(pool_scan_stat_t, pss_max_txg) / 8) {
+			nice_num_str_nvlist(scan, "min_txg",
+			    ps->pss_min_txg, B_TRUE,
+			    cb->cb_json_as_int, ZFS_NICENUM_1024);
+			nice_num_str_nvlist(scan, "max_txg",
+			    ps->pss_max_txg, B_TRUE,
+			    cb->cb_json_as_int, ZFS_NICENUM_1024);
+		}
 	}
 
 	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
@@ -10053,9 +10280,12 @@ print_scan_status(zpool_handle_t *zhp, nvlist_t *nvroot)
 	boolean_t have_rebuild = (active_rebuild || (rebuild_end_time > 0));
 
 	/* Always print the scrub status when available. */
-	if (have_scrub && scrub_start > errorscrub_start)
+	if (have_scrub && scrub_start > errorscrub_start) {
 		print_scan_scrub_resilver_status(ps);
-	else if (have_errorscrub && errorscrub_start >= scrub_start)
+		print_scan_range_status(ps, c);
+		print_scan_metadata_status(ps, c);
+		print_scan_throttle_status(ps, c);
+	} else if (have_errorscrub && errorscrub_start >= scrub_start)
 		print_err_scrub_status(ps);
 
 	/*
@@ -10065,6 +10295,7 @@ print_scan_status(zpool_handle_t *zhp, nvlist_t *nvroot)
 	if (active_resilver || (!active_rebuild && have_resilver &&
 	    resilver_end_time && resilver_end_time > rebuild_end_time)) {
 		print_scan_scrub_resilver_status(ps);
+		print_scan_throttle_status(ps, c);
 	} else if (active_rebuild || (!active_resilver && have_rebuild &&
 	    rebuild_end_time && rebuild_end_time > resilver_end_time)) {
 		print_rebuild_status(zhp, nvroot);
@@ -1,19 +1,25 @@
 // SPDX-License-Identifier: CDDL-1.0
 /*
  * Gather top-level ZFS pool and resilver/scan statistics and print using
- * influxdb line protocol
+ * influxdb line protocol or OpenMetrics text format
  * usage: [options] [pool_name]
  * where options are:
  *   --execd, -e           run in telegraf execd input plugin mode, [CR] on
  *                         stdin causes a sample to be printed and wait for
  *                         the next [CR]
+ *   --kstats, -k          also print ARC, ZIL and per-dataset kstats
+ *   --listen, -l [addr:]port
+ *                         run as a daemon serving the metrics over HTTP,
+ *                         each GET request causes a sample to be served
  *   --no-histograms, -n   don't print histogram data (reduces cardinality
  *                         if you don't care about histograms)
+ *   --openmetrics, -o     print in OpenMetrics text format
  *   --sum-histogram-buckets, -s sum histogram bucket values
  *
  * To integrate into telegraf use one of:
  * 1. the `inputs.execd` plugin with the `--execd` option
  * 2. the `inputs.exec` plugin to simply run with no options
+ * To integrate into prometheus, scrape `--openmetrics --listen` mode.
  *
  * NOTE: libzfs is an unstable interface. YMMV.
  *
@@ -67,11 +73,21 @@
  *
  * CDDL HEADER END
  */
+#include <ctype.h>
 #include <string.h>
 #include <getopt.h>
+#include <dirent.h>
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/kstat.h>
+#include <sys/time.h>
 #include <libzfs.h>
 
 #define	POOL_MEASUREMENT	"zpool_stats"
@@ -82,9 +98,20 @@
 #define	MIN_LAT_INDEX	10  /* minimum latency index 10 = 1024ns */
 #define	POOL_IO_SIZE_MEASUREMENT	"zpool_io_size"
 #define	MIN_SIZE_INDEX	9  /* minimum size index 9 = 512 bytes */
+#define	ZVOL_LATENCY_MEASUREMENT	"zvol_latency"
+#define	ZVOL_IO_SIZE_MEASUREMENT	"zvol_io_size"
+#define	ZVOL_HISTO_COLS	10
+#define	ARC_MEASUREMENT	"zfs_arc"
+#define	ZIL_MEASUREMENT	"zfs_zil"
+#define	DATASET_MEASUREMENT	"zfs_dataset"
+#define	ZFS_KSTAT_DIR	"/proc/spl/kstat/zfs"
+#define	KSTAT_MAX_ENTRIES	512
+#define	LABELS_LEN	(4 * MAXPATHLEN)
 
 /* global options */
 int execd_mode = 0;
+int kstat_stats = 0;
+int openmetrics = 0;
 int no_histograms = 0;
 int sum_histogram_buckets = 0;
 char metric_data_type = 'u';
@@ -92,6 +119,36 @@ uint64_t metric_value_mask = UINT64_MAX;
 uint64_t timestamp = 0;
 int complained_about_sync = 0;
 const char *tags = "";
+FILE *out;
+
+/* the measurement being printed */
+const char *cur_measurement;
+int cur_fields;
+
+/*
+ * OpenMetrics requires the samples of a metric family to be contiguous,
+ * but we walk the vdev tree printing all of the fields of a measurement at
+ * once.  Hence each family gets its own buffer, which are all printed at
+ * the end of the sample.
+ */
+typedef struct om_family {
+	char	omf_name[128];
+	const char	*omf_type;
+	char	*omf_buf;
+	size_t	omf_size;
+	FILE	*omf_fp;
+} om_family_t;
+
+om_family_t *om_families = NULL;
+int om_nfamilies = 0;
+int om_maxfamilies = 0;
+int om_last = 0;
+
+/* labels of the current measurement, without and with the "le" label */
+char om_labels[LABELS_LEN];
+char om_count_labels[LABELS_LEN];
+/* 0 if not a histogram, 1 for a bucket, 2 for the +Inf bucket */
+int om_histogram;
 
 typedef int (*stat_printer_f)(nvlist_t *, const char *, const char *);
 
@@ -128,16 +185,239 @@ escape_string(const char *s)
 	return (t);
 }
 
+/*
+ * find or create the OpenMetrics family of the given name
+ */
+static om_family_t *
+om_family(const char *name, const char *type)
+{
+	om_family_t *f;
+
+	if (om_last < om_nfamilies &&
+	    strcmp(om_families[om_last].omf_name, name) == 0)
+		return (&om_families[om_last]);
+	for (om_last = 0; om_last < om_nfamilies; om_last++) {
+		if (strcmp(om_families[om_last].omf_name, name) == 0)
+			return (&om_families[om_last]);
+	}
+
+	if (om_nfamilies == om_maxfamilies) {
+		om_maxfamilies = om_maxfamilies ? om_maxfamilies * 2 : 64;
+		om_families = realloc(om_families,
+		    om_maxfamilies * sizeof (om_family_t));
+		if (om_families == NULL) {
+			fprintf(stderr, "error: cannot allocate memory\n");
+			exit(1);
+		}
+	}
+	f = &om_families[om_nfamilies];
+	(void) strlcpy(f->omf_name, name, sizeof (f->omf_name));
+	f->omf_type = type;
+	f->omf_fp = open_memstream(&f->omf_buf, &f->omf_size);
+	if (f->omf_fp == NULL) {
+		fprintf(stderr, "error: cannot allocate memory\n");
+		exit(1);
+	}
+	om_last = om_nfamilies++;
+	return (f);
+}
+
+/*
+ * print all of the OpenMetrics families collected for this sample
+ */
+static void
+om_flush(void)
+{
+	for (int i = 0; i < om_nfamilies; i++) {
+		om_family_t *f = &om_families[i];
+
+		(void) fclose(f->omf_fp);
+		fprintf(out, "# TYPE %s %s\n", f->omf_name, f->omf_type);
+		(void) fwrite(f->omf_buf, 1, f->omf_size, out);
+		free(f->omf_buf);
+	}
+	om_nfamilies = 0;
+	om_last = 0;
+	fprintf(out, "# EOF\n");
+}
+
+/*
+ * metric and label names may only contain [a-zA-Z0-9_:]
+ */
+static void
+om_sanitize(char *s)
+{
+	for (; *s != '\0'; s++) {
+		if (!isalnum(*s) && *s != '_' && *s != ':')
+			*s = '_';
+	}
+}
+
+/*
+ * append key="value" to an OpenMetrics label set
+ */
+static void
+om_add_label(char *buf, const char *key, const char *val)
+{
+	size_t n = strlen(buf);
+
+	if (n + strlen(key) + 4 >= LABELS_LEN)
+		return;
+	n += snprintf(buf + n, LABELS_LEN - n, "%s%s=\"", n ? "," : "", key);
+	for (; *val != '\0' && n + 4 < LABELS_LEN; val++) {
+		if (*val == '\n') {
+			buf[n++] = '\\';
+			buf[n++] = 'n';
+			continue;
+		}
+		if (*val == '\\' || *val == '"')
+			buf[n++] = '\\';
+		buf[n++] = *val;
+	}
+	buf[n++] = '"';
+	buf[n] = '\0';
+}
+
+/*
+ * convert a set of influxdb tags into OpenMetrics labels.  An "le" tag
+ * marks the measurement as a histogram bucket, for which the +Inf bucket
+ * also provides the count, without the "le" label.
+ */
+static void
+om_set_labels(const char *s)
+{
+	char key[64], val[2 * MAXPATHLEN];
+	char labels[LABELS_LEN] = "", count_labels[LABELS_LEN] = "";
+
+	om_histogram = 0;
+	while (*s != '\0') {
+		size_t k = 0, v = 0;
+
+		for (; *s != '\0' && *s != '=' && *s != ','; s++) {
+			if (*s == '\\' && s[1] != '\0')
+				s++;
+			if (k < sizeof (key) - 1)
+				key[k++] = *s;
+		}
+		key[k] = '\0';
+		if (*s == '=')
+			s++;
+		for (; *s != '\0' && *s != ','; s++) {
+			if (*s == '\\' && s[1] != '\0')
+				s++;
+			if (v < sizeof (val) - 1)
+				val[v++] = *s;
+		}
+		val[v] = '\0';
+		if (*s == ',')
+			s++;
+		if (k == 0)
+			continue;
+
+		om_sanitize(key);
+		om_add_label(labels, key, val);
+		if (strcmp(key, "le") == 0)
+			om_histogram = (strcmp(val, "+Inf") == 0) ? 2 : 1;
+		else
+			om_add_label(count_labels, key, val);
+	}
+	(void) snprintf(om_labels, sizeof (om_labels),
+	    labels[0] ? "{%s}" : "%s", labels);
+	(void) snprintf(om_count_labels, sizeof (om_count_labels),
+	    count_labels[0] ? "{%s}" : "%s", count_labels);
+}
+
+/*
+ * print a sample of the current measurement.  Each field becomes its own
+ * metric family, as OpenMetrics has no notion of fields.
+ */
+static void
+om_sample(const char *key, const char *value)
+{
+	char name[128];
+	om_family_t *f;
+
+	(void) snprintf(name, sizeof (name), "%s_%s", cur_measurement, key);
+	om_sanitize(name);
+	f = om_family(name, om_histogram ? "histogram" : "gauge");
+	if (om_histogram == 0) {
+		fprintf(f->omf_fp, "%s%s %s\n", name, om_labels, value);
+		return;
+	}
+	fprintf(f->omf_fp, "%s_bucket%s %s\n", name, om_labels, value);
+	if (om_histogram == 2)
+		fprintf(f->omf_fp, "%s_count%s %s\n", name, om_count_labels,
+		    value);
+}
+
+/*
+ * start printing a measurement, with labels given as influxdb tags
+ */
+static void
+start_measurement(const char *measurement, const char *fmt, ...)
+{
+	char labels[LABELS_LEN] = "";
+	va_list ap;
+
+	if (fmt != NULL) {
+		va_start(ap, fmt);
+		(void) vsnprintf(labels, sizeof (labels), fmt, ap);
+		va_end(ap);
+	}
+	cur_measurement = measurement;
+	cur_fields = 0;
+
+	if (openmetrics) {
+		char all[2 * LABELS_LEN];
+
+		(void) snprintf(all, sizeof (all), "%s,%s", tags, labels);
+		om_set_labels(all);
+	} else {
+		fprintf(out, "%s%s%s%s ", measurement, tags,
+		    labels[0] ? "," : "", labels);
+	}
+}
+
+static void
+end_measurement(void)
+{
+	if (!openmetrics)
+		fprintf(out, " %llu\n", (u_longlong_t)timestamp);
+}
+
 /*
  * print key=value where value is a uint64_t
  */
 static void
 print_kv(const char *key, uint64_t value)
 {
-	printf("%s=%llu%c", key,
+	if (openmetrics) {
+		char buf[32];
+
+		(void) snprintf(buf, sizeof (buf), "%llu", (u_longlong_t)value);
+		om_sample(key, buf);
+		return;
+	}
+	fprintf(out, "%s%s=%llu%c", cur_fields++ ? "," : "", key,
 	    (u_longlong_t)value & metric_value_mask, metric_data_type);
 }
 
+/*
+ * print key=value where value is a double
+ */
+static void
+print_kv_double(const char *key, double value)
+{
+	if (openmetrics) {
+		char buf[32];
+
+		(void) snprintf(buf, sizeof (buf), "%.2f", value);
+		om_sample(key, buf);
+		return;
+	}
+	fprintf(out, "%s%s=%.2f", cur_fields++ ? "," : "", key, value);
+}
+
 /*
  * print_scan_status() prints the details as often seen in the "zpool status"
  * output. However, unlike the zpool command, which is intended for humans,
@@ -234,24 +514,24 @@ print_scan_status(nvlist_t *nvroot, const char *pool_name)
 	rate = rate ? rate : 1;
 
 	/* influxdb line protocol format: "tags metrics timestamp" */
-	printf("%s%s,function=%s,name=%s,state=%s ",
-	    SCAN_MEASUREMENT, tags, func, pool_name, state[ps->pss_state]);
+	start_measurement(SCAN_MEASUREMENT, "function=%s,name=%s,state=%s",
+	    func, pool_name, state[ps->pss_state]);
 	print_kv("end_ts", ps->pss_end_time);
-	print_kv(",errors", ps->pss_errors);
-	print_kv(",examined", examined);
-	print_kv(",skipped", ps->pss_skipped);
-	print_kv(",issued", ps->pss_issued);
-	print_kv(",pass_examined", pass_exam);
-	print_kv(",pass_issued", ps->pss_pass_issued);
-	print_kv(",paused_ts", paused_ts);
-	print_kv(",paused_t", paused_time);
-	printf(",pct_done=%.2f", pct_done);
-	print_kv(",processed", ps->pss_processed);
-	print_kv(",rate", rate);
-	print_kv(",remaining_t", remaining_time);
-	print_kv(",start_ts", ps->pss_start_time);
-	print_kv(",to_examine", ps->pss_to_examine);
-	printf(" %llu\n", (u_longlong_t)timestamp);
+	print_kv("errors", ps->pss_errors);
+	print_kv("examined", examined);
+	print_kv("skipped", ps->pss_skipped);
+	print_kv("issued", ps->pss_issued);
+	print_kv("pass_examined", pass_exam);
+	print_kv("pass_issued", ps->pss_pass_issued);
+	print_kv("paused_ts", paused_ts);
+	print_kv("paused_t", paused_time);
+	print_kv_double("pct_done", pct_done);
+	print_kv("processed", ps->pss_processed);
+	print_kv("rate", rate);
+	print_kv("remaining_t", remaining_time);
+	print_kv("start_ts", ps->pss_start_time);
+	print_kv("to_examine", ps->pss_to_examine);
+	end_measurement();
 	return (0);
 }
 
@@ -347,21 +627,21 @@ print_summary_stats(nvlist_t *nvroot, const char *pool_name,
 	    (uint64_t **)&vs, &c) != 0) {
 		return (1);
 	}
-	printf("%s%s,name=%s,state=%s,%s ", POOL_MEASUREMENT, tags,
+	start_measurement(POOL_MEASUREMENT, "name=%s,state=%s,%s",
 	    pool_name, zpool_state_to_name((vdev_state_t)vs->vs_state,
 	    (vdev_aux_t)vs->vs_aux), vdev_desc);
 	print_kv("alloc", vs->vs_alloc);
-	print_kv(",free", vs->vs_space - vs->vs_alloc);
-	print_kv(",size", vs->vs_space);
-	print_kv(",read_bytes", vs->vs_bytes[ZIO_TYPE_READ]);
-	print_kv(",read_errors", vs->vs_read_errors);
-	print_kv(",read_ops", vs->vs_ops[ZIO_TYPE_READ]);
-	print_kv(",write_bytes", vs->vs_bytes[ZIO_TYPE_WRITE]);
-	print_kv(",write_errors", vs->vs_write_errors);
-	print_kv(",write_ops", vs->vs_ops[ZIO_TYPE_WRITE]);
-	print_kv(",checksum_errors", vs->vs_checksum_errors);
-	print_kv(",fragmentation", vs->vs_fragmentation);
-	printf(" %llu\n", (u_longlong_t)timestamp);
+	print_kv("free", vs->vs_space - vs->vs_alloc);
+	print_kv("size", vs->vs_space);
+	print_kv("read_bytes", vs->vs_bytes[ZIO_TYPE_READ]);
+	print_kv("read_errors", vs->vs_read_errors);
+	print_kv("read_ops", vs->vs_ops[ZIO_TYPE_READ]);
+	print_kv("write_bytes", vs->vs_bytes[ZIO_TYPE_WRITE]);
+	print_kv("write_errors", vs->vs_write_errors);
+	print_kv("write_ops", vs->vs_ops[ZIO_TYPE_WRITE]);
+	print_kv("checksum_errors", vs->vs_checksum_errors);
+	print_kv("fragmentation", vs->vs_fragmentation);
+	end_measurement();
 	return (0);
 }
 
@@ -434,14 +714,13 @@ print_vdev_latency_stats(nvlist_t *nvroot, const char *pool_name,
 			continue;
 		}
 		if (bucket < end) {
-			printf("%s%s,le=%0.6f,name=%s,%s ",
-			    POOL_LATENCY_MEASUREMENT, tags,
+			start_measurement(POOL_LATENCY_MEASUREMENT,
+			    "le=%0.6f,name=%s,%s",
 			    (float)(1ULL << bucket) * 1e-9,
 			    pool_name, vdev_desc);
 		} else {
-			printf("%s%s,le=+Inf,name=%s,%s ",
-			    POOL_LATENCY_MEASUREMENT, tags, pool_name,
-			    vdev_desc);
+			start_measurement(POOL_LATENCY_MEASUREMENT,
+			    "le=+Inf,name=%s,%s", pool_name, vdev_desc);
 		}
 		for (int i = 0; lat_type[i].name; i++) {
 			if (bucket <= MIN_LAT_INDEX || sum_histogram_buckets) {
@@ -450,11 +729,8 @@ print_vdev_latency_stats(nvlist_t *nvroot, const char *pool_name,
 				lat_type[i].sum = lat_type[i].array[bucket];
 			}
 			print_kv(lat_type[i].short_name, lat_type[i].sum);
-			if (lat_type[i + 1].name != NULL) {
-				printf(",");
-			}
 		}
-		printf(" %llu\n", (u_longlong_t)timestamp);
+		end_measurement();
 	}
 	return (0);
 }
@@ -532,13 +808,12 @@ print_vdev_size_stats(nvlist_t *nvroot, const char *pool_name,
 		}
 
 		if (bucket < end) {
-			printf("%s%s,le=%llu,name=%s,%s ",
-			    POOL_IO_SIZE_MEASUREMENT, tags, 1ULL << bucket,
+			start_measurement(POOL_IO_SIZE_MEASUREMENT,
+			    "le=%llu,name=%s,%s", 1ULL << bucket,
 			    pool_name, vdev_desc);
 		} else {
-			printf("%s%s,le=+Inf,name=%s,%s ",
-			    POOL_IO_SIZE_MEASUREMENT, tags, pool_name,
-			    vdev_desc);
+			start_measurement(POOL_IO_SIZE_MEASUREMENT,
+			    "le=+Inf,name=%s,%s", pool_name, vdev_desc);
 		}
 		for (int i = 0; size_type[i].name; i++) {
 			if (bucket <= MIN_SIZE_INDEX || sum_histogram_buckets) {
@@ -547,11 +822,8 @@ print_vdev_size_stats(nvlist_t *nvroot, const char *pool_name,
 				size_type[i].sum = size_type[i].array[bucket];
 			}
 			print_kv(size_type[i].short_name, size_type[i].sum);
-			if (size_type[i + 1].name != NULL) {
-				printf(",");
-			}
 		}
-		printf(" %llu\n", (u_longlong_t)timestamp);
+		end_measurement();
 	}
 	return (0);
 }
@@ -595,7 +867,7 @@ print_queue_stats(nvlist_t *nvroot, const char *pool_name,
 		return (6);
 	}
 
-	printf("%s%s,name=%s,%s ", POOL_QUEUE_MEASUREMENT, tags, pool_name,
+	start_measurement(POOL_QUEUE_MEASUREMENT, "name=%s,%s", pool_name,
 	    get_vdev_desc(nvroot, parent_name));
 	for (int i = 0; queue_type[i].name; i++) {
 		if (nvlist_lookup_uint64(nv_ex,
@@ -605,11 +877,8 @@ print_queue_stats(nvlist_t *nvroot, const char *pool_name,
 			return (3);
 		}
 		print_kv(queue_type[i].short_name, value);
-		if (queue_type[i + 1].name != NULL) {
-			printf(",");
-		}
 	}
-	printf(" %llu\n", (u_longlong_t)timestamp);
+	end_measurement();
 	return (0);
 }
 
@@ -648,8 +917,7 @@ print_top_level_vdev_stats(nvlist_t *nvroot, const char *pool_name)
 		return (6);
 	}
 
-	printf("%s%s,name=%s,vdev=root ", VDEV_MEASUREMENT, tags,
-	    pool_name);
+	start_measurement(VDEV_MEASUREMENT, "name=%s,vdev=root", pool_name);
 	for (int i = 0; queue_type[i].name; i++) {
 		if (nvlist_lookup_uint64(nv_ex,
 		    queue_type[i].name, &value) != 0) {
@@ -657,12 +925,9 @@ print_top_level_vdev_stats(nvlist_t *nvroot, const char *pool_name)
 			    queue_type[i].name);
 			return (3);
 		}
-		if (i > 0)
-			printf(",");
 		print_kv(queue_type[i].short_name, value);
 	}
-
-	printf(" %llu\n", (u_longlong_t)timestamp);
+	end_measurement();
 	return (0);
 }
 
@@ -697,6 +962,233 @@ print_recursive_stats(stat_printer_f func, nvlist_t *nvroot,
 	return (0);
 }
 
+/*
+ * Print one of the histograms of a zvol io_histo kstat, made up of columns
+ * [first, first + ncols) of its rows.  As for the vdev histograms, the
+ * buckets below min_index are folded into the first one printed.
+ */
+static void
+print_zvol_histo(uint64_t histo[][ZVOL_HISTO_COLS], int rows,
+    const char *measurement, const char *const *names, int first, int ncols,
+    int min_index, boolean_t seconds, const char *pool_name,
+    const char *ds_name)
+{
+	uint64_t sum[ZVOL_HISTO_COLS] = { 0 };
+
+	for (int bucket = 0; bucket < rows; bucket++) {
+		for (int i = 0; i < ncols; i++) {
+			if (bucket <= min_index || sum_histogram_buckets)
+				sum[i] += histo[bucket][first + i];
+			else
+				sum[i] = histo[bucket][first + i];
+		}
+		if (bucket < min_index)
+			continue;
+
+		if (bucket == rows - 1) {
+			start_measurement(measurement,
+			    "le=+Inf,name=%s,dataset=%s", pool_name, ds_name);
+		} else if (seconds) {
+			start_measurement(measurement,
+			    "le=%0.6f,name=%s,dataset=%s",
+			    (float)(1ULL << bucket) * 1e-9, pool_name, ds_name);
+		} else {
+			start_measurement(measurement,
+			    "le=%llu,name=%s,dataset=%s", 1ULL << bucket,
+			    pool_name, ds_name);
+		}
+		for (int i = 0; i < ncols; i++)
+			print_kv(names[i], sum[i]);
+		end_measurement();
+	}
+}
+
+/*
+ * zvol and filesystem request latency and size histograms are kept in an
+ * objset-0x<id>-io_histo kstat, next to the objset-0x<id> kstat holding the
+ * dataset's name.  They are read from procfs, so only on Linux.  Older
+ * kernels lack the sync_write and tx_wait columns.
+ */
+static void
+print_zvol_stats_one(const char *dir, unsigned long long objset,
+    const char *pool_name)
+{
+	static const char *const names[ZVOL_HISTO_COLS] = {
+	    "read", "write", "discard", "flush", "sync_write", "tx_wait",
+	    "read", "write", "discard", "sync_write"
+	};
+	uint64_t histo[VDEV_L_HISTO_BUCKETS][ZVOL_HISTO_COLS];
+	char path[MAXPATHLEN], line[512];
+	char name[ZFS_MAX_DATASET_NAME_LEN] = "";
+	boolean_t header = B_FALSE;
+	int rows = 0;
+	FILE *fp;
+
+	(void) snprintf(path, sizeof (path), "%s/objset-0x%llx", dir, objset);
+	if ((fp = fopen(path, "r")) == NULL)
+		return;
+	while (fgets(line, sizeof (line), fp) != NULL) {
+		if (sscanf(line, "dataset_name %*d %255s", name) == 1)
+			break;
+	}
+	(void) fclose(fp);
+	if (name[0] == '\0')
+		return;
+
+	(void) snprintf(path, sizeof (path), "%s/objset-0x%llx-io_histo",
+	    dir, objset);
+	if ((fp = fopen(path, "r")) == NULL)
+		return;
+	while (fgets(line, sizeof (line), fp) != NULL &&
+	    rows < VDEV_L_HISTO_BUCKETS) {
+		uint64_t *h = histo[rows];
+
+		if (!header) {
+			header = (strncmp(line, "bucket", 6) == 0);
+			continue;
+		}
+		memset(h, 0, sizeof (histo[rows]));
+		if (sscanf(line, "%*u %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64
+		    " %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64
+		    " %"SCNu64, &h[0], &h[1], &h[2], &h[3], &h[6], &h[7], &h[8],
+		    &h[4], &h[5], &h[9]) >= 7)
+			rows++;
+	}
+	(void) fclose(fp);
+	if (rows == 0)
+		return;
+
+	char *ds_name = escape_string(name);
+	print_zvol_histo(histo, rows, ZVOL_LATENCY_MEASUREMENT, names, 0, 6,
+	    MIN_LAT_INDEX, B_TRUE, pool_name, ds_name);
+	print_zvol_histo(histo, rows, ZVOL_IO_SIZE_MEASUREMENT, names + 6, 6,
+	    4, MIN_SIZE_INDEX, B_FALSE, pool_name, ds_name);
+	free(ds_name);
+}
+
+static void
+print_zvol_stats(const char *pool, const char *pool_name)
+{
+	char dir[MAXPATHLEN];
+	struct dirent *ent;
+	DIR *dp;
+
+	(void) snprintf(dir, sizeof (dir), "%s/%s", ZFS_KSTAT_DIR, pool);
+	if ((dp = opendir(dir)) == NULL)
+		return;
+
+	while ((ent = readdir(dp)) != NULL) {
+		unsigned long long objset;
+		char suffix[16];
+
+		if (sscanf(ent->d_name, "objset-0x%llx-%15s", &objset,
+		    suffix) == 2 && strcmp(suffix, "io_histo") == 0)
+			print_zvol_stats_one(dir, objset, pool_name);
+	}
+	(void) closedir(dp);
+}
+
+/*
+ * Print the numeric entries of a named kstat as one measurement.  The
+ * objset kstats hold the dataset name as a string entry, in which case
+ * pool_name is given and the dataset and pool become tags.  They are read
+ * from procfs, so only on Linux.
+ */
+static void
+print_kstat(const char *path, const char *measurement, const char *pool_name)
+{
+	struct kstat_entry {
+		char name[64];
+		uint64_t value;
+	} *kse;
+	char line[512], name[64], ds[ZFS_MAX_DATASET_NAME_LEN] = "";
+	int type, n = 0;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		return;
+	if ((kse = calloc(KSTAT_MAX_ENTRIES, sizeof (*kse))) == NULL) {
+		(void) fclose(fp);
+		return;
+	}
+
+	/* skip the kstat header line, the column header won't parse */
+	(void) fgets(line, sizeof (line), fp);
+	while (fgets(line, sizeof (line), fp) != NULL &&
+	    n < KSTAT_MAX_ENTRIES) {
+		if (sscanf(line, "%63s %d", name, &type) != 2)
+			continue;
+		if (type == KSTAT_DATA_STRING) {
+			if (strcmp(name, "dataset_name") == 0)
+				(void) sscanf(line, "%*s %*d %255s", ds);
+			continue;
+		}
+		if (type > KSTAT_DATA_UINT64)
+			continue;
+		if (sscanf(line, "%*s %*d %"SCNu64, &kse[n].value) == 1) {
+			(void) strlcpy(kse[n].name, name, sizeof (kse[n].name));
+			n++;
+		}
+	}
+	(void) fclose(fp);
+
+	if (n > 0 && pool_name == NULL) {
+		start_measurement(measurement, NULL);
+	} else if (n > 0 && ds[0] != '\0') {
+		char *ds_name = escape_string(ds);
+		start_measurement(measurement, "name=%s,dataset=%s",
+		    pool_name, ds_name);
+		free(ds_name);
+	} else {
+		n = 0;
+	}
+	for (int i = 0; i < n; i++)
+		print_kv(kse[i].name, kse[i].value);
+	if (n > 0)
+		end_measurement();
+	free(kse);
+}
+
+/*
+ * every dataset has an objset-0x<id> kstat with its I/O and unlink counts
+ */
+static void
+print_dataset_stats(const char *pool, const char *pool_name)
+{
+	char dir[MAXPATHLEN], path[MAXPATHLEN + 256];
+	struct dirent *ent;
+	DIR *dp;
+
+	(void) snprintf(dir, sizeof (dir), "%s/%s", ZFS_KSTAT_DIR, pool);
+	if ((dp = opendir(dir)) == NULL)
+		return;
+
+	while ((ent = readdir(dp)) != NULL) {
+		unsigned long long objset;
+		int len = 0;
+
+		if (sscanf(ent->d_name, "objset-0x%llx%n", &objset,
+		    &len) != 1 || ent->d_name[len] != '\0')
+			continue;
+		(void) snprintf(path, sizeof (path), "%s/%s", dir,
+		    ent->d_name);
+		print_kstat(path, DATASET_MEASUREMENT, pool_name);
+	}
+	(void) closedir(dp);
+}
+
+static void
+update_timestamp(void)
+{
+	struct timespec tv;
+
+	if (clock_gettime(CLOCK_REALTIME, &tv) != 0)
+		timestamp = (uint64_t)time(NULL) * 1000000000;
+	else
+		timestamp =
+		    ((uint64_t)tv.tv_sec * 1000000000) + (uint64_t)tv.tv_nsec;
+}
+
 /*
  * call-back to print the stats from the pool config
  *
@@ -711,7 +1203,6 @@ print_stats(zpool_handle_t *zhp, void *data)
 	boolean_t missing;
 	nvlist_t *config, *nvroot;
 	vdev_stat_t *vs;
-	struct timespec tv;
 	char *pool_name;
 
 	/* if not this pool return quickly */
@@ -727,11 +1218,7 @@ print_stats(zpool_handle_t *zhp, void *data)
 	}
 
 	config = zpool_get_config(zhp, NULL);
-	if (clock_gettime(CLOCK_REALTIME, &tv) != 0)
-		timestamp = (uint64_t)time(NULL) * 1000000000;
-	else
-		timestamp =
-		    ((uint64_t)tv.tv_sec * 1000000000) + (uint64_t)tv.tv_nsec;
+	update_timestamp();
 
 	if (nvlist_lookup_nvlist(
 	    config, ZPOOL_CONFIG_VDEV_TREE, &nvroot) != 0) {
@@ -761,19 +1248,193 @@ print_stats(zpool_handle_t *zhp, void *data)
 	if (err == 0)
 		err = print_recursive_stats(print_queue_stats, nvroot,
 		    pool_name, NULL, 0);
+	if (err == 0)
+		print_zvol_stats(zpool_get_name(zhp), pool_name);
 	}
 	if (err == 0)
 		err = print_scan_status(nvroot, pool_name);
+	if (err == 0 && kstat_stats)
+		print_dataset_stats(zpool_get_name(zhp), pool_name);
 
 	free(pool_name);
 	zpool_close(zhp);
 	return (err);
 }
 
+/*
+ * take one sample of all of the pools, or of the given pool
+ */
+static int
+print_sample(libzfs_handle_t *g_zfs, const char *pool)
+{
+	char path[MAXPATHLEN];
+	int ret;
+
+	ret = zpool_iter(g_zfs, print_stats, (void *)pool);
+	if (kstat_stats) {
+		update_timestamp();
+		(void) snprintf(path, sizeof (path), "%s/arcstats",
+		    ZFS_KSTAT_DIR);
+		print_kstat(path, ARC_MEASUREMENT, NULL);
+		(void) snprintf(path, sizeof (path), "%s/zil", ZFS_KSTAT_DIR);
+		print_kstat(path, ZIL_MEASUREMENT, NULL);
+	}
+	if (openmetrics)
+		om_flush();
+	return (ret);
+}
+
+static int
+listen_socket(const char *arg)
+{
+	struct addrinfo hints = { 0 }, *res, *ai;
+	const char *node = NULL, *service = arg;
+	char buf[256], *c;
+	int fd = -1, on = 1, err;
+
+	(void) strlcpy(buf, arg, sizeof (buf));
+	if ((c = strrchr(buf, ':')) != NULL) {
+		*c = '\0';
+		service = c + 1;
+		node = buf;
+		/* strip the brackets around an IPv6 address */
+		if (buf[0] == '[' && c > buf + 1 && c[-1] == ']') {
+			c[-1] = '\0';
+			node = buf + 1;
+		}
+		if (*node == '\0')
+			node = NULL;
+	}
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if ((err = getaddrinfo(node, service, &hints, &res)) != 0) {
+		fprintf(stderr, "error: cannot resolve %s: %s\n", arg,
+		    gai_strerror(err));
+		exit(EXIT_FAILURE);
+	}
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		(void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on,
+		    sizeof (on));
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+		    listen(fd, 16) == 0)
+			break;
+		(void) close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0) {
+		fprintf(stderr, "error: cannot listen on %s: %s\n", arg,
+		    strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return (fd);
+}
+
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return (-1);
+		buf += n;
+		len -= n;
+	}
+	return (0);
+}
+
+static void
+send_response(int fd, const char *status, const char *type,
+    const char *body, size_t len)
+{
+	char header[256];
+	int n;
+
+	n = snprintf(header, sizeof (header), "HTTP/1.0 %s\r\n"
+	    "Content-Type: %s\r\nContent-Length: %llu\r\n"
+	    "Connection: close\r\n\r\n", status, type, (u_longlong_t)len);
+	if (write_all(fd, header, n) == 0)
+		(void) write_all(fd, body, len);
+}
+
+/*
+ * Serve the metrics over HTTP, one request at a time, so a hung pool only
+ * ever blocks this process.  The libzfs handle stays open between the
+ * requests, saving the cost of starting up for every sample.
+ */
+static int
+serve(libzfs_handle_t *g_zfs, int sock, const char *pool)
+{
+	struct timeval tv = { .tv_sec = 10 };
+	const char *type = openmetrics ?
+	    "application/openmetrics-text; version=1.0.0; charset=utf-8" :
+	    "text/plain; charset=utf-8";
+	char req[1024], *body;
+	size_t bodylen;
+
+	(void) signal(SIGPIPE, SIG_IGN);
+	for (;;) {
+		size_t len = 0;
+		ssize_t n;
+		int fd;
+
+		if ((fd = accept(sock, NULL, NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf(stderr, "error: accept failed: %s\n",
+			    strerror(errno));
+			return (1);
+		}
+		(void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv,
+		    sizeof (tv));
+		(void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv,
+		    sizeof (tv));
+
+		/* only the request line matters, but read all the headers */
+		while (len < sizeof (req) - 1) {
+			n = read(fd, req + len, sizeof (req) - 1 - len);
+			if (n <= 0)
+				break;
+			len += n;
+			req[len] = '\0';
+			if (strstr(req, "\r\n\r\n") != NULL)
+				break;
+		}
+		req[len] = '\0';
+
+		if (strncmp(req, "GET / ", 6) == 0 ||
+		    (strncmp(req, "GET /metrics", 12) == 0 &&
+		    (req[12] == ' ' || req[12] == '?'))) {
+			if ((out = open_memstream(&body, &bodylen)) == NULL) {
+				fprintf(stderr, "error: cannot allocate "
+				    "memory\n");
+				exit(1);
+			}
+			(void) print_sample(g_zfs, pool);
+			(void) fclose(out);
+			send_response(fd, "200 OK", type, body, bodylen);
+			free(body);
+		} else {
+			send_response(fd, "404 Not Found",
+			    "text/plain; charset=utf-8", "not found\n", 10);
+		}
+		(void) close(fd);
+	}
+}
+
 static void
 usage(char *name)
 {
-	fprintf(stderr, "usage: %s [--execd][--no-histograms]"
+	fprintf(stderr, "usage: %s [--execd|--listen [addr:]port]"
+	    "[--no-histograms][--openmetrics][--kstats]"
 	    "[--sum-histogram-buckets] [--signed-int] [poolname]\n", name);
 	exit(EXIT_FAILURE);
 }
@@ -784,18 +1445,23 @@ main(int argc, char *argv[])
 	int opt;
 	int ret = 8;
 	char *line = NULL, *ttags = NULL;
+	const char *listen_addr = NULL;
 	size_t len, tagslen = 0;
 	struct option long_options[] = {
 	    {"execd", no_argument, NULL, 'e'},
 	    {"help", no_argument, NULL, 'h'},
+	    {"kstats", no_argument, NULL, 'k'},
+	    {"listen", required_argument, NULL, 'l'},
 	    {"no-histograms", no_argument, NULL, 'n'},
+	    {"openmetrics", no_argument, NULL, 'o'},
 	    {"signed-int", no_argument, NULL, 'i'},
 	    {"sum-histogram-buckets", no_argument, NULL, 's'},
 	    {"tags", required_argument, NULL, 't'},
 	    {0, 0, 0, 0}
 	};
+	out = stdout;
 	while ((opt = getopt_long(
-	    argc, argv, "ehinst:", long_options, NULL)) != -1) {
+	    argc, argv, "ehikl:nost:", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'e':
 			execd_mode = 1;
@@ -804,9 +1470,18 @@ main(int argc, char *argv[])
 			metric_data_type = 'i';
 			metric_value_mask = INT64_MAX;
 			break;
+		case 'k':
+			kstat_stats = 1;
+			break;
+		case 'l':
+			listen_addr = optarg;
+			break;
 		case 'n':
 			no_histograms = 1;
 			break;
+		case 'o':
+			openmetrics = 1;
+			break;
 		case 's':
 			sum_histogram_buckets = 1;
 			break;
@@ -827,6 +1502,11 @@ main(int argc, char *argv[])
 			usage(argv[0]);
 		}
 	}
+	if (execd_mode && listen_addr != NULL)
+		usage(argv[0]);
+	/* OpenMetrics histogram buckets are cumulative */
+	if (openmetrics)
+		sum_histogram_buckets = 1;
 
 	libzfs_handle_t *g_zfs;
 	if ((g_zfs = libzfs_init()) == NULL) {
@@ -835,12 +1515,14 @@ main(int argc, char *argv[])
 		    "Is the zfs module loaded or zrepl running?\n");
 		exit(EXIT_FAILURE);
 	}
+	if (listen_addr != NULL)
+		return (serve(g_zfs, listen_socket(listen_addr), argv[optind]));
 	if (execd_mode == 0) {
-		ret = zpool_iter(g_zfs, print_stats, argv[optind]);
+		ret = print_sample(g_zfs, argv[optind]);
 		return (ret);
 	}
 	while (getline(&line, &len, stdin) != -1) {
-		ret = zpool_iter(g_zfs, print_stats, argv[optind]);
+		ret = print_sample(g_zfs, argv[optind]);
 		fflush(stdout);
 	}
 	return (ret);
@@ -21,10 +21,39 @@
 #ifndef	_ZSTREAM_H
 #define	_ZSTREAM_H
 
+#include <stdio.h>
+#include <sys/zfs_ioctl.h>
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
+/*
+ * A send stream record queued on a zstream_workq_t.  zr_work records are
+ * passed to the queue's work function on a worker thread before being
+ * written out in submission order.
+ */
+typedef struct zstream_rec {
+	dmu_replay_record_t	zr_drr;
+	char			*zr_buf;
+	uint64_t		zr_payload_size;
+	uint64_t		zr_private;
+	boolean_t		zr_work;
+	boolean_t		zr_done;
+} zstream_rec_t;
+
+typedef struct zstream_workq zstream_workq_t;
+typedef void zstream_work_func_t(zstream_rec_t *, void *);
+
+extern zstream_workq_t *zstream_workq_create(int, zstream_work_func_t *,
+    void *, int);
+extern int zstream_workq_submit(zstream_workq_t *, zstream_rec_t *);
+extern int zstream_workq_destroy(zstream_workq_t *);
+extern zstream_rec_t *zstream_rec_alloc(const dmu_replay_record_t *);
+extern void zstream_rec_read_payload(zstream_rec_t *, uint64_t, FILE *);
+extern void zstream_rec_set_payload(zstream_rec_t *, char *, uint64_t);
+extern void zstream_rec_free(zstream_rec_t *);
+
 extern void *safe_calloc(size_t n);
 extern int sfread(void *buf, size_t size, FILE *fp);
 extern void *safe_malloc(size_t size);
@@ -38,44 +38,95 @@
 #include "zfs_fletcher.h"
 #include "zstream.h"
 
-static int
-dump_record(dmu_replay_record_t *drr, void *payload, int payload_len,
-    zio_cksum_t *zc, int outfd)
+typedef struct recompress_arg {
+	enum zio_compress	ra_ctype;
+	int			ra_level;
+} recompress_arg_t;
+
+/*
+ * Decompress and recompress the payload of one WRITE record.  Runs on a
+ * zstream_workq_t worker thread.
+ */
+static void
+recompress_write(zstream_rec_t *rec, void *arg)
 {
-	assert(offsetof(dmu_replay_record_t, drr_u.drr_checksum.drr_checksum)
-	    == sizeof (dmu_replay_record_t) - sizeof (zio_cksum_t));
-	fletcher_4_incremental_native(drr,
-	    offsetof(dmu_replay_record_t, drr_u.drr_checksum.drr_checksum), zc);
-	if (drr->drr_type != DRR_BEGIN) {
-		assert(ZIO_CHECKSUM_IS_ZERO(&drr->drr_u.
-		    drr_checksum.drr_checksum));
-		drr->drr_u.drr_checksum.drr_checksum = *zc;
+	recompress_arg_t *ra = arg;
+	struct drr_write *drrw = &rec->zr_drr.drr_u.drr_write;
+	uint64_t payload_size = rec->zr_payload_size;
+	uint64_t lsize = drrw->drr_logical_size;
+	enum zio_compress ctype = ra->ra_ctype;
+	enum zio_compress dtype = drrw->drr_compressiontype;
+
+	if (zio_compress_table[dtype].ci_decompress == NULL)
+		dtype = ZIO_COMPRESS_OFF;
+
+	/* Decompress the payload */
+	char *dbuf = rec->zr_buf;
+	if (dtype != ZIO_COMPRESS_OFF) {
+		abd_t cabd, dabd;
+		dbuf = safe_calloc(lsize);
+		abd_get_from_buf_struct(&cabd, rec->zr_buf, payload_size);
+		abd_get_from_buf_struct(&dabd, dbuf, lsize);
+		if (zio_decompress_data(dtype, &cabd, &dabd,
+		    payload_size, abd_get_size(&dabd), NULL) != 0) {
+			warnx("decompression type %d failed "
+			    "for ino %llu offset %llu",
+			    dtype,
+			    (u_longlong_t)drrw->drr_object,
+			    (u_longlong_t)drrw->drr_offset);
+			exit(4);
+		}
+		abd_free(&dabd);
+		abd_free(&cabd);
+		zstream_rec_set_payload(rec, dbuf, lsize);
 	}
-	fletcher_4_incremental_native(&drr->drr_u.drr_checksum.drr_checksum,
-	    sizeof (zio_cksum_t), zc);
-	if (write(outfd, drr, sizeof (*drr)) == -1)
-		return (errno);
-	if (payload_len != 0) {
-		fletcher_4_incremental_native(payload, payload_len, zc);
-		if (write(outfd, payload, payload_len) == -1)
-			return (errno);
+
+	drrw->drr_compressiontype = 0;
+	drrw->drr_compressed_size = 0;
+	if (ctype == ZIO_COMPRESS_OFF)
+		return;
+
+	/* Recompress the payload */
+	abd_t dabd, abd;
+	char *cbuf = safe_calloc(lsize);
+	abd_get_from_buf_struct(&dabd, dbuf, lsize);
+	abd_t *pabd = abd_get_from_buf_struct(&abd, cbuf, lsize);
+	size_t csize = zio_compress_data(ctype, &dabd, &pabd, lsize, lsize,
+	    ra->ra_level);
+	size_t rounded = P2ROUNDUP(csize, SPA_MINBLOCKSIZE);
+	if (rounded < lsize) {
+		abd_zero_off(pabd, csize, rounded - csize);
+		drrw->drr_compressiontype = ctype;
+		drrw->drr_compressed_size = rounded;
 	}
-	return (0);
+	abd_free(&abd);
+	abd_free(&dabd);
+	if (rounded < lsize)
+		zstream_rec_set_payload(rec, cbuf, rounded);
+	else
+		free(cbuf);
 }
 
 int
 zstream_do_recompress(int argc, char *argv[])
 {
-	int bufsz = SPA_MAXBLOCKSIZE;
-	char *buf = safe_malloc(bufsz);
 	dmu_replay_record_t thedrr;
 	dmu_replay_record_t *drr = &thedrr;
-	zio_cksum_t stream_cksum;
 	int c;
 	int level = 0;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
 
-	while ((c = getopt(argc, argv, "l:")) != -1) {
+	while ((c = getopt(argc, argv, "j:l:")) != -1) {
 		switch (c) {
+		case 'j':
+			if (sscanf(optarg, "%d", &nthreads) != 1 ||
+			    nthreads < 1) {
+				fprintf(stderr,
+				    "failed to parse thread count '%s'\n",
+				    optarg);
+				zstream_usage();
+			}
+			break;
 		case 'l':
 			if (sscanf(optarg, "%d", &level) != 1) {
 				fprintf(stderr,
@@ -127,25 +178,20 @@ zstream_do_recompress(int argc, char *argv[])
 	fletcher_4_init();
 	zio_init();
 	zstd_init();
+
+	recompress_arg_t ra = { .ra_ctype = ctype, .ra_level = level };
+	zstream_workq_t *zw = zstream_workq_create(nthreads,
+	    recompress_write, &ra, STDOUT_FILENO);
+
 	int begin = 0;
 	boolean_t seen = B_FALSE;
 	while (sfread(drr, sizeof (*drr), stdin) != 0) {
-		struct drr_write *drrw;
-		uint64_t payload_size = 0;
-
-		/*
-		 * We need to regenerate the checksum.
-		 */
-		if (drr->drr_type != DRR_BEGIN) {
-			memset(&drr->drr_u.drr_checksum.drr_checksum, 0,
-			    sizeof (drr->drr_u.drr_checksum.drr_checksum));
-		}
-
+		zstream_rec_t *rec = zstream_rec_alloc(drr);
+		drr = &rec->zr_drr;
 
 		switch (drr->drr_type) {
 		case DRR_BEGIN:
 		{
-			ZIO_SET_CHECKSUM(&stream_cksum, 0, 0, 0, 0);
 			VERIFY0(begin++);
 			seen = B_TRUE;
 
@@ -153,21 +199,11 @@ zstream_do_recompress(int argc, char *argv[])
 
 			VERIFY3U(sz, <=, 1U << 28);
 
-			if (sz != 0) {
-				if (sz > bufsz) {
-					buf = realloc(buf, sz);
-					if (buf == NULL)
-						err(1, "realloc");
-					bufsz = sz;
-				}
-				(void) sfread(buf, sz, stdin);
-			}
-			payload_size = sz;
+			zstream_rec_read_payload(rec, sz, stdin);
 			break;
 		}
 		case DRR_END:
 		{
-			struct drr_end *drre = &drr->drr_u.drr_end;
 			/*
 			 * We would prefer to just check --begin == 0, but
 			 * replication streams have an end of stream END
@@ -175,13 +211,6 @@ zstream_do_recompress(int argc, char *argv[])
 			 */
 			VERIFY3B(seen, ==, B_TRUE);
 			begin--;
-			/*
-			 * Use the recalculated checksum, unless this is
-			 * the END record of a stream package, which has
-			 * no checksum.
-			 */
-			if (!ZIO_CHECKSUM_IS_ZERO(&drre->drr_checksum))
-				drre->drr_checksum = stream_cksum;
 			break;
 		}
 
@@ -191,8 +220,8 @@ zstream_do_recompress(int argc, char *argv[])
 			VERIFY3S(begin, ==, 1);
 
 			if (drro->drr_bonuslen > 0) {
-				payload_size = DRR_OBJECT_PAYLOAD_SIZE(drro);
-				(void) sfread(buf, payload_size, stdin);
+				zstream_rec_read_payload(rec,
+				    DRR_OBJECT_PAYLOAD_SIZE(drro), stdin);
 			}
 			break;
 		}
@@ -201,8 +230,8 @@ zstream_do_recompress(int argc, char *argv[])
 		{
 			struct drr_spill *drrs = &drr->drr_u.drr_spill;
 			VERIFY3S(begin, ==, 1);
-			payload_size = DRR_SPILL_PAYLOAD_SIZE(drrs);
-			(void) sfread(buf, payload_size, stdin);
+			zstream_rec_read_payload(rec,
+			    DRR_SPILL_PAYLOAD_SIZE(drrs), stdin);
 			break;
 		}
 
@@ -216,8 +245,9 @@ zstream_do_recompress(int argc, char *argv[])
 		case DRR_WRITE:
 		{
 			VERIFY3S(begin, ==, 1);
-			drrw = &thedrr.drr_u.drr_write;
-			payload_size = DRR_WRITE_PAYLOAD_SIZE(drrw);
+			struct drr_write *drrw = &drr->drr_u.drr_write;
+			zstream_rec_read_payload(rec,
+			    DRR_WRITE_PAYLOAD_SIZE(drrw), stdin);
 			/*
 			 * In order to recompress an encrypted block, you have
 			 * to decrypt, decompress, recompress, and
@@ -232,85 +262,16 @@ zstream_do_recompress(int argc, char *argv[])
 					break;
 				}
 			}
-			if (encrypted) {
-				(void) sfread(buf, payload_size, stdin);
+			if (encrypted)
 				break;
-			}
 			enum zio_compress dtype = drrw->drr_compressiontype;
 			if (dtype >= ZIO_COMPRESS_FUNCTIONS) {
 				fprintf(stderr, "Invalid compression type in "
 				    "stream: %d\n", dtype);
 				exit(3);
 			}
-			if (zio_compress_table[dtype].ci_decompress == NULL)
-				dtype = ZIO_COMPRESS_OFF;
-
-			/* Set up buffers to minimize memcpys */
-			char *cbuf, *dbuf;
-			if (ctype == ZIO_COMPRESS_OFF)
-				dbuf = buf;
-			else
-				dbuf = safe_calloc(bufsz);
-
-			if (dtype == ZIO_COMPRESS_OFF)
-				cbuf = dbuf;
-			else
-				cbuf = safe_calloc(payload_size);
-
-			/* Read and decompress the payload */
-			(void) sfread(cbuf, payload_size, stdin);
-			if (dtype != ZIO_COMPRESS_OFF) {
-				abd_t cabd, dabd;
-				abd_get_from_buf_struct(&cabd,
-				    cbuf, payload_size);
-				abd_get_from_buf_struct(&dabd, dbuf,
-				    MIN(bufsz, drrw->drr_logical_size));
-				if (zio_decompress_data(dtype, &cabd, &dabd,
-				    payload_size, abd_get_size(&dabd),
-				    NULL) != 0) {
-					warnx("decompression type %d failed "
-					    "for ino %llu offset %llu",
-					    dtype,
-					    (u_longlong_t)drrw->drr_object,
-					    (u_longlong_t)drrw->drr_offset);
-					exit(4);
-				}
-				payload_size = drrw->drr_logical_size;
-				abd_free(&dabd);
-				abd_free(&cabd);
-				free(cbuf);
-			}
-
-			/* Recompress the payload */
-			if (ctype != ZIO_COMPRESS_OFF) {
-				abd_t dabd, abd;
-				abd_get_from_buf_struct(&dabd,
-				    dbuf, drrw->drr_logical_size);
-				abd_t *pabd =
-				    abd_get_from_buf_struct(&abd, buf, bufsz);
-				size_t csize = zio_compress_data(ctype, &dabd,
-				    &pabd, drrw->drr_logical_size,
-				    drrw->drr_logical_size, level);
-				size_t rounded =
-				    P2ROUNDUP(csize, SPA_MINBLOCKSIZE);
-				if (rounded >= drrw->drr_logical_size) {
-					memcpy(buf, dbuf, payload_size);
-					drrw->drr_compressiontype = 0;
-					drrw->drr_compressed_size = 0;
-				} else {
-					abd_zero_off(pabd, csize,
-					    rounded - csize);
-					drrw->drr_compressiontype = ctype;
-					drrw->drr_compressed_size =
-					    payload_size = rounded;
-				}
-				abd_free(&abd);
-				abd_free(&dabd);
-				free(dbuf);
-			} else {
-				drrw->drr_compressiontype = 0;
-				drrw->drr_compressed_size = 0;
-			}
+			/* Decompress and recompress on a worker thread */
+			rec->zr_work = B_TRUE;
 			break;
 		}
 
@@ -319,9 +280,8 @@ zstream_do_recompress(int argc, char *argv[])
 			struct drr_write_embedded *drrwe =
 			    &drr->drr_u.drr_write_embedded;
 			VERIFY3S(begin, ==, 1);
-			payload_size =
-			    P2ROUNDUP((uint64_t)drrwe->drr_psize, 8);
-			(void) sfread(buf, payload_size, stdin);
+			zstream_rec_read_payload(rec,
+			    P2ROUNDUP((uint64_t)drrwe->drr_psize, 8), stdin);
 			break;
 		}
 
@@ -348,31 +308,11 @@ zstream_do_recompress(int argc, char *argv[])
 			exit(1);
 		}
 
-		/*
-		 * We need to recalculate the checksum, and it needs to be
-		 * initially zero to do that.  BEGIN records don't have
-		 * a checksum.
-		 */
-		if (drr->drr_type != DRR_BEGIN) {
-			memset(&drr->drr_u.drr_checksum.drr_checksum, 0,
-			    sizeof (drr->drr_u.drr_checksum.drr_checksum));
-		}
-		if (dump_record(drr, buf, payload_size,
-		    &stream_cksum, STDOUT_FILENO) != 0)
+		drr = &thedrr;
+		if (zstream_workq_submit(zw, rec) != 0)
 			break;
-		if (drr->drr_type == DRR_END) {
-			/*
-			 * Typically the END record is either the last
-			 * thing in the stream, or it is followed
-			 * by a BEGIN record (which also zeros the checksum).
-			 * However, a stream package ends with two END
-			 * records.  The last END record's checksum starts
-			 * from zero.
-			 */
-			ZIO_SET_CHECKSUM(&stream_cksum, 0, 0, 0, 0);
-		}
 	}
-	free(buf);
+	(void) zstream_workq_destroy(zw);
 	fletcher_4_fini();
 	zio_fini();
 	zstd_fini();
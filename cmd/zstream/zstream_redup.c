@@ -29,9 +29,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <umem.h>
 #include <unistd.h>
 #include <sys/debug.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/zfs_ioctl.h>
 #include <sys/zio_checksum.h>
@@ -41,20 +41,33 @@
 
 #define	MAX_RDT_PHYSMEM_PERCENT		20
 #define	SMALLEST_POSSIBLE_MAX_RDT_MB		128
+#define	RDT_MIN_HASHBITS		16
 
+/*
+ * The redup table maps the (guid, object, offset) of every WRITE record to
+ * the record's offset in the input stream.  It is an open-addressed, linearly
+ * probed table that only stores the key's hash next to the stream offset;
+ * the key itself is checked by reading the WRITE record back from the stream
+ * on lookup, which has to happen anyway to copy its payload.  A stream offset
+ * of zero marks an empty slot, since the stream always starts with a BEGIN
+ * record.
+ *
+ * The table grows by doubling at 3/4 load.  Once it would no longer fit in
+ * the memory budget, it is placed in an unlinked temporary file (under
+ * $TMPDIR) instead, so that streams of any size can be converted.
+ */
 typedef struct redup_entry {
-	struct redup_entry	*rde_next;
-	uint64_t rde_guid;
-	uint64_t rde_object;
-	uint64_t rde_offset;
+	uint64_t rde_hash;
 	uint64_t rde_stream_offset;
 } redup_entry_t;
 
 typedef struct redup_table {
-	redup_entry_t	**redup_hash_array;
-	umem_cache_t	*ddecache;
-	uint64_t	ddt_count;
-	int		numhashbits;
+	redup_entry_t	*rdt_array;
+	uint64_t	rdt_size;	/* size of the mapping in bytes */
+	int		rdt_fd;		/* backing file, or -1 if in memory */
+	uint64_t	rdt_maxmem;	/* largest table to keep in memory */
+	uint64_t	rdt_count;
+	int		rdt_numhashbits;
 } redup_table_t;
 
 void *
@@ -129,43 +142,156 @@ dump_record(dmu_replay_record_t *drr, void *payload, int payload_len,
 	return (0);
 }
 
+/*
+ * Map a zeroed table array of the given size, in anonymous memory if it fits
+ * in the memory budget and in an unlinked temporary file otherwise.
+ */
+static void
+rdt_map(redup_table_t *rdt, uint64_t size)
+{
+	void *addr;
+
+	rdt->rdt_fd = -1;
+	if (size <= rdt->rdt_maxmem) {
+		addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+		/* The table is probed at random; avoid TLB misses. */
+		if (addr != MAP_FAILED)
+			(void) madvise(addr, size, MADV_HUGEPAGE);
+#endif
+	} else {
+		const char *tmpdir = getenv("TMPDIR");
+		char path[MAXPATHLEN];
+
+		if (tmpdir == NULL || tmpdir[0] == '\0')
+			tmpdir = "/tmp";
+		(void) snprintf(path, sizeof (path), "%s/zstream.XXXXXX",
+		    tmpdir);
+		rdt->rdt_fd = mkstemp(path);
+		if (rdt->rdt_fd == -1) {
+			(void) fprintf(stderr, "Error while creating temporary "
+			    "file in '%s': %s\n", tmpdir, strerror(errno));
+			exit(1);
+		}
+		(void) unlink(path);
+		if (ftruncate(rdt->rdt_fd, size) != 0) {
+			(void) fprintf(stderr, "Error while extending "
+			    "temporary file: %s\n", strerror(errno));
+			exit(1);
+		}
+		addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    rdt->rdt_fd, 0);
+	}
+	if (addr == MAP_FAILED) {
+		(void) fprintf(stderr, "Error: could not map %llu bytes for "
+		    "the redup table: %s\n", (u_longlong_t)size,
+		    strerror(errno));
+		exit(1);
+	}
+	rdt->rdt_array = addr;
+	rdt->rdt_size = size;
+}
+
+static void
+rdt_unmap(redup_table_t *rdt)
+{
+	(void) munmap(rdt->rdt_array, rdt->rdt_size);
+	if (rdt->rdt_fd != -1)
+		(void) close(rdt->rdt_fd);
+	rdt->rdt_array = NULL;
+	rdt->rdt_fd = -1;
+}
+
+static void
+rdt_init(redup_table_t *rdt, uint64_t maxmem)
+{
+	rdt->rdt_maxmem = maxmem;
+	rdt->rdt_count = 0;
+	rdt->rdt_numhashbits = RDT_MIN_HASHBITS;
+	rdt_map(rdt, sizeof (redup_entry_t) << rdt->rdt_numhashbits);
+}
+
+static void
+rdt_fini(redup_table_t *rdt)
+{
+	rdt_unmap(rdt);
+}
+
+static void
+rdt_place(redup_table_t *rdt, uint64_t hash, uint64_t stream_offset)
+{
+	uint64_t mask = (1ULL << rdt->rdt_numhashbits) - 1;
+	uint64_t idx = hash & mask;
+
+	while (rdt->rdt_array[idx].rde_stream_offset != 0)
+		idx = (idx + 1) & mask;
+	rdt->rdt_array[idx].rde_hash = hash;
+	rdt->rdt_array[idx].rde_stream_offset = stream_offset;
+}
+
+/*
+ * Double the size of the table and rehash all of its entries.
+ */
+static void
+rdt_grow(redup_table_t *rdt)
+{
+	redup_table_t old = *rdt;
+	uint64_t oldbuckets = 1ULL << old.rdt_numhashbits;
+
+	rdt->rdt_numhashbits++;
+	rdt_map(rdt, sizeof (redup_entry_t) << rdt->rdt_numhashbits);
+	for (uint64_t i = 0; i < oldbuckets; i++) {
+		redup_entry_t *rde = &old.rdt_array[i];
+		if (rde->rde_stream_offset != 0) {
+			rdt_place(rdt, rde->rde_hash,
+			    rde->rde_stream_offset);
+		}
+	}
+	rdt_unmap(&old);
+}
+
 static void
 rdt_insert(redup_table_t *rdt,
     uint64_t guid, uint64_t object, uint64_t offset, uint64_t stream_offset)
 {
-	uint64_t ch = cityhash3(guid, object, offset);
-	uint64_t hashcode = BF64_GET(ch, 0, rdt->numhashbits);
-	redup_entry_t **rdepp;
-
-	rdepp = &(rdt->redup_hash_array[hashcode]);
-	redup_entry_t *rde = umem_cache_alloc(rdt->ddecache, UMEM_NOFAIL);
-	rde->rde_next = *rdepp;
-	rde->rde_guid = guid;
-	rde->rde_object = object;
-	rde->rde_offset = offset;
-	rde->rde_stream_offset = stream_offset;
-	*rdepp = rde;
-	rdt->ddt_count++;
+	assert(stream_offset != 0);
+	if (rdt->rdt_count + 1 > (3ULL << rdt->rdt_numhashbits) / 4)
+		rdt_grow(rdt);
+	rdt_place(rdt, cityhash3(guid, object, offset), stream_offset);
+	rdt->rdt_count++;
 }
 
-static void
-rdt_lookup(redup_table_t *rdt,
+/*
+ * Find the WRITE record with the given guid, object and offset, and read its
+ * header from the stream into drr.  Returns the record's stream offset.
+ */
+static uint64_t
+rdt_lookup(redup_table_t *rdt, int infd,
     uint64_t guid, uint64_t object, uint64_t offset,
-    uint64_t *stream_offsetp)
+    dmu_replay_record_t *drr)
 {
-	uint64_t ch = cityhash3(guid, object, offset);
-	uint64_t hashcode = BF64_GET(ch, 0, rdt->numhashbits);
-
-	for (redup_entry_t *rde = rdt->redup_hash_array[hashcode];
-	    rde != NULL; rde = rde->rde_next) {
-		if (rde->rde_guid == guid &&
-		    rde->rde_object == object &&
-		    rde->rde_offset == offset) {
-			*stream_offsetp = rde->rde_stream_offset;
-			return;
-		}
+	uint64_t hash = cityhash3(guid, object, offset);
+	uint64_t mask = (1ULL << rdt->rdt_numhashbits) - 1;
+
+	for (uint64_t idx = hash & mask;
+	    rdt->rdt_array[idx].rde_stream_offset != 0;
+	    idx = (idx + 1) & mask) {
+		redup_entry_t *rde = &rdt->rdt_array[idx];
+		if (rde->rde_hash != hash)
+			continue;
+
+		spread(infd, drr, sizeof (*drr), rde->rde_stream_offset);
+		struct drr_write *drrw = &drr->drr_u.drr_write;
+		if (drr->drr_type == DRR_WRITE &&
+		    drrw->drr_toguid == guid &&
+		    drrw->drr_object == object &&
+		    drrw->drr_offset == offset)
+			return (rde->rde_stream_offset);
 	}
-	assert(!"could not find expected redup table entry");
+	(void) fprintf(stderr, "Error: could not find the WRITE record "
+	    "referenced by a WRITE_BYREF record\n");
+	exit(1);
 }
 
 /*
@@ -182,7 +308,6 @@ zfs_redup_stream(int infd, int outfd, boolean_t verbose)
 	dmu_replay_record_t *drr = &thedrr;
 	redup_table_t rdt;
 	zio_cksum_t stream_cksum;
-	uint64_t numbuckets;
 	uint64_t num_records = 0;
 	uint64_t num_write_byref_records = 0;
 
@@ -197,21 +322,7 @@ zfs_redup_stream(int infd, int outfd, boolean_t verbose)
 	    SMALLEST_POSSIBLE_MAX_RDT_MB << 20);
 #endif
 
-	numbuckets = max_rde_size / (sizeof (redup_entry_t));
-
-	/*
-	 * numbuckets must be a power of 2.  Increase number to
-	 * a power of 2 if necessary.
-	 */
-	if (!ISP2(numbuckets))
-		numbuckets = 1ULL << highbit64(numbuckets);
-
-	rdt.redup_hash_array =
-	    safe_calloc(numbuckets * sizeof (redup_entry_t *));
-	rdt.ddecache = umem_cache_create("rde", sizeof (redup_entry_t), 0,
-	    NULL, NULL, NULL, NULL, NULL, 0);
-	rdt.numhashbits = highbit64(numbuckets) - 1;
-	rdt.ddt_count = 0;
+	rdt_init(&rdt, max_rde_size);
 
 	char *buf = safe_calloc(bufsz);
 	FILE *ofp = fdopen(infd, "r");
@@ -319,18 +430,10 @@ zfs_redup_stream(int infd, int outfd, boolean_t verbose)
 			 * record with the found WRITE record, but with
 			 * drr_object,drr_offset,drr_toguid replaced with ours.
 			 */
-			uint64_t stream_offset = 0;
-			rdt_lookup(&rdt, drrwb.drr_refguid,
-			    drrwb.drr_refobject, drrwb.drr_refoffset,
-			    &stream_offset);
-
-			spread(infd, drr, sizeof (*drr), stream_offset);
-
-			assert(drr->drr_type == DRR_WRITE);
+			uint64_t stream_offset = rdt_lookup(&rdt, infd,
+			    drrwb.drr_refguid, drrwb.drr_refobject,
+			    drrwb.drr_refoffset, drr);
 			struct drr_write *drrw = &drr->drr_u.drr_write;
-			assert(drrw->drr_toguid == drrwb.drr_refguid);
-			assert(drrw->drr_object == drrwb.drr_refobject);
-			assert(drrw->drr_offset == drrwb.drr_refoffset);
 
 			payload_size = DRR_WRITE_PAYLOAD_SIZE(drrw);
 			spread(infd, buf, payload_size,
@@ -416,17 +519,15 @@ zfs_redup_stream(int infd, int outfd, boolean_t verbose)
 
 	if (verbose) {
 		char mem_str[16];
-		zfs_nicenum(rdt.ddt_count * sizeof (redup_entry_t),
-		    mem_str, sizeof (mem_str));
+		zfs_nicenum(rdt.rdt_size, mem_str, sizeof (mem_str));
 		fprintf(stderr, "converted stream with %llu total records, "
-		    "including %llu dedup records, using %sB memory.\n",
+		    "including %llu dedup records, using %sB %s.\n",
 		    (long long)num_records,
 		    (long long)num_write_byref_records,
-		    mem_str);
+		    mem_str, rdt.rdt_fd == -1 ? "memory" : "temporary file");
 	}
 
-	umem_cache_destroy(rdt.ddecache);
-	free(rdt.redup_hash_array);
+	rdt_fini(&rdt);
 	free(buf);
 	(void) fclose(ofp);
 }
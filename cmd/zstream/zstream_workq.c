@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: CDDL-1.0
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * An ordered work queue for the zstream subcommands that rewrite WRITE
+ * records (recompress and decompress).
+ *
+ * The main thread reads records from the input stream and submits them in
+ * order.  A pool of worker threads runs the per-record transform on the
+ * records that need one, in any order, and a single writer thread writes
+ * the records out in their original order, recomputing the stream checksum
+ * as it goes.  At most zw_depth records are in flight, which bounds memory
+ * use.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/zfs_ioctl.h>
+#include <sys/zio_checksum.h>
+#include "zfs_fletcher.h"
+#include "zstream.h"
+
+struct zstream_workq {
+	pthread_mutex_t		zw_lock;
+	pthread_cond_t		zw_cv;
+	zstream_rec_t		**zw_ring;
+	uint64_t		zw_depth;
+	uint64_t		zw_head;	/* next record to write */
+	uint64_t		zw_next;	/* next record for a worker */
+	uint64_t		zw_tail;	/* next free slot */
+	boolean_t		zw_exiting;
+	int			zw_err;
+	zstream_work_func_t	*zw_func;
+	void			*zw_arg;
+	int			zw_outfd;
+	zio_cksum_t		zw_cksum;
+	int			zw_nthreads;
+	pthread_t		*zw_workers;
+	pthread_t		zw_writer;
+};
+
+static int
+dump_record(dmu_replay_record_t *drr, void *payload, int payload_len,
+    zio_cksum_t *zc, int outfd)
+{
+	assert(offsetof(dmu_replay_record_t, drr_u.drr_checksum.drr_checksum)
+	    == sizeof (dmu_replay_record_t) - sizeof (zio_cksum_t));
+	fletcher_4_incremental_native(drr,
+	    offsetof(dmu_replay_record_t, drr_u.drr_checksum.drr_checksum), zc);
+	if (drr->drr_type != DRR_BEGIN) {
+		assert(ZIO_CHECKSUM_IS_ZERO(&drr->drr_u.
+		    drr_checksum.drr_checksum));
+		drr->drr_u.drr_checksum.drr_checksum = *zc;
+	}
+	fletcher_4_incremental_native(&drr->drr_u.drr_checksum.drr_checksum,
+	    sizeof (zio_cksum_t), zc);
+	if (write(outfd, drr, sizeof (*drr)) == -1)
+		return (errno);
+	if (payload_len != 0) {
+		fletcher_4_incremental_native(payload, payload_len, zc);
+		if (write(outfd, payload, payload_len) == -1)
+			return (errno);
+	}
+	return (0);
+}
+
+static int
+zstream_rec_write(zstream_workq_t *zw, zstream_rec_t *rec)
+{
+	dmu_replay_record_t *drr = &rec->zr_drr;
+	int err;
+
+	if (drr->drr_type == DRR_BEGIN) {
+		ZIO_SET_CHECKSUM(&zw->zw_cksum, 0, 0, 0, 0);
+	} else if (drr->drr_type == DRR_END) {
+		/*
+		 * Use the recalculated checksum, unless this is the END
+		 * record of a stream package, which has no checksum.
+		 */
+		struct drr_end *drre = &drr->drr_u.drr_end;
+		if (!ZIO_CHECKSUM_IS_ZERO(&drre->drr_checksum))
+			drre->drr_checksum = zw->zw_cksum;
+	}
+
+	/*
+	 * We need to recalculate the checksum, and it needs to be
+	 * initially zero to do that.  BEGIN records don't have
+	 * a checksum.
+	 */
+	if (drr->drr_type != DRR_BEGIN) {
+		memset(&drr->drr_u.drr_checksum.drr_checksum, 0,
+		    sizeof (drr->drr_u.drr_checksum.drr_checksum));
+	}
+	err = dump_record(drr, rec->zr_buf, rec->zr_payload_size,
+	    &zw->zw_cksum, zw->zw_outfd);
+
+	if (drr->drr_type == DRR_END) {
+		/*
+		 * Typically the END record is either the last
+		 * thing in the stream, or it is followed
+		 * by a BEGIN record (which also zeros the checksum).
+		 * However, a stream package ends with two END
+		 * records.  The last END record's checksum starts
+		 * from zero.
+		 */
+		ZIO_SET_CHECKSUM(&zw->zw_cksum, 0, 0, 0, 0);
+	}
+	return (err);
+}
+
+static void *
+zstream_worker(void *arg)
+{
+	zstream_workq_t *zw = arg;
+
+	pthread_mutex_lock(&zw->zw_lock);
+	for (;;) {
+		while (zw->zw_next == zw->zw_tail && !zw->zw_exiting)
+			pthread_cond_wait(&zw->zw_cv, &zw->zw_lock);
+		if (zw->zw_next == zw->zw_tail)
+			break;
+		zstream_rec_t *rec = zw->zw_ring[zw->zw_next++ % zw->zw_depth];
+		pthread_mutex_unlock(&zw->zw_lock);
+
+		if (rec->zr_work)
+			zw->zw_func(rec, zw->zw_arg);
+
+		pthread_mutex_lock(&zw->zw_lock);
+		rec->zr_done = B_TRUE;
+		pthread_cond_broadcast(&zw->zw_cv);
+	}
+	pthread_mutex_unlock(&zw->zw_lock);
+	return (NULL);
+}
+
+static void *
+zstream_writer(void *arg)
+{
+	zstream_workq_t *zw = arg;
+
+	pthread_mutex_lock(&zw->zw_lock);
+	for (;;) {
+		zstream_rec_t *rec = NULL;
+		while (zw->zw_head != zw->zw_tail) {
+			rec = zw->zw_ring[zw->zw_head % zw->zw_depth];
+			if (rec->zr_done)
+				break;
+			rec = NULL;
+			pthread_cond_wait(&zw->zw_cv, &zw->zw_lock);
+		}
+		if (rec == NULL) {
+			if (zw->zw_exiting)
+				break;
+			pthread_cond_wait(&zw->zw_cv, &zw->zw_lock);
+			continue;
+		}
+		int err = zw->zw_err;
+		pthread_mutex_unlock(&zw->zw_lock);
+
+		/* After a write error, just drain the remaining records. */
+		if (err == 0)
+			err = zstream_rec_write(zw, rec);
+		zstream_rec_free(rec);
+
+		pthread_mutex_lock(&zw->zw_lock);
+		if (zw->zw_err == 0)
+			zw->zw_err = err;
+		zw->zw_head++;
+		pthread_cond_broadcast(&zw->zw_cv);
+	}
+	pthread_mutex_unlock(&zw->zw_lock);
+	return (NULL);
+}
+
+zstream_workq_t *
+zstream_workq_create(int nthreads, zstream_work_func_t *func, void *arg,
+    int outfd)
+{
+	zstream_workq_t *zw = safe_calloc(sizeof (*zw));
+
+	if (nthreads <= 0)
+		nthreads = 1;
+	pthread_mutex_init(&zw->zw_lock, NULL);
+	pthread_cond_init(&zw->zw_cv, NULL);
+	zw->zw_depth = 4 * nthreads;
+	zw->zw_ring = safe_calloc(zw->zw_depth * sizeof (zstream_rec_t *));
+	zw->zw_func = func;
+	zw->zw_arg = arg;
+	zw->zw_outfd = outfd;
+	zw->zw_nthreads = nthreads;
+	zw->zw_workers = safe_calloc(nthreads * sizeof (pthread_t));
+
+	for (int i = 0; i < nthreads; i++) {
+		if (pthread_create(&zw->zw_workers[i], NULL, zstream_worker,
+		    zw) != 0)
+			err(1, "pthread_create");
+	}
+	if (pthread_create(&zw->zw_writer, NULL, zstream_writer, zw) != 0)
+		err(1, "pthread_create");
+	return (zw);
+}
+
+/*
+ * Queue a record for output, waiting while the queue is full.  Returns the
+ * first error hit while writing out earlier records, if any.
+ */
+int
+zstream_workq_submit(zstream_workq_t *zw, zstream_rec_t *rec)
+{
+	pthread_mutex_lock(&zw->zw_lock);
+	while (zw->zw_tail - zw->zw_head >= zw->zw_depth)
+		pthread_cond_wait(&zw->zw_cv, &zw->zw_lock);
+	zw->zw_ring[zw->zw_tail++ % zw->zw_depth] = rec;
+	pthread_cond_broadcast(&zw->zw_cv);
+	int err = zw->zw_err;
+	pthread_mutex_unlock(&zw->zw_lock);
+	return (err);
+}
+
+/*
+ * Wait for every submitted record to be written and tear down the threads.
+ */
+int
+zstream_workq_destroy(zstream_workq_t *zw)
+{
+	pthread_mutex_lock(&zw->zw_lock);
+	zw->zw_exiting = B_TRUE;
+	pthread_cond_broadcast(&zw->zw_cv);
+	pthread_mutex_unlock(&zw->zw_lock);
+
+	for (int i = 0; i < zw->zw_nthreads; i++)
+		(void) pthread_join(zw->zw_workers[i], NULL);
+	(void) pthread_join(zw->zw_writer, NULL);
+
+	int err = zw->zw_err;
+	pthread_cond_destroy(&zw->zw_cv);
+	pthread_mutex_destroy(&zw->zw_lock);
+	free(zw->zw_workers);
+	free(zw->zw_ring);
+	free(zw);
+	return (err);
+}
+
+zstream_rec_t *
+zstream_rec_alloc(const dmu_replay_record_t *drr)
+{
+	zstream_rec_t *rec = safe_calloc(sizeof (*rec));
+	rec->zr_drr = *drr;
+	return (rec);
+}
+
+/*
+ * Read a payload of the given size from the input stream into the record.
+ */
+void
+zstream_rec_read_payload(zstream_rec_t *rec, uint64_t size, FILE *fp)
+{
+	if (size == 0)
+		return;
+	rec->zr_buf = safe_malloc(size);
+	rec->zr_payload_size = size;
+	(void) sfread(rec->zr_buf, size, fp);
+}
+
+/*
+ * Replace the record's payload with a newly allocated buffer.
+ */
+void
+zstream_rec_set_payload(zstream_rec_t *rec, char *buf, uint64_t size)
+{
+	if (rec->zr_buf != buf)
+		free(rec->zr_buf);
+	rec->zr_buf = buf;
+	rec->zr_payload_size = size;
+}
+
+void
+zstream_rec_free(zstream_rec_t *rec)
+{
+	free(rec->zr_buf);
+	free(rec);
+}
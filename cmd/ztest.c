@@ -204,6 +204,7 @@ typedef struct ztest_shared_opts {
 	int zo_mmp_test;
 	int zo_special_vdevs;
 	int zo_dump_dbgmsg;
+	int zo_bench;
 	int zo_gvars_count;
 	char zo_gvars[ZO_GVARS_MAX_COUNT][ZO_GVARS_MAX_ARGLEN];
 } ztest_shared_opts_t;
@@ -397,6 +398,7 @@ typedef struct ztest_info {
 	uint64_t	zi_iters;	/* iterations per execution */
 	uint64_t	*zi_interval;	/* execute every <interval> seconds */
 	const char	*zi_funcname;	/* name of test function */
+	boolean_t	zi_bench;	/* part of the benchmark mix */
 } ztest_info_t;
 
 typedef struct ztest_shared_callstate {
@@ -462,25 +464,38 @@ static uint64_t zopt_rarely = 60ULL * NANOSEC;		/* every 60 seconds */
 	    .zi_interval = (interval), \
 	    .zi_funcname = # func }
 
+/*
+ * Functions which are also part of the fixed workload mix run by the
+ * benchmark mode (-b).  They exercise the in-memory DMU, dbuf, dnode, ZAP
+ * and ZIL code paths without injecting faults or changing the pool
+ * configuration.
+ */
+#define	ZTI_BENCH(func, iters, interval) \
+	{   .zi_func = (func), \
+	    .zi_iters = (iters), \
+	    .zi_interval = (interval), \
+	    .zi_funcname = # func, \
+	    .zi_bench = B_TRUE }
+
 static ztest_info_t ztest_info[] = {
-	ZTI_INIT(ztest_dmu_read_write, 1, &zopt_always),
-	ZTI_INIT(ztest_dmu_write_parallel, 10, &zopt_always),
-	ZTI_INIT(ztest_dmu_object_alloc_free, 1, &zopt_always),
-	ZTI_INIT(ztest_dmu_object_next_chunk, 1, &zopt_sometimes),
-	ZTI_INIT(ztest_dmu_commit_callbacks, 1, &zopt_always),
-	ZTI_INIT(ztest_zap, 30, &zopt_always),
-	ZTI_INIT(ztest_zap_parallel, 100, &zopt_always),
+	ZTI_BENCH(ztest_dmu_read_write, 1, &zopt_always),
+	ZTI_BENCH(ztest_dmu_write_parallel, 10, &zopt_always),
+	ZTI_BENCH(ztest_dmu_object_alloc_free, 1, &zopt_always),
+	ZTI_BENCH(ztest_dmu_object_next_chunk, 1, &zopt_sometimes),
+	ZTI_BENCH(ztest_dmu_commit_callbacks, 1, &zopt_always),
+	ZTI_BENCH(ztest_zap, 30, &zopt_always),
+	ZTI_BENCH(ztest_zap_parallel, 100, &zopt_always),
 	ZTI_INIT(ztest_split_pool, 1, &zopt_sometimes),
-	ZTI_INIT(ztest_zil_commit, 1, &zopt_incessant),
+	ZTI_BENCH(ztest_zil_commit, 1, &zopt_incessant),
 	ZTI_INIT(ztest_zil_remount, 1, &zopt_sometimes),
-	ZTI_INIT(ztest_dmu_read_write_zcopy, 1, &zopt_often),
+	ZTI_BENCH(ztest_dmu_read_write_zcopy, 1, &zopt_often),
 	ZTI_INIT(ztest_dmu_objset_create_destroy, 1, &zopt_often),
 	ZTI_INIT(ztest_dsl_prop_get_set, 1, &zopt_often),
 	ZTI_INIT(ztest_spa_prop_get_set, 1, &zopt_sometimes),
 #if 0
 	ZTI_INIT(ztest_dmu_prealloc, 1, &zopt_sometimes),
 #endif
-	ZTI_INIT(ztest_fzap, 1, &zopt_sometimes),
+	ZTI_BENCH(ztest_fzap, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_dmu_snapshot_create_destroy, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_spa_create_destroy, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_fault_inject, 1, &zopt_sometimes),
@@ -566,6 +581,17 @@ static pthread_rwlock_t ztest_name_lock;
 static boolean_t ztest_dump_core = B_TRUE;
 static boolean_t ztest_exiting;
 
+/*
+ * txg sync times sampled while running the benchmark mode.
+ */
+typedef struct ztest_bench_txg {
+	boolean_t	zbt_exiting;
+	uint64_t	zbt_txgs;	/* txgs synced */
+	uint64_t	zbt_samples;	/* sync times observed */
+	hrtime_t	zbt_total;	/* total of observed sync times */
+	hrtime_t	zbt_max;	/* longest observed sync time */
+} ztest_bench_txg_t;
+
 /* Global commit callback list */
 static ztest_cb_list_t zcl;
 /* Commit cb delay */
@@ -808,6 +834,9 @@ static ztest_option_t option_table[] = {
 	{ 'X', "raidz-expansion", NULL,
 	    "Perform a dedicated raidz expansion test",
 	    NO_DEFAULT, NULL},
+	{ 'b', "benchmark", NULL,
+	    "Run a fixed workload mix for the run time and report throughput",
+	    NO_DEFAULT, NULL},
 	{ 'o',	"option", "\"NAME=VALUE\"",
 	    "Set the named tunable to the given value",
 	    NO_DEFAULT, NULL},
@@ -1057,6 +1086,9 @@ process_options(int argc, char **argv)
 		case 'X':
 			zo->zo_raidz_expand_test = RAIDZ_EXPAND_REQUESTED;
 			break;
+		case 'b':
+			zo->zo_bench = 1;
+			break;
 		case 'E':
 			zo->zo_init = 0;
 			break;
@@ -1118,6 +1150,25 @@ process_options(int argc, char **argv)
 		raid_kind = "raidz";
 	}
 
+	/*
+	 * The benchmark runs a single uninterrupted pass, and avoids the
+	 * random pool layout choices so runs can be compared.
+	 */
+	if (zo->zo_bench) {
+		if (zo->zo_raidz_expand_test != RAIDZ_EXPAND_NONE) {
+			(void) fprintf(stderr, "-b and -X are mutually "
+			    "exclusive\n");
+			usage(B_FALSE);
+		}
+		zo->zo_killrate = 0;
+		zo->zo_passtime = MAX(1, zo->zo_time);
+		zo->zo_mmp_test = 0;
+		if (zo->zo_special_vdevs == ZTEST_VDEV_CLASS_RND)
+			zo->zo_special_vdevs = ZTEST_VDEV_CLASS_OFF;
+		if (strcmp(raid_kind, "random") == 0)
+			raid_kind = "raidz";
+	}
+
 	if (strcmp(raid_kind, "random") == 0) {
 		switch (ztest_random(3)) {
 		case 0:
@@ -6227,7 +6278,8 @@ ztest_dsl_prop_get_set(ztest_ds_t *zd, uint64_t id)
 		ZFS_PROP_CHECKSUM,
 		ZFS_PROP_COMPRESSION,
 		ZFS_PROP_COPIES,
-		ZFS_PROP_DEDUP
+		ZFS_PROP_DEDUP,
+		ZFS_PROP_PREFETCH
 	};
 
 	(void) pthread_rwlock_rdlock(&ztest_name_lock);
@@ -6242,6 +6294,27 @@ ztest_dsl_prop_get_set(ztest_ds_t *zd, uint64_t id)
 	    ztest_random_blocksize(), (int)ztest_random(2));
 	ASSERT(error == 0 || error == ENOSPC);
 
+	/*
+	 * Exercise per-dataset ARC limits and reservations; zero disables.
+	 */
+	error = ztest_dsl_prop_set_uint64(zd->zd_name, ZFS_PROP_ARC_LIMIT,
+	    ztest_random(2) ? 0 : (ztest_random(16) + 1) << 20,
+	    (int)ztest_random(2));
+	ASSERT(error == 0 || error == ENOSPC);
+
+	error = ztest_dsl_prop_set_uint64(zd->zd_name, ZFS_PROP_ARC_RESERVE,
+	    ztest_random(2) ? 0 : (ztest_random(4) + 1) << 20,
+	    (int)ztest_random(2));
+	ASSERT(error == 0 || error == ENOSPC);
+
+	/*
+	 * Exercise the per-dataset write throttle; zero disables.
+	 */
+	error = ztest_dsl_prop_set_uint64(zd->zd_name, ZFS_PROP_DIRTY_MAX,
+	    ztest_random(2) ? 0 : (ztest_random(16) + 1) << 20,
+	    (int)ztest_random(2));
+	ASSERT(error == 0 || error == ENOSPC);
+
 	(void) pthread_rwlock_unlock(&ztest_name_lock);
 }
 
@@ -7732,10 +7805,16 @@ ztest_thread(void *arg)
 			break;
 
 		/*
-		 * Pick a random function to execute.
+		 * Pick a random function to execute.  The benchmark runs
+		 * its functions back to back, ignoring their intervals.
 		 */
 		rand = ztest_random(ZTEST_FUNCS);
 		zi = &ztest_info[rand];
+		if (ztest_opts.zo_bench) {
+			if (zi->zi_bench)
+				ztest_execute(rand, zi, id);
+			continue;
+		}
 		zc = ZTEST_GET_SHARED_CALLSTATE(rand);
 		call_next = zc->zc_next;
 
@@ -8306,10 +8385,84 @@ ztest_raidz_expand_run(ztest_shared_t *zs, spa_t *spa)
 	ztest_kill(zs);
 }
 
+/*
+ * Sample the duration of every spa_sync() that completes while the
+ * benchmark is running.  Syncs which finish within the same poll interval
+ * are counted, but only the last one's duration is observed.
+ */
+static __attribute__((noreturn)) void
+ztest_bench_txg_thread(void *arg)
+{
+	ztest_bench_txg_t *zbt = arg;
+	spa_t *spa = ztest_spa;
+	uint64_t last = spa_last_synced_txg(spa);
+
+	while (!zbt->zbt_exiting) {
+		uint64_t txg = spa_last_synced_txg(spa);
+
+		if (txg != last) {
+			hrtime_t t = spa->spa_sync_lasttime;
+
+			zbt->zbt_txgs += txg - last;
+			zbt->zbt_samples++;
+			zbt->zbt_total += t;
+			zbt->zbt_max = MAX(zbt->zbt_max, t);
+			last = txg;
+		}
+		(void) poll(NULL, 0, 1);
+	}
+
+	thread_exit();
+}
+
+static void
+ztest_bench_report(hrtime_t elapsed, const ztest_bench_txg_t *zbt)
+{
+	double secs = MAX((double)elapsed / NANOSEC, 1e-9);
+	uint64_t ops = 0;
+
+	(void) printf("\nBenchmark results: %.1f seconds, %d threads, "
+	    "%d datasets\n\n", secs, ztest_opts.zo_threads,
+	    MIN(ztest_opts.zo_datasets, ztest_opts.zo_threads));
+	(void) printf("%10s %12s %12s   %s\n",
+	    "Calls", "Ops/sec", "Avg usec", "Function");
+	(void) printf("%10s %12s %12s   %s\n",
+	    "-----", "-------", "--------", "--------");
+	for (int f = 0; f < ZTEST_FUNCS; f++) {
+		ztest_info_t *zi = &ztest_info[f];
+		ztest_shared_callstate_t *zc = ZTEST_GET_SHARED_CALLSTATE(f);
+
+		if (!zi->zi_bench)
+			continue;
+
+		ops += zc->zc_count * zi->zi_iters;
+		(void) printf("%10"PRIu64" %12.1f %12.1f   %s\n",
+		    zc->zc_count, zc->zc_count * zi->zi_iters / secs,
+		    zc->zc_count == 0 ? 0.0 :
+		    (double)zc->zc_time / zc->zc_count / 1000,
+		    zi->zi_funcname);
+	}
+	(void) printf("%10s %12.1f %12s   %s\n", "", ops / secs, "", "total");
+
+	(void) printf("\ntxg sync: %"PRIu64" txgs, %.1f ms avg, "
+	    "%.1f ms max\n", zbt->zbt_txgs,
+	    zbt->zbt_samples == 0 ? 0.0 :
+	    (double)zbt->zbt_total / zbt->zbt_samples / MICROSEC,
+	    (double)zbt->zbt_max / MICROSEC);
+	(void) printf("lock contention: mutex %"PRIu64" contended, "
+	    "%.1f ms waited; rwlock %"PRIu64" contended, %.1f ms waited\n\n",
+	    zfs_lockstat.zls_mutex_contended,
+	    (double)zfs_lockstat.zls_mutex_wait / MICROSEC,
+	    zfs_lockstat.zls_rw_contended,
+	    (double)zfs_lockstat.zls_rw_wait / MICROSEC);
+}
+
 static void
 ztest_generic_run(ztest_shared_t *zs, spa_t *spa)
 {
-	kthread_t **run_threads;
+	kthread_t **run_threads, *bench_thread = NULL;
+	ztest_bench_txg_t zbt = { 0 };
+	hrtime_t bench_start = 0;
 	int i, ndatasets;
 
 	run_threads = umem_zalloc(ztest_opts.zo_threads * sizeof (kthread_t *),
@@ -8326,6 +8479,14 @@ ztest_generic_run(ztest_shared_t *zs, spa_t *spa)
 	for (i = 0; i < ndatasets; i++)
 		VERIFY0(ztest_dataset_open(i));
 
+	if (ztest_opts.zo_bench) {
+		memset(&zfs_lockstat, 0, sizeof (zfs_lockstat));
+		zfs_lockstat_enabled = B_TRUE;
+		bench_thread = thread_create(NULL, 0, ztest_bench_txg_thread,
+		    &zbt, 0, NULL, TS_RUN | TS_JOINABLE, defclsyspri);
+		bench_start = gethrtime();
+	}
+
 	/*
 	 * Kick off all the tests that run in parallel.
 	 */
@@ -8341,6 +8502,15 @@ ztest_generic_run(ztest_shared_t *zs, spa_t *spa)
 	for (i = 0; i < ztest_opts.zo_threads; i++)
 		VERIFY0(thread_join(run_threads[i]));
 
+	if (ztest_opts.zo_bench) {
+		hrtime_t elapsed = gethrtime() - bench_start;
+
+		zfs_lockstat_enabled = B_FALSE;
+		zbt.zbt_exiting = B_TRUE;
+		VERIFY0(thread_join(bench_thread));
+		ztest_bench_report(elapsed, &zbt);
+	}
+
 	/*
 	 * Close all datasets. This must be done after all the threads
 	 * are joined so we can be sure none of the datasets are in-use
@@ -233,6 +233,33 @@ AC_DEFUN([ZFS_AC_KERNEL_BIO_ALLOC_4ARG], [
 	])
 ])
 
+dnl #
+dnl # Linux 5.17 API,
+dnl #
+dnl # REQ_HIPRI was renamed to REQ_POLLED and blk_poll() was replaced by
+dnl # bio_poll(), which polls for the completion of a specific bio.
+dnl #
+AC_DEFUN([ZFS_AC_KERNEL_SRC_BIO_POLL], [
+	ZFS_LINUX_TEST_SRC([bio_poll], [
+		#include <linux/bio.h>
+		#include <linux/blkdev.h>
+	],[
+		struct bio *bio = NULL;
+		bio->bi_opf |= REQ_POLLED;
+		int ret __attribute__ ((unused)) = bio_poll(bio, NULL, 0);
+	], [], [ZFS_META_LICENSE])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_BIO_POLL], [
+	AC_MSG_CHECKING([whether bio_poll() is available])
+	ZFS_LINUX_TEST_RESULT([bio_poll_license], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_BIO_POLL, 1, [bio_poll() is available])
+	],[
+		AC_MSG_RESULT(no)
+	])
+])
+
 AC_DEFUN([ZFS_AC_KERNEL_SRC_BIO], [
 	ZFS_AC_KERNEL_SRC_BIO_OPS
 	ZFS_AC_KERNEL_SRC_BIO_SET_DEV
@@ -242,6 +269,7 @@ AC_DEFUN([ZFS_AC_KERNEL_SRC_BIO], [
 	ZFS_AC_KERNEL_SRC_BDEV_SUBMIT_BIO_RETURNS_VOID
 	ZFS_AC_KERNEL_SRC_BIO_SET_DEV_MACRO
 	ZFS_AC_KERNEL_SRC_BIO_ALLOC_4ARG
+	ZFS_AC_KERNEL_SRC_BIO_POLL
 ])
 
 AC_DEFUN([ZFS_AC_KERNEL_BIO], [
@@ -252,4 +280,5 @@ AC_DEFUN([ZFS_AC_KERNEL_BIO], [
 	ZFS_AC_KERNEL_BIO_BDEV_DISK
 	ZFS_AC_KERNEL_BDEV_SUBMIT_BIO_RETURNS_VOID
 	ZFS_AC_KERNEL_BIO_ALLOC_4ARG
+	ZFS_AC_KERNEL_BIO_POLL
 ])
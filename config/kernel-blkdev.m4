@@ -538,6 +538,30 @@ AC_DEFUN([ZFS_AC_KERNEL_BLKDEV_BDEV_NR_BYTES], [
 	])
 ])
 
+dnl #
+dnl # 5.14 API change
+dnl # Added bdev_is_zoned() helper.
+dnl #
+AC_DEFUN([ZFS_AC_KERNEL_SRC_BLKDEV_BDEV_IS_ZONED], [
+	ZFS_LINUX_TEST_SRC([bdev_is_zoned], [
+		#include <linux/blkdev.h>
+	],[
+		struct block_device *bdev = NULL;
+		bool zoned __attribute__ ((unused)) = bdev_is_zoned(bdev);
+		sector_t zs __attribute__ ((unused)) = bdev_zone_sectors(bdev);
+	])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_BLKDEV_BDEV_IS_ZONED], [
+	AC_MSG_CHECKING([whether bdev_is_zoned() is available])
+	ZFS_LINUX_TEST_RESULT([bdev_is_zoned], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_BDEV_IS_ZONED, 1, [bdev_is_zoned() is available])
+	],[
+		AC_MSG_RESULT(no)
+	])
+])
+
 dnl #
 dnl # 5.20 API change,
 dnl # Removed bdevname(), snprintf(.., %pg) should be used.
@@ -752,6 +776,7 @@ AC_DEFUN([ZFS_AC_KERNEL_SRC_BLKDEV], [
 	ZFS_AC_KERNEL_SRC_BLKDEV_BDEV_CHECK_MEDIA_CHANGE
 	ZFS_AC_KERNEL_SRC_BLKDEV_BDEV_WHOLE
 	ZFS_AC_KERNEL_SRC_BLKDEV_BDEV_NR_BYTES
+	ZFS_AC_KERNEL_SRC_BLKDEV_BDEV_IS_ZONED
 	ZFS_AC_KERNEL_SRC_BLKDEV_BDEVNAME
 	ZFS_AC_KERNEL_SRC_BLKDEV_ISSUE_DISCARD
 	ZFS_AC_KERNEL_SRC_BLKDEV_BDEV_KOBJ
@@ -773,6 +798,7 @@ AC_DEFUN([ZFS_AC_KERNEL_BLKDEV], [
 	ZFS_AC_KERNEL_BLKDEV_BDEV_CHECK_MEDIA_CHANGE
 	ZFS_AC_KERNEL_BLKDEV_BDEV_WHOLE
 	ZFS_AC_KERNEL_BLKDEV_BDEV_NR_BYTES
+	ZFS_AC_KERNEL_BLKDEV_BDEV_IS_ZONED
 	ZFS_AC_KERNEL_BLKDEV_BDEVNAME
 	ZFS_AC_KERNEL_BLKDEV_GET_ERESTARTSYS
 	ZFS_AC_KERNEL_BLKDEV_ISSUE_DISCARD
@@ -0,0 +1,26 @@
+dnl #
+dnl # Linux 5.16 dropped the unused res2 argument of kiocb->ki_complete().
+dnl #
+AC_DEFUN([ZFS_AC_KERNEL_SRC_KIOCB_KI_COMPLETE], [
+	ZFS_LINUX_TEST_SRC([kiocb_ki_complete_2args], [
+		#include <linux/fs.h>
+
+		static void complete(struct kiocb *kiocb, long ret)
+		    { (void) kiocb; (void) ret; }
+
+		static struct kiocb kiocb __attribute__ ((unused)) = {
+			.ki_complete = complete,
+		};
+	],[])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_KIOCB_KI_COMPLETE], [
+	AC_MSG_CHECKING([whether kiocb->ki_complete() takes 2 arguments])
+	ZFS_LINUX_TEST_RESULT([kiocb_ki_complete_2args], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_KI_COMPLETE_2ARGS, 1,
+		    [kiocb->ki_complete() takes 2 arguments])
+	],[
+		AC_MSG_RESULT(no)
+	])
+])
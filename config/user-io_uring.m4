@@ -0,0 +1,8 @@
+dnl #
+dnl # Check for <linux/io_uring.h>, used by libzpool to issue file vdev
+dnl # I/O asynchronously.  The system calls are made directly, so no
+dnl # library is required.
+dnl #
+AC_DEFUN([ZFS_AC_CONFIG_USER_IO_URING], [
+	AC_CHECK_HEADERS([linux/io_uring.h])
+])
@@ -172,6 +172,31 @@ AC_DEFUN([ZFS_AC_DEBUG_KMEM_TRACKING], [
 	AC_MSG_RESULT([$enable_debug_kmem_tracking])
 ])
 
+dnl #
+dnl # Disabled by default, provides lock contention statistics.  When enabled
+dnl # every kmutex_t and krwlock_t records which mutex_init()/rw_init() call
+dnl # site it was initialized at, and the spl_lockstat_enabled module option
+dnl # can be set to count acquisitions, contended acquisitions and the time
+dnl # spent waiting for each of these lock classes.  Only the Linux kernel
+dnl # modules are instrumented.
+dnl #
+AC_DEFUN([ZFS_AC_DEBUG_LOCKSTAT], [
+	AC_MSG_CHECKING([whether lock contention statistics are enabled])
+	AC_ARG_ENABLE([debug-lockstat],
+		[AS_HELP_STRING([--enable-debug-lockstat],
+		[Enable lock contention statistics @<:@default=no@:>@])],
+		[],
+		[enable_debug_lockstat=no])
+
+	AS_IF([test "x$enable_debug_lockstat" = xyes], [
+		KERNEL_DEBUG_CPPFLAGS="${KERNEL_DEBUG_CPPFLAGS} -DDEBUG_LOCKSTAT"
+	])
+
+	AC_SUBST(KERNEL_DEBUG_CPPFLAGS)
+
+	AC_MSG_RESULT([$enable_debug_lockstat])
+])
+
 AC_DEFUN([ZFS_AC_DEBUG_INVARIANTS_DETECT_FREEBSD], [
 	AS_IF([sysctl -n kern.conftxt | grep -Fqx $'options\tINVARIANTS'],
 		[enable_invariants="yes"],
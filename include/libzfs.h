@@ -302,6 +302,7 @@ typedef struct initialize_cbdata {
  * Functions to manipulate pool and vdev state
  */
 _LIBZFS_H int zpool_scan(zpool_handle_t *, pool_scan_func_t, pool_scrub_cmd_t);
+_LIBZFS_H int zpool_scan_throttle(zpool_handle_t *, uint64_t, uint64_t);
 _LIBZFS_H int zpool_scan_range(zpool_handle_t *, pool_scan_func_t,
     pool_scrub_cmd_t, time_t, time_t);
 _LIBZFS_H int zpool_initialize_one(zpool_handle_t *, void *);
@@ -843,6 +844,10 @@ typedef struct sendflags {
 
 	/* stream represents a partially received dataset */
 	boolean_t saved;
+
+	/* send only part "part" (from 0) of "nparts" parts, if nonzero */
+	int part;
+	int nparts;
 } sendflags_t;
 
 typedef boolean_t (snapfilter_cb_t)(zfs_handle_t *, void *);
@@ -988,6 +993,7 @@ _LIBZFS_H int zfs_unshare(zfs_handle_t *zhp, const char *mountpoint,
     const enum sa_protocol *proto);
 _LIBZFS_H int zfs_unshareall(zfs_handle_t *zhp,
     const enum sa_protocol *proto);
+_LIBZFS_H void zfs_begin_shares(const enum sa_protocol *proto);
 _LIBZFS_H void zfs_commit_shares(const enum sa_protocol *proto);
 _LIBZFS_H void zfs_truncate_shares(const enum sa_protocol *proto);
 
@@ -102,6 +102,8 @@ _LIBZFS_CORE_H int lzc_send_redacted(const char *, const char *, int,
     enum lzc_send_flags, const char *);
 _LIBZFS_CORE_H int lzc_send_resume_redacted(const char *, const char *, int,
     enum lzc_send_flags, uint64_t, uint64_t, const char *);
+_LIBZFS_CORE_H int lzc_send_part(const char *, const char *, int,
+    enum lzc_send_flags, const char *, uint64_t, uint64_t);
 _LIBZFS_CORE_H int lzc_receive(const char *, nvlist_t *, const char *,
     boolean_t, boolean_t, int);
 _LIBZFS_CORE_H int lzc_receive_resumable(const char *, nvlist_t *, const char *,
@@ -165,6 +167,9 @@ _LIBZFS_CORE_H int lzc_scrub(zfs_ioc_t, const char *, nvlist_t *, nvlist_t **);
 _LIBZFS_CORE_H int lzc_ddt_prune(const char *, zpool_ddt_prune_unit_t,
     uint64_t);
 
+_LIBZFS_CORE_H int lzc_get_dataset_props(const char *, nvlist_t *,
+    nvlist_t **);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -82,6 +82,14 @@ extern "C" {
 #define	kpreempt_enable() critical_exit()
 #define	CPU_SEQID curcpu
 #define	CPU_SEQID_UNSTABLE curcpu
+#ifdef _STANDALONE
+#define	max_nnodes 1
+#define	CPU_NODEID_UNSTABLE 0
+#else /* _STANDALONE */
+extern int vm_ndomains;
+#define	max_nnodes vm_ndomains
+#define	CPU_NODEID_UNSTABLE PCPU_GET(domain)
+#endif /* _STANDALONE */
 #define	is_system_labeled()		0
 /*
  * Convert a single byte to/from binary-coded decimal (BCD).
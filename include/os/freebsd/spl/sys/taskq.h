@@ -102,6 +102,9 @@ taskq_t	*taskq_create_proc(const char *, int, pri_t, int, int,
     struct proc *, uint_t);
 taskq_t	*taskq_create_sysdc(const char *, int, int, int,
     struct proc *, uint_t, uint_t);
+#define	taskq_create_node(name, nthreads, pri, min, max, flags, node) \
+	((void) sizeof (node), \
+	    taskq_create(name, nthreads, pri, min, max, flags))
 void	nulltask(void *);
 extern void taskq_destroy(taskq_t *);
 extern void taskq_wait_id(taskq_t *, taskqid_t);
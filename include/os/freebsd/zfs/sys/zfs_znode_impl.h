@@ -60,7 +60,13 @@ extern "C" {
 	uint64_t		z_gid;          \
 	uint64_t		z_gen;          \
 	uint64_t		z_atime[2];     \
-	uint64_t		z_links;
+	uint64_t		z_links;	\
+	boolean_t		z_stat_valid;	\
+	uint64_t		z_stat_gen;	\
+	uint64_t		z_stat_mtime[2];	\
+	uint64_t		z_stat_ctime[2];	\
+	uint64_t		z_stat_crtime[2];	\
+	uint64_t		z_stat_rdev;
 
 #define	ZFS_LINK_MAX	UINT64_MAX
 
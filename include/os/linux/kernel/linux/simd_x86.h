@@ -623,6 +623,19 @@ zfs_vpclmulqdq_available(void)
 #endif
 }
 
+/*
+ * Check if GFNI instruction set is available
+ */
+static inline boolean_t
+zfs_gfni_available(void)
+{
+#if defined(X86_FEATURE_GFNI)
+	return (!!boot_cpu_has(X86_FEATURE_GFNI));
+#else
+	return (B_FALSE);
+#endif
+}
+
 /*
  * Check if SHA_NI instruction set is available
  */
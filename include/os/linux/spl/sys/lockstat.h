@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *  This file is part of the SPL, Solaris Porting Layer.
+ *
+ *  The SPL is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *  The SPL is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with the SPL.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SPL_LOCKSTAT_H
+#define	_SPL_LOCKSTAT_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <linux/atomic.h>
+#include <linux/list.h>
+#include <linux/module.h>
+
+/*
+ * Lock contention statistics, available when built with
+ * --enable-debug-lockstat.
+ *
+ * Every mutex_init() and rw_init() call site gets its own static lock
+ * class, in the same way lockdep assigns lock classes, so all the locks
+ * initialized at one place (e.g. every buffer hash lock) are reported as
+ * a single entry.  While the spl_lockstat_enabled module option is set,
+ * each acquisition is counted against the class of the lock.  When the
+ * lock appears to be held at the time of the acquisition, it is also
+ * counted as contended and the time spent waiting for it is accumulated.
+ * Classes are listed in /proc/spl/kstat/spl/lockstat the first time one
+ * of their locks is acquired with statistics enabled.
+ */
+typedef enum {
+	SPL_LOCKSTAT_MUTEX,
+	SPL_LOCKSTAT_RWLOCK,
+} spl_lockstat_type_t;
+
+typedef struct spl_lockstat_class {
+	const char		*lsc_name;
+	const char		*lsc_file;
+	int			lsc_line;
+	spl_lockstat_type_t	lsc_type;
+	struct module		*lsc_owner;
+	atomic_t		lsc_registered;
+	struct list_head	lsc_list;
+	atomic64_t		lsc_acquired;
+	atomic64_t		lsc_contended;
+	atomic64_t		lsc_wait;
+	atomic64_t		lsc_wait_max;
+} spl_lockstat_class_t;
+
+#ifdef DEBUG_LOCKSTAT
+extern int spl_lockstat_enabled;
+
+extern void spl_lockstat_record(spl_lockstat_class_t *lsc, hrtime_t start);
+extern void spl_lockstat_purge(struct module *owner);
+extern void spl_lockstat_init(void);
+extern void spl_lockstat_fini(void);
+
+/*
+ * Must be a #define so that every caller gets its own static class.
+ */
+#define	spl_lockstat_class_init(lscp, name, type)		\
+{								\
+	static spl_lockstat_class_t __lsc = {			\
+		.lsc_name = (name),				\
+		.lsc_file = __FILE__,				\
+		.lsc_line = __LINE__,				\
+		.lsc_type = (type),				\
+		.lsc_owner = THIS_MODULE,			\
+	};							\
+	*(lscp) = &__lsc;					\
+}
+
+/*
+ * Acquire a lock with the given statement, counting the acquisition
+ * against the lock class when statistics are enabled.
+ */
+#define	spl_lockstat_enter(lsc, held, lock)			\
+{								\
+	spl_lockstat_class_t *_lsc_ = (lsc);			\
+								\
+	if (unlikely(spl_lockstat_enabled) && _lsc_ != NULL) {	\
+		hrtime_t _start_ = (held) ? gethrtime() : 0;	\
+		lock;						\
+		spl_lockstat_record(_lsc_, _start_);		\
+	} else {						\
+		lock;						\
+	}							\
+}
+
+#define	spl_lockstat_acquired(lsc)				\
+{								\
+	spl_lockstat_class_t *_lsc_ = (lsc);			\
+								\
+	if (unlikely(spl_lockstat_enabled) && _lsc_ != NULL)	\
+		spl_lockstat_record(_lsc_, 0);			\
+}
+#else  /* DEBUG_LOCKSTAT */
+#define	spl_lockstat_purge(owner)		((void) 0)
+#define	spl_lockstat_init()			((void) 0)
+#define	spl_lockstat_fini()			((void) 0)
+#define	spl_lockstat_class_init(lscp, name, type)
+#define	spl_lockstat_enter(lsc, held, lock)	{ lock; }
+#define	spl_lockstat_acquired(lsc)		((void) 0)
+#endif /* DEBUG_LOCKSTAT */
+
+#endif /* _SPL_LOCKSTAT_H */
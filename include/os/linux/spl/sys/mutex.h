@@ -30,6 +30,7 @@
 #include <linux/mutex.h>
 #include <linux/lockdep.h>
 #include <linux/compiler_compat.h>
+#include <sys/lockstat.h>
 
 typedef enum {
 	MUTEX_DEFAULT	= 0,
@@ -45,6 +46,9 @@ typedef struct {
 #ifdef CONFIG_LOCKDEP
 	kmutex_type_t		m_type;
 #endif /* CONFIG_LOCKDEP */
+#ifdef DEBUG_LOCKSTAT
+	spl_lockstat_class_t	*m_lsc;
+#endif /* DEBUG_LOCKSTAT */
 } kmutex_t;
 
 #define	MUTEX(mp)		(&((mp)->m_mutex))
@@ -106,6 +110,8 @@ spl_mutex_lockdep_on_maybe(kmutex_t *mp)			\
 	spin_lock_init(&(mp)->m_lock);				\
 	spl_mutex_clear_owner(mp);				\
 	spl_mutex_set_type(mp, type);				\
+	spl_lockstat_class_init(&(mp)->m_lsc, #mp,		\
+	    SPL_LOCKSTAT_MUTEX);				\
 }
 
 #undef mutex_destroy
@@ -120,8 +126,10 @@ spl_mutex_lockdep_on_maybe(kmutex_t *mp)			\
 	int _rc_;						\
 								\
 	spl_mutex_lockdep_off_maybe(mp);			\
-	if ((_rc_ = mutex_trylock(MUTEX(mp))) == 1)		\
+	if ((_rc_ = mutex_trylock(MUTEX(mp))) == 1) {		\
 		spl_mutex_set_owner(mp);			\
+		spl_lockstat_acquired((mp)->m_lsc);		\
+	}							\
 	spl_mutex_lockdep_on_maybe(mp);				\
 								\
 	_rc_;							\
@@ -133,7 +141,8 @@ spl_mutex_lockdep_on_maybe(kmutex_t *mp)			\
 {								\
 	ASSERT3P(mutex_owner(mp), !=, current);			\
 	spl_mutex_lockdep_off_maybe(mp);			\
-	mutex_lock_nested(MUTEX(mp), (subclass));		\
+	spl_lockstat_enter((mp)->m_lsc, mutex_is_locked(MUTEX(mp)), \
+	    mutex_lock_nested(MUTEX(mp), (subclass)));		\
 	spl_mutex_lockdep_on_maybe(mp);				\
 	spl_mutex_set_owner(mp);				\
 }
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <linux/rwsem.h>
 #include <linux/sched.h>
+#include <sys/lockstat.h>
 
 typedef enum {
 	RW_DRIVER	= 2,
@@ -47,6 +48,9 @@ typedef struct {
 #ifdef CONFIG_LOCKDEP
 	krw_type_t	rw_type;
 #endif /* CONFIG_LOCKDEP */
+#ifdef DEBUG_LOCKSTAT
+	spl_lockstat_class_t *rw_lsc;
+#endif /* DEBUG_LOCKSTAT */
 } krwlock_t;
 
 #define	SEM(rwp)	(&(rwp)->rw_rwlock)
@@ -125,6 +129,8 @@ RW_READ_HELD(krwlock_t *rwp)
 	__init_rwsem(SEM(rwp), #rwp, &__key);				\
 	spl_rw_clear_owner(rwp);					\
 	spl_rw_set_type(rwp, type);					\
+	spl_lockstat_class_init(&(rwp)->rw_lsc, #rwp,			\
+	    SPL_LOCKSTAT_RWLOCK);					\
 })
 
 /*
@@ -154,6 +160,8 @@ RW_READ_HELD(krwlock_t *rwp)
 	default:							\
 		VERIFY(0);						\
 	}								\
+	if (_rc_)							\
+		spl_lockstat_acquired((rwp)->rw_lsc);			\
 	spl_rw_lockdep_on_maybe(rwp);					\
 	_rc_;								\
 })
@@ -163,10 +171,12 @@ RW_READ_HELD(krwlock_t *rwp)
 	spl_rw_lockdep_off_maybe(rwp);					\
 	switch (rw) {							\
 	case RW_READER:							\
-		down_read(SEM(rwp));					\
+		spl_lockstat_enter((rwp)->rw_lsc,			\
+		    rw_owner(rwp) != NULL, down_read(SEM(rwp)));	\
 		break;							\
 	case RW_WRITER:							\
-		down_write(SEM(rwp));					\
+		spl_lockstat_enter((rwp)->rw_lsc,			\
+		    RW_LOCK_HELD(rwp), down_write(SEM(rwp)));		\
 		spl_rw_set_owner(rwp);					\
 		break;							\
 	default:							\
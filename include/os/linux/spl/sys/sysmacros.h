@@ -78,6 +78,8 @@
 #define	boot_ncpus			num_online_cpus()
 #define	CPU_SEQID			smp_processor_id()
 #define	CPU_SEQID_UNSTABLE		raw_smp_processor_id()
+#define	max_nnodes			nr_node_ids
+#define	CPU_NODEID_UNSTABLE		numa_node_id()
 #define	is_system_labeled()		0
 
 #ifndef RLIM64_INFINITY
@@ -70,6 +70,10 @@ extern void zfs_unlinked_drain_stop_wait(zfsvfs_t *zfsvfs);
 extern int zfs_sticky_remove_access(znode_t *, znode_t *, cred_t *cr);
 extern int zfs_get_xattrdir(znode_t *, znode_t **, cred_t *, int);
 extern int zfs_make_xattrdir(znode_t *, vattr_t *, znode_t **, cred_t *);
+extern void zfs_dnlc_init(void);
+extern void zfs_dnlc_fini(void);
+extern void zfs_dnlc_purge(znode_t *);
+extern void zfs_dnlc_free(znode_t *);
 
 #ifdef	__cplusplus
 }
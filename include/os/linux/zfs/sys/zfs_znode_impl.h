@@ -50,6 +50,7 @@ extern "C" {
 
 #define	ZNODE_OS_FIELDS			\
 	inode_timespec_t z_btime; /* creation/birth time (cached) */ \
+	struct zfs_dnlc	*z_dnlc; /* name lookup cache, see zfs_dir.c */ \
 	struct inode	z_inode;
 
 /*
@@ -82,6 +82,7 @@ struct abd_iter {
 };
 
 extern abd_t *abd_zero_scatter;
+extern abd_t *abd_sink_scatter;
 
 abd_t *abd_gang_get_offset(abd_t *, size_t *);
 abd_t *abd_alloc_struct(size_t);
@@ -257,6 +257,21 @@ typedef struct arc_buf_info {
 	enum zio_compress	abi_l2arc_compress;
 } arc_buf_info_t;
 
+/*
+ * One block of an arc_read_batch() request.  arr_flags and arr_zio_flags
+ * are passed to arc_read() for this block (ARC_FLAG_WAIT is ignored), and
+ * arr_error receives its return value.
+ */
+typedef struct arc_read_req {
+	const blkptr_t		*arr_bp;
+	const zbookmark_phys_t	*arr_zb;
+	arc_read_done_func_t	*arr_done;
+	void			*arr_private;
+	arc_flags_t		arr_flags;
+	int			arr_zio_flags;
+	int			arr_error;
+} arc_read_req_t;
+
 /*
  * Flags returned by arc_cached; describes which part of the arc
  * the block is cached in.
@@ -318,6 +333,8 @@ int arc_referenced(arc_buf_t *buf);
 int arc_read(zio_t *pio, spa_t *spa, const blkptr_t *bp,
     arc_read_done_func_t *done, void *priv, zio_priority_t priority,
     int flags, arc_flags_t *arc_flags, const zbookmark_phys_t *zb);
+int arc_read_batch(zio_t *pio, spa_t *spa, arc_read_req_t *reqs,
+    uint_t nreqs, zio_priority_t priority, boolean_t wait);
 zio_t *arc_write(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
     arc_buf_t *buf, boolean_t uncached, boolean_t l2arc, const zio_prop_t *zp,
     arc_write_done_func_t *ready, arc_write_done_func_t *child_ready,
@@ -328,6 +345,19 @@ arc_prune_t *arc_add_prune_callback(arc_prune_func_t *func, void *priv);
 void arc_remove_prune_callback(arc_prune_t *p);
 void arc_freed(spa_t *spa, const blkptr_t *bp);
 int arc_cached(spa_t *spa, const blkptr_t *bp);
+uint_t arc_frequency(spa_t *spa, const blkptr_t *bp, boolean_t record);
+boolean_t arc_admit(spa_t *spa, const blkptr_t *bp, boolean_t record);
+
+/*
+ * Account of a pool's dedup table blocks, which are charged to it instead of
+ * to the MOS.
+ */
+#define	ARC_ACCOUNT_DDT		UINT64_MAX
+
+uint16_t arc_account_hold(spa_t *spa, uint64_t objset);
+void arc_account_rele(uint16_t id);
+void arc_account_set(uint16_t id, uint64_t limit, uint64_t reserve);
+uint64_t arc_account_size(uint16_t id);
 
 void arc_flush(spa_t *spa, boolean_t retry);
 void arc_flush_async(spa_t *spa);
@@ -35,6 +35,7 @@
 #include <sys/zio_crypt.h>
 #include <sys/zthr.h>
 #include <sys/aggsum.h>
+#include <sys/pcsum.h>
 #include <sys/wmsum.h>
 
 #ifdef __cplusplus
@@ -171,6 +172,10 @@ typedef struct l1arc_buf_hdr {
 	uint32_t		b_mfu_hits;
 	uint32_t		b_mfu_ghost_hits;
 	uint8_t			b_byteswap;
+	/* NUMA node this header is homed on, see zfs_arc_numa */
+	uint8_t			b_numa_node;
+	/* dataset account charged for b_pabd/b_rabd, see arc_account_t */
+	uint16_t		b_account;
 	arc_buf_t		*b_buf;
 
 	/* self protecting */
@@ -421,6 +426,12 @@ typedef struct l2arc_dev {
 	 */
 	zfs_refcount_t		l2ad_lb_count;
 	boolean_t		l2ad_trim_all; /* TRIM whole device */
+	/*
+	 * Feed scheduling, protected by l2arc_dev_mtx.
+	 */
+	boolean_t		l2ad_feeding;	/* claimed by a feed thread */
+	clock_t			l2ad_feed_next;	/* next feed due (lbolt) */
+	uint_t			l2ad_feed_slice; /* ARC sublist slice to scan */
 } l2arc_dev_t;
 
 /*
@@ -886,6 +897,11 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_memory_free_bytes;
 	kstat_named_t arcstat_memory_available_bytes;
 	kstat_named_t arcstat_no_grow;
+	/*
+	 * Decaying average of the rate, in bytes per second, at which the
+	 * kernel has asked the ARC to shrink its target size.
+	 */
+	kstat_named_t arcstat_reclaim_pressure;
 	kstat_named_t arcstat_tempreserve;
 	kstat_named_t arcstat_loaned_bytes;
 	kstat_named_t arcstat_prune;
@@ -909,6 +925,16 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_raw_size;
 	kstat_named_t arcstat_cached_only_in_progress;
 	kstat_named_t arcstat_abd_chunk_waste_size;
+	kstat_named_t arcstat_admission_admitted;
+	kstat_named_t arcstat_admission_rejected;
+	kstat_named_t arcstat_dataset_limit_evicted;
+	kstat_named_t arcstat_dataset_reserve_skip;
+	kstat_named_t arcstat_dcache_hits;
+	kstat_named_t arcstat_dcache_misses;
+	kstat_named_t arcstat_dcache_size;
+	kstat_named_t arcstat_dcache_evicted;
+	/* Bytes of dedup table blocks held, across all pools. */
+	kstat_named_t arcstat_ddt_size;
 } arc_stats_t;
 
 typedef struct arc_sums {
@@ -946,7 +972,7 @@ typedef struct arc_sums {
 	wmsum_t arcstat_hash_elements;
 	wmsum_t arcstat_hash_collisions;
 	wmsum_t arcstat_hash_chains;
-	aggsum_t arcstat_size;
+	pcsum_t arcstat_size;
 	wmsum_t arcstat_compressed_size;
 	wmsum_t arcstat_uncompressed_size;
 	wmsum_t arcstat_overhead_size;
@@ -954,7 +980,7 @@ typedef struct arc_sums {
 	wmsum_t arcstat_data_size;
 	wmsum_t arcstat_metadata_size;
 	wmsum_t arcstat_dbuf_size;
-	aggsum_t arcstat_dnode_size;
+	pcsum_t arcstat_dnode_size;
 	wmsum_t arcstat_bonus_size;
 	wmsum_t arcstat_l2_hits;
 	wmsum_t arcstat_l2_misses;
@@ -980,7 +1006,7 @@ typedef struct arc_sums {
 	wmsum_t arcstat_l2_io_error;
 	wmsum_t arcstat_l2_lsize;
 	wmsum_t arcstat_l2_psize;
-	aggsum_t arcstat_l2_hdr_size;
+	pcsum_t arcstat_l2_hdr_size;
 	wmsum_t arcstat_l2_log_blk_writes;
 	wmsum_t arcstat_l2_log_blk_asize;
 	wmsum_t arcstat_l2_log_blk_count;
@@ -1010,8 +1036,53 @@ typedef struct arc_sums {
 	wmsum_t arcstat_raw_size;
 	wmsum_t arcstat_cached_only_in_progress;
 	wmsum_t arcstat_abd_chunk_waste_size;
+	wmsum_t arcstat_admission_admitted;
+	wmsum_t arcstat_admission_rejected;
+	wmsum_t arcstat_dataset_limit_evicted;
+	wmsum_t arcstat_dataset_reserve_skip;
+	wmsum_t arcstat_dcache_hits;
+	wmsum_t arcstat_dcache_misses;
+	wmsum_t arcstat_dcache_size;
+	wmsum_t arcstat_dcache_evicted;
 } arc_sums_t;
 
+/*
+ * Per-NUMA node ARC statistics, exported as arcstats_node<N> when the ARC
+ * state lists are split by node (see zfs_arc_numa).
+ */
+typedef struct arc_numa_stats {
+	kstat_named_t arcnumastat_hits;
+	kstat_named_t arcnumastat_remote_hits;
+	kstat_named_t arcnumastat_misses;
+	kstat_named_t arcnumastat_size;
+	kstat_named_t arcnumastat_evicted;
+} arc_numa_stats_t;
+
+typedef struct arc_numa_node {
+	wmsum_t ann_hits;		/* local hits by this node's CPUs */
+	wmsum_t ann_remote_hits;	/* hits on other nodes' headers */
+	wmsum_t ann_misses;		/* misses by this node's CPUs */
+	wmsum_t ann_size;		/* bytes of headers homed here */
+	wmsum_t ann_evicted;		/* bytes evicted from this node */
+	arc_numa_stats_t ann_stats;
+	kstat_t *ann_ksp;
+} arc_numa_node_t;
+
+/*
+ * Per-dataset ARC account, identified by a small index stored in each L1
+ * header (b_account).  Protected by arc_account_lock, except for aa_size.
+ */
+typedef struct arc_account {
+	avl_node_t	aa_node;
+	uint64_t	aa_spa;		/* spa load guid */
+	uint64_t	aa_objset;	/* objset id */
+	uint64_t	aa_holds;	/* open objsets and kstats */
+	uint64_t	aa_limit;	/* arc_limit, 0 if none */
+	uint64_t	aa_reserve;	/* effective arc_reserve */
+	uint16_t	aa_id;
+	aggsum_t	aa_size;	/* bytes of b_pabd/b_rabd charged */
+} arc_account_t;
+
 typedef struct arc_evict_waiter {
 	list_node_t aew_node;
 	kcondvar_t aew_cv;
@@ -83,6 +83,9 @@ void Blake3_Init(BLAKE3_CTX *ctx);
 /* init the context for a MAC and/or tree hash operation */
 void Blake3_InitKeyed(BLAKE3_CTX *ctx, const uint8_t key[BLAKE3_KEY_LEN]);
 
+/* use the implementation fastest for an input of about this size */
+void Blake3_SizeHint(BLAKE3_CTX *ctx, uint64_t size);
+
 /* process the input bytes */
 void Blake3_Update(BLAKE3_CTX *ctx, const void *input, size_t input_len);
 
@@ -93,8 +96,15 @@ void Blake3_Final(const BLAKE3_CTX *ctx, uint8_t *out);
 void Blake3_FinalSeek(const BLAKE3_CTX *ctx, uint64_t seek, uint8_t *out,
     size_t out_len);
 
-/* these are pre-allocated contexts */
+/*
+ * Scattered buffers are gathered into pieces of this size before hashing,
+ * so that the SIMD implementations see enough chunks to fill their lanes.
+ */
+#define	BLAKE3_GATHER_LEN	(16 * BLAKE3_CHUNK_LEN)
+
+/* these are pre-allocated contexts and gather buffers */
 extern void **blake3_per_cpu_ctx;
+extern void **blake3_per_cpu_buf;
 extern void blake3_per_cpu_ctx_init(void);
 extern void blake3_per_cpu_ctx_fini(void);
 
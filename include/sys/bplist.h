@@ -51,6 +51,8 @@ void bplist_destroy(bplist_t *bpl);
 void bplist_append(bplist_t *bpl, const blkptr_t *bp);
 void bplist_iterate(bplist_t *bpl, bplist_itor_t *func,
     void *arg, dmu_tx_t *tx);
+void bplist_iterate_sorted(bplist_t *bpl, bplist_itor_t *func,
+    void *arg, dmu_tx_t *tx);
 void bplist_clear(bplist_t *bpl);
 
 #ifdef	__cplusplus
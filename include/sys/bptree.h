@@ -49,6 +49,8 @@ typedef struct bptree_entry_phys {
 
 typedef int bptree_itor_t(void *arg, const blkptr_t *bp, dmu_tx_t *tx);
 
+typedef struct bptree_pipe bptree_pipe_t;
+
 uint64_t bptree_alloc(objset_t *os, dmu_tx_t *tx);
 int bptree_free(objset_t *os, uint64_t obj, dmu_tx_t *tx);
 boolean_t bptree_is_empty(objset_t *os, uint64_t obj);
@@ -59,6 +61,11 @@ void bptree_add(objset_t *os, uint64_t obj, blkptr_t *bp, uint64_t birth_txg,
 int bptree_iterate(objset_t *os, uint64_t obj, boolean_t free,
     bptree_itor_t func, void *arg, dmu_tx_t *tx);
 
+bptree_pipe_t *bptree_pipe_create(spa_t *spa, uint64_t nblocks);
+void bptree_pipe_destroy(bptree_pipe_t *bpp);
+int bptree_iterate_pipe(objset_t *os, uint64_t obj, bptree_pipe_t *bpp,
+    bptree_itor_t func, void *arg, dmu_tx_t *tx);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -45,10 +45,13 @@ extern uint64_t brt_get_saved(spa_t *spa);
 extern uint64_t brt_get_ratio(spa_t *spa);
 
 extern boolean_t brt_maybe_exists(spa_t *spa, const blkptr_t *bp);
+extern void brt_prefetch_free(spa_t *spa, const blkptr_t *bp);
 extern void brt_init(void);
 extern void brt_fini(void);
 
 extern void brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx);
+extern void brt_pending_add_batch(spa_t *spa, const blkptr_t *bps,
+    size_t nbps, dmu_tx_t *tx);
 extern void brt_pending_remove(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx);
 extern void brt_pending_apply(spa_t *spa, uint64_t txg);
 
@@ -62,10 +62,16 @@ _Static_assert(BRT_RANGESIZE / SPA_MINBLOCKSIZE <= UINT16_MAX,
  * is represented by a single bit. This gives us 4096 bits. A set bit in the
  * bitmap means that we had a change in at least one of the 16384 entcounts
  * that reside on a 32kB disk block (32kB / sizeof (uint16_t)).
+ *
+ * The in-memory copy of the entcounts uses the same 32kB blocks as its unit
+ * of allocation: a block is only allocated once it holds a non-zero entcount,
+ * so a 1PB vdev with clones in only a handful of regions needs a handful of
+ * 32kB blocks (plus a 32kB array of block pointers) instead of 128MB.
  */
 #define	BRT_BLOCKSIZE	(32 * 1024)
+#define	BRT_BLOCK_ENTCOUNTS	(BRT_BLOCKSIZE / sizeof (uint16_t))
 #define	BRT_RANGESIZE_TO_NBLOCKS(size)					\
-	(((size) - 1) / BRT_BLOCKSIZE / sizeof (uint16_t) + 1)
+	(((size) - 1) / BRT_BLOCK_ENTCOUNTS + 1)
 
 #define	BRT_LITTLE_ENDIAN	0
 #define	BRT_BIG_ENDIAN		1
@@ -128,9 +134,15 @@ struct brt_vdev {
 	 */
 	uint64_t	bv_size;
 	/*
-	 * This is the array with BRT entry count per BRT_RANGESIZE.
+	 * This is the array with BRT entry count per BRT_RANGESIZE, split
+	 * into BRT_RANGESIZE_TO_NBLOCKS(bv_size) blocks of BRT_BLOCK_ENTCOUNTS
+	 * entcounts each. A NULL block means all of its entcounts are zero.
+	 */
+	uint16_t	**bv_entcount;
+	/*
+	 * Number of non-NULL blocks in bv_entcount[].
 	 */
-	uint16_t	*bv_entcount;
+	uint64_t	bv_entcount_blocks;
 	/*
 	 * bv_entcount[] potentially can be a bit too big to sychronize it all
 	 * when we just changed few entcounts. The fields below allow us to
@@ -170,6 +170,61 @@ NAME(zfs_btree_t *tree, uint8_t *buf, uint32_t nelems,			\
 _Pragma("GCC diagnostic pop")
 /* END CSTYLED */
 
+/*
+ * Number of elements below which ZFS_BTREE_FIND_IN_BUF_SORTED_FUNC()
+ * stops halving the search window and scans it instead.
+ */
+#define	ZFS_BTREE_SCAN_ELEMS	16
+
+/*
+ * Variant of ZFS_BTREE_FIND_IN_BUF_FUNC() for element types whose order
+ * against a search value can be decided by a single key comparison, such
+ * as the disjoint segments of a range tree.  It narrows the window with
+ * Shar's algorithm using that comparison only, and then counts how many
+ * of the remaining (at most ZFS_BTREE_SCAN_ELEMS) elements sort before
+ * the value with a branch-free loop that the compiler can vectorize.
+ * The full comparator is called once, on the resulting element.
+ *
+ * Arguments are the same as for ZFS_BTREE_FIND_IN_BUF_FUNC(), plus:
+ *
+ * BEFORE - Returns 1 if the element sorts strictly before the value and 0
+ *          otherwise.  It must agree with COMP(elem, value) < 0.
+ */
+/* BEGIN CSTYLED */
+#define	ZFS_BTREE_FIND_IN_BUF_SORTED_FUNC(NAME, T, BEFORE, COMP)	\
+_Pragma("GCC diagnostic push")						\
+_Pragma("GCC diagnostic ignored \"-Wunknown-pragmas\"")			\
+static void *								\
+NAME(zfs_btree_t *tree, uint8_t *buf, uint32_t nelems,			\
+    const void *value, zfs_btree_index_t *where)			\
+{									\
+	T *i = (T *)buf;						\
+	(void) tree;							\
+	_Pragma("GCC unroll 6")						\
+	while (nelems > ZFS_BTREE_SCAN_ELEMS) {				\
+		uint32_t half = nelems / 2;				\
+		nelems -= half;						\
+		i += BEFORE(&i[half - 1], value) * half;		\
+	}								\
+									\
+	uint32_t before = 0;						\
+	for (uint32_t k = 0; k < nelems; k++)				\
+		before += BEFORE(&i[k], value);				\
+	i += before - (before == nelems);				\
+									\
+	int comp = COMP(i, value);					\
+	where->bti_offset = (i - (T *)buf) + (comp < 0);		\
+	where->bti_before = (comp != 0);				\
+									\
+	if (comp == 0) {						\
+		return (i);						\
+	}								\
+									\
+	return (NULL);							\
+}									\
+_Pragma("GCC diagnostic pop")
+/* END CSTYLED */
+
 /*
  * Allocate and deallocate caches for btree nodes.
  */
@@ -40,6 +40,8 @@ typedef struct dataset_sum_stats_t {
 	wmsum_t dss_nread;
 	wmsum_t dss_nunlinks;
 	wmsum_t dss_nunlinked;
+	wmsum_t dss_blksz_adapted;
+	wmsum_t dss_blksz_adapted_bytes;
 } dataset_sum_stats_t;
 
 typedef struct dataset_kstat_values {
@@ -58,16 +60,76 @@ typedef struct dataset_kstat_values {
 	 * entry is removed from the unlinked set
 	 */
 	kstat_named_t dkv_nunlinked;
+	/*
+	 * Bytes of ARC buffers charged to this dataset
+	 */
+	kstat_named_t dkv_arc_size;
+	/*
+	 * Dirty data held by this dataset, and the total time its
+	 * transactions have been delayed by the write throttle since its
+	 * objset was opened
+	 */
+	kstat_named_t dkv_dirty_bytes;
+	kstat_named_t dkv_dirty_delay_ns;
+	/*
+	 * Files given a block size smaller than the recordsize because of
+	 * their write pattern, and the sum of those block sizes
+	 */
+	kstat_named_t dkv_blksz_adapted;
+	kstat_named_t dkv_blksz_adapted_bytes;
+	/*
+	 * Gang blocks written, and gang blocks read from disk, since the
+	 * dataset's objset was opened
+	 */
+	kstat_named_t dkv_gang_writes;
+	kstat_named_t dkv_gang_reads;
 	/*
 	 * Per dataset zil kstats
 	 */
 	zil_kstat_values_t dkv_zil_stats;
 } dataset_kstat_values_t;
 
+/*
+ * Request latency and size histograms, kept for zvols and filesystems.
+ * Bucket i counts the requests whose latency in nanoseconds, or size in
+ * bytes, has its highest bit at 2^i; the last bucket also counts everything
+ * larger.  Flushes and transaction waits only have a latency.
+ */
+typedef enum dataset_io_type {
+	DATASET_IO_READ,
+	DATASET_IO_WRITE,
+	DATASET_IO_DISCARD,
+	DATASET_IO_FLUSH,
+	DATASET_IO_SYNC_WRITE,
+	DATASET_IO_TX_WAIT,
+	DATASET_IO_TYPES
+} dataset_io_type_t;
+
+#define	DATASET_IO_HISTO_BUCKETS	VDEV_L_HISTO_BUCKETS
+
+/*
+ * The histograms are updated on every request, so are striped by CPU to
+ * keep the updates from contending.
+ */
+#define	DATASET_IO_HISTO_MAX_STRIPES	8
+
+typedef struct dataset_io_histo {
+	int dih_bucket;
+	uint64_t dih_lat[DATASET_IO_TYPES];
+	uint64_t dih_size[DATASET_IO_TYPES];
+} dataset_io_histo_t;
+
 typedef struct dataset_kstats {
 	dataset_sum_stats_t dk_sums;
 	zil_sums_t dk_zil_sums;
 	kstat_t *dk_kstats;
+	kstat_t *dk_io_kstat;
+	dataset_io_histo_t *dk_io_histo;
+	dataset_io_histo_t dk_io_histo_sum;
+	uint_t dk_io_nstripes;
+	uint16_t dk_arc_account;
+	spa_t *dk_spa;
+	uint64_t dk_objset;
 } dataset_kstats_t;
 
 int dataset_kstats_create(dataset_kstats_t *, objset_t *);
@@ -77,7 +139,11 @@ void dataset_kstats_rename(dataset_kstats_t *dk, const char *);
 void dataset_kstats_update_write_kstats(dataset_kstats_t *, int64_t);
 void dataset_kstats_update_read_kstats(dataset_kstats_t *, int64_t);
 
+void dataset_kstats_update_io_histo(dataset_kstats_t *, dataset_io_type_t,
+    uint64_t, hrtime_t);
+
 void dataset_kstats_update_nunlinks_kstat(dataset_kstats_t *, int64_t);
 void dataset_kstats_update_nunlinked_kstat(dataset_kstats_t *, int64_t);
+void dataset_kstats_update_blksz_kstat(dataset_kstats_t *, uint64_t);
 
 #endif /* _SYS_DATASET_KSTATS_H */
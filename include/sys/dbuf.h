@@ -165,8 +165,17 @@ typedef struct dbuf_dirty_record {
 			boolean_t dr_brtwrite;
 			boolean_t dr_diowrite;
 			boolean_t dr_rewrite;
+			boolean_t dr_promote;
 			boolean_t dr_has_raw_params;
 
+			/*
+			 * Set when dmu_write_uio_dnode() checksummed the
+			 * data while filling the buffer; cleared by any
+			 * later change to it (see dbuf_unoverride()).
+			 */
+			boolean_t dr_fused_cksum;
+			zio_cksum_t dr_cksum;
+
 			/* Override and raw params are mutually exclusive. */
 			union {
 				blkptr_t dr_overridden_by;
@@ -307,6 +316,18 @@ typedef struct dmu_buf_impl {
 	/* In which dbuf cache this dbuf is, if any. */
 	dbuf_cached_state_t db_caching_status;
 
+	/*
+	 * If nonzero, this cached dbuf is parked in a per-CPU dbuf cache
+	 * front rather than on its cache's multilist; see dbuf_front_insert().
+	 */
+	uint32_t db_front;
+
+	/*
+	 * The sublist of its cache's multilist this dbuf was inserted into,
+	 * while it is on one.  Protected by db_mtx.
+	 */
+	uint32_t db_cache_sublist;
+
 	/*
 	 * Refcount accessed by dmu_buf_{hold,rele}.
 	 * If nonzero, the buffer can't be destroyed.
@@ -329,14 +350,32 @@ typedef struct dmu_buf_impl {
 	dmu_buf_user_t *db_user;
 } dmu_buf_impl_t;
 
+/*
+ * The hash table buckets are protected by an array of mutexes, each of
+ * which covers every bucket whose index maps to it under hash_mutex_mask.
+ * Every bucket array is at least as large as the mutex array, so a dbuf
+ * maps to the same stripe no matter which bucket array it is in, and the
+ * table can be resized by migrating one stripe at a time.  Each stripe
+ * records the bucket array that holds its dbufs, which may be the old or
+ * the new one while a resize is in progress; it must only be read with
+ * the stripe's mutex held.
+ */
+typedef struct dbuf_hash_stripe {
+	kmutex_t hs_mutex;
+	uint64_t hs_table_mask;
+	dmu_buf_impl_t **hs_table;
+} dbuf_hash_stripe_t;
+
+#define	DBUF_HASH_STRIPE(h, idx) \
+	(&(h)->hash_stripes[(idx) & ((h)->hash_mutex_mask)])
 #define	DBUF_HASH_MUTEX(h, idx) \
-	(&(h)->hash_mutexes[(idx) & ((h)->hash_mutex_mask)])
+	(&DBUF_HASH_STRIPE(h, idx)->hs_mutex)
 
 typedef struct dbuf_hash_table {
-	uint64_t hash_table_mask;
+	uint64_t hash_table_mask;	/* largest bucket array in use */
 	uint64_t hash_mutex_mask;
-	dmu_buf_impl_t **hash_table;
-	kmutex_t *hash_mutexes;
+	dmu_buf_impl_t **hash_table;	/* resize target, or current array */
+	dbuf_hash_stripe_t *hash_stripes;
 } dbuf_hash_table_t;
 
 typedef void (*dbuf_prefetch_fn)(void *, uint64_t, uint64_t, boolean_t);
@@ -383,6 +422,7 @@ void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx, boolean_t canfail);
 void dmu_buf_will_fill_flags(dmu_buf_t *db, dmu_tx_t *tx, boolean_t canfail,
     dmu_flags_t flags);
 boolean_t dmu_buf_fill_done(dmu_buf_t *db, dmu_tx_t *tx, boolean_t failed);
+void dmu_buf_fill_cksum(dmu_buf_t *db, dmu_tx_t *tx, const zio_cksum_t *zcp);
 void dbuf_assign_arcbuf(dmu_buf_impl_t *db, arc_buf_t *buf, dmu_tx_t *tx,
     dmu_flags_t flags);
 dbuf_dirty_record_t *dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
@@ -468,6 +508,7 @@ dbuf_find_dirty_eq(dmu_buf_impl_t *db, uint64_t txg)
 
 #define	DBUF_IS_CACHEABLE(_db)	(!(_db)->db_pending_evict &&		\
 	((_db)->db_objset->os_primary_cache == ZFS_CACHE_ALL ||		\
+	(_db)->db_objset->os_primary_cache == ZFS_CACHE_FILTERED ||	\
 	(dbuf_is_metadata(_db) &&					\
 	((_db)->db_objset->os_primary_cache == ZFS_CACHE_METADATA))))
 
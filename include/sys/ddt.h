@@ -33,6 +33,7 @@
 #include <sys/fs/zfs.h>
 #include <sys/zio.h>
 #include <sys/dmu.h>
+#include <sys/zthr.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -270,6 +271,14 @@ typedef struct {
 	ddt_key_t	ddl_checkpoint;	/* last checkpoint */
 } ddt_log_t;
 
+/* In-core DDT membership filter, see ddt_filter.c */
+typedef struct ddt_filter ddt_filter_t;
+
+/*
+ * Max keys of writes waiting on ddt_lock that are held for a batched prefetch.
+ */
+#define	DDT_PREFETCH_QUEUE	32
+
 /*
  * In-core DDT object. This covers all entries and stats for a the whole pool
  * for a given checksum type.
@@ -294,6 +303,12 @@ typedef struct {
 
 	uint64_t	ddt_flush_force_txg;	/* flush hard before this txg */
 
+	ddt_filter_t	*ddt_filter;	/* store membership filter */
+
+	kmutex_t	ddt_prefetch_lock;	/* protects prefetch queue */
+	uint_t		ddt_prefetch_count;	/* keys on prefetch queue */
+	ddt_key_t	ddt_prefetch_queue[DDT_PREFETCH_QUEUE];
+
 	kstat_t		*ddt_ksp;	/* kstats context */
 
 	enum zio_checksum ddt_checksum;	/* checksum algorithm in use */
@@ -384,6 +399,8 @@ extern ddt_entry_t *ddt_lookup(ddt_t *ddt, const blkptr_t *bp,
     boolean_t verify);
 extern void ddt_remove(ddt_t *ddt, ddt_entry_t *dde);
 extern void ddt_prefetch(spa_t *spa, const blkptr_t *bp);
+extern void ddt_prefetch_queue(ddt_t *ddt, const blkptr_t *bp);
+extern void ddt_prefetch_issue(ddt_t *ddt, const blkptr_t *bp);
 extern void ddt_prefetch_all(spa_t *spa);
 
 extern boolean_t ddt_class_contains(spa_t *spa, ddt_class_t max_class,
@@ -396,6 +413,8 @@ extern void ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde);
 
 extern int ddt_key_compare(const void *x1, const void *x2);
 
+extern void ddt_arc_reserve_update(spa_t *spa);
+
 extern void ddt_create(spa_t *spa);
 extern int ddt_load(spa_t *spa);
 extern void ddt_unload(spa_t *spa);
@@ -408,6 +427,8 @@ extern int ddt_walk(spa_t *spa, ddt_bookmark_t *ddb,
 
 extern boolean_t ddt_addref(spa_t *spa, const blkptr_t *bp);
 
+extern boolean_t ddt_prune_thread_check(void *arg, zthr_t *zthr);
+extern void ddt_prune_thread(void *arg, zthr_t *zthr);
 extern int ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
     uint64_t amount);
 
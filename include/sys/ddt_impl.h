@@ -45,6 +45,7 @@ extern "C" {
 /* Names of interesting objects in the DDT root dir */
 #define	DDT_DIR_VERSION		"version"
 #define	DDT_DIR_FLAGS		"flags"
+#define	DDT_DIR_FILTER		"filter"
 
 /* Fill a lightweight entry from a live entry. */
 #define	DDT_ENTRY_TO_LIGHTWEIGHT(ddt, dde, ddlwe) do {			\
@@ -155,6 +156,17 @@ typedef struct {
 	uint64_t	dlu_offset;	/* offset for next entry */
 } ddt_log_update_t;
 
+/* On-disk membership filter header, stored in the bonus buffer. */
+#define	DDT_FILTER_VERSION	(1)
+
+typedef struct {
+	uint64_t	dfp_version;	/* DDT_FILTER_VERSION */
+	uint64_t	dfp_size;	/* bitmap size in bytes, power of 2 */
+	uint64_t	dfp_nhash;	/* bits set per key */
+	uint64_t	dfp_txg;	/* last txg filter and store synced */
+	uint64_t	dfp_nset;	/* number of bits set */
+} ddt_filter_phys_t;
+
 /*
  * Ops vector to access a specific DDT object type.
  */
@@ -212,6 +224,19 @@ extern void ddt_log_free(ddt_t *ddt);
 extern void ddt_log_init(void);
 extern void ddt_log_fini(void);
 
+/* Dedup membership filter API */
+extern int ddt_filter_load(ddt_t *ddt);
+extern void ddt_filter_free(ddt_t *ddt);
+extern void ddt_filter_create(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_filter_destroy(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_filter_sync(ddt_t *ddt, dmu_tx_t *tx);
+
+extern boolean_t ddt_filter_active(const ddt_t *ddt);
+extern boolean_t ddt_filter_contains(const ddt_t *ddt, const ddt_key_t *ddk);
+extern void ddt_filter_add(ddt_t *ddt, const ddt_key_t *ddk);
+extern void ddt_filter_touch(ddt_t *ddt);
+extern uint64_t ddt_filter_object(const ddt_t *ddt);
+
 /*
  * These are only exposed so that zdb can access them. Try not to use them
  * outside of the DDT implementation proper, and if you do, consider moving
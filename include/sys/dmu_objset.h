@@ -100,6 +100,15 @@ typedef struct objset_phys {
 typedef int (*dmu_objset_upgrade_cb_t)(objset_t *);
 
 #define	OBJSET_PROP_UNINITIALIZED	((uint64_t)-1)
+
+/*
+ * Per-CPU object allocation cursor, padded to its own cache line so that
+ * CPUs creating objects in parallel do not bounce each other's cursors.
+ */
+typedef struct objset_obj_next {
+	uint64_t	oon_object;
+} ____cacheline_aligned objset_obj_next_t;
+
 struct objset {
 	/* Immutable: */
 	struct dsl_dataset *os_dsl_dataset;
@@ -134,6 +143,7 @@ struct objset {
 	zfs_cache_type_t os_primary_cache;
 	zfs_cache_type_t os_secondary_cache;
 	zfs_prefetch_type_t os_prefetch;
+	uint64_t os_prefetch_distance;
 	zfs_sync_type_t os_sync;
 	zfs_direct_t os_direct;
 	zfs_redundant_metadata_type_t os_redundant_metadata;
@@ -154,6 +164,35 @@ struct objset {
 	 */
 	uint64_t os_zpl_special_smallblock;
 
+	/*
+	 * ARC account this dataset's buffers are charged to, and the
+	 * arc_limit and arc_reserve properties applied to it.
+	 */
+	uint16_t os_arc_account;
+	uint64_t os_arc_limit;
+	uint64_t os_arc_reserve;
+
+	/*
+	 * Dirty data of this dataset, for the dirty_max property, and the
+	 * total time its transactions have been delayed by the dataset and
+	 * pool write throttles.  Protected by os_dirty_lock.
+	 */
+	uint64_t os_dirty_max;
+	kmutex_t os_dirty_lock;
+	kcondvar_t os_dirty_cv;
+	uint64_t os_dirty_total;
+	uint64_t os_dirty_pertxg[TXG_SIZE];
+	hrtime_t os_dirty_last_wakeup;
+	uint64_t os_dirty_delay;
+
+	/*
+	 * Gang blocks written for this dataset, and reads of its gang blocks
+	 * which missed the ARC and so paid for the gang header and child
+	 * reads, since the objset was opened.  Updated atomically.
+	 */
+	uint64_t os_gang_writes;
+	uint64_t os_gang_reads;
+
 	/*
 	 * Pointer is constant; the blkptr it points to is protected by
 	 * os_dsl_dataset->ds_bp_rwlock
@@ -177,7 +216,7 @@ struct objset {
 	uint64_t os_obj_next_chunk;
 
 	/* Per-CPU next object to allocate, protected by atomic ops. */
-	uint64_t *os_obj_next_percpu;
+	objset_obj_next_t *os_obj_next_percpu;
 	int os_obj_next_percpu_len;
 
 	/* Protected by os_lock */
@@ -268,6 +307,11 @@ int dmu_fsname(const char *snapname, char *buf);
 
 void dmu_objset_evict_done(objset_t *os);
 void dmu_objset_willuse_space(objset_t *os, int64_t space, dmu_tx_t *tx);
+void dmu_objset_undirty_space(objset_t *os, int64_t space, uint64_t txg);
+boolean_t dmu_objset_need_dirty_delay(objset_t *os);
+uint64_t dmu_objset_dirty_wait(objset_t *os, uint64_t *maxp);
+void dmu_objset_live_stats(spa_t *spa, uint64_t dsobj, uint64_t *dirtyp,
+    uint64_t *delayp, uint64_t *gang_writesp, uint64_t *gang_readsp);
 
 void dmu_objset_init(void);
 void dmu_objset_fini(void);
@@ -58,6 +58,7 @@ typedef struct dmu_recv_cookie {
 	nvlist_t *drc_keynvl;
 	uint64_t drc_fromsnapobj;
 	uint64_t drc_ivset_guid;
+	uint64_t drc_end_object; /* Stream stops here, see FEATURE_PART */
 	void *drc_owner;
 	cred_t *drc_cred;
 	nvlist_t *drc_begin_nvl;
@@ -41,6 +41,7 @@
 #define	BEGINNV_REDACT_FROM_SNAPS	"redact_from_snaps"
 #define	BEGINNV_RESUME_OBJECT		"resume_object"
 #define	BEGINNV_RESUME_OFFSET		"resume_offset"
+#define	BEGINNV_END_OBJECT		"end_object"
 
 struct vnode;
 struct dsl_dataset;
@@ -52,8 +53,8 @@ int
 dmu_send(const char *tosnap, const char *fromsnap, boolean_t embedok,
     boolean_t large_block_ok, boolean_t compressok, boolean_t rawok,
     boolean_t savedok, uint64_t resumeobj, uint64_t resumeoff,
-    const char *redactbook, int outfd, offset_t *off,
-    struct dmu_send_outparams *dsop);
+    uint64_t part, uint64_t nparts, const char *redactbook, int outfd,
+    offset_t *off, struct dmu_send_outparams *dsop);
 int dmu_send_estimate_fast(struct dsl_dataset *ds, struct dsl_dataset *fromds,
     zfs_bookmark_phys_t *frombook, boolean_t stream_compressed,
     boolean_t saved, uint64_t *sizep);
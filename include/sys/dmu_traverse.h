@@ -76,6 +76,8 @@ int traverse_dataset_resume(struct dsl_dataset *ds, uint64_t txg_start,
 int traverse_dataset_destroyed(spa_t *spa, blkptr_t *blkptr,
     uint64_t txg_start, zbookmark_phys_t *resume, int flags,
     blkptr_cb_t func, void *arg);
+int traverse_mos(spa_t *spa,
+    uint64_t txg_start, int flags, blkptr_cb_t func, void *arg);
 int traverse_pool(spa_t *spa,
     uint64_t txg_start, int flags, blkptr_cb_t func, void *arg);
 
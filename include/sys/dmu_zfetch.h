@@ -51,7 +51,7 @@ typedef struct zsrange {
 	uint16_t	end;
 } zsrange_t;
 
-#define	ZFETCH_RANGES	9		/* Fits zstream_t into 128 bytes */
+#define	ZFETCH_RANGES	9		/* Fits zstream_t into 144 bytes */
 
 typedef struct zstream {
 	list_node_t	zs_node;	/* link for zf_stream */
@@ -66,6 +66,15 @@ typedef struct zstream {
 	uint64_t	zs_ipf_end;	/* data block to prefetch L1 up to */
 	boolean_t	zs_missed;	/* stream saw cache misses */
 	boolean_t	zs_more;	/* need more distant prefetch */
+	/*
+	 * For a stream with no sequential hits yet, the distance between
+	 * the first blocks of its last two accesses.  For a reverse or
+	 * fixed-stride stream (zs_plen != 0), the distance between the
+	 * first blocks of all its consecutive accesses.
+	 */
+	int32_t		zs_stride;
+	uint16_t	zs_plen;	/* blocks per reverse/stride access */
+	uint64_t	zs_last;	/* first block of the last access */
 	zfs_refcount_t	zs_callers;	/* number of pending callers */
 	/*
 	 * Number of stream references: dnode, callers and pending blocks.
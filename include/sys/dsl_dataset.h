@@ -213,6 +213,8 @@ typedef struct dsl_dataset {
 	/* protected by lock on pool's dp_dirty_datasets list */
 	txg_node_t ds_dirty_link;
 	list_node_t ds_synced_link;
+	/* dispatches dsl_pool_sync()'s user accounting for this dataset */
+	taskq_ent_t ds_sync_tqent;
 
 	/*
 	 * ds_phys->ds_<accounting> is also protected by ds_lock.
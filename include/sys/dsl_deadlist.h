@@ -93,6 +93,7 @@ typedef int deadlist_iter_t(void *args, dsl_deadlist_entry_t *dle);
 int dsl_deadlist_open(dsl_deadlist_t *dl, objset_t *os, uint64_t object);
 void dsl_deadlist_close(dsl_deadlist_t *dl);
 void dsl_deadlist_iterate(dsl_deadlist_t *dl, deadlist_iter_t func, void *arg);
+void dsl_deadlist_preload(dsl_deadlist_t *dl);
 uint64_t dsl_deadlist_alloc(objset_t *os, dmu_tx_t *tx);
 void dsl_deadlist_free(objset_t *os, uint64_t dlobj, dmu_tx_t *tx);
 void dsl_deadlist_insert(dsl_deadlist_t *dl, const blkptr_t *bp,
@@ -63,6 +63,7 @@ extern uint64_t zfs_dirty_data_max_max;
 extern uint64_t zfs_wrlog_data_max;
 extern uint_t zfs_dirty_data_max_percent;
 extern uint_t zfs_dirty_data_max_max_percent;
+extern uint_t zfs_dirty_data_sync_percent;
 extern uint_t zfs_delay_min_dirty_percent;
 extern uint_t zfs_vdev_async_write_active_min_dirty_percent;
 extern uint_t zfs_vdev_async_write_active_max_dirty_percent;
@@ -139,6 +140,7 @@ typedef struct dsl_pool {
 	txg_list_t dp_sync_tasks;
 	txg_list_t dp_early_sync_tasks;
 	taskq_t *dp_sync_taskq;
+	taskq_t *dp_dbuf_sync_taskq;
 	taskq_t *dp_zil_clean_taskq;
 
 	/*
@@ -76,6 +76,8 @@ typedef struct dsl_scan_phys {
 typedef enum dsl_scan_flags {
 	DSF_VISIT_DS_AGAIN = 1<<0,
 	DSF_SCRUB_PAUSED = 1<<1,
+	DSF_METADATA_FIRST = 1<<2,	/* metadata-first scrub */
+	DSF_METADATA_PASS = 1<<3,	/* still in the metadata pass */
 } dsl_scan_flags_t;
 
 #define	DSL_SCAN_FLAGS_MASK (DSF_VISIT_DS_AGAIN)
@@ -95,6 +97,31 @@ typedef struct dsl_errorscrub_phys {
 #define	ERRORSCRUB_PHYS_NUMINTS (sizeof (dsl_errorscrub_phys_t) \
 	/ sizeof (uint64_t))
 
+/*
+ * Results of the metadata pass of a metadata-first scrub, recorded when
+ * that pass completes so they can be reported while the data pass runs.
+ */
+typedef struct dsl_scan_meta_phys {
+	uint64_t smp_end_time;	/* metadata pass end time, unix timestamp */
+	uint64_t smp_examined;	/* metadata bytes examined */
+	uint64_t smp_errors;	/* errors found by the metadata pass */
+} dsl_scan_meta_phys_t;
+
+#define	SCAN_META_PHYS_NUMINTS (sizeof (dsl_scan_meta_phys_t) \
+	/ sizeof (uint64_t))
+
+/*
+ * Per-pool limits on the scrub and resilver issue rate, set through
+ * zpool scrub and kept across scans. Zero means no limit.
+ */
+typedef struct dsl_scan_throttle_phys {
+	uint64_t stp_rate;	/* bytes/sec per top-level vdev */
+	uint64_t stp_latency;	/* added foreground latency, microseconds */
+} dsl_scan_throttle_phys_t;
+
+#define	SCAN_THROTTLE_PHYS_NUMINTS (sizeof (dsl_scan_throttle_phys_t) \
+	/ sizeof (uint64_t))
+
 /*
  * Every pool will have one dsl_scan_t and this structure will contain
  * in-memory information about the scan and a pointer to the on-disk
@@ -137,6 +164,7 @@ typedef struct dsl_scan {
 	boolean_t scn_async_destroying;
 	boolean_t scn_async_stalled;
 	uint64_t  scn_async_block_min_time_ms;
+	struct bptree_pipe *scn_bptree_pipe; /* async destroy traversal */
 
 	/* flags and stats for controlling scan state */
 	boolean_t scn_is_sorted;	/* doing sequential scan */
@@ -174,10 +202,20 @@ typedef struct dsl_scan {
 	dsl_scan_phys_t scn_phys;	/* on disk representation of scan */
 	dsl_scan_phys_t scn_phys_cached;
 	avl_tree_t scn_queue;		/* queue of datasets to scan */
+	avl_tree_t scn_queue_prio;	/* scn_queue in visiting order */
+	uint64_t scn_last_priority;	/* scan_priority of last dataset */
 	kmutex_t scn_queue_lock;	/* serializes scn_queue inserts */
 	uint64_t scn_queues_pending;	/* outstanding data to issue */
+	/* sorted runs spilled out of the queues, see scan_io_queue_spill() */
+	uint64_t scn_spill_obj;		/* MOS object holding the runs */
+	uint64_t scn_spill_end;		/* end of the last run written */
+	uint64_t scn_spill_runs;	/* runs not yet issued */
 	/* members needed for syncing error scrub status to disk */
 	dsl_errorscrub_phys_t errorscrub_phys;
+	/* results of a completed metadata pass */
+	dsl_scan_meta_phys_t scn_meta_phys;
+	/* issue rate limits */
+	dsl_scan_throttle_phys_t scn_throttle;
 } dsl_scan_t;
 
 typedef struct {
@@ -196,6 +234,7 @@ void dsl_scan_setup_sync(void *, dmu_tx_t *);
 void dsl_scan_fini(struct dsl_pool *dp);
 void dsl_scan_sync(struct dsl_pool *, dmu_tx_t *);
 int dsl_scan_cancel(struct dsl_pool *);
+int dsl_scan_set_throttle(struct dsl_pool *, uint64_t rate, uint64_t latency);
 int dsl_scan(struct dsl_pool *, pool_scan_func_t, uint64_t starttxg,
     uint64_t txgend);
 void dsl_scan_assess_vdev(struct dsl_pool *dp, vdev_t *vd);
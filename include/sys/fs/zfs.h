@@ -203,6 +203,11 @@ typedef enum {
 	ZFS_PROP_DEFAULTUSEROBJQUOTA,
 	ZFS_PROP_DEFAULTGROUPOBJQUOTA,
 	ZFS_PROP_DEFAULTPROJECTOBJQUOTA,
+	ZFS_PROP_ARC_LIMIT,
+	ZFS_PROP_ARC_RESERVE,
+	ZFS_PROP_PREFETCH_DISTANCE,
+	ZFS_PROP_DIRTY_MAX,
+	ZFS_PROP_SCAN_PRIORITY,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
@@ -272,6 +277,7 @@ typedef enum {
 	ZPOOL_PROP_DEDUP_TABLE_QUOTA,
 	ZPOOL_PROP_DEDUPCACHED,
 	ZPOOL_PROP_LAST_SCRUBBED_TXG,
+	ZPOOL_PROP_DEDUP_TABLE_ARC_RESERVE,
 	ZPOOL_NUM_PROPS
 } zpool_prop_t;
 
@@ -385,6 +391,7 @@ typedef enum {
 	VDEV_PROP_TRIM_SUPPORT,
 	VDEV_PROP_TRIM_ERRORS,
 	VDEV_PROP_SLOW_IOS,
+	VDEV_PROP_POLL,
 	VDEV_NUM_PROPS
 } vdev_prop_t;
 
@@ -505,7 +512,8 @@ typedef enum zfs_smb_acl_op {
 typedef enum zfs_cache_type {
 	ZFS_CACHE_NONE = 0,
 	ZFS_CACHE_METADATA = 1,
-	ZFS_CACHE_ALL = 2
+	ZFS_CACHE_ALL = 2,
+	ZFS_CACHE_FILTERED = 3
 } zfs_cache_type_t;
 
 typedef enum {
@@ -547,7 +555,8 @@ typedef enum {
 typedef enum {
 	ZFS_DIRECT_DISABLED = 0,
 	ZFS_DIRECT_STANDARD,
-	ZFS_DIRECT_ALWAYS
+	ZFS_DIRECT_ALWAYS,
+	ZFS_DIRECT_ADAPTIVE
 } zfs_direct_t;
 
 typedef enum zfs_keystatus {
@@ -574,9 +583,17 @@ typedef enum zfs_key_location {
 typedef enum {
 	ZFS_PREFETCH_NONE = 0,
 	ZFS_PREFETCH_METADATA = 1,
-	ZFS_PREFETCH_ALL = 2
+	ZFS_PREFETCH_ALL = 2,
+	ZFS_PREFETCH_CONSERVATIVE = 3,
+	ZFS_PREFETCH_AGGRESSIVE = 4
 } zfs_prefetch_type_t;
 
+typedef enum {
+	ZFS_SCAN_PRIORITY_LOW = 0,
+	ZFS_SCAN_PRIORITY_NORMAL = 1,
+	ZFS_SCAN_PRIORITY_HIGH = 2
+} zfs_scan_priority_t;
+
 #define	DEFAULT_PBKDF2_ITERATIONS 350000
 #define	MIN_PBKDF2_ITERATIONS 100000
 
@@ -775,6 +792,15 @@ typedef struct zpool_load_policy {
 #define	ZPOOL_CONFIG_VDEV_TRIM_PEND_QUEUE	"vdev_async_trim_pend_queue"
 #define	ZPOOL_CONFIG_VDEV_REBUILD_PEND_QUEUE	"vdev_rebuild_pend_queue"
 
+/* Queue depths (max_active) */
+#define	ZPOOL_CONFIG_VDEV_SYNC_R_MAX_ACTIVE	"vdev_sync_r_max_active"
+#define	ZPOOL_CONFIG_VDEV_SYNC_W_MAX_ACTIVE	"vdev_sync_w_max_active"
+#define	ZPOOL_CONFIG_VDEV_ASYNC_R_MAX_ACTIVE	"vdev_async_r_max_active"
+#define	ZPOOL_CONFIG_VDEV_ASYNC_W_MAX_ACTIVE	"vdev_async_w_max_active"
+#define	ZPOOL_CONFIG_VDEV_SCRUB_MAX_ACTIVE	"vdev_async_scrub_max_active"
+#define	ZPOOL_CONFIG_VDEV_TRIM_MAX_ACTIVE	"vdev_async_trim_max_active"
+#define	ZPOOL_CONFIG_VDEV_REBUILD_MAX_ACTIVE	"vdev_rebuild_max_active"
+
 /* Latency read/write histogram stats */
 #define	ZPOOL_CONFIG_VDEV_TOT_R_LAT_HISTO	"vdev_tot_r_lat_histo"
 #define	ZPOOL_CONFIG_VDEV_TOT_W_LAT_HISTO	"vdev_tot_w_lat_histo"
@@ -788,6 +814,19 @@ typedef struct zpool_load_policy {
 #define	ZPOOL_CONFIG_VDEV_TRIM_LAT_HISTO	"vdev_trim_histo"
 #define	ZPOOL_CONFIG_VDEV_REBUILD_LAT_HISTO	"vdev_rebuild_histo"
 
+/* zio pipeline stage latency histograms */
+#define	ZPOOL_CONFIG_VDEV_COMPRESS_STAGE_HISTO \
+	"vdev_compress_stage_histo"
+#define	ZPOOL_CONFIG_VDEV_CKSUM_GEN_STAGE_HISTO \
+	"vdev_cksum_gen_stage_histo"
+#define	ZPOOL_CONFIG_VDEV_ALLOC_STAGE_HISTO	"vdev_alloc_stage_histo"
+#define	ZPOOL_CONFIG_VDEV_QUEUE_STAGE_HISTO	"vdev_queue_stage_histo"
+#define	ZPOOL_CONFIG_VDEV_DISK_STAGE_HISTO	"vdev_disk_stage_histo"
+#define	ZPOOL_CONFIG_VDEV_CKSUM_VERIFY_STAGE_HISTO \
+	"vdev_cksum_verify_stage_histo"
+#define	ZPOOL_CONFIG_VDEV_DECOMPRESS_STAGE_HISTO \
+	"vdev_decompress_stage_histo"
+
 /* Request size histograms */
 #define	ZPOOL_CONFIG_VDEV_SYNC_IND_R_HISTO	"vdev_sync_ind_r_histo"
 #define	ZPOOL_CONFIG_VDEV_SYNC_IND_W_HISTO	"vdev_sync_ind_w_histo"
@@ -1096,6 +1135,7 @@ typedef enum pool_scrub_cmd {
 	POOL_SCRUB_NORMAL = 0,
 	POOL_SCRUB_PAUSE,
 	POOL_SCRUB_FROM_LAST_TXG,
+	POOL_SCRUB_THROTTLE,
 	POOL_SCRUB_FLAGS_END
 } pool_scrub_cmd_t;
 
@@ -1152,6 +1192,21 @@ typedef enum zio_priority {
 	ZIO_PRIORITY_NOW,		/* non-queued i/os (e.g. free) */
 } zio_priority_t;
 
+/*
+ * zio pipeline stages with their own latency histograms.  Needed to
+ * interpret vdev statistics below.
+ */
+typedef enum zio_stage_histo {
+	ZIO_SH_COMPRESS,		/* write compression */
+	ZIO_SH_CHECKSUM_GENERATE,	/* write checksum generation */
+	ZIO_SH_DVA_ALLOCATE,		/* block allocation */
+	ZIO_SH_QUEUE,			/* vdev queue wait */
+	ZIO_SH_DISK,			/* device access */
+	ZIO_SH_CHECKSUM_VERIFY,		/* read checksum verification */
+	ZIO_SH_DECOMPRESS,		/* ARC decompression */
+	ZIO_SH_TYPES
+} zio_stage_histo_t;
+
 /*
  * Pool statistics.  Note: all fields should be 64-bit because this
  * is passed between kernel and userland as an nvlist uint64 array.
@@ -1190,8 +1245,28 @@ typedef struct pool_scan_stat {
 	/* error scrub pause time in milliseconds */
 	uint64_t	pss_pass_error_scrub_pause;
 
+	/* metadata-first scrub values stored on disk */
+	uint64_t	pss_meta_phase;	/* pool_scan_meta_phase_t */
+	uint64_t	pss_meta_end_time; /* metadata pass end time */
+	uint64_t	pss_meta_examined; /* metadata bytes examined */
+	uint64_t	pss_meta_errors; /* metadata pass errors */
+
+	/* scan throttle values stored on disk */
+	uint64_t	pss_throttle_rate; /* bytes/s per top-level vdev */
+	uint64_t	pss_throttle_latency; /* added latency budget, us */
+
+	/* range of birth txgs verified by the scan */
+	uint64_t	pss_min_txg; /* only blocks born after this txg */
+	uint64_t	pss_max_txg; /* only blocks born up to this txg */
+
 } pool_scan_stat_t;
 
+typedef enum pool_scan_meta_phase {
+	POOL_SCAN_META_NONE,		/* not a metadata-first scrub */
+	POOL_SCAN_META_METADATA,	/* scrubbing metadata blocks */
+	POOL_SCAN_META_DATA,		/* metadata done, scrubbing data */
+} pool_scan_meta_phase_t;
+
 typedef struct pool_removal_stat {
 	uint64_t prs_state; /* dsl_scan_state_t */
 	uint64_t prs_removing_vdev;
@@ -1324,6 +1399,9 @@ typedef struct vdev_stat_ex {
 	/* Number of ZIOs pending to be issued to disk */
 	uint64_t vsx_pend_queue[ZIO_PRIORITY_NUM_QUEUEABLE];
 
+	/* Number of ZIOs allowed to be active on disk (max_active) */
+	uint64_t vsx_max_active[ZIO_PRIORITY_NUM_QUEUEABLE];
+
 	/*
 	 * Below are the histograms for various latencies. Buckets are in
 	 * units of nanoseconds.
@@ -1360,6 +1438,9 @@ typedef struct vdev_stat_ex {
 	uint64_t vsx_agg_histo[ZIO_PRIORITY_NUM_QUEUEABLE]
 	    [VDEV_RQ_HISTO_BUCKETS];
 
+	/* Time spent in each timed zio pipeline stage (ns) */
+	uint64_t vsx_stage_histo[ZIO_SH_TYPES][VDEV_L_HISTO_BUCKETS];
+
 } vdev_stat_ex_t;
 
 /*
@@ -1562,6 +1643,7 @@ typedef enum zfs_ioc {
 	ZFS_IOC_POOL_SCRUB,			/* 0x5a57 */
 	ZFS_IOC_POOL_PREFETCH,			/* 0x5a58 */
 	ZFS_IOC_DDT_PRUNE,			/* 0x5a59 */
+	ZFS_IOC_GET_DATASET_PROPS,		/* 0x5a5a */
 
 	/*
 	 * Per-platform (Optional) - 8/128 numbers reserved.
@@ -1629,6 +1711,7 @@ typedef struct zfs_rewrite_args {
 
 /* zfs_rewrite_args flags */
 #define	ZFS_REWRITE_PHYSICAL	0x1	/* Preserve logical birth time. */
+#define	ZFS_REWRITE_HOT		0x2	/* Only hot blocks, promoted. */
 
 #define	ZFS_IOC_REWRITE		_IOW(0x83, 3, zfs_rewrite_args_t)
 
@@ -1673,6 +1756,7 @@ typedef enum {
 	ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS,
 	ZFS_ERR_ASHIFT_MISMATCH,
 	ZFS_ERR_STREAM_LARGE_MICROZAP,
+	ZFS_ERR_STREAM_PART,
 } zfs_errno_t;
 
 /*
@@ -1821,6 +1905,14 @@ typedef enum {
 #define	DDT_PRUNE_UNIT		"ddt_prune_unit"
 #define	DDT_PRUNE_AMOUNT	"ddt_prune_amount"
 
+/*
+ * The following are names used when invoking ZFS_IOC_GET_DATASET_PROPS.
+ */
+#define	ZFS_DATASET_PROPS_DATASETS	"dataset_props_datasets"
+#define	ZFS_DATASET_PROPS_NAMES		"dataset_props_names"
+#define	ZFS_DATASET_PROPS_VALUES	"dataset_props_values"
+#define	ZFS_DATASET_PROPS_ERRORS	"dataset_props_errors"
+
 /*
  * Flags for ZFS_IOC_VDEV_SET_STATE
  */
@@ -79,6 +79,7 @@ uint64_t metaslab_largest_allocatable(metaslab_t *);
 #define	METASLAB_GANG_HEADER		0x2
 #define	METASLAB_GANG_CHILD		0x4
 #define	METASLAB_ASYNC_ALLOC		0x8
+#define	METASLAB_HINT_NEXT		0x10
 
 int metaslab_alloc(spa_t *, metaslab_class_t *, uint64_t, blkptr_t *, int,
     uint64_t, const blkptr_t *, int, zio_alloc_list_t *, int, const void *);
@@ -265,6 +265,25 @@ struct metaslab_group {
 	uint64_t		mg_fragmentation;
 	uint64_t		mg_histogram[ZFS_RANGE_TREE_HISTOGRAM_SIZE];
 
+	/*
+	 * Number of metaslabs in mg_metaslab_tree by the power of two of
+	 * the largest allocation their weight says they can satisfy.  Lets
+	 * the allocator skip a group which cannot fit an allocation without
+	 * trying its metaslabs.  Protected by mg_lock.
+	 */
+	uint64_t		mg_size_index[64];
+
+	/*
+	 * Recent allocation rate and metaslab load time of the group,
+	 * used by metaslab_group_preload() to keep enough free space
+	 * loaded to cover allocations while another metaslab loads.
+	 */
+	uint64_t		mg_alloc_txg_bytes;	/* allocated this txg */
+	uint64_t		mg_alloc_rate;		/* bytes/sec average */
+	hrtime_t		mg_alloc_rate_time;	/* last rate update */
+	hrtime_t		mg_alloc_interval;	/* last rate interval */
+	hrtime_t		mg_load_time;		/* average load time */
+
 	int			mg_ms_disabled;
 	boolean_t		mg_disabled_updating;
 	kmutex_t		mg_ms_disabled_lock;
@@ -483,6 +502,8 @@ struct metaslab {
 
 	uint64_t	ms_alloc_txg;	/* last successful alloc (debug only) */
 	uint64_t	ms_max_size;	/* maximum allocatable size	*/
+	uint64_t	ms_wp;		/* write pointer, if zoned	*/
+	int		ms_size_bucket;	/* mg_size_index bucket, or -1	*/
 
 	/*
 	 * -1 if it's not active in an allocator, otherwise set to the allocator
@@ -60,6 +60,17 @@ struct multilist {
 	 * The number of sublists used internally by this multilist.
 	 */
 	uint64_t			ml_num_sublists;
+	/*
+	 * The number of equally sized, contiguous groups the sublists are
+	 * split into (see multilist_create_grouped()).
+	 */
+	uint_t				ml_num_groups;
+	/*
+	 * Whether there is a sublist for every possible CPU, which
+	 * objects may be inserted into from that CPU (see
+	 * multilist_create_cpu_local()).
+	 */
+	boolean_t			ml_cpu_local;
 	/*
 	 * The array of pointers to the actual sublists.
 	 */
@@ -74,6 +85,10 @@ struct multilist {
 
 void multilist_create(multilist_t *, size_t, size_t,
     multilist_sublist_index_func_t *);
+void multilist_create_grouped(multilist_t *, size_t, size_t, uint_t,
+    multilist_sublist_index_func_t *);
+void multilist_create_cpu_local(multilist_t *, size_t, size_t,
+    multilist_sublist_index_func_t *);
 void multilist_destroy(multilist_t *);
 
 void multilist_insert(multilist_t *, void *);
@@ -82,6 +97,9 @@ int  multilist_is_empty(multilist_t *);
 
 unsigned int multilist_get_num_sublists(multilist_t *);
 unsigned int multilist_get_random_index(multilist_t *);
+unsigned int multilist_get_cpu_index(multilist_t *);
+unsigned int multilist_get_num_groups(multilist_t *);
+unsigned int multilist_get_group_sublists(multilist_t *);
 
 void multilist_sublist_lock(multilist_sublist_t *);
 multilist_sublist_t *multilist_sublist_lock_idx(multilist_t *, unsigned int);
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: CDDL-1.0
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef	_SYS_PCSUM_H
+#define	_SYS_PCSUM_H
+
+#include <sys/zfs_context.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct pcsum_bucket {
+	uint64_t psb_delta;
+} ____cacheline_aligned pcsum_bucket_t;
+
+/*
+ * Per-CPU sum with a bounded error.  See pcsum.c.
+ */
+typedef struct pcsum {
+	kmutex_t ps_lock;
+	uint64_t ps_value;
+	int64_t ps_batch;
+	uint64_t ps_error;
+	pcsum_bucket_t *ps_buckets ____cacheline_aligned;
+	uint_t ps_numbuckets;
+} pcsum_t;
+
+void pcsum_init(pcsum_t *, uint64_t, uint64_t);
+void pcsum_fini(pcsum_t *);
+void pcsum_add(pcsum_t *, int64_t);
+int64_t pcsum_estimate(pcsum_t *);
+int pcsum_compare(pcsum_t *, uint64_t);
+uint64_t pcsum_value(pcsum_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* _SYS_PCSUM_H */
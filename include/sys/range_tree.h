@@ -46,6 +46,7 @@ typedef enum zfs_range_seg_type {
 	ZFS_RANGE_SEG32,
 	ZFS_RANGE_SEG64,
 	ZFS_RANGE_SEG_GAP,
+	ZFS_RANGE_SEG24,
 	ZFS_RANGE_SEG_NUM_TYPES,
 } zfs_range_seg_type_t;
 
@@ -87,6 +88,20 @@ typedef struct zfs_range_seg32 {
 	uint32_t	rs_end;		/* ending offset (non-inclusive) */
 } zfs_range_seg32_t;
 
+/*
+ * Metaslabs with fewer than 2^24 allocatable units can store their segments
+ * in 24-bit integers, which makes every segment, and so every btree leaf,
+ * hold a third more segments than with zfs_range_seg32_t.  The fields are
+ * little-endian byte arrays so that the segment packs into 6 bytes; use
+ * zfs_rs24_get() and zfs_rs24_set() to access them.
+ */
+typedef struct zfs_range_seg24 {
+	uint8_t		rs_start[3];	/* starting offset of this segment */
+	uint8_t		rs_end[3];	/* ending offset (non-inclusive) */
+} zfs_range_seg24_t;
+
+#define	ZFS_RANGE_SEG24_MAX	((1ULL << 24) - 1)
+
 /*
  * Extremely large metaslabs, vdev-wide trees, and dnode-wide trees may
  * require 64-bit integers for ranges.
@@ -115,6 +130,22 @@ typedef zfs_range_seg_gap_t zfs_range_seg_max_t;
  */
 typedef void zfs_range_seg_t;
 
+static inline uint32_t
+zfs_rs24_get(const uint8_t *field)
+{
+	return (field[0] | ((uint32_t)field[1] << 8) |
+	    ((uint32_t)field[2] << 16));
+}
+
+static inline void
+zfs_rs24_set(uint8_t *field, uint64_t val)
+{
+	ASSERT3U(val, <=, ZFS_RANGE_SEG24_MAX);
+	field[0] = (uint8_t)val;
+	field[1] = (uint8_t)(val >> 8);
+	field[2] = (uint8_t)(val >> 16);
+}
+
 struct zfs_range_tree_ops {
 	void    (*rtop_create)(zfs_range_tree_t *rt, void *arg);
 	void    (*rtop_destroy)(zfs_range_tree_t *rt, void *arg);
@@ -134,6 +165,8 @@ zfs_rs_get_start_raw(const zfs_range_seg_t *rs, const zfs_range_tree_t *rt)
 		return (((const zfs_range_seg64_t *)rs)->rs_start);
 	case ZFS_RANGE_SEG_GAP:
 		return (((const zfs_range_seg_gap_t *)rs)->rs_start);
+	case ZFS_RANGE_SEG24:
+		return (zfs_rs24_get(((const zfs_range_seg24_t *)rs)->rs_start));
 	default:
 		VERIFY(0);
 		return (0);
@@ -151,6 +184,8 @@ zfs_rs_get_end_raw(const zfs_range_seg_t *rs, const zfs_range_tree_t *rt)
 		return (((const zfs_range_seg64_t *)rs)->rs_end);
 	case ZFS_RANGE_SEG_GAP:
 		return (((const zfs_range_seg_gap_t *)rs)->rs_end);
+	case ZFS_RANGE_SEG24:
+		return (zfs_rs24_get(((const zfs_range_seg24_t *)rs)->rs_end));
 	default:
 		VERIFY(0);
 		return (0);
@@ -172,6 +207,11 @@ zfs_rs_get_fill_raw(const zfs_range_seg_t *rs, const zfs_range_tree_t *rt)
 	}
 	case ZFS_RANGE_SEG_GAP:
 		return (((const zfs_range_seg_gap_t *)rs)->rs_fill);
+	case ZFS_RANGE_SEG24: {
+		const zfs_range_seg24_t *r24 = (const zfs_range_seg24_t *)rs;
+		return (zfs_rs24_get(r24->rs_end) -
+		    zfs_rs24_get(r24->rs_start));
+	}
 	default:
 		VERIFY(0);
 		return (0);
@@ -212,6 +252,9 @@ zfs_rs_set_start_raw(zfs_range_seg_t *rs, zfs_range_tree_t *rt, uint64_t start)
 	case ZFS_RANGE_SEG_GAP:
 		((zfs_range_seg_gap_t *)rs)->rs_start = start;
 		break;
+	case ZFS_RANGE_SEG24:
+		zfs_rs24_set(((zfs_range_seg24_t *)rs)->rs_start, start);
+		break;
 	default:
 		VERIFY(0);
 	}
@@ -232,6 +275,9 @@ zfs_rs_set_end_raw(zfs_range_seg_t *rs, zfs_range_tree_t *rt, uint64_t end)
 	case ZFS_RANGE_SEG_GAP:
 		((zfs_range_seg_gap_t *)rs)->rs_end = end;
 		break;
+	case ZFS_RANGE_SEG24:
+		zfs_rs24_set(((zfs_range_seg24_t *)rs)->rs_end, end);
+		break;
 	default:
 		VERIFY(0);
 	}
@@ -246,6 +292,8 @@ zfs_zfs_rs_set_fill_raw(zfs_range_seg_t *rs, zfs_range_tree_t *rt,
 	case ZFS_RANGE_SEG32:
 		/* fall through */
 	case ZFS_RANGE_SEG64:
+		/* fall through */
+	case ZFS_RANGE_SEG24:
 		ASSERT3U(fill, ==, zfs_rs_get_end_raw(rs, rt) -
 		    zfs_rs_get_start_raw(rs, rt));
 		break;
@@ -311,6 +359,7 @@ uint64_t zfs_range_tree_max(zfs_range_tree_t *rt);
 uint64_t zfs_range_tree_span(zfs_range_tree_t *rt);
 
 void zfs_range_tree_add(void *arg, uint64_t start, uint64_t size);
+void zfs_range_tree_add_sorted(void *arg, uint64_t start, uint64_t size);
 void zfs_range_tree_remove(void *arg, uint64_t start, uint64_t size);
 void zfs_range_tree_remove_fill(zfs_range_tree_t *rt, uint64_t start,
     uint64_t size);
@@ -322,6 +371,7 @@ void zfs_range_tree_vacate(zfs_range_tree_t *rt, zfs_range_tree_func_t *func,
     void *arg);
 void zfs_range_tree_walk(zfs_range_tree_t *rt, zfs_range_tree_func_t *func,
     void *arg);
+void zfs_range_tree_merge(zfs_range_tree_t *src, zfs_range_tree_t *dst);
 zfs_range_seg_t *zfs_range_tree_first(zfs_range_tree_t *rt);
 
 void zfs_range_tree_remove_xor_add_segment(uint64_t start, uint64_t end,
@@ -218,6 +218,7 @@ struct sa_handle {
 	void		*sa_userp;
 	sa_idx_tab_t	*sa_bonus_tab;	 /* idx of bonus */
 	sa_idx_tab_t	*sa_spill_tab; /* only present if spill activated */
+	uint64_t	sa_gen;		/* bumped on every update */
 };
 
 #define	SA_GET_DB(hdl, type)	\
@@ -83,6 +83,9 @@ typedef struct {
 
 	/* algorithm type */
 	int algotype;
+
+	/* the FPU is held across updates, see SHA2FpuBegin() */
+	int fpu_held;
 } SHA2_CTX;
 
 /* SHA2 algorithm types */
@@ -98,12 +101,19 @@ typedef enum sha2_mech_type {
 /* SHA2 Init function */
 extern void SHA2Init(int algotype, SHA2_CTX *ctx);
 
+/* Pick the implementation fastest for a message of about this size */
+extern void SHA2SizeHint(SHA2_CTX *ctx, uint64_t size);
+
 /* SHA2 Update function */
 extern void SHA2Update(SHA2_CTX *ctx, const void *data, size_t len);
 
 /* SHA2 Final function */
 extern void SHA2Final(void *digest, SHA2_CTX *ctx);
 
+/* Hold the FPU across SHA2Update() calls */
+extern void SHA2FpuBegin(SHA2_CTX *ctx);
+extern void SHA2FpuEnd(SHA2_CTX *ctx);
+
 #ifdef __cplusplus
 }
 #endif
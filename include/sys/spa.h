@@ -71,6 +71,7 @@ struct bplist;
 struct dsl_pool;
 struct dsl_dataset;
 struct dsl_crypto_params;
+struct zio_trace;
 
 /*
  * Alignment Shift (ashift) is an immutable, internal top-level vdev property
@@ -853,6 +854,7 @@ extern int spa_scan_range(spa_t *spa, pool_scan_func_t func, uint64_t txgstart,
     uint64_t txgend);
 extern int spa_scan_stop(spa_t *spa);
 extern int spa_scrub_pause_resume(spa_t *spa, pool_scrub_cmd_t flag);
+extern int spa_scan_set_throttle(spa_t *spa, uint64_t rate, uint64_t latency);
 
 /* spa syncing */
 extern void spa_sync(spa_t *spa, uint64_t txg); /* only for DMU use */
@@ -866,6 +868,7 @@ void spa_sync_tq_destroy(spa_t *spa);
 uint_t spa_acq_allocator(spa_t *spa);
 void spa_rel_allocator(spa_t *spa, uint_t allocator);
 void spa_select_allocator(zio_t *zio);
+int spa_affinity_allocator(spa_t *spa);
 
 /* spa namespace global mutex */
 extern kmutex_t spa_namespace_lock;
@@ -940,6 +943,9 @@ typedef struct spa_stats {
 	spa_history_kstat_t	state;		/* pool state */
 	spa_history_kstat_t	guid;		/* pool guid */
 	spa_history_kstat_t	iostats;
+	spa_history_kstat_t	zstd_auto;
+	spa_history_kstat_t	allocators;
+	spa_history_list_t	zio_trace;
 } spa_stats_t;
 
 typedef enum txg_state {
@@ -951,6 +957,24 @@ typedef enum txg_state {
 	TXG_STATE_COMMITTED	= 5,
 } txg_state_t;
 
+/*
+ * Phases of spa_sync() whose wall time and I/O counts are recorded in the
+ * txg history.  Phases repeated on each sync pass are summed.
+ */
+typedef enum spa_sync_phase {
+	SPA_SYNC_PHASE_DSL_POOL,	/* dsl_pool_sync() */
+	SPA_SYNC_PHASE_FREES,		/* spa_sync_frees() */
+	SPA_SYNC_PHASE_BRT,		/* brt_sync() */
+	SPA_SYNC_PHASE_DDT,		/* ddt_sync() */
+	SPA_SYNC_PHASE_SCAN,		/* dsl_scan_sync() and errorscrub */
+	SPA_SYNC_PHASE_LOG_FLUSH,	/* spa_flush_metaslabs() */
+	SPA_SYNC_PHASE_VDEV,		/* vdev_sync() and metaslab_sync() */
+	SPA_SYNC_PHASE_DEFERRED_FREES,	/* spa_sync_deferred_frees() */
+	SPA_SYNC_PHASE_CONFIG,		/* vdev_config_sync() */
+	SPA_SYNC_PHASE_DONE,		/* dsl_pool and vdev sync_done */
+	SPA_SYNC_PHASES
+} spa_sync_phase_t;
+
 typedef struct txg_stat {
 	vdev_stat_t		vs1;
 	vdev_stat_t		vs2;
@@ -986,6 +1010,12 @@ typedef struct spa_iostats {
 	kstat_named_t	direct_read_bytes;
 	kstat_named_t	direct_write_count;
 	kstat_named_t	direct_write_bytes;
+	kstat_named_t	raidz_expand_copy_count;
+	kstat_named_t	raidz_expand_copy_bytes;
+	kstat_named_t	raidz_expand_copy_nsecs;
+	kstat_named_t	mmp_writes_rotational;
+	kstat_named_t	mmp_writes_nonrotational;
+	kstat_named_t	mmp_writes_batched;
 } spa_iostats_t;
 
 extern void spa_stats_init(spa_t *spa);
@@ -998,7 +1028,18 @@ extern int spa_txg_history_set(spa_t *spa,  uint64_t txg,
 extern txg_stat_t *spa_txg_history_init_io(spa_t *, uint64_t,
     struct dsl_pool *);
 extern void spa_txg_history_fini_io(spa_t *, txg_stat_t *);
+extern int spa_txg_history_set_flush(spa_t *spa, uint64_t txg,
+    uint64_t mflushed, hrtime_t flush_time);
+extern void spa_txg_history_phase_start(spa_t *spa);
+extern void spa_txg_history_phase_end(spa_t *spa, spa_sync_phase_t phase);
+extern int spa_txg_history_set_phases(spa_t *spa, uint64_t txg);
 extern void spa_tx_assign_add_nsecs(spa_t *spa, uint64_t nsecs);
+extern void spa_zio_trace_add(spa_t *spa, struct zio_trace *zt);
+extern void spa_zstd_auto_set_level(spa_t *spa, uint8_t level);
+extern void spa_zstd_auto_add(spa_t *spa, uint8_t level, uint64_t lsize,
+    uint64_t psize);
+extern void spa_allocator_stats_add(spa_t *spa, int allocator,
+    uint64_t allocs, uint64_t bytes, uint64_t contended);
 extern int spa_mmp_history_set_skip(spa_t *spa, uint64_t mmp_kstat_id);
 extern int spa_mmp_history_set(spa_t *spa, uint64_t mmp_kstat_id, int io_error,
     hrtime_t duration);
@@ -1013,6 +1054,10 @@ extern void spa_iostats_read_add(spa_t *spa, uint64_t size, uint64_t iops,
     dmu_flags_t flags);
 extern void spa_iostats_write_add(spa_t *spa, uint64_t size, uint64_t iops,
     dmu_flags_t flags);
+extern void spa_iostats_raidz_expand_add(spa_t *spa, uint64_t copies,
+    uint64_t bytes, uint64_t nsecs);
+extern void spa_iostats_mmp_add(spa_t *spa, uint64_t rotational,
+    uint64_t nonrotational, uint64_t batched);
 extern void spa_import_progress_add(spa_t *spa);
 extern void spa_import_progress_remove(uint64_t spa_guid);
 extern int spa_import_progress_set_mmp_check(uint64_t pool_guid,
@@ -1110,6 +1155,8 @@ extern void spa_set_deadman_failmode(spa_t *spa, const char *failmode);
 extern boolean_t spa_suspended(spa_t *spa);
 extern uint64_t spa_bootfs(spa_t *spa);
 extern uint64_t spa_get_last_scrubbed_txg(spa_t *spa);
+extern uint64_t spa_txg_from_time(spa_t *spa, uint64_t time,
+    boolean_t round_up);
 extern uint64_t spa_delegation(spa_t *spa);
 extern objset_t *spa_meta_objset(spa_t *spa);
 extern space_map_t *spa_syncing_log_sm(spa_t *spa);
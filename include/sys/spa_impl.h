@@ -191,6 +191,7 @@ typedef enum spa_proc_state {
 
 typedef struct spa_taskqs {
 	uint_t stqs_count;
+	uint_t stqs_nodes;	/* NUMA nodes the taskqs are split over */
 	taskq_t **stqs_taskq;
 } spa_taskqs_t;
 
@@ -244,6 +245,7 @@ struct spa {
 	boolean_t	spa_is_exporting;	/* true while exporting pool */
 	kthread_t	*spa_export_thread;	/* valid during pool export */
 	kthread_t	*spa_load_thread;	/* loading, no namespace lock */
+	taskq_t		*spa_vdev_load_taskq;	/* valid during vdev_load() */
 	metaslab_class_t *spa_normal_class;	/* normal data class */
 	metaslab_class_t *spa_log_class;	/* intent log data class */
 	metaslab_class_t *spa_embedded_log_class; /* log on normal vdevs */
@@ -414,6 +416,8 @@ struct spa {
 	uint64_t	spa_dspace;		/* dspace in normal class */
 	uint64_t	spa_rdspace;		/* raw (non-dedup) --//-- */
 	boolean_t	spa_active_ddt_prune;	/* ddt prune process active */
+	zthr_t		*spa_ddt_prune_zthr;	/* background ddt prune */
+	hrtime_t	spa_ddt_prune_time;	/* last background prune */
 	brt_vdev_t	**spa_brt_vdevs;	/* array of per-vdev BRTs */
 	uint64_t	spa_brt_nvdevs;		/* number of vdevs in BRT */
 	uint64_t	spa_brt_rangesize;	/* pool's BRT range size */
@@ -439,6 +443,12 @@ struct spa {
 	taskqid_t	spa_deadman_tqid;	/* Task id */
 	uint64_t	spa_deadman_calls;	/* number of deadman calls */
 	hrtime_t	spa_sync_starttime;	/* starting time of spa_sync */
+	hrtime_t	spa_sync_lasttime;	/* duration of last spa_sync */
+	hrtime_t	spa_sync_phase_start;	/* start of current phase */
+	uint64_t	spa_sync_phase_startios; /* leaf I/Os at phase start */
+	hrtime_t	spa_sync_phase_time[SPA_SYNC_PHASES];
+	uint64_t	spa_sync_phase_ios[SPA_SYNC_PHASES];
+	uint8_t		spa_zstd_auto_level;	/* level for zstd-auto */
 	uint64_t	spa_deadman_synctime;	/* deadman sync expiration */
 	uint64_t	spa_deadman_ziotime;	/* deadman zio expiration */
 	uint64_t	spa_all_vdev_zaps;	/* ZAP of per-vd ZAP obj #s */
@@ -446,6 +456,8 @@ struct spa {
 	uint64_t	spa_autotrim;		/* automatic background trim? */
 	uint64_t	spa_errata;		/* errata issues detected */
 	spa_stats_t	spa_stats;		/* assorted spa statistics */
+	/* zio stage times not charged to a leaf vdev (see zio_stage_histo) */
+	uint64_t	spa_stage_histo[ZIO_SH_TYPES][VDEV_L_HISTO_BUCKETS];
 	spa_keystore_t	spa_keystore;		/* loaded crypto keys */
 
 	/* arc_memory_throttle() parameters during low memory condition */
@@ -472,8 +484,11 @@ struct spa {
 
 	char		*spa_compatibility;	/* compatibility file(s) */
 	uint64_t	spa_dedup_table_quota;	/* property DDT maximum size */
+	uint64_t	spa_dedup_table_arc_reserve; /* property DDT ARC floor */
+	uint16_t	spa_ddt_arc_account;	/* ARC account of DDT blocks */
 	uint64_t	spa_dedup_dsize;	/* cached on-disk size of DDT */
 	uint64_t	spa_dedup_class_full_txg; /* txg dedup class was full */
+	boolean_t	spa_special_small_full; /* special full for small blks */
 
 	/*
 	 * spa_refcount & spa_config_lock must be the last elements
@@ -137,6 +137,26 @@ typedef struct space_map {
  * Note that a two-word entry will not straddle a block boundary.
  * If necessary, the last word of a block will be padded with a
  * debug entry (with act = syncpass = txg = 0).
+ *
+ *
+ * compact record (SPA_FEATURE_SPACEMAP_V3)
+ *
+ *     2     2     1      10              25                 24
+ *  +-----+-----+------+-------+-------------------+---------------+
+ *  | 1 1 | 0 1 | type |  pad  |       vdev        |    nbytes     |
+ *  +-----+-----+------+-------+-------------------+---------------+
+ *   63 62 61 60  59    58   49 48               24 23             0
+ *
+ * followed by howmany(nbytes, 8) words holding a stream of nbytes
+ * bytes.  Byte i of the stream is stored in bits [8 * (i % 8), +8)
+ * of word i / 8, so the encoding is independent of host byte order.
+ * The stream is a sequence of segments, each made up of two unsigned
+ * LEB128 variable-length integers: the distance (in sm_shift units)
+ * from the end of the previous segment of the record to the start of
+ * this one (from the start of the map for the first segment), followed
+ * by the run (in sm_shift units) minus one.  All segments of a record
+ * share its type and vdev, and a record never straddles a block
+ * boundary; blocks are padded with debug entries as above.
  */
 
 typedef enum {
@@ -202,9 +222,31 @@ typedef struct space_map_entry {
 #define	SM2_RUN_MAX		SM2_RUN_DECODE(~0ULL)
 #define	SM2_OFFSET_MAX		SM2_OFFSET_DECODE(~0ULL)
 
+/* compact record constants */
+#define	SM3_MARKER		1
+#define	SM3_NBYTES_BITS		24
+#define	SM3_VDEV_BITS		(SPA_VDEVBITS + 1)
+#define	SM3_RECORD_MAX_BYTES	4096
+#define	SM3_SEG_MAX_BYTES	20
+
+#define	SM_PAD_DECODE(x)	BF64_DECODE(x, 60, 2)
+#define	SM_PAD_ENCODE(x)	BF64_ENCODE(x, 60, 2)
+
+#define	SM3_TYPE_DECODE(x)	BF64_DECODE(x, 59, 1)
+#define	SM3_TYPE_ENCODE(x)	BF64_ENCODE(x, 59, 1)
+#define	SM3_VDEV_DECODE(x)	\
+	BF64_DECODE(x, SM3_NBYTES_BITS, SM3_VDEV_BITS)
+#define	SM3_VDEV_ENCODE(x)	\
+	BF64_ENCODE(x, SM3_NBYTES_BITS, SM3_VDEV_BITS)
+#define	SM3_NBYTES_DECODE(x)	BF64_DECODE(x, 0, SM3_NBYTES_BITS)
+#define	SM3_NBYTES_ENCODE(x)	BF64_ENCODE(x, 0, SM3_NBYTES_BITS)
+
 boolean_t sm_entry_is_debug(uint64_t e);
 boolean_t sm_entry_is_single_word(uint64_t e);
 boolean_t sm_entry_is_double_word(uint64_t e);
+boolean_t sm_entry_is_compact(uint64_t e);
+uint64_t sm_compact_decode(const uint64_t *payload, uint64_t nbytes,
+    uint64_t *pos);
 
 typedef int (*sm_cb_t)(space_map_entry_t *sme, void *arg);
 
@@ -226,6 +268,7 @@ int64_t space_map_allocated(space_map_t *sm);
 uint64_t space_map_length(space_map_t *sm);
 uint64_t space_map_entries(space_map_t *sm, zfs_range_tree_t *rt);
 uint64_t space_map_nblocks(space_map_t *sm);
+int space_map_compact_size(space_map_t *sm, uint64_t *sizep);
 
 void space_map_write(space_map_t *sm, zfs_range_tree_t *rt, maptype_t maptype,
     uint64_t vdev_id, dmu_tx_t *tx);
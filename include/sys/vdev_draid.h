@@ -89,6 +89,8 @@ typedef struct vdev_draid_config {
 extern uint64_t vdev_draid_rand(uint64_t *);
 extern int vdev_draid_lookup_map(uint64_t, const draid_map_t **);
 extern int vdev_draid_generate_perms(const draid_map_t *, uint8_t **);
+extern void vdev_draid_group_children(const vdev_draid_config_t *, uint64_t,
+    uint8_t *);
 
 /*
  * General dRAID support functions.
@@ -136,6 +136,17 @@ typedef union vdev_queue_class {
 	avl_tree_t	vqc_tree;
 } vdev_queue_class_t;
 
+/*
+ * Adaptive max_active state of one I/O class, see "Latency Target" in
+ * vdev_queue.c.
+ */
+typedef struct vdev_queue_adapt {
+	uint32_t	vqa_max_active;	/* current depth of the class */
+	boolean_t	vqa_saturated;	/* depth reached during interval */
+	hrtime_t	vqa_min_lat;	/* fastest completion in interval */
+	hrtime_t	vqa_start;	/* start of the interval */
+} vdev_queue_adapt_t;
+
 struct vdev_queue {
 	vdev_t		*vq_vdev;
 	vdev_queue_class_t vq_class[ZIO_PRIORITY_NUM_QUEUEABLE];
@@ -148,9 +159,15 @@ struct vdev_queue {
 	uint32_t	vq_active;	/* Number of active I/Os. */
 	uint32_t	vq_ia_active;	/* Active interactive I/Os. */
 	uint32_t	vq_nia_credit;	/* Non-interactive I/Os credit. */
+	uint32_t	vq_ndeadline;	/* Queued I/Os with a deadline. */
 	list_t		vq_active_list;	/* List of active I/Os. */
 	hrtime_t	vq_io_complete_ts; /* time last i/o completed */
 	hrtime_t	vq_io_delta_ts;
+	vdev_queue_adapt_t vq_adapt[ZIO_PRIORITY_NUM_QUEUEABLE];
+	hrtime_t	vq_fg_lat_scan;	/* sync I/O latency during scan I/O */
+	hrtime_t	vq_fg_lat_idle;	/* sync I/O latency without scan I/O */
+	hrtime_t	vq_read_lat;	/* average read latency */
+	hrtime_t	vq_read_lat_ts;	/* time of the last read completion */
 	zio_t		vq_io_search; /* used as local for stack reduction */
 	kmutex_t	vq_lock;
 };
@@ -250,7 +267,9 @@ struct vdev {
 	boolean_t	vdev_expanding;	/* expand the vdev?		*/
 	boolean_t	vdev_reopening;	/* reopen in progress?		*/
 	boolean_t	vdev_nonrot;	/* true if solid state		*/
+	uint64_t	vdev_zone_size;	/* zone size if zoned, else 0	*/
 	int		vdev_load_error; /* error on last load		*/
+	uint32_t	vdev_load_pending; /* children still loading	*/
 	int		vdev_open_error; /* error on last open		*/
 	int		vdev_validate_error; /* error on last validate	*/
 	kthread_t	*vdev_open_thread; /* thread opening children	*/
@@ -267,6 +286,7 @@ struct vdev {
 	metaslab_group_t *vdev_mg;	/* metaslab group		*/
 	metaslab_group_t *vdev_log_mg;	/* embedded slog metaslab group	*/
 	metaslab_t	**vdev_ms;	/* metaslab array		*/
+	hrtime_t	vdev_ms_flush_time; /* avg metaslab_flush() time */
 	txg_list_t	vdev_ms_list;	/* per-txg dirty metaslab lists	*/
 	txg_list_t	vdev_dtl_list;	/* per-txg dirty DTL lists	*/
 	txg_node_t	vdev_txg_node;	/* per-txg dirty vdev linkage	*/
@@ -279,6 +299,7 @@ struct vdev {
 	uint64_t	vdev_noalloc;	/* device is passivated?	*/
 	uint64_t	vdev_removing;	/* device is being removed?	*/
 	uint64_t	vdev_failfast;	/* device failfast setting	*/
+	uint64_t	vdev_poll;	/* poll for sync I/O completion	*/
 	boolean_t	vdev_rz_expanding; /* raidz is being expanded?	*/
 	boolean_t	vdev_ishole;	/* is a hole in the namespace	*/
 	uint64_t	vdev_top_zap;
@@ -342,6 +363,7 @@ struct vdev {
 	kmutex_t	vdev_trim_io_lock;
 	kcondvar_t	vdev_trim_io_cv;
 	uint64_t	vdev_trim_inflight[3];
+	hrtime_t	vdev_autotrim_latency;	/* avg autotrim I/O time */
 
 	/*
 	 * Values stored in the config for an indirect or removing vdev.
@@ -77,6 +77,14 @@ typedef struct vdev_indirect_mapping_phys {
 
 #define	VDEV_INDIRECT_MAPPING_SIZE_V0	(3 * sizeof (uint64_t))
 
+/*
+ * vim_index holds the source offset of one in every 2^VIM_INDEX_SHIFT
+ * entries, and vim_cache holds 2^VIM_CACHE_SHIFT recently found entries.
+ */
+#define	VIM_INDEX_SHIFT		6
+#define	VIM_CACHE_SHIFT		6
+#define	VIM_CACHE_SIZE		(1 << VIM_CACHE_SHIFT)
+
 typedef struct vdev_indirect_mapping {
 	uint64_t	vim_object;
 	boolean_t	vim_havecounts;
@@ -93,6 +101,18 @@ typedef struct vdev_indirect_mapping {
 
 	dmu_buf_t	*vim_dbuf;
 	vdev_indirect_mapping_phys_t	*vim_phys;
+
+	/*
+	 * In-memory lookup state, rebuilt whenever vim_entries changes.
+	 * vim_index is a compact array of sampled source offsets which
+	 * narrows a lookup to a small window of vim_entries, and vim_cache
+	 * maps a hash of the offset to the (index + 1) of the entry last
+	 * found for it, or 0.  Cached indices are always validated, so
+	 * vim_cache may be updated without locking.
+	 */
+	uint64_t	*vim_index;
+	uint64_t	vim_index_count;
+	uint64_t	vim_cache[VIM_CACHE_SIZE];
 } vdev_indirect_mapping_t;
 
 extern vdev_indirect_mapping_t *vdev_indirect_mapping_open(objset_t *os,
@@ -135,6 +155,9 @@ extern void vdev_indirect_mapping_increment_obsolete_count(
 extern void vdev_indirect_mapping_free_obsolete_counts(
     vdev_indirect_mapping_t *vim, uint32_t *counts);
 
+extern void vdev_indirect_mapping_stat_init(void);
+extern void vdev_indirect_mapping_stat_fini(void);
+
 #ifdef	__cplusplus
 }
 #endif
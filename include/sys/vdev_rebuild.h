@@ -58,21 +58,37 @@ typedef struct vdev_rebuild_phys {
 	uint64_t	vrp_errors;		/* errors during rebuild */
 } vdev_rebuild_phys_t;
 
+/*
+ * A rebuild is split across one or more cursors which each claim the next
+ * unscanned metaslab in order, and issue the rebuild I/O for its allocated
+ * extents.  All cursors share the in flight I/O limit of the rebuild.
+ */
+typedef struct vdev_rebuild_cursor {
+	struct vdev_rebuild *vrc_rebuild;	/* owning rebuild */
+	metaslab_t	*vrc_msp;		/* scanning disabled metaslab */
+	/* scan ranges (in metaslab) */
+	zfs_range_tree_t	*vrc_tree;
+	uint64_t	vrc_offset;		/* next offset to issue */
+} vdev_rebuild_cursor_t;
+
 /*
  * The vdev_rebuild_t describes the current state and how a top-level vdev
- * should be rebuilt.  The core elements are the top-vdev, the metaslab being
- * rebuilt, range tree containing the allocated extents and the on-disk state.
+ * should be rebuilt.  The core elements are the top-vdev, the cursors
+ * scanning its metaslabs and the on-disk state.
  */
 typedef struct vdev_rebuild {
 	vdev_t		*vr_top_vdev;		/* top-level vdev to rebuild */
-	metaslab_t	*vr_scan_msp;		/* scanning disabled metaslab */
-	/* scan ranges (in metaslab) */
-	zfs_range_tree_t	*vr_scan_tree;
+	vdev_rebuild_cursor_t *vr_cursors;	/* metaslab scan cursors */
+	uint_t		vr_ncursors;		/* number of cursors */
+	uint64_t	vr_scan_next_ms;	/* next metaslab to claim */
+	int		vr_scan_error;		/* first cursor error */
 	kmutex_t	vr_io_lock;		/* inflight IO lock */
 	kcondvar_t	vr_io_cv;		/* inflight IO cv */
 
 	/* In-core state and progress */
 	uint64_t	vr_scan_offset[TXG_SIZE];
+	uint64_t	vr_scan_txg[TXG_SIZE];	/* txg of update sync task */
+	uint64_t	vr_scan_max_txg;	/* highest txg issued */
 	uint64_t	vr_prev_scan_time_ms;	/* any previous scan time */
 	uint64_t	vr_bytes_inflight_max;	/* maximum bytes inflight */
 	uint64_t	vr_bytes_inflight;	/* current bytes inflight */
@@ -46,6 +46,13 @@ typedef struct spa_vdev_removal {
 	 */
 	list_t		svr_new_segments[TXG_SIZE];
 
+	/*
+	 * Copy tasks issued each txg, in source offset order.  Their
+	 * mappings are appended to svr_new_segments in this order when
+	 * the txg syncs.
+	 */
+	list_t		svr_copy_tasks[TXG_SIZE];
+
 	/*
 	 * Ranges that were freed while a mapping was in flight.  This is
 	 * a subset of the ranges covered by vdev_im_new_segments.
@@ -277,6 +277,21 @@ int zap_update_uint64_by_dnode(dnode_t *dn, const uint64_t *key,
     int key_numints,
     int integer_size, uint64_t num_integers, const void *val, dmu_tx_t *tx);
 
+/*
+ * Set nkeys attributes of a uint64-keyed zap object under a single lock
+ * of the zap.  The keys array holds nkeys keys of key_numints integers
+ * each, and vals holds the nkeys matching values of num_integers integers
+ * of integer_size each.  The entries are updated in hash order, so that
+ * consecutive updates mostly hit the same leaf.  On error, some of the
+ * attributes may have been set already.
+ */
+int zap_update_uint64_batch(objset_t *os, uint64_t zapobj,
+    const uint64_t *keys, int key_numints, uint64_t nkeys,
+    int integer_size, uint64_t num_integers, const void *vals, dmu_tx_t *tx);
+int zap_update_uint64_batch_by_dnode(dnode_t *dn,
+    const uint64_t *keys, int key_numints, uint64_t nkeys,
+    int integer_size, uint64_t num_integers, const void *vals, dmu_tx_t *tx);
+
 /*
  * Get the length (in integers) and the integer size of the specified
  * attribute.
@@ -355,6 +370,15 @@ int zap_lookup_int_key(objset_t *os, uint64_t obj,
 int zap_increment(objset_t *os, uint64_t obj, const char *name, int64_t delta,
     dmu_tx_t *tx);
 
+/*
+ * Like zap_increment() for each of the n names and deltas, but under a
+ * single lock of the zap and, for a fat zap, in hash order so that
+ * consecutive updates mostly hit the same leaf.  On error, some of the
+ * attributes may have been updated already.
+ */
+int zap_increment_batch(objset_t *os, uint64_t obj, const char *const *names,
+    const int64_t *deltas, uint64_t n, dmu_tx_t *tx);
+
 struct zap;
 struct zap_leaf;
 typedef struct zap_cursor {
@@ -429,6 +453,13 @@ void zap_cursor_advance(zap_cursor_t *zc);
  */
 uint64_t zap_cursor_serialize(zap_cursor_t *zc);
 
+/*
+ * Get the persistent cookie at which a cursor walk of zapobj would
+ * reach the attribute "name", without looking it up.
+ */
+int zap_cursor_serialize_name(objset_t *os, uint64_t zapobj,
+    const char *name, uint64_t *serialized);
+
 /*
  * Initialize a zap cursor pointing to the position recorded by
  * zap_cursor_serialize (in the "serialized" argument).  You can also
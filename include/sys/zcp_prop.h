@@ -27,6 +27,8 @@ extern "C" {
 
 int zcp_load_get_lib(lua_State *state);
 boolean_t prop_valid_for_ds(dsl_dataset_t *ds, zfs_prop_t zfs_prop);
+int zcp_get_system_prop_ds(lua_State *state, dsl_dataset_t *ds,
+    const char *dataset_name, zfs_prop_t zfs_prop);
 
 #ifdef	__cplusplus
 }
@@ -168,6 +168,7 @@ typedef struct zfs_acl {
 	zfs_acl_node_t	*z_curr_node;	/* current node iterator is handling */
 	list_t		z_acl;		/* chunks of ACE data */
 	const acl_ops_t	*z_ops;		/* ACL operations */
+	struct zfs_acl_access *z_access; /* recent access decisions */
 } zfs_acl_t;
 
 typedef struct acl_locator_cb {
@@ -274,6 +274,21 @@ extern int mutex_tryenter(kmutex_t *mp);
 #define	NESTED_SINGLE 1
 #define	mutex_enter_nested(mp, class) mutex_enter(mp)
 #define	mutex_enter_interruptible(mp) mutex_enter_check_return(mp)
+
+/*
+ * Lock contention statistics, collected by mutex_enter() and rw_enter()
+ * while zfs_lockstat_enabled is set.  Wait times are in nanoseconds.
+ */
+typedef struct zfs_lockstat {
+	uint64_t	zls_mutex_contended;
+	uint64_t	zls_mutex_wait;
+	uint64_t	zls_rw_contended;
+	uint64_t	zls_rw_wait;
+} zfs_lockstat_t;
+
+extern boolean_t zfs_lockstat_enabled;
+extern zfs_lockstat_t zfs_lockstat;
+
 /*
  * RW locks
  */
@@ -496,6 +511,8 @@ extern taskq_t	*taskq_create_synced(const char *, int, pri_t, int, int, uint_t,
 	    (taskq_create(a, b, c, d, e, f))
 #define	taskq_create_sysdc(a, b, d, e, p, dc, f) \
 	    ((void) sizeof (dc), taskq_create(a, b, maxclsyspri, d, e, f))
+#define	taskq_create_node(a, b, c, d, e, f, n) \
+	    ((void) sizeof (n), taskq_create(a, b, c, d, e, f))
 extern taskqid_t taskq_dispatch(taskq_t *, task_func_t, void *, uint_t);
 extern taskqid_t taskq_dispatch_delay(taskq_t *, task_func_t, void *, uint_t,
     clock_t);
@@ -623,6 +640,8 @@ extern void delay(clock_t ticks);
 
 #define	CPU_SEQID	((uintptr_t)pthread_self() & (max_ncpus - 1))
 #define	CPU_SEQID_UNSTABLE	CPU_SEQID
+#define	max_nnodes	1
+#define	CPU_NODEID_UNSTABLE	0
 
 #define	kcred		NULL
 #define	CRED()		NULL
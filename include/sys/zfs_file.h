@@ -62,4 +62,16 @@ zfs_file_t *zfs_file_get(int fd);
 void zfs_file_put(zfs_file_t *fp);
 void *zfs_file_private(zfs_file_t *fp);
 
+#ifndef _KERNEL
+typedef void (zfs_file_aio_done_t)(void *arg, void *buf, int err,
+    ssize_t resid);
+
+void zfs_file_aio_init(void);
+void zfs_file_aio_fini(void);
+int zfs_file_aio_pread(zfs_file_t *fp, void *buf, size_t len, loff_t off,
+    zfs_file_aio_done_t *done, void *arg);
+int zfs_file_aio_pwrite(zfs_file_t *fp, const void *buf, size_t len,
+    loff_t off, zfs_file_aio_done_t *done, void *arg);
+#endif
+
 #endif /* _SYS_ZFS_FILE_H */
@@ -31,6 +31,27 @@
 extern "C" {
 #endif
 
+/*
+ * The fastest implementation is picked separately for small buffers, as
+ * the widest SIMD implementations can lose to narrower ones there.
+ */
+typedef enum zfs_impl_bucket {
+	ZFS_IMPL_BUCKET_4K,	/* buffers up to 4k */
+	ZFS_IMPL_BUCKET_16K,	/* buffers up to 16k */
+	ZFS_IMPL_BUCKET_LARGE,	/* larger buffers */
+	ZFS_IMPL_BUCKETS
+} zfs_impl_bucket_t;
+
+static inline zfs_impl_bucket_t
+zfs_impl_bucket(uint64_t size)
+{
+	if (size <= 4096)
+		return (ZFS_IMPL_BUCKET_4K);
+	if (size <= 16384)
+		return (ZFS_IMPL_BUCKET_16K);
+	return (ZFS_IMPL_BUCKET_LARGE);
+}
+
 /* generic implementation backends */
 typedef struct
 {
@@ -46,8 +67,8 @@ typedef struct
 	/* get name of selected implementation */
 	const char *(*getname)(void);
 
-	/* setup id as fastest implementation */
-	void (*set_fastest)(uint32_t id);
+	/* setup id as fastest implementation for a size bucket */
+	void (*set_fastest)(uint32_t id, zfs_impl_bucket_t bucket);
 
 	/* set implementation by id */
 	void (*setid)(uint32_t id);
@@ -46,15 +46,26 @@ struct zfs_locked_range;
 
 typedef void (zfs_rangelock_cb_t)(struct zfs_locked_range *, void *);
 
+typedef struct zfs_rangelock_stripe {
+	kmutex_t rls_lock;
+	avl_tree_t rls_tree;	/* contains locked_range_t */
+} zfs_rangelock_stripe_t;
+
 typedef struct zfs_rangelock {
 	avl_tree_t rl_tree; /* contains locked_range_t */
 	kmutex_t rl_lock;
 	zfs_rangelock_cb_t *rl_cb;
 	void *rl_arg;
+	uint64_t rl_fast;	/* fast reader and writer counts */
+	kcondvar_t rl_fast_cv;	/* cv for writers waiting on fast readers */
+	uint32_t rl_nmain;	/* locks held in or waiting for rl_tree */
+	uint_t rl_stripe_shift;	/* log2 of the offset region per stripe */
+	zfs_rangelock_stripe_t *rl_stripes; /* allocated on demand */
 } zfs_rangelock_t;
 
 typedef struct zfs_locked_range {
 	zfs_rangelock_t *lr_rangelock; /* rangelock that this lock applies to */
+	zfs_rangelock_stripe_t *lr_stripe; /* stripe holding it, or NULL */
 	avl_node_t lr_node;	/* avl node link */
 	uint64_t lr_offset;	/* file range offset */
 	uint64_t lr_length;	/* file range length */
@@ -65,6 +76,7 @@ typedef struct zfs_locked_range {
 	uint8_t lr_proxy;	/* acting for original range */
 	uint8_t lr_write_wanted; /* writer wants to lock this range */
 	uint8_t lr_read_wanted;	/* reader wants to lock this range */
+	uint8_t lr_fast;	/* reader taken without the tree */
 } zfs_locked_range_t;
 
 void zfs_rangelock_init(zfs_rangelock_t *, zfs_rangelock_cb_t *, void *);
@@ -74,6 +86,8 @@ zfs_locked_range_t *zfs_rangelock_enter(zfs_rangelock_t *,
     uint64_t, uint64_t, zfs_rangelock_type_t);
 zfs_locked_range_t *zfs_rangelock_tryenter(zfs_rangelock_t *,
     uint64_t, uint64_t, zfs_rangelock_type_t);
+zfs_locked_range_t *zfs_rangelock_enter_nofast(zfs_rangelock_t *,
+    uint64_t, uint64_t, zfs_rangelock_type_t);
 void zfs_rangelock_exit(zfs_locked_range_t *);
 void zfs_rangelock_reduce(zfs_locked_range_t *, uint64_t, uint64_t);
 
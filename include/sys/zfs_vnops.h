@@ -33,6 +33,9 @@ extern int zfs_bclone_enabled;
 
 extern int zfs_fsync(znode_t *, int, cred_t *);
 extern int zfs_read(znode_t *, zfs_uio_t *, int, cred_t *);
+typedef void zfs_read_done_func_t(void *, int, ssize_t);
+extern boolean_t zfs_read_async(znode_t *, zfs_uio_t *, int,
+    zfs_read_done_func_t *, void *);
 extern int zfs_write(znode_t *, zfs_uio_t *, int, cred_t *);
 extern int zfs_holey(znode_t *, ulong_t, loff_t *);
 extern int zfs_access(znode_t *, int, int, cred_t *);
@@ -47,6 +50,8 @@ extern int zfs_setsecattr(znode_t *, vsecattr_t *, int, cred_t *);
 
 extern int zfs_get_direct_alignment(znode_t *, uint64_t *);
 
+extern void zfs_dir_prefetch(znode_t *, const char *);
+
 extern int mappedread(znode_t *, int, zfs_uio_t *);
 extern int mappedread_sf(znode_t *, int, zfs_uio_t *);
 extern void update_pages(znode_t *, int64_t, int, objset_t *);
@@ -181,6 +181,17 @@ typedef struct zfs_dirlock {
 	struct zfs_dirlock *dl_next;	/* next in z_dirlocks list */
 } zfs_dirlock_t;
 
+/*
+ * Lookup-order walk state of a directory, used to prefetch the entries a
+ * walk in on-disk order will reach next (see zfs_dir_prefetch()).
+ */
+typedef struct zfs_dir_walk {
+	uint64_t	zw_pos;		/* cursor position of last lookup */
+	uint64_t	zw_dnode;	/* dnodes prefetched up to here */
+	uint64_t	zw_data;	/* first blocks prefetched up to here */
+	uint_t		zw_seq;		/* ascending lookups in a row */
+} zfs_dir_walk_t;
+
 typedef struct znode {
 	uint64_t	z_id;		/* object ID for this znode */
 	kmutex_t	z_lock;		/* znode modification lock */
@@ -196,9 +207,12 @@ typedef struct znode {
 	boolean_t	z_suspended;	/* extra ref from a suspend? */
 	uint_t		z_blksz;	/* block size in bytes */
 	uint_t		z_seq;		/* modification sequence number */
+	uint_t		z_wr_inplace;	/* small overwrites of 1st block */
+	uint_t		z_wr_maxsz;	/* size of largest such overwrite */
 	uint64_t	z_mapcnt;	/* number of pages mapped to file */
 	uint64_t	z_dnodesize;	/* dnode size */
 	uint64_t	z_size;		/* file size (cached) */
+	uint64_t	z_replay_eof;	/* new end of file - replay only */
 	uint64_t	z_pflags;	/* pflags (cached) */
 	uint32_t	z_sync_cnt;	/* synchronous open count */
 	mode_t		z_mode;		/* mode (cached) */
@@ -209,6 +223,7 @@ typedef struct znode {
 	uint64_t	z_xattr_parent;	/* parent obj for this xattr */
 	uint64_t	z_projid;	/* project ID */
 	list_node_t	z_link_node;	/* all znodes in fs link */
+	zfs_dir_walk_t	z_walk;		/* dir lookup walk state */
 	sa_handle_t	*z_sa_hdl;	/* handle to sa data */
 
 	/*
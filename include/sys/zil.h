@@ -472,6 +472,12 @@ typedef struct itx {
 	uint8_t		itx_lr_data[];	/* type-specific part of lr_xx_t */
 } itx_t;
 
+/*
+ * Number of buckets in the zil latency histograms, the last one covering
+ * everything from 2^(ZIL_LAT_BUCKETS - 2) us (~4s) up.
+ */
+#define	ZIL_LAT_BUCKETS		24
+
 /*
  * Used for zil kstat.
  */
@@ -506,6 +512,13 @@ typedef struct zil_stats {
 	kstat_named_t zil_commit_suspend_count;
 	kstat_named_t zil_commit_crash_count;
 
+	/*
+	 * Total time in nanoseconds spent in zil_commit(), from the request
+	 * until the caller's records are on stable storage. Divide by
+	 * zil_commit_count for the average commit latency.
+	 */
+	kstat_named_t zil_commit_time;
+
 	/*
 	 * Number of transactions (reads, writes, renames, etc.)
 	 * that have been committed.
@@ -544,6 +557,19 @@ typedef struct zil_stats {
 	kstat_named_t zil_itx_metaslab_slog_bytes;
 	kstat_named_t zil_itx_metaslab_slog_write;
 	kstat_named_t zil_itx_metaslab_slog_alloc;
+
+	/*
+	 * Log2 latency histograms, in microseconds. Bucket 0 counts
+	 * operations that took less than 1us, bucket n counts those that
+	 * took [2^(n-1), 2^n) us, and the last bucket everything slower.
+	 * - commit: zil_commit() from request to stable storage
+	 * - lwb_write: lwb write issue until the write zio is done
+	 * - lwb_flush: lwb write done until its vdev flushes are done
+	 * These are named at runtime by zil_kstat_values_init().
+	 */
+	kstat_named_t zil_commit_lat[ZIL_LAT_BUCKETS];
+	kstat_named_t zil_lwb_write_lat[ZIL_LAT_BUCKETS];
+	kstat_named_t zil_lwb_flush_lat[ZIL_LAT_BUCKETS];
 } zil_kstat_values_t;
 
 typedef struct zil_sums {
@@ -553,6 +579,7 @@ typedef struct zil_sums {
 	wmsum_t zil_commit_stall_count;
 	wmsum_t zil_commit_suspend_count;
 	wmsum_t zil_commit_crash_count;
+	wmsum_t zil_commit_time;
 	wmsum_t zil_itx_count;
 	wmsum_t zil_itx_indirect_count;
 	wmsum_t zil_itx_indirect_bytes;
@@ -568,6 +595,9 @@ typedef struct zil_sums {
 	wmsum_t zil_itx_metaslab_slog_bytes;
 	wmsum_t zil_itx_metaslab_slog_write;
 	wmsum_t zil_itx_metaslab_slog_alloc;
+	wmsum_t zil_commit_lat[ZIL_LAT_BUCKETS];
+	wmsum_t zil_lwb_write_lat[ZIL_LAT_BUCKETS];
+	wmsum_t zil_lwb_flush_lat[ZIL_LAT_BUCKETS];
 } zil_sums_t;
 
 #define	ZIL_STAT_INCR(zil, stat, val) \
@@ -624,6 +654,8 @@ extern void	zil_close(zilog_t *zilog);
 
 extern boolean_t zil_replay(objset_t *os, void *arg,
     zil_replay_func_t *const replay_func[TX_MAX_TYPE]);
+extern boolean_t zil_replay_parallel(objset_t *os, void *arg,
+    zil_replay_func_t *const replay_func[TX_MAX_TYPE]);
 extern boolean_t zil_replaying(zilog_t *zilog, dmu_tx_t *tx);
 extern boolean_t zil_destroy(zilog_t *zilog, boolean_t keep_first);
 extern void	zil_destroy_sync(zilog_t *zilog, dmu_tx_t *tx);
@@ -665,6 +697,7 @@ extern itx_wr_state_t zil_write_state(zilog_t *zilog, uint64_t size,
 
 extern void zil_sums_init(zil_sums_t *zs);
 extern void zil_sums_fini(zil_sums_t *zs);
+extern void zil_kstat_values_init(zil_kstat_values_t *zs);
 extern void zil_kstat_values_update(zil_kstat_values_t *zs,
     zil_sums_t *zil_sums);
 
@@ -376,10 +376,14 @@ typedef struct zio_prop {
 	boolean_t		zp_byteorder:1;
 	boolean_t		zp_direct_write:1;
 	boolean_t		zp_rewrite:1;
+	boolean_t		zp_promote:1;
+	boolean_t		zp_complevel_auto:1;
+	boolean_t		zp_fused_cksum:1;
 	uint32_t		zp_zpl_smallblk;
 	uint8_t			zp_salt[ZIO_DATA_SALT_LEN];
 	uint8_t			zp_iv[ZIO_DATA_IV_LEN];
 	uint8_t			zp_mac[ZIO_DATA_MAC_LEN];
+	zio_cksum_t		zp_cksum;
 } zio_prop_t;
 
 typedef struct zio_cksum_report zio_cksum_report_t;
@@ -466,12 +470,58 @@ typedef struct zio_link {
 	list_node_t	zl_child_node;
 } zio_link_t;
 
+/*
+ * An offload provider takes pipeline work off the CPU, e.g. onto a
+ * hardware accelerator, and lets the zio wait for it without holding a
+ * taskq thread.  When zoo_checksum_start() accepts a request (returns 0)
+ * the provider must call zio_offload_done() exactly once when the work has
+ * completed, from any context.  The zio then re-executes its stage, which
+ * collects the result with zoo_checksum_fini() and falls back to the CPU
+ * if that fails.
+ */
+typedef struct zio_offload_req {
+	zio_t		*zor_zio;
+	const struct zio_offload_ops *zor_ops;
+	void		*zor_private;	/* provider state */
+} zio_offload_req_t;
+
+typedef struct zio_offload_ops {
+	const char	*zoo_name;
+	int		(*zoo_checksum_start)(zio_offload_req_t *zor,
+	    enum zio_checksum checksum, struct abd *abd, uint64_t size);
+	int		(*zoo_checksum_fini)(zio_offload_req_t *zor,
+	    struct abd *abd, uint64_t size, zio_cksum_t *zcp);
+} zio_offload_ops_t;
+
 enum zio_qstate {
 	ZIO_QS_NONE = 0,
 	ZIO_QS_QUEUED,
 	ZIO_QS_ACTIVE,
+	ZIO_QS_FAST,	/* active, issued without vq_lock */
 };
 
+/*
+ * Trace of a sampled zio, see zio_trace_sample.  zt_stage[i] is when the
+ * zio entered pipeline stage 1 << i, relative to its creation, or 0 if it
+ * never did.  Once the zio is destroyed, the trace is handed over to its
+ * pool's zio_trace kstat.
+ */
+typedef struct zio_trace {
+	hrtime_t	zt_start;	/* zio created at */
+	uint64_t	zt_txg;
+	uint64_t	zt_objset;
+	uint64_t	zt_object;
+	uint64_t	zt_size;
+	uint64_t	zt_guid;	/* leaf vdev, 0 if none */
+	hrtime_t	zt_queued;	/* time spent in the vdev queue */
+	hrtime_t	zt_device;	/* device access time */
+	zio_type_t	zt_type;
+	zio_priority_t	zt_priority;
+	int		zt_error;
+	hrtime_t	zt_stage[ZIO_STAGES];
+	procfs_list_node_t	zt_node;
+} zio_trace_t;
+
 struct zio {
 	/* Core information about this I/O */
 	zbookmark_phys_t	io_bookmark;
@@ -524,6 +574,7 @@ struct zio {
 	hrtime_t	io_timestamp;	/* submitted at */
 	hrtime_t	io_queued_timestamp;
 	hrtime_t	io_target_timestamp;
+	hrtime_t	io_deadline;	/* issue by, 0 if none */
 	hrtime_t	io_delta;	/* vdev queue service delta */
 	hrtime_t	io_delay;	/* Device access time (disk or */
 					/* file). */
@@ -543,6 +594,7 @@ struct zio {
 	uint64_t	*io_stall;
 	zio_t		*io_gang_leader;
 	zio_gang_node_t	*io_gang_tree;
+	zio_offload_req_t *io_offload;
 	void		*io_executor;
 	void		*io_waiter;
 	void		*io_bio;
@@ -550,6 +602,8 @@ struct zio {
 	kcondvar_t	io_cv;
 	int		io_allocator;
 
+	zio_trace_t	*io_trace;	/* NULL unless sampled */
+
 	/* FMA state */
 	zio_cksum_report_t *io_cksum_report;
 	uint64_t	io_ena;
@@ -622,8 +676,8 @@ extern zio_t *zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg,
     const blkptr_t *bp, zio_flag_t flags);
 
 extern int zio_alloc_zil(spa_t *spa, objset_t *os, uint64_t txg,
-    blkptr_t *new_bp, uint64_t min_size, uint64_t max_size, boolean_t *slog,
-    boolean_t allow_larger);
+    blkptr_t *new_bp, const blkptr_t *prev_bp, uint64_t min_size,
+    uint64_t max_size, boolean_t *slog, boolean_t allow_larger);
 extern void zio_flush(zio_t *zio, vdev_t *vd);
 extern void zio_shrink(zio_t *zio, uint64_t size);
 
@@ -633,15 +687,27 @@ extern int zio_wait(zio_t *zio);
 extern void zio_nowait(zio_t *zio);
 extern void zio_execute(void *zio);
 extern void zio_interrupt(void *zio);
+extern void zio_offload_register(const zio_offload_ops_t *ops);
+extern void zio_offload_unregister(const zio_offload_ops_t *ops);
+extern void zio_offload_done(zio_offload_req_t *zor);
 extern void zio_delay_init(zio_t *zio);
 extern void zio_delay_interrupt(zio_t *zio);
 extern void zio_deadman(zio_t *zio, const char *tag);
+extern void zio_stage_histo_add(spa_t *spa, vdev_t *vd,
+    zio_stage_histo_t sh, hrtime_t delta);
+
+extern int zio_stage_histo;
+
+extern void zio_trace_free(zio_trace_t *zt);
 
 extern zio_t *zio_walk_parents(zio_t *cio, zio_link_t **);
 extern zio_t *zio_walk_children(zio_t *pio, zio_link_t **);
 extern zio_t *zio_unique_parent(zio_t *cio);
 extern void zio_add_child(zio_t *pio, zio_t *cio);
 
+extern void zio_stats_raidz_write(uint64_t data, uint64_t parity,
+    uint64_t skip);
+
 extern void *zio_buf_alloc(size_t size);
 extern void zio_buf_free(void *buf, size_t size);
 extern void *zio_data_buf_alloc(size_t size);
@@ -680,6 +746,7 @@ extern enum zio_compress zio_compress_select(spa_t *spa,
     enum zio_compress child, enum zio_compress parent);
 extern uint8_t zio_complevel_select(spa_t *spa, enum zio_compress compress,
     uint8_t child, uint8_t parent);
+extern void zio_complevel_auto_update(spa_t *spa);
 
 extern void zio_suspend(spa_t *spa, zio_t *zio, zio_suspend_reason_t);
 extern int zio_resume(spa_t *spa);
@@ -116,7 +116,7 @@ enum zio_zstd_levels {
 	ZIO_ZSTD_LEVEL_FAST_500,
 	ZIO_ZSTD_LEVEL_FAST_1000,
 #define	ZIO_ZSTD_LEVEL_FAST_MAX	ZIO_ZSTD_LEVEL_FAST_1000
-	ZIO_ZSTD_LEVEL_AUTO = 251, /* Reserved for future use */
+	ZIO_ZSTD_LEVEL_AUTO = 251, /* Chosen per txg, see zstd-auto */
 	ZIO_ZSTD_LEVEL_LEVELS
 };
 
@@ -181,6 +181,21 @@ extern int zio_decompress_data(enum zio_compress c, abd_t *src, abd_t *abd,
     size_t s_len, size_t d_len, uint8_t *level);
 extern int zio_compress_to_feature(enum zio_compress comp);
 
+/*
+ * Results of the compression benchmark (see the compress_bench kstat).
+ */
+typedef struct zio_compress_bench {
+	uint64_t	zcb_compress_bw;	/* MiB/s */
+	uint64_t	zcb_decompress_bw;	/* MiB/s, 0 if not measured */
+	uint64_t	zcb_ratio;		/* s_len / c_len, times 100 */
+} zio_compress_bench_t;
+
+extern void zio_compress_bench_init(void);
+extern void zio_compress_bench_fini(void);
+extern void zio_compress_bench_run(void);
+extern int zio_compress_bench_get(enum zio_compress c, uint8_t level,
+    zio_compress_bench_t *zcb);
+
 #define	ZFS_COMPRESS_WRAP_DECL(name)					\
 size_t									\
 name(abd_t *src, abd_t *dst, size_t s_len, size_t d_len, int n)		\
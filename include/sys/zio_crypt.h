@@ -73,6 +73,25 @@ typedef struct zio_crypt_info {
 
 extern const zio_crypt_info_t zio_crypt_table[ZIO_CRYPT_FUNCTIONS];
 
+/* number of keys derived from non-current salts kept per loaded key */
+#define	ZIO_CRYPT_SALT_CACHE_SIZE	8
+
+/* an encryption key derived from the master key and an older salt */
+typedef struct zio_crypt_salt_key {
+	/* salt the key was derived from */
+	uint8_t zsk_salt[ZIO_DATA_SALT_LEN];
+
+	/* buffer for the derived encryption key */
+	uint8_t zsk_keydata[MASTER_KEY_MAX_LEN];
+
+	/* illumos crypto api key and template for the derived key */
+	crypto_key_t zsk_key;
+	crypto_ctx_template_t zsk_tmpl;
+
+	/* whether this entry holds a derived key */
+	boolean_t zsk_valid;
+} zio_crypt_salt_key_t;
+
 /* in memory representation of an unwrapped key that is loaded into memory */
 typedef struct zio_crypt_key {
 	/* encryption algorithm */
@@ -108,6 +127,15 @@ typedef struct zio_crypt_key {
 #else
 	/* template of current encryption key for illumos crypto api */
 	crypto_ctx_template_t zk_current_tmpl;
+
+	/* recently used keys derived from salts other than zk_salt */
+	zio_crypt_salt_key_t zk_salt_cache[ZIO_CRYPT_SALT_CACHE_SIZE];
+
+	/* next zk_salt_cache entry to replace */
+	uint_t zk_salt_cache_next;
+
+	/* lock protecting zk_salt_cache */
+	krwlock_t zk_salt_cache_lock;
 #endif
 
 	/* illumos crypto api current hmac key */
@@ -166,6 +166,9 @@ enum zio_stage {
 	ZIO_STAGE_DONE			= 1 << 26	/* RWFCXT */
 };
 
+/* number of pipeline stages, highbit64(ZIO_STAGE_DONE) */
+#define	ZIO_STAGES	27
+
 #define	ZIO_ROOT_PIPELINE			\
 	ZIO_STAGE_DONE
 
@@ -282,6 +285,16 @@ enum zio_stage {
 	ZIO_STAGE_DVA_CLAIM |			\
 	ZIO_STAGE_VDEV_IO_START)
 
+/*
+ * Stages whose execution time is recorded when zio_stage_histo is set.
+ * Queue and device time are taken from io_delta/io_delay instead.
+ */
+#define	ZIO_TIMED_STAGES			\
+	(ZIO_STAGE_WRITE_COMPRESS |		\
+	ZIO_STAGE_CHECKSUM_GENERATE |		\
+	ZIO_STAGE_DVA_ALLOCATE |		\
+	ZIO_STAGE_CHECKSUM_VERIFY)
+
 extern void zio_inject_init(void);
 extern void zio_inject_fini(void);
 
@@ -100,6 +100,18 @@ int zfs_zstd_decompress(abd_t *src, abd_t *dst, size_t s_len,
     size_t d_len, int n);
 void zfs_zstd_cache_reap_now(void);
 
+/* Dictionaries, see zfs_zstd_dict_create() */
+typedef struct zfs_zstd_dict zfs_zstd_dict_t;
+
+zfs_zstd_dict_t *zfs_zstd_dict_create(const void *buf, size_t len);
+void zfs_zstd_dict_hold(zfs_zstd_dict_t *zd);
+void zfs_zstd_dict_rele(zfs_zstd_dict_t *zd);
+uint32_t zfs_zstd_dict_id(const zfs_zstd_dict_t *zd);
+size_t zfs_zstd_compress_dict(abd_t *src, abd_t *dst, size_t s_len,
+    size_t d_len, int level, zfs_zstd_dict_t *zd);
+int zfs_zstd_decompress_dict(abd_t *src, abd_t *dst, size_t s_len,
+    size_t d_len, uint8_t *level, zfs_zstd_dict_t *zd);
+
 /*
  * So, the reason we have all these complicated set/get functions is that
  * originally, in the zstd "header" we wrote out to disk, we used a 32-bit
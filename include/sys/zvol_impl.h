@@ -74,12 +74,17 @@ typedef struct zv_request_stack {
 	struct bio	*bio;
 #ifdef __linux__
 	struct request	*rq;
+	hrtime_t	start;		/* arrival, for the I/O histograms */
 #endif
 } zv_request_t;
 
 typedef struct zv_request_task {
 	zv_request_t	zvr;
 	taskq_ent_t	ent;
+	avl_node_t	wq_node;	/* queued writes, for coalescing */
+	uint64_t	wq_offset;
+	uint64_t	wq_size;
+	boolean_t	wq_queued;
 } zv_request_task_t;
 
 /*
@@ -114,7 +119,7 @@ void zvol_insert(zvol_state_t *zv);
 void zvol_log_truncate(zvol_state_t *zv, dmu_tx_t *tx, uint64_t off,
     uint64_t len);
 void zvol_log_write(zvol_state_t *zv, dmu_tx_t *tx, uint64_t offset,
-    uint64_t size, boolean_t commit);
+    uint64_t size, boolean_t o_direct, boolean_t commit);
 int zvol_get_data(void *arg, uint64_t arg2, lr_write_t *lr, char *buf,
     struct lwb *lwb, zio_t *zio);
 int zvol_init_impl(void);
@@ -90,6 +90,7 @@ typedef enum spa_feature {
 	SPA_FEATURE_DYNAMIC_GANG_HEADER,
 	SPA_FEATURE_BLOCK_CLONING_ENDIAN,
 	SPA_FEATURE_PHYSICAL_REWRITE,
+	SPA_FEATURE_SPACEMAP_V3,
 	SPA_FEATURES
 } spa_feature_t;
 
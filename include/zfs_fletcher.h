@@ -37,6 +37,9 @@
 extern "C" {
 #endif
 
+/* Largest buffer whose checksum fletcher_4_combine() can fold in */
+#define	ZFS_FLETCHER_4_INC_MAX_SIZE	(8ULL << 20)
+
 /*
  * fletcher checksum functions
  *
@@ -64,6 +67,8 @@ _ZFS_FLETCHER_H void fletcher_4_byteswap(const void *, uint64_t, const void *,
     zio_cksum_t *);
 _ZFS_FLETCHER_H int fletcher_4_incremental_native(void *, size_t, void *);
 _ZFS_FLETCHER_H int fletcher_4_incremental_byteswap(void *, size_t, void *);
+_ZFS_FLETCHER_H void fletcher_4_combine(zio_cksum_t *, uint64_t,
+    const zio_cksum_t *);
 _ZFS_FLETCHER_H int fletcher_4_impl_set(const char *selector);
 _ZFS_FLETCHER_H void fletcher_4_init(void);
 _ZFS_FLETCHER_H void fletcher_4_fini(void);
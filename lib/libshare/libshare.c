@@ -32,6 +32,7 @@
 #include <string.h>
 #include <errno.h>
 #include <libintl.h>
+#include <pthread.h>
 #include <sys/file.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -59,6 +60,12 @@ const char *const sa_protocol_names[SA_PROTOCOL_COUNT] = {
 static const sa_fstype_t *fstypes[SA_PROTOCOL_COUNT] =
 	{&libshare_nfs_type, &libshare_smb_type};
 
+/*
+ * The protocol implementations keep global state and edit shared files, so
+ * serialize them here.  This lets callers share from many threads at once.
+ */
+static pthread_mutex_t sa_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int
 sa_enable_share(const char *zfsname, const char *mountpoint,
     const char *shareopts, enum sa_protocol protocol)
@@ -67,7 +74,10 @@ sa_enable_share(const char *zfsname, const char *mountpoint,
 
 	const struct sa_share_impl args =
 	    init_share(zfsname, mountpoint, shareopts);
-	return (fstypes[protocol]->enable_share(&args));
+	pthread_mutex_lock(&sa_lock);
+	int error = fstypes[protocol]->enable_share(&args);
+	pthread_mutex_unlock(&sa_lock);
+	return (error);
 }
 
 int
@@ -76,7 +86,10 @@ sa_disable_share(const char *mountpoint, enum sa_protocol protocol)
 	VALIDATE_PROTOCOL(protocol, SA_INVALID_PROTOCOL);
 
 	const struct sa_share_impl args = init_share(NULL, mountpoint, NULL);
-	return (fstypes[protocol]->disable_share(&args));
+	pthread_mutex_lock(&sa_lock);
+	int error = fstypes[protocol]->disable_share(&args);
+	pthread_mutex_unlock(&sa_lock);
+	return (error);
 }
 
 boolean_t
@@ -85,7 +98,27 @@ sa_is_shared(const char *mountpoint, enum sa_protocol protocol)
 	VALIDATE_PROTOCOL(protocol, B_FALSE);
 
 	const struct sa_share_impl args = init_share(NULL, mountpoint, NULL);
-	return (fstypes[protocol]->is_shared(&args));
+	pthread_mutex_lock(&sa_lock);
+	boolean_t shared = fstypes[protocol]->is_shared(&args);
+	pthread_mutex_unlock(&sa_lock);
+	return (shared);
+}
+
+/*
+ * Defer share changes for the protocol until the next sa_commit_shares(),
+ * which then applies them all at once.  Protocols which apply each change
+ * cheaply ignore this.
+ */
+void
+sa_begin_shares(enum sa_protocol protocol)
+{
+	/* CSTYLED */
+	VALIDATE_PROTOCOL(protocol, );
+
+	pthread_mutex_lock(&sa_lock);
+	if (fstypes[protocol]->begin_shares != NULL)
+		fstypes[protocol]->begin_shares();
+	pthread_mutex_unlock(&sa_lock);
 }
 
 void
@@ -94,7 +127,9 @@ sa_commit_shares(enum sa_protocol protocol)
 	/* CSTYLED */
 	VALIDATE_PROTOCOL(protocol, );
 
+	pthread_mutex_lock(&sa_lock);
 	fstypes[protocol]->commit_shares();
+	pthread_mutex_unlock(&sa_lock);
 }
 
 void
@@ -103,8 +138,10 @@ sa_truncate_shares(enum sa_protocol protocol)
 	/* CSTYLED */
 	VALIDATE_PROTOCOL(protocol, );
 
+	pthread_mutex_lock(&sa_lock);
 	if (fstypes[protocol]->truncate_shares != NULL)
 		fstypes[protocol]->truncate_shares();
+	pthread_mutex_unlock(&sa_lock);
 }
 
 int
@@ -41,6 +41,7 @@ typedef struct {
 	int (*const validate_shareopts)(const char *shareopts);
 	int (*const commit_shares)(void);
 	void (*const truncate_shares)(void);
+	void (*const begin_shares)(void);
 } sa_fstype_t;
 
 extern const sa_fstype_t libshare_nfs_type, libshare_smb_type;
@@ -27,6 +27,8 @@
 #include <fcntl.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <libshare.h>
 #include <unistd.h>
@@ -188,22 +190,22 @@ nfs_process_exports(const char *exports, const char *mountpoint,
 
 	FILE *oldfp = fopen(exports, "re");
 	if (oldfp != NULL) {
-		boolean_t need_mp_free;
-		char *mp;
-		if ((error = nfs_escape_mountpoint(mountpoint,
-		    &mp, &need_mp_free)) != SA_OK) {
+		boolean_t need_mp_free = B_FALSE;
+		char *mp = NULL;
+		if (mountpoint != NULL && (error = nfs_escape_mountpoint(
+		    mountpoint, &mp, &need_mp_free)) != SA_OK) {
 			(void) fclose(oldfp);
 			return (error);
 		}
 
 		char *buf = NULL, *sep;
-		size_t buflen = 0, mplen = strlen(mp);
+		size_t buflen = 0, mplen = mp != NULL ? strlen(mp) : 0;
 
 		while (cont && getline(&buf, &buflen, oldfp) != -1) {
 			if (buf[0] == '\n' || buf[0] == '#')
 				continue;
 
-			cont = cbk(userdata, buf,
+			cont = cbk(userdata, buf, mp != NULL &&
 			    (sep = strpbrk(buf, "\t \n")) != NULL &&
 			    sep - buf == mplen &&
 			    strncmp(buf, mp, mplen) == 0);
@@ -252,6 +254,206 @@ nfs_copy_entries(FILE *newfp, const char *exports, const char *mountpoint)
 	return (error);
 }
 
+/*
+ * While a batch is open, share changes are collected here instead of
+ * rewriting the exports file for each of them, and nfs_flush_batch() then
+ * applies them all with a single rewrite.  This state is protected by the
+ * lock taken around every libshare entry point in libshare.c.
+ */
+typedef struct nfs_batch_entry {
+	char	*nbe_mountpoint;	/* escaped, as in the exports file */
+	char	*nbe_entries;		/* exports lines, empty to unshare */
+	size_t	nbe_seq;
+} nfs_batch_entry_t;
+
+static struct {
+	boolean_t		nb_active;
+	const char		*nb_lockfile;
+	const char		*nb_exports;
+	const char		*nb_expdir;
+	nfs_batch_entry_t	*nb_ents;
+	size_t			nb_count;
+	size_t			nb_size;
+} nfs_batch;
+
+static void
+nfs_batch_discard(void)
+{
+	for (size_t i = 0; i < nfs_batch.nb_count; i++) {
+		free(nfs_batch.nb_ents[i].nbe_mountpoint);
+		free(nfs_batch.nb_ents[i].nbe_entries);
+	}
+	free(nfs_batch.nb_ents);
+	nfs_batch.nb_ents = NULL;
+	nfs_batch.nb_count = nfs_batch.nb_size = 0;
+}
+
+static int
+nfs_batch_add(const char *lockfile, const char *exports,
+    const char *expdir, sa_share_impl_t impl_share,
+    int(*cbk)(sa_share_impl_t impl_share, FILE *tmpfile))
+{
+	nfs_batch_entry_t *nbe;
+	boolean_t need_mp_free;
+	char *mp, *buf = NULL;
+	size_t buflen = 0;
+	FILE *fp;
+	int error;
+
+	if (nfs_batch.nb_count == nfs_batch.nb_size) {
+		size_t size = nfs_batch.nb_size == 0 ? 64 :
+		    nfs_batch.nb_size * 2;
+		nbe = realloc(nfs_batch.nb_ents, size * sizeof (*nbe));
+		if (nbe == NULL)
+			return (SA_NO_MEMORY);
+		nfs_batch.nb_ents = nbe;
+		nfs_batch.nb_size = size;
+	}
+
+	if ((fp = open_memstream(&buf, &buflen)) == NULL)
+		return (SA_NO_MEMORY);
+	error = cbk(impl_share, fp);
+	if (fclose(fp) != 0 && error == SA_OK)
+		error = SA_SYSTEM_ERR;
+	if (error == SA_OK) {
+		error = nfs_escape_mountpoint(impl_share->sa_mountpoint, &mp,
+		    &need_mp_free);
+	}
+	if (error == SA_OK && !need_mp_free && (mp = strdup(mp)) == NULL)
+		error = SA_NO_MEMORY;
+	if (error != SA_OK) {
+		free(buf);
+		return (error);
+	}
+
+	nbe = &nfs_batch.nb_ents[nfs_batch.nb_count];
+	nbe->nbe_mountpoint = mp;
+	nbe->nbe_entries = buf;
+	nbe->nbe_seq = nfs_batch.nb_count++;
+	nfs_batch.nb_lockfile = lockfile;
+	nfs_batch.nb_exports = exports;
+	nfs_batch.nb_expdir = expdir;
+
+	return (SA_OK);
+}
+
+static int
+nfs_batch_mountpoint_compare(const void *a, const void *b)
+{
+	const nfs_batch_entry_t *l = a, *r = b;
+
+	return (strcmp(l->nbe_mountpoint, r->nbe_mountpoint));
+}
+
+static int
+nfs_batch_compare(const void *a, const void *b)
+{
+	const nfs_batch_entry_t *l = a, *r = b;
+	int cmp = nfs_batch_mountpoint_compare(a, b);
+
+	if (cmp != 0)
+		return (cmp);
+	return (l->nbe_seq < r->nbe_seq ? -1 : l->nbe_seq > r->nbe_seq);
+}
+
+static boolean_t
+nfs_copy_unbatched_cb(void *userdata, char *line, boolean_t found_mountpoint)
+{
+	(void) found_mountpoint;
+	FILE *newfp = userdata;
+	nfs_batch_entry_t key;
+	char *sep, c = '\0';
+
+	if ((sep = strpbrk(line, "\t \n")) != NULL) {
+		c = *sep;
+		*sep = '\0';
+	}
+	key.nbe_mountpoint = line;
+	boolean_t batched = bsearch(&key, nfs_batch.nb_ents,
+	    nfs_batch.nb_count, sizeof (nfs_batch_entry_t),
+	    nfs_batch_mountpoint_compare) != NULL;
+	if (sep != NULL)
+		*sep = c;
+
+	if (!batched)
+		fputs(line, newfp);
+	return (B_TRUE);
+}
+
+/*
+ * Start collecting share changes until the next nfs_flush_batch().
+ */
+void
+nfs_begin_batch(void)
+{
+	nfs_batch.nb_active = B_TRUE;
+}
+
+/*
+ * Apply the share changes collected since nfs_begin_batch(), keeping only
+ * the last change made to each mountpoint, and end the batch.
+ */
+int
+nfs_flush_batch(void)
+{
+	int error, nfs_lock_fd = -1;
+	struct tmpfile tmpf;
+	size_t i, n = 0;
+
+	if (!nfs_batch.nb_active)
+		return (SA_OK);
+	nfs_batch.nb_active = B_FALSE;
+	if (nfs_batch.nb_count == 0) {
+		nfs_batch_discard();
+		return (SA_OK);
+	}
+
+	qsort(nfs_batch.nb_ents, nfs_batch.nb_count,
+	    sizeof (nfs_batch_entry_t), nfs_batch_compare);
+	for (i = 0; i < nfs_batch.nb_count; i++) {
+		nfs_batch_entry_t *nbe = &nfs_batch.nb_ents[i];
+
+		if (i + 1 < nfs_batch.nb_count &&
+		    nfs_batch_mountpoint_compare(nbe, nbe + 1) == 0) {
+			free(nbe->nbe_mountpoint);
+			free(nbe->nbe_entries);
+			continue;
+		}
+		nfs_batch.nb_ents[n++] = *nbe;
+	}
+	nfs_batch.nb_count = n;
+
+	if (!nfs_init_tmpfile(nfs_batch.nb_exports, nfs_batch.nb_expdir,
+	    &tmpf)) {
+		nfs_batch_discard();
+		return (SA_SYSTEM_ERR);
+	}
+
+	error = nfs_exports_lock(nfs_batch.nb_lockfile, &nfs_lock_fd);
+	if (error != 0) {
+		nfs_abort_tmpfile(&tmpf);
+		nfs_batch_discard();
+		return (error);
+	}
+
+	fputs(FILE_HEADER, tmpf.fp);
+	error = nfs_process_exports(nfs_batch.nb_exports, NULL,
+	    nfs_copy_unbatched_cb, tmpf.fp);
+	for (i = 0; error == SA_OK && i < n; i++)
+		fputs(nfs_batch.nb_ents[i].nbe_entries, tmpf.fp);
+	if (error == SA_OK && ferror(tmpf.fp) != 0)
+		error = ferror(tmpf.fp);
+
+	if (error == SA_OK)
+		error = nfs_fini_tmpfile(nfs_batch.nb_exports, &tmpf);
+	else
+		nfs_abort_tmpfile(&tmpf);
+	nfs_exports_unlock(nfs_batch.nb_lockfile, &nfs_lock_fd);
+	nfs_batch_discard();
+
+	return (error);
+}
+
 int
 nfs_toggle_share(const char *lockfile, const char *exports,
     const char *expdir, sa_share_impl_t impl_share,
@@ -260,6 +462,11 @@ nfs_toggle_share(const char *lockfile, const char *exports,
 	int error, nfs_lock_fd = -1;
 	struct tmpfile tmpf;
 
+	if (nfs_batch.nb_active) {
+		return (nfs_batch_add(lockfile, exports, expdir, impl_share,
+		    cbk));
+	}
+
 	if (!nfs_init_tmpfile(exports, expdir, &tmpf))
 		return (SA_SYSTEM_ERR);
 
@@ -292,6 +499,9 @@ nfs_reset_shares(const char *lockfile, const char *exports)
 {
 	int nfs_lock_fd = -1;
 
+	/* Changes still pending in a batch are truncated away as well. */
+	nfs_batch_discard();
+
 	if (nfs_exports_lock(lockfile, &nfs_lock_fd) == 0) {
 		(void) ! truncate(exports, 0);
 		nfs_exports_unlock(lockfile, &nfs_lock_fd);
@@ -312,6 +522,29 @@ boolean_t
 nfs_is_shared_impl(const char *exports, sa_share_impl_t impl_share)
 {
 	boolean_t found = B_FALSE;
+
+	/* The most recent change still pending in a batch wins. */
+	if (nfs_batch.nb_count != 0) {
+		boolean_t need_mp_free;
+		char *mp;
+		size_t i;
+
+		if (nfs_escape_mountpoint(impl_share->sa_mountpoint, &mp,
+		    &need_mp_free) != SA_OK)
+			return (B_FALSE);
+		for (i = nfs_batch.nb_count; i > 0; i--) {
+			nfs_batch_entry_t *nbe = &nfs_batch.nb_ents[i - 1];
+			if (strcmp(nbe->nbe_mountpoint, mp) == 0) {
+				found = nbe->nbe_entries[0] != '\0';
+				break;
+			}
+		}
+		if (need_mp_free)
+			free(mp);
+		if (i > 0)
+			return (found);
+	}
+
 	nfs_process_exports(exports, impl_share->sa_mountpoint,
 	    nfs_is_shared_cb, &found);
 	return (found);
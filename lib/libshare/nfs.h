@@ -36,3 +36,5 @@ int nfs_toggle_share(const char *lockfile, const char *exports,
     const char *expdir, sa_share_impl_t impl_share,
     int(*cbk)(sa_share_impl_t impl_share, FILE *tmpfile));
 void nfs_reset_shares(const char *lockfile, const char *exports);
+void nfs_begin_batch(void);
+int nfs_flush_batch(void);
@@ -205,6 +205,10 @@ nfs_commit_shares(void)
 {
 	struct pidfh *pfh;
 	pid_t mountdpid;
+	int error;
+
+	if ((error = nfs_flush_batch()) != SA_OK)
+		return (error);
 
 start:
 	pfh = pidfile_open(_PATH_MOUNTDPID, 0600, &mountdpid);
@@ -241,4 +245,5 @@ const sa_fstype_t libshare_nfs_type = {
 	.validate_shareopts = nfs_validate_shareopts,
 	.commit_shares = nfs_commit_shares,
 	.truncate_shares = nfs_truncate_shares,
+	.begin_shares = nfs_begin_batch,
 };
@@ -526,6 +526,10 @@ nfs_validate_shareopts(const char *shareopts)
 static int
 nfs_commit_shares(void)
 {
+	int error = nfs_flush_batch();
+	if (error != SA_OK)
+		return (error);
+
 	if (!nfs_available())
 		return (SA_SYSTEM_ERR);
 
@@ -554,6 +558,7 @@ const sa_fstype_t libshare_nfs_type = {
 	.validate_shareopts = nfs_validate_shareopts,
 	.commit_shares = nfs_commit_shares,
 	.truncate_shares = nfs_truncate_shares,
+	.begin_shares = nfs_begin_batch,
 };
 
 static boolean_t
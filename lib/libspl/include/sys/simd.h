@@ -104,7 +104,8 @@ typedef enum cpuid_inst_sets {
 	MOVBE,
 	SHA_NI,
 	VAES,
-	VPCLMULQDQ
+	VPCLMULQDQ,
+	GFNI
 } cpuid_inst_sets_t;
 
 /*
@@ -131,6 +132,7 @@ typedef struct cpuid_feature_desc {
 #define	_MOVBE_BIT		(1U << 22)
 #define	_VAES_BIT		(1U << 9)
 #define	_VPCLMULQDQ_BIT		(1U << 10)
+#define	_GFNI_BIT		(1U << 8)
 #define	_SHA_NI_BIT		(1U << 29)
 
 /*
@@ -163,6 +165,7 @@ static const cpuid_feature_desc_t cpuid_features[] = {
 	[SHA_NI]	= {7U, 0U, _SHA_NI_BIT,		EBX	},
 	[VAES]		= {7U, 0U, _VAES_BIT,		ECX	},
 	[VPCLMULQDQ]	= {7U, 0U, _VPCLMULQDQ_BIT,	ECX	},
+	[GFNI]		= {7U, 0U, _GFNI_BIT,		ECX	},
 };
 
 /*
@@ -239,6 +242,7 @@ CPUID_FEATURE_CHECK(movbe, MOVBE);
 CPUID_FEATURE_CHECK(shani, SHA_NI);
 CPUID_FEATURE_CHECK(vaes, VAES);
 CPUID_FEATURE_CHECK(vpclmulqdq, VPCLMULQDQ);
+CPUID_FEATURE_CHECK(gfni, GFNI);
 
 /*
  * Detect register set support
@@ -407,6 +411,15 @@ zfs_vpclmulqdq_available(void)
 	return (__cpuid_has_vpclmulqdq());
 }
 
+/*
+ * Check if GFNI instruction is available
+ */
+static inline boolean_t
+zfs_gfni_available(void)
+{
+	return (__cpuid_has_gfni());
+}
+
 /*
  * AVX-512 family of instruction sets:
  *
@@ -42,6 +42,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -67,6 +68,21 @@ typedef int umem_constructor_t(void *, void *, int);
 typedef void umem_destructor_t(void *, void *);
 typedef void umem_reclaim_t(void *);
 
+/*
+ * Freed buffers of a cache are kept constructed in magazines, so they can be
+ * handed out again without going through malloc() and the constructor.  See
+ * lib/libspl/umem.c.
+ */
+#define	UMEM_MAGAZINE_ROUNDS	64
+#define	UMEM_MAGAZINE_BYTES	(32 * 1024)
+#define	UMEM_MAGAZINE_MAX	16
+
+typedef struct umem_magazine {
+	pthread_mutex_t		mag_lock;
+	int			mag_rounds;
+	void			*mag_round[UMEM_MAGAZINE_ROUNDS];
+} umem_magazine_t;
+
 typedef struct umem_cache {
 	char			cache_name[UMEM_CACHE_NAMELEN + 1];
 	size_t			cache_bufsize;
@@ -77,6 +93,9 @@ typedef struct umem_cache {
 	void			*cache_private;
 	void			*cache_arena;
 	int			cache_cflags;
+	int			cache_nmags;
+	int			cache_mag_rounds;
+	umem_magazine_t		*cache_mags;
 } umem_cache_t;
 
 /* Prototypes for functions to provide defaults for umem envvars */
@@ -157,72 +176,15 @@ static inline void
 umem_nofail_callback(umem_nofail_callback_t *cb __maybe_unused)
 {}
 
-static inline umem_cache_t *
-umem_cache_create(
-    const char *name, size_t bufsize, size_t align,
-    umem_constructor_t *constructor,
-    umem_destructor_t *destructor,
-    umem_reclaim_t *reclaim,
-    void *priv, void *vmp, int cflags)
-{
-	umem_cache_t *cp;
-
-	cp = (umem_cache_t *)umem_alloc(sizeof (umem_cache_t), UMEM_DEFAULT);
-	if (cp) {
-		strlcpy(cp->cache_name, name, UMEM_CACHE_NAMELEN);
-		cp->cache_bufsize = bufsize;
-		cp->cache_align = align;
-		cp->cache_constructor = constructor;
-		cp->cache_destructor = destructor;
-		cp->cache_reclaim = reclaim;
-		cp->cache_private = priv;
-		cp->cache_arena = vmp;
-		cp->cache_cflags = cflags;
-	}
-
-	return (cp);
-}
-
-static inline void
-umem_cache_destroy(umem_cache_t *cp)
-{
-	umem_free(cp, sizeof (umem_cache_t));
-}
-
-__attribute__((malloc))
-static inline void *
-umem_cache_alloc(umem_cache_t *cp, int flags)
-{
-	void *ptr = NULL;
-
-	if (cp->cache_align != 0)
-		ptr = umem_alloc_aligned(
-		    cp->cache_bufsize, cp->cache_align, flags);
-	else
-		ptr = umem_alloc(cp->cache_bufsize, flags);
-
-	if (ptr && cp->cache_constructor)
-		cp->cache_constructor(ptr, cp->cache_private, UMEM_DEFAULT);
-
-	return (ptr);
-}
-
-static inline void
-umem_cache_free(umem_cache_t *cp, void *ptr)
-{
-	if (cp->cache_destructor)
-		cp->cache_destructor(ptr, cp->cache_private);
-
-	if (cp->cache_align != 0)
-		umem_free_aligned(ptr, cp->cache_bufsize);
-	else
-		umem_free(ptr, cp->cache_bufsize);
-}
-
-static inline void
-umem_cache_reap_now(umem_cache_t *cp __maybe_unused)
-{
-}
+extern umem_cache_t *umem_cache_create(const char *name, size_t bufsize,
+    size_t align, umem_constructor_t *constructor,
+    umem_destructor_t *destructor, umem_reclaim_t *reclaim,
+    void *priv, void *vmp, int cflags);
+extern void umem_cache_destroy(umem_cache_t *cp);
+extern void *umem_cache_alloc(umem_cache_t *cp, int flags)
+    __attribute__((malloc));
+extern void umem_cache_free(umem_cache_t *cp, void *ptr);
+extern void umem_cache_reap_now(umem_cache_t *cp);
 
 #ifdef  __cplusplus
 }
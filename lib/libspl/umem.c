@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: CDDL-1.0
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Object caches for the malloc based umem implementation.
+ *
+ * Like the kernel's kmem caches, a cache keeps freed buffers in their
+ * constructed state, so a later umem_cache_alloc() can return one without
+ * calling malloc() and the constructor again.  Buffers are kept in up to
+ * UMEM_MAGAZINE_MAX magazines per cache, each with its own lock.  Every
+ * thread is assigned a magazine the first time it uses a cache, which
+ * spreads concurrent threads over the magazines much as the kernel's
+ * per-CPU caches do.  A magazine holds at most UMEM_MAGAZINE_BYTES worth of
+ * buffers, so caches of large buffers, such as the zio buffer caches, do
+ * not pin much memory; those of buffers larger than that are not cached.
+ *
+ * When built with AddressSanitizer, buffers are always freed, so that use
+ * after free is still detected.
+ */
+
+#include <errno.h>
+#include <umem.h>
+#include <unistd.h>
+#include <sys/param.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define	UMEM_NO_MAGAZINES
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define	UMEM_NO_MAGAZINES
+#endif
+#endif
+
+static unsigned int umem_magazine_next;
+static __thread int umem_magazine_id = -1;
+
+static umem_magazine_t *
+umem_cache_magazine(umem_cache_t *cp)
+{
+	if (umem_magazine_id == -1) {
+		umem_magazine_id = __atomic_fetch_add(&umem_magazine_next, 1,
+		    __ATOMIC_RELAXED) % UMEM_MAGAZINE_MAX;
+	}
+
+	return (&cp->cache_mags[umem_magazine_id % cp->cache_nmags]);
+}
+
+static void
+umem_cache_free_impl(umem_cache_t *cp, void *ptr)
+{
+	if (cp->cache_destructor)
+		cp->cache_destructor(ptr, cp->cache_private);
+
+	if (cp->cache_align != 0)
+		umem_free_aligned(ptr, cp->cache_bufsize);
+	else
+		umem_free(ptr, cp->cache_bufsize);
+}
+
+umem_cache_t *
+umem_cache_create(
+    const char *name, size_t bufsize, size_t align,
+    umem_constructor_t *constructor,
+    umem_destructor_t *destructor,
+    umem_reclaim_t *reclaim,
+    void *priv, void *vmp, int cflags)
+{
+	umem_cache_t *cp;
+
+	cp = (umem_cache_t *)umem_alloc(sizeof (umem_cache_t), UMEM_DEFAULT);
+	if (cp) {
+		strlcpy(cp->cache_name, name, UMEM_CACHE_NAMELEN);
+		cp->cache_bufsize = bufsize;
+		cp->cache_align = align;
+		cp->cache_constructor = constructor;
+		cp->cache_destructor = destructor;
+		cp->cache_reclaim = reclaim;
+		cp->cache_private = priv;
+		cp->cache_arena = vmp;
+		cp->cache_cflags = cflags;
+		cp->cache_nmags = 0;
+		cp->cache_mag_rounds = MIN(UMEM_MAGAZINE_ROUNDS,
+		    UMEM_MAGAZINE_BYTES / MAX(bufsize, 1));
+		cp->cache_mags = NULL;
+
+#ifndef UMEM_NO_MAGAZINES
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		int nmags = MAX(MIN(ncpus, UMEM_MAGAZINE_MAX), 1);
+
+		if (cp->cache_mag_rounds > 0) {
+			cp->cache_mags = umem_zalloc(
+			    nmags * sizeof (umem_magazine_t), UMEM_DEFAULT);
+		}
+		if (cp->cache_mags != NULL) {
+			for (int i = 0; i < nmags; i++) {
+				VERIFY0(pthread_mutex_init(
+				    &cp->cache_mags[i].mag_lock, NULL));
+			}
+			cp->cache_nmags = nmags;
+		}
+#endif
+	}
+
+	return (cp);
+}
+
+void
+umem_cache_destroy(umem_cache_t *cp)
+{
+	umem_cache_reap_now(cp);
+
+	for (int i = 0; i < cp->cache_nmags; i++)
+		VERIFY0(pthread_mutex_destroy(&cp->cache_mags[i].mag_lock));
+	if (cp->cache_mags != NULL) {
+		umem_free(cp->cache_mags,
+		    cp->cache_nmags * sizeof (umem_magazine_t));
+	}
+
+	umem_free(cp, sizeof (umem_cache_t));
+}
+
+void *
+umem_cache_alloc(umem_cache_t *cp, int flags)
+{
+	void *ptr = NULL;
+
+	if (cp->cache_nmags != 0) {
+		umem_magazine_t *mag = umem_cache_magazine(cp);
+
+		pthread_mutex_lock(&mag->mag_lock);
+		if (mag->mag_rounds > 0)
+			ptr = mag->mag_round[--mag->mag_rounds];
+		pthread_mutex_unlock(&mag->mag_lock);
+
+		if (ptr != NULL)
+			return (ptr);
+	}
+
+	if (cp->cache_align != 0)
+		ptr = umem_alloc_aligned(
+		    cp->cache_bufsize, cp->cache_align, flags);
+	else
+		ptr = umem_alloc(cp->cache_bufsize, flags);
+
+	if (ptr && cp->cache_constructor)
+		cp->cache_constructor(ptr, cp->cache_private, UMEM_DEFAULT);
+
+	return (ptr);
+}
+
+void
+umem_cache_free(umem_cache_t *cp, void *ptr)
+{
+	if (cp->cache_nmags != 0) {
+		umem_magazine_t *mag = umem_cache_magazine(cp);
+
+		pthread_mutex_lock(&mag->mag_lock);
+		if (mag->mag_rounds < cp->cache_mag_rounds) {
+			mag->mag_round[mag->mag_rounds++] = ptr;
+			ptr = NULL;
+		}
+		pthread_mutex_unlock(&mag->mag_lock);
+
+		if (ptr == NULL)
+			return;
+	}
+
+	umem_cache_free_impl(cp, ptr);
+}
+
+/*
+ * Free the buffers held in the magazines of the cache.
+ */
+void
+umem_cache_reap_now(umem_cache_t *cp)
+{
+	for (int i = 0; i < cp->cache_nmags; i++) {
+		umem_magazine_t *mag = &cp->cache_mags[i];
+
+		pthread_mutex_lock(&mag->mag_lock);
+		while (mag->mag_rounds > 0) {
+			void *ptr = mag->mag_round[--mag->mag_rounds];
+
+			pthread_mutex_unlock(&mag->mag_lock);
+			umem_cache_free_impl(cp, ptr);
+			pthread_mutex_lock(&mag->mag_lock);
+		}
+		pthread_mutex_unlock(&mag->mag_lock);
+	}
+}
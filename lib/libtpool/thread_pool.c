@@ -35,6 +35,21 @@
 static pthread_mutex_t thread_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 static tpool_t *thread_pools = NULL;
 
+/*
+ * The pool worker running on this thread, if any.
+ */
+static __thread tpool_worker_t *tpool_self = NULL;
+
+/*
+ * tp_idle and tp_current are only changed with tp_mutex held, but are
+ * read without it by tpool_dispatch() from within a job.
+ */
+#define	TP_COUNT_INC(cnt)	\
+	__atomic_add_fetch(&(cnt), 1, __ATOMIC_SEQ_CST)
+#define	TP_COUNT_DEC(cnt)	\
+	__atomic_sub_fetch(&(cnt), 1, __ATOMIC_SEQ_CST)
+#define	TP_COUNT_LOAD(cnt)	__atomic_load_n(&(cnt), __ATOMIC_SEQ_CST)
+
 static void
 delete_pool(tpool_t *tpool)
 {
@@ -67,6 +82,127 @@ delete_pool(tpool_t *tpool)
 	free(tpool);
 }
 
+/*
+ * Worker deques.  Jobs dispatched from within a job go onto the deque of
+ * the worker running it rather than the pool's queue, so that recursive
+ * fan-out doesn't serialize on tp_mutex.  The owner runs them newest
+ * first, which keeps nested work depth-first, and idle workers steal the
+ * oldest ones.  Lock order is tp_mutex > tpw_lock.
+ */
+static void
+deque_push(tpool_worker_t *worker, tpool_job_t *job)
+{
+	pthread_mutex_lock(&worker->tpw_lock);
+	job->tpj_prev = NULL;
+	job->tpj_next = worker->tpw_head;
+	if (worker->tpw_head != NULL)
+		worker->tpw_head->tpj_prev = job;
+	else
+		worker->tpw_tail = job;
+	worker->tpw_head = job;
+	pthread_mutex_unlock(&worker->tpw_lock);
+}
+
+static tpool_job_t *
+deque_pop(tpool_worker_t *worker)
+{
+	tpool_job_t *job;
+
+	pthread_mutex_lock(&worker->tpw_lock);
+	if ((job = worker->tpw_head) != NULL) {
+		worker->tpw_head = job->tpj_next;
+		if (worker->tpw_head != NULL)
+			worker->tpw_head->tpj_prev = NULL;
+		else
+			worker->tpw_tail = NULL;
+	}
+	pthread_mutex_unlock(&worker->tpw_lock);
+	return (job);
+}
+
+static tpool_job_t *
+deque_steal(tpool_worker_t *worker)
+{
+	tpool_job_t *job;
+
+	pthread_mutex_lock(&worker->tpw_lock);
+	if ((job = worker->tpw_tail) != NULL) {
+		worker->tpw_tail = job->tpj_prev;
+		if (worker->tpw_tail != NULL)
+			worker->tpw_tail->tpj_next = NULL;
+		else
+			worker->tpw_head = NULL;
+	}
+	pthread_mutex_unlock(&worker->tpw_lock);
+	return (job);
+}
+
+/*
+ * Move whatever is left on a worker's deque to the end of the pool's
+ * queue, oldest first.  This keeps the invariant that only active
+ * workers have jobs on their deques, which tpool_wait() relies on.
+ */
+static void
+deque_requeue(tpool_t *tpool, tpool_worker_t *worker)
+{
+	tpool_job_t *job;
+
+	while ((job = deque_steal(worker)) != NULL) {
+		job->tpj_next = NULL;
+		if (tpool->tp_head == NULL)
+			tpool->tp_head = job;
+		else
+			tpool->tp_tail->tpj_next = job;
+		tpool->tp_tail = job;
+		tpool->tp_njobs++;
+	}
+}
+
+/*
+ * Whether there is a job for an idle worker, either on the pool's queue
+ * or to be stolen from another worker.  Called with tp_mutex held.
+ */
+static int
+tpool_has_job(tpool_t *tpool)
+{
+	tpool_worker_t *worker;
+	int found = 0;
+
+	if (tpool->tp_head != NULL)
+		return (1);
+	for (worker = tpool->tp_workers; worker != NULL && !found;
+	    worker = worker->tpw_next) {
+		pthread_mutex_lock(&worker->tpw_lock);
+		found = (worker->tpw_tail != NULL);
+		pthread_mutex_unlock(&worker->tpw_lock);
+	}
+	return (found);
+}
+
+/*
+ * Take the next job for an idle worker.  Called with tp_mutex held.
+ */
+static tpool_job_t *
+tpool_take_job(tpool_t *tpool)
+{
+	tpool_worker_t *worker;
+	tpool_job_t *job;
+
+	if ((job = tpool->tp_head) != NULL) {
+		tpool->tp_head = job->tpj_next;
+		if (job == tpool->tp_tail)
+			tpool->tp_tail = NULL;
+		tpool->tp_njobs--;
+		return (job);
+	}
+	for (worker = tpool->tp_workers; worker != NULL;
+	    worker = worker->tpw_next) {
+		if ((job = deque_steal(worker)) != NULL)
+			return (job);
+	}
+	return (NULL);
+}
+
 /*
  * Worker thread is terminating.
  */
@@ -74,8 +210,18 @@ static void
 worker_cleanup(void *arg)
 {
 	tpool_t *tpool = (tpool_t *)arg;
-
-	if (--tpool->tp_current == 0 &&
+	tpool_worker_t *self = tpool_self;
+	tpool_worker_t **workerp;
+
+	for (workerp = &tpool->tp_workers; *workerp != self;
+	    workerp = &(*workerp)->tpw_next)
+		;
+	*workerp = self->tpw_next;
+	ASSERT(self->tpw_head == NULL);
+	(void) pthread_mutex_destroy(&self->tpw_lock);
+	tpool_self = NULL;
+
+	if (TP_COUNT_DEC(tpool->tp_current) == 0 &&
 	    (tpool->tp_flags & (TP_DESTROY | TP_ABANDON))) {
 		if (tpool->tp_flags & TP_ABANDON) {
 			pthread_mutex_unlock(&tpool->tp_mutex);
@@ -110,6 +256,7 @@ job_cleanup(void *arg)
 	tpool_active_t **activepp;
 
 	pthread_mutex_lock(&tpool->tp_mutex);
+	deque_requeue(tpool, tpool_self);
 	for (activepp = &tpool->tp_active; ; activepp = &activep->tpa_next) {
 		activep = *activepp;
 		if (activep->tpa_tid == my_tid) {
@@ -121,6 +268,30 @@ job_cleanup(void *arg)
 		notify_waiters(tpool);
 }
 
+/*
+ * Call a job's function, then restore the worker's signal mask and
+ * cancellation state.
+ */
+static void
+run_job(void (*func)(void *), void *arg)
+{
+	sigset_t maskset;
+	(void) pthread_sigmask(SIG_SETMASK, NULL, &maskset);
+
+	/*
+	 * Call the specified function.
+	 */
+	func(arg);
+	/*
+	 * We don't know what this thread has been doing,
+	 * so we reset its signal mask and cancellation
+	 * state back to the values prior to calling func().
+	 */
+	(void) pthread_sigmask(SIG_SETMASK, &maskset, NULL);
+	(void) pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+	(void) pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+}
+
 static void *
 tpool_worker(void *arg)
 {
@@ -129,8 +300,15 @@ tpool_worker(void *arg)
 	tpool_job_t *job;
 	void (*func)(void *);
 	tpool_active_t active;
+	tpool_worker_t self = { 0 };
+
+	(void) pthread_mutex_init(&self.tpw_lock, NULL);
+	self.tpw_pool = tpool;
 
 	pthread_mutex_lock(&tpool->tp_mutex);
+	self.tpw_next = tpool->tp_workers;
+	tpool->tp_workers = &self;
+	tpool_self = &self;
 	pthread_cleanup_push(worker_cleanup, tpool);
 
 	/*
@@ -140,10 +318,10 @@ tpool_worker(void *arg)
 	active.tpa_tid = pthread_self();
 	for (;;) {
 		elapsed = 0;
-		tpool->tp_idle++;
+		(void) TP_COUNT_INC(tpool->tp_idle);
 		if (tpool->tp_flags & TP_WAIT)
 			notify_waiters(tpool);
-		while ((tpool->tp_head == NULL ||
+		while ((!tpool_has_job(tpool) ||
 		    (tpool->tp_flags & TP_SUSPEND)) &&
 		    !(tpool->tp_flags & (TP_DESTROY | TP_ABANDON))) {
 			if (tpool->tp_current <= tpool->tp_minimum ||
@@ -163,7 +341,7 @@ tpool_worker(void *arg)
 				}
 			}
 		}
-		tpool->tp_idle--;
+		(void) TP_COUNT_DEC(tpool->tp_idle);
 		if (tpool->tp_flags & TP_DESTROY)
 			break;
 		if (tpool->tp_flags & TP_ABANDON) {
@@ -173,41 +351,36 @@ tpool_worker(void *arg)
 				(void) pthread_cond_broadcast(
 				    &tpool->tp_workcv);
 			}
-			if (tpool->tp_head == NULL)
+			if (!tpool_has_job(tpool))
 				break;
 		}
-		if ((job = tpool->tp_head) != NULL &&
-		    !(tpool->tp_flags & TP_SUSPEND)) {
+		if (!(tpool->tp_flags & TP_SUSPEND) &&
+		    (job = tpool_take_job(tpool)) != NULL) {
 			elapsed = 0;
 			func = job->tpj_func;
 			arg = job->tpj_arg;
-			tpool->tp_head = job->tpj_next;
-			if (job == tpool->tp_tail)
-				tpool->tp_tail = NULL;
-			tpool->tp_njobs--;
 			active.tpa_next = tpool->tp_active;
 			tpool->tp_active = &active;
 			pthread_mutex_unlock(&tpool->tp_mutex);
 			pthread_cleanup_push(job_cleanup, tpool);
 			free(job);
 
-			sigset_t maskset;
-			(void) pthread_sigmask(SIG_SETMASK, NULL, &maskset);
+			run_job(func, arg);
 
 			/*
-			 * Call the specified function.
-			 */
-			func(arg);
-			/*
-			 * We don't know what this thread has been doing,
-			 * so we reset its signal mask and cancellation
-			 * state back to the values prior to calling func().
+			 * Run the jobs dispatched by this one, newest first,
+			 * without going back through tp_mutex.  Anything left
+			 * when the pool is suspended or destroyed is put back
+			 * on the pool's queue by job_cleanup().
 			 */
-			(void) pthread_sigmask(SIG_SETMASK, &maskset, NULL);
-			(void) pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED,
-			    NULL);
-			(void) pthread_setcancelstate(PTHREAD_CANCEL_ENABLE,
-			    NULL);
+			while (!(__atomic_load_n(&tpool->tp_flags,
+			    __ATOMIC_ACQUIRE) & (TP_SUSPEND | TP_DESTROY)) &&
+			    (job = deque_pop(&self)) != NULL) {
+				func = job->tpj_func;
+				arg = job->tpj_arg;
+				free(job);
+				run_job(func, arg);
+			}
 			pthread_cleanup_pop(1);
 		}
 		if (elapsed && tpool->tp_current > tpool->tp_minimum) {
@@ -413,6 +586,7 @@ int
 tpool_dispatch(tpool_t *tpool, void (*func)(void *), void *arg)
 {
 	tpool_job_t *job;
+	tpool_worker_t *self = tpool_self;
 
 	ASSERT(!(tpool->tp_flags & (TP_DESTROY | TP_ABANDON)));
 
@@ -422,6 +596,31 @@ tpool_dispatch(tpool_t *tpool, void (*func)(void *), void *arg)
 	job->tpj_func = func;
 	job->tpj_arg = arg;
 
+	/*
+	 * A job dispatching more work to its own pool puts it on its
+	 * worker's deque, and only takes tp_mutex when there is an idle
+	 * worker to wake up or room for another one.  The idle count is
+	 * read after the push and raised before idle workers look for
+	 * work, so one of the two always sees the other.
+	 */
+	if (self != NULL && self->tpw_pool == tpool &&
+	    !(__atomic_load_n(&tpool->tp_flags, __ATOMIC_ACQUIRE) &
+	    TP_SUSPEND)) {
+		deque_push(self, job);
+		if (TP_COUNT_LOAD(tpool->tp_idle) == 0 &&
+		    TP_COUNT_LOAD(tpool->tp_current) >= tpool->tp_maximum)
+			return (0);
+
+		pthread_mutex_lock(&tpool->tp_mutex);
+		if (tpool->tp_idle > 0)
+			(void) pthread_cond_signal(&tpool->tp_workcv);
+		else if (tpool->tp_current < tpool->tp_maximum &&
+		    create_worker(tpool) == 0)
+			(void) TP_COUNT_INC(tpool->tp_current);
+		pthread_mutex_unlock(&tpool->tp_mutex);
+		return (0);
+	}
+
 	pthread_mutex_lock(&tpool->tp_mutex);
 
 	if (!(tpool->tp_flags & TP_SUSPEND)) {
@@ -432,7 +631,7 @@ tpool_dispatch(tpool_t *tpool, void (*func)(void *), void *arg)
 		} else {
 			if (create_worker(tpool) == 0) {
 				/* Started a new worker thread */
-				tpool->tp_current++;
+				(void) TP_COUNT_INC(tpool->tp_current);
 			} else if (tpool->tp_current > 0) {
 				/* Leave task on queue */
 			} else {
@@ -587,7 +786,7 @@ tpool_resume(tpool_t *tpool)
 	while (excess-- > 0 && tpool->tp_current < tpool->tp_maximum) {
 		if (create_worker(tpool) != 0)
 			break;		/* pthread_create() failed */
-		tpool->tp_current++;
+		(void) TP_COUNT_INC(tpool->tp_current);
 	}
 	pthread_mutex_unlock(&tpool->tp_mutex);
 }
@@ -45,10 +45,25 @@ extern "C" {
 typedef struct tpool_job tpool_job_t;
 struct tpool_job {
 	tpool_job_t	*tpj_next;		/* list of jobs */
+	tpool_job_t	*tpj_prev;		/* only used in worker deques */
 	void		(*tpj_func)(void *);	/* function to call */
 	void		*tpj_arg;		/* its argument */
 };
 
+/*
+ * Per-worker deque of jobs dispatched by the jobs the worker runs,
+ * linked through the worker's stack.  The worker takes the newest job
+ * from the head; idle workers steal the oldest one from the tail.
+ */
+typedef struct tpool_worker tpool_worker_t;
+struct tpool_worker {
+	tpool_worker_t	*tpw_next;	/* list of workers in the pool */
+	tpool_t		*tpw_pool;	/* the pool this worker belongs to */
+	pthread_mutex_t	tpw_lock;	/* protects the deque */
+	tpool_job_t	*tpw_head;	/* newest job */
+	tpool_job_t	*tpw_tail;	/* oldest job */
+};
+
 /*
  * List of active threads, linked through their stacks.
  */
@@ -69,6 +84,7 @@ struct tpool {
 	pthread_cond_t	tp_workcv;	/* synchronization with workers */
 	pthread_cond_t	tp_waitcv;	/* synchronization in tpool_wait() */
 	tpool_active_t	*tp_active;	/* threads performing work */
+	tpool_worker_t	*tp_workers;	/* all worker threads */
 	tpool_job_t	*tp_head;	/* FIFO job queue */
 	tpool_job_t	*tp_tail;
 	pthread_attr_t	tp_attr;	/* attributes of the workers */
@@ -303,9 +303,11 @@ zpool_handle(zfs_handle_t *zhp)
 	pool_name = zfs_alloc(zhp->zfs_hdl, len);
 	(void) strlcpy(pool_name, zhp->zfs_name, len);
 
+	pthread_mutex_lock(&zhp->zfs_hdl->libzfs_pool_handles_lock);
 	zph = zpool_find_handle(zhp, pool_name, len);
 	if (zph == NULL)
 		zph = zpool_add_handle(zhp, pool_name);
+	pthread_mutex_unlock(&zhp->zfs_hdl->libzfs_pool_handles_lock);
 
 	free(pool_name);
 	return (zph);
@@ -2791,6 +2793,10 @@ zfs_prop_get(zfs_handle_t *zhp, zfs_prop_t prop, char *propbuf, size_t proplen,
 	case ZFS_PROP_REFQUOTA:
 	case ZFS_PROP_RESERVATION:
 	case ZFS_PROP_REFRESERVATION:
+	case ZFS_PROP_ARC_LIMIT:
+	case ZFS_PROP_ARC_RESERVE:
+	case ZFS_PROP_PREFETCH_DISTANCE:
+	case ZFS_PROP_DIRTY_MAX:
 
 		if (get_numeric_property(zhp, prop, src, &source, &val) != 0)
 			return (-1);
@@ -43,6 +43,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <thread_pool.h>
 #include <sys/zfs_ioctl.h>
 #include <libzfs.h>
 #include <libzutil.h>
@@ -62,11 +63,41 @@
 #define	ZDIFF_RENAMED_COLOR  ANSI_BOLD_BLUE
 
 /*
- * Given a {dsname, object id}, get the object path
+ * In-use objects are resolved to their stats and paths in batches of this
+ * many objects, using up to ZDIFF_THREADS threads.  Resolving an object
+ * takes an ioctl per snapshot which walks the path up to the root, so doing
+ * them in parallel keeps the pool busy instead of waiting for each in turn.
+ * The results are then reported in object order.
+ */
+#define	ZDIFF_BATCH		256
+#define	ZDIFF_THREADS		16
+
+/*
+ * The stats and path of an object in one snapshot.
+ */
+typedef struct differ_stat {
+	int		ds_zerr;
+	zfs_stat_t	ds_sb;
+	char		ds_name[MAXPATHLEN];
+	char		ds_errbuf[ERRBUFLEN];
+} differ_stat_t;
+
+typedef struct differ_obj {
+	differ_info_t	*do_di;
+	uint64_t	do_obj;
+	int		do_fobjerr;
+	int		do_tobjerr;
+	differ_stat_t	do_from;
+	differ_stat_t	do_to;
+} differ_obj_t;
+
+/*
+ * Given a {dsname, object id}, get the object path.  This only fills in
+ * ds, so it may be called concurrently for different objects.
  */
 static int
 get_stats_for_obj(differ_info_t *di, const char *dsname, uint64_t obj,
-    char *pn, int maxlen, zfs_stat_t *sb)
+    differ_stat_t *ds)
 {
 	zfs_cmd_t zc = {"\0"};
 	int error;
@@ -76,32 +107,34 @@ get_stats_for_obj(differ_info_t *di, const char *dsname, uint64_t obj,
 
 	errno = 0;
 	error = zfs_ioctl(di->zhp->zfs_hdl, ZFS_IOC_OBJ_TO_STATS, &zc);
-	di->zerr = errno;
+	ds->ds_zerr = errno;
 
 	/* we can get stats even if we failed to get a path */
-	(void) memcpy(sb, &zc.zc_stat, sizeof (zfs_stat_t));
+	(void) memcpy(&ds->ds_sb, &zc.zc_stat, sizeof (zfs_stat_t));
 	if (error == 0) {
-		ASSERT0(di->zerr);
-		(void) strlcpy(pn, zc.zc_value, maxlen);
+		ASSERT0(ds->ds_zerr);
+		(void) strlcpy(ds->ds_name, zc.zc_value,
+		    sizeof (ds->ds_name));
 		return (0);
 	}
 
-	if (di->zerr == ESTALE) {
-		(void) snprintf(pn, maxlen, "(on_delete_queue)");
+	if (ds->ds_zerr == ESTALE) {
+		(void) snprintf(ds->ds_name, sizeof (ds->ds_name),
+		    "(on_delete_queue)");
 		return (0);
-	} else if (di->zerr == EPERM) {
-		(void) snprintf(di->errbuf, sizeof (di->errbuf),
+	} else if (ds->ds_zerr == EPERM) {
+		(void) snprintf(ds->ds_errbuf, sizeof (ds->ds_errbuf),
 		    dgettext(TEXT_DOMAIN,
 		    "The sys_config privilege or diff delegated permission "
 		    "is needed\nto discover path names"));
 		return (-1);
-	} else if (di->zerr == EACCES) {
-		(void) snprintf(di->errbuf, sizeof (di->errbuf),
+	} else if (ds->ds_zerr == EACCES) {
+		(void) snprintf(ds->ds_errbuf, sizeof (ds->ds_errbuf),
 		    dgettext(TEXT_DOMAIN,
 		    "Key must be loaded to discover path names"));
 		return (-1);
 	} else {
-		(void) snprintf(di->errbuf, sizeof (di->errbuf),
+		(void) snprintf(ds->ds_errbuf, sizeof (ds->ds_errbuf),
 		    dgettext(TEXT_DOMAIN,
 		    "Unable to determine path or stats for "
 		    "object %lld in %s"), (longlong_t)obj, dsname);
@@ -259,33 +292,47 @@ print_file(FILE *fp, differ_info_t *di, char type, const char *file,
 		color_end();
 }
 
+/*
+ * Check the from and to snapshots for info on the object.  This is run
+ * by the thread pool for every object of a batch.
+ */
+static void
+resolve_inuse_obj(void *arg)
+{
+	differ_obj_t *dobj = arg;
+	differ_info_t *di = dobj->do_di;
+
+	dobj->do_fobjerr = get_stats_for_obj(di, di->fromsnap, dobj->do_obj,
+	    &dobj->do_from);
+	dobj->do_tobjerr = get_stats_for_obj(di, di->tosnap, dobj->do_obj,
+	    &dobj->do_to);
+}
+
 static int
-write_inuse_diffs_one(FILE *fp, differ_info_t *di, uint64_t dobj)
+write_inuse_diffs_one(FILE *fp, differ_info_t *di, differ_obj_t *dobj)
 {
-	struct zfs_stat fsb, tsb;
+	differ_stat_t *from = &dobj->do_from;
+	differ_stat_t *to = &dobj->do_to;
+	zfs_stat_t *fsb = &from->ds_sb;
+	zfs_stat_t *tsb = &to->ds_sb;
+	char *fobjname = from->ds_name;
+	char *tobjname = to->ds_name;
 	mode_t fmode, tmode;
-	char fobjname[MAXPATHLEN], tobjname[MAXPATHLEN];
 	boolean_t already_logged = B_FALSE;
-	int fobjerr, tobjerr;
+	int fobjerr = dobj->do_fobjerr;
+	int tobjerr = dobj->do_tobjerr;
 	int change;
 
-	if (dobj == di->shares)
-		return (0);
-
 	/*
-	 * Check the from and to snapshots for info on the object. If
-	 * we get ENOENT, then the object just didn't exist in that
-	 * snapshot.  If we get ENOTSUP, then we tried to get
-	 * info on a non-ZPL object, which we don't care about anyway.
-	 * For any other error we print a warning which includes the
-	 * errno and continue.
+	 * If we got ENOENT, then the object just didn't exist in that
+	 * snapshot.  If we got ENOTSUP, then we tried to get info on a
+	 * non-ZPL object, which we don't care about anyway.  For any other
+	 * error we print a warning which includes the errno and continue.
 	 */
-
-	fobjerr = get_stats_for_obj(di, di->fromsnap, dobj, fobjname,
-	    MAXPATHLEN, &fsb);
-	if (fobjerr && di->zerr != ENOTSUP && di->zerr != ENOENT) {
-		zfs_error_aux(di->zhp->zfs_hdl, "%s", zfs_strerror(di->zerr));
-		zfs_error(di->zhp->zfs_hdl, di->zerr, di->errbuf);
+	if (fobjerr && from->ds_zerr != ENOTSUP && from->ds_zerr != ENOENT) {
+		zfs_error_aux(di->zhp->zfs_hdl, "%s",
+		    zfs_strerror(from->ds_zerr));
+		zfs_error(di->zhp->zfs_hdl, from->ds_zerr, from->ds_errbuf);
 		/*
 		 * Let's not print an error for the same object more than
 		 * once if it happens in both snapshots
@@ -293,71 +340,66 @@ write_inuse_diffs_one(FILE *fp, differ_info_t *di, uint64_t dobj)
 		already_logged = B_TRUE;
 	}
 
-	tobjerr = get_stats_for_obj(di, di->tosnap, dobj, tobjname,
-	    MAXPATHLEN, &tsb);
-
-	if (tobjerr && di->zerr != ENOTSUP && di->zerr != ENOENT) {
+	if (tobjerr && to->ds_zerr != ENOTSUP && to->ds_zerr != ENOENT) {
 		if (!already_logged) {
 			zfs_error_aux(di->zhp->zfs_hdl,
-			    "%s", zfs_strerror(di->zerr));
-			zfs_error(di->zhp->zfs_hdl, di->zerr, di->errbuf);
+			    "%s", zfs_strerror(to->ds_zerr));
+			zfs_error(di->zhp->zfs_hdl, to->ds_zerr,
+			    to->ds_errbuf);
 		}
 	}
 	/*
 	 * Unallocated object sharing the same meta dnode block
 	 */
-	if (fobjerr && tobjerr) {
-		di->zerr = 0;
+	if (fobjerr && tobjerr)
 		return (0);
-	}
 
-	di->zerr = 0; /* negate get_stats_for_obj() from side that failed */
-	fmode = fsb.zs_mode & S_IFMT;
-	tmode = tsb.zs_mode & S_IFMT;
-	if (fmode == S_IFDIR || tmode == S_IFDIR || fsb.zs_links == 0 ||
-	    tsb.zs_links == 0)
+	fmode = fsb->zs_mode & S_IFMT;
+	tmode = tsb->zs_mode & S_IFMT;
+	if (fmode == S_IFDIR || tmode == S_IFDIR || fsb->zs_links == 0 ||
+	    tsb->zs_links == 0)
 		change = 0;
 	else
-		change = tsb.zs_links - fsb.zs_links;
+		change = tsb->zs_links - fsb->zs_links;
 
 	if (fobjerr) {
 		if (change) {
-			print_link_change(fp, di, change, tobjname, &tsb);
+			print_link_change(fp, di, change, tobjname, tsb);
 			return (0);
 		}
-		print_file(fp, di, ZDIFF_ADDED, tobjname, &tsb);
+		print_file(fp, di, ZDIFF_ADDED, tobjname, tsb);
 		return (0);
 	} else if (tobjerr) {
 		if (change) {
-			print_link_change(fp, di, change, fobjname, &fsb);
+			print_link_change(fp, di, change, fobjname, fsb);
 			return (0);
 		}
-		print_file(fp, di, ZDIFF_REMOVED, fobjname, &fsb);
+		print_file(fp, di, ZDIFF_REMOVED, fobjname, fsb);
 		return (0);
 	}
 
-	if (fmode != tmode && fsb.zs_gen == tsb.zs_gen)
-		tsb.zs_gen++;	/* Force a generational difference */
+	if (fmode != tmode && fsb->zs_gen == tsb->zs_gen)
+		tsb->zs_gen++;	/* Force a generational difference */
 
 	/* Simple modification or no change */
-	if (fsb.zs_gen == tsb.zs_gen) {
+	if (fsb->zs_gen == tsb->zs_gen) {
 		/* No apparent changes.  Could we assert !this?  */
-		if (fsb.zs_ctime[0] == tsb.zs_ctime[0] &&
-		    fsb.zs_ctime[1] == tsb.zs_ctime[1])
+		if (fsb->zs_ctime[0] == tsb->zs_ctime[0] &&
+		    fsb->zs_ctime[1] == tsb->zs_ctime[1])
 			return (0);
 		if (change) {
 			print_link_change(fp, di, change,
-			    change > 0 ? fobjname : tobjname, &tsb);
+			    change > 0 ? fobjname : tobjname, tsb);
 		} else if (strcmp(fobjname, tobjname) == 0) {
-			print_file(fp, di, *ZDIFF_MODIFIED, fobjname, &tsb);
+			print_file(fp, di, *ZDIFF_MODIFIED, fobjname, tsb);
 		} else {
-			print_rename(fp, di, fobjname, tobjname, &tsb);
+			print_rename(fp, di, fobjname, tobjname, tsb);
 		}
 		return (0);
 	} else {
 		/* file re-created or object re-used */
-		print_file(fp, di, ZDIFF_REMOVED, fobjname, &fsb);
-		print_file(fp, di, ZDIFF_ADDED, tobjname, &tsb);
+		print_file(fp, di, ZDIFF_REMOVED, fobjname, fsb);
+		print_file(fp, di, ZDIFF_ADDED, tobjname, tsb);
 		return (0);
 	}
 }
@@ -365,32 +407,53 @@ write_inuse_diffs_one(FILE *fp, differ_info_t *di, uint64_t dobj)
 static int
 write_inuse_diffs(FILE *fp, differ_info_t *di, dmu_diff_record_t *dr)
 {
-	uint64_t o;
+	uint64_t o = dr->ddr_first;
 	int err;
 
-	for (o = dr->ddr_first; o <= dr->ddr_last; o++) {
-		if ((err = write_inuse_diffs_one(fp, di, o)) != 0)
-			return (err);
+	while (o <= dr->ddr_last) {
+		int n = 0;
+
+		for (; o <= dr->ddr_last && n < ZDIFF_BATCH; o++) {
+			differ_obj_t *dobj;
+
+			if (o == di->shares)
+				continue;
+
+			dobj = &di->batch[n++];
+			dobj->do_di = di;
+			dobj->do_obj = o;
+			if (di->tp == NULL ||
+			    tpool_dispatch(di->tp, resolve_inuse_obj, dobj) != 0)
+				resolve_inuse_obj(dobj);
+		}
+
+		if (di->tp != NULL)
+			tpool_wait(di->tp);
+
+		for (int i = 0; i < n; i++) {
+			err = write_inuse_diffs_one(fp, di, &di->batch[i]);
+			if (err != 0)
+				return (err);
+		}
 	}
 	return (0);
 }
 
 static int
-describe_free(FILE *fp, differ_info_t *di, uint64_t object, char *namebuf,
-    int maxlen)
+describe_free(FILE *fp, differ_info_t *di, uint64_t object,
+    differ_stat_t *ds)
 {
-	struct zfs_stat sb;
-
-	(void) get_stats_for_obj(di, di->fromsnap, object, namebuf,
-	    maxlen, &sb);
+	if (get_stats_for_obj(di, di->fromsnap, object, ds) != 0)
+		(void) strlcpy(di->errbuf, ds->ds_errbuf, sizeof (di->errbuf));
+	di->zerr = ds->ds_zerr;
 
 	/* Don't print if in the delete queue on from side */
-	if (di->zerr == ESTALE || di->zerr == ENOENT) {
+	if (ds->ds_zerr == ESTALE || ds->ds_zerr == ENOENT) {
 		di->zerr = 0;
 		return (0);
 	}
 
-	print_file(fp, di, ZDIFF_REMOVED, namebuf, &sb);
+	print_file(fp, di, ZDIFF_REMOVED, ds->ds_name, &ds->ds_sb);
 	return (0);
 }
 
@@ -399,7 +462,7 @@ write_free_diffs(FILE *fp, differ_info_t *di, dmu_diff_record_t *dr)
 {
 	zfs_cmd_t zc = {"\0"};
 	libzfs_handle_t *lhdl = di->zhp->zfs_hdl;
-	char fobjname[MAXPATHLEN];
+	differ_stat_t ds;
 
 	(void) strlcpy(zc.zc_name, di->fromsnap, sizeof (zc.zc_name));
 	zc.zc_obj = dr->ddr_first - 1;
@@ -418,8 +481,7 @@ write_free_diffs(FILE *fp, differ_info_t *di, dmu_diff_record_t *dr)
 			if (zc.zc_obj > dr->ddr_last) {
 				break;
 			}
-			(void) describe_free(fp, di, zc.zc_obj, fobjname,
-			    MAXPATHLEN);
+			(void) describe_free(fp, di, zc.zc_obj, &ds);
 		} else if (errno == ESRCH) {
 			break;
 		} else {
@@ -535,6 +597,9 @@ make_temp_snapshot(differ_info_t *di)
 static void
 teardown_differ_info(differ_info_t *di)
 {
+	if (di->tp != NULL)
+		tpool_destroy(di->tp);
+	free(di->batch);
 	free(di->ds);
 	free(di->dsmnt);
 	free(di->fromsnap);
@@ -776,6 +841,10 @@ zfs_show_diffs(zfs_handle_t *zhp, int outfd, const char *fromsnap,
 	di.outputfd = outfd;
 	di.datafd = pipefd[0];
 
+	/* Without a thread pool objects are resolved one at a time. */
+	di.batch = zfs_alloc(zhp->zfs_hdl, ZDIFF_BATCH * sizeof (differ_obj_t));
+	di.tp = tpool_create(1, ZDIFF_THREADS, 0, NULL);
+
 	if (pthread_create(&tid, NULL, differ, &di)) {
 		zfs_error_aux(zhp->zfs_hdl, "%s", zfs_strerror(errno));
 		(void) close(pipefd[0]);
@@ -820,11 +889,11 @@ zfs_show_diffs(zfs_handle_t *zhp, int outfd, const char *fromsnap,
 
 	(void) close(pipefd[1]);
 	(void) pthread_join(tid, NULL);
+	teardown_differ_info(&di);
 
 	if (di.zerr != 0) {
 		zfs_error_aux(zhp->zfs_hdl, "%s", zfs_strerror(di.zerr));
 		return (zfs_error(zhp->zfs_hdl, EZFS_DIFF, di.errbuf));
 	}
-	teardown_differ_info(&di);
 	return (0);
 }
@@ -67,6 +67,11 @@ struct libzfs_handle {
 	 */
 	pthread_mutex_t libzfs_mnttab_cache_lock;
 	avl_tree_t libzfs_mnttab_cache;
+	/*
+	 * Protects libzfs_pool_handles, which is added to when dataset
+	 * handles are created by parallel iteration threads.
+	 */
+	pthread_mutex_t libzfs_pool_handles_lock;
 	int libzfs_pool_iter;
 	boolean_t libzfs_prop_debug;
 	regex_t libzfs_urire;
@@ -225,6 +230,8 @@ typedef struct differ_info {
 	int cleanupfd;
 	int outputfd;
 	int datafd;
+	struct tpool *tp;		/* resolves objects in parallel */
+	struct differ_obj *batch;	/* objects being resolved */
 } differ_info_t;
 
 extern int do_mount(zfs_handle_t *zhp, const char *mntpt, const char *opts,
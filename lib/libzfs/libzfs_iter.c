@@ -62,8 +62,15 @@ zfs_iter_clones(zfs_handle_t *zhp, int flags __maybe_unused, zfs_iter_f func,
 	return (0);
 }
 
+/*
+ * The kernel sets zc_nvlist_dst_size to the size of the nvlist it returned,
+ * so the size of the buffer, which is reused for every entry of the list,
+ * is kept in *dst_size.  Otherwise every entry with larger properties than
+ * the previous one would fail with ENOMEM and be fetched a second time.
+ */
 static int
-zfs_do_list_ioctl(zfs_handle_t *zhp, int arg, zfs_cmd_t *zc)
+zfs_do_list_ioctl(zfs_handle_t *zhp, int arg, zfs_cmd_t *zc,
+    uint64_t *dst_size)
 {
 	int rc;
 	uint64_t	orig_cookie;
@@ -72,12 +79,15 @@ zfs_do_list_ioctl(zfs_handle_t *zhp, int arg, zfs_cmd_t *zc)
 top:
 	(void) strlcpy(zc->zc_name, zhp->zfs_name, sizeof (zc->zc_name));
 	zc->zc_objset_stats.dds_creation_txg = 0;
+	zc->zc_nvlist_dst_size = *dst_size;
 	rc = zfs_ioctl(zhp->zfs_hdl, arg, zc);
 
 	if (rc == -1) {
 		switch (errno) {
 		case ENOMEM:
 			/* expand nvlist memory and try again */
+			*dst_size = MAX(zc->zc_nvlist_dst_size, *dst_size * 2);
+			zc->zc_nvlist_dst_size = *dst_size;
 			zcmd_expand_dst_nvlist(zhp->zfs_hdl, zc);
 			zc->zc_cookie = orig_cookie;
 			goto top;
@@ -115,18 +125,20 @@ zfs_iter_filesystems_v2(zfs_handle_t *zhp, int flags, zfs_iter_f func,
 {
 	zfs_cmd_t zc = {"\0"};
 	zfs_handle_t *nzhp;
+	uint64_t dst_size;
 	int ret;
 
 	if (zhp->zfs_type != ZFS_TYPE_FILESYSTEM)
 		return (0);
 
 	zcmd_alloc_dst_nvlist(zhp->zfs_hdl, &zc, 0);
+	dst_size = zc.zc_nvlist_dst_size;
 
 	if ((flags & ZFS_ITER_SIMPLE) == ZFS_ITER_SIMPLE)
 		zc.zc_simple = B_TRUE;
 
 	while ((ret = zfs_do_list_ioctl(zhp, ZFS_IOC_DATASET_LIST_NEXT,
-	    &zc)) == 0) {
+	    &zc, &dst_size)) == 0) {
 		if (zc.zc_simple)
 			nzhp = make_dataset_simple_handle_zc(zhp, &zc);
 		else
@@ -164,6 +176,7 @@ zfs_iter_snapshots_v2(zfs_handle_t *zhp, int flags, zfs_iter_f func,
 {
 	zfs_cmd_t zc = {"\0"};
 	zfs_handle_t *nzhp;
+	uint64_t dst_size;
 	int ret;
 	nvlist_t *range_nvl = NULL;
 
@@ -174,6 +187,7 @@ zfs_iter_snapshots_v2(zfs_handle_t *zhp, int flags, zfs_iter_f func,
 	zc.zc_simple = (flags & ZFS_ITER_SIMPLE) != 0;
 
 	zcmd_alloc_dst_nvlist(zhp->zfs_hdl, &zc, 0);
+	dst_size = zc.zc_nvlist_dst_size;
 
 	if (min_txg != 0) {
 		range_nvl = fnvlist_alloc();
@@ -189,7 +203,7 @@ zfs_iter_snapshots_v2(zfs_handle_t *zhp, int flags, zfs_iter_f func,
 		zcmd_write_src_nvlist(zhp->zfs_hdl, &zc, range_nvl);
 
 	while ((ret = zfs_do_list_ioctl(zhp, ZFS_IOC_SNAPSHOT_LIST_NEXT,
-	    &zc)) == 0) {
+	    &zc, &dst_size)) == 0) {
 
 		if (zc.zc_simple)
 			nzhp = make_dataset_simple_handle_zc(zhp, &zc);
@@ -48,6 +48,7 @@
  *	zfs_share()
  *	zfs_unshare()
  *	zfs_unshareall()
+ *	zfs_begin_shares()
  *	zfs_commit_shares()
  *
  * The following functions are available for pool consumers, and will
@@ -778,6 +779,20 @@ zfs_is_shared(zfs_handle_t *zhp, char **where,
 	return (B_FALSE);
 }
 
+/*
+ * Collect the share changes made from now on and apply them all at once in
+ * the next zfs_commit_shares(), rather than one at a time.
+ */
+void
+zfs_begin_shares(const enum sa_protocol *proto)
+{
+	if (proto == NULL)
+		proto = share_all_proto;
+
+	for (const enum sa_protocol *p = proto; *p != SA_NO_PROTOCOL; ++p)
+		sa_begin_shares(*p);
+}
+
 void
 zfs_commit_shares(const enum sa_protocol *proto)
 {
@@ -1045,59 +1060,80 @@ libzfs_path_contains(const char *path1, const char *path2)
 }
 
 /*
- * Given a mountpoint specified by idx in the handles array, find the first
- * non-descendent of that mountpoint and return its index. Descendant paths
- * start with the parent's path. This function relies on the ordering
- * enforced by mountpoint_cmp().
+ * The mount schedule shared by all the tasks of one zfs_foreach_mountpoint()
+ * call.  The handles are sorted by mountpoint_cmp(), so the filesystems
+ * mounted beneath handles[i] are exactly handles[i + 1] up to, but not
+ * including, handles[ms_next[i]].  The mountpoints and the ms_next[] array
+ * are computed once up front, so that a task only has to look at its direct
+ * children to schedule them, and the workers aren't kept waiting on tasks
+ * which rescan the whole subtree below them.
  */
-static int
-non_descendant_idx(zfs_handle_t **handles, size_t num_handles, int idx)
-{
-	char parent[ZFS_MAXPROPLEN];
-	char child[ZFS_MAXPROPLEN];
-	int i;
+typedef struct mnt_sched {
+	libzfs_handle_t	*ms_hdl;
+	tpool_t		*ms_tp;
+	zfs_handle_t	**ms_zhps;	/* filesystems to mount */
+	size_t		ms_num_handles;
+	size_t		*ms_next;	/* index of first non-descendant */
+	zfs_iter_f	ms_func;
+	void		*ms_data;
+} mnt_sched_t;
 
-	verify(zfs_prop_get(handles[idx], ZFS_PROP_MOUNTPOINT, parent,
-	    sizeof (parent), NULL, NULL, 0, B_FALSE) == 0);
+typedef struct mnt_param {
+	mnt_sched_t	*mnt_sched;
+	size_t		mnt_idx;	/* Index of selected entry to mount */
+} mnt_param_t;
 
-	for (i = idx + 1; i < num_handles; i++) {
-		verify(zfs_prop_get(handles[i], ZFS_PROP_MOUNTPOINT, child,
-		    sizeof (child), NULL, NULL, 0, B_FALSE) == 0);
-		if (!libzfs_path_contains(parent, child))
-			break;
+/*
+ * For each mountpoint, find the index of the first entry after it which is
+ * not one of its descendants.  Descendant paths start with the parent's path
+ * and, thanks to the ordering enforced by mountpoint_cmp(), directly follow
+ * it.  Keep a stack of the entries whose subtree is still open: an entry
+ * which isn't beneath the top of the stack closes that subtree.
+ */
+static size_t *
+non_descendant_idx(libzfs_handle_t *hdl, zfs_handle_t **handles,
+    size_t num_handles)
+{
+	size_t *next = zfs_alloc(hdl, num_handles * sizeof (size_t));
+	size_t *stack = zfs_alloc(hdl, num_handles * sizeof (size_t));
+	char **mountpoints = zfs_alloc(hdl, num_handles * sizeof (char *));
+	char mountpoint[ZFS_MAXPROPLEN];
+	size_t depth = 0;
+
+	for (size_t i = 0; i < num_handles; i++) {
+		verify(zfs_prop_get(handles[i], ZFS_PROP_MOUNTPOINT,
+		    mountpoint, sizeof (mountpoint), NULL, NULL, 0,
+		    B_FALSE) == 0);
+		mountpoints[i] = zfs_strdup(hdl, mountpoint);
+
+		while (depth > 0 && !libzfs_path_contains(
+		    mountpoints[stack[depth - 1]], mountpoints[i]))
+			next[stack[--depth]] = i;
+		stack[depth++] = i;
 	}
-	return (i);
+	while (depth > 0)
+		next[stack[--depth]] = num_handles;
+
+	for (size_t i = 0; i < num_handles; i++)
+		free(mountpoints[i]);
+	free(mountpoints);
+	free(stack);
+	return (next);
 }
 
-typedef struct mnt_param {
-	libzfs_handle_t	*mnt_hdl;
-	tpool_t		*mnt_tp;
-	zfs_handle_t	**mnt_zhps; /* filesystems to mount */
-	size_t		mnt_num_handles;
-	int		mnt_idx;	/* Index of selected entry to mount */
-	zfs_iter_f	mnt_func;
-	void		*mnt_data;
-} mnt_param_t;
-
 /*
  * Allocate and populate the parameter struct for mount function, and
  * schedule mounting of the entry selected by idx.
  */
 static void
-zfs_dispatch_mount(libzfs_handle_t *hdl, zfs_handle_t **handles,
-    size_t num_handles, int idx, zfs_iter_f func, void *data, tpool_t *tp)
+zfs_dispatch_mount(mnt_sched_t *ms, size_t idx)
 {
-	mnt_param_t *mnt_param = zfs_alloc(hdl, sizeof (mnt_param_t));
+	mnt_param_t *mnt_param = zfs_alloc(ms->ms_hdl, sizeof (mnt_param_t));
 
-	mnt_param->mnt_hdl = hdl;
-	mnt_param->mnt_tp = tp;
-	mnt_param->mnt_zhps = handles;
-	mnt_param->mnt_num_handles = num_handles;
+	mnt_param->mnt_sched = ms;
 	mnt_param->mnt_idx = idx;
-	mnt_param->mnt_func = func;
-	mnt_param->mnt_data = data;
 
-	if (tpool_dispatch(tp, zfs_mount_task, (void*)mnt_param)) {
+	if (tpool_dispatch(ms->ms_tp, zfs_mount_task, (void*)mnt_param)) {
 		/* Could not dispatch to thread pool; execute directly */
 		zfs_mount_task((void*)mnt_param);
 	}
@@ -1149,8 +1185,8 @@ zfs_share_one(zfs_handle_t *zhp, void *arg)
 }
 
 /*
- * Thread pool function to mount one file system. On completion, it finds and
- * schedules its children to be mounted. This depends on the sorting done in
+ * Thread pool function to mount one file system. On completion, it schedules
+ * its children to be mounted. This depends on the sorting done in
  * zfs_foreach_mountpoint(). Note that the degenerate case (chain of entries
  * each descending from the previous) will have no parallelism since we always
  * have to wait for the parent to finish mounting before we can schedule
@@ -1160,39 +1196,21 @@ static void
 zfs_mount_task(void *arg)
 {
 	mnt_param_t *mp = arg;
-	int idx = mp->mnt_idx;
-	zfs_handle_t **handles = mp->mnt_zhps;
-	size_t num_handles = mp->mnt_num_handles;
-	char mountpoint[ZFS_MAXPROPLEN];
-
-	verify(zfs_prop_get(handles[idx], ZFS_PROP_MOUNTPOINT, mountpoint,
-	    sizeof (mountpoint), NULL, NULL, 0, B_FALSE) == 0);
+	mnt_sched_t *ms = mp->mnt_sched;
+	size_t idx = mp->mnt_idx;
 
-	if (mp->mnt_func(handles[idx], mp->mnt_data) != 0)
-		goto out;
+	free(mp);
+	if (ms->ms_func(ms->ms_zhps[idx], ms->ms_data) != 0)
+		return;
 
 	/*
 	 * We dispatch tasks to mount filesystems with mountpoints underneath
-	 * this one. We do this by dispatching the next filesystem with a
+	 * this one. We do this by dispatching the first filesystem with a
 	 * descendant mountpoint of the one we just mounted, then skip all of
 	 * its descendants, dispatch the next descendant mountpoint, and so on.
-	 * The non_descendant_idx() function skips over filesystems that are
-	 * descendants of the filesystem we just dispatched.
 	 */
-	for (int i = idx + 1; i < num_handles;
-	    i = non_descendant_idx(handles, num_handles, i)) {
-		char child[ZFS_MAXPROPLEN];
-		verify(zfs_prop_get(handles[i], ZFS_PROP_MOUNTPOINT,
-		    child, sizeof (child), NULL, NULL, 0, B_FALSE) == 0);
-
-		if (!libzfs_path_contains(mountpoint, child))
-			break; /* not a descendant, return */
-		zfs_dispatch_mount(mp->mnt_hdl, handles, num_handles, i,
-		    mp->mnt_func, mp->mnt_data, mp->mnt_tp);
-	}
-
-out:
-	free(mp);
+	for (size_t i = idx + 1; i < ms->ms_next[idx]; i = ms->ms_next[i])
+		zfs_dispatch_mount(ms, i);
 }
 
 /*
@@ -1242,19 +1260,29 @@ zfs_foreach_mountpoint(libzfs_handle_t *hdl, zfs_handle_t **handles,
 		return;
 	}
 
+	if (num_handles == 0)
+		return;
+
 	/*
 	 * Issue the callback function for each dataset using a parallel
 	 * algorithm that uses a thread pool to manage threads.
 	 */
-	tpool_t *tp = tpool_create(1, nthr, 0, NULL);
+	mnt_sched_t ms = {
+		.ms_hdl = hdl,
+		.ms_tp = tpool_create(1, nthr, 0, NULL),
+		.ms_zhps = handles,
+		.ms_num_handles = num_handles,
+		.ms_next = non_descendant_idx(hdl, handles, num_handles),
+		.ms_func = func,
+		.ms_data = data,
+	};
 
 	/*
 	 * There may be multiple "top level" mountpoints outside of the pool's
 	 * root mountpoint, e.g.: /foo /bar. Dispatch a mount task for each of
 	 * these.
 	 */
-	for (int i = 0; i < num_handles;
-	    i = non_descendant_idx(handles, num_handles, i)) {
+	for (size_t i = 0; i < num_handles; i = ms.ms_next[i]) {
 		/*
 		 * Since the mountpoints have been sorted so that the zoned
 		 * filesystems are at the end, a zoned filesystem seen from
@@ -1263,12 +1291,12 @@ zfs_foreach_mountpoint(libzfs_handle_t *hdl, zfs_handle_t **handles,
 		if (zoneid == GLOBAL_ZONEID &&
 		    zfs_prop_get_int(handles[i], ZFS_PROP_ZONED))
 			break;
-		zfs_dispatch_mount(hdl, handles, num_handles, i, func, data,
-		    tp);
+		zfs_dispatch_mount(&ms, i);
 	}
 
-	tpool_wait(tp);	/* wait for all scheduled mounts to complete */
-	tpool_destroy(tp);
+	tpool_wait(ms.ms_tp);	/* wait for all scheduled mounts to complete */
+	tpool_destroy(ms.ms_tp);
+	free(ms.ms_next);
 }
 
 /*
@@ -1309,17 +1337,17 @@ zpool_enable_datasets(zpool_handle_t *zhp, const char *mntopts, int flags,
 		ret = EZFS_MOUNTFAILED;
 
 	/*
-	 * Share all filesystems that need to be shared. This needs to be
-	 * a separate pass because libshare is not mt-safe, and so we need
-	 * to share serially.
+	 * Share all filesystems that need to be shared, in a separate pass
+	 * so that every filesystem is shared even if some mounts failed.
+	 * The share changes are collected and committed all at once.
 	 */
 	ms.ms_mntstatus = 0;
+	zfs_begin_shares(NULL);
 	zfs_foreach_mountpoint(zhp->zpool_hdl, cb.cb_handles, cb.cb_used,
-	    zfs_share_one, &ms, 1);
+	    zfs_share_one, &ms, nthr);
+	zfs_commit_shares(NULL);
 	if (ms.ms_mntstatus != 0)
 		ret = EZFS_SHAREFAILED;
-	else
-		zfs_commit_shares(NULL);
 
 out:
 	for (int i = 0; i < cb.cb_used; i++)
@@ -369,6 +369,14 @@ zpool_get_prop(zpool_handle_t *zhp, zpool_prop_t prop, char *buf,
 			}
 			zfs_fallthrough;
 
+		case ZPOOL_PROP_DEDUP_TABLE_ARC_RESERVE:
+			if (intval == 0) {
+				(void) strlcpy(buf, literal ? "0" : "none",
+				    len);
+				break;
+			}
+			zfs_fallthrough;
+
 		case ZPOOL_PROP_SIZE:
 		case ZPOOL_PROP_ALLOCATED:
 		case ZPOOL_PROP_FREE:
@@ -2777,6 +2785,39 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd) {
 	return (zpool_scan_range(zhp, func, cmd, 0, 0));
 }
 
+/*
+ * Set the pool's scrub and resilver issue limits: a rate in bytes per second
+ * per top-level vdev and a budget in microseconds for the latency scanning
+ * may add to foreground I/O. UINT64_MAX leaves a limit unchanged and zero
+ * removes it.
+ */
+int
+zpool_scan_throttle(zpool_handle_t *zhp, uint64_t rate, uint64_t latency)
+{
+	char errbuf[ERRBUFLEN];
+	int err;
+	libzfs_handle_t *hdl = zhp->zpool_hdl;
+
+	nvlist_t *args = fnvlist_alloc();
+	fnvlist_add_uint64(args, "scan_type", (uint64_t)POOL_SCAN_SCRUB);
+	fnvlist_add_uint64(args, "scan_command",
+	    (uint64_t)POOL_SCRUB_THROTTLE);
+	if (rate != UINT64_MAX)
+		fnvlist_add_uint64(args, "scan_rate", rate);
+	if (latency != UINT64_MAX)
+		fnvlist_add_uint64(args, "scan_latency", latency);
+
+	err = lzc_scrub(ZFS_IOC_POOL_SCRUB, zhp->zpool_name, args, NULL);
+	fnvlist_free(args);
+
+	if (err == 0)
+		return (0);
+
+	(void) snprintf(errbuf, sizeof (errbuf), dgettext(TEXT_DOMAIN,
+	    "cannot set scan throttle on %s"), zhp->zpool_name);
+	return (zpool_standard_error(hdl, err, errbuf));
+}
+
 int
 zpool_scan_range(zpool_handle_t *zhp, pool_scan_func_t func,
     pool_scrub_cmd_t cmd, time_t date_start, time_t date_end)
@@ -2747,6 +2747,9 @@ zfs_send_one_cb_impl(zfs_handle_t *zhp, const char *from, int fd,
 		    errbuf, &size);
 		if (err != 0)
 			return (err);
+		/* Parts are assumed to be of about the same size. */
+		if (flags->nparts > 1)
+			size /= flags->nparts;
 	}
 
 	if (flags->dryrun)
@@ -2777,8 +2780,14 @@ zfs_send_one_cb_impl(zfs_handle_t *zhp, const char *from, int fd,
 		SEND_PROGRESS_THREAD_PARENT_BLOCK(&oldmask);
 	}
 
-	err = lzc_send_redacted(name, from, fd,
-	    lzc_flags_from_sendflags(flags), redactbook);
+	if (flags->nparts > 1) {
+		err = lzc_send_part(name, from, fd,
+		    lzc_flags_from_sendflags(flags), redactbook, flags->part,
+		    flags->nparts);
+	} else {
+		err = lzc_send_redacted(name, from, fd,
+		    lzc_flags_from_sendflags(flags), redactbook);
+	}
 
 	if (send_progress_thread_exit(hdl, ptid, &oldmask))
 			return (-1);
@@ -4644,6 +4653,8 @@ zfs_receive_one(libzfs_handle_t *hdl, int infd, const char *tosnap,
 
 	boolean_t resuming = DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
 	    DMU_BACKUP_FEATURE_RESUMING;
+	boolean_t stream_part = DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
+	    DMU_BACKUP_FEATURE_PART;
 	boolean_t raw = DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
 	    DMU_BACKUP_FEATURE_RAW;
 	boolean_t embedded = DMU_GET_FEATUREFLAGS(drrb->drr_versioninfo) &
@@ -4653,6 +4664,14 @@ zfs_receive_one(libzfs_handle_t *hdl, int infd, const char *tosnap,
 	stream_resumingnewfs = (drrb->drr_fromguid == 0 ||
 	    (drrb->drr_flags & DRR_FLAG_CLONE) || originsnap) && resuming;
 
+	if (stream_part && !flags->resumable) {
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "stream is one part of a snapshot, and must be "
+		    "received with -s"));
+		err = zfs_error(hdl, EZFS_BADSTREAM, errbuf);
+		goto out;
+	}
+
 	if (stream_wantsnewfs) {
 		/*
 		 * if the parent fs does not exist, look for it based on
@@ -5052,6 +5071,17 @@ zfs_receive_one(libzfs_handle_t *hdl, int infd, const char *tosnap,
 		    flags->resumable, raw, infd, drr_noswap, -1, &read_bytes,
 		    &errflags, NULL, &prop_errors);
 	}
+	/*
+	 * All but the last part of a snapshot leave the receive partially
+	 * complete for the next part.
+	 */
+	if (ioctl_err == ZFS_ERR_STREAM_PART) {
+		err = ioctl_err = 0;
+		if (flags->verbose) {
+			(void) printf("received part of %s, the following "
+			    "parts must be received next\n", destsnap);
+		}
+	}
 	ioctl_errno = ioctl_err;
 	prop_errflags = errflags;
 
@@ -5325,7 +5355,8 @@ zfs_receive_one(libzfs_handle_t *hdl, int infd, const char *tosnap,
 		changelist_free(clp);
 	}
 
-	if ((newfs || stream_avl) && type == ZFS_TYPE_FILESYSTEM && !redacted)
+	if ((newfs || stream_avl) && type == ZFS_TYPE_FILESYSTEM && !redacted &&
+	    !stream_part)
 		flags->domount = B_TRUE;
 
 	if (prop_errflags & ZPROP_ERR_NOCLEAR) {
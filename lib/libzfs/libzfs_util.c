@@ -1084,6 +1084,7 @@ libzfs_init(void)
 	zpool_feature_init();
 	vdev_prop_init();
 	libzfs_mnttab_init(hdl);
+	pthread_mutex_init(&hdl->libzfs_pool_handles_lock, NULL);
 	fletcher_4_init();
 
 	if (getenv("ZFS_PROP_DEBUG") != NULL) {
@@ -1125,6 +1126,7 @@ libzfs_fini(libzfs_handle_t *hdl)
 {
 	(void) close(hdl->libzfs_fd);
 	zpool_free_handles(hdl);
+	(void) pthread_mutex_destroy(&hdl->libzfs_pool_handles_lock);
 	namespace_clear(hdl);
 	libzfs_mnttab_fini(hdl);
 	libzfs_core_fini();
@@ -848,7 +848,7 @@ lzc_send_resume(const char *snapname, const char *from, int fd,
 static int
 lzc_send_resume_redacted_cb_impl(const char *snapname, const char *from, int fd,
     enum lzc_send_flags flags, uint64_t resumeobj, uint64_t resumeoff,
-    const char *redactbook)
+    const char *redactbook, uint64_t part, uint64_t nparts)
 {
 	nvlist_t *args;
 	int err;
@@ -871,6 +871,10 @@ lzc_send_resume_redacted_cb_impl(const char *snapname, const char *from, int fd,
 		fnvlist_add_uint64(args, "resume_object", resumeobj);
 		fnvlist_add_uint64(args, "resume_offset", resumeoff);
 	}
+	if (nparts != 0) {
+		fnvlist_add_uint64(args, "part", part);
+		fnvlist_add_uint64(args, "nparts", nparts);
+	}
 	if (redactbook != NULL)
 		fnvlist_add_string(args, "redactbook", redactbook);
 
@@ -886,6 +890,8 @@ struct lzc_send_resume_redacted {
 	uint64_t resumeobj;
 	uint64_t resumeoff;
 	const char *redactbook;
+	uint64_t part;
+	uint64_t nparts;
 };
 
 static int
@@ -894,7 +900,7 @@ lzc_send_resume_redacted_cb(int fd, void *arg)
 	struct lzc_send_resume_redacted *zsrr = arg;
 	return (lzc_send_resume_redacted_cb_impl(zsrr->snapname, zsrr->from,
 	    fd, zsrr->flags, zsrr->resumeobj, zsrr->resumeoff,
-	    zsrr->redactbook));
+	    zsrr->redactbook, zsrr->part, zsrr->nparts));
 }
 
 int
@@ -913,6 +919,30 @@ lzc_send_resume_redacted(const char *snapname, const char *from, int fd,
 	return (lzc_send_wrapper(lzc_send_resume_redacted_cb, fd, &zsrr));
 }
 
+/*
+ * Send one of "nparts" parts of a snapshot, numbered from zero.  The objects
+ * of the snapshot are split into "nparts" ranges, and the stream for "part"
+ * contains only those in its range.  The parts can be generated concurrently,
+ * and must be received in order, with "resumable" set, into the same target.
+ * Every part but the last leaves the receive partially complete, to be
+ * continued by the next part.
+ */
+int
+lzc_send_part(const char *snapname, const char *from, int fd,
+    enum lzc_send_flags flags, const char *redactbook, uint64_t part,
+    uint64_t nparts)
+{
+	struct lzc_send_resume_redacted zsrr = {
+		.snapname = snapname,
+		.from = from,
+		.flags = flags,
+		.redactbook = redactbook,
+		.part = part,
+		.nparts = nparts,
+	};
+	return (lzc_send_wrapper(lzc_send_resume_redacted_cb, fd, &zsrr));
+}
+
 /*
  * "from" can be NULL, a snapshot, or a bookmark.
  *
@@ -1994,3 +2024,21 @@ lzc_ddt_prune(const char *pool, zpool_ddt_prune_unit_t unit, uint64_t amount)
 
 	return (error);
 }
+
+/*
+ * Get only the requested properties of many datasets in the given pool with a
+ * single ioctl.  The innvl holds the dataset names in a string array under
+ * ZFS_DATASET_PROPS_DATASETS and the property names in a string array under
+ * ZFS_DATASET_PROPS_NAMES.
+ *
+ * On success, the outnvl holds an nvlist under ZFS_DATASET_PROPS_VALUES
+ * mapping each dataset to its properties, in the same format as
+ * ZFS_IOC_OBJSET_STATS returns them, and an nvlist under
+ * ZFS_DATASET_PROPS_ERRORS mapping each dataset that could not be read to
+ * an errno.  Properties that are at their default value are not returned.
+ */
+int
+lzc_get_dataset_props(const char *pool, nvlist_t *innvl, nvlist_t **outnvl)
+{
+	return (lzc_ioctl(ZFS_IOC_GET_DATASET_PROPS, pool, innvl, outnvl));
+}
@@ -47,6 +47,7 @@
 #define	ABD_SCATTER_MIN_SIZE	(512 * 3)
 
 abd_t *abd_zero_scatter = NULL;
+abd_t *abd_sink_scatter = NULL;
 
 static uint_t
 abd_iovcnt_for_bytes(size_t size)
@@ -200,11 +201,33 @@ abd_init(void)
 		iov[i].iov_base = zero;
 		iov[i].iov_len = ABD_PAGESIZE;
 	}
+
+	/*
+	 * Likewise the "sink" scatter abd, whose single page is the target
+	 * of reads whose data is discarded and is never read back.
+	 */
+	abd_sink_scatter = abd_alloc_struct(SPA_MAXBLOCKSIZE);
+	abd_sink_scatter->abd_flags |= ABD_FLAG_OWNER;
+	abd_sink_scatter->abd_size = SPA_MAXBLOCKSIZE;
+
+	void *sink =
+	    umem_alloc_aligned(ABD_PAGESIZE, ABD_PAGESIZE, UMEM_NOFAIL);
+
+	iov = ABD_SCATTER(abd_sink_scatter).abd_iov;
+	for (int i = 0; i < n; i++) {
+		iov[i].iov_base = sink;
+		iov[i].iov_len = ABD_PAGESIZE;
+	}
 }
 
 void
 abd_fini(void)
 {
+	umem_free_aligned(
+	    ABD_SCATTER(abd_sink_scatter).abd_iov[0].iov_base, ABD_PAGESIZE);
+	abd_free_struct(abd_sink_scatter);
+	abd_sink_scatter = NULL;
+
 	umem_free_aligned(
 	    ABD_SCATTER(abd_zero_scatter).abd_iov[0].iov_base, ABD_PAGESIZE);
 	abd_free_struct(abd_zero_scatter);
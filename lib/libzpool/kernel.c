@@ -189,6 +189,16 @@ kstat_set_raw_ops(kstat_t *ksp,
  * =========================================================================
  */
 
+boolean_t zfs_lockstat_enabled = B_FALSE;
+zfs_lockstat_t zfs_lockstat;
+
+static void
+lockstat_contended(uint64_t *contended, uint64_t *wait, hrtime_t start)
+{
+	atomic_inc_64(contended);
+	atomic_add_64(wait, gethrtime() - start);
+}
+
 void
 mutex_init(kmutex_t *mp, char *name, int type, void *cookie)
 {
@@ -206,7 +216,18 @@ mutex_destroy(kmutex_t *mp)
 void
 mutex_enter(kmutex_t *mp)
 {
-	VERIFY0(pthread_mutex_lock(&mp->m_lock));
+	int error;
+
+	if (!zfs_lockstat_enabled) {
+		VERIFY0(pthread_mutex_lock(&mp->m_lock));
+	} else if ((error = pthread_mutex_trylock(&mp->m_lock)) != 0) {
+		hrtime_t start = gethrtime();
+
+		VERIFY3S(error, ==, EBUSY);
+		VERIFY0(pthread_mutex_lock(&mp->m_lock));
+		lockstat_contended(&zfs_lockstat.zls_mutex_contended,
+		    &zfs_lockstat.zls_mutex_wait, start);
+	}
 	mp->m_owner = pthread_self();
 }
 
@@ -245,6 +266,18 @@ mutex_exit(kmutex_t *mp)
  * =========================================================================
  */
 
+static void
+rw_enter_impl(krwlock_t *rwlp, krw_t rw)
+{
+	if (rw == RW_READER) {
+		VERIFY0(pthread_rwlock_rdlock(&rwlp->rw_lock));
+		atomic_inc_uint(&rwlp->rw_readers);
+	} else {
+		VERIFY0(pthread_rwlock_wrlock(&rwlp->rw_lock));
+		rwlp->rw_owner = pthread_self();
+	}
+}
+
 void
 rw_init(krwlock_t *rwlp, char *name, int type, void *arg)
 {
@@ -263,12 +296,14 @@ rw_destroy(krwlock_t *rwlp)
 void
 rw_enter(krwlock_t *rwlp, krw_t rw)
 {
-	if (rw == RW_READER) {
-		VERIFY0(pthread_rwlock_rdlock(&rwlp->rw_lock));
-		atomic_inc_uint(&rwlp->rw_readers);
-	} else {
-		VERIFY0(pthread_rwlock_wrlock(&rwlp->rw_lock));
-		rwlp->rw_owner = pthread_self();
+	if (!zfs_lockstat_enabled) {
+		rw_enter_impl(rwlp, rw);
+	} else if (!rw_tryenter(rwlp, rw)) {
+		hrtime_t start = gethrtime();
+
+		rw_enter_impl(rwlp, rw);
+		lockstat_contended(&zfs_lockstat.zls_rw_contended,
+		    &zfs_lockstat.zls_rw_wait, start);
 	}
 }
 
@@ -0,0 +1,376 @@
+// SPDX-License-Identifier: CDDL-1.0
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Asynchronous file I/O for libzpool.
+ *
+ * File vdevs normally issue each zio as a blocking pread()/pwrite() on a
+ * vdev_file taskq thread.  Where io_uring is available, zfs_file_aio_pread()
+ * and zfs_file_aio_pwrite() instead place the request on a single process
+ * wide submission ring and return; a reaper thread collects completions and
+ * calls the caller's done function.  No thread is held for the duration of
+ * an I/O, and the kernel is free to have many in flight at once.
+ *
+ * If the ring cannot be set up (no kernel support, or io_uring disabled or
+ * filtered in this environment) both functions return ENOTSUP and the caller
+ * falls back to synchronous I/O.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zfs_file.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define	ZFS_FILE_RING_ENTRIES	256
+
+typedef struct zfs_file_aio_req {
+	zfs_file_aio_done_t	*zar_done;
+	void			*zar_arg;
+	struct iovec		zar_iov;
+} zfs_file_aio_req_t;
+
+typedef struct zfs_file_ring {
+	int		zr_fd;
+	uint32_t	zr_entries;
+
+	kmutex_t	zr_lock;	/* protects submission and below */
+	kcondvar_t	zr_cv;
+	uint32_t	zr_inflight;	/* submitted, not yet reaped */
+	boolean_t	zr_exit;
+	boolean_t	zr_exited;
+
+	void		*zr_sq_ptr;
+	size_t		zr_sq_size;
+	uint32_t	*zr_sq_head;
+	uint32_t	*zr_sq_tail;
+	uint32_t	*zr_sq_mask;
+	uint32_t	*zr_sq_array;
+	struct io_uring_sqe *zr_sqes;
+	size_t		zr_sqes_size;
+
+	void		*zr_cq_ptr;
+	size_t		zr_cq_size;
+	uint32_t	*zr_cq_head;
+	uint32_t	*zr_cq_tail;
+	uint32_t	*zr_cq_mask;
+	struct io_uring_cqe *zr_cqes;
+} zfs_file_ring_t;
+
+static zfs_file_ring_t *zfs_file_ring = NULL;
+
+static int
+zfs_file_ring_setup(uint32_t entries, struct io_uring_params *p)
+{
+	return (syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+zfs_file_ring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+    uint32_t flags)
+{
+	return (syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+	    flags, NULL, 0));
+}
+
+/*
+ * Queue one SQE for zar, or a NOP if zar is NULL, and submit it.  Blocks
+ * while the ring already has as many requests in flight as its submission
+ * queue can hold, which keeps the completion queue from overflowing.
+ */
+static int
+zfs_file_ring_submit(zfs_file_ring_t *zr, uint8_t opcode, int fd,
+    loff_t off, zfs_file_aio_req_t *zar)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t tail, idx;
+	int rc;
+
+	mutex_enter(&zr->zr_lock);
+	while (zr->zr_inflight >= zr->zr_entries && !zr->zr_exit)
+		cv_wait(&zr->zr_cv, &zr->zr_lock);
+	if (zr->zr_exit && zar != NULL) {
+		mutex_exit(&zr->zr_lock);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	tail = *zr->zr_sq_tail;
+	idx = tail & *zr->zr_sq_mask;
+	sqe = &zr->zr_sqes[idx];
+	memset(sqe, 0, sizeof (*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	if (zar != NULL) {
+		sqe->addr = (uint64_t)(uintptr_t)&zar->zar_iov;
+		sqe->len = 1;
+		sqe->off = off;
+	}
+	sqe->user_data = (uint64_t)(uintptr_t)zar;
+	zr->zr_sq_array[idx] = idx;
+	__atomic_store_n(zr->zr_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	do {
+		rc = zfs_file_ring_enter(zr->zr_fd, 1, 0, 0);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0) {
+		/* Take the SQE back; the kernel did not consume it. */
+		__atomic_store_n(zr->zr_sq_tail, tail, __ATOMIC_RELEASE);
+		rc = errno;
+		mutex_exit(&zr->zr_lock);
+		return (SET_ERROR(rc));
+	}
+	if (zar != NULL)
+		zr->zr_inflight++;
+	mutex_exit(&zr->zr_lock);
+
+	return (0);
+}
+
+static __attribute__((noreturn)) void
+zfs_file_ring_reaper(void *arg)
+{
+	zfs_file_ring_t *zr = arg;
+	boolean_t exit = B_FALSE;
+
+	while (!exit) {
+		uint32_t head, tail, reaped = 0;
+
+		if (zfs_file_ring_enter(zr->zr_fd, 0, 1,
+		    IORING_ENTER_GETEVENTS) < 0)
+			VERIFY3S(errno, ==, EINTR);
+
+		head = *zr->zr_cq_head;
+		tail = __atomic_load_n(zr->zr_cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe =
+			    &zr->zr_cqes[head & *zr->zr_cq_mask];
+			zfs_file_aio_req_t *zar =
+			    (zfs_file_aio_req_t *)(uintptr_t)cqe->user_data;
+			int res = cqe->res;
+
+			__atomic_store_n(zr->zr_cq_head, head + 1,
+			    __ATOMIC_RELEASE);
+
+			/* The NOP submitted by zfs_file_aio_fini(). */
+			if (zar == NULL) {
+				exit = B_TRUE;
+				continue;
+			}
+			reaped++;
+
+			if (res < 0) {
+				zar->zar_done(zar->zar_arg,
+				    zar->zar_iov.iov_base, -res, 0);
+			} else {
+				zar->zar_done(zar->zar_arg,
+				    zar->zar_iov.iov_base, 0,
+				    zar->zar_iov.iov_len - res);
+			}
+			kmem_free(zar, sizeof (*zar));
+		}
+
+		if (reaped != 0) {
+			mutex_enter(&zr->zr_lock);
+			zr->zr_inflight -= reaped;
+			cv_broadcast(&zr->zr_cv);
+			mutex_exit(&zr->zr_lock);
+		}
+	}
+
+	mutex_enter(&zr->zr_lock);
+	zr->zr_exited = B_TRUE;
+	cv_broadcast(&zr->zr_cv);
+	mutex_exit(&zr->zr_lock);
+
+	thread_exit();
+}
+
+void
+zfs_file_aio_init(void)
+{
+	struct io_uring_params p = { 0 };
+	zfs_file_ring_t *zr;
+	int fd;
+
+	fd = zfs_file_ring_setup(ZFS_FILE_RING_ENTRIES, &p);
+	if (fd < 0)
+		return;
+
+	zr = kmem_zalloc(sizeof (*zr), KM_SLEEP);
+	zr->zr_fd = fd;
+	zr->zr_entries = p.sq_entries;
+
+	zr->zr_sq_size = p.sq_off.array + p.sq_entries * sizeof (uint32_t);
+	zr->zr_cq_size = p.cq_off.cqes +
+	    p.cq_entries * sizeof (struct io_uring_cqe);
+	zr->zr_sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+	zr->zr_sq_ptr = mmap(NULL, zr->zr_sq_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	zr->zr_cq_ptr = mmap(NULL, zr->zr_cq_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	zr->zr_sqes = mmap(NULL, zr->zr_sqes_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (zr->zr_sq_ptr == MAP_FAILED || zr->zr_cq_ptr == MAP_FAILED ||
+	    zr->zr_sqes == MAP_FAILED) {
+		if (zr->zr_sq_ptr != MAP_FAILED)
+			(void) munmap(zr->zr_sq_ptr, zr->zr_sq_size);
+		if (zr->zr_cq_ptr != MAP_FAILED)
+			(void) munmap(zr->zr_cq_ptr, zr->zr_cq_size);
+		if (zr->zr_sqes != MAP_FAILED)
+			(void) munmap(zr->zr_sqes, zr->zr_sqes_size);
+		(void) close(fd);
+		kmem_free(zr, sizeof (*zr));
+		return;
+	}
+
+	zr->zr_sq_head = (uint32_t *)((char *)zr->zr_sq_ptr + p.sq_off.head);
+	zr->zr_sq_tail = (uint32_t *)((char *)zr->zr_sq_ptr + p.sq_off.tail);
+	zr->zr_sq_mask =
+	    (uint32_t *)((char *)zr->zr_sq_ptr + p.sq_off.ring_mask);
+	zr->zr_sq_array = (uint32_t *)((char *)zr->zr_sq_ptr + p.sq_off.array);
+	zr->zr_cq_head = (uint32_t *)((char *)zr->zr_cq_ptr + p.cq_off.head);
+	zr->zr_cq_tail = (uint32_t *)((char *)zr->zr_cq_ptr + p.cq_off.tail);
+	zr->zr_cq_mask =
+	    (uint32_t *)((char *)zr->zr_cq_ptr + p.cq_off.ring_mask);
+	zr->zr_cqes = (struct io_uring_cqe *)
+	    ((char *)zr->zr_cq_ptr + p.cq_off.cqes);
+
+	mutex_init(&zr->zr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zr->zr_cv, NULL, CV_DEFAULT, NULL);
+
+	(void) thread_create(NULL, 0, zfs_file_ring_reaper, zr, 0, &p0,
+	    TS_RUN, defclsyspri);
+
+	zfs_file_ring = zr;
+}
+
+void
+zfs_file_aio_fini(void)
+{
+	zfs_file_ring_t *zr = zfs_file_ring;
+
+	if (zr == NULL)
+		return;
+
+	/*
+	 * Refuse new requests and wait for outstanding ones, then wake the
+	 * reaper with a NOP that carries no request and wait for it to go.
+	 */
+	mutex_enter(&zr->zr_lock);
+	zr->zr_exit = B_TRUE;
+	while (zr->zr_inflight != 0)
+		cv_wait(&zr->zr_cv, &zr->zr_lock);
+	mutex_exit(&zr->zr_lock);
+
+	VERIFY0(zfs_file_ring_submit(zr, IORING_OP_NOP, -1, 0, NULL));
+
+	mutex_enter(&zr->zr_lock);
+	while (!zr->zr_exited)
+		cv_wait(&zr->zr_cv, &zr->zr_lock);
+	mutex_exit(&zr->zr_lock);
+
+	zfs_file_ring = NULL;
+
+	(void) munmap(zr->zr_sqes, zr->zr_sqes_size);
+	(void) munmap(zr->zr_cq_ptr, zr->zr_cq_size);
+	(void) munmap(zr->zr_sq_ptr, zr->zr_sq_size);
+	(void) close(zr->zr_fd);
+	cv_destroy(&zr->zr_cv);
+	mutex_destroy(&zr->zr_lock);
+	kmem_free(zr, sizeof (*zr));
+}
+
+static int
+zfs_file_aio_rw(zfs_file_t *fp, boolean_t write, void *buf, size_t count,
+    loff_t off, zfs_file_aio_done_t *done, void *arg)
+{
+	zfs_file_ring_t *zr = zfs_file_ring;
+	zfs_file_aio_req_t *zar;
+	int error;
+
+	/* The dump file of ztest -V is written synchronously after reads. */
+	if (zr == NULL || fp->f_dump_fd != -1)
+		return (SET_ERROR(ENOTSUP));
+
+	zar = kmem_alloc(sizeof (*zar), KM_SLEEP);
+	zar->zar_done = done;
+	zar->zar_arg = arg;
+	zar->zar_iov.iov_base = buf;
+	zar->zar_iov.iov_len = count;
+
+	error = zfs_file_ring_submit(zr,
+	    write ? IORING_OP_WRITEV : IORING_OP_READV, fp->f_fd, off, zar);
+	if (error != 0)
+		kmem_free(zar, sizeof (*zar));
+
+	return (error);
+}
+
+#else /* !HAVE_LINUX_IO_URING_H */
+
+void
+zfs_file_aio_init(void)
+{
+}
+
+void
+zfs_file_aio_fini(void)
+{
+}
+
+static int
+zfs_file_aio_rw(zfs_file_t *fp, boolean_t write, void *buf, size_t count,
+    loff_t off, zfs_file_aio_done_t *done, void *arg)
+{
+	(void) fp, (void) write, (void) buf, (void) count, (void) off;
+	(void) done, (void) arg;
+	return (SET_ERROR(ENOTSUP));
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
+/*
+ * Start an asynchronous read of count bytes at off into buf.  On success
+ * done(arg, buf, error, resid) is called from another thread once the read
+ * has completed.  Returns ENOTSUP if asynchronous I/O is unavailable, in
+ * which case done is never called.
+ */
+int
+zfs_file_aio_pread(zfs_file_t *fp, void *buf, size_t count, loff_t off,
+    zfs_file_aio_done_t *done, void *arg)
+{
+	return (zfs_file_aio_rw(fp, B_FALSE, buf, count, off, done, arg));
+}
+
+/*
+ * Asynchronous counterpart of zfs_file_pwrite(), see zfs_file_aio_pread().
+ */
+int
+zfs_file_aio_pwrite(zfs_file_t *fp, const void *buf, size_t count,
+    loff_t off, zfs_file_aio_done_t *done, void *arg)
+{
+	return (zfs_file_aio_rw(fp, B_TRUE, (void *)buf, count, off,
+	    done, arg));
+}
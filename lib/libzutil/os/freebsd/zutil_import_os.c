@@ -154,7 +154,7 @@ zpool_open_func(void *arg)
 		goto out;
 	}
 
-	if (zpool_read_label(fd, &config, &num_labels) != 0)
+	if (zpool_read_label_cached(rn, fd, &config, &num_labels) != 0)
 		goto out;
 	if (num_labels == 0) {
 		nvlist_free(config);
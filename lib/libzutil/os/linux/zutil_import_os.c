@@ -136,7 +136,7 @@ zpool_open_func(void *arg)
 	if (fd < 0)
 		return;
 
-	error = zpool_read_label(fd, &config, &num_labels);
+	error = zpool_read_label_cached(rn, fd, &config, &num_labels);
 	if (error != 0) {
 		(void) close(fd);
 		return;
@@ -191,6 +191,7 @@ zpool_open_func(void *arg)
 			slice->rn_hdl = hdl;
 			slice->rn_order = IMPORT_ORDER_PREFERRED_1;
 			slice->rn_labelpaths = B_FALSE;
+			slice->rn_devcache = rn->rn_devcache;
 			pthread_mutex_lock(rn->rn_lock);
 			if (avl_find(rn->rn_avl, slice, &where)) {
 			pthread_mutex_unlock(rn->rn_lock);
@@ -217,6 +218,7 @@ zpool_open_func(void *arg)
 			slice->rn_hdl = hdl;
 			slice->rn_order = IMPORT_ORDER_PREFERRED_2;
 			slice->rn_labelpaths = B_FALSE;
+			slice->rn_devcache = rn->rn_devcache;
 			pthread_mutex_lock(rn->rn_lock);
 			if (avl_find(rn->rn_avl, slice, &where)) {
 				pthread_mutex_unlock(rn->rn_lock);
@@ -922,6 +922,31 @@ label_offset(uint64_t size, int l)
 	    0 : size - VDEV_LABELS * sizeof (vdev_label_t)));
 }
 
+/*
+ * Check that an unpacked label describes a vdev, returning its guid.
+ */
+static boolean_t
+label_config_valid(nvlist_t *config, uint64_t *guidp)
+{
+	uint64_t state, guid, txg;
+
+	if (nvlist_lookup_uint64(config, ZPOOL_CONFIG_GUID, &guid) != 0 ||
+	    guid == 0)
+		return (B_FALSE);
+
+	if (nvlist_lookup_uint64(config, ZPOOL_CONFIG_POOL_STATE,
+	    &state) != 0 || state > POOL_STATE_L2CACHE)
+		return (B_FALSE);
+
+	if (state != POOL_STATE_SPARE && state != POOL_STATE_L2CACHE &&
+	    (nvlist_lookup_uint64(config, ZPOOL_CONFIG_POOL_TXG,
+	    &txg) != 0 || txg == 0))
+		return (B_FALSE);
+
+	*guidp = guid;
+	return (B_TRUE);
+}
+
 /*
  * The same description applies as to zpool_read_label below,
  * except here we do it without aio, presumably because an aio call
@@ -948,7 +973,7 @@ zpool_read_label_slow(int fd, nvlist_t **config, int *num_labels)
 		return (-1);
 
 	for (l = 0; l < VDEV_LABELS; l++) {
-		uint64_t state, guid, txg;
+		uint64_t guid;
 		off_t offset = label_offset(size, l) + VDEV_SKIP_SIZE;
 
 		if (pread64(fd, label, sizeof (vdev_phys_t),
@@ -959,21 +984,7 @@ zpool_read_label_slow(int fd, nvlist_t **config, int *num_labels)
 		    sizeof (label->vp_nvlist), config, 0) != 0)
 			continue;
 
-		if (nvlist_lookup_uint64(*config, ZPOOL_CONFIG_GUID,
-		    &guid) != 0 || guid == 0) {
-			nvlist_free(*config);
-			continue;
-		}
-
-		if (nvlist_lookup_uint64(*config, ZPOOL_CONFIG_POOL_STATE,
-		    &state) != 0 || state > POOL_STATE_L2CACHE) {
-			nvlist_free(*config);
-			continue;
-		}
-
-		if (state != POOL_STATE_SPARE && state != POOL_STATE_L2CACHE &&
-		    (nvlist_lookup_uint64(*config, ZPOOL_CONFIG_POOL_TXG,
-		    &txg) != 0 || txg == 0)) {
+		if (!label_config_valid(*config, &guid)) {
 			nvlist_free(*config);
 			continue;
 		}
@@ -1097,7 +1108,7 @@ zpool_read_label(int fd, nvlist_t **config, int *num_labels)
 	}
 
 	for (l = 0; l < VDEV_LABELS; l++) {
-		uint64_t state, guid, txg;
+		uint64_t guid;
 
 		if (aio_return(&aiocbs[l]) != sizeof (vdev_phys_t))
 			continue;
@@ -1106,21 +1117,7 @@ zpool_read_label(int fd, nvlist_t **config, int *num_labels)
 		    sizeof (labels[l].vp_nvlist), config, 0) != 0)
 			continue;
 
-		if (nvlist_lookup_uint64(*config, ZPOOL_CONFIG_GUID,
-		    &guid) != 0 || guid == 0) {
-			nvlist_free(*config);
-			continue;
-		}
-
-		if (nvlist_lookup_uint64(*config, ZPOOL_CONFIG_POOL_STATE,
-		    &state) != 0 || state > POOL_STATE_L2CACHE) {
-			nvlist_free(*config);
-			continue;
-		}
-
-		if (state != POOL_STATE_SPARE && state != POOL_STATE_L2CACHE &&
-		    (nvlist_lookup_uint64(*config, ZPOOL_CONFIG_POOL_TXG,
-		    &txg) != 0 || txg == 0)) {
+		if (!label_config_valid(*config, &guid)) {
 			nvlist_free(*config);
 			continue;
 		}
@@ -1147,6 +1144,294 @@ zpool_read_label(int fd, nvlist_t **config, int *num_labels)
 #endif
 }
 
+/*
+ * Device discovery cache.
+ *
+ * When ZPOOL_IMPORT_DEVCACHE names a file, the import scan remembers what it
+ * found on each device: its identity (device number and size), the vdev guid
+ * and txg from its first label, and how many of its labels were valid, or
+ * that it carried no label at all.  On the next scan a device whose identity
+ * is unchanged is validated by reading only its first label instead of all
+ * four.  If that label still matches the cached guid at the same or a later
+ * txg it is used as is; if the device had no label and its first label is
+ * still not valid it is skipped.  Anything else, including devices which are
+ * not in the cache, gets the full label read.
+ *
+ * The file is a packed nvlist of the entries wrapped together with a
+ * checksum of them, and is ignored if that checksum does not match.  It is
+ * only a hint: each cached result is confirmed against the device before it
+ * is used, so a missing, stale or damaged cache only costs the full read.
+ */
+#define	DEVCACHE_VERSION	1
+#define	DEVCACHE_VERSION_KEY	"version"
+#define	DEVCACHE_ENTRIES_KEY	"entries"
+#define	DEVCACHE_CHECKSUM_KEY	"checksum"
+#define	DEVCACHE_RDEV		"rdev"
+#define	DEVCACHE_SIZE		"size"
+#define	DEVCACHE_GUID		"guid"
+#define	DEVCACHE_TXG		"txg"
+#define	DEVCACHE_LABELS		"labels"
+
+struct zutil_devcache {
+	pthread_mutex_t	dc_lock;
+	char		*dc_path;
+	nvlist_t	*dc_old;	/* entries loaded from the file */
+	nvlist_t	*dc_new;	/* entries seen by this scan */
+};
+
+/*
+ * 64-bit FNV-1a, used to detect a damaged or hand-edited cache file.
+ */
+static uint64_t
+devcache_checksum(const uchar_t *buf, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= buf[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return (hash);
+}
+
+static nvlist_t *
+devcache_load(const char *path)
+{
+	nvlist_t *nvl = NULL, *entries = NULL;
+	struct stat64 statbuf;
+	uchar_t *packed;
+	uint64_t version, cksum;
+	uint_t len;
+	char *buf;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return (NULL);
+
+	if (fstat64(fd, &statbuf) != 0 || statbuf.st_size <= 0 ||
+	    (buf = malloc(statbuf.st_size)) == NULL) {
+		(void) close(fd);
+		return (NULL);
+	}
+
+	if (read(fd, buf, statbuf.st_size) != statbuf.st_size ||
+	    nvlist_unpack(buf, statbuf.st_size, &nvl, 0) != 0) {
+		(void) close(fd);
+		free(buf);
+		return (NULL);
+	}
+	(void) close(fd);
+	free(buf);
+
+	if (nvlist_lookup_uint64(nvl, DEVCACHE_VERSION_KEY, &version) == 0 &&
+	    version == DEVCACHE_VERSION &&
+	    nvlist_lookup_uint8_array(nvl, DEVCACHE_ENTRIES_KEY, &packed,
+	    &len) == 0 &&
+	    nvlist_lookup_uint64(nvl, DEVCACHE_CHECKSUM_KEY, &cksum) == 0 &&
+	    devcache_checksum(packed, len) == cksum)
+		(void) nvlist_unpack((char *)packed, len, &entries, 0);
+
+	nvlist_free(nvl);
+	return (entries);
+}
+
+static zutil_devcache_t *
+zutil_devcache_open(const char *path)
+{
+	zutil_devcache_t *dc;
+
+	if (path == NULL || *path == '\0')
+		return (NULL);
+
+	if ((dc = calloc(1, sizeof (*dc))) == NULL)
+		return (NULL);
+
+	if ((dc->dc_path = strdup(path)) == NULL ||
+	    nvlist_alloc(&dc->dc_new, NV_UNIQUE_NAME, 0) != 0) {
+		free(dc->dc_path);
+		free(dc);
+		return (NULL);
+	}
+	dc->dc_old = devcache_load(path);
+	pthread_mutex_init(&dc->dc_lock, NULL);
+
+	return (dc);
+}
+
+/*
+ * Write out the entries seen by this scan, keeping the old entries for any
+ * devices which were not part of it.  The new file replaces the old one
+ * atomically; failures are ignored since the cache is only a hint.
+ */
+static void
+zutil_devcache_close(zutil_devcache_t *dc)
+{
+	nvlist_t *nvl = NULL;
+	char *entries = NULL, *buf = NULL, *tmp = NULL;
+	size_t entries_len = 0, len = 0;
+	int fd;
+
+	if (dc == NULL)
+		return;
+
+	if (dc->dc_old != NULL) {
+		for (nvpair_t *elem = nvlist_next_nvpair(dc->dc_old, NULL);
+		    elem != NULL; elem = nvlist_next_nvpair(dc->dc_old, elem)) {
+			if (!nvlist_exists(dc->dc_new, nvpair_name(elem)))
+				(void) nvlist_add_nvpair(dc->dc_new, elem);
+		}
+	}
+
+	if (nvlist_pack(dc->dc_new, &entries, &entries_len, NV_ENCODE_XDR,
+	    0) != 0 || nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0) != 0 ||
+	    nvlist_add_uint64(nvl, DEVCACHE_VERSION_KEY,
+	    DEVCACHE_VERSION) != 0 ||
+	    nvlist_add_uint8_array(nvl, DEVCACHE_ENTRIES_KEY,
+	    (uchar_t *)entries, entries_len) != 0 ||
+	    nvlist_add_uint64(nvl, DEVCACHE_CHECKSUM_KEY,
+	    devcache_checksum((uchar_t *)entries, entries_len)) != 0 ||
+	    nvlist_pack(nvl, &buf, &len, NV_ENCODE_XDR, 0) != 0 ||
+	    asprintf(&tmp, "%s.new", dc->dc_path) == -1)
+		goto out;
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+	    0644)) < 0)
+		goto out;
+
+	if (write(fd, buf, len) == (ssize_t)len && fsync(fd) == 0) {
+		(void) close(fd);
+		if (rename(tmp, dc->dc_path) != 0)
+			(void) unlink(tmp);
+	} else {
+		(void) close(fd);
+		(void) unlink(tmp);
+	}
+out:
+	free(tmp);
+	free(buf);
+	free(entries);
+	nvlist_free(nvl);
+	nvlist_free(dc->dc_old);
+	nvlist_free(dc->dc_new);
+	pthread_mutex_destroy(&dc->dc_lock);
+	free(dc->dc_path);
+	free(dc);
+}
+
+static void
+devcache_record(zutil_devcache_t *dc, const char *name,
+    const struct stat64 *statbuf, uint64_t guid, uint64_t txg, int labels)
+{
+	nvlist_t *entry;
+
+	if (nvlist_alloc(&entry, NV_UNIQUE_NAME, 0) != 0)
+		return;
+
+	if (nvlist_add_uint64(entry, DEVCACHE_RDEV, statbuf->st_rdev) == 0 &&
+	    nvlist_add_uint64(entry, DEVCACHE_SIZE, statbuf->st_size) == 0 &&
+	    nvlist_add_uint64(entry, DEVCACHE_GUID, guid) == 0 &&
+	    nvlist_add_uint64(entry, DEVCACHE_TXG, txg) == 0 &&
+	    nvlist_add_uint64(entry, DEVCACHE_LABELS, labels) == 0) {
+		pthread_mutex_lock(&dc->dc_lock);
+		(void) nvlist_add_nvlist(dc->dc_new, name, entry);
+		pthread_mutex_unlock(&dc->dc_lock);
+	}
+	nvlist_free(entry);
+}
+
+/*
+ * Read and validate only the first label of a device.
+ */
+static nvlist_t *
+zpool_read_first_label(int fd, uint64_t size, uint64_t *guidp)
+{
+	vdev_phys_t *label;
+	nvlist_t *config = NULL;
+
+	label = (vdev_phys_t *)umem_alloc_aligned(sizeof (*label), PAGESIZE,
+	    UMEM_DEFAULT);
+	if (label == NULL)
+		return (NULL);
+
+	if (pread64(fd, label, sizeof (vdev_phys_t),
+	    label_offset(size, 0) + VDEV_SKIP_SIZE) == sizeof (vdev_phys_t) &&
+	    nvlist_unpack(label->vp_nvlist, sizeof (label->vp_nvlist),
+	    &config, 0) == 0 && !label_config_valid(config, guidp)) {
+		nvlist_free(config);
+		config = NULL;
+	}
+
+	umem_free_aligned(label, sizeof (*label));
+	return (config);
+}
+
+/*
+ * Like zpool_read_label(), but consult the device discovery cache, when one
+ * is in use, to avoid reading every label of devices which have not changed
+ * since the last scan.
+ */
+int
+zpool_read_label_cached(rdsk_node_t *rn, int fd, nvlist_t **config,
+    int *num_labels)
+{
+	zutil_devcache_t *dc = rn->rn_devcache;
+	struct stat64 statbuf;
+	nvlist_t *entry;
+	uint64_t size, rdev, cached_size, cached_guid, cached_txg, labels;
+	uint64_t guid = 0, txg = 0;
+	int error;
+
+	if (dc == NULL || fstat64_blk(fd, &statbuf) == -1)
+		return (zpool_read_label(fd, config, num_labels));
+
+	if (dc->dc_old != NULL &&
+	    nvlist_lookup_nvlist(dc->dc_old, rn->rn_name, &entry) == 0 &&
+	    nvlist_lookup_uint64(entry, DEVCACHE_RDEV, &rdev) == 0 &&
+	    nvlist_lookup_uint64(entry, DEVCACHE_SIZE, &cached_size) == 0 &&
+	    nvlist_lookup_uint64(entry, DEVCACHE_GUID, &cached_guid) == 0 &&
+	    nvlist_lookup_uint64(entry, DEVCACHE_TXG, &cached_txg) == 0 &&
+	    nvlist_lookup_uint64(entry, DEVCACHE_LABELS, &labels) == 0 &&
+	    labels <= VDEV_LABELS && rdev == statbuf.st_rdev &&
+	    cached_size == statbuf.st_size) {
+		size = P2ALIGN_TYPED(statbuf.st_size, sizeof (vdev_label_t),
+		    uint64_t);
+		*config = zpool_read_first_label(fd, size, &guid);
+
+		if (*config == NULL && cached_guid == 0) {
+			devcache_record(dc, rn->rn_name, &statbuf, 0, 0, 0);
+			*num_labels = 0;
+			return (0);
+		}
+
+		if (*config != NULL) {
+			(void) nvlist_lookup_uint64(*config,
+			    ZPOOL_CONFIG_POOL_TXG, &txg);
+			if (guid == cached_guid && txg >= cached_txg &&
+			    labels > 0) {
+				devcache_record(dc, rn->rn_name, &statbuf,
+				    guid, txg, labels);
+				*num_labels = labels;
+				return (0);
+			}
+			nvlist_free(*config);
+			*config = NULL;
+		}
+	}
+
+	error = zpool_read_label(fd, config, num_labels);
+	if (error != 0)
+		return (error);
+
+	if (*config != NULL) {
+		(void) nvlist_lookup_uint64(*config, ZPOOL_CONFIG_GUID, &guid);
+		(void) nvlist_lookup_uint64(*config, ZPOOL_CONFIG_POOL_TXG,
+		    &txg);
+	}
+	devcache_record(dc, rn->rn_name, &statbuf, guid, txg, *num_labels);
+
+	return (0);
+}
+
 /*
  * Sorted by full path and then vdev guid to allow for multiple entries with
  * the same full path name.  This is required because it's possible to
@@ -1458,6 +1743,7 @@ zpool_find_import_impl(libpc_handle_t *hdl, importargs_t *iarg,
 	rdsk_node_t *slice;
 	void *cookie;
 	tpool_t *t;
+	zutil_devcache_t *dc;
 
 	verify(iarg->poolname == NULL || iarg->guid == 0);
 
@@ -1480,13 +1766,17 @@ zpool_find_import_impl(libpc_handle_t *hdl, importargs_t *iarg,
 		threads = MIN(threads, am / VDEV_LABELS);
 #endif
 #endif
+	dc = zutil_devcache_open(getenv("ZPOOL_IMPORT_DEVCACHE"));
 	t = tpool_create(1, threads, 0, NULL);
 	for (slice = avl_first(cache); slice;
-	    (slice = avl_walk(cache, slice, AVL_AFTER)))
+	    (slice = avl_walk(cache, slice, AVL_AFTER))) {
+		slice->rn_devcache = dc;
 		(void) tpool_dispatch(t, zpool_open_func, slice);
+	}
 
 	tpool_wait(t);
 	tpool_destroy(t);
+	zutil_devcache_close(dc);
 
 	/*
 	 * Process the cache, filtering out any entries which are not
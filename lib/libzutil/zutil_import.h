@@ -42,6 +42,8 @@ int zpool_find_import_blkid(libpc_handle_t *hdl, pthread_mutex_t *lock,
 void * zutil_alloc(libpc_handle_t *hdl, size_t size);
 char *zutil_strdup(libpc_handle_t *hdl, const char *str);
 
+typedef struct zutil_devcache zutil_devcache_t;
+
 typedef struct rdsk_node {
 	char *rn_name;			/* Full path to device */
 	int rn_order;			/* Preferred order (low to high) */
@@ -53,10 +55,12 @@ typedef struct rdsk_node {
 	avl_node_t rn_node;
 	pthread_mutex_t *rn_lock;
 	boolean_t rn_labelpaths;
+	zutil_devcache_t *rn_devcache;	/* Device discovery cache */
 } rdsk_node_t;
 
 int slice_cache_compare(const void *, const void *);
 
 void zpool_open_func(void *);
+int zpool_read_label_cached(rdsk_node_t *, int, nvlist_t **, int *);
 
 #endif /* _LIBZUTIL_ZUTIL_IMPORT_H_ */
@@ -520,6 +520,12 @@ Blake3_InitKeyed(BLAKE3_CTX *ctx, const uint8_t key[BLAKE3_KEY_LEN])
 	hasher_init_base(ctx, key_words, KEYED_HASH);
 }
 
+void
+Blake3_SizeHint(BLAKE3_CTX *ctx, uint64_t size)
+{
+	ctx->ops = blake3_get_ops_sized(size);
+}
+
 static void
 Blake3_Update2(BLAKE3_CTX *ctx, const void *input, size_t input_len)
 {
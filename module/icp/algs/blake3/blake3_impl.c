@@ -281,11 +281,13 @@ static const blake3_ops_t *const blake3_impls[] = {
 #define	IMPL_OPS_T		blake3_ops_t
 #define	IMPL_ARRAY		blake3_impls
 #define	IMPL_GET_OPS		blake3_get_ops
+#define	IMPL_GET_OPS_SIZED	blake3_get_ops_sized
 #define	ZFS_IMPL_OPS		zfs_blake3_ops
 #include <generic_impl.c>
 
 #ifdef _KERNEL
 void **blake3_per_cpu_ctx;
+void **blake3_per_cpu_buf;
 
 void
 blake3_per_cpu_ctx_init(void)
@@ -294,9 +296,12 @@ blake3_per_cpu_ctx_init(void)
 	 * Create "The Godfather" ptr to hold all blake3 ctx
 	 */
 	blake3_per_cpu_ctx = kmem_alloc(max_ncpus * sizeof (void *), KM_SLEEP);
+	blake3_per_cpu_buf = kmem_alloc(max_ncpus * sizeof (void *), KM_SLEEP);
 	for (int i = 0; i < max_ncpus; i++) {
 		blake3_per_cpu_ctx[i] = kmem_alloc(sizeof (BLAKE3_CTX),
 		    KM_SLEEP);
+		blake3_per_cpu_buf[i] = kmem_alloc(BLAKE3_GATHER_LEN,
+		    KM_SLEEP);
 	}
 }
 
@@ -306,9 +311,11 @@ blake3_per_cpu_ctx_fini(void)
 	for (int i = 0; i < max_ncpus; i++) {
 		memset(blake3_per_cpu_ctx[i], 0, sizeof (BLAKE3_CTX));
 		kmem_free(blake3_per_cpu_ctx[i], sizeof (BLAKE3_CTX));
+		kmem_free(blake3_per_cpu_buf[i], BLAKE3_GATHER_LEN);
 	}
 	memset(blake3_per_cpu_ctx, 0, max_ncpus * sizeof (void *));
 	kmem_free(blake3_per_cpu_ctx, max_ncpus * sizeof (void *));
+	kmem_free(blake3_per_cpu_buf, max_ncpus * sizeof (void *));
 }
 
 #define	IMPL_FMT(impl, i)	(((impl) == (i)) ? "[%s] " : "%s ")
@@ -1225,6 +1225,28 @@ static size_t aesni_gcm_encrypt_avx2(const uint8_t *in, uint8_t *out,
 }
 #endif /* if CAN_USE_GCM_ASM >= 2 */
 
+/*
+ * Return where to encrypt len bytes of input at datap to: straight into the
+ * output if it is contiguous there and doesn't partially overlap the input,
+ * which saves copying the ciphertext out of a bounce buffer.  Otherwise
+ * return the bounce buffer, allocating it on first use.  Must be called
+ * with the FPU unlocked.
+ */
+static uint8_t *
+gcm_avx_out_buf(crypto_data_t *out, const uint8_t *datap, size_t len,
+    uint8_t **ct_buf, size_t chunk_size)
+{
+	uint8_t *dst = crypto_get_output_buf(out, len);
+
+	if (dst != NULL &&
+	    (dst == datap || dst + len <= datap || datap + len <= dst))
+		return (dst);
+
+	if (*ct_buf == NULL)
+		*ct_buf = vmem_alloc(chunk_size, KM_SLEEP);
+	return (*ct_buf);
+}
+
 /*
  * Encrypt multiple blocks of data in GCM mode.
  * This is done in gcm_avx_chunk_size chunks, utilizing AVX assembler routines
@@ -1250,6 +1272,7 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 	uint64_t *htable = ctx->gcm_Htable;
 	uint64_t *cb = ctx->gcm_cb;
 	uint8_t *ct_buf = NULL;
+	uint8_t *dst;
 	uint8_t *tmp = (uint8_t *)ctx->gcm_tmp;
 	int rv = CRYPTO_SUCCESS;
 
@@ -1281,14 +1304,6 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 		}
 	}
 
-	/* Allocate a buffer to encrypt to if there is enough input. */
-	if (bleft >= GCM_AVX_MIN_ENCRYPT_BYTES) {
-		ct_buf = vmem_alloc(chunk_size, KM_SLEEP);
-		if (ct_buf == NULL) {
-			return (CRYPTO_HOST_MEMORY);
-		}
-	}
-
 	/* If we completed an incomplete block, encrypt and write it out. */
 	if (ctx->gcm_remainder_len > 0) {
 		kfpu_begin();
@@ -1310,9 +1325,11 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 
 	/* Do the bulk encryption in chunk_size blocks. */
 	for (; bleft >= chunk_size; bleft -= chunk_size) {
+		dst = gcm_avx_out_buf(out, datap, chunk_size, &ct_buf,
+		    chunk_size);
 		kfpu_begin();
 		done = encrypt_blocks(
-		    datap, ct_buf, chunk_size, key, cb, htable, ghash);
+		    datap, dst, chunk_size, key, cb, htable, ghash);
 
 		clear_fpu_regs();
 		kfpu_end();
@@ -1320,9 +1337,11 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 			rv = CRYPTO_FAILED;
 			goto out_nofpu;
 		}
-		rv = crypto_put_output_data(ct_buf, out, chunk_size);
-		if (rv != CRYPTO_SUCCESS) {
-			goto out_nofpu;
+		if (dst == ct_buf) {
+			rv = crypto_put_output_data(ct_buf, out, chunk_size);
+			if (rv != CRYPTO_SUCCESS) {
+				goto out_nofpu;
+			}
 		}
 		out->cd_offset += chunk_size;
 		datap += chunk_size;
@@ -1333,17 +1352,22 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 		goto out_nofpu;
 	}
 	/* Bulk encrypt the remaining data. */
+	dst = NULL;
+	if (bleft >= GCM_AVX_MIN_ENCRYPT_BYTES)
+		dst = gcm_avx_out_buf(out, datap, bleft, &ct_buf, chunk_size);
 	kfpu_begin();
-	if (bleft >= GCM_AVX_MIN_ENCRYPT_BYTES) {
-		done = encrypt_blocks(datap, ct_buf, bleft, key, cb, htable,
+	if (dst != NULL) {
+		done = encrypt_blocks(datap, dst, bleft, key, cb, htable,
 		    ghash);
 		if (done == 0) {
 			rv = CRYPTO_FAILED;
 			goto out;
 		}
-		rv = crypto_put_output_data(ct_buf, out, done);
-		if (rv != CRYPTO_SUCCESS) {
-			goto out;
+		if (dst == ct_buf) {
+			rv = crypto_put_output_data(ct_buf, out, done);
+			if (rv != CRYPTO_SUCCESS) {
+				goto out;
+			}
 		}
 		out->cd_offset += done;
 		ctx->gcm_processed_data_len += done;
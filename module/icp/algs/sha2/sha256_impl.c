@@ -36,6 +36,9 @@
 	extern void ASMABI E(uint32_t s[8], const void *, size_t); \
 	static inline void N(uint32_t s[8], const void *d, size_t b) { \
 	kfpu_begin(); E(s, d, b); kfpu_end(); \
+} \
+	static inline void N##_nofpu(uint32_t s[8], const void *d, size_t b) { \
+	E(s, d, b); \
 }
 
 /* some implementation is always okay */
@@ -72,6 +75,7 @@ TF(zfs_sha256_transform_ssse3, tf_sha256_ssse3);
 const sha256_ops_t sha256_ssse3_impl = {
 	.is_supported = sha2_have_ssse3,
 	.transform = tf_sha256_ssse3,
+	.transform_nofpu = tf_sha256_ssse3_nofpu,
 	.name = "ssse3"
 };
 #endif
@@ -86,6 +90,7 @@ TF(zfs_sha256_transform_avx, tf_sha256_avx);
 const sha256_ops_t sha256_avx_impl = {
 	.is_supported = sha2_have_avx,
 	.transform = tf_sha256_avx,
+	.transform_nofpu = tf_sha256_avx_nofpu,
 	.name = "avx"
 };
 #endif
@@ -100,6 +105,7 @@ TF(zfs_sha256_transform_avx2, tf_sha256_avx2);
 const sha256_ops_t sha256_avx2_impl = {
 	.is_supported = sha2_have_avx2,
 	.transform = tf_sha256_avx2,
+	.transform_nofpu = tf_sha256_avx2_nofpu,
 	.name = "avx2"
 };
 #endif
@@ -115,6 +121,7 @@ TF(zfs_sha256_transform_shani, tf_sha256_shani);
 const sha256_ops_t sha256_shani_impl = {
 	.is_supported = sha2_have_shani,
 	.transform = tf_sha256_shani,
+	.transform_nofpu = tf_sha256_shani_nofpu,
 	.name = "shani"
 };
 #endif
@@ -142,6 +149,7 @@ TF(zfs_sha256_block_neon, tf_sha256_neon);
 const sha256_ops_t sha256_neon_impl = {
 	.is_supported = sha256_have_neon,
 	.transform = tf_sha256_neon,
+	.transform_nofpu = tf_sha256_neon_nofpu,
 	.name = "neon"
 };
 
@@ -149,6 +157,7 @@ TF(zfs_sha256_block_armv8, tf_sha256_armv8ce);
 const sha256_ops_t sha256_armv8_impl = {
 	.is_supported = sha256_have_armv8ce,
 	.transform = tf_sha256_armv8ce,
+	.transform_nofpu = tf_sha256_armv8ce_nofpu,
 	.name = "armv8-ce"
 };
 #endif
@@ -163,6 +172,7 @@ TF(zfs_sha256_ppc, tf_sha256_ppc);
 const sha256_ops_t sha256_ppc_impl = {
 	.is_supported = sha2_is_supported,
 	.transform = tf_sha256_ppc,
+	.transform_nofpu = tf_sha256_ppc_nofpu,
 	.name = "ppc"
 };
 
@@ -170,6 +180,7 @@ TF(zfs_sha256_power8, tf_sha256_power8);
 const sha256_ops_t sha256_power8_impl = {
 	.is_supported = sha256_have_isa207,
 	.transform = tf_sha256_power8,
+	.transform_nofpu = tf_sha256_power8_nofpu,
 	.name = "power8"
 };
 #endif /* __PPC64__ */
@@ -213,6 +224,7 @@ static const sha256_ops_t *const sha256_impls[] = {
 #define	IMPL_OPS_T		sha256_ops_t
 #define	IMPL_ARRAY		sha256_impls
 #define	IMPL_GET_OPS		sha256_get_ops
+#define	IMPL_GET_OPS_SIZED	sha256_get_ops_sized
 #define	ZFS_IMPL_OPS		zfs_sha256_ops
 #include <generic_impl.c>
 
@@ -25,6 +25,7 @@
  * Copyright (c) 2022 Tino Reichardt <milky-zfs@mcmilk.de>
  */
 
+#include <sys/simd.h>
 #include <sys/zfs_context.h>
 #include <sys/zfs_impl.h>
 #include <sys/sha2.h>
@@ -226,16 +227,19 @@ static void sha512_generic(uint64_t state[8], const void *data, size_t num_blks)
 	}
 }
 
-static void sha256_update(sha256_ctx *ctx, const uint8_t *data, size_t len)
+static void sha256_update(sha256_ctx *ctx, const uint8_t *data, size_t len,
+    boolean_t fpu_held)
 {
 	uint64_t pos = ctx->count[0];
 	uint64_t total = ctx->count[1];
 	uint8_t *m = ctx->wbuf;
 	const sha256_ops_t *ops = ctx->ops;
+	sha256_f transform = fpu_held && ops->transform_nofpu != NULL ?
+	    ops->transform_nofpu : ops->transform;
 
 	if (pos && pos + len >= 64) {
 		memcpy(m + pos, data, 64 - pos);
-		ops->transform(ctx->state, m, 1);
+		transform(ctx->state, m, 1);
 		len -= 64 - pos;
 		total += (64 - pos) * 8;
 		data += 64 - pos;
@@ -245,7 +249,7 @@ static void sha256_update(sha256_ctx *ctx, const uint8_t *data, size_t len)
 	if (len >= 64) {
 		uint32_t blocks = len / 64;
 		uint32_t bytes = blocks * 64;
-		ops->transform(ctx->state, data, blocks);
+		transform(ctx->state, data, blocks);
 		len -= bytes;
 		total += (bytes) * 8;
 		data += bytes;
@@ -258,16 +262,19 @@ static void sha256_update(sha256_ctx *ctx, const uint8_t *data, size_t len)
 	ctx->count[1] = total;
 }
 
-static void sha512_update(sha512_ctx *ctx, const uint8_t *data, size_t len)
+static void sha512_update(sha512_ctx *ctx, const uint8_t *data, size_t len,
+    boolean_t fpu_held)
 {
 	uint64_t pos = ctx->count[0];
 	uint64_t total = ctx->count[1];
 	uint8_t *m = ctx->wbuf;
 	const sha512_ops_t *ops = ctx->ops;
+	sha512_f transform = fpu_held && ops->transform_nofpu != NULL ?
+	    ops->transform_nofpu : ops->transform;
 
 	if (pos && pos + len >= 128) {
 		memcpy(m + pos, data, 128 - pos);
-		ops->transform(ctx->state, m, 1);
+		transform(ctx->state, m, 1);
 		len -= 128 - pos;
 		total += (128 - pos) * 8;
 		data += 128 - pos;
@@ -277,7 +284,7 @@ static void sha512_update(sha512_ctx *ctx, const uint8_t *data, size_t len)
 	if (len >= 128) {
 		uint64_t blocks = len / 128;
 		uint64_t bytes = blocks * 128;
-		ops->transform(ctx->state, data, blocks);
+		transform(ctx->state, data, blocks);
 		len -= bytes;
 		total += (bytes) * 8;
 		data += bytes;
@@ -461,22 +468,76 @@ SHA2Update(SHA2_CTX *ctx, const void *data, size_t len)
 
 	switch (ctx->algotype) {
 		case SHA256:
-			sha256_update(&ctx->sha256, data, len);
+			sha256_update(&ctx->sha256, data, len, ctx->fpu_held);
 			break;
 		case SHA512:
 		case SHA512_HMAC_MECH_INFO_TYPE:
-			sha512_update(&ctx->sha512, data, len);
+			sha512_update(&ctx->sha512, data, len, ctx->fpu_held);
 			break;
 		case SHA512_256:
-			sha512_update(&ctx->sha512, data, len);
+			sha512_update(&ctx->sha512, data, len, ctx->fpu_held);
 			break;
 	}
 }
 
+/*
+ * Hold the FPU across the following SHA2Update() calls, instead of saving
+ * and restoring it around every one of them, when the selected
+ * implementation uses it.  Must be paired with SHA2FpuEnd() before any
+ * SHA2Final().  Note that on some platforms this disables preemption, so
+ * callers should bound the amount of data hashed in between.
+ */
+void
+SHA2FpuBegin(SHA2_CTX *ctx)
+{
+	boolean_t uses_fpu;
+
+	ASSERT(!ctx->fpu_held);
+
+	if (ctx->algotype == SHA256) {
+		const sha256_ops_t *ops = ctx->sha256.ops;
+		uses_fpu = ops->transform_nofpu != NULL;
+	} else {
+		const sha512_ops_t *ops = ctx->sha512.ops;
+		uses_fpu = ops->transform_nofpu != NULL;
+	}
+
+	if (uses_fpu) {
+		kfpu_begin();
+		ctx->fpu_held = B_TRUE;
+	}
+}
+
+void
+SHA2FpuEnd(SHA2_CTX *ctx)
+{
+	if (ctx->fpu_held) {
+		ctx->fpu_held = B_FALSE;
+		kfpu_end();
+	}
+}
+
+/*
+ * Switch a freshly initialized context to the implementation that the
+ * checksum benchmark found fastest for messages of the given size.
+ */
+void
+SHA2SizeHint(SHA2_CTX *ctx, uint64_t size)
+{
+	ASSERT(!ctx->fpu_held);
+
+	if (ctx->algotype == SHA256)
+		ctx->sha256.ops = sha256_get_ops_sized(size);
+	else
+		ctx->sha512.ops = sha512_get_ops_sized(size);
+}
+
 /* SHA2Final function */
 void
 SHA2Final(void *digest, SHA2_CTX *ctx)
 {
+	ASSERT(!ctx->fpu_held);
+
 	switch (ctx->algotype) {
 		case SHA256:
 			sha256_final(&ctx->sha256, digest, 256);
@@ -36,6 +36,9 @@
 	extern void ASMABI E(uint64_t s[8], const void *, size_t); \
 	static inline void N(uint64_t s[8], const void *d, size_t b) { \
 	kfpu_begin(); E(s, d, b); kfpu_end(); \
+} \
+	static inline void N##_nofpu(uint64_t s[8], const void *d, size_t b) { \
+	E(s, d, b); \
 }
 
 /* some implementation is always okay */
@@ -71,6 +74,7 @@ TF(zfs_sha512_transform_avx, tf_sha512_avx);
 const sha512_ops_t sha512_avx_impl = {
 	.is_supported = sha2_have_avx,
 	.transform = tf_sha512_avx,
+	.transform_nofpu = tf_sha512_avx_nofpu,
 	.name = "avx"
 };
 #endif
@@ -85,6 +89,7 @@ TF(zfs_sha512_transform_avx2, tf_sha512_avx2);
 const sha512_ops_t sha512_avx2_impl = {
 	.is_supported = sha2_have_avx2,
 	.transform = tf_sha512_avx2,
+	.transform_nofpu = tf_sha512_avx2_nofpu,
 	.name = "avx2"
 };
 #endif
@@ -107,6 +112,7 @@ TF(zfs_sha512_block_armv8, tf_sha512_armv8ce);
 const sha512_ops_t sha512_armv8_impl = {
 	.is_supported = sha512_have_armv8ce,
 	.transform = tf_sha512_armv8ce,
+	.transform_nofpu = tf_sha512_armv8ce_nofpu,
 	.name = "armv8-ce"
 };
 #endif
@@ -121,6 +127,7 @@ TF(zfs_sha512_block_neon, tf_sha512_neon);
 const sha512_ops_t sha512_neon_impl = {
 	.is_supported = sha512_have_neon,
 	.transform = tf_sha512_neon,
+	.transform_nofpu = tf_sha512_neon_nofpu,
 	.name = "neon"
 };
 #endif
@@ -130,6 +137,7 @@ TF(zfs_sha512_ppc, tf_sha512_ppc);
 const sha512_ops_t sha512_ppc_impl = {
 	.is_supported = sha2_is_supported,
 	.transform = tf_sha512_ppc,
+	.transform_nofpu = tf_sha512_ppc_nofpu,
 	.name = "ppc"
 };
 
@@ -142,6 +150,7 @@ TF(zfs_sha512_power8, tf_sha512_power8);
 const sha512_ops_t sha512_power8_impl = {
 	.is_supported = sha512_have_isa207,
 	.transform = tf_sha512_power8,
+	.transform_nofpu = tf_sha512_power8_nofpu,
 	.name = "power8"
 };
 #endif /* __PPC64__ */
@@ -181,6 +190,7 @@ static const sha512_ops_t *const sha512_impls[] = {
 #define	IMPL_OPS_T		sha512_ops_t
 #define	IMPL_ARRAY		sha512_impls
 #define	IMPL_GET_OPS		sha512_get_ops
+#define	IMPL_GET_OPS_SIZED	sha512_get_ops_sized
 #define	ZFS_IMPL_OPS		zfs_sha512_ops
 #include <generic_impl.c>
 
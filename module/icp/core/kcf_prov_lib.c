@@ -113,6 +113,42 @@ crypto_put_output_data(uchar_t *buf, crypto_data_t *output, int len)
 	return (CRYPTO_SUCCESS);
 }
 
+/*
+ * Return a pointer to the len bytes of the output at its current offset if
+ * they are contiguous, so that a cipher can write its output there directly
+ * rather than copying it in with crypto_put_output_data().  Return NULL
+ * otherwise.
+ */
+uchar_t *
+crypto_get_output_buf(crypto_data_t *output, size_t len)
+{
+	zfs_uio_t *uiop;
+	off_t offset;
+	uint_t vec_idx;
+
+	switch (output->cd_format) {
+	case CRYPTO_DATA_RAW:
+		if (output->cd_offset + len > output->cd_raw.iov_len)
+			return (NULL);
+		return ((uchar_t *)output->cd_raw.iov_base +
+		    output->cd_offset);
+
+	case CRYPTO_DATA_UIO:
+		uiop = output->cd_uio;
+		if (zfs_uio_segflg(uiop) != UIO_SYSSPACE)
+			return (NULL);
+		offset = zfs_uio_index_at_offset(uiop, output->cd_offset,
+		    &vec_idx);
+		if (vec_idx == zfs_uio_iovcnt(uiop) ||
+		    zfs_uio_iovlen(uiop, vec_idx) - offset < len)
+			return (NULL);
+		return ((uchar_t *)zfs_uio_iovbase(uiop, vec_idx) + offset);
+
+	default:
+		return (NULL);
+	}
+}
+
 int
 crypto_update_iov(void *ctx, crypto_data_t *input, crypto_data_t *output,
     int (*cipher)(void *, caddr_t, size_t, crypto_data_t *))
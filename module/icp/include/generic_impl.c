@@ -49,6 +49,9 @@ static IMPL_OPS_T generic_fastest_impl = {
 	.name = "fastest"
 };
 
+/* Fastest implementations for the small buffer size buckets, if known */
+static const IMPL_OPS_T *generic_fastest_sized[ZFS_IMPL_BUCKET_LARGE];
+
 /* Hold all supported implementations */
 static const IMPL_OPS_T *generic_supp_impls[ARRAY_SIZE(IMPL_ARRAY)];
 static uint32_t generic_supp_impls_cnt = 0;
@@ -186,13 +189,19 @@ generic_impl_setname(const char *val)
 	return (err);
 }
 
-/* setup id as fastest implementation */
+/* setup id as fastest implementation for buffers in the given bucket */
 static void
-generic_impl_set_fastest(uint32_t id)
+generic_impl_set_fastest(uint32_t id, zfs_impl_bucket_t bucket)
 {
 	generic_impl_init();
-	memcpy(&generic_fastest_impl, generic_supp_impls[id],
-	    sizeof (generic_fastest_impl));
+	ASSERT3U(id, <, generic_supp_impls_cnt);
+	if (bucket == ZFS_IMPL_BUCKET_LARGE) {
+		memcpy(&generic_fastest_impl, generic_supp_impls[id],
+		    sizeof (generic_fastest_impl));
+	} else {
+		ASSERT3U(bucket, <, ZFS_IMPL_BUCKET_LARGE);
+		generic_fastest_sized[bucket] = generic_supp_impls[id];
+	}
 }
 
 /* return impl iterating functions */
@@ -232,3 +241,18 @@ IMPL_GET_OPS(void)
 	ASSERT3P(ops, !=, NULL);
 	return (ops);
 }
+
+/* get impl ops_t of selected implementation for a buffer of given size */
+const IMPL_OPS_T *
+IMPL_GET_OPS_SIZED(uint64_t size)
+{
+	zfs_impl_bucket_t bucket = zfs_impl_bucket(size);
+	const IMPL_OPS_T *ops;
+
+	if (bucket != ZFS_IMPL_BUCKET_LARGE &&
+	    IMPL_READ(generic_impl_chosen) == IMPL_FASTEST &&
+	    (ops = generic_fastest_sized[bucket]) != NULL)
+		return (ops);
+
+	return (IMPL_GET_OPS());
+}
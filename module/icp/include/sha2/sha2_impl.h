@@ -45,16 +45,22 @@ typedef struct {
 	const char *name;
 	sha256_f transform;
 	sha2_is_supported_f is_supported;
+	/* transform for callers holding the FPU, NULL if it isn't used */
+	sha256_f transform_nofpu;
 } sha256_ops_t;
 
 typedef struct {
 	const char *name;
 	sha512_f transform;
 	sha2_is_supported_f is_supported;
+	/* transform for callers holding the FPU, NULL if it isn't used */
+	sha512_f transform_nofpu;
 } sha512_ops_t;
 
 extern const sha256_ops_t *sha256_get_ops(void);
 extern const sha512_ops_t *sha512_get_ops(void);
+extern const sha256_ops_t *sha256_get_ops_sized(uint64_t size);
+extern const sha512_ops_t *sha512_get_ops_sized(uint64_t size);
 
 typedef enum {
 	SHA1_TYPE,
@@ -331,6 +331,7 @@ extern void kcf_provider_zero_refcnt(kcf_provider_desc_t *);
 extern void kcf_free_provider_desc(kcf_provider_desc_t *);
 extern void undo_register_provider(kcf_provider_desc_t *, boolean_t);
 extern int crypto_put_output_data(uchar_t *, crypto_data_t *, int);
+extern uchar_t *crypto_get_output_buf(crypto_data_t *, size_t);
 extern int crypto_update_iov(void *, crypto_data_t *, crypto_data_t *,
     int (*cipher)(void *, caddr_t, size_t, crypto_data_t *));
 extern int crypto_update_uio(void *, crypto_data_t *, crypto_data_t *,
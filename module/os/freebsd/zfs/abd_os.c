@@ -114,6 +114,14 @@ static kstat_t *abd_ksp;
  */
 abd_t *abd_zero_scatter = NULL;
 
+/*
+ * Like abd_zero_scatter, but every chunk is abd_sink_buf, which is never
+ * read.  It is used as the target of reads whose data is discarded, such as
+ * the gaps between aggregated I/Os, so they need no buffer of their own.
+ */
+abd_t *abd_sink_scatter = NULL;
+static void *abd_sink_buf = NULL;
+
 static uint_t
 abd_chunkcnt_for_bytes(size_t size)
 {
@@ -247,8 +255,9 @@ abd_free_struct_impl(abd_t *abd)
 }
 
 /*
- * Allocate scatter ABD of size SPA_MAXBLOCKSIZE, where
- * each chunk in the scatterlist will be set to the same area.
+ * Allocate scatter ABDs of size SPA_MAXBLOCKSIZE, where
+ * each chunk in the scatterlist will be set to the same area:
+ * zero_region for abd_zero_scatter and abd_sink_buf for abd_sink_scatter.
  */
 _Static_assert(ZERO_REGION_SIZE >= PAGE_SIZE, "zero_region too small");
 static void
@@ -270,6 +279,19 @@ abd_alloc_zero_scatter(void)
 
 	ABDSTAT_BUMP(abdstat_scatter_cnt);
 	ABDSTAT_INCR(abdstat_scatter_data_size, PAGE_SIZE);
+
+	abd_sink_buf = kmem_cache_alloc(abd_chunk_cache, KM_SLEEP);
+	abd_sink_scatter = abd_alloc_struct(SPA_MAXBLOCKSIZE);
+	abd_sink_scatter->abd_flags |= ABD_FLAG_OWNER;
+	abd_sink_scatter->abd_size = SPA_MAXBLOCKSIZE;
+
+	ABD_SCATTER(abd_sink_scatter).abd_offset = 0;
+
+	for (i = 0; i < n; i++)
+		ABD_SCATTER(abd_sink_scatter).abd_chunks[i] = abd_sink_buf;
+
+	ABDSTAT_BUMP(abdstat_scatter_cnt);
+	ABDSTAT_INCR(abdstat_scatter_data_size, PAGE_SIZE);
 }
 
 static void
@@ -278,6 +300,14 @@ abd_free_zero_scatter(void)
 	ABDSTAT_BUMPDOWN(abdstat_scatter_cnt);
 	ABDSTAT_INCR(abdstat_scatter_data_size, -(int)PAGE_SIZE);
 
+	abd_free_struct(abd_sink_scatter);
+	abd_sink_scatter = NULL;
+	kmem_cache_free(abd_chunk_cache, abd_sink_buf);
+	abd_sink_buf = NULL;
+
+	ABDSTAT_BUMPDOWN(abdstat_scatter_cnt);
+	ABDSTAT_INCR(abdstat_scatter_data_size, -(int)PAGE_SIZE);
+
 	abd_free_struct(abd_zero_scatter);
 	abd_zero_scatter = NULL;
 }
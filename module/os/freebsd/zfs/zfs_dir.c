@@ -59,6 +59,7 @@
 #include <sys/zfs_sa.h>
 #include <sys/dmu_objset.h>
 #include <sys/dsl_dir.h>
+#include <sys/zfs_vnops.h>
 
 #include <sys/ccompat.h>
 
@@ -247,6 +248,7 @@ zfs_dirlook(znode_t *dzp, const char *name, znode_t **zpp)
 		error = zfs_dirent_lookup(dzp, name, &zp, ZEXISTS);
 		if (error == 0) {
 			dzp->z_zn_prefetch = B_TRUE; /* enable prefetching */
+			zfs_dir_prefetch(dzp, name);
 			*zpp = zp;
 		}
 	}
@@ -1162,7 +1162,7 @@ zfsvfs_setup(zfsvfs_t *zfsvfs, boolean_t mounting)
 				boolean_t use_nc = zfsvfs->z_use_namecache;
 				zfsvfs->z_use_namecache = B_FALSE;
 				zfsvfs->z_replay = B_TRUE;
-				zil_replay(zfsvfs->z_os, zfsvfs,
+				zil_replay_parallel(zfsvfs->z_os, zfsvfs,
 				    zfs_replay_vector);
 				zfsvfs->z_replay = B_FALSE;
 				zfsvfs->z_use_namecache = use_nc;
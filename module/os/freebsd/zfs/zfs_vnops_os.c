@@ -1966,23 +1966,45 @@ zfs_getattr(vnode_t *vp, vattr_t *vap, int flags, cred_t *cr)
 	boolean_t skipaclchk = (flags & ATTR_NOACLCHECK) ? B_TRUE : B_FALSE;
 	sa_bulk_attr_t bulk[4];
 	int count = 0;
+	uint64_t gen;
 
 	if ((error = zfs_enter_verify_zp(zfsvfs, zp, FTAG)) != 0)
 		return (error);
 
 	zfs_fuid_map_ids(zp, cr, &vap->va_uid, &vap->va_gid);
 
-	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_MTIME(zfsvfs), NULL, &mtime, 16);
-	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CTIME(zfsvfs), NULL, &ctime, 16);
-	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CRTIME(zfsvfs), NULL, &crtime, 16);
-	if (vp->v_type == VBLK || vp->v_type == VCHR)
-		SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_RDEV(zfsvfs), NULL,
-		    &rdev, 8);
-
-	if ((error = sa_bulk_lookup(zp->z_sa_hdl, bulk, count)) != 0) {
-		zfs_exit(zfsvfs, FTAG);
-		return (error);
+	/*
+	 * The times and rdev are kept in the znode between calls, and only
+	 * looked up again once the SA handle says they may have changed.
+	 */
+	mutex_enter(&zp->z_lock);
+	gen = sa_handle_gen(zp->z_sa_hdl);
+	if (!zp->z_stat_valid || zp->z_stat_gen != gen) {
+		SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_MTIME(zfsvfs), NULL,
+		    &zp->z_stat_mtime, 16);
+		SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CTIME(zfsvfs), NULL,
+		    &zp->z_stat_ctime, 16);
+		SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CRTIME(zfsvfs), NULL,
+		    &zp->z_stat_crtime, 16);
+		if (vp->v_type == VBLK || vp->v_type == VCHR)
+			SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_RDEV(zfsvfs),
+			    NULL, &zp->z_stat_rdev, 8);
+
+		if ((error = sa_bulk_lookup(zp->z_sa_hdl, bulk,
+		    count)) != 0) {
+			zp->z_stat_valid = B_FALSE;
+			mutex_exit(&zp->z_lock);
+			zfs_exit(zfsvfs, FTAG);
+			return (error);
+		}
+		zp->z_stat_gen = gen;
+		zp->z_stat_valid = B_TRUE;
 	}
+	memcpy(mtime, zp->z_stat_mtime, sizeof (mtime));
+	memcpy(ctime, zp->z_stat_ctime, sizeof (ctime));
+	memcpy(crtime, zp->z_stat_crtime, sizeof (crtime));
+	rdev = zp->z_stat_rdev;
+	mutex_exit(&zp->z_lock);
 
 	/*
 	 * If ACL is trivial don't bother looking for ACE_READ_ATTRIBUTES.
@@ -122,10 +122,12 @@ zfs_rangelock_cb(zfs_locked_range_t *new, void *arg)
 
 	/*
 	 * If we need to grow the block size then lock the whole file range.
+	 * A file of more than one block can't change its block size.
 	 */
 	uint64_t end_size = MAX(zp->z_size, new->lr_offset + new->lr_length);
 	if (end_size > zp->z_blksz && (!ISP2(zp->z_blksz) ||
-	    zp->z_blksz < ZTOZSB(zp)->z_max_blksz)) {
+	    (zp->z_blksz < ZTOZSB(zp)->z_max_blksz &&
+	    zp->z_size <= zp->z_blksz))) {
 		new->lr_offset = 0;
 		new->lr_length = UINT64_MAX;
 	}
@@ -364,6 +366,7 @@ zfs_znode_sa_init(zfsvfs_t *zfsvfs, znode_t *zp,
 	}
 
 	zp->z_is_sa = (obj_type == DMU_OT_SA) ? B_TRUE : B_FALSE;
+	zp->z_stat_valid = B_FALSE;
 
 	/*
 	 * Slap on VROOT if we are the root znode unless we are the root
@@ -449,8 +452,11 @@ zfs_znode_alloc(zfsvfs_t *zfsvfs, dmu_buf_t *db, int blksz,
 	zp->z_mapcnt = 0;
 	zp->z_id = db->db_object;
 	zp->z_blksz = blksz;
+	zp->z_wr_inplace = 0;
+	zp->z_wr_maxsz = 0;
 	zp->z_seq = 0x7A4653;
 	zp->z_sync_cnt = 0;
+	zp->z_replay_eof = 0;
 	atomic_store_ptr(&zp->z_cached_symlink, NULL);
 
 	zfs_znode_sa_init(zfsvfs, zp, db, obj_type, hdl);
@@ -501,6 +507,7 @@ zfs_znode_alloc(zfsvfs_t *zfsvfs, dmu_buf_t *db, int blksz,
 	switch (vp->v_type) {
 	case VDIR:
 		zp->z_zn_prefetch = B_TRUE; /* z_prefetch default is enabled */
+		memset(&zp->z_walk, 0, sizeof (zfs_dir_walk_t));
 		break;
 	case VFIFO:
 		vp->v_op = &zfs_fifoops;
@@ -835,6 +835,8 @@ spl_init(void)
 	if ((rc = spl_zone_init()))
 		goto out8;
 
+	spl_lockstat_init();
+
 	return (rc);
 
 out8:
@@ -860,6 +862,7 @@ out0:
 static void __exit
 spl_fini(void)
 {
+	spl_lockstat_fini();
 	spl_zone_fini();
 	spl_zlib_fini();
 	spl_kmem_cache_fini();
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *  This file is part of the SPL, Solaris Porting Layer.
+ *
+ *  The SPL is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or (at your
+ *  option) any later version.
+ *
+ *  The SPL is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with the SPL.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Solaris Porting Layer (SPL) Lock Contention Statistics.
+ */
+
+#include <sys/lockstat.h>
+#include <sys/kstat.h>
+#include <linux/spinlock.h>
+
+#ifdef DEBUG_LOCKSTAT
+
+int spl_lockstat_enabled = 0;
+EXPORT_SYMBOL(spl_lockstat_enabled);
+module_param(spl_lockstat_enabled, int, 0644);
+MODULE_PARM_DESC(spl_lockstat_enabled,
+	"Collect lock contention statistics");
+
+/*
+ * Registered lock classes.  The registry is protected by a native
+ * spinlock rather than a kmutex_t, which would itself be instrumented.
+ */
+static LIST_HEAD(spl_lockstat_list);
+static DEFINE_SPINLOCK(spl_lockstat_lock);
+static kstat_t *spl_lockstat_ksp = NULL;
+
+void
+spl_lockstat_record(spl_lockstat_class_t *lsc, hrtime_t start)
+{
+	if (atomic_read(&lsc->lsc_registered) == 0 &&
+	    atomic_cmpxchg(&lsc->lsc_registered, 0, 1) == 0) {
+		spin_lock(&spl_lockstat_lock);
+		list_add_tail(&lsc->lsc_list, &spl_lockstat_list);
+		spin_unlock(&spl_lockstat_lock);
+	}
+
+	atomic64_inc(&lsc->lsc_acquired);
+	if (start == 0)
+		return;
+
+	s64 delta = gethrtime() - start;
+	s64 max = atomic64_read(&lsc->lsc_wait_max);
+
+	atomic64_inc(&lsc->lsc_contended);
+	atomic64_add(delta, &lsc->lsc_wait);
+	while (delta > max) {
+		s64 old = atomic64_cmpxchg(&lsc->lsc_wait_max, max, delta);
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+EXPORT_SYMBOL(spl_lockstat_record);
+
+/*
+ * Called by a module before it is unloaded to forget about the lock
+ * classes which were statically allocated in it.
+ */
+void
+spl_lockstat_purge(struct module *owner)
+{
+	spl_lockstat_class_t *lsc, *tmp;
+
+	spin_lock(&spl_lockstat_lock);
+	list_for_each_entry_safe(lsc, tmp, &spl_lockstat_list, lsc_list) {
+		if (lsc->lsc_owner == owner) {
+			list_del(&lsc->lsc_list);
+			atomic_set(&lsc->lsc_registered, 0);
+		}
+	}
+	spin_unlock(&spl_lockstat_lock);
+}
+EXPORT_SYMBOL(spl_lockstat_purge);
+
+static int
+spl_lockstat_kstat_headers(char *buf, size_t size)
+{
+	size_t n = snprintf(buf, size, "%-40s %-6s %12s %12s %16s %14s %s\n",
+	    "class", "type", "acquired", "contended", "wait_ns",
+	    "max_wait_ns", "site");
+	return (n >= size ? ENOMEM : 0);
+}
+
+static int
+spl_lockstat_kstat_data(char *buf, size_t size, void *data)
+{
+	spl_lockstat_class_t *lsc;
+	const char *file;
+	size_t n;
+	int err = 0;
+
+	spin_lock(&spl_lockstat_lock);
+	list_for_each_entry(lsc, &spl_lockstat_list, lsc_list) {
+		file = strrchr(lsc->lsc_file, '/');
+		file = (file != NULL) ? file + 1 : lsc->lsc_file;
+
+		n = snprintf(buf, size,
+		    "%-40s %-6s %12lld %12lld %16lld %14lld %s:%d\n",
+		    lsc->lsc_name,
+		    lsc->lsc_type == SPL_LOCKSTAT_MUTEX ? "mutex" : "rwlock",
+		    (longlong_t)atomic64_read(&lsc->lsc_acquired),
+		    (longlong_t)atomic64_read(&lsc->lsc_contended),
+		    (longlong_t)atomic64_read(&lsc->lsc_wait),
+		    (longlong_t)atomic64_read(&lsc->lsc_wait_max),
+		    file, lsc->lsc_line);
+		if (n >= size) {
+			err = ENOMEM;
+			break;
+		}
+
+		buf = &buf[n];
+		size -= n;
+	}
+	spin_unlock(&spl_lockstat_lock);
+
+	return (err);
+}
+
+/*
+ * Writing to the kstat resets the statistics of all lock classes.
+ */
+static int
+spl_lockstat_kstat_update(kstat_t *ksp, int rw)
+{
+	spl_lockstat_class_t *lsc;
+
+	if (rw != KSTAT_WRITE)
+		return (0);
+
+	spin_lock(&spl_lockstat_lock);
+	list_for_each_entry(lsc, &spl_lockstat_list, lsc_list) {
+		atomic64_set(&lsc->lsc_acquired, 0);
+		atomic64_set(&lsc->lsc_contended, 0);
+		atomic64_set(&lsc->lsc_wait, 0);
+		atomic64_set(&lsc->lsc_wait_max, 0);
+	}
+	spin_unlock(&spl_lockstat_lock);
+
+	return (0);
+}
+
+void
+spl_lockstat_init(void)
+{
+	kstat_t *ksp = kstat_create("spl", 0, "lockstat", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+
+	if (ksp == NULL)
+		return;
+
+	ksp->ks_data = (void *)(uintptr_t)1;
+	ksp->ks_ndata = 1;
+	ksp->ks_update = spl_lockstat_kstat_update;
+	kstat_set_raw_ops(ksp, spl_lockstat_kstat_headers,
+	    spl_lockstat_kstat_data, NULL);
+	kstat_install(ksp);
+
+	spl_lockstat_ksp = ksp;
+}
+
+void
+spl_lockstat_fini(void)
+{
+	if (spl_lockstat_ksp != NULL) {
+		kstat_delete(spl_lockstat_ksp);
+		spl_lockstat_ksp = NULL;
+	}
+
+	spl_lockstat_purge(THIS_MODULE);
+}
+
+#endif /* DEBUG_LOCKSTAT */
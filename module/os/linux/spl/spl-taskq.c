@@ -1160,7 +1160,21 @@ taskq_thread_create(taskq_t *tq)
 		return (NULL);
 	}
 
-	if (spl_taskq_thread_bind) {
+	if (tq->tq_node != NUMA_NO_NODE) {
+		/*
+		 * Spread the threads of a node-local taskq over the CPUs of
+		 * that node.  Races on tq_node_cpu only affect the spread.
+		 */
+		const struct cpumask *mask = cpumask_of_node(tq->tq_node);
+		int cpu = cpumask_next(tq->tq_node_cpu, mask);
+
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(mask);
+		if (cpu < nr_cpu_ids) {
+			tq->tq_node_cpu = cpu;
+			kthread_bind(tqt->tqt_thread, cpu);
+		}
+	} else if (spl_taskq_thread_bind) {
 		last_used_cpu = (last_used_cpu + 1) % num_online_cpus();
 		kthread_bind(tqt->tqt_thread, last_used_cpu);
 	}
@@ -1323,6 +1337,19 @@ taskq_kstats_fini(taskq_t *tq)
 taskq_t *
 taskq_create(const char *name, int threads_arg, pri_t pri,
     int minalloc, int maxalloc, uint_t flags)
+{
+	return (taskq_create_node(name, threads_arg, pri, minalloc, maxalloc,
+	    flags, NUMA_NO_NODE));
+}
+EXPORT_SYMBOL(taskq_create);
+
+/*
+ * Create a taskq whose threads only run on the CPUs of NUMA node "node".
+ * NUMA_NO_NODE gives a regular taskq.
+ */
+taskq_t *
+taskq_create_node(const char *name, int threads_arg, pri_t pri,
+    int minalloc, int maxalloc, uint_t flags, int node)
 {
 	taskq_t *tq;
 	taskq_thread_t *tqt;
@@ -1368,6 +1395,8 @@ taskq_create(const char *name, int threads_arg, pri_t pri,
 	tq->tq_maxthreads = nthreads;
 	tq->tq_cpu_pct = threads_arg;
 	tq->tq_pri = pri;
+	tq->tq_node = node;
+	tq->tq_node_cpu = -1;
 	tq->tq_minalloc = minalloc;
 	tq->tq_maxalloc = maxalloc;
 	tq->tq_nalloc = 0;
@@ -1430,7 +1459,7 @@ taskq_create(const char *name, int threads_arg, pri_t pri,
 
 	return (tq);
 }
-EXPORT_SYMBOL(taskq_create);
+EXPORT_SYMBOL(taskq_create_node);
 
 void
 taskq_destroy(taskq_t *tq)
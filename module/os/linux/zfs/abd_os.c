@@ -59,6 +59,7 @@
 #include <sys/arc.h>
 #include <sys/zfs_context.h>
 #include <sys/zfs_znode.h>
+#include <sys/shrinker.h>
 #include <linux/kmap_compat.h>
 #include <linux/mm_compat.h>
 #include <linux/scatterlist.h>
@@ -82,6 +83,10 @@ typedef struct abd_stats {
 	kstat_named_t abdstat_scatter_page_multi_zone;
 	kstat_named_t abdstat_scatter_page_alloc_retry;
 	kstat_named_t abdstat_scatter_sg_table_retry;
+	kstat_named_t abdstat_scatter_order_fallback;
+	kstat_named_t abdstat_scatter_pool_hits;
+	kstat_named_t abdstat_scatter_pool_misses;
+	kstat_named_t abdstat_scatter_pool_size;
 } abd_stats_t;
 
 static abd_stats_t abd_stats = {
@@ -136,6 +141,20 @@ static abd_stats_t abd_stats = {
 	 *  allocate the sg table for an ABD.
 	 */
 	{ "scatter_sg_table_retry",		KSTAT_DATA_UINT64 },
+	/*
+	 * The number of times a higher order chunk could not be allocated
+	 * without reclaim and a smaller order was tried instead.  A steadily
+	 * increasing value indicates fragmented memory.
+	 */
+	{ "scatter_order_fallback",		KSTAT_DATA_UINT64 },
+	/*
+	 * The number of higher order chunks which were satisfied from, or
+	 * could not be satisfied from, the pool of recently freed chunks.
+	 */
+	{ "scatter_pool_hits",			KSTAT_DATA_UINT64 },
+	{ "scatter_pool_misses",		KSTAT_DATA_UINT64 },
+	/* Amount of memory currently held in the chunk pool */
+	{ "scatter_pool_size",			KSTAT_DATA_UINT64 },
 };
 
 static struct {
@@ -150,6 +169,9 @@ static struct {
 	wmsum_t abdstat_scatter_page_multi_zone;
 	wmsum_t abdstat_scatter_page_alloc_retry;
 	wmsum_t abdstat_scatter_sg_table_retry;
+	wmsum_t abdstat_scatter_order_fallback;
+	wmsum_t abdstat_scatter_pool_hits;
+	wmsum_t abdstat_scatter_pool_misses;
 } abd_sums;
 
 #define	abd_for_each_sg(abd, sg, n, i)	\
@@ -195,6 +217,14 @@ struct page;
  */
 static struct page *abd_zero_page = NULL;
 
+/*
+ * Like abd_zero_scatter, but every page is abd_sink_page, which is never
+ * read.  It is used as the target of reads whose data is discarded, such as
+ * the gaps between aggregated I/Os, so they need no buffer of their own.
+ */
+abd_t *abd_sink_scatter = NULL;
+static struct page *abd_sink_page = NULL;
+
 static kmem_cache_t *abd_cache = NULL;
 static kstat_t *abd_ksp;
 
@@ -228,6 +258,19 @@ abd_free_struct_impl(abd_t *abd)
 
 static unsigned zfs_abd_scatter_max_order = ABD_MAX_ORDER - 1;
 
+/*
+ * When set, higher order chunks are only allocated from the NUMA node of
+ * the allocating CPU; the allocation falls back to smaller orders on that
+ * node before single pages are allowed to come from a remote node.
+ */
+static int zfs_abd_scatter_numa_local = 0;
+
+/*
+ * Maximum amount of memory, in bytes, held in the pool of freed higher
+ * order chunks.  Zero disables the pool.
+ */
+static unsigned long zfs_abd_scatter_pool_max = 64 * 1024 * 1024;
+
 /*
  * Mark zfs data pages so they can be excluded from kernel crash dumps
  */
@@ -254,6 +297,121 @@ abd_unmark_zfs_page(struct page *page)
 #define	abd_unmark_zfs_page(page)
 #endif /* _LP64 */
 
+/*
+ * Chunks of at least 64KiB are the ones which are worth keeping around;
+ * once memory is fragmented they are expensive to allocate again, while
+ * smaller orders are usually cheap to find.
+ */
+#define	ABD_POOL_MIN_ORDER	(PAGE_SHIFT < 16 ? 16 - PAGE_SHIFT : 1)
+
+/*
+ * Compound pages freed by abd_free_chunks() are kept in a small per-order
+ * pool, up to zfs_abd_scatter_pool_max bytes, so that the next ABD of a
+ * similar size can reuse them instead of falling back to smaller orders.
+ * The pool is drained by a shrinker when the kernel needs the memory back.
+ */
+static struct {
+	kmutex_t		acp_lock;
+	uint64_t		acp_size;
+	struct list_head	acp_chunks[ABD_MAX_ORDER];
+} abd_chunk_pool;
+
+static struct shrinker *abd_chunk_pool_shrinker;
+
+static struct page *
+abd_chunk_pool_get(unsigned int order)
+{
+	struct page *page = NULL;
+
+	if (order < ABD_POOL_MIN_ORDER || zfs_abd_scatter_pool_max == 0)
+		return (NULL);
+
+	mutex_enter(&abd_chunk_pool.acp_lock);
+	if (!list_empty(&abd_chunk_pool.acp_chunks[order])) {
+		page = list_first_entry(&abd_chunk_pool.acp_chunks[order],
+		    struct page, lru);
+		list_del(&page->lru);
+		abd_chunk_pool.acp_size -= PAGE_SIZE << order;
+	}
+	mutex_exit(&abd_chunk_pool.acp_lock);
+
+	if (page != NULL)
+		ABDSTAT_BUMP(abdstat_scatter_pool_hits);
+	else
+		ABDSTAT_BUMP(abdstat_scatter_pool_misses);
+
+	return (page);
+}
+
+static boolean_t
+abd_chunk_pool_put(struct page *page, unsigned int order)
+{
+	size_t size = PAGE_SIZE << order;
+	boolean_t pooled = B_FALSE;
+
+	if (order < ABD_POOL_MIN_ORDER)
+		return (B_FALSE);
+
+	mutex_enter(&abd_chunk_pool.acp_lock);
+	if (abd_chunk_pool.acp_size + size <= zfs_abd_scatter_pool_max) {
+		list_add(&page->lru, &abd_chunk_pool.acp_chunks[order]);
+		abd_chunk_pool.acp_size += size;
+		pooled = B_TRUE;
+	}
+	mutex_exit(&abd_chunk_pool.acp_lock);
+
+	return (pooled);
+}
+
+/*
+ * Release up to nr_pages worth of pooled chunks, largest first, and return
+ * the number of pages actually released.
+ */
+static unsigned long
+abd_chunk_pool_drain(unsigned long nr_pages)
+{
+	unsigned long freed = 0;
+	LIST_HEAD(reap);
+	struct page *page, *tmp;
+
+	mutex_enter(&abd_chunk_pool.acp_lock);
+	for (int order = ABD_MAX_ORDER - 1;
+	    order >= ABD_POOL_MIN_ORDER && freed < nr_pages; order--) {
+		struct list_head *chunks = &abd_chunk_pool.acp_chunks[order];
+		while (!list_empty(chunks) && freed < nr_pages) {
+			page = list_first_entry(chunks, struct page, lru);
+			list_move(&page->lru, &reap);
+			abd_chunk_pool.acp_size -= PAGE_SIZE << order;
+			freed += 1UL << order;
+		}
+	}
+	mutex_exit(&abd_chunk_pool.acp_lock);
+
+	list_for_each_entry_safe(page, tmp, &reap, lru) {
+		list_del(&page->lru);
+		__free_pages(page, compound_order(page));
+	}
+
+	return (freed);
+}
+
+static unsigned long
+abd_chunk_pool_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	(void) shrink;
+	(void) sc;
+	return (READ_ONCE(abd_chunk_pool.acp_size) >> PAGE_SHIFT);
+}
+
+static unsigned long
+abd_chunk_pool_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	(void) shrink;
+	unsigned long freed = abd_chunk_pool_drain(sc->nr_to_scan);
+
+	return (freed == 0 ? SHRINK_STOP : freed);
+}
+
 #ifndef CONFIG_HIGHMEM
 
 /*
@@ -282,6 +440,11 @@ abd_alloc_chunks(abd_t *abd, size_t size)
 
 	INIT_LIST_HEAD(&pages);
 
+	if (zfs_abd_scatter_numa_local) {
+		nid = numa_node_id();
+		gfp_comp |= __GFP_THISNODE;
+	}
+
 	ASSERT3U(alloc_pages, <, nr_pages);
 
 	while (alloc_pages < nr_pages) {
@@ -291,12 +454,22 @@ abd_alloc_chunks(abd_t *abd, size_t size)
 		order = MIN(highbit64(nr_pages - alloc_pages) - 1, max_order);
 		chunk_pages = (1U << order);
 
-		page = alloc_pages_node(nid, order ? gfp_comp : gfp, order);
+		/*
+		 * Pooled chunks may live on any node, so they are only used
+		 * when the allocation isn't restricted to the local node.
+		 */
+		page = NULL;
+		if (!zfs_abd_scatter_numa_local)
+			page = abd_chunk_pool_get(order);
+		if (page == NULL)
+			page = alloc_pages_node(nid, order ? gfp_comp : gfp,
+			    order);
 		if (page == NULL) {
 			if (order == 0) {
 				ABDSTAT_BUMP(abdstat_scatter_page_alloc_retry);
 				schedule_timeout_interruptible(1);
 			} else {
+				ABDSTAT_BUMP(abdstat_scatter_order_fallback);
 				max_order = MAX(0, order - 1);
 			}
 			continue;
@@ -307,7 +480,8 @@ abd_alloc_chunks(abd_t *abd, size_t size)
 		if ((nid != NUMA_NO_NODE) && (page_to_nid(page) != nid))
 			zones++;
 
-		nid = page_to_nid(page);
+		if (!zfs_abd_scatter_numa_local)
+			nid = page_to_nid(page);
 		ABDSTAT_BUMP(abdstat_scatter_orders[order]);
 		chunks++;
 		alloc_pages += chunk_pages;
@@ -460,7 +634,8 @@ abd_free_chunks(abd_t *abd)
 			page = sg_page(sg);
 			abd_unmark_zfs_page(page);
 			order = compound_order(page);
-			__free_pages(page, order);
+			if (!abd_chunk_pool_put(page, order))
+				__free_pages(page, order);
 			ASSERT3U(sg->length, <=, PAGE_SIZE << order);
 			ABDSTAT_BUMPDOWN(abdstat_scatter_orders[order]);
 		}
@@ -471,16 +646,62 @@ abd_free_chunks(abd_t *abd)
 
 /*
  * Allocate scatter ABD of size SPA_MAXBLOCKSIZE, where each page in
- * the scatterlist will be set to the zero'd out buffer abd_zero_page.
+ * the scatterlist will be set to the same page.
  */
-static void
-abd_alloc_zero_scatter(void)
+static abd_t *
+abd_alloc_page_scatter(struct page *page)
 {
 	struct scatterlist *sg = NULL;
 	struct sg_table table;
 	gfp_t gfp = __GFP_NOWARN | GFP_NOIO;
 	int nr_pages = abd_chunkcnt_for_bytes(SPA_MAXBLOCKSIZE);
 	int i = 0;
+	abd_t *abd;
+
+	while (sg_alloc_table(&table, nr_pages, gfp)) {
+		ABDSTAT_BUMP(abdstat_scatter_sg_table_retry);
+		schedule_timeout_interruptible(1);
+	}
+	ASSERT3U(table.nents, ==, nr_pages);
+
+	abd = abd_alloc_struct(SPA_MAXBLOCKSIZE);
+	abd->abd_flags |= ABD_FLAG_OWNER;
+	ABD_SCATTER(abd).abd_offset = 0;
+	ABD_SCATTER(abd).abd_sgl = table.sgl;
+	ABD_SCATTER(abd).abd_nents = nr_pages;
+	abd->abd_size = SPA_MAXBLOCKSIZE;
+	abd->abd_flags |= ABD_FLAG_MULTI_CHUNK;
+
+	abd_for_each_sg(abd, sg, nr_pages, i) {
+		sg_set_page(sg, page, PAGESIZE, 0);
+	}
+
+	ABDSTAT_BUMP(abdstat_scatter_cnt);
+	ABDSTAT_INCR(abdstat_scatter_data_size, PAGESIZE);
+	ABDSTAT_BUMP(abdstat_scatter_page_multi_chunk);
+
+	return (abd);
+}
+
+static void
+abd_free_page_scatter(abd_t *abd)
+{
+	ABDSTAT_BUMPDOWN(abdstat_scatter_cnt);
+	ABDSTAT_INCR(abdstat_scatter_data_size, -(int)PAGESIZE);
+	ABDSTAT_BUMPDOWN(abdstat_scatter_page_multi_chunk);
+
+	abd_free_sg_table(abd);
+	abd_free_struct(abd);
+}
+
+/*
+ * Allocate the zero scatter ABD, whose pages are all abd_zero_page, and the
+ * sink scatter ABD, whose pages are all abd_sink_page.
+ */
+static void
+abd_alloc_zero_scatter(void)
+{
+	gfp_t gfp = __GFP_NOWARN | GFP_NOIO;
 
 #if defined(HAVE_ZERO_PAGE_GPL_ONLY)
 	gfp_t gfp_zero_page = gfp | __GFP_ZERO;
@@ -492,28 +713,14 @@ abd_alloc_zero_scatter(void)
 #else
 	abd_zero_page = ZERO_PAGE(0);
 #endif /* HAVE_ZERO_PAGE_GPL_ONLY */
+	abd_zero_scatter = abd_alloc_page_scatter(abd_zero_page);
 
-	while (sg_alloc_table(&table, nr_pages, gfp)) {
-		ABDSTAT_BUMP(abdstat_scatter_sg_table_retry);
+	while ((abd_sink_page = __page_cache_alloc(gfp)) == NULL) {
+		ABDSTAT_BUMP(abdstat_scatter_page_alloc_retry);
 		schedule_timeout_interruptible(1);
 	}
-	ASSERT3U(table.nents, ==, nr_pages);
-
-	abd_zero_scatter = abd_alloc_struct(SPA_MAXBLOCKSIZE);
-	abd_zero_scatter->abd_flags |= ABD_FLAG_OWNER;
-	ABD_SCATTER(abd_zero_scatter).abd_offset = 0;
-	ABD_SCATTER(abd_zero_scatter).abd_sgl = table.sgl;
-	ABD_SCATTER(abd_zero_scatter).abd_nents = nr_pages;
-	abd_zero_scatter->abd_size = SPA_MAXBLOCKSIZE;
-	abd_zero_scatter->abd_flags |= ABD_FLAG_MULTI_CHUNK;
-
-	abd_for_each_sg(abd_zero_scatter, sg, nr_pages, i) {
-		sg_set_page(sg, abd_zero_page, PAGESIZE, 0);
-	}
-
-	ABDSTAT_BUMP(abdstat_scatter_cnt);
-	ABDSTAT_INCR(abdstat_scatter_data_size, PAGESIZE);
-	ABDSTAT_BUMP(abdstat_scatter_page_multi_chunk);
+	abd_mark_zfs_page(abd_sink_page);
+	abd_sink_scatter = abd_alloc_page_scatter(abd_sink_page);
 }
 
 boolean_t
@@ -574,12 +781,12 @@ abd_verify_scatter(abd_t *abd)
 static void
 abd_free_zero_scatter(void)
 {
-	ABDSTAT_BUMPDOWN(abdstat_scatter_cnt);
-	ABDSTAT_INCR(abdstat_scatter_data_size, -(int)PAGESIZE);
-	ABDSTAT_BUMPDOWN(abdstat_scatter_page_multi_chunk);
+	abd_free_page_scatter(abd_sink_scatter);
+	abd_sink_scatter = NULL;
+	abd_unmark_zfs_page(abd_sink_page);
+	__free_page(abd_sink_page);
 
-	abd_free_sg_table(abd_zero_scatter);
-	abd_free_struct(abd_zero_scatter);
+	abd_free_page_scatter(abd_zero_scatter);
 	abd_zero_scatter = NULL;
 	ASSERT3P(abd_zero_page, !=, NULL);
 #if defined(HAVE_ZERO_PAGE_GPL_ONLY)
@@ -619,6 +826,14 @@ abd_kstats_update(kstat_t *ksp, int rw)
 	    wmsum_value(&abd_sums.abdstat_scatter_page_alloc_retry);
 	as->abdstat_scatter_sg_table_retry.value.ui64 =
 	    wmsum_value(&abd_sums.abdstat_scatter_sg_table_retry);
+	as->abdstat_scatter_order_fallback.value.ui64 =
+	    wmsum_value(&abd_sums.abdstat_scatter_order_fallback);
+	as->abdstat_scatter_pool_hits.value.ui64 =
+	    wmsum_value(&abd_sums.abdstat_scatter_pool_hits);
+	as->abdstat_scatter_pool_misses.value.ui64 =
+	    wmsum_value(&abd_sums.abdstat_scatter_pool_misses);
+	as->abdstat_scatter_pool_size.value.ui64 =
+	    READ_ONCE(abd_chunk_pool.acp_size);
 	return (0);
 }
 
@@ -642,6 +857,16 @@ abd_init(void)
 	wmsum_init(&abd_sums.abdstat_scatter_page_multi_zone, 0);
 	wmsum_init(&abd_sums.abdstat_scatter_page_alloc_retry, 0);
 	wmsum_init(&abd_sums.abdstat_scatter_sg_table_retry, 0);
+	wmsum_init(&abd_sums.abdstat_scatter_order_fallback, 0);
+	wmsum_init(&abd_sums.abdstat_scatter_pool_hits, 0);
+	wmsum_init(&abd_sums.abdstat_scatter_pool_misses, 0);
+
+	mutex_init(&abd_chunk_pool.acp_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < ABD_MAX_ORDER; i++)
+		INIT_LIST_HEAD(&abd_chunk_pool.acp_chunks[i]);
+	abd_chunk_pool_shrinker = spl_register_shrinker("zfs-abd-pool",
+	    abd_chunk_pool_count, abd_chunk_pool_scan, DEFAULT_SEEKS);
+	VERIFY(abd_chunk_pool_shrinker);
 
 	abd_ksp = kstat_create("zfs", 0, "abdstats", "misc", KSTAT_TYPE_NAMED,
 	    sizeof (abd_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
@@ -665,6 +890,12 @@ abd_fini(void)
 {
 	abd_free_zero_scatter();
 
+	spl_unregister_shrinker(abd_chunk_pool_shrinker);
+	abd_chunk_pool_shrinker = NULL;
+	(void) abd_chunk_pool_drain(ULONG_MAX);
+	ASSERT0(abd_chunk_pool.acp_size);
+	mutex_destroy(&abd_chunk_pool.acp_lock);
+
 	if (abd_ksp != NULL) {
 		kstat_delete(abd_ksp);
 		abd_ksp = NULL;
@@ -682,6 +913,9 @@ abd_fini(void)
 	wmsum_fini(&abd_sums.abdstat_scatter_page_multi_zone);
 	wmsum_fini(&abd_sums.abdstat_scatter_page_alloc_retry);
 	wmsum_fini(&abd_sums.abdstat_scatter_sg_table_retry);
+	wmsum_fini(&abd_sums.abdstat_scatter_order_fallback);
+	wmsum_fini(&abd_sums.abdstat_scatter_pool_hits);
+	wmsum_fini(&abd_sums.abdstat_scatter_pool_misses);
 
 	if (abd_cache) {
 		kmem_cache_destroy(abd_cache);
@@ -1348,3 +1582,9 @@ MODULE_PARM_DESC(zfs_abd_scatter_min_size,
 module_param(zfs_abd_scatter_max_order, uint, 0644);
 MODULE_PARM_DESC(zfs_abd_scatter_max_order,
 	"Maximum order allocation used for a scatter ABD.");
+module_param(zfs_abd_scatter_numa_local, int, 0644);
+MODULE_PARM_DESC(zfs_abd_scatter_numa_local,
+	"Allocate higher order scatter ABD chunks from the local node only.");
+module_param(zfs_abd_scatter_pool_max, ulong, 0644);
+MODULE_PARM_DESC(zfs_abd_scatter_pool_max,
+	"Maximum bytes of freed higher order scatter ABD chunks to keep.");
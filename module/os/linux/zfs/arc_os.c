@@ -148,7 +148,7 @@ arc_available_memory(void)
 static uint64_t
 arc_evictable_memory(void)
 {
-	int64_t asize = aggsum_value(&arc_sums.arcstat_size);
+	int64_t asize = pcsum_value(&arc_sums.arcstat_size);
 	uint64_t arc_clean =
 	    zfs_refcount_count(&arc_mru->arcs_esize[ARC_BUFC_DATA]) +
 	    zfs_refcount_count(&arc_mru->arcs_esize[ARC_BUFC_METADATA]) +
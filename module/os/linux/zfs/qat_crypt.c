@@ -58,8 +58,26 @@ int zfs_qat_checksum_disable = 0;
 typedef struct cy_callback {
 	CpaBoolean verify_result;
 	struct completion complete;
+	/* if set, called instead of completing the completion */
+	void (*done)(void *arg);
+	void *arg;
 } cy_callback_t;
 
+/* state of a checksum request, which must live until it has completed */
+typedef struct qat_cksum_req {
+	cy_callback_t cb;
+	CpaInstanceHandle inst_handle;
+	CpaCySymSessionCtx *session_ctx;
+	Cpa8U *digest_buffer;
+	CpaCySymOpData op_data;
+	CpaBufferList src_buffer_list;
+	CpaFlatBuffer *flat_src_buf_array;
+	struct page *in_pages[MAX_PAGE_NUM];
+	Cpa32U page_num;
+} qat_cksum_req_t;
+
+static const zio_offload_ops_t qat_offload_ops;
+
 static void
 symcallback(void *p_callback, CpaStatus status, const CpaCySymOp operation,
     void *op_data, CpaBufferList *buf_list_dst, CpaBoolean verify)
@@ -69,7 +87,10 @@ symcallback(void *p_callback, CpaStatus status, const CpaCySymOp operation,
 	if (cb != NULL) {
 		/* indicate that the function has been called */
 		cb->verify_result = verify;
-		complete(&cb->complete);
+		if (cb->done != NULL)
+			cb->done(cb->arg);
+		else
+			complete(&cb->complete);
 	}
 }
 
@@ -136,6 +157,7 @@ qat_cy_init(void)
 	}
 
 	qat_cy_init_done = B_TRUE;
+	zio_offload_register(&qat_offload_ops);
 	return (0);
 
 error:
@@ -149,6 +171,7 @@ qat_cy_fini(void)
 	if (!qat_cy_init_done)
 		return;
 
+	zio_offload_unregister(&qat_offload_ops);
 	qat_cy_clean();
 }
 
@@ -302,7 +325,7 @@ qat_crypt(qat_encrypt_dir_t dir, uint8_t *src_buf, uint8_t *dst_buf,
 	Cpa32U bytes_left = 0;
 	Cpa8S *data = NULL;
 	CpaCySymSessionCtx *cy_session_ctx = NULL;
-	cy_callback_t cb;
+	cy_callback_t cb = { 0 };
 	CpaCySymOpData op_data = { 0 };
 	CpaBufferList src_buffer_list = { 0 };
 	CpaBufferList dst_buffer_list = { 0 };
@@ -465,34 +488,43 @@ fail:
 	return (status);
 }
 
-int
-qat_checksum(uint64_t cksum, uint8_t *buf, uint64_t size, zio_cksum_t *zcp)
+static void
+qat_checksum_cleanup(qat_cksum_req_t *req)
+{
+	for (Cpa32U i = 0; i < req->page_num; i++)
+		kunmap(req->in_pages[i]);
+
+	cpaCySymRemoveSession(req->inst_handle, req->session_ctx);
+	QAT_PHYS_CONTIG_FREE(req->digest_buffer);
+	QAT_PHYS_CONTIG_FREE(req->src_buffer_list.pPrivateMetaData);
+	QAT_PHYS_CONTIG_FREE(req->session_ctx);
+	QAT_PHYS_CONTIG_FREE(req->flat_src_buf_array);
+}
+
+/*
+ * Submit a checksum request.  On success, req->cb is signalled once the
+ * request has completed, and qat_checksum_finish() must then be called.
+ */
+static CpaStatus
+qat_checksum_start(qat_cksum_req_t *req, uint64_t cksum, uint8_t *buf,
+    uint64_t size)
 {
 	CpaStatus status;
 	Cpa16U i;
-	CpaInstanceHandle cy_inst_handle;
 	Cpa16U nr_bufs = (size >> PAGE_SHIFT) + 2;
 	Cpa32U bytes_left = 0;
 	Cpa8S *data = NULL;
-	CpaCySymSessionCtx *cy_session_ctx = NULL;
-	cy_callback_t cb;
-	Cpa8U *digest_buffer = NULL;
-	CpaCySymOpData op_data = { 0 };
-	CpaBufferList src_buffer_list = { 0 };
-	CpaFlatBuffer *flat_src_buf_array = NULL;
 	CpaFlatBuffer *flat_src_buf = NULL;
-	struct page *in_pages[MAX_PAGE_NUM];
-	Cpa32U page_num = 0;
 	Cpa32U page_off = 0;
 
 	QAT_STAT_BUMP(cksum_requests);
 	QAT_STAT_INCR(cksum_total_in_bytes, size);
 
 	i = (Cpa32U)atomic_inc_32_nv(&inst_num) % num_inst;
-	cy_inst_handle = cy_inst_handles[i];
+	req->inst_handle = cy_inst_handles[i];
 
-	status = qat_init_checksum_session_ctx(cy_inst_handle,
-	    &cy_session_ctx, cksum);
+	status = qat_init_checksum_session_ctx(req->inst_handle,
+	    &req->session_ctx, cksum);
 	if (status != CPA_STATUS_SUCCESS) {
 		/* don't count unsupported checksums as a failure */
 		if (cksum == ZIO_CHECKSUM_SHA256 ||
@@ -506,76 +538,166 @@ qat_checksum(uint64_t cksum, uint8_t *buf, uint64_t size, zio_cksum_t *zcp)
 	 * page-aligned buffer addresses and buffers whose sizes
 	 * are not divisible by PAGE_SIZE.
 	 */
-	status = qat_init_cy_buffer_lists(cy_inst_handle, nr_bufs,
-	    &src_buffer_list, &src_buffer_list);
+	status = qat_init_cy_buffer_lists(req->inst_handle, nr_bufs,
+	    &req->src_buffer_list, &req->src_buffer_list);
 	if (status != CPA_STATUS_SUCCESS)
 		goto fail;
 
-	status = QAT_PHYS_CONTIG_ALLOC(&flat_src_buf_array,
+	status = QAT_PHYS_CONTIG_ALLOC(&req->flat_src_buf_array,
 	    nr_bufs * sizeof (CpaFlatBuffer));
 	if (status != CPA_STATUS_SUCCESS)
 		goto fail;
-	status = QAT_PHYS_CONTIG_ALLOC(&digest_buffer,
+	status = QAT_PHYS_CONTIG_ALLOC(&req->digest_buffer,
 	    sizeof (zio_cksum_t));
 	if (status != CPA_STATUS_SUCCESS)
 		goto fail;
 
 	bytes_left = size;
 	data = buf;
-	flat_src_buf = flat_src_buf_array;
+	flat_src_buf = req->flat_src_buf_array;
 	while (bytes_left > 0) {
 		page_off = ((long)data & ~PAGE_MASK);
-		in_pages[page_num] = qat_mem_to_page(data);
-		flat_src_buf->pData = kmap(in_pages[page_num]) + page_off;
+		req->in_pages[req->page_num] = qat_mem_to_page(data);
+		flat_src_buf->pData = kmap(req->in_pages[req->page_num]) +
+		    page_off;
 		flat_src_buf->dataLenInBytes =
 		    min((long)PAGE_SIZE - page_off, (long)bytes_left);
 		data += flat_src_buf->dataLenInBytes;
 		bytes_left -= flat_src_buf->dataLenInBytes;
 		flat_src_buf++;
-		page_num++;
+		req->page_num++;
 	}
-	src_buffer_list.pBuffers = flat_src_buf_array;
-	src_buffer_list.numBuffers = page_num;
-
-	op_data.sessionCtx = cy_session_ctx;
-	op_data.packetType = CPA_CY_SYM_PACKET_TYPE_FULL;
-	op_data.hashStartSrcOffsetInBytes = 0;
-	op_data.messageLenToHashInBytes = size;
-	op_data.pDigestResult = digest_buffer;
-
-	cb.verify_result = CPA_FALSE;
-	init_completion(&cb.complete);
-	status = cpaCySymPerformOp(cy_inst_handle, &cb, &op_data,
-	    &src_buffer_list, &src_buffer_list, NULL);
+	req->src_buffer_list.pBuffers = req->flat_src_buf_array;
+	req->src_buffer_list.numBuffers = req->page_num;
+
+	req->op_data.sessionCtx = req->session_ctx;
+	req->op_data.packetType = CPA_CY_SYM_PACKET_TYPE_FULL;
+	req->op_data.hashStartSrcOffsetInBytes = 0;
+	req->op_data.messageLenToHashInBytes = size;
+	req->op_data.pDigestResult = req->digest_buffer;
+
+	req->cb.verify_result = CPA_FALSE;
+	status = cpaCySymPerformOp(req->inst_handle, &req->cb, &req->op_data,
+	    &req->src_buffer_list, &req->src_buffer_list, NULL);
 	if (status != CPA_STATUS_SUCCESS)
 		goto fail;
 
-	/* we now wait until the completion of the operation. */
-	wait_for_completion(&cb.complete);
+	return (status);
 
-	if (cb.verify_result == CPA_FALSE) {
+fail:
+	QAT_STAT_BUMP(cksum_fails);
+	qat_checksum_cleanup(req);
+
+	return (status);
+}
+
+static CpaStatus
+qat_checksum_finish(qat_cksum_req_t *req, zio_cksum_t *zcp)
+{
+	CpaStatus status = CPA_STATUS_SUCCESS;
+
+	if (req->cb.verify_result == CPA_FALSE) {
 		status = CPA_STATUS_FAIL;
-		goto fail;
+		QAT_STAT_BUMP(cksum_fails);
+	} else {
+		memcpy(zcp, req->digest_buffer, sizeof (zio_cksum_t));
 	}
 
-	memcpy(zcp, digest_buffer, sizeof (zio_cksum_t));
+	qat_checksum_cleanup(req);
 
-fail:
+	return (status);
+}
+
+int
+qat_checksum(uint64_t cksum, uint8_t *buf, uint64_t size, zio_cksum_t *zcp)
+{
+	qat_cksum_req_t req = { 0 };
+	CpaStatus status;
+
+	init_completion(&req.cb.complete);
+	status = qat_checksum_start(&req, cksum, buf, size);
 	if (status != CPA_STATUS_SUCCESS)
-		QAT_STAT_BUMP(cksum_fails);
+		return (status);
 
-	for (i = 0; i < page_num; i++)
-		kunmap(in_pages[i]);
+	/* we now wait until the completion of the operation. */
+	wait_for_completion(&req.cb.complete);
 
-	cpaCySymRemoveSession(cy_inst_handle, cy_session_ctx);
-	QAT_PHYS_CONTIG_FREE(digest_buffer);
-	QAT_PHYS_CONTIG_FREE(src_buffer_list.pPrivateMetaData);
-	QAT_PHYS_CONTIG_FREE(cy_session_ctx);
-	QAT_PHYS_CONTIG_FREE(flat_src_buf_array);
+	return (qat_checksum_finish(&req, zcp));
+}
 
-	return (status);
+/*
+ * Asynchronous checksums for the zio pipeline, so that a few zio threads
+ * can keep the QAT instances busy instead of each one waiting for its own
+ * request.
+ */
+typedef struct qat_cksum_offload {
+	qat_cksum_req_t qco_req;
+	uint8_t *qco_buf;
+} qat_cksum_offload_t;
+
+static void
+qat_checksum_offload_done(void *arg)
+{
+	zio_offload_done(arg);
+}
+
+static int
+qat_checksum_offload_start(zio_offload_req_t *zor,
+    enum zio_checksum checksum, abd_t *abd, uint64_t size)
+{
+	qat_cksum_offload_t *qco;
+
+	if (checksum != ZIO_CHECKSUM_SHA256 || !qat_checksum_use_accel(size))
+		return (SET_ERROR(ENOTSUP));
+
+	qco = kmem_zalloc(sizeof (qat_cksum_offload_t), KM_SLEEP);
+	qco->qco_buf = abd_borrow_buf_copy(abd, size);
+	qco->qco_req.cb.done = qat_checksum_offload_done;
+	qco->qco_req.cb.arg = zor;
+	zor->zor_private = qco;
+
+	/* the request may already be done when this returns */
+	if (qat_checksum_start(&qco->qco_req, checksum, qco->qco_buf,
+	    size) != CPA_STATUS_SUCCESS) {
+		zor->zor_private = NULL;
+		abd_return_buf(abd, qco->qco_buf, size);
+		kmem_free(qco, sizeof (qat_cksum_offload_t));
+		return (SET_ERROR(EIO));
+	}
+
+	return (0);
 }
 
+static int
+qat_checksum_offload_fini(zio_offload_req_t *zor, abd_t *abd,
+    uint64_t size, zio_cksum_t *zcp)
+{
+	qat_cksum_offload_t *qco = zor->zor_private;
+	zio_cksum_t tmp;
+	CpaStatus status;
+
+	status = qat_checksum_finish(&qco->qco_req, &tmp);
+	abd_return_buf(abd, qco->qco_buf, size);
+	kmem_free(qco, sizeof (qat_cksum_offload_t));
+
+	if (status != CPA_STATUS_SUCCESS)
+		return (SET_ERROR(EIO));
+
+	/* SHA256 checksums are stored big endian, see abd_checksum_sha256() */
+	zcp->zc_word[0] = BE_64(tmp.zc_word[0]);
+	zcp->zc_word[1] = BE_64(tmp.zc_word[1]);
+	zcp->zc_word[2] = BE_64(tmp.zc_word[2]);
+	zcp->zc_word[3] = BE_64(tmp.zc_word[3]);
+
+	return (0);
+}
+
+static const zio_offload_ops_t qat_offload_ops = {
+	.zoo_name = "qat",
+	.zoo_checksum_start = qat_checksum_offload_start,
+	.zoo_checksum_fini = qat_checksum_offload_fini,
+};
+
 static int
 param_set_qat_encrypt(const char *val, zfs_kernel_param_t *kp)
 {
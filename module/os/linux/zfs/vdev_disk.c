@@ -447,6 +447,13 @@ vdev_disk_open(vdev_t *v, uint64_t *psize, uint64_t *max_psize,
 	/* Inform the ZIO pipeline that we are non-rotational */
 	v->vdev_nonrot = blk_queue_nonrot(bdev_get_queue(bdev));
 
+	/* Zoned (SMR host-managed, ZNS) devices want append-only allocation */
+	v->vdev_zone_size = 0;
+#ifdef HAVE_BDEV_IS_ZONED
+	if (bdev_is_zoned(bdev))
+		v->vdev_zone_size = (uint64_t)bdev_zone_sectors(bdev) << 9;
+#endif
+
 	/* Physical volume size in bytes for the partition */
 	*psize = bdev_capacity(bdev);
 
@@ -702,6 +709,17 @@ vbio_add_page(vbio_t *vbio, struct page *page, uint_t size, uint_t offset)
 			    vbio->vbio_max_segs);
 			VERIFY(bio);
 
+#ifdef HAVE_BIO_POLL
+			/*
+			 * We can only poll for a single BIO. If we need
+			 * more, let them all complete by interrupt instead.
+			 */
+			if (vbio->vbio_bio && (vbio->vbio_flags & REQ_POLLED)) {
+				vbio->vbio_flags &= ~REQ_POLLED;
+				vbio->vbio_bio->bi_opf &= ~REQ_POLLED;
+			}
+#endif
+
 			BIO_BI_SECTOR(bio) = vbio->vbio_offset >> 9;
 			bio_set_op_attrs(bio,
 			    vbio->vbio_zio->io_type == ZIO_TYPE_WRITE ?
@@ -750,6 +768,27 @@ vbio_fill_cb(struct page *page, size_t off, size_t len, void *priv)
 	return (vbio_add_page(vbio, page, len, off));
 }
 
+#ifdef HAVE_BIO_POLL
+/*
+ * Spin until a polled BIO completes. We hold our own reference to the BIO so
+ * it stays valid until we're done; vbio_completion() clears bi_private to
+ * tell us it has finished with it. If the queue doesn't support polling, the
+ * block layer will have cleared REQ_POLLED and the BIO will complete by
+ * interrupt as usual, so there's nothing to wait for.
+ */
+static void
+vbio_poll(struct bio *bio)
+{
+	if (bio->bi_opf & REQ_POLLED) {
+		while (READ_ONCE(bio->bi_private) != NULL) {
+			bio_poll(bio, NULL, 0);
+			cond_resched();
+		}
+	}
+	bio_put(bio);
+}
+#endif
+
 /* Create some BIOs, fill them with data and submit them */
 static void
 vbio_submit(vbio_t *vbio, abd_t *abd, uint64_t size)
@@ -768,8 +807,15 @@ vbio_submit(vbio_t *vbio, abd_t *abd, uint64_t size)
 	(void) abd_iterate_page_func(abd, 0, size, vbio_fill_cb, vbio);
 	ASSERT(vbio->vbio_bio);
 
-	vbio->vbio_bio->bi_end_io = vbio_completion;
-	vbio->vbio_bio->bi_private = vbio;
+	struct bio *bio = vbio->vbio_bio;
+	bio->bi_end_io = vbio_completion;
+	bio->bi_private = vbio;
+
+#ifdef HAVE_BIO_POLL
+	boolean_t poll = !!(vbio->vbio_flags & REQ_POLLED);
+	if (poll)
+		bio_get(bio);
+#endif
 
 	/*
 	 * Once submitted, vbio_bio now owns vbio (through bi_private) and we
@@ -777,9 +823,15 @@ vbio_submit(vbio_t *vbio, abd_t *abd, uint64_t size)
 	 * called and free the vbio before this task is run again, so we must
 	 * consider it invalid from this point.
 	 */
-	vdev_submit_bio(vbio->vbio_bio);
+	vdev_submit_bio(bio);
 
 	blk_finish_plug(&plug);
+
+#ifdef HAVE_BIO_POLL
+	/* Polling must wait for the unplug, or there'd be nothing to find */
+	if (poll)
+		vbio_poll(bio);
+#endif
 }
 
 /* IO completion callback */
@@ -798,6 +850,9 @@ vbio_completion(struct bio *bio)
 	if (zio->io_error)
 		vdev_disk_error(zio);
 
+	/* Tell a polling submitter we're done with the BIO (see vbio_poll()) */
+	WRITE_ONCE(bio->bi_private, NULL);
+
 	/* Return the BIO to the kernel */
 	bio_put(bio);
 
@@ -926,6 +981,19 @@ vdev_disk_io_rw(zio_t *zio)
 		    zfs_vdev_failfast_mask & 2, zfs_vdev_failfast_mask & 4);
 	}
 
+#ifdef HAVE_BIO_POLL
+	/*
+	 * Synchronous I/O on vdevs with the poll property set is completed
+	 * by spinning on the device's completion queue in vbio_poll(),
+	 * avoiding the interrupt and wakeup latency. This is intended for
+	 * low-latency devices (eg SLOG), where that latency dominates.
+	 */
+	if ((zio->io_priority == ZIO_PRIORITY_SYNC_READ ||
+	    zio->io_priority == ZIO_PRIORITY_SYNC_WRITE) &&
+	    (v->vdev_poll || v->vdev_top->vdev_poll))
+		flags |= REQ_POLLED;
+#endif
+
 	/*
 	 * Check alignment of the incoming ABD. If any part of it would require
 	 * submitting a page that is not aligned to both the logical block size
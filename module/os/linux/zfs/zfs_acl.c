@@ -52,6 +52,7 @@
 #include <sys/sa.h>
 #include <sys/trace_acl.h>
 #include <sys/zpl.h>
+#include <sys/mod.h>
 
 #define	ALLOW	ACE_ACCESS_ALLOWED_ACE_TYPE
 #define	DENY	ACE_ACCESS_DENIED_ACE_TYPE
@@ -449,6 +450,97 @@ zfs_acl_version_zp(znode_t *zp)
 	return (zfs_acl_version(ZTOZSB(zp)->z_version));
 }
 
+/*
+ * Cache of recent access decisions made by zfs_zaccess_aces_check(), kept
+ * with the cached ACL of a znode.  Evaluating a long ACL, with group
+ * membership checks for each group ACE, for every access by the same
+ * users is costly on shared file servers.  Because the cache belongs to
+ * the zfs_acl_t, it is discarded along with the ACL whenever the ACL is
+ * changed or the znode is evicted.  The owner and group the decision was
+ * made against are recorded too, as they can change without a new ACL.
+ * Each entry holds a reference on its credential, which is immutable, so
+ * a decision can never be returned for a different credential.
+ */
+#define	ZFS_ACL_ACCESS_ENTRIES	4
+
+typedef struct zfs_acl_access_entry {
+	cred_t		*za_cr;
+	uid_t		za_fowner;
+	uid_t		za_gowner;
+	uint32_t	za_mode;	/* requested access */
+	uint32_t	za_working_mode; /* access left ungranted */
+	int		za_error;
+} zfs_acl_access_entry_t;
+
+typedef struct zfs_acl_access {
+	uint_t			za_next;
+	zfs_acl_access_entry_t	za_entries[ZFS_ACL_ACCESS_ENTRIES];
+} zfs_acl_access_t;
+
+static int zfs_acl_access_cache = 1;
+
+static void
+zfs_acl_access_free(zfs_acl_t *aclp)
+{
+	zfs_acl_access_t *za = aclp->z_access;
+
+	if (za == NULL)
+		return;
+
+	for (int i = 0; i < ZFS_ACL_ACCESS_ENTRIES; i++) {
+		if (za->za_entries[i].za_cr != NULL)
+			crfree(za->za_entries[i].za_cr);
+	}
+	kmem_free(za, sizeof (zfs_acl_access_t));
+	aclp->z_access = NULL;
+}
+
+static zfs_acl_access_entry_t *
+zfs_acl_access_find(zfs_acl_t *aclp, cred_t *cr, uint32_t mode,
+    uid_t fowner, uid_t gowner)
+{
+	zfs_acl_access_t *za = aclp->z_access;
+
+	if (za == NULL)
+		return (NULL);
+
+	for (int i = 0; i < ZFS_ACL_ACCESS_ENTRIES; i++) {
+		zfs_acl_access_entry_t *zae = &za->za_entries[i];
+
+		if (zae->za_cr == cr && zae->za_mode == mode &&
+		    zae->za_fowner == fowner && zae->za_gowner == gowner)
+			return (zae);
+	}
+	return (NULL);
+}
+
+static void
+zfs_acl_access_add(zfs_acl_t *aclp, cred_t *cr, uint32_t mode,
+    uid_t fowner, uid_t gowner, uint32_t working_mode, int error)
+{
+	zfs_acl_access_t *za = aclp->z_access;
+
+	if (za == NULL) {
+		za = kmem_zalloc(sizeof (zfs_acl_access_t), KM_NOSLEEP);
+		if (za == NULL)
+			return;
+		aclp->z_access = za;
+	}
+
+	zfs_acl_access_entry_t *zae = &za->za_entries[za->za_next];
+	za->za_next = (za->za_next + 1) % ZFS_ACL_ACCESS_ENTRIES;
+
+	if (zae->za_cr != NULL)
+		crfree(zae->za_cr);
+	crhold(cr);
+	zae->za_cr = cr;
+	zae->za_fowner = fowner;
+	zae->za_gowner = gowner;
+	zae->za_mode = mode;
+	zae->za_working_mode = working_mode;
+	zae->za_error = error;
+}
+
 zfs_acl_t *
 zfs_acl_alloc(int vers)
 {
@@ -503,6 +595,7 @@ zfs_acl_release_nodes(zfs_acl_t *aclp)
 void
 zfs_acl_free(zfs_acl_t *aclp)
 {
+	zfs_acl_access_free(aclp);
 	zfs_acl_release_nodes(aclp);
 	list_destroy(&aclp->z_acl);
 	kmem_free(aclp, sizeof (zfs_acl_t));
@@ -2300,6 +2393,8 @@ zfs_zaccess_aces_check(znode_t *zp, uint32_t *working_mode,
 	boolean_t	checkit;
 	uid_t		gowner;
 	uid_t		fowner;
+	uint32_t	mode = *working_mode;
+	zfs_acl_access_entry_t *zae;
 
 	if (mnt_ns) {
 		fowner = zfs_uid_to_vfsuid(mnt_ns, zfs_i_user_ns(ZTOI(zp)),
@@ -2319,6 +2414,15 @@ zfs_zaccess_aces_check(znode_t *zp, uint32_t *working_mode,
 
 	ASSERT(zp->z_acl_cached);
 
+	if (!anyaccess && zfs_acl_access_cache &&
+	    (zae = zfs_acl_access_find(aclp, cr, mode, fowner,
+	    gowner)) != NULL) {
+		*working_mode = zae->za_working_mode;
+		error = zae->za_error;
+		mutex_exit(&zp->z_acl_lock);
+		return (error);
+	}
+
 	while ((acep = zfs_acl_next_ace(aclp, acep, &who, &access_mask,
 	    &iflags, &type))) {
 		uint32_t mask_matched;
@@ -2396,17 +2500,21 @@ zfs_zaccess_aces_check(znode_t *zp, uint32_t *working_mode,
 			break;
 	}
 
-	mutex_exit(&zp->z_acl_lock);
-
 	/* Put the found 'denies' back on the working mode */
 	if (deny_mask) {
 		*working_mode |= deny_mask;
-		return (SET_ERROR(EACCES));
+		error = SET_ERROR(EACCES);
 	} else if (*working_mode) {
-		return (-1);
+		error = -1;
 	}
 
-	return (0);
+	if (!anyaccess && zfs_acl_access_cache) {
+		zfs_acl_access_add(aclp, cr, mode, fowner, gowner,
+		    *working_mode, error);
+	}
+	mutex_exit(&zp->z_acl_lock);
+
+	return (error);
 }
 
 /*
@@ -3033,3 +3141,6 @@ zfs_zaccess_rename(znode_t *sdzp, znode_t *szp, znode_t *tdzp,
 
 	return (error);
 }
+
+ZFS_MODULE_PARAM(zfs, zfs_, acl_access_cache, INT, ZMOD_RW,
+	"Cache recent NFSv4 ACL access decisions per file");
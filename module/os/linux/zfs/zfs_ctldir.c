@@ -102,9 +102,13 @@
  * The zfs_snapshots_by_name tree is indexed by the full dataset name
  * while the zfs_snapshots_by_objsetid tree is indexed by the unique
  * objsetid.  This allows for fast lookups either by name or objsetid.
+ * Entries are also kept on the zfs_snapshots_lru list, in the order they
+ * were mounted, so the oldest can be unmounted early once more than
+ * zfs_snapshot_automount_max snapshots are mounted.
  */
 static avl_tree_t zfs_snapshots_by_name;
 static avl_tree_t zfs_snapshots_by_objsetid;
+static list_t zfs_snapshots_lru;
 static krwlock_t zfs_snapshot_lock;
 
 /*
@@ -113,6 +117,7 @@ static krwlock_t zfs_snapshot_lock;
 int zfs_expire_snapshot = ZFSCTL_EXPIRE_SNAPSHOT;
 static int zfs_admin_snapshot = 0;
 static int zfs_snapshot_no_setuid = 0;
+static int zfs_snapshot_automount_max = 0;
 
 typedef struct {
 	char		*se_name;	/* full snapshot name */
@@ -124,6 +129,7 @@ typedef struct {
 	taskqid_t	se_taskqid;	/* scheduled unmount taskqid */
 	avl_node_t	se_node_name;	/* zfs_snapshots_by_name link */
 	avl_node_t	se_node_objsetid; /* zfs_snapshots_by_objsetid link */
+	list_node_t	se_node_lru;	/* zfs_snapshots_lru link */
 	zfs_refcount_t	se_refcount;	/* reference count */
 } zfs_snapentry_t;
 
@@ -201,6 +207,7 @@ zfsctl_snapshot_add(zfs_snapentry_t *se)
 	zfsctl_snapshot_hold(se);
 	avl_add(&zfs_snapshots_by_name, se);
 	avl_add(&zfs_snapshots_by_objsetid, se);
+	list_insert_tail(&zfs_snapshots_lru, se);
 }
 
 /*
@@ -215,6 +222,7 @@ zfsctl_snapshot_remove(zfs_snapentry_t *se)
 	ASSERT(RW_WRITE_HELD(&zfs_snapshot_lock));
 	avl_remove(&zfs_snapshots_by_name, se);
 	avl_remove(&zfs_snapshots_by_objsetid, se);
+	list_remove(&zfs_snapshots_lru, se);
 	zfsctl_snapshot_rele(se);
 }
 
@@ -358,6 +366,49 @@ snapentry_expire(void *data)
 	rw_exit(&zfs_snapshot_lock);
 }
 
+/*
+ * Task responsible for unmounting an automounted snapshot evicted by
+ * zfsctl_snapshot_evict().  Unlike snapentry_expire() the unmount is not
+ * deferred until the snapshot has been idle for zfs_expire_snapshot, but
+ * it is still not forced, so a snapshot which is in use stays mounted.
+ */
+static void
+snapentry_evict(void *data)
+{
+	zfs_snapentry_t *se = (zfs_snapentry_t *)data;
+
+	(void) zfsctl_snapshot_unmount(se->se_name, 0);
+	zfsctl_snapshot_rele(se);
+}
+
+/*
+ * When more than zfs_snapshot_automount_max snapshots are automounted,
+ * unmount the one which was mounted the longest time ago.  Tools which
+ * walk thousands of snapshots would otherwise leave all of them mounted
+ * until they expire, and every further mount and unmount gets slower as
+ * the mount table grows.  The evicted entry is moved to the end of the
+ * list, so that if it is busy the next one is tried on the next mount.
+ */
+static void
+zfsctl_snapshot_evict(void)
+{
+	zfs_snapentry_t *se;
+
+	ASSERT(RW_WRITE_HELD(&zfs_snapshot_lock));
+
+	if (zfs_snapshot_automount_max <= 0 ||
+	    avl_numnodes(&zfs_snapshots_by_name) <= zfs_snapshot_automount_max)
+		return;
+
+	se = list_remove_head(&zfs_snapshots_lru);
+	list_insert_tail(&zfs_snapshots_lru, se);
+
+	zfsctl_snapshot_hold(se);
+	if (taskq_dispatch(system_taskq, snapentry_evict, se,
+	    TQ_SLEEP) == TASKQID_INVALID)
+		zfsctl_snapshot_rele(se);
+}
+
 /*
  * Cancel an automatic unmount of a snapname.  This callback is responsible
  * for dropping the reference on the zfs_snapentry_t which was taken when
@@ -1296,6 +1347,7 @@ zfsctl_snapshot_mount(struct path *path, int flags)
 		    dentry);
 		zfsctl_snapshot_add(se);
 		zfsctl_snapshot_unmount_delay_impl(se, zfs_expire_snapshot);
+		zfsctl_snapshot_evict();
 		rw_exit(&zfs_snapshot_lock);
 	}
 	path_put(&spath);
@@ -1398,6 +1450,8 @@ zfsctl_init(void)
 	avl_create(&zfs_snapshots_by_objsetid, snapentry_compare_by_objsetid,
 	    sizeof (zfs_snapentry_t), offsetof(zfs_snapentry_t,
 	    se_node_objsetid));
+	list_create(&zfs_snapshots_lru, sizeof (zfs_snapentry_t),
+	    offsetof(zfs_snapentry_t, se_node_lru));
 	rw_init(&zfs_snapshot_lock, NULL, RW_DEFAULT, NULL);
 }
 
@@ -1410,6 +1464,7 @@ zfsctl_fini(void)
 {
 	avl_destroy(&zfs_snapshots_by_name);
 	avl_destroy(&zfs_snapshots_by_objsetid);
+	list_destroy(&zfs_snapshots_lru);
 	rw_destroy(&zfs_snapshot_lock);
 }
 
@@ -1422,3 +1477,8 @@ MODULE_PARM_DESC(zfs_expire_snapshot, "Seconds to expire .zfs/snapshot");
 module_param(zfs_snapshot_no_setuid, int, 0644);
 MODULE_PARM_DESC(zfs_snapshot_no_setuid,
 	"Disable setuid/setgid for automounts in .zfs/snapshot");
+
+module_param(zfs_snapshot_automount_max, int, 0644);
+MODULE_PARM_DESC(zfs_snapshot_automount_max,
+	"Max snapshots automounted in .zfs/snapshot before the oldest "
+	"is unmounted");
@@ -55,6 +55,8 @@
 #include <sys/zfs_sa.h>
 #include <sys/dmu_objset.h>
 #include <sys/dsl_dir.h>
+#include <sys/kstat.h>
+#include <sys/wmsum.h>
 
 /*
  * zfs_match_find() is used by zfs_dirent_lock() to perform zap lookups
@@ -105,6 +107,237 @@ zfs_match_find(zfsvfs_t *zfsvfs, znode_t *dzp, const char *name,
 	return (error);
 }
 
+/*
+ * Directory name lookup cache (DNLC).
+ *
+ * When zfs_dnlc_enabled is set, every directory on a file system without
+ * normalization or case folding keeps a small, direct-mapped cache of the
+ * names recently looked up in it.  An entry records either the object the
+ * name refers to, or that the name does not exist (a negative entry), so
+ * that repeated lookups of the same name, hits or misses, skip the ZAP.
+ *
+ * Entries are only valid while their de_gen matches the cache's dc_gen,
+ * which zfs_dnlc_purge() bumps whenever the directory's ZAP is modified
+ * (see zfs_link_create() and zfs_dropname()) or reloaded (zfs_rezget()).
+ * A lookup samples dc_gen before it goes to the ZAP and only enters its
+ * result if no purge happened in the meantime.  Names longer than
+ * ZFS_DNLC_NAMELEN are never cached.
+ */
+static int zfs_dnlc_enabled = 0;
+
+#define	ZFS_DNLC_SIZE		64	/* entries per directory */
+#define	ZFS_DNLC_NAMELEN	39
+
+typedef struct zfs_dnlc_ent {
+	uint64_t	de_gen;		/* valid if equal to dc_gen */
+	uint64_t	de_zoid;	/* object id, 0 if negative */
+	uint8_t		de_namelen;
+	char		de_name[ZFS_DNLC_NAMELEN];
+} zfs_dnlc_ent_t;
+
+typedef struct zfs_dnlc {
+	kmutex_t	dc_lock;
+	uint64_t	dc_gen;
+	zfs_dnlc_ent_t	dc_ents[ZFS_DNLC_SIZE];
+} zfs_dnlc_t;
+
+typedef struct zfs_dnlc_stats {
+	kstat_named_t dnlcstat_hits;
+	kstat_named_t dnlcstat_negative_hits;
+	kstat_named_t dnlcstat_misses;
+	kstat_named_t dnlcstat_enters;
+	kstat_named_t dnlcstat_purges;
+} zfs_dnlc_stats_t;
+
+static zfs_dnlc_stats_t zfs_dnlc_stats = {
+	{ "hits",			KSTAT_DATA_UINT64 },
+	{ "negative_hits",		KSTAT_DATA_UINT64 },
+	{ "misses",			KSTAT_DATA_UINT64 },
+	{ "enters",			KSTAT_DATA_UINT64 },
+	{ "purges",			KSTAT_DATA_UINT64 },
+};
+
+static struct {
+	wmsum_t dnlcstat_hits;
+	wmsum_t dnlcstat_negative_hits;
+	wmsum_t dnlcstat_misses;
+	wmsum_t dnlcstat_enters;
+	wmsum_t dnlcstat_purges;
+} zfs_dnlc_sums;
+
+#define	DNLCSTAT_BUMP(stat)	wmsum_add(&zfs_dnlc_sums.stat, 1)
+
+static kstat_t *zfs_dnlc_ksp;
+
+static int
+zfs_dnlc_kstats_update(kstat_t *ksp, int rw)
+{
+	zfs_dnlc_stats_t *ds = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+	ds->dnlcstat_hits.value.ui64 =
+	    wmsum_value(&zfs_dnlc_sums.dnlcstat_hits);
+	ds->dnlcstat_negative_hits.value.ui64 =
+	    wmsum_value(&zfs_dnlc_sums.dnlcstat_negative_hits);
+	ds->dnlcstat_misses.value.ui64 =
+	    wmsum_value(&zfs_dnlc_sums.dnlcstat_misses);
+	ds->dnlcstat_enters.value.ui64 =
+	    wmsum_value(&zfs_dnlc_sums.dnlcstat_enters);
+	ds->dnlcstat_purges.value.ui64 =
+	    wmsum_value(&zfs_dnlc_sums.dnlcstat_purges);
+	return (0);
+}
+
+void
+zfs_dnlc_init(void)
+{
+	wmsum_init(&zfs_dnlc_sums.dnlcstat_hits, 0);
+	wmsum_init(&zfs_dnlc_sums.dnlcstat_negative_hits, 0);
+	wmsum_init(&zfs_dnlc_sums.dnlcstat_misses, 0);
+	wmsum_init(&zfs_dnlc_sums.dnlcstat_enters, 0);
+	wmsum_init(&zfs_dnlc_sums.dnlcstat_purges, 0);
+
+	zfs_dnlc_ksp = kstat_create("zfs", 0, "dnlcstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (zfs_dnlc_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (zfs_dnlc_ksp != NULL) {
+		zfs_dnlc_ksp->ks_data = &zfs_dnlc_stats;
+		zfs_dnlc_ksp->ks_update = zfs_dnlc_kstats_update;
+		kstat_install(zfs_dnlc_ksp);
+	}
+}
+
+void
+zfs_dnlc_fini(void)
+{
+	if (zfs_dnlc_ksp != NULL) {
+		kstat_delete(zfs_dnlc_ksp);
+		zfs_dnlc_ksp = NULL;
+	}
+
+	wmsum_fini(&zfs_dnlc_sums.dnlcstat_hits);
+	wmsum_fini(&zfs_dnlc_sums.dnlcstat_negative_hits);
+	wmsum_fini(&zfs_dnlc_sums.dnlcstat_misses);
+	wmsum_fini(&zfs_dnlc_sums.dnlcstat_enters);
+	wmsum_fini(&zfs_dnlc_sums.dnlcstat_purges);
+}
+
+static zfs_dnlc_ent_t *
+zfs_dnlc_slot(zfs_dnlc_t *dc, const char *name, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (uint8_t)name[i]) * 0x100000001b3ULL;
+	return (&dc->dc_ents[h % ZFS_DNLC_SIZE]);
+}
+
+/*
+ * Look name up in dzp's DNLC.  Returns B_TRUE on a hit, with *errorp set
+ * to 0 and *zoidp to the object, or to ENOENT for a negative entry.  On a
+ * miss *genp is set to the generation to pass to zfs_dnlc_enter().
+ */
+static boolean_t
+zfs_dnlc_lookup(znode_t *dzp, const char *name, uint64_t *zoidp,
+    int *errorp, uint64_t *genp)
+{
+	zfs_dnlc_t *dc = dzp->z_dnlc;
+	size_t len = strlen(name);
+	boolean_t hit = B_FALSE;
+
+	if (dc == NULL) {
+		zfs_dnlc_t *ndc = kmem_zalloc(sizeof (*ndc), KM_SLEEP);
+		mutex_init(&ndc->dc_lock, NULL, MUTEX_DEFAULT, NULL);
+		ndc->dc_gen = 1;
+		dc = atomic_cas_ptr(&dzp->z_dnlc, NULL, ndc);
+		if (dc == NULL) {
+			dc = ndc;
+		} else {
+			mutex_destroy(&ndc->dc_lock);
+			kmem_free(ndc, sizeof (*ndc));
+		}
+	}
+
+	mutex_enter(&dc->dc_lock);
+	*genp = dc->dc_gen;
+	if (len <= ZFS_DNLC_NAMELEN) {
+		zfs_dnlc_ent_t *de = zfs_dnlc_slot(dc, name, len);
+		if (de->de_gen == dc->dc_gen && de->de_namelen == len &&
+		    memcmp(de->de_name, name, len) == 0) {
+			*zoidp = de->de_zoid;
+			*errorp = (de->de_zoid == 0) ? SET_ERROR(ENOENT) : 0;
+			hit = B_TRUE;
+		}
+	}
+	mutex_exit(&dc->dc_lock);
+
+	if (!hit)
+		DNLCSTAT_BUMP(dnlcstat_misses);
+	else if (*errorp != 0)
+		DNLCSTAT_BUMP(dnlcstat_negative_hits);
+	else
+		DNLCSTAT_BUMP(dnlcstat_hits);
+	return (hit);
+}
+
+/*
+ * Enter the result of a ZAP lookup of name into dzp's DNLC, zoid being 0
+ * if the name does not exist.  Nothing is entered if the directory changed
+ * since the generation gen was sampled by zfs_dnlc_lookup().
+ */
+static void
+zfs_dnlc_enter(znode_t *dzp, const char *name, uint64_t gen, uint64_t zoid)
+{
+	zfs_dnlc_t *dc = dzp->z_dnlc;
+	size_t len = strlen(name);
+
+	if (len > ZFS_DNLC_NAMELEN)
+		return;
+
+	mutex_enter(&dc->dc_lock);
+	if (dc->dc_gen == gen) {
+		zfs_dnlc_ent_t *de = zfs_dnlc_slot(dc, name, len);
+		de->de_gen = gen;
+		de->de_zoid = zoid;
+		de->de_namelen = len;
+		memcpy(de->de_name, name, len);
+		DNLCSTAT_BUMP(dnlcstat_enters);
+	}
+	mutex_exit(&dc->dc_lock);
+}
+
+/*
+ * Invalidate all of dzp's DNLC entries.  Must be called whenever the
+ * entries of the directory's ZAP may have changed.
+ */
+void
+zfs_dnlc_purge(znode_t *dzp)
+{
+	zfs_dnlc_t *dc = dzp->z_dnlc;
+
+	if (dc == NULL)
+		return;
+
+	mutex_enter(&dc->dc_lock);
+	dc->dc_gen++;
+	mutex_exit(&dc->dc_lock);
+	DNLCSTAT_BUMP(dnlcstat_purges);
+}
+
+void
+zfs_dnlc_free(znode_t *dzp)
+{
+	zfs_dnlc_t *dc = dzp->z_dnlc;
+
+	if (dc == NULL)
+		return;
+
+	dzp->z_dnlc = NULL;
+	mutex_destroy(&dc->dc_lock);
+	kmem_free(dc, sizeof (*dc));
+}
+
 /*
  * Lock a directory entry.  A dirlock on <dzp, name> protects that name
  * in dzp's directory zap object.  As long as you hold a dirlock, you can
@@ -314,6 +547,22 @@ zfs_dirent_lock(zfs_dirlock_t **dlpp, znode_t *dzp, char *name,
 		    sizeof (zoid));
 		if (error == 0)
 			error = (zoid == 0 ? SET_ERROR(ENOENT) : 0);
+	} else if (zfs_dnlc_enabled && zfsvfs->z_norm == 0) {
+		/*
+		 * Without normalization the name is matched exactly and
+		 * zfs_match_find() returns no direntflags or real name, so
+		 * a DNLC entry can stand in for the ZAP lookup.
+		 */
+		uint64_t gen;
+
+		if (!zfs_dnlc_lookup(dzp, name, &zoid, &error, &gen)) {
+			error = zfs_match_find(zfsvfs, dzp, name, mt,
+			    update, direntflags, realpnp, &zoid);
+			if (error == 0 || error == ENOENT) {
+				zfs_dnlc_enter(dzp, name, gen,
+				    error == 0 ? zoid : 0);
+			}
+		}
 	} else {
 		error = zfs_match_find(zfsvfs, dzp, name, mt,
 		    update, direntflags, realpnp, &zoid);
@@ -433,6 +682,7 @@ zfs_dirlook(znode_t *dzp, char *name, znode_t **zpp, int flags,
 			*zpp = zp;
 			zfs_dirent_unlock(dl);
 			dzp->z_zn_prefetch = B_TRUE; /* enable prefetching */
+			zfs_dir_prefetch(dzp, name);
 		}
 		rpnp = NULL;
 	}
@@ -837,6 +1087,7 @@ zfs_link_create(zfs_dirlock_t *dl, znode_t *zp, dmu_tx_t *tx, int flag)
 	value = zfs_dirent(zp, zp->z_mode);
 	error = zap_add(ZTOZSB(zp)->z_os, dzp->z_id, dl->dl_name, 8, 1,
 	    &value, tx);
+	zfs_dnlc_purge(dzp);
 
 	/*
 	 * zap_add could fail to add the entry if it exceeds the capacity of the
@@ -944,6 +1195,7 @@ zfs_dropname(zfs_dirlock_t *dl, znode_t *zp, znode_t *dzp, dmu_tx_t *tx,
 		error = zap_remove(ZTOZSB(zp)->z_os, dzp->z_id, dl->dl_name,
 		    tx);
 	}
+	zfs_dnlc_purge(dzp);
 
 	return (error);
 }
@@ -1289,3 +1541,6 @@ zfs_sticky_remove_access(znode_t *zdp, znode_t *zp, cred_t *cr)
 	else
 		return (secpolicy_vnode_remove(cr));
 }
+
+ZFS_MODULE_PARAM(zfs, zfs_, dnlc_enabled, INT, ZMOD_RW,
+	"Cache directory name lookups, including negative ones");
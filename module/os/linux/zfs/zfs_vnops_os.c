@@ -346,6 +346,14 @@ mappedread(znode_t *zp, int nbytes, zfs_uio_t *uio)
 
 static unsigned long zfs_delete_blocks = DMU_MAX_DELETEBLKCNT;
 
+/*
+ * Pages of mmap'd files are filled from, and written back through, the ARC,
+ * which then holds a second copy of every hot page.  When this is set they
+ * are read and written uncached, so the ARC drops its copy once the page
+ * cache has the data (or, for writes, once it is synced out).
+ */
+static int zfs_mmap_uncached = 0;
+
 /*
  * Write the bytes to a file.
  *
@@ -3895,7 +3903,15 @@ zfs_putpage(struct inode *ip, struct page *pp, struct writeback_control *wbc,
 
 	va = kmap(pp);
 	ASSERT3U(pglen, <=, PAGE_SIZE);
-	dmu_write(zfsvfs->z_os, zp->z_id, pgoff, pglen, va, tx);
+	if (zfs_mmap_uncached) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)sa_get_db(zp->z_sa_hdl);
+		DB_DNODE_ENTER(db);
+		VERIFY0(dmu_write_by_dnode(DB_DNODE(db), pgoff, pglen, va, tx,
+		    DMU_READ_PREFETCH | DMU_UNCACHEDIO));
+		DB_DNODE_EXIT(db);
+	} else {
+		dmu_write(zfsvfs->z_os, zp->z_id, pgoff, pglen, va, tx);
+	}
 	kunmap(pp);
 
 	SA_ADD_BULK_ATTR(bulk, cnt, SA_ZPL_MTIME(zfsvfs), NULL, &mtime, 16);
@@ -3984,6 +4000,220 @@ zfs_putpage(struct inode *ip, struct page *pp, struct writeback_control *wbc,
 	return (err);
 }
 
+/*
+ * The pages of one log record written by zfs_putpages(), whose writeback
+ * completes together.
+ */
+typedef struct zfs_putpages_run {
+	uint_t		zpr_npages;
+	struct page	*zpr_pages[];
+} zfs_putpages_run_t;
+
+static void
+zfs_putpages_commit_cb(void *arg, int err)
+{
+	zfs_putpages_run_t *zpr = arg;
+
+	for (uint_t i = 0; i < zpr->zpr_npages; i++)
+		zfs_page_writeback_done(zpr->zpr_pages[i], err);
+	kmem_free(zpr, offsetof(zfs_putpages_run_t,
+	    zpr_pages[zpr->zpr_npages]));
+}
+
+/*
+ * Push a run of pages out to disk as zfs_putpage() does, but in a single
+ * transaction, with a log record per stretch of contiguous pages rather
+ * than per page.  The pages must be in ascending order within a record,
+ * unlocked, redirtied by redirty_page_for_writepage() and referenced by the
+ * caller, which drops its references afterwards.  The array is reordered.
+ */
+int
+zfs_putpages(struct inode *ip, struct page **pages, uint_t npages,
+    struct writeback_control *wbc, boolean_t for_sync)
+{
+	znode_t		*zp = ITOZ(ip);
+	zfsvfs_t	*zfsvfs = ITOZSB(ip);
+	struct address_space *mapping = ip->i_mapping;
+	loff_t		off, len, isize;
+	dmu_tx_t	*tx;
+	caddr_t		va;
+	int		err = 0;
+	uint_t		i, j, nwrite = 0;
+	uint64_t	written = 0;
+	uint64_t	mtime[2], ctime[2];
+	inode_timespec_t tmp_ts;
+	sa_bulk_attr_t	bulk[3];
+	int		cnt = 0;
+
+	ASSERT3U(npages, >, 0);
+
+	if ((err = zfs_enter_verify_zp(zfsvfs, zp, FTAG)) != 0)
+		return (err);
+
+	off = page_offset(pages[0]);
+	len = page_offset(pages[npages - 1]) + PAGE_SIZE - off;
+	zfs_locked_range_t *lr = zfs_rangelock_enter(&zp->z_rangelock,
+	    off, len, RL_WRITER);
+	isize = i_size_read(ip);
+
+	/*
+	 * As in zfs_putpage(), recheck each page now that the range lock is
+	 * held, and start writeback on the ones that still need writing,
+	 * which are moved to the front of the array in order.
+	 */
+	for (i = 0; i < npages; i++) {
+		struct page *pp = pages[i];
+
+		lock_page(pp);
+		if (unlikely(pp->mapping != mapping || !PageDirty(pp) ||
+		    PageWriteback(pp) || !clear_page_dirty_for_io(pp))) {
+			unlock_page(pp);
+			continue;
+		}
+		wbc->pages_skipped--;
+
+		/* Truncated away while the page was unlocked */
+		if (page_offset(pp) >= isize) {
+			unlock_page(pp);
+			continue;
+		}
+
+		set_page_writeback(pp);
+		unlock_page(pp);
+		pages[i] = pages[nwrite];
+		pages[nwrite++] = pp;
+	}
+
+	if (nwrite == 0) {
+		zfs_rangelock_exit(lr);
+		goto out;
+	}
+
+	off = page_offset(pages[0]);
+	len = MIN(page_offset(pages[nwrite - 1]) + PAGE_SIZE, isize) - off;
+
+	tx = dmu_tx_create(zfsvfs->z_os);
+	dmu_tx_hold_write(tx, zp->z_id, off, len);
+	dmu_tx_hold_sa(tx, zp->z_sa_hdl, B_FALSE);
+	zfs_sa_upgrade_txholds(tx, zp);
+
+	err = dmu_tx_assign(tx, DMU_TX_WAIT);
+	if (err != 0) {
+		dmu_tx_abort(tx);
+		for (i = 0; i < nwrite; i++)
+			zfs_page_writeback_done(pages[i], err);
+		zfs_rangelock_exit(lr);
+		zfs_exit(zfsvfs, FTAG);
+
+		/*
+		 * Don't return error for an async writeback; we've re-dirtied
+		 * the pages so they will be tried again some other time.
+		 */
+		return (for_sync ? err : 0);
+	}
+
+	for (i = 0; i < nwrite; i++) {
+		loff_t pgoff = page_offset(pages[i]);
+		unsigned int pglen = MIN(PAGE_SIZE, isize - pgoff);
+
+		va = kmap(pages[i]);
+		if (zfs_mmap_uncached) {
+			dmu_buf_impl_t *db =
+			    (dmu_buf_impl_t *)sa_get_db(zp->z_sa_hdl);
+			DB_DNODE_ENTER(db);
+			VERIFY0(dmu_write_by_dnode(DB_DNODE(db), pgoff, pglen,
+			    va, tx, DMU_READ_PREFETCH | DMU_UNCACHEDIO));
+			DB_DNODE_EXIT(db);
+		} else {
+			dmu_write(zfsvfs->z_os, zp->z_id, pgoff, pglen, va,
+			    tx);
+		}
+		kunmap(pages[i]);
+	}
+
+	SA_ADD_BULK_ATTR(bulk, cnt, SA_ZPL_MTIME(zfsvfs), NULL, &mtime, 16);
+	SA_ADD_BULK_ATTR(bulk, cnt, SA_ZPL_CTIME(zfsvfs), NULL, &ctime, 16);
+	SA_ADD_BULK_ATTR(bulk, cnt, SA_ZPL_FLAGS(zfsvfs), NULL,
+	    &zp->z_pflags, 8);
+
+	/* Preserve the mtime and ctime provided by the inode */
+	tmp_ts = zpl_inode_get_mtime(ip);
+	ZFS_TIME_ENCODE(&tmp_ts, mtime);
+	tmp_ts = zpl_inode_get_ctime(ip);
+	ZFS_TIME_ENCODE(&tmp_ts, ctime);
+	zp->z_atime_dirty = B_FALSE;
+	zp->z_seq++;
+
+	err = sa_bulk_update(zp->z_sa_hdl, bulk, cnt, tx);
+
+	/*
+	 * Log each stretch of contiguous pages as one write.  See
+	 * zfs_putpage() for the meaning of for_sync and wbc->sync_mode.
+	 */
+	for (i = 0; i < nwrite; i = j) {
+		zfs_putpages_run_t *zpr = NULL;
+
+		for (j = i + 1; j < nwrite; j++) {
+			if (page_index(pages[j]) != page_index(pages[j - 1]) + 1)
+				break;
+		}
+		off = page_offset(pages[i]);
+		len = MIN(page_offset(pages[j - 1]) + PAGE_SIZE, isize) - off;
+
+		if (for_sync) {
+			zpr = kmem_alloc(offsetof(zfs_putpages_run_t,
+			    zpr_pages[j - i]), KM_SLEEP);
+			zpr->zpr_npages = j - i;
+			memcpy(zpr->zpr_pages, &pages[i],
+			    (j - i) * sizeof (struct page *));
+		}
+		zfs_log_write(zfsvfs->z_log, tx, TX_WRITE, zp, off, len,
+		    for_sync, B_FALSE, for_sync ? zfs_putpages_commit_cb : NULL,
+		    zpr);
+		written += len;
+	}
+
+	if (!for_sync) {
+		/*
+		 * Async writeback is logged and written to the DMU, so the
+		 * pages can now be unlocked.
+		 */
+		for (i = 0; i < nwrite; i++)
+			zfs_page_writeback_done(pages[i], 0);
+	}
+
+	dmu_tx_commit(tx);
+
+	zfs_rangelock_exit(lr);
+
+	if (wbc->sync_mode != WB_SYNC_NONE) {
+		err = zil_commit_flags(zfsvfs->z_log, zp->z_id, ZIL_COMMIT_NOW);
+		if (err != 0) {
+			zfs_exit(zfsvfs, FTAG);
+			return (err);
+		}
+	}
+
+	dataset_kstats_update_write_kstats(&zfsvfs->z_kstat, written);
+
+out:
+	/* Another process started write on some pages, wait if required */
+	if (wbc->sync_mode != WB_SYNC_NONE) {
+		for (i = nwrite; i < npages; i++) {
+			if (PageWriteback(pages[i]))
+#ifdef HAVE_PAGEMAP_FOLIO_WAIT_BIT
+				folio_wait_bit(page_folio(pages[i]),
+				    PG_writeback);
+#else
+				wait_on_page_bit(pages[i], PG_writeback);
+#endif
+		}
+	}
+
+	zfs_exit(zfsvfs, FTAG);
+	return (err);
+}
+
 /*
  * Update the system attributes when the inode has been dirtied.  For the
  * moment we only update the mode, atime, mtime, and ctime.
@@ -4123,8 +4353,8 @@ zfs_fillpage(struct inode *ip, struct page *pp)
 		io_len = i_size - io_off;
 
 	void *va = kmap(pp);
-	int error = dmu_read(zfsvfs->z_os, zp->z_id, io_off,
-	    io_len, va, DMU_READ_PREFETCH);
+	int error = dmu_read(zfsvfs->z_os, zp->z_id, io_off, io_len, va,
+	    DMU_READ_PREFETCH | (zfs_mmap_uncached ? DMU_UNCACHEDIO : 0));
 	if (io_len != PAGE_SIZE)
 		memset((char *)va + io_len, 0, PAGE_SIZE - io_len);
 	kunmap(pp);
@@ -4405,4 +4635,8 @@ EXPORT_SYMBOL(zfs_map);
 
 module_param(zfs_delete_blocks, ulong, 0644);
 MODULE_PARM_DESC(zfs_delete_blocks, "Delete files larger than N blocks async");
+
+module_param(zfs_mmap_uncached, int, 0644);
+MODULE_PARM_DESC(zfs_mmap_uncached,
+	"Don't keep mmap'd file pages in the ARC as well as the page cache");
 #endif
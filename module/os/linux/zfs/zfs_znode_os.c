@@ -96,10 +96,12 @@ zfs_rangelock_cb(zfs_locked_range_t *new, void *arg)
 
 	/*
 	 * If we need to grow the block size then lock the whole file range.
+	 * A file of more than one block can't change its block size.
 	 */
 	uint64_t end_size = MAX(zp->z_size, new->lr_offset + new->lr_length);
 	if (end_size > zp->z_blksz && (!ISP2(zp->z_blksz) ||
-	    zp->z_blksz < ZTOZSB(zp)->z_max_blksz)) {
+	    (zp->z_blksz < ZTOZSB(zp)->z_max_blksz &&
+	    zp->z_size <= zp->z_blksz))) {
 		new->lr_offset = 0;
 		new->lr_length = UINT64_MAX;
 	}
@@ -123,6 +125,7 @@ zfs_znode_cache_constructor(void *buf, void *arg, int kmflags)
 	zfs_rangelock_init(&zp->z_rangelock, zfs_rangelock_cb, zp);
 
 	zp->z_dirlocks = NULL;
+	zp->z_dnlc = NULL;
 	zp->z_acl_cached = NULL;
 	zp->z_xattr_cached = NULL;
 	zp->z_xattr_parent = 0;
@@ -145,6 +148,7 @@ zfs_znode_cache_destructor(void *buf, void *arg)
 	zfs_rangelock_fini(&zp->z_rangelock);
 
 	ASSERT0P(zp->z_dirlocks);
+	ASSERT0P(zp->z_dnlc);
 	ASSERT0P(zp->z_acl_cached);
 	ASSERT0P(zp->z_xattr_cached);
 }
@@ -188,11 +192,15 @@ zfs_znode_init(void)
 	znode_hold_cache = kmem_cache_create("zfs_znode_hold_cache",
 	    sizeof (znode_hold_t), 0, zfs_znode_hold_cache_constructor,
 	    zfs_znode_hold_cache_destructor, NULL, NULL, NULL, 0);
+
+	zfs_dnlc_init();
 }
 
 void
 zfs_znode_fini(void)
 {
+	zfs_dnlc_fini();
+
 	/*
 	 * Cleanup zcache
 	 */
@@ -387,6 +395,8 @@ zfs_inode_destroy(struct inode *ip)
 	}
 	mutex_exit(&zfsvfs->z_znodes_lock);
 
+	zfs_dnlc_free(zp);
+
 	if (zp->z_acl_cached) {
 		zfs_acl_free(zp->z_acl_cached);
 		zp->z_acl_cached = NULL;
@@ -423,6 +433,7 @@ zfs_inode_set_ops(zfsvfs_t *zfsvfs, struct inode *ip)
 		ip->i_op = &zpl_dir_inode_operations;
 		ip->i_fop = &zpl_dir_file_operations;
 		ITOZ(ip)->z_zn_prefetch = B_TRUE;
+		memset(&ITOZ(ip)->z_walk, 0, sizeof (zfs_dir_walk_t));
 		break;
 
 	case S_IFLNK:
@@ -541,8 +552,11 @@ zfs_znode_alloc(zfsvfs_t *zfsvfs, dmu_buf_t *db, int blksz,
 	zp->z_mapcnt = 0;
 	zp->z_id = db->db_object;
 	zp->z_blksz = blksz;
+	zp->z_wr_inplace = 0;
+	zp->z_wr_maxsz = 0;
 	zp->z_seq = 0x7A4653;
 	zp->z_sync_cnt = 0;
+	zp->z_replay_eof = 0;
 
 	zfs_znode_sa_init(zfsvfs, zp, db, obj_type, hdl);
 
@@ -1186,6 +1200,8 @@ zfs_rezget(znode_t *zp)
 
 	zh = zfs_znode_hold_enter(zfsvfs, obj_num);
 
+	zfs_dnlc_purge(zp);
+
 	mutex_enter(&zp->z_acl_lock);
 	if (zp->z_acl_cached) {
 		zfs_acl_free(zp->z_acl_cached);
@@ -211,10 +211,16 @@ void
 zio_crypt_key_destroy(zio_crypt_key_t *key)
 {
 	rw_destroy(&key->zk_salt_lock);
+	rw_destroy(&key->zk_salt_cache_lock);
 
 	/* free crypto templates */
 	crypto_destroy_ctx_template(key->zk_current_tmpl);
 	crypto_destroy_ctx_template(key->zk_hmac_tmpl);
+	for (int i = 0; i < ZIO_CRYPT_SALT_CACHE_SIZE; i++) {
+		if (key->zk_salt_cache[i].zsk_valid)
+			crypto_destroy_ctx_template(
+			    key->zk_salt_cache[i].zsk_tmpl);
+	}
 
 	/* zero out sensitive data */
 	memset(key, 0, sizeof (zio_crypt_key_t));
@@ -250,6 +256,7 @@ zio_crypt_key_init(uint64_t crypt, zio_crypt_key_t *key)
 #endif
 	memset(key, 0, sizeof (zio_crypt_key_t));
 	rw_init(&key->zk_salt_lock, NULL, RW_DEFAULT, NULL);
+	rw_init(&key->zk_salt_cache_lock, NULL, RW_DEFAULT, NULL);
 
 	/* fill keydata buffers and salt with random data */
 	ret = random_get_bytes((uint8_t *)&key->zk_guid, sizeof (uint64_t));
@@ -314,7 +321,7 @@ zio_crypt_key_change_salt(zio_crypt_key_t *key)
 {
 	int ret = 0;
 	uint8_t salt[ZIO_DATA_SALT_LEN];
-	crypto_mechanism_t mech;
+	crypto_mechanism_t mech = {0};
 	uint_t keydata_len = zio_crypt_table[key->zk_crypt].ci_keylen;
 
 	/* generate a new salt */
@@ -340,6 +347,8 @@ zio_crypt_key_change_salt(zio_crypt_key_t *key)
 
 	/* destroy the old context template and create the new one */
 	crypto_destroy_ctx_template(key->zk_current_tmpl);
+	mech.cm_type =
+	    crypto_mech2id(zio_crypt_table[key->zk_crypt].ci_mechname);
 	ret = crypto_create_ctx_template(&mech, &key->zk_current_key,
 	    &key->zk_current_tmpl);
 	if (ret != CRYPTO_SUCCESS)
@@ -569,6 +578,7 @@ zio_crypt_key_unwrap(crypto_key_t *cwkey, uint64_t crypt, uint64_t version,
 	ASSERT3U(crypt, <, ZIO_CRYPT_FUNCTIONS);
 
 	rw_init(&key->zk_salt_lock, NULL, RW_DEFAULT, NULL);
+	rw_init(&key->zk_salt_cache_lock, NULL, RW_DEFAULT, NULL);
 
 	keydata_len = zio_crypt_table[crypt].ci_keylen;
 
@@ -1905,6 +1915,86 @@ error:
 	return (ret);
 }
 
+static zio_crypt_salt_key_t *
+zio_crypt_salt_key_lookup(zio_crypt_key_t *key, const uint8_t *salt)
+{
+	ASSERT(RW_LOCK_HELD(&key->zk_salt_cache_lock));
+
+	for (int i = 0; i < ZIO_CRYPT_SALT_CACHE_SIZE; i++) {
+		zio_crypt_salt_key_t *zsk = &key->zk_salt_cache[i];
+
+		if (zsk->zsk_valid &&
+		    memcmp(zsk->zsk_salt, salt, ZIO_DATA_SALT_LEN) == 0)
+			return (zsk);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Return the encryption key derived from the master key and a salt other
+ * than the current one. Blocks written since the key was last loaded all
+ * share a handful of salts, so rather than running HKDF and expanding the
+ * AES key schedule for every block, the derived keys and their templates
+ * are kept in a small per-key cache. On success zk_salt_cache_lock is held
+ * as reader, keeping the entry in place until the caller drops it.
+ */
+static int
+zio_crypt_salt_key_hold(zio_crypt_key_t *key, uint8_t *salt,
+    zio_crypt_salt_key_t **zskp)
+{
+	int ret;
+	crypto_mechanism_t mech = {0};
+	uint_t keydata_len = zio_crypt_table[key->zk_crypt].ci_keylen;
+	uint8_t keydata[MASTER_KEY_MAX_LEN];
+	zio_crypt_salt_key_t *zsk;
+
+	rw_enter(&key->zk_salt_cache_lock, RW_READER);
+	if ((zsk = zio_crypt_salt_key_lookup(key, salt)) != NULL) {
+		*zskp = zsk;
+		return (0);
+	}
+	rw_exit(&key->zk_salt_cache_lock);
+
+	/* derive the key before taking the lock as writer */
+	ret = hkdf_sha512(key->zk_master_keydata, keydata_len, NULL, 0,
+	    salt, ZIO_DATA_SALT_LEN, keydata, keydata_len);
+	if (ret != 0)
+		return (ret);
+
+	rw_enter(&key->zk_salt_cache_lock, RW_WRITER);
+
+	/* someone else may have cached it in the meantime */
+	if ((zsk = zio_crypt_salt_key_lookup(key, salt)) == NULL) {
+		zsk = &key->zk_salt_cache[key->zk_salt_cache_next];
+		key->zk_salt_cache_next =
+		    (key->zk_salt_cache_next + 1) % ZIO_CRYPT_SALT_CACHE_SIZE;
+
+		if (zsk->zsk_valid)
+			crypto_destroy_ctx_template(zsk->zsk_tmpl);
+
+		memcpy(zsk->zsk_salt, salt, ZIO_DATA_SALT_LEN);
+		memcpy(zsk->zsk_keydata, keydata, keydata_len);
+		zsk->zsk_key.ck_data = zsk->zsk_keydata;
+		zsk->zsk_key.ck_length = CRYPTO_BYTES2BITS(keydata_len);
+
+		/* as for zk_current_tmpl, a missing template is fine */
+		mech.cm_type = crypto_mech2id(
+		    zio_crypt_table[key->zk_crypt].ci_mechname);
+		ret = crypto_create_ctx_template(&mech, &zsk->zsk_key,
+		    &zsk->zsk_tmpl);
+		if (ret != CRYPTO_SUCCESS)
+			zsk->zsk_tmpl = NULL;
+		zsk->zsk_valid = B_TRUE;
+	}
+
+	rw_downgrade(&key->zk_salt_cache_lock);
+	memset(keydata, 0, keydata_len);
+
+	*zskp = zsk;
+	return (0);
+}
+
 /*
  * Primary encryption / decryption entrypoint for zio data.
  */
@@ -1916,12 +2006,10 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 {
 	int ret;
 	boolean_t locked = B_FALSE;
-	uint64_t crypt = key->zk_crypt;
-	uint_t keydata_len = zio_crypt_table[crypt].ci_keylen;
 	uint_t enc_len, auth_len;
 	zfs_uio_t puio, cuio;
-	uint8_t enc_keydata[MASTER_KEY_MAX_LEN];
-	crypto_key_t tmp_ckey, *ckey = NULL;
+	zio_crypt_salt_key_t *zsk = NULL;
+	crypto_key_t *ckey = NULL;
 	crypto_ctx_template_t tmpl;
 	uint8_t *authbuf = NULL;
 
@@ -1930,9 +2018,9 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 
 	/*
 	 * If the needed key is the current one, just use it. Otherwise we
-	 * need to generate a temporary one from the given salt + master key.
-	 * If we are encrypting, we must return a copy of the current salt
-	 * so that it can be stored in the blkptr_t.
+	 * need one derived from the given salt + master key, which we get
+	 * from the salt cache. If we are encrypting, we must return a copy
+	 * of the current salt so that it can be stored in the blkptr_t.
 	 */
 	rw_enter(&key->zk_salt_lock, RW_READER);
 	locked = B_TRUE;
@@ -1944,16 +2032,12 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 		rw_exit(&key->zk_salt_lock);
 		locked = B_FALSE;
 
-		ret = hkdf_sha512(key->zk_master_keydata, keydata_len, NULL, 0,
-		    salt, ZIO_DATA_SALT_LEN, enc_keydata, keydata_len);
+		ret = zio_crypt_salt_key_hold(key, salt, &zsk);
 		if (ret != 0)
 			goto error;
 
-		tmp_ckey.ck_data = enc_keydata;
-		tmp_ckey.ck_length = CRYPTO_BYTES2BITS(keydata_len);
-
-		ckey = &tmp_ckey;
-		tmpl = NULL;
+		ckey = &zsk->zsk_key;
+		tmpl = zsk->zsk_tmpl;
 	}
 
 	/*
@@ -1981,6 +2065,8 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 				rw_exit(&key->zk_salt_lock);
 				locked = B_FALSE;
 			}
+			if (zsk != NULL)
+				rw_exit(&key->zk_salt_cache_lock);
 
 			return (0);
 		}
@@ -2003,11 +2089,11 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 	if (locked) {
 		rw_exit(&key->zk_salt_lock);
 	}
+	if (zsk != NULL)
+		rw_exit(&key->zk_salt_cache_lock);
 
 	if (authbuf != NULL)
 		zio_buf_free(authbuf, datalen);
-	if (ckey == &tmp_ckey)
-		memset(enc_keydata, 0, keydata_len);
 	zio_crypt_destroy_uio(&puio);
 	zio_crypt_destroy_uio(&cuio);
 
@@ -2016,10 +2102,10 @@ zio_do_crypt_data(boolean_t encrypt, zio_crypt_key_t *key,
 error:
 	if (locked)
 		rw_exit(&key->zk_salt_lock);
+	if (zsk != NULL)
+		rw_exit(&key->zk_salt_cache_lock);
 	if (authbuf != NULL)
 		zio_buf_free(authbuf, datalen);
-	if (ckey == &tmp_ckey)
-		memset(enc_keydata, 0, keydata_len);
 	zio_crypt_destroy_uio(&puio);
 	zio_crypt_destroy_uio(&cuio);
 
@@ -49,6 +49,13 @@
  */
 static unsigned int zfs_fallocate_reserve_percent = 110;
 
+/*
+ * When an application declares a random access pattern for a file with
+ * POSIX_FADV_RANDOM, prefetch the indirect blocks of the advised range in
+ * the background, so later reads only need to read the data block itself.
+ */
+static int zfs_fadvise_random_prefetch = 1;
+
 static int
 zpl_open(struct inode *ip, struct file *filp)
 {
@@ -207,6 +214,24 @@ zpl_file_accessed(struct file *filp)
 	}
 }
 
+static void
+zpl_aio_read_done(void *arg, int error, ssize_t nread)
+{
+	struct kiocb *kiocb = arg;
+	long ret = nread;
+
+	if (error != 0)
+		ret = -error;
+	else
+		kiocb->ki_pos += nread;
+
+#if defined(HAVE_KI_COMPLETE_2ARGS)
+	kiocb->ki_complete(kiocb, ret);
+#else
+	kiocb->ki_complete(kiocb, ret, 0);
+#endif
+}
+
 static ssize_t
 zpl_iter_read(struct kiocb *kiocb, struct iov_iter *to)
 {
@@ -221,6 +246,24 @@ zpl_iter_read(struct kiocb *kiocb, struct iov_iter *to)
 	crhold(cr);
 	cookie = spl_fstrans_mark();
 
+	/*
+	 * Asynchronous Direct I/O reads complete from the zio done callback,
+	 * which may drop the kiocb's reference on filp before we return.
+	 */
+	if (!is_sync_kiocb(kiocb)) {
+		get_file(filp);
+		if (zfs_read_async(ITOZ(filp->f_mapping->host), &uio,
+		    filp->f_flags | zfs_io_flags(kiocb), zpl_aio_read_done,
+		    kiocb)) {
+			spl_fstrans_unmark(cookie);
+			crfree(cr);
+			zpl_file_accessed(filp);
+			fput(filp);
+			return (-EIOCBQUEUED);
+		}
+		fput(filp);
+	}
+
 	ssize_t ret = -zfs_read(ITOZ(filp->f_mapping->host), &uio,
 	    filp->f_flags | zfs_io_flags(kiocb), cr);
 
@@ -461,6 +504,7 @@ zpl_readahead(struct readahead_control *ractl)
 }
 #endif
 
+#ifdef HAVE_VFS_WRITEPAGE
 static int
 zpl_putpage(struct page *pp, struct writeback_control *wbc, void *data)
 {
@@ -477,12 +521,85 @@ zpl_putpage(struct page *pp, struct writeback_control *wbc, void *data)
 
 	return (ret);
 }
+#endif
+
+/*
+ * Dirty pages found by write_cache_pages() are gathered into runs of
+ * contiguous pages, up to a record in size and not crossing a record
+ * boundary, and each run is pushed out by zfs_putpages() in one
+ * transaction and log record rather than a page at a time.
+ */
+typedef struct zpl_writepages_batch {
+	boolean_t	zwb_for_sync;
+	uint_t		zwb_max;	/* pages per record */
+	uint_t		zwb_npages;
+	struct page	**zwb_pages;
+} zpl_writepages_batch_t;
+
+static int
+zpl_writepages_flush(struct inode *ip, struct writeback_control *wbc,
+    zpl_writepages_batch_t *zwb)
+{
+	fstrans_cookie_t cookie;
+	int ret;
+
+	cookie = spl_fstrans_mark();
+	ret = zfs_putpages(ip, zwb->zwb_pages, zwb->zwb_npages, wbc,
+	    zwb->zwb_for_sync);
+	spl_fstrans_unmark(cookie);
+
+	for (uint_t i = 0; i < zwb->zwb_npages; i++)
+		put_page(zwb->zwb_pages[i]);
+	zwb->zwb_npages = 0;
+
+	return (ret);
+}
+
+static int
+zpl_putpage_batched(struct page *pp, struct writeback_control *wbc,
+    void *data)
+{
+	zpl_writepages_batch_t *zwb = data;
+	struct inode *ip = pp->mapping->host;
+	int ret = 0;
+
+	ASSERT(PageLocked(pp));
+	ASSERT(!PageWriteback(pp));
+
+	/* Page is beyond end of file */
+	if (page_offset(pp) >= i_size_read(ip)) {
+		unlock_page(pp);
+		return (0);
+	}
+
+	/*
+	 * The page must be unlocked before zfs_putpages() takes the range
+	 * lock, so let it go as zfs_putpage() would; zfs_putpages() will
+	 * recheck its state under the range lock.
+	 */
+	get_page(pp);
+	redirty_page_for_writepage(wbc, pp);
+	unlock_page(pp);
+
+	if (zwb->zwb_npages != 0) {
+		struct page *last = zwb->zwb_pages[zwb->zwb_npages - 1];
+
+		if (zwb->zwb_npages == zwb->zwb_max ||
+		    page_index(pp) != page_index(last) + 1 ||
+		    page_index(pp) % zwb->zwb_max == 0)
+			ret = zpl_writepages_flush(ip, wbc, zwb);
+	}
+	zwb->zwb_pages[zwb->zwb_npages++] = pp;
+
+	return (ret);
+}
 
 #ifdef HAVE_WRITEPAGE_T_FOLIO
 static int
-zpl_putfolio(struct folio *pp, struct writeback_control *wbc, void *data)
+zpl_putfolio_batched(struct folio *pp, struct writeback_control *wbc,
+    void *data)
 {
-	return (zpl_putpage(&pp->page, wbc, data));
+	return (zpl_putpage_batched(&pp->page, wbc, data));
 }
 #endif
 
@@ -490,13 +607,30 @@ static inline int
 zpl_write_cache_pages(struct address_space *mapping,
     struct writeback_control *wbc, void *data)
 {
-	int result;
+	zpl_writepages_batch_t zwb;
+	fstrans_cookie_t cookie;
+	int result, err;
+
+	zwb.zwb_for_sync = *(boolean_t *)data;
+	zwb.zwb_max = MAX(ITOZSB(mapping->host)->z_max_blksz >> PAGE_SHIFT, 1);
+	zwb.zwb_npages = 0;
+	cookie = spl_fstrans_mark();
+	zwb.zwb_pages = kmem_alloc(zwb.zwb_max * sizeof (struct page *),
+	    KM_SLEEP);
+	spl_fstrans_unmark(cookie);
 
 #ifdef HAVE_WRITEPAGE_T_FOLIO
-	result = write_cache_pages(mapping, wbc, zpl_putfolio, data);
+	result = write_cache_pages(mapping, wbc, zpl_putfolio_batched, &zwb);
 #else
-	result = write_cache_pages(mapping, wbc, zpl_putpage, data);
+	result = write_cache_pages(mapping, wbc, zpl_putpage_batched, &zwb);
 #endif
+	if (zwb.zwb_npages != 0) {
+		err = zpl_writepages_flush(mapping->host, wbc, &zwb);
+		if (result == 0)
+			result = err;
+	}
+
+	kmem_free(zwb.zwb_pages, zwb.zwb_max * sizeof (struct page *));
 	return (result);
 }
 
@@ -721,8 +855,22 @@ zpl_fadvise(struct file *filp, loff_t offset, loff_t len, int advice)
 		dmu_prefetch(os, zp->z_id, 0, offset, len,
 		    ZIO_PRIORITY_ASYNC_READ);
 		break;
-	case POSIX_FADV_NORMAL:
 	case POSIX_FADV_RANDOM:
+		/*
+		 * Prefetch the level 1 indirect blocks of the range.  As
+		 * above, dmu_prefetch_max bounds how many of them are read,
+		 * with only higher level blocks prefetched beyond that.
+		 */
+		if (!zfs_fadvise_random_prefetch)
+			break;
+		if (len == 0)
+			len = i_size_read(ip) - offset;
+		if (len > 0) {
+			dmu_prefetch(os, zp->z_id, 1, offset, len,
+			    ZIO_PRIORITY_ASYNC_READ);
+		}
+		break;
+	case POSIX_FADV_NORMAL:
 	case POSIX_FADV_DONTNEED:
 	case POSIX_FADV_NOREUSE:
 		/* ignored for now */
@@ -1138,3 +1286,7 @@ const struct file_operations zpl_dir_file_operations = {
 module_param(zfs_fallocate_reserve_percent, uint, 0644);
 MODULE_PARM_DESC(zfs_fallocate_reserve_percent,
 	"Percentage of length to use for the available capacity check");
+
+module_param(zfs_fadvise_random_prefetch, int, 0644);
+MODULE_PARM_DESC(zfs_fadvise_random_prefetch,
+	"Prefetch indirect blocks of files advised POSIX_FADV_RANDOM");
@@ -73,6 +73,34 @@ static boolean_t zvol_use_blk_mq = B_FALSE;
  */
 static unsigned int zvol_blk_mq_blocks_per_thread = 8;
 
+/*
+ * Use Direct I/O for requests made up of whole, page aligned segments, so
+ * the data moves between the request's pages and the disks without being
+ * copied through dbufs.  See zvol_dio_setup().
+ */
+static unsigned int zvol_direct = 0;
+
+/*
+ * Largest run of adjacent queued writes, in bytes, that will be issued
+ * together under one range lock, one transaction and one log record.  See
+ * zvol_coalesce().  0 disables write coalescing.
+ */
+static unsigned int zvol_write_coalesce_max = 1024 * 1024;
+
+/*
+ * Complete discards as soon as they have been logged, and leave the freeing
+ * of the discarded range to zvol_discard_taskq.  See zvol_discard_batch().
+ */
+static unsigned int zvol_discard_async = 0;
+
+/* Most requests that are coalesced into a single batch */
+#define	ZVOL_COALESCE_REQS	64
+
+typedef void zvol_batch_func_t(zvol_state_t *, zv_request_t *, int,
+    uint64_t, uint64_t);
+
+static taskq_t *zvol_discard_taskq;
+
 #ifndef	BLKDEV_DEFAULT_RQ
 /* BLKDEV_MAX_RQ was renamed to BLKDEV_DEFAULT_RQ in the 5.16 kernel */
 #define	BLKDEV_DEFAULT_RQ BLKDEV_MAX_RQ
@@ -93,6 +121,32 @@ zvol_end_io(struct bio *bio, struct request *rq, int error)
 	}
 }
 
+/*
+ * Finalize a BIO or request which made it to one of the zvol I/O paths, and
+ * account for it in the zvol's latency and size histograms.
+ */
+static void
+zvol_request_done(zv_request_t *zvr, int error)
+{
+	struct bio *bio = zvr->bio;
+	struct request *rq = zvr->rq;
+	uint64_t size = io_size(bio, rq);
+	dataset_io_type_t type;
+
+	if (io_is_discard(bio, rq) || io_is_secure_erase(bio, rq))
+		type = DATASET_IO_DISCARD;
+	else if (io_data_dir(bio, rq) != WRITE)
+		type = DATASET_IO_READ;
+	else if (size == 0)
+		type = DATASET_IO_FLUSH;
+	else
+		type = DATASET_IO_WRITE;
+
+	dataset_kstats_update_io_histo(&zvr->zv->zv_kstat, type, size,
+	    gethrtime() - zvr->start);
+	zvol_end_io(bio, rq, error);
+}
+
 static unsigned int zvol_blk_mq_queue_depth = BLKDEV_DEFAULT_RQ;
 static unsigned int zvol_actual_blk_mq_queue_depth;
 
@@ -105,6 +159,15 @@ struct zvol_state_os {
 
 	/* Set from the global 'zvol_use_blk_mq' at zvol load */
 	boolean_t use_blk_mq;
+
+	/* Queued writes and discards that may still be coalesced */
+	kmutex_t		zvo_wq_lock;
+	avl_tree_t		zvo_wq;
+	avl_tree_t		zvo_dq;
+
+	/* Frees still running on zvol_discard_taskq */
+	uint_t			zvo_discards;
+	kcondvar_t		zvo_discard_cv;
 };
 
 static struct ida zvol_ida;
@@ -188,6 +251,87 @@ zvol_os_is_zvol(const char *path)
 	return (B_FALSE);
 }
 
+static boolean_t
+zvol_dio_bio_pages(struct bio *bio, struct page **pages, long *np)
+{
+	struct bio_vec bv;
+	bvec_iterator_t iter;
+
+	bio_for_each_segment(bv, bio, iter) {
+		if (bv.bv_offset != 0 || bv.bv_len != PAGESIZE)
+			return (B_FALSE);
+		if (pages != NULL)
+			pages[*np] = bv.bv_page;
+		(*np)++;
+	}
+
+	return (B_TRUE);
+}
+
+static boolean_t
+zvol_dio_pages(struct bio *bio, struct request *rq, struct page **pages,
+    long *np)
+{
+	struct bio *b;
+
+	*np = 0;
+	if (bio != NULL)
+		return (zvol_dio_bio_pages(bio, pages, np));
+
+	__rq_for_each_bio(b, rq) {
+		if (!zvol_dio_bio_pages(b, pages, np))
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Hand the pages of a bio or request to the uio for Direct I/O.  The DMU
+ * then wraps them in a scatter ABD (abd_alloc_from_pages()) and reads or
+ * writes whole blocks straight from them, falling back to the buffered path
+ * for the partial blocks at either end.  abd_alloc_from_pages() expects a
+ * run of pages at the same page offset as the I/O, so this is only done
+ * when every segment is a whole, page aligned page.  The page references
+ * belong to the bio; only the array is released, by zvol_dio_free().
+ */
+static boolean_t
+zvol_dio_setup(zfs_uio_t *uio, struct bio *bio, struct request *rq)
+{
+	struct page **pages;
+	long npages;
+
+	if (!zvol_direct || !IS_P2ALIGNED(uio->uio_loffset, PAGESIZE) ||
+	    !IS_P2ALIGNED(uio->uio_resid, PAGESIZE) || uio->uio_skip != 0)
+		return (B_FALSE);
+
+	if (!zvol_dio_pages(bio, rq, NULL, &npages) ||
+	    npages != uio->uio_resid >> PAGESHIFT)
+		return (B_FALSE);
+
+	pages = vmem_alloc(npages * sizeof (struct page *), KM_SLEEP);
+	VERIFY(zvol_dio_pages(bio, rq, pages, &npages));
+
+	uio->uio_dio.pages = pages;
+	uio->uio_dio.npages = npages;
+	uio->uio_dio.pinned = B_FALSE;
+	uio->uio_extflg |= UIO_DIRECT;
+
+	return (B_TRUE);
+}
+
+static void
+zvol_dio_free(zfs_uio_t *uio)
+{
+	if (!(uio->uio_extflg & UIO_DIRECT))
+		return;
+
+	vmem_free(uio->uio_dio.pages,
+	    uio->uio_dio.npages * sizeof (struct page *));
+	memset(&uio->uio_dio, 0, sizeof (zfs_uio_dio_t));
+	uio->uio_extflg &= ~UIO_DIRECT;
+}
+
 static void
 zvol_write(zv_request_t *zvr)
 {
@@ -213,7 +357,7 @@ zvol_write(zv_request_t *zvr)
 		error = zil_commit(zv->zv_zilog, ZVOL_OBJ);
 		if (error != 0) {
 			rw_exit(&zv->zv_suspend_lock);
-			zvol_end_io(bio, rq, -error);
+			zvol_request_done(zvr, -error);
 			return;
 		}
 	}
@@ -221,13 +365,17 @@ zvol_write(zv_request_t *zvr)
 	/* Some requests are just for flush and nothing else. */
 	if (io_size(bio, rq) == 0) {
 		rw_exit(&zv->zv_suspend_lock);
-		zvol_end_io(bio, rq, 0);
+		zvol_request_done(zvr, 0);
 		return;
 	}
 
 	zfs_uio_bvec_init(&uio, bio, rq);
 
 	ssize_t start_resid = uio.uio_resid;
+	dmu_flags_t dflags = DMU_READ_PREFETCH;
+	boolean_t o_direct = zvol_dio_setup(&uio, bio, rq);
+	if (o_direct)
+		dflags |= DMU_DIRECTIO;
 
 	/*
 	 * With use_blk_mq, accounting is done by blk_mq_start_request()
@@ -265,9 +413,9 @@ zvol_write(zv_request_t *zvr)
 			break;
 		}
 		error = dmu_write_uio_dnode(zv->zv_dn, &uio, bytes, tx,
-		    DMU_READ_PREFETCH);
+		    dflags);
 		if (error == 0) {
-			zvol_log_write(zv, tx, off, bytes, sync);
+			zvol_log_write(zv, tx, off, bytes, o_direct, sync);
 		}
 		dmu_tx_commit(tx);
 
@@ -275,6 +423,7 @@ zvol_write(zv_request_t *zvr)
 			break;
 	}
 	zfs_rangelock_exit(lr);
+	zvol_dio_free(&uio);
 
 	int64_t nwritten = start_resid - uio.uio_resid;
 	dataset_kstats_update_write_kstats(&zv->zv_kstat, nwritten);
@@ -289,7 +438,7 @@ zvol_write(zv_request_t *zvr)
 		blk_generic_end_io_acct(q, disk, WRITE, bio, start_time);
 	}
 
-	zvol_end_io(bio, rq, error);
+	zvol_request_done(zvr, error);
 }
 
 static void
@@ -300,36 +449,306 @@ zvol_write_task(void *arg)
 	zv_request_task_free(task);
 }
 
+static int
+zvol_wq_compare(const void *arg1, const void *arg2)
+{
+	const zv_request_task_t *t1 = arg1;
+	const zv_request_task_t *t2 = arg2;
+
+	int cmp = TREE_CMP(t1->wq_offset, t2->wq_offset);
+	if (likely(cmp))
+		return (cmp);
+
+	return (TREE_PCMP(t1, t2));
+}
+
+/*
+ * Create a task for a request and queue it on zvo_wq or zvo_dq, where it
+ * may be claimed by zvol_coalesce() before its own callback runs.
+ */
+static zv_request_task_t *
+zvol_wq_add(zv_request_t zvr, avl_tree_t *wq, uint64_t offset, uint64_t size)
+{
+	struct zvol_state_os *zso = zvr.zv->zv_zso;
+	zv_request_task_t *task = zv_request_task_create(zvr);
+
+	task->wq_offset = offset;
+	task->wq_size = size;
+	task->wq_queued = B_TRUE;
+	mutex_enter(&zso->zvo_wq_lock);
+	avl_add(wq, task);
+	mutex_exit(&zso->zvo_wq_lock);
+
+	return (task);
+}
+
+/*
+ * Find a queued request which begins at 'end', or failing that one which ends
+ * at 'start', of the batch [start, end).  Overlapping requests are left alone.
+ */
+static zv_request_task_t *
+zvol_wq_find_adjacent(avl_tree_t *wq, uint64_t start, uint64_t end)
+{
+	zv_request_task_t search, *t;
+	avl_index_t where;
+
+	/* Any write at 'end' sorts immediately next to the search key. */
+	search.wq_offset = end;
+	VERIFY0P(avl_find(wq, &search, &where));
+	t = avl_nearest(wq, where, AVL_AFTER);
+	if (t != NULL && t->wq_offset == end)
+		return (t);
+	t = avl_nearest(wq, where, AVL_BEFORE);
+	if (t != NULL && t->wq_offset == end)
+		return (t);
+
+	search.wq_offset = start;
+	VERIFY0P(avl_find(wq, &search, &where));
+	t = avl_nearest(wq, where, AVL_BEFORE);
+	while (t != NULL && t->wq_offset >= start)
+		t = AVL_PREV(wq, t);
+	if (t != NULL && t->wq_offset + t->wq_size == start)
+		return (t);
+
+	return (NULL);
+}
+
+/*
+ * Write a batch of adjacent requests, which together cover [start, end),
+ * under one range lock, in one transaction and with one log record, then
+ * complete each of them.  Batches never include flushes, and are bounded by
+ * zvol_write_coalesce_max so they always fit in a single transaction.  They
+ * are made up of small writes, so Direct I/O is not attempted.
+ */
 static void
-zvol_discard(zv_request_t *zvr)
+zvol_write_batch(zvol_state_t *zv, zv_request_t *zvrs, int n,
+    uint64_t start, uint64_t end)
 {
-	struct bio *bio = zvr->bio;
-	struct request *rq = zvr->rq;
-	zvol_state_t *zv = zvr->zv;
-	uint64_t start = io_offset(bio, rq);
-	uint64_t size = io_size(bio, rq);
-	uint64_t end = start + size;
-	boolean_t sync;
-	int error = 0;
-	dmu_tx_t *tx;
 	struct request_queue *q = zv->zv_zso->zvo_queue;
 	struct gendisk *disk = zv->zv_zso->zvo_disk;
 	unsigned long start_time = 0;
-	boolean_t acct = B_FALSE;
+	boolean_t acct = blk_queue_io_stat(q);
+	boolean_t sync = zv->zv_objset->os_sync == ZFS_SYNC_ALWAYS;
+	int64_t nwritten = 0;
+	int error = 0;
 
-	ASSERT3P(zv, !=, NULL);
 	ASSERT3U(zv->zv_open_count, >, 0);
 	ASSERT3P(zv->zv_zilog, !=, NULL);
 
-	if (bio) {
-		acct = blk_queue_io_stat(q);
-		if (acct) {
+	for (int i = 0; i < n; i++) {
+		if (io_is_fua(zvrs[i].bio, zvrs[i].rq))
+			sync = B_TRUE;
+		if (zvrs[i].bio != NULL && acct) {
 			start_time = blk_generic_start_io_acct(q, disk, WRITE,
-			    bio);
+			    zvrs[i].bio);
+		}
+	}
+
+	zfs_locked_range_t *lr = zfs_rangelock_enter(&zv->zv_rangelock,
+	    start, end - start, RL_WRITER);
+
+	if (end > zv->zv_volsize)
+		error = SET_ERROR(EIO);
+
+	dmu_tx_t *tx = dmu_tx_create(zv->zv_objset);
+	dmu_tx_hold_write_by_dnode(tx, zv->zv_dn, start, end - start);
+	if (error == 0)
+		error = dmu_tx_assign(tx, DMU_TX_WAIT);
+	if (error != 0) {
+		dmu_tx_abort(tx);
+	} else {
+		for (int i = 0; i < n && error == 0; i++) {
+			zfs_uio_t uio;
+
+			zfs_uio_bvec_init(&uio, zvrs[i].bio, zvrs[i].rq);
+			ssize_t start_resid = uio.uio_resid;
+			error = dmu_write_uio_dnode(zv->zv_dn, &uio,
+			    uio.uio_resid, tx, DMU_READ_PREFETCH);
+			nwritten += start_resid - uio.uio_resid;
 		}
+		if (error == 0) {
+			zvol_log_write(zv, tx, start, end - start, B_FALSE,
+			    sync);
+		}
+		dmu_tx_commit(tx);
 	}
+	zfs_rangelock_exit(lr);
 
-	sync = io_is_fua(bio, rq) || zv->zv_objset->os_sync == ZFS_SYNC_ALWAYS;
+	dataset_kstats_update_write_kstats(&zv->zv_kstat, nwritten);
+	task_io_account_write(nwritten);
+
+	if (error == 0 && sync)
+		error = zil_commit(zv->zv_zilog, ZVOL_OBJ);
+
+	for (int i = 0; i < n; i++) {
+		rw_exit(&zv->zv_suspend_lock);
+		if (zvrs[i].bio != NULL && acct) {
+			blk_generic_end_io_acct(q, disk, WRITE, zvrs[i].bio,
+			    start_time);
+		}
+		zvol_request_done(&zvrs[i], error);
+	}
+}
+
+/*
+ * Common taskq callback for the writes and discards which
+ * zvol_request_impl() also queued on zvo_wq or zvo_dq.  If another thread
+ * has already claimed the request as part of its own batch there is nothing
+ * left to do but free the task.  Otherwise pull any queued requests adjacent
+ * to this one, up to 'max' bytes in all, off the queue and issue them
+ * together.  When an initiator sends small sequential requests faster than
+ * they are processed, this turns a backlog of requests into a few larger
+ * transactions and log records rather than one of each per request.
+ */
+static void
+zvol_coalesce(zv_request_task_t *task, avl_tree_t *wq, uint64_t max,
+    void (*single)(zv_request_t *), zvol_batch_func_t *batch)
+{
+	zvol_state_t *zv = task->zvr.zv;
+	struct zvol_state_os *zso = zv->zv_zso;
+	zv_request_task_t *t;
+	zv_request_t *zvrs = NULL;
+	int n = 1;
+
+	mutex_enter(&zso->zvo_wq_lock);
+	if (!task->wq_queued) {
+		mutex_exit(&zso->zvo_wq_lock);
+		zv_request_task_free(task);
+		return;
+	}
+	avl_remove(wq, task);
+	task->wq_queued = B_FALSE;
+
+	/*
+	 * The claimed requests are copied out, since each claimed task is
+	 * still freed by its own callback, which may run at any time once
+	 * it has been taken off the queue.
+	 */
+	uint64_t start = task->wq_offset;
+	uint64_t end = start + task->wq_size;
+	while (n < ZVOL_COALESCE_REQS &&
+	    (t = zvol_wq_find_adjacent(wq, start, end)) != NULL &&
+	    end - start + t->wq_size <= max) {
+		if (zvrs == NULL) {
+			zvrs = kmem_alloc(ZVOL_COALESCE_REQS *
+			    sizeof (zv_request_t), KM_NOSLEEP);
+			if (zvrs == NULL)
+				break;
+			zvrs[0] = task->zvr;
+		}
+		avl_remove(wq, t);
+		t->wq_queued = B_FALSE;
+		zvrs[n++] = t->zvr;
+		start = MIN(start, t->wq_offset);
+		end = MAX(end, t->wq_offset + t->wq_size);
+	}
+	mutex_exit(&zso->zvo_wq_lock);
+
+	if (n == 1)
+		single(&task->zvr);
+	else
+		batch(zv, zvrs, n, start, end);
+
+	if (zvrs != NULL)
+		kmem_free(zvrs, ZVOL_COALESCE_REQS * sizeof (zv_request_t));
+	zv_request_task_free(task);
+}
+
+static void
+zvol_write_coalesce_task(void *arg)
+{
+	zv_request_task_t *task = arg;
+
+	zvol_coalesce(task, &task->zvr.zv->zv_zso->zvo_wq,
+	    zvol_write_coalesce_max, zvol_write, zvol_write_batch);
+}
+
+/*
+ * A free left running on zvol_discard_taskq by zvol_discard_batch(), once
+ * the discarded range has been logged and the requests acknowledged.  It
+ * holds the range lock, and the requests' holds on zv_suspend_lock, until
+ * the free is done.
+ */
+typedef struct zvol_discard_job {
+	zvol_state_t		*zdj_zv;
+	zfs_locked_range_t	*zdj_lr;
+	uint64_t		zdj_start;
+	uint64_t		zdj_size;
+	int			zdj_holds;
+} zvol_discard_job_t;
+
+static void
+zvol_discard_free_task(void *arg)
+{
+	zvol_discard_job_t *zdj = arg;
+	zvol_state_t *zv = zdj->zdj_zv;
+	struct zvol_state_os *zso = zv->zv_zso;
+
+	(void) dmu_free_long_range(zv->zv_objset, ZVOL_OBJ, zdj->zdj_start,
+	    zdj->zdj_size);
+	zfs_rangelock_exit(zdj->zdj_lr);
+	for (int i = 0; i < zdj->zdj_holds; i++)
+		rw_exit(&zv->zv_suspend_lock);
+
+	mutex_enter(&zso->zvo_wq_lock);
+	if (--zso->zvo_discards == 0)
+		cv_broadcast(&zso->zvo_discard_cv);
+	mutex_exit(&zso->zvo_wq_lock);
+
+	kmem_free(zdj, sizeof (*zdj));
+}
+
+/*
+ * Wait for the background frees of a zvol to finish, before it is closed.
+ */
+static void
+zvol_discard_wait(zvol_state_t *zv)
+{
+	struct zvol_state_os *zso = zv->zv_zso;
+
+	mutex_enter(&zso->zvo_wq_lock);
+	while (zso->zvo_discards > 0)
+		cv_wait(&zso->zvo_discard_cv, &zso->zvo_wq_lock);
+	mutex_exit(&zso->zvo_wq_lock);
+}
+
+/*
+ * Discard a batch of adjacent requests, which together cover [start, end),
+ * with one log record and one free.  Secure erase requests are only ever
+ * discarded on their own.  With zvol_discard_async the requests are
+ * completed as soon as the discard has been logged, and the free itself is
+ * left to zvol_discard_taskq.
+ */
+static void
+zvol_discard_batch(zvol_state_t *zv, zv_request_t *zvrs, int n,
+    uint64_t start, uint64_t end)
+{
+	struct zvol_state_os *zso = zv->zv_zso;
+	struct request_queue *q = zso->zvo_queue;
+	struct gendisk *disk = zso->zvo_disk;
+	boolean_t secure = io_is_secure_erase(zvrs[0].bio, zvrs[0].rq);
+	boolean_t sync = zv->zv_objset->os_sync == ZFS_SYNC_ALWAYS;
+	boolean_t acct = blk_queue_io_stat(q);
+	unsigned long start_time = 0;
+	zvol_discard_job_t *zdj = NULL;
+	zfs_locked_range_t *lr;
+	uint64_t size;
+	int error = 0;
+	dmu_tx_t *tx;
+
+	ASSERT3P(zv, !=, NULL);
+	ASSERT3U(zv->zv_open_count, >, 0);
+	ASSERT3P(zv->zv_zilog, !=, NULL);
+	ASSERT(n == 1 || !secure);
+
+	for (int i = 0; i < n; i++) {
+		if (io_is_fua(zvrs[i].bio, zvrs[i].rq))
+			sync = B_TRUE;
+		if (zvrs[i].bio != NULL && acct) {
+			start_time = blk_generic_start_io_acct(q, disk, WRITE,
+			    zvrs[i].bio);
+		}
+	}
 
 	if (end > zv->zv_volsize) {
 		error = SET_ERROR(EIO);
@@ -342,17 +761,16 @@ zvol_discard(zv_request_t *zvr)
 	 * the unaligned parts which is slow (read-modify-write) and useless
 	 * since we are not freeing any space by doing so.
 	 */
-	if (!io_is_secure_erase(bio, rq)) {
+	if (!secure) {
 		start = P2ROUNDUP(start, zv->zv_volblocksize);
 		end = P2ALIGN_TYPED(end, zv->zv_volblocksize, uint64_t);
-		size = end - start;
 	}
 
 	if (start >= end)
 		goto unlock;
+	size = end - start;
 
-	zfs_locked_range_t *lr = zfs_rangelock_enter(&zv->zv_rangelock,
-	    start, size, RL_WRITER);
+	lr = zfs_rangelock_enter(&zv->zv_rangelock, start, size, RL_WRITER);
 
 	tx = dmu_tx_create(zv->zv_objset);
 	dmu_tx_mark_netfree(tx);
@@ -362,23 +780,53 @@ zvol_discard(zv_request_t *zvr)
 	} else {
 		zvol_log_truncate(zv, tx, start, size);
 		dmu_tx_commit(tx);
-		error = dmu_free_long_range(zv->zv_objset,
-		    ZVOL_OBJ, start, size);
+		if (zvol_discard_async && !secure) {
+			zdj = kmem_alloc(sizeof (*zdj), KM_SLEEP);
+			zdj->zdj_zv = zv;
+			zdj->zdj_lr = lr;
+			zdj->zdj_start = start;
+			zdj->zdj_size = size;
+			zdj->zdj_holds = n;
+		} else {
+			error = dmu_free_long_range(zv->zv_objset,
+			    ZVOL_OBJ, start, size);
+		}
 	}
-	zfs_rangelock_exit(lr);
+	if (zdj == NULL)
+		zfs_rangelock_exit(lr);
 
 	if (error == 0 && sync)
 		error = zil_commit(zv->zv_zilog, ZVOL_OBJ);
 
-unlock:
-	rw_exit(&zv->zv_suspend_lock);
+	if (zdj != NULL) {
+		mutex_enter(&zso->zvo_wq_lock);
+		zso->zvo_discards++;
+		mutex_exit(&zso->zvo_wq_lock);
+	}
 
-	if (bio && acct) {
-		blk_generic_end_io_acct(q, disk, WRITE, bio,
-		    start_time);
+unlock:
+	for (int i = 0; i < n; i++) {
+		if (zdj == NULL)
+			rw_exit(&zv->zv_suspend_lock);
+		if (zvrs[i].bio != NULL && acct) {
+			blk_generic_end_io_acct(q, disk, WRITE, zvrs[i].bio,
+			    start_time);
+		}
+		zvol_request_done(&zvrs[i], error);
 	}
 
-	zvol_end_io(bio, rq, error);
+	if (zdj != NULL && taskq_dispatch(zvol_discard_taskq,
+	    zvol_discard_free_task, zdj, TQ_SLEEP) == TASKQID_INVALID)
+		zvol_discard_free_task(zdj);
+}
+
+static void
+zvol_discard(zv_request_t *zvr)
+{
+	uint64_t start = io_offset(zvr->bio, zvr->rq);
+
+	zvol_discard_batch(zvr->zv, zvr, 1, start,
+	    start + io_size(zvr->bio, zvr->rq));
 }
 
 static void
@@ -389,6 +837,15 @@ zvol_discard_task(void *arg)
 	zv_request_task_free(task);
 }
 
+static void
+zvol_discard_coalesce_task(void *arg)
+{
+	zv_request_task_t *task = arg;
+
+	zvol_coalesce(task, &task->zvr.zv->zv_zso->zvo_dq, UINT64_MAX,
+	    zvol_discard, zvol_discard_batch);
+}
+
 static void
 zvol_read(zv_request_t *zvr)
 {
@@ -411,6 +868,9 @@ zvol_read(zv_request_t *zvr)
 	disk = zv->zv_zso->zvo_disk;
 
 	ssize_t start_resid = uio.uio_resid;
+	dmu_flags_t dflags = DMU_READ_PREFETCH;
+	if (zvol_dio_setup(&uio, bio, rq))
+		dflags |= DMU_DIRECTIO;
 
 	/*
 	 * When blk-mq is being used, accounting is done by
@@ -435,8 +895,7 @@ zvol_read(zv_request_t *zvr)
 		if (bytes > volsize - uio.uio_loffset)
 			bytes = volsize - uio.uio_loffset;
 
-		error = dmu_read_uio_dnode(zv->zv_dn, &uio, bytes,
-		    DMU_READ_PREFETCH);
+		error = dmu_read_uio_dnode(zv->zv_dn, &uio, bytes, dflags);
 		if (error) {
 			/* convert checksum errors into IO errors */
 			if (error == ECKSUM)
@@ -445,6 +904,7 @@ zvol_read(zv_request_t *zvr)
 		}
 	}
 	zfs_rangelock_exit(lr);
+	zvol_dio_free(&uio);
 
 	int64_t nread = start_resid - uio.uio_resid;
 	dataset_kstats_update_read_kstats(&zv->zv_kstat, nread);
@@ -456,7 +916,7 @@ zvol_read(zv_request_t *zvr)
 		blk_generic_end_io_acct(q, disk, READ, bio, start_time);
 	}
 
-	zvol_end_io(bio, rq, error);
+	zvol_request_done(zvr, error);
 }
 
 static void
@@ -498,6 +958,7 @@ zvol_request_impl(zvol_state_t *zv, struct bio *bio, struct request *rq,
 		.zv = zv,
 		.bio = bio,
 		.rq = rq,
+		.start = gethrtime(),
 	};
 
 	if (io_has_data(bio, rq) && offset + size > zv->zv_volsize) {
@@ -592,19 +1053,30 @@ zvol_request_impl(zvol_state_t *zv, struct bio *bio, struct request *rq,
 		if (io_is_discard(bio, rq) || io_is_secure_erase(bio, rq)) {
 			if (force_sync) {
 				zvol_discard(&zvr);
+			} else if (size > 0 && !io_is_secure_erase(bio, rq) &&
+			    !io_is_flush(bio, rq)) {
+				task = zvol_wq_add(zvr, &zv->zv_zso->zvo_dq,
+				    offset, size);
+				taskq_dispatch_ent(ztqs->tqs_taskq[tq_idx],
+				    zvol_discard_coalesce_task, task, 0,
+				    &task->ent);
 			} else {
 				task = zv_request_task_create(zvr);
 				taskq_dispatch_ent(ztqs->tqs_taskq[tq_idx],
 				    zvol_discard_task, task, 0, &task->ent);
 			}
+		} else if (force_sync) {
+			zvol_write(&zvr);
+		} else if (size > 0 && size < zvol_write_coalesce_max &&
+		    io_has_data(bio, rq) && !io_is_flush(bio, rq)) {
+			task = zvol_wq_add(zvr, &zv->zv_zso->zvo_wq, offset,
+			    size);
+			taskq_dispatch_ent(ztqs->tqs_taskq[tq_idx],
+			    zvol_write_coalesce_task, task, 0, &task->ent);
 		} else {
-			if (force_sync) {
-				zvol_write(&zvr);
-			} else {
-				task = zv_request_task_create(zvr);
-				taskq_dispatch_ent(ztqs->tqs_taskq[tq_idx],
-				    zvol_write_task, task, 0, &task->ent);
-			}
+			task = zv_request_task_create(zvr);
+			taskq_dispatch_ent(ztqs->tqs_taskq[tq_idx],
+			    zvol_write_task, task, 0, &task->ent);
 		}
 	} else {
 		/*
@@ -873,6 +1345,7 @@ zvol_release(struct gendisk *disk, fmode_t unused)
 	zv->zv_open_count--;
 	if (zv->zv_open_count == 0) {
 		ASSERT(RW_READ_HELD(&zv->zv_suspend_lock));
+		zvol_discard_wait(zv);
 		zvol_last_close(zv);
 	}
 
@@ -1337,6 +1810,12 @@ zvol_alloc(dev_t dev, const char *name, uint64_t volsize, uint64_t volblocksize,
 	zv = kmem_zalloc(sizeof (zvol_state_t), KM_SLEEP);
 	zso = kmem_zalloc(sizeof (struct zvol_state_os), KM_SLEEP);
 	zv->zv_zso = zso;
+	mutex_init(&zso->zvo_wq_lock, NULL, MUTEX_DEFAULT, NULL);
+	avl_create(&zso->zvo_wq, zvol_wq_compare, sizeof (zv_request_task_t),
+	    offsetof(zv_request_task_t, wq_node));
+	avl_create(&zso->zvo_dq, zvol_wq_compare, sizeof (zv_request_task_t),
+	    offsetof(zv_request_task_t, wq_node));
+	cv_init(&zso->zvo_discard_cv, NULL, CV_DEFAULT, NULL);
 	zv->zv_volmode = volmode;
 	zv->zv_volsize = volsize;
 	zv->zv_volblocksize = volblocksize;
@@ -1416,6 +1895,10 @@ zvol_alloc(dev_t dev, const char *name, uint64_t volsize, uint64_t volblocksize,
 	return (ret);
 
 out_kmem:
+	cv_destroy(&zso->zvo_discard_cv);
+	avl_destroy(&zso->zvo_dq);
+	avl_destroy(&zso->zvo_wq);
+	mutex_destroy(&zso->zvo_wq_lock);
 	kmem_free(zso, sizeof (struct zvol_state_os));
 	kmem_free(zv, sizeof (zvol_state_t));
 	return (ret);
@@ -1460,6 +1943,10 @@ zvol_os_remove_minor(zvol_state_t *zv)
 
 	ida_simple_remove(&zvol_ida, MINOR(zso->zvo_dev) >> ZVOL_MINOR_BITS);
 
+	cv_destroy(&zso->zvo_discard_cv);
+	avl_destroy(&zso->zvo_dq);
+	avl_destroy(&zso->zvo_wq);
+	mutex_destroy(&zso->zvo_wq_lock);
 	kmem_free(zso, sizeof (struct zvol_state_os));
 
 	mutex_enter(&zv->zv_state_lock);
@@ -1811,6 +2298,9 @@ zvol_init(void)
 		    1024);
 	}
 
+	zvol_discard_taskq = taskq_create("zvol_discard", MAX(max_ncpus / 4, 1),
+	    defclsyspri, 1, INT_MAX, TASKQ_DYNAMIC);
+
 	ida_init(&zvol_ida);
 	return (0);
 }
@@ -1822,6 +2312,7 @@ zvol_fini(void)
 
 	zvol_fini_impl();
 
+	taskq_destroy(zvol_discard_taskq);
 	ida_destroy(&zvol_ida);
 }
 
@@ -1841,6 +2332,17 @@ module_param(zvol_blk_mq_blocks_per_thread, uint, 0644);
 MODULE_PARM_DESC(zvol_blk_mq_blocks_per_thread,
 	"Process volblocksize blocks per thread");
 
+module_param(zvol_direct, uint, 0644);
+MODULE_PARM_DESC(zvol_direct, "Use Direct I/O for page aligned requests");
+
+module_param(zvol_write_coalesce_max, uint, 0644);
+MODULE_PARM_DESC(zvol_write_coalesce_max,
+	"Max bytes of adjacent queued writes to issue together");
+
+module_param(zvol_discard_async, uint, 0644);
+MODULE_PARM_DESC(zvol_discard_async,
+	"Complete discards once logged and free in the background");
+
 #ifndef HAVE_BLKDEV_GET_ERESTARTSYS
 module_param(zvol_open_timeout_ms, uint, 0644);
 MODULE_PARM_DESC(zvol_open_timeout_ms, "Timeout for ZVOL open retries");
@@ -160,6 +160,13 @@
 	(((c) >= 'A' && (c) <= 'Z') ? (c) - 'A' + 'a' : (c))
 
 #define	U8_ISASCII(c)			(((uchar_t)(c)) < 0x80U)
+
+/*
+ * 64-bit words with 0x01 and 0x80 in every byte, for the word at a time
+ * 7-bit ASCII fast paths.
+ */
+#define	U8_WORD_ONES			(~0ULL / 0xFF)
+#define	U8_WORD_HIGHS			(U8_WORD_ONES * 0x80)
 /*
  * The following macro assumes that the two characters that are to be
  * swapped are adjacent to each other and 'a' comes before 'b'.
@@ -327,6 +334,121 @@ static const uint8_t u8_valid_max_2nd_byte[0x100] = {
 };
 
 
+/*
+ * Return the length of the longest prefix of s, at most n bytes long, which
+ * consists of 7-bit ASCII characters only.  If stop_at_null is set, the
+ * prefix also ends at the first null byte.  Eight bytes are checked at a
+ * time, since in practice most names are plain ASCII.
+ */
+static size_t
+u8_ascii_span(const uchar_t *s, size_t n, boolean_t stop_at_null)
+{
+	size_t i;
+	uint64_t w;
+
+	for (i = 0; i + sizeof (w) <= n; i += sizeof (w)) {
+		memcpy(&w, s + i, sizeof (w));
+		if (w & U8_WORD_HIGHS)
+			break;
+		if (stop_at_null && ((w - U8_WORD_ONES) & ~w & U8_WORD_HIGHS))
+			break;
+	}
+
+	for (; i < n; i++) {
+		if (!U8_ISASCII(s[i]) || (stop_at_null && s[i] == '\0'))
+			break;
+	}
+
+	return (i);
+}
+
+/*
+ * Flip the case of every byte of w in the range [lo, hi].  All bytes must
+ * be 7-bit ASCII characters, so the additions never carry into the next
+ * byte and the highest bit of each byte tells whether it is in the range.
+ */
+static inline uint64_t
+u8_ascii_case_word(uint64_t w, uchar_t lo, uchar_t hi)
+{
+	uint64_t ge = w + U8_WORD_ONES * (0x80 - lo);
+	uint64_t gt = w + U8_WORD_ONES * (0x80 - hi - 1);
+
+	return (w ^ ((ge & ~gt & U8_WORD_HIGHS) >> 2));
+}
+
+/*
+ * Copy n bytes of 7-bit ASCII characters from s to d, converting them
+ * to upper or lower case if requested.
+ */
+static void
+u8_ascii_conv(uchar_t *d, const uchar_t *s, size_t n, boolean_t is_it_toupper,
+    boolean_t is_it_tolower)
+{
+	uchar_t lo = is_it_toupper ? 'a' : 'A';
+	uchar_t hi = is_it_toupper ? 'z' : 'Z';
+	size_t i;
+	uint64_t w;
+
+	if (!is_it_toupper && !is_it_tolower) {
+		memmove(d, s, n);
+		return;
+	}
+
+	for (i = 0; i + sizeof (w) <= n; i += sizeof (w)) {
+		memcpy(&w, s + i, sizeof (w));
+		w = u8_ascii_case_word(w, lo, hi);
+		memcpy(d + i, &w, sizeof (w));
+	}
+
+	for (; i < n; i++)
+		d[i] = is_it_toupper ? U8_ASCII_TOUPPER(s[i]) :
+		    U8_ASCII_TOLOWER(s[i]);
+}
+
+/*
+ * Compare the first n bytes of two strings of 7-bit ASCII characters,
+ * converting them to upper or lower case first if requested.  Returns -1,
+ * 0 or 1 like the character by character comparisons below.
+ */
+static int
+u8_ascii_compare(const uchar_t *s1, const uchar_t *s2, size_t n,
+    boolean_t is_it_toupper, boolean_t is_it_tolower)
+{
+	uchar_t lo = is_it_toupper ? 'a' : 'A';
+	uchar_t hi = is_it_toupper ? 'z' : 'Z';
+	boolean_t conv = is_it_toupper || is_it_tolower;
+	uchar_t c1, c2;
+	uint64_t w1, w2;
+	size_t i;
+
+	for (i = 0; i + sizeof (w1) <= n; i += sizeof (w1)) {
+		memcpy(&w1, s1 + i, sizeof (w1));
+		memcpy(&w2, s2 + i, sizeof (w2));
+		if (conv) {
+			w1 = u8_ascii_case_word(w1, lo, hi);
+			w2 = u8_ascii_case_word(w2, lo, hi);
+		}
+		if (w1 != w2)
+			break;
+	}
+
+	for (; i < n; i++) {
+		c1 = s1[i];
+		c2 = s2[i];
+		if (is_it_toupper) {
+			c1 = U8_ASCII_TOUPPER(c1);
+			c2 = U8_ASCII_TOUPPER(c2);
+		} else if (is_it_tolower) {
+			c1 = U8_ASCII_TOLOWER(c1);
+			c2 = U8_ASCII_TOLOWER(c2);
+		}
+		if (c1 != c2)
+			return (c1 > c2 ? 1 : -1);
+	}
+
+	return (0);
+}
+
 /*
  * The u8_validate() validates on the given UTF-8 character string and
  * calculate the byte length. It is quite similar to mblen(3C) except that
@@ -1863,6 +1985,9 @@ u8_strcmp(const char *s1, const char *s2, size_t n, int flag, size_t uv,
 	int f;
 	size_t n1;
 	size_t n2;
+	size_t a1;
+	size_t a2;
+	boolean_t is_it_tolower;
 
 	*errnum = 0;
 
@@ -1920,6 +2045,36 @@ u8_strcmp(const char *s1, const char *s2, size_t n, int flag, size_t uv,
 			n2 = n;
 	}
 
+	/*
+	 * Compare the leading 7-bit ASCII characters of both strings a word
+	 * at a time first, and only leave the rest to the slower functions
+	 * below.  With normalization, an ASCII character which is followed
+	 * by a non-ASCII one may start a combining sequence and so is left
+	 * to do_norm_compare() as well.
+	 */
+	a1 = u8_ascii_span((const uchar_t *)s1, n1, B_FALSE);
+	a2 = u8_ascii_span((const uchar_t *)s2, n2, B_FALSE);
+	if (flag & (U8_CANON_DECOMP | U8_COMPAT_DECOMP | U8_CANON_COMP)) {
+		if (a1 > 0 && a1 < n1)
+			a1--;
+		if (a2 > 0 && a2 < n2)
+			a2--;
+	}
+#ifdef U8_STRCMP_CI_LOWER
+	is_it_tolower = flag & U8_STRCMP_CI_LOWER;
+#else
+	is_it_tolower = B_FALSE;
+#endif
+	a1 = MIN(a1, a2);
+	f = u8_ascii_compare((const uchar_t *)s1, (const uchar_t *)s2, a1,
+	    flag & U8_STRCMP_CI_UPPER, is_it_tolower);
+	if (f != 0)
+		return (f);
+	s1 += a1;
+	s2 += a1;
+	n1 -= a1;
+	n2 -= a1;
+
 	/*
 	 * Simple case conversion can be done much faster and so we do
 	 * them separately here.
@@ -2006,6 +2161,22 @@ u8_textprep_str(char *inarray, size_t *inlen, char *outarray, size_t *outlen,
 
 	ret_val = 0;
 
+	/*
+	 * Convert the leading 7-bit ASCII characters a word at a time first,
+	 * as they need neither the case conversion nor the normalization
+	 * tables.  With normalization, the last of them may start a
+	 * combining sequence with a following non-ASCII character, so it is
+	 * left to the loop below.  If the output buffer is too small, the
+	 * loop below also takes care of reporting that at the right spot.
+	 */
+	j = u8_ascii_span(ib, ibtail - ib, do_not_ignore_null);
+	if (f != 0 && j > 0 && ib + j < ibtail && !U8_ISASCII(ib[j]))
+		j--;
+	j = MIN(j, (size_t)(obtail - ob));
+	u8_ascii_conv(ob, ib, j, is_it_toupper, is_it_tolower);
+	ib += j;
+	ob += j;
+
 	/*
 	 * If we don't have a normalization flag set, we do the simple case
 	 * conversion based text preparation separately below. Text
@@ -810,6 +810,18 @@ zpool_feature_init(void)
 		    ZFEATURE_TYPE_BOOLEAN, physical_rewrite_deps, sfeatures);
 	}
 
+	{
+		static const spa_feature_t spacemap_v3_deps[] = {
+			SPA_FEATURE_SPACEMAP_V2,
+			SPA_FEATURE_NONE
+		};
+		zfeature_register(SPA_FEATURE_SPACEMAP_V3,
+		    "org.openzfs:spacemap_v3", "spacemap_v3",
+		    "Space maps use compact delta-encoded entries.",
+		    ZFEATURE_FLAG_ACTIVATE_ON_ENABLE, ZFEATURE_TYPE_BOOLEAN,
+		    spacemap_v3_deps, sfeatures);
+	}
+
 	zfs_mod_list_supported_free(sfeatures);
 }
 
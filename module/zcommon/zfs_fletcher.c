@@ -543,8 +543,6 @@ fletcher_4_byteswap(const void *buf, uint64_t size,
 
 /* Incremental Fletcher 4 */
 
-#define	ZFS_FLETCHER_4_INC_MAX_SIZE	(8ULL << 20)
-
 static inline void
 fletcher_4_incremental_combine(zio_cksum_t *zcp, const uint64_t size,
     const zio_cksum_t *nzcp)
@@ -588,6 +586,19 @@ fletcher_4_incremental_impl(boolean_t native, const void *buf, uint64_t size,
 	}
 }
 
+/*
+ * Fold the fletcher_4_native() checksum of a separately checksummed buffer
+ * of "size" bytes into the running incremental checksum "zcp", as if the
+ * buffer had been passed to fletcher_4_incremental_native().  This lets
+ * callers checksum pieces of a stream independently, e.g. on other threads.
+ */
+void
+fletcher_4_combine(zio_cksum_t *zcp, uint64_t size, const zio_cksum_t *nzcp)
+{
+	ASSERT3U(size, <=, ZFS_FLETCHER_4_INC_MAX_SIZE);
+	fletcher_4_incremental_combine(zcp, size, nzcp);
+}
+
 int
 fletcher_4_incremental_native(void *buf, size_t size, void *data)
 {
@@ -1010,5 +1021,6 @@ EXPORT_SYMBOL(fletcher_4_native_varsize);
 EXPORT_SYMBOL(fletcher_4_byteswap);
 EXPORT_SYMBOL(fletcher_4_incremental_native);
 EXPORT_SYMBOL(fletcher_4_incremental_byteswap);
+EXPORT_SYMBOL(fletcher_4_combine);
 EXPORT_SYMBOL(fletcher_4_abd_ops);
 #endif
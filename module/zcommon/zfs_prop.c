@@ -168,6 +168,11 @@ zfs_prop_init(void)
 		{ "zstd-18",	ZIO_COMPLEVEL_ZSTD(ZIO_ZSTD_LEVEL_18) },
 		{ "zstd-19",	ZIO_COMPLEVEL_ZSTD(ZIO_ZSTD_LEVEL_19) },
 
+		/*
+		 * ZSTD-Auto picks a level per txg from the pool's write load.
+		 */
+		{ "zstd-auto",	ZIO_COMPLEVEL_ZSTD(ZIO_ZSTD_LEVEL_AUTO) },
+
 		/*
 		 * The ZSTD-Fast levels are also synthetic.
 		 */
@@ -348,10 +353,27 @@ zfs_prop_init(void)
 		{ NULL }
 	};
 
+	static const zprop_index_t primary_cache_table[] = {
+		{ "none",	ZFS_CACHE_NONE },
+		{ "metadata",	ZFS_CACHE_METADATA },
+		{ "all",	ZFS_CACHE_ALL },
+		{ "filtered",	ZFS_CACHE_FILTERED },
+		{ NULL }
+	};
+
 	static const zprop_index_t prefetch_table[] = {
 		{ "none",	ZFS_PREFETCH_NONE },
 		{ "metadata",	ZFS_PREFETCH_METADATA },
 		{ "all",	ZFS_PREFETCH_ALL },
+		{ "conservative", ZFS_PREFETCH_CONSERVATIVE },
+		{ "aggressive",	ZFS_PREFETCH_AGGRESSIVE },
+		{ NULL }
+	};
+
+	static const zprop_index_t scan_priority_table[] = {
+		{ "low",	ZFS_SCAN_PRIORITY_LOW },
+		{ "normal",	ZFS_SCAN_PRIORITY_NORMAL },
+		{ "high",	ZFS_SCAN_PRIORITY_HIGH },
 		{ NULL }
 	};
 
@@ -402,6 +424,7 @@ zfs_prop_init(void)
 		{ "disabled",	ZFS_DIRECT_DISABLED },
 		{ "standard",	ZFS_DIRECT_STANDARD },
 		{ "always",	ZFS_DIRECT_ALWAYS },
+		{ "adaptive",	ZFS_DIRECT_ADAPTIVE },
 		{ NULL }
 	};
 
@@ -433,7 +456,7 @@ zfs_prop_init(void)
 	    ZIO_COMPRESS_DEFAULT, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
 	    "on | off | lzjb | gzip | gzip-[1-9] | zle | lz4 | "
-	    "zstd | zstd-[1-19] | "
+	    "zstd | zstd-[1-19] | zstd-auto | "
 	    "zstd-fast | zstd-fast-[1-10,20,30,40,50,60,70,80,90,100,500,1000]",
 	    "COMPRESS", compress_table, sfeatures);
 	zprop_register_index(ZFS_PROP_SNAPDIR, "snapdir", ZFS_SNAPDIR_HIDDEN,
@@ -465,7 +488,8 @@ zfs_prop_init(void)
 	zprop_register_index(ZFS_PROP_PRIMARYCACHE, "primarycache",
 	    ZFS_CACHE_ALL, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_SNAPSHOT | ZFS_TYPE_VOLUME,
-	    "all | none | metadata", "PRIMARYCACHE", cache_table, sfeatures);
+	    "all | none | metadata | filtered", "PRIMARYCACHE",
+	    primary_cache_table, sfeatures);
 	zprop_register_index(ZFS_PROP_SECONDARYCACHE, "secondarycache",
 	    ZFS_CACHE_ALL, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_SNAPSHOT | ZFS_TYPE_VOLUME,
@@ -473,7 +497,12 @@ zfs_prop_init(void)
 	zprop_register_index(ZFS_PROP_PREFETCH, "prefetch",
 	    ZFS_PREFETCH_ALL, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_SNAPSHOT | ZFS_TYPE_VOLUME,
-	    "none | metadata | all", "PREFETCH", prefetch_table, sfeatures);
+	    "none | metadata | all | conservative | aggressive", "PREFETCH",
+	    prefetch_table, sfeatures);
+	zprop_register_index(ZFS_PROP_SCAN_PRIORITY, "scan_priority",
+	    ZFS_SCAN_PRIORITY_NORMAL, PROP_INHERIT,
+	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME, "low | normal | high",
+	    "SCANPRIO", scan_priority_table, sfeatures);
 	zprop_register_index(ZFS_PROP_LOGBIAS, "logbias", ZFS_LOGBIAS_LATENCY,
 	    PROP_INHERIT, ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
 	    "latency | throughput", "LOGBIAS", logbias_table, sfeatures);
@@ -491,7 +520,7 @@ zfs_prop_init(void)
 	    sfeatures);
 	zprop_register_index(ZFS_PROP_DIRECT, "direct",
 	    ZFS_DIRECT_STANDARD, PROP_INHERIT, ZFS_TYPE_FILESYSTEM,
-	    "disabled | standard | always", "DIRECT", direct_table,
+	    "disabled | standard | always | adaptive", "DIRECT", direct_table,
 	    sfeatures);
 
 	/* inherit index (boolean) properties */
@@ -740,6 +769,19 @@ zfs_prop_init(void)
 	    "special_small_blocks", 0, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME, "0 to 16M",
 	    "SPECIAL_SMALL_BLOCKS", B_FALSE, sfeatures);
+	zprop_register_number(ZFS_PROP_ARC_LIMIT, "arc_limit", 0, PROP_INHERIT,
+	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME, "<size> | none",
+	    "ARCLIMIT", B_FALSE, sfeatures);
+	zprop_register_number(ZFS_PROP_ARC_RESERVE, "arc_reserve", 0,
+	    PROP_INHERIT, ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
+	    "<size> | none", "ARCRESERVE", B_FALSE, sfeatures);
+	zprop_register_number(ZFS_PROP_PREFETCH_DISTANCE, "prefetch_distance",
+	    0, PROP_INHERIT,
+	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_SNAPSHOT | ZFS_TYPE_VOLUME,
+	    "<size> | none", "PFDIST", B_FALSE, sfeatures);
+	zprop_register_number(ZFS_PROP_DIRTY_MAX, "dirty_max", 0, PROP_INHERIT,
+	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME, "<size> | none",
+	    "DIRTYMAX", B_FALSE, sfeatures);
 
 	/* hidden properties */
 	zprop_register_hidden(ZFS_PROP_NUMCLONES, "numclones", PROP_TYPE_NUMBER,
@@ -143,6 +143,9 @@ zpool_prop_init(void)
 	zprop_register_number(ZPOOL_PROP_DEDUP_TABLE_QUOTA, "dedup_table_quota",
 	    UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_POOL, "<size>", "DDTQUOTA",
 	    B_FALSE, sfeatures);
+	zprop_register_number(ZPOOL_PROP_DEDUP_TABLE_ARC_RESERVE,
+	    "dedup_table_arc_reserve", 0, PROP_DEFAULT, ZFS_TYPE_POOL,
+	    "<size> | none", "DDTARCRESERVE", B_FALSE, sfeatures);
 
 	/* default index (boolean) properties */
 	zprop_register_index(ZPOOL_PROP_DELEGATION, "delegation", 1,
@@ -475,6 +478,9 @@ vdev_prop_init(void)
 	zprop_register_index(VDEV_PROP_FAILFAST, "failfast", B_TRUE,
 	    PROP_DEFAULT, ZFS_TYPE_VDEV, "on | off", "FAILFAST", boolean_table,
 	    sfeatures);
+	zprop_register_index(VDEV_PROP_POLL, "poll", B_FALSE,
+	    PROP_DEFAULT, ZFS_TYPE_VDEV, "on | off", "POLL", boolean_table,
+	    sfeatures);
 
 	/* hidden properties */
 	zprop_register_hidden(VDEV_PROP_NAME, "name", PROP_TYPE_STRING,
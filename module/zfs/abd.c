@@ -623,6 +623,18 @@ abd_get_zeros(size_t size)
 	return (abd_get_offset_size(abd_zero_scatter, 0, size));
 }
 
+/*
+ * Return a size scatter ABD for reads whose data will be discarded.  All of
+ * its pages are the same page, so its contents are meaningless.
+ */
+abd_t *
+abd_get_sink(size_t size)
+{
+	ASSERT3P(abd_sink_scatter, !=, NULL);
+	ASSERT3U(size, <=, SPA_MAXBLOCKSIZE);
+	return (abd_get_offset_size(abd_sink_scatter, 0, size));
+}
+
 /*
  * Create a linear ABD for an existing buf.
  */
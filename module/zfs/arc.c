@@ -298,6 +298,7 @@
 #include <sys/multilist.h>
 #include <sys/abd.h>
 #include <sys/dbuf.h>
+#include <sys/dmu_objset.h>
 #include <sys/zil.h>
 #include <sys/fm/fs/zfs.h>
 #include <sys/callb.h>
@@ -307,6 +308,7 @@
 #include <sys/arc_impl.h>
 #include <sys/trace_zfs.h>
 #include <sys/aggsum.h>
+#include <sys/pcsum.h>
 #include <sys/wmsum.h>
 #include <cityhash.h>
 #include <sys/vdev_trim.h>
@@ -485,6 +487,52 @@ static taskq_t *arc_flush_taskq;
  */
 static uint_t zfs_arc_evict_threads = 0;
 
+/*
+ * When enabled at module load on a system with more than one NUMA node,
+ * each ARC state list is split into one group of sublists per node.  A
+ * header is homed on the node of the CPU which allocated it (which is also
+ * where its data pages are allocated from), and eviction starts with the
+ * sublists of the node which most recently ran short of memory.  Per-node
+ * statistics are exported in the arcstats_node<N> kstats.
+ */
+static int zfs_arc_numa = 0;
+
+/*
+ * Number of NUMA nodes the ARC state lists are split into.  The node id
+ * is stored in a uint8_t in the header, and larger systems share groups.
+ */
+#define	ARC_NUMA_MAX_NODES	64
+static uint_t arc_numa_nodes = 1;
+static arc_numa_node_t *arc_numa;
+
+/* Node which most recently waited for eviction; it is evicted from first. */
+static uint_t arc_evict_node = 0;
+
+/*
+ * Admission filter for datasets with primarycache=filtered.  Data blocks
+ * of such datasets which miss in the dbuf cache are counted in a compact
+ * count-min frequency sketch keyed on the block's DVA.  Once the ARC is
+ * full, a block is only admitted to the MRU if it has been seen at least
+ * zfs_arc_admission_min_freq times within the sketch's aging window;
+ * otherwise it is read into the uncached state and dropped after use, so
+ * one-touch scans do not push the working set out of the cache.
+ */
+static uint_t zfs_arc_admission_min_freq = 2;
+
+#define	ARC_SKETCH_ROWS		4
+#define	ARC_SKETCH_MAX_FREQ	15
+#define	ARC_SKETCH_MIN_WIDTH	(1ULL << 12)
+#define	ARC_SKETCH_MAX_WIDTH	(1ULL << 22)
+
+typedef struct arc_sketch {
+	uint64_t	as_mask;	/* counters per row, minus one */
+	uint64_t	as_window;	/* increments before aging */
+	uint64_t	as_incrs;	/* increments since last aging */
+	uint8_t		*as_counts[ARC_SKETCH_ROWS];
+} arc_sketch_t;
+
+static arc_sketch_t arc_sketch;
+
 /* The 7 states: */
 arc_state_t ARC_anon;
 arc_state_t ARC_mru;
@@ -628,6 +676,7 @@ arc_stats_t arc_stats = {
 	{ "memory_free_bytes",		KSTAT_DATA_UINT64 },
 	{ "memory_available_bytes",	KSTAT_DATA_INT64 },
 	{ "arc_no_grow",		KSTAT_DATA_UINT64 },
+	{ "reclaim_pressure",		KSTAT_DATA_UINT64 },
 	{ "arc_tempreserve",		KSTAT_DATA_UINT64 },
 	{ "arc_loaned_bytes",		KSTAT_DATA_UINT64 },
 	{ "arc_prune",			KSTAT_DATA_UINT64 },
@@ -645,10 +694,26 @@ arc_stats_t arc_stats = {
 	{ "arc_raw_size",		KSTAT_DATA_UINT64 },
 	{ "cached_only_in_progress",	KSTAT_DATA_UINT64 },
 	{ "abd_chunk_waste_size",	KSTAT_DATA_UINT64 },
+	{ "admission_admitted",		KSTAT_DATA_UINT64 },
+	{ "admission_rejected",		KSTAT_DATA_UINT64 },
+	{ "dataset_limit_evicted",	KSTAT_DATA_UINT64 },
+	{ "dataset_reserve_skip",	KSTAT_DATA_UINT64 },
+	{ "dcache_hits",		KSTAT_DATA_UINT64 },
+	{ "dcache_misses",		KSTAT_DATA_UINT64 },
+	{ "dcache_size",		KSTAT_DATA_UINT64 },
+	{ "dcache_evicted",		KSTAT_DATA_UINT64 },
+	{ "ddt_size",			KSTAT_DATA_UINT64 },
 };
 
 arc_sums_t arc_sums;
 
+/*
+ * Per-CPU batch of the size sums in arc_sums.  The estimates used to decide
+ * whether the ARC is overflowing are within 2 * ARC_SUM_BATCH per CPU of
+ * the actual sizes.
+ */
+#define	ARC_SUM_BATCH	(8 * SPA_OLD_MAXBLOCKSIZE)
+
 #define	ARCSTAT_MAX(stat, val) {					\
 	uint64_t m;							\
 	while ((val) > (m = arc_stats.stat.value.ui64) &&		\
@@ -695,6 +760,55 @@ arc_sums_t arc_sums;
 
 static kstat_t			*arc_ksp;
 
+#define	ARC_NUMA_INCR(node, stat, val) do {				\
+	if (arc_numa != NULL)						\
+		wmsum_add(&arc_numa[(node)].stat, (val));		\
+} while (0)
+
+static inline uint8_t
+arc_numa_cur_node(void)
+{
+	return (arc_numa_nodes > 1 ? CPU_NODEID_UNSTABLE % arc_numa_nodes : 0);
+}
+
+/*
+ * Per-dataset ARC accounting.  Every open head dataset holds an account,
+ * keyed by spa load guid and objset id, and headers are charged to it for
+ * the physical buffers they hold (b_pabd and b_rabd).  An account with an
+ * arc_limit is trimmed back to it by arc_evict_accounts() before anything
+ * else is evicted, and while an account is within its arc_reserve,
+ * arc_evict() skips its buffers.
+ *
+ * Accounts are never freed while the ARC is loaded, only reused for another
+ * dataset once released and empty, so a header's b_account index can always
+ * be dereferenced.  Index 0 means "not accounted".
+ */
+#define	ARC_ACCOUNT_MAX		(1U << 14)
+#define	ARC_ACCOUNT_EVICT_MS	250
+
+static krwlock_t arc_account_lock;
+static avl_tree_t arc_account_tree;
+static arc_account_t **arc_accounts;
+static uint_t arc_account_count;	/* indices handed out, including 0 */
+static uint64_t arc_account_reserved;	/* sum of effective reserves */
+static boolean_t arc_accounts_over;	/* some account exceeds its limit */
+static clock_t arc_last_account_evict;
+
+static inline void
+arc_account_charge(arc_buf_hdr_t *hdr, int64_t delta)
+{
+	uint16_t id = hdr->b_l1hdr.b_account;
+
+	if (id == 0)
+		return;
+
+	arc_account_t *aa = arc_accounts[id];
+	aggsum_add(&aa->aa_size, delta);
+	if (delta > 0 && aa->aa_limit != 0 && !arc_accounts_over &&
+	    aggsum_upper_bound(&aa->aa_size) > aa->aa_limit)
+		arc_accounts_over = B_TRUE;
+}
+
 /*
  * There are several ARC variables that are critical to export as kstats --
  * but we don't want to have to grovel around in the kstat whenever we wish to
@@ -707,8 +821,16 @@ static kstat_t			*arc_ksp;
 #define	arc_loaned_bytes	ARCSTAT(arcstat_loaned_bytes)
 #define	arc_dnode_limit	ARCSTAT(arcstat_dnode_limit) /* max size for dnodes */
 #define	arc_need_free	ARCSTAT(arcstat_need_free) /* waiting to be evicted */
+#define	arc_reclaim_pressure	ARCSTAT(arcstat_reclaim_pressure)
 
 hrtime_t arc_growtime;
+
+/*
+ * Bytes the target size was reduced by since arc_reclaim_pressure was last
+ * updated, and the time of that update.
+ */
+static uint64_t arc_reclaim_bytes;
+static hrtime_t arc_reclaim_time;
 list_t arc_prune_list;
 kmutex_t arc_prune_mtx;
 taskq_t *arc_prune_taskq;
@@ -776,18 +898,37 @@ taskq_t *arc_prune_taskq;
  * Hash table routines
  */
 
+/*
+ * Every lookup, insert and removal takes the hash lock of its bucket, so
+ * on large systems a fixed number of stripes becomes a hot spot.  The
+ * number of stripes scales with the number of CPUs (at least BUF_LOCKS
+ * and at most one per bucket), and each lock is padded to its own cache
+ * line so that neighbouring stripes do not false-share.
+ *
+ * The hash chains cannot be walked without the lock: headers come from a
+ * kmem cache whose memory is not type-stable, and every caller of
+ * buf_hash_find() needs the hash lock held on return anyway.
+ */
 #define	BUF_LOCKS 2048
+#define	BUF_LOCKS_PER_CPU 256
+
+typedef struct buf_hash_lock {
+	kmutex_t bhl_lock;
+} ____cacheline_aligned buf_hash_lock_t;
+
 typedef struct buf_hash_table {
 	uint64_t ht_mask;
 	arc_buf_hdr_t **ht_table;
-	kmutex_t ht_locks[BUF_LOCKS] ____cacheline_aligned;
+	uint64_t ht_lock_mask;
+	buf_hash_lock_t *ht_locks;
 } buf_hash_table_t;
 
 static buf_hash_table_t buf_hash_table;
 
 #define	BUF_HASH_INDEX(spa, dva, birth) \
 	(buf_hash(spa, dva, birth) & buf_hash_table.ht_mask)
-#define	BUF_HASH_LOCK(idx)	(&buf_hash_table.ht_locks[idx & (BUF_LOCKS-1)])
+#define	BUF_HASH_LOCK(idx)	\
+	(&buf_hash_table.ht_locks[(idx) & buf_hash_table.ht_lock_mask].bhl_lock)
 #define	HDR_LOCK(hdr) \
 	(BUF_HASH_LOCK(BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
 
@@ -842,6 +983,7 @@ int l2arc_noprefetch = B_TRUE;			/* don't cache prefetch bufs */
 int l2arc_feed_again = B_TRUE;			/* turbo warmup */
 int l2arc_norw = B_FALSE;			/* no reads during writes */
 static uint_t l2arc_meta_percent = 33;	/* limit on headers size */
+static uint_t l2arc_feed_threads = 4;		/* max feed threads */
 
 /*
  * L2ARC Internals
@@ -865,6 +1007,7 @@ typedef struct l2arc_read_callback {
 
 typedef struct l2arc_data_free {
 	/* protected by l2arc_free_on_write_mtx */
+	l2arc_dev_t	*l2df_dev;	/* device being written */
 	abd_t		*l2df_abd;
 	size_t		l2df_size;
 	arc_buf_contents_t l2df_type;
@@ -885,9 +1028,23 @@ typedef enum arc_ovf_level {
 	ARC_OVF_SEVERE			/* ARC is severely overflowed. */
 } arc_ovf_level_t;
 
-static kmutex_t l2arc_feed_thr_lock;
-static kcondvar_t l2arc_feed_thr_cv;
-static uint8_t l2arc_thread_exit;
+/*
+ * Each L2ARC feed thread has its own lock and condition variable, so that
+ * one thread writing to a slow cache device does not hold up the others.
+ * A device is fed by at most one thread at a time (l2ad_feeding), and keeps
+ * its own feed schedule (l2ad_feed_next), so l2arc_write_max and
+ * l2arc_write_boost apply per device.
+ */
+typedef struct l2arc_feeder {
+	kmutex_t	lf_lock;
+	kcondvar_t	lf_cv;
+	boolean_t	lf_exit;
+	uint_t		lf_id;
+} l2arc_feeder_t;
+
+static l2arc_feeder_t *l2arc_feeders;
+static uint_t l2arc_nfeeders;
+static uint_t l2arc_feed_slice;			/* next sublist slice */
 
 static kmutex_t l2arc_rebuild_thr_lock;
 static kcondvar_t l2arc_rebuild_thr_cv;
@@ -920,7 +1077,7 @@ static inline void arc_hdr_clear_flags(arc_buf_hdr_t *hdr, arc_flags_t flags);
 
 static boolean_t l2arc_write_eligible(uint64_t, arc_buf_hdr_t *);
 static void l2arc_read_done(zio_t *);
-static void l2arc_do_free_on_write(void);
+static void l2arc_do_free_on_write(l2arc_dev_t *dev);
 static void l2arc_hdr_arcstats_update(arc_buf_hdr_t *hdr, boolean_t incr,
     boolean_t state_only);
 
@@ -1000,6 +1157,7 @@ static void l2arc_log_blk_fetch_abort(zio_t *zio);
 /* L2ARC persistence block restoration routines. */
 static void l2arc_log_blk_restore(l2arc_dev_t *dev,
     const l2arc_log_blk_phys_t *lb, uint64_t lb_asize);
+static void l2arc_log_blk_restore_task(void *arg);
 static void l2arc_hdr_restore(const l2arc_log_ent_phys_t *le,
     l2arc_dev_t *dev);
 
@@ -1165,8 +1323,10 @@ buf_fini(void)
 	kmem_free(buf_hash_table.ht_table,
 	    (buf_hash_table.ht_mask + 1) * sizeof (void *));
 #endif
-	for (int i = 0; i < BUF_LOCKS; i++)
+	for (uint64_t i = 0; i <= buf_hash_table.ht_lock_mask; i++)
 		mutex_destroy(BUF_HASH_LOCK(i));
+	vmem_free(buf_hash_table.ht_locks,
+	    (buf_hash_table.ht_lock_mask + 1) * sizeof (buf_hash_lock_t));
 	kmem_cache_destroy(hdr_full_cache);
 	kmem_cache_destroy(hdr_l2only_cache);
 	kmem_cache_destroy(buf_cache);
@@ -1262,6 +1422,7 @@ buf_init(void)
 {
 	uint64_t *ct = NULL;
 	uint64_t hsize = 1ULL << 12;
+	uint64_t nlocks;
 	int i, j;
 
 	/*
@@ -1303,8 +1464,14 @@ retry:
 		for (ct = zfs_crc64_table + i, *ct = i, j = 8; j > 0; j--)
 			*ct = (*ct >> 1) ^ (-(*ct & 1) & ZFS_CRC64_POLY);
 
-	for (i = 0; i < BUF_LOCKS; i++)
-		mutex_init(BUF_HASH_LOCK(i), NULL, MUTEX_DEFAULT, NULL);
+	nlocks = MAX(BUF_LOCKS, 1ULL << highbit64(
+	    (uint64_t)boot_ncpus * BUF_LOCKS_PER_CPU - 1));
+	nlocks = MIN(nlocks, hsize);
+	buf_hash_table.ht_lock_mask = nlocks - 1;
+	buf_hash_table.ht_locks = vmem_zalloc(nlocks *
+	    sizeof (buf_hash_lock_t), KM_SLEEP);
+	for (uint64_t l = 0; l < nlocks; l++)
+		mutex_init(BUF_HASH_LOCK(l), NULL, MUTEX_DEFAULT, NULL);
 }
 
 #define	ARC_MINTIME	(hz>>4) /* 62 ms */
@@ -1998,6 +2165,254 @@ arc_buf_untransform_in_place(arc_buf_t *buf)
 	buf->b_flags &= ~ARC_BUF_FLAG_COMPRESSED;
 }
 
+/*
+ * Decompressed block side cache.  With compressed ARC, every fill of an
+ * uncompressed buf from a compressed header has to decompress the block
+ * again once the previous buf was released.  For hot headers, those in
+ * the MFU state, we keep a copy of the decompressed block in a small cache
+ * of its own, keyed by the block's identity (spa, DVA, birth), so
+ * subsequent fills are a memcpy instead.  Since that identity names
+ * immutable on-disk contents, entries never go stale; they are dropped
+ * LRU-first once the cache exceeds its target size, when the pool is
+ * flushed from the ARC, or under memory pressure.
+ *
+ * The cache is split into shards, each with its own lock, LRU list and
+ * share of the target size.  Protected (encrypted or authenticated) blocks
+ * are never cached, so no plaintext outlives an unloaded key here.
+ */
+static uint64_t zfs_arc_dcache_max_bytes = UINT64_MAX;
+static uint_t zfs_arc_dcache_shift = 6;
+
+#define	ARC_DCACHE_SHARDS	64
+#define	ARC_DCACHE_MAX_BLOCK	SPA_OLD_MAXBLOCKSIZE
+
+typedef struct arc_dcache_ent {
+	avl_node_t	ade_node;
+	list_node_t	ade_lru;
+	uint64_t	ade_spa;
+	dva_t		ade_dva;
+	uint64_t	ade_birth;
+	uint32_t	ade_size;
+	boolean_t	ade_metadata;
+	void		*ade_data;
+} arc_dcache_ent_t;
+
+typedef struct arc_dcache_shard {
+	kmutex_t	ads_lock;
+	avl_tree_t	ads_tree;
+	list_t		ads_lru;	/* most recently used first */
+	uint64_t	ads_size;
+} ____cacheline_aligned arc_dcache_shard_t;
+
+static arc_dcache_shard_t *arc_dcache;
+
+static int
+arc_dcache_compare(const void *x1, const void *x2)
+{
+	const arc_dcache_ent_t *e1 = x1, *e2 = x2;
+
+	int cmp = TREE_CMP(e1->ade_dva.dva_word[0], e2->ade_dva.dva_word[0]);
+	if (likely(cmp))
+		return (cmp);
+	cmp = TREE_CMP(e1->ade_dva.dva_word[1], e2->ade_dva.dva_word[1]);
+	if (likely(cmp))
+		return (cmp);
+	cmp = TREE_CMP(e1->ade_birth, e2->ade_birth);
+	if (likely(cmp))
+		return (cmp);
+
+	return (TREE_CMP(e1->ade_spa, e2->ade_spa));
+}
+
+static inline uint64_t
+arc_dcache_shard_max(void)
+{
+	return (MIN(zfs_arc_dcache_max_bytes, arc_c >> zfs_arc_dcache_shift) /
+	    ARC_DCACHE_SHARDS);
+}
+
+static inline boolean_t
+arc_dcache_eligible(const arc_buf_hdr_t *hdr)
+{
+	return (arc_dcache != NULL && HDR_IN_HASH_TABLE(hdr) &&
+	    !HDR_PROTECTED(hdr) && HDR_GET_LSIZE(hdr) <= ARC_DCACHE_MAX_BLOCK);
+}
+
+static inline arc_dcache_shard_t *
+arc_dcache_shard(const arc_buf_hdr_t *hdr)
+{
+	return (&arc_dcache[buf_hash(hdr->b_spa, &hdr->b_dva,
+	    hdr->b_birth) & (ARC_DCACHE_SHARDS - 1)]);
+}
+
+static void
+arc_dcache_ent_free(arc_dcache_shard_t *ads, arc_dcache_ent_t *ade)
+{
+	ASSERT(MUTEX_HELD(&ads->ads_lock));
+
+	avl_remove(&ads->ads_tree, ade);
+	list_remove(&ads->ads_lru, ade);
+	ads->ads_size -= ade->ade_size;
+	ARCSTAT_INCR(arcstat_dcache_size, -(int64_t)ade->ade_size);
+
+	if (ade->ade_metadata)
+		zio_buf_free(ade->ade_data, ade->ade_size);
+	else
+		zio_data_buf_free(ade->ade_data, ade->ade_size);
+	kmem_free(ade, sizeof (arc_dcache_ent_t));
+}
+
+/*
+ * Fill 'data' from the side cache.  Returns B_FALSE on a miss.
+ */
+static boolean_t
+arc_dcache_lookup(arc_buf_hdr_t *hdr, void *data)
+{
+	arc_dcache_ent_t search, *ade;
+
+	if (!arc_dcache_eligible(hdr))
+		return (B_FALSE);
+
+	arc_dcache_shard_t *ads = arc_dcache_shard(hdr);
+	if (ads->ads_size == 0) {
+		ARCSTAT_BUMP(arcstat_dcache_misses);
+		return (B_FALSE);
+	}
+
+	search.ade_spa = hdr->b_spa;
+	search.ade_dva = hdr->b_dva;
+	search.ade_birth = hdr->b_birth;
+
+	mutex_enter(&ads->ads_lock);
+	ade = avl_find(&ads->ads_tree, &search, NULL);
+	if (ade == NULL) {
+		mutex_exit(&ads->ads_lock);
+		ARCSTAT_BUMP(arcstat_dcache_misses);
+		return (B_FALSE);
+	}
+	ASSERT3U(ade->ade_size, ==, HDR_GET_LSIZE(hdr));
+	memcpy(data, ade->ade_data, ade->ade_size);
+	if (list_head(&ads->ads_lru) != ade) {
+		list_remove(&ads->ads_lru, ade);
+		list_insert_head(&ads->ads_lru, ade);
+	}
+	mutex_exit(&ads->ads_lock);
+
+	ARCSTAT_BUMP(arcstat_dcache_hits);
+	return (B_TRUE);
+}
+
+/*
+ * Remember the freshly decompressed contents of a hot header.
+ */
+static void
+arc_dcache_insert(arc_buf_hdr_t *hdr, const void *data)
+{
+	arc_dcache_ent_t *ade, *old;
+	avl_index_t where;
+
+	if (!arc_dcache_eligible(hdr) || hdr->b_l1hdr.b_state != arc_mfu)
+		return;
+
+	uint64_t shard_max = arc_dcache_shard_max();
+	uint32_t size = HDR_GET_LSIZE(hdr);
+	if (size > shard_max)
+		return;
+
+	ade = kmem_alloc(sizeof (arc_dcache_ent_t), KM_NOSLEEP);
+	if (ade == NULL)
+		return;
+	ade->ade_spa = hdr->b_spa;
+	ade->ade_dva = hdr->b_dva;
+	ade->ade_birth = hdr->b_birth;
+	ade->ade_size = size;
+	ade->ade_metadata = HDR_ISTYPE_METADATA(hdr);
+	ade->ade_data = ade->ade_metadata ? zio_buf_alloc(size) :
+	    zio_data_buf_alloc(size);
+	memcpy(ade->ade_data, data, size);
+
+	arc_dcache_shard_t *ads = arc_dcache_shard(hdr);
+	mutex_enter(&ads->ads_lock);
+	old = avl_find(&ads->ads_tree, ade, &where);
+	if (old != NULL) {
+		/* Somebody beat us to it. */
+		mutex_exit(&ads->ads_lock);
+		if (ade->ade_metadata)
+			zio_buf_free(ade->ade_data, size);
+		else
+			zio_data_buf_free(ade->ade_data, size);
+		kmem_free(ade, sizeof (arc_dcache_ent_t));
+		return;
+	}
+	avl_insert(&ads->ads_tree, ade, where);
+	list_insert_head(&ads->ads_lru, ade);
+	ads->ads_size += size;
+	ARCSTAT_INCR(arcstat_dcache_size, size);
+
+	while (ads->ads_size > shard_max) {
+		old = list_tail(&ads->ads_lru);
+		ARCSTAT_INCR(arcstat_dcache_evicted, old->ade_size);
+		arc_dcache_ent_free(ads, old);
+	}
+	mutex_exit(&ads->ads_lock);
+}
+
+/*
+ * Drop all side cache entries of the given spa, or all of them if 0.
+ */
+static void
+arc_dcache_flush(uint64_t spa)
+{
+	if (arc_dcache == NULL)
+		return;
+
+	for (int i = 0; i < ARC_DCACHE_SHARDS; i++) {
+		arc_dcache_shard_t *ads = &arc_dcache[i];
+		arc_dcache_ent_t *ade, *next;
+
+		mutex_enter(&ads->ads_lock);
+		for (ade = list_head(&ads->ads_lru); ade != NULL; ade = next) {
+			next = list_next(&ads->ads_lru, ade);
+			if (spa == 0 || ade->ade_spa == spa)
+				arc_dcache_ent_free(ads, ade);
+		}
+		mutex_exit(&ads->ads_lock);
+	}
+}
+
+static void
+arc_dcache_init(void)
+{
+	arc_dcache = kmem_zalloc(sizeof (arc_dcache_shard_t) *
+	    ARC_DCACHE_SHARDS, KM_SLEEP);
+	for (int i = 0; i < ARC_DCACHE_SHARDS; i++) {
+		arc_dcache_shard_t *ads = &arc_dcache[i];
+
+		mutex_init(&ads->ads_lock, NULL, MUTEX_DEFAULT, NULL);
+		avl_create(&ads->ads_tree, arc_dcache_compare,
+		    sizeof (arc_dcache_ent_t),
+		    offsetof(arc_dcache_ent_t, ade_node));
+		list_create(&ads->ads_lru, sizeof (arc_dcache_ent_t),
+		    offsetof(arc_dcache_ent_t, ade_lru));
+	}
+}
+
+static void
+arc_dcache_fini(void)
+{
+	arc_dcache_flush(0);
+	for (int i = 0; i < ARC_DCACHE_SHARDS; i++) {
+		arc_dcache_shard_t *ads = &arc_dcache[i];
+
+		ASSERT0(ads->ads_size);
+		list_destroy(&ads->ads_lru);
+		avl_destroy(&ads->ads_tree);
+		mutex_destroy(&ads->ads_lock);
+	}
+	kmem_free(arc_dcache, sizeof (arc_dcache_shard_t) * ARC_DCACHE_SHARDS);
+	arc_dcache = NULL;
+}
+
 /*
  * Given a buf that has a data buffer attached to it, this function will
  * efficiently fill the buf with data of the specified compression setting from
@@ -2147,13 +2562,15 @@ arc_buf_fill(arc_buf_t *buf, spa_t *spa, const zbookmark_phys_t *zb,
 		/*
 		 * Try copying the data from another buf which already has a
 		 * decompressed version. If that's not possible, it's time to
-		 * bite the bullet and decompress the data from the hdr.
+		 * bite the bullet and decompress the data from the hdr, unless
+		 * the side cache still holds it (in on-disk byte order).
 		 */
 		if (arc_buf_try_copy_decompressed_data(buf)) {
 			/* Skip byteswapping and checksumming (already done) */
 			return (0);
-		} else {
+		} else if (!arc_dcache_lookup(hdr, buf->b_data)) {
 			abd_t dabd;
+			hrtime_t start = gethrtime();
 			abd_get_from_buf_struct(&dabd, buf->b_data,
 			    HDR_GET_LSIZE(hdr));
 			error = zio_decompress_data(HDR_GET_COMPRESS(hdr),
@@ -2161,6 +2578,10 @@ arc_buf_fill(arc_buf_t *buf, spa_t *spa, const zbookmark_phys_t *zb,
 			    HDR_GET_PSIZE(hdr), HDR_GET_LSIZE(hdr),
 			    &hdr->b_complevel);
 			abd_free(&dabd);
+			if (zio_stage_histo && spa != NULL) {
+				zio_stage_histo_add(spa, NULL,
+				    ZIO_SH_DECOMPRESS, gethrtime() - start);
+			}
 
 			/*
 			 * Absent hardware errors or software bugs, this should
@@ -2178,6 +2599,7 @@ arc_buf_fill(arc_buf_t *buf, spa_t *spa, const zbookmark_phys_t *zb,
 					mutex_exit(hash_lock);
 				return (SET_ERROR(EIO));
 			}
+			arc_dcache_insert(hdr, buf->b_data);
 		}
 	}
 
@@ -2631,7 +3053,7 @@ arc_space_consume(uint64_t space, arc_space_type_t type)
 		ARCSTAT_INCR(arcstat_bonus_size, space);
 		break;
 	case ARC_SPACE_DNODE:
-		aggsum_add(&arc_sums.arcstat_dnode_size, space);
+		pcsum_add(&arc_sums.arcstat_dnode_size, space);
 		break;
 	case ARC_SPACE_DBUF:
 		ARCSTAT_INCR(arcstat_dbuf_size, space);
@@ -2640,7 +3062,7 @@ arc_space_consume(uint64_t space, arc_space_type_t type)
 		ARCSTAT_INCR(arcstat_hdr_size, space);
 		break;
 	case ARC_SPACE_L2HDRS:
-		aggsum_add(&arc_sums.arcstat_l2_hdr_size, space);
+		pcsum_add(&arc_sums.arcstat_l2_hdr_size, space);
 		break;
 	case ARC_SPACE_ABD_CHUNK_WASTE:
 		/*
@@ -2656,7 +3078,7 @@ arc_space_consume(uint64_t space, arc_space_type_t type)
 	if (type != ARC_SPACE_DATA && type != ARC_SPACE_ABD_CHUNK_WASTE)
 		ARCSTAT_INCR(arcstat_meta_used, space);
 
-	aggsum_add(&arc_sums.arcstat_size, space);
+	pcsum_add(&arc_sums.arcstat_size, space);
 }
 
 void
@@ -2677,7 +3099,7 @@ arc_space_return(uint64_t space, arc_space_type_t type)
 		ARCSTAT_INCR(arcstat_bonus_size, -space);
 		break;
 	case ARC_SPACE_DNODE:
-		aggsum_add(&arc_sums.arcstat_dnode_size, -space);
+		pcsum_add(&arc_sums.arcstat_dnode_size, -space);
 		break;
 	case ARC_SPACE_DBUF:
 		ARCSTAT_INCR(arcstat_dbuf_size, -space);
@@ -2686,7 +3108,7 @@ arc_space_return(uint64_t space, arc_space_type_t type)
 		ARCSTAT_INCR(arcstat_hdr_size, -space);
 		break;
 	case ARC_SPACE_L2HDRS:
-		aggsum_add(&arc_sums.arcstat_l2_hdr_size, -space);
+		pcsum_add(&arc_sums.arcstat_l2_hdr_size, -space);
 		break;
 	case ARC_SPACE_ABD_CHUNK_WASTE:
 		ARCSTAT_INCR(arcstat_abd_chunk_waste_size, -space);
@@ -2696,8 +3118,8 @@ arc_space_return(uint64_t space, arc_space_type_t type)
 	if (type != ARC_SPACE_DATA && type != ARC_SPACE_ABD_CHUNK_WASTE)
 		ARCSTAT_INCR(arcstat_meta_used, -space);
 
-	ASSERT(aggsum_compare(&arc_sums.arcstat_size, space) >= 0);
-	aggsum_add(&arc_sums.arcstat_size, -space);
+	ASSERT(pcsum_compare(&arc_sums.arcstat_size, space) >= 0);
+	pcsum_add(&arc_sums.arcstat_size, -space);
 }
 
 /*
@@ -2931,10 +3353,12 @@ arc_loan_inuse_buf(arc_buf_t *buf, const void *tag)
 }
 
 static void
-l2arc_free_abd_on_write(abd_t *abd, size_t size, arc_buf_contents_t type)
+l2arc_free_abd_on_write(l2arc_dev_t *dev, abd_t *abd, size_t size,
+    arc_buf_contents_t type)
 {
 	l2arc_data_free_t *df = kmem_alloc(sizeof (*df), KM_SLEEP);
 
+	df->l2df_dev = dev;
 	df->l2df_abd = abd;
 	df->l2df_size = size;
 	df->l2df_type = type;
@@ -2966,10 +3390,13 @@ arc_hdr_free_on_write(arc_buf_hdr_t *hdr, boolean_t free_rdata)
 		arc_space_return(size, ARC_SPACE_DATA);
 	}
 
+	ASSERT(HDR_HAS_L2HDR(hdr));
 	if (free_rdata) {
-		l2arc_free_abd_on_write(hdr->b_crypt_hdr.b_rabd, size, type);
+		l2arc_free_abd_on_write(hdr->b_l2hdr.b_dev,
+		    hdr->b_crypt_hdr.b_rabd, size, type);
 	} else {
-		l2arc_free_abd_on_write(hdr->b_l1hdr.b_pabd, size, type);
+		l2arc_free_abd_on_write(hdr->b_l2hdr.b_dev,
+		    hdr->b_l1hdr.b_pabd, size, type);
 	}
 }
 
@@ -3008,6 +3435,8 @@ arc_share_buf(arc_buf_hdr_t *hdr, arc_buf_t *buf)
 	ARCSTAT_INCR(arcstat_compressed_size, arc_hdr_size(hdr));
 	ARCSTAT_INCR(arcstat_uncompressed_size, HDR_GET_LSIZE(hdr));
 	ARCSTAT_INCR(arcstat_overhead_size, -arc_buf_size(buf));
+	ARC_NUMA_INCR(hdr->b_l1hdr.b_numa_node, ann_size, arc_hdr_size(hdr));
+	arc_account_charge(hdr, arc_hdr_size(hdr));
 }
 
 static void
@@ -3037,6 +3466,8 @@ arc_unshare_buf(arc_buf_hdr_t *hdr, arc_buf_t *buf)
 	ARCSTAT_INCR(arcstat_compressed_size, -arc_hdr_size(hdr));
 	ARCSTAT_INCR(arcstat_uncompressed_size, -HDR_GET_LSIZE(hdr));
 	ARCSTAT_INCR(arcstat_overhead_size, arc_buf_size(buf));
+	ARC_NUMA_INCR(hdr->b_l1hdr.b_numa_node, ann_size, -arc_hdr_size(hdr));
+	arc_account_charge(hdr, -arc_hdr_size(hdr));
 }
 
 /*
@@ -3216,6 +3647,8 @@ arc_hdr_alloc_abd(arc_buf_hdr_t *hdr, int alloc_flags)
 
 	ARCSTAT_INCR(arcstat_compressed_size, size);
 	ARCSTAT_INCR(arcstat_uncompressed_size, HDR_GET_LSIZE(hdr));
+	ARC_NUMA_INCR(hdr->b_l1hdr.b_numa_node, ann_size, size);
+	arc_account_charge(hdr, size);
 }
 
 static void
@@ -3254,6 +3687,237 @@ arc_hdr_free_abd(arc_buf_hdr_t *hdr, boolean_t free_rdata)
 
 	ARCSTAT_INCR(arcstat_compressed_size, -size);
 	ARCSTAT_INCR(arcstat_uncompressed_size, -HDR_GET_LSIZE(hdr));
+	ARC_NUMA_INCR(hdr->b_l1hdr.b_numa_node, ann_size, -size);
+	arc_account_charge(hdr, -size);
+}
+
+static int
+arc_account_compare(const void *x1, const void *x2)
+{
+	const arc_account_t *a1 = x1, *a2 = x2;
+
+	int cmp = TREE_CMP(a1->aa_spa, a2->aa_spa);
+	if (likely(cmp))
+		return (cmp);
+
+	return (TREE_CMP(a1->aa_objset, a2->aa_objset));
+}
+
+/*
+ * Return the account of the given dataset, or 0 if it has none.
+ */
+static uint16_t
+arc_account_lookup(uint64_t spa, uint64_t objset)
+{
+	arc_account_t search, *aa;
+	uint16_t id = 0;
+
+	if (arc_account_count <= 1)
+		return (0);
+
+	search.aa_spa = spa;
+	search.aa_objset = objset;
+	rw_enter(&arc_account_lock, RW_READER);
+	if ((aa = avl_find(&arc_account_tree, &search, NULL)) != NULL)
+		id = aa->aa_id;
+	rw_exit(&arc_account_lock);
+
+	return (id);
+}
+
+/*
+ * The objset whose account a block is charged to.  Dedup table blocks are
+ * pulled out of the MOS into their pool's ARC_ACCOUNT_DDT account, which
+ * carries the dedup_table_arc_reserve pool property.
+ */
+static inline uint64_t
+arc_account_objset(const zbookmark_phys_t *zb, dmu_object_type_t type)
+{
+	if (zb->zb_objset == DMU_META_OBJSET && type == DMU_OT_DDT_ZAP)
+		return (ARC_ACCOUNT_DDT);
+	return (zb->zb_objset);
+}
+
+/*
+ * Total bytes charged to the DDT accounts of all pools.
+ */
+static uint64_t
+arc_account_ddt_size(void)
+{
+	uint64_t size = 0;
+
+	rw_enter(&arc_account_lock, RW_READER);
+	for (uint_t id = 1; id < arc_account_count; id++) {
+		arc_account_t *aa = arc_accounts[id];
+		if (aa->aa_objset == ARC_ACCOUNT_DDT)
+			size += aggsum_value(&aa->aa_size);
+	}
+	rw_exit(&arc_account_lock);
+
+	return (size);
+}
+
+/*
+ * Charge an L1 header, and whatever buffers it currently holds, to a
+ * different account.
+ */
+static void
+arc_hdr_set_account(arc_buf_hdr_t *hdr, uint16_t id)
+{
+	uint64_t size = 0;
+
+	ASSERT(HDR_HAS_L1HDR(hdr));
+	if (hdr->b_l1hdr.b_account == id)
+		return;
+
+	if (hdr->b_l1hdr.b_pabd != NULL)
+		size += arc_hdr_size(hdr);
+	if (HDR_HAS_RABD(hdr))
+		size += HDR_GET_PSIZE(hdr);
+
+	arc_account_charge(hdr, -size);
+	hdr->b_l1hdr.b_account = id;
+	arc_account_charge(hdr, size);
+}
+
+/*
+ * Returns true if the header's account is within its reservation, in which
+ * case arc_evict() should leave the header alone.
+ */
+static boolean_t
+arc_hdr_reserved(arc_buf_hdr_t *hdr)
+{
+	uint16_t id = hdr->b_l1hdr.b_account;
+
+	if (id == 0 || (hdr->b_l1hdr.b_pabd == NULL && !HDR_HAS_RABD(hdr)))
+		return (B_FALSE);
+
+	arc_account_t *aa = arc_accounts[id];
+	return (aa->aa_reserve != 0 &&
+	    aggsum_upper_bound(&aa->aa_size) <= aa->aa_reserve);
+}
+
+static void
+arc_account_set_impl(arc_account_t *aa, uint64_t limit, uint64_t reserve)
+{
+	ASSERT(RW_WRITE_HELD(&arc_account_lock));
+
+	/*
+	 * Reservations are only honoured up to arc_c_min in total, which
+	 * the ARC never shrinks below, so that reserved buffers can never
+	 * keep arc_evict() from reaching its target.
+	 */
+	arc_account_reserved -= aa->aa_reserve;
+	reserve = MIN(reserve,
+	    arc_c_min - MIN(arc_c_min, arc_account_reserved));
+	if (limit != 0)
+		reserve = MIN(reserve, limit);
+
+	aa->aa_limit = limit;
+	aa->aa_reserve = reserve;
+	arc_account_reserved += reserve;
+	if (limit != 0)
+		arc_accounts_over = B_TRUE;
+}
+
+/*
+ * Find a free account, either a new one or one which has been released
+ * and has nothing charged to it any more.
+ */
+static arc_account_t *
+arc_account_alloc(void)
+{
+	arc_account_t *aa;
+
+	ASSERT(RW_WRITE_HELD(&arc_account_lock));
+
+	if (arc_account_count < ARC_ACCOUNT_MAX) {
+		aa = kmem_zalloc(sizeof (arc_account_t), KM_SLEEP);
+		aggsum_init(&aa->aa_size, 0);
+		aa->aa_id = arc_account_count;
+		arc_accounts[aa->aa_id] = aa;
+		membar_producer();
+		arc_account_count++;
+		return (aa);
+	}
+
+	for (uint_t id = 1; id < arc_account_count; id++) {
+		aa = arc_accounts[id];
+		if (aa->aa_holds == 0 && aggsum_value(&aa->aa_size) == 0) {
+			avl_remove(&arc_account_tree, aa);
+			return (aa);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Take a hold on the account of a dataset, creating it if necessary.
+ * Returns 0 if we have run out of accounts, in which case the dataset's
+ * buffers are not accounted.
+ */
+uint16_t
+arc_account_hold(spa_t *spa, uint64_t objset)
+{
+	arc_account_t search, *aa;
+
+	search.aa_spa = spa_load_guid(spa);
+	search.aa_objset = objset;
+
+	rw_enter(&arc_account_lock, RW_WRITER);
+	if ((aa = avl_find(&arc_account_tree, &search, NULL)) == NULL) {
+		if ((aa = arc_account_alloc()) == NULL) {
+			rw_exit(&arc_account_lock);
+			zfs_dbgmsg("out of ARC accounts for objset %llu",
+			    (u_longlong_t)objset);
+			return (0);
+		}
+		aa->aa_spa = search.aa_spa;
+		aa->aa_objset = objset;
+		avl_add(&arc_account_tree, aa);
+	}
+	aa->aa_holds++;
+	rw_exit(&arc_account_lock);
+
+	return (aa->aa_id);
+}
+
+void
+arc_account_rele(uint16_t id)
+{
+	if (id == 0)
+		return;
+
+	rw_enter(&arc_account_lock, RW_WRITER);
+	arc_account_t *aa = arc_accounts[id];
+	ASSERT3U(aa->aa_holds, >, 0);
+	if (--aa->aa_holds == 0)
+		arc_account_set_impl(aa, 0, 0);
+	rw_exit(&arc_account_lock);
+}
+
+/*
+ * Set the arc_limit and arc_reserve of an account, 0 meaning none.
+ */
+void
+arc_account_set(uint16_t id, uint64_t limit, uint64_t reserve)
+{
+	if (id == 0)
+		return;
+
+	rw_enter(&arc_account_lock, RW_WRITER);
+	arc_account_set_impl(arc_accounts[id], limit, reserve);
+	rw_exit(&arc_account_lock);
+}
+
+uint64_t
+arc_account_size(uint16_t id)
+{
+	if (id == 0)
+		return (0);
+
+	return (aggsum_value(&arc_accounts[id]->aa_size));
 }
 
 /*
@@ -3309,6 +3973,8 @@ arc_hdr_alloc(uint64_t spa, int32_t psize, int32_t lsize,
 	hdr->b_l1hdr.b_mru_ghost_hits = 0;
 	hdr->b_l1hdr.b_mfu_hits = 0;
 	hdr->b_l1hdr.b_mfu_ghost_hits = 0;
+	hdr->b_l1hdr.b_numa_node = arc_numa_cur_node();
+	hdr->b_l1hdr.b_account = 0;
 	hdr->b_l1hdr.b_buf = NULL;
 
 	ASSERT(zfs_refcount_is_zero(&hdr->b_l1hdr.b_refcnt));
@@ -3349,6 +4015,8 @@ arc_hdr_realloc(arc_buf_hdr_t *hdr, kmem_cache_t *old, kmem_cache_t *new)
 		 * l2c_only even though it's about to change.
 		 */
 		nhdr->b_l1hdr.b_state = arc_l2c_only;
+		nhdr->b_l1hdr.b_numa_node = arc_numa_cur_node();
+		nhdr->b_l1hdr.b_account = 0;
 
 		/* Verify previous threads set to NULL before freeing */
 		ASSERT0P(nhdr->b_l1hdr.b_pabd);
@@ -3899,7 +4567,7 @@ arc_set_need_free(void)
 
 static uint64_t
 arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
-    uint64_t spa, uint64_t bytes)
+    uint64_t spa, uint16_t account, boolean_t reserve, uint64_t bytes)
 {
 	multilist_sublist_t *mls;
 	uint64_t bytes_evicted = 0, real_evicted = 0;
@@ -3947,6 +4615,10 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 			continue;
 		}
 
+		/* or only those charged to a certain dataset */
+		if (account != 0 && hdr->b_l1hdr.b_account != account)
+			continue;
+
 		hash_lock = HDR_LOCK(hdr);
 
 		/*
@@ -3961,6 +4633,12 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 		ASSERT(!MUTEX_HELD(hash_lock));
 
 		if (mutex_tryenter(hash_lock)) {
+			if (reserve && arc_hdr_reserved(hdr)) {
+				mutex_exit(hash_lock);
+				ARCSTAT_BUMP(arcstat_dataset_reserve_skip);
+				continue;
+			}
+
 			uint64_t revicted;
 			uint64_t evicted = arc_evict_hdr(hdr, &revicted);
 			mutex_exit(hash_lock);
@@ -3983,6 +4661,9 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 
 	multilist_sublist_unlock(mls);
 
+	ARC_NUMA_INCR(idx / multilist_get_group_sublists(ml), ann_evicted,
+	    bytes_evicted);
+
 	/*
 	 * Increment the count of evicted bytes, and wake up any threads that
 	 * are waiting for the count to reach this value.  Since the list is
@@ -4070,6 +4751,8 @@ typedef struct evict_arg {
 	arc_buf_hdr_t		*eva_marker;
 	int			eva_idx;
 	uint64_t		eva_spa;
+	uint16_t		eva_account;
+	boolean_t		eva_reserve;
 	uint64_t		eva_bytes;
 	uint64_t		eva_evicted;
 } evict_arg_t;
@@ -4079,7 +4762,8 @@ arc_evict_task(void *arg)
 {
 	evict_arg_t *eva = arg;
 	eva->eva_evicted = arc_evict_state_impl(eva->eva_ml, eva->eva_idx,
-	    eva->eva_marker, eva->eva_spa, eva->eva_bytes);
+	    eva->eva_marker, eva->eva_spa, eva->eva_account,
+	    eva->eva_reserve, eva->eva_bytes);
 }
 
 static void
@@ -4113,6 +4797,22 @@ arc_evict_thread_init(void)
 	}
 }
 
+/*
+ * Pick the sublist to start evicting from.  When the state lists are split
+ * by NUMA node, start at a random sublist of the node which most recently
+ * waited for eviction, so that most of its memory is freed first.
+ */
+static int
+arc_evict_start_index(multilist_t *ml)
+{
+	uint_t nsub = multilist_get_group_sublists(ml);
+
+	if (multilist_get_num_groups(ml) == 1)
+		return (multilist_get_random_index(ml));
+
+	return (arc_evict_node * nsub + random_in_range(nsub));
+}
+
 /*
  * The minimum number of bytes we can evict at once is a block size.
  * So, SPA_MAXBLOCKSIZE is a reasonable minimal value per an eviction task.
@@ -4132,12 +4832,18 @@ arc_evict_thread_init(void)
  * If bytes is specified using the special value ARC_EVICT_ALL, this
  * will evict all available (i.e. unlocked and evictable) buffers from
  * the given arc state; which is used by arc_flush().
+ *
+ * If account is non-zero, only buffers charged to that dataset are
+ * evicted.  Otherwise, unless flushing, buffers of datasets within their
+ * arc_reserve are left alone.
  */
 static uint64_t
 arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
-    uint64_t bytes)
+    uint16_t account, uint64_t bytes)
 {
 	uint64_t total_evicted = 0;
+	boolean_t reserve = (spa == 0 && account == 0 &&
+	    bytes != ARC_EVICT_ALL && arc_account_reserved != 0);
 	multilist_t *ml = &state->arcs_list[type];
 	int num_sublists;
 	arc_buf_hdr_t **markers;
@@ -4179,6 +4885,8 @@ arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
 				taskq_init_ent(&eva[i].eva_tqent);
 				eva[i].eva_ml = ml;
 				eva[i].eva_spa = spa;
+				eva[i].eva_account = account;
+				eva[i].eva_reserve = reserve;
 			}
 		} else {
 			/*
@@ -4197,7 +4905,7 @@ arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
 	 */
 	uint64_t scan_evicted = 0;
 	int sublists_left = num_sublists;
-	int sublist_idx = multilist_get_random_index(ml);
+	int sublist_idx = arc_evict_start_index(ml);
 
 	/*
 	 * While we haven't hit our target number of bytes to evict, or
@@ -4259,7 +4967,8 @@ arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
 				break;
 
 			bytes_evicted = arc_evict_state_impl(ml, sublist_idx,
-			    markers[sublist_idx], spa, bytes_remaining);
+			    markers[sublist_idx], spa, account, reserve,
+			    bytes_remaining);
 
 			scan_evicted += bytes_evicted;
 			total_evicted += bytes_evicted;
@@ -4303,7 +5012,7 @@ arc_evict_state(arc_state_t *state, arc_buf_contents_t type, uint64_t spa,
 		 */
 		if (sublists_left == 0) {
 			sublists_left = num_sublists;
-			sublist_idx = multilist_get_random_index(ml);
+			sublist_idx = arc_evict_start_index(ml);
 			scan_evicted = 0;
 
 			/*
@@ -4351,7 +5060,8 @@ arc_flush_state(arc_state_t *state, uint64_t spa, arc_buf_contents_t type,
 	uint64_t evicted = 0;
 
 	while (zfs_refcount_count(&state->arcs_esize[type]) != 0) {
-		evicted += arc_evict_state(state, type, spa, ARC_EVICT_ALL);
+		evicted += arc_evict_state(state, type, spa, 0,
+		    ARC_EVICT_ALL);
 
 		if (!retry)
 			break;
@@ -4375,12 +5085,55 @@ arc_evict_impl(arc_state_t *state, arc_buf_contents_t type, int64_t bytes)
 	if (bytes > 0 && zfs_refcount_count(&state->arcs_esize[type]) > 0) {
 		delta = MIN(zfs_refcount_count(&state->arcs_esize[type]),
 		    bytes);
-		return (arc_evict_state(state, type, 0, delta));
+		return (arc_evict_state(state, type, 0, 0, delta));
 	}
 
 	return (0);
 }
 
+/*
+ * Trim every dataset which has grown past its arc_limit back down to it,
+ * taking from MRU before MFU and from data before metadata.
+ */
+static uint64_t
+arc_evict_accounts(void)
+{
+	arc_state_t *states[] = { arc_mru, arc_mfu };
+	arc_buf_contents_t types[] = { ARC_BUFC_DATA, ARC_BUFC_METADATA };
+	uint64_t total_evicted = 0;
+
+	arc_accounts_over = B_FALSE;
+	arc_last_account_evict = ddi_get_lbolt();
+
+	uint_t count = arc_account_count;
+	membar_consumer();
+	for (uint_t id = 1; id < count; id++) {
+		arc_account_t *aa = arc_accounts[id];
+		uint64_t limit = aa->aa_limit;
+		uint64_t evicted = 0;
+
+		if (limit == 0)
+			continue;
+
+		uint64_t size = aggsum_value(&aa->aa_size);
+		if (size <= limit)
+			continue;
+
+		for (int s = 0; s < ARRAY_SIZE(states); s++) {
+			for (int t = 0; t < ARRAY_SIZE(types); t++) {
+				if (evicted >= size - limit)
+					break;
+				evicted += arc_evict_state(states[s], types[t],
+				    0, id, size - limit - evicted);
+			}
+		}
+		ARCSTAT_INCR(arcstat_dataset_limit_evicted, evicted);
+		total_evicted += evicted;
+	}
+
+	return (total_evicted);
+}
+
 /*
  * Adjust specified fraction, taking into account initial ghost state(s) size,
  * ghost hit bytes towards increasing the fraction, ghost hit bytes towards
@@ -4481,7 +5234,7 @@ arc_evict(void)
 	arc_pd = arc_evict_adj(arc_pd, gsrd + gsfd, grd, gfd, 100);
 	arc_pm = arc_evict_adj(arc_pm, gsrm + gsfm, grm, gfm, 100);
 
-	uint64_t asize = aggsum_value(&arc_sums.arcstat_size);
+	uint64_t asize = pcsum_value(&arc_sums.arcstat_size);
 	uint64_t ac = arc_c;
 	int64_t wt = t - (asize - ac);
 
@@ -4490,7 +5243,7 @@ arc_evict(void)
 	 * target is not evictable or if they go over arc_dnode_limit.
 	 */
 	int64_t prune = 0;
-	int64_t dn = aggsum_value(&arc_sums.arcstat_dnode_size);
+	int64_t dn = pcsum_value(&arc_sums.arcstat_dnode_size);
 	int64_t nem = zfs_refcount_count(&arc_mru->arcs_size[ARC_BUFC_METADATA])
 	    + zfs_refcount_count(&arc_mfu->arcs_size[ARC_BUFC_METADATA])
 	    - zfs_refcount_count(&arc_mru->arcs_esize[ARC_BUFC_METADATA])
@@ -4593,6 +5346,8 @@ arc_flush_impl(uint64_t guid, boolean_t retry)
 
 	(void) arc_flush_state(arc_uncached, guid, ARC_BUFC_DATA, retry);
 	(void) arc_flush_state(arc_uncached, guid, ARC_BUFC_METADATA, retry);
+
+	arc_dcache_flush(guid);
 }
 
 void
@@ -4699,10 +5454,10 @@ uint64_t
 arc_reduce_target_size(uint64_t to_free)
 {
 	/*
-	 * Get the actual arc size.  Even if we don't need it, this updates
-	 * the aggsum lower bound estimate for arc_is_overflowing().
+	 * Get the actual arc size.  Even if we don't need it, this folds
+	 * the per-CPU deltas into the estimate for arc_is_overflowing().
 	 */
-	uint64_t asize = aggsum_value(&arc_sums.arcstat_size);
+	uint64_t asize = pcsum_value(&arc_sums.arcstat_size);
 
 	/*
 	 * All callers want the ARC to actually evict (at least) this much
@@ -4720,6 +5475,7 @@ arc_reduce_target_size(uint64_t to_free)
 	} else {
 		to_free = 0;
 	}
+	atomic_add_64(&arc_reclaim_bytes, to_free);
 
 	/*
 	 * Since dbuf cache size is a fraction of target ARC size, we should
@@ -4832,6 +5588,15 @@ arc_evict_cb_check(void *arg, zthr_t *zthr)
 	if (arc_evict_needed)
 		return (B_TRUE);
 
+	/*
+	 * If some dataset has grown past its arc_limit, trim it, but not
+	 * more often than every ARC_ACCOUNT_EVICT_MS in case its buffers
+	 * can't be evicted.
+	 */
+	if (arc_accounts_over && ddi_get_lbolt() - arc_last_account_evict >
+	    MSEC_TO_TICK(ARC_ACCOUNT_EVICT_MS))
+		return (B_TRUE);
+
 	/*
 	 * If we have buffers in uncached state, evict them periodically.
 	 */
@@ -4858,6 +5623,10 @@ arc_evict_cb(void *arg, zthr_t *zthr)
 	evicted += arc_flush_state(arc_uncached, 0, ARC_BUFC_DATA, B_FALSE);
 	evicted += arc_flush_state(arc_uncached, 0, ARC_BUFC_METADATA, B_FALSE);
 
+	/* Trim datasets that have grown past their arc_limit. */
+	if (arc_accounts_over)
+		evicted += arc_evict_accounts();
+
 	/* Evict from other states only if told to. */
 	if (arc_evict_needed)
 		evicted += arc_evict();
@@ -4879,7 +5648,7 @@ arc_evict_cb(void *arg, zthr_t *zthr)
 	 */
 	mutex_enter(&arc_evict_lock);
 	arc_evict_needed = !zthr_iscancelled(zthr) &&
-	    evicted > 0 && aggsum_compare(&arc_sums.arcstat_size, arc_c) > 0;
+	    evicted > 0 && pcsum_compare(&arc_sums.arcstat_size, arc_c) > 0;
 	if (!arc_evict_needed) {
 		/*
 		 * We're either no longer overflowing, or we
@@ -4903,6 +5672,21 @@ arc_reap_cb_check(void *arg, zthr_t *zthr)
 
 	int64_t free_memory = arc_available_memory();
 	static int reap_cb_check_counter = 0;
+	hrtime_t now = gethrtime();
+
+	/*
+	 * Fold the target size reductions requested since the last update
+	 * into the decaying average of the reclaim rate.
+	 */
+	if (now - arc_reclaim_time >= SEC2NSEC(1)) {
+		uint64_t rate = atomic_swap_64(&arc_reclaim_bytes, 0) *
+		    MILLISEC / NSEC2MSEC(now - arc_reclaim_time);
+		if (arc_reclaim_time == 0)
+			rate = 0;
+		arc_reclaim_pressure += ((int64_t)rate -
+		    (int64_t)arc_reclaim_pressure) / 8;
+		arc_reclaim_time = now;
+	}
 
 	/*
 	 * If a kmem reap is already active, don't schedule more.  We must
@@ -4923,7 +5707,15 @@ arc_reap_cb_check(void *arg, zthr_t *zthr)
 		return (B_TRUE);
 	} else if (free_memory < arc_c >> arc_no_grow_shift) {
 		arc_no_grow = B_TRUE;
-	} else if (gethrtime() >= arc_growtime) {
+	} else if (arc_reclaim_pressure > arc_c >> arc_shrink_shift) {
+		/*
+		 * The kernel is still steadily asking for memory back, even
+		 * though there is free memory right now.  Growing would only
+		 * invite the next shrink, so hold the target until the
+		 * pressure has decayed.
+		 */
+		arc_no_grow = B_TRUE;
+	} else if (now >= arc_growtime) {
 		arc_no_grow = B_FALSE;
 	}
 
@@ -4953,8 +5745,10 @@ arc_reap_cb(void *arg, zthr_t *zthr)
 	fstrans_cookie_t cookie = spl_fstrans_mark();
 
 	/*
-	 * Kick off asynchronous kmem_reap()'s of all our caches.
+	 * Kick off asynchronous kmem_reap()'s of all our caches, after
+	 * giving back the memory held by the decompressed side cache.
 	 */
+	arc_dcache_flush(0);
 	arc_kmem_reap_soon();
 
 	/*
@@ -5059,7 +5853,7 @@ arc_adapt(uint64_t bytes)
 	 * If we're within (2 * maxblocksize) bytes of the target
 	 * cache size, increment the target cache size
 	 */
-	if (aggsum_upper_bound(&arc_sums.arcstat_size) +
+	if (pcsum_estimate(&arc_sums.arcstat_size) +
 	    2 * SPA_MAXBLOCKSIZE >= arc_c) {
 		uint64_t dc = MAX(bytes, SPA_OLD_MAXBLOCKSIZE);
 		if (atomic_add_64_nv(&arc_c, dc) > arc_c_max)
@@ -5074,17 +5868,15 @@ static arc_ovf_level_t
 arc_is_overflowing(boolean_t lax, boolean_t use_reserve)
 {
 	/*
-	 * We just compare the lower bound here for performance reasons. Our
+	 * We just compare the estimate here for performance reasons. Our
 	 * primary goals are to make sure that the arc never grows without
 	 * bound, and that it can reach its maximum size. This check
 	 * accomplishes both goals. The maximum amount we could run over by is
-	 * 2 * aggsum_borrow_multiplier * NUM_CPUS * the average size of a block
-	 * in the ARC. In practice, that's in the tens of MB, which is low
-	 * enough to be safe.
+	 * 2 * ARC_SUM_BATCH * NUM_CPUS, which is low enough to be safe.
 	 */
-	int64_t arc_over = aggsum_lower_bound(&arc_sums.arcstat_size) - arc_c -
+	int64_t arc_over = pcsum_estimate(&arc_sums.arcstat_size) - arc_c -
 	    zfs_max_recordsize;
-	int64_t dn_over = aggsum_lower_bound(&arc_sums.arcstat_dnode_size) -
+	int64_t dn_over = pcsum_estimate(&arc_sums.arcstat_dnode_size) -
 	    arc_dnode_limit;
 
 	/* Always allow at least one block of overflow. */
@@ -5169,6 +5961,7 @@ arc_wait_for_eviction(uint64_t amount, boolean_t lax, boolean_t use_reserve)
 
 		uint64_t last_count = 0;
 		mutex_enter(&arc_evict_lock);
+		arc_evict_node = arc_numa_cur_node();
 		if (!list_is_empty(&arc_evict_waiters)) {
 			arc_evict_waiter_t *last =
 			    list_tail(&arc_evict_waiters);
@@ -5777,6 +6570,112 @@ arc_read_done(zio_t *zio)
 	}
 }
 
+static void
+arc_sketch_init(void)
+{
+	arc_sketch_t *as = &arc_sketch;
+	uint64_t width = ARC_SKETCH_MIN_WIDTH;
+
+	/* Roughly one counter per 128K of maximum ARC size. */
+	while (width < ARC_SKETCH_MAX_WIDTH &&
+	    (width << SPA_OLD_MAXBLOCKSHIFT) < arc_c_max)
+		width <<= 1;
+
+	as->as_mask = width - 1;
+	as->as_window = width * 10;
+	as->as_incrs = 0;
+	for (int i = 0; i < ARC_SKETCH_ROWS; i++)
+		as->as_counts[i] = vmem_zalloc(width, KM_SLEEP);
+}
+
+static void
+arc_sketch_fini(void)
+{
+	arc_sketch_t *as = &arc_sketch;
+
+	for (int i = 0; i < ARC_SKETCH_ROWS; i++) {
+		vmem_free(as->as_counts[i], as->as_mask + 1);
+		as->as_counts[i] = NULL;
+	}
+}
+
+/*
+ * Halve every counter, so that the sketch tracks recent frequency rather
+ * than all-time popularity.  The counters are updated without locking;
+ * a lost update only makes the estimate slightly less accurate.
+ */
+static void
+arc_sketch_age(arc_sketch_t *as)
+{
+	for (int i = 0; i < ARC_SKETCH_ROWS; i++) {
+		uint8_t *row = as->as_counts[i];
+		for (uint64_t j = 0; j <= as->as_mask; j++)
+			row[j] >>= 1;
+	}
+}
+
+/*
+ * Return the estimated access frequency of the given hash, first counting
+ * one more access if 'record' is set.  Each row is indexed by a different
+ * combination of the two halves of the hash.
+ */
+static uint_t
+arc_sketch_frequency(arc_sketch_t *as, uint64_t hash, boolean_t record)
+{
+	uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+	uint_t freq = ARC_SKETCH_MAX_FREQ;
+
+	for (int i = 0; i < ARC_SKETCH_ROWS; i++) {
+		uint8_t *cnt = &as->as_counts[i][(h1 + i * h2) & as->as_mask];
+		if (record && *cnt < ARC_SKETCH_MAX_FREQ)
+			(*cnt)++;
+		freq = MIN(freq, *cnt);
+	}
+
+	if (record && atomic_inc_64_nv(&as->as_incrs) % as->as_window == 0)
+		arc_sketch_age(as);
+
+	return (freq);
+}
+
+/*
+ * Return the estimated recent access frequency of the given block, first
+ * counting one more access to it if 'record' is set.
+ */
+uint_t
+arc_frequency(spa_t *spa, const blkptr_t *bp, boolean_t record)
+{
+	uint64_t hash = buf_hash(spa_load_guid(spa), BP_IDENTITY(bp),
+	    BP_GET_PHYSICAL_BIRTH(bp));
+
+	return (arc_sketch_frequency(&arc_sketch, hash, record));
+}
+
+/*
+ * Decide whether a data block of a primarycache=filtered dataset should be
+ * cached by the ARC, counting one access to it if 'record' is set.  This is
+ * called by the DMU before reading a block; when it returns B_FALSE the
+ * caller reads the block with ARC_FLAG_UNCACHED.  While the ARC is still
+ * below its target size every block is admitted.
+ */
+boolean_t
+arc_admit(spa_t *spa, const blkptr_t *bp, boolean_t record)
+{
+	if (BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp))
+		return (B_TRUE);
+
+	uint_t freq = arc_frequency(spa, bp, record);
+
+	if (freq >= zfs_arc_admission_min_freq ||
+	    pcsum_estimate(&arc_sums.arcstat_size) < arc_c) {
+		ARCSTAT_BUMP(arcstat_admission_admitted);
+		return (B_TRUE);
+	}
+
+	ARCSTAT_BUMP(arcstat_admission_rejected);
+	return (B_FALSE);
+}
+
 /*
  * Lookup the block at the specified DVA (in bp), and return the manner in
  * which the block is cached. A zero return indicates not cached.
@@ -6010,6 +6909,13 @@ top:
 
 		DTRACE_PROBE1(arc__hit, arc_buf_hdr_t *, hdr);
 		arc_access(hdr, *arc_flags, B_TRUE);
+		if (arc_numa != NULL) {
+			uint8_t node = arc_numa_cur_node();
+			if (node == hdr->b_l1hdr.b_numa_node)
+				ARC_NUMA_INCR(node, ann_hits, 1);
+			else
+				ARC_NUMA_INCR(node, ann_remote_hits, 1);
+		}
 
 		if (done && !no_buf) {
 			ASSERT(!embedded_bp || !BP_IS_HOLE(bp));
@@ -6192,7 +7098,10 @@ top:
 		if (!embedded_bp)
 			arc_access(hdr, *arc_flags, B_FALSE);
 		arc_hdr_set_flags(hdr, ARC_FLAG_IO_IN_PROGRESS);
+		arc_hdr_set_account(hdr, arc_account_lookup(guid,
+		    arc_account_objset(zb, BP_GET_TYPE(bp))));
 		arc_hdr_alloc_abd(hdr, alloc_flags);
+		ARC_NUMA_INCR(arc_numa_cur_node(), ann_misses, 1);
 		if (encrypted_read) {
 			ASSERT(HDR_HAS_RABD(hdr));
 			size = HDR_GET_PSIZE(hdr);
@@ -6440,6 +7349,54 @@ done:
 	goto out;
 }
 
+/*
+ * Issue arc_read() for a vector of blocks at once.  All reads that miss
+ * in the cache are issued as children of a single parent zio, which hangs
+ * off 'pio' if one is given; hits are satisfied immediately, exactly as
+ * they would be by arc_read().  If 'wait' is set, return only once every
+ * read has completed, with the first error encountered; otherwise return
+ * the first error reported synchronously by arc_read(), while the reads
+ * themselves proceed asynchronously.  Per-block results are left in
+ * arr_error and arr_flags either way.
+ */
+int
+arc_read_batch(zio_t *pio, spa_t *spa, arc_read_req_t *reqs, uint_t nreqs,
+    zio_priority_t priority, boolean_t wait)
+{
+	zio_t *rio;
+	int error = 0;
+
+	if (nreqs == 0)
+		return (0);
+
+	if (pio != NULL)
+		rio = zio_null(pio, spa, NULL, NULL, NULL, ZIO_FLAG_CANFAIL);
+	else
+		rio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+
+	for (uint_t i = 0; i < nreqs; i++) {
+		arc_read_req_t *arr = &reqs[i];
+
+		arr->arr_flags &= ~ARC_FLAG_WAIT;
+		arr->arr_flags |= ARC_FLAG_NOWAIT;
+		arr->arr_error = arc_read(rio, spa, arr->arr_bp, arr->arr_done,
+		    arr->arr_private, priority, arr->arr_zio_flags,
+		    &arr->arr_flags, arr->arr_zb);
+		if (error == 0)
+			error = arr->arr_error;
+	}
+
+	if (wait) {
+		int werror = zio_wait(rio);
+		if (error == 0)
+			error = werror;
+	} else {
+		zio_nowait(rio);
+	}
+
+	return (error);
+}
+
 arc_prune_t *
 arc_add_prune_callback(arc_prune_func_t *func, void *private)
 {
@@ -7050,6 +8007,10 @@ arc_write(zio_t *pio, spa_t *spa, uint64_t txg,
 		arc_hdr_set_flags(hdr, ARC_FLAG_UNCACHED);
 	else if (l2arc)
 		arc_hdr_set_flags(hdr, ARC_FLAG_L2CACHE);
+	if (zb != NULL) {
+		arc_hdr_set_account(hdr, arc_account_lookup(spa_load_guid(spa),
+		    arc_account_objset(zb, zp->zp_type)));
+	}
 
 	if (ARC_BUF_ENCRYPTED(buf)) {
 		ASSERT(ARC_BUF_COMPRESSED(buf));
@@ -7310,7 +8271,7 @@ arc_kstat_update(kstat_t *ksp, int rw)
 	as->arcstat_hash_chains.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_hash_chains);
 	as->arcstat_size.value.ui64 =
-	    aggsum_value(&arc_sums.arcstat_size);
+	    pcsum_value(&arc_sums.arcstat_size);
 	as->arcstat_compressed_size.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_compressed_size);
 	as->arcstat_uncompressed_size.value.ui64 =
@@ -7328,7 +8289,7 @@ arc_kstat_update(kstat_t *ksp, int rw)
 #if defined(COMPAT_FREEBSD11)
 	as->arcstat_other_size.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_bonus_size) +
-	    aggsum_value(&arc_sums.arcstat_dnode_size) +
+	    pcsum_value(&arc_sums.arcstat_dnode_size) +
 	    wmsum_value(&arc_sums.arcstat_dbuf_size);
 #endif
 
@@ -7370,7 +8331,7 @@ arc_kstat_update(kstat_t *ksp, int rw)
 	    &as->arcstat_uncached_evictable_metadata);
 
 	as->arcstat_dnode_size.value.ui64 =
-	    aggsum_value(&arc_sums.arcstat_dnode_size);
+	    pcsum_value(&arc_sums.arcstat_dnode_size);
 	as->arcstat_bonus_size.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_bonus_size);
 	as->arcstat_l2_hits.value.ui64 =
@@ -7422,7 +8383,7 @@ arc_kstat_update(kstat_t *ksp, int rw)
 	as->arcstat_l2_psize.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_l2_psize);
 	as->arcstat_l2_hdr_size.value.ui64 =
-	    aggsum_value(&arc_sums.arcstat_l2_hdr_size);
+	    pcsum_value(&arc_sums.arcstat_l2_hdr_size);
 	as->arcstat_l2_log_blk_writes.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_l2_log_blk_writes);
 	as->arcstat_l2_log_blk_asize.value.ui64 =
@@ -7489,6 +8450,23 @@ arc_kstat_update(kstat_t *ksp, int rw)
 	    wmsum_value(&arc_sums.arcstat_cached_only_in_progress);
 	as->arcstat_abd_chunk_waste_size.value.ui64 =
 	    wmsum_value(&arc_sums.arcstat_abd_chunk_waste_size);
+	as->arcstat_admission_admitted.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_admission_admitted);
+	as->arcstat_admission_rejected.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_admission_rejected);
+	as->arcstat_dataset_limit_evicted.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_dataset_limit_evicted);
+	as->arcstat_dataset_reserve_skip.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_dataset_reserve_skip);
+	as->arcstat_dcache_hits.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_dcache_hits);
+	as->arcstat_dcache_misses.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_dcache_misses);
+	as->arcstat_dcache_size.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_dcache_size);
+	as->arcstat_dcache_evicted.value.ui64 =
+	    wmsum_value(&arc_sums.arcstat_dcache_evicted);
+	as->arcstat_ddt_size.value.ui64 = arc_account_ddt_size();
 
 	return (0);
 }
@@ -7499,6 +8477,9 @@ arc_kstat_update(kstat_t *ksp, int rw)
  * code is laid out; arc_evict_state() assumes ARC buffers are evenly
  * distributed between all sublists and uses this assumption when
  * deciding which sublist to evict from and how much to evict from it.
+ *
+ * When the state lists are split by NUMA node, the distribution is only
+ * even within the group of sublists of the header's home node.
  */
 static unsigned int
 arc_state_multilist_index_func(multilist_t *ml, void *obj)
@@ -7525,8 +8506,12 @@ arc_state_multilist_index_func(multilist_t *ml, void *obj)
 	 * would not be evenly distributed. In this context full 64bit
 	 * division would be a waste of time, so limit it to 32 bits.
 	 */
-	return ((unsigned int)buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth) %
-	    multilist_get_num_sublists(ml));
+	unsigned int hash = (unsigned int)buf_hash(hdr->b_spa, &hdr->b_dva,
+	    hdr->b_birth);
+	unsigned int nsub = multilist_get_group_sublists(ml);
+
+	ASSERT3U(hdr->b_l1hdr.b_numa_node, <, multilist_get_num_groups(ml));
+	return (hdr->b_l1hdr.b_numa_node * nsub + hash % nsub);
 }
 
 static unsigned int
@@ -7616,8 +8601,9 @@ static void
 arc_state_multilist_init(multilist_t *ml,
     multilist_sublist_index_func_t *index_func, int *maxcountp)
 {
-	multilist_create(ml, sizeof (arc_buf_hdr_t),
-	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node), index_func);
+	multilist_create_grouped(ml, sizeof (arc_buf_hdr_t),
+	    offsetof(arc_buf_hdr_t, b_l1hdr.b_arc_node), arc_numa_nodes,
+	    index_func);
 	*maxcountp = MAX(*maxcountp, multilist_get_num_sublists(ml));
 }
 
@@ -7732,7 +8718,7 @@ arc_state_init(void)
 	wmsum_init(&arc_sums.arcstat_hash_elements, 0);
 	wmsum_init(&arc_sums.arcstat_hash_collisions, 0);
 	wmsum_init(&arc_sums.arcstat_hash_chains, 0);
-	aggsum_init(&arc_sums.arcstat_size, 0);
+	pcsum_init(&arc_sums.arcstat_size, 0, ARC_SUM_BATCH);
 	wmsum_init(&arc_sums.arcstat_compressed_size, 0);
 	wmsum_init(&arc_sums.arcstat_uncompressed_size, 0);
 	wmsum_init(&arc_sums.arcstat_overhead_size, 0);
@@ -7740,7 +8726,7 @@ arc_state_init(void)
 	wmsum_init(&arc_sums.arcstat_data_size, 0);
 	wmsum_init(&arc_sums.arcstat_metadata_size, 0);
 	wmsum_init(&arc_sums.arcstat_dbuf_size, 0);
-	aggsum_init(&arc_sums.arcstat_dnode_size, 0);
+	pcsum_init(&arc_sums.arcstat_dnode_size, 0, ARC_SUM_BATCH);
 	wmsum_init(&arc_sums.arcstat_bonus_size, 0);
 	wmsum_init(&arc_sums.arcstat_l2_hits, 0);
 	wmsum_init(&arc_sums.arcstat_l2_misses, 0);
@@ -7766,7 +8752,7 @@ arc_state_init(void)
 	wmsum_init(&arc_sums.arcstat_l2_io_error, 0);
 	wmsum_init(&arc_sums.arcstat_l2_lsize, 0);
 	wmsum_init(&arc_sums.arcstat_l2_psize, 0);
-	aggsum_init(&arc_sums.arcstat_l2_hdr_size, 0);
+	pcsum_init(&arc_sums.arcstat_l2_hdr_size, 0, ARC_SUM_BATCH);
 	wmsum_init(&arc_sums.arcstat_l2_log_blk_writes, 0);
 	wmsum_init(&arc_sums.arcstat_l2_log_blk_asize, 0);
 	wmsum_init(&arc_sums.arcstat_l2_log_blk_count, 0);
@@ -7796,6 +8782,14 @@ arc_state_init(void)
 	wmsum_init(&arc_sums.arcstat_raw_size, 0);
 	wmsum_init(&arc_sums.arcstat_cached_only_in_progress, 0);
 	wmsum_init(&arc_sums.arcstat_abd_chunk_waste_size, 0);
+	wmsum_init(&arc_sums.arcstat_admission_admitted, 0);
+	wmsum_init(&arc_sums.arcstat_admission_rejected, 0);
+	wmsum_init(&arc_sums.arcstat_dataset_limit_evicted, 0);
+	wmsum_init(&arc_sums.arcstat_dataset_reserve_skip, 0);
+	wmsum_init(&arc_sums.arcstat_dcache_hits, 0);
+	wmsum_init(&arc_sums.arcstat_dcache_misses, 0);
+	wmsum_init(&arc_sums.arcstat_dcache_size, 0);
+	wmsum_init(&arc_sums.arcstat_dcache_evicted, 0);
 
 	arc_anon->arcs_state = ARC_STATE_ANON;
 	arc_mru->arcs_state = ARC_STATE_MRU;
@@ -7891,7 +8885,7 @@ arc_state_fini(void)
 	wmsum_fini(&arc_sums.arcstat_hash_elements);
 	wmsum_fini(&arc_sums.arcstat_hash_collisions);
 	wmsum_fini(&arc_sums.arcstat_hash_chains);
-	aggsum_fini(&arc_sums.arcstat_size);
+	pcsum_fini(&arc_sums.arcstat_size);
 	wmsum_fini(&arc_sums.arcstat_compressed_size);
 	wmsum_fini(&arc_sums.arcstat_uncompressed_size);
 	wmsum_fini(&arc_sums.arcstat_overhead_size);
@@ -7899,7 +8893,7 @@ arc_state_fini(void)
 	wmsum_fini(&arc_sums.arcstat_data_size);
 	wmsum_fini(&arc_sums.arcstat_metadata_size);
 	wmsum_fini(&arc_sums.arcstat_dbuf_size);
-	aggsum_fini(&arc_sums.arcstat_dnode_size);
+	pcsum_fini(&arc_sums.arcstat_dnode_size);
 	wmsum_fini(&arc_sums.arcstat_bonus_size);
 	wmsum_fini(&arc_sums.arcstat_l2_hits);
 	wmsum_fini(&arc_sums.arcstat_l2_misses);
@@ -7925,7 +8919,7 @@ arc_state_fini(void)
 	wmsum_fini(&arc_sums.arcstat_l2_io_error);
 	wmsum_fini(&arc_sums.arcstat_l2_lsize);
 	wmsum_fini(&arc_sums.arcstat_l2_psize);
-	aggsum_fini(&arc_sums.arcstat_l2_hdr_size);
+	pcsum_fini(&arc_sums.arcstat_l2_hdr_size);
 	wmsum_fini(&arc_sums.arcstat_l2_log_blk_writes);
 	wmsum_fini(&arc_sums.arcstat_l2_log_blk_asize);
 	wmsum_fini(&arc_sums.arcstat_l2_log_blk_count);
@@ -7955,6 +8949,14 @@ arc_state_fini(void)
 	wmsum_fini(&arc_sums.arcstat_raw_size);
 	wmsum_fini(&arc_sums.arcstat_cached_only_in_progress);
 	wmsum_fini(&arc_sums.arcstat_abd_chunk_waste_size);
+	wmsum_fini(&arc_sums.arcstat_admission_admitted);
+	wmsum_fini(&arc_sums.arcstat_admission_rejected);
+	wmsum_fini(&arc_sums.arcstat_dataset_limit_evicted);
+	wmsum_fini(&arc_sums.arcstat_dataset_reserve_skip);
+	wmsum_fini(&arc_sums.arcstat_dcache_hits);
+	wmsum_fini(&arc_sums.arcstat_dcache_misses);
+	wmsum_fini(&arc_sums.arcstat_dcache_size);
+	wmsum_fini(&arc_sums.arcstat_dcache_evicted);
 }
 
 uint64_t
@@ -7973,6 +8975,130 @@ arc_set_limits(uint64_t allmem)
 	arc_c_max = arc_default_max(arc_c_min, allmem);
 }
 
+static const arc_numa_stats_t arc_numa_stats_template = {
+	{ "hits",			KSTAT_DATA_UINT64 },
+	{ "remote_hits",		KSTAT_DATA_UINT64 },
+	{ "misses",			KSTAT_DATA_UINT64 },
+	{ "size",			KSTAT_DATA_UINT64 },
+	{ "evicted",			KSTAT_DATA_UINT64 },
+};
+
+static int
+arc_numa_kstat_update(kstat_t *ksp, int rw)
+{
+	arc_numa_node_t *ann = ksp->ks_private;
+	arc_numa_stats_t *ans = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+
+	ans->arcnumastat_hits.value.ui64 = wmsum_value(&ann->ann_hits);
+	ans->arcnumastat_remote_hits.value.ui64 =
+	    wmsum_value(&ann->ann_remote_hits);
+	ans->arcnumastat_misses.value.ui64 = wmsum_value(&ann->ann_misses);
+	ans->arcnumastat_size.value.ui64 = wmsum_value(&ann->ann_size);
+	ans->arcnumastat_evicted.value.ui64 = wmsum_value(&ann->ann_evicted);
+
+	return (0);
+}
+
+/*
+ * Decide whether to split the ARC state lists by NUMA node.  This has to
+ * happen before arc_state_init() creates the lists, and cannot change for
+ * the lifetime of the module since the node is part of the sublist index.
+ */
+static void
+arc_numa_init(void)
+{
+	arc_numa_nodes = 1;
+	if (zfs_arc_numa == 0 || max_nnodes < 2)
+		return;
+
+	arc_numa_nodes = MIN(max_nnodes, ARC_NUMA_MAX_NODES);
+	arc_numa = kmem_zalloc(sizeof (arc_numa_node_t) * arc_numa_nodes,
+	    KM_SLEEP);
+
+	for (uint_t i = 0; i < arc_numa_nodes; i++) {
+		arc_numa_node_t *ann = &arc_numa[i];
+		char name[KSTAT_STRLEN];
+
+		wmsum_init(&ann->ann_hits, 0);
+		wmsum_init(&ann->ann_remote_hits, 0);
+		wmsum_init(&ann->ann_misses, 0);
+		wmsum_init(&ann->ann_size, 0);
+		wmsum_init(&ann->ann_evicted, 0);
+		ann->ann_stats = arc_numa_stats_template;
+
+		(void) snprintf(name, sizeof (name), "arcstats_node%u", i);
+		ann->ann_ksp = kstat_create("zfs", 0, name, "misc",
+		    KSTAT_TYPE_NAMED, sizeof (arc_numa_stats_t) /
+		    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+		if (ann->ann_ksp != NULL) {
+			ann->ann_ksp->ks_data = &ann->ann_stats;
+			ann->ann_ksp->ks_private = ann;
+			ann->ann_ksp->ks_update = arc_numa_kstat_update;
+			kstat_install(ann->ann_ksp);
+		}
+	}
+}
+
+static void
+arc_account_init(void)
+{
+	rw_init(&arc_account_lock, NULL, RW_DEFAULT, NULL);
+	avl_create(&arc_account_tree, arc_account_compare,
+	    sizeof (arc_account_t), offsetof(arc_account_t, aa_node));
+	arc_accounts = vmem_zalloc(sizeof (arc_account_t *) * ARC_ACCOUNT_MAX,
+	    KM_SLEEP);
+	/* Index 0 is reserved for "not accounted". */
+	arc_account_count = 1;
+	arc_account_reserved = 0;
+	arc_accounts_over = B_FALSE;
+}
+
+static void
+arc_account_fini(void)
+{
+	void *cookie = NULL;
+	arc_account_t *aa;
+
+	while ((aa = avl_destroy_nodes(&arc_account_tree, &cookie)) != NULL)
+		;
+	for (uint_t id = 1; id < arc_account_count; id++) {
+		aa = arc_accounts[id];
+		ASSERT0(aa->aa_holds);
+		aggsum_fini(&aa->aa_size);
+		kmem_free(aa, sizeof (arc_account_t));
+	}
+	vmem_free(arc_accounts, sizeof (arc_account_t *) * ARC_ACCOUNT_MAX);
+	arc_accounts = NULL;
+	arc_account_count = 0;
+	avl_destroy(&arc_account_tree);
+	rw_destroy(&arc_account_lock);
+}
+
+static void
+arc_numa_fini(void)
+{
+	if (arc_numa == NULL)
+		return;
+
+	for (uint_t i = 0; i < arc_numa_nodes; i++) {
+		arc_numa_node_t *ann = &arc_numa[i];
+
+		if (ann->ann_ksp != NULL)
+			kstat_delete(ann->ann_ksp);
+		wmsum_fini(&ann->ann_hits);
+		wmsum_fini(&ann->ann_remote_hits);
+		wmsum_fini(&ann->ann_misses);
+		wmsum_fini(&ann->ann_size);
+		wmsum_fini(&ann->ann_evicted);
+	}
+	kmem_free(arc_numa, sizeof (arc_numa_node_t) * arc_numa_nodes);
+	arc_numa = NULL;
+	arc_numa_nodes = 1;
+}
+
 void
 arc_init(void)
 {
@@ -8039,7 +9165,11 @@ arc_init(void)
 
 	arc_register_hotplug();
 
+	arc_numa_init();
+	arc_account_init();
 	arc_state_init();
+	arc_sketch_init();
+	arc_dcache_init();
 
 	buf_init();
 
@@ -8174,7 +9304,7 @@ arc_fini(void)
 	 * to occur before arc_state_fini() runs and destroys the aggsum
 	 * values which are updated when freeing scatter ABDs.
 	 */
-	l2arc_do_free_on_write();
+	l2arc_do_free_on_write(NULL);
 
 	/*
 	 * buf_fini() must proceed arc_state_fini() because buf_fin() may
@@ -8182,7 +9312,11 @@ arc_fini(void)
 	 * arc_space_return() which accesses aggsums freed in act_state_fini().
 	 */
 	buf_fini();
+	arc_dcache_fini();
+	arc_sketch_fini();
 	arc_state_fini();
+	arc_account_fini();
+	arc_numa_fini();
 
 	arc_unregister_hotplug();
 
@@ -8533,14 +9667,28 @@ l2arc_dev_invalid(const l2arc_dev_t *dev)
 	    dev->l2ad_spa == NULL || dev->l2ad_spa->spa_is_exporting);
 }
 
+/*
+ * A device is busy if another feed thread is writing to it, or if it is not
+ * yet due for its next feed.
+ */
+static boolean_t
+l2arc_dev_busy(const l2arc_dev_t *dev, clock_t now)
+{
+	return (dev->l2ad_feeding || dev->l2ad_feed_next > now);
+}
+
 /*
  * Cycle through L2ARC devices.  This is how L2ARC load balances.
- * If a device is returned, this also returns holding the spa config lock.
+ * If a device is returned, this also returns holding the spa config lock,
+ * and the device is marked as being fed until l2arc_dev_put() is called.
+ * If no device is due, *nextp is lowered to the earliest time at which
+ * one will be.
  */
 static l2arc_dev_t *
-l2arc_dev_get_next(void)
+l2arc_dev_get_next(clock_t *nextp)
 {
 	l2arc_dev_t *first, *next = NULL;
+	clock_t now = ddi_get_lbolt();
 
 	/*
 	 * Lock out the removal of spas (spa_namespace_lock), then removal
@@ -8573,13 +9721,18 @@ l2arc_dev_get_next(void)
 			break;
 
 		ASSERT3P(next, !=, NULL);
-	} while (l2arc_dev_invalid(next));
+		if (!l2arc_dev_invalid(next) && !next->l2ad_feeding)
+			*nextp = MIN(*nextp, next->l2ad_feed_next);
+	} while (l2arc_dev_invalid(next) || l2arc_dev_busy(next, now));
 
 	/* if we were unable to find any usable vdevs, return NULL */
-	if (l2arc_dev_invalid(next))
+	if (l2arc_dev_invalid(next) || l2arc_dev_busy(next, now)) {
 		next = NULL;
-
-	l2arc_dev_last = next;
+	} else {
+		next->l2ad_feeding = B_TRUE;
+		next->l2ad_feed_slice = l2arc_feed_slice++ % l2arc_nfeeders;
+		l2arc_dev_last = next;
+	}
 
 out:
 	mutex_exit(&l2arc_dev_mtx);
@@ -8596,15 +9749,40 @@ out:
 }
 
 /*
- * Free buffers that were tagged for destruction.
+ * Release a device returned by l2arc_dev_get_next(), scheduling its next
+ * feed at 'next', and drop the spa config lock.
+ */
+static void
+l2arc_dev_put(l2arc_dev_t *dev, clock_t next)
+{
+	spa_t *spa = dev->l2ad_spa;
+
+	mutex_enter(&l2arc_dev_mtx);
+	ASSERT(dev->l2ad_feeding);
+	dev->l2ad_feed_next = next;
+	dev->l2ad_feeding = B_FALSE;
+	mutex_exit(&l2arc_dev_mtx);
+
+	spa_config_exit(spa, SCL_L2ARC, dev);
+}
+
+/*
+ * Free buffers that were tagged for destruction once the write to the given
+ * device completed, or all of them if dev is NULL.  Writes to other cache
+ * devices may still be in flight from other feed threads, so their buffers
+ * must be left alone.
  */
 static void
-l2arc_do_free_on_write(void)
+l2arc_do_free_on_write(l2arc_dev_t *dev)
 {
-	l2arc_data_free_t *df;
+	l2arc_data_free_t *df, *df_next;
 
 	mutex_enter(&l2arc_free_on_write_mtx);
-	while ((df = list_remove_head(l2arc_free_on_write)) != NULL) {
+	for (df = list_head(l2arc_free_on_write); df != NULL; df = df_next) {
+		df_next = list_next(l2arc_free_on_write, df);
+		if (dev != NULL && df->l2df_dev != dev)
+			continue;
+		list_remove(l2arc_free_on_write, df);
 		ASSERT3P(df->l2df_abd, !=, NULL);
 		abd_free(df->l2df_abd);
 		kmem_free(df, sizeof (l2arc_data_free_t));
@@ -8795,7 +9973,7 @@ top:
 	ASSERT(dev->l2ad_vdev != NULL);
 	vdev_space_update(dev->l2ad_vdev, -bytes_dropped, 0, 0);
 
-	l2arc_do_free_on_write();
+	l2arc_do_free_on_write(dev);
 
 	kmem_free(cb, sizeof (l2arc_write_callback_t));
 }
@@ -8922,14 +10100,25 @@ l2arc_read_done(zio_t *zio)
 	 * move it and free the buffer.
 	 */
 	if (cb->l2rcb_abd != NULL) {
-		ASSERT3U(arc_hdr_size(hdr), <, zio->io_size);
+		/*
+		 * As in arc_read(), a compressed L2ARC block read while
+		 * Compressed ARC is disabled is only PSIZE bytes long.
+		 */
+		uint64_t size = arc_hdr_size(hdr);
+		if (HDR_GET_COMPRESS(hdr) != ZIO_COMPRESS_OFF &&
+		    !HDR_COMPRESSION_ENABLED(hdr) &&
+		    HDR_GET_PSIZE(hdr) != 0) {
+			size = HDR_GET_PSIZE(hdr);
+		}
+
+		ASSERT3U(size, <, zio->io_size);
 		if (zio->io_error == 0) {
 			if (using_rdata) {
 				abd_copy(hdr->b_crypt_hdr.b_rabd,
-				    cb->l2rcb_abd, arc_hdr_size(hdr));
+				    cb->l2rcb_abd, size);
 			} else {
 				abd_copy(hdr->b_l1hdr.b_pabd,
-				    cb->l2rcb_abd, arc_hdr_size(hdr));
+				    cb->l2rcb_abd, size);
 			}
 		}
 
@@ -9043,7 +10232,7 @@ l2arc_read_done(zio_t *zio)
  * the lock pointer.
  */
 static multilist_sublist_t *
-l2arc_sublist_lock(int list_num)
+l2arc_sublist_lock(int list_num, const l2arc_dev_t *dev)
 {
 	multilist_t *ml = NULL;
 	unsigned int idx;
@@ -9072,8 +10261,21 @@ l2arc_sublist_lock(int list_num)
 	 * because the caller feeds only a little bit of data for each
 	 * call (8MB). Subsequent calls will result in different
 	 * sublists being selected.
+	 *
+	 * With several feed threads, each feed picks from its own
+	 * interleaved slice of the sublists, so that concurrent feeds
+	 * to different devices neither contend on the same sublist lock
+	 * nor walk over each other's markers.  Slices are handed out in
+	 * turn by l2arc_dev_get_next(), so a lone device still sees all
+	 * of them over successive feeds.
 	 */
 	idx = multilist_get_random_index(ml);
+	unsigned int nsub = multilist_get_num_sublists(ml);
+	if (l2arc_nfeeders > 1 && nsub >= l2arc_nfeeders) {
+		idx = idx - (idx % l2arc_nfeeders) + dev->l2ad_feed_slice;
+		if (idx >= nsub)
+			idx -= l2arc_nfeeders;
+	}
 	return (multilist_sublist_lock_idx(ml, idx));
 }
 
@@ -9516,7 +10718,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 		 * Until the ARC is warm and starts to evict, read from the
 		 * head of the ARC lists rather than the tail.
 		 */
-		multilist_sublist_t *mls = l2arc_sublist_lock(pass);
+		multilist_sublist_t *mls = l2arc_sublist_lock(pass, dev);
 		ASSERT3P(mls, !=, NULL);
 		if (from_head)
 			hdr = multilist_sublist_head(mls);
@@ -9621,7 +10823,8 @@ skip:
 					goto next;
 				}
 
-				l2arc_free_abd_on_write(to_write, asize, type);
+				l2arc_free_abd_on_write(dev, to_write, asize,
+				    type);
 			}
 
 			hdr->b_l2hdr.b_dev = dev;
@@ -9743,7 +10946,7 @@ next:
 static boolean_t
 l2arc_hdr_limit_reached(void)
 {
-	int64_t s = aggsum_upper_bound(&arc_sums.arcstat_l2_hdr_size);
+	int64_t s = pcsum_estimate(&arc_sums.arcstat_l2_hdr_size);
 
 	return (arc_reclaim_needed() ||
 	    (s > (arc_warm ? arc_c : arc_c_max) * l2arc_meta_percent / 100));
@@ -9751,12 +10954,13 @@ l2arc_hdr_limit_reached(void)
 
 /*
  * This thread feeds the L2ARC at regular intervals.  This is the beating
- * heart of the L2ARC.
+ * heart of the L2ARC.  Up to l2arc_feed_threads of these run concurrently,
+ * each writing to a different cache device.
  */
 static  __attribute__((noreturn)) void
-l2arc_feed_thread(void *unused)
+l2arc_feed_thread(void *arg)
 {
-	(void) unused;
+	l2arc_feeder_t *lf = arg;
 	callb_cpr_t cpr;
 	l2arc_dev_t *dev;
 	spa_t *spa;
@@ -9764,16 +10968,15 @@ l2arc_feed_thread(void *unused)
 	clock_t begin, next = ddi_get_lbolt();
 	fstrans_cookie_t cookie;
 
-	CALLB_CPR_INIT(&cpr, &l2arc_feed_thr_lock, callb_generic_cpr, FTAG);
+	CALLB_CPR_INIT(&cpr, &lf->lf_lock, callb_generic_cpr, FTAG);
 
-	mutex_enter(&l2arc_feed_thr_lock);
+	mutex_enter(&lf->lf_lock);
 
 	cookie = spl_fstrans_mark();
-	while (l2arc_thread_exit == 0) {
+	while (!lf->lf_exit) {
 		CALLB_CPR_SAFE_BEGIN(&cpr);
-		(void) cv_timedwait_idle(&l2arc_feed_thr_cv,
-		    &l2arc_feed_thr_lock, next);
-		CALLB_CPR_SAFE_END(&cpr, &l2arc_feed_thr_lock);
+		(void) cv_timedwait_idle(&lf->lf_cv, &lf->lf_lock, next);
+		CALLB_CPR_SAFE_END(&cpr, &lf->lf_lock);
 		next = ddi_get_lbolt() + hz;
 
 		/*
@@ -9790,15 +10993,18 @@ l2arc_feed_thread(void *unused)
 		/*
 		 * This selects the next l2arc device to write to, and in
 		 * doing so the next spa to feed from: dev->l2ad_spa.   This
-		 * will return NULL if there are now no l2arc devices or if
-		 * they are all faulted.
+		 * will return NULL if there are now no l2arc devices, if
+		 * they are all faulted, or if they are all being fed by
+		 * other threads or not yet due.
 		 *
 		 * If a device is returned, its spa's config lock is also
 		 * held to prevent device removal.  l2arc_dev_get_next()
 		 * will grab and release l2arc_dev_mtx.
 		 */
-		if ((dev = l2arc_dev_get_next()) == NULL)
+		if ((dev = l2arc_dev_get_next(&next)) == NULL) {
+			next = MAX(next, begin + 1);
 			continue;
+		}
 
 		spa = dev->l2ad_spa;
 		ASSERT3P(spa, !=, NULL);
@@ -9808,8 +11014,8 @@ l2arc_feed_thread(void *unused)
 		 * sleep a little longer.
 		 */
 		if (!spa_writeable(spa)) {
-			next = ddi_get_lbolt() + 5 * l2arc_feed_secs * hz;
-			spa_config_exit(spa, SCL_L2ARC, dev);
+			l2arc_dev_put(dev,
+			    ddi_get_lbolt() + 5 * l2arc_feed_secs * hz);
 			continue;
 		}
 
@@ -9818,7 +11024,7 @@ l2arc_feed_thread(void *unused)
 		 */
 		if (l2arc_hdr_limit_reached()) {
 			ARCSTAT_BUMP(arcstat_l2_abort_lowmem);
-			spa_config_exit(spa, SCL_L2ARC, dev);
+			l2arc_dev_put(dev, next);
 			continue;
 		}
 
@@ -9840,13 +11046,13 @@ l2arc_feed_thread(void *unused)
 		 * Calculate interval between writes.
 		 */
 		next = l2arc_write_interval(begin, size, wrote);
-		spa_config_exit(spa, SCL_L2ARC, dev);
+		l2arc_dev_put(dev, next);
 	}
 	spl_fstrans_unmark(cookie);
 
-	l2arc_thread_exit = 0;
-	cv_broadcast(&l2arc_feed_thr_cv);
-	CALLB_CPR_EXIT(&cpr);		/* drops l2arc_feed_thr_lock */
+	lf->lf_exit = B_FALSE;
+	cv_broadcast(&lf->lf_cv);
+	CALLB_CPR_EXIT(&cpr);		/* drops lf->lf_lock */
 	thread_exit();
 }
 
@@ -10165,11 +11371,8 @@ l2arc_remove_vdev(vdev_t *vd)
 void
 l2arc_init(void)
 {
-	l2arc_thread_exit = 0;
 	l2arc_ndev = 0;
 
-	mutex_init(&l2arc_feed_thr_lock, NULL, MUTEX_DEFAULT, NULL);
-	cv_init(&l2arc_feed_thr_cv, NULL, CV_DEFAULT, NULL);
 	mutex_init(&l2arc_rebuild_thr_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&l2arc_rebuild_thr_cv, NULL, CV_DEFAULT, NULL);
 	mutex_init(&l2arc_dev_mtx, NULL, MUTEX_DEFAULT, NULL);
@@ -10186,8 +11389,6 @@ l2arc_init(void)
 void
 l2arc_fini(void)
 {
-	mutex_destroy(&l2arc_feed_thr_lock);
-	cv_destroy(&l2arc_feed_thr_cv);
 	mutex_destroy(&l2arc_rebuild_thr_lock);
 	cv_destroy(&l2arc_rebuild_thr_cv);
 	mutex_destroy(&l2arc_dev_mtx);
@@ -10203,8 +11404,18 @@ l2arc_start(void)
 	if (!(spa_mode_global & SPA_MODE_WRITE))
 		return;
 
-	(void) thread_create(NULL, 0, l2arc_feed_thread, NULL, 0, &p0,
-	    TS_RUN, defclsyspri);
+	l2arc_nfeeders = MAX(1, MIN(l2arc_feed_threads, max_ncpus));
+	l2arc_feeders = kmem_zalloc(sizeof (l2arc_feeder_t) * l2arc_nfeeders,
+	    KM_SLEEP);
+	for (uint_t i = 0; i < l2arc_nfeeders; i++) {
+		l2arc_feeder_t *lf = &l2arc_feeders[i];
+
+		mutex_init(&lf->lf_lock, NULL, MUTEX_DEFAULT, NULL);
+		cv_init(&lf->lf_cv, NULL, CV_DEFAULT, NULL);
+		lf->lf_id = i;
+		(void) thread_create(NULL, 0, l2arc_feed_thread, lf, 0, &p0,
+		    TS_RUN, defclsyspri);
+	}
 }
 
 void
@@ -10213,12 +11424,21 @@ l2arc_stop(void)
 	if (!(spa_mode_global & SPA_MODE_WRITE))
 		return;
 
-	mutex_enter(&l2arc_feed_thr_lock);
-	cv_signal(&l2arc_feed_thr_cv);	/* kick thread out of startup */
-	l2arc_thread_exit = 1;
-	while (l2arc_thread_exit != 0)
-		cv_wait(&l2arc_feed_thr_cv, &l2arc_feed_thr_lock);
-	mutex_exit(&l2arc_feed_thr_lock);
+	for (uint_t i = 0; i < l2arc_nfeeders; i++) {
+		l2arc_feeder_t *lf = &l2arc_feeders[i];
+
+		mutex_enter(&lf->lf_lock);
+		cv_signal(&lf->lf_cv);	/* kick thread out of startup */
+		lf->lf_exit = B_TRUE;
+		while (lf->lf_exit)
+			cv_wait(&lf->lf_cv, &lf->lf_lock);
+		mutex_exit(&lf->lf_lock);
+		mutex_destroy(&lf->lf_lock);
+		cv_destroy(&lf->lf_cv);
+	}
+	kmem_free(l2arc_feeders, sizeof (l2arc_feeder_t) * l2arc_nfeeders);
+	l2arc_feeders = NULL;
+	l2arc_nfeeders = 0;
 }
 
 /*
@@ -10283,6 +11503,27 @@ l2arc_spa_rebuild_stop(spa_t *spa)
 	}
 }
 
+/*
+ * Log blocks which have been read and validated by l2arc_rebuild() are
+ * restored by a taskq with a single thread, which keeps them in order, while
+ * the rebuild thread goes on reading the following log blocks.  At most
+ * L2ARC_REBUILD_RESTORE_DEPTH of them are waiting to be restored.
+ */
+#define	L2ARC_REBUILD_RESTORE_DEPTH	4
+
+typedef struct l2arc_rebuild_pipe {
+	kmutex_t	lrp_lock;
+	kcondvar_t	lrp_cv;
+	uint_t		lrp_pending;
+} l2arc_rebuild_pipe_t;
+
+typedef struct l2arc_rebuild_restore {
+	l2arc_dev_t		*lrr_dev;
+	l2arc_rebuild_pipe_t	*lrr_pipe;
+	l2arc_log_blk_phys_t	*lrr_lb;
+	l2arc_log_blkptr_t	lrr_lbp;
+} l2arc_rebuild_restore_t;
+
 /*
  * Main entry point for L2ARC rebuilding.
  */
@@ -10322,12 +11563,19 @@ l2arc_rebuild(l2arc_dev_t *dev)
 	l2arc_log_blk_phys_t	*this_lb, *next_lb;
 	zio_t			*this_io = NULL, *next_io = NULL;
 	l2arc_log_blkptr_t	lbps[2];
-	l2arc_lb_ptr_buf_t	*lb_ptr_buf;
+	l2arc_rebuild_pipe_t	pipe;
+	taskq_t			*restore_tq;
 	boolean_t		lock_held;
 
 	this_lb = vmem_zalloc(sizeof (*this_lb), KM_SLEEP);
 	next_lb = vmem_zalloc(sizeof (*next_lb), KM_SLEEP);
 
+	mutex_init(&pipe.lrp_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&pipe.lrp_cv, NULL, CV_DEFAULT, NULL);
+	pipe.lrp_pending = 0;
+	restore_tq = taskq_create("l2arc_rebuild", 1, defclsyspri, 1,
+	    INT_MAX, 0);
+
 	/*
 	 * We prevent device removal while issuing reads to the device,
 	 * then during the rebuilding phases we drop this lock again so
@@ -10392,29 +11640,25 @@ l2arc_rebuild(l2arc_dev_t *dev)
 
 		/*
 		 * Now that we know that the next_lb checks out alright, we
-		 * can start reconstruction from this log block.
-		 * L2BLK_GET_PSIZE returns aligned size for log blocks.
+		 * can hand this log block over for reconstruction and read
+		 * the next one in the meantime.
 		 */
-		uint64_t asize = L2BLK_GET_PSIZE((&lbps[0])->lbp_prop);
-		l2arc_log_blk_restore(dev, this_lb, asize);
-
-		/*
-		 * log block restored, include its pointer in the list of
-		 * pointers to log blocks present in the L2ARC device.
-		 */
-		lb_ptr_buf = kmem_zalloc(sizeof (l2arc_lb_ptr_buf_t), KM_SLEEP);
-		lb_ptr_buf->lb_ptr = kmem_zalloc(sizeof (l2arc_log_blkptr_t),
+		l2arc_log_blkptr_t prev_lbp = this_lb->lb_prev_lbp;
+		l2arc_rebuild_restore_t *lrr = kmem_alloc(sizeof (*lrr),
 		    KM_SLEEP);
-		memcpy(lb_ptr_buf->lb_ptr, &lbps[0],
-		    sizeof (l2arc_log_blkptr_t));
-		mutex_enter(&dev->l2ad_mtx);
-		list_insert_tail(&dev->l2ad_lbptr_list, lb_ptr_buf);
-		ARCSTAT_INCR(arcstat_l2_log_blk_asize, asize);
-		ARCSTAT_BUMP(arcstat_l2_log_blk_count);
-		zfs_refcount_add_many(&dev->l2ad_lb_asize, asize, lb_ptr_buf);
-		zfs_refcount_add(&dev->l2ad_lb_count, lb_ptr_buf);
-		mutex_exit(&dev->l2ad_mtx);
-		vdev_space_update(vd, asize, 0, 0);
+		lrr->lrr_dev = dev;
+		lrr->lrr_pipe = &pipe;
+		lrr->lrr_lb = this_lb;
+		lrr->lrr_lbp = lbps[0];
+
+		mutex_enter(&pipe.lrp_lock);
+		while (pipe.lrp_pending >= L2ARC_REBUILD_RESTORE_DEPTH)
+			cv_wait(&pipe.lrp_cv, &pipe.lrp_lock);
+		pipe.lrp_pending++;
+		mutex_exit(&pipe.lrp_lock);
+		VERIFY3U(taskq_dispatch(restore_tq, l2arc_log_blk_restore_task,
+		    lrr, TQ_SLEEP), !=, TASKQID_INVALID);
+		this_lb = vmem_zalloc(sizeof (*this_lb), KM_SLEEP);
 
 		/*
 		 * Protection against loops of log blocks:
@@ -10471,7 +11715,7 @@ l2arc_rebuild(l2arc_dev_t *dev)
 		 * Continue with the next log block.
 		 */
 		lbps[0] = lbps[1];
-		lbps[1] = this_lb->lb_prev_lbp;
+		lbps[1] = prev_lbp;
 		PTR_SWAP(this_lb, next_lb);
 		this_io = next_io;
 		next_io = NULL;
@@ -10485,6 +11729,13 @@ out:
 	vmem_free(this_lb, sizeof (*this_lb));
 	vmem_free(next_lb, sizeof (*next_lb));
 
+	/* Wait for the log blocks already read to be restored. */
+	taskq_wait(restore_tq);
+	taskq_destroy(restore_tq);
+	ASSERT0(pipe.lrp_pending);
+	cv_destroy(&pipe.lrp_cv);
+	mutex_destroy(&pipe.lrp_lock);
+
 	if (err == ECANCELED) {
 		/*
 		 * In case the rebuild was canceled do not log to spa history
@@ -10772,6 +12023,45 @@ l2arc_log_blk_restore(l2arc_dev_t *dev, const l2arc_log_blk_phys_t *lb,
 	ARCSTAT_BUMP(arcstat_l2_rebuild_log_blks);
 }
 
+/*
+ * Restores a log block handed over by l2arc_rebuild() and includes its
+ * pointer in the list of pointers to log blocks present in the L2ARC device.
+ */
+static void
+l2arc_log_blk_restore_task(void *arg)
+{
+	l2arc_rebuild_restore_t *lrr = arg;
+	l2arc_rebuild_pipe_t *pipe = lrr->lrr_pipe;
+	l2arc_dev_t *dev = lrr->lrr_dev;
+	l2arc_lb_ptr_buf_t *lb_ptr_buf;
+
+	/* L2BLK_GET_PSIZE returns aligned size for log blocks. */
+	uint64_t asize = L2BLK_GET_PSIZE((&lrr->lrr_lbp)->lbp_prop);
+	l2arc_log_blk_restore(dev, lrr->lrr_lb, asize);
+
+	lb_ptr_buf = kmem_zalloc(sizeof (l2arc_lb_ptr_buf_t), KM_SLEEP);
+	lb_ptr_buf->lb_ptr = kmem_zalloc(sizeof (l2arc_log_blkptr_t),
+	    KM_SLEEP);
+	memcpy(lb_ptr_buf->lb_ptr, &lrr->lrr_lbp,
+	    sizeof (l2arc_log_blkptr_t));
+	mutex_enter(&dev->l2ad_mtx);
+	list_insert_tail(&dev->l2ad_lbptr_list, lb_ptr_buf);
+	ARCSTAT_INCR(arcstat_l2_log_blk_asize, asize);
+	ARCSTAT_BUMP(arcstat_l2_log_blk_count);
+	zfs_refcount_add_many(&dev->l2ad_lb_asize, asize, lb_ptr_buf);
+	zfs_refcount_add(&dev->l2ad_lb_count, lb_ptr_buf);
+	mutex_exit(&dev->l2ad_mtx);
+	vdev_space_update(dev->l2ad_vdev, asize, 0, 0);
+
+	vmem_free(lrr->lrr_lb, sizeof (*lrr->lrr_lb));
+	kmem_free(lrr, sizeof (*lrr));
+
+	mutex_enter(&pipe->lrp_lock);
+	pipe->lrp_pending--;
+	cv_signal(&pipe->lrp_cv);
+	mutex_exit(&pipe->lrp_lock);
+}
+
 /*
  * Restores a single ARC buf hdr from a log entry. The ARC buffer is put
  * into a state indicating that it has been evicted to L2ARC.
@@ -11240,6 +12530,9 @@ ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, trim_ahead, U64, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, feed_secs, U64, ZMOD_RW,
 	"Seconds between L2ARC writing");
 
+ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, feed_threads, UINT, ZMOD_RD,
+	"Max number of concurrent L2ARC feed threads");
+
 ZFS_MODULE_PARAM(zfs_l2arc, l2arc_, feed_min_ms, U64, ZMOD_RW,
 	"Min feed interval in milliseconds");
 
@@ -11280,6 +12573,13 @@ ZFS_MODULE_PARAM_CALL(zfs_arc, zfs_arc_, dnode_limit_percent,
     param_set_arc_int, param_get_uint, ZMOD_RW,
 	"Percent of ARC meta buffers for dnodes");
 
+ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, dcache_max_bytes, U64, ZMOD_RW,
+	"Max size in bytes of the decompressed block side cache");
+
+ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, dcache_shift, UINT, ZMOD_RW,
+	"Set size of the decompressed block side cache to log2 fraction of "
+	"arc size");
+
 ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, dnode_reduce_percent, UINT, ZMOD_RW,
 	"Percentage of excess dnodes to try to unpin");
 
@@ -11294,3 +12594,9 @@ ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, prune_task_threads, INT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, evict_threads, UINT, ZMOD_RD,
 	"Number of threads to use for ARC eviction.");
+
+ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, numa, INT, ZMOD_RD,
+	"Split ARC state lists and eviction by NUMA node");
+
+ZFS_MODULE_PARAM(zfs_arc, zfs_arc_, admission_min_freq, UINT, ZMOD_RW,
+	"Minimum access count to admit a primarycache=filtered data block");
@@ -29,12 +29,43 @@
 #include <sys/blake3.h>
 #include <sys/abd.h>
 
+typedef struct blake3_iter {
+	BLAKE3_CTX	*bi_ctx;
+	uint8_t		*bi_buf;	/* gather buffer, NULL if unused */
+	size_t		bi_len;		/* bytes pending in bi_buf */
+} blake3_iter_t;
+
+/*
+ * A scattered ABD comes in page-sized pieces, which BLAKE3 can only spread
+ * over a few SIMD lanes at a time.  Gather those into BLAKE3_GATHER_LEN
+ * pieces first, so a wide implementation gets enough chunks to fill its
+ * lanes; the copy is much cheaper than the hashing it speeds up.
+ */
 static int
 blake3_incremental(void *buf, size_t size, void *arg)
 {
-	BLAKE3_CTX *ctx = arg;
+	blake3_iter_t *bi = arg;
+	uint8_t *data = buf;
+
+	if (bi->bi_buf == NULL ||
+	    (bi->bi_len == 0 && size >= BLAKE3_GATHER_LEN)) {
+		Blake3_Update(bi->bi_ctx, buf, size);
+		return (0);
+	}
+
+	while (size > 0) {
+		size_t n = MIN(size, BLAKE3_GATHER_LEN - bi->bi_len);
+
+		memcpy(bi->bi_buf + bi->bi_len, data, n);
+		bi->bi_len += n;
+		data += n;
+		size -= n;
 
-	Blake3_Update(ctx, buf, size);
+		if (bi->bi_len == BLAKE3_GATHER_LEN) {
+			Blake3_Update(bi->bi_ctx, bi->bi_buf, bi->bi_len);
+			bi->bi_len = 0;
+		}
+	}
 
 	return (0);
 }
@@ -49,16 +80,23 @@ abd_checksum_blake3_native(abd_t *abd, uint64_t size, const void *ctx_template,
     zio_cksum_t *zcp)
 {
 	ASSERT(ctx_template != NULL);
+	blake3_iter_t bi = { 0 };
 
 #if defined(_KERNEL)
 	kpreempt_disable();
 	BLAKE3_CTX *ctx = blake3_per_cpu_ctx[CPU_SEQID];
+	if (!abd_is_linear(abd) && size > PAGESIZE)
+		bi.bi_buf = blake3_per_cpu_buf[CPU_SEQID];
 #else
 	BLAKE3_CTX *ctx = kmem_alloc(sizeof (*ctx), KM_SLEEP);
 #endif
 
 	memcpy(ctx, ctx_template, sizeof (*ctx));
-	(void) abd_iterate_func(abd, 0, size, blake3_incremental, ctx);
+	Blake3_SizeHint(ctx, size);
+	bi.bi_ctx = ctx;
+	(void) abd_iterate_func(abd, 0, size, blake3_incremental, &bi);
+	if (bi.bi_len != 0)
+		Blake3_Update(ctx, bi.bi_buf, bi.bi_len);
 	Blake3_Final(ctx, (uint8_t *)zcp);
 
 #if defined(_KERNEL)
@@ -76,6 +76,66 @@ bplist_iterate(bplist_t *bpl, bplist_itor_t *func, void *arg, dmu_tx_t *tx)
 	mutex_exit(&bpl->bpl_lock);
 }
 
+static int
+bplist_entry_compare(const void *x1, const void *x2)
+{
+	const dva_t *dva1 = &(*(bplist_entry_t *const *)x1)->bpe_blk.blk_dva[0];
+	const dva_t *dva2 = &(*(bplist_entry_t *const *)x2)->bpe_blk.blk_dva[0];
+
+	int cmp = TREE_CMP(DVA_GET_VDEV(dva1), DVA_GET_VDEV(dva2));
+	if (likely(cmp))
+		return (cmp);
+
+	return (TREE_CMP(DVA_GET_OFFSET(dva1), DVA_GET_OFFSET(dva2)));
+}
+
+/*
+ * Like bplist_iterate(), but hand the block pointers to the callback
+ * ordered by the vdev and offset of their first DVA rather than in the
+ * order they were appended. When the callback frees the blocks, the frees
+ * then reach each metaslab in one run and in ascending offset order,
+ * instead of bouncing between metaslabs.
+ */
+void
+bplist_iterate_sorted(bplist_t *bpl, bplist_itor_t *func, void *arg,
+    dmu_tx_t *tx)
+{
+	bplist_entry_t *bpe;
+	list_t batch;
+
+	list_create(&batch, sizeof (bplist_entry_t),
+	    offsetof(bplist_entry_t, bpe_node));
+
+	mutex_enter(&bpl->bpl_lock);
+	while (!list_is_empty(&bpl->bpl_list)) {
+		bplist_entry_t **bpes;
+		uint64_t count = 0, i = 0;
+
+		list_move_tail(&batch, &bpl->bpl_list);
+		mutex_exit(&bpl->bpl_lock);
+
+		for (bpe = list_head(&batch); bpe != NULL;
+		    bpe = list_next(&batch, bpe))
+			count++;
+		bpes = vmem_alloc(count * sizeof (*bpes), KM_SLEEP);
+		while ((bpe = list_remove_head(&batch)) != NULL)
+			bpes[i++] = bpe;
+		qsort(bpes, count, sizeof (*bpes), bplist_entry_compare);
+
+		for (i = 0; i < count; i++) {
+			bplist_iterate_last_removed = bpes[i];
+			func(arg, &bpes[i]->bpe_blk, tx);
+			kmem_free(bpes[i], sizeof (bplist_entry_t));
+		}
+		vmem_free(bpes, count * sizeof (*bpes));
+
+		mutex_enter(&bpl->bpl_lock);
+	}
+	mutex_exit(&bpl->bpl_lock);
+
+	list_destroy(&batch);
+}
+
 void
 bplist_clear(bplist_t *bpl)
 {
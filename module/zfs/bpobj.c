@@ -32,6 +32,13 @@
 #include <sys/zfeature.h>
 #include <sys/zap.h>
 
+/*
+ * Number of sub-bpobjs ahead of the one being processed whose headers
+ * bpobj_iterate_impl() prefetches, so that opening each of them does not
+ * have to wait for a synchronous read.
+ */
+#define	BPOBJ_SUBOBJ_PREFETCH	16
+
 /*
  * Return an empty bpobj, preferably the empty dummy one (dp_empty_bpobj).
  */
@@ -480,17 +487,31 @@ bpobj_iterate_impl(bpobj_t *initial_bpo, bpobj_itor_t func, void *arg,
 			ASSERT(bpo->bpo_havecomp);
 			ASSERT0P(bpobj_size);
 
-			/* Add the last subobj to stack. */
+			/*
+			 * Add the last subobj to stack.  Read it together
+			 * with the ids of the subobjs that will be processed
+			 * after it, and prefetch their headers.  Since the
+			 * window slides by one entry per subobj, each of them
+			 * is passed to dmu_prefetch_head() several times, the
+			 * later calls pulling in its first block of blkptrs.
+			 */
 			int64_t i = bpi->bpi_unprocessed_subobjs - 1;
-			uint64_t offset = i * sizeof (uint64_t);
+			int64_t lo = MAX(i - BPOBJ_SUBOBJ_PREFETCH, 0);
+			uint64_t subobjs[BPOBJ_SUBOBJ_PREFETCH + 1];
 
-			uint64_t subobj;
 			err = dmu_read(bpo->bpo_os, bpo->bpo_phys->bpo_subobjs,
-			    offset, sizeof (uint64_t), &subobj,
+			    lo * sizeof (uint64_t),
+			    (i - lo + 1) * sizeof (uint64_t), subobjs,
 			    DMU_READ_NO_PREFETCH);
 			if (err)
 				break;
 
+			uint64_t subobj = subobjs[i - lo];
+			for (int64_t j = i - 1; j >= lo; j--) {
+				dmu_prefetch_head(bpo->bpo_os, subobjs[j - lo],
+				    ZIO_PRIORITY_ASYNC_READ);
+			}
+
 			bpobj_t *subbpo = kmem_alloc(sizeof (bpobj_t),
 			    KM_SLEEP);
 			err = bpobj_open(subbpo, bpo->bpo_os, subobj);
@@ -501,8 +522,8 @@ bpobj_iterate_impl(bpobj_t *initial_bpo, bpobj_itor_t func, void *arg,
 
 			if (subbpo->bpo_havesubobj &&
 			    subbpo->bpo_phys->bpo_subobjs != 0) {
-				dmu_prefetch(subbpo->bpo_os,
-				    subbpo->bpo_phys->bpo_subobjs, 0, 0, 0,
+				dmu_prefetch_head(subbpo->bpo_os,
+				    subbpo->bpo_phys->bpo_subobjs,
 				    ZIO_PRIORITY_ASYNC_READ);
 			}
 
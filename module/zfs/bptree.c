@@ -57,6 +57,48 @@ struct bptree_args {
 	dmu_tx_t *ba_tx;	/* caller supplied tx, NULL if not freeing */
 } bptree_args_t;
 
+/*
+ * A bptree pipe moves the traversal of a bptree entry out of syncing
+ * context. A producer task walks the destroyed dataset, issuing the
+ * metadata reads, and queues the block pointers it visits in a bounded
+ * ring. bptree_iterate_pipe() drains the ring from syncing context and
+ * hands each block pointer to the caller, so the frees, the space
+ * accounting and the on-disk resume bookmark all stay in the same txg.
+ * Since the producer runs ahead of syncing context, the sync thread no
+ * longer waits on the indirect block reads of the traversal as long as
+ * the ring is not empty.
+ *
+ * The producer survives across txgs: if the callback asks to pause, the
+ * block it paused on is left at the head of the ring and is handed out
+ * again by the next call. The bookmark recorded on disk is that of the
+ * block at the head of the ring, so resuming after an export simply
+ * traverses the entry again from that block.
+ */
+typedef struct bptree_pipe_ent {
+	blkptr_t bpe_bp;
+	zbookmark_phys_t bpe_zb;
+} bptree_pipe_ent_t;
+
+struct bptree_pipe {
+	spa_t *bpp_spa;
+	taskq_t *bpp_taskq;	/* runs the producer */
+	kmutex_t bpp_lock;	/* protects the fields below */
+	kcondvar_t bpp_cv;
+
+	bptree_pipe_ent_t *bpp_ring;
+	uint64_t bpp_size;	/* number of ring slots */
+	uint64_t bpp_head;	/* next slot to hand out */
+	uint64_t bpp_count;	/* number of queued block pointers */
+
+	boolean_t bpp_active;	/* producer dispatched for bpp_obj/index */
+	boolean_t bpp_done;	/* producer finished its traversal */
+	boolean_t bpp_stop;	/* producer asked to stop */
+	int bpp_err;		/* producer traversal result */
+	uint64_t bpp_obj;	/* bptree object being traversed */
+	uint64_t bpp_index;	/* bptree entry being traversed */
+	bptree_entry_phys_t bpp_bte; /* producer's copy of the entry */
+};
+
 uint64_t
 bptree_alloc(objset_t *os, dmu_tx_t *tx)
 {
@@ -148,6 +190,14 @@ bptree_add(objset_t *os, uint64_t obj, blkptr_t *bp, uint64_t birth_txg,
 	dmu_buf_rele(db, FTAG);
 }
 
+static void
+bptree_account_free(spa_t *spa, bptree_phys_t *bt, const blkptr_t *bp)
+{
+	bt->bt_bytes -= bp_get_dsize_sync(spa, bp);
+	bt->bt_comp -= BP_GET_PSIZE(bp);
+	bt->bt_uncomp -= BP_GET_UCSIZE(bp);
+}
+
 static int
 bptree_visit_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
     const zbookmark_phys_t *zb, const dnode_phys_t *dnp, void *arg)
@@ -161,14 +211,72 @@ bptree_visit_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
 		return (0);
 
 	err = ba->ba_func(ba->ba_arg, bp, ba->ba_tx);
-	if (err == 0 && ba->ba_free) {
-		ba->ba_phys->bt_bytes -= bp_get_dsize_sync(spa, bp);
-		ba->ba_phys->bt_comp -= BP_GET_PSIZE(bp);
-		ba->ba_phys->bt_uncomp -= BP_GET_UCSIZE(bp);
-	}
+	if (err == 0 && ba->ba_free)
+		bptree_account_free(spa, ba->ba_phys, bp);
 	return (err);
 }
 
+/*
+ * The callback has freed the visited block pointers of entry i, up to the
+ * point where the traversal stopped with err. Record our traversal progress
+ * on disk, either by updating this record's bookmark, or by logically
+ * removing this record by advancing bt_begin. Returns nonzero if the
+ * iteration should stop.
+ */
+static int
+bptree_entry_sync(objset_t *os, uint64_t obj, bptree_phys_t *bt, uint64_t i,
+    bptree_entry_phys_t *bte, int err, boolean_t *ioerr, dmu_tx_t *tx)
+{
+	if (err != 0) {
+		/* save bookmark for future resume */
+		ASSERT3U(bte->be_zb.zb_objset, ==, ZB_DESTROYED_OBJSET);
+		ASSERT0(bte->be_zb.zb_level);
+		dmu_write(os, obj, i * sizeof (*bte), sizeof (*bte), bte, tx);
+		if (err == EIO || err == ECKSUM || err == ENXIO) {
+			/*
+			 * Skip the rest of this tree and continue on to the
+			 * next entry.
+			 */
+			*ioerr = B_TRUE;
+		} else {
+			return (err);
+		}
+	} else if (*ioerr) {
+		/*
+		 * This entry is finished, but there were i/o errors on
+		 * previous entries, so we can't adjust bt_begin. Set this
+		 * entry's be_birth_txg such that it will be treated as a
+		 * no-op in future traversals.
+		 */
+		bte->be_birth_txg = UINT64_MAX;
+		dmu_write(os, obj, i * sizeof (*bte), sizeof (*bte), bte, tx);
+	}
+
+	if (!*ioerr) {
+		bt->bt_begin++;
+		(void) dmu_free_range(os, obj, i * sizeof (*bte),
+		    sizeof (*bte), tx);
+	}
+	return (0);
+}
+
+static void
+bptree_verify_space(bptree_phys_t *bt)
+{
+	/* if all blocks are free there should be no used space */
+	if (bt->bt_begin == bt->bt_end) {
+		if (zfs_free_leak_on_eio) {
+			bt->bt_bytes = 0;
+			bt->bt_comp = 0;
+			bt->bt_uncomp = 0;
+		}
+
+		ASSERT0(bt->bt_bytes);
+		ASSERT0(bt->bt_comp);
+		ASSERT0(bt->bt_uncomp);
+	}
+}
+
 /*
  * If "free" is set:
  *  - It is assumed that "func" will be freeing the block pointers.
@@ -235,48 +343,10 @@ bptree_iterate(objset_t *os, uint64_t obj, boolean_t free, bptree_itor_t func,
 		    bte.be_birth_txg, &bte.be_zb, flags,
 		    bptree_visit_cb, &ba);
 		if (free) {
-			/*
-			 * The callback has freed the visited block pointers.
-			 * Record our traversal progress on disk, either by
-			 * updating this record's bookmark, or by logically
-			 * removing this record by advancing bt_begin.
-			 */
-			if (err != 0) {
-				/* save bookmark for future resume */
-				ASSERT3U(bte.be_zb.zb_objset, ==,
-				    ZB_DESTROYED_OBJSET);
-				ASSERT0(bte.be_zb.zb_level);
-				dmu_write(os, obj, i * sizeof (bte),
-				    sizeof (bte), &bte, tx);
-				if (err == EIO || err == ECKSUM ||
-				    err == ENXIO) {
-					/*
-					 * Skip the rest of this tree and
-					 * continue on to the next entry.
-					 */
-					err = 0;
-					ioerr = B_TRUE;
-				} else {
-					break;
-				}
-			} else if (ioerr) {
-				/*
-				 * This entry is finished, but there were
-				 * i/o errors on previous entries, so we
-				 * can't adjust bt_begin.  Set this entry's
-				 * be_birth_txg such that it will be
-				 * treated as a no-op in future traversals.
-				 */
-				bte.be_birth_txg = UINT64_MAX;
-				dmu_write(os, obj, i * sizeof (bte),
-				    sizeof (bte), &bte, tx);
-			}
-
-			if (!ioerr) {
-				ba.ba_phys->bt_begin++;
-				(void) dmu_free_range(os, obj,
-				    i * sizeof (bte), sizeof (bte), tx);
-			}
+			err = bptree_entry_sync(os, obj, ba.ba_phys, i, &bte,
+			    err, &ioerr, tx);
+			if (err != 0)
+				break;
 		} else if (err != 0) {
 			break;
 		}
@@ -285,19 +355,220 @@ bptree_iterate(objset_t *os, uint64_t obj, boolean_t free, bptree_itor_t func,
 	ASSERT(!free || err != 0 || ioerr ||
 	    ba.ba_phys->bt_begin == ba.ba_phys->bt_end);
 
-	/* if all blocks are free there should be no used space */
-	if (ba.ba_phys->bt_begin == ba.ba_phys->bt_end) {
-		if (zfs_free_leak_on_eio) {
-			ba.ba_phys->bt_bytes = 0;
-			ba.ba_phys->bt_comp = 0;
-			ba.ba_phys->bt_uncomp = 0;
+	bptree_verify_space(ba.ba_phys);
+
+	dmu_buf_rele(db, FTAG);
+
+	return (err);
+}
+
+static int
+bptree_pipe_cb(spa_t *spa, zilog_t *zilog, const blkptr_t *bp,
+    const zbookmark_phys_t *zb, const dnode_phys_t *dnp, void *arg)
+{
+	(void) spa, (void) zilog, (void) dnp;
+	bptree_pipe_t *bpp = arg;
+	bptree_pipe_ent_t *bpe;
+
+	if (zb->zb_level == ZB_DNODE_LEVEL || BP_IS_HOLE(bp) ||
+	    BP_IS_REDACTED(bp))
+		return (0);
+
+	mutex_enter(&bpp->bpp_lock);
+	while (bpp->bpp_count == bpp->bpp_size && !bpp->bpp_stop)
+		cv_wait(&bpp->bpp_cv, &bpp->bpp_lock);
+	if (bpp->bpp_stop) {
+		mutex_exit(&bpp->bpp_lock);
+		return (SET_ERROR(EINTR));
+	}
+	bpe = &bpp->bpp_ring[(bpp->bpp_head + bpp->bpp_count) %
+	    bpp->bpp_size];
+	bpe->bpe_bp = *bp;
+	bpe->bpe_zb = *zb;
+	bpp->bpp_count++;
+	cv_broadcast(&bpp->bpp_cv);
+	mutex_exit(&bpp->bpp_lock);
+
+	return (0);
+}
+
+static void
+bptree_pipe_thread(void *arg)
+{
+	bptree_pipe_t *bpp = arg;
+	bptree_entry_phys_t *bte = &bpp->bpp_bte;
+	int flags = TRAVERSE_PREFETCH_METADATA | TRAVERSE_POST |
+	    TRAVERSE_NO_DECRYPT;
+	int err;
+
+	if (zfs_free_leak_on_eio)
+		flags |= TRAVERSE_HARD;
+	err = traverse_dataset_destroyed(bpp->bpp_spa, &bte->be_bp,
+	    bte->be_birth_txg, &bte->be_zb, flags, bptree_pipe_cb, bpp);
+
+	mutex_enter(&bpp->bpp_lock);
+	bpp->bpp_err = err;
+	bpp->bpp_done = B_TRUE;
+	cv_broadcast(&bpp->bpp_cv);
+	mutex_exit(&bpp->bpp_lock);
+}
+
+/*
+ * Stop the producer, if any, and discard everything it has queued.
+ */
+static void
+bptree_pipe_stop(bptree_pipe_t *bpp)
+{
+	mutex_enter(&bpp->bpp_lock);
+	bpp->bpp_stop = B_TRUE;
+	cv_broadcast(&bpp->bpp_cv);
+	mutex_exit(&bpp->bpp_lock);
+
+	taskq_wait(bpp->bpp_taskq);
+
+	bpp->bpp_stop = B_FALSE;
+	bpp->bpp_active = B_FALSE;
+	bpp->bpp_done = B_FALSE;
+	bpp->bpp_err = 0;
+	bpp->bpp_head = 0;
+	bpp->bpp_count = 0;
+}
+
+static void
+bptree_pipe_start(bptree_pipe_t *bpp, uint64_t obj, uint64_t i,
+    const bptree_entry_phys_t *bte)
+{
+	bptree_pipe_stop(bpp);
+
+	bpp->bpp_obj = obj;
+	bpp->bpp_index = i;
+	bpp->bpp_bte = *bte;
+	bpp->bpp_active = B_TRUE;
+	VERIFY3U(taskq_dispatch(bpp->bpp_taskq, bptree_pipe_thread, bpp,
+	    TQ_SLEEP), !=, TASKQID_INVALID);
+}
+
+bptree_pipe_t *
+bptree_pipe_create(spa_t *spa, uint64_t nblocks)
+{
+	bptree_pipe_t *bpp = kmem_zalloc(sizeof (*bpp), KM_SLEEP);
+
+	ASSERT3U(nblocks, >, 0);
+	bpp->bpp_spa = spa;
+	bpp->bpp_size = nblocks;
+	bpp->bpp_ring = vmem_alloc(nblocks * sizeof (bptree_pipe_ent_t),
+	    KM_SLEEP);
+	mutex_init(&bpp->bpp_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&bpp->bpp_cv, NULL, CV_DEFAULT, NULL);
+	bpp->bpp_taskq = taskq_create("z_bptree_pipe", 1, defclsyspri,
+	    1, 1, 0);
+
+	return (bpp);
+}
+
+void
+bptree_pipe_destroy(bptree_pipe_t *bpp)
+{
+	bptree_pipe_stop(bpp);
+	taskq_destroy(bpp->bpp_taskq);
+	cv_destroy(&bpp->bpp_cv);
+	mutex_destroy(&bpp->bpp_lock);
+	vmem_free(bpp->bpp_ring, bpp->bpp_size * sizeof (bptree_pipe_ent_t));
+	kmem_free(bpp, sizeof (*bpp));
+}
+
+/*
+ * Like bptree_iterate() with "free" set, but with the traversal of each
+ * entry done by the producer task of the given pipe. The same pipe must be
+ * passed on every call for the bptree, so that a traversal paused by
+ * "func" is picked up where it left off.
+ */
+int
+bptree_iterate_pipe(objset_t *os, uint64_t obj, bptree_pipe_t *bpp,
+    bptree_itor_t func, void *arg, dmu_tx_t *tx)
+{
+	boolean_t ioerr = B_FALSE;
+	bptree_phys_t *bt;
+	dmu_buf_t *db;
+	int err;
+
+	ASSERT(dmu_tx_is_syncing(tx));
+
+	err = dmu_bonus_hold(os, obj, FTAG, &db);
+	if (err != 0)
+		return (err);
+
+	dmu_buf_will_dirty(db, tx);
+	bt = db->db_data;
+
+	for (uint64_t i = bt->bt_begin; i < bt->bt_end; i++) {
+		bptree_entry_phys_t bte;
+
+		err = dmu_read(os, obj, i * sizeof (bte), sizeof (bte),
+		    &bte, DMU_READ_NO_PREFETCH);
+		if (err != 0)
+			break;
+
+		if (!bpp->bpp_active || bpp->bpp_obj != obj ||
+		    bpp->bpp_index != i) {
+			zfs_dbgmsg("bptree index %lld: piping from "
+			    "min_txg=%lld bookmark %lld/%lld/%lld/%lld",
+			    (longlong_t)i,
+			    (longlong_t)bte.be_birth_txg,
+			    (longlong_t)bte.be_zb.zb_objset,
+			    (longlong_t)bte.be_zb.zb_object,
+			    (longlong_t)bte.be_zb.zb_level,
+			    (longlong_t)bte.be_zb.zb_blkid);
+			bptree_pipe_start(bpp, obj, i, &bte);
 		}
 
-		ASSERT0(ba.ba_phys->bt_bytes);
-		ASSERT0(ba.ba_phys->bt_comp);
-		ASSERT0(ba.ba_phys->bt_uncomp);
+		mutex_enter(&bpp->bpp_lock);
+		for (;;) {
+			bptree_pipe_ent_t *bpe;
+
+			while (bpp->bpp_count == 0 && !bpp->bpp_done)
+				cv_wait(&bpp->bpp_cv, &bpp->bpp_lock);
+			if (bpp->bpp_count == 0) {
+				/* the producer is done with this entry */
+				err = bpp->bpp_err;
+				if (err != 0)
+					bte.be_zb = bpp->bpp_bte.be_zb;
+				bpp->bpp_active = B_FALSE;
+				break;
+			}
+
+			/*
+			 * The producer never touches the slots between
+			 * bpp_head and bpp_head + bpp_count, so the entry
+			 * stays valid while we drop the lock.
+			 */
+			bpe = &bpp->bpp_ring[bpp->bpp_head];
+			mutex_exit(&bpp->bpp_lock);
+			err = func(arg, &bpe->bpe_bp, tx);
+			if (err == 0)
+				bptree_account_free(os->os_spa, bt,
+				    &bpe->bpe_bp);
+			mutex_enter(&bpp->bpp_lock);
+			if (err != 0) {
+				/* resume from this block next time */
+				bte.be_zb = bpe->bpe_zb;
+				break;
+			}
+			bpp->bpp_head = (bpp->bpp_head + 1) % bpp->bpp_size;
+			bpp->bpp_count--;
+			cv_broadcast(&bpp->bpp_cv);
+		}
+		mutex_exit(&bpp->bpp_lock);
+
+		err = bptree_entry_sync(os, obj, bt, i, &bte, err, &ioerr, tx);
+		if (err != 0)
+			break;
 	}
 
+	ASSERT(err != 0 || ioerr || bt->bt_begin == bt->bt_end);
+
+	bptree_verify_space(bt);
+
 	dmu_buf_rele(db, FTAG);
 
 	return (err);
@@ -250,6 +250,11 @@ static kmem_cache_t *brt_entry_cache;
  */
 static int brt_zap_prefetch = 1;
 
+/*
+ * Enable/disable prefetching of BRT entries of blocks that are being freed.
+ */
+static int brt_free_prefetch = 1;
+
 #ifdef ZFS_DEBUG
 #define	BRT_DEBUG(...)	do {						\
 	if ((zfs_flags & ZFS_DEBUG_BRT) != 0) {				\
@@ -276,6 +281,7 @@ typedef struct brt_stats {
 	kstat_named_t brt_decref_free_data_later;
 	kstat_named_t brt_decref_free_data_now;
 	kstat_named_t brt_decref_no_entry;
+	kstat_named_t brt_decref_prefetch;
 } brt_stats_t;
 
 static brt_stats_t brt_stats = {
@@ -288,7 +294,8 @@ static brt_stats_t brt_stats = {
 	{ "decref_entry_still_referenced",	KSTAT_DATA_UINT64 },
 	{ "decref_free_data_later",		KSTAT_DATA_UINT64 },
 	{ "decref_free_data_now",		KSTAT_DATA_UINT64 },
-	{ "decref_no_entry",			KSTAT_DATA_UINT64 }
+	{ "decref_no_entry",			KSTAT_DATA_UINT64 },
+	{ "decref_prefetch",			KSTAT_DATA_UINT64 }
 };
 
 struct {
@@ -302,6 +309,7 @@ struct {
 	wmsum_t brt_decref_free_data_later;
 	wmsum_t brt_decref_free_data_now;
 	wmsum_t brt_decref_no_entry;
+	wmsum_t brt_decref_prefetch;
 } brt_sums;
 
 #define	BRTSTAT_BUMP(stat)	wmsum_add(&brt_sums.stat, 1)
@@ -333,10 +341,15 @@ brt_vdev_entcount_get(const brt_vdev_t *brtvd, uint64_t idx)
 
 	ASSERT3U(idx, <, brtvd->bv_size);
 
+	uint16_t *block = brtvd->bv_entcount[idx / BRT_BLOCK_ENTCOUNTS];
+	if (block == NULL)
+		return (0);
+
+	idx %= BRT_BLOCK_ENTCOUNTS;
 	if (unlikely(brtvd->bv_need_byteswap)) {
-		return (BSWAP_16(brtvd->bv_entcount[idx]));
+		return (BSWAP_16(block[idx]));
 	} else {
-		return (brtvd->bv_entcount[idx]);
+		return (block[idx]);
 	}
 }
 
@@ -346,10 +359,24 @@ brt_vdev_entcount_set(brt_vdev_t *brtvd, uint64_t idx, uint16_t entcnt)
 
 	ASSERT3U(idx, <, brtvd->bv_size);
 
+	uint16_t **blockp = &brtvd->bv_entcount[idx / BRT_BLOCK_ENTCOUNTS];
+	if (*blockp == NULL) {
+		ASSERT(entcnt > 0);
+		uint16_t *block = vmem_zalloc(BRT_BLOCKSIZE, KM_SLEEP);
+		/*
+		 * brt_maybe_exists() looks at the blocks without the lock,
+		 * so make sure it can't see the block before it is zeroed.
+		 */
+		membar_producer();
+		*blockp = block;
+		brtvd->bv_entcount_blocks++;
+	}
+
+	idx %= BRT_BLOCK_ENTCOUNTS;
 	if (unlikely(brtvd->bv_need_byteswap)) {
-		brtvd->bv_entcount[idx] = BSWAP_16(entcnt);
+		(*blockp)[idx] = BSWAP_16(entcnt);
 	} else {
-		brtvd->bv_entcount[idx] = entcnt;
+		(*blockp)[idx] = entcnt;
 	}
 }
 
@@ -387,16 +414,24 @@ brt_vdev_dump(brt_vdev_t *brtvd)
 
 	uint64_t nblocks = BRT_RANGESIZE_TO_NBLOCKS(brtvd->bv_size);
 	zfs_dbgmsg("  BRT vdevid=%llu meta_dirty=%d entcount_dirty=%d "
-	    "size=%llu totalcount=%llu nblocks=%llu bitmapsize=%zu",
+	    "size=%llu totalcount=%llu nblocks=%llu allocated=%llu "
+	    "bitmapsize=%zu",
 	    (u_longlong_t)brtvd->bv_vdevid,
 	    brtvd->bv_meta_dirty, brtvd->bv_entcount_dirty,
 	    (u_longlong_t)brtvd->bv_size,
 	    (u_longlong_t)brtvd->bv_totalcount,
 	    (u_longlong_t)nblocks,
+	    (u_longlong_t)brtvd->bv_entcount_blocks,
 	    (size_t)BT_SIZEOFMAP(nblocks));
 	if (brtvd->bv_totalcount > 0) {
 		zfs_dbgmsg("    entcounts:");
 		for (idx = 0; idx < brtvd->bv_size; idx++) {
+			if (brtvd->bv_entcount[idx / BRT_BLOCK_ENTCOUNTS] ==
+			    NULL) {
+				idx += BRT_BLOCK_ENTCOUNTS -
+				    idx % BRT_BLOCK_ENTCOUNTS - 1;
+				continue;
+			}
 			uint16_t entcnt = brt_vdev_entcount_get(brtvd, idx);
 			if (entcnt > 0) {
 				zfs_dbgmsg("      [%04llu] %hu",
@@ -461,7 +496,9 @@ brt_vdev_create(spa_t *spa, brt_vdev_t *brtvd, dmu_tx_t *tx)
 	    (u_longlong_t)brtvd->bv_mos_entries);
 
 	/*
-	 * We allocate DMU buffer to store the bv_entcount[] array.
+	 * We allocate DMU buffer to store the bv_entcount[] array, one
+	 * BRT_BLOCKSIZE block per bv_entcount[] block. Blocks that were never
+	 * written are holes and read back as zeros.
 	 * We will keep array size (bv_size) and cummulative count for all
 	 * bv_entcount[]s (bv_totalcount) in the bonus buffer.
 	 */
@@ -497,7 +534,7 @@ static void
 brt_vdev_realloc(spa_t *spa, brt_vdev_t *brtvd)
 {
 	vdev_t *vd;
-	uint16_t *entcount;
+	uint16_t **entcount;
 	ulong_t *bitmap;
 	uint64_t nblocks, onblocks, size;
 
@@ -508,8 +545,8 @@ brt_vdev_realloc(spa_t *spa, brt_vdev_t *brtvd)
 	size = (vdev_get_min_asize(vd) - 1) / spa->spa_brt_rangesize + 1;
 	spa_config_exit(spa, SCL_VDEV, FTAG);
 
-	entcount = vmem_zalloc(sizeof (entcount[0]) * size, KM_SLEEP);
 	nblocks = BRT_RANGESIZE_TO_NBLOCKS(size);
+	entcount = vmem_zalloc(sizeof (entcount[0]) * nblocks, KM_SLEEP);
 	bitmap = kmem_zalloc(BT_SIZEOFMAP(nblocks), KM_SLEEP);
 
 	if (!brtvd->bv_initiated) {
@@ -528,11 +565,15 @@ brt_vdev_realloc(spa_t *spa, brt_vdev_t *brtvd)
 		 */
 		ASSERT3U(brtvd->bv_size, <=, size);
 
+		/*
+		 * Only the array of block pointers is reallocated, the
+		 * blocks themselves are moved over as they are.
+		 */
+		onblocks = BRT_RANGESIZE_TO_NBLOCKS(brtvd->bv_size);
 		memcpy(entcount, brtvd->bv_entcount,
-		    sizeof (entcount[0]) * MIN(size, brtvd->bv_size));
+		    sizeof (entcount[0]) * MIN(nblocks, onblocks));
 		vmem_free(brtvd->bv_entcount,
-		    sizeof (entcount[0]) * brtvd->bv_size);
-		onblocks = BRT_RANGESIZE_TO_NBLOCKS(brtvd->bv_size);
+		    sizeof (entcount[0]) * onblocks);
 		memcpy(bitmap, brtvd->bv_bitmap, MIN(BT_SIZEOFMAP(nblocks),
 		    BT_SIZEOFMAP(onblocks)));
 		kmem_free(brtvd->bv_bitmap, BT_SIZEOFMAP(onblocks));
@@ -554,6 +595,8 @@ brt_vdev_load(spa_t *spa, brt_vdev_t *brtvd)
 {
 	dmu_buf_t *db;
 	brt_vdev_phys_t *bvphys;
+	uint16_t *block;
+	uint64_t size, nblocks;
 	int error;
 
 	ASSERT(!brtvd->bv_initiated);
@@ -577,13 +620,42 @@ brt_vdev_load(spa_t *spa, brt_vdev_t *brtvd)
 	ASSERT3U(bvphys->bvp_size, <=, brtvd->bv_size);
 
 	/*
-	 * If VDEV grew, we will leave new bv_entcount[] entries zeroed out.
+	 * Read the on-disk array a block at a time and only keep the blocks
+	 * that have any non-zero entcount. Holes cost no I/O and all the
+	 * reads are issued up front by the prefetch. If VDEV grew, we will
+	 * leave new bv_entcount[] entries zeroed out.
 	 */
-	error = dmu_read(spa->spa_meta_objset, brtvd->bv_mos_brtvdev, 0,
-	    MIN(brtvd->bv_size, bvphys->bvp_size) * sizeof (uint16_t),
-	    brtvd->bv_entcount, DMU_READ_NO_PREFETCH);
-	if (error != 0)
-		return (error);
+	size = MIN(brtvd->bv_size, bvphys->bvp_size);
+	nblocks = BRT_RANGESIZE_TO_NBLOCKS(size);
+	dmu_prefetch(spa->spa_meta_objset, brtvd->bv_mos_brtvdev, 0, 0,
+	    size * sizeof (uint16_t), ZIO_PRIORITY_SYNC_READ);
+	block = vmem_alloc(BRT_BLOCKSIZE, KM_SLEEP);
+	for (uint64_t i = 0; i < nblocks; i++) {
+		uint64_t n = MIN(BRT_BLOCK_ENTCOUNTS,
+		    size - i * BRT_BLOCK_ENTCOUNTS);
+
+		error = dmu_read(spa->spa_meta_objset, brtvd->bv_mos_brtvdev,
+		    i * BRT_BLOCKSIZE, n * sizeof (uint16_t), block,
+		    DMU_READ_NO_PREFETCH);
+		if (error != 0) {
+			vmem_free(block, BRT_BLOCKSIZE);
+			dmu_buf_rele(db, FTAG);
+			return (error);
+		}
+
+		uint64_t j;
+		for (j = 0; j < n && block[j] == 0; j++)
+			;
+		if (j == n)
+			continue;
+
+		memset(block + n, 0, (BRT_BLOCK_ENTCOUNTS - n) *
+		    sizeof (uint16_t));
+		brtvd->bv_entcount[i] = block;
+		brtvd->bv_entcount_blocks++;
+		block = vmem_alloc(BRT_BLOCKSIZE, KM_SLEEP);
+	}
+	vmem_free(block, BRT_BLOCKSIZE);
 
 	ASSERT(bvphys->bvp_mos_entries != 0);
 	VERIFY0(dnode_hold(spa->spa_meta_objset, bvphys->bvp_mos_entries, brtvd,
@@ -613,9 +685,14 @@ brt_vdev_dealloc(brt_vdev_t *brtvd)
 	ASSERT(brtvd->bv_initiated);
 	ASSERT0(avl_numnodes(&brtvd->bv_tree));
 
-	vmem_free(brtvd->bv_entcount, sizeof (uint16_t) * brtvd->bv_size);
-	brtvd->bv_entcount = NULL;
 	uint64_t nblocks = BRT_RANGESIZE_TO_NBLOCKS(brtvd->bv_size);
+	for (uint64_t i = 0; i < nblocks; i++) {
+		if (brtvd->bv_entcount[i] != NULL)
+			vmem_free(brtvd->bv_entcount[i], BRT_BLOCKSIZE);
+	}
+	vmem_free(brtvd->bv_entcount, sizeof (uint16_t *) * nblocks);
+	brtvd->bv_entcount = NULL;
+	brtvd->bv_entcount_blocks = 0;
 	kmem_free(brtvd->bv_bitmap, BT_SIZEOFMAP(nblocks));
 	brtvd->bv_bitmap = NULL;
 
@@ -758,7 +835,7 @@ brt_vdev_addref(spa_t *spa, brt_vdev_t *brtvd, const brt_entry_t *bre,
 	brtvd->bv_totalcount++;
 	brt_vdev_entcount_inc(brtvd, idx);
 	brtvd->bv_entcount_dirty = TRUE;
-	idx = idx / BRT_BLOCKSIZE / 8;
+	idx = idx / BRT_BLOCK_ENTCOUNTS;
 	BT_SET(brtvd->bv_bitmap, idx);
 }
 
@@ -786,7 +863,7 @@ brt_vdev_decref(spa_t *spa, brt_vdev_t *brtvd, const brt_entry_t *bre,
 	brtvd->bv_totalcount--;
 	brt_vdev_entcount_dec(brtvd, idx);
 	brtvd->bv_entcount_dirty = TRUE;
-	idx = idx / BRT_BLOCKSIZE / 8;
+	idx = idx / BRT_BLOCK_ENTCOUNTS;
 	BT_SET(brtvd->bv_bitmap, idx);
 }
 
@@ -804,13 +881,21 @@ brt_vdev_sync(spa_t *spa, brt_vdev_t *brtvd, dmu_tx_t *tx)
 	    FTAG, &db));
 
 	if (brtvd->bv_entcount_dirty) {
-		/*
-		 * TODO: Walk brtvd->bv_bitmap and write only the dirty blocks.
-		 */
-		dmu_write(spa->spa_meta_objset, brtvd->bv_mos_brtvdev, 0,
-		    brtvd->bv_size * sizeof (brtvd->bv_entcount[0]),
-		    brtvd->bv_entcount, tx);
 		uint64_t nblocks = BRT_RANGESIZE_TO_NBLOCKS(brtvd->bv_size);
+		for (uint64_t i = 0; i < nblocks; i++) {
+			if (!BT_TEST(brtvd->bv_bitmap, i))
+				continue;
+			/*
+			 * A block only gets dirty through an entcount change,
+			 * so it must have been allocated by then.
+			 */
+			ASSERT(brtvd->bv_entcount[i] != NULL);
+			uint64_t n = MIN(BRT_BLOCK_ENTCOUNTS,
+			    brtvd->bv_size - i * BRT_BLOCK_ENTCOUNTS);
+			dmu_write(spa->spa_meta_objset, brtvd->bv_mos_brtvdev,
+			    i * BRT_BLOCKSIZE, n * sizeof (uint16_t),
+			    brtvd->bv_entcount[i], tx);
+		}
 		memset(brtvd->bv_bitmap, 0, BT_SIZEOFMAP(nblocks));
 		brtvd->bv_entcount_dirty = FALSE;
 	}
@@ -992,6 +1077,8 @@ brt_kstats_update(kstat_t *ksp, int rw)
 	    wmsum_value(&brt_sums.brt_decref_free_data_now);
 	bs->brt_decref_no_entry.value.ui64 =
 	    wmsum_value(&brt_sums.brt_decref_no_entry);
+	bs->brt_decref_prefetch.value.ui64 =
+	    wmsum_value(&brt_sums.brt_decref_prefetch);
 
 	return (0);
 }
@@ -1010,6 +1097,7 @@ brt_stat_init(void)
 	wmsum_init(&brt_sums.brt_decref_free_data_later, 0);
 	wmsum_init(&brt_sums.brt_decref_free_data_now, 0);
 	wmsum_init(&brt_sums.brt_decref_no_entry, 0);
+	wmsum_init(&brt_sums.brt_decref_prefetch, 0);
 
 	brt_ksp = kstat_create("zfs", 0, "brtstats", "misc", KSTAT_TYPE_NAMED,
 	    sizeof (brt_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
@@ -1038,6 +1126,7 @@ brt_stat_fini(void)
 	wmsum_fini(&brt_sums.brt_decref_free_data_later);
 	wmsum_fini(&brt_sums.brt_decref_free_data_now);
 	wmsum_fini(&brt_sums.brt_decref_no_entry);
+	wmsum_fini(&brt_sums.brt_decref_prefetch);
 }
 
 void
@@ -1161,9 +1250,9 @@ brt_entry_get_refcount(spa_t *spa, const blkptr_t *bp)
 }
 
 static void
-brt_prefetch(brt_vdev_t *brtvd, const blkptr_t *bp)
+brt_entry_prefetch(brt_vdev_t *brtvd, const blkptr_t *bp)
 {
-	if (!brt_zap_prefetch || brtvd->bv_mos_entries == 0)
+	if (brtvd->bv_mos_entries == 0)
 		return;
 
 	uint64_t off = DVA_GET_OFFSET(&bp->blk_dva[0]);
@@ -1175,6 +1264,36 @@ brt_prefetch(brt_vdev_t *brtvd, const blkptr_t *bp)
 	rw_exit(&brtvd->bv_mos_entries_lock);
 }
 
+static void
+brt_prefetch(brt_vdev_t *brtvd, const blkptr_t *bp)
+{
+	if (brt_zap_prefetch)
+		brt_entry_prefetch(brtvd, bp);
+}
+
+/*
+ * Called when the free of a block is issued, well before zio_brt_free()
+ * gets to brt_entry_decref() on the async issue taskq. Frees come in
+ * bursts sorted by vdev and offset (see bplist_iterate_sorted()), so
+ * starting the read of the BRT ZAP leaf here lets the reads of a whole
+ * burst overlap instead of each decref waiting for its own read.
+ */
+void
+brt_prefetch_free(spa_t *spa, const blkptr_t *bp)
+{
+	if (!brt_free_prefetch || BP_GET_LEVEL(bp) > 0 ||
+	    BP_IS_METADATA(bp) || !brt_maybe_exists(spa, bp))
+		return;
+
+	uint64_t vdevid = DVA_GET_VDEV(&bp->blk_dva[0]);
+	brt_vdev_t *brtvd = brt_vdev(spa, vdevid, B_FALSE);
+	if (brtvd == NULL)
+		return;
+
+	BRTSTAT_BUMP(brt_decref_prefetch);
+	brt_entry_prefetch(brtvd, bp);
+}
+
 static int
 brt_entry_compare(const void *x1, const void *x2)
 {
@@ -1226,6 +1345,111 @@ brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
 	}
 }
 
+static int
+brt_entry_batch_compare(const void *x1, const void *x2)
+{
+	const brt_entry_t *bre1 = *(brt_entry_t * const *)x1;
+	const brt_entry_t *bre2 = *(brt_entry_t * const *)x2;
+	const blkptr_t *bp1 = &bre1->bre_bp, *bp2 = &bre2->bre_bp;
+
+	int cmp = TREE_CMP(DVA_GET_VDEV(&bp1->blk_dva[0]),
+	    DVA_GET_VDEV(&bp2->blk_dva[0]));
+	if (cmp != 0)
+		return (cmp);
+	return (brt_entry_compare(bre1, bre2));
+}
+
+/*
+ * Same as calling brt_pending_add() for every BP in the array that points
+ * at a data block (holes and embedded BPs are skipped), but done in bulk.
+ * The BPs are sorted by vdev and offset, the BRT entries of the whole batch
+ * are prefetched before anything is inserted, and each vdev's pending lock
+ * is taken once per batch. As consecutive entries are in tree order, most
+ * of them are inserted right after the previous one without a full search.
+ */
+void
+brt_pending_add_batch(spa_t *spa, const blkptr_t *bps, size_t nbps,
+    dmu_tx_t *tx)
+{
+	brt_entry_t **bres, *bre, *prev;
+	avl_index_t where;
+	uint64_t txg;
+	size_t i, n, start;
+
+	txg = dmu_tx_get_txg(tx);
+	ASSERT3U(txg, !=, 0);
+
+	if (nbps == 0)
+		return;
+
+	bres = kmem_alloc(sizeof (brt_entry_t *) * nbps, KM_SLEEP);
+	for (i = 0, n = 0; i < nbps; i++) {
+		if (BP_IS_HOLE(&bps[i]) || BP_IS_EMBEDDED(&bps[i]))
+			continue;
+		bre = kmem_cache_alloc(brt_entry_cache, KM_SLEEP);
+		bre->bre_bp = bps[i];
+		bre->bre_count = 0;
+		bre->bre_pcount = 1;
+		bres[n++] = bre;
+	}
+	qsort(bres, n, sizeof (brt_entry_t *), brt_entry_batch_compare);
+
+	for (start = 0; start < n; start = i) {
+		uint64_t vdevid = DVA_GET_VDEV(&bres[start]->bre_bp.blk_dva[0]);
+		brt_vdev_t *brtvd = brt_vdev(spa, vdevid, B_TRUE);
+		avl_tree_t *pending_tree =
+		    &brtvd->bv_pending_tree[txg & TXG_MASK];
+
+		for (i = start; i < n &&
+		    DVA_GET_VDEV(&bres[i]->bre_bp.blk_dva[0]) == vdevid; i++) {
+			if (i == start || brt_entry_compare(bres[i - 1],
+			    bres[i]) != 0)
+				brt_prefetch(brtvd, &bres[i]->bre_bp);
+		}
+
+		mutex_enter(&brtvd->bv_pending_lock);
+		prev = NULL;
+		for (size_t j = start; j < i; j++) {
+			brt_entry_t *newbre = bres[j];
+
+			if (prev != NULL) {
+				int cmp = brt_entry_compare(prev, newbre);
+				ASSERT3S(cmp, <=, 0);
+				if (cmp == 0) {
+					prev->bre_pcount++;
+					continue;
+				}
+				bre = AVL_NEXT(pending_tree, prev);
+				if (bre == NULL ||
+				    brt_entry_compare(newbre, bre) < 0) {
+					avl_insert_here(pending_tree, newbre,
+					    prev, AVL_AFTER);
+					prev = newbre;
+					bres[j] = NULL;
+					continue;
+				}
+			}
+
+			bre = avl_find(pending_tree, newbre, &where);
+			if (bre == NULL) {
+				avl_insert(pending_tree, newbre, where);
+				prev = newbre;
+				bres[j] = NULL;
+			} else {
+				bre->bre_pcount++;
+				prev = bre;
+			}
+		}
+		mutex_exit(&brtvd->bv_pending_lock);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (bres[i] != NULL)
+			kmem_cache_free(brt_entry_cache, bres[i]);
+	}
+	kmem_free(bres, sizeof (brt_entry_t *) * nbps);
+}
+
 void
 brt_pending_remove(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
 {
@@ -1360,28 +1584,26 @@ brt_pending_apply(spa_t *spa, uint64_t txg)
 	brt_unlock(spa);
 }
 
-static void
-brt_sync_entry(spa_t *spa, dnode_t *dn, brt_entry_t *bre, dmu_tx_t *tx)
+/*
+ * Remove the ZAP entry of a BRT entry whose count dropped to zero.  Returns
+ * B_TRUE if the entry's count has to be updated instead, which
+ * brt_sync_table() does for all such entries of a vdev in one batch.
+ */
+static boolean_t
+brt_sync_entry(dnode_t *dn, brt_entry_t *bre, dmu_tx_t *tx)
 {
 	uint64_t off = BRE_OFFSET(bre);
 
 	if (bre->bre_pcount == 0) {
 		/* The net change is zero, nothing to do in ZAP. */
+		return (B_FALSE);
 	} else if (bre->bre_count == 0) {
 		int error = zap_remove_uint64_by_dnode(dn, &off,
 		    BRT_KEY_WORDS, tx);
 		VERIFY(error == 0 || error == ENOENT);
-	} else {
-		if (brt_has_endian_fixed(spa)) {
-			VERIFY0(zap_update_uint64_by_dnode(dn, &off,
-			    BRT_KEY_WORDS, sizeof (bre->bre_count), 1,
-			    &bre->bre_count, tx));
-		} else {
-			VERIFY0(zap_update_uint64_by_dnode(dn, &off,
-			    BRT_KEY_WORDS, 1, sizeof (bre->bre_count),
-			    &bre->bre_count, tx));
-		}
+		return (B_FALSE);
 	}
+	return (B_TRUE);
 }
 
 static void
@@ -1407,13 +1629,39 @@ brt_sync_table(spa_t *spa, dmu_tx_t *tx)
 		if (brtvd->bv_mos_brtvdev == 0)
 			brt_vdev_create(spa, brtvd, tx);
 
+		dnode_t *dn = brtvd->bv_mos_entries_dnode;
+		uint64_t nents = avl_numnodes(&brtvd->bv_tree);
+		uint64_t *keys = NULL, *counts = NULL, n = 0;
+		if (nents != 0) {
+			keys = vmem_alloc(nents * sizeof (uint64_t), KM_SLEEP);
+			counts = vmem_alloc(nents * sizeof (uint64_t),
+			    KM_SLEEP);
+		}
+
 		void *c = NULL;
 		while ((bre = avl_destroy_nodes(&brtvd->bv_tree, &c)) != NULL) {
-			brt_sync_entry(spa, brtvd->bv_mos_entries_dnode, bre,
-			    tx);
+			if (brt_sync_entry(dn, bre, tx)) {
+				keys[n] = BRE_OFFSET(bre);
+				counts[n] = bre->bre_count;
+				n++;
+			}
 			kmem_cache_free(brt_entry_cache, bre);
 		}
 
+		if (brt_has_endian_fixed(spa)) {
+			VERIFY0(zap_update_uint64_batch_by_dnode(dn, keys,
+			    BRT_KEY_WORDS, n, sizeof (uint64_t), 1, counts,
+			    tx));
+		} else {
+			VERIFY0(zap_update_uint64_batch_by_dnode(dn, keys,
+			    BRT_KEY_WORDS, n, 1, sizeof (uint64_t), counts,
+			    tx));
+		}
+		if (nents != 0) {
+			vmem_free(keys, nents * sizeof (uint64_t));
+			vmem_free(counts, nents * sizeof (uint64_t));
+		}
+
 #ifdef ZFS_DEBUG
 		if (zfs_flags & ZFS_DEBUG_BRT)
 			brt_vdev_dump(brtvd);
@@ -1521,6 +1769,8 @@ brt_unload(spa_t *spa)
 
 ZFS_MODULE_PARAM(zfs_brt, , brt_zap_prefetch, INT, ZMOD_RW,
 	"Enable prefetching of BRT ZAP entries");
+ZFS_MODULE_PARAM(zfs_brt, , brt_free_prefetch, INT, ZMOD_RW,
+	"Enable prefetching of BRT ZAP entries of freed blocks");
 ZFS_MODULE_PARAM(zfs_brt, , brt_zap_default_bs, UINT, ZMOD_RW,
 	"BRT ZAP leaf blockshift");
 ZFS_MODULE_PARAM(zfs_brt, , brt_zap_default_ibs, UINT, ZMOD_RW,
@@ -25,6 +25,7 @@
  * Copyright (c) 2018 Datto Inc.
  */
 
+#include <sys/arc.h>
 #include <sys/dataset_kstats.h>
 #include <sys/dmu_objset.h>
 #include <sys/dsl_dataset.h>
@@ -38,6 +39,13 @@ static dataset_kstat_values_t empty_dataset_kstats = {
 	{ "nread",	KSTAT_DATA_UINT64 },
 	{ "nunlinks",	KSTAT_DATA_UINT64 },
 	{ "nunlinked",	KSTAT_DATA_UINT64 },
+	{ "arc_size",	KSTAT_DATA_UINT64 },
+	{ "dirty_bytes",	KSTAT_DATA_UINT64 },
+	{ "dirty_delay_ns",	KSTAT_DATA_UINT64 },
+	{ "blksz_adapted",	KSTAT_DATA_UINT64 },
+	{ "blksz_adapted_bytes",	KSTAT_DATA_UINT64 },
+	{ "gang_writes",	KSTAT_DATA_UINT64 },
+	{ "gang_reads",	KSTAT_DATA_UINT64 },
 	{
 	{ "zil_commit_count",			KSTAT_DATA_UINT64 },
 	{ "zil_commit_writer_count",		KSTAT_DATA_UINT64 },
@@ -45,6 +53,7 @@ static dataset_kstat_values_t empty_dataset_kstats = {
 	{ "zil_commit_stall_count",		KSTAT_DATA_UINT64 },
 	{ "zil_commit_suspend_count",		KSTAT_DATA_UINT64 },
 	{ "zil_commit_crash_count",		KSTAT_DATA_UINT64 },
+	{ "zil_commit_time",			KSTAT_DATA_UINT64 },
 	{ "zil_itx_count",			KSTAT_DATA_UINT64 },
 	{ "zil_itx_indirect_count",		KSTAT_DATA_UINT64 },
 	{ "zil_itx_indirect_bytes",		KSTAT_DATA_UINT64 },
@@ -85,12 +94,115 @@ dataset_kstats_update(kstat_t *ksp, int rw)
 	    wmsum_value(&dk->dk_sums.dss_nunlinks);
 	dkv->dkv_nunlinked.value.ui64 =
 	    wmsum_value(&dk->dk_sums.dss_nunlinked);
+	dkv->dkv_blksz_adapted.value.ui64 =
+	    wmsum_value(&dk->dk_sums.dss_blksz_adapted);
+	dkv->dkv_blksz_adapted_bytes.value.ui64 =
+	    wmsum_value(&dk->dk_sums.dss_blksz_adapted_bytes);
+	dkv->dkv_arc_size.value.ui64 = arc_account_size(dk->dk_arc_account);
+	dmu_objset_live_stats(dk->dk_spa, dk->dk_objset,
+	    &dkv->dkv_dirty_bytes.value.ui64,
+	    &dkv->dkv_dirty_delay_ns.value.ui64,
+	    &dkv->dkv_gang_writes.value.ui64,
+	    &dkv->dkv_gang_reads.value.ui64);
 
 	zil_kstat_values_update(&dkv->dkv_zil_stats, &dk->dk_zil_sums);
 
 	return (0);
 }
 
+static int
+dataset_kstats_io_histo_headers(char *buf, size_t size)
+{
+	(void) kmem_scnprintf(buf, size,
+	    "%-12s %12s %12s %12s %12s %12s %12s %12s %14s %12s %15s\n",
+	    "bucket", "read_lat", "write_lat", "discard_lat", "flush_lat",
+	    "read_size", "write_size", "discard_size", "sync_write_lat",
+	    "tx_wait_lat", "sync_write_size");
+
+	return (0);
+}
+
+static int
+dataset_kstats_io_histo_data(char *buf, size_t size, void *data)
+{
+	dataset_io_histo_t *dih = data;
+
+	(void) kmem_scnprintf(buf, size,
+	    "%-12llu %12llu %12llu %12llu %12llu %12llu %12llu %12llu %14llu "
+	    "%12llu %15llu\n",
+	    1ULL << dih->dih_bucket,
+	    (u_longlong_t)dih->dih_lat[DATASET_IO_READ],
+	    (u_longlong_t)dih->dih_lat[DATASET_IO_WRITE],
+	    (u_longlong_t)dih->dih_lat[DATASET_IO_DISCARD],
+	    (u_longlong_t)dih->dih_lat[DATASET_IO_FLUSH],
+	    (u_longlong_t)dih->dih_size[DATASET_IO_READ],
+	    (u_longlong_t)dih->dih_size[DATASET_IO_WRITE],
+	    (u_longlong_t)dih->dih_size[DATASET_IO_DISCARD],
+	    (u_longlong_t)dih->dih_lat[DATASET_IO_SYNC_WRITE],
+	    (u_longlong_t)dih->dih_lat[DATASET_IO_TX_WAIT],
+	    (u_longlong_t)dih->dih_size[DATASET_IO_SYNC_WRITE]);
+
+	return (0);
+}
+
+/*
+ * Sum the stripes of bucket n.  The kstat's lock serializes the readers of
+ * dk_io_histo_sum.
+ */
+static void *
+dataset_kstats_io_histo_addr(kstat_t *ksp, loff_t n)
+{
+	dataset_kstats_t *dk = ksp->ks_private;
+	dataset_io_histo_t *sum = &dk->dk_io_histo_sum;
+
+	if (n >= DATASET_IO_HISTO_BUCKETS)
+		return (NULL);
+
+	memset(sum, 0, sizeof (*sum));
+	sum->dih_bucket = n;
+	for (uint_t s = 0; s < dk->dk_io_nstripes; s++) {
+		dataset_io_histo_t *dih =
+		    &dk->dk_io_histo[s * DATASET_IO_HISTO_BUCKETS + n];
+		for (int t = 0; t < DATASET_IO_TYPES; t++) {
+			sum->dih_lat[t] += dih->dih_lat[t];
+			sum->dih_size[t] += dih->dih_size[t];
+		}
+	}
+	return (sum);
+}
+
+/*
+ * Zvols and filesystems also get an "objset-0x<id>-io_histo" kstat, with a
+ * row for each latency and size bucket.  See dataset_kstats_update_io_histo().
+ */
+static void
+dataset_kstats_io_histo_create(dataset_kstats_t *dk, const char *module,
+    objset_t *objset)
+{
+	char kstat_name[KSTAT_STRLEN];
+
+	(void) snprintf(kstat_name, sizeof (kstat_name),
+	    "objset-0x%llx-io_histo", (unsigned long long)dmu_objset_id(objset));
+
+	kstat_t *kstat = kstat_create(module, 0, kstat_name, "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (kstat == NULL)
+		return;
+
+	dk->dk_io_nstripes = MIN(boot_ncpus, DATASET_IO_HISTO_MAX_STRIPES);
+	dk->dk_io_histo = kmem_zalloc(dk->dk_io_nstripes *
+	    DATASET_IO_HISTO_BUCKETS * sizeof (dataset_io_histo_t), KM_SLEEP);
+
+	kstat->ks_data = NULL;
+	kstat->ks_ndata = UINT32_MAX;
+	kstat->ks_private = dk;
+	kstat_set_raw_ops(kstat, dataset_kstats_io_histo_headers,
+	    dataset_kstats_io_histo_data, dataset_kstats_io_histo_addr);
+
+	dk->dk_io_kstat = kstat;
+	kstat_install(kstat);
+}
+
 int
 dataset_kstats_create(dataset_kstats_t *dk, objset_t *objset)
 {
@@ -156,6 +268,7 @@ dataset_kstats_create(dataset_kstats_t *dk, objset_t *objset)
 	    kmem_alloc(sizeof (empty_dataset_kstats), KM_SLEEP);
 	memcpy(dk_kstats, &empty_dataset_kstats,
 	    sizeof (empty_dataset_kstats));
+	zil_kstat_values_init(&dk_kstats->dkv_zil_stats);
 
 	char *ds_name = kmem_zalloc(ZFS_MAX_DATASET_NAME_LEN, KM_SLEEP);
 	dsl_dataset_name(objset->os_dsl_dataset, ds_name);
@@ -174,10 +287,21 @@ dataset_kstats_create(dataset_kstats_t *dk, objset_t *objset)
 	wmsum_init(&dk->dk_sums.dss_nread, 0);
 	wmsum_init(&dk->dk_sums.dss_nunlinks, 0);
 	wmsum_init(&dk->dk_sums.dss_nunlinked, 0);
+	wmsum_init(&dk->dk_sums.dss_blksz_adapted, 0);
+	wmsum_init(&dk->dk_sums.dss_blksz_adapted_bytes, 0);
 	zil_sums_init(&dk->dk_zil_sums);
+	dk->dk_arc_account = arc_account_hold(dmu_objset_spa(objset),
+	    dmu_objset_id(objset));
+	dk->dk_spa = dmu_objset_spa(objset);
+	dk->dk_objset = dmu_objset_id(objset);
 
 	dk->dk_kstats = kstat;
 	kstat_install(kstat);
+
+	if (dmu_objset_type(objset) == DMU_OST_ZVOL ||
+	    dmu_objset_type(objset) == DMU_OST_ZFS)
+		dataset_kstats_io_histo_create(dk, kstat_module_name, objset);
+
 	return (0);
 }
 
@@ -187,6 +311,15 @@ dataset_kstats_destroy(dataset_kstats_t *dk)
 	if (dk->dk_kstats == NULL)
 		return;
 
+	if (dk->dk_io_kstat != NULL) {
+		kstat_delete(dk->dk_io_kstat);
+		dk->dk_io_kstat = NULL;
+		kmem_free(dk->dk_io_histo, dk->dk_io_nstripes *
+		    DATASET_IO_HISTO_BUCKETS * sizeof (dataset_io_histo_t));
+		dk->dk_io_histo = NULL;
+		dk->dk_io_nstripes = 0;
+	}
+
 	dataset_kstat_values_t *dkv = dk->dk_kstats->ks_data;
 	kstat_delete(dk->dk_kstats);
 	dk->dk_kstats = NULL;
@@ -200,7 +333,11 @@ dataset_kstats_destroy(dataset_kstats_t *dk)
 	wmsum_fini(&dk->dk_sums.dss_nread);
 	wmsum_fini(&dk->dk_sums.dss_nunlinks);
 	wmsum_fini(&dk->dk_sums.dss_nunlinked);
+	wmsum_fini(&dk->dk_sums.dss_blksz_adapted);
+	wmsum_fini(&dk->dk_sums.dss_blksz_adapted_bytes);
 	zil_sums_fini(&dk->dk_zil_sums);
+	arc_account_rele(dk->dk_arc_account);
+	dk->dk_arc_account = 0;
 }
 
 void
@@ -242,6 +379,32 @@ dataset_kstats_update_read_kstats(dataset_kstats_t *dk, int64_t nread)
 	wmsum_add(&dk->dk_sums.dss_nread, nread);
 }
 
+/*
+ * Account for a completed request of 'size' bytes which took 'lat'
+ * nanoseconds, from its arrival to its completion.  Zvols account for
+ * their block device requests, filesystems for zfs_read(), zfs_write()
+ * and zfs_fsync(), and for the time zfs_write() waits to be assigned to a
+ * transaction group.
+ */
+void
+dataset_kstats_update_io_histo(dataset_kstats_t *dk, dataset_io_type_t type,
+    uint64_t size, hrtime_t lat)
+{
+	if (dk->dk_io_histo == NULL)
+		return;
+
+	dataset_io_histo_t *dih = &dk->dk_io_histo[
+	    (CPU_SEQID_UNSTABLE % dk->dk_io_nstripes) *
+	    DATASET_IO_HISTO_BUCKETS];
+
+	atomic_inc_64(&dih[HISTO(MAX(lat, 0),
+	    DATASET_IO_HISTO_BUCKETS)].dih_lat[type]);
+	if (type != DATASET_IO_FLUSH && type != DATASET_IO_TX_WAIT) {
+		atomic_inc_64(&dih[HISTO(size,
+		    DATASET_IO_HISTO_BUCKETS)].dih_size[type]);
+	}
+}
+
 void
 dataset_kstats_update_nunlinks_kstat(dataset_kstats_t *dk, int64_t delta)
 {
@@ -259,3 +422,13 @@ dataset_kstats_update_nunlinked_kstat(dataset_kstats_t *dk, int64_t delta)
 
 	wmsum_add(&dk->dk_sums.dss_nunlinked, delta);
 }
+
+void
+dataset_kstats_update_blksz_kstat(dataset_kstats_t *dk, uint64_t blksz)
+{
+	if (dk->dk_kstats == NULL)
+		return;
+
+	wmsum_add(&dk->dk_sums.dss_blksz_adapted, 1);
+	wmsum_add(&dk->dk_sums.dss_blksz_adapted_bytes, blksz);
+}
@@ -56,6 +56,7 @@
 #include <cityhash.h>
 #include <sys/spa_impl.h>
 #include <sys/wmsum.h>
+#include <sys/pcsum.h>
 #include <sys/vdev_impl.h>
 
 static kstat_t *dbuf_ksp;
@@ -106,6 +107,11 @@ typedef struct dbuf_stats {
 	 */
 	kstat_named_t hash_table_count;
 	kstat_named_t hash_mutex_count;
+	/*
+	 * Number of times the hash table was grown or shrunk online.
+	 */
+	kstat_named_t hash_table_grows;
+	kstat_named_t hash_table_shrinks;
 	/*
 	 * Statistics about the size of the metadata dbuf cache.
 	 */
@@ -118,6 +124,14 @@ typedef struct dbuf_stats {
 	 * the data in the regular dbuf cache.
 	 */
 	kstat_named_t metadata_cache_overflow;
+	/*
+	 * Statistics about the per-CPU dbuf cache fronts: dbufs parked in
+	 * a front on release, dbufs held again straight from a front, and
+	 * dbufs pushed out of a front onto the dbuf cache multilists.
+	 */
+	kstat_named_t front_inserts;
+	kstat_named_t front_hits;
+	kstat_named_t front_spills;
 } dbuf_stats_t;
 
 dbuf_stats_t dbuf_stats = {
@@ -139,10 +153,15 @@ dbuf_stats_t dbuf_stats = {
 	{ "hash_insert_race",			KSTAT_DATA_UINT64 },
 	{ "hash_table_count",			KSTAT_DATA_UINT64 },
 	{ "hash_mutex_count",			KSTAT_DATA_UINT64 },
+	{ "hash_table_grows",			KSTAT_DATA_UINT64 },
+	{ "hash_table_shrinks",			KSTAT_DATA_UINT64 },
 	{ "metadata_cache_count",		KSTAT_DATA_UINT64 },
 	{ "metadata_cache_size_bytes",		KSTAT_DATA_UINT64 },
 	{ "metadata_cache_size_bytes_max",	KSTAT_DATA_UINT64 },
-	{ "metadata_cache_overflow",		KSTAT_DATA_UINT64 }
+	{ "metadata_cache_overflow",		KSTAT_DATA_UINT64 },
+	{ "front_inserts",			KSTAT_DATA_UINT64 },
+	{ "front_hits",				KSTAT_DATA_UINT64 },
+	{ "front_spills",			KSTAT_DATA_UINT64 }
 };
 
 struct {
@@ -156,8 +175,13 @@ struct {
 	wmsum_t hash_elements;
 	wmsum_t hash_chains;
 	wmsum_t hash_insert_race;
+	wmsum_t hash_table_grows;
+	wmsum_t hash_table_shrinks;
 	wmsum_t metadata_cache_count;
 	wmsum_t metadata_cache_overflow;
+	wmsum_t front_inserts;
+	wmsum_t front_hits;
+	wmsum_t front_spills;
 } dbuf_sums;
 
 #define	DBUF_STAT_INCR(stat, val)	\
@@ -218,13 +242,19 @@ static boolean_t dbuf_evict_thread_exit;
  *
  * If a given dbuf meets the requirements for the metadata cache, it will go
  * there, otherwise it will be considered for the generic LRU dbuf cache. The
- * caches and the refcounts tracking their sizes are stored in an array indexed
- * by those caches' matching enum values (from dbuf_cached_state_t).
+ * caches and the per-CPU sums tracking their sizes are stored in an array
+ * indexed by those caches' matching enum values (from dbuf_cached_state_t).
  */
 typedef struct dbuf_cache {
 	multilist_t cache;
-	zfs_refcount_t size ____cacheline_aligned;
+	pcsum_t size ____cacheline_aligned;
 } dbuf_cache_t;
+
+/*
+ * Per-CPU batch of the cache size sums; the sizes used to decide whether
+ * to evict are within 2 * DBUF_CACHE_SUM_BATCH per CPU of the actual ones.
+ */
+#define	DBUF_CACHE_SUM_BATCH	SPA_OLD_MAXBLOCKSIZE
 dbuf_cache_t dbuf_caches[DB_CACHE_MAX];
 
 /* Size limits for the caches */
@@ -238,8 +268,21 @@ static uint_t dbuf_metadata_cache_shift = 6;
 /* Set the dbuf hash mutex count as log2 shift (dynamic by default) */
 static uint_t dbuf_mutex_cache_shift = 0;
 
+/* Allow the dbuf hash table to be resized online */
+static int dbuf_hash_resize = 1;
+
+/* Park released dbufs in a per-CPU front before the cache multilists */
+static int dbuf_cache_front = 1;
+
+/*
+ * Minimum number of dirty level-1 records in a single list before their
+ * subtrees are synced in parallel by dp_dbuf_sync_taskq (0 disables).
+ */
+static uint_t dbuf_sync_parallel_min = 32;
+
 static unsigned long dbuf_cache_target_bytes(void);
 static unsigned long dbuf_metadata_cache_target_bytes(void);
+static inline boolean_t dbuf_cache_above_lowater(void);
 
 /*
  * The LRU dbuf cache uses a three-stage eviction policy:
@@ -344,25 +387,27 @@ dbuf_find(objset_t *os, uint64_t obj, uint8_t level, uint64_t blkid,
     uint64_t *hash_out)
 {
 	dbuf_hash_table_t *h = &dbuf_hash_table;
+	dbuf_hash_stripe_t *hs;
 	uint64_t hv;
 	uint64_t idx;
 	dmu_buf_impl_t *db;
 
 	hv = dbuf_hash(os, obj, level, blkid);
-	idx = hv & h->hash_table_mask;
+	hs = DBUF_HASH_STRIPE(h, hv);
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (db = h->hash_table[idx]; db != NULL; db = db->db_hash_next) {
+	mutex_enter(&hs->hs_mutex);
+	idx = hv & hs->hs_table_mask;
+	for (db = hs->hs_table[idx]; db != NULL; db = db->db_hash_next) {
 		if (DBUF_EQUAL(db, os, obj, level, blkid)) {
 			mutex_enter(&db->db_mtx);
 			if (db->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(&hs->hs_mutex);
 				return (db);
 			}
 			mutex_exit(&db->db_mtx);
 		}
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	mutex_exit(&hs->hs_mutex);
 	if (hash_out != NULL)
 		*hash_out = hv;
 	return (NULL);
@@ -399,21 +444,23 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	objset_t *os = db->db_objset;
 	uint64_t obj = db->db.db_object;
 	int level = db->db_level;
+	dbuf_hash_stripe_t *hs;
 	uint64_t blkid, idx;
 	dmu_buf_impl_t *dbf;
 	uint32_t i;
 
 	blkid = db->db_blkid;
 	ASSERT3U(dbuf_hash(os, obj, level, blkid), ==, db->db_hash);
-	idx = db->db_hash & h->hash_table_mask;
+	hs = DBUF_HASH_STRIPE(h, db->db_hash);
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (dbf = h->hash_table[idx], i = 0; dbf != NULL;
+	mutex_enter(&hs->hs_mutex);
+	idx = db->db_hash & hs->hs_table_mask;
+	for (dbf = hs->hs_table[idx], i = 0; dbf != NULL;
 	    dbf = dbf->db_hash_next, i++) {
 		if (DBUF_EQUAL(dbf, os, obj, level, blkid)) {
 			mutex_enter(&dbf->db_mtx);
 			if (dbf->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				mutex_exit(&hs->hs_mutex);
 				return (dbf);
 			}
 			mutex_exit(&dbf->db_mtx);
@@ -429,9 +476,9 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	}
 
 	mutex_enter(&db->db_mtx);
-	db->db_hash_next = h->hash_table[idx];
-	h->hash_table[idx] = db;
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	db->db_hash_next = hs->hs_table[idx];
+	hs->hs_table[idx] = db;
+	mutex_exit(&hs->hs_mutex);
 	DBUF_STAT_BUMP(hash_elements);
 
 	return (NULL);
@@ -458,8 +505,7 @@ dbuf_include_in_metadata_cache(dmu_buf_impl_t *db)
 		 * Sanity check for small-memory systems: don't allocate too
 		 * much memory for this purpose.
 		 */
-		if (zfs_refcount_count(
-		    &dbuf_caches[DB_DBUF_METADATA_CACHE].size) >
+		if (pcsum_estimate(&dbuf_caches[DB_DBUF_METADATA_CACHE].size) >
 		    dbuf_metadata_cache_target_bytes()) {
 			DBUF_STAT_BUMP(metadata_cache_overflow);
 			return (B_FALSE);
@@ -478,12 +524,13 @@ static void
 dbuf_hash_remove(dmu_buf_impl_t *db)
 {
 	dbuf_hash_table_t *h = &dbuf_hash_table;
+	dbuf_hash_stripe_t *hs;
 	uint64_t idx;
 	dmu_buf_impl_t *dbf, **dbp;
 
 	ASSERT3U(dbuf_hash(db->db_objset, db->db.db_object, db->db_level,
 	    db->db_blkid), ==, db->db_hash);
-	idx = db->db_hash & h->hash_table_mask;
+	hs = DBUF_HASH_STRIPE(h, db->db_hash);
 
 	/*
 	 * We mustn't hold db_mtx to maintain lock ordering:
@@ -493,21 +540,318 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 	ASSERT(db->db_state == DB_EVICTING);
 	ASSERT(!MUTEX_HELD(&db->db_mtx));
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	dbp = &h->hash_table[idx];
+	mutex_enter(&hs->hs_mutex);
+	idx = db->db_hash & hs->hs_table_mask;
+	dbp = &hs->hs_table[idx];
 	while ((dbf = *dbp) != db) {
 		dbp = &dbf->db_hash_next;
 		ASSERT(dbf != NULL);
 	}
 	*dbp = db->db_hash_next;
 	db->db_hash_next = NULL;
-	if (h->hash_table[idx] &&
-	    h->hash_table[idx]->db_hash_next == NULL)
+	if (hs->hs_table[idx] &&
+	    hs->hs_table[idx]->db_hash_next == NULL)
 		DBUF_STAT_BUMPDOWN(hash_chains);
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	mutex_exit(&hs->hs_mutex);
 	DBUF_STAT_BUMPDOWN(hash_elements);
 }
 
+/*
+ * The dbuf hash table is grown once it holds more than DBUF_HASH_GROW_LOAD
+ * dbufs per bucket on average, and shrunk again, though never below its
+ * boot-time size, once it holds fewer than one dbuf per DBUF_HASH_SHRINK_LOAD
+ * buckets.  The dbufs are moved to the new bucket array one stripe at a
+ * time, holding only that stripe's mutex, so lookups in the rest of the
+ * table proceed while it is being resized.  Only the dbuf eviction thread
+ * resizes the table.
+ */
+#define	DBUF_HASH_GROW_LOAD	2
+#define	DBUF_HASH_SHRINK_LOAD	8
+
+static uint64_t dbuf_hash_table_min;
+static uint64_t dbuf_hash_table_max;
+static hrtime_t dbuf_hash_table_checked;
+
+static void
+dbuf_hash_table_resize(uint64_t hsize)
+{
+	dbuf_hash_table_t *h = &dbuf_hash_table;
+	dmu_buf_impl_t **old = h->hash_table, **new;
+	uint64_t oldmask = h->hash_table_mask, newmask = hsize - 1;
+	uint64_t nstripes = h->hash_mutex_mask + 1;
+	uint64_t chain_max = 0;
+
+	ASSERT(ISP2(hsize));
+	ASSERT3U(hsize, >=, nstripes);
+
+	new = vmem_zalloc(hsize * sizeof (void *), KM_NOSLEEP);
+	if (new == NULL)
+		return;
+
+	/* Let the dbufs kstat walk whichever bucket array is larger. */
+	h->hash_table_mask = MAX(oldmask, newmask);
+
+	for (uint64_t m = 0; m < nstripes; m++) {
+		dbuf_hash_stripe_t *hs = &h->hash_stripes[m];
+		dmu_buf_impl_t *db, *next;
+		int64_t chains = 0;
+
+		mutex_enter(&hs->hs_mutex);
+		ASSERT3P(hs->hs_table, ==, old);
+		for (uint64_t idx = m; idx <= oldmask; idx += nstripes) {
+			if (old[idx] != NULL && old[idx]->db_hash_next != NULL)
+				chains--;
+			for (db = old[idx]; db != NULL; db = next) {
+				uint64_t nidx = db->db_hash & newmask;
+
+				next = db->db_hash_next;
+				db->db_hash_next = new[nidx];
+				new[nidx] = db;
+			}
+		}
+		for (uint64_t idx = m; idx <= newmask; idx += nstripes) {
+			uint64_t len = 0;
+
+			for (db = new[idx]; db != NULL; db = db->db_hash_next)
+				len++;
+			if (len > 1) {
+				chains++;
+				chain_max = MAX(chain_max, len - 1);
+			}
+		}
+		hs->hs_table = new;
+		hs->hs_table_mask = newmask;
+		mutex_exit(&hs->hs_mutex);
+
+		DBUF_STAT_INCR(hash_chains, chains);
+		if ((m & 0xff) == 0xff)
+			kpreempt(KPREEMPT_SYNC);
+	}
+
+	h->hash_table = new;
+	h->hash_table_mask = newmask;
+	vmem_free(old, (oldmask + 1) * sizeof (void *));
+
+	/* The longest chain seen so far is that of the new bucket array. */
+	dbuf_stats.hash_chain_max.value.ui64 = chain_max;
+	if (newmask > oldmask)
+		DBUF_STAT_BUMP(hash_table_grows);
+	else
+		DBUF_STAT_BUMP(hash_table_shrinks);
+}
+
+/*
+ * Called periodically by the dbuf eviction thread; resizes the hash table
+ * if its load is out of bounds.
+ */
+static void
+dbuf_hash_table_check(void)
+{
+	dbuf_hash_table_t *h = &dbuf_hash_table;
+	hrtime_t now = gethrtime();
+
+	if (!dbuf_hash_resize || now - dbuf_hash_table_checked < SEC2NSEC(1))
+		return;
+	dbuf_hash_table_checked = now;
+
+	uint64_t hsize = h->hash_table_mask + 1;
+	uint64_t elements = wmsum_value(&dbuf_sums.hash_elements);
+
+	if (elements > hsize * DBUF_HASH_GROW_LOAD &&
+	    hsize < dbuf_hash_table_max) {
+		uint64_t target = 1ULL << highbit64(elements /
+		    DBUF_HASH_GROW_LOAD);
+		dbuf_hash_table_resize(MIN(target, dbuf_hash_table_max));
+	} else if (elements < hsize / DBUF_HASH_SHRINK_LOAD &&
+	    hsize > dbuf_hash_table_min) {
+		dbuf_hash_table_resize(hsize >> 1);
+	}
+}
+
+/*
+ * Put a dbuf on its cache's multilist, in the sublist of the current CPU.
+ * Releasing and re-holding cached dbufs from the same CPU then keeps using
+ * the same sublist lock rather than bouncing between all of them.
+ */
+static void
+dbuf_cache_insert(dmu_buf_impl_t *db)
+{
+	multilist_t *ml = &dbuf_caches[db->db_caching_status].cache;
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	db->db_cache_sublist = multilist_get_cpu_index(ml);
+	multilist_insert(ml, db);
+}
+
+/*
+ * Per-CPU dbuf cache fronts.  Releasing the last hold on a cacheable dbuf
+ * and holding it again right away would otherwise insert it into and
+ * remove it from a dbuf cache multilist, taking a sublist lock shared with
+ * every other CPU each way.  Instead, the dbuf is parked in a small array
+ * belonging to the releasing CPU.  It is accounted for exactly as if it
+ * were on the multilist of its cache, and is only moved onto that
+ * multilist once newer releases need its slot.  Since the fronts are not
+ * visible to dbuf_evict_one(), they are limited to a few blocks per CPU
+ * of at most DBUF_FRONT_MAX_SIZE bytes each, are bypassed while the dbuf
+ * cache is above its low water mark, and are drained by the eviction
+ * thread before it starts evicting.
+ *
+ * db_front encodes the front and slot a dbuf is parked in (0 if none) and
+ * is protected by db_mtx; the contents of a front by its df_lock.  The
+ * lock order is db_mtx > df_lock, so a dbuf being pushed out of a front
+ * is only ever locked with mutex_tryenter().
+ */
+#define	DBUF_FRONT_SLOTS	8
+#define	DBUF_FRONT_MAX_SIZE	SPA_OLD_MAXBLOCKSIZE
+
+typedef struct dbuf_front {
+	kmutex_t	df_lock;
+	uint_t		df_next;
+	dmu_buf_impl_t	*df_slots[DBUF_FRONT_SLOTS];
+} ____cacheline_aligned dbuf_front_t;
+
+static dbuf_front_t *dbuf_fronts;
+static uint_t dbuf_nfronts;
+
+/*
+ * Park a dbuf whose last hold is being released in this CPU's front.
+ * Returns B_FALSE if the caller should put it on the multilist instead.
+ */
+static boolean_t
+dbuf_front_insert(dmu_buf_impl_t *db)
+{
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT0(db->db_front);
+	ASSERT3U(db->db_caching_status, !=, DB_NO_CACHE);
+
+	if (!dbuf_cache_front || db->db.db_size > DBUF_FRONT_MAX_SIZE)
+		return (B_FALSE);
+	if (db->db_caching_status == DB_DBUF_CACHE &&
+	    dbuf_cache_above_lowater())
+		return (B_FALSE);
+
+	uint_t f = CPU_SEQID_UNSTABLE % dbuf_nfronts;
+	dbuf_front_t *df = &dbuf_fronts[f];
+
+	mutex_enter(&df->df_lock);
+	uint_t slot = df->df_next;
+	dmu_buf_impl_t *odb = df->df_slots[slot];
+	if (odb != NULL) {
+		/*
+		 * Push the oldest dbuf in this front onto its multilist.  If
+		 * it is busy, most likely because it is just being held
+		 * again, let the new dbuf take the slow path instead.
+		 */
+		if (!mutex_tryenter(&odb->db_mtx)) {
+			mutex_exit(&df->df_lock);
+			return (B_FALSE);
+		}
+		ASSERT3U(odb->db_front, ==, f * DBUF_FRONT_SLOTS + slot + 1);
+		ASSERT(zfs_refcount_is_zero(&odb->db_holds));
+		odb->db_front = 0;
+		dbuf_cache_insert(odb);
+		mutex_exit(&odb->db_mtx);
+		DBUF_STAT_BUMP(front_spills);
+	}
+	df->df_slots[slot] = db;
+	df->df_next = (slot + 1) % DBUF_FRONT_SLOTS;
+	db->db_front = f * DBUF_FRONT_SLOTS + slot + 1;
+	mutex_exit(&df->df_lock);
+
+	DBUF_STAT_BUMP(front_inserts);
+	return (B_TRUE);
+}
+
+/*
+ * Push every dbuf parked in a front that is not busy onto its multilist,
+ * so that dbuf_evict_one() can find it.
+ */
+static void
+dbuf_front_drain(void)
+{
+	for (uint_t f = 0; f < dbuf_nfronts; f++) {
+		dbuf_front_t *df = &dbuf_fronts[f];
+
+		mutex_enter(&df->df_lock);
+		for (uint_t slot = 0; slot < DBUF_FRONT_SLOTS; slot++) {
+			dmu_buf_impl_t *db = df->df_slots[slot];
+
+			if (db == NULL || !mutex_tryenter(&db->db_mtx))
+				continue;
+			ASSERT3U(db->db_front, ==,
+			    f * DBUF_FRONT_SLOTS + slot + 1);
+			db->db_front = 0;
+			dbuf_cache_insert(db);
+			mutex_exit(&db->db_mtx);
+			df->df_slots[slot] = NULL;
+			DBUF_STAT_BUMP(front_spills);
+		}
+		mutex_exit(&df->df_lock);
+	}
+}
+
+/*
+ * Take a dbuf out of the front it is parked in.
+ */
+static void
+dbuf_front_remove(dmu_buf_impl_t *db)
+{
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT3U(db->db_front, !=, 0);
+
+	uint_t f = (db->db_front - 1) / DBUF_FRONT_SLOTS;
+	uint_t slot = (db->db_front - 1) % DBUF_FRONT_SLOTS;
+	dbuf_front_t *df = &dbuf_fronts[f];
+
+	mutex_enter(&df->df_lock);
+	ASSERT3P(df->df_slots[slot], ==, db);
+	df->df_slots[slot] = NULL;
+	mutex_exit(&df->df_lock);
+	db->db_front = 0;
+}
+
+/*
+ * Whether a dbuf is in one of the dbuf caches, and taking it out again.
+ */
+static inline boolean_t
+dbuf_cache_linked(dmu_buf_impl_t *db)
+{
+	return (db->db_front != 0 || multilist_link_active(&db->db_cache_link));
+}
+
+static void
+dbuf_cache_unlink(dmu_buf_impl_t *db)
+{
+	if (db->db_front != 0)
+		dbuf_front_remove(db);
+	else
+		multilist_remove(&dbuf_caches[db->db_caching_status].cache, db);
+}
+
+static void
+dbuf_front_init(void)
+{
+	dbuf_nfronts = MAX(max_ncpus, 1);
+	dbuf_fronts = kmem_zalloc(dbuf_nfronts * sizeof (dbuf_front_t),
+	    KM_SLEEP);
+	for (uint_t f = 0; f < dbuf_nfronts; f++) {
+		mutex_init(&dbuf_fronts[f].df_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
+}
+
+static void
+dbuf_front_fini(void)
+{
+	for (uint_t f = 0; f < dbuf_nfronts; f++) {
+		for (int i = 0; i < DBUF_FRONT_SLOTS; i++)
+			ASSERT0P(dbuf_fronts[f].df_slots[i]);
+		mutex_destroy(&dbuf_fronts[f].df_lock);
+	}
+	kmem_free(dbuf_fronts, dbuf_nfronts * sizeof (dbuf_front_t));
+	dbuf_fronts = NULL;
+}
+
 typedef enum {
 	DBVU_EVICTING,
 	DBVU_NOT_EVICTING
@@ -577,8 +921,8 @@ dbuf_evict_user(dmu_buf_impl_t *db)
 		 * not exist anymore by the time the sync functions run.
 		 */
 		uint64_t size = dbu->dbu_size;
-		(void) zfs_refcount_remove_many(
-		    &dbuf_caches[db->db_caching_status].size, size, dbu);
+		pcsum_add(&dbuf_caches[db->db_caching_status].size,
+		    -(int64_t)size);
 		if (db->db_caching_status == DB_DBUF_CACHE)
 			DBUF_STAT_DECR(cache_levels_bytes[db->db_level], size);
 	}
@@ -692,6 +1036,20 @@ dnode_level_is_l2cacheable(blkptr_t *bp, dnode_t *dn, int64_t level)
 	return (B_FALSE);
 }
 
+/*
+ * Data blocks of primarycache=filtered datasets only enter the ARC once the
+ * ARC's admission filter has seen them often enough.  Every call counts one
+ * access to the block.
+ */
+static boolean_t
+dbuf_is_admitted(dmu_buf_impl_t *db, const blkptr_t *bp)
+{
+	if (db->db_objset->os_primary_cache != ZFS_CACHE_FILTERED ||
+	    dbuf_is_metadata(db))
+		return (B_TRUE);
+
+	return (arc_admit(db->db_objset->os_spa, bp, B_TRUE));
+}
 
 /*
  * This function *must* return indices evenly distributed between all
@@ -706,21 +1064,12 @@ dbuf_cache_multilist_index_func(multilist_t *ml, void *obj)
 	dmu_buf_impl_t *db = obj;
 
 	/*
-	 * The assumption here, is the hash value for a given
-	 * dmu_buf_impl_t will remain constant throughout it's lifetime
-	 * (i.e. it's objset, object, level and blkid fields don't change).
-	 * Thus, we don't need to store the dbuf's sublist index
-	 * on insertion, as this index can be recalculated on removal.
-	 *
-	 * Also, the low order bits of the hash value are thought to be
-	 * distributed evenly. Otherwise, in the case that the multilist
-	 * has a power of two number of sublists, each sublists' usage
-	 * would not be evenly distributed. In this context full 64bit
-	 * division would be a waste of time, so limit it to 32 bits.
+	 * Dbufs are inserted into the sublist of the CPU releasing them
+	 * (see dbuf_cache_insert()), which is recorded so that they can be
+	 * removed from it again.
 	 */
-	return ((unsigned int)dbuf_hash(db->db_objset, db->db.db_object,
-	    db->db_level, db->db_blkid) %
-	    multilist_get_num_sublists(ml));
+	ASSERT3U(db->db_cache_sublist, <, multilist_get_num_sublists(ml));
+	return (db->db_cache_sublist);
 }
 
 /*
@@ -764,8 +1113,8 @@ dbuf_cache_lowater_bytes(void)
 static inline boolean_t
 dbuf_cache_above_lowater(void)
 {
-	return (zfs_refcount_count(&dbuf_caches[DB_DBUF_CACHE].size) >
-	    dbuf_cache_lowater_bytes());
+	return (pcsum_compare(&dbuf_caches[DB_DBUF_CACHE].size,
+	    dbuf_cache_lowater_bytes()) > 0);
 }
 
 /*
@@ -774,12 +1123,25 @@ dbuf_cache_above_lowater(void)
 static void
 dbuf_evict_one(void)
 {
-	int idx = multilist_get_random_index(&dbuf_caches[DB_DBUF_CACHE].cache);
-	multilist_sublist_t *mls = multilist_sublist_lock_idx(
-	    &dbuf_caches[DB_DBUF_CACHE].cache, idx);
+	multilist_t *ml = &dbuf_caches[DB_DBUF_CACHE].cache;
+	unsigned int num_sublists = multilist_get_num_sublists(ml);
+	unsigned int idx = multilist_get_random_index(ml);
+	multilist_sublist_t *mls;
 
 	ASSERT(!MUTEX_HELD(&dbuf_evict_lock));
 
+	/*
+	 * Dbufs only go onto the sublists of CPUs which release them, so
+	 * skip over the empty sublists of idle or offline CPUs.
+	 */
+	for (unsigned int i = 0; ; i++) {
+		mls = multilist_sublist_lock_idx(ml, idx);
+		if (!multilist_sublist_is_empty(mls) || i + 1 == num_sublists)
+			break;
+		multilist_sublist_unlock(mls);
+		idx = (idx + 1) % num_sublists;
+	}
+
 	dmu_buf_impl_t *db = multilist_sublist_tail(mls);
 	while (db != NULL && mutex_tryenter(&db->db_mtx) == 0) {
 		db = multilist_sublist_prev(mls, db);
@@ -793,10 +1155,8 @@ dbuf_evict_one(void)
 		multilist_sublist_unlock(mls);
 		uint64_t size = db->db.db_size;
 		uint64_t usize = dmu_buf_user_size(&db->db);
-		(void) zfs_refcount_remove_many(
-		    &dbuf_caches[DB_DBUF_CACHE].size, size, db);
-		(void) zfs_refcount_remove_many(
-		    &dbuf_caches[DB_DBUF_CACHE].size, usize, db->db_user);
+		pcsum_add(&dbuf_caches[DB_DBUF_CACHE].size, -(int64_t)size);
+		pcsum_add(&dbuf_caches[DB_DBUF_CACHE].size, -(int64_t)usize);
 		DBUF_STAT_BUMPDOWN(cache_levels[db->db_level]);
 		DBUF_STAT_BUMPDOWN(cache_count);
 		DBUF_STAT_DECR(cache_levels_bytes[db->db_level], size + usize);
@@ -831,17 +1191,24 @@ dbuf_evict_thread(void *unused)
 			(void) cv_timedwait_idle_hires(&dbuf_evict_cv,
 			    &dbuf_evict_lock, SEC2NSEC(1), MSEC2NSEC(1), 0);
 			CALLB_CPR_SAFE_END(&cpr, &dbuf_evict_lock);
+
+			mutex_exit(&dbuf_evict_lock);
+			dbuf_hash_table_check();
+			mutex_enter(&dbuf_evict_lock);
 		}
 		mutex_exit(&dbuf_evict_lock);
 
 		/*
 		 * Keep evicting as long as we're above the low water mark
 		 * for the cache. We do this without holding the locks to
-		 * minimize lock contention.
+		 * minimize lock contention.  While we are above it, no new
+		 * dbufs are parked in the per-CPU fronts.
 		 */
+		dbuf_front_drain();
 		while (dbuf_cache_above_lowater() && !dbuf_evict_thread_exit) {
 			dbuf_evict_one();
 		}
+		dbuf_hash_table_check();
 
 		mutex_enter(&dbuf_evict_lock);
 	}
@@ -887,7 +1254,7 @@ dbuf_evict_notify(uint64_t size)
 void
 dbuf_cache_reduce_target_size(void)
 {
-	uint64_t size = zfs_refcount_count(&dbuf_caches[DB_DBUF_CACHE].size);
+	uint64_t size = pcsum_estimate(&dbuf_caches[DB_DBUF_CACHE].size);
 
 	if (size > dbuf_cache_target_bytes())
 		cv_signal(&dbuf_evict_cv);
@@ -905,7 +1272,7 @@ dbuf_kstat_update(kstat_t *ksp, int rw)
 	ds->cache_count.value.ui64 =
 	    wmsum_value(&dbuf_sums.cache_count);
 	ds->cache_size_bytes.value.ui64 =
-	    zfs_refcount_count(&dbuf_caches[DB_DBUF_CACHE].size);
+	    pcsum_value(&dbuf_caches[DB_DBUF_CACHE].size);
 	ds->cache_target_bytes.value.ui64 = dbuf_cache_target_bytes();
 	ds->cache_hiwater_bytes.value.ui64 = dbuf_cache_hiwater_bytes();
 	ds->cache_lowater_bytes.value.ui64 = dbuf_cache_lowater_bytes();
@@ -931,12 +1298,19 @@ dbuf_kstat_update(kstat_t *ksp, int rw)
 	    wmsum_value(&dbuf_sums.hash_insert_race);
 	ds->hash_table_count.value.ui64 = h->hash_table_mask + 1;
 	ds->hash_mutex_count.value.ui64 = h->hash_mutex_mask + 1;
+	ds->hash_table_grows.value.ui64 =
+	    wmsum_value(&dbuf_sums.hash_table_grows);
+	ds->hash_table_shrinks.value.ui64 =
+	    wmsum_value(&dbuf_sums.hash_table_shrinks);
 	ds->metadata_cache_count.value.ui64 =
 	    wmsum_value(&dbuf_sums.metadata_cache_count);
-	ds->metadata_cache_size_bytes.value.ui64 = zfs_refcount_count(
-	    &dbuf_caches[DB_DBUF_METADATA_CACHE].size);
+	ds->metadata_cache_size_bytes.value.ui64 =
+	    pcsum_value(&dbuf_caches[DB_DBUF_METADATA_CACHE].size);
 	ds->metadata_cache_overflow.value.ui64 =
 	    wmsum_value(&dbuf_sums.metadata_cache_overflow);
+	ds->front_inserts.value.ui64 = wmsum_value(&dbuf_sums.front_inserts);
+	ds->front_hits.value.ui64 = wmsum_value(&dbuf_sums.front_hits);
+	ds->front_spills.value.ui64 = wmsum_value(&dbuf_sums.front_spills);
 	return (0);
 }
 
@@ -955,17 +1329,6 @@ dbuf_init(void)
 	while (hsize * zfs_arc_average_blocksize < arc_all_memory() / 8)
 		hsize <<= 1;
 
-	h->hash_table = NULL;
-	while (h->hash_table == NULL) {
-		h->hash_table_mask = hsize - 1;
-
-		h->hash_table = vmem_zalloc(hsize * sizeof (void *), KM_SLEEP);
-		if (h->hash_table == NULL)
-			hsize >>= 1;
-
-		ASSERT3U(hsize, >=, 1ULL << 10);
-	}
-
 	/*
 	 * The hash table buckets are protected by an array of mutexes where
 	 * each mutex is reponsible for protecting 128 buckets.  A minimum
@@ -976,25 +1339,55 @@ dbuf_init(void)
 	else
 		hmsize = 1ULL << MIN(dbuf_mutex_cache_shift, 24);
 
-	h->hash_mutexes = NULL;
-	while (h->hash_mutexes == NULL) {
+	h->hash_stripes = NULL;
+	while (h->hash_stripes == NULL) {
 		h->hash_mutex_mask = hmsize - 1;
 
-		h->hash_mutexes = vmem_zalloc(hmsize * sizeof (kmutex_t),
-		    KM_SLEEP);
-		if (h->hash_mutexes == NULL)
+		h->hash_stripes = vmem_zalloc(hmsize *
+		    sizeof (dbuf_hash_stripe_t), KM_SLEEP);
+		if (h->hash_stripes == NULL)
 			hmsize >>= 1;
 	}
 
+	/* The bucket array may never be smaller than the mutex array. */
+	hsize = MAX(hsize, hmsize);
+
+	h->hash_table = NULL;
+	while (h->hash_table == NULL) {
+		h->hash_table_mask = hsize - 1;
+
+		h->hash_table = vmem_zalloc(hsize * sizeof (void *), KM_SLEEP);
+		if (h->hash_table == NULL)
+			hsize >>= 1;
+
+		ASSERT3U(hsize, >=, 1ULL << 10);
+		ASSERT3U(hsize, >=, hmsize);
+	}
+
+	/*
+	 * Online resizing may grow the table until it takes up 1/64th of
+	 * memory, and shrinks it no further than its initial size.
+	 */
+	dbuf_hash_table_min = hsize;
+	dbuf_hash_table_max = hsize;
+	while (dbuf_hash_table_max * sizeof (void *) < arc_all_memory() / 64)
+		dbuf_hash_table_max <<= 1;
+
 	dbuf_kmem_cache = kmem_cache_create("dmu_buf_impl_t",
 	    sizeof (dmu_buf_impl_t),
 	    0, dbuf_cons, dbuf_dest, NULL, NULL, NULL, 0);
 	dbuf_dirty_kmem_cache = kmem_cache_create("dbuf_dirty_record_t",
 	    sizeof (dbuf_dirty_record_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 
-	for (int i = 0; i < hmsize; i++)
-		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_NOLOCKDEP, NULL);
+	for (int i = 0; i < hmsize; i++) {
+		dbuf_hash_stripe_t *hs = &h->hash_stripes[i];
+
+		mutex_init(&hs->hs_mutex, NULL, MUTEX_NOLOCKDEP, NULL);
+		hs->hs_table = h->hash_table;
+		hs->hs_table_mask = h->hash_table_mask;
+	}
 
+	dbuf_front_init();
 	dbuf_stats_init(h);
 
 	/*
@@ -1004,11 +1397,11 @@ dbuf_init(void)
 	dbu_evict_taskq = taskq_create("dbu_evict", 1, defclsyspri, 0, 0, 0);
 
 	for (dbuf_cached_state_t dcs = 0; dcs < DB_CACHE_MAX; dcs++) {
-		multilist_create(&dbuf_caches[dcs].cache,
+		multilist_create_cpu_local(&dbuf_caches[dcs].cache,
 		    sizeof (dmu_buf_impl_t),
 		    offsetof(dmu_buf_impl_t, db_cache_link),
 		    dbuf_cache_multilist_index_func);
-		zfs_refcount_create(&dbuf_caches[dcs].size);
+		pcsum_init(&dbuf_caches[dcs].size, 0, DBUF_CACHE_SUM_BATCH);
 	}
 
 	dbuf_evict_thread_exit = B_FALSE;
@@ -1029,8 +1422,13 @@ dbuf_init(void)
 	wmsum_init(&dbuf_sums.hash_elements, 0);
 	wmsum_init(&dbuf_sums.hash_chains, 0);
 	wmsum_init(&dbuf_sums.hash_insert_race, 0);
+	wmsum_init(&dbuf_sums.hash_table_grows, 0);
+	wmsum_init(&dbuf_sums.hash_table_shrinks, 0);
 	wmsum_init(&dbuf_sums.metadata_cache_count, 0);
 	wmsum_init(&dbuf_sums.metadata_cache_overflow, 0);
+	wmsum_init(&dbuf_sums.front_inserts, 0);
+	wmsum_init(&dbuf_sums.front_hits, 0);
+	wmsum_init(&dbuf_sums.front_spills, 0);
 
 	dbuf_ksp = kstat_create("zfs", 0, "dbufstats", "misc",
 	    KSTAT_TYPE_NAMED, sizeof (dbuf_stats) / sizeof (kstat_named_t),
@@ -1059,17 +1457,7 @@ dbuf_fini(void)
 
 	dbuf_stats_destroy();
 
-	for (int i = 0; i < (h->hash_mutex_mask + 1); i++)
-		mutex_destroy(&h->hash_mutexes[i]);
-
-	vmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
-	vmem_free(h->hash_mutexes, (h->hash_mutex_mask + 1) *
-	    sizeof (kmutex_t));
-
-	kmem_cache_destroy(dbuf_kmem_cache);
-	kmem_cache_destroy(dbuf_dirty_kmem_cache);
-	taskq_destroy(dbu_evict_taskq);
-
+	/* The eviction thread may be resizing the hash table. */
 	mutex_enter(&dbuf_evict_lock);
 	dbuf_evict_thread_exit = B_TRUE;
 	while (dbuf_evict_thread_exit) {
@@ -1078,11 +1466,23 @@ dbuf_fini(void)
 	}
 	mutex_exit(&dbuf_evict_lock);
 
+	for (int i = 0; i < (h->hash_mutex_mask + 1); i++)
+		mutex_destroy(&h->hash_stripes[i].hs_mutex);
+
+	vmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
+	vmem_free(h->hash_stripes, (h->hash_mutex_mask + 1) *
+	    sizeof (dbuf_hash_stripe_t));
+
+	dbuf_front_fini();
+	kmem_cache_destroy(dbuf_kmem_cache);
+	kmem_cache_destroy(dbuf_dirty_kmem_cache);
+	taskq_destroy(dbu_evict_taskq);
+
 	mutex_destroy(&dbuf_evict_lock);
 	cv_destroy(&dbuf_evict_cv);
 
 	for (dbuf_cached_state_t dcs = 0; dcs < DB_CACHE_MAX; dcs++) {
-		zfs_refcount_destroy(&dbuf_caches[dcs].size);
+		pcsum_fini(&dbuf_caches[dcs].size);
 		multilist_destroy(&dbuf_caches[dcs].cache);
 	}
 
@@ -1103,8 +1503,13 @@ dbuf_fini(void)
 	wmsum_fini(&dbuf_sums.hash_elements);
 	wmsum_fini(&dbuf_sums.hash_chains);
 	wmsum_fini(&dbuf_sums.hash_insert_race);
+	wmsum_fini(&dbuf_sums.hash_table_grows);
+	wmsum_fini(&dbuf_sums.hash_table_shrinks);
 	wmsum_fini(&dbuf_sums.metadata_cache_count);
 	wmsum_fini(&dbuf_sums.metadata_cache_overflow);
+	wmsum_fini(&dbuf_sums.front_inserts);
+	wmsum_fini(&dbuf_sums.front_hits);
+	wmsum_fini(&dbuf_sums.front_spills);
 }
 
 /*
@@ -1374,9 +1779,13 @@ static void
 dbuf_read_done(zio_t *zio, const zbookmark_phys_t *zb, const blkptr_t *bp,
     arc_buf_t *buf, void *vdb)
 {
-	(void) zb, (void) bp;
+	(void) zb;
 	dmu_buf_impl_t *db = vdb;
 
+	/* A zio is only passed in when the block had to be read from disk */
+	if (zio != NULL && buf != NULL && bp != NULL && BP_IS_GANG(bp))
+		atomic_inc_64(&db->db_objset->os_gang_reads);
+
 	mutex_enter(&db->db_mtx);
 	ASSERT3U(db->db_state, ==, DB_READ);
 
@@ -1630,7 +2039,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, dnode_t *dn, zio_t *zio, dmu_flags_t flags,
 	DTRACE_SET_STATE(db, "read issued");
 	mutex_exit(&db->db_mtx);
 
-	if (!DBUF_IS_CACHEABLE(db))
+	if (!DBUF_IS_CACHEABLE(db) || !dbuf_is_admitted(db, bp))
 		aflags |= ARC_FLAG_UNCACHED;
 	else if (dbuf_is_l2cacheable(db, bp))
 		aflags |= ARC_FLAG_L2CACHE;
@@ -1931,6 +2340,9 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	ASSERT(dr->dt.dl.dr_override_state != DR_IN_DMU_SYNC);
 	ASSERT0(db->db_level);
 
+	/* The caller is about to modify the data, drop its checksum. */
+	dr->dt.dl.dr_fused_cksum = B_FALSE;
+
 	if (db->db_blkid == DMU_BONUS_BLKID ||
 	    dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN)
 		return;
@@ -2577,6 +2989,7 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 
 	ASSERT(db->db.db_size != 0);
 
+	dmu_objset_undirty_space(dn->dn_objset, dr->dr_accounted, txg);
 	dsl_pool_undirty_space(dmu_objset_pool(dn->dn_objset),
 	    dr->dr_accounted, txg);
 
@@ -2725,6 +3138,26 @@ dmu_buf_will_rewrite(dmu_buf_t *db_fake, dmu_tx_t *tx)
 	mutex_exit(&db->db_mtx);
 }
 
+/*
+ * Ask for the block, which must already be dirty in this txg, to be
+ * written to the special allocation class if there is room, regardless of
+ * its size.  Used to move frequently read file blocks to faster storage.
+ */
+void
+dmu_buf_will_promote(dmu_buf_t *db_fake, dmu_tx_t *tx)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)db_fake;
+
+	ASSERT(tx->tx_txg != 0);
+	ASSERT(!zfs_refcount_is_zero(&db->db_holds));
+
+	mutex_enter(&db->db_mtx);
+	dbuf_dirty_record_t *dr = dbuf_find_dirty_eq(db, tx->tx_txg);
+	if (dr != NULL && db->db_level == 0)
+		dr->dt.dl.dr_promote = B_TRUE;
+	mutex_exit(&db->db_mtx);
+}
+
 boolean_t
 dmu_buf_is_dirty(dmu_buf_t *db_fake, dmu_tx_t *tx)
 {
@@ -3010,10 +3443,30 @@ dbuf_override_impl(dmu_buf_impl_t *db, const blkptr_t *bp, dmu_tx_t *tx)
 	BP_SET_LOGICAL_BIRTH(&dl->dr_overridden_by, dr->dr_txg);
 }
 
+/*
+ * Record the checksum of the data just copied into a buffer that is being
+ * filled, for dbuf_write() to pass down to the write zio.  Must be called
+ * before dmu_buf_fill_done().
+ */
+void
+dmu_buf_fill_cksum(dmu_buf_t *dbuf, dmu_tx_t *tx, const zio_cksum_t *zcp)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbuf;
+	dbuf_dirty_record_t *dr;
+
+	mutex_enter(&db->db_mtx);
+	dr = dbuf_find_dirty_eq(db, tx->tx_txg);
+	if (db->db_state == DB_FILL && db->db_level == 0 && dr != NULL &&
+	    dr->dt.dl.dr_data == db->db_buf) {
+		dr->dt.dl.dr_cksum = *zcp;
+		dr->dt.dl.dr_fused_cksum = B_TRUE;
+	}
+	mutex_exit(&db->db_mtx);
+}
+
 boolean_t
 dmu_buf_fill_done(dmu_buf_t *dbuf, dmu_tx_t *tx, boolean_t failed)
 {
-	(void) tx;
 	dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbuf;
 	mutex_enter(&db->db_mtx);
 	DBUF_VERIFY(db);
@@ -3023,6 +3476,10 @@ dmu_buf_fill_done(dmu_buf_t *dbuf, dmu_tx_t *tx, boolean_t failed)
 			ASSERT(db->db_blkid != DMU_BONUS_BLKID);
 			/* we were freed while filling */
 			/* XXX dbuf_undirty? */
+			dbuf_dirty_record_t *dr = dbuf_find_dirty_eq(db,
+			    tx->tx_txg);
+			if (dr != NULL)
+				dr->dt.dl.dr_fused_cksum = B_FALSE;
 			memset(db->db.db_data, 0, db->db.db_size);
 			db->db_freed_in_flight = FALSE;
 			db->db_state = DB_CACHED;
@@ -3226,16 +3683,15 @@ dbuf_destroy(dmu_buf_impl_t *db)
 
 	dbuf_clear_data(db);
 
-	if (multilist_link_active(&db->db_cache_link)) {
+	if (dbuf_cache_linked(db)) {
 		ASSERT(db->db_caching_status == DB_DBUF_CACHE ||
 		    db->db_caching_status == DB_DBUF_METADATA_CACHE);
 
-		multilist_remove(&dbuf_caches[db->db_caching_status].cache, db);
+		dbuf_cache_unlink(db);
 
 		ASSERT0(dmu_buf_user_size(&db->db));
-		(void) zfs_refcount_remove_many(
-		    &dbuf_caches[db->db_caching_status].size,
-		    db->db.db_size, db);
+		pcsum_add(&dbuf_caches[db->db_caching_status].size,
+		    -(int64_t)db->db.db_size);
 
 		if (db->db_caching_status == DB_DBUF_METADATA_CACHE) {
 			DBUF_STAT_BUMPDOWN(metadata_cache_count);
@@ -3307,6 +3763,7 @@ dbuf_destroy(dmu_buf_impl_t *db)
 	ASSERT0P(db->db_blkptr);
 	ASSERT0P(db->db_data_pending);
 	ASSERT3U(db->db_caching_status, ==, DB_NO_CACHE);
+	ASSERT0(db->db_front);
 	ASSERT(!multilist_link_active(&db->db_cache_link));
 
 	/*
@@ -3459,6 +3916,7 @@ dbuf_create(dnode_t *dn, uint8_t level, uint64_t blkid,
 		db->db_state = DB_UNCACHED;
 		DTRACE_SET_STATE(db, "bonus buffer created");
 		db->db_caching_status = DB_NO_CACHE;
+		db->db_front = 0;
 		/* the bonus dbuf is not placed in the hash table */
 		arc_space_consume(sizeof (dmu_buf_impl_t), ARC_SPACE_DBUF);
 		return (db);
@@ -3494,6 +3952,7 @@ dbuf_create(dnode_t *dn, uint8_t level, uint64_t blkid,
 	db->db_state = DB_UNCACHED;
 	DTRACE_SET_STATE(db, "regular buffer created");
 	db->db_caching_status = DB_NO_CACHE;
+	db->db_front = 0;
 	mutex_exit(&dn->dn_dbufs_mtx);
 	arc_space_consume(sizeof (dmu_buf_impl_t), ARC_SPACE_DBUF);
 
@@ -3812,7 +4271,14 @@ dbuf_prefetch_impl(dnode_t *dn, int64_t level, uint64_t blkid,
 	dpa->dpa_cb = cb;
 	dpa->dpa_arg = arg;
 
-	if (!DNODE_LEVEL_IS_CACHEABLE(dn, level))
+	/*
+	 * Prefetches only consult the admission filter, the access is
+	 * counted when (and if) the block is actually read.
+	 */
+	if (!DNODE_LEVEL_IS_CACHEABLE(dn, level) ||
+	    (dn->dn_objset->os_primary_cache == ZFS_CACHE_FILTERED &&
+	    level == 0 && curlevel == 0 && !DMU_OT_IS_METADATA(dn->dn_type) &&
+	    !arc_admit(dpa->dpa_spa, &bp, B_FALSE)))
 		dpa->dpa_aflags |= ARC_FLAG_UNCACHED;
 	else if (dnode_level_is_l2cacheable(&bp, dn, level))
 		dpa->dpa_aflags |= ARC_FLAG_L2CACHE;
@@ -3984,20 +4450,21 @@ dbuf_hold_impl(dnode_t *dn, uint8_t level, uint64_t blkid,
 		}
 	}
 
-	if (multilist_link_active(&db->db_cache_link)) {
+	if (dbuf_cache_linked(db)) {
 		ASSERT(zfs_refcount_is_zero(&db->db_holds));
 		ASSERT(db->db_caching_status == DB_DBUF_CACHE ||
 		    db->db_caching_status == DB_DBUF_METADATA_CACHE);
 
-		multilist_remove(&dbuf_caches[db->db_caching_status].cache, db);
+		if (db->db_front != 0)
+			DBUF_STAT_BUMP(front_hits);
+		dbuf_cache_unlink(db);
 
 		uint64_t size = db->db.db_size;
 		uint64_t usize = dmu_buf_user_size(&db->db);
-		(void) zfs_refcount_remove_many(
-		    &dbuf_caches[db->db_caching_status].size, size, db);
-		(void) zfs_refcount_remove_many(
-		    &dbuf_caches[db->db_caching_status].size, usize,
-		    db->db_user);
+		pcsum_add(&dbuf_caches[db->db_caching_status].size,
+		    -(int64_t)size);
+		pcsum_add(&dbuf_caches[db->db_caching_status].size,
+		    -(int64_t)usize);
 
 		if (db->db_caching_status == DB_DBUF_METADATA_CACHE) {
 			DBUF_STAT_BUMPDOWN(metadata_cache_count);
@@ -4219,7 +4686,7 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, const void *tag, boolean_t evicting)
 			 * is either not cacheable or was marked for eviction.
 			 */
 			dbuf_destroy(db);
-		} else if (!multilist_link_active(&db->db_cache_link)) {
+		} else if (!dbuf_cache_linked(db)) {
 			ASSERT3U(db->db_caching_status, ==, DB_NO_CACHE);
 
 			dbuf_cached_state_t dcs =
@@ -4227,13 +4694,13 @@ dbuf_rele_and_unlock(dmu_buf_impl_t *db, const void *tag, boolean_t evicting)
 			    DB_DBUF_METADATA_CACHE : DB_DBUF_CACHE;
 			db->db_caching_status = dcs;
 
-			multilist_insert(&dbuf_caches[dcs].cache, db);
+			if (evicting || !dbuf_front_insert(db))
+				dbuf_cache_insert(db);
 			uint64_t db_size = db->db.db_size;
 			uint64_t dbu_size = dmu_buf_user_size(&db->db);
-			(void) zfs_refcount_add_many(
-			    &dbuf_caches[dcs].size, db_size, db);
-			size = zfs_refcount_add_many(
-			    &dbuf_caches[dcs].size, dbu_size, db->db_user);
+			pcsum_add(&dbuf_caches[dcs].size, db_size);
+			pcsum_add(&dbuf_caches[dcs].size, dbu_size);
+			size = pcsum_estimate(&dbuf_caches[dcs].size);
 			uint8_t db_level = db->db_level;
 			mutex_exit(&db->db_mtx);
 
@@ -4653,6 +5120,7 @@ dbuf_lightweight_done(zio_t *zio)
 		dsl_dataset_block_born(ds, zio->io_bp, tx);
 	}
 
+	dmu_objset_undirty_space(os, dr->dr_accounted, zio->io_txg);
 	dsl_pool_undirty_space(dmu_objset_pool(os), dr->dr_accounted,
 	    zio->io_txg);
 
@@ -4863,6 +5331,98 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 	}
 }
 
+typedef struct dbuf_sync_wait {
+	kmutex_t	dsw_lock;
+	kcondvar_t	dsw_cv;
+	uint64_t	dsw_pending;
+} dbuf_sync_wait_t;
+
+typedef struct dbuf_sync_task {
+	dbuf_dirty_record_t	*dst_dr;
+	dmu_tx_t		*dst_tx;
+	dbuf_sync_wait_t	*dst_wait;
+	taskq_ent_t		dst_tqent;
+} dbuf_sync_task_t;
+
+static void
+dbuf_sync_l1_task(void *arg)
+{
+	dbuf_sync_task_t *dst = arg;
+	dbuf_sync_wait_t *dsw = dst->dst_wait;
+
+	dbuf_sync_indirect(dst->dst_dr, dst->dst_tx);
+	kmem_free(dst, sizeof (*dst));
+
+	mutex_enter(&dsw->dsw_lock);
+	if (--dsw->dsw_pending == 0)
+		cv_broadcast(&dsw->dsw_cv);
+	mutex_exit(&dsw->dsw_lock);
+}
+
+/*
+ * A single large dirty object (e.g. a zvol taking random writes) would
+ * otherwise be synced by one thread walking every dirty dbuf.  When a list
+ * of level-1 records is long enough, hand each level-1 subtree to
+ * dp_dbuf_sync_taskq and wait for all of them before returning, so the
+ * caller's parent zio is still not issued until every child zio exists.
+ * The subtrees are disjoint; each task only takes locks of its own dbufs
+ * and adds children to its own level-1 zio.
+ *
+ * The meta-dnode is excluded since its leaf dirty records are put back on
+ * the dnode's dirty list for the caller to wait on.
+ */
+noinline static void
+dbuf_sync_list_parallel(list_t *list, dmu_tx_t *tx)
+{
+	dbuf_dirty_record_t *dr, *dr_next;
+	uint_t count = 0;
+
+	dr = list_head(list);
+	if (dr == NULL || dr->dr_dnode->dn_object == DMU_META_DNODE_OBJECT)
+		return;
+
+	for (; dr != NULL && count < dbuf_sync_parallel_min;
+	    dr = list_next(list, dr)) {
+		if (dr->dr_dbuf != NULL && dr->dr_dbuf->db_level == 1)
+			count++;
+	}
+	if (count < dbuf_sync_parallel_min)
+		return;
+
+	taskq_t *tq = tx->tx_pool->dp_dbuf_sync_taskq;
+	dbuf_sync_wait_t dsw;
+	mutex_init(&dsw.dsw_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&dsw.dsw_cv, NULL, CV_DEFAULT, NULL);
+	dsw.dsw_pending = 0;
+
+	for (dr = list_head(list); dr != NULL; dr = dr_next) {
+		dr_next = list_next(list, dr);
+		if (dr->dr_dbuf == NULL || dr->dr_dbuf->db_level != 1)
+			continue;
+		list_remove(list, dr);
+
+		dbuf_sync_task_t *dst = kmem_alloc(sizeof (*dst), KM_SLEEP);
+		dst->dst_dr = dr;
+		dst->dst_tx = tx;
+		dst->dst_wait = &dsw;
+		taskq_init_ent(&dst->dst_tqent);
+
+		mutex_enter(&dsw.dsw_lock);
+		dsw.dsw_pending++;
+		mutex_exit(&dsw.dsw_lock);
+		taskq_dispatch_ent(tq, dbuf_sync_l1_task, dst, 0,
+		    &dst->dst_tqent);
+	}
+
+	mutex_enter(&dsw.dsw_lock);
+	while (dsw.dsw_pending != 0)
+		cv_wait(&dsw.dsw_cv, &dsw.dsw_lock);
+	mutex_exit(&dsw.dsw_lock);
+
+	cv_destroy(&dsw.dsw_cv);
+	mutex_destroy(&dsw.dsw_lock);
+}
+
 /*
  * Syncs out a range of dirty records for indirect or leaf dbufs.  May be
  * called recursively from dbuf_sync_indirect().
@@ -4872,6 +5432,9 @@ dbuf_sync_list(list_t *list, int level, dmu_tx_t *tx)
 {
 	dbuf_dirty_record_t *dr;
 
+	if (level == 1 && dbuf_sync_parallel_min != 0)
+		dbuf_sync_list_parallel(list, tx);
+
 	while ((dr = list_head(list))) {
 		if (dr->dr_zio != NULL) {
 			/*
@@ -4923,6 +5486,9 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 	dnode_diduse_space(dn, delta - zio->io_prev_space_delta);
 	zio->io_prev_space_delta = delta;
 
+	if (BP_IS_GANG(bp))
+		atomic_inc_64(&db->db_objset->os_gang_writes);
+
 	if (BP_GET_BIRTH(bp) != 0) {
 		ASSERT((db->db_blkid != DMU_SPILL_BLKID &&
 		    BP_GET_TYPE(bp) == dn->dn_type) ||
@@ -5127,6 +5693,7 @@ dbuf_write_done(zio_t *zio, arc_buf_t *buf, void *vdb)
 	db->db_data_pending = NULL;
 	dbuf_rele_and_unlock(db, (void *)(uintptr_t)tx->tx_txg, B_FALSE);
 
+	dmu_objset_undirty_space(os, dr->dr_accounted, zio->io_txg);
 	dsl_pool_undirty_space(dmu_objset_pool(os), dr->dr_accounted,
 	    zio->io_txg);
 
@@ -5356,6 +5923,16 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx)
 
 	dmu_write_policy(os, dn, db->db_level, wp_flag, &zp);
 
+	/*
+	 * Use the checksum taken while the data was copied in, if the block
+	 * is still going to be checksummed with fletcher4.
+	 */
+	if (db->db_level == 0 && dr->dt.dl.dr_fused_cksum &&
+	    zp.zp_checksum == ZIO_CHECKSUM_FLETCHER_4) {
+		zp.zp_fused_cksum = B_TRUE;
+		zp.zp_cksum = dr->dt.dl.dr_cksum;
+	}
+
 	/*
 	 * Set rewrite properties for zfs_rewrite() operations.
 	 */
@@ -5374,6 +5951,15 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, dmu_tx_t *tx)
 		}
 	}
 
+	/*
+	 * A promoted block must get a new allocation to move at all, so
+	 * don't let nopwrite keep it where it is.
+	 */
+	if (db->db_level == 0 && dr->dt.dl.dr_promote) {
+		zp.zp_promote = B_TRUE;
+		zp.zp_nopwrite = B_FALSE;
+	}
+
 	/*
 	 * We copy the blkptr now (rather than when we instantiate the dirty
 	 * record), because its value can change between open context and
@@ -5445,6 +6031,7 @@ EXPORT_SYMBOL(dbuf_dirty);
 EXPORT_SYMBOL(dmu_buf_set_crypt_params);
 EXPORT_SYMBOL(dmu_buf_will_dirty);
 EXPORT_SYMBOL(dmu_buf_will_rewrite);
+EXPORT_SYMBOL(dmu_buf_will_promote);
 EXPORT_SYMBOL(dmu_buf_is_dirty);
 EXPORT_SYMBOL(dmu_buf_will_clone_or_dio);
 EXPORT_SYMBOL(dmu_buf_will_not_fill);
@@ -5489,3 +6076,12 @@ ZFS_MODULE_PARAM(zfs_dbuf, dbuf_, metadata_cache_shift, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_dbuf, dbuf_, mutex_cache_shift, UINT, ZMOD_RD,
 	"Set size of dbuf cache mutex array as log2 shift.");
+
+ZFS_MODULE_PARAM(zfs_dbuf, dbuf_, hash_resize, INT, ZMOD_RW,
+	"Allow the dbuf hash table to be resized online.");
+
+ZFS_MODULE_PARAM(zfs_dbuf_cache, dbuf_cache_, front, INT, ZMOD_RW,
+	"Park released dbufs in per-CPU fronts of the dbuf cache.");
+
+ZFS_MODULE_PARAM(zfs_dbuf, dbuf_, sync_parallel_min, UINT, ZMOD_RW,
+	"Min dirty L1 records in a list to sync their subtrees in parallel.");
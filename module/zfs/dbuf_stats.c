@@ -92,7 +92,7 @@ __dbuf_stats_hash_table_data(char *buf, size_t size, dmu_buf_impl_t *db)
 	    !!dbuf_is_metadata(db),
 	    db->db_state,
 	    (ulong_t)zfs_refcount_count(&db->db_holds),
-	    multilist_link_active(&db->db_cache_link),
+	    db->db_front != 0 || multilist_link_active(&db->db_cache_link),
 	    /* arc_buf_info_t */
 	    abi.abi_state_type,
 	    abi.abi_state_contents,
@@ -131,16 +131,22 @@ dbuf_stats_hash_table_data(char *buf, size_t size, void *data)
 {
 	dbuf_stats_t *dsh = (dbuf_stats_t *)data;
 	dbuf_hash_table_t *h = dsh->hash;
+	dbuf_hash_stripe_t *hs;
 	dmu_buf_impl_t *db;
 	int length, error = 0;
 
 	ASSERT3S(dsh->idx, >=, 0);
-	ASSERT3S(dsh->idx, <=, h->hash_table_mask);
 	if (size)
 		buf[0] = 0;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, dsh->idx));
-	for (db = h->hash_table[dsh->idx]; db != NULL; db = db->db_hash_next) {
+	/*
+	 * The table may have shrunk since dbuf_stats_hash_table_addr()
+	 * checked the index.
+	 */
+	hs = DBUF_HASH_STRIPE(h, dsh->idx);
+	mutex_enter(&hs->hs_mutex);
+	db = (dsh->idx <= hs->hs_table_mask) ? hs->hs_table[dsh->idx] : NULL;
+	for (; db != NULL; db = db->db_hash_next) {
 		/*
 		 * Returning ENOMEM will cause the data and header functions
 		 * to be called with a larger scratch buffers.
@@ -160,7 +166,7 @@ dbuf_stats_hash_table_data(char *buf, size_t size, void *data)
 
 		mutex_exit(&db->db_mtx);
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, dsh->idx));
+	mutex_exit(&hs->hs_mutex);
 
 	return (error);
 }
@@ -230,6 +230,12 @@ static kmem_cache_t *ddt_entry_trad_cache;
  */
 int zfs_dedup_prefetch = 0;
 
+/*
+ * Prefetch the store entries of dedup writes that queued up behind ddt_lock
+ * together, in a single locked pass, rather than one lookup at a time.
+ */
+static int zfs_dedup_prefetch_batch = 1;
+
 /*
  * If the dedup class cannot satisfy a DDT allocation, treat as over quota
  * for this many TXGs.
@@ -243,6 +249,18 @@ uint_t dedup_class_wait_txgs = 5;
  */
 static uint32_t zfs_ddt_prunes_per_txg = 50000;
 
+/*
+ * Once the DDT grows past this percentage of its dedup_table_quota, the
+ * background prune thread starts removing the oldest unique entries, a
+ * zfs_dedup_prune_auto_step percent of them per pass, with no more than
+ * zfs_dedup_prune_auto_per_txg of them synced per txg, and at least
+ * zfs_dedup_prune_auto_interval_ms between passes. 0 disables it.
+ */
+static uint_t zfs_dedup_prune_auto_pct = 90;
+static uint_t zfs_dedup_prune_auto_step = 5;
+static uint32_t zfs_dedup_prune_auto_per_txg = 5000;
+static uint_t zfs_dedup_prune_auto_interval_ms = 10000;
+
 /*
  * For testing, synthesize aged DDT entries
  * (in global scope for ztest)
@@ -290,6 +308,16 @@ boolean_t zfs_dedup_log_hard_cap = B_FALSE;
  */
 uint_t zfs_dedup_log_flush_flow_rate_txgs = 10;
 
+/*
+ * Number of key range shards the dedup log flush is split into, each written
+ * to the store objects in parallel on the sync taskq. 1 flushes serially from
+ * the sync thread.
+ */
+uint_t zfs_dedup_log_flush_shards = 8;
+
+/* Entries flushed by each shard in one batch */
+#define	DDT_FLUSH_SHARD_ENTRIES	256
+
 static const ddt_ops_t *const ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
 };
@@ -331,6 +359,14 @@ typedef struct {
 	kstat_named_t dds_lookup_stored_hit;
 	kstat_named_t dds_lookup_stored_miss;
 
+	/* store searches skipped or allowed by the filter, and wasted */
+	kstat_named_t dds_lookup_filter_skip;
+	kstat_named_t dds_lookup_filter_pass;
+	kstat_named_t dds_lookup_filter_false_positive;
+
+	/* keys prefetched together for writes waiting on the lock */
+	kstat_named_t dds_lookup_batch_prefetch;
+
 	/* number of entries on log trees */
 	kstat_named_t dds_log_active_entries;
 	kstat_named_t dds_log_flushing_entries;
@@ -354,6 +390,10 @@ static const ddt_kstats_t ddt_kstats_template = {
 	{ "lookup_log_miss",		KSTAT_DATA_UINT64 },
 	{ "lookup_stored_hit",		KSTAT_DATA_UINT64 },
 	{ "lookup_stored_miss",		KSTAT_DATA_UINT64 },
+	{ "lookup_filter_skip",		KSTAT_DATA_UINT64 },
+	{ "lookup_filter_pass",		KSTAT_DATA_UINT64 },
+	{ "lookup_filter_false_positive", KSTAT_DATA_UINT64 },
+	{ "lookup_batch_prefetch",	KSTAT_DATA_UINT64 },
 	{ "log_active_entries",		KSTAT_DATA_UINT64 },
 	{ "log_flushing_entries",	KSTAT_DATA_UINT64 },
 	{ "log_ingest_rate",		KSTAT_DATA_UINT32 },
@@ -409,6 +449,8 @@ ddt_object_create(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 	VERIFY0(zap_add(os, spa->spa_ddt_stat_object, name,
 	    sizeof (uint64_t), sizeof (ddt_histogram_t) / sizeof (uint64_t),
 	    &ddt->ddt_histogram[type][class], tx));
+
+	ddt_filter_touch(ddt);
 }
 
 static void
@@ -435,6 +477,8 @@ ddt_object_destroy(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 	memset(&ddt->ddt_object_stats[type][class], 0, sizeof (ddt_object_t));
 
 	*objectp = 0;
+
+	ddt_filter_touch(ddt);
 }
 
 static int
@@ -568,6 +612,8 @@ ddt_object_update(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 {
 	ASSERT(ddt_object_exists(ddt, type, class));
 
+	ddt_filter_add(ddt, &ddlwe->ddlwe_key);
+
 	return (ddt_ops[type]->ddt_op_update(ddt->ddt_os,
 	    ddt->ddt_object[type][class], &ddlwe->ddlwe_key,
 	    &ddlwe->ddlwe_phys, DDT_PHYS_SIZE(ddt), tx));
@@ -579,6 +625,8 @@ ddt_object_remove(ddt_t *ddt, ddt_type_t type, ddt_class_t class,
 {
 	ASSERT(ddt_object_exists(ddt, type, class));
 
+	ddt_filter_touch(ddt);
+
 	return (ddt_ops[type]->ddt_op_remove(ddt->ddt_os,
 	    ddt->ddt_object[type][class], ddk, tx));
 }
@@ -1276,28 +1324,48 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t verify)
 		DDT_KSTAT_BUMP(ddt, dds_lookup_log_miss);
 	}
 
-	/*
-	 * ddt_tree is now stable, so unlock and let everyone else keep moving.
-	 * Anyone landing on this entry will find it without DDE_FLAG_LOADED,
-	 * and go to sleep waiting for it above.
-	 */
-	ddt_exit(ddt);
+	boolean_t filtered = ddt_filter_active(ddt);
+	if (filtered && !ddt_filter_contains(ddt, &search)) {
+		/*
+		 * The filter knows every key ever stored, so this one is
+		 * definitely new; skip searching the store objects.
+		 */
+		DDT_KSTAT_BUMP(ddt, dds_lookup_filter_skip);
+		error = ENOENT;
+		type = DDT_TYPES;
+		class = DDT_CLASSES;
+	} else {
+		if (filtered)
+			DDT_KSTAT_BUMP(ddt, dds_lookup_filter_pass);
 
-	/* Search all store objects for the entry. */
-	error = ENOENT;
-	for (type = 0; type < DDT_TYPES; type++) {
-		for (class = 0; class < DDT_CLASSES; class++) {
-			error = ddt_object_lookup(ddt, type, class, dde);
-			if (error != ENOENT) {
-				ASSERT0(error);
-				break;
+		/*
+		 * ddt_tree is now stable, so unlock and let everyone else
+		 * keep moving. Anyone landing on this entry will find it
+		 * without DDE_FLAG_LOADED, and go to sleep waiting for it
+		 * above.
+		 */
+		ddt_exit(ddt);
+
+		/* Search all store objects for the entry. */
+		error = ENOENT;
+		for (type = 0; type < DDT_TYPES; type++) {
+			for (class = 0; class < DDT_CLASSES; class++) {
+				error = ddt_object_lookup(ddt, type, class,
+				    dde);
+				if (error != ENOENT) {
+					ASSERT0(error);
+					break;
+				}
 			}
+			if (error != ENOENT)
+				break;
 		}
-		if (error != ENOENT)
-			break;
-	}
 
-	ddt_enter(ddt);
+		ddt_enter(ddt);
+
+		if (filtered && error == ENOENT)
+			DDT_KSTAT_BUMP(ddt, dds_lookup_filter_false_positive);
+	}
 
 	ASSERT(!(dde->dde_flags & DDE_FLAG_LOADED));
 
@@ -1395,6 +1463,93 @@ ddt_prefetch(spa_t *spa, const blkptr_t *bp)
 	}
 }
 
+/*
+ * Queue the key of a dedup write about to take ddt_lock, so that whichever
+ * writer gets the lock first can prefetch it along with the others waiting.
+ */
+void
+ddt_prefetch_queue(ddt_t *ddt, const blkptr_t *bp)
+{
+	if (!zfs_dedup_prefetch_batch)
+		return;
+
+	mutex_enter(&ddt->ddt_prefetch_lock);
+	if (ddt->ddt_prefetch_count < DDT_PREFETCH_QUEUE) {
+		ddt_key_fill(
+		    &ddt->ddt_prefetch_queue[ddt->ddt_prefetch_count++], bp);
+	}
+	mutex_exit(&ddt->ddt_prefetch_lock);
+}
+
+/*
+ * Take every key queued by ddt_prefetch_queue() other than this writer's
+ * own, which it is about to look up anyway. Those already in memory, on the
+ * live tree or a log, or known by the filter not to be stored, are dropped
+ * in one pass; the store objects are then prefetched for the rest with the
+ * lock dropped, so the waiters' lookups find their entries in the ARC.
+ *
+ * Called with ddt_lock held, which may be dropped and reacquired.
+ */
+void
+ddt_prefetch_issue(ddt_t *ddt, const blkptr_t *bp)
+{
+	ddt_key_t self, *keys;
+	uint_t count, n = 0;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	if (!zfs_dedup_prefetch_batch ||
+	    ddt->ddt_version == DDT_VERSION_UNCONFIGURED)
+		return;
+
+	ddt_key_fill(&self, bp);
+
+	mutex_enter(&ddt->ddt_prefetch_lock);
+	count = ddt->ddt_prefetch_count;
+	if (count == 0 || (count == 1 &&
+	    ddt_key_compare(&self, &ddt->ddt_prefetch_queue[0]) == 0)) {
+		ddt->ddt_prefetch_count = 0;
+		mutex_exit(&ddt->ddt_prefetch_lock);
+		return;
+	}
+	keys = kmem_alloc(count * sizeof (ddt_key_t), KM_SLEEP);
+	memcpy(keys, ddt->ddt_prefetch_queue, count * sizeof (ddt_key_t));
+	ddt->ddt_prefetch_count = 0;
+	mutex_exit(&ddt->ddt_prefetch_lock);
+
+	boolean_t filtered = ddt_filter_active(ddt);
+	for (uint_t i = 0; i < count; i++) {
+		ddt_key_t *ddk = &keys[i];
+
+		if (ddt_key_compare(ddk, &self) == 0 ||
+		    avl_find(&ddt->ddt_tree, ddk, NULL) != NULL)
+			continue;
+		if ((ddt->ddt_flags & DDT_FLAG_LOG) &&
+		    ddt_log_find_key(ddt, ddk, NULL))
+			continue;
+		if (filtered && !ddt_filter_contains(ddt, ddk))
+			continue;
+		keys[n++] = *ddk;
+	}
+
+	if (n > 0) {
+		ddt_exit(ddt);
+		for (uint_t i = 0; i < n; i++) {
+			for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
+				for (ddt_class_t class = 0;
+				    class < DDT_CLASSES; class++) {
+					ddt_object_prefetch(ddt, type, class,
+					    &keys[i]);
+				}
+			}
+		}
+		DDT_KSTAT_ADD(ddt, dds_lookup_batch_prefetch, n);
+		ddt_enter(ddt);
+	}
+
+	kmem_free(keys, count * sizeof (ddt_key_t));
+}
+
 /*
  * ddt_key_t comparison. Any struct wanting to make use of this function must
  * have the key as the first element. Casts it to N uint64_ts, and checks until
@@ -1457,6 +1612,7 @@ ddt_destroy_dir(ddt_t *ddt, dmu_tx_t *tx)
 		}
 	}
 
+	ddt_filter_destroy(ddt, tx);
 	ddt_log_destroy(ddt, tx);
 
 	uint64_t count;
@@ -1622,6 +1778,7 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 	ddt = kmem_cache_alloc(ddt_cache, KM_SLEEP);
 	memset(ddt, 0, sizeof (ddt_t));
 	mutex_init(&ddt->ddt_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&ddt->ddt_prefetch_lock, NULL, MUTEX_DEFAULT, NULL);
 	avl_create(&ddt->ddt_tree, ddt_key_compare,
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
 	avl_create(&ddt->ddt_repair_tree, ddt_key_compare,
@@ -1648,15 +1805,34 @@ ddt_table_free(ddt_t *ddt)
 		kstat_delete(ddt->ddt_ksp);
 	}
 
+	ddt_filter_free(ddt);
 	ddt_log_free(ddt);
 	ASSERT0(avl_numnodes(&ddt->ddt_tree));
 	ASSERT0(avl_numnodes(&ddt->ddt_repair_tree));
 	avl_destroy(&ddt->ddt_tree);
 	avl_destroy(&ddt->ddt_repair_tree);
+	mutex_destroy(&ddt->ddt_prefetch_lock);
 	mutex_destroy(&ddt->ddt_lock);
 	kmem_cache_free(ddt_cache, ddt);
 }
 
+/*
+ * DDT blocks are charged to an ARC account of their own rather than to the
+ * MOS, so that the dedup_table_arc_reserve pool property can keep them cached
+ * through pressure from other data. The account is held for as long as the
+ * DDTs are loaded, which also lets arcstats report how much DDT is resident.
+ */
+void
+ddt_arc_reserve_update(spa_t *spa)
+{
+	if (spa->spa_ddt_arc_account == 0) {
+		spa->spa_ddt_arc_account =
+		    arc_account_hold(spa, ARC_ACCOUNT_DDT);
+	}
+	arc_account_set(spa->spa_ddt_arc_account, 0,
+	    spa->spa_dedup_table_arc_reserve);
+}
+
 void
 ddt_create(spa_t *spa)
 {
@@ -1674,6 +1850,7 @@ ddt_load(spa_t *spa)
 	int error;
 
 	ddt_create(spa);
+	ddt_arc_reserve_update(spa);
 
 	error = zap_lookup(spa->spa_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
 	    DMU_POOL_DDT_STATS, sizeof (uint64_t), 1,
@@ -1705,6 +1882,10 @@ ddt_load(spa_t *spa)
 		if (error != 0 && error != ENOENT)
 			return (error);
 
+		error = ddt_filter_load(ddt);
+		if (error != 0)
+			return (error);
+
 		DDT_KSTAT_SET(ddt, dds_log_active_entries,
 		    avl_numnodes(&ddt->ddt_log_active->ddl_tree));
 		DDT_KSTAT_SET(ddt, dds_log_flushing_entries,
@@ -1732,6 +1913,9 @@ ddt_unload(spa_t *spa)
 			spa->spa_ddt[c] = NULL;
 		}
 	}
+
+	arc_account_rele(spa->spa_ddt_arc_account);
+	spa->spa_ddt_arc_account = 0;
 }
 
 boolean_t
@@ -1970,7 +2154,8 @@ ddt_sync_scan_entry(ddt_t *ddt, ddt_lightweight_entry_t *ddlwe, dmu_tx_t *tx)
 
 static void
 ddt_sync_flush_entry(ddt_t *ddt, ddt_lightweight_entry_t *ddlwe,
-    ddt_type_t otype, ddt_class_t oclass, dmu_tx_t *tx)
+    ddt_type_t otype, ddt_class_t oclass,
+    ddt_histogram_t (*histogram)[DDT_CLASSES], dmu_tx_t *tx)
 {
 	ddt_key_t *ddk = &ddlwe->ddlwe_key;
 	ddt_type_t ntype = DDT_TYPE_DEFAULT;
@@ -2022,8 +2207,7 @@ ddt_sync_flush_entry(ddt_t *ddt, ddt_lightweight_entry_t *ddlwe,
 	 * Add or update the entry
 	 */
 	if (refcnt != 0) {
-		ddt_histogram_t *ddh =
-		    &ddt->ddt_histogram[ntype][nclass];
+		ddt_histogram_t *ddh = &histogram[ntype][nclass];
 
 		ddt_histogram_add_entry(ddt, ddh, ddlwe);
 
@@ -2079,6 +2263,84 @@ ddt_flush_force_update_txg(ddt_t *ddt, uint64_t txg)
 	ddt->ddt_flush_force_txg = 0;
 }
 
+typedef struct {
+	ddt_t			*dfs_ddt;
+	ddt_lightweight_entry_t	*dfs_entries;
+	uint32_t		dfs_count;
+	dmu_tx_t		*dfs_tx;
+	ddt_histogram_t		dfs_histogram[DDT_TYPES][DDT_CLASSES];
+} ddt_flush_shard_t;
+
+static void
+ddt_sync_flush_shard(void *arg)
+{
+	ddt_flush_shard_t *dfs = arg;
+
+	for (uint32_t i = 0; i < dfs->dfs_count; i++) {
+		ddt_lightweight_entry_t *ddlwe = &dfs->dfs_entries[i];
+		ddt_sync_flush_entry(dfs->dfs_ddt, ddlwe, ddlwe->ddlwe_type,
+		    ddlwe->ddlwe_class, dfs->dfs_histogram, dfs->dfs_tx);
+	}
+}
+
+/*
+ * Flush a batch of entries taken in key order from the flushing log, by
+ * splitting it into contiguous key ranges that are written to the store
+ * objects in parallel. Shards only touch their own entries and histograms;
+ * any store object they'll need is created up front, since that changes the
+ * DDT itself.
+ */
+static void
+ddt_sync_flush_batch(ddt_t *ddt, ddt_lightweight_entry_t *entries,
+    uint32_t count, ddt_flush_shard_t *shards, uint_t nshards, dmu_tx_t *tx)
+{
+	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
+
+	for (uint32_t i = 0; i < count; i++) {
+		ddt_univ_phys_t *ddp = &entries[i].ddlwe_phys;
+		uint64_t refcnt = 0;
+
+		for (int p = 0; p < DDT_NPHYS(ddt); p++) {
+			if (!DDT_PHYS_IS_DITTO(ddt, p))
+				refcnt += ddt_phys_refcnt(ddp,
+				    DDT_PHYS_VARIANT(ddt, p));
+		}
+		if (refcnt == 0)
+			continue;
+
+		ddt_class_t nclass =
+		    (refcnt > 1) ? DDT_CLASS_DUPLICATE : DDT_CLASS_UNIQUE;
+		if (!ddt_object_exists(ddt, DDT_TYPE_DEFAULT, nclass))
+			ddt_object_create(ddt, DDT_TYPE_DEFAULT, nclass, tx);
+	}
+
+	uint32_t per = howmany(count, nshards);
+	uint_t n = 0;
+	for (uint32_t i = 0; i < count; i += per, n++) {
+		ddt_flush_shard_t *dfs = &shards[n];
+
+		dfs->dfs_ddt = ddt;
+		dfs->dfs_entries = &entries[i];
+		dfs->dfs_count = MIN(per, count - i);
+		dfs->dfs_tx = tx;
+		memset(dfs->dfs_histogram, 0, sizeof (dfs->dfs_histogram));
+		VERIFY(taskq_dispatch(dp->dp_sync_taskq, ddt_sync_flush_shard,
+		    dfs, TQ_SLEEP) != TASKQID_INVALID);
+	}
+	taskq_wait(dp->dp_sync_taskq);
+
+	for (uint_t i = 0; i < n; i++) {
+		for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
+			for (ddt_class_t class = 0; class < DDT_CLASSES;
+			    class++) {
+				ddt_histogram_add(
+				    &ddt->ddt_histogram[type][class],
+				    &shards[i].dfs_histogram[type][class]);
+			}
+		}
+	}
+}
+
 static void
 ddt_sync_flush_log(ddt_t *ddt, dmu_tx_t *tx)
 {
@@ -2174,9 +2436,53 @@ ddt_sync_flush_log(ddt_t *ddt, dmu_tx_t *tx)
 	}
 
 	ddt_lightweight_entry_t ddlwe;
+	uint_t nshards = MAX(1, zfs_dedup_log_flush_shards);
+
+	if (nshards > 1) {
+		/*
+		 * Flush in batches, taking a shard's worth of entries for
+		 * each shard, and checking the limits between batches.
+		 */
+		uint32_t batch_max = nshards * DDT_FLUSH_SHARD_ENTRIES;
+		ddt_lightweight_entry_t *entries = vmem_alloc(
+		    batch_max * sizeof (ddt_lightweight_entry_t), KM_SLEEP);
+		ddt_flush_shard_t *shards = kmem_alloc(
+		    nshards * sizeof (ddt_flush_shard_t), KM_SLEEP);
+
+		for (;;) {
+			uint32_t n = 0;
+			uint32_t want = MIN(batch_max, flush_max - count);
+
+			while (n < want && ddt_log_take_first(ddt,
+			    ddt->ddt_log_flushing, &entries[n]))
+				n++;
+			if (n == 0)
+				break;
+
+			ddt_sync_flush_batch(ddt, entries, n, shards,
+			    nshards, tx);
+			ddlwe = entries[n - 1];
+			count += n;
+
+			if (count >= flush_max)
+				break;
+
+			uint64_t diff = gethrtime() - flush_start;
+			if (count > zfs_dedup_log_flush_entries_min &&
+			    diff >= target_time * 2)
+				break;
+			if (count > flush_min && diff >= target_time)
+				break;
+		}
+
+		kmem_free(shards, nshards * sizeof (ddt_flush_shard_t));
+		vmem_free(entries, batch_max * sizeof (ddt_lightweight_entry_t));
+		goto flushed;
+	}
+
 	while (ddt_log_take_first(ddt, ddt->ddt_log_flushing, &ddlwe)) {
 		ddt_sync_flush_entry(ddt, &ddlwe,
-		    ddlwe.ddlwe_type, ddlwe.ddlwe_class, tx);
+		    ddlwe.ddlwe_type, ddlwe.ddlwe_class, ddt->ddt_histogram, tx);
 
 		/* End if we've synced as much as we needed to. */
 		if (++count >= flush_max)
@@ -2198,6 +2504,7 @@ ddt_sync_flush_log(ddt_t *ddt, dmu_tx_t *tx)
 			break;
 	}
 
+flushed:
 	if (avl_is_empty(&ddt->ddt_log_flushing->ddl_tree)) {
 		/* We emptied it, so truncate on-disk */
 		DDT_KSTAT_ZERO(ddt, dds_log_flushing_entries);
@@ -2335,7 +2642,7 @@ ddt_sync_table_flush(ddt_t *ddt, dmu_tx_t *tx)
 		ddt_lightweight_entry_t ddlwe;
 		DDT_ENTRY_TO_LIGHTWEIGHT(ddt, dde, &ddlwe);
 		ddt_sync_flush_entry(ddt, &ddlwe,
-		    dde->dde_type, dde->dde_class, tx);
+		    dde->dde_type, dde->dde_class, ddt->ddt_histogram, tx);
 		ddt_sync_scan_entry(ddt, &ddlwe, tx);
 		ddt_free(ddt, dde);
 	}
@@ -2369,6 +2676,10 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx)
 	if (ddt->ddt_version == DDT_VERSION_FDT && ddt->ddt_dir_object == 0)
 		ddt_create_dir(ddt, tx);
 
+	/* An FDT with nothing stored yet can start a membership filter */
+	if (ddt->ddt_version == DDT_VERSION_FDT && ddt->ddt_filter == NULL)
+		ddt_filter_create(ddt, tx);
+
 	if (ddt->ddt_flags & DDT_FLAG_LOG)
 		ddt_sync_table_log(ddt, tx);
 	else
@@ -2405,6 +2716,7 @@ ddt_sync(spa_t *spa, uint64_t txg)
 		ddt_sync_table(ddt, tx);
 		if (ddt->ddt_flags & DDT_FLAG_LOG)
 			ddt_sync_flush_log(ddt, tx);
+		ddt_filter_sync(ddt, tx);
 		ddt_repair_table(ddt, rio);
 	}
 
@@ -2639,8 +2951,9 @@ ddt_prune_entry(list_t *list, ddt_t *ddt, const ddt_key_t *ddk,
  *
  *  Also called by zdb(8) to dump the age histogram
  */
-void
-ddt_prune_walk(spa_t *spa, uint64_t cutoff, ddt_age_histo_t *histogram)
+static void
+ddt_prune_walk_impl(spa_t *spa, uint64_t cutoff, ddt_age_histo_t *histogram,
+    uint32_t per_txg, zthr_t *zthr)
 {
 	ddt_bookmark_t ddb = {
 		.ddb_class = DDT_CLASS_UNIQUE,
@@ -2672,7 +2985,8 @@ ddt_prune_walk(spa_t *spa, uint64_t cutoff, ddt_age_histo_t *histogram)
 		ddt_t *ddt = spa->spa_ddt[ddb.ddb_checksum];
 		VERIFY(ddt);
 
-		if (spa_shutting_down(spa) || issig())
+		if (spa_shutting_down(spa) || issig() ||
+		    (zthr != NULL && zthr_iscancelled(zthr)))
 			break;
 
 		ASSERT(ddt->ddt_flags & DDT_FLAG_FLAT);
@@ -2690,7 +3004,7 @@ ddt_prune_walk(spa_t *spa, uint64_t cutoff, ddt_age_histo_t *histogram)
 
 		/* prune older entries */
 		if (pruning && class_start < cutoff) {
-			if (candidates++ >= zfs_ddt_prunes_per_txg) {
+			if (candidates++ >= per_txg) {
 				/* sync prune candidates in batches */
 				VERIFY0(dsl_sync_task(spa_name(spa),
 				    NULL, prune_candidates_sync,
@@ -2728,6 +3042,13 @@ ddt_prune_walk(spa_t *spa, uint64_t cutoff, ddt_age_histo_t *histogram)
 	}
 }
 
+void
+ddt_prune_walk(spa_t *spa, uint64_t cutoff, ddt_age_histo_t *histogram)
+{
+	ddt_prune_walk_impl(spa, cutoff, histogram, zfs_ddt_prunes_per_txg,
+	    NULL);
+}
+
 static uint64_t
 ddt_total_entries(spa_t *spa)
 {
@@ -2737,9 +3058,9 @@ ddt_total_entries(spa_t *spa)
 	return (ddo.ddo_count);
 }
 
-int
-ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
-    uint64_t amount)
+static int
+ddt_prune_unique_entries_impl(spa_t *spa, zpool_ddt_prune_unit_t unit,
+    uint64_t amount, uint32_t per_txg, zthr_t *zthr)
 {
 	uint64_t cutoff;
 	uint64_t start_time = gethrtime();
@@ -2759,7 +3080,7 @@ ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
 		uint64_t oldest = 0;
 
 		/* Make a pass over DDT to build a histogram */
-		ddt_prune_walk(spa, 0, &histogram);
+		ddt_prune_walk_impl(spa, 0, &histogram, per_txg, zthr);
 
 		int target = (histogram.dah_entries * amount) / 100;
 
@@ -2785,12 +3106,14 @@ ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
 	} else if (unit == ZPOOL_DDT_PRUNE_AGE) {
 		cutoff = gethrestime_sec() - amount;
 	} else {
+		spa->spa_active_ddt_prune = B_FALSE;
 		return (EINVAL);
 	}
 
-	if (cutoff > 0 && !spa_shutting_down(spa) && !issig()) {
+	if (cutoff > 0 && !spa_shutting_down(spa) && !issig() &&
+	    (zthr == NULL || !zthr_iscancelled(zthr))) {
 		/* Traverse DDT to prune entries older that our cuttoff */
-		ddt_prune_walk(spa, cutoff, NULL);
+		ddt_prune_walk_impl(spa, cutoff, NULL, per_txg, zthr);
 	}
 
 	zfs_dbgmsg("%s: prune completed in %llu ms",
@@ -2800,9 +3123,97 @@ ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
 	return (0);
 }
 
+int
+ddt_prune_unique_entries(spa_t *spa, zpool_ddt_prune_unit_t unit,
+    uint64_t amount)
+{
+	return (ddt_prune_unique_entries_impl(spa, unit, amount,
+	    zfs_ddt_prunes_per_txg, NULL));
+}
+
+/*
+ * True if the DDT is close enough to its quota that unique entries should be
+ * pruned in the background. For an automatic quota, whose limit depends on
+ * the dedup or special class, that's once it is over quota.
+ */
+static boolean_t
+ddt_prune_pressure(spa_t *spa)
+{
+	uint64_t quota = spa->spa_dedup_table_quota;
+
+	if (zfs_dedup_prune_auto_pct == 0 || quota == 0)
+		return (B_FALSE);
+
+	if (quota == UINT64_MAX)
+		return (ddt_over_quota(spa));
+
+	return (ddt_get_ddt_dsize(spa) >=
+	    quota / 100 * MIN(zfs_dedup_prune_auto_pct, 100));
+}
+
+boolean_t
+ddt_prune_thread_check(void *arg, zthr_t *zthr)
+{
+	(void) zthr;
+	spa_t *spa = arg;
+
+	if (!spa_writeable(spa) || spa->spa_active_ddt_prune ||
+	    gethrtime() - spa->spa_ddt_prune_time <
+	    MSEC2NSEC(zfs_dedup_prune_auto_interval_ms))
+		return (B_FALSE);
+
+	/* Only fast dedup tables record the age needed to prune */
+	boolean_t flat = B_FALSE;
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt != NULL &&
+		    ddt->ddt_version != DDT_VERSION_UNCONFIGURED &&
+		    (ddt->ddt_flags & DDT_FLAG_FLAT))
+			flat = B_TRUE;
+	}
+
+	return (flat && ddt_prune_pressure(spa));
+}
+
+/*
+ * Prune the oldest zfs_dedup_prune_auto_step percent of unique entries, in
+ * batches of at most zfs_dedup_prune_auto_per_txg per txg so the work is
+ * spread out rather than stalling a sync. Further passes follow as long as
+ * the DDT stays close to its quota.
+ */
+void
+ddt_prune_thread(void *arg, zthr_t *zthr)
+{
+	spa_t *spa = arg;
+
+	zfs_dbgmsg("%s: DDT near quota, pruning %u%% of unique entries",
+	    spa_name(spa), zfs_dedup_prune_auto_step);
+
+	(void) ddt_prune_unique_entries_impl(spa, ZPOOL_DDT_PRUNE_PERCENTAGE,
+	    MAX(1, MIN(zfs_dedup_prune_auto_step, 100)),
+	    MAX(1, zfs_dedup_prune_auto_per_txg), zthr);
+
+	spa->spa_ddt_prune_time = gethrtime();
+}
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prune_auto_pct, UINT, ZMOD_RW,
+	"Percent of dedup_table_quota at which to prune in the background");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prune_auto_step, UINT, ZMOD_RW,
+	"Percent of unique DDT entries to prune per background pass");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prune_auto_per_txg, UINT, ZMOD_RW,
+	"Max DDT entries to prune per txg in the background");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prune_auto_interval_ms, UINT,
+	ZMOD_RW, "Min time between background DDT prune passes");
+
 ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prefetch, INT, ZMOD_RW,
 	"Enable prefetching dedup-ed blks");
 
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prefetch_batch, INT, ZMOD_RW,
+	"Prefetch the DDT entries of queued dedup writes together");
+
 ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_min_time_ms, UINT, ZMOD_RW,
 	"Min time to spend on incremental dedup log flush each transaction");
 
@@ -2821,5 +3232,8 @@ ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_cap, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_hard_cap, UINT, ZMOD_RW,
 	"Whether to use the soft cap as a hard cap");
 
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_shards, UINT, ZMOD_RW,
+	"Number of key range shards to flush the dedup log in parallel");
+
 ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_flow_rate_txgs, UINT, ZMOD_RW,
 	"Number of txgs to average flow rates across");
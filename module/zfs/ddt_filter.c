@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: CDDL-1.0
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/ddt.h>
+#include <sys/ddt_impl.h>
+#include <sys/dmu.h>
+#include <sys/dmu_tx.h>
+#include <sys/dnode.h>
+#include <sys/zap.h>
+#include <sys/zio_checksum.h>
+
+/*
+ * DDT membership filter.
+ *
+ * Most blocks written to a dedup dataset are unique, so most calls to
+ * ddt_lookup() end up searching every store object for an entry that isn't
+ * there, reading ZAP blocks from disk to find that out. The filter is a
+ * bloom filter holding the key of every entry ever written to a store object
+ * of this DDT. When it says a key is absent, it is definitely absent, and the
+ * store search can be skipped entirely. Entries removed from the store stay
+ * in the filter; they only cost a false positive.
+ *
+ * The filter is only built for an FDT whose store objects are all empty, and
+ * is kept in sync from then on by ddt_object_update(). Its bitmap is stored
+ * in an object in the DDT dir, rewritten block by block as bits get set, and
+ * its header records the last txg in which the store and the filter were
+ * synced together. On load, a filter is only trusted if no store object was
+ * modified after that txg; otherwise (eg the pool was imported by software
+ * that doesn't maintain it), it is discarded.
+ */
+
+/* Bitmap size for new filters, in bytes. 0 disables new filters. */
+static uint64_t zfs_dedup_filter_size = 4 * 1024 * 1024;
+
+/* Largest bitmap we'll load from disk */
+#define	DDT_FILTER_MAX_SIZE	(1ULL << 30)
+
+/* Bits set per key */
+#define	DDT_FILTER_NHASH	4
+
+/* On-disk write and dirty tracking granularity */
+#define	DDT_FILTER_BLOCKSIZE	SPA_OLD_MAXBLOCKSIZE
+
+struct ddt_filter {
+	uint64_t	ddf_object;	/* on-disk filter object */
+	uint64_t	ddf_size;	/* bitmap size in bytes */
+	uint64_t	ddf_nhash;	/* bits set per key */
+	uint64_t	ddf_nset;	/* number of bits set */
+	uint64_t	*ddf_bits;	/* bitmap, NULL if filter is stale */
+	uint8_t		*ddf_dirty;	/* per-block dirty flags */
+	boolean_t	ddf_modified;	/* store changed this txg */
+};
+
+static void
+ddt_filter_hash(const ddt_key_t *ddk, uint64_t *h1, uint64_t *h2)
+{
+	/*
+	 * Dedup checksums are cryptographically strong, so the checksum words
+	 * are already well distributed; just fold in the block properties.
+	 */
+	*h1 = ddk->ddk_cksum.zc_word[0] ^
+	    (ddk->ddk_prop * 0x9e3779b97f4a7c15ULL);
+	*h2 = ddk->ddk_cksum.zc_word[1] | 1;
+}
+
+static ddt_filter_t *
+ddt_filter_alloc(uint64_t object, uint64_t size, uint64_t nhash)
+{
+	ddt_filter_t *ddf = kmem_zalloc(sizeof (ddt_filter_t), KM_SLEEP);
+
+	ddf->ddf_object = object;
+	ddf->ddf_size = size;
+	ddf->ddf_nhash = nhash;
+	if (size != 0) {
+		ddf->ddf_bits = vmem_zalloc(size, KM_SLEEP);
+		ddf->ddf_dirty = kmem_zalloc(
+		    howmany(size, DDT_FILTER_BLOCKSIZE), KM_SLEEP);
+	}
+
+	return (ddf);
+}
+
+void
+ddt_filter_free(ddt_t *ddt)
+{
+	ddt_filter_t *ddf = ddt->ddt_filter;
+
+	if (ddf == NULL)
+		return;
+
+	if (ddf->ddf_bits != NULL) {
+		vmem_free(ddf->ddf_bits, ddf->ddf_size);
+		kmem_free(ddf->ddf_dirty,
+		    howmany(ddf->ddf_size, DDT_FILTER_BLOCKSIZE));
+	}
+	kmem_free(ddf, sizeof (ddt_filter_t));
+	ddt->ddt_filter = NULL;
+}
+
+boolean_t
+ddt_filter_active(const ddt_t *ddt)
+{
+	return (ddt->ddt_filter != NULL && ddt->ddt_filter->ddf_bits != NULL);
+}
+
+/*
+ * Returns B_FALSE if the key is definitely not on any store object. Must only
+ * be called if the filter is active.
+ */
+boolean_t
+ddt_filter_contains(const ddt_t *ddt, const ddt_key_t *ddk)
+{
+	const ddt_filter_t *ddf = ddt->ddt_filter;
+	uint64_t mask = ddf->ddf_size * NBBY - 1;
+	uint64_t h1, h2;
+
+	ASSERT(ddt_filter_active(ddt));
+
+	ddt_filter_hash(ddk, &h1, &h2);
+	for (uint64_t i = 0; i < ddf->ddf_nhash; i++) {
+		uint64_t bit = (h1 + i * h2) & mask;
+		if (!(ddf->ddf_bits[bit >> 6] & (1ULL << (bit & 63))))
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Called from syncing context for every key written to a store object.
+ */
+void
+ddt_filter_add(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	ddt_filter_t *ddf = ddt->ddt_filter;
+	uint64_t mask, h1, h2;
+
+	if (!ddt_filter_active(ddt))
+		return;
+
+	mask = ddf->ddf_size * NBBY - 1;
+	ddt_filter_hash(ddk, &h1, &h2);
+	for (uint64_t i = 0; i < ddf->ddf_nhash; i++) {
+		uint64_t bit = (h1 + i * h2) & mask;
+		uint64_t *word = &ddf->ddf_bits[bit >> 6];
+		uint64_t set = 1ULL << (bit & 63);
+
+		if (*word & set)
+			continue;
+
+		/* Lookups read the bitmap under ddt_lock, we don't hold it */
+		atomic_or_64(word, set);
+		atomic_inc_64(&ddf->ddf_nset);
+		ddf->ddf_dirty[(bit >> 3) / DDT_FILTER_BLOCKSIZE] = 1;
+	}
+	ddf->ddf_modified = B_TRUE;
+}
+
+/*
+ * Called from syncing context whenever a store object is changed in a way
+ * that doesn't add a key (removals, object create/destroy), so that the
+ * filter's sync txg follows the store.
+ */
+void
+ddt_filter_touch(ddt_t *ddt)
+{
+	if (ddt->ddt_filter != NULL)
+		ddt->ddt_filter->ddf_modified = B_TRUE;
+}
+
+/*
+ * Latest txg in which any store object of this DDT was modified.
+ */
+static int
+ddt_filter_store_birth(ddt_t *ddt, uint64_t *birth)
+{
+	*birth = 0;
+
+	for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
+		for (ddt_class_t class = 0; class < DDT_CLASSES; class++) {
+			uint64_t object = ddt->ddt_object[type][class];
+			dnode_t *dn;
+
+			if (object == 0)
+				continue;
+
+			int error = dnode_hold(ddt->ddt_os, object, FTAG, &dn);
+			if (error != 0)
+				return (error);
+			for (int i = 0; i < dn->dn_phys->dn_nblkptr; i++) {
+				*birth = MAX(*birth, BP_GET_LOGICAL_BIRTH(
+				    &dn->dn_phys->dn_blkptr[i]));
+			}
+			dnode_rele(dn, FTAG);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Load the filter for this DDT, if it has one. Must be called after the store
+ * objects are loaded. A filter that can't be trusted is loaded inactive, and
+ * will be removed from disk by the next ddt_filter_sync().
+ */
+int
+ddt_filter_load(ddt_t *ddt)
+{
+	ddt_filter_phys_t *dfp;
+	dmu_buf_t *db;
+	uint64_t object, birth;
+	boolean_t valid;
+	int error;
+
+	ASSERT0P(ddt->ddt_filter);
+
+	if (ddt->ddt_version != DDT_VERSION_FDT || ddt->ddt_dir_object == 0)
+		return (0);
+
+	error = zap_lookup(ddt->ddt_os, ddt->ddt_dir_object, DDT_DIR_FILTER,
+	    sizeof (uint64_t), 1, &object);
+	if (error != 0)
+		return (error == ENOENT ? 0 : error);
+
+	error = ddt_filter_store_birth(ddt, &birth);
+	if (error != 0)
+		return (error);
+
+	error = dmu_bonus_hold(ddt->ddt_os, object, FTAG, &db);
+	if (error != 0)
+		return (error);
+	dfp = db->db_data;
+
+	valid = dfp->dfp_version == DDT_FILTER_VERSION &&
+	    ISP2(dfp->dfp_size) && dfp->dfp_size >= sizeof (uint64_t) &&
+	    dfp->dfp_size <= DDT_FILTER_MAX_SIZE && dfp->dfp_nhash > 0 &&
+	    birth <= dfp->dfp_txg;
+	if (!valid) {
+		zfs_dbgmsg("ddt_filter_load: spa=%s ddt=%s filter version=%llu "
+		    "txg=%llu store txg=%llu is stale, discarding",
+		    spa_name(ddt->ddt_spa),
+		    zio_checksum_table[ddt->ddt_checksum].ci_name,
+		    (u_longlong_t)dfp->dfp_version,
+		    (u_longlong_t)dfp->dfp_txg, (u_longlong_t)birth);
+		ddt->ddt_filter = ddt_filter_alloc(object, 0, 0);
+		dmu_buf_rele(db, FTAG);
+		return (0);
+	}
+
+	ddt_filter_t *ddf = ddt_filter_alloc(object, dfp->dfp_size,
+	    dfp->dfp_nhash);
+	ddf->ddf_nset = dfp->dfp_nset;
+	dmu_buf_rele(db, FTAG);
+
+	error = dmu_read(ddt->ddt_os, object, 0, ddf->ddf_size, ddf->ddf_bits,
+	    DMU_READ_PREFETCH);
+	if (error != 0) {
+		ddt->ddt_filter = ddf;
+		ddt_filter_free(ddt);
+		return (error);
+	}
+
+	ddt->ddt_filter = ddf;
+	return (0);
+}
+
+/*
+ * Create a new, empty filter. Only valid while the DDT has no store objects,
+ * since the filter must cover every stored key.
+ */
+void
+ddt_filter_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_filter_phys_t *dfp;
+	dmu_buf_t *db;
+	uint64_t object, size;
+
+	ASSERT(dmu_tx_is_syncing(tx));
+	ASSERT0P(ddt->ddt_filter);
+	ASSERT3U(ddt->ddt_version, ==, DDT_VERSION_FDT);
+	ASSERT3U(ddt->ddt_dir_object, !=, 0);
+
+	size = MIN(zfs_dedup_filter_size, DDT_FILTER_MAX_SIZE);
+	if (size < sizeof (uint64_t))
+		return;
+	size = 1ULL << highbit64(size - 1);
+	if (size > zfs_dedup_filter_size)
+		size >>= 1;
+
+	for (ddt_type_t type = 0; type < DDT_TYPES; type++) {
+		for (ddt_class_t class = 0; class < DDT_CLASSES; class++) {
+			if (ddt->ddt_object[type][class] != 0)
+				return;
+		}
+	}
+
+	object = dmu_object_alloc(ddt->ddt_os, DMU_OTN_UINT64_METADATA,
+	    DDT_FILTER_BLOCKSIZE, DMU_OTN_UINT64_METADATA,
+	    sizeof (ddt_filter_phys_t), tx);
+
+	VERIFY0(dmu_bonus_hold(ddt->ddt_os, object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	dfp = db->db_data;
+	dfp->dfp_version = DDT_FILTER_VERSION;
+	dfp->dfp_size = size;
+	dfp->dfp_nhash = DDT_FILTER_NHASH;
+	dfp->dfp_txg = tx->tx_txg;
+	dfp->dfp_nset = 0;
+	dmu_buf_rele(db, FTAG);
+
+	VERIFY0(zap_add(ddt->ddt_os, ddt->ddt_dir_object, DDT_DIR_FILTER,
+	    sizeof (uint64_t), 1, &object, tx));
+
+	ddt_enter(ddt);
+	ddt->ddt_filter = ddt_filter_alloc(object, size, DDT_FILTER_NHASH);
+	ddt_exit(ddt);
+}
+
+/*
+ * Remove the filter from disk and memory.
+ */
+void
+ddt_filter_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_filter_t *ddf = ddt->ddt_filter;
+
+	ASSERT(dmu_tx_is_syncing(tx));
+
+	if (ddf == NULL)
+		return;
+
+	VERIFY0(zap_remove(ddt->ddt_os, ddt->ddt_dir_object, DDT_DIR_FILTER,
+	    tx));
+	VERIFY0(dmu_object_free(ddt->ddt_os, ddf->ddf_object, tx));
+
+	ddt_enter(ddt);
+	ddt_filter_free(ddt);
+	ddt_exit(ddt);
+}
+
+/*
+ * Write out the blocks of the bitmap that changed this txg, and record that
+ * the filter covers the store as of this txg. Called from ddt_sync() once all
+ * store updates for the txg are done.
+ */
+void
+ddt_filter_sync(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_filter_t *ddf = ddt->ddt_filter;
+	ddt_filter_phys_t *dfp;
+	dmu_buf_t *db;
+
+	if (ddf == NULL)
+		return;
+
+	if (ddf->ddf_bits == NULL) {
+		/* stale filter from load, get rid of it */
+		ddt_filter_destroy(ddt, tx);
+		return;
+	}
+
+	if (!ddf->ddf_modified)
+		return;
+
+	for (uint64_t b = 0; b < howmany(ddf->ddf_size, DDT_FILTER_BLOCKSIZE);
+	    b++) {
+		if (!ddf->ddf_dirty[b])
+			continue;
+
+		uint64_t off = b * DDT_FILTER_BLOCKSIZE;
+		dmu_write(ddt->ddt_os, ddf->ddf_object, off,
+		    MIN(DDT_FILTER_BLOCKSIZE, ddf->ddf_size - off),
+		    (uint8_t *)ddf->ddf_bits + off, tx);
+		ddf->ddf_dirty[b] = 0;
+	}
+
+	VERIFY0(dmu_bonus_hold(ddt->ddt_os, ddf->ddf_object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	dfp = db->db_data;
+	dfp->dfp_txg = tx->tx_txg;
+	dfp->dfp_nset = ddf->ddf_nset;
+	dmu_buf_rele(db, FTAG);
+
+	ddf->ddf_modified = B_FALSE;
+}
+
+uint64_t
+ddt_filter_object(const ddt_t *ddt)
+{
+	return (ddt->ddt_filter != NULL ? ddt->ddt_filter->ddf_object : 0);
+}
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, filter_size, U64, ZMOD_RW,
+	"Size in bytes of the membership filter for new dedup tables");
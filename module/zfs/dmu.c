@@ -102,6 +102,16 @@ uint_t dmu_prefetch_max = 8 * SPA_MAXBLOCKSIZE;
  */
 uint_t dmu_ddt_copies = 0;
 
+/*
+ * When a write fills a whole block that will be stored uncompressed with a
+ * fletcher4 checksum, compute the checksum while copying the data in, a
+ * chunk at a time so each chunk is checksummed while still in cache, and
+ * hand it to the write zio instead of reading the block again in
+ * zio_checksum_generate().
+ */
+int dmu_fused_cksum = 1;
+#define	DMU_FUSED_CKSUM_CHUNK	(32 * 1024)
+
 const dmu_object_type_info_t dmu_ot[DMU_OT_NUMTYPES] = {
 	{DMU_BSWAP_UINT8,  TRUE,  FALSE, FALSE, "unallocated"		},
 	{DMU_BSWAP_ZAP,    TRUE,  TRUE,  FALSE, "object directory"	},
@@ -893,6 +903,41 @@ dmu_prefetch_dnode(objset_t *os, uint64_t object, zio_priority_t pri)
 	rw_exit(&dn->dn_struct_rwlock);
 }
 
+/*
+ * Issue prefetch I/Os for the given object's dnode and, once the dnode
+ * block has reached the ARC, for the object's first data block.  This
+ * never waits for I/O, so a caller walking ahead of a consumer prefetches
+ * the dnode on its first call and the data block on a later one.
+ */
+void
+dmu_prefetch_head(objset_t *os, uint64_t object, zio_priority_t pri)
+{
+	if (object == 0 || object >= DN_MAX_OBJECT)
+		return;
+
+	dnode_t *mdn = DMU_META_DNODE(os);
+	blkptr_t bp;
+	boolean_t cached = B_FALSE;
+
+	rw_enter(&mdn->dn_struct_rwlock, RW_READER);
+	uint64_t blkid = dbuf_whichblock(mdn, 0,
+	    object * sizeof (dnode_phys_t));
+	if (dbuf_dnode_findbp(mdn, 0, blkid, &bp, NULL, NULL) == 0)
+		cached = (arc_cached(os->os_spa, &bp) & ARC_CACHED_IN_L1) != 0;
+	if (!cached)
+		dbuf_prefetch(mdn, 0, blkid, pri, 0);
+	rw_exit(&mdn->dn_struct_rwlock);
+
+	if (!cached)
+		return;
+
+	dnode_t *dn;
+	if (dnode_hold(os, object, FTAG, &dn) != 0)
+		return;
+	dmu_prefetch_by_dnode(dn, 0, 0, 1, pri);
+	dnode_rele(dn, FTAG);
+}
+
 /*
  * Get the next "chunk" of file data to free.  We traverse the file from
  * the end so that the file gets shorter over time (if we crash in the
@@ -1484,6 +1529,51 @@ dmu_read_uio(objset_t *os, uint64_t object, zfs_uio_t *uio, uint64_t size,
 	return (err);
 }
 
+/*
+ * Returns B_TRUE if level 0 blocks of this dnode are written to disk exactly
+ * as they sit in the dbuf and checksummed with fletcher4, so a checksum taken
+ * while filling the dbuf is the one zio_checksum_generate() would compute.
+ */
+static boolean_t
+dmu_fused_cksum_ok(dnode_t *dn)
+{
+	objset_t *os = dn->dn_objset;
+
+	if (!dmu_fused_cksum || os->os_encrypted ||
+	    os->os_dedup_checksum != ZIO_CHECKSUM_OFF)
+		return (B_FALSE);
+
+	if (zio_compress_select(os->os_spa, dn->dn_compress,
+	    os->os_compress) != ZIO_COMPRESS_OFF)
+		return (B_FALSE);
+
+	return (zio_checksum_select(dn->dn_checksum, os->os_checksum) ==
+	    ZIO_CHECKSUM_FLETCHER_4);
+}
+
+/*
+ * Copy a whole block from the uio into the dbuf being filled, updating the
+ * fletcher4 checksum of each chunk right after it has been copied.
+ */
+static int
+dmu_write_uio_fused_cksum(dmu_buf_t *db, zfs_uio_t *uio, zio_cksum_t *zcp)
+{
+	int err = 0;
+
+	fletcher_init(zcp);
+	for (uint64_t off = 0; off < db->db_size; off += DMU_FUSED_CKSUM_CHUNK) {
+		uint64_t len = MIN(DMU_FUSED_CKSUM_CHUNK, db->db_size - off);
+		char *buf = (char *)db->db_data + off;
+
+		err = zfs_uio_fault_move(buf, len, UIO_WRITE, uio);
+		if (err)
+			break;
+		(void) fletcher_4_incremental_native(buf, len, zcp);
+	}
+
+	return (err);
+}
+
 int
 dmu_write_uio_dnode(dnode_t *dn, zfs_uio_t *uio, uint64_t size, dmu_tx_t *tx,
     dmu_flags_t flags)
@@ -1493,16 +1583,21 @@ dmu_write_uio_dnode(dnode_t *dn, zfs_uio_t *uio, uint64_t size, dmu_tx_t *tx,
 	int err = 0;
 	uint64_t write_size;
 	dmu_flags_t oflags = flags;
+	boolean_t fused_cksum = dmu_fused_cksum_ok(dn);
 
 top:
 	write_size = size;
 
 	/*
 	 * We only allow Direct I/O writes to happen if we are block
-	 * sized aligned. Otherwise, we pass the write off to the ARC.
+	 * sized aligned. Otherwise, we pass the write off to the ARC,
+	 * unless the caller allows the partial blocks at either end of
+	 * the request to be rewritten in full through a bounce buffer.
 	 */
 	if ((flags & DMU_DIRECTIO) && (uio->uio_extflg & UIO_DIRECT) &&
-	    (write_size >= dn->dn_datablksz)) {
+	    (write_size >= dn->dn_datablksz || (flags & DMU_DIRECTIO_RMW))) {
+		uint64_t blkphase = zfs_uio_offset(uio) % dn->dn_datablksz;
+
 		if (zfs_dio_aligned(zfs_uio_offset(uio), write_size,
 		    dn->dn_datablksz)) {
 			return (dmu_write_uio_direct(dn, uio, size, flags, tx));
@@ -1519,12 +1614,19 @@ top:
 			} else {
 				return (err);
 			}
+		} else if (flags & DMU_DIRECTIO_RMW) {
+			write_size = MIN(write_size,
+			    dn->dn_datablksz - blkphase);
+			err = dmu_write_uio_direct_rmw(dn, uio, write_size,
+			    flags, tx);
+			if (err == 0 && (size -= write_size) > 0)
+				goto top;
+			return (err);
 		} else {
-			write_size =
-			    P2PHASE(zfs_uio_offset(uio), dn->dn_datablksz);
+			write_size = blkphase;
 		}
 	}
-	flags &= ~DMU_DIRECTIO;
+	flags &= ~(DMU_DIRECTIO | DMU_DIRECTIO_RMW);
 
 	err = dmu_buf_hold_array_by_dnode(dn, zfs_uio_offset(uio), write_size,
 	    FALSE, FTAG, &numbufs, &dbp, flags);
@@ -1557,8 +1659,16 @@ top:
 		}
 
 		ASSERT(db->db_data != NULL);
-		err = zfs_uio_fault_move((char *)db->db_data + bufoff,
-		    tocpy, UIO_WRITE, uio);
+		if (tocpy == db->db_size && fused_cksum) {
+			zio_cksum_t zc;
+
+			err = dmu_write_uio_fused_cksum(db, uio, &zc);
+			if (err == 0)
+				dmu_buf_fill_cksum(db, tx, &zc);
+		} else {
+			err = zfs_uio_fault_move((char *)db->db_data + bufoff,
+			    tocpy, UIO_WRITE, uio);
+		}
 
 		if (tocpy == db->db_size && dmu_buf_fill_done(db, tx, err)) {
 			/* The fill was reverted.  Undo any uio progress. */
@@ -2326,6 +2436,7 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	boolean_t nopwrite = B_FALSE;
 	boolean_t dedup_verify = os->os_dedup_verify;
 	boolean_t encrypt = B_FALSE;
+	boolean_t complevel_auto = B_FALSE;
 	int copies = os->os_copies;
 	int gang_copies = os->os_copies;
 
@@ -2419,6 +2530,8 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	} else {
 		compress = zio_compress_select(os->os_spa, dn->dn_compress,
 		    compress);
+		complevel_auto = (compress == ZIO_COMPRESS_ZSTD &&
+		    complevel == ZIO_ZSTD_LEVEL_AUTO);
 		complevel = zio_complevel_select(os->os_spa, compress,
 		    complevel, complevel);
 
@@ -2509,6 +2622,9 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	zp->zp_byteorder = ZFS_HOST_BYTEORDER;
 	zp->zp_direct_write = (wp & WP_DIRECT_WR) ? B_TRUE : B_FALSE;
 	zp->zp_rewrite = B_FALSE;
+	zp->zp_promote = B_FALSE;
+	zp->zp_complevel_auto = complevel_auto;
+	zp->zp_fused_cksum = B_FALSE;
 	memset(zp->zp_salt, 0, ZIO_DATA_SALT_LEN);
 	memset(zp->zp_iv, 0, ZIO_DATA_IV_LEN);
 	memset(zp->zp_mac, 0, ZIO_DATA_MAC_LEN);
@@ -2744,16 +2860,14 @@ dmu_brt_clone(objset_t *os, uint64_t object, uint64_t offset, uint64_t length,
 		dl->dr_override_state = DR_OVERRIDDEN;
 
 		mutex_exit(&db->db_mtx);
-
-		/*
-		 * When data in embedded into BP there is no need to create
-		 * BRT entry as there is no data block. Just copy the BP as
-		 * it contains the data.
-		 */
-		if (!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp)) {
-			brt_pending_add(spa, bp, tx);
-		}
 	}
+
+	/*
+	 * When data in embedded into BP there is no need to create BRT entry
+	 * as there is no data block. Just copy the BP as it contains the data.
+	 * brt_pending_add_batch() skips those, and holes, on its own.
+	 */
+	brt_pending_add_batch(spa, bps, nbps, tx);
 out:
 	dmu_buf_rele_array(dbp, numbufs, FTAG);
 
@@ -2940,6 +3054,7 @@ EXPORT_SYMBOL(dmu_buf_rele_array);
 EXPORT_SYMBOL(dmu_prefetch);
 EXPORT_SYMBOL(dmu_prefetch_by_dnode);
 EXPORT_SYMBOL(dmu_prefetch_dnode);
+EXPORT_SYMBOL(dmu_prefetch_head);
 EXPORT_SYMBOL(dmu_free_range);
 EXPORT_SYMBOL(dmu_free_long_range);
 EXPORT_SYMBOL(dmu_free_long_object);
@@ -2988,3 +3103,6 @@ ZFS_MODULE_PARAM(zfs, , dmu_prefetch_max, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs, , dmu_ddt_copies, UINT, ZMOD_RW,
 	"Override copies= for dedup objects");
+
+ZFS_MODULE_PARAM(zfs, , dmu_fused_cksum, INT, ZMOD_RW,
+	"Checksum uncompressed fletcher4 blocks while copying them in");
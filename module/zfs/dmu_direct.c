@@ -73,6 +73,37 @@ make_abd_for_dbuf(dmu_buf_impl_t *db, abd_t *data, uint64_t offset,
 	return (mbuf);
 }
 
+/*
+ * With direct=adaptive, a Direct I/O read of a block that is already in
+ * the ARC, or that has been read at least this many times recently, goes
+ * through the ARC so that a small hot set stays cached while streaming
+ * reads still bypass it.
+ */
+static uint_t zfs_dio_adaptive_min_freq = 2;
+
+/*
+ * Decide whether a direct=adaptive read of db should be served through
+ * the ARC, counting one access to the block.  Blocks with pending Direct
+ * I/O writes or clones always take the direct path.
+ */
+static boolean_t
+dmu_direct_adaptive_hot(dmu_buf_impl_t *db, const blkptr_t *bp)
+{
+	objset_t *os = db->db_objset;
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+
+	if (os->os_direct != ZFS_DIRECT_ADAPTIVE || bp == NULL ||
+	    BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp) ||
+	    !list_is_empty(&db->db_dirty_records))
+		return (B_FALSE);
+
+	if (arc_frequency(os->os_spa, bp, B_TRUE) >= zfs_dio_adaptive_min_freq)
+		return (B_TRUE);
+
+	return ((arc_cached(os->os_spa, bp) & ARC_CACHED_IN_L1) != 0);
+}
+
 static void
 dmu_read_abd_done(zio_t *zio)
 {
@@ -245,9 +276,15 @@ dmu_write_abd(dnode_t *dn, uint64_t offset, uint64_t size,
 	return (err);
 }
 
-int
-dmu_read_abd(dnode_t *dn, uint64_t offset, uint64_t size,
-    abd_t *data, dmu_flags_t flags)
+/*
+ * Issue the Direct I/O reads for the given range as children of rio.
+ * Blocks that are holes or already cached are filled in directly.  On
+ * error some children may already have been issued; the caller must
+ * still execute rio.
+ */
+static int
+dmu_read_abd_impl(dnode_t *dn, uint64_t offset, uint64_t size,
+    abd_t *data, dmu_flags_t flags, zio_t *rio)
 {
 	objset_t *os = dn->dn_objset;
 	spa_t *spa = os->os_spa;
@@ -261,8 +298,6 @@ dmu_read_abd(dnode_t *dn, uint64_t offset, uint64_t size,
 	if (err)
 		return (err);
 
-	zio_t *rio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
-
 	for (int i = 0; i < numbufs; i++) {
 		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
 		abd_t *mbuf;
@@ -284,7 +319,22 @@ dmu_read_abd(dnode_t *dn, uint64_t offset, uint64_t size,
 		err = dmu_buf_get_bp_from_dbuf(db, &bp);
 		if (err) {
 			mutex_exit(&db->db_mtx);
-			goto error;
+			break;
+		}
+
+		if (db->db_state != DB_CACHED &&
+		    dmu_direct_adaptive_hot(db, bp)) {
+			mutex_exit(&db->db_mtx);
+			err = dbuf_read(db, NULL,
+			    DB_RF_CANFAIL | DMU_READ_NO_PREFETCH);
+			if (err)
+				break;
+			mutex_enter(&db->db_mtx);
+			err = dmu_buf_get_bp_from_dbuf(db, &bp);
+			if (err) {
+				mutex_exit(&db->db_mtx);
+				break;
+			}
 		}
 
 		/*
@@ -341,14 +391,67 @@ dmu_read_abd(dnode_t *dn, uint64_t offset, uint64_t size,
 
 	dmu_buf_rele_array(dbp, numbufs, FTAG);
 
-	return (zio_wait(rio));
-
-error:
-	dmu_buf_rele_array(dbp, numbufs, FTAG);
-	(void) zio_wait(rio);
 	return (err);
 }
 
+int
+dmu_read_abd(dnode_t *dn, uint64_t offset, uint64_t size,
+    abd_t *data, dmu_flags_t flags)
+{
+	zio_t *rio = zio_root(dn->dn_objset->os_spa, NULL, NULL,
+	    ZIO_FLAG_CANFAIL);
+
+	int err = dmu_read_abd_impl(dn, offset, size, data, flags, rio);
+	int zerr = zio_wait(rio);
+
+	return (err != 0 ? err : zerr);
+}
+
+typedef struct dmu_read_async_arg {
+	dmu_read_done_func_t	*dra_done;
+	void			*dra_arg;
+	int			dra_err;
+} dmu_read_async_arg_t;
+
+static void
+dmu_read_direct_async_done(zio_t *zio)
+{
+	dmu_read_async_arg_t *dra = zio->io_private;
+	int err = dra->dra_err != 0 ? dra->dra_err : zio->io_error;
+
+	dra->dra_done(dra->dra_arg, err);
+	kmem_free(dra, sizeof (dmu_read_async_arg_t));
+}
+
+/*
+ * Asynchronous variant of dmu_read_abd().  done(arg, error) is called
+ * exactly once, from zio completion context once all reads are done, or
+ * from this thread if nothing needed to be issued.  It must not block on
+ * I/O.
+ */
+void
+dmu_read_direct_async(dmu_buf_t *zdb, uint64_t offset, uint64_t size,
+    abd_t *data, dmu_flags_t flags, dmu_read_done_func_t *done, void *arg)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)zdb;
+
+	ASSERT(flags & DMU_DIRECTIO);
+
+	dmu_read_async_arg_t *dra =
+	    kmem_zalloc(sizeof (dmu_read_async_arg_t), KM_SLEEP);
+	dra->dra_done = done;
+	dra->dra_arg = arg;
+
+	DB_DNODE_ENTER(db);
+	dnode_t *dn = DB_DNODE(db);
+	zio_t *rio = zio_root(dn->dn_objset->os_spa,
+	    dmu_read_direct_async_done, dra, ZIO_FLAG_CANFAIL);
+	dra->dra_err = dmu_read_abd_impl(dn, offset, size, data, flags, rio);
+	DB_DNODE_EXIT(db);
+
+	zio_nowait(rio);
+}
+
 #ifdef _KERNEL
 int
 dmu_read_uio_direct(dnode_t *dn, zfs_uio_t *uio, uint64_t size,
@@ -393,7 +496,51 @@ dmu_write_uio_direct(dnode_t *dn, zfs_uio_t *uio, uint64_t size,
 
 	return (err);
 }
+
+/*
+ * Direct I/O write of a fragment of a single block.  The rest of the block
+ * is read into a bounce buffer, the fragment is merged in and the whole
+ * block is written directly.  The caller's range lock must cover the
+ * entire block.
+ */
+int
+dmu_write_uio_direct_rmw(dnode_t *dn, zfs_uio_t *uio, uint64_t size,
+    dmu_flags_t flags, dmu_tx_t *tx)
+{
+	offset_t offset = zfs_uio_offset(uio);
+	offset_t page_index = (offset - zfs_uio_soffset(uio)) >> PAGESHIFT;
+	uint64_t blksz = dn->dn_datablksz;
+	uint64_t blkoff = offset - offset % blksz;
+	int err;
+
+	ASSERT(uio->uio_extflg & UIO_DIRECT);
+	ASSERT(flags & DMU_DIRECTIO_RMW);
+	ASSERT3U(offset + size, <=, blkoff + blksz);
+	ASSERT3U(page_index, <, uio->uio_dio.npages);
+
+	abd_t *bounce = abd_alloc_for_io(blksz, B_FALSE);
+	err = dmu_read_abd(dn, blkoff, blksz, bounce, flags);
+	if (err == 0) {
+		abd_t *data = abd_alloc_from_pages(
+		    &uio->uio_dio.pages[page_index],
+		    offset & (PAGESIZE - 1), size);
+		abd_copy_off(bounce, data, offset - blkoff, 0, size);
+		abd_free(data);
+
+		err = dmu_write_abd(dn, blkoff, blksz, bounce, flags, tx);
+	}
+	abd_free(bounce);
+
+	if (err == 0)
+		zfs_uioskip(uio, size);
+
+	return (err);
+}
 #endif /* _KERNEL */
 
 EXPORT_SYMBOL(dmu_read_abd);
+EXPORT_SYMBOL(dmu_read_direct_async);
 EXPORT_SYMBOL(dmu_write_abd);
+
+ZFS_MODULE_PARAM(zfs, zfs_, dio_adaptive_min_freq, UINT, ZMOD_RW,
+	"Recent reads after which a direct=adaptive block is cached");
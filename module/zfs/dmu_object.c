@@ -60,7 +60,7 @@ dmu_object_alloc_impl(objset_t *os, dmu_object_type_t ot, int blocksize,
 	int error;
 
 	cpuobj = &os->os_obj_next_percpu[CPU_SEQID_UNSTABLE %
-	    os->os_obj_next_percpu_len];
+	    os->os_obj_next_percpu_len].oon_object;
 
 	if (dn_slots == 0) {
 		dn_slots = DNODE_MIN_SLOTS;
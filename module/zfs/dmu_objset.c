@@ -203,8 +203,19 @@ compression_changed_cb(void *arg, uint64_t newval)
 
 	os->os_compress = zio_compress_select(os->os_spa,
 	    ZIO_COMPRESS_ALGO(newval), ZIO_COMPRESS_ON);
-	os->os_complevel = zio_complevel_select(os->os_spa, os->os_compress,
-	    ZIO_COMPRESS_LEVEL(newval), ZIO_COMPLEVEL_DEFAULT);
+
+	/*
+	 * zstd-auto is resolved for every write in dmu_write_policy(), so
+	 * keep the reserved level instead of pinning the current choice.
+	 */
+	if (os->os_compress == ZIO_COMPRESS_ZSTD &&
+	    ZIO_COMPRESS_LEVEL(newval) == ZIO_ZSTD_LEVEL_AUTO) {
+		os->os_complevel = ZIO_ZSTD_LEVEL_AUTO;
+	} else {
+		os->os_complevel = zio_complevel_select(os->os_spa,
+		    os->os_compress, ZIO_COMPRESS_LEVEL(newval),
+		    ZIO_COMPLEVEL_DEFAULT);
+	}
 }
 
 static void
@@ -248,7 +259,7 @@ primary_cache_changed_cb(void *arg, uint64_t newval)
 	 * Inheritance and range checking should have been done by now.
 	 */
 	ASSERT(newval == ZFS_CACHE_ALL || newval == ZFS_CACHE_NONE ||
-	    newval == ZFS_CACHE_METADATA);
+	    newval == ZFS_CACHE_METADATA || newval == ZFS_CACHE_FILTERED);
 
 	os->os_primary_cache = newval;
 }
@@ -276,10 +287,20 @@ prefetch_changed_cb(void *arg, uint64_t newval)
 	 * Inheritance should have been done by now.
 	 */
 	ASSERT(newval == ZFS_PREFETCH_ALL || newval == ZFS_PREFETCH_NONE ||
-	    newval == ZFS_PREFETCH_METADATA);
+	    newval == ZFS_PREFETCH_METADATA ||
+	    newval == ZFS_PREFETCH_CONSERVATIVE ||
+	    newval == ZFS_PREFETCH_AGGRESSIVE);
 	os->os_prefetch = newval;
 }
 
+static void
+prefetch_distance_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	os->os_prefetch_distance = newval;
+}
+
 static void
 sync_changed_cb(void *arg, uint64_t newval)
 {
@@ -348,6 +369,34 @@ smallblk_changed_cb(void *arg, uint64_t newval)
 	os->os_zpl_special_smallblock = newval;
 }
 
+static void
+arc_limit_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	os->os_arc_limit = newval;
+	arc_account_set(os->os_arc_account, os->os_arc_limit,
+	    os->os_arc_reserve);
+}
+
+static void
+arc_reserve_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	os->os_arc_reserve = newval;
+	arc_account_set(os->os_arc_account, os->os_arc_limit,
+	    os->os_arc_reserve);
+}
+
+static void
+dirty_max_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	os->os_dirty_max = newval;
+}
+
 static void
 direct_changed_cb(void *arg, uint64_t newval)
 {
@@ -357,7 +406,7 @@ direct_changed_cb(void *arg, uint64_t newval)
 	 * Inheritance and range checking should have been done by now.
 	 */
 	ASSERT(newval == ZFS_DIRECT_DISABLED || newval == ZFS_DIRECT_STANDARD ||
-	    newval == ZFS_DIRECT_ALWAYS);
+	    newval == ZFS_DIRECT_ALWAYS || newval == ZFS_DIRECT_ADAPTIVE);
 
 	os->os_direct = newval;
 }
@@ -578,6 +627,11 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 			    zfs_prop_to_name(ZFS_PROP_PREFETCH),
 			    prefetch_changed_cb, os);
 		}
+		if (err == 0) {
+			err = dsl_prop_register(ds,
+			    zfs_prop_to_name(ZFS_PROP_PREFETCH_DISTANCE),
+			    prefetch_distance_changed_cb, os);
+		}
 		if (!ds->ds_is_snapshot) {
 			if (err == 0) {
 				err = dsl_prop_register(ds,
@@ -636,8 +690,26 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 				    zfs_prop_to_name(ZFS_PROP_DIRECT),
 				    direct_changed_cb, os);
 			}
+			if (err == 0) {
+				os->os_arc_account = arc_account_hold(spa,
+				    ds->ds_object);
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_ARC_LIMIT),
+				    arc_limit_changed_cb, os);
+			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_ARC_RESERVE),
+				    arc_reserve_changed_cb, os);
+			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_DIRTY_MAX),
+				    dirty_max_changed_cb, os);
+			}
 		}
 		if (err != 0) {
+			arc_account_rele(os->os_arc_account);
 			arc_buf_destroy(os->os_phys_buf, &os->os_phys_buf);
 			kmem_free(os, sizeof (objset_t));
 			return (err);
@@ -679,6 +751,8 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 	mutex_init(&os->os_userused_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&os->os_obj_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&os->os_user_ptr_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&os->os_dirty_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&os->os_dirty_cv, NULL, CV_DEFAULT, NULL);
 	os->os_obj_next_percpu_len = boot_ncpus;
 	os->os_obj_next_percpu = kmem_zalloc(os->os_obj_next_percpu_len *
 	    sizeof (os->os_obj_next_percpu[0]), KM_SLEEP);
@@ -1007,6 +1081,8 @@ dmu_objset_evict(objset_t *os)
 
 	if (ds)
 		dsl_prop_unregister_all(ds, os);
+	arc_account_rele(os->os_arc_account);
+	os->os_arc_account = 0;
 
 	if (os->os_sa)
 		sa_tear_down(os);
@@ -1058,6 +1134,9 @@ dmu_objset_evict_done(objset_t *os)
 	mutex_destroy(&os->os_obj_lock);
 	mutex_destroy(&os->os_user_ptr_lock);
 	mutex_destroy(&os->os_upgrade_lock);
+	ASSERT0(os->os_dirty_total);
+	mutex_destroy(&os->os_dirty_lock);
+	cv_destroy(&os->os_dirty_cv);
 	for (int i = 0; i < TXG_SIZE; i++)
 		multilist_destroy(&os->os_dirty_dnodes[i]);
 	spa_evicting_os_deregister(os->os_spa, os);
@@ -1845,52 +1924,59 @@ userquota_compare(const void *l, const void *r)
 	return (TREE_ISIGN(rv));
 }
 
+/*
+ * Apply the deltas accumulated in one tree of the cache to the given used
+ * object, with a single batched ZAP update, and destroy the tree.
+ */
 static void
-do_userquota_cacheflush(objset_t *os, userquota_cache_t *cache, dmu_tx_t *tx)
+userquota_cacheflush_tree(objset_t *os, uint64_t obj, avl_tree_t *avl,
+    dmu_tx_t *tx)
 {
-	void *cookie;
+	uint64_t n = avl_numnodes(avl);
 	userquota_node_t *uqn;
+	void *cookie = NULL;
 
-	ASSERT(dmu_tx_is_syncing(tx));
+	if (n > 0) {
+		const char **names = vmem_alloc(n * sizeof (*names), KM_SLEEP);
+		int64_t *deltas = vmem_alloc(n * sizeof (*deltas), KM_SLEEP);
+		uint64_t i = 0;
+
+		for (uqn = avl_first(avl); uqn != NULL;
+		    uqn = AVL_NEXT(avl, uqn), i++) {
+			names[i] = uqn->uqn_id;
+			deltas[i] = uqn->uqn_delta;
+		}
 
-	cookie = NULL;
-	while ((uqn = avl_destroy_nodes(&cache->uqc_user_deltas,
-	    &cookie)) != NULL) {
 		/*
 		 * os_userused_lock protects against concurrent calls to
-		 * zap_increment_int().  It's needed because zap_increment_int()
-		 * is not thread-safe (i.e. not atomic).
+		 * zap_increment_batch().  It's needed because the increments
+		 * are not thread-safe (i.e. not atomic).
 		 */
 		mutex_enter(&os->os_userused_lock);
-		VERIFY0(zap_increment(os, DMU_USERUSED_OBJECT,
-		    uqn->uqn_id, uqn->uqn_delta, tx));
+		VERIFY0(zap_increment_batch(os, obj, names, deltas, n, tx));
 		mutex_exit(&os->os_userused_lock);
-		kmem_free(uqn, sizeof (*uqn));
+
+		vmem_free(names, n * sizeof (*names));
+		vmem_free(deltas, n * sizeof (*deltas));
 	}
-	avl_destroy(&cache->uqc_user_deltas);
 
-	cookie = NULL;
-	while ((uqn = avl_destroy_nodes(&cache->uqc_group_deltas,
-	    &cookie)) != NULL) {
-		mutex_enter(&os->os_userused_lock);
-		VERIFY0(zap_increment(os, DMU_GROUPUSED_OBJECT,
-		    uqn->uqn_id, uqn->uqn_delta, tx));
-		mutex_exit(&os->os_userused_lock);
+	while ((uqn = avl_destroy_nodes(avl, &cookie)) != NULL)
 		kmem_free(uqn, sizeof (*uqn));
-	}
-	avl_destroy(&cache->uqc_group_deltas);
+	avl_destroy(avl);
+}
 
+static void
+do_userquota_cacheflush(objset_t *os, userquota_cache_t *cache, dmu_tx_t *tx)
+{
+	ASSERT(dmu_tx_is_syncing(tx));
+
+	userquota_cacheflush_tree(os, DMU_USERUSED_OBJECT,
+	    &cache->uqc_user_deltas, tx);
+	userquota_cacheflush_tree(os, DMU_GROUPUSED_OBJECT,
+	    &cache->uqc_group_deltas, tx);
 	if (dmu_objset_projectquota_enabled(os)) {
-		cookie = NULL;
-		while ((uqn = avl_destroy_nodes(&cache->uqc_project_deltas,
-		    &cookie)) != NULL) {
-			mutex_enter(&os->os_userused_lock);
-			VERIFY0(zap_increment(os, DMU_PROJECTUSED_OBJECT,
-			    uqn->uqn_id, uqn->uqn_delta, tx));
-			mutex_exit(&os->os_userused_lock);
-			kmem_free(uqn, sizeof (*uqn));
-		}
-		avl_destroy(&cache->uqc_project_deltas);
+		userquota_cacheflush_tree(os, DMU_PROJECTUSED_OBJECT,
+		    &cache->uqc_project_deltas, tx);
 	}
 }
 
@@ -3032,6 +3118,29 @@ dmu_fsname(const char *snapname, char *buf)
  * [2] When we are dirtying MOS data, in which case we only update the
  *     pool's accounting of dirty data.
  */
+/*
+ * Account space dirtied in this dataset against its dirty_max, and start
+ * syncing the txg early once it holds enough of the dataset's dirty data,
+ * as dsl_pool_dirty_space() does for the pool's.
+ */
+static void
+dmu_objset_dirty_space(objset_t *os, int64_t space, dmu_tx_t *tx)
+{
+	uint64_t txg = tx->tx_txg;
+	boolean_t needsync;
+
+	mutex_enter(&os->os_dirty_lock);
+	os->os_dirty_pertxg[txg & TXG_MASK] += space;
+	os->os_dirty_total += space;
+	needsync = os->os_dirty_max != 0 && !dmu_tx_is_syncing(tx) &&
+	    os->os_dirty_pertxg[txg & TXG_MASK] >
+	    os->os_dirty_max * zfs_dirty_data_sync_percent / 100;
+	mutex_exit(&os->os_dirty_lock);
+
+	if (needsync)
+		txg_kick(dmu_objset_pool(os), txg);
+}
+
 void
 dmu_objset_willuse_space(objset_t *os, int64_t space, dmu_tx_t *tx)
 {
@@ -3040,11 +3149,117 @@ dmu_objset_willuse_space(objset_t *os, int64_t space, dmu_tx_t *tx)
 
 	if (ds != NULL) {
 		dsl_dir_willuse_space(ds->ds_dir, aspace, tx);
+		if (space > 0)
+			dmu_objset_dirty_space(os, space, tx);
 	}
 
 	dsl_pool_dirty_space(dmu_tx_pool(tx), space, tx);
 }
 
+/*
+ * Release space dirtied by dmu_objset_willuse_space() in the given txg,
+ * once it has been written out or undirtied.  The pool's dirty space is
+ * released separately, by dsl_pool_undirty_space().
+ */
+void
+dmu_objset_undirty_space(objset_t *os, int64_t space, uint64_t txg)
+{
+	ASSERT3S(space, >=, 0);
+	if (space == 0 || os->os_dsl_dataset == NULL)
+		return;
+
+	mutex_enter(&os->os_dirty_lock);
+	if (os->os_dirty_pertxg[txg & TXG_MASK] < space) {
+		/* see dsl_pool_undirty_space() */
+		space = os->os_dirty_pertxg[txg & TXG_MASK];
+	}
+	os->os_dirty_pertxg[txg & TXG_MASK] -= space;
+	ASSERT3U(os->os_dirty_total, >=, space);
+	os->os_dirty_total -= space;
+	if (os->os_dirty_total < os->os_dirty_max || os->os_dirty_max == 0)
+		cv_broadcast(&os->os_dirty_cv);
+	mutex_exit(&os->os_dirty_lock);
+}
+
+/*
+ * Returns true if this dataset has enough dirty data that its transactions
+ * should be delayed by its own write throttle; see dmu_tx_delay().
+ */
+boolean_t
+dmu_objset_need_dirty_delay(objset_t *os)
+{
+	if (os == NULL || os->os_dsl_dataset == NULL)
+		return (B_FALSE);
+
+	uint64_t dirty_max = os->os_dirty_max;
+	if (dirty_max == 0)
+		return (B_FALSE);
+
+	return (os->os_dirty_total >
+	    dirty_max * zfs_delay_min_dirty_percent / 100);
+}
+
+/*
+ * Wait until this dataset is below its dirty_max.  Returns the amount of
+ * dirty data it has left then and, through maxp, the dirty_max it was
+ * compared against, which is 0 if none is set.
+ */
+uint64_t
+dmu_objset_dirty_wait(objset_t *os, uint64_t *maxp)
+{
+	uint64_t dirty;
+
+	*maxp = 0;
+	if (os == NULL || os->os_dsl_dataset == NULL)
+		return (0);
+
+	mutex_enter(&os->os_dirty_lock);
+	while (os->os_dirty_max != 0 &&
+	    os->os_dirty_total >= os->os_dirty_max)
+		cv_wait(&os->os_dirty_cv, &os->os_dirty_lock);
+	dirty = os->os_dirty_total;
+	*maxp = os->os_dirty_max;
+	mutex_exit(&os->os_dirty_lock);
+
+	return (dirty);
+}
+
+/*
+ * Report the dirty data, total write throttle delay and gang block counts
+ * of the open objset of dataset dsobj, for its dataset kstats.  The kstats
+ * outlive any one objset of the dataset (e.g. across a rollback), so they
+ * look it up here rather than keep a pointer to it.
+ */
+void
+dmu_objset_live_stats(spa_t *spa, uint64_t dsobj, uint64_t *dirtyp,
+    uint64_t *delayp, uint64_t *gang_writesp, uint64_t *gang_readsp)
+{
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	dsl_dataset_t *ds;
+
+	*dirtyp = 0;
+	*delayp = 0;
+	*gang_writesp = 0;
+	*gang_readsp = 0;
+
+	dsl_pool_config_enter(dp, FTAG);
+	if (dsl_dataset_hold_obj(dp, dsobj, FTAG, &ds) == 0) {
+		mutex_enter(&ds->ds_opening_lock);
+		objset_t *os = ds->ds_objset;
+		if (os != NULL) {
+			mutex_enter(&os->os_dirty_lock);
+			*dirtyp = os->os_dirty_total;
+			*delayp = os->os_dirty_delay;
+			mutex_exit(&os->os_dirty_lock);
+			*gang_writesp = atomic_load_64(&os->os_gang_writes);
+			*gang_readsp = atomic_load_64(&os->os_gang_reads);
+		}
+		mutex_exit(&ds->ds_opening_lock);
+		dsl_dataset_rele(ds, FTAG);
+	}
+	dsl_pool_config_exit(dp, FTAG);
+}
+
 #if defined(_KERNEL)
 EXPORT_SYMBOL(dmu_objset_zil);
 EXPORT_SYMBOL(dmu_objset_pool);
@@ -74,6 +74,7 @@
 static uint_t zfs_recv_queue_length = SPA_MAXBLOCKSIZE;
 static uint_t zfs_recv_queue_ff = 20;
 static uint_t zfs_recv_write_batch_size = 1024 * 1024;
+static uint_t zfs_recv_write_threads = 4;
 static int zfs_recv_best_effort_corrective = 0;
 
 static const void *const dmu_recv_tag = "dmu_recv_tag";
@@ -129,6 +130,19 @@ struct receive_writer_arg {
 
 	list_t write_batch;
 
+	/*
+	 * When write_tqs is set, full write batches are handed to one of
+	 * write_ntqs single-threaded taskqs, chosen by object number, instead
+	 * of being flushed by the writer thread.  writes_pending counts the
+	 * batches in flight and write_err keeps the first error they hit.
+	 */
+	taskq_t **write_tqs;
+	uint_t write_ntqs;
+	kmutex_t write_lock;
+	kcondvar_t write_cv;
+	uint64_t writes_pending;
+	int write_err;
+
 	/* Encryption parameters for the last received DRR_OBJECT_RANGE */
 	boolean_t or_crypt_params_present;
 	uint64_t or_firstobj;
@@ -1458,7 +1472,8 @@ do_corrective_recv(struct receive_writer_arg *rwa, struct drr_write *drrw,
 		    B_FALSE);
 		uint64_t csize = zio_compress_data(BP_GET_COMPRESS(bp),
 		    abd, &cabd, abd_get_size(abd), BP_GET_PSIZE(bp),
-		    rwa->os->os_complevel);
+		    zio_complevel_select(rwa->os->os_spa, BP_GET_COMPRESS(bp),
+		    rwa->os->os_complevel, ZIO_COMPLEVEL_DEFAULT));
 		abd_zero_off(cabd, csize, BP_GET_PSIZE(bp) - csize);
 		/* Swap in newly compressed data into the abd */
 		abd_free(abd);
@@ -2214,25 +2229,22 @@ receive_freeobjects(struct receive_writer_arg *rwa,
 
 /*
  * Note: if this fails, the caller will clean up any records left on the
- * rwa->write_batch list.
+ * batch list.
  */
 static int
-flush_write_batch_impl(struct receive_writer_arg *rwa)
+flush_write_batch_impl(struct receive_writer_arg *rwa, list_t *batch)
 {
 	dnode_t *dn;
 	int err;
 
-	if (dnode_hold(rwa->os, rwa->last_object, FTAG, &dn) != 0)
-		return (SET_ERROR(EINVAL));
-
-	struct receive_record_arg *last_rrd = list_tail(&rwa->write_batch);
+	struct receive_record_arg *last_rrd = list_tail(batch);
 	struct drr_write *last_drrw = &last_rrd->header.drr_u.drr_write;
 
-	struct receive_record_arg *first_rrd = list_head(&rwa->write_batch);
+	struct receive_record_arg *first_rrd = list_head(batch);
 	struct drr_write *first_drrw = &first_rrd->header.drr_u.drr_write;
 
-	ASSERT3U(rwa->last_object, ==, last_drrw->drr_object);
-	ASSERT3U(rwa->last_offset, ==, last_drrw->drr_offset);
+	if (dnode_hold(rwa->os, last_drrw->drr_object, FTAG, &dn) != 0)
+		return (SET_ERROR(EINVAL));
 
 	dmu_tx_t *tx = dmu_tx_create(rwa->os);
 	dmu_tx_hold_write_by_dnode(tx, dn, first_drrw->drr_offset,
@@ -2246,11 +2258,11 @@ flush_write_batch_impl(struct receive_writer_arg *rwa)
 	}
 
 	struct receive_record_arg *rrd;
-	while ((rrd = list_head(&rwa->write_batch)) != NULL) {
+	while ((rrd = list_head(batch)) != NULL) {
 		struct drr_write *drrw = &rrd->header.drr_u.drr_write;
 		abd_t *abd = rrd->abd;
 
-		ASSERT3U(drrw->drr_object, ==, rwa->last_object);
+		ASSERT3U(drrw->drr_object, ==, last_drrw->drr_object);
 
 		if (drrw->drr_logical_size != dn->dn_datablksz) {
 			/*
@@ -2367,7 +2379,7 @@ flush_write_batch_impl(struct receive_writer_arg *rwa)
 		 */
 		save_resume_state(rwa, drrw->drr_object, drrw->drr_offset, tx);
 
-		list_remove(&rwa->write_batch, rrd);
+		list_remove(batch, rrd);
 		kmem_free(rrd, sizeof (*rrd));
 	}
 
@@ -2376,21 +2388,109 @@ flush_write_batch_impl(struct receive_writer_arg *rwa)
 	return (err);
 }
 
+static void
+free_write_batch(list_t *batch)
+{
+	struct receive_record_arg *rrd;
+	while ((rrd = list_remove_head(batch)) != NULL) {
+		abd_free(rrd->abd);
+		kmem_free(rrd, sizeof (*rrd));
+	}
+}
+
+typedef struct receive_write_job {
+	struct receive_writer_arg *rwj_rwa;
+	list_t rwj_batch;
+	taskq_ent_t rwj_tqent;
+} receive_write_job_t;
+
+static void
+receive_write_job_func(void *arg)
+{
+	receive_write_job_t *rwj = arg;
+	struct receive_writer_arg *rwa = rwj->rwj_rwa;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+
+	int err = flush_write_batch_impl(rwa, &rwj->rwj_batch);
+	if (err != 0)
+		free_write_batch(&rwj->rwj_batch);
+	list_destroy(&rwj->rwj_batch);
+	kmem_free(rwj, sizeof (*rwj));
+
+	mutex_enter(&rwa->write_lock);
+	if (rwa->write_err == 0)
+		rwa->write_err = err;
+	rwa->writes_pending--;
+	cv_broadcast(&rwa->write_cv);
+	mutex_exit(&rwa->write_lock);
+	spl_fstrans_unmark(cookie);
+}
+
+/*
+ * Wait until no more than "max" write batches are in flight, and return the
+ * first error any of them hit.
+ */
+static int
+receive_write_wait(struct receive_writer_arg *rwa, uint64_t max)
+{
+	if (rwa->write_tqs == NULL)
+		return (0);
+
+	mutex_enter(&rwa->write_lock);
+	while (rwa->writes_pending > max)
+		cv_wait(&rwa->write_cv, &rwa->write_lock);
+	int err = rwa->write_err;
+	mutex_exit(&rwa->write_lock);
+	return (err);
+}
+
+/*
+ * Hand a full write batch to the taskq for its object.  Batches of one
+ * object always go to the same single-threaded taskq, so they are applied
+ * in stream order, while batches of different objects proceed in
+ * parallel.  Every non-WRITE record waits for all outstanding batches
+ * first (see receive_process_record()), so ordering against object
+ * creation, frees and the end of the stream is unchanged.
+ */
+static int
+dispatch_write_batch(struct receive_writer_arg *rwa)
+{
+	int err = receive_write_wait(rwa, 2 * rwa->write_ntqs);
+	if (err != 0)
+		return (err);
+
+	struct receive_record_arg *rrd = list_head(&rwa->write_batch);
+	uint64_t object = rrd->header.drr_u.drr_write.drr_object;
+
+	receive_write_job_t *rwj = kmem_alloc(sizeof (*rwj), KM_SLEEP);
+	rwj->rwj_rwa = rwa;
+	list_create(&rwj->rwj_batch, sizeof (struct receive_record_arg),
+	    offsetof(struct receive_record_arg, node.bqn_node));
+	list_move_tail(&rwj->rwj_batch, &rwa->write_batch);
+	taskq_init_ent(&rwj->rwj_tqent);
+
+	mutex_enter(&rwa->write_lock);
+	rwa->writes_pending++;
+	mutex_exit(&rwa->write_lock);
+	taskq_dispatch_ent(rwa->write_tqs[object % rwa->write_ntqs],
+	    receive_write_job_func, rwj, 0, &rwj->rwj_tqent);
+	return (0);
+}
+
 noinline static int
 flush_write_batch(struct receive_writer_arg *rwa)
 {
 	if (list_is_empty(&rwa->write_batch))
 		return (0);
 	int err = rwa->err;
-	if (err == 0)
-		err = flush_write_batch_impl(rwa);
-	if (err != 0) {
-		struct receive_record_arg *rrd;
-		while ((rrd = list_remove_head(&rwa->write_batch)) != NULL) {
-			abd_free(rrd->abd);
-			kmem_free(rrd, sizeof (*rrd));
-		}
+	if (err == 0) {
+		if (rwa->write_tqs != NULL)
+			err = dispatch_write_batch(rwa);
+		else
+			err = flush_write_batch_impl(rwa, &rwa->write_batch);
 	}
+	if (err != 0)
+		free_write_batch(&rwa->write_batch);
 	ASSERT(list_is_empty(&rwa->write_batch));
 	return (err);
 }
@@ -2843,6 +2943,37 @@ receive_read_payload_and_next_header(dmu_recv_cookie_t *drc, int len, void *buf)
 	return (0);
 }
 
+static int
+receive_read_abd_cb(void *buf, size_t len, void *arg)
+{
+	dmu_recv_cookie_t *drc = arg;
+
+	int err = receive_read(drc, len, buf);
+	if (err == 0)
+		receive_cksum(drc, len, buf);
+	return (err);
+}
+
+/*
+ * Like receive_read_payload_and_next_header(), but the payload is read
+ * directly into an ABD that may be scattered, one chunk at a time.
+ */
+static int
+receive_read_payload_abd_and_next_header(dmu_recv_cookie_t *drc, abd_t *abd)
+{
+	size_t len = abd_get_size(abd);
+
+	ASSERT3U(len, <=, SPA_MAXBLOCKSIZE);
+	int err = abd_iterate_func(abd, 0, len, receive_read_abd_cb, drc);
+	if (err != 0)
+		return (err);
+
+	drc->drc_rrd->payload_size = len;
+	drc->drc_rrd->bytes_read = drc->drc_bytes_read;
+
+	return (receive_read_payload_and_next_header(drc, 0, NULL));
+}
+
 /*
  * Issue the prefetch reads for any necessary indirect blocks.
  *
@@ -2917,9 +3048,24 @@ receive_read_record(dmu_recv_cookie_t *drc)
 	{
 		struct drr_write *drrw = &drc->drc_rrd->header.drr_u.drr_write;
 		int size = DRR_WRITE_PAYLOAD_SIZE(drrw);
-		abd_t *abd = abd_alloc_linear(size, B_FALSE);
-		err = receive_read_payload_and_next_header(drc, size,
-		    abd_to_buf(abd));
+		abd_t *abd;
+		/*
+		 * Compressed (and raw compressed) payloads are handed to the
+		 * zio layer as-is by a lightweight write and are never
+		 * byteswapped, so they can be read straight into a scattered
+		 * ABD rather than a large linear buffer.  Corrective receives
+		 * and uncompressed payloads may need the data in a linear
+		 * buffer.
+		 */
+		if (DRR_WRITE_COMPRESSED(drrw) && !drc->drc_heal) {
+			abd = abd_alloc(size, B_FALSE);
+			err = receive_read_payload_abd_and_next_header(drc,
+			    abd);
+		} else {
+			abd = abd_alloc_linear(size, B_FALSE);
+			err = receive_read_payload_and_next_header(drc, size,
+			    abd_to_buf(abd));
+		}
 		if (err != 0) {
 			abd_free(abd);
 			return (err);
@@ -3126,6 +3272,8 @@ receive_process_record(struct receive_writer_arg *rwa,
 
 	if (!rwa->heal && rrd->header.drr_type != DRR_WRITE) {
 		err = flush_write_batch(rwa);
+		if (err == 0)
+			err = receive_write_wait(rwa, 0);
 		if (err != 0) {
 			if (rrd->abd != NULL) {
 				abd_free(rrd->abd);
@@ -3273,6 +3421,9 @@ receive_writer_thread(void *arg)
 		zio_wait(rwa->heal_pio);
 	} else {
 		int err = flush_write_batch(rwa);
+		int werr = receive_write_wait(rwa, 0);
+		if (err == 0)
+			err = werr;
 		if (rwa->err == 0)
 			rwa->err = err;
 	}
@@ -3310,6 +3461,33 @@ resume_check(dmu_recv_cookie_t *drc, nvlist_t *begin_nvl)
 	return (0);
 }
 
+/*
+ * The stream was one part of a snapshot split by "zfs send --part".  Rather
+ * than completing the snapshot, record the first object of the next part as
+ * the resume point, which that part will be checked against.
+ */
+static int
+receive_part_end(dmu_recv_cookie_t *drc)
+{
+	dsl_dataset_t *ds = drc->drc_os->os_dsl_dataset;
+	dmu_tx_t *tx = dmu_tx_create(drc->drc_os);
+
+	int err = dmu_tx_assign(tx, DMU_TX_WAIT);
+	if (err != 0) {
+		dmu_tx_abort(tx);
+		return (err);
+	}
+
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	ds->ds_resume_object[txgoff] = drc->drc_end_object;
+	ds->ds_resume_offset[txgoff] = 0;
+	ds->ds_resume_bytes[txgoff] = MAX(drc->drc_bytes_read, 1);
+	dsl_dataset_dirty(ds, tx);
+	dmu_tx_commit(tx);
+
+	return (0);
+}
+
 /*
  * Read in the stream's records, one by one, and apply them to the pool.  There
  * are two threads involved; the thread that calls this function will spin up a
@@ -3388,6 +3566,19 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, offset_t *voffp)
 			goto out;
 	}
 
+	/*
+	 * A part of a snapshot leaves resume state behind for the next
+	 * part, so it can only be received into a resumable receive.
+	 */
+	if (drc->drc_featureflags & DMU_BACKUP_FEATURE_PART) {
+		if (!drc->drc_resumable || nvlist_lookup_uint64(
+		    drc->drc_begin_nvl, BEGINNV_END_OBJECT,
+		    &drc->drc_end_object) != 0 || drc->drc_end_object == 0) {
+			err = SET_ERROR(EINVAL);
+			goto out;
+		}
+	}
+
 	/*
 	 * For compatibility with recursive send streams, we do this here,
 	 * rather than in dmu_recv_begin. If we pull the next header too
@@ -3427,6 +3618,23 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, offset_t *voffp)
 	list_create(&rwa->write_batch, sizeof (struct receive_record_arg),
 	    offsetof(struct receive_record_arg, node.bqn_node));
 
+	/*
+	 * Resumable receives record the last written (object, offset) per
+	 * txg and rely on writes being assigned to txgs in stream order, so
+	 * they, like healing receives, keep writing from one thread.
+	 */
+	mutex_init(&rwa->write_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&rwa->write_cv, NULL, CV_DEFAULT, NULL);
+	if (zfs_recv_write_threads > 1 && !rwa->heal && !rwa->resumable) {
+		rwa->write_ntqs = zfs_recv_write_threads;
+		rwa->write_tqs = kmem_alloc(rwa->write_ntqs *
+		    sizeof (taskq_t *), KM_SLEEP);
+		for (uint_t i = 0; i < rwa->write_ntqs; i++) {
+			rwa->write_tqs[i] = taskq_create("z_recv_write", 1,
+			    minclsyspri, 1, INT_MAX, TASKQ_PREPOPULATE);
+		}
+	}
+
 	(void) thread_create(NULL, 0, receive_writer_thread, rwa, 0, curproc,
 	    TS_RUN, minclsyspri);
 	/*
@@ -3486,9 +3694,11 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, offset_t *voffp)
 	/*
 	 * If we are receiving a full stream as a clone, all object IDs which
 	 * are greater than the maximum ID referenced in the stream are
-	 * by definition unused and must be freed.
+	 * by definition unused and must be freed.  Objects beyond the end of
+	 * a part belong to the parts still to come.
 	 */
-	if (drc->drc_clone && drc->drc_drrb->drr_fromguid == 0) {
+	if (drc->drc_clone && drc->drc_drrb->drr_fromguid == 0 &&
+	    drc->drc_end_object == 0) {
 		uint64_t obj = rwa->max_object + 1;
 		int free_err = 0;
 		int next_err = 0;
@@ -3513,9 +3723,27 @@ dmu_recv_stream(dmu_recv_cookie_t *drc, offset_t *voffp)
 	mutex_destroy(&rwa->mutex);
 	bqueue_destroy(&rwa->q);
 	list_destroy(&rwa->write_batch);
+	if (rwa->write_tqs != NULL) {
+		for (uint_t i = 0; i < rwa->write_ntqs; i++)
+			taskq_destroy(rwa->write_tqs[i]);
+		kmem_free(rwa->write_tqs, rwa->write_ntqs * sizeof (taskq_t *));
+	}
+	ASSERT0(rwa->writes_pending);
+	cv_destroy(&rwa->write_cv);
+	mutex_destroy(&rwa->write_lock);
 	if (err == 0)
 		err = rwa->err;
 
+	/*
+	 * The partially received state of a part is kept, like that of an
+	 * interrupted resumable receive, by returning an error.
+	 */
+	if (err == 0 && drc->drc_end_object != 0) {
+		err = receive_part_end(drc);
+		if (err == 0)
+			err = SET_ERROR(ZFS_ERR_STREAM_PART);
+	}
+
 out:
 	/*
 	 * If we hit an error before we started the receive_writer_thread
@@ -3864,5 +4092,8 @@ ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, queue_ff, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, write_batch_size, UINT, ZMOD_RW,
 	"Maximum amount of writes to batch into one transaction");
 
+ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, write_threads, UINT, ZMOD_RW,
+	"Number of threads applying write batches of different objects");
+
 ZFS_MODULE_PARAM(zfs_recv, zfs_recv_, best_effort_corrective, INT, ZMOD_RW,
 	"Ignore errors during corrective receive");
@@ -728,6 +728,7 @@ perform_thread_merge(bqueue_t *q, uint32_t num_threads,
 	avl_tree_t start_tree, end_tree;
 	struct redact_record *record;
 	struct redact_record *current_record = NULL;
+	boolean_t stop = B_FALSE;
 	int err = 0;
 	struct merge_data md = { {0} };
 	list_create(&md.md_redact_block_pending,
@@ -782,6 +783,17 @@ perform_thread_merge(bqueue_t *q, uint32_t num_threads,
 		struct redact_node *last_start = avl_last(&start_tree);
 		struct redact_node *first_end = avl_first(&end_tree);
 
+		/*
+		 * Blocks are only redacted if every thread redacts them, so
+		 * once any thread has reached the end of its snapshot there
+		 * is nothing left to find.  Stop the other threads rather
+		 * than wait for them to traverse the rest of theirs.
+		 */
+		if (last_start->record->eos_marker) {
+			stop = B_TRUE;
+			break;
+		}
+
 		/*
 		 * If the last start record is before the first end record,
 		 * then we have blocks that are redacted by all threads.
@@ -802,12 +814,12 @@ perform_thread_merge(bqueue_t *q, uint32_t num_threads,
 	}
 
 	/*
-	 * We're done; if we were cancelled, we need to cancel our workers and
-	 * clear out their queues.  Either way, we need to remove every thread's
-	 * redact_node struct from the avl trees.
+	 * We're done; if we were cancelled or stopped early, we need to cancel
+	 * our workers and clear out their queues.  Either way, we need to
+	 * remove every thread's redact_node struct from the avl trees.
 	 */
 	for (int i = 0; i < num_threads; i++) {
-		if (err != 0) {
+		if (err != 0 || stop) {
 			thread_args[i].cancel = B_TRUE;
 			while (!redact_nodes[i].record->eos_marker) {
 				(void) update_avl_trees(&start_tree, &end_tree,
@@ -77,6 +77,15 @@ static int zfs_send_corrupt_data = B_FALSE;
  * cache, this may need to be decreased.
  */
 static uint_t zfs_send_queue_length = SPA_MAXBLOCKSIZE;
+/*
+ * The reader thread issues a read for each data block as it is queued and
+ * the main thread consumes them in stream order, so the number of reads in
+ * flight is bounded by how many blocks fit in the prefetch queue.  With
+ * large records zfs_send_queue_length alone only covers a handful of
+ * blocks, so the queue is grown to hold at least this many blocks of the
+ * dataset's recordsize (limited to 1/64th of memory).
+ */
+static uint_t zfs_send_read_window = 64;
 /*
  * This tunable controls the length of the queues that zfs send worker threads
  * use to communicate.  If the send_main_thread is blocking on these queues,
@@ -168,6 +177,9 @@ struct send_range {
 			boolean_t		io_outstanding;
 			boolean_t		io_compressed;
 			int			io_err;
+			/* fletcher4 of the payload, see send_data_cksum() */
+			boolean_t		cksum_valid;
+			zio_cksum_t		cksum;
 		} data;
 		struct srh {
 			uint32_t		datablksz;
@@ -221,12 +233,27 @@ typedef struct dmu_send_cookie {
 	uint64_t dsc_last_data_offset;
 	uint64_t dsc_resume_object;
 	uint64_t dsc_resume_offset;
+	uint64_t dsc_end_object;
 	boolean_t dsc_sent_begin;
 	boolean_t dsc_sent_end;
+	/* precomputed checksum of the next dumped payload, if any */
+	const zio_cksum_t *dsc_payload_cksum;
+	uint64_t dsc_payload_cksum_size;
 } dmu_send_cookie_t;
 
 static int do_dump(dmu_send_cookie_t *dscp, struct send_range *range);
 
+/*
+ * Size of the payload dmu_dump_write() will send for a block read with
+ * issue_data_read(): the physical size for compressed and raw reads, and
+ * the logical size otherwise.
+ */
+static uint64_t
+send_data_cksum_size(struct srd *srdp)
+{
+	return (srdp->io_compressed ? BP_GET_PSIZE(&srdp->bp) : srdp->datasz);
+}
+
 static void
 range_free(struct send_range *range)
 {
@@ -292,7 +319,11 @@ dump_record(dmu_send_cookie_t *dscp, void *payload, int payload_len)
 		 * payload is null when dso_dryrun == B_TRUE (i.e. when we're
 		 * doing a send size calculation)
 		 */
-		if (payload != NULL) {
+		if (payload != NULL && dscp->dsc_payload_cksum != NULL &&
+		    dscp->dsc_payload_cksum_size == payload_len) {
+			fletcher_4_combine(&dscp->dsc_zc, payload_len,
+			    dscp->dsc_payload_cksum);
+		} else if (payload != NULL) {
 			(void) fletcher_4_incremental_native(
 			    payload, payload_len, &dscp->dsc_zc);
 		}
@@ -667,6 +698,17 @@ dump_freeobjects(dmu_send_cookie_t *dscp, uint64_t firstobj, uint64_t numobjs)
 			numobjs = maxobj - firstobj;
 	}
 
+	/*
+	 * Objects past the end of this part are left to the next one.
+	 */
+	if (dscp->dsc_end_object != 0) {
+		if (dscp->dsc_end_object <= firstobj)
+			return (0);
+
+		if (dscp->dsc_end_object < firstobj + numobjs)
+			numobjs = dscp->dsc_end_object - firstobj;
+	}
+
 	/*
 	 * If there is a pending op, but it's not PENDING_FREEOBJECTS,
 	 * push it out, since free block aggregation can only be done for
@@ -1000,10 +1042,16 @@ do_dump(dmu_send_cookie_t *dscp, struct send_range *range)
 				srdp->datablksz -= n;
 			}
 		} else {
+			if (err == 0 && srdp->cksum_valid) {
+				dscp->dsc_payload_cksum = &srdp->cksum;
+				dscp->dsc_payload_cksum_size =
+				    send_data_cksum_size(srdp);
+			}
 			err = dmu_dump_write(dscp, srdp->obj_type,
 			    range->object, offset,
 			    srdp->datablksz, srdp->datasz, bp,
 			    srdp->io_compressed, data);
+			dscp->dsc_payload_cksum = NULL;
 		}
 		return (err);
 	}
@@ -1057,6 +1105,7 @@ range_alloc(enum type type, uint64_t object, uint64_t start_blkid,
 		range->sru.data.io_outstanding = 0;
 		range->sru.data.io_err = 0;
 		range->sru.data.io_compressed = B_FALSE;
+		range->sru.data.cksum_valid = B_FALSE;
 	} else if (type == OBJECT) {
 		range->sru.object.spill_range = NULL;
 	}
@@ -1265,6 +1314,18 @@ send_range_after(const struct send_range *from, const struct send_range *to)
 	return (0);
 }
 
+/*
+ * Return the first object covered by the range, used to stop a partial send
+ * at its end object.  Ranges of the meta dnode cover whole dnode blocks.
+ */
+static uint64_t
+send_range_first_object(const struct send_range *range)
+{
+	if (range->object == DMU_META_DNODE_OBJECT)
+		return (range->start_blkid << DNODES_PER_BLOCK_SHIFT);
+	return (range->object);
+}
+
 /*
  * Pop the new data off the queue, check that the records we receive are in
  * the right order, but do not free the old data.  This is used so that the
@@ -1558,6 +1619,26 @@ send_merge_thread(void *arg)
 	thread_exit();
 }
 
+/*
+ * Compute the fletcher4 checksum of a block's payload as soon as its read
+ * completes, in the zio completion or reader thread, so the main send
+ * thread only has to fold it into the running stream checksum with
+ * fletcher_4_combine() rather than checksum every payload byte itself.
+ * The stream is unchanged; large blocks that are split into several
+ * records, or that are too large to combine, are checksummed by
+ * dump_record() as before.
+ */
+static void
+send_data_cksum(struct srd *srdp, const void *buf)
+{
+	uint64_t size = send_data_cksum_size(srdp);
+
+	if (size > ZFS_FLETCHER_4_INC_MAX_SIZE || !IS_P2ALIGNED(size, 4))
+		return;
+	fletcher_4_native(buf, size, NULL, &srdp->cksum);
+	srdp->cksum_valid = B_TRUE;
+}
+
 struct send_reader_thread_arg {
 	struct send_merge_thread_arg *smta;
 	bqueue_t q;
@@ -1572,6 +1653,11 @@ dmu_send_read_done(zio_t *zio)
 {
 	struct send_range *range = zio->io_private;
 
+	if (zio->io_error == 0) {
+		send_data_cksum(&range->sru.data,
+		    abd_to_buf(range->sru.data.abd));
+	}
+
 	mutex_enter(&range->sru.data.lock);
 	if (zio->io_error != 0) {
 		abd_free(range->sru.data.abd);
@@ -1650,6 +1736,8 @@ issue_data_read(struct send_reader_thread_arg *srta, struct send_range *range)
 	int arc_err = arc_read(NULL, os->os_spa, bp,
 	    arc_getbuf_func, &srdp->abuf, ZIO_PRIORITY_ASYNC_READ,
 	    zioflags, &aflags, &zb);
+	if (arc_err == 0 && srdp->abuf != NULL)
+		send_data_cksum(srdp, srdp->abuf->b_data);
 	/*
 	 * If the data is not already cached in the ARC, we read directly
 	 * from zio.  This avoids the performance overhead of adding a new
@@ -1939,6 +2027,9 @@ struct dmu_send_params {
 	boolean_t savedok;
 	uint64_t resumeobj;
 	uint64_t resumeoff;
+	uint64_t part;
+	uint64_t nparts;
+	uint64_t endobj;
 	uint64_t saved_guid;
 	zfs_bookmark_phys_t *redactbook;
 	/* Stream output params */
@@ -2007,6 +2098,10 @@ setup_featureflags(struct dmu_send_params *dspp, objset_t *os,
 		*featureflags |= DMU_BACKUP_FEATURE_RESUMING;
 	}
 
+	if (dspp->endobj != 0) {
+		*featureflags |= DMU_BACKUP_FEATURE_PART;
+	}
+
 	if (dspp->redactbook != NULL) {
 		*featureflags |= DMU_BACKUP_FEATURE_REDACTED;
 	}
@@ -2159,10 +2254,13 @@ setup_merge_thread(struct send_merge_thread_arg *smt_arg,
 static void
 setup_reader_thread(struct send_reader_thread_arg *srt_arg,
     struct dmu_send_params *dspp, struct send_merge_thread_arg *smt_arg,
-    uint64_t featureflags)
+    uint64_t featureflags, uint64_t recordsize)
 {
+	uint64_t window = MIN((uint64_t)zfs_send_read_window * recordsize,
+	    arc_all_memory() / 64);
+
 	VERIFY0(bqueue_init(&srt_arg->q, zfs_send_queue_ff,
-	    MAX(zfs_send_queue_length, 2 * zfs_max_recordsize),
+	    MAX(MAX(zfs_send_queue_length, 2 * zfs_max_recordsize), window),
 	    offsetof(struct send_range, ln)));
 	srt_arg->smta = smt_arg;
 	srt_arg->issue_reads = !dspp->dso->dso_dryrun;
@@ -2186,12 +2284,18 @@ setup_resume_points(struct dmu_send_params *dspp,
 	uint64_t blkid = 0;
 	if (resuming) {
 		obj = dspp->resumeobj;
-		dmu_object_info_t to_doi;
-		err = dmu_object_info(os, obj, &to_doi);
-		if (err != 0)
-			return (err);
+		/*
+		 * The first object of a part need not exist, so only look
+		 * up the block size when resuming in the middle of an object.
+		 */
+		if (dspp->resumeoff != 0) {
+			dmu_object_info_t to_doi;
+			err = dmu_object_info(os, obj, &to_doi);
+			if (err != 0)
+				return (err);
 
-		blkid = dspp->resumeoff / to_doi.doi_data_block_size;
+			blkid = dspp->resumeoff / to_doi.doi_data_block_size;
+		}
 	}
 	/*
 	 * If we're resuming a redacted send, we can skip to the appropriate
@@ -2228,6 +2332,32 @@ setup_resume_points(struct dmu_send_params *dspp,
 	return (0);
 }
 
+/*
+ * Split the objects of the snapshot into nparts ranges of whole dnode blocks
+ * and restrict the stream to one of them.  Every part but the first is sent
+ * as a resuming stream starting at its first object, so that it can be
+ * received on top of the previous part, and every part but the last stops
+ * at the first object of the next part.  All parts are generated from the
+ * same snapshot, so they can be sent concurrently and still fit together.
+ */
+static int
+setup_send_part(struct dmu_send_params *dspp, objset_t *os)
+{
+	if (dspp->part >= dspp->nparts || dspp->savedok ||
+	    dspp->resumeobj != 0 || dspp->resumeoff != 0)
+		return (SET_ERROR(EINVAL));
+
+	uint64_t nblks = DMU_META_DNODE(os)->dn_maxblkid + 1;
+	uint64_t per_part = DIV_ROUND_UP(nblks, dspp->nparts);
+
+	dspp->resumeobj = (dspp->part * per_part) << DNODES_PER_BLOCK_SHIFT;
+	if (dspp->part + 1 < dspp->nparts) {
+		dspp->endobj =
+		    ((dspp->part + 1) * per_part) << DNODES_PER_BLOCK_SHIFT;
+	}
+	return (0);
+}
+
 static dmu_sendstatus_t *
 setup_send_progress(struct dmu_send_params *dspp)
 {
@@ -2369,6 +2499,7 @@ dmu_send_impl(struct dmu_send_params *dspp)
 	int err;
 	uint64_t fromtxg = dspp->ancestor_zb.zbm_creation_txg;
 	uint64_t featureflags = 0;
+	uint64_t recordsize;
 	struct redact_list_thread_arg *from_arg;
 	struct send_thread_arg *to_arg;
 	struct redact_list_thread_arg *rlt_arg;
@@ -2377,8 +2508,7 @@ dmu_send_impl(struct dmu_send_params *dspp)
 	struct send_range *range;
 	redaction_list_t *from_rl = NULL;
 	redaction_list_t *redact_rl = NULL;
-	boolean_t resuming = (dspp->resumeobj != 0 || dspp->resumeoff != 0);
-	boolean_t book_resuming = resuming;
+	boolean_t resuming, book_resuming;
 
 	dsl_dataset_t *to_ds = dspp->to_ds;
 	zfs_bookmark_phys_t *ancestor_zb = &dspp->ancestor_zb;
@@ -2391,6 +2521,13 @@ dmu_send_impl(struct dmu_send_params *dspp)
 		return (err);
 	}
 
+	if (dspp->nparts > 1 && (err = setup_send_part(dspp, os)) != 0) {
+		dsl_pool_rele(dp, tag);
+		return (err);
+	}
+	resuming = (dspp->resumeobj != 0 || dspp->resumeoff != 0);
+	book_resuming = resuming;
+
 	/*
 	 * If this is a non-raw send of an encrypted ds, we can ensure that
 	 * the objset_phys_t is authenticated. This is safe because this is
@@ -2471,6 +2608,11 @@ dmu_send_impl(struct dmu_send_params *dspp)
 	dsc.dsc_featureflags = featureflags;
 	dsc.dsc_resume_object = dspp->resumeobj;
 	dsc.dsc_resume_offset = dspp->resumeoff;
+	dsc.dsc_end_object = dspp->endobj;
+
+	if (dsl_prop_get_int_ds(to_ds, zfs_prop_to_name(ZFS_PROP_RECORDSIZE),
+	    &recordsize) != 0)
+		recordsize = SPA_OLD_MAXBLOCKSIZE;
 
 	dsl_pool_rele(dp, tag);
 
@@ -2531,6 +2673,9 @@ dmu_send_impl(struct dmu_send_params *dspp)
 			goto out;
 	}
 
+	if (dspp->endobj != 0)
+		fnvlist_add_uint64(nvl, BEGINNV_END_OBJECT, dspp->endobj);
+
 	if (featureflags & DMU_BACKUP_FEATURE_RAW) {
 		uint64_t ivset_guid = ancestor_zb->zbm_ivset_guid;
 		nvlist_t *keynvl = NULL;
@@ -2564,10 +2709,16 @@ dmu_send_impl(struct dmu_send_params *dspp)
 	setup_from_thread(from_arg, from_rl, dssp);
 	setup_redact_list_thread(rlt_arg, dspp, redact_rl, dssp);
 	setup_merge_thread(smt_arg, dspp, from_arg, to_arg, rlt_arg, os);
-	setup_reader_thread(srt_arg, dspp, smt_arg, featureflags);
+	setup_reader_thread(srt_arg, dspp, smt_arg, featureflags, recordsize);
 
+	boolean_t part_done = B_FALSE;
 	range = bqueue_dequeue(&srt_arg->q);
 	while (err == 0 && !range->eos_marker) {
+		if (dsc.dsc_end_object != 0 &&
+		    send_range_first_object(range) >= dsc.dsc_end_object) {
+			part_done = B_TRUE;
+			break;
+		}
 		err = do_dump(&dsc, range);
 		range = get_next_range(&srt_arg->q, range);
 		if (issig())
@@ -2575,12 +2726,13 @@ dmu_send_impl(struct dmu_send_params *dspp)
 	}
 
 	/*
-	 * If we hit an error or are interrupted, cancel our worker threads and
-	 * clear the queue of any pending records.  The threads will pass the
-	 * cancel up the tree of worker threads, and each one will clean up any
-	 * pending records before exiting.
+	 * If we hit an error or are interrupted, or have reached the end of
+	 * the part being sent, cancel our worker threads and clear the queue
+	 * of any pending records.  The threads will pass the cancel up the
+	 * tree of worker threads, and each one will clean up any pending
+	 * records before exiting.
 	 */
-	if (err != 0) {
+	if (err != 0 || part_done) {
 		srt_arg->cancel = B_TRUE;
 		while (!range->eos_marker) {
 			range = get_next_range(&srt_arg->q, range);
@@ -2595,7 +2747,7 @@ dmu_send_impl(struct dmu_send_params *dspp)
 	bqueue_destroy(&to_arg->q);
 	bqueue_destroy(&from_arg->q);
 
-	if (err == 0 && srt_arg->error != 0)
+	if (err == 0 && !part_done && srt_arg->error != 0)
 		err = srt_arg->error;
 
 	if (err != 0)
@@ -2748,8 +2900,8 @@ int
 dmu_send(const char *tosnap, const char *fromsnap, boolean_t embedok,
     boolean_t large_block_ok, boolean_t compressok, boolean_t rawok,
     boolean_t savedok, uint64_t resumeobj, uint64_t resumeoff,
-    const char *redactbook, int outfd, offset_t *off,
-    dmu_send_outparams_t *dsop)
+    uint64_t part, uint64_t nparts, const char *redactbook, int outfd,
+    offset_t *off, dmu_send_outparams_t *dsop)
 {
 	int err = 0;
 	ds_hold_flags_t dsflags;
@@ -2769,6 +2921,8 @@ dmu_send(const char *tosnap, const char *fromsnap, boolean_t embedok,
 	dspp.tag = FTAG;
 	dspp.resumeobj = resumeobj;
 	dspp.resumeoff = resumeoff;
+	dspp.part = part;
+	dspp.nparts = nparts;
 	dspp.rawok = rawok;
 	dspp.savedok = savedok;
 
@@ -3124,6 +3278,9 @@ ZFS_MODULE_PARAM(zfs_send, zfs_send_, corrupt_data, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_send, zfs_send_, queue_length, UINT, ZMOD_RW,
 	"Maximum send queue length");
 
+ZFS_MODULE_PARAM(zfs_send, zfs_send_, read_window, UINT, ZMOD_RW,
+	"Minimum number of data blocks zfs send keeps reads in flight for");
+
 ZFS_MODULE_PARAM(zfs_send, zfs_send_, unmodified_spill_blocks, INT, ZMOD_RW,
 	"Send unmodified spill blocks");
 
@@ -758,6 +758,19 @@ traverse_dataset_destroyed(spa_t *spa, blkptr_t *blkptr,
 	    blkptr, txg_start, resume, flags, func, arg));
 }
 
+/*
+ * Visit only the MOS. Callers which want to split the traversal of the
+ * datasets themselves (e.g. across threads) use this together with
+ * traverse_dataset() to cover what traverse_pool() would visit.
+ */
+int
+traverse_mos(spa_t *spa, uint64_t txg_start, int flags,
+    blkptr_cb_t func, void *arg)
+{
+	return (traverse_impl(spa, NULL, 0, spa_get_rootblkptr(spa),
+	    txg_start, NULL, flags, func, arg));
+}
+
 /*
  * NB: pool must not be changing on-disk (eg, from zdb or sync context).
  */
@@ -771,8 +784,7 @@ traverse_pool(spa_t *spa, uint64_t txg_start, int flags,
 	boolean_t hard = (flags & TRAVERSE_HARD);
 
 	/* visit the MOS */
-	err = traverse_impl(spa, NULL, 0, spa_get_rootblkptr(spa),
-	    txg_start, NULL, flags, func, arg);
+	err = traverse_mos(spa, txg_start, flags, func, arg);
 	if (err != 0)
 		return (err);
 
@@ -814,6 +826,7 @@ traverse_pool(spa_t *spa, uint64_t txg_start, int flags,
 }
 
 EXPORT_SYMBOL(traverse_dataset);
+EXPORT_SYMBOL(traverse_mos);
 EXPORT_SYMBOL(traverse_pool);
 
 ZFS_MODULE_PARAM(zfs, zfs_, pd_bytes_max, INT, ZMOD_RW,
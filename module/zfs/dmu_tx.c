@@ -58,6 +58,8 @@ dmu_tx_stats_t dmu_tx_stats = {
 	{ "dmu_tx_dirty_over_max",	KSTAT_DATA_UINT64 },
 	{ "dmu_tx_dirty_frees_delay",	KSTAT_DATA_UINT64 },
 	{ "dmu_tx_wrlog_delay",		KSTAT_DATA_UINT64 },
+	{ "dmu_tx_dataset_dirty_delay",	KSTAT_DATA_UINT64 },
+	{ "dmu_tx_dataset_dirty_over_max",	KSTAT_DATA_UINT64 },
 	{ "dmu_tx_quota",		KSTAT_DATA_UINT64 },
 };
 
@@ -954,11 +956,13 @@ static const hrtime_t zfs_delay_max_ns = 100 * MICROSEC; /* 100 milliseconds */
  * of zfs_delay_scale to increase the steepness of the curve.
  */
 static void
-dmu_tx_delay(dmu_tx_t *tx, uint64_t dirty)
+dmu_tx_delay(dmu_tx_t *tx, uint64_t dirty, uint64_t os_dirty,
+    uint64_t os_dirty_max)
 {
 	dsl_pool_t *dp = tx->tx_pool;
+	objset_t *os = tx->tx_objset;
 	uint64_t delay_min_bytes, wrlog;
-	hrtime_t wakeup, tx_time = 0, now;
+	hrtime_t wakeup, tx_time = 0, os_time = 0, now;
 
 	/* Calculate minimum transaction time for the dirty data amount. */
 	delay_min_bytes =
@@ -987,21 +991,52 @@ dmu_tx_delay(dmu_tx_t *tx, uint64_t dirty)
 		    (zfs_wrlog_data_max - wrlog), tx_time);
 	}
 
-	if (tx_time == 0)
+	/*
+	 * Calculate minimum transaction time for the dataset's dirty data,
+	 * on the same curve scaled to its dirty_max.  As above, the caller
+	 * has waited until the dataset is under its dirty_max.
+	 */
+	delay_min_bytes = os_dirty_max * zfs_delay_min_dirty_percent / 100;
+	if (os_dirty_max != 0 && os_dirty > delay_min_bytes) {
+		ASSERT3U(os_dirty, <, os_dirty_max);
+		os_time = zfs_delay_scale * (os_dirty - delay_min_bytes) /
+		    (os_dirty_max - os_dirty);
+	}
+
+	if (tx_time == 0 && os_time == 0)
 		return;
 
 	tx_time = MIN(tx_time, zfs_delay_max_ns);
+	os_time = MIN(os_time, zfs_delay_max_ns);
 	now = gethrtime();
-	if (now > tx->tx_start + tx_time)
+	if (now > tx->tx_start + MAX(tx_time, os_time))
 		return;
 
-	DTRACE_PROBE3(delay__mintime, dmu_tx_t *, tx, uint64_t, dirty,
-	    uint64_t, tx_time);
+	/*
+	 * Transactions delayed by the dataset's own curve are spaced out
+	 * against each other rather than against the whole pool's, so a
+	 * dataset over its dirty_max doesn't push out the wakeups of
+	 * transactions in other datasets.
+	 */
+	if (os_time > tx_time) {
+		DTRACE_PROBE3(delay__mintime, dmu_tx_t *, tx, uint64_t,
+		    os_dirty, uint64_t, os_time);
+
+		mutex_enter(&os->os_dirty_lock);
+		wakeup = MAX(tx->tx_start + os_time,
+		    os->os_dirty_last_wakeup + os_time);
+		os->os_dirty_last_wakeup = wakeup;
+		mutex_exit(&os->os_dirty_lock);
+	} else {
+		DTRACE_PROBE3(delay__mintime, dmu_tx_t *, tx, uint64_t, dirty,
+		    uint64_t, tx_time);
 
-	mutex_enter(&dp->dp_lock);
-	wakeup = MAX(tx->tx_start + tx_time, dp->dp_last_wakeup + tx_time);
-	dp->dp_last_wakeup = wakeup;
-	mutex_exit(&dp->dp_lock);
+		mutex_enter(&dp->dp_lock);
+		wakeup = MAX(tx->tx_start + tx_time,
+		    dp->dp_last_wakeup + tx_time);
+		dp->dp_last_wakeup = wakeup;
+		mutex_exit(&dp->dp_lock);
+	}
 
 	zfs_sleep_until(wakeup);
 }
@@ -1081,6 +1116,13 @@ dmu_tx_try_assign(dmu_tx_t *tx)
 		return (SET_ERROR(ERESTART));
 	}
 
+	if (!tx->tx_dirty_delayed &&
+	    dmu_objset_need_dirty_delay(tx->tx_objset)) {
+		tx->tx_wait_dirty = B_TRUE;
+		DMU_TX_STAT_BUMP(dmu_tx_dataset_dirty_delay);
+		return (SET_ERROR(ERESTART));
+	}
+
 	tx->tx_txg = txg_hold_open(tx->tx_pool, &tx->tx_txgh);
 	tx->tx_needassign_txh = NULL;
 
@@ -1344,7 +1386,8 @@ dmu_tx_wait(dmu_tx_t *tx)
 	before = gethrtime();
 
 	if (tx->tx_wait_dirty) {
-		uint64_t dirty;
+		objset_t *os = tx->tx_objset;
+		uint64_t dirty, os_dirty, os_dirty_max;
 
 		/*
 		 * dmu_tx_try_assign() has determined that we need to wait
@@ -1359,7 +1402,22 @@ dmu_tx_wait(dmu_tx_t *tx)
 		dirty = dp->dp_dirty_total;
 		mutex_exit(&dp->dp_lock);
 
-		dmu_tx_delay(tx, dirty);
+		/*
+		 * Likewise for the dataset's dirty_max, if it has one.
+		 */
+		if (os != NULL && os->os_dsl_dataset != NULL &&
+		    os->os_dirty_max != 0 &&
+		    os->os_dirty_total >= os->os_dirty_max)
+			DMU_TX_STAT_BUMP(dmu_tx_dataset_dirty_over_max);
+		os_dirty = dmu_objset_dirty_wait(os, &os_dirty_max);
+
+		dmu_tx_delay(tx, dirty, os_dirty, os_dirty_max);
+
+		if (os != NULL && os->os_dsl_dataset != NULL) {
+			mutex_enter(&os->os_dirty_lock);
+			os->os_dirty_delay += gethrtime() - before;
+			mutex_exit(&os->os_dirty_lock);
+		}
 
 		tx->tx_wait_dirty = B_FALSE;
 
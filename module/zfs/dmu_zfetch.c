@@ -70,6 +70,8 @@ unsigned int	zfetch_max_idistance = 128 * 1024 * 1024;
 unsigned int	zfetch_max_reorder = 16 * 1024 * 1024;
 /* Max log2 fraction of holes in a stream */
 unsigned int	zfetch_hole_shift = 2;
+/* Detect and prefetch reverse and fixed-stride streams */
+static int	zfetch_patterns = B_TRUE;
 
 typedef struct zfetch_stats {
 	kstat_named_t zfetchstat_hits;
@@ -77,6 +79,8 @@ typedef struct zfetch_stats {
 	kstat_named_t zfetchstat_stride;
 	kstat_named_t zfetchstat_past;
 	kstat_named_t zfetchstat_misses;
+	kstat_named_t zfetchstat_reverse;
+	kstat_named_t zfetchstat_fixed_stride;
 	kstat_named_t zfetchstat_max_streams;
 	kstat_named_t zfetchstat_io_issued;
 	kstat_named_t zfetchstat_io_active;
@@ -88,6 +92,8 @@ static zfetch_stats_t zfetch_stats = {
 	{ "stride",			KSTAT_DATA_UINT64 },
 	{ "past",			KSTAT_DATA_UINT64 },
 	{ "misses",			KSTAT_DATA_UINT64 },
+	{ "reverse",			KSTAT_DATA_UINT64 },
+	{ "fixed_stride",		KSTAT_DATA_UINT64 },
 	{ "max_streams",		KSTAT_DATA_UINT64 },
 	{ "io_issued",			KSTAT_DATA_UINT64 },
 	{ "io_active",			KSTAT_DATA_UINT64 },
@@ -99,6 +105,8 @@ struct {
 	wmsum_t zfetchstat_stride;
 	wmsum_t zfetchstat_past;
 	wmsum_t zfetchstat_misses;
+	wmsum_t zfetchstat_reverse;
+	wmsum_t zfetchstat_fixed_stride;
 	wmsum_t zfetchstat_max_streams;
 	wmsum_t zfetchstat_io_issued;
 	aggsum_t zfetchstat_io_active;
@@ -129,6 +137,10 @@ zfetch_kstats_update(kstat_t *ksp, int rw)
 	    wmsum_value(&zfetch_sums.zfetchstat_past);
 	zs->zfetchstat_misses.value.ui64 =
 	    wmsum_value(&zfetch_sums.zfetchstat_misses);
+	zs->zfetchstat_reverse.value.ui64 =
+	    wmsum_value(&zfetch_sums.zfetchstat_reverse);
+	zs->zfetchstat_fixed_stride.value.ui64 =
+	    wmsum_value(&zfetch_sums.zfetchstat_fixed_stride);
 	zs->zfetchstat_max_streams.value.ui64 =
 	    wmsum_value(&zfetch_sums.zfetchstat_max_streams);
 	zs->zfetchstat_io_issued.value.ui64 =
@@ -146,6 +158,8 @@ zfetch_init(void)
 	wmsum_init(&zfetch_sums.zfetchstat_stride, 0);
 	wmsum_init(&zfetch_sums.zfetchstat_past, 0);
 	wmsum_init(&zfetch_sums.zfetchstat_misses, 0);
+	wmsum_init(&zfetch_sums.zfetchstat_reverse, 0);
+	wmsum_init(&zfetch_sums.zfetchstat_fixed_stride, 0);
 	wmsum_init(&zfetch_sums.zfetchstat_max_streams, 0);
 	wmsum_init(&zfetch_sums.zfetchstat_io_issued, 0);
 	aggsum_init(&zfetch_sums.zfetchstat_io_active, 0);
@@ -174,12 +188,59 @@ zfetch_fini(void)
 	wmsum_fini(&zfetch_sums.zfetchstat_stride);
 	wmsum_fini(&zfetch_sums.zfetchstat_past);
 	wmsum_fini(&zfetch_sums.zfetchstat_misses);
+	wmsum_fini(&zfetch_sums.zfetchstat_reverse);
+	wmsum_fini(&zfetch_sums.zfetchstat_fixed_stride);
 	wmsum_fini(&zfetch_sums.zfetchstat_max_streams);
 	wmsum_fini(&zfetch_sums.zfetchstat_io_issued);
 	ASSERT0(aggsum_value(&zfetch_sums.zfetchstat_io_active));
 	aggsum_fini(&zfetch_sums.zfetchstat_io_active);
 }
 
+/*
+ * Prefetch limits for the files of a dataset.  The conservative and
+ * aggressive profiles of the prefetch property scale the tunables down
+ * and up, and the prefetch_distance property, if set, replaces the data
+ * prefetch distance.  Distances are capped so that stream distances
+ * can't overflow.
+ */
+#define	ZFETCH_DISTANCE_CAP	(1U << 30)
+
+static unsigned int
+dmu_zfetch_max_distance(objset_t *os)
+{
+	uint64_t dist = zfetch_max_distance;
+
+	if (os->os_prefetch_distance != 0)
+		dist = os->os_prefetch_distance;
+	else if (os->os_prefetch == ZFS_PREFETCH_CONSERVATIVE)
+		dist /= 4;
+	else if (os->os_prefetch == ZFS_PREFETCH_AGGRESSIVE)
+		dist *= 4;
+	return (MIN(dist, ZFETCH_DISTANCE_CAP));
+}
+
+static unsigned int
+dmu_zfetch_max_idistance(objset_t *os)
+{
+	uint64_t dist = zfetch_max_idistance;
+
+	if (os->os_prefetch == ZFS_PREFETCH_CONSERVATIVE)
+		dist /= 4;
+	else if (os->os_prefetch == ZFS_PREFETCH_AGGRESSIVE)
+		dist *= 2;
+	return (MIN(dist, ZFETCH_DISTANCE_CAP));
+}
+
+static unsigned int
+dmu_zfetch_max_streams(objset_t *os)
+{
+	if (os->os_prefetch == ZFS_PREFETCH_CONSERVATIVE)
+		return (MAX(zfetch_max_streams / 2, 1));
+	else if (os->os_prefetch == ZFS_PREFETCH_AGGRESSIVE)
+		return (zfetch_max_streams * 2);
+	return (zfetch_max_streams);
+}
+
 /*
  * This takes a pointer to a zfetch structure and a dnode.  It performs the
  * necessary setup for the zfetch structure, grokking data from the
@@ -242,10 +303,11 @@ dmu_zfetch_fini(zfetch_t *zf)
  * If there aren't too many active streams already, create one more.
  * In process delete/reuse all streams without hits for zfetch_max_sec_reap.
  * If needed, reuse oldest stream without hits for zfetch_min_sec_reap or ever.
- * The "blkid" argument is the next block that we expect this stream to access.
+ * The "blkid" and "nblks" arguments describe the access creating the stream,
+ * which expects it to be followed by an access to blkid + nblks.
  */
-static void
-dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
+static zstream_t *
+dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid, uint64_t nblks)
 {
 	zstream_t *zs, *zs_next, *zs_old = NULL;
 	uint_t now = gethrestime_sec(), t;
@@ -278,12 +340,14 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
 
 	/*
 	 * The maximum number of streams is normally zfetch_max_streams,
-	 * but for small files we lower it such that it's at least possible
-	 * for all the streams to be non-overlapping.
+	 * as adjusted by the dataset's prefetch profile, but for small files
+	 * we lower it such that it's at least possible for all the streams
+	 * to be non-overlapping.
 	 */
-	uint32_t max_streams = MAX(1, MIN(zfetch_max_streams,
+	objset_t *os = zf->zf_dnode->dn_objset;
+	uint32_t max_streams = MAX(1, MIN(dmu_zfetch_max_streams(os),
 	    (zf->zf_dnode->dn_maxblkid << zf->zf_dnode->dn_datablkshift) /
-	    zfetch_max_distance));
+	    MAX(dmu_zfetch_max_distance(os), 1)));
 	if (zf->zf_numstreams >= max_streams) {
 		t = now - zfetch_min_sec_reap;
 		for (zs = list_head(&zf->zf_stream); zs != NULL;
@@ -302,7 +366,7 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
 			goto reuse;
 		}
 		ZFETCHSTAT_BUMP(zfetchstat_max_streams);
-		return;
+		return (NULL);
 	}
 
 	zs = kmem_zalloc(sizeof (*zs), KM_SLEEP);
@@ -314,18 +378,22 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
 
 reuse:
 	list_insert_head(&zf->zf_stream, zs);
-	zs->zs_blkid = blkid;
+	zs->zs_blkid = blkid + nblks;
 	/* Allow immediate stream reuse until first hit. */
 	zs->zs_atime = now - zfetch_min_sec_reap;
 	memset(zs->zs_ranges, 0, sizeof (zs->zs_ranges));
 	zs->zs_pf_dist = 0;
 	zs->zs_ipf_dist = 0;
-	zs->zs_pf_start = blkid;
-	zs->zs_pf_end = blkid;
-	zs->zs_ipf_start = blkid;
-	zs->zs_ipf_end = blkid;
+	zs->zs_pf_start = zs->zs_blkid;
+	zs->zs_pf_end = zs->zs_blkid;
+	zs->zs_ipf_start = zs->zs_blkid;
+	zs->zs_ipf_end = zs->zs_blkid;
 	zs->zs_missed = B_FALSE;
 	zs->zs_more = B_FALSE;
+	zs->zs_stride = 0;
+	zs->zs_plen = 0;
+	zs->zs_last = blkid;
+	return (zs);
 }
 
 static void
@@ -333,8 +401,15 @@ dmu_zfetch_done(void *arg, uint64_t level, uint64_t blkid, boolean_t io_issued)
 {
 	zstream_t *zs = arg;
 
-	if (io_issued && level == 0 && blkid < zs->zs_blkid)
-		zs->zs_more = B_TRUE;
+	/*
+	 * The prefetch was late if demand accesses already got to the block.
+	 */
+	if (io_issued && level == 0) {
+		if (zs->zs_plen == 0 ? blkid < zs->zs_blkid :
+		    zs->zs_stride > 0 ? blkid < zs->zs_last + zs->zs_plen :
+		    blkid >= zs->zs_last)
+			zs->zs_more = B_TRUE;
+	}
 	if (zfs_refcount_remove(&zs->zs_refs, NULL) == 0)
 		dmu_zfetch_stream_fini(zs);
 	aggsum_add(&zfetch_sums.zfetchstat_io_active, -1);
@@ -454,6 +529,148 @@ dmu_zfetch_future(zstream_t *zs, uint64_t blkid, uint64_t nblks)
 	return (0);
 }
 
+/*
+ * Grow the data prefetch distance of a stream hit by a demand access of
+ * nbytes.  Start prefetch from the demand access size.  Double the distance
+ * every access up to zfetch_min_distance.  After that only if needed
+ * increase the distance by 1/8 up to max_dist.
+ *
+ * Don't double the distance beyond single block if we have more than ~6%
+ * of ARC held by active prefetches.  It should help with getting out of
+ * RAM on some badly mispredicted read patterns.
+ */
+static void
+dmu_zfetch_pf_dist(zstream_t *zs, unsigned int nbytes, unsigned int dbs,
+    unsigned int max_dist)
+{
+	if (unlikely(zs->zs_pf_dist < nbytes))
+		zs->zs_pf_dist = nbytes;
+	else if (zs->zs_pf_dist < zfetch_min_distance &&
+	    (zs->zs_pf_dist < (1 << dbs) ||
+	    aggsum_compare(&zfetch_sums.zfetchstat_io_active,
+	    arc_c_max >> (4 + dbs)) < 0))
+		zs->zs_pf_dist *= 2;
+	else if (zs->zs_more)
+		zs->zs_pf_dist += zs->zs_pf_dist / 8;
+	zs->zs_more = B_FALSE;
+	if (zs->zs_pf_dist > max_dist)
+		zs->zs_pf_dist = max_dist;
+}
+
+/*
+ * Return the distance of access for nblks blocks starting at blkid from
+ * the first block of the access before it, or 0 if the access is a repeat
+ * or a sequential continuation of that one, or too far away from it.
+ */
+static int32_t
+dmu_zfetch_delta(uint64_t last, uint64_t blkid, uint64_t nblks)
+{
+	int64_t delta = blkid - last;
+
+	if (delta > INT32_MAX || delta < INT32_MIN ||
+	    (delta >= 0 && (uint64_t)delta <= nblks))
+		return (0);
+	return (delta);
+}
+
+/*
+ * Whether a stream may still turn into a reverse or fixed-stride stream,
+ * i.e. it is not one yet and had no sequential hits.
+ */
+static inline boolean_t
+dmu_zfetch_fresh(zstream_t *zs)
+{
+	return (zfetch_patterns && zs->zs_plen == 0 && zs->zs_ipf_dist == 0);
+}
+
+/*
+ * Check whether access for nblks blocks starting at blkid continues a
+ * reverse or fixed-stride pattern of a fresh stream, i.e. whether its
+ * distance from the stream's last access is the same as the distance
+ * before that.  If so, turn the stream into a reverse or fixed-stride
+ * stream and return B_TRUE.  Otherwise, remember the distance and the
+ * access if "update" is set.
+ */
+static boolean_t
+dmu_zfetch_pattern(zstream_t *zs, uint64_t blkid, uint64_t nblks,
+    boolean_t update)
+{
+	if (!dmu_zfetch_fresh(zs))
+		return (B_FALSE);
+
+	int32_t delta = dmu_zfetch_delta(zs->zs_last, blkid, nblks);
+	if (delta != 0 && delta == zs->zs_stride && nblks <= UINT16_MAX) {
+		zs->zs_plen = nblks;
+		zs->zs_last = blkid;
+		memset(zs->zs_ranges, 0, sizeof (zs->zs_ranges));
+		zs->zs_pf_dist = 0;
+		zs->zs_pf_start = blkid + delta;
+		zs->zs_pf_end = blkid + delta;
+		zs->zs_ipf_start = blkid;
+		zs->zs_ipf_end = blkid;
+		zs->zs_more = B_FALSE;
+		return (B_TRUE);
+	}
+
+	if (update) {
+		zs->zs_stride = delta;
+		zs->zs_last = blkid;
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Whether "a" is behind "b" in the direction of a reverse or fixed-stride
+ * stream.
+ */
+static inline boolean_t
+dmu_zfetch_behind(zstream_t *zs, int64_t a, int64_t b)
+{
+	return (zs->zs_stride > 0 ? a < b : a > b);
+}
+
+/*
+ * Process reverse or fixed-stride stream access starting at blkid, which is
+ * zs_stride blocks away from the last one.  Extend the data prefetch by
+ * the following accesses of the pattern, zs_plen blocks each, as far as the
+ * prefetch distance allows.  Return B_FALSE if there are no further
+ * accesses of the pattern within the file.
+ */
+static boolean_t
+dmu_zfetch_pattern_hit(zstream_t *zs, uint64_t blkid, boolean_t fetch_data,
+    unsigned int dbs, unsigned int max_dist, uint64_t maxblkid)
+{
+	int64_t stride = zs->zs_stride;
+	int64_t next = blkid + stride;
+	int64_t left;
+
+	zs->zs_last = blkid;
+	zs->zs_atime = gethrestime_sec();
+	if (stride < 0) {
+		ZFETCHSTAT_BUMP(zfetchstat_reverse);
+		if (next < 0)
+			return (B_FALSE);
+		left = next / -stride + 1;
+	} else {
+		ZFETCHSTAT_BUMP(zfetchstat_fixed_stride);
+		if (next > (int64_t)maxblkid)
+			return (B_FALSE);
+		left = (maxblkid - next) / stride + 1;
+	}
+	if (!fetch_data)
+		return (B_TRUE);
+
+	uint64_t nbytes = (uint64_t)zs->zs_plen << dbs;
+	dmu_zfetch_pf_dist(zs, MIN(nbytes, max_dist), dbs, max_dist);
+	int64_t n = MAX(zs->zs_pf_dist / nbytes, 1);
+	int64_t end = next + MIN(n, left) * stride;
+	if (dmu_zfetch_behind(zs, zs->zs_pf_start, next))
+		zs->zs_pf_start = next;
+	if (dmu_zfetch_behind(zs, zs->zs_pf_end, end))
+		zs->zs_pf_end = end;
+	return (B_TRUE);
+}
+
 /*
  * This is the predictive prefetch entry point.  dmu_zfetch_prepare()
  * associates dnode access specified with blkid and nblks arguments with
@@ -465,6 +682,9 @@ dmu_zfetch_future(zstream_t *zs, uint64_t blkid, uint64_t nblks)
  * fetch_data argument specifies whether actual data blocks should be fetched:
  *   FALSE -- prefetch only indirect blocks for predicted data blocks;
  *   TRUE -- prefetch predicted data blocks plus following indirect blocks.
+ * Besides the usual forward streams, descending-block (reverse) streams and
+ * streams of equally sized accesses a fixed distance apart are detected for
+ * data accesses.  Those only prefetch data blocks along their pattern.
  */
 zstream_t *
 dmu_zfetch_prepare(zfetch_t *zf, uint64_t blkid, uint64_t nblks,
@@ -522,6 +742,8 @@ dmu_zfetch_prepare(zfetch_t *zf, uint64_t blkid, uint64_t nblks,
 	uint64_t end_blkid = blkid + nblks;
 	for (zs = list_head(&zf->zf_stream); zs != NULL;
 	    zs = list_next(&zf->zf_stream, zs)) {
+		if (zs->zs_plen != 0)
+			continue;
 		if (blkid == zs->zs_blkid) {
 			goto hit;
 		} else if (blkid + 1 == zs->zs_blkid) {
@@ -531,17 +753,28 @@ dmu_zfetch_prepare(zfetch_t *zf, uint64_t blkid, uint64_t nblks,
 		}
 	}
 
+	/* Find reverse or fixed-stride stream continued by this access. */
+	for (zs = list_head(&zf->zf_stream); zs != NULL;
+	    zs = list_next(&zf->zf_stream, zs)) {
+		if (zs->zs_plen != 0 && blkid == zs->zs_last + zs->zs_stride)
+			goto pattern;
+	}
+
 	/*
 	 * Find close enough prefetch stream.  Access crossing stream position
 	 * is a hit in its new part.  Access ahead of stream position considered
 	 * a hit for metadata prefetch, since we do not care about fill percent,
 	 * or stored for future otherwise.  Access behind stream position is
 	 * silently ignored, since we already skipped it reaching fill percent.
+	 * Data accesses ahead of or behind a stream that had no hits yet may
+	 * also turn it into a fixed-stride or reverse stream.
 	 */
 	uint_t max_reorder = MIN((zfetch_max_reorder >> dbs) + 1, UINT16_MAX);
 	uint_t t = gethrestime_sec() - zfetch_max_sec_reap;
 	for (zs = list_head(&zf->zf_stream); zs != NULL;
 	    zs = list_next(&zf->zf_stream, zs)) {
+		if (zs->zs_plen != 0)
+			continue;
 		if (blkid > zs->zs_blkid) {
 			if (end_blkid <= zs->zs_blkid + max_reorder) {
 				if (!fetch_data) {
@@ -550,6 +783,9 @@ dmu_zfetch_prepare(zfetch_t *zf, uint64_t blkid, uint64_t nblks,
 					ZFETCHSTAT_BUMP(zfetchstat_stride);
 					goto future;
 				}
+				if (dmu_zfetch_pattern(zs, blkid, nblks,
+				    B_TRUE))
+					goto pattern;
 				nblks = dmu_zfetch_future(zs, blkid, nblks);
 				if (nblks > 0)
 					ZFETCHSTAT_BUMP(zfetchstat_stride);
@@ -563,6 +799,9 @@ dmu_zfetch_prepare(zfetch_t *zf, uint64_t blkid, uint64_t nblks,
 			goto hit;
 		} else if (end_blkid + max_reorder > zs->zs_blkid &&
 		    (int)(zs->zs_atime - t) >= 0) {
+			if (fetch_data &&
+			    dmu_zfetch_pattern(zs, blkid, nblks, B_TRUE))
+				goto pattern;
 			ZFETCHSTAT_BUMP(zfetchstat_past);
 			zs->zs_atime = gethrestime_sec();
 			goto out;
@@ -570,17 +809,45 @@ dmu_zfetch_prepare(zfetch_t *zf, uint64_t blkid, uint64_t nblks,
 	}
 
 	/*
-	 * This access is not part of any existing stream.  Create a new
-	 * stream for it unless we are at the end of file.
+	 * This access is not part of any existing stream.  It may still be
+	 * the third of a fixed-stride or reverse pattern too sparse for the
+	 * above, the first two accesses of which created the two most recent
+	 * streams.  Otherwise create a new stream for it, remembering its
+	 * distance from the most recent one.  At the end of file it can only
+	 * be the start of a reverse stream.
 	 */
 	ASSERT0P(zs);
-	if (end_blkid < maxblkid)
-		dmu_zfetch_stream_create(zf, end_blkid);
+	zstream_t *zs_prev = list_head(&zf->zf_stream);
+	if (fetch_data && zs_prev != NULL &&
+	    dmu_zfetch_pattern(zs_prev, blkid, nblks, B_FALSE)) {
+		zs = zs_prev;
+		goto pattern;
+	}
+	if (end_blkid < maxblkid || (fetch_data && zfetch_patterns)) {
+		int32_t delta = 0;
+		if (zs_prev != NULL && dmu_zfetch_fresh(zs_prev))
+			delta = dmu_zfetch_delta(zs_prev->zs_last, blkid, nblks);
+		zs = dmu_zfetch_stream_create(zf, blkid, nblks);
+		if (zs != NULL) {
+			zs->zs_stride = delta;
+			zs = NULL;
+		}
+	}
 	mutex_exit(&zf->zf_lock);
 	ZFETCHSTAT_BUMP(zfetchstat_misses);
 	ipf_start = 0;
 	goto prescient;
 
+pattern:
+	/* If the pattern leaves the file, remove the stream. */
+	if (!dmu_zfetch_pattern_hit(zs, blkid, fetch_data, dbs,
+	    dmu_zfetch_max_distance(zf->zf_dnode->dn_objset), maxblkid)) {
+		dmu_zfetch_stream_remove(zf, zs);
+		goto out;
+	}
+	ipf_start = 0;
+	goto issue;
+
 hit:
 	nblks = dmu_zfetch_hit(zs, nblks);
 	ZFETCHSTAT_BUMP(zfetchstat_hits);
@@ -606,30 +873,12 @@ out:
 	/*
 	 * This access was to a block that we issued a prefetch for on
 	 * behalf of this stream.  Calculate further prefetch distances.
-	 *
-	 * Start prefetch from the demand access size (nblks).  Double the
-	 * distance every access up to zfetch_min_distance.  After that only
-	 * if needed increase the distance by 1/8 up to zfetch_max_distance.
-	 *
-	 * Don't double the distance beyond single block if we have more
-	 * than ~6% of ARC held by active prefetches.  It should help with
-	 * getting out of RAM on some badly mispredicted read patterns.
 	 */
 	unsigned int nbytes = nblks << dbs;
 	unsigned int pf_nblks;
 	if (fetch_data) {
-		if (unlikely(zs->zs_pf_dist < nbytes))
-			zs->zs_pf_dist = nbytes;
-		else if (zs->zs_pf_dist < zfetch_min_distance &&
-		    (zs->zs_pf_dist < (1 << dbs) ||
-		    aggsum_compare(&zfetch_sums.zfetchstat_io_active,
-		    arc_c_max >> (4 + dbs)) < 0))
-			zs->zs_pf_dist *= 2;
-		else if (zs->zs_more)
-			zs->zs_pf_dist += zs->zs_pf_dist / 8;
-		zs->zs_more = B_FALSE;
-		if (zs->zs_pf_dist > zfetch_max_distance)
-			zs->zs_pf_dist = zfetch_max_distance;
+		dmu_zfetch_pf_dist(zs, nbytes, dbs,
+		    dmu_zfetch_max_distance(zf->zf_dnode->dn_objset));
 		pf_nblks = zs->zs_pf_dist >> dbs;
 	} else {
 		pf_nblks = 0;
@@ -647,8 +896,10 @@ out:
 		zs->zs_ipf_dist = nbytes;
 	else
 		zs->zs_ipf_dist *= 2;
-	if (zs->zs_ipf_dist > zfetch_max_idistance)
-		zs->zs_ipf_dist = zfetch_max_idistance;
+	unsigned int max_idist =
+	    dmu_zfetch_max_idistance(zf->zf_dnode->dn_objset);
+	if (zs->zs_ipf_dist > max_idist)
+		zs->zs_ipf_dist = max_idist;
 	pf_nblks = zs->zs_ipf_dist >> dbs;
 	if (zs->zs_ipf_start < zs->zs_pf_end)
 		zs->zs_ipf_start = zs->zs_pf_end;
@@ -656,6 +907,7 @@ out:
 	if (zs->zs_ipf_end < zs->zs_pf_end + pf_nblks)
 		zs->zs_ipf_end = zs->zs_pf_end + pf_nblks;
 
+issue:
 	zfs_refcount_add(&zs->zs_refs, NULL);
 	/* Count concurrent callers. */
 	zfs_refcount_add(&zs->zs_callers, NULL);
@@ -692,8 +944,8 @@ void
 dmu_zfetch_run(zfetch_t *zf, zstream_t *zs, boolean_t missed,
     boolean_t have_lock, boolean_t uncached)
 {
-	int64_t pf_start, pf_end, ipf_start, ipf_end;
-	int epbs, issued;
+	int64_t pf_start, pf_end, ipf_start, ipf_end, stride;
+	int epbs, issued, plen;
 
 	if (missed)
 		zs->zs_missed = missed;
@@ -710,6 +962,12 @@ dmu_zfetch_run(zfetch_t *zf, zstream_t *zs, boolean_t missed,
 		return;
 	}
 
+	/*
+	 * Data blocks to prefetch come in runs of plen blocks, the first
+	 * blocks of which are stride blocks apart, from pf_start up to but
+	 * not including pf_end.  That is just one contiguous run for forward
+	 * streams.
+	 */
 	mutex_enter(&zf->zf_lock);
 	if (zs->zs_missed) {
 		pf_start = zs->zs_pf_start;
@@ -719,15 +977,22 @@ dmu_zfetch_run(zfetch_t *zf, zstream_t *zs, boolean_t missed,
 	}
 	ipf_start = zs->zs_ipf_start;
 	ipf_end = zs->zs_ipf_start = zs->zs_ipf_end;
+	if (zs->zs_plen != 0) {
+		stride = zs->zs_stride;
+		plen = zs->zs_plen;
+	} else {
+		stride = plen = 1;
+	}
 	mutex_exit(&zf->zf_lock);
-	ASSERT3S(pf_start, <=, pf_end);
+	ASSERT0((pf_end - pf_start) % stride);
+	ASSERT3S((pf_end - pf_start) / stride, >=, 0);
 	ASSERT3S(ipf_start, <=, ipf_end);
 
 	epbs = zf->zf_dnode->dn_indblkshift - SPA_BLKPTRSHIFT;
 	ipf_start = P2ROUNDUP(ipf_start, 1 << epbs) >> epbs;
 	ipf_end = P2ROUNDUP(ipf_end, 1 << epbs) >> epbs;
 	ASSERT3S(ipf_start, <=, ipf_end);
-	issued = pf_end - pf_start + ipf_end - ipf_start;
+	issued = (pf_end - pf_start) / stride * plen + ipf_end - ipf_start;
 	if (issued > 1) {
 		/* More references on top of taken in dmu_zfetch_prepare(). */
 		zfs_refcount_add_few(&zs->zs_refs, issued - 1, NULL);
@@ -743,10 +1008,12 @@ dmu_zfetch_run(zfetch_t *zf, zstream_t *zs, boolean_t missed,
 		rw_enter(&zf->zf_dnode->dn_struct_rwlock, RW_READER);
 
 	issued = 0;
-	for (int64_t blk = pf_start; blk < pf_end; blk++) {
-		issued += dbuf_prefetch_impl(zf->zf_dnode, 0, blk,
-		    ZIO_PRIORITY_ASYNC_READ, uncached ?
-		    ARC_FLAG_UNCACHED : 0, dmu_zfetch_done, zs);
+	for (int64_t run = pf_start; run != pf_end; run += stride) {
+		for (int64_t blk = run; blk < run + plen; blk++) {
+			issued += dbuf_prefetch_impl(zf->zf_dnode, 0, blk,
+			    ZIO_PRIORITY_ASYNC_READ, uncached ?
+			    ARC_FLAG_UNCACHED : 0, dmu_zfetch_done, zs);
+		}
 	}
 	for (int64_t iblk = ipf_start; iblk < ipf_end; iblk++) {
 		issued += dbuf_prefetch_impl(zf->zf_dnode, 1, iblk,
@@ -797,3 +1064,6 @@ ZFS_MODULE_PARAM(zfs_prefetch, zfetch_, max_reorder, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_prefetch, zfetch_, hole_shift, UINT, ZMOD_RW,
 	"Max log2 fraction of holes in a stream");
+
+ZFS_MODULE_PARAM(zfs_prefetch, zfetch_, patterns, INT, ZMOD_RW,
+	"Detect and prefetch reverse and fixed-stride streams");
@@ -625,6 +625,7 @@ dsl_dataset_hold_obj(dsl_pool_t *dp, uint64_t dsobj, const void *tag,
 		ds->ds_object = dsobj;
 		ds->ds_is_snapshot = dsl_dataset_phys(ds)->ds_num_children != 0;
 		list_link_init(&ds->ds_synced_link);
+		taskq_init_ent(&ds->ds_sync_tqent);
 
 		err = dsl_dir_hold_obj(dp, dsl_dataset_phys(ds)->ds_dir_obj,
 		    NULL, ds, &ds->ds_dir);
@@ -1517,6 +1518,23 @@ dsl_dataset_snapshot_reserve_space(dsl_dataset_t *ds, dmu_tx_t *tx)
 	return (0);
 }
 
+/*
+ * Read in the metadata dsl_dataset_snapshot_sync_impl() is going to modify,
+ * while the snapshot is checked in open context.  Otherwise each dataset's
+ * snapshot name ZAP and deadlist are read by the sync thread, which for a
+ * recursive snapshot of many datasets makes the txg sync, and with it every
+ * writer in the pool, wait for thousands of serial reads.
+ */
+static void
+dsl_dataset_snapshot_prefetch(dsl_dataset_t *ds, const char *snapname)
+{
+	uint64_t value;
+
+	(void) dsl_dataset_snap_lookup(ds, snapname, &value);
+	if (dsl_deadlist_is_open(&ds->ds_deadlist))
+		dsl_deadlist_preload(&ds->ds_deadlist);
+}
+
 int
 dsl_dataset_snapshot_check_impl(dsl_dataset_t *ds, const char *snapname,
     dmu_tx_t *tx, boolean_t recv, uint64_t cnt, cred_t *cr)
@@ -1526,8 +1544,10 @@ dsl_dataset_snapshot_check_impl(dsl_dataset_t *ds, const char *snapname,
 
 	ds->ds_trysnap_txg = tx->tx_txg;
 
-	if (!dmu_tx_is_syncing(tx))
+	if (!dmu_tx_is_syncing(tx)) {
+		dsl_dataset_snapshot_prefetch(ds, snapname);
 		return (0);
+	}
 
 	/*
 	 * We don't allow multiple snapshots of the same txg.  If there
@@ -2301,6 +2321,13 @@ dsl_dataset_sync_done(dsl_dataset_t *ds, dmu_tx_t *tx)
 
 	multilist_destroy(&os->os_synced_dnodes);
 
+	/*
+	 * As in dsl_pool_sync(), release any of this dataset's dirty space
+	 * that was not released as its dirty records were written.
+	 */
+	dmu_objset_undirty_space(os,
+	    os->os_dirty_pertxg[tx->tx_txg & TXG_MASK], tx->tx_txg);
+
 	if (os->os_encrypted)
 		os->os_next_write_raw[tx->tx_txg & TXG_MASK] = B_FALSE;
 	else
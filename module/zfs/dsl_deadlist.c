@@ -300,6 +300,23 @@ dsl_deadlist_iterate(dsl_deadlist_t *dl, deadlist_iter_t func, void *args)
 	}
 }
 
+/*
+ * Load the entries of the deadlist in open context, ahead of a change to it
+ * in syncing context, so that the sync thread doesn't wait for the reads.
+ */
+void
+dsl_deadlist_preload(dsl_deadlist_t *dl)
+{
+	ASSERT(dsl_deadlist_is_open(dl));
+
+	if (dl->dl_oldfmt)
+		return;
+
+	mutex_enter(&dl->dl_lock);
+	dsl_deadlist_load_tree(dl);
+	mutex_exit(&dl->dl_lock);
+}
+
 int
 dsl_deadlist_open(dsl_deadlist_t *dl, objset_t *os, uint64_t object)
 {
@@ -88,6 +88,12 @@ dsl_destroy_snapshot_check_impl(dsl_dataset_t *ds, boolean_t defer)
 	return (0);
 }
 
+/*
+ * Maximum number of snapshots that dsl_destroy_snapshots_nvl() destroys in
+ * a single txg.  Zero means no limit.
+ */
+static uint_t zfs_destroy_snapshots_per_txg = 256;
+
 int
 dsl_destroy_snapshot_check(void *arg, dmu_tx_t *tx)
 {
@@ -587,40 +593,17 @@ dsl_destroy_snapshot_sync(void *arg, dmu_tx_t *tx)
 }
 
 /*
- * The semantics of this function are described in the comment above
- * lzc_destroy_snaps().  To summarize:
- *
- * The snapshots must all be in the same pool.
- *
- * Snapshots that don't exist will be silently ignored (considered to be
- * "already deleted").
- *
- * On success, all snaps will be destroyed and this will return 0.
- * On failure, no snaps will be destroyed, the errlist will be filled in,
- * and this will return an errno.
+ * Run one channel program that checks that every snapshot in "check" can be
+ * destroyed, and if so destroys the snapshots in "destroy", which must be a
+ * subset of "check".
  */
-int
-dsl_destroy_snapshots_nvl(nvlist_t *snaps, boolean_t defer,
-    nvlist_t *errlist)
+static int
+dsl_destroy_snapshots_batch(nvlist_t *check, nvlist_t *destroy,
+    boolean_t defer, nvlist_t *errlist)
 {
-	if (nvlist_next_nvpair(snaps, NULL) == NULL)
-		return (0);
-
-	/*
-	 * lzc_destroy_snaps() is documented to take an nvlist whose
-	 * values "don't matter".  We need to convert that nvlist to
-	 * one that we know can be converted to LUA.
-	 */
-	nvlist_t *snaps_normalized = fnvlist_alloc();
-	for (nvpair_t *pair = nvlist_next_nvpair(snaps, NULL);
-	    pair != NULL; pair = nvlist_next_nvpair(snaps, pair)) {
-		fnvlist_add_boolean_value(snaps_normalized,
-		    nvpair_name(pair), B_TRUE);
-	}
-
 	nvlist_t *arg = fnvlist_alloc();
-	fnvlist_add_nvlist(arg, "snaps", snaps_normalized);
-	fnvlist_free(snaps_normalized);
+	fnvlist_add_nvlist(arg, "snaps", check);
+	fnvlist_add_nvlist(arg, "destroy", destroy);
 	fnvlist_add_boolean_value(arg, "defer", defer);
 
 	nvlist_t *wrapper = fnvlist_alloc();
@@ -630,6 +613,7 @@ dsl_destroy_snapshots_nvl(nvlist_t *snaps, boolean_t defer,
 	const char *program =
 	    "arg = ...\n"
 	    "snaps = arg['snaps']\n"
+	    "destroy = arg['destroy']\n"
 	    "defer = arg['defer']\n"
 	    "errors = { }\n"
 	    "has_errors = false\n"
@@ -637,7 +621,7 @@ dsl_destroy_snapshots_nvl(nvlist_t *snaps, boolean_t defer,
 	    "    errno = zfs.check.destroy{snap, defer=defer}\n"
 	    "    zfs.debug('snap: ' .. snap .. ' errno: ' .. errno)\n"
 	    "    if errno == ENOENT then\n"
-	    "        snaps[snap] = nil\n"
+	    "        destroy[snap] = nil\n"
 	    "    elseif errno ~= 0 then\n"
 	    "        errors[snap] = errno\n"
 	    "        has_errors = true\n"
@@ -646,14 +630,14 @@ dsl_destroy_snapshots_nvl(nvlist_t *snaps, boolean_t defer,
 	    "if has_errors then\n"
 	    "    return errors\n"
 	    "end\n"
-	    "for snap, v in pairs(snaps) do\n"
+	    "for snap, v in pairs(destroy) do\n"
 	    "    errno = zfs.sync.destroy{snap, defer=defer}\n"
 	    "    assert(errno == 0)\n"
 	    "end\n"
 	    "return { }\n";
 
 	nvlist_t *result = fnvlist_alloc();
-	int error = zcp_eval(nvpair_name(nvlist_next_nvpair(snaps, NULL)),
+	int error = zcp_eval(nvpair_name(nvlist_next_nvpair(check, NULL)),
 	    program,
 	    B_TRUE,
 	    0,
@@ -689,6 +673,68 @@ dsl_destroy_snapshots_nvl(nvlist_t *snaps, boolean_t defer,
 	return (rv);
 }
 
+/*
+ * The semantics of this function are described in the comment above
+ * lzc_destroy_snaps().  To summarize:
+ *
+ * The snapshots must all be in the same pool.
+ *
+ * Snapshots that don't exist will be silently ignored (considered to be
+ * "already deleted").
+ *
+ * On success, all snaps will be destroyed and this will return 0.
+ * On failure, no snaps will be destroyed, the errlist will be filled in,
+ * and this will return an errno.
+ *
+ * Destroying a snapshot merges its deadlists into the next snapshot's,
+ * which can be slow, so at most zfs_destroy_snapshots_per_txg snapshots are
+ * destroyed in each txg.  The first txg checks all of the snapshots, so a
+ * failure there destroys nothing.  A snapshot that becomes undestroyable
+ * while the later batches are running (e.g. a new hold) fails only the
+ * remaining batches.
+ */
+int
+dsl_destroy_snapshots_nvl(nvlist_t *snaps, boolean_t defer,
+    nvlist_t *errlist)
+{
+	if (nvlist_next_nvpair(snaps, NULL) == NULL)
+		return (0);
+
+	/*
+	 * lzc_destroy_snaps() is documented to take an nvlist whose
+	 * values "don't matter".  We need to convert that nvlist to
+	 * one that we know can be converted to LUA.
+	 */
+	nvlist_t *snaps_normalized = fnvlist_alloc();
+	for (nvpair_t *pair = nvlist_next_nvpair(snaps, NULL);
+	    pair != NULL; pair = nvlist_next_nvpair(snaps, pair)) {
+		fnvlist_add_boolean_value(snaps_normalized,
+		    nvpair_name(pair), B_TRUE);
+	}
+
+	nvlist_t *check = snaps_normalized;
+	nvpair_t *pair = nvlist_next_nvpair(snaps_normalized, NULL);
+	int error = 0;
+	while (pair != NULL && error == 0) {
+		nvlist_t *batch = fnvlist_alloc();
+		uint_t n = 0;
+
+		do {
+			fnvlist_add_boolean_value(batch, nvpair_name(pair),
+			    B_TRUE);
+			pair = nvlist_next_nvpair(snaps_normalized, pair);
+		} while (pair != NULL && (zfs_destroy_snapshots_per_txg == 0 ||
+		    ++n < zfs_destroy_snapshots_per_txg));
+
+		error = dsl_destroy_snapshots_batch(
+		    check != NULL ? check : batch, batch, defer, errlist);
+		check = NULL;
+		fnvlist_free(batch);
+	}
+	fnvlist_free(snaps_normalized);
+	return (error);
+}
+
 int
 dsl_destroy_snapshot(const char *name, boolean_t defer)
 {
@@ -1301,3 +1347,6 @@ EXPORT_SYMBOL(dsl_destroy_inconsistent);
 EXPORT_SYMBOL(dsl_dataset_user_release_tmp);
 EXPORT_SYMBOL(dsl_destroy_head_check_impl);
 #endif
+
+ZFS_MODULE_PARAM(zfs, zfs_, destroy_snapshots_per_txg, UINT, ZMOD_RW,
+	"Max number of snapshots destroyed per txg by a batched destroy");
@@ -1397,6 +1397,22 @@ top_of_function:
 
 		dd = dd->dd_parent;
 		asize = parent_rsrv;
+
+		/*
+		 * An ancestor with neither a quota nor a reservation has
+		 * nothing to check, and passes the whole reservation on to
+		 * its own parent, so skip it rather than take its dd_lock.
+		 * Many datasets under a common parent would otherwise all
+		 * serialize on that parent's lock for every transaction.
+		 * Its dd_tempreserved is only used for its own quota check;
+		 * if a quota is set while skipped reservations are still
+		 * outstanding, they are simply not counted against it.
+		 */
+		while (dd->dd_parent != NULL &&
+		    dsl_dir_phys(dd)->dd_quota == 0 &&
+		    dsl_dir_phys(dd)->dd_reserved == 0)
+			dd = dd->dd_parent;
+
 		ignorequota = (dsl_dir_phys(dd)->dd_head_dataset_obj == 0);
 		first = B_FALSE;
 		goto top_of_function;
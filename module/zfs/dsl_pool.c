@@ -117,7 +117,7 @@ uint64_t zfs_wrlog_data_max = 0;
  * zfs_dirty_data_max), push out a txg.  This should be less than
  * zfs_vdev_async_write_active_min_dirty_percent.
  */
-static uint_t zfs_dirty_data_sync_percent = 20;
+uint_t zfs_dirty_data_sync_percent = 20;
 
 /*
  * Once there is this amount of dirty data, the dmu_tx_delay() will kick in
@@ -212,6 +212,15 @@ dsl_pool_open_impl(spa_t *spa, uint64_t txg)
 
 	dp->dp_sync_taskq = spa_sync_tq_create(spa, "dp_sync_taskq");
 
+	/*
+	 * Level-1 subtrees of very large dirty objects are synced here, see
+	 * dbuf_sync_list().  This can't be dp_sync_taskq since the object
+	 * being split is itself being synced by a dp_sync_taskq thread.
+	 */
+	dp->dp_dbuf_sync_taskq = taskq_create("dp_dbuf_sync_taskq", 75,
+	    minclsyspri, boot_ncpus, INT_MAX,
+	    TASKQ_PREPOPULATE | TASKQ_DYNAMIC | TASKQ_THREADS_CPU_PCT);
+
 	dp->dp_zil_clean_taskq = taskq_create("dp_zil_clean_taskq",
 	    zfs_zil_clean_taskq_nthr_pct, minclsyspri,
 	    zfs_zil_clean_taskq_minalloc,
@@ -403,6 +412,7 @@ dsl_pool_close(dsl_pool_t *dp)
 	txg_list_destroy(&dp->dp_dirty_dirs);
 
 	taskq_destroy(dp->dp_zil_clean_taskq);
+	taskq_destroy(dp->dp_dbuf_sync_taskq);
 	spa_sync_tq_destroy(dp->dp_spa);
 
 	if (dp->dp_spa->spa_state == POOL_STATE_EXPORTED ||
@@ -673,6 +683,28 @@ dsl_early_sync_task_verify(dsl_pool_t *dp, uint64_t txg)
 	((void) sizeof (dp), (void) sizeof (txg), B_TRUE)
 #endif
 
+/*
+ * Update the user/group/project space accounting of a dataset synced by
+ * dsl_pool_sync(), once all of its blocks have been written.
+ */
+static void
+dsl_pool_sync_accounting_task(void *arg)
+{
+	dsl_dataset_t *ds = arg;
+	objset_t *os = ds->ds_objset;
+
+	dmu_objset_sync_done(os, os->os_synctx);
+}
+
+static void
+dsl_pool_sync_dataset_done(zio_t *zio)
+{
+	dsl_dataset_t *ds = zio->io_private;
+
+	taskq_dispatch_ent(ds->ds_dir->dd_pool->dp_sync_taskq,
+	    dsl_pool_sync_accounting_task, ds, 0, &ds->ds_sync_tqent);
+}
+
 void
 dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 {
@@ -706,10 +738,10 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	}
 
 	/*
-	 * Write out all dirty blocks of dirty datasets. Note, this could
-	 * create a very large (+10k) zio tree.
+	 * Take the list of dirty datasets up front: once a dataset's user
+	 * accounting below starts, it may dirty the dataset again, and that
+	 * must be left for the second round of syncs.
 	 */
-	rio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
 	while ((ds = txg_list_remove(&dp->dp_dirty_datasets, txg)) != NULL) {
 		/*
 		 * We must not sync any non-MOS datasets twice, because
@@ -718,7 +750,25 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 		 */
 		ASSERT(!list_link_active(&ds->ds_synced_link));
 		list_insert_tail(&synced_datasets, ds);
-		dsl_dataset_sync(ds, rio, tx);
+	}
+
+	/*
+	 * Write out all dirty blocks of dirty datasets. Note, this could
+	 * create a very large (+10k) zio tree.
+	 *
+	 * Each dataset's writes go under their own null zio. When they
+	 * are all done, its user/group/project space accounting is
+	 * dispatched to dp_sync_taskq right away. Otherwise it would wait
+	 * for the writes of every other dataset, and a single slow dataset
+	 * would hold up everyone else's accounting.
+	 */
+	rio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
+	for (ds = list_head(&synced_datasets); ds != NULL;
+	    ds = list_next(&synced_datasets, ds)) {
+		zio_t *dsio = zio_null(rio, dp->dp_spa, NULL,
+		    dsl_pool_sync_dataset_done, ds, ZIO_FLAG_MUSTSUCCEED);
+		dsl_dataset_sync(ds, dsio, tx);
+		zio_nowait(dsio);
 	}
 	VERIFY0(zio_wait(rio));
 
@@ -733,15 +783,11 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	mutex_exit(&dp->dp_lock);
 
 	/*
-	 * After the data blocks have been written (ensured by the zio_wait()
-	 * above), update the user/group/project space accounting.  This happens
-	 * in tasks dispatched to dp_sync_taskq, so wait for them before
-	 * continuing.
+	 * The user/group/project space accounting of each dataset was
+	 * dispatched to dp_sync_taskq as its blocks were written, and
+	 * dispatches further tasks there itself; wait for all of them
+	 * before continuing.
 	 */
-	for (ds = list_head(&synced_datasets); ds != NULL;
-	    ds = list_next(&synced_datasets, ds)) {
-		dmu_objset_sync_done(ds->ds_objset, tx);
-	}
 	taskq_wait(dp->dp_sync_taskq);
 
 	/*
@@ -891,7 +937,8 @@ dsl_pool_sync_context(dsl_pool_t *dp)
 {
 	return (curthread == dp->dp_tx.tx_sync_thread ||
 	    spa_is_initializing(dp->dp_spa) ||
-	    taskq_member(dp->dp_sync_taskq, curthread));
+	    taskq_member(dp->dp_sync_taskq, curthread) ||
+	    taskq_member(dp->dp_dbuf_sync_taskq, curthread));
 }
 
 /*
@@ -1302,6 +1302,85 @@ dsl_prop_get_all(objset_t *os, nvlist_t **nvp)
 	return (dsl_prop_get_all_ds(os->os_dsl_dataset, nvp, 0));
 }
 
+/*
+ * Look up only the named properties of this dataset, in the same format as
+ * dsl_prop_get_all().  As there, properties that are not set anywhere are
+ * left out and read-only properties are not included; those come from
+ * dmu_objset_stats().
+ */
+int
+dsl_prop_get_list(objset_t *os, const char *const *names, uint_t nnames,
+    nvlist_t **nvp)
+{
+	dsl_dataset_t *ds = os->os_dsl_dataset;
+	char setpoint[ZFS_MAX_DATASET_NAME_LEN];
+	char *strval = NULL;
+	int err = 0;
+
+	ASSERT(dsl_pool_config_held(ds->ds_dir->dd_pool));
+	VERIFY0(nvlist_alloc(nvp, NV_UNIQUE_NAME, KM_SLEEP));
+
+	for (uint_t i = 0; i < nnames; i++) {
+		const char *propname = names[i];
+		zfs_prop_t prop = zfs_name_to_prop(propname);
+		boolean_t isstr;
+		uint64_t intval;
+
+		if (prop == ZPROP_USERPROP) {
+			if (!zfs_prop_user(propname))
+				continue;
+			isstr = B_TRUE;
+		} else {
+			if (zfs_prop_readonly(prop) && !zfs_prop_setonce(prop))
+				continue;
+			if (ds->ds_is_snapshot &&
+			    !zfs_prop_valid_for_type(prop, ZFS_TYPE_SNAPSHOT,
+			    B_FALSE))
+				continue;
+			isstr = (zfs_prop_get_type(prop) == PROP_TYPE_STRING);
+		}
+		if (nvlist_exists(*nvp, propname))
+			continue;
+
+		if (isstr) {
+			if (strval == NULL)
+				strval = kmem_alloc(ZAP_MAXVALUELEN, KM_SLEEP);
+			err = dsl_prop_get_ds(ds, propname, 1, ZAP_MAXVALUELEN,
+			    strval, setpoint);
+		} else {
+			err = dsl_prop_get_ds(ds, propname, 8, 1, &intval,
+			    setpoint);
+		}
+		if (err == ENOENT) {
+			err = 0;
+			continue;
+		}
+		if (err != 0)
+			break;
+
+		/* Default values are filled in by the caller. */
+		if (setpoint[0] == '\0')
+			continue;
+
+		nvlist_t *propval = fnvlist_alloc();
+		if (isstr)
+			fnvlist_add_string(propval, ZPROP_VALUE, strval);
+		else
+			fnvlist_add_uint64(propval, ZPROP_VALUE, intval);
+		fnvlist_add_string(propval, ZPROP_SOURCE, setpoint);
+		fnvlist_add_nvlist(*nvp, propname, propval);
+		fnvlist_free(propval);
+	}
+
+	if (strval != NULL)
+		kmem_free(strval, ZAP_MAXVALUELEN);
+	if (err != 0) {
+		nvlist_free(*nvp);
+		*nvp = NULL;
+	}
+	return (err);
+}
+
 int
 dsl_prop_get_received(const char *dsname, nvlist_t **nvp)
 {
@@ -1371,6 +1450,7 @@ EXPORT_SYMBOL(dsl_prop_unregister_all);
 EXPORT_SYMBOL(dsl_prop_get);
 EXPORT_SYMBOL(dsl_prop_get_integer);
 EXPORT_SYMBOL(dsl_prop_get_all);
+EXPORT_SYMBOL(dsl_prop_get_list);
 EXPORT_SYMBOL(dsl_prop_get_received);
 EXPORT_SYMBOL(dsl_prop_get_ds);
 EXPORT_SYMBOL(dsl_prop_get_int_ds);
@@ -122,6 +122,7 @@ typedef int (scan_cb_t)(dsl_pool_t *, const blkptr_t *,
 static scan_cb_t dsl_scan_scrub_cb;
 
 static int scan_ds_queue_compare(const void *a, const void *b);
+static int scan_ds_queue_prio_compare(const void *a, const void *b);
 static int scan_prefetch_queue_compare(const void *a, const void *b);
 static void scan_ds_queue_clear(dsl_scan_t *scn);
 static void scan_ds_prefetch_queue_clear(dsl_scan_t *scn);
@@ -132,6 +133,7 @@ static void scan_ds_queue_remove(dsl_scan_t *scn, uint64_t dsobj);
 static void scan_ds_queue_sync(dsl_scan_t *scn, dmu_tx_t *tx);
 static uint64_t dsl_scan_count_data_disks(spa_t *spa);
 static void read_by_block_level(dsl_scan_t *scn, zbookmark_phys_t zb);
+static void dsl_scan_bptree_pipe_destroy(dsl_scan_t *scn);
 
 extern uint_t zfs_vdev_async_write_active_min_dirty_percent;
 static int zfs_scan_blkstats = 0;
@@ -153,6 +155,15 @@ static uint_t zfs_scan_report_txgs = 0;
  */
 static int zfs_scan_strict_mem_lim = B_FALSE;
 
+/*
+ * When enabled, reaching the hard memory limit no longer forces the scan
+ * to issue its largest extents early. Instead the lowest addressed part of
+ * each sorting queue is written out as a sorted run to a scratch object in
+ * the MOS, and the runs are merged back with the in-memory queues at the
+ * next checkpoint. See scan_io_queue_spill() for details.
+ */
+static int zfs_scan_spill = B_FALSE;
+
 /*
  * Maximum number of parallelly executed bytes per leaf vdev. We attempt
  * to strike a balance here between keeping the vdev queues full of I/Os
@@ -165,6 +176,14 @@ static uint64_t zfs_scan_vdev_limit = 16 << 20;
 
 static uint_t zfs_scan_issue_strategy = 0;
 
+/*
+ * Interval at which the scan issue throttle re-evaluates the issue rate of
+ * each top-level vdev against the pool's latency budget. The throttle
+ * never lowers the rate below scan_throttle_min_rate.
+ */
+static uint_t zfs_scan_throttle_interval_ms = 100;
+static const uint64_t scan_throttle_min_rate = 1 << 20;	/* bytes/sec */
+
 /* don't queue & sort zios, go direct */
 static int zfs_scan_legacy = B_FALSE;
 static uint64_t zfs_scan_max_ext_gap = 2 << 20; /* in bytes */
@@ -204,15 +223,31 @@ static uint_t zfs_scan_checkpoint_intval = 7200; /* in seconds */
 int zfs_scan_suspend_progress = 0; /* set to prevent scans from progressing */
 static int zfs_no_scrub_io = B_FALSE; /* set to disable scrub i/o */
 static int zfs_no_scrub_prefetch = B_FALSE; /* set to disable scrub prefetch */
+
+/*
+ * When set, new scrubs make two passes over the pool: the first issues
+ * only metadata (indirect blocks and metadata object types) and the
+ * second issues the remaining data blocks. Damage to pool metadata is
+ * then found long before the scrub has read every data block.
+ */
+static int zfs_scrub_metadata_first = B_FALSE;
 static const ddt_class_t zfs_scrub_ddt_class_max = DDT_CLASS_DUPLICATE;
 /* max number of blocks to free in a single TXG */
 static uint64_t zfs_async_block_max_blocks = UINT64_MAX;
 /* max number of dedup blocks to free in a single TXG */
 static uint64_t zfs_max_async_dedup_frees = 100000;
+/*
+ * Number of block pointers the async destroy traversal may queue ahead of
+ * syncing context; 0 traverses the bptree from syncing context instead.
+ */
+static uint64_t zfs_async_destroy_queue_blocks = 65536;
 
 /* set to disable resilver deferring */
 static int zfs_resilver_disable_defer = B_FALSE;
 
+/* set to repair high scan_priority datasets before scanning the rest */
+static int zfs_resilver_priority_checkpoint = B_TRUE;
+
 /* Don't defer a resilver if the one in progress only got this far: */
 static uint_t zfs_resilver_defer_percent = 10;
 
@@ -257,7 +292,9 @@ static scan_cb_t *scan_funcs[POOL_SCAN_FUNCS] = {
 typedef struct {
 	uint64_t	sds_dsobj;
 	uint64_t	sds_txg;
+	uint64_t	sds_priority;	/* scan_priority when queued */
 	avl_node_t	sds_node;
+	avl_node_t	sds_prio_node;
 } scan_ds_t;
 
 /*
@@ -319,6 +356,48 @@ typedef struct scan_io {
 #define	SIO_GET_MUSED(sio)		\
 	(sizeof (scan_io_t) + ((sio)->sio_nr_dvas * sizeof (dva_t)))
 
+/*
+ * On-disk form of a scan_io_t in a spilled run. Runs are scratch data
+ * that is discarded on import, so the records are kept in native byte
+ * order and always have room for SPA_DVAS_PER_BP DVAs.
+ */
+typedef struct scan_spill_rec {
+	uint64_t		ssr_blk_prop;
+	uint64_t		ssr_phys_birth;
+	uint64_t		ssr_birth;
+	zio_cksum_t		ssr_cksum;
+	uint32_t		ssr_nr_dvas;
+	uint32_t		ssr_flags;
+	zbookmark_phys_t	ssr_zb;
+	dva_t			ssr_dva[SPA_DVAS_PER_BP];
+} scan_spill_rec_t;
+
+/* records written per dmu_write() and buffered per run while merging */
+#define	SCAN_SPILL_WRITE_RECS	1024
+#define	SCAN_SPILL_READ_RECS	128
+
+/* in-core cursor over one sorted run in scn_spill_obj */
+typedef struct scan_spill_run {
+	avl_node_t		srn_avl_node; /* link into q_spill_runs */
+	list_node_t		srn_list_node; /* link into q_spill_refill */
+	uint64_t		srn_id;	/* spill generation of this run */
+	uint64_t		srn_off; /* next byte to read from the object */
+	uint64_t		srn_left; /* records not yet read */
+	scan_spill_rec_t	*srn_buf; /* records read but not merged */
+	uint_t			srn_cnt; /* number of records in srn_buf */
+	uint_t			srn_idx; /* next record in srn_buf */
+} scan_spill_run_t;
+
+#define	SRN_HEAD_OFFSET(srn)	\
+	DVA_GET_OFFSET(&(srn)->srn_buf[(srn)->srn_idx].ssr_dva[0])
+
+/* a spilled block that was freed after being written to a run */
+typedef struct scan_spill_free {
+	avl_node_t		ssf_avl_node; /* link into q_spill_freed */
+	uint64_t		ssf_offset; /* offset of the freed DVA */
+	uint64_t		ssf_gen; /* runs older than this are stale */
+} scan_spill_free_t;
+
 struct dsl_scan_io_queue {
 	dsl_scan_t	*q_scn; /* associated dsl_scan_t */
 	vdev_t		*q_vd; /* top-level vdev that this queue represents */
@@ -331,11 +410,24 @@ struct dsl_scan_io_queue {
 	uint64_t	q_sio_memused;
 	uint64_t	q_last_ext_addr;
 
+	/* sorted runs spilled to the pool, see scan_io_queue_spill() */
+	avl_tree_t	q_spill_runs; /* buffered runs sorted by next offset */
+	list_t		q_spill_refill; /* runs whose buffer must be read */
+	avl_tree_t	q_spill_freed; /* spilled blocks freed since */
+	uint64_t	q_spill_nruns; /* runs not yet fully merged */
+	uint64_t	q_spill_gen; /* id of the next run */
+
 	/* members for zio rate limiting */
 	uint64_t	q_maxinflight_bytes;
 	uint64_t	q_inflight_bytes;
 	kcondvar_t	q_zio_cv; /* used under vd->vdev_scan_io_queue_lock */
 
+	/* members for the issue throttle, only used by the issuing thread */
+	hrtime_t	q_throttle_start; /* start of the current interval */
+	uint64_t	q_throttle_bytes; /* bytes issued in the interval */
+	uint64_t	q_throttle_rate; /* current issue rate, bytes/sec */
+	boolean_t	q_throttle_limited; /* issue was delayed in interval */
+
 	/* per txg statistics */
 	uint64_t	q_total_seg_size_this_txg;
 	uint64_t	q_segs_this_txg;
@@ -352,6 +444,9 @@ typedef struct scan_prefetch_ctx {
 	uint16_t spc_datablkszsec;	/* dn_idatablkszsec of current dnode */
 } scan_prefetch_ctx_t;
 
+/* max prefetches dsl_scan_prefetch_thread() hands to arc in one batch */
+#define	SCAN_PREFETCH_BATCH	16
+
 /* private data for dsl_scan_prefetch() */
 typedef struct scan_prefetch_issue_ctx {
 	avl_node_t spic_avl_node;	/* link into scn->scn_prefetch_queue */
@@ -367,6 +462,9 @@ static void scan_io_queue_insert_impl(dsl_scan_io_queue_t *queue,
 
 static dsl_scan_io_queue_t *scan_io_queue_create(vdev_t *vd);
 static void scan_io_queues_destroy(dsl_scan_t *scn);
+static void count_block_skipped(dsl_scan_t *scn, const blkptr_t *bp,
+    boolean_t all);
+static void scan_spill_obj_free(dsl_scan_t *scn, dmu_tx_t *tx);
 
 static kmem_cache_t *sio_cache[SPA_DVAS_PER_BP];
 
@@ -501,6 +599,8 @@ dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 
 	avl_create(&scn->scn_queue, scan_ds_queue_compare, sizeof (scan_ds_t),
 	    offsetof(scan_ds_t, sds_node));
+	avl_create(&scn->scn_queue_prio, scan_ds_queue_prio_compare,
+	    sizeof (scan_ds_t), offsetof(scan_ds_t, sds_prio_node));
 	mutex_init(&scn->scn_queue_lock, NULL, MUTEX_DEFAULT, NULL);
 	avl_create(&scn->scn_prefetch_queue, scan_prefetch_queue_compare,
 	    sizeof (scan_prefetch_issue_ctx_t),
@@ -534,6 +634,32 @@ dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 		if (err != 0 && err != ENOENT)
 			return (err);
 
+		err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_SCAN_METADATA, sizeof (uint64_t),
+		    SCAN_META_PHYS_NUMINTS, &scn->scn_meta_phys);
+
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_SCAN_THROTTLE, sizeof (uint64_t),
+		    SCAN_THROTTLE_PHYS_NUMINTS, &scn->scn_throttle);
+
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		/*
+		 * Runs spilled before the pool was exported are stale, as
+		 * the bookmark only advances once every run has been issued.
+		 * Remember the object so that dsl_scan_sync() can free it.
+		 */
+		err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_SCAN_SPILL, sizeof (uint64_t), 1,
+		    &scn->scn_spill_obj);
+
+		if (err != 0 && err != ENOENT)
+			return (err);
+
 		err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
 		    DMU_POOL_SCAN, sizeof (uint64_t), SCAN_PHYS_NUMINTS,
 		    &scn->scn_phys);
@@ -658,8 +784,10 @@ dsl_scan_fini(dsl_pool_t *dp)
 		if (scn->scn_taskq != NULL)
 			taskq_destroy(scn->scn_taskq);
 
+		dsl_scan_bptree_pipe_destroy(scn);
 		scan_ds_queue_clear(scn);
 		avl_destroy(&scn->scn_queue);
+		avl_destroy(&scn->scn_queue_prio);
 		mutex_destroy(&scn->scn_queue_lock);
 		scan_ds_prefetch_queue_clear(scn);
 		avl_destroy(&scn->scn_prefetch_queue);
@@ -782,7 +910,8 @@ dsl_errorscrub_setup_check(void *arg, dmu_tx_t *tx)
  * Because we can be running in the block sorting algorithm, we do not always
  * want to write out the record, only when it is "safe" to do so. This safety
  * condition is achieved by making sure that the sorting queues are empty
- * (scn_queues_pending == 0). When this condition is not true, the sync'd state
+ * (scn_queues_pending == 0) and that no spilled runs remain to be issued
+ * (scn_spill_runs == 0). When this condition is not true, the sync'd state
  * is inconsistent with how much actual scanning progress has been made. The
  * kind of sync to be performed is specified by the sync_type argument. If the
  * sync is optional, we only sync if the queues are empty. If the sync is
@@ -805,8 +934,9 @@ dsl_scan_sync_state(dsl_scan_t *scn, dmu_tx_t *tx, state_sync_type_t sync_type)
 	int i;
 	spa_t *spa = scn->scn_dp->dp_spa;
 
-	ASSERT(sync_type != SYNC_MANDATORY || scn->scn_queues_pending == 0);
-	if (scn->scn_queues_pending == 0) {
+	ASSERT(sync_type != SYNC_MANDATORY || (scn->scn_queues_pending == 0 &&
+	    scn->scn_spill_runs == 0));
+	if (scn->scn_queues_pending == 0 && scn->scn_spill_runs == 0) {
 		for (i = 0; i < spa->spa_root_vdev->vdev_children; i++) {
 			vdev_t *vd = spa->spa_root_vdev->vdev_child[i];
 			dsl_scan_io_queue_t *q = vd->vdev_scan_io_queue;
@@ -816,6 +946,7 @@ dsl_scan_sync_state(dsl_scan_t *scn, dmu_tx_t *tx, state_sync_type_t sync_type)
 
 			mutex_enter(&vd->vdev_scan_io_queue_lock);
 			ASSERT3P(avl_first(&q->q_sios_by_addr), ==, NULL);
+			ASSERT0(q->q_spill_nruns);
 			ASSERT3P(zfs_btree_first(&q->q_exts_by_size, NULL), ==,
 			    NULL);
 			ASSERT3P(zfs_range_tree_first(q->q_exts_by_addr), ==,
@@ -881,6 +1012,10 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 	memset(&scn->errorscrub_phys, 0, sizeof (scn->errorscrub_phys));
 	dsl_errorscrub_sync_state(scn, tx);
 
+	memset(&scn->scn_meta_phys, 0, sizeof (scn->scn_meta_phys));
+	(void) zap_remove(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_SCAN_METADATA, tx);
+
 	scn->scn_phys.scn_func = setup_sync_arg->func;
 	scn->scn_phys.scn_state = DSS_SCANNING;
 	scn->scn_phys.scn_min_txg = setup_sync_arg->txgstart;
@@ -898,6 +1033,7 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 	scn->scn_done_txg = 0;
 	scn->scn_last_checkpoint = 0;
 	scn->scn_checkpointing = B_FALSE;
+	scn->scn_last_priority = ZFS_SCAN_PRIORITY_LOW;
 	spa_scan_stat_init(spa);
 	vdev_scan_stat_init(spa->spa_root_vdev);
 
@@ -928,6 +1064,11 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 		if (scn->scn_phys.scn_min_txg > TXG_INITIAL)
 			scn->scn_phys.scn_ddt_class_max = DDT_CLASS_DITTO;
 
+		if (DSL_SCAN_IS_SCRUB(scn) && zfs_scrub_metadata_first) {
+			scn->scn_phys.scn_flags |=
+			    DSF_METADATA_FIRST | DSF_METADATA_PASS;
+		}
+
 		/*
 		 * When starting a resilver clear any existing rebuild state.
 		 * This is required to prevent stale rebuild status from
@@ -1081,6 +1222,42 @@ dsl_errorscrub_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 	ASSERT(!dsl_errorscrubbing(scn->scn_dp));
 }
 
+/*
+ * Called once the metadata pass of a metadata-first scrub has issued all
+ * of its I/O. Record its results and rewind the traversal so that the
+ * same scrub now visits the pool again for the data blocks.
+ */
+static void
+dsl_scan_metadata_pass_done(dsl_scan_t *scn, dmu_tx_t *tx)
+{
+	dsl_pool_t *dp = scn->scn_dp;
+	spa_t *spa = dp->dp_spa;
+
+	ASSERT(scn->scn_phys.scn_flags & DSF_METADATA_FIRST);
+
+	scn->scn_meta_phys.smp_end_time = gethrestime_sec();
+	scn->scn_meta_phys.smp_examined = scn->scn_phys.scn_examined;
+	scn->scn_meta_phys.smp_errors = scn->scn_phys.scn_errors;
+	VERIFY0(zap_update(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_SCAN_METADATA, sizeof (uint64_t),
+	    SCAN_META_PHYS_NUMINTS, &scn->scn_meta_phys, tx));
+
+	scn->scn_phys.scn_flags &= ~DSF_METADATA_PASS;
+	memset(&scn->scn_phys.scn_bookmark, 0, sizeof (zbookmark_phys_t));
+	memset(&scn->scn_phys.scn_ddt_bookmark, 0, sizeof (ddt_bookmark_t));
+	scn->scn_done_txg = 0;
+	scn->scn_checkpointing = B_FALSE;
+	scn->scn_clearing = B_FALSE;
+	ASSERT0(avl_numnodes(&scn->scn_queue));
+
+	ddt_walk_init(spa, scn->scn_phys.scn_max_txg);
+
+	spa_history_log_internal(spa, "scan metadata pass done", tx,
+	    "errors=%llu", (u_longlong_t)scn->scn_phys.scn_errors);
+	zfs_dbgmsg("scan metadata pass complete for %s txg %llu, "
+	    "starting data pass", spa->spa_name, (longlong_t)tx->tx_txg);
+}
+
 static void
 dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 {
@@ -1127,6 +1304,7 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 
 	if (scn->scn_is_sorted) {
 		scan_io_queues_destroy(scn);
+		scan_spill_obj_free(scn, tx);
 		scn->scn_is_sorted = B_FALSE;
 
 		if (scn->scn_taskq != NULL) {
@@ -1144,7 +1322,15 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 	} else {
 		spa_history_log_internal(spa, "scan done", tx,
 		    "errors=%llu", (u_longlong_t)spa_approx_errlog_size(spa));
-		if (DSL_SCAN_IS_SCRUB(scn)) {
+		/*
+		 * Only move last_scrubbed_txg forward if this scrub has
+		 * verified every block born since the previous one, so that
+		 * a scrub limited to a later start date can't make
+		 * "zpool scrub -C" skip the blocks in between.
+		 */
+		if (DSL_SCAN_IS_SCRUB(scn) &&
+		    scn->scn_phys.scn_min_txg <= spa->spa_scrubbed_last_txg &&
+		    scn->scn_phys.scn_max_txg > spa->spa_scrubbed_last_txg) {
 			VERIFY0(zap_update(dp->dp_meta_objset,
 			    DMU_POOL_DIRECTORY_OBJECT,
 			    DMU_POOL_LAST_SCRUBBED_TXG,
@@ -1359,6 +1545,49 @@ dsl_scan_cancel(dsl_pool_t *dp)
 	    dsl_scan_cancel_sync, NULL, 3, ZFS_SPACE_CHECK_RESERVED));
 }
 
+typedef struct scan_throttle_arg {
+	uint64_t	sta_rate;
+	uint64_t	sta_latency;
+} scan_throttle_arg_t;
+
+static void
+dsl_scan_set_throttle_sync(void *arg, dmu_tx_t *tx)
+{
+	scan_throttle_arg_t *sta = arg;
+	dsl_pool_t *dp = dmu_tx_pool(tx);
+	dsl_scan_t *scn = dp->dp_scan;
+
+	if (sta->sta_rate != UINT64_MAX)
+		scn->scn_throttle.stp_rate = sta->sta_rate;
+	if (sta->sta_latency != UINT64_MAX)
+		scn->scn_throttle.stp_latency = sta->sta_latency;
+
+	VERIFY0(zap_update(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_SCAN_THROTTLE, sizeof (uint64_t),
+	    SCAN_THROTTLE_PHYS_NUMINTS, &scn->scn_throttle, tx));
+
+	spa_history_log_internal(dp->dp_spa, "scan throttle", tx,
+	    "rate=%llu latency=%llu",
+	    (u_longlong_t)scn->scn_throttle.stp_rate,
+	    (u_longlong_t)scn->scn_throttle.stp_latency);
+}
+
+/*
+ * Set the per-pool scan issue limits. UINT64_MAX leaves a limit unchanged
+ * and zero removes it.
+ */
+int
+dsl_scan_set_throttle(dsl_pool_t *dp, uint64_t rate, uint64_t latency)
+{
+	scan_throttle_arg_t sta = {
+		.sta_rate = rate,
+		.sta_latency = latency,
+	};
+
+	return (dsl_sync_task(spa_name(dp->dp_spa), NULL,
+	    dsl_scan_set_throttle_sync, &sta, 1, ZFS_SPACE_CHECK_RESERVED));
+}
+
 static int
 dsl_scrub_pause_resume_check(void *arg, dmu_tx_t *tx)
 {
@@ -1477,11 +1706,31 @@ scan_ds_queue_compare(const void *a, const void *b)
 	return (1);
 }
 
+/*
+ * Datasets are visited in order of decreasing scan_priority, and in order of
+ * object number within a priority.  Any order is correct, as a dataset is
+ * only queued once the blocks it shares with its origin or previous snapshot
+ * have been visited.
+ */
+static int
+scan_ds_queue_prio_compare(const void *a, const void *b)
+{
+	const scan_ds_t *sds_a = a, *sds_b = b;
+
+	int cmp = TREE_CMP(sds_b->sds_priority, sds_a->sds_priority);
+	if (cmp != 0)
+		return (cmp);
+	return (TREE_CMP(sds_a->sds_dsobj, sds_b->sds_dsobj));
+}
+
 static void
 scan_ds_queue_clear(dsl_scan_t *scn)
 {
 	void *cookie = NULL;
 	scan_ds_t *sds;
+	while (avl_destroy_nodes(&scn->scn_queue_prio, &cookie) != NULL)
+		;
+	cookie = NULL;
 	while ((sds = avl_destroy_nodes(&scn->scn_queue, &cookie)) != NULL) {
 		kmem_free(sds, sizeof (*sds));
 	}
@@ -1499,6 +1748,20 @@ scan_ds_queue_contains(dsl_scan_t *scn, uint64_t dsobj, uint64_t *txg)
 	return (sds != NULL);
 }
 
+static uint64_t
+scan_ds_priority(dsl_pool_t *dp, uint64_t dsobj)
+{
+	dsl_dataset_t *ds;
+	uint64_t priority = ZFS_SCAN_PRIORITY_NORMAL;
+
+	if (dsl_dataset_hold_obj(dp, dsobj, FTAG, &ds) == 0) {
+		(void) dsl_prop_get_int_ds(ds,
+		    zfs_prop_to_name(ZFS_PROP_SCAN_PRIORITY), &priority);
+		dsl_dataset_rele(ds, FTAG);
+	}
+	return (priority);
+}
+
 static void
 scan_ds_queue_insert(dsl_scan_t *scn, uint64_t dsobj, uint64_t txg)
 {
@@ -1508,9 +1771,11 @@ scan_ds_queue_insert(dsl_scan_t *scn, uint64_t dsobj, uint64_t txg)
 	sds = kmem_zalloc(sizeof (*sds), KM_SLEEP);
 	sds->sds_dsobj = dsobj;
 	sds->sds_txg = txg;
+	sds->sds_priority = scan_ds_priority(scn->scn_dp, dsobj);
 
 	VERIFY3P(avl_find(&scn->scn_queue, sds, &where), ==, NULL);
 	avl_insert(&scn->scn_queue, sds, where);
+	avl_add(&scn->scn_queue_prio, sds);
 }
 
 static void
@@ -1523,6 +1788,7 @@ scan_ds_queue_remove(dsl_scan_t *scn, uint64_t dsobj)
 	sds = avl_find(&scn->scn_queue, &srch, NULL);
 	VERIFY(sds != NULL);
 	avl_remove(&scn->scn_queue, sds);
+	avl_remove(&scn->scn_queue_prio, sds);
 	kmem_free(sds, sizeof (*sds));
 }
 
@@ -1580,9 +1846,14 @@ scan_ds_queue_sync(dsl_scan_t *scn, dmu_tx_t *tx)
  *	metadata scan and I/O issue (even at 2k recordsize, 128 MiB's
  *	worth of queues is about 1.2 GiB of on-pool data, so scanning
  *	that should take at least a decent fraction of a second).
+ *
+ * With zfs_scan_spill set, hitting the hard limit instead writes the
+ * queues out to the pool until they are back below the soft limit and
+ * metadata scanning continues; see scan_io_queue_spill().
  */
-static boolean_t
-dsl_scan_should_clear(dsl_scan_t *scn)
+static uint64_t
+dsl_scan_mem_used(dsl_scan_t *scn, uint64_t *mlim_hardp,
+    uint64_t *mlim_softp)
 {
 	spa_t *spa = scn->scn_dp->dp_spa;
 	vdev_t *rvd = scn->scn_dp->dp_spa->spa_root_vdev;
@@ -1616,6 +1887,18 @@ dsl_scan_should_clear(dsl_scan_t *scn)
 		mutex_exit(&tvd->vdev_scan_io_queue_lock);
 	}
 
+	*mlim_hardp = mlim_hard;
+	*mlim_softp = mlim_soft;
+	return (mused);
+}
+
+static boolean_t
+dsl_scan_should_clear(dsl_scan_t *scn)
+{
+	uint64_t mlim_hard, mlim_soft, mused;
+
+	mused = dsl_scan_mem_used(scn, &mlim_hard, &mlim_soft);
+
 	dprintf("current scan memory usage: %llu bytes\n", (longlong_t)mused);
 
 	if (mused == 0)
@@ -2090,12 +2373,13 @@ dsl_scan_prefetch_thread(void *arg)
 	dsl_scan_t *scn = arg;
 	spa_t *spa = scn->scn_dp->dp_spa;
 	scan_prefetch_issue_ctx_t *spic;
+	scan_prefetch_issue_ctx_t *spics[SCAN_PREFETCH_BATCH];
+	arc_read_req_t *reqs = kmem_alloc(sizeof (arc_read_req_t) *
+	    SCAN_PREFETCH_BATCH, KM_SLEEP);
 
 	/* loop until we are told to stop */
 	while (!scn->scn_prefetch_stop) {
-		arc_flags_t flags = ARC_FLAG_NOWAIT |
-		    ARC_FLAG_PRESCIENT_PREFETCH | ARC_FLAG_PREFETCH;
-		int zio_flags = ZIO_FLAG_CANFAIL | ZIO_FLAG_SCAN_THREAD;
+		uint_t n = 0;
 
 		mutex_enter(&spa->spa_scrub_lock);
 
@@ -2115,34 +2399,60 @@ dsl_scan_prefetch_thread(void *arg)
 			break;
 		}
 
-		/* remove the prefetch IO from the tree */
-		spic = avl_first(&scn->scn_prefetch_queue);
-		spa->spa_scrub_inflight += BP_GET_PSIZE(&spic->spic_bp);
-		avl_remove(&scn->scn_prefetch_queue, spic);
+		/*
+		 * Remove as many prefetch IOs from the tree as fit in the
+		 * in flight limit, up to a batch.
+		 */
+		do {
+			spic = avl_first(&scn->scn_prefetch_queue);
+			spa->spa_scrub_inflight += BP_GET_PSIZE(&spic->spic_bp);
+			avl_remove(&scn->scn_prefetch_queue, spic);
+			spics[n++] = spic;
+		} while (n < SCAN_PREFETCH_BATCH &&
+		    avl_numnodes(&scn->scn_prefetch_queue) != 0 &&
+		    spa->spa_scrub_inflight < scn->scn_maxinflight_bytes);
 
 		mutex_exit(&spa->spa_scrub_lock);
 
-		if (BP_IS_PROTECTED(&spic->spic_bp)) {
-			ASSERT(BP_GET_TYPE(&spic->spic_bp) == DMU_OT_DNODE ||
-			    BP_GET_TYPE(&spic->spic_bp) == DMU_OT_OBJSET);
-			ASSERT3U(BP_GET_LEVEL(&spic->spic_bp), ==, 0);
-			zio_flags |= ZIO_FLAG_RAW;
-		}
+		for (uint_t i = 0; i < n; i++) {
+			arc_read_req_t *arr = &reqs[i];
+			blkptr_t *bp = &spics[i]->spic_bp;
+
+			arr->arr_bp = bp;
+			arr->arr_zb = &spics[i]->spic_zb;
+			arr->arr_done = dsl_scan_prefetch_cb;
+			arr->arr_private = spics[i]->spic_spc;
+			arr->arr_flags = ARC_FLAG_NOWAIT |
+			    ARC_FLAG_PRESCIENT_PREFETCH | ARC_FLAG_PREFETCH;
+			arr->arr_zio_flags = ZIO_FLAG_CANFAIL |
+			    ZIO_FLAG_SCAN_THREAD;
+
+			if (BP_IS_PROTECTED(bp)) {
+				ASSERT(BP_GET_TYPE(bp) == DMU_OT_DNODE ||
+				    BP_GET_TYPE(bp) == DMU_OT_OBJSET);
+				ASSERT3U(BP_GET_LEVEL(bp), ==, 0);
+				arr->arr_zio_flags |= ZIO_FLAG_RAW;
+			}
 
-		/* We don't need data L1 buffer since we do not prefetch L0. */
-		blkptr_t *bp = &spic->spic_bp;
-		if (BP_GET_LEVEL(bp) == 1 && BP_GET_TYPE(bp) != DMU_OT_DNODE &&
-		    BP_GET_TYPE(bp) != DMU_OT_OBJSET)
-			flags |= ARC_FLAG_NO_BUF;
+			/*
+			 * We don't need data L1 buffer since we do not
+			 * prefetch L0.
+			 */
+			if (BP_GET_LEVEL(bp) == 1 &&
+			    BP_GET_TYPE(bp) != DMU_OT_DNODE &&
+			    BP_GET_TYPE(bp) != DMU_OT_OBJSET)
+				arr->arr_flags |= ARC_FLAG_NO_BUF;
+		}
 
-		/* issue the prefetch asynchronously */
-		(void) arc_read(scn->scn_zio_root, spa, bp,
-		    dsl_scan_prefetch_cb, spic->spic_spc, ZIO_PRIORITY_SCRUB,
-		    zio_flags, &flags, &spic->spic_zb);
+		/* issue the prefetches asynchronously */
+		(void) arc_read_batch(scn->scn_zio_root, spa, reqs, n,
+		    ZIO_PRIORITY_SCRUB, B_FALSE);
 
-		kmem_free(spic, sizeof (scan_prefetch_issue_ctx_t));
+		for (uint_t i = 0; i < n; i++)
+			kmem_free(spics[i], sizeof (scan_prefetch_issue_ctx_t));
 	}
 
+	kmem_free(reqs, sizeof (arc_read_req_t) * SCAN_PREFETCH_BATCH);
 	ASSERT(scn->scn_prefetch_stop);
 
 	/* free any prefetches we didn't get to complete */
@@ -3163,14 +3473,38 @@ dsl_scan_visit(dsl_scan_t *scn, dmu_tx_t *tx)
 	memset(&scn->scn_phys.scn_bookmark, 0, sizeof (zbookmark_phys_t));
 
 	/*
-	 * Keep pulling things out of the dataset avl queue. Updates to the
-	 * persistent zap-object-as-queue happen only at checkpoints.
+	 * Keep pulling things out of the dataset avl queue, highest
+	 * scan_priority first. Updates to the persistent zap-object-as-queue
+	 * happen only at checkpoints.
 	 */
-	while ((sds = avl_first(&scn->scn_queue)) != NULL) {
+	while ((sds = avl_first(&scn->scn_queue_prio)) != NULL) {
 		dsl_dataset_t *ds;
 		uint64_t dsobj = sds->sds_dsobj;
 		uint64_t txg = sds->sds_txg;
 
+		/*
+		 * Once a sorted resilver has visited every high priority
+		 * dataset, checkpoint before moving on to the others, so
+		 * that the blocks of the high priority datasets are
+		 * repaired without waiting for the rest of the pool to be
+		 * scanned. Suspending with a destroyed objset bookmark
+		 * resumes from this queue.
+		 */
+		if (zfs_resilver_priority_checkpoint && scn->scn_is_sorted &&
+		    scn->scn_phys.scn_func == POOL_SCAN_RESILVER &&
+		    scn->scn_last_priority == ZFS_SCAN_PRIORITY_HIGH &&
+		    sds->sds_priority < ZFS_SCAN_PRIORITY_HIGH) {
+			zfs_dbgmsg("visited high priority datasets of %s; "
+			    "checkpointing", dp->dp_spa->spa_name);
+			scn->scn_last_priority = sds->sds_priority;
+			scn->scn_phys.scn_bookmark.zb_objset =
+			    ZB_DESTROYED_OBJSET;
+			scn->scn_checkpointing = B_TRUE;
+			scn->scn_suspending = B_TRUE;
+			return;
+		}
+		scn->scn_last_priority = sds->sds_priority;
+
 		/* dequeue and free the ds from the queue */
 		scan_ds_queue_remove(scn, dsobj);
 		sds = NULL;
@@ -3255,6 +3589,87 @@ scan_io_queue_check_suspend(dsl_scan_t *scn)
 	    spa_shutting_down(scn->scn_dp->dp_spa));
 }
 
+/*
+ * Pace the issuing of size bytes to the queue's top-level vdev according to
+ * the pool's scan throttle. The rate is capped at the bandwidth limit, and
+ * once per zfs_scan_throttle_interval_ms it is adjusted against the latency
+ * budget: cut by a quarter when scan I/O added more foreground latency than
+ * allowed, and grown by an eighth when the throttle held the scan back.
+ * Returns B_TRUE if the scan needs to suspend before these bytes may be
+ * issued.
+ */
+static boolean_t
+scan_io_queue_throttle(dsl_scan_io_queue_t *queue, uint64_t size)
+{
+	dsl_scan_t *scn = queue->q_scn;
+	uint64_t max_rate = scn->scn_throttle.stp_rate;
+	uint64_t latency = scn->scn_throttle.stp_latency;
+	hrtime_t now = gethrtime();
+	hrtime_t elapsed = now - queue->q_throttle_start;
+	hrtime_t wakeup;
+	uint64_t rate = queue->q_throttle_rate;
+
+	if (max_rate == 0 && latency == 0) {
+		queue->q_throttle_rate = 0;
+		return (B_FALSE);
+	}
+
+	if (elapsed >= MSEC2NSEC(zfs_scan_throttle_interval_ms)) {
+		if (rate == 0 || latency == 0) {
+			rate = max_rate != 0 ? max_rate :
+			    16 * scan_throttle_min_rate;
+		} else if (vdev_queue_scan_latency(queue->q_vd) >
+		    USEC2NSEC(latency)) {
+			rate -= rate / 4;
+		} else if (queue->q_throttle_limited) {
+			rate += rate / 8;
+		}
+		if (max_rate != 0)
+			rate = MIN(rate, max_rate);
+		queue->q_throttle_rate = MAX(rate, scan_throttle_min_rate);
+		queue->q_throttle_start = now;
+		queue->q_throttle_bytes = 0;
+		queue->q_throttle_limited = B_FALSE;
+	}
+
+	queue->q_throttle_bytes += size;
+	wakeup = queue->q_throttle_start +
+	    queue->q_throttle_bytes * NANOSEC / queue->q_throttle_rate;
+
+	while (now < wakeup) {
+		queue->q_throttle_limited = B_TRUE;
+		if (scan_io_queue_check_suspend(scn)) {
+			queue->q_throttle_bytes -= size;
+			return (B_TRUE);
+		}
+		zfs_sleep_until(MIN(wakeup, now + MSEC2NSEC(10)));
+		now = gethrtime();
+	}
+
+	return (B_FALSE);
+}
+
+/*
+ * Removes a cold sio from the queue along with its share of the fill of
+ * the containing extent. The caller takes ownership of the sio.
+ */
+static void
+scan_io_queue_remove(dsl_scan_io_queue_t *queue, scan_io_t *sio)
+{
+	uint64_t start = SIO_GET_OFFSET(sio);
+	uint64_t size = SIO_GET_ASIZE(sio);
+
+	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
+
+	avl_remove(&queue->q_sios_by_addr, sio);
+	if (avl_is_empty(&queue->q_sios_by_addr))
+		atomic_add_64(&queue->q_scn->scn_queues_pending, -1);
+	queue->q_sio_memused -= SIO_GET_MUSED(sio);
+
+	ASSERT(zfs_range_tree_contains(queue->q_exts_by_addr, start, size));
+	zfs_range_tree_remove_fill(queue->q_exts_by_addr, start, size);
+}
+
 /*
  * Given a list of scan_io_t's in io_list, this issues the I/Os out to
  * disk. This consumes the io_list and frees the scan_io_t's. This is
@@ -3273,7 +3688,8 @@ scan_io_queue_issue(dsl_scan_io_queue_t *queue, list_t *io_list)
 	while ((sio = list_head(io_list)) != NULL) {
 		blkptr_t bp;
 
-		if (scan_io_queue_check_suspend(scn)) {
+		if (scan_io_queue_check_suspend(scn) ||
+		    scan_io_queue_throttle(queue, SIO_GET_ASIZE(sio))) {
 			suspended = B_TRUE;
 			break;
 		}
@@ -3435,6 +3851,426 @@ scan_io_queue_fetch_ext(dsl_scan_io_queue_t *queue)
 	return (addr_rs);
 }
 
+/*
+ * Spilling
+ *
+ * A pool with a lot of metadata can produce more sorted I/Os than fit
+ * below the memory limit between two checkpoints. By default we then
+ * issue the largest extents early (see dsl_scan_should_clear()), which
+ * makes the I/O pattern of the rest of the scan increasingly random. With
+ * zfs_scan_spill set, dsl_scan_sync() instead writes the lowest addressed
+ * sios of each queue out to the pool as a sorted run and keeps scanning
+ * metadata. All runs of a scan are appended to one MOS object,
+ * scn_spill_obj. Once the scan checkpoints, scan_io_queue_merge() merges
+ * the runs of each queue with its in-memory sios, so that everything found
+ * since the last checkpoint is still issued in LBA order.
+ *
+ * A block that is freed after it was spilled can't be taken out of its
+ * run. Instead, dsl_scan_freed_dva() records the offset of the block in
+ * q_spill_freed together with the id of the next run, and records of
+ * older runs at that offset are skipped by the merge. Runs never outlive
+ * a checkpoint: the bookmark is only synced once all of them have been
+ * issued, so runs left behind by an export are simply freed on import.
+ */
+static void
+sio2ssr(const scan_io_t *sio, scan_spill_rec_t *ssr)
+{
+	memset(ssr, 0, sizeof (*ssr));
+	ssr->ssr_blk_prop = sio->sio_blk_prop;
+	ssr->ssr_phys_birth = sio->sio_phys_birth;
+	ssr->ssr_birth = sio->sio_birth;
+	ssr->ssr_cksum = sio->sio_cksum;
+	ssr->ssr_nr_dvas = sio->sio_nr_dvas;
+	ssr->ssr_flags = sio->sio_flags;
+	ssr->ssr_zb = sio->sio_zb;
+	memcpy(ssr->ssr_dva, sio->sio_dva, sio->sio_nr_dvas * sizeof (dva_t));
+}
+
+static scan_io_t *
+ssr2sio(const scan_spill_rec_t *ssr)
+{
+	scan_io_t *sio = sio_alloc(ssr->ssr_nr_dvas);
+
+	sio->sio_blk_prop = ssr->ssr_blk_prop;
+	sio->sio_phys_birth = ssr->ssr_phys_birth;
+	sio->sio_birth = ssr->ssr_birth;
+	sio->sio_cksum = ssr->ssr_cksum;
+	sio->sio_nr_dvas = ssr->ssr_nr_dvas;
+	sio->sio_flags = ssr->ssr_flags;
+	sio->sio_zb = ssr->ssr_zb;
+	memcpy(sio->sio_dva, ssr->ssr_dva, sio->sio_nr_dvas * sizeof (dva_t));
+
+	return (sio);
+}
+
+/*
+ * Comparator for the q_spill_runs tree. Runs are sorted by the offset of
+ * the next record they will return, so the first run holds the lowest
+ * addressed spilled sio.
+ */
+static int
+scan_spill_run_compare(const void *x, const void *y)
+{
+	const scan_spill_run_t *a = x, *b = y;
+
+	int cmp = TREE_CMP(SRN_HEAD_OFFSET(a), SRN_HEAD_OFFSET(b));
+	if (likely(cmp))
+		return (cmp);
+
+	return (TREE_CMP(a->srn_id, b->srn_id));
+}
+
+static int
+scan_spill_free_compare(const void *x, const void *y)
+{
+	const scan_spill_free_t *a = x, *b = y;
+
+	return (TREE_CMP(a->ssf_offset, b->ssf_offset));
+}
+
+static void
+scan_spill_run_destroy(dsl_scan_io_queue_t *queue, scan_spill_run_t *run)
+{
+	scan_spill_free_t *ssf;
+	void *cookie = NULL;
+
+	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
+	ASSERT3U(queue->q_spill_nruns, >, 0);
+
+	if (run->srn_buf != NULL) {
+		kmem_free(run->srn_buf,
+		    SCAN_SPILL_READ_RECS * sizeof (scan_spill_rec_t));
+	}
+	kmem_free(run, sizeof (*run));
+	atomic_add_64(&queue->q_scn->scn_spill_runs, -1);
+
+	/* frees can only affect runs that still exist */
+	if (--queue->q_spill_nruns == 0) {
+		while ((ssf = avl_destroy_nodes(&queue->q_spill_freed,
+		    &cookie)) != NULL)
+			kmem_free(ssf, sizeof (*ssf));
+	}
+}
+
+/* Called by dsl_scan_freed_dva() for blocks not found in the queue. */
+static void
+scan_spill_note_free(dsl_scan_io_queue_t *queue, uint64_t offset)
+{
+	scan_spill_free_t srch, *ssf;
+	avl_index_t idx;
+
+	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
+
+	srch.ssf_offset = offset;
+	ssf = avl_find(&queue->q_spill_freed, &srch, &idx);
+	if (ssf == NULL) {
+		ssf = kmem_alloc(sizeof (*ssf), KM_SLEEP);
+		ssf->ssf_offset = offset;
+		avl_insert(&queue->q_spill_freed, ssf, idx);
+	}
+	ssf->ssf_gen = queue->q_spill_gen;
+}
+
+static boolean_t
+scan_spill_is_freed(dsl_scan_io_queue_t *queue, uint64_t id, uint64_t offset)
+{
+	scan_spill_free_t srch, *ssf;
+
+	srch.ssf_offset = offset;
+	ssf = avl_find(&queue->q_spill_freed, &srch, NULL);
+
+	return (ssf != NULL && id < ssf->ssf_gen);
+}
+
+/*
+ * Writes the lowest addressed sios of the queue out to a new run until at
+ * least `target' bytes of queue memory have been released. This must be
+ * called from syncing context with the queue lock held, which is dropped
+ * while the records are handed to the DMU.
+ */
+static void
+scan_io_queue_spill(dsl_scan_io_queue_t *queue, uint64_t target,
+    dmu_tx_t *tx)
+{
+	dsl_scan_t *scn = queue->q_scn;
+	kmutex_t *q_lock = &queue->q_vd->vdev_scan_io_queue_lock;
+	size_t bufsize = SCAN_SPILL_WRITE_RECS * sizeof (scan_spill_rec_t);
+	scan_spill_rec_t *buf;
+	scan_spill_run_t *run;
+	scan_io_t *sio;
+	uint64_t released = 0;
+
+	ASSERT(MUTEX_HELD(q_lock));
+	ASSERT(dmu_tx_is_syncing(tx));
+	ASSERT3U(scn->scn_spill_obj, !=, 0);
+
+	if (avl_is_empty(&queue->q_sios_by_addr))
+		return;
+
+	/*
+	 * Bump the generation before taking any sios out of the queue, so
+	 * that a block freed from here on is recorded as newer than this run.
+	 */
+	run = kmem_zalloc(sizeof (*run), KM_SLEEP);
+	run->srn_id = queue->q_spill_gen++;
+	run->srn_off = scn->scn_spill_end;
+	queue->q_spill_nruns++;
+	atomic_add_64(&scn->scn_spill_runs, 1);
+
+	buf = vmem_alloc(bufsize, KM_SLEEP);
+	while (released < target) {
+		uint_t n = 0;
+
+		while (n < SCAN_SPILL_WRITE_RECS && released < target &&
+		    (sio = avl_first(&queue->q_sios_by_addr)) != NULL) {
+			sio2ssr(sio, &buf[n++]);
+			released += SIO_GET_MUSED(sio);
+			scan_io_queue_remove(queue, sio);
+			sio_free(sio);
+		}
+		if (n == 0)
+			break;
+
+		mutex_exit(q_lock);
+		dmu_write(scn->scn_dp->dp_meta_objset, scn->scn_spill_obj,
+		    scn->scn_spill_end, n * sizeof (scan_spill_rec_t), buf, tx);
+		mutex_enter(q_lock);
+
+		scn->scn_spill_end += n * sizeof (scan_spill_rec_t);
+		run->srn_left += n;
+	}
+	vmem_free(buf, bufsize);
+
+	ASSERT3U(run->srn_left, >, 0);
+	queue->q_last_ext_addr = -1;
+	list_insert_tail(&queue->q_spill_refill, run);
+}
+
+/*
+ * Spills all queues down to the soft memory limit. Each queue gives up a
+ * share of the excess that is proportional to the memory it is using.
+ */
+static void
+scan_io_queues_spill(dsl_scan_t *scn, dmu_tx_t *tx)
+{
+	objset_t *mos = scn->scn_dp->dp_meta_objset;
+	vdev_t *rvd = scn->scn_dp->dp_spa->spa_root_vdev;
+	uint64_t mlim_hard, mlim_soft, mused, frac, runs, end;
+
+	mused = dsl_scan_mem_used(scn, &mlim_hard, &mlim_soft);
+	if (mused <= mlim_soft)
+		return;
+
+	if (scn->scn_spill_obj == 0) {
+		scn->scn_spill_obj = dmu_object_alloc(mos,
+		    DMU_OTN_UINT64_METADATA, SPA_OLD_MAXBLOCKSIZE,
+		    DMU_OT_NONE, 0, tx);
+		VERIFY0(zap_add(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_SCAN_SPILL, sizeof (uint64_t), 1,
+		    &scn->scn_spill_obj, tx));
+		scn->scn_spill_end = 0;
+	}
+
+	/* fraction of each queue to spill, in 1/1024ths */
+	frac = howmany((mused - mlim_soft) << 10, mused);
+	runs = scn->scn_spill_runs;
+	end = scn->scn_spill_end;
+
+	for (uint64_t i = 0; i < rvd->vdev_children; i++) {
+		vdev_t *tvd = rvd->vdev_child[i];
+		dsl_scan_io_queue_t *queue;
+
+		mutex_enter(&tvd->vdev_scan_io_queue_lock);
+		queue = tvd->vdev_scan_io_queue;
+		if (queue != NULL && queue->q_sio_memused != 0) {
+			scan_io_queue_spill(queue,
+			    howmany(queue->q_sio_memused * frac, 1024), tx);
+		}
+		mutex_exit(&tvd->vdev_scan_io_queue_lock);
+	}
+
+	zfs_dbgmsg("scan spilled %llu runs (%llu bytes) for %s txg %llu",
+	    (longlong_t)(scn->scn_spill_runs - runs),
+	    (longlong_t)(scn->scn_spill_end - end),
+	    scn->scn_dp->dp_spa->spa_name, (longlong_t)tx->tx_txg);
+}
+
+/* Frees scn_spill_obj once all of its runs are gone. */
+static void
+scan_spill_obj_free(dsl_scan_t *scn, dmu_tx_t *tx)
+{
+	objset_t *mos = scn->scn_dp->dp_meta_objset;
+
+	ASSERT(dmu_tx_is_syncing(tx));
+	ASSERT0(scn->scn_spill_runs);
+
+	if (scn->scn_spill_obj == 0)
+		return;
+
+	VERIFY0(dmu_object_free(mos, scn->scn_spill_obj, tx));
+	VERIFY0(zap_remove(mos, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_SCAN_SPILL, tx));
+	scn->scn_spill_obj = 0;
+	scn->scn_spill_end = 0;
+}
+
+static int
+scan_spill_run_refill(dsl_scan_t *scn, scan_spill_run_t *run)
+{
+	uint_t n = MIN(run->srn_left, SCAN_SPILL_READ_RECS);
+	int err;
+
+	ASSERT3U(n, >, 0);
+
+	if (run->srn_buf == NULL) {
+		run->srn_buf = kmem_alloc(SCAN_SPILL_READ_RECS *
+		    sizeof (scan_spill_rec_t), KM_SLEEP);
+	}
+
+	err = dmu_read(scn->scn_dp->dp_meta_objset, scn->scn_spill_obj,
+	    run->srn_off, n * sizeof (scan_spill_rec_t), run->srn_buf,
+	    DMU_READ_PREFETCH);
+	if (err != 0)
+		return (err);
+
+	run->srn_off += n * sizeof (scan_spill_rec_t);
+	run->srn_left -= n;
+	run->srn_cnt = n;
+	run->srn_idx = 0;
+
+	return (0);
+}
+
+/*
+ * Takes the lowest addressed sio out of the in-memory queue and the
+ * buffered runs, skipping spilled blocks that have since been freed.
+ * Returns NULL when there is nothing left or when a run must be refilled
+ * before the next sio can be determined.
+ */
+static scan_io_t *
+scan_io_queue_merge_next(dsl_scan_io_queue_t *queue)
+{
+	scan_spill_run_t *run;
+	scan_io_t *sio;
+
+	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
+
+	while (list_is_empty(&queue->q_spill_refill)) {
+		boolean_t freed;
+		blkptr_t bp;
+
+		run = avl_first(&queue->q_spill_runs);
+		sio = avl_first(&queue->q_sios_by_addr);
+		if (sio != NULL && (run == NULL ||
+		    SIO_GET_OFFSET(sio) <= SRN_HEAD_OFFSET(run))) {
+			scan_io_queue_remove(queue, sio);
+			return (sio);
+		}
+		if (run == NULL)
+			return (NULL);
+
+		avl_remove(&queue->q_spill_runs, run);
+		sio = ssr2sio(&run->srn_buf[run->srn_idx++]);
+		freed = scan_spill_is_freed(queue, run->srn_id,
+		    SIO_GET_OFFSET(sio));
+
+		if (run->srn_idx < run->srn_cnt)
+			avl_add(&queue->q_spill_runs, run);
+		else if (run->srn_left != 0)
+			list_insert_tail(&queue->q_spill_refill, run);
+		else
+			scan_spill_run_destroy(queue, run);
+
+		if (!freed)
+			return (sio);
+
+		/* count the block as though we skipped it */
+		sio2bp(sio, &bp);
+		count_block_skipped(queue->q_scn, &bp, B_FALSE);
+		sio_free(sio);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Issues the queue's in-memory sios and spilled runs as a single stream
+ * in LBA order. Like scan_io_queue_fetch_ext(), this does nothing unless
+ * the scan is clearing. Returns B_TRUE if we were suspended, in which
+ * case the sios that were not issued remain in io_list.
+ */
+static boolean_t
+scan_io_queue_merge(dsl_scan_io_queue_t *queue, list_t *io_list)
+{
+	dsl_scan_t *scn = queue->q_scn;
+	kmutex_t *q_lock = &queue->q_vd->vdev_scan_io_queue_lock;
+	boolean_t suspended = B_FALSE;
+	scan_spill_run_t *run;
+	scan_io_t *sio;
+
+	ASSERT(MUTEX_HELD(q_lock));
+	ASSERT(list_is_empty(io_list));
+
+	if (!scn->scn_checkpointing && !scn->scn_clearing)
+		return (B_FALSE);
+
+	while (!suspended) {
+		uint64_t seg_start, seg_end;
+		uint_t num_sios = 0;
+
+		/*
+		 * Read in the next records of every run that ran dry. The
+		 * runs are only ever touched by this thread and by syncing
+		 * context while we are not running, so we can drop the lock.
+		 */
+		while ((run = list_remove_head(&queue->q_spill_refill)) !=
+		    NULL) {
+			int err;
+
+			mutex_exit(q_lock);
+			err = scan_spill_run_refill(scn, run);
+			mutex_enter(q_lock);
+
+			if (err == 0) {
+				avl_add(&queue->q_spill_runs, run);
+				continue;
+			}
+
+			zfs_dbgmsg("failed to read spilled scan run %llu "
+			    "for %s vdev %llu: error %d",
+			    (longlong_t)run->srn_id,
+			    scn->scn_dp->dp_spa->spa_name,
+			    (longlong_t)queue->q_vd->vdev_id, err);
+			atomic_inc_64(&scn->scn_phys.scn_errors);
+			scan_spill_run_destroy(queue, run);
+		}
+
+		/* we issue at most 32 sios at once, like the extent path */
+		while (num_sios < 32 &&
+		    (sio = scan_io_queue_merge_next(queue)) != NULL) {
+			list_insert_tail(io_list, sio);
+			num_sios++;
+		}
+
+		if (num_sios == 0) {
+			if (list_is_empty(&queue->q_spill_refill))
+				break;
+			continue;
+		}
+
+		seg_start = SIO_GET_OFFSET((scan_io_t *)list_head(io_list));
+		seg_end = SIO_GET_END_OFFSET((scan_io_t *)list_tail(io_list));
+
+		mutex_exit(q_lock);
+		suspended = scan_io_queue_issue(queue, io_list);
+		mutex_enter(q_lock);
+
+		scan_io_queues_update_seg_stats(queue, seg_start, seg_end);
+	}
+
+	return (suspended);
+}
+
 static void
 scan_io_queues_run_one(void *arg)
 {
@@ -3465,8 +4301,12 @@ scan_io_queues_run_one(void *arg)
 	queue->q_total_zio_size_this_txg = 0;
 	queue->q_zios_this_txg = 0;
 
+	/* spilled runs have to be merged with the in-memory queue */
+	if (queue->q_spill_nruns != 0)
+		suspended = scan_io_queue_merge(queue, &sio_list);
+
 	/* loop until we run out of time or sios */
-	while ((rs = scan_io_queue_fetch_ext(queue)) != NULL) {
+	while (!suspended && (rs = scan_io_queue_fetch_ext(queue)) != NULL) {
 		uint64_t seg_start = 0, seg_end = 0;
 		boolean_t more_left;
 
@@ -3541,7 +4381,7 @@ scan_io_queues_run(dsl_scan_t *scn)
 	ASSERT(scn->scn_is_sorted);
 	ASSERT(spa_config_held(spa, SCL_CONFIG, RW_READER));
 
-	if (scn->scn_queues_pending == 0)
+	if (scn->scn_queues_pending == 0 && scn->scn_spill_runs == 0)
 		return;
 
 	if (scn->scn_taskq == NULL) {
@@ -3792,6 +4632,34 @@ dsl_scan_need_resilver(spa_t *spa, const dva_t *dva, size_t psize,
 	return (B_TRUE);
 }
 
+static void
+dsl_scan_bptree_pipe_destroy(dsl_scan_t *scn)
+{
+	if (scn->scn_bptree_pipe != NULL) {
+		bptree_pipe_destroy(scn->scn_bptree_pipe);
+		scn->scn_bptree_pipe = NULL;
+	}
+}
+
+static int
+dsl_scan_bptree_iterate(dsl_scan_t *scn, dmu_tx_t *tx)
+{
+	dsl_pool_t *dp = scn->scn_dp;
+
+	if (zfs_async_destroy_queue_blocks == 0) {
+		dsl_scan_bptree_pipe_destroy(scn);
+		return (bptree_iterate(dp->dp_meta_objset, dp->dp_bptree_obj,
+		    B_TRUE, dsl_scan_free_block_cb, scn, tx));
+	}
+
+	if (scn->scn_bptree_pipe == NULL) {
+		scn->scn_bptree_pipe = bptree_pipe_create(dp->dp_spa,
+		    zfs_async_destroy_queue_blocks);
+	}
+	return (bptree_iterate_pipe(dp->dp_meta_objset, dp->dp_bptree_obj,
+	    scn->scn_bptree_pipe, dsl_scan_free_block_cb, scn, tx));
+}
+
 static int
 dsl_process_async_destroys(dsl_pool_t *dp, dmu_tx_t *tx)
 {
@@ -3822,8 +4690,7 @@ dsl_process_async_destroys(dsl_pool_t *dp, dmu_tx_t *tx)
 		scn->scn_is_bptree = B_TRUE;
 		scn->scn_zio_root = zio_root(spa, NULL,
 		    NULL, ZIO_FLAG_MUSTSUCCEED);
-		err = bptree_iterate(dp->dp_meta_objset,
-		    dp->dp_bptree_obj, B_TRUE, dsl_scan_free_block_cb, scn, tx);
+		err = dsl_scan_bptree_iterate(scn, tx);
 		VERIFY0(zio_wait(scn->scn_zio_root));
 		scn->scn_zio_root = NULL;
 
@@ -3845,6 +4712,7 @@ dsl_process_async_destroys(dsl_pool_t *dp, dmu_tx_t *tx)
 			VERIFY0(bptree_free(dp->dp_meta_objset,
 			    dp->dp_bptree_obj, tx));
 			dp->dp_bptree_obj = 0;
+			dsl_scan_bptree_pipe_destroy(scn);
 			scn->scn_async_destroying = B_FALSE;
 			scn->scn_async_stalled = B_FALSE;
 		} else {
@@ -4480,6 +5348,13 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 			scn->scn_last_checkpoint = ddi_get_lbolt();
 	}
 
+	/*
+	 * Once every spilled run has been issued, or if the runs were left
+	 * behind by an export, the spill object is no longer needed.
+	 */
+	if (scn->scn_spill_runs == 0)
+		scan_spill_obj_free(scn, tx);
+
 	/*
 	 * For sorted scans, determine what kind of work we will be doing
 	 * this txg based on our memory limitations and whether or not we
@@ -4494,7 +5369,8 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		 * Otherwise, use the memory limit to determine if we should
 		 * scan for metadata or start issue scrub IOs. We accumulate
 		 * metadata until we hit our hard memory limit at which point
-		 * we issue scrub IOs until we are at our soft memory limit.
+		 * we issue scrub IOs until we are at our soft memory limit,
+		 * or spill the queues down to it if zfs_scan_spill is set.
 		 */
 		if (scn->scn_checkpointing ||
 		    ddi_get_lbolt() - scn->scn_last_checkpoint >
@@ -4507,6 +5383,11 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 			scn->scn_clearing = B_TRUE;
 		} else {
 			boolean_t should_clear = dsl_scan_should_clear(scn);
+			if (should_clear && !scn->scn_clearing &&
+			    zfs_scan_spill) {
+				scan_io_queues_spill(scn, tx);
+				should_clear = B_FALSE;
+			}
 			if (should_clear && !scn->scn_clearing) {
 				zfs_dbgmsg("begin scan clearing for %s",
 				    spa->spa_name);
@@ -4606,7 +5487,8 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 			    spa->spa_name,
 			    (longlong_t)tx->tx_txg);
 		}
-	} else if (scn->scn_is_sorted && scn->scn_queues_pending != 0) {
+	} else if (scn->scn_is_sorted && (scn->scn_queues_pending != 0 ||
+	    scn->scn_spill_runs != 0)) {
 		ASSERT(scn->scn_clearing);
 
 		/* need to issue scrubbing IOs from per-vdev queues */
@@ -4630,14 +5512,20 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		    (longlong_t)scn->scn_avg_zio_size_this_txg,
 		    (longlong_t)scn->scn_avg_seg_size_this_txg);
 	} else if (scn->scn_done_txg != 0 && scn->scn_done_txg <= tx->tx_txg) {
-		/* Finished with everything. Mark the scrub as complete */
-		zfs_dbgmsg("scan issuing complete txg %llu for %s",
-		    (longlong_t)tx->tx_txg,
-		    spa->spa_name);
 		ASSERT3U(scn->scn_done_txg, !=, 0);
 		ASSERT0(spa->spa_scrub_inflight);
 		ASSERT0(scn->scn_queues_pending);
-		dsl_scan_done(scn, B_TRUE, tx);
+		ASSERT0(scn->scn_spill_runs);
+		if (scn->scn_phys.scn_flags & DSF_METADATA_PASS) {
+			/* Metadata is done, start over for the data */
+			dsl_scan_metadata_pass_done(scn, tx);
+		} else {
+			/* Finished with everything. Mark the scrub complete */
+			zfs_dbgmsg("scan issuing complete txg %llu for %s",
+			    (longlong_t)tx->tx_txg,
+			    spa->spa_name);
+			dsl_scan_done(scn, B_TRUE, tx);
+		}
 		sync_type = SYNC_MANDATORY;
 	}
 
@@ -4816,6 +5704,21 @@ dsl_scan_scrub_cb(dsl_pool_t *dp,
 	boolean_t needs_io = B_FALSE;
 	int zio_flags = ZIO_FLAG_SCAN_THREAD | ZIO_FLAG_RAW | ZIO_FLAG_CANFAIL;
 
+	/*
+	 * A metadata-first scrub traverses the pool twice. Each block is
+	 * accounted and issued only by the pass it belongs to, so that the
+	 * progress counters cover the pool exactly once.
+	 */
+	if (scn->scn_phys.scn_flags & DSF_METADATA_FIRST) {
+		boolean_t metadata = BP_GET_LEVEL(bp) > 0 ||
+		    DMU_OT_IS_METADATA(BP_GET_TYPE(bp));
+		boolean_t metadata_pass =
+		    !!(scn->scn_phys.scn_flags & DSF_METADATA_PASS);
+
+		if (metadata != metadata_pass)
+			return (0);
+	}
+
 	count_block(dp->dp_blkstats, bp);
 	if (phys_birth <= scn->scn_phys.scn_min_txg ||
 	    phys_birth >= scn->scn_phys.scn_max_txg) {
@@ -5093,6 +5996,14 @@ scan_io_queue_create(vdev_t *vd)
 	    zfs_scan_max_ext_gap);
 	avl_create(&q->q_sios_by_addr, sio_addr_compare,
 	    sizeof (scan_io_t), offsetof(scan_io_t, sio_nodes.sio_addr_node));
+	avl_create(&q->q_spill_runs, scan_spill_run_compare,
+	    sizeof (scan_spill_run_t), offsetof(scan_spill_run_t,
+	    srn_avl_node));
+	list_create(&q->q_spill_refill, sizeof (scan_spill_run_t),
+	    offsetof(scan_spill_run_t, srn_list_node));
+	avl_create(&q->q_spill_freed, scan_spill_free_compare,
+	    sizeof (scan_spill_free_t), offsetof(scan_spill_free_t,
+	    ssf_avl_node));
 
 	return (q);
 }
@@ -5106,11 +6017,20 @@ void
 dsl_scan_io_queue_destroy(dsl_scan_io_queue_t *queue)
 {
 	dsl_scan_t *scn = queue->q_scn;
+	scan_spill_run_t *run;
 	scan_io_t *sio;
 	void *cookie = NULL;
 
 	ASSERT(MUTEX_HELD(&queue->q_vd->vdev_scan_io_queue_lock));
 
+	while ((run = list_remove_head(&queue->q_spill_refill)) != NULL)
+		scan_spill_run_destroy(queue, run);
+	while ((run = avl_destroy_nodes(&queue->q_spill_runs, &cookie)) !=
+	    NULL)
+		scan_spill_run_destroy(queue, run);
+	ASSERT0(queue->q_spill_nruns);
+	cookie = NULL;
+
 	if (!avl_is_empty(&queue->q_sios_by_addr))
 		atomic_add_64(&scn->scn_queues_pending, -1);
 	while ((sio = avl_destroy_nodes(&queue->q_sios_by_addr, &cookie)) !=
@@ -5125,6 +6045,9 @@ dsl_scan_io_queue_destroy(dsl_scan_io_queue_t *queue)
 	zfs_range_tree_vacate(queue->q_exts_by_addr, NULL, queue);
 	zfs_range_tree_destroy(queue->q_exts_by_addr);
 	avl_destroy(&queue->q_sios_by_addr);
+	avl_destroy(&queue->q_spill_runs);
+	list_destroy(&queue->q_spill_refill);
+	avl_destroy(&queue->q_spill_freed);
 	cv_destroy(&queue->q_zio_cv);
 
 	kmem_free(queue, sizeof (*queue));
@@ -5212,6 +6135,9 @@ dsl_scan_freed_dva(spa_t *spa, const blkptr_t *bp, int dva_i)
 	 *	block the caller. Eventually, dsl_scan_issue_ios will
 	 *	be done with issuing the zio's it gathered and will
 	 *	signal us.
+	 * 3) Spilled, written out to one of the queue's sorted runs. We
+	 *	can't take the record out of the run, so we only remember
+	 *	the offset and let the merge skip the record instead.
 	 */
 	sio = avl_find(&queue->q_sios_by_addr, srch_sio, &idx);
 	sio_free(srch_sio);
@@ -5222,20 +6148,16 @@ dsl_scan_freed_dva(spa_t *spa, const blkptr_t *bp, int dva_i)
 		/* Got it while it was cold in the queue */
 		ASSERT3U(start, ==, SIO_GET_OFFSET(sio));
 		ASSERT3U(size, ==, SIO_GET_ASIZE(sio));
-		avl_remove(&queue->q_sios_by_addr, sio);
-		if (avl_is_empty(&queue->q_sios_by_addr))
-			atomic_add_64(&scn->scn_queues_pending, -1);
-		queue->q_sio_memused -= SIO_GET_MUSED(sio);
-
-		ASSERT(zfs_range_tree_contains(queue->q_exts_by_addr, start,
-		    size));
-		zfs_range_tree_remove_fill(queue->q_exts_by_addr, start, size);
+		scan_io_queue_remove(queue, sio);
 
 		/* count the block as though we skipped it */
 		sio2bp(sio, &tmpbp);
 		count_block_skipped(scn, &tmpbp, B_FALSE);
 
 		sio_free(sio);
+	} else if (queue->q_spill_nruns != 0) {
+		/* It may have been spilled, see scan_io_queue_merge_next() */
+		scan_spill_note_free(queue, start);
 	}
 	mutex_exit(q_lock);
 }
@@ -5315,12 +6237,18 @@ ZFS_MODULE_PARAM(zfs, zfs_, no_scrub_io, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs, zfs_, no_scrub_prefetch, INT, ZMOD_RW,
 	"Set to disable scrub prefetching");
 
+ZFS_MODULE_PARAM(zfs, zfs_, scrub_metadata_first, INT, ZMOD_RW,
+	"Scrub all metadata before scrubbing data blocks");
+
 ZFS_MODULE_PARAM(zfs, zfs_, async_block_max_blocks, U64, ZMOD_RW,
 	"Max number of blocks freed in one txg");
 
 ZFS_MODULE_PARAM(zfs, zfs_, max_async_dedup_frees, U64, ZMOD_RW,
 	"Max number of dedup blocks freed in one txg");
 
+ZFS_MODULE_PARAM(zfs, zfs_, async_destroy_queue_blocks, U64, ZMOD_RW,
+	"Blocks queued ahead of syncing context by async destroy traversal");
+
 ZFS_MODULE_PARAM(zfs, zfs_, free_bpobj_enabled, INT, ZMOD_RW,
 	"Enable processing of the free_bpobj");
 
@@ -5336,6 +6264,9 @@ ZFS_MODULE_PARAM(zfs, zfs_, scan_issue_strategy, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs, zfs_, scan_legacy, INT, ZMOD_RW,
 	"Scrub using legacy non-sequential method");
 
+ZFS_MODULE_PARAM(zfs, zfs_, scan_throttle_interval_ms, UINT, ZMOD_RW,
+	"Interval at which the scan issue throttle adjusts the issue rate");
+
 ZFS_MODULE_PARAM(zfs, zfs_, scan_checkpoint_intval, UINT, ZMOD_RW,
 	"Scan progress on-disk checkpointing interval");
 
@@ -5348,6 +6279,9 @@ ZFS_MODULE_PARAM(zfs, zfs_, scan_mem_lim_soft_fact, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs, zfs_, scan_strict_mem_lim, INT, ZMOD_RW,
 	"Tunable to attempt to reduce lock contention");
 
+ZFS_MODULE_PARAM(zfs, zfs_, scan_spill, INT, ZMOD_RW,
+	"Spill sorted scan queues to the pool at the memory limit");
+
 ZFS_MODULE_PARAM(zfs, zfs_, scan_fill_weight, UINT, ZMOD_RW,
 	"Tunable to adjust bias towards more filled segments during scans");
 
@@ -5357,6 +6291,9 @@ ZFS_MODULE_PARAM(zfs, zfs_, scan_report_txgs, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs, zfs_, resilver_disable_defer, INT, ZMOD_RW,
 	"Process all resilvers immediately");
 
+ZFS_MODULE_PARAM(zfs, zfs_, resilver_priority_checkpoint, INT, ZMOD_RW,
+	"Repair high scan_priority datasets before scanning the others");
+
 ZFS_MODULE_PARAM(zfs, zfs_, resilver_defer_percent, UINT, ZMOD_RW,
 	"Issued IO percent complete after which resilvers are deferred");
 
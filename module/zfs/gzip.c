@@ -29,6 +29,8 @@
 
 #include <sys/debug.h>
 #include <sys/types.h>
+#include <sys/abd.h>
+#include <sys/mod.h>
 #include <sys/qat.h>
 #include <sys/zio_compress.h>
 
@@ -48,6 +50,37 @@ typedef uLongf zlen_t;
 
 #endif
 
+/*
+ * Early abort heuristic for incompressible data, as zstd has.  For gzip
+ * levels above 1 on records of at least zfs_gzip_abort_size, first try LZ4
+ * and, if that fails, gzip-1; only if either compresses the record is the
+ * requested level tried.  Both passes are many times faster than gzip-6 to
+ * gzip-9, which otherwise spend their full time on already compressed data
+ * only to store it uncompressed.  The output for compressible data is
+ * unchanged.
+ */
+static uint_t zfs_gzip_earlyabort_pass = 1;
+static uint_t zfs_gzip_abort_size = (128 * 1024);
+
+static boolean_t
+zfs_gzip_early_abort(void *s_start, void *d_start, size_t s_len,
+    size_t d_len)
+{
+	abd_t sabd, dabd;
+	zlen_t dstlen = d_len;
+	size_t pass_len;
+
+	abd_get_from_buf_struct(&sabd, s_start, s_len);
+	abd_get_from_buf_struct(&dabd, d_start, d_len);
+	pass_len = zfs_lz4_compress(&sabd, &dabd, s_len, d_len, 0);
+	abd_free(&dabd);
+	abd_free(&sabd);
+	if (pass_len < d_len)
+		return (B_FALSE);
+
+	return (compress_func(d_start, &dstlen, s_start, s_len, 1) != Z_OK);
+}
+
 static size_t
 zfs_gzip_compress_buf(void *s_start, void *d_start, size_t s_len,
     size_t d_len, int n)
@@ -73,7 +106,10 @@ zfs_gzip_compress_buf(void *s_start, void *d_start, size_t s_len,
 		/* if hardware compression fails, do it again with software */
 	}
 
-	if (compress_func(d_start, &dstlen, s_start, s_len, n) != Z_OK) {
+	if ((zfs_gzip_earlyabort_pass > 0 && n > 1 &&
+	    s_len >= zfs_gzip_abort_size &&
+	    zfs_gzip_early_abort(s_start, d_start, s_len, d_len)) ||
+	    compress_func(d_start, &dstlen, s_start, s_len, n) != Z_OK) {
 		if (d_len != s_len)
 			return (s_len);
 
@@ -109,3 +145,9 @@ zfs_gzip_decompress_buf(void *s_start, void *d_start, size_t s_len,
 
 ZFS_COMPRESS_WRAP_DECL(zfs_gzip_compress)
 ZFS_DECOMPRESS_WRAP_DECL(zfs_gzip_decompress)
+
+ZFS_MODULE_PARAM(zfs, zfs_, gzip_earlyabort_pass, UINT, ZMOD_RW,
+	"Enable early abort attempts when using gzip");
+
+ZFS_MODULE_PARAM(zfs, zfs_, gzip_abort_size, UINT, ZMOD_RW,
+	"Minimal size of block to attempt early abort");
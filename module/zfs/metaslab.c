@@ -228,6 +228,17 @@ uint_t metaslab_preload_limit = 10;
  */
 static int metaslab_preload_enabled = B_TRUE;
 
+/*
+ * In addition to the metaslab_preload_limit best metaslabs, keep preloading
+ * metaslabs until their free space covers this percentage of the space the
+ * group is expected to allocate while a metaslab is loaded and the next txg
+ * syncs.  The expectation is based on the group's recent allocation rate
+ * and metaslab load time.  This lets a sudden burst of writes move on to
+ * already loaded metaslabs rather than waiting for a space map to be read.
+ * Set to 0 to preload only metaslab_preload_limit metaslabs.
+ */
+static uint_t metaslab_preload_lookahead_pct = 200;
+
 /*
  * Enable/disable fragmentation weighting on metaslabs.
  */
@@ -306,6 +317,14 @@ static uint_t zfs_metaslab_mem_limit = 25;
  */
 static const boolean_t zfs_metaslab_force_large_segs = B_FALSE;
 
+/*
+ * Store the segments of metaslabs with fewer than 2^24 allocatable units
+ * in 24-bit integers, which lets each loaded metaslab's range trees hold a
+ * third more segments in the same memory.  Only affects metaslabs that are
+ * initialized after it is changed.
+ */
+static int metaslab_compact_segs = B_TRUE;
+
 /*
  * By default we only store segments over a certain size in the size-sorted
  * metaslab trees (ms_allocatable_by_size and
@@ -344,6 +363,14 @@ static int zfs_metaslab_try_hard_before_gang = B_FALSE;
  */
 static uint_t zfs_metaslab_find_max_tries = 100;
 
+/*
+ * When not trying hard, consult the metaslab group's size index and skip
+ * groups in which no metaslab can satisfy the allocation, rather than
+ * activating and trying their metaslabs.  On full, fragmented pools this
+ * moves large allocations straight to a group that can hold them.
+ */
+static int metaslab_size_index_enabled = B_TRUE;
+
 static uint64_t metaslab_weight(metaslab_t *, boolean_t);
 static void metaslab_set_fragmentation(metaslab_t *, boolean_t);
 static void metaslab_free_impl(vdev_t *, uint64_t, uint64_t, boolean_t);
@@ -354,6 +381,8 @@ static uint64_t metaslab_weight_from_range_tree(metaslab_t *msp);
 static void metaslab_flush_update(metaslab_t *, dmu_tx_t *);
 static unsigned int metaslab_idx_func(multilist_t *, void *);
 static void metaslab_evict(metaslab_t *, uint64_t);
+static boolean_t metaslab_is_zoned(metaslab_t *msp);
+static uint64_t metaslab_zoned_largest(metaslab_t *msp);
 static void metaslab_rt_add(zfs_range_tree_t *rt, zfs_range_seg_t *rs,
     void *arg);
 kmem_cache_t *metaslab_alloc_trace_cache;
@@ -363,6 +392,10 @@ typedef struct metaslab_stats {
 	kstat_named_t metaslabstat_reload_tree;
 	kstat_named_t metaslabstat_too_many_tries;
 	kstat_named_t metaslabstat_try_hard;
+	kstat_named_t metaslabstat_load_stall;
+	kstat_named_t metaslabstat_load_stall_nsecs;
+	kstat_named_t metaslabstat_preload_lookahead;
+	kstat_named_t metaslabstat_size_index_skip;
 } metaslab_stats_t;
 
 static metaslab_stats_t metaslab_stats = {
@@ -370,10 +403,16 @@ static metaslab_stats_t metaslab_stats = {
 	{ "reload_tree",		KSTAT_DATA_UINT64 },
 	{ "too_many_tries",		KSTAT_DATA_UINT64 },
 	{ "try_hard",			KSTAT_DATA_UINT64 },
+	{ "load_stall",			KSTAT_DATA_UINT64 },
+	{ "load_stall_nsecs",		KSTAT_DATA_UINT64 },
+	{ "preload_lookahead",		KSTAT_DATA_UINT64 },
+	{ "size_index_skip",		KSTAT_DATA_UINT64 },
 };
 
 #define	METASLABSTAT_BUMP(stat) \
 	atomic_inc_64(&metaslab_stats.stat.value.ui64);
+#define	METASLABSTAT_INCR(stat, val) \
+	atomic_add_64(&metaslab_stats.stat.value.ui64, (val));
 
 char *
 metaslab_rt_name(metaslab_group_t *mg, metaslab_t *ms, const char *name)
@@ -1342,6 +1381,64 @@ metaslab_group_histogram_remove(metaslab_group_t *mg, metaslab_t *msp)
 	mutex_exit(&mg->mg_lock);
 }
 
+/*
+ * Returns the mg_size_index bucket for a metaslab with the given weight:
+ * the power of two of the largest allocation the metaslab may satisfy, or
+ * -1 if it has no free space.  Segment-based weights record the bucket of
+ * the largest free segments, space-based weights bound it by the free space,
+ * and a known ms_max_size gives a lower bound.
+ */
+static int
+metaslab_size_bucket(metaslab_t *msp, uint64_t weight)
+{
+	uint64_t w = weight & ~METASLAB_ACTIVE_MASK;
+	int bucket = -1;
+
+	if (!WEIGHT_IS_SPACEBASED(w))
+		bucket = WEIGHT_GET_INDEX(w);
+	else if ((w & ~METASLAB_WEIGHT_TYPE) != 0)
+		bucket = highbit64(w & ~METASLAB_WEIGHT_TYPE) - 1;
+
+	if (msp->ms_max_size != 0)
+		bucket = MAX(bucket, highbit64(msp->ms_max_size) - 1);
+
+	return (bucket);
+}
+
+static void
+metaslab_size_index_update(metaslab_group_t *mg, metaslab_t *msp,
+    uint64_t weight)
+{
+	ASSERT(MUTEX_HELD(&mg->mg_lock));
+
+	if (msp->ms_size_bucket >= 0) {
+		ASSERT3U(mg->mg_size_index[msp->ms_size_bucket], >, 0);
+		mg->mg_size_index[msp->ms_size_bucket]--;
+	}
+	msp->ms_size_bucket = metaslab_size_bucket(msp, weight);
+	if (msp->ms_size_bucket >= 0)
+		mg->mg_size_index[msp->ms_size_bucket]++;
+}
+
+/*
+ * Returns B_FALSE if no metaslab in the group can satisfy an allocation
+ * of asize bytes according to the size index.  The index is read without
+ * the mg_lock so this is only a hint; callers fall back to trying hard.
+ */
+static boolean_t
+metaslab_group_may_fit(metaslab_group_t *mg, uint64_t asize)
+{
+	if (!metaslab_size_index_enabled)
+		return (B_TRUE);
+
+	for (int i = highbit64(asize) - 1; i < 64; i++) {
+		if (mg->mg_size_index[i] != 0)
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
+}
+
 static void
 metaslab_group_add(metaslab_group_t *mg, metaslab_t *msp)
 {
@@ -1349,6 +1446,7 @@ metaslab_group_add(metaslab_group_t *mg, metaslab_t *msp)
 	mutex_enter(&mg->mg_lock);
 	msp->ms_group = mg;
 	msp->ms_weight = 0;
+	msp->ms_size_bucket = -1;
 	avl_add(&mg->mg_metaslab_tree, msp);
 	mutex_exit(&mg->mg_lock);
 
@@ -1367,6 +1465,10 @@ metaslab_group_remove(metaslab_group_t *mg, metaslab_t *msp)
 	mutex_enter(&mg->mg_lock);
 	ASSERT(msp->ms_group == mg);
 	avl_remove(&mg->mg_metaslab_tree, msp);
+	if (msp->ms_size_bucket >= 0) {
+		mg->mg_size_index[msp->ms_size_bucket]--;
+		msp->ms_size_bucket = -1;
+	}
 
 	metaslab_class_t *mc = msp->ms_group->mg_class;
 	multilist_sublist_t *mls =
@@ -1389,7 +1491,7 @@ metaslab_group_sort_impl(metaslab_group_t *mg, metaslab_t *msp, uint64_t weight)
 	avl_remove(&mg->mg_metaslab_tree, msp);
 	msp->ms_weight = weight;
 	avl_add(&mg->mg_metaslab_tree, msp);
-
+	metaslab_size_index_update(mg, msp, weight);
 }
 
 static void
@@ -1489,6 +1591,27 @@ metaslab_rangesize64_compare(const void *x1, const void *x2)
 	return (cmp + !cmp * TREE_CMP(r1->rs_start, r2->rs_start));
 }
 
+/*
+ * Comparison function for the private size-ordered tree using 24-bit
+ * ranges. Tree is sorted by size, larger sizes at the end of the tree.
+ */
+__attribute__((always_inline)) inline
+static int
+metaslab_rangesize24_compare(const void *x1, const void *x2)
+{
+	const zfs_range_seg24_t *r1 = x1;
+	const zfs_range_seg24_t *r2 = x2;
+
+	uint32_t rs_start1 = zfs_rs24_get(r1->rs_start);
+	uint32_t rs_start2 = zfs_rs24_get(r2->rs_start);
+	uint64_t rs_size1 = zfs_rs24_get(r1->rs_end) - rs_start1;
+	uint64_t rs_size2 = zfs_rs24_get(r2->rs_end) - rs_start2;
+
+	int cmp = TREE_CMP(rs_size1, rs_size2);
+
+	return (cmp + !cmp * TREE_CMP(rs_start1, rs_start2));
+}
+
 typedef struct metaslab_rt_arg {
 	zfs_btree_t *mra_bt;
 	uint32_t mra_floor_shift;
@@ -1531,6 +1654,9 @@ ZFS_BTREE_FIND_IN_BUF_FUNC(metaslab_rt_find_rangesize32_in_buf,
 ZFS_BTREE_FIND_IN_BUF_FUNC(metaslab_rt_find_rangesize64_in_buf,
     zfs_range_seg64_t, metaslab_rangesize64_compare)
 
+ZFS_BTREE_FIND_IN_BUF_FUNC(metaslab_rt_find_rangesize24_in_buf,
+    zfs_range_seg24_t, metaslab_rangesize24_compare)
+
 /*
  * Create any block allocator specific components. The current allocators
  * rely on using both a size-ordered zfs_range_tree_t and an array of
@@ -1556,6 +1682,11 @@ metaslab_rt_create(zfs_range_tree_t *rt, void *arg)
 		compare = metaslab_rangesize64_compare;
 		bt_find = metaslab_rt_find_rangesize64_in_buf;
 		break;
+	case ZFS_RANGE_SEG24:
+		size = sizeof (zfs_range_seg24_t);
+		compare = metaslab_rangesize24_compare;
+		bt_find = metaslab_rt_find_rangesize24_in_buf;
+		break;
 	default:
 		panic("Invalid range seg type %d", rt->rt_type);
 	}
@@ -1636,6 +1767,8 @@ metaslab_largest_allocatable(metaslab_t *msp)
 
 	if (t == NULL)
 		return (0);
+	if (metaslab_is_zoned(msp))
+		return (metaslab_zoned_largest(msp));
 	if (zfs_btree_numnodes(t) == 0)
 		metaslab_size_tree_full_load(msp->ms_allocatable);
 
@@ -2051,6 +2184,118 @@ metaslab_ndf_alloc(metaslab_t *msp, uint64_t size, uint64_t max_size,
 	return (-1ULL);
 }
 
+/*
+ * ==========================================================================
+ * Zoned (write pointer) block allocator
+ *
+ * Metaslabs on zoned vdevs (host-managed SMR, NVMe ZNS) are allocated
+ * append-only: each allocation is made at the metaslab's write pointer,
+ * which only moves forward. Space freed behind the write pointer can't be
+ * reused until the whole metaslab is free again, at which point the write
+ * pointer returns to the start of the metaslab. The write pointer is kept
+ * in core only; when a metaslab is loaded it is placed at the start of the
+ * free space at the end of the metaslab.
+ * ==========================================================================
+ */
+static boolean_t
+metaslab_is_zoned(metaslab_t *msp)
+{
+	return (msp->ms_group->mg_vd->vdev_zone_size != 0);
+}
+
+/*
+ * Return the first allocatable segment at or after the write pointer, and
+ * set up "where" so the caller can walk forward from there.
+ */
+static zfs_range_seg_t *
+metaslab_zoned_first(metaslab_t *msp, zfs_btree_index_t *where)
+{
+	zfs_range_tree_t *rt = msp->ms_allocatable;
+	zfs_range_seg_max_t rsearch;
+	zfs_range_seg_t *rs;
+
+	/* An empty metaslab can be rewritten from the start. */
+	if (zfs_range_tree_space(rt) == msp->ms_size)
+		msp->ms_wp = msp->ms_start;
+
+	zfs_rs_set_start(&rsearch, rt, msp->ms_wp);
+	zfs_rs_set_end(&rsearch, rt, msp->ms_wp + (1ULL << rt->rt_shift));
+
+	rs = zfs_btree_find(&rt->rt_root, &rsearch, where);
+	if (rs == NULL)
+		rs = zfs_btree_next(&rt->rt_root, where, where);
+	return (rs);
+}
+
+/*
+ * Return the largest allocation that could be made at or after the write
+ * pointer. Usually there is just the one free segment at the end of the
+ * metaslab, but claimed blocks (eg. during ZIL claim) may split it.
+ */
+static uint64_t
+metaslab_zoned_largest(metaslab_t *msp)
+{
+	zfs_range_tree_t *rt = msp->ms_allocatable;
+	zfs_btree_index_t where;
+	uint64_t largest = 0;
+
+	for (zfs_range_seg_t *rs = metaslab_zoned_first(msp, &where);
+	    rs != NULL; rs = zfs_btree_next(&rt->rt_root, &where, &where)) {
+		uint64_t start = MAX(zfs_rs_get_start(rs, rt), msp->ms_wp);
+		largest = MAX(largest, zfs_rs_get_end(rs, rt) - start);
+	}
+	return (largest);
+}
+
+/*
+ * Called when the metaslab is loaded to place the write pointer at the
+ * start of the free space at the end of the metaslab, or past the end if
+ * the last block of the metaslab is allocated.
+ */
+static void
+metaslab_zoned_load(metaslab_t *msp)
+{
+	zfs_range_tree_t *rt = msp->ms_allocatable;
+	uint64_t end = msp->ms_start + msp->ms_size;
+	uint64_t wp = end;
+
+	zfs_range_seg_t *rs = zfs_btree_last(&rt->rt_root, NULL);
+	if (rs != NULL && zfs_rs_get_end(rs, rt) == end)
+		wp = zfs_rs_get_start(rs, rt);
+
+	msp->ms_wp = MAX(msp->ms_wp, wp);
+}
+
+static uint64_t
+metaslab_zoned_alloc(metaslab_t *msp, uint64_t size, uint64_t max_size,
+    uint64_t *found_size)
+{
+	zfs_range_tree_t *rt = msp->ms_allocatable;
+	zfs_btree_index_t where;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+
+	/*
+	 * Any free space we skip over here because it's too small is left
+	 * behind the write pointer, and won't be used until the metaslab is
+	 * emptied.
+	 */
+	for (zfs_range_seg_t *rs = metaslab_zoned_first(msp, &where);
+	    rs != NULL; rs = zfs_btree_next(&rt->rt_root, &where, &where)) {
+		uint64_t start = MAX(zfs_rs_get_start(rs, rt), msp->ms_wp);
+		uint64_t end = zfs_rs_get_end(rs, rt);
+
+		if (start + size <= end) {
+			*found_size = MIN(end - start, max_size);
+			msp->ms_wp = start + *found_size;
+			return (start);
+		}
+	}
+
+	*found_size = 0;
+	return (-1ULL);
+}
+
 /*
  * ==========================================================================
  * Metaslabs
@@ -2581,8 +2826,7 @@ metaslab_load_impl(metaslab_t *msp)
 	 */
 	zfs_range_tree_walk(msp->ms_unflushed_allocs,
 	    zfs_range_tree_remove, msp->ms_allocatable);
-	zfs_range_tree_walk(msp->ms_unflushed_frees,
-	    zfs_range_tree_add, msp->ms_allocatable);
+	zfs_range_tree_merge(msp->ms_unflushed_frees, msp->ms_allocatable);
 
 	ASSERT3P(msp->ms_group, !=, NULL);
 	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
@@ -2647,13 +2891,31 @@ metaslab_load_impl(metaslab_t *msp)
 	 */
 	uint64_t weight = msp->ms_weight;
 	uint64_t max_size = msp->ms_max_size;
+	boolean_t zoned = metaslab_is_zoned(msp);
+	if (zoned)
+		metaslab_zoned_load(msp);
 	metaslab_recalculate_weight_and_sort(msp);
-	if (!WEIGHT_IS_SPACEBASED(weight))
+	/*
+	 * These don't hold for zoned metaslabs, whose weight only counts
+	 * the space beyond the write pointer.
+	 */
+	if (!WEIGHT_IS_SPACEBASED(weight) && !zoned)
 		ASSERT3U(weight, <=, msp->ms_weight);
 	msp->ms_max_size = metaslab_largest_allocatable(msp);
-	ASSERT3U(max_size, <=, msp->ms_max_size);
+	if (!zoned)
+		ASSERT3U(max_size, <=, msp->ms_max_size);
 	hrtime_t load_end = gethrtime();
 	msp->ms_load_time = load_end;
+
+	metaslab_group_t *mg = msp->ms_group;
+	mutex_enter(&mg->mg_lock);
+	if (mg->mg_load_time == 0)
+		mg->mg_load_time = load_end - load_start;
+	else
+		mg->mg_load_time = (mg->mg_load_time * 3 +
+		    (load_end - load_start)) / 4;
+	mutex_exit(&mg->mg_lock);
+
 	zfs_dbgmsg("metaslab_load: txg %llu, spa %s, class %s, vdev_id %llu, "
 	    "ms_id %llu, smp_length %llu, "
 	    "unflushed_allocs %llu, unflushed_frees %llu, "
@@ -2813,7 +3075,12 @@ zfs_range_seg_type_t
 metaslab_calculate_range_tree_type(vdev_t *vdev, metaslab_t *msp,
     uint64_t *start, uint64_t *shift)
 {
-	if (vdev->vdev_ms_shift - vdev->vdev_ashift < 32 &&
+	if (vdev->vdev_ms_shift - vdev->vdev_ashift < 24 &&
+	    metaslab_compact_segs && !zfs_metaslab_force_large_segs) {
+		*shift = vdev->vdev_ashift;
+		*start = msp->ms_start;
+		return (ZFS_RANGE_SEG24);
+	} else if (vdev->vdev_ms_shift - vdev->vdev_ashift < 32 &&
 	    !zfs_metaslab_force_large_segs) {
 		*shift = vdev->vdev_ashift;
 		*start = msp->ms_start;
@@ -2879,6 +3146,7 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object,
 	vdev_ops_t *ops = vd->vdev_ops;
 	if (ops->vdev_op_metaslab_init != NULL)
 		ops->vdev_op_metaslab_init(vd, &ms->ms_start, &ms->ms_size);
+	ms->ms_wp = ms->ms_start;
 
 	/*
 	 * We only open space map objects that already exist. All others
@@ -3270,6 +3538,33 @@ metaslab_space_weight(metaslab_t *msp)
 	return (weight);
 }
 
+/*
+ * Return a segment-based weight describing a single free segment of the
+ * given size.
+ */
+static uint64_t
+metaslab_weight_from_size(metaslab_t *msp, uint64_t size)
+{
+	uint8_t shift = msp->ms_group->mg_vd->vdev_ashift;
+	int idx = highbit64(size) - 1;
+	int max_idx = SPACE_MAP_HISTOGRAM_SIZE + shift - 1;
+	uint64_t weight = 0;
+
+	if (size == 0)
+		return (0);
+
+	if (idx < max_idx) {
+		WEIGHT_SET_COUNT(weight, 1ULL);
+		WEIGHT_SET_INDEX(weight, idx);
+	} else {
+		WEIGHT_SET_COUNT(weight, 1ULL << (idx - max_idx));
+		WEIGHT_SET_INDEX(weight, max_idx);
+	}
+	WEIGHT_SET_ACTIVE(weight, 0);
+	ASSERT(!WEIGHT_IS_SPACEBASED(weight));
+	return (weight);
+}
+
 /*
  * Return the weight of the specified metaslab, according to the segment-based
  * weighting algorithm. The metaslab must be loaded. This function can
@@ -3284,6 +3579,12 @@ metaslab_weight_from_range_tree(metaslab_t *msp)
 
 	ASSERT(msp->ms_loaded);
 
+	/* Only the space beyond the write pointer is usable when zoned. */
+	if (metaslab_is_zoned(msp)) {
+		return (metaslab_weight_from_size(msp,
+		    metaslab_zoned_largest(msp)));
+	}
+
 	for (int i = ZFS_RANGE_TREE_HISTOGRAM_SIZE - 1; i >= SPA_MINBLOCKSHIFT;
 	    i--) {
 		uint8_t shift = msp->ms_group->mg_vd->vdev_ashift;
@@ -3367,30 +3668,15 @@ metaslab_weight_from_spacemap(metaslab_t *msp)
 static uint64_t
 metaslab_segment_weight(metaslab_t *msp)
 {
-	metaslab_group_t *mg = msp->ms_group;
 	uint64_t weight = 0;
-	uint8_t shift = mg->mg_vd->vdev_ashift;
 
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
 
 	/*
 	 * The metaslab is completely free.
 	 */
-	if (metaslab_allocated_space(msp) == 0) {
-		int idx = highbit64(msp->ms_size) - 1;
-		int max_idx = SPACE_MAP_HISTOGRAM_SIZE + shift - 1;
-
-		if (idx < max_idx) {
-			WEIGHT_SET_COUNT(weight, 1ULL);
-			WEIGHT_SET_INDEX(weight, idx);
-		} else {
-			WEIGHT_SET_COUNT(weight, 1ULL << (idx - max_idx));
-			WEIGHT_SET_INDEX(weight, max_idx);
-		}
-		WEIGHT_SET_ACTIVE(weight, 0);
-		ASSERT(!WEIGHT_IS_SPACEBASED(weight));
-		return (weight);
-	}
+	if (metaslab_allocated_space(msp) == 0)
+		return (metaslab_weight_from_size(msp, msp->ms_size));
 
 	ASSERT3U(msp->ms_sm->sm_dbuf->db_size, ==, sizeof (space_map_phys_t));
 
@@ -3587,7 +3873,18 @@ metaslab_activate(metaslab_t *msp, int allocator, uint64_t activation_weight)
 		return (0);
 	}
 
+	/*
+	 * Activating a metaslab which is not loaded stalls the allocation
+	 * until its space map has been read.  Count these to show whether
+	 * preloading is keeping up.
+	 */
+	hrtime_t stall_start = msp->ms_loaded ? 0 : gethrtime();
 	int error = metaslab_load(msp);
+	if (stall_start != 0) {
+		METASLABSTAT_BUMP(metaslabstat_load_stall);
+		METASLABSTAT_INCR(metaslabstat_load_stall_nsecs,
+		    gethrtime() - stall_start);
+	}
 	if (error != 0) {
 		metaslab_group_sort(msp->ms_group, msp, 0);
 		return (error);
@@ -3754,6 +4051,43 @@ metaslab_preload(void *arg)
 	spl_fstrans_unmark(cookie);
 }
 
+/*
+ * Returns the number of bytes the group is expected to allocate while a
+ * metaslab is being loaded and the following txg syncs.
+ */
+static uint64_t
+metaslab_group_preload_lookahead(metaslab_group_t *mg)
+{
+	ASSERT(MUTEX_HELD(&mg->mg_lock));
+
+	hrtime_t horizon = mg->mg_load_time + mg->mg_alloc_interval;
+	return (mg->mg_alloc_rate * NSEC2MSEC(horizon) / MILLISEC *
+	    metaslab_preload_lookahead_pct / 100);
+}
+
+/*
+ * Update the group's allocation rate from the space allocated since the
+ * previous update.  Called once per txg from metaslab_sync_reassess().
+ */
+static void
+metaslab_group_alloc_rate_update(metaslab_group_t *mg)
+{
+	hrtime_t now = gethrtime();
+	uint64_t bytes = atomic_swap_64(&mg->mg_alloc_txg_bytes, 0);
+
+	mutex_enter(&mg->mg_lock);
+	if (mg->mg_alloc_rate_time != 0 && now > mg->mg_alloc_rate_time) {
+		hrtime_t interval = now - mg->mg_alloc_rate_time;
+		uint64_t rate = bytes * MILLISEC /
+		    MAX(NSEC2MSEC(interval), 1);
+
+		mg->mg_alloc_rate = (mg->mg_alloc_rate * 3 + rate) / 4;
+		mg->mg_alloc_interval = interval;
+	}
+	mg->mg_alloc_rate_time = now;
+	mutex_exit(&mg->mg_lock);
+}
+
 static void
 metaslab_group_preload(metaslab_group_t *mg)
 {
@@ -3767,6 +4101,9 @@ metaslab_group_preload(metaslab_group_t *mg)
 
 	mutex_enter(&mg->mg_lock);
 
+	uint64_t lookahead = metaslab_group_preload_lookahead(mg);
+	uint64_t covered = 0;
+
 	/*
 	 * Load the next potential metaslabs
 	 */
@@ -3775,13 +4112,21 @@ metaslab_group_preload(metaslab_group_t *mg)
 
 		/*
 		 * We preload only the maximum number of metaslabs specified
-		 * by metaslab_preload_limit. If a metaslab is being forced
-		 * to condense then we preload it too. This will ensure
-		 * that force condensing happens in the next txg.
+		 * by metaslab_preload_limit, or more if the free space in
+		 * those would not cover the expected allocations while the
+		 * next metaslab loads. If a metaslab is being forced to
+		 * condense then we preload it too. This will ensure that
+		 * force condensing happens in the next txg.
 		 */
-		if (++m > metaslab_preload_limit && !msp->ms_condense_wanted) {
-			continue;
+		if (++m > metaslab_preload_limit) {
+			if (covered < lookahead) {
+				METASLABSTAT_BUMP(
+				    metaslabstat_preload_lookahead);
+			} else if (!msp->ms_condense_wanted) {
+				continue;
+			}
 		}
+		covered += msp->ms_size - msp->ms_allocated_space;
 
 		VERIFY(taskq_dispatch(spa->spa_metaslab_taskq, metaslab_preload,
 		    msp, TQ_SLEEP | (m <= spa->spa_alloc_count ? TQ_FRONT : 0))
@@ -3925,14 +4270,12 @@ metaslab_condense(metaslab_t *msp, dmu_tx_t *tx)
 	    ZFS_RT_F_DYN_NAME,
 	    metaslab_rt_name(msp->ms_group, msp, "condense_tree"));
 
-	for (int t = 0; t < TXG_DEFER_SIZE; t++) {
-		zfs_range_tree_walk(msp->ms_defer[t],
-		    zfs_range_tree_add, condense_tree);
-	}
+	for (int t = 0; t < TXG_DEFER_SIZE; t++)
+		zfs_range_tree_merge(msp->ms_defer[t], condense_tree);
 
 	for (int t = 0; t < TXG_CONCURRENT_STATES; t++) {
-		zfs_range_tree_walk(msp->ms_allocating[(txg + t) & TXG_MASK],
-		    zfs_range_tree_add, condense_tree);
+		zfs_range_tree_merge(msp->ms_allocating[(txg + t) & TXG_MASK],
+		    condense_tree);
 	}
 
 	ASSERT3U(spa->spa_unflushed_stats.sus_memused, >=,
@@ -4605,14 +4948,15 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	 * the defer_tree -- this is safe to do because we've
 	 * just emptied out the defer_tree.
 	 */
-	zfs_range_tree_vacate(*defer_tree,
-	    msp->ms_loaded ? zfs_range_tree_add : NULL, msp->ms_allocatable);
+	if (msp->ms_loaded)
+		zfs_range_tree_merge(*defer_tree, msp->ms_allocatable);
+	zfs_range_tree_vacate(*defer_tree, NULL, NULL);
 	if (defer_allowed) {
 		zfs_range_tree_swap(&msp->ms_freed, defer_tree);
 	} else {
-		zfs_range_tree_vacate(msp->ms_freed,
-		    msp->ms_loaded ? zfs_range_tree_add : NULL,
-		    msp->ms_allocatable);
+		if (msp->ms_loaded)
+			zfs_range_tree_merge(msp->ms_freed, msp->ms_allocatable);
+		zfs_range_tree_vacate(msp->ms_freed, NULL, NULL);
 	}
 
 	msp->ms_synced_length = space_map_length(msp->ms_sm);
@@ -4635,6 +4979,7 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 		mg->mg_ms_ready++;
 		mutex_exit(&mg->mg_lock);
 	}
+	atomic_add_64(&mg->mg_alloc_txg_bytes, msp->ms_allocated_this_txg);
 
 	/*
 	 * Re-sort metaslab within its group now that we've adjusted
@@ -4659,6 +5004,7 @@ metaslab_sync_reassess(metaslab_group_t *mg)
 	spa_config_enter(spa, SCL_ALLOC, FTAG, RW_READER);
 	mg->mg_fragmentation = metaslab_group_fragmentation(mg);
 	metaslab_group_alloc_update(mg);
+	metaslab_group_alloc_rate_update(mg);
 
 	/*
 	 * Preload the next potential metaslabs but only on active
@@ -4843,7 +5189,10 @@ metaslab_block_alloc(metaslab_t *msp, uint64_t size, uint64_t max_size,
 	VERIFY0(msp->ms_disabled);
 	VERIFY0(msp->ms_new);
 
-	start = mc->mc_ops->msop_alloc(msp, size, max_size, actual_size);
+	if (metaslab_is_zoned(msp))
+		start = metaslab_zoned_alloc(msp, size, max_size, actual_size);
+	else
+		start = mc->mc_ops->msop_alloc(msp, size, max_size, actual_size);
 	if (start != -1ULL) {
 		size = *actual_size;
 		metaslab_group_t *mg = msp->ms_group;
@@ -4994,6 +5343,7 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 {
 	metaslab_t *msp = NULL;
 	uint64_t offset = -1ULL;
+	uint64_t contended = 0;
 
 	uint64_t activation_weight = METASLAB_WEIGHT_PRIMARY;
 	for (int i = 0; i < d; i++) {
@@ -5016,6 +5366,20 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 
 	ASSERT3U(mg->mg_vd->vdev_ms_count, >=, 2);
 
+	/*
+	 * Skip the group if none of its metaslabs can fit the allocation.
+	 * As below, a group which can't fit the minimum block size is out
+	 * of space.
+	 */
+	if (!try_hard && !metaslab_group_may_fit(mg, asize)) {
+		METASLABSTAT_BUMP(metaslabstat_size_index_skip);
+		metaslab_trace_add(zal, mg, NULL, asize, d,
+		    TRACE_GROUP_FAILURE, allocator);
+		if (asize <= vdev_get_min_alloc(mg->mg_vd))
+			mg->mg_no_free_space = B_TRUE;
+		return (-1ULL);
+	}
+
 	metaslab_t *search = kmem_alloc(sizeof (*search), KM_SLEEP);
 	search->ms_weight = UINT64_MAX;
 	search->ms_start = 0;
@@ -5031,7 +5395,10 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 	for (;;) {
 		boolean_t was_active = B_FALSE;
 
-		mutex_enter(&mg->mg_lock);
+		if (!mutex_tryenter(&mg->mg_lock)) {
+			contended++;
+			mutex_enter(&mg->mg_lock);
+		}
 
 		if (activation_weight == METASLAB_WEIGHT_PRIMARY &&
 		    mga->mga_primary != NULL) {
@@ -5072,7 +5439,10 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 		mutex_exit(&mg->mg_lock);
 		if (msp == NULL)
 			break;
-		mutex_enter(&msp->ms_lock);
+		if (!mutex_tryenter(&msp->ms_lock)) {
+			contended++;
+			mutex_enter(&msp->ms_lock);
+		}
 
 		metaslab_active_mask_verify(msp);
 
@@ -5285,6 +5655,10 @@ next:
 			mg->mg_no_free_space = B_TRUE;
 		}
 	}
+
+	spa_allocator_stats_add(mg->mg_vd->vdev_spa, allocator,
+	    offset != -1ULL, offset != -1ULL ? *actual_asize : 0, contended);
+
 	return (offset);
 }
 
@@ -5390,10 +5764,18 @@ metaslab_alloc_dva_range(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
 	 * If we are doing gang blocks (hintdva is non-NULL), try to keep
 	 * ourselves on the same vdev as our gang block header.  It makes our
 	 * fault domains something tractable.
+	 *
+	 * With METASLAB_HINT_NEXT we instead start at the vdev after the hint,
+	 * which the ZIL uses to stripe consecutive log blocks of one chain
+	 * across log devices no matter where other chains moved the rotor.
 	 */
 	if (hintdva && DVA_IS_VALID(&hintdva[d])) {
 		vd = vdev_lookup_top(spa, DVA_GET_VDEV(&hintdva[d]));
-		mg = vdev_get_mg(vd, mc);
+		if (vd != NULL) {
+			mg = vdev_get_mg(vd, mc);
+			if ((flags & METASLAB_HINT_NEXT) && mg->mg_class == mc)
+				mg = mg->mg_next;
+		}
 	}
 	if (mg == NULL && d != 0) {
 		vd = vdev_lookup_top(spa, DVA_GET_VDEV(&dva[d - 1]));
@@ -6362,6 +6744,10 @@ ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, debug_unload, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, preload_enabled, INT, ZMOD_RW,
 	"Preload potential metaslabs during reassessment");
 
+ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, preload_lookahead_pct, UINT,
+	ZMOD_RW, "Preload free space covering this percent of the allocations "
+	"expected while a metaslab loads");
+
 ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, preload_limit, UINT, ZMOD_RW,
 	"Max number of metaslabs per group to preload");
 
@@ -6371,6 +6757,9 @@ ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, unload_delay, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, unload_delay_ms, UINT, ZMOD_RW,
 	"Delay in milliseconds after metaslab was last used before unloading");
 
+ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, compact_segs, INT, ZMOD_RW,
+	"Store segments of small metaslabs in 24-bit integers");
+
 ZFS_MODULE_PARAM(zfs_mg, zfs_mg_, noalloc_threshold, UINT, ZMOD_RW,
 	"Percentage of metaslab group size that should be free to make it "
 	"eligible for allocation");
@@ -6423,6 +6812,9 @@ ZFS_MODULE_PARAM(zfs_metaslab, zfs_metaslab_, mem_limit, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_metaslab, zfs_metaslab_, try_hard_before_gang, INT,
 	ZMOD_RW, "Try hard to allocate before ganging");
 
+ZFS_MODULE_PARAM(zfs_metaslab, metaslab_, size_index_enabled, INT, ZMOD_RW,
+	"Skip metaslab groups which cannot fit an allocation");
+
 ZFS_MODULE_PARAM(zfs_metaslab, zfs_metaslab_, find_max_tries, UINT, ZMOD_RW,
 	"Normally only consider this many of the best metaslabs in each vdev");
 
@@ -187,6 +187,17 @@ uint_t zfs_multihost_import_intervals = MMP_DEFAULT_IMPORT_INTERVALS;
  */
 uint_t zfs_multihost_fail_intervals = MMP_DEFAULT_FAIL_INTERVALS;
 
+/*
+ * Reduces the cost of mmp writes on pools built mostly from rotational disks.
+ * When set, mmp writes are directed to non-rotational leaf vdevs outside of
+ * the log class whenever one is usable, and an mmp write is not issued when
+ * a txg sync has written the uberblock since the previous mmp write period,
+ * since that already shows the pool is in use.  The rate at which activity
+ * is published is unchanged, so the import activity check is unaffected.
+ * Log devices are avoided because a pool may be imported without them.
+ */
+static uint_t zfs_multihost_low_overhead = 0;
+
 static const void *const mmp_tag = "mmp_write_uberblock";
 static __attribute__((noreturn)) void mmp_thread(void *arg);
 
@@ -281,22 +292,12 @@ typedef enum mmp_vdev_state_flag {
  */
 
 static int
-mmp_next_leaf(spa_t *spa)
+mmp_next_leaf_impl(spa_t *spa, boolean_t nonrot_only)
 {
 	vdev_t *leaf;
 	vdev_t *starting_leaf;
 	int fail_mask = 0;
 
-	ASSERT(MUTEX_HELD(&spa->spa_mmp.mmp_io_lock));
-	ASSERT(spa_config_held(spa, SCL_STATE, RW_READER));
-	ASSERT(list_link_active(&spa->spa_leaf_list.list_head) == B_TRUE);
-	ASSERT(!list_is_empty(&spa->spa_leaf_list));
-
-	if (spa->spa_mmp.mmp_leaf_last_gen != spa->spa_leaf_list_gen) {
-		spa->spa_mmp.mmp_last_leaf = list_head(&spa->spa_leaf_list);
-		spa->spa_mmp.mmp_leaf_last_gen = spa->spa_leaf_list_gen;
-	}
-
 	leaf = spa->spa_mmp.mmp_last_leaf;
 	if (leaf == NULL)
 		leaf = list_head(&spa->spa_leaf_list);
@@ -320,6 +321,9 @@ mmp_next_leaf(spa_t *spa)
 			fail_mask |= MMP_FAIL_NOT_WRITABLE;
 		} else if (leaf->vdev_ops == &vdev_draid_spare_ops) {
 			continue;
+		} else if (nonrot_only && (!leaf->vdev_nonrot ||
+		    leaf->vdev_top->vdev_islog)) {
+			continue;
 		} else if (leaf->vdev_mmp_pending != 0) {
 			fail_mask |= MMP_FAIL_WRITE_PENDING;
 		} else {
@@ -328,9 +332,49 @@ mmp_next_leaf(spa_t *spa)
 		}
 	} while (leaf != starting_leaf);
 
-	ASSERT(fail_mask);
+	ASSERT(fail_mask || nonrot_only);
 
-	return (fail_mask);
+	return (fail_mask == 0 ? MMP_FAIL_NOT_WRITABLE : fail_mask);
+}
+
+static int
+mmp_next_leaf(spa_t *spa)
+{
+	ASSERT(MUTEX_HELD(&spa->spa_mmp.mmp_io_lock));
+	ASSERT(spa_config_held(spa, SCL_STATE, RW_READER));
+	ASSERT(list_link_active(&spa->spa_leaf_list.list_head) == B_TRUE);
+	ASSERT(!list_is_empty(&spa->spa_leaf_list));
+
+	if (spa->spa_mmp.mmp_leaf_last_gen != spa->spa_leaf_list_gen) {
+		spa->spa_mmp.mmp_last_leaf = list_head(&spa->spa_leaf_list);
+		spa->spa_mmp.mmp_leaf_last_gen = spa->spa_leaf_list_gen;
+	}
+
+	/*
+	 * Fall back to any leaf when no non-rotational leaf is usable, the
+	 * fail mask then reflects the state of every leaf.
+	 */
+	if (zfs_multihost_low_overhead &&
+	    mmp_next_leaf_impl(spa, B_TRUE) == 0)
+		return (0);
+
+	return (mmp_next_leaf_impl(spa, B_FALSE));
+}
+
+/*
+ * Returns B_TRUE if a txg sync has written the uberblock since 'since'.
+ */
+static boolean_t
+mmp_synced_since(spa_t *spa, hrtime_t since)
+{
+	mmp_thread_t *mmp = &spa->spa_mmp;
+	boolean_t synced;
+
+	mutex_enter(&mmp->mmp_io_lock);
+	synced = (mmp->mmp_last_sync > since);
+	mutex_exit(&mmp->mmp_io_lock);
+
+	return (synced);
 }
 
 /*
@@ -426,6 +470,7 @@ mmp_update_uberblock(spa_t *spa, uberblock_t *ub)
 	mmp->mmp_ub = *ub;
 	mmp->mmp_seq = 1;
 	mmp->mmp_ub.ub_timestamp = gethrestime_sec();
+	mmp->mmp_last_sync = gethrtime();
 	mmp_delay_update(spa, B_TRUE);
 	mutex_exit(&mmp->mmp_io_lock);
 }
@@ -536,6 +581,7 @@ mmp_write_uberblock(spa_t *spa)
 
 	(void) spa_mmp_history_add(spa, ub->ub_txg, ub->ub_timestamp,
 	    ub->ub_mmp_delay, vd, label, vd->vdev_mmp_kstat_id, 0);
+	spa_iostats_mmp_add(spa, !vd->vdev_nonrot, vd->vdev_nonrot, 0);
 
 	zio_nowait(zio);
 }
@@ -557,6 +603,7 @@ mmp_thread(void *arg)
 	uint64_t last_mmp_interval;
 	uint32_t last_mmp_fail_intervals;
 	hrtime_t last_mmp_fail_ns;
+	hrtime_t last_mmp_slot;
 	callb_cpr_t cpr;
 	int skip_wait = 0;
 
@@ -573,6 +620,7 @@ mmp_thread(void *arg)
 	mmp->mmp_last_write = gethrtime();
 	mmp->mmp_delay = MSEC2NSEC(MMP_INTERVAL_OK(zfs_multihost_interval));
 	mutex_exit(&mmp->mmp_io_lock);
+	last_mmp_slot = gethrtime();
 
 	while (!mmp->mmp_thread_exiting) {
 		hrtime_t next_time = gethrtime() +
@@ -681,8 +729,20 @@ mmp_thread(void *arg)
 			zio_suspend(spa, NULL, ZIO_SUSPEND_MMP);
 		}
 
-		if (multihost && !suspended)
-			mmp_write_uberblock(spa);
+		/*
+		 * An uberblock written by a txg sync since the last period
+		 * already published activity, so in low overhead mode the
+		 * mmp write is folded into it.  Tunable changes are always
+		 * written out so other hosts see them promptly.
+		 */
+		if (multihost && !suspended) {
+			if (zfs_multihost_low_overhead && skip_wait == 0 &&
+			    mmp_synced_since(spa, last_mmp_slot))
+				spa_iostats_mmp_add(spa, 0, 0, 1);
+			else
+				mmp_write_uberblock(spa);
+		}
+		last_mmp_slot = gethrtime();
 
 		if (skip_wait > 0) {
 			next_time = gethrtime() + MSEC2NSEC(MMP_MIN_INTERVAL) /
@@ -746,3 +806,6 @@ ZFS_MODULE_PARAM(zfs_multihost, zfs_multihost_, fail_intervals, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_multihost, zfs_multihost_, import_intervals, UINT, ZMOD_RW,
 	"Number of zfs_multihost_interval periods to wait for activity");
+
+ZFS_MODULE_PARAM(zfs_multihost, zfs_multihost_, low_overhead, UINT, ZMOD_RW,
+	"Prefer non-rotational leaves and fold mmp writes into txg syncs");
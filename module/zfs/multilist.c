@@ -70,15 +70,19 @@ multilist_d2l(multilist_t *ml, void *obj)
  */
 static void
 multilist_create_impl(multilist_t *ml, size_t size, size_t offset,
-    uint_t num, multilist_sublist_index_func_t *index_func)
+    uint_t num, uint_t ngroups, multilist_sublist_index_func_t *index_func)
 {
 	ASSERT3U(size, >, 0);
 	ASSERT3U(size, >=, offset + sizeof (multilist_node_t));
 	ASSERT3U(num, >, 0);
+	ASSERT3U(ngroups, >, 0);
+	ASSERT0(num % ngroups);
 	ASSERT3P(index_func, !=, NULL);
 
 	ml->ml_offset = offset;
 	ml->ml_num_sublists = num;
+	ml->ml_num_groups = ngroups;
+	ml->ml_cpu_local = B_FALSE;
 	ml->ml_index_func = index_func;
 
 	ml->ml_sublists = vmem_zalloc(sizeof (multilist_sublist_t) *
@@ -95,25 +99,73 @@ multilist_create_impl(multilist_t *ml, size_t size, size_t offset,
 
 /*
  * Allocate a new multilist, using the default number of sublists (the number
- * of CPUs, or at least 4, or the tunable zfs_multilist_num_sublists). Note
- * that the multilists do not expand if more CPUs are hot-added. In that case,
- * we will have less fanout than boot_ncpus, but we don't want to always
- * reserve the RAM necessary to create the extra slots for additional CPUs up
- * front, and dynamically adding them is a complex task.
+ * of CPUs online when it is created, or at least 4, or the tunable
+ * zfs_multilist_num_sublists). Note that these multilists do not expand if
+ * more CPUs are hot-added. In that case, we will have less fanout than
+ * boot_ncpus, but we don't want to always reserve the RAM necessary to
+ * create the extra slots for additional CPUs up front, and objects placed by
+ * a hash of their contents can't be moved to a new sublist while they are
+ * linked. Long-lived multilists which can remember where each object was
+ * inserted should use multilist_create_cpu_local() instead.
  */
+static uint_t
+multilist_default_num_sublists(void)
+{
+	if (zfs_multilist_num_sublists > 0)
+		return (zfs_multilist_num_sublists);
+
+	return (MAX(boot_ncpus, 4));
+}
+
 void
 multilist_create(multilist_t *ml, size_t size, size_t offset,
     multilist_sublist_index_func_t *index_func)
 {
-	uint_t num_sublists;
+	multilist_create_impl(ml, size, offset,
+	    multilist_default_num_sublists(), 1, index_func);
+}
 
-	if (zfs_multilist_num_sublists > 0) {
-		num_sublists = zfs_multilist_num_sublists;
-	} else {
-		num_sublists = MAX(boot_ncpus, 4);
-	}
+/*
+ * Allocate a new multilist whose sublists are split into 'ngroups' equally
+ * sized, contiguous groups; group 'g' owns the sublist indices
+ * [g * multilist_get_group_sublists(), (g + 1) *
+ * multilist_get_group_sublists()).  The default number of sublists is
+ * rounded up to a multiple of 'ngroups' so that every group has the same
+ * fanout.  It is up to the index function to place objects in the right
+ * group; this is used by the ARC to keep buffers homed on different NUMA
+ * nodes on separate sublists.
+ */
+void
+multilist_create_grouped(multilist_t *ml, size_t size, size_t offset,
+    uint_t ngroups, multilist_sublist_index_func_t *index_func)
+{
+	uint_t num_sublists = roundup(multilist_default_num_sublists(),
+	    ngroups);
 
-	multilist_create_impl(ml, size, offset, num_sublists, index_func);
+	multilist_create_impl(ml, size, offset, num_sublists, ngroups,
+	    index_func);
+}
+
+/*
+ * Allocate a new multilist with a sublist for every CPU that may ever come
+ * online, so that callers can insert objects into the sublist of the current
+ * CPU (see multilist_get_cpu_index()) instead of one shared with all other
+ * CPUs, and CPUs which are hot-added later get sublists of their own.  The
+ * index function must then return the index which was used to insert each
+ * object, typically by recording it in the object.  Since the number of
+ * sublists never changes, existing objects stay valid as CPUs come and go.
+ */
+void
+multilist_create_cpu_local(multilist_t *ml, size_t size, size_t offset,
+    multilist_sublist_index_func_t *index_func)
+{
+	uint_t num_sublists = zfs_multilist_num_sublists;
+
+	if (num_sublists == 0)
+		num_sublists = MAX(max_ncpus, 4);
+
+	multilist_create_impl(ml, size, offset, num_sublists, 1, index_func);
+	ml->ml_cpu_local = B_TRUE;
 }
 
 /*
@@ -138,6 +190,8 @@ multilist_destroy(multilist_t *ml)
 	    sizeof (multilist_sublist_t) * ml->ml_num_sublists);
 
 	ml->ml_num_sublists = 0;
+	ml->ml_num_groups = 0;
+	ml->ml_cpu_local = B_FALSE;
 	ml->ml_offset = 0;
 	ml->ml_sublists = NULL;
 }
@@ -278,6 +332,32 @@ multilist_get_random_index(multilist_t *ml)
 	return (random_in_range(ml->ml_num_sublists));
 }
 
+/*
+ * Return the index of the current CPU's sublist of a multilist created with
+ * multilist_create_cpu_local().  This is only a hint; the thread may have
+ * moved to another CPU by the time the object is inserted.
+ */
+unsigned int
+multilist_get_cpu_index(multilist_t *ml)
+{
+	ASSERT(ml->ml_cpu_local);
+	return (CPU_SEQID_UNSTABLE % ml->ml_num_sublists);
+}
+
+/* Return the number of sublist groups composing this multilist */
+unsigned int
+multilist_get_num_groups(multilist_t *ml)
+{
+	return (ml->ml_num_groups);
+}
+
+/* Return the number of sublists in each group of this multilist */
+unsigned int
+multilist_get_group_sublists(multilist_t *ml)
+{
+	return (ml->ml_num_sublists / ml->ml_num_groups);
+}
+
 void
 multilist_sublist_lock(multilist_sublist_t *mls)
 {
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: CDDL-1.0
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/pcsum.h>
+
+/*
+ * Per-CPU sums are fanned-out counters for values which are updated very
+ * often and compared against a limit fairly often, such as the size of the
+ * ARC.  Like wmsums, updates only touch a CPU-local bucket; unlike wmsums,
+ * the value can be estimated cheaply and with a known maximum error, so
+ * most comparisons never have to look at the buckets.
+ *
+ * Each bucket holds the change accumulated on its CPU since it was last
+ * folded into the central value.  Updates are atomic additions to the
+ * bucket.  Once a bucket's delta reaches the batch size given to
+ * pcsum_init() it is moved into the central value under ps_lock, and
+ * updates at least as large as the batch go to the central value directly.
+ * A bucket therefore never holds more than twice the batch, and the
+ * central value is always within ps_error (2 * batch * number of buckets)
+ * of the true sum.
+ *
+ * pcsum_estimate() just reads the central value.  pcsum_compare() uses it
+ * whenever the target is outside the error band, and otherwise falls back
+ * to pcsum_value(), which folds every bucket under ps_lock.  Unlike
+ * reconciling an aggsum, folding a bucket doesn't take anything away from
+ * the CPU that owns it, so exact reads don't make later updates any more
+ * expensive.  Since folds are the only operations that take ps_lock, it
+ * is acquired roughly once per batch worth of updates on each CPU.
+ */
+
+void
+pcsum_init(pcsum_t *ps, uint64_t value, uint64_t batch)
+{
+	memset(ps, 0, sizeof (*ps));
+	mutex_init(&ps->ps_lock, NULL, MUTEX_DEFAULT, NULL);
+	ps->ps_value = value;
+	ps->ps_batch = MAX(batch, 1);
+	ps->ps_numbuckets = boot_ncpus;
+	ps->ps_error = 2 * ps->ps_batch * ps->ps_numbuckets;
+	ps->ps_buckets = kmem_zalloc(ps->ps_numbuckets *
+	    sizeof (pcsum_bucket_t), KM_SLEEP);
+}
+
+void
+pcsum_fini(pcsum_t *ps)
+{
+	kmem_free(ps->ps_buckets, ps->ps_numbuckets * sizeof (pcsum_bucket_t));
+	mutex_destroy(&ps->ps_lock);
+}
+
+/*
+ * Move one bucket's delta into the central value.  Must be called with
+ * ps_lock held, so that pcsum_value() never sees a delta in flight.
+ */
+static void
+pcsum_fold(pcsum_t *ps, pcsum_bucket_t *psb)
+{
+	ASSERT(MUTEX_HELD(&ps->ps_lock));
+	uint64_t delta = atomic_swap_64(&psb->psb_delta, 0);
+	if (delta != 0)
+		atomic_add_64(&ps->ps_value, delta);
+}
+
+void
+pcsum_add(pcsum_t *ps, int64_t delta)
+{
+	if (delta >= ps->ps_batch || delta <= -ps->ps_batch) {
+		atomic_add_64(&ps->ps_value, delta);
+		return;
+	}
+
+	pcsum_bucket_t *psb =
+	    &ps->ps_buckets[CPU_SEQID_UNSTABLE % ps->ps_numbuckets];
+	int64_t nv = (int64_t)atomic_add_64_nv(&psb->psb_delta, delta);
+	if (nv >= ps->ps_batch || nv <= -ps->ps_batch) {
+		mutex_enter(&ps->ps_lock);
+		pcsum_fold(ps, psb);
+		mutex_exit(&ps->ps_lock);
+	}
+}
+
+/*
+ * Return the central value, which is within ps_error of the sum.
+ */
+int64_t
+pcsum_estimate(pcsum_t *ps)
+{
+	return ((int64_t)atomic_load_64(&ps->ps_value));
+}
+
+/*
+ * Return the exact value of the sum, folding every bucket.
+ */
+uint64_t
+pcsum_value(pcsum_t *ps)
+{
+	mutex_enter(&ps->ps_lock);
+	for (uint_t i = 0; i < ps->ps_numbuckets; i++)
+		pcsum_fold(ps, &ps->ps_buckets[i]);
+	uint64_t value = atomic_load_64(&ps->ps_value);
+	mutex_exit(&ps->ps_lock);
+	return (value);
+}
+
+/*
+ * Compare the sum to target.  Returns -1 if the sum is less than target, 1
+ * if it's greater, and 0 if they are equal.  Only targets within the error
+ * band of the estimate require the buckets to be folded.
+ */
+int
+pcsum_compare(pcsum_t *ps, uint64_t target)
+{
+	int64_t est = pcsum_estimate(ps);
+	int64_t err = ps->ps_error;
+
+	if (est + err < 0 || (uint64_t)(est + err) < target)
+		return (-1);
+	if (est - err > 0 && (uint64_t)(est - err) > target)
+		return (1);
+
+	uint64_t value = pcsum_value(ps);
+	return (value < target ? -1 : value > target ? 1 : 0);
+}
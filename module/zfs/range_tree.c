@@ -91,6 +91,9 @@ zfs_rs_copy(zfs_range_seg_t *src, zfs_range_seg_t *dest, zfs_range_tree_t *rt)
 	case ZFS_RANGE_SEG_GAP:
 		size = sizeof (zfs_range_seg_gap_t);
 		break;
+	case ZFS_RANGE_SEG24:
+		size = sizeof (zfs_range_seg24_t);
+		break;
 	default:
 		__builtin_unreachable();
 	}
@@ -192,14 +195,84 @@ zfs_range_tree_seg_gap_compare(const void *x1, const void *x2)
 	return ((r1->rs_start >= r2->rs_end) - (r1->rs_end <= r2->rs_start));
 }
 
-ZFS_BTREE_FIND_IN_BUF_FUNC(zfs_range_tree_seg32_find_in_buf, zfs_range_seg32_t,
+__attribute__((always_inline)) inline
+static int
+zfs_range_tree_seg24_compare(const void *x1, const void *x2)
+{
+	const zfs_range_seg24_t *r1 = x1;
+	const zfs_range_seg24_t *r2 = x2;
+	uint32_t r1_start = zfs_rs24_get(r1->rs_start);
+	uint32_t r1_end = zfs_rs24_get(r1->rs_end);
+	uint32_t r2_start = zfs_rs24_get(r2->rs_start);
+	uint32_t r2_end = zfs_rs24_get(r2->rs_end);
+
+	ASSERT3U(r1_start, <=, r1_end);
+	ASSERT3U(r2_start, <=, r2_end);
+
+	return ((r1_start >= r2_end) - (r1_end <= r2_start));
+}
+
+/*
+ * Segments in a range tree never overlap, so a (non-empty) segment sorts
+ * before the search range exactly when it ends at or before the start of
+ * the search range.  This lets the searches below get away with a single
+ * comparison per element.
+ */
+__attribute__((always_inline)) inline
+static int
+zfs_range_tree_seg32_before(const void *x1, const void *x2)
+{
+	const zfs_range_seg32_t *r1 = x1;
+	const zfs_range_seg32_t *r2 = x2;
+
+	return (r1->rs_end <= r2->rs_start);
+}
+
+__attribute__((always_inline)) inline
+static int
+zfs_range_tree_seg64_before(const void *x1, const void *x2)
+{
+	const zfs_range_seg64_t *r1 = x1;
+	const zfs_range_seg64_t *r2 = x2;
+
+	return (r1->rs_end <= r2->rs_start);
+}
+
+__attribute__((always_inline)) inline
+static int
+zfs_range_tree_seg_gap_before(const void *x1, const void *x2)
+{
+	const zfs_range_seg_gap_t *r1 = x1;
+	const zfs_range_seg_gap_t *r2 = x2;
+
+	return (r1->rs_end <= r2->rs_start);
+}
+
+__attribute__((always_inline)) inline
+static int
+zfs_range_tree_seg24_before(const void *x1, const void *x2)
+{
+	const zfs_range_seg24_t *r1 = x1;
+	const zfs_range_seg24_t *r2 = x2;
+
+	return (zfs_rs24_get(r1->rs_end) <= zfs_rs24_get(r2->rs_start));
+}
+
+ZFS_BTREE_FIND_IN_BUF_SORTED_FUNC(zfs_range_tree_seg32_find_in_buf,
+    zfs_range_seg32_t, zfs_range_tree_seg32_before,
     zfs_range_tree_seg32_compare)
 
-ZFS_BTREE_FIND_IN_BUF_FUNC(zfs_range_tree_seg64_find_in_buf, zfs_range_seg64_t,
+ZFS_BTREE_FIND_IN_BUF_SORTED_FUNC(zfs_range_tree_seg64_find_in_buf,
+    zfs_range_seg64_t, zfs_range_tree_seg64_before,
     zfs_range_tree_seg64_compare)
 
-ZFS_BTREE_FIND_IN_BUF_FUNC(zfs_range_tree_seg_gap_find_in_buf,
-    zfs_range_seg_gap_t, zfs_range_tree_seg_gap_compare)
+ZFS_BTREE_FIND_IN_BUF_SORTED_FUNC(zfs_range_tree_seg_gap_find_in_buf,
+    zfs_range_seg_gap_t, zfs_range_tree_seg_gap_before,
+    zfs_range_tree_seg_gap_compare)
+
+ZFS_BTREE_FIND_IN_BUF_SORTED_FUNC(zfs_range_tree_seg24_find_in_buf,
+    zfs_range_seg24_t, zfs_range_tree_seg24_before,
+    zfs_range_tree_seg24_compare)
 
 static zfs_range_tree_t *
 zfs_range_tree_create_impl(const zfs_range_tree_ops_t *ops,
@@ -229,6 +302,11 @@ zfs_range_tree_create_impl(const zfs_range_tree_ops_t *ops,
 		compare = zfs_range_tree_seg_gap_compare;
 		bt_find = zfs_range_tree_seg_gap_find_in_buf;
 		break;
+	case ZFS_RANGE_SEG24:
+		size = sizeof (zfs_range_seg24_t);
+		compare = zfs_range_tree_seg24_compare;
+		bt_find = zfs_range_tree_seg24_find_in_buf;
+		break;
 	default:
 		panic("Invalid range seg type %d", type);
 	}
@@ -472,6 +550,172 @@ zfs_range_tree_add(void *arg, uint64_t start, uint64_t size)
 	zfs_range_tree_add_impl(arg, start, size, size);
 }
 
+/*
+ * Append the segment [start, end) to a tree whose segments all end before
+ * start.  No search is needed, and a tree that is built only by appending
+ * stays in the btree's bulk-insert mode, which fills leaves completely
+ * instead of splitting them in half.
+ */
+static void
+zfs_range_tree_append(zfs_range_tree_t *rt, uint64_t start, uint64_t end)
+{
+	zfs_btree_index_t where = {0};
+	zfs_range_seg_max_t tmp;
+	zfs_range_seg_t *rs = &tmp;
+
+	if (zfs_btree_last(&rt->rt_root, &where) != NULL) {
+		where.bti_offset++;
+		where.bti_before = B_TRUE;
+	}
+
+	zfs_rs_set_start(rs, rt, start);
+	zfs_rs_set_end(rs, rt, end);
+	zfs_rs_set_fill(rs, rt, end - start);
+	zfs_btree_add_idx(&rt->rt_root, rs, &where);
+
+	if (rt->rt_ops != NULL && rt->rt_ops->rtop_add != NULL)
+		rt->rt_ops->rtop_add(rt, rs, rt->rt_arg);
+
+	zfs_range_tree_stat_incr(rt, rs);
+	rt->rt_space += end - start;
+}
+
+/*
+ * Add a segment from a stream of segments sorted by offset, such as one
+ * produced by walking another range tree.  Segments that start at or after
+ * the end of the tree are appended, or merged into the last segment,
+ * without searching the tree; any other segment, and any segment added to
+ * a gap-supporting tree, is added with zfs_range_tree_add().
+ */
+void
+zfs_range_tree_add_sorted(void *arg, uint64_t start, uint64_t size)
+{
+	zfs_range_tree_t *rt = arg;
+	zfs_range_seg_t *rs;
+	uint64_t end = start + size;
+
+	ASSERT3U(size, !=, 0);
+	ASSERT3U(end, >, start);
+
+	rs = zfs_btree_last(&rt->rt_root, NULL);
+	if (rt->rt_gap != 0 || (rs != NULL && zfs_rs_get_end(rs, rt) > start)) {
+		zfs_range_tree_add_impl(rt, start, size, size);
+		return;
+	}
+
+	if (rs == NULL || zfs_rs_get_end(rs, rt) < start) {
+		zfs_range_tree_append(rt, start, end);
+		return;
+	}
+
+	if (rt->rt_ops != NULL && rt->rt_ops->rtop_remove != NULL)
+		rt->rt_ops->rtop_remove(rt, rs, rt->rt_arg);
+
+	zfs_range_tree_stat_decr(rt, rs);
+
+	uint64_t fill = zfs_rs_get_fill(rs, rt);
+	zfs_rs_set_end(rs, rt, end);
+	zfs_rs_set_fill(rs, rt, fill + size);
+
+	if (rt->rt_ops != NULL && rt->rt_ops->rtop_add != NULL)
+		rt->rt_ops->rtop_add(rt, rs, rt->rt_arg);
+
+	zfs_range_tree_stat_incr(rt, rs);
+	rt->rt_space += size;
+}
+
+/*
+ * Add every segment of src to dst, leaving src unchanged.  This is
+ * equivalent to zfs_range_tree_walk(src, zfs_range_tree_add, dst), but when
+ * src is large compared to dst, dst is rebuilt bottom-up from a single
+ * ordered pass over both trees instead of searching it once per segment.
+ */
+void
+zfs_range_tree_merge(zfs_range_tree_t *src, zfs_range_tree_t *dst)
+{
+	uint64_t src_segs = zfs_range_tree_numsegs(src);
+	uint64_t dst_segs = zfs_range_tree_numsegs(dst);
+	zfs_btree_index_t where;
+	zfs_range_seg_t *rs;
+
+	if (src_segs == 0)
+		return;
+
+	/*
+	 * Adding src one segment at a time costs a search of dst for each
+	 * segment, unless src lies entirely after dst.  Rebuilding costs a
+	 * pass over both trees and, if dst has callbacks, another call to
+	 * them for every segment of dst.
+	 */
+	boolean_t after = zfs_range_tree_min(src) >= zfs_range_tree_max(dst);
+	uint64_t threshold = (dst->rt_ops != NULL) ? dst_segs :
+	    dst_segs / MAX(highbit64(dst_segs), 1);
+	if (after || dst->rt_gap != 0 || src_segs < threshold) {
+		zfs_range_tree_func_t *func = after ?
+		    zfs_range_tree_add_sorted : zfs_range_tree_add;
+		for (rs = zfs_btree_first(&src->rt_root, &where); rs != NULL;
+		    rs = zfs_btree_next(&src->rt_root, &where, &where)) {
+			func(dst, zfs_rs_get_start(rs, src),
+			    zfs_rs_get_end(rs, src) - zfs_rs_get_start(rs, src));
+		}
+		return;
+	}
+
+	zfs_btree_t old = dst->rt_root;
+	zfs_btree_create_custom(&dst->rt_root, old.bt_compar,
+	    old.bt_find_in_buf, old.bt_elem_size, old.bt_leaf_size);
+
+	if (dst->rt_ops != NULL && dst->rt_ops->rtop_vacate != NULL)
+		dst->rt_ops->rtop_vacate(dst, dst->rt_arg);
+	memset(dst->rt_histogram, 0, sizeof (dst->rt_histogram));
+	dst->rt_space = 0;
+
+	zfs_btree_index_t dst_where, src_where;
+	zfs_range_seg_t *dst_rs = zfs_btree_first(&old, &dst_where);
+	zfs_range_seg_t *src_rs = zfs_btree_first(&src->rt_root, &src_where);
+	uint64_t start = 0, end = 0;
+
+	while (dst_rs != NULL || src_rs != NULL) {
+		uint64_t rstart, rend;
+
+		if (src_rs == NULL || (dst_rs != NULL &&
+		    zfs_rs_get_start(dst_rs, dst) <=
+		    zfs_rs_get_start(src_rs, src))) {
+			rstart = zfs_rs_get_start(dst_rs, dst);
+			rend = zfs_rs_get_end(dst_rs, dst);
+			dst_rs = zfs_btree_next(&old, &dst_where, &dst_where);
+		} else {
+			rstart = zfs_rs_get_start(src_rs, src);
+			rend = zfs_rs_get_end(src_rs, src);
+			src_rs = zfs_btree_next(&src->rt_root, &src_where,
+			    &src_where);
+		}
+
+		if (start == end || end < rstart) {
+			if (start != end)
+				zfs_range_tree_append(dst, start, end);
+			start = rstart;
+			end = rend;
+			continue;
+		}
+
+		if (end > rstart) {
+			zfs_panic_recover("zfs: rt=%s: merging segment "
+			    "(offset=%llx size=%llx) overlapping with existing "
+			    "one (offset=%llx size=%llx)",
+			    ZFS_RT_NAME(dst),
+			    (longlong_t)rstart, (longlong_t)(rend - rstart),
+			    (longlong_t)start, (longlong_t)(end - start));
+		}
+		end = MAX(end, rend);
+	}
+	if (start != end)
+		zfs_range_tree_append(dst, start, end);
+
+	zfs_btree_clear(&old);
+	zfs_btree_destroy(&old);
+}
+
 static void
 zfs_range_tree_remove_impl(zfs_range_tree_t *rt, uint64_t start, uint64_t size,
     boolean_t do_fill)
@@ -830,7 +1074,7 @@ zfs_range_tree_remove_xor_add_segment(uint64_t start, uint64_t end,
 
 		/* there is no overlap */
 		if (end <= zfs_rs_get_start(curr, removefrom)) {
-			zfs_range_tree_add(addto, start, end - start);
+			zfs_range_tree_add_sorted(addto, start, end - start);
 			return;
 		}
 
@@ -845,8 +1089,10 @@ zfs_range_tree_remove_xor_add_segment(uint64_t start, uint64_t end,
 
 		zfs_range_tree_remove(removefrom, overlap_start, overlap_size);
 
-		if (start < overlap_start)
-			zfs_range_tree_add(addto, start, overlap_start - start);
+		if (start < overlap_start) {
+			zfs_range_tree_add_sorted(addto, start,
+			    overlap_start - start);
+		}
 
 		start = overlap_end;
 		next = zfs_btree_find(&removefrom->rt_root, &rs, &where);
@@ -871,7 +1117,7 @@ zfs_range_tree_remove_xor_add_segment(uint64_t start, uint64_t end,
 
 	if (start != end) {
 		VERIFY3U(start, <, end);
-		zfs_range_tree_add(addto, start, end - start);
+		zfs_range_tree_add_sorted(addto, start, end - start);
 	} else {
 		VERIFY3U(start, ==, end);
 	}
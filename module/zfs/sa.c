@@ -1422,6 +1422,7 @@ sa_handle_get_from_db(objset_t *os, dmu_buf_t *db, void *userp,
 		handle->sa_spill = NULL;
 		handle->sa_bonus_tab = NULL;
 		handle->sa_spill_tab = NULL;
+		handle->sa_gen = 0;
 
 		error = sa_build_index(handle, SA_BONUS);
 
@@ -1883,6 +1884,7 @@ sa_replace_all_by_template_locked(sa_handle_t *hdl, sa_bulk_attr_t *attr_desc,
 
 	if (sa->sa_need_attr_registration)
 		sa_attr_register_sync(hdl, tx);
+	atomic_inc_64(&hdl->sa_gen);
 	return (sa_build_layouts(hdl, attr_desc, attr_count, tx));
 }
 
@@ -2071,6 +2073,7 @@ sa_bulk_update_impl(sa_handle_t *hdl, sa_bulk_attr_t *bulk, int count,
 		sa_attr_register_sync(hdl, tx);
 
 	error = sa_attr_op(hdl, bulk, count, SA_UPDATE, tx);
+	atomic_inc_64(&hdl->sa_gen);
 	if (error == 0 && !IS_SA_BONUSTYPE(bonustype) && sa->sa_update_cb)
 		sa->sa_update_cb(hdl, tx);
 
@@ -2158,6 +2161,7 @@ sa_remove(sa_handle_t *hdl, sa_attr_type_t attr, dmu_tx_t *tx)
 	mutex_enter(&hdl->sa_lock);
 	error = sa_modify_attrs(hdl, attr, SA_REMOVE, NULL,
 	    NULL, 0, tx);
+	atomic_inc_64(&hdl->sa_gen);
 	mutex_exit(&hdl->sa_lock);
 	return (error);
 }
@@ -2181,6 +2185,21 @@ sa_set_userp(sa_handle_t *hdl, void *ptr)
 	hdl->sa_userp = ptr;
 }
 
+/*
+ * Return a count that changes whenever the handle's attributes are updated,
+ * so that callers keeping copies of attribute values can tell when they're
+ * stale.  Values looked up after this returns are at least as new as the
+ * count.
+ */
+uint64_t
+sa_handle_gen(sa_handle_t *hdl)
+{
+	uint64_t gen = atomic_load_64(&hdl->sa_gen);
+
+	membar_consumer();
+	return (gen);
+}
+
 dmu_buf_t *
 sa_get_db(sa_handle_t *hdl)
 {
@@ -2274,6 +2293,7 @@ EXPORT_SYMBOL(sa_object_info);
 EXPORT_SYMBOL(sa_object_size);
 EXPORT_SYMBOL(sa_get_userdata);
 EXPORT_SYMBOL(sa_set_userp);
+EXPORT_SYMBOL(sa_handle_gen);
 EXPORT_SYMBOL(sa_get_db);
 EXPORT_SYMBOL(sa_handle_object);
 EXPORT_SYMBOL(sa_register_update_callback);
@@ -218,6 +218,19 @@ static const boolean_t spa_create_process = B_TRUE; /* no process => no sysdc */
 
 static uint_t	zio_taskq_write_tpq = 16;
 
+/*
+ * Split the scaled zio taskqs evenly across NUMA nodes, binding each
+ * taskq's threads to its node, and dispatch to the current node's taskqs.
+ */
+static int	zio_taskq_numa = 0;
+
+/*
+ * How write I/Os are assigned to an allocator when they are not issued by
+ * a sync thread: 0 hashes the block's bookmark, 1 maps each CPU to its own
+ * allocator, and 2 gives each NUMA node its own set of allocators.
+ */
+static uint_t	spa_allocator_affinity = 0;
+
 /*
  * Report any spa_load_verify errors found, but do not fail spa_load.
  * This is used by zdb to analyze non-idle pools.
@@ -346,6 +359,13 @@ static uint_t spa_note_txg_time = 10 * 60;
  */
 static uint_t spa_flush_txg_time = 10 * 60;
 
+/*
+ * Issue the frees processed by spa_sync() ordered by vdev and offset, so
+ * that they are applied one metaslab at a time rather than in the order
+ * the blocks were freed.
+ */
+static int spa_sort_frees = B_TRUE;
+
 /*
  * ==========================================================================
  * SPA properties routines
@@ -757,6 +777,7 @@ spa_prop_validate(spa_t *spa, nvlist_t *props)
 			break;
 
 		case ZPOOL_PROP_DEDUP_TABLE_QUOTA:
+		case ZPOOL_PROP_DEDUP_TABLE_ARC_RESERVE:
 			error = nvpair_value_uint64(elem, &intval);
 			break;
 
@@ -1170,7 +1191,7 @@ spa_taskqs_init(spa_t *spa, zio_type_t t, zio_taskq_type_t q)
 	uint_t value = ztip->zti_value;
 	uint_t count = ztip->zti_count;
 	spa_taskqs_t *tqs = &spa->spa_zio_taskq[t][q];
-	uint_t cpus, flags = TASKQ_DYNAMIC;
+	uint_t cpus, nodes = 1, flags = TASKQ_DYNAMIC;
 
 	switch (mode) {
 	case ZTI_MODE_FIXED:
@@ -1234,6 +1255,15 @@ spa_taskqs_init(spa_t *spa, zio_type_t t, zio_taskq_type_t q)
 		}
 		/* Limit each taskq within 100% to not trigger assertion. */
 		count = MAX(count, (zio_taskq_batch_pct + 99) / 100);
+
+		/*
+		 * Give every NUMA node the same number of taskqs, so that
+		 * taskq i can be bound to node (i % nodes).
+		 */
+		if (zio_taskq_numa && max_nnodes > 1) {
+			nodes = max_nnodes;
+			count = roundup(count, nodes);
+		}
 		value = (zio_taskq_batch_pct + count / 2) / count;
 		break;
 
@@ -1250,7 +1280,9 @@ spa_taskqs_init(spa_t *spa, zio_type_t t, zio_taskq_type_t q)
 	}
 
 	ASSERT3U(count, >, 0);
+	ASSERT0(count % nodes);
 	tqs->stqs_count = count;
+	tqs->stqs_nodes = nodes;
 	tqs->stqs_taskq = kmem_alloc(count * sizeof (taskq_t *), KM_SLEEP);
 
 	for (uint_t i = 0; i < count; i++) {
@@ -1279,8 +1311,13 @@ spa_taskqs_init(spa_t *spa, zio_type_t t, zio_taskq_type_t q)
 			const pri_t pri = (t == ZIO_TYPE_WRITE &&
 			    q == ZIO_TASKQ_ISSUE) ?
 			    wtqclsyspri : maxclsyspri;
-			tq = taskq_create_proc(name, value, pri, 50,
-			    INT_MAX, spa->spa_proc, flags);
+			if (nodes > 1) {
+				tq = taskq_create_node(name, value, pri, 50,
+				    INT_MAX, flags, i % nodes);
+			} else {
+				tq = taskq_create_proc(name, value, pri, 50,
+				    INT_MAX, spa->spa_proc, flags);
+			}
 #ifdef HAVE_SYSDC
 		}
 #endif
@@ -1605,6 +1642,19 @@ spa_taskq_dispatch(spa_t *spa, zio_type_t t, zio_taskq_type_t q,
 	} else if ((t == ZIO_TYPE_WRITE) && (q == ZIO_TASKQ_ISSUE) &&
 	    ZIO_HAS_ALLOCATOR(zio)) {
 		tq = tqs->stqs_taskq[zio->io_allocator % tqs->stqs_count];
+	} else if (tqs->stqs_nodes > 1) {
+		/*
+		 * Stay on the current NUMA node.  For the interrupt taskqs
+		 * this is the node whose CPU took the device's completion
+		 * interrupt, so checksum verification and decompression
+		 * run next to the data.
+		 */
+		uint_t nodes = tqs->stqs_nodes;
+		uint_t node = CPU_NODEID_UNSTABLE % nodes;
+		uint_t per_node = tqs->stqs_count / nodes;
+
+		tq = tqs->stqs_taskq[node +
+		    nodes * (((uint64_t)gethrtime()) % per_node)];
 	} else {
 		tq = tqs->stqs_taskq[((uint64_t)gethrtime()) % tqs->stqs_count];
 	}
@@ -2074,6 +2124,10 @@ spa_destroy_aux_threads(spa_t *spa)
 		zthr_destroy(spa->spa_raidz_expand_zthr);
 		spa->spa_raidz_expand_zthr = NULL;
 	}
+	if (spa->spa_ddt_prune_zthr != NULL) {
+		zthr_destroy(spa->spa_ddt_prune_zthr);
+		spa->spa_ddt_prune_zthr = NULL;
+	}
 }
 
 static void
@@ -3491,6 +3545,11 @@ spa_spawn_aux_threads(spa_t *spa)
 	    zthr_create("z_checkpoint_discard",
 	    spa_checkpoint_discard_thread_check,
 	    spa_checkpoint_discard_thread, spa, minclsyspri);
+
+	ASSERT0P(spa->spa_ddt_prune_zthr);
+	spa->spa_ddt_prune_zthr =
+	    zthr_create_timer("z_ddt_prune", ddt_prune_thread_check,
+	    ddt_prune_thread, spa, SEC2NSEC(1), minclsyspri);
 }
 
 /*
@@ -4958,6 +5017,8 @@ spa_ld_get_props(spa_t *spa)
 		spa_prop_find(spa, ZPOOL_PROP_AUTOEXPAND, &spa->spa_autoexpand);
 		spa_prop_find(spa, ZPOOL_PROP_DEDUP_TABLE_QUOTA,
 		    &spa->spa_dedup_table_quota);
+		spa_prop_find(spa, ZPOOL_PROP_DEDUP_TABLE_ARC_RESERVE,
+		    &spa->spa_dedup_table_arc_reserve);
 		spa_prop_find(spa, ZPOOL_PROP_MULTIHOST, &spa->spa_multihost);
 		spa_prop_find(spa, ZPOOL_PROP_AUTOTRIM, &spa->spa_autotrim);
 		spa->spa_autoreplace = (autoreplace != 0);
@@ -6032,14 +6093,12 @@ spa_open_common(const char *pool, spa_t **spapp, const void *tag,
 
 	spa_open_ref(spa, tag);
 
-	if (config != NULL)
-		*config = spa_config_generate(spa, NULL, -1ULL, B_TRUE);
-
 	/*
 	 * If we've recovered the pool, pass back any information we
 	 * gathered while doing the load.
 	 */
 	if (state == SPA_LOAD_RECOVER && config != NULL) {
+		*config = spa_config_generate(spa, NULL, -1ULL, B_TRUE);
 		fnvlist_add_nvlist(*config, ZPOOL_CONFIG_LOAD_INFO,
 		    spa->spa_load_info);
 	}
@@ -6051,6 +6110,16 @@ spa_open_common(const char *pool, spa_t **spapp, const void *tag,
 		mutex_exit(&spa_namespace_lock);
 	}
 
+	/*
+	 * Otherwise the config, which carries the stats of every vdev and
+	 * is expensive to generate for large pools, is built after dropping
+	 * spa_namespace_lock so that frequent ZFS_IOC_POOL_STATS callers do
+	 * not stall other pool operations.  Our open reference keeps the
+	 * pool from being exported or destroyed in the meantime.
+	 */
+	if (state != SPA_LOAD_RECOVER && config != NULL)
+		*config = spa_config_generate(spa, NULL, -1ULL, B_TRUE);
+
 	if (firstopen)
 		zvol_create_minors(spa_name(spa));
 
@@ -6817,6 +6886,9 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	spa->spa_autotrim = zpool_prop_default_numeric(ZPOOL_PROP_AUTOTRIM);
 	spa->spa_dedup_table_quota =
 	    zpool_prop_default_numeric(ZPOOL_PROP_DEDUP_TABLE_QUOTA);
+	spa->spa_dedup_table_arc_reserve =
+	    zpool_prop_default_numeric(ZPOOL_PROP_DEDUP_TABLE_ARC_RESERVE);
+	ddt_arc_reserve_update(spa);
 
 	if (props != NULL) {
 		spa_configfile_set(spa, props, B_FALSE);
@@ -9099,6 +9171,17 @@ spa_scrub_pause_resume(spa_t *spa, pool_scrub_cmd_t cmd)
 	return (dsl_scrub_set_pause_resume(spa->spa_dsl_pool, cmd));
 }
 
+int
+spa_scan_set_throttle(spa_t *spa, uint64_t rate, uint64_t latency)
+{
+	ASSERT0(spa_config_held(spa, SCL_ALL, RW_WRITER));
+
+	if (!spa_writeable(spa))
+		return (SET_ERROR(EROFS));
+
+	return (dsl_scan_set_throttle(spa->spa_dsl_pool, rate, latency));
+}
+
 int
 spa_scan_stop(spa_t *spa)
 {
@@ -9414,6 +9497,10 @@ spa_async_suspend(spa_t *spa)
 	zthr_t *ll_condense_thread = spa->spa_livelist_condense_zthr;
 	if (ll_condense_thread != NULL)
 		zthr_cancel(ll_condense_thread);
+
+	zthr_t *ddt_prune_zthr = spa->spa_ddt_prune_zthr;
+	if (ddt_prune_zthr != NULL)
+		zthr_cancel(ddt_prune_zthr);
 }
 
 void
@@ -9444,6 +9531,10 @@ spa_async_resume(spa_t *spa)
 	zthr_t *ll_condense_thread = spa->spa_livelist_condense_zthr;
 	if (ll_condense_thread != NULL)
 		zthr_resume(ll_condense_thread);
+
+	zthr_t *ddt_prune_zthr = spa->spa_ddt_prune_zthr;
+	if (ddt_prune_zthr != NULL)
+		zthr_resume(ddt_prune_zthr);
 }
 
 static boolean_t
@@ -9539,6 +9630,16 @@ bpobj_spa_free_sync_cb(void *arg, const blkptr_t *bp, boolean_t bp_freed,
 	return (spa_free_sync_cb(arg, bp, tx));
 }
 
+static int
+bpobj_spa_free_append_cb(void *arg, const blkptr_t *bp, boolean_t bp_freed,
+    dmu_tx_t *tx)
+{
+	(void) tx;
+	ASSERT(!bp_freed);
+	bplist_append(arg, bp);
+	return (0);
+}
+
 /*
  * Note: this simple function is not inlined to make it easier to dtrace the
  * amount of time spent syncing frees.
@@ -9547,7 +9648,10 @@ static void
 spa_sync_frees(spa_t *spa, bplist_t *bpl, dmu_tx_t *tx)
 {
 	zio_t *zio = zio_root(spa, NULL, NULL, 0);
-	bplist_iterate(bpl, spa_free_sync_cb, zio, tx);
+	if (spa_sort_frees)
+		bplist_iterate_sorted(bpl, spa_free_sync_cb, zio, tx);
+	else
+		bplist_iterate(bpl, spa_free_sync_cb, zio, tx);
 	VERIFY0(zio_wait(zio));
 }
 
@@ -9574,8 +9678,22 @@ spa_sync_deferred_frees(spa_t *spa, dmu_tx_t *tx)
 	 * deferred frees from the previous TXG.
 	 */
 	zio_t *zio = zio_root(spa, NULL, NULL, 0);
-	VERIFY3U(bpobj_iterate(&spa->spa_deferred_bpobj,
-	    bpobj_spa_free_sync_cb, zio, tx), ==, 0);
+	if (spa_sort_frees) {
+		/*
+		 * The deferred frees hold at most one txg worth of frees, so
+		 * gather them in memory and issue them sorted.
+		 */
+		bplist_t bpl;
+
+		bplist_create(&bpl);
+		VERIFY3U(bpobj_iterate(&spa->spa_deferred_bpobj,
+		    bpobj_spa_free_append_cb, &bpl, tx), ==, 0);
+		bplist_iterate_sorted(&bpl, spa_free_sync_cb, zio, tx);
+		bplist_destroy(&bpl);
+	} else {
+		VERIFY3U(bpobj_iterate(&spa->spa_deferred_bpobj,
+		    bpobj_spa_free_sync_cb, zio, tx), ==, 0);
+	}
 	VERIFY0(zio_wait(zio));
 }
 
@@ -9995,6 +10113,11 @@ spa_sync_props(void *arg, dmu_tx_t *tx)
 				case ZPOOL_PROP_DEDUP_TABLE_QUOTA:
 					spa->spa_dedup_table_quota = intval;
 					break;
+				case ZPOOL_PROP_DEDUP_TABLE_ARC_RESERVE:
+					spa->spa_dedup_table_arc_reserve =
+					    intval;
+					ddt_arc_reserve_update(spa);
+					break;
 				default:
 					break;
 				}
@@ -10165,8 +10288,12 @@ spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx)
 		spa_sync_aux_dev(spa, &spa->spa_l2cache, tx,
 		    ZPOOL_CONFIG_L2CACHE, DMU_POOL_L2CACHE);
 		spa_errlog_sync(spa, txg);
+
+		spa_txg_history_phase_start(spa);
 		dsl_pool_sync(dp, txg);
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_DSL_POOL);
 
+		spa_txg_history_phase_start(spa);
 		if (pass < zfs_sync_pass_deferred_free ||
 		    spa_feature_is_active(spa, SPA_FEATURE_LOG_SPACEMAP)) {
 			/*
@@ -10185,20 +10312,34 @@ spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx)
 			bplist_iterate(free_bpl, bpobj_enqueue_alloc_cb,
 			    &spa->spa_deferred_bpobj, tx);
 		}
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_FREES);
 
+		spa_txg_history_phase_start(spa);
 		brt_sync(spa, txg);
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_BRT);
+
+		spa_txg_history_phase_start(spa);
 		ddt_sync(spa, txg);
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_DDT);
+
+		spa_txg_history_phase_start(spa);
 		dsl_scan_sync(dp, tx);
 		dsl_errorscrub_sync(dp, tx);
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_SCAN);
+
 		svr_sync(spa, tx);
 		spa_sync_upgrades(spa, tx);
 
+		spa_txg_history_phase_start(spa);
 		spa_flush_metaslabs(spa, tx);
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_LOG_FLUSH);
 
+		spa_txg_history_phase_start(spa);
 		vdev_t *vd = NULL;
 		while ((vd = txg_list_remove(&spa->spa_vdev_txg_list, txg))
 		    != NULL)
 			vdev_sync(vd, txg);
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_VDEV);
 
 		if (pass == 1) {
 			/*
@@ -10245,7 +10386,9 @@ spa_sync_iterate_to_convergence(spa_t *spa, dmu_tx_t *tx)
 			break;
 		}
 
+		spa_txg_history_phase_start(spa);
 		spa_sync_deferred_frees(spa, tx);
+		spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_DEFERRED_FREES);
 	} while (dmu_objset_is_dirty(mos, txg));
 }
 
@@ -10349,6 +10492,8 @@ spa_sync(spa_t *spa, uint64_t txg)
 
 	spa->spa_syncing_txg = txg;
 	spa->spa_sync_pass = 0;
+	memset(spa->spa_sync_phase_time, 0, sizeof (spa->spa_sync_phase_time));
+	memset(spa->spa_sync_phase_ios, 0, sizeof (spa->spa_sync_phase_ios));
 
 	/*
 	 * If there are any pending vdev state changes, convert them
@@ -10384,6 +10529,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 	dmu_tx_t *tx = dmu_tx_create_assigned(dp, txg);
 
 	spa->spa_sync_starttime = gethrtime();
+	zio_complevel_auto_update(spa);
 
 	taskq_cancel_id(system_delay_taskq, spa->spa_deadman_tqid);
 	spa->spa_deadman_tqid = taskq_dispatch_delay(system_delay_taskq,
@@ -10439,11 +10585,14 @@ spa_sync(spa_t *spa, uint64_t txg)
 		ASSERT0(spa->spa_vdev_removal->svr_bytes_done[txg & TXG_MASK]);
 	}
 
+	spa_txg_history_phase_start(spa);
 	spa_sync_rewrite_vdev_config(spa, tx);
+	spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_CONFIG);
 	dmu_tx_commit(tx);
 
 	taskq_cancel_id(system_delay_taskq, spa->spa_deadman_tqid);
 	spa->spa_deadman_tqid = 0;
+	spa->spa_sync_lasttime = gethrtime() - spa->spa_sync_starttime;
 
 	/*
 	 * Clear the dirty config list.
@@ -10461,6 +10610,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 		spa->spa_config_syncing = NULL;
 	}
 
+	spa_txg_history_phase_start(spa);
 	dsl_pool_sync_done(dp, txg);
 
 	/*
@@ -10469,6 +10619,7 @@ spa_sync(spa_t *spa, uint64_t txg)
 	while ((vd = txg_list_remove(&spa->spa_vdev_txg_list, TXG_CLEAN(txg)))
 	    != NULL)
 		vdev_sync_done(vd, txg);
+	spa_txg_history_phase_end(spa, SPA_SYNC_PHASE_DONE);
 
 	metaslab_class_evict_old(spa->spa_normal_class, txg);
 	metaslab_class_evict_old(spa->spa_log_class, txg);
@@ -10505,6 +10656,8 @@ spa_sync(spa_t *spa, uint64_t txg)
 	spa->spa_ubsync = spa->spa_uberblock;
 	spa_config_exit(spa, SCL_CONFIG, FTAG);
 
+	(void) spa_txg_history_set_phases(spa, txg);
+
 	spa_handle_ignored_writes(spa);
 
 	/*
@@ -10616,6 +10769,34 @@ spa_rel_allocator(spa_t *spa, uint_t allocator)
 		spa->spa_allocs_use->sau_inuse[allocator] = B_FALSE;
 }
 
+/*
+ * Returns the allocator for the current CPU, or -1 when allocator affinity
+ * is disabled.  With per-CPU affinity each allocator serves a contiguous
+ * range of CPUs.  With per-node affinity the allocators are split evenly
+ * between the NUMA nodes and the CPUs of each node share its allocators.
+ */
+int
+spa_affinity_allocator(spa_t *spa)
+{
+	uint_t count = spa->spa_alloc_count;
+	uint_t cpu = CPU_SEQID_UNSTABLE;
+
+	if (spa_allocator_affinity == 0)
+		return (-1);
+
+	if (spa_allocator_affinity == 2 && max_nnodes > 1) {
+		uint_t node = CPU_NODEID_UNSTABLE;
+
+		if (count < max_nnodes)
+			return (node % count);
+
+		uint_t per_node = count / max_nnodes;
+		return (node * per_node + cpu % per_node);
+	}
+
+	return ((uint64_t)cpu * count / MAX(boot_ncpus, 1) % count);
+}
+
 void
 spa_select_allocator(zio_t *zio)
 {
@@ -10649,6 +10830,17 @@ spa_select_allocator(zio_t *zio)
 		}
 	}
 
+	/*
+	 * With allocator affinity, use the allocator of the issuing CPU so
+	 * that threads on different CPUs do not contend for the same active
+	 * metaslabs.
+	 */
+	int allocator = spa_affinity_allocator(spa);
+	if (allocator >= 0) {
+		zio->io_allocator = allocator;
+		return;
+	}
+
 	/*
 	 * We want to try to use as many allocators as possible to help improve
 	 * performance, but we also want logically adjacent IOs to be physically
@@ -11235,6 +11427,9 @@ ZFS_MODULE_PARAM(zfs_zio, zio_, taskq_batch_pct, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_zio, zio_, taskq_batch_tpq, UINT, ZMOD_RW,
 	"Number of threads per IO worker taskqueue");
 
+ZFS_MODULE_PARAM(zfs_zio, zio_, taskq_numa, INT, ZMOD_RW,
+	"Split scaled IO worker taskqueues per NUMA node");
+
 ZFS_MODULE_PARAM(zfs, zfs_, max_missing_tvds, U64, ZMOD_RW,
 	"Allow importing pool with up to this number of missing top-level "
 	"vdevs (in read-only mode)");
@@ -11265,6 +11460,9 @@ ZFS_MODULE_PARAM(zfs_spa, spa_, flush_txg_time, UINT, ZMOD_RW,
 	"How frequently the TXG timestamps database should be flushed "
 	"to disk (in seconds)");
 
+ZFS_MODULE_PARAM(zfs_spa, spa_, sort_frees, INT, ZMOD_RW,
+	"Issue frees in spa_sync() sorted by vdev and offset");
+
 #ifdef _KERNEL
 ZFS_MODULE_VIRTUAL_PARAM_CALL(zfs_zio, zio_, taskq_read,
 	spa_taskq_read_param_set, spa_taskq_read_param_get, ZMOD_RW,
@@ -11274,5 +11472,8 @@ ZFS_MODULE_VIRTUAL_PARAM_CALL(zfs_zio, zio_, taskq_write,
 	"Configure IO queues for write IO");
 #endif
 
+ZFS_MODULE_PARAM(zfs_spa, spa_, allocator_affinity, UINT, ZMOD_RW,
+	"Map allocators to CPUs (1) or NUMA nodes (2) instead of hashing");
+
 ZFS_MODULE_PARAM(zfs_zio, zio_, taskq_write_tpq, UINT, ZMOD_RW,
 	"Number of CPUs per write issue taskq");
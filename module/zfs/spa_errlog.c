@@ -78,6 +78,22 @@ typedef struct clones {
 	list_node_t node;
 } clones_t;
 
+/*
+ * Error blocks collected from the error logs and lists by spa_get_errlog(),
+ * to be checked against the affected snapshots and clones once the error
+ * log locks have been dropped.
+ */
+typedef struct errlog_ent {
+	uint64_t		ee_head_ds;
+	zbookmark_err_phys_t	ee_zep;
+} errlog_ent_t;
+
+typedef struct errlog_ents {
+	errlog_ent_t	*ees_ents;
+	uint64_t	ees_count;
+	uint64_t	ees_size;
+} errlog_ents_t;
+
 /*
  * spa_upgrade_errlog_limit : A zfs module parameter that controls the number
  *		of on-disk error log entries that will be converted to the new
@@ -535,6 +551,76 @@ process_error_block(spa_t *spa, uint64_t head_ds, zbookmark_err_phys_t *zep,
 
 	return (error);
 }
+
+static void
+errlog_ents_add(errlog_ents_t *ees, uint64_t head_ds,
+    const zbookmark_err_phys_t *zep)
+{
+	if (ees->ees_count == ees->ees_size) {
+		uint64_t size = MAX(ees->ees_size * 2, 64);
+		errlog_ent_t *ents = vmem_alloc(size * sizeof (errlog_ent_t),
+		    KM_SLEEP);
+		if (ees->ees_size != 0) {
+			memcpy(ents, ees->ees_ents,
+			    ees->ees_count * sizeof (errlog_ent_t));
+			vmem_free(ees->ees_ents,
+			    ees->ees_size * sizeof (errlog_ent_t));
+		}
+		ees->ees_ents = ents;
+		ees->ees_size = size;
+	}
+
+	errlog_ent_t *ee = &ees->ees_ents[ees->ees_count++];
+	ee->ee_head_ds = head_ds;
+	ee->ee_zep = *zep;
+}
+
+static int
+errlog_ent_compare(const void *x1, const void *x2)
+{
+	const errlog_ent_t *e1 = x1;
+	const errlog_ent_t *e2 = x2;
+
+	int cmp = TREE_CMP(e1->ee_head_ds, e2->ee_head_ds);
+	if (cmp != 0)
+		return (cmp);
+	cmp = TREE_CMP(e1->ee_zep.zb_object, e2->ee_zep.zb_object);
+	if (cmp != 0)
+		return (cmp);
+	cmp = TREE_CMP(e1->ee_zep.zb_level, e2->ee_zep.zb_level);
+	if (cmp != 0)
+		return (cmp);
+	cmp = TREE_CMP(e1->ee_zep.zb_blkid, e2->ee_zep.zb_blkid);
+	if (cmp != 0)
+		return (cmp);
+	return (TREE_CMP(e1->ee_zep.zb_birth, e2->ee_zep.zb_birth));
+}
+
+/*
+ * Check the collected error blocks against the affected filesystems,
+ * snapshots and clones.  A block found in more than one of the logs and
+ * lists is only processed once.
+ */
+static int
+process_error_ents(spa_t *spa, errlog_ents_t *ees, void *uaddr,
+    uint64_t *count)
+{
+	qsort(ees->ees_ents, ees->ees_count, sizeof (errlog_ent_t),
+	    errlog_ent_compare);
+
+	for (uint64_t i = 0; i < ees->ees_count; i++) {
+		errlog_ent_t *ee = &ees->ees_ents[i];
+
+		if (i > 0 && errlog_ent_compare(ee - 1, ee) == 0)
+			continue;
+
+		int error = process_error_block(spa, ee->ee_head_ds,
+		    &ee->ee_zep, uaddr, count);
+		if (error != 0)
+			return (error);
+	}
+	return (0);
+}
 #endif
 
 /* Return the number of errors in the error log */
@@ -951,7 +1037,8 @@ spa_upgrade_errlog(spa_t *spa, dmu_tx_t *tx)
  * If an error block is shared by two datasets it will be counted twice.
  */
 static int
-process_error_log(spa_t *spa, uint64_t obj, void *uaddr, uint64_t *count)
+process_error_log(spa_t *spa, uint64_t obj, errlog_ents_t *ees, void *uaddr,
+    uint64_t *count)
 {
 	if (obj == 0)
 		return (0);
@@ -1009,20 +1096,7 @@ process_error_log(spa_t *spa, uint64_t obj, void *uaddr, uint64_t *count)
 
 			zbookmark_err_phys_t head_ds_block;
 			name_to_errphys(head_ds_attr->za_name, &head_ds_block);
-			int error = process_error_block(spa, head_ds,
-			    &head_ds_block, uaddr, count);
-
-			if (error != 0) {
-				zap_cursor_fini(head_ds_cursor);
-				kmem_free(head_ds_cursor,
-				    sizeof (*head_ds_cursor));
-				zap_attribute_free(head_ds_attr);
-
-				zap_cursor_fini(zc);
-				zap_attribute_free(za);
-				kmem_free(zc, sizeof (*zc));
-				return (error);
-			}
+			errlog_ents_add(ees, head_ds, &head_ds_block);
 		}
 		zap_cursor_fini(head_ds_cursor);
 		kmem_free(head_ds_cursor, sizeof (*head_ds_cursor));
@@ -1035,7 +1109,8 @@ process_error_log(spa_t *spa, uint64_t obj, void *uaddr, uint64_t *count)
 }
 
 static int
-process_error_list(spa_t *spa, avl_tree_t *list, void *uaddr, uint64_t *count)
+process_error_list(spa_t *spa, avl_tree_t *list, errlog_ents_t *ees,
+    void *uaddr, uint64_t *count)
 {
 	spa_error_entry_t *se;
 
@@ -1064,10 +1139,7 @@ process_error_list(spa_t *spa, avl_tree_t *list, void *uaddr, uint64_t *count)
 		if (error != 0)
 			head_ds = se->se_bookmark.zb_objset;
 
-		error = process_error_block(spa, head_ds,
-		    &se->se_zep, uaddr, count);
-		if (error != 0)
-			return (error);
+		errlog_ents_add(ees, head_ds, &se->se_zep);
 	}
 	return (0);
 }
@@ -1083,6 +1155,12 @@ process_error_list(spa_t *spa, avl_tree_t *list, void *uaddr, uint64_t *count)
  * in-core error lists.  We only need the error list lock to log and error, so
  * we grab the error log lock while we read the on-disk logs, and only pick up
  * the error list lock when we are finished.
+ *
+ * With head_errlog, the error blocks are only collected while the locks are
+ * held.  Checking each of them against every snapshot and clone which may
+ * share it can take a long time on pools with many snapshots, so it is done
+ * after the locks have been dropped, without stalling spa_errlog_sync() and
+ * spa_log_error().
  */
 int
 spa_get_errlog(spa_t *spa, void *uaddr, uint64_t *count)
@@ -1090,31 +1168,39 @@ spa_get_errlog(spa_t *spa, void *uaddr, uint64_t *count)
 	int ret = 0;
 
 #ifdef _KERNEL
+	errlog_ents_t ees = { NULL, 0, 0 };
+
 	/*
 	 * The pool config lock is needed to hold a dataset_t via (among other
-	 * places) process_error_list() -> process_error_block()->
+	 * places) process_error_ents() -> process_error_block()->
 	 * find_top_affected_fs(), and lock ordering requires that we get it
 	 * before the spa_errlog_lock.
 	 */
 	dsl_pool_config_enter(spa->spa_dsl_pool, FTAG);
 	mutex_enter(&spa->spa_errlog_lock);
 
-	ret = process_error_log(spa, spa->spa_errlog_scrub, uaddr, count);
+	ret = process_error_log(spa, spa->spa_errlog_scrub, &ees, uaddr,
+	    count);
 
 	if (!ret && !spa->spa_scrub_finished)
-		ret = process_error_log(spa, spa->spa_errlog_last, uaddr,
+		ret = process_error_log(spa, spa->spa_errlog_last, &ees, uaddr,
 		    count);
 
 	mutex_enter(&spa->spa_errlist_lock);
 	if (!ret)
-		ret = process_error_list(spa, &spa->spa_errlist_scrub, uaddr,
-		    count);
+		ret = process_error_list(spa, &spa->spa_errlist_scrub, &ees,
+		    uaddr, count);
 	if (!ret)
-		ret = process_error_list(spa, &spa->spa_errlist_last, uaddr,
-		    count);
+		ret = process_error_list(spa, &spa->spa_errlist_last, &ees,
+		    uaddr, count);
 	mutex_exit(&spa->spa_errlist_lock);
 
 	mutex_exit(&spa->spa_errlog_lock);
+
+	if (!ret)
+		ret = process_error_ents(spa, &ees, uaddr, count);
+	if (ees.ees_size != 0)
+		vmem_free(ees.ees_ents, ees.ees_size * sizeof (errlog_ent_t));
 	dsl_pool_config_exit(spa->spa_dsl_pool, FTAG);
 #else
 	(void) spa, (void) uaddr, (void) count;
@@ -285,6 +285,24 @@ static uint64_t zfs_max_logsm_summary_length = 10;
  */
 static uint64_t zfs_min_metaslabs_to_flush = 1;
 
+/*
+ * Tunable that sets a per-TXG time budget, in milliseconds, for flushing
+ * metaslabs.
+ *
+ * The cost of flushing a metaslab is estimated from a moving average of
+ * how long metaslab_flush() has taken on its top-level vdev. That time is
+ * dominated by reading the tail of the metaslab's space map, so it is much
+ * higher on HDDs than on SSDs. Once the next flush would take the TXG past
+ * its budget, the remaining flushes are left to later TXGs, whose block
+ * heuristic then asks for correspondingly more, which spreads the work
+ * evenly instead of letting it pile up in a few TXGs.
+ *
+ * The budget never holds us under zfs_min_metaslabs_to_flush, and it is
+ * ignored while the log exceeds its block, TXG, or memory limits. Setting
+ * this to 0 disables it.
+ */
+static uint_t zfs_unflushed_flush_budget_ms = 0;
+
 /*
  * Tunable that specifies how far in the past do we want to look when trying to
  * estimate the incoming log blocks for the current TXG.
@@ -747,6 +765,24 @@ spa_log_exceeds_memlimit(spa_t *spa)
 	return (B_FALSE);
 }
 
+/*
+ * Returns true if the log has more blocks or TXGs than our limits allow,
+ * which happens when the block heuristic has fallen behind.
+ */
+static boolean_t
+spa_log_exceeds_blocklimit(spa_t *spa)
+{
+	if (spa_log_sm_nblocks(spa) > spa_log_sm_blocklimit(spa))
+		return (B_TRUE);
+
+	uint64_t txgcount = 0;
+	for (log_summary_entry_t *e = list_head(&spa->spa_log_summary);
+	    e; e = list_next(&spa->spa_log_summary, e))
+		txgcount += e->lse_txgcount;
+
+	return (txgcount > zfs_unflushed_log_txg_max);
+}
+
 boolean_t
 spa_flush_all_logs_requested(spa_t *spa)
 {
@@ -817,6 +853,17 @@ spa_flush_metaslabs(spa_t *spa, dmu_tx_t *tx)
 		want_to_flush = spa_estimate_metaslabs_to_flush(spa);
 	}
 
+	/*
+	 * The time budget for this TXG's flushes, if any. It only spreads
+	 * flushes over TXGs, so drop it if we have already fallen behind.
+	 */
+	hrtime_t budget = MSEC2NSEC(zfs_unflushed_flush_budget_ms);
+	if (spa_flush_all_logs_requested(spa) ||
+	    spa_log_exceeds_blocklimit(spa))
+		budget = 0;
+	hrtime_t flush_time = 0;
+	uint64_t flushed = 0;
+
 	/* Used purely for verification purposes */
 	uint64_t visited = 0;
 
@@ -848,11 +895,32 @@ spa_flush_metaslabs(spa_t *spa, dmu_tx_t *tx)
 			break;
 
 		if (metaslab_unflushed_dirty(curr)) {
+			vdev_t *vd = curr->ms_group->mg_vd;
+
+			/*
+			 * Leave the rest of the flushes to later TXGs if this
+			 * one would take us past our time budget.
+			 */
+			if (budget != 0 &&
+			    flushed >= zfs_min_metaslabs_to_flush &&
+			    flush_time + vd->vdev_ms_flush_time > budget &&
+			    !spa_log_exceeds_memlimit(spa))
+				break;
+
+			hrtime_t start = gethrtime();
 			mutex_enter(&curr->ms_sync_lock);
 			mutex_enter(&curr->ms_lock);
-			metaslab_flush(curr, tx);
+			boolean_t done = metaslab_flush(curr, tx);
 			mutex_exit(&curr->ms_lock);
 			mutex_exit(&curr->ms_sync_lock);
+			if (done) {
+				hrtime_t delta = gethrtime() - start;
+				vd->vdev_ms_flush_time =
+				    (vd->vdev_ms_flush_time == 0) ? delta :
+				    (vd->vdev_ms_flush_time * 7 + delta) / 8;
+				flush_time += delta;
+				flushed++;
+			}
 			if (want_to_flush > 0)
 				want_to_flush--;
 		} else
@@ -862,6 +930,8 @@ spa_flush_metaslabs(spa_t *spa, dmu_tx_t *tx)
 	}
 	ASSERT3U(avl_numnodes(&spa->spa_metaslabs_by_flushed), >=, visited);
 
+	(void) spa_txg_history_set_flush(spa, txg, flushed, flush_time);
+
 	spa_log_sm_set_blocklimit(spa);
 }
 
@@ -1392,6 +1462,9 @@ ZFS_MODULE_PARAM(zfs, zfs_, unflushed_log_block_pct, UINT, ZMOD_RW,
 	"metaslabs in the pool (e.g. 400 means the number of log blocks is "
 	"capped at 4 times the number of metaslabs)");
 
+ZFS_MODULE_PARAM(zfs, zfs_, unflushed_flush_budget_ms, UINT, ZMOD_RW,
+	"Per-txg time budget in milliseconds for flushing metaslabs");
+
 ZFS_MODULE_PARAM(zfs, zfs_, max_log_walking, U64, ZMOD_RW,
 	"The number of past TXGs that the flushing algorithm of the log "
 	"spacemap feature uses to estimate incoming log blocks");
@@ -446,6 +446,15 @@ static int zfs_user_indirect_is_special = B_TRUE;
  */
 static uint_t zfs_special_class_metadata_reserve_pct = 25;
 
+/*
+ * The percentage of special class space, just below the metadata reserve,
+ * over which the small block threshold is gradually lowered.  As the class
+ * fills through this range, only ever smaller blocks are let in, until
+ * none are at the reserve.  Once the reserve has been reached, small blocks
+ * are only let in again after allocations drop back below this range.
+ */
+static uint_t zfs_special_class_small_taper_pct = 10;
+
 /*
  * ==========================================================================
  * SPA config locking
@@ -742,6 +751,11 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 	spa->spa_deadman_ziotime = MSEC2NSEC(zfs_deadman_ziotime_ms);
 	spa_set_deadman_failmode(spa, zfs_deadman_failmode);
 	spa_set_allocator(spa, zfs_active_allocator);
+	spa->spa_zstd_auto_level = ZIO_ZSTD_LEVEL_DEFAULT;
+
+	/* Do not allow more allocators than fraction of CPUs. */
+	spa->spa_alloc_count = MAX(MIN(spa_num_allocators,
+	    boot_ncpus / MAX(spa_cpus_per_allocator, 1)), 1);
 
 	zfs_refcount_create(&spa->spa_refcount);
 	spa_config_lock_init(spa);
@@ -756,10 +770,6 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 	if (altroot)
 		spa->spa_root = spa_strdup(altroot);
 
-	/* Do not allow more allocators than fraction of CPUs. */
-	spa->spa_alloc_count = MAX(MIN(spa_num_allocators,
-	    boot_ncpus / MAX(spa_cpus_per_allocator, 1)), 1);
-
 	if (spa->spa_alloc_count > 1) {
 		spa->spa_allocs_use = kmem_zalloc(offsetof(spa_allocs_use_t,
 		    sau_inuse[spa->spa_alloc_count]), KM_SLEEP);
@@ -2076,20 +2086,38 @@ spa_preferred_class(spa_t *spa, const zio_t *zio)
 
 	/*
 	 * Allow small file or zvol blocks in special class if opted in by
-	 * the special_smallblk property. However, always leave a reserve of
-	 * zfs_special_class_metadata_reserve_pct exclusively for metadata.
+	 * the special_smallblk property, or any promoted (frequently read)
+	 * ones. However, always leave a reserve of
+	 * zfs_special_class_metadata_reserve_pct exclusively for metadata,
+	 * and lower the threshold as the class approaches that reserve.
+	 * Promoted blocks are only let in below that taper range, so they
+	 * never crowd out small blocks.
 	 */
 	if ((DMU_OT_IS_FILE(objtype) || objtype == DMU_OT_ZVOL) &&
 	    spa_has_special(spa) && !tried_special &&
-	    zio->io_size <= zp->zp_zpl_smallblk) {
+	    (zp->zp_promote || zio->io_size <= zp->zp_zpl_smallblk)) {
 		metaslab_class_t *special = spa_special_class(spa);
 		uint64_t alloc = metaslab_class_get_alloc(special);
 		uint64_t space = metaslab_class_get_space(special);
 		uint64_t limit =
 		    (space * (100 - zfs_special_class_metadata_reserve_pct))
 		    / 100;
+		uint64_t taper = MIN(limit,
+		    (space * zfs_special_class_small_taper_pct) / 100);
+
+		if (alloc >= limit) {
+			spa->spa_special_small_full = B_TRUE;
+			return (spa_normal_class(spa));
+		}
+
+		if (alloc < limit - taper) {
+			spa->spa_special_small_full = B_FALSE;
+			return (special);
+		}
 
-		if (alloc < limit)
+		uint64_t pct = (limit - alloc) * 100 / taper;
+		if (!spa->spa_special_small_full && !zp->zp_promote &&
+		    zio->io_size <= zp->zp_zpl_smallblk * pct / 100)
 			return (special);
 	}
 
@@ -2594,10 +2622,12 @@ spa_init(spa_mode_t mode)
 	dmu_init();
 	zil_init();
 	vdev_mirror_stat_init();
+	vdev_indirect_mapping_stat_init();
 	vdev_raidz_math_init();
 	vdev_file_init();
 	zfs_prop_init();
 	chksum_init();
+	zio_compress_bench_init();
 	zpool_prop_init();
 	zpool_feature_init();
 	vdev_prop_init();
@@ -2617,7 +2647,9 @@ spa_fini(void)
 
 	vdev_file_fini();
 	vdev_mirror_stat_fini();
+	vdev_indirect_mapping_stat_fini();
 	vdev_raidz_math_fini();
+	zio_compress_bench_fini();
 	chksum_fini();
 	zil_fini();
 	dmu_fini();
@@ -2714,6 +2746,27 @@ spa_get_last_scrubbed_txg(spa_t *spa)
 	return (spa->spa_scrubbed_last_txg);
 }
 
+/*
+ * Map a time, in seconds since the epoch, to a txg using the pool's
+ * txg time database.  With round_up unset this is the last txg noted at or
+ * before the time, which is a safe lower bound for the birth txg of blocks
+ * written after it; with round_up set it is the first txg noted at or after
+ * the time.  The lookup is done entirely in memory.  Returns 0 if there is
+ * no such record, e.g. because the time predates the database.
+ */
+uint64_t
+spa_txg_from_time(spa_t *spa, uint64_t time, boolean_t round_up)
+{
+	uint64_t txg;
+
+	mutex_enter(&spa->spa_txg_log_time_lock);
+	txg = dbrrd_query(&spa->spa_txg_log_time, time,
+	    round_up ? DBRRD_CEILING : DBRRD_FLOOR);
+	mutex_exit(&spa->spa_txg_log_time_lock);
+
+	return (txg);
+}
+
 uint64_t
 spa_bootfs(spa_t *spa)
 {
@@ -2810,6 +2863,25 @@ spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps)
 	/* error scrub data not stored on disk */
 	ps->pss_pass_error_scrub_pause = spa->spa_scan_pass_errorscrub_pause;
 
+	/* metadata-first scrub data stored on disk */
+	if (scn->scn_phys.scn_flags & DSF_METADATA_PASS)
+		ps->pss_meta_phase = POOL_SCAN_META_METADATA;
+	else if (scn->scn_phys.scn_flags & DSF_METADATA_FIRST)
+		ps->pss_meta_phase = POOL_SCAN_META_DATA;
+	else
+		ps->pss_meta_phase = POOL_SCAN_META_NONE;
+	ps->pss_meta_end_time = scn->scn_meta_phys.smp_end_time;
+	ps->pss_meta_examined = scn->scn_meta_phys.smp_examined;
+	ps->pss_meta_errors = scn->scn_meta_phys.smp_errors;
+
+	/* scan throttle data stored on disk */
+	ps->pss_throttle_rate = scn->scn_throttle.stp_rate;
+	ps->pss_throttle_latency = scn->scn_throttle.stp_latency;
+
+	/* birth txg range of the scan */
+	ps->pss_min_txg = scn->scn_phys.scn_min_txg;
+	ps->pss_max_txg = scn->scn_phys.scn_max_txg;
+
 	return (0);
 }
 
@@ -3171,6 +3243,10 @@ ZFS_MODULE_PARAM(zfs, zfs_, special_class_metadata_reserve_pct, UINT, ZMOD_RW,
 	"Small file blocks in special vdevs depends on this much "
 	"free space available");
 
+ZFS_MODULE_PARAM(zfs, zfs_, special_class_small_taper_pct, UINT, ZMOD_RW,
+	"Special vdev space below the metadata reserve over which the "
+	"small block threshold is lowered");
+
 ZFS_MODULE_PARAM_CALL(zfs_spa, spa_, slop_shift, param_set_slop_shift,
 	param_get_uint, ZMOD_RW, "Reserved free space in pool");
 
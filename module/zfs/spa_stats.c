@@ -24,7 +24,9 @@
 #include <sys/spa_impl.h>
 #include <sys/vdev_impl.h>
 #include <sys/spa.h>
+#include <sys/zio.h>
 #include <zfs_comutil.h>
+#include <zfs_valstr.h>
 
 /*
  * Keeps stats on last N reads per spa_t, disabled by default.
@@ -46,6 +48,11 @@ static uint_t zfs_txg_history = 100;
  */
 static uint_t zfs_multihost_history = B_FALSE;
 
+/*
+ * Keeps the last N sampled zio traces, see zio_trace_sample.
+ */
+static uint_t zio_trace_history = 1000;
+
 /*
  * ==========================================================================
  * SPA Read History Routines
@@ -191,6 +198,22 @@ spa_read_history_add(spa_t *spa, const zbookmark_phys_t *zb, uint32_t aflags)
  * Txg statistics - Information exported regarding each txg sync
  */
 
+/*
+ * Column headers for the time and I/O count of each spa_sync_phase_t.
+ */
+static const char *const spa_sync_phase_names[SPA_SYNC_PHASES][2] = {
+	[SPA_SYNC_PHASE_DSL_POOL]	= { "dsltime", "dslio" },
+	[SPA_SYNC_PHASE_FREES]		= { "freetime", "freeio" },
+	[SPA_SYNC_PHASE_BRT]		= { "brttime", "brtio" },
+	[SPA_SYNC_PHASE_DDT]		= { "ddttime", "ddtio" },
+	[SPA_SYNC_PHASE_SCAN]		= { "scantime", "scanio" },
+	[SPA_SYNC_PHASE_LOG_FLUSH]	= { "lsmtime", "lsmio" },
+	[SPA_SYNC_PHASE_VDEV]		= { "vdevtime", "vdevio" },
+	[SPA_SYNC_PHASE_DEFERRED_FREES]	= { "dfreetime", "dfreeio" },
+	[SPA_SYNC_PHASE_CONFIG]		= { "cfgtime", "cfgio" },
+	[SPA_SYNC_PHASE_DONE]		= { "donetime", "doneio" },
+};
+
 typedef struct spa_txg_history {
 	uint64_t	txg;		/* txg id */
 	txg_state_t	state;		/* active txg state */
@@ -199,6 +222,10 @@ typedef struct spa_txg_history {
 	uint64_t	reads;		/* number of read operations */
 	uint64_t	writes;		/* number of write operations */
 	uint64_t	ndirty;		/* number of dirty bytes */
+	uint64_t	mflushed;	/* number of metaslabs flushed */
+	hrtime_t	flush_time;	/* time spent flushing metaslabs */
+	hrtime_t	phase_time[SPA_SYNC_PHASES]; /* time in sync phases */
+	uint64_t	phase_ios[SPA_SYNC_PHASES]; /* I/Os in sync phases */
 	hrtime_t	times[TXG_STATE_COMMITTED]; /* completion times */
 	procfs_list_node_t	sth_node;
 } spa_txg_history_t;
@@ -207,9 +234,14 @@ static int
 spa_txg_history_show_header(struct seq_file *f)
 {
 	seq_printf(f, "%-8s %-16s %-5s %-12s %-12s %-12s "
-	    "%-8s %-8s %-12s %-12s %-12s %-12s\n", "txg", "birth", "state",
-	    "ndirty", "nread", "nwritten", "reads", "writes",
-	    "otime", "qtime", "wtime", "stime");
+	    "%-8s %-8s %-12s %-12s %-12s %-12s %-8s %-12s", "txg", "birth",
+	    "state", "ndirty", "nread", "nwritten", "reads", "writes",
+	    "otime", "qtime", "wtime", "stime", "mflushed", "ftime");
+	for (int p = 0; p < SPA_SYNC_PHASES; p++) {
+		seq_printf(f, " %-12s %-8s", spa_sync_phase_names[p][0],
+		    spa_sync_phase_names[p][1]);
+	}
+	seq_printf(f, "\n");
 	return (0);
 }
 
@@ -247,13 +279,21 @@ spa_txg_history_show(struct seq_file *f, void *data)
 		    sth->times[TXG_STATE_WAIT_FOR_SYNC];
 
 	seq_printf(f, "%-8llu %-16llu %-5c %-12llu "
-	    "%-12llu %-12llu %-8llu %-8llu %-12llu %-12llu %-12llu %-12llu\n",
+	    "%-12llu %-12llu %-8llu %-8llu %-12llu %-12llu %-12llu %-12llu "
+	    "%-8llu %-12llu",
 	    (longlong_t)sth->txg, sth->times[TXG_STATE_BIRTH], state,
 	    (u_longlong_t)sth->ndirty,
 	    (u_longlong_t)sth->nread, (u_longlong_t)sth->nwritten,
 	    (u_longlong_t)sth->reads, (u_longlong_t)sth->writes,
 	    (u_longlong_t)open, (u_longlong_t)quiesce, (u_longlong_t)wait,
-	    (u_longlong_t)sync);
+	    (u_longlong_t)sync, (u_longlong_t)sth->mflushed,
+	    (u_longlong_t)sth->flush_time);
+	for (int p = 0; p < SPA_SYNC_PHASES; p++) {
+		seq_printf(f, " %-12llu %-8llu",
+		    (u_longlong_t)sth->phase_time[p],
+		    (u_longlong_t)sth->phase_ios[p]);
+	}
+	seq_printf(f, "\n");
 
 	return (0);
 }
@@ -397,6 +437,124 @@ spa_txg_history_set_io(spa_t *spa, uint64_t txg, uint64_t nread,
 	return (error);
 }
 
+/*
+ * Set the number of metaslabs flushed in txg, and the time it took.
+ */
+int
+spa_txg_history_set_flush(spa_t *spa, uint64_t txg, uint64_t mflushed,
+    hrtime_t flush_time)
+{
+	spa_history_list_t *shl = &spa->spa_stats.txg_history;
+	spa_txg_history_t *sth;
+	int error = ENOENT;
+
+	if (zfs_txg_history == 0)
+		return (0);
+
+	mutex_enter(&shl->procfs_list.pl_lock);
+	for (sth = list_tail(&shl->procfs_list.pl_list); sth != NULL;
+	    sth = list_prev(&shl->procfs_list.pl_list, sth)) {
+		if (sth->txg == txg) {
+			sth->mflushed = mflushed;
+			sth->flush_time = flush_time;
+			error = 0;
+			break;
+		}
+	}
+	mutex_exit(&shl->procfs_list.pl_lock);
+
+	return (error);
+}
+
+/*
+ * Count the reads and writes completed by the leaf vdevs under vd.  This
+ * only reads the leaves' own counters, rather than aggregating all stats
+ * the way vdev_get_stats() does, so it's cheap enough to call around each
+ * sync phase.  The caller must hold SCL_CONFIG, as spa_sync() does.
+ */
+static uint64_t
+spa_txg_history_leaf_ios(vdev_t *vd)
+{
+	uint64_t ios = 0;
+
+	if (vd->vdev_ops->vdev_op_leaf) {
+		mutex_enter(&vd->vdev_stat_lock);
+		ios = vd->vdev_stat.vs_ops[ZIO_TYPE_READ] +
+		    vd->vdev_stat.vs_ops[ZIO_TYPE_WRITE];
+		mutex_exit(&vd->vdev_stat_lock);
+	}
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++)
+		ios += spa_txg_history_leaf_ios(vd->vdev_child[c]);
+
+	return (ios);
+}
+
+/*
+ * Mark the start of a phase of spa_sync(), to be ended by
+ * spa_txg_history_phase_end().
+ */
+void
+spa_txg_history_phase_start(spa_t *spa)
+{
+	if (zfs_txg_history == 0)
+		return;
+
+	spa->spa_sync_phase_start = gethrtime();
+	spa->spa_sync_phase_startios =
+	    spa_txg_history_leaf_ios(spa->spa_root_vdev);
+}
+
+/*
+ * Add the time since spa_txg_history_phase_start(), and the I/Os the
+ * pool completed meanwhile, to the given phase of the syncing txg.  The
+ * I/O count includes any I/O not issued by spa_sync() itself, such as
+ * reads issued in open context.
+ */
+void
+spa_txg_history_phase_end(spa_t *spa, spa_sync_phase_t phase)
+{
+	if (zfs_txg_history == 0 || spa->spa_sync_phase_start == 0)
+		return;
+
+	spa->spa_sync_phase_time[phase] +=
+	    gethrtime() - spa->spa_sync_phase_start;
+	spa->spa_sync_phase_ios[phase] +=
+	    spa_txg_history_leaf_ios(spa->spa_root_vdev) -
+	    spa->spa_sync_phase_startios;
+	spa->spa_sync_phase_start = 0;
+}
+
+/*
+ * Record the sync phase times and I/O counts accumulated by spa_sync().
+ */
+int
+spa_txg_history_set_phases(spa_t *spa, uint64_t txg)
+{
+	spa_history_list_t *shl = &spa->spa_stats.txg_history;
+	spa_txg_history_t *sth;
+	int error = ENOENT;
+
+	if (zfs_txg_history == 0)
+		return (0);
+
+	mutex_enter(&shl->procfs_list.pl_lock);
+	for (sth = list_tail(&shl->procfs_list.pl_list); sth != NULL;
+	    sth = list_prev(&shl->procfs_list.pl_list, sth)) {
+		if (sth->txg == txg) {
+			memcpy(sth->phase_time, spa->spa_sync_phase_time,
+			    sizeof (sth->phase_time));
+			memcpy(sth->phase_ios, spa->spa_sync_phase_ios,
+			    sizeof (sth->phase_ios));
+			error = 0;
+			break;
+		}
+	}
+	mutex_exit(&shl->procfs_list.pl_lock);
+
+	return (error);
+}
+
 txg_stat_t *
 spa_txg_history_init_io(spa_t *spa, uint64_t txg, dsl_pool_t *dp)
 {
@@ -549,6 +707,233 @@ spa_tx_assign_add_nsecs(spa_t *spa, uint64_t nsecs)
 	atomic_inc_64(&((kstat_named_t *)shk->priv)[idx].value.ui64);
 }
 
+/*
+ * ==========================================================================
+ * SPA zstd-auto Statistics Routines
+ * ==========================================================================
+ */
+
+/*
+ * Statistics for compression=zstd-auto - the level currently chosen, the
+ * logical and compressed bytes of blocks written in auto mode (from which
+ * the achieved ratio follows), and the number of blocks written at each
+ * level.  Writing to the kstat zeroes everything except the current level.
+ */
+#define	SPA_ZSTD_AUTO_LEVEL	0
+#define	SPA_ZSTD_AUTO_LSIZE	1
+#define	SPA_ZSTD_AUTO_PSIZE	2
+#define	SPA_ZSTD_AUTO_BLOCKS	3
+
+static int
+spa_zstd_auto_update(kstat_t *ksp, int rw)
+{
+	spa_t *spa = ksp->ks_private;
+	spa_history_kstat_t *shk = &spa->spa_stats.zstd_auto;
+	int i;
+
+	if (rw == KSTAT_WRITE) {
+		for (i = SPA_ZSTD_AUTO_LSIZE; i < shk->count; i++)
+			((kstat_named_t *)shk->priv)[i].value.ui64 = 0;
+	}
+
+	return (0);
+}
+
+static void
+spa_zstd_auto_init(spa_t *spa)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.zstd_auto;
+	kstat_named_t *ks;
+	kstat_t *ksp;
+	char *name;
+	int i;
+
+	mutex_init(&shk->lock, NULL, MUTEX_DEFAULT, NULL);
+
+	shk->count = SPA_ZSTD_AUTO_BLOCKS + ZIO_ZSTD_LEVEL_MAX;
+	shk->size = shk->count * sizeof (kstat_named_t);
+	shk->priv = kmem_zalloc(shk->size, KM_SLEEP);
+
+	for (i = 0; i < shk->count; i++) {
+		ks = &((kstat_named_t *)shk->priv)[i];
+		ks->data_type = KSTAT_DATA_UINT64;
+		if (i == SPA_ZSTD_AUTO_LEVEL) {
+			(void) strlcpy(ks->name, "level", KSTAT_STRLEN);
+			ks->value.ui64 = spa->spa_zstd_auto_level;
+		} else if (i == SPA_ZSTD_AUTO_LSIZE) {
+			(void) strlcpy(ks->name, "lsize", KSTAT_STRLEN);
+		} else if (i == SPA_ZSTD_AUTO_PSIZE) {
+			(void) strlcpy(ks->name, "psize", KSTAT_STRLEN);
+		} else {
+			(void) snprintf(ks->name, KSTAT_STRLEN,
+			    "level_%d_blocks",
+			    i - SPA_ZSTD_AUTO_BLOCKS + ZIO_ZSTD_LEVEL_MIN);
+		}
+	}
+
+	name = kmem_asprintf("zfs/%s", spa_name(spa));
+	ksp = kstat_create(name, 0, "zstd_auto", "misc",
+	    KSTAT_TYPE_NAMED, 0, KSTAT_FLAG_VIRTUAL);
+	shk->kstat = ksp;
+
+	if (ksp) {
+		ksp->ks_lock = &shk->lock;
+		ksp->ks_data = shk->priv;
+		ksp->ks_ndata = shk->count;
+		ksp->ks_data_size = shk->size;
+		ksp->ks_private = spa;
+		ksp->ks_update = spa_zstd_auto_update;
+		kstat_install(ksp);
+	}
+	kmem_strfree(name);
+}
+
+static void
+spa_zstd_auto_destroy(spa_t *spa)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.zstd_auto;
+	kstat_t *ksp;
+
+	ksp = shk->kstat;
+	if (ksp)
+		kstat_delete(ksp);
+
+	kmem_free(shk->priv, shk->size);
+	mutex_destroy(&shk->lock);
+}
+
+void
+spa_zstd_auto_set_level(spa_t *spa, uint8_t level)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.zstd_auto;
+
+	((kstat_named_t *)shk->priv)[SPA_ZSTD_AUTO_LEVEL].value.ui64 = level;
+}
+
+void
+spa_zstd_auto_add(spa_t *spa, uint8_t level, uint64_t lsize, uint64_t psize)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.zstd_auto;
+	kstat_named_t *ks = shk->priv;
+
+	ASSERT3U(level, >=, ZIO_ZSTD_LEVEL_MIN);
+	ASSERT3U(level, <=, ZIO_ZSTD_LEVEL_MAX);
+
+	atomic_add_64(&ks[SPA_ZSTD_AUTO_LSIZE].value.ui64, lsize);
+	atomic_add_64(&ks[SPA_ZSTD_AUTO_PSIZE].value.ui64, psize);
+	atomic_inc_64(&ks[SPA_ZSTD_AUTO_BLOCKS + level -
+	    ZIO_ZSTD_LEVEL_MIN].value.ui64);
+}
+
+/*
+ * ==========================================================================
+ * SPA Allocator Statistics Routines
+ * ==========================================================================
+ */
+
+/*
+ * Per-allocator statistics - the number and size of the blocks allocated
+ * through each allocator, and how often an allocation had to wait for a
+ * metaslab group or metaslab lock held by another thread.  These show
+ * whether allocations are spread across the allocators and whether they
+ * still contend.  Writing to the kstat zeroes all counters.
+ */
+#define	SPA_ALLOCATOR_ALLOCS	0
+#define	SPA_ALLOCATOR_BYTES	1
+#define	SPA_ALLOCATOR_CONTENDED	2
+#define	SPA_ALLOCATOR_STATS	3
+
+static int
+spa_allocators_update(kstat_t *ksp, int rw)
+{
+	spa_t *spa = ksp->ks_private;
+	spa_history_kstat_t *shk = &spa->spa_stats.allocators;
+
+	if (rw == KSTAT_WRITE) {
+		for (int i = 0; i < shk->count; i++)
+			((kstat_named_t *)shk->priv)[i].value.ui64 = 0;
+	}
+
+	return (0);
+}
+
+static void
+spa_allocators_init(spa_t *spa)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.allocators;
+	static const char *const stat_names[SPA_ALLOCATOR_STATS] = {
+		"allocs", "bytes", "contended"
+	};
+	kstat_named_t *ks;
+	kstat_t *ksp;
+	char *name;
+
+	mutex_init(&shk->lock, NULL, MUTEX_DEFAULT, NULL);
+
+	shk->count = spa->spa_alloc_count * SPA_ALLOCATOR_STATS;
+	shk->size = shk->count * sizeof (kstat_named_t);
+	shk->priv = kmem_zalloc(shk->size, KM_SLEEP);
+
+	for (int i = 0; i < shk->count; i++) {
+		ks = &((kstat_named_t *)shk->priv)[i];
+		ks->data_type = KSTAT_DATA_UINT64;
+		(void) snprintf(ks->name, KSTAT_STRLEN, "allocator_%d_%s",
+		    i / SPA_ALLOCATOR_STATS,
+		    stat_names[i % SPA_ALLOCATOR_STATS]);
+	}
+
+	name = kmem_asprintf("zfs/%s", spa_name(spa));
+	ksp = kstat_create(name, 0, "allocators", "misc",
+	    KSTAT_TYPE_NAMED, 0, KSTAT_FLAG_VIRTUAL);
+	shk->kstat = ksp;
+
+	if (ksp) {
+		ksp->ks_lock = &shk->lock;
+		ksp->ks_data = shk->priv;
+		ksp->ks_ndata = shk->count;
+		ksp->ks_data_size = shk->size;
+		ksp->ks_private = spa;
+		ksp->ks_update = spa_allocators_update;
+		kstat_install(ksp);
+	}
+	kmem_strfree(name);
+}
+
+static void
+spa_allocators_destroy(spa_t *spa)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.allocators;
+	kstat_t *ksp;
+
+	ksp = shk->kstat;
+	if (ksp)
+		kstat_delete(ksp);
+
+	kmem_free(shk->priv, shk->size);
+	mutex_destroy(&shk->lock);
+}
+
+void
+spa_allocator_stats_add(spa_t *spa, int allocator, uint64_t allocs,
+    uint64_t bytes, uint64_t contended)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.allocators;
+	kstat_named_t *ks = shk->priv;
+
+	ASSERT3S(allocator, >=, 0);
+	ASSERT3S(allocator, <, spa->spa_alloc_count);
+
+	ks += allocator * SPA_ALLOCATOR_STATS;
+	if (allocs != 0)
+		atomic_add_64(&ks[SPA_ALLOCATOR_ALLOCS].value.ui64, allocs);
+	if (bytes != 0)
+		atomic_add_64(&ks[SPA_ALLOCATOR_BYTES].value.ui64, bytes);
+	if (contended != 0) {
+		atomic_add_64(&ks[SPA_ALLOCATOR_CONTENDED].value.ui64,
+		    contended);
+	}
+}
+
 /*
  * ==========================================================================
  * SPA MMP History Routines
@@ -904,6 +1289,12 @@ static const spa_iostats_t spa_iostats_template = {
 	{ "direct_read_bytes",			KSTAT_DATA_UINT64 },
 	{ "direct_write_count",			KSTAT_DATA_UINT64 },
 	{ "direct_write_bytes",			KSTAT_DATA_UINT64 },
+	{ "raidz_expand_copy_count",		KSTAT_DATA_UINT64 },
+	{ "raidz_expand_copy_bytes",		KSTAT_DATA_UINT64 },
+	{ "raidz_expand_copy_nsecs",		KSTAT_DATA_UINT64 },
+	{ "mmp_writes_rotational",		KSTAT_DATA_UINT64 },
+	{ "mmp_writes_nonrotational",		KSTAT_DATA_UINT64 },
+	{ "mmp_writes_batched",			KSTAT_DATA_UINT64 },
 };
 
 #define	SPA_IOSTATS_ADD(stat, val) \
@@ -987,6 +1378,48 @@ spa_iostats_write_add(spa_t *spa, uint64_t size, uint64_t iops,
 	}
 }
 
+/*
+ * RAIDZ expansion copies.  The rate of the expansion is copy_bytes divided
+ * by copy_nsecs, the time the reflow thread has spent copying (excluding
+ * pauses and the initial scratch-area reflow).
+ */
+void
+spa_iostats_raidz_expand_add(spa_t *spa, uint64_t copies, uint64_t bytes,
+    uint64_t nsecs)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+
+	if (ksp == NULL)
+		return;
+
+	spa_iostats_t *iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(raidz_expand_copy_count, copies);
+	SPA_IOSTATS_ADD(raidz_expand_copy_bytes, bytes);
+	SPA_IOSTATS_ADD(raidz_expand_copy_nsecs, nsecs);
+}
+
+/*
+ * Account MMP writes by the kind of leaf they were issued to, so the seek
+ * cost on rotational media is visible, and count the MMP writes which were
+ * not issued because a txg sync had just written the uberblock.
+ */
+void
+spa_iostats_mmp_add(spa_t *spa, uint64_t rotational, uint64_t nonrotational,
+    uint64_t batched)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+
+	if (ksp == NULL)
+		return;
+
+	spa_iostats_t *iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(mmp_writes_rotational, rotational);
+	SPA_IOSTATS_ADD(mmp_writes_nonrotational, nonrotational);
+	SPA_IOSTATS_ADD(mmp_writes_batched, batched);
+}
+
 static int
 spa_iostats_update(kstat_t *ksp, int rw)
 {
@@ -1037,6 +1470,136 @@ spa_iostats_destroy(spa_t *spa)
 	mutex_destroy(&shk->lock);
 }
 
+/*
+ * ==========================================================================
+ * SPA zio Trace Routines
+ * ==========================================================================
+ */
+
+/*
+ * Each sampled zio is shown on one line, ending with the time it spent in
+ * each pipeline stage it went through, up to the DONE stage: from entering
+ * the stage to entering the next one.  The time after a stage which issued
+ * child I/O includes waiting for the children.
+ */
+static int
+spa_zio_trace_show_header(struct seq_file *f)
+{
+	seq_printf(f, "%-8s %-16s %-6s %-10s %-8s %-8s %-8s %-8s %-18s "
+	    "%-5s %-10s %-10s %-10s %s\n", "UID", "start", "type",
+	    "priority", "txg", "objset", "object", "size", "vdev", "error",
+	    "queue", "device", "total", "stages");
+
+	return (0);
+}
+
+static int
+spa_zio_trace_show(struct seq_file *f, void *data)
+{
+	zio_trace_t *zt = (zio_trace_t *)data;
+	char type[16], priority[16], stage[32];
+	int last = -1;
+
+	(void) zfs_valstr_zio_type(zt->zt_type, type, sizeof (type));
+	(void) zfs_valstr_zio_priority(zt->zt_priority, priority,
+	    sizeof (priority));
+
+	seq_printf(f, "%-8llu %-16llu %-6s %-10s %-8llu 0x%-6llx %-8llu "
+	    "%-8llu 0x%-16llx %-5d %-10llu %-10llu %-10llu ",
+	    (u_longlong_t)zt->zt_node.pln_id, (u_longlong_t)zt->zt_start,
+	    type, priority, (u_longlong_t)zt->zt_txg,
+	    (u_longlong_t)zt->zt_objset, (u_longlong_t)zt->zt_object,
+	    (u_longlong_t)zt->zt_size, (u_longlong_t)zt->zt_guid,
+	    zt->zt_error, (u_longlong_t)zt->zt_queued,
+	    (u_longlong_t)zt->zt_device,
+	    (u_longlong_t)zt->zt_stage[ZIO_STAGES - 1]);
+
+	/* every zio starts in the OPEN stage, at time 0 */
+	for (int i = 0; i < ZIO_STAGES; i++) {
+		if (i > 0 && zt->zt_stage[i] == 0)
+			continue;
+		if (last >= 0) {
+			(void) zfs_valstr_zio_stage(1ULL << last, stage,
+			    sizeof (stage));
+			seq_printf(f, "%s%s:%llu", last > 0 ? "," : "", stage,
+			    (u_longlong_t)(zt->zt_stage[i] -
+			    zt->zt_stage[last]));
+		}
+		last = i;
+	}
+	seq_printf(f, "\n");
+
+	return (0);
+}
+
+/* Remove oldest elements from list until there are no more than 'size' left */
+static void
+spa_zio_trace_truncate(spa_history_list_t *shl, unsigned int size)
+{
+	zio_trace_t *zt;
+	while (shl->size > size) {
+		zt = list_remove_head(&shl->procfs_list.pl_list);
+		ASSERT3P(zt, !=, NULL);
+		zio_trace_free(zt);
+		shl->size--;
+	}
+
+	if (size == 0)
+		ASSERT(list_is_empty(&shl->procfs_list.pl_list));
+}
+
+static int
+spa_zio_trace_clear(procfs_list_t *procfs_list)
+{
+	spa_history_list_t *shl = procfs_list->pl_private;
+	mutex_enter(&procfs_list->pl_lock);
+	spa_zio_trace_truncate(shl, 0);
+	mutex_exit(&procfs_list->pl_lock);
+	return (0);
+}
+
+static void
+spa_zio_trace_init(spa_t *spa)
+{
+	spa_history_list_t *shl = &spa->spa_stats.zio_trace;
+
+	shl->size = 0;
+	shl->procfs_list.pl_private = shl;
+	procfs_list_install("zfs",
+	    spa_name(spa),
+	    "zio_trace",
+	    0600,
+	    &shl->procfs_list,
+	    spa_zio_trace_show,
+	    spa_zio_trace_show_header,
+	    spa_zio_trace_clear,
+	    offsetof(zio_trace_t, zt_node));
+}
+
+static void
+spa_zio_trace_destroy(spa_t *spa)
+{
+	spa_history_list_t *shl = &spa->spa_stats.zio_trace;
+	procfs_list_uninstall(&shl->procfs_list);
+	spa_zio_trace_truncate(shl, 0);
+	procfs_list_destroy(&shl->procfs_list);
+}
+
+/*
+ * Add the trace of a completed zio, taking ownership of it.
+ */
+void
+spa_zio_trace_add(spa_t *spa, zio_trace_t *zt)
+{
+	spa_history_list_t *shl = &spa->spa_stats.zio_trace;
+
+	mutex_enter(&shl->procfs_list.pl_lock);
+	procfs_list_add(&shl->procfs_list, zt);
+	shl->size++;
+	spa_zio_trace_truncate(shl, zio_trace_history);
+	mutex_exit(&shl->procfs_list.pl_lock);
+}
+
 void
 spa_stats_init(spa_t *spa)
 {
@@ -1047,11 +1610,17 @@ spa_stats_init(spa_t *spa)
 	spa_state_init(spa);
 	spa_guid_init(spa);
 	spa_iostats_init(spa);
+	spa_zstd_auto_init(spa);
+	spa_allocators_init(spa);
+	spa_zio_trace_init(spa);
 }
 
 void
 spa_stats_destroy(spa_t *spa)
 {
+	spa_zio_trace_destroy(spa);
+	spa_allocators_destroy(spa);
+	spa_zstd_auto_destroy(spa);
 	spa_iostats_destroy(spa);
 	spa_health_destroy(spa);
 	spa_tx_assign_destroy(spa);
@@ -1072,3 +1641,6 @@ ZFS_MODULE_PARAM(zfs_txg, zfs_txg_, history, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_multihost, zfs_multihost_, history, UINT, ZMOD_RW,
 	"Historical statistics for last N multihost writes");
+
+ZFS_MODULE_PARAM(zfs_zio, zio_, trace_history, UINT, ZMOD_RW,
+	"Keep the last N sampled zio traces");
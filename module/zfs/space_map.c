@@ -76,7 +76,113 @@ sm_entry_is_single_word(uint64_t e)
 boolean_t
 sm_entry_is_double_word(uint64_t e)
 {
-	return (SM_PREFIX_DECODE(e) == SM2_PREFIX);
+	return (SM_PREFIX_DECODE(e) == SM2_PREFIX &&
+	    SM_PAD_DECODE(e) != SM3_MARKER);
+}
+
+boolean_t
+sm_entry_is_compact(uint64_t e)
+{
+	return (SM_PREFIX_DECODE(e) == SM2_PREFIX &&
+	    SM_PAD_DECODE(e) == SM3_MARKER);
+}
+
+static uint64_t
+sm_compact_header(maptype_t maptype, uint64_t vdev_id, uint64_t nbytes)
+{
+	ASSERT3U(nbytes, <=, SM3_RECORD_MAX_BYTES);
+	return (SM_PREFIX_ENCODE(SM2_PREFIX) | SM_PAD_ENCODE(SM3_MARKER) |
+	    SM3_TYPE_ENCODE(maptype) | SM3_VDEV_ENCODE(vdev_id) |
+	    SM3_NBYTES_ENCODE(nbytes));
+}
+
+/*
+ * Number of bytes needed to encode v as an unsigned LEB128 integer.
+ */
+static int
+sm_compact_len(uint64_t v)
+{
+	int n = 1;
+	while ((v >>= 7) != 0)
+		n++;
+	return (n);
+}
+
+static int
+sm_compact_encode(uint8_t *buf, uint64_t v)
+{
+	int n = 0;
+	do {
+		uint8_t b = v & 0x7f;
+		v >>= 7;
+		if (v != 0)
+			b |= 0x80;
+		buf[n++] = b;
+	} while (v != 0);
+	ASSERT3S(n, <=, SM3_SEG_MAX_BYTES / 2);
+	return (n);
+}
+
+/*
+ * Decodes the integer starting at byte *pos of the payload of a compact
+ * record and advances *pos past it.
+ */
+uint64_t
+sm_compact_decode(const uint64_t *payload, uint64_t nbytes, uint64_t *pos)
+{
+	uint64_t v = 0;
+	for (int shift = 0; ; shift += 7) {
+		VERIFY3U(*pos, <, nbytes);
+		VERIFY3S(shift, <, 64);
+
+		uint64_t b = (payload[*pos >> 3] >> ((*pos & 7) << 3)) & 0xff;
+		(*pos)++;
+		v |= (b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+			return (v);
+	}
+}
+
+/*
+ * Invokes the callback on each segment of the compact record whose header
+ * word is e and whose payload starts at payload.
+ */
+static int
+space_map_compact_iterate(space_map_t *sm, uint64_t e,
+    const uint64_t *payload, uint64_t txg, uint64_t sync_pass,
+    sm_cb_t callback, void *arg)
+{
+	uint64_t nbytes = SM3_NBYTES_DECODE(e);
+	uint64_t pos = 0, cursor = 0;
+	int error = 0;
+
+	while (pos < nbytes && error == 0) {
+		uint64_t raw_offset = cursor +
+		    sm_compact_decode(payload, nbytes, &pos);
+		uint64_t raw_run = sm_compact_decode(payload, nbytes, &pos) + 1;
+		cursor = raw_offset + raw_run;
+
+		uint64_t entry_offset = (raw_offset << sm->sm_shift) +
+		    sm->sm_start;
+		uint64_t entry_run = raw_run << sm->sm_shift;
+
+		ASSERT3U(entry_offset, >=, sm->sm_start);
+		ASSERT3U(entry_offset, <, sm->sm_start + sm->sm_size);
+		ASSERT3U(entry_run, <=, sm->sm_size);
+		ASSERT3U(entry_offset + entry_run, <=,
+		    sm->sm_start + sm->sm_size);
+
+		space_map_entry_t sme = {
+		    .sme_type = SM3_TYPE_DECODE(e),
+		    .sme_vdev = SM3_VDEV_DECODE(e),
+		    .sme_offset = entry_offset,
+		    .sme_run = entry_run,
+		    .sme_txg = txg,
+		    .sme_sync_pass = sync_pass
+		};
+		error = callback(&sme, arg);
+	}
+	return (error);
 }
 
 /*
@@ -142,6 +248,18 @@ space_map_iterate(space_map_t *sm, uint64_t end, sm_cb_t callback, void *arg)
 				continue;
 			}
 
+			if (sm_entry_is_compact(e)) {
+				uint64_t nwords = howmany(SM3_NBYTES_DECODE(e),
+				    sizeof (uint64_t));
+				VERIFY3P(block_cursor + nwords, <, block_end);
+
+				error = space_map_compact_iterate(sm, e,
+				    block_cursor + 1, txg, sync_pass,
+				    callback, arg);
+				block_cursor += nwords;
+				continue;
+			}
+
 			uint64_t raw_offset, raw_run, vdev_id;
 			maptype_t type;
 			if (sm_entry_is_single_word(e)) {
@@ -192,16 +310,16 @@ space_map_iterate(space_map_t *sm, uint64_t end, sm_cb_t callback, void *arg)
 }
 
 /*
- * Reads the entries from the last block of the space map into
- * buf in reverse order. Populates nwords with number of words
- * in the last block.
+ * Copies the words of the last block of the space map into buf.
+ * Populates nwords with the number of words in the last block and
+ * block_offset with the offset of that block within the space map.
  *
  * Refer to block comment within space_map_incremental_destroy()
  * to understand why this function is needed.
  */
 static int
-space_map_reversed_last_block_entries(space_map_t *sm, uint64_t *buf,
-    uint64_t bufsz, uint64_t *nwords)
+space_map_last_block_entries(space_map_t *sm, uint64_t *buf,
+    uint64_t bufsz, uint64_t *nwords, uint64_t *block_offset)
 {
 	int error = 0;
 	dmu_buf_t *db;
@@ -223,46 +341,97 @@ space_map_reversed_last_block_entries(space_map_t *sm, uint64_t *buf,
 	ASSERT3U(bufsz, >=, db->db_size);
 	ASSERT(nwords != NULL);
 
-	uint64_t *words = db->db_data;
 	*nwords =
 	    (sm->sm_phys->smp_length - db->db_offset) / sizeof (uint64_t);
+	*block_offset = db->db_offset;
 
 	ASSERT3U(*nwords, <=, bufsz / sizeof (uint64_t));
+	memcpy(buf, db->db_data, *nwords * sizeof (uint64_t));
 
-	uint64_t n = *nwords;
-	uint64_t j = n - 1;
-	for (uint64_t i = 0; i < n; i++) {
-		uint64_t entry = words[i];
-		if (sm_entry_is_double_word(entry)) {
-			/*
-			 * Since we are populating the buffer backwards
-			 * we have to be extra careful and add the two
-			 * words of the double-word entry in the right
-			 * order.
-			 */
-			ASSERT3U(j, >, 0);
-			buf[j - 1] = entry;
-
-			i++;
-			ASSERT3U(i, <, n);
-			entry = words[i];
-			buf[j] = entry;
-			j -= 2;
-		} else {
-			ASSERT(sm_entry_is_debug(entry) ||
-			    sm_entry_is_single_word(entry));
-			buf[j] = entry;
-			j--;
-		}
+	dmu_buf_rele(db, FTAG);
+	return (error);
+}
+
+typedef struct sm_compact_seg {
+	uint64_t	scs_offset;	/* units of sm_shift */
+	uint64_t	scs_run;	/* units of sm_shift */
+	uint64_t	scs_end;	/* payload bytes up to this segment */
+} sm_compact_seg_t;
+
+#define	SM3_RECORD_MAX_SEGS	(SM3_RECORD_MAX_BYTES / 2)
+
+/*
+ * Applies the callback to the segments of the compact record at the end
+ * of the space map, last segment first, removing each one from the space
+ * map as it goes.  Since every segment is delta-encoded against the ones
+ * before it, stopping in the middle of the record only requires shrinking
+ * the byte count in its header.
+ */
+static int
+space_map_compact_destroy(space_map_t *sm, const uint64_t *hdrp,
+    uint64_t record_offset, sm_compact_seg_t *segs, sm_cb_t callback,
+    void *arg, dmu_tx_t *tx)
+{
+	uint64_t e = *hdrp;
+	uint64_t nbytes = SM3_NBYTES_DECODE(e);
+	const uint64_t *payload = hdrp + 1;
+
+	ASSERT3U(sm->sm_phys->smp_length, ==, record_offset +
+	    (1 + howmany(nbytes, sizeof (uint64_t))) * sizeof (uint64_t));
+
+	uint64_t pos = 0, cursor = 0;
+	int64_t nsegs = 0;
+	while (pos < nbytes) {
+		VERIFY3S(nsegs, <, SM3_RECORD_MAX_SEGS);
+		sm_compact_seg_t *scs = &segs[nsegs++];
+		scs->scs_offset = cursor +
+		    sm_compact_decode(payload, nbytes, &pos);
+		scs->scs_run = sm_compact_decode(payload, nbytes, &pos) + 1;
+		scs->scs_end = pos;
+		cursor = scs->scs_offset + scs->scs_run;
 	}
 
-	/*
-	 * Assert that we wrote backwards all the
-	 * way to the beginning of the buffer.
-	 */
-	ASSERT3S(j, ==, -1);
+	int error = 0;
+	int64_t j;
+	for (j = nsegs - 1; j >= 0; j--) {
+		uint64_t entry_offset =
+		    (segs[j].scs_offset << sm->sm_shift) + sm->sm_start;
+		uint64_t entry_run = segs[j].scs_run << sm->sm_shift;
+
+		VERIFY3U(entry_offset, >=, sm->sm_start);
+		VERIFY3U(entry_offset, <, sm->sm_start + sm->sm_size);
+		VERIFY3U(entry_run, <=, sm->sm_size);
+		VERIFY3U(entry_offset + entry_run, <=,
+		    sm->sm_start + sm->sm_size);
+
+		space_map_entry_t sme = {
+		    .sme_type = SM3_TYPE_DECODE(e),
+		    .sme_vdev = SM3_VDEV_DECODE(e),
+		    .sme_offset = entry_offset,
+		    .sme_run = entry_run
+		};
+		error = callback(&sme, arg);
+		if (error != 0)
+			break;
 
-	dmu_buf_rele(db, FTAG);
+		if (sme.sme_type == SM_ALLOC)
+			sm->sm_phys->smp_alloc -= entry_run;
+		else
+			sm->sm_phys->smp_alloc += entry_run;
+	}
+
+	if (j < 0) {
+		sm->sm_phys->smp_length = record_offset;
+	} else if (j < nsegs - 1) {
+		/* segments [0, j] remain in the record */
+		uint64_t remaining = segs[j].scs_end;
+		uint64_t hdr = sm_compact_header(SM3_TYPE_DECODE(e),
+		    SM3_VDEV_DECODE(e), remaining);
+		dmu_write(sm->sm_os, space_map_object(sm), record_offset,
+		    sizeof (hdr), &hdr, tx);
+		sm->sm_phys->smp_length = record_offset + (1 +
+		    howmany(remaining, sizeof (uint64_t))) * sizeof (uint64_t);
+	}
 	return (error);
 }
 
@@ -278,6 +447,10 @@ space_map_incremental_destroy(space_map_t *sm, sm_cb_t callback, void *arg,
 {
 	uint64_t bufsz = MAX(sm->sm_blksz, SPA_MINBLOCKSIZE);
 	uint64_t *buf = zio_buf_alloc(bufsz);
+	uint64_t maxentries = bufsz / sizeof (uint64_t);
+	uint64_t *entries = vmem_alloc(maxentries * sizeof (uint64_t),
+	    KM_SLEEP);
+	sm_compact_seg_t *segs = NULL;
 
 	dmu_buf_will_dirty(sm->sm_dbuf, tx);
 
@@ -294,17 +467,16 @@ space_map_incremental_destroy(space_map_t *sm, sm_cb_t callback, void *arg,
 	 *
 	 * The problem with this approach is that we cannot literally
 	 * iterate through the words in the space map backwards as we
-	 * can't distinguish two-word space map entries from their second
-	 * word. Thus we do the following:
+	 * can't distinguish multi-word space map entries from their
+	 * trailing words. Thus we do the following:
 	 *
-	 * 1] We get all the entries from the last block of the space map
-	 *    and put them into a buffer in reverse order. This way the
-	 *    last entry comes first in the buffer, the second to last is
-	 *    second, etc.
-	 * 2] We iterate through the entries in the buffer and we apply
-	 *    the callback to each one. As we move from entry to entry we
-	 *    we decrease the size of the space map, deleting effectively
-	 *    each entry.
+	 * 1] We copy the last block of the space map into a buffer and
+	 *    walk it forwards, recording where each entry starts.
+	 * 2] We iterate through the entries of the block backwards and
+	 *    we apply the callback to each one. As we move from entry to
+	 *    entry we decrease the size of the space map, deleting
+	 *    effectively each entry. Compact records are handled one
+	 *    segment at a time [see space_map_compact_destroy()].
 	 * 3] If there are no more entries in the space map or the callback
 	 *    returns a value other than 0, we stop iterating over the
 	 *    space map. If there are entries remaining and the callback
@@ -312,15 +484,28 @@ space_map_incremental_destroy(space_map_t *sm, sm_cb_t callback, void *arg,
 	 */
 	int error = 0;
 	while (space_map_length(sm) > 0 && error == 0) {
-		uint64_t nwords = 0;
-		error = space_map_reversed_last_block_entries(sm, buf, bufsz,
-		    &nwords);
+		uint64_t nwords = 0, block_offset = 0;
+		error = space_map_last_block_entries(sm, buf, bufsz,
+		    &nwords, &block_offset);
 		if (error != 0)
 			break;
 
-		ASSERT3U(nwords, <=, bufsz / sizeof (uint64_t));
+		ASSERT3U(nwords, <=, maxentries);
 
+		uint64_t nentries = 0;
 		for (uint64_t i = 0; i < nwords; i++) {
+			entries[nentries++] = i;
+			if (sm_entry_is_double_word(buf[i])) {
+				i++;
+			} else if (sm_entry_is_compact(buf[i])) {
+				i += howmany(SM3_NBYTES_DECODE(buf[i]),
+				    sizeof (uint64_t));
+			}
+			VERIFY3U(i, <, nwords);
+		}
+
+		for (int64_t k = nentries - 1; k >= 0 && error == 0; k--) {
+			uint64_t i = entries[k];
 			uint64_t e = buf[i];
 
 			if (sm_entry_is_debug(e)) {
@@ -328,6 +513,17 @@ space_map_incremental_destroy(space_map_t *sm, sm_cb_t callback, void *arg,
 				continue;
 			}
 
+			if (sm_entry_is_compact(e)) {
+				if (segs == NULL) {
+					segs = vmem_alloc(SM3_RECORD_MAX_SEGS *
+					    sizeof (*segs), KM_SLEEP);
+				}
+				error = space_map_compact_destroy(sm, &buf[i],
+				    block_offset + i * sizeof (uint64_t), segs,
+				    callback, arg, tx);
+				continue;
+			}
+
 			int words = 1;
 			uint64_t raw_offset, raw_run, vdev_id;
 			maptype_t type;
@@ -344,10 +540,7 @@ space_map_incremental_destroy(space_map_t *sm, sm_cb_t callback, void *arg,
 				vdev_id = SM2_VDEV_DECODE(e);
 
 				/* move to the second word */
-				i++;
-				e = buf[i];
-
-				ASSERT3P(i, <=, nwords);
+				e = buf[i + 1];
 
 				type = SM2_TYPE_DECODE(e);
 				raw_offset = SM2_OFFSET_DECODE(e);
@@ -388,6 +581,9 @@ space_map_incremental_destroy(space_map_t *sm, sm_cb_t callback, void *arg,
 		ASSERT0(space_map_allocated(sm));
 	}
 
+	if (segs != NULL)
+		vmem_free(segs, SM3_RECORD_MAX_SEGS * sizeof (*segs));
+	vmem_free(entries, maxentries * sizeof (uint64_t));
 	zio_buf_free(buf, bufsz);
 	return (error);
 }
@@ -405,7 +601,7 @@ space_map_load_callback(space_map_entry_t *sme, void *arg)
 	if (sme->sme_type == smla->smla_type) {
 		VERIFY3U(zfs_range_tree_space(smla->smla_rt) + sme->sme_run, <=,
 		    smla->smla_sm->sm_size);
-		zfs_range_tree_add(smla->smla_rt, sme->sme_offset,
+		zfs_range_tree_add_sorted(smla->smla_rt, sme->sme_offset,
 		    sme->sme_run);
 	} else {
 		zfs_range_tree_remove(smla->smla_rt, sme->sme_offset,
@@ -666,40 +862,143 @@ space_map_write_seg(space_map_t *sm, uint64_t rstart, uint64_t rend,
 }
 
 /*
+ * Returns a pointer to the word right after the end of the space map,
+ * making sure that at least 'words' words fit in its block from there.
+ * If they don't, the rest of the current block is padded with debug
+ * entries and the next block is held and dirtied instead.
+ *
+ * Note: Like space_map_write_seg(), the function may release the dbuf
+ * from the pointer initially passed to it, and return a different dbuf.
+ */
+static uint64_t *
+space_map_reserve_words(space_map_t *sm, uint64_t words, dmu_buf_t **dbp,
+    const void *tag, dmu_tx_t *tx)
+{
+	dmu_buf_t *db = *dbp;
+	ASSERT3U(db->db_size, ==, sm->sm_blksz);
+	ASSERT3U(words, <=, sm->sm_blksz / sizeof (uint64_t));
+
+	uint64_t *block_base = db->db_data;
+	uint64_t *block_end = block_base + (sm->sm_blksz / sizeof (uint64_t));
+	uint64_t *block_cursor = block_base +
+	    (sm->sm_phys->smp_length - db->db_offset) / sizeof (uint64_t);
+
+	ASSERT3P(block_cursor, <=, block_end);
+	if (block_cursor + words <= block_end)
+		return (block_cursor);
+
+	while (block_cursor < block_end) {
+		*block_cursor = SM_PREFIX_ENCODE(SM_DEBUG_PREFIX) |
+		    SM_DEBUG_ACTION_ENCODE(0) |
+		    SM_DEBUG_SYNCPASS_ENCODE(0) |
+		    SM_DEBUG_TXG_ENCODE(0);
+		block_cursor++;
+		sm->sm_phys->smp_length += sizeof (uint64_t);
+	}
+
+	dmu_buf_rele(db, tag);
+	VERIFY0(dmu_buf_hold(sm->sm_os, space_map_object(sm),
+	    sm->sm_phys->smp_length, tag, &db, DMU_READ_PREFETCH));
+	dmu_buf_will_dirty(db, tx);
+	ASSERT3U(db->db_size, ==, sm->sm_blksz);
+	ASSERT3U(db->db_offset, ==, sm->sm_phys->smp_length);
+
+	/* update caller's dbuf */
+	*dbp = db;
+	return (db->db_data);
+}
+
+/*
+ * Writes the segments of the range tree as compact records.  A record is
+ * closed, and a new one started, when the next segment does not fit in
+ * the record's maximum size or in the rest of the current block.
+ *
  * Note: The space map's dbuf must be dirty for the changes in sm_phys to
  * take effect.
  */
 static void
-space_map_write_impl(space_map_t *sm, zfs_range_tree_t *rt, maptype_t maptype,
-    uint64_t vdev_id, dmu_tx_t *tx)
+space_map_write_compact(space_map_t *sm, zfs_range_tree_t *rt,
+    maptype_t maptype, uint64_t vdev_id, dmu_buf_t **dbp, const void *tag,
+    dmu_tx_t *tx)
 {
-	spa_t *spa = tx->tx_pool->dp_spa;
-	dmu_buf_t *db;
+	uint64_t *hdr = NULL;
+	uint64_t nbytes = 0, cap = 0, cursor = 0;
+	uint8_t seg[SM3_SEG_MAX_BYTES];
 
-	space_map_write_intro_debug(sm, maptype, tx);
+	ASSERT3U(vdev_id, <=, SM_NO_VDEVID);
 
-#ifdef ZFS_DEBUG
-	/*
-	 * We do this right after we write the intro debug entry
-	 * because the estimate does not take it into account.
-	 */
-	uint64_t initial_objsize = sm->sm_phys->smp_length;
-	uint64_t estimated_growth =
-	    space_map_estimate_optimal_size(sm, rt, SM_NO_VDEVID);
-	uint64_t estimated_final_objsize = initial_objsize + estimated_growth;
-#endif
+	zfs_btree_t *t = &rt->rt_root;
+	zfs_btree_index_t where;
+	for (zfs_range_seg_t *rs = zfs_btree_first(t, &where); rs != NULL;
+	    rs = zfs_btree_next(t, &where, &where)) {
+		uint64_t rstart = zfs_rs_get_start(rs, rt);
+		uint64_t rend = zfs_rs_get_end(rs, rt);
+
+		ASSERT3U(rstart, >=, sm->sm_start);
+		ASSERT3U(rstart, <, sm->sm_start + sm->sm_size);
+		ASSERT3U(rend - rstart, <=, sm->sm_size);
+		ASSERT3U(rend, <=, sm->sm_start + sm->sm_size);
+
+		uint64_t start = (rstart - sm->sm_start) >> sm->sm_shift;
+		uint64_t run = (rend - rstart) >> sm->sm_shift;
+		ASSERT3U(start, >=, cursor);
+
+		int n = 0;
+		if (hdr != NULL) {
+			n = sm_compact_encode(seg, start - cursor);
+			n += sm_compact_encode(seg + n, run - 1);
+		}
 
-	/*
-	 * Find the offset right after the last word in the space map
-	 * and use that to get a hold of the last block, so we can
-	 * start appending to it.
-	 */
-	uint64_t next_word_offset = sm->sm_phys->smp_length;
-	VERIFY0(dmu_buf_hold(sm->sm_os, space_map_object(sm),
-	    next_word_offset, FTAG, &db, DMU_READ_PREFETCH));
-	ASSERT3U(db->db_size, ==, sm->sm_blksz);
+		if (hdr == NULL || nbytes + n > cap) {
+			if (hdr != NULL) {
+				*hdr = sm_compact_header(maptype, vdev_id,
+				    nbytes);
+				sm->sm_phys->smp_length += (1 +
+				    howmany(nbytes, sizeof (uint64_t))) *
+				    sizeof (uint64_t);
+			}
 
-	dmu_buf_will_dirty(db, tx);
+			hdr = space_map_reserve_words(sm,
+			    1 + howmany(SM3_SEG_MAX_BYTES, sizeof (uint64_t)),
+			    dbp, tag, tx);
+			uint64_t *block_end = (uint64_t *)(*dbp)->db_data +
+			    (sm->sm_blksz / sizeof (uint64_t));
+			cap = MIN(SM3_RECORD_MAX_BYTES,
+			    (block_end - hdr - 1) * sizeof (uint64_t));
+			nbytes = 0;
+
+			n = sm_compact_encode(seg, start);
+			n += sm_compact_encode(seg + n, run - 1);
+		}
+		ASSERT3U(nbytes + n, <=, cap);
+
+		uint64_t *payload = hdr + 1;
+		for (int i = 0; i < n; i++, nbytes++) {
+			if ((nbytes & 7) == 0)
+				payload[nbytes >> 3] = 0;
+			payload[nbytes >> 3] |=
+			    (uint64_t)seg[i] << ((nbytes & 7) << 3);
+		}
+		cursor = start + run;
+	}
+
+	if (hdr != NULL) {
+		*hdr = sm_compact_header(maptype, vdev_id, nbytes);
+		sm->sm_phys->smp_length +=
+		    (1 + howmany(nbytes, sizeof (uint64_t))) *
+		    sizeof (uint64_t);
+	}
+}
+
+/*
+ * Writes the segments of the range tree as one-word or two-word entries.
+ */
+static void
+space_map_write_entries(space_map_t *sm, zfs_range_tree_t *rt,
+    maptype_t maptype, uint64_t vdev_id, dmu_buf_t **dbp, const void *tag,
+    dmu_tx_t *tx)
+{
+	spa_t *spa = tx->tx_pool->dp_spa;
 
 	zfs_btree_t *t = &rt->rt_root;
 	zfs_btree_index_t where;
@@ -734,7 +1033,52 @@ space_map_write_impl(space_map_t *sm, zfs_range_tree_t *rt, maptype_t maptype,
 			words = 2;
 
 		space_map_write_seg(sm, zfs_rs_get_start(rs, rt),
-		    zfs_rs_get_end(rs, rt), maptype, vdev_id, words, &db,
+		    zfs_rs_get_end(rs, rt), maptype, vdev_id, words, dbp,
+		    tag, tx);
+	}
+}
+
+/*
+ * Note: The space map's dbuf must be dirty for the changes in sm_phys to
+ * take effect.
+ */
+static void
+space_map_write_impl(space_map_t *sm, zfs_range_tree_t *rt, maptype_t maptype,
+    uint64_t vdev_id, dmu_tx_t *tx)
+{
+	spa_t *spa = tx->tx_pool->dp_spa;
+	dmu_buf_t *db;
+
+	space_map_write_intro_debug(sm, maptype, tx);
+
+#ifdef ZFS_DEBUG
+	/*
+	 * We do this right after we write the intro debug entry
+	 * because the estimate does not take it into account.
+	 */
+	uint64_t initial_objsize = sm->sm_phys->smp_length;
+	uint64_t estimated_growth =
+	    space_map_estimate_optimal_size(sm, rt, SM_NO_VDEVID);
+	uint64_t estimated_final_objsize = initial_objsize + estimated_growth;
+#endif
+
+	/*
+	 * Find the offset right after the last word in the space map
+	 * and use that to get a hold of the last block, so we can
+	 * start appending to it.
+	 */
+	uint64_t next_word_offset = sm->sm_phys->smp_length;
+	VERIFY0(dmu_buf_hold(sm->sm_os, space_map_object(sm),
+	    next_word_offset, FTAG, &db, DMU_READ_PREFETCH));
+	ASSERT3U(db->db_size, ==, sm->sm_blksz);
+
+	dmu_buf_will_dirty(db, tx);
+
+	if (spa_feature_is_active(spa, SPA_FEATURE_SPACEMAP_V3)) {
+		space_map_write_compact(sm, rt, maptype, vdev_id, &db,
+		    FTAG, tx);
+	} else {
+		space_map_write_entries(sm, rt, maptype, vdev_id, &db,
 		    FTAG, tx);
 	}
 
@@ -958,6 +1302,47 @@ space_map_free(space_map_t *sm, dmu_tx_t *tx)
 	sm->sm_object = 0;
 }
 
+/*
+ * Worst-case estimate of the size of the range tree's segments when
+ * written to the given space map as compact records.  The offset of
+ * each segment is assumed to take as many bytes as the largest offset
+ * in the space map, and its run as many as the largest run of its
+ * histogram bucket.  On top of that we account for a record header and
+ * a partially filled payload word for every record, and for debug
+ * padding and an extra record at the end of every block.
+ */
+static uint64_t
+space_map_estimate_compact_size(space_map_t *sm, zfs_range_tree_t *rt)
+{
+	uint64_t shift = sm->sm_shift;
+	uint64_t offset_bytes = sm_compact_len(sm->sm_size >> shift);
+	uint64_t size = 0;
+
+	for (int idx = 0; idx < ZFS_RANGE_TREE_HISTOGRAM_SIZE; idx++) {
+		if (rt->rt_histogram[idx] == 0)
+			continue;
+
+		/* runs in this bucket are shorter than 2^(idx + 1) bytes */
+		uint64_t run_bits = (idx + 1 > shift) ? idx + 1 - shift : 1;
+		uint64_t run_bytes = (run_bits < 64) ?
+		    sm_compact_len((1ULL << run_bits) - 1) :
+		    sm_compact_len(UINT64_MAX);
+		size += rt->rt_histogram[idx] * (offset_bytes + run_bytes);
+	}
+
+	uint64_t records =
+	    size / (SM3_RECORD_MAX_BYTES - SM3_SEG_MAX_BYTES) + 1;
+	size += records * 2 * sizeof (uint64_t);
+
+	uint64_t block_words = sm->sm_blksz / sizeof (uint64_t);
+	uint64_t min_words = 1 + howmany(SM3_SEG_MAX_BYTES, sizeof (uint64_t));
+	uint64_t blocks = size / ((block_words - min_words) *
+	    sizeof (uint64_t)) + 2;
+	size += blocks * (min_words + 2) * sizeof (uint64_t);
+
+	return (size);
+}
+
 /*
  * Given a range tree, it makes a worst-case estimate of how much
  * space would the tree's segments take if they were written to
@@ -972,6 +1357,9 @@ space_map_estimate_optimal_size(space_map_t *sm, zfs_range_tree_t *rt,
 	uint64_t *histogram = rt->rt_histogram;
 	uint64_t entries_for_seg = 0;
 
+	if (spa_feature_is_active(spa, SPA_FEATURE_SPACEMAP_V3))
+		return (space_map_estimate_compact_size(sm, rt));
+
 	/*
 	 * In order to get a quick estimate of the optimal size that this
 	 * range tree would have on-disk as a space map, we iterate through
@@ -1110,3 +1498,109 @@ space_map_nblocks(space_map_t *sm)
 		return (0);
 	return (DIV_ROUND_UP(space_map_length(sm), sm->sm_blksz));
 }
+
+typedef struct space_map_compact_size_arg {
+	space_map_t	*scsa_sm;
+	uint64_t	scsa_length;
+	boolean_t	scsa_started;
+	boolean_t	scsa_open;
+	uint64_t	scsa_nbytes;
+	uint64_t	scsa_cap;
+	uint64_t	scsa_cursor;
+	uint64_t	scsa_txg;
+	uint64_t	scsa_sync_pass;
+	maptype_t	scsa_type;
+	uint32_t	scsa_vdev;
+} space_map_compact_size_arg_t;
+
+static void
+space_map_compact_size_close(space_map_compact_size_arg_t *scsa)
+{
+	if (!scsa->scsa_open)
+		return;
+	scsa->scsa_length += (1 +
+	    howmany(scsa->scsa_nbytes, sizeof (uint64_t))) * sizeof (uint64_t);
+	scsa->scsa_open = B_FALSE;
+}
+
+static void
+space_map_compact_size_open(space_map_compact_size_arg_t *scsa)
+{
+	uint64_t blksz = scsa->scsa_sm->sm_blksz;
+	uint64_t words_left =
+	    (blksz - (scsa->scsa_length % blksz)) / sizeof (uint64_t);
+
+	if (words_left < 1 + howmany(SM3_SEG_MAX_BYTES, sizeof (uint64_t))) {
+		scsa->scsa_length += words_left * sizeof (uint64_t);
+		words_left = blksz / sizeof (uint64_t);
+	}
+	scsa->scsa_cap = MIN(SM3_RECORD_MAX_BYTES,
+	    (words_left - 1) * sizeof (uint64_t));
+	scsa->scsa_nbytes = 0;
+	scsa->scsa_cursor = 0;
+	scsa->scsa_open = B_TRUE;
+}
+
+static int
+space_map_compact_size_cb(space_map_entry_t *sme, void *arg)
+{
+	space_map_compact_size_arg_t *scsa = arg;
+	space_map_t *sm = scsa->scsa_sm;
+	uint64_t start = (sme->sme_offset - sm->sm_start) >> sm->sm_shift;
+	uint64_t run = sme->sme_run >> sm->sm_shift;
+
+	/*
+	 * Every space_map_write() starts with a debug entry; assume a new
+	 * one whenever the type, TXG or sync pass changes, or whenever the
+	 * entries stop being sorted.
+	 */
+	if (!scsa->scsa_started || sme->sme_txg != scsa->scsa_txg ||
+	    sme->sme_sync_pass != scsa->scsa_sync_pass ||
+	    sme->sme_type != scsa->scsa_type ||
+	    (scsa->scsa_open && start < scsa->scsa_cursor)) {
+		space_map_compact_size_close(scsa);
+		scsa->scsa_length += sizeof (uint64_t);
+		space_map_compact_size_open(scsa);
+	} else if (sme->sme_vdev != scsa->scsa_vdev) {
+		space_map_compact_size_close(scsa);
+		space_map_compact_size_open(scsa);
+	}
+	scsa->scsa_started = B_TRUE;
+	scsa->scsa_txg = sme->sme_txg;
+	scsa->scsa_sync_pass = sme->sme_sync_pass;
+	scsa->scsa_type = sme->sme_type;
+	scsa->scsa_vdev = sme->sme_vdev;
+
+	uint64_t n = sm_compact_len(start - scsa->scsa_cursor) +
+	    sm_compact_len(run - 1);
+	if (scsa->scsa_nbytes + n > scsa->scsa_cap) {
+		space_map_compact_size_close(scsa);
+		space_map_compact_size_open(scsa);
+		n = sm_compact_len(start) + sm_compact_len(run - 1);
+	}
+	scsa->scsa_nbytes += n;
+	scsa->scsa_cursor = start + run;
+
+	return (0);
+}
+
+/*
+ * Computes how many bytes the entries of the space map would take if
+ * they had been written as compact records, following the same record
+ * and block boundaries as space_map_write().  Used by zdb to report the
+ * savings of SPA_FEATURE_SPACEMAP_V3 on an existing pool.
+ */
+int
+space_map_compact_size(space_map_t *sm, uint64_t *sizep)
+{
+	space_map_compact_size_arg_t scsa = { .scsa_sm = sm };
+
+	int error = space_map_iterate(sm, space_map_length(sm),
+	    space_map_compact_size_cb, &scsa);
+	if (error != 0)
+		return (error);
+
+	space_map_compact_size_close(&scsa);
+	*sizep = scsa.scsa_length;
+	return (0);
+}
@@ -100,6 +100,26 @@ static uint_t zfs_vdev_default_ms_shift = 29;
 /* upper limit for metaslab size (16G) */
 static uint_t zfs_vdev_max_ms_shift = 34;
 
+/*
+ * When loading the metaslabs of a top-level vdev, prefetch the space map
+ * dnodes of this many metaslabs ahead of the one being initialized so
+ * that their reads are issued concurrently rather than one at a time.
+ */
+static uint_t zfs_vdev_ms_load_prefetch = 64;
+
+/*
+ * Upper limit on the number of threads used to load vdevs in parallel
+ * during pool import (0 = one thread per leaf vdev).
+ */
+static uint_t zfs_vdev_load_threads = 0;
+
+/*
+ * If non-zero, treat every leaf vdev as a zoned device with zones of this
+ * size, regardless of what the device reports. Useful for zoned devices
+ * hidden behind a translation layer, and for testing.
+ */
+static uint64_t zfs_vdev_zone_size = 0;
+
 int vdev_validate_skip = B_FALSE;
 
 /*
@@ -741,6 +761,7 @@ vdev_alloc_common(spa_t *spa, uint_t id, uint64_t guid, vdev_ops_t *ops)
 	vd->vdev_io_t = vdev_prop_default_numeric(VDEV_PROP_IO_T);
 	vd->vdev_slow_io_n = vdev_prop_default_numeric(VDEV_PROP_SLOW_IO_N);
 	vd->vdev_slow_io_t = vdev_prop_default_numeric(VDEV_PROP_SLOW_IO_T);
+	vd->vdev_poll = vdev_prop_default_numeric(VDEV_PROP_POLL);
 
 	list_link_init(&vd->vdev_config_dirty_node);
 	list_link_init(&vd->vdev_state_dirty_node);
@@ -1400,6 +1421,7 @@ vdev_add_parent(vdev_t *cvd, vdev_ops_t *ops)
 	mvd->vdev_state = cvd->vdev_state;
 	mvd->vdev_crtxg = cvd->vdev_crtxg;
 	mvd->vdev_nonrot = cvd->vdev_nonrot;
+	mvd->vdev_zone_size = cvd->vdev_zone_size;
 
 	vdev_remove_child(pvd, cvd);
 	vdev_add_child(pvd, mvd);
@@ -1622,23 +1644,47 @@ vdev_metaslab_init(vdev_t *vd, uint64_t txg)
 		mutex_exit(&msp->ms_lock);
 	}
 
+	/*
+	 * vdev_ms_array may be 0 if we are creating the "fake" metaslabs
+	 * for an indirect vdev for zdb's leak detection. See
+	 * zdb_leak_init().  Otherwise, when opening the pool, read the
+	 * whole metaslab array at once so that the space map dnodes can
+	 * be prefetched ahead of metaslab_init().
+	 */
+	uint64_t *objects = NULL;
+	uint64_t nobjects = newc - oldc;
+	if (txg == 0 && vd->vdev_ms_array != 0 && nobjects != 0) {
+		objects = vmem_alloc(nobjects * sizeof (uint64_t), KM_SLEEP);
+		error = dmu_read(spa->spa_meta_objset, vd->vdev_ms_array,
+		    oldc * sizeof (uint64_t), nobjects * sizeof (uint64_t),
+		    objects, DMU_READ_PREFETCH);
+		if (error != 0) {
+			vdev_dbgmsg(vd, "unable to read the metaslab "
+			    "array [error=%d]", error);
+			vmem_free(objects, nobjects * sizeof (uint64_t));
+			return (error);
+		}
+	}
+
+	uint64_t window = MIN(zfs_vdev_ms_load_prefetch, nobjects);
+	for (uint64_t i = 0; objects != NULL && i < window; i++) {
+		if (objects[i] != 0) {
+			dmu_prefetch_dnode(spa->spa_meta_objset, objects[i],
+			    ZIO_PRIORITY_SYNC_READ);
+		}
+	}
+
 	for (uint64_t m = oldc; m < newc; m++) {
 		uint64_t object = 0;
-		/*
-		 * vdev_ms_array may be 0 if we are creating the "fake"
-		 * metaslabs for an indirect vdev for zdb's leak detection.
-		 * See zdb_leak_init().
-		 */
-		if (txg == 0 && vd->vdev_ms_array != 0) {
-			error = dmu_read(spa->spa_meta_objset,
-			    vd->vdev_ms_array,
-			    m * sizeof (uint64_t), sizeof (uint64_t), &object,
-			    DMU_READ_PREFETCH);
-			if (error != 0) {
-				vdev_dbgmsg(vd, "unable to read the metaslab "
-				    "array [error=%d]", error);
-				return (error);
+
+		if (objects != NULL) {
+			uint64_t i = m - oldc;
+			if (i + window < nobjects && objects[i + window] != 0) {
+				dmu_prefetch_dnode(spa->spa_meta_objset,
+				    objects[i + window],
+				    ZIO_PRIORITY_SYNC_READ);
 			}
+			object = objects[i];
 		}
 
 		error = metaslab_init(vd->vdev_mg, m, object, txg,
@@ -1646,10 +1692,16 @@ vdev_metaslab_init(vdev_t *vd, uint64_t txg)
 		if (error != 0) {
 			vdev_dbgmsg(vd, "metaslab_init failed [error=%d]",
 			    error);
+			if (objects != NULL)
+				vmem_free(objects,
+				    nobjects * sizeof (uint64_t));
 			return (error);
 		}
 	}
 
+	if (objects != NULL)
+		vmem_free(objects, nobjects * sizeof (uint64_t));
+
 	/*
 	 * Find the emptiest metaslab on the vdev and mark it for use for
 	 * embedded slog by moving it from the regular to the log metaslab
@@ -1929,14 +1981,6 @@ vdev_probe(vdev_t *vd, zio_t *zio)
 	return (NULL);
 }
 
-static void
-vdev_load_child(void *arg)
-{
-	vdev_t *vd = arg;
-
-	vd->vdev_load_error = vdev_load(vd);
-}
-
 static void
 vdev_open_child(void *arg)
 {
@@ -1985,6 +2029,7 @@ vdev_open_children_impl(vdev_t *vd, vdev_open_children_func_t *open_func)
 	taskq_t *tq = taskq_create("vdev_open", children, minclsyspri,
 	    children, children, TASKQ_PREPOPULATE);
 	vd->vdev_nonrot = B_TRUE;
+	vd->vdev_zone_size = 0;
 
 	for (int c = 0; c < children; c++) {
 		vdev_t *cvd = vd->vdev_child[c];
@@ -2009,6 +2054,8 @@ vdev_open_children_impl(vdev_t *vd, vdev_open_children_func_t *open_func)
 		    cvd->vdev_state <= VDEV_STATE_FAULTED)
 			continue;
 		vd->vdev_nonrot &= cvd->vdev_nonrot;
+		vd->vdev_zone_size = MAX(vd->vdev_zone_size,
+		    cvd->vdev_zone_size);
 	}
 
 	if (tq != NULL)
@@ -2149,6 +2196,9 @@ vdev_open(vdev_t *vd)
 	error = vd->vdev_ops->vdev_op_open(vd, &osize, &max_osize,
 	    &logical_ashift, &physical_ashift);
 
+	if (vd->vdev_ops->vdev_op_leaf && zfs_vdev_zone_size != 0)
+		vd->vdev_zone_size = zfs_vdev_zone_size;
+
 	/* Keep the device in removed state if unplugged */
 	if (error == ENOENT && vd->vdev_removed) {
 		vdev_set_state(vd, B_TRUE, VDEV_STATE_REMOVED,
@@ -2981,6 +3031,14 @@ vdev_metaslab_set_size(vdev_t *vd)
 			ms_shift = highbit64(asize / zfs_vdev_ms_count_limit);
 	}
 
+	/*
+	 * On zoned devices, make each metaslab cover a whole number of
+	 * zones so that append-only allocation within a metaslab maps onto
+	 * sequential writes within its zones.
+	 */
+	if (vd->vdev_zone_size != 0 && ISP2(vd->vdev_zone_size))
+		ms_shift = MAX(ms_shift, highbit64(vd->vdev_zone_size) - 1);
+
 	vd->vdev_ms_shift = ms_shift;
 	ASSERT3U(vd->vdev_ms_shift, >=, SPA_MAXBLOCKSHIFT);
 }
@@ -3485,8 +3543,7 @@ vdev_dtl_load(vdev_t *vd)
 		error = space_map_load(vd->vdev_dtl_sm, rt, SM_ALLOC);
 		if (error == 0) {
 			mutex_enter(&vd->vdev_dtl_lock);
-			zfs_range_tree_walk(rt, zfs_range_tree_add,
-			    vd->vdev_dtl[DTL_MISSING]);
+			zfs_range_tree_merge(rt, vd->vdev_dtl[DTL_MISSING]);
 			mutex_exit(&vd->vdev_dtl_lock);
 		}
 
@@ -3633,7 +3690,7 @@ vdev_dtl_sync(vdev_t *vd, uint64_t txg)
 	    ZFS_RT_F_DYN_NAME, vdev_rt_name(vd, "rtsync"));
 
 	mutex_enter(&vd->vdev_dtl_lock);
-	zfs_range_tree_walk(rt, zfs_range_tree_add, rtsync);
+	zfs_range_tree_merge(rt, rtsync);
 	mutex_exit(&vd->vdev_dtl_lock);
 
 	space_map_truncate(vd->vdev_dtl_sm, zfs_vdev_dtl_sm_blksz, tx);
@@ -3763,21 +3820,86 @@ vdev_checkpoint_sm_object(vdev_t *vd, uint64_t *sm_obj)
 	return (error);
 }
 
+static int vdev_load_self(vdev_t *vd);
+
+/*
+ * Finish loading a vdev whose children have all been loaded: fail with the
+ * first child error, otherwise load the vdev's own state.
+ */
+static int
+vdev_load_children_done(vdev_t *vd)
+{
+	for (int c = 0; c < vd->vdev_children; c++) {
+		int error = vd->vdev_child[c]->vdev_load_error;
+
+		if (error != 0)
+			return (error);
+	}
+
+	return (vdev_load_self(vd));
+}
+
+/*
+ * Load one vdev from the vdev_load taskq.  Children are always loaded
+ * before their parent: the last child to finish dispatches its parent,
+ * so the DTL loads of every leaf and the metaslab init of every top-level
+ * vdev run concurrently, and import time is bounded by the slowest vdev
+ * rather than by the sum of the leaves under each top-level vdev.  The
+ * root vdev is finished by vdev_load() once the taskq drains.
+ */
+static void
+vdev_load_task(void *arg)
+{
+	vdev_t *vd = arg;
+	vdev_t *pvd = vd->vdev_parent;
+	taskq_t *tq = vd->vdev_spa->spa_vdev_load_taskq;
+
+	vd->vdev_load_error = vdev_load_children_done(vd);
+
+	if (pvd->vdev_ops != &vdev_root_ops &&
+	    atomic_dec_32_nv(&pvd->vdev_load_pending) == 0) {
+		VERIFY(taskq_dispatch(tq, vdev_load_task, pvd,
+		    TQ_SLEEP) != TASKQID_INVALID);
+	}
+}
+
+static void
+vdev_load_schedule(taskq_t *tq, vdev_t *vd)
+{
+	if (vd->vdev_children == 0) {
+		VERIFY(taskq_dispatch(tq, vdev_load_task, vd,
+		    TQ_SLEEP) != TASKQID_INVALID);
+		return;
+	}
+
+	/*
+	 * Set the count before dispatching any child, since the last child
+	 * to complete is the one that dispatches this vdev.
+	 */
+	vd->vdev_load_pending = vd->vdev_children;
+	for (int c = 0; c < vd->vdev_children; c++)
+		vdev_load_schedule(tq, vd->vdev_child[c]);
+}
+
 int
 vdev_load(vdev_t *vd)
 {
-	int children = vd->vdev_children;
-	int error = 0;
+	spa_t *spa = vd->vdev_spa;
 	taskq_t *tq = NULL;
 
 	/*
-	 * It's only worthwhile to use the taskq for the root vdev, because the
-	 * slow part is metaslab_init, and that only happens for top-level
-	 * vdevs.
+	 * Use the taskq only when loading the whole tree from the root, with
+	 * one thread per leaf vdev.  Subtrees backed by zvols are loaded
+	 * synchronously, as they are when opened.
 	 */
 	if (vd->vdev_ops == &vdev_root_ops && vd->vdev_children > 0) {
-		tq = taskq_create("vdev_load", children, minclsyspri,
-		    children, children, TASKQ_PREPOPULATE);
+		int threads = MAX(vdev_count_leaves_impl(vd), 1);
+		if (zfs_vdev_load_threads != 0)
+			threads = MIN(threads, zfs_vdev_load_threads);
+		tq = taskq_create("vdev_load", threads, minclsyspri,
+		    threads, INT_MAX, TASKQ_PREPOPULATE);
+		ASSERT0P(spa->spa_vdev_load_taskq);
+		spa->spa_vdev_load_taskq = tq;
 	}
 
 	/*
@@ -3786,25 +3908,25 @@ vdev_load(vdev_t *vd)
 	for (int c = 0; c < vd->vdev_children; c++) {
 		vdev_t *cvd = vd->vdev_child[c];
 
-		if (tq == NULL || vdev_uses_zvols(cvd)) {
+		if (tq == NULL || vdev_uses_zvols(cvd))
 			cvd->vdev_load_error = vdev_load(cvd);
-		} else {
-			VERIFY(taskq_dispatch(tq, vdev_load_child,
-			    cvd, TQ_SLEEP) != TASKQID_INVALID);
-		}
+		else
+			vdev_load_schedule(tq, cvd);
 	}
 
 	if (tq != NULL) {
 		taskq_wait(tq);
+		spa->spa_vdev_load_taskq = NULL;
 		taskq_destroy(tq);
 	}
 
-	for (int c = 0; c < vd->vdev_children; c++) {
-		int error = vd->vdev_child[c]->vdev_load_error;
+	return (vdev_load_children_done(vd));
+}
 
-		if (error != 0)
-			return (error);
-	}
+static int
+vdev_load_self(vdev_t *vd)
+{
+	int error = 0;
 
 	vdev_set_deflate_ratio(vd);
 
@@ -3914,6 +4036,11 @@ vdev_load(vdev_t *vd)
 		if (error && error != ENOENT)
 			vdev_dbgmsg(vd, "vdev_load: zap_lookup(zap=%llu) "
 			    "failed [error=%d]", (u_longlong_t)zapobj, error);
+
+		error = vdev_prop_get_int(vd, VDEV_PROP_POLL, &vd->vdev_poll);
+		if (error && error != ENOENT)
+			vdev_dbgmsg(vd, "vdev_load: zap_lookup(zap=%llu) "
+			    "failed [error=%d]", (u_longlong_t)zapobj, error);
 	}
 
 	/*
@@ -4783,6 +4910,7 @@ vdev_get_child_stat_ex(vdev_t *cvd, vdev_stat_ex_t *vsx, vdev_stat_ex_t *cvsx)
 		}
 		vsx->vsx_active_queue[t] += cvsx->vsx_active_queue[t];
 		vsx->vsx_pend_queue[t] += cvsx->vsx_pend_queue[t];
+		vsx->vsx_max_active[t] += cvsx->vsx_max_active[t];
 
 		for (b = 0; b < ARRAY_SIZE(vsx->vsx_ind_histo[0]); b++)
 			vsx->vsx_ind_histo[t][b] += cvsx->vsx_ind_histo[t][b];
@@ -4791,6 +4919,12 @@ vdev_get_child_stat_ex(vdev_t *cvd, vdev_stat_ex_t *vsx, vdev_stat_ex_t *cvsx)
 			vsx->vsx_agg_histo[t][b] += cvsx->vsx_agg_histo[t][b];
 	}
 
+	for (t = 0; t < ZIO_SH_TYPES; t++) {
+		for (b = 0; b < ARRAY_SIZE(vsx->vsx_stage_histo[0]); b++) {
+			vsx->vsx_stage_histo[t][b] +=
+			    cvsx->vsx_stage_histo[t][b];
+		}
+	}
 }
 
 boolean_t
@@ -4844,6 +4978,21 @@ vdev_get_stats_ex_impl(vdev_t *vd, vdev_stat_t *vs, vdev_stat_ex_t *vsx)
 			if (vsx)
 				vdev_get_child_stat_ex(cvd, vsx, cvsx);
 		}
+
+		/*
+		 * Stages of logical I/O are not charged to any leaf, so
+		 * they only appear in the pool-wide stage histograms.
+		 */
+		if (vsx && vd == vd->vdev_spa->spa_root_vdev) {
+			spa_t *spa = vd->vdev_spa;
+
+			for (t = 0; t < ZIO_SH_TYPES; t++) {
+				for (int b = 0; b < VDEV_L_HISTO_BUCKETS; b++) {
+					vsx->vsx_stage_histo[t][b] +=
+					    spa->spa_stage_histo[t][b];
+				}
+			}
+		}
 	} else {
 		/*
 		 * We're a leaf.  Just copy our ZIO active queue stats in.  The
@@ -4857,6 +5006,7 @@ vdev_get_stats_ex_impl(vdev_t *vd, vdev_stat_t *vs, vdev_stat_ex_t *vsx)
 		for (t = 0; t < ZIO_PRIORITY_NUM_QUEUEABLE; t++) {
 			vsx->vsx_active_queue[t] = vd->vdev_queue.vq_cactive[t];
 			vsx->vsx_pend_queue[t] = vdev_queue_class_length(vd, t);
+			vsx->vsx_max_active[t] = vdev_queue_class_depth(vd, t);
 		}
 	}
 }
@@ -5121,6 +5271,13 @@ vdev_stat_update(zio_t *zio, uint64_t psize)
 				    [L_HISTO(zio->io_delay)]++;
 				vsx->vsx_total_histo[type]
 				    [L_HISTO(zio->io_delta)]++;
+				if (zio_stage_histo) {
+					vsx->vsx_stage_histo[ZIO_SH_QUEUE]
+					    [L_HISTO(zio->io_delta -
+					    zio->io_delay)]++;
+					vsx->vsx_stage_histo[ZIO_SH_DISK]
+					    [L_HISTO(zio->io_delay)]++;
+				}
 			}
 		}
 
@@ -5728,11 +5885,15 @@ vdev_deadman(vdev_t *vd, const char *tag)
 			 * Look at the head of all the pending queues,
 			 * if any I/O has been outstanding for longer than
 			 * the spa_deadman_synctime invoke the deadman logic.
+			 * I/Os issued by the queue fast path are not on the
+			 * list; the zio deadman finds those from the root.
 			 */
 			fio = list_head(&vq->vq_active_list);
-			delta = gethrtime() - fio->io_timestamp;
-			if (delta > spa_deadman_synctime(spa))
-				zio_deadman(fio, tag);
+			if (fio != NULL) {
+				delta = gethrtime() - fio->io_timestamp;
+				if (delta > spa_deadman_synctime(spa))
+					zio_deadman(fio, tag);
+			}
 		}
 		mutex_exit(&vq->vq_lock);
 	}
@@ -6107,6 +6268,13 @@ vdev_prop_set(vdev_t *vd, nvlist_t *innvl, nvlist_t *outnvl)
 			}
 			vd->vdev_failfast = intval & 1;
 			break;
+		case VDEV_PROP_POLL:
+			if (nvpair_value_uint64(elem, &intval) != 0) {
+				error = EINVAL;
+				break;
+			}
+			vd->vdev_poll = intval & 1;
+			break;
 		case VDEV_PROP_CHECKSUM_N:
 			if (nvpair_value_uint64(elem, &intval) != 0) {
 				error = EINVAL;
@@ -6488,6 +6656,7 @@ vdev_prop_get(vdev_t *vd, nvlist_t *innvl, nvlist_t *outnvl)
 				    intval, src);
 				break;
 			case VDEV_PROP_FAILFAST:
+			case VDEV_PROP_POLL:
 				src = ZPROP_SRC_LOCAL;
 				strval = NULL;
 
@@ -6638,6 +6807,15 @@ ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, min_ms_count, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, ms_count_limit, UINT, ZMOD_RW,
 	"Practical upper limit of total metaslabs per top-level vdev");
 
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, ms_load_prefetch, UINT, ZMOD_RW,
+	"Number of metaslab space maps to prefetch ahead when loading a vdev");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, load_threads, UINT, ZMOD_RW,
+	"Maximum threads used to load top-level vdevs (0 = one per vdev)");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, zone_size, U64, ZMOD_RW,
+	"Treat leaf vdevs as zoned with this zone size (0 = as reported)");
+
 ZFS_MODULE_PARAM(zfs, zfs_, slow_io_events_per_second, UINT, ZMOD_RW,
 	"Rate limit slow IO (delay) events to this many per second");
 
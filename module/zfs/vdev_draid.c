@@ -556,7 +556,7 @@ vdev_draid_lookup_map(uint64_t children, const draid_map_t **mapp)
  * Lookup the permutation array and iteration id for the provided offset.
  */
 static void
-vdev_draid_get_perm(vdev_draid_config_t *vdc, uint64_t pindex,
+vdev_draid_get_perm(const vdev_draid_config_t *vdc, uint64_t pindex,
     uint8_t **base, uint64_t *iter)
 {
 	uint64_t ncols = vdc->vdc_children;
@@ -566,11 +566,44 @@ vdev_draid_get_perm(vdev_draid_config_t *vdc, uint64_t pindex,
 	*iter = poff % ncols;
 }
 
+/*
+ * Both the permutation entry and the iteration are less than the number of
+ * children, so their sum can be reduced with a single subtraction.  This is
+ * evaluated for every column of every I/O, where a division is costly.
+ */
 static inline uint64_t
-vdev_draid_permute_id(vdev_draid_config_t *vdc,
+vdev_draid_permute_id(const vdev_draid_config_t *vdc,
     uint8_t *base, uint64_t iter, uint64_t index)
 {
-	return ((base[index] + iter) % vdc->vdc_children);
+	uint64_t id = base[index] + iter;
+
+	ASSERT3U(base[index], <, vdc->vdc_children);
+	ASSERT3U(iter, <, vdc->vdc_children);
+
+	return (id >= vdc->vdc_children ? id - vdc->vdc_children : id);
+}
+
+/*
+ * Fill in the child vdev id of each of the group's columns.  Used by the
+ * dRAID mapping benchmark, and equivalent to the per-column mapping done
+ * by vdev_draid_map_alloc_row().
+ */
+void
+vdev_draid_group_children(const vdev_draid_config_t *vdc, uint64_t group,
+    uint8_t *ids)
+{
+	uint64_t ndisks = vdc->vdc_ndisks;
+	uint64_t c = (group * vdc->vdc_groupwidth) % ndisks;
+	uint8_t *base;
+	uint64_t iter;
+
+	vdev_draid_get_perm(vdc, group / vdc->vdc_ngroups, &base, &iter);
+
+	for (uint64_t i = 0; i < vdc->vdc_groupwidth; i++) {
+		ids[i] = vdev_draid_permute_id(vdc, base, iter, c);
+		if (++c == ndisks)
+			c = 0;
+	}
 }
 
 /*
@@ -1040,13 +1073,14 @@ vdev_draid_map_alloc_row(zio_t *zio, raidz_row_t **rrp, uint64_t io_offset,
 	uint8_t *base;
 	uint64_t iter, asize = 0;
 	vdev_draid_get_perm(vdc, perm, &base, &iter);
-	for (uint64_t i = 0; i < groupwidth; i++) {
+	for (uint64_t i = 0, c = groupstart; i < groupwidth; i++, c++) {
 		raidz_col_t *rc = &rr->rr_col[i];
-		uint64_t c = (groupstart + i) % ndisks;
 
 		/* increment the offset if we wrap to the next row */
-		if (i == wrap)
+		if (i == wrap) {
 			physical_offset += VDEV_DRAID_ROWHEIGHT;
+			c = 0;
+		}
 
 		rc->rc_devidx = vdev_draid_permute_id(vdc, base, iter, c);
 		rc->rc_offset = physical_offset;
@@ -1403,8 +1437,10 @@ vdev_draid_group_degraded(vdev_t *vd, uint64_t offset)
 	uint64_t iter;
 	vdev_draid_get_perm(vdc, perm, &base, &iter);
 
-	for (uint64_t i = 0; i < vdc->vdc_groupwidth; i++) {
-		uint64_t c = (groupstart + i) % vdc->vdc_ndisks;
+	for (uint64_t i = 0, c = groupstart; i < vdc->vdc_groupwidth;
+	    i++, c++) {
+		if (c == vdc->vdc_ndisks)
+			c = 0;
 		uint64_t cid = vdev_draid_permute_id(vdc, base, iter, c);
 		vdev_t *cvd = vd->vdev_child[cid];
 
@@ -1443,8 +1479,10 @@ vdev_draid_group_missing(vdev_t *vd, uint64_t offset, uint64_t txg,
 	uint64_t iter;
 	vdev_draid_get_perm(vdc, perm, &base, &iter);
 
-	for (uint64_t i = 0; i < vdc->vdc_groupwidth; i++) {
-		uint64_t c = (groupstart + i) % vdc->vdc_ndisks;
+	for (uint64_t i = 0, c = groupstart; i < vdc->vdc_groupwidth;
+	    i++, c++) {
+		if (c == vdc->vdc_ndisks)
+			c = 0;
 		uint64_t cid = vdev_draid_permute_id(vdc, base, iter, c);
 		vdev_t *cvd = vd->vdev_child[cid];
 
@@ -1932,6 +1970,16 @@ vdev_draid_io_start_read(zio_t *zio, raidz_row_t *rr)
 			continue;
 		}
 
+		if (vdev_raidz_child_slow(zio, rr, cvd)) {
+			if (c >= rr->rr_firstdatacol)
+				rr->rr_missingdata++;
+			else
+				rr->rr_missingparity++;
+			rc->rc_error = SET_ERROR(ESTALE);
+			rc->rc_skipped = 1;
+			continue;
+		}
+
 		if (zio->io_flags & ZIO_FLAG_RESILVER) {
 			vdev_t *svd;
 
@@ -2141,8 +2189,10 @@ vdev_draid_xlate(vdev_t *cvd, const zfs_range_seg64_t *logical_rs,
 	 * Otherwise, leave them unmodified which will result in an empty
 	 * (zero-length) physical range being returned.
 	 */
-	for (uint64_t i = 0; i < vdc->vdc_groupwidth; i++) {
-		uint64_t c = (groupstart + i) % vdc->vdc_ndisks;
+	for (uint64_t i = 0, c = groupstart; i < vdc->vdc_groupwidth;
+	    i++, c++) {
+		if (c == vdc->vdc_ndisks)
+			c = 0;
 
 		if (c == 0 && i != 0) {
 			/* the group wrapped, increment the start */
@@ -2485,6 +2535,7 @@ vdev_draid_spare_open(vdev_t *vd, uint64_t *psize, uint64_t *max_psize,
 
 	vds->vds_draid_vdev = tvd;
 	vd->vdev_nonrot = tvd->vdev_nonrot;
+	vd->vdev_zone_size = tvd->vdev_zone_size;
 
 	return (0);
 }
@@ -52,6 +52,14 @@ static taskq_t *vdev_file_taskq;
 static uint_t vdev_file_logical_ashift = SPA_MINBLOCKSHIFT;
 static uint_t vdev_file_physical_ashift = SPA_MINBLOCKSHIFT;
 
+#ifndef _KERNEL
+/*
+ * Issue reads and writes through zfs_file_aio_pread()/pwrite() instead of a
+ * blocking call on a taskq thread, when the platform supports it.
+ */
+static int vdev_file_aio = 1;
+#endif
+
 void
 vdev_file_init(void)
 {
@@ -59,11 +67,17 @@ vdev_file_init(void)
 	    minclsyspri, boot_ncpus, INT_MAX, TASKQ_DYNAMIC);
 
 	VERIFY(vdev_file_taskq);
+#ifndef _KERNEL
+	zfs_file_aio_init();
+#endif
 }
 
 void
 vdev_file_fini(void)
 {
+#ifndef _KERNEL
+	zfs_file_aio_fini();
+#endif
 	taskq_destroy(vdev_file_taskq);
 }
 
@@ -238,6 +252,51 @@ vdev_file_io_strategy(void *arg)
 	zio_delay_interrupt(zio);
 }
 
+#ifndef _KERNEL
+static void
+vdev_file_io_aio_done(void *arg, void *buf, int err, ssize_t resid)
+{
+	zio_t *zio = arg;
+
+	if (zio->io_type == ZIO_TYPE_READ)
+		abd_return_buf_copy(zio->io_abd, buf, zio->io_size);
+	else
+		abd_return_buf(zio->io_abd, buf, zio->io_size);
+
+	zio->io_error = err;
+	if (resid != 0 && zio->io_error == 0)
+		zio->io_error = SET_ERROR(ENOSPC);
+
+	zio_delay_interrupt(zio);
+}
+
+/*
+ * Start zio asynchronously.  Returns non-zero if that is not possible and the
+ * caller must issue it synchronously instead.
+ */
+static int
+vdev_file_io_aio(zio_t *zio)
+{
+	vdev_file_t *vf = zio->io_vd->vdev_tsd;
+	void *buf;
+	int err;
+
+	if (zio->io_type == ZIO_TYPE_READ) {
+		buf = abd_borrow_buf(zio->io_abd, zio->io_size);
+		err = zfs_file_aio_pread(vf->vf_file, buf, zio->io_size,
+		    zio->io_offset, vdev_file_io_aio_done, zio);
+	} else {
+		buf = abd_borrow_buf_copy(zio->io_abd, zio->io_size);
+		err = zfs_file_aio_pwrite(vf->vf_file, buf, zio->io_size,
+		    zio->io_offset, vdev_file_io_aio_done, zio);
+	}
+	if (err != 0)
+		abd_return_buf(zio->io_abd, buf, zio->io_size);
+
+	return (err);
+}
+#endif
+
 static void
 vdev_file_io_fsync(void *arg)
 {
@@ -298,6 +357,11 @@ vdev_file_io_start(zio_t *zio)
 	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
 	zio->io_target_timestamp = zio_handle_io_delay(zio);
 
+#ifndef _KERNEL
+	if (vdev_file_aio && vdev_file_io_aio(zio) == 0)
+		return;
+#endif
+
 	VERIFY3U(taskq_dispatch(vdev_file_taskq, vdev_file_io_strategy, zio,
 	    TQ_SLEEP), !=, TASKQID_INVALID);
 }
@@ -366,6 +430,11 @@ vdev_ops_t vdev_disk_ops = {
 
 #endif
 
+#ifndef _KERNEL
+ZFS_MODULE_PARAM(zfs_vdev_file, vdev_file_, aio, INT, ZMOD_RW,
+	"Use asynchronous I/O for file vdevs where supported");
+#endif
+
 ZFS_MODULE_PARAM(zfs_vdev_file, vdev_file_, logical_ashift, UINT, ZMOD_RW,
 	"Logical ashift for file-based devices");
 ZFS_MODULE_PARAM(zfs_vdev_file, vdev_file_, physical_ashift, UINT, ZMOD_RW,
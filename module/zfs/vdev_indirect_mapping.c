@@ -26,6 +26,46 @@
 #include <sys/zfeature.h>
 #include <sys/dmu_objset.h>
 
+/*
+ * Indirect mapping lookup kstats
+ */
+static kstat_t *vim_ksp = NULL;
+
+typedef struct vim_stats {
+	kstat_named_t vim_stat_cache_hits;
+	kstat_named_t vim_stat_cache_misses;
+} vim_stats_t;
+
+static vim_stats_t vim_stats = {
+	/* Lookup satisfied by the entry cached for its offset */
+	{ "cache_hits",				KSTAT_DATA_UINT64 },
+	/* Lookup which searched the mapping */
+	{ "cache_misses",			KSTAT_DATA_UINT64 },
+};
+
+#define	VIM_STAT_BUMP(stat)	atomic_inc_64(&vim_stats.stat.value.ui64)
+
+void
+vdev_indirect_mapping_stat_init(void)
+{
+	vim_ksp = kstat_create("zfs", 0, "vdev_indirect_mapping_stats",
+	    "misc", KSTAT_TYPE_NAMED,
+	    sizeof (vim_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (vim_ksp != NULL) {
+		vim_ksp->ks_data = &vim_stats;
+		kstat_install(vim_ksp);
+	}
+}
+
+void
+vdev_indirect_mapping_stat_fini(void)
+{
+	if (vim_ksp != NULL) {
+		kstat_delete(vim_ksp);
+		vim_ksp = NULL;
+	}
+}
+
 #ifdef ZFS_DEBUG
 static boolean_t
 vdev_indirect_mapping_verify(vdev_indirect_mapping_t *vim)
@@ -173,6 +213,46 @@ dva_mapping_overlap_compare(const void *v_key, const void *v_array_elem)
  * the offset is missing from the table). If there are no entries whose
  * source offset is greater than the passed in offset, NULL is returned.
  */
+/*
+ * Hash an offset to its vim_cache slot.  Offsets within the same 128K are
+ * hashed together, since they are likely to be covered by the same entry.
+ */
+static inline uint64_t
+vdev_indirect_mapping_cache_slot(uint64_t offset)
+{
+	return (((offset >> SPA_OLD_MAXBLOCKSHIFT) * 0x9E3779B97F4A7C15ULL) >>
+	    (64 - VIM_CACHE_SHIFT));
+}
+
+/*
+ * Rebuild the in-memory lookup state after vim_entries has changed.  The
+ * index is only worth keeping once the mapping is larger than one window.
+ */
+static void
+vdev_indirect_mapping_index_build(vdev_indirect_mapping_t *vim)
+{
+	uint64_t num_entries = vim->vim_phys->vimp_num_entries;
+
+	if (vim->vim_index != NULL) {
+		vmem_free(vim->vim_index,
+		    vim->vim_index_count * sizeof (uint64_t));
+		vim->vim_index = NULL;
+		vim->vim_index_count = 0;
+	}
+	memset(vim->vim_cache, 0, sizeof (vim->vim_cache));
+
+	if (num_entries <= (1ULL << VIM_INDEX_SHIFT))
+		return;
+
+	vim->vim_index_count = ((num_entries - 1) >> VIM_INDEX_SHIFT) + 1;
+	vim->vim_index = vmem_alloc(vim->vim_index_count * sizeof (uint64_t),
+	    KM_SLEEP);
+	for (uint64_t i = 0; i < vim->vim_index_count; i++) {
+		vim->vim_index[i] = DVA_MAPPING_GET_SRC_OFFSET(
+		    &vim->vim_entries[i << VIM_INDEX_SHIFT]);
+	}
+}
+
 static vdev_indirect_mapping_entry_phys_t *
 vdev_indirect_mapping_entry_for_offset_impl(vdev_indirect_mapping_t *vim,
     uint64_t offset, boolean_t next_if_missing)
@@ -185,6 +265,34 @@ vdev_indirect_mapping_entry_for_offset_impl(vdev_indirect_mapping_t *vim,
 	uint64_t last = vim->vim_phys->vimp_num_entries - 1;
 	uint64_t base = 0;
 
+	uint64_t slot = vdev_indirect_mapping_cache_slot(offset);
+	uint64_t hint = atomic_load_64(&vim->vim_cache[slot]);
+	if (hint != 0 && hint - 1 <= last &&
+	    dva_mapping_overlap_compare(&offset,
+	    &vim->vim_entries[hint - 1]) == 0) {
+		VIM_STAT_BUMP(vim_stat_cache_hits);
+		return (&vim->vim_entries[hint - 1]);
+	}
+	VIM_STAT_BUMP(vim_stat_cache_misses);
+
+	/*
+	 * Narrow the search to the window of entries starting at the last
+	 * sampled offset not greater than the one we're looking for.
+	 */
+	if (vim->vim_index != NULL && offset >= vim->vim_index[0]) {
+		uint64_t lo = 0, hi = vim->vim_index_count - 1;
+
+		while (lo < hi) {
+			uint64_t i = lo + ((hi - lo + 1) >> 1);
+			if (vim->vim_index[i] <= offset)
+				lo = i;
+			else
+				hi = i - 1;
+		}
+		base = lo << VIM_INDEX_SHIFT;
+		last = MIN(last, base + (1ULL << VIM_INDEX_SHIFT) - 1);
+	}
+
 	/*
 	 * We don't define these inside of the while loop because we use
 	 * their value in the case that offset isn't in the mapping.
@@ -200,6 +308,7 @@ vdev_indirect_mapping_entry_for_offset_impl(vdev_indirect_mapping_t *vim,
 
 		if (result == 0) {
 			entry = &vim->vim_entries[mid];
+			atomic_store_64(&vim->vim_cache[slot], mid + 1);
 			break;
 		} else if (result < 0) {
 			last = mid - 1;
@@ -291,6 +400,12 @@ vdev_indirect_mapping_close(vdev_indirect_mapping_t *vim)
 {
 	ASSERT(vdev_indirect_mapping_verify(vim));
 
+	if (vim->vim_index != NULL) {
+		vmem_free(vim->vim_index,
+		    vim->vim_index_count * sizeof (uint64_t));
+		vim->vim_index = NULL;
+	}
+
 	if (vim->vim_phys->vimp_num_entries > 0) {
 		uint64_t map_size = vdev_indirect_mapping_size(vim);
 		vmem_free(vim->vim_entries, map_size);
@@ -363,6 +478,7 @@ vdev_indirect_mapping_open(objset_t *os, uint64_t mapping_object)
 		vim->vim_entries = vmem_alloc(map_size, KM_SLEEP);
 		VERIFY0(dmu_read(os, vim->vim_object, 0, map_size,
 		    vim->vim_entries, DMU_READ_PREFETCH));
+		vdev_indirect_mapping_index_build(vim);
 	}
 
 	ASSERT(vdev_indirect_mapping_verify(vim));
@@ -489,6 +605,7 @@ vdev_indirect_mapping_add_entries(vdev_indirect_mapping_t *vim,
 	VERIFY0(dmu_read(vim->vim_objset, vim->vim_object, old_size,
 	    new_size - old_size, &vim->vim_entries[old_count],
 	    DMU_READ_PREFETCH));
+	vdev_indirect_mapping_index_build(vim);
 
 	zfs_dbgmsg("txg %llu: wrote %llu entries to "
 	    "indirect mapping obj %llu; max offset=0x%llx",
@@ -39,10 +39,17 @@
  */
 static uint64_t zfs_initialize_value = 0xdeadbeefdeadbeeeULL;
 
-/* maximum number of I/Os outstanding per leaf vdev */
-static const int zfs_initialize_limit = 1;
+/*
+ * Maximum number of I/Os outstanding per leaf vdev.  Keeping several large
+ * writes queued lets the vdev queue stream them back to back, which is
+ * much faster than one write at a time on rotational media.
+ */
+static uint_t zfs_initialize_limit = 1;
 
-/* size of initializing writes; default 1MiB, see zfs_remove_max_segment */
+/*
+ * Size of initializing writes; default 1MiB, see zfs_remove_max_segment.
+ * Clamped to SPA_MAXBLOCKSIZE.
+ */
 static uint64_t zfs_initialize_chunk_size = 1024 * 1024;
 
 static boolean_t
@@ -242,7 +249,8 @@ vdev_initialize_write(vdev_t *vd, uint64_t start, uint64_t size, abd_t *data)
 
 	/* Limit inflight initializing I/Os */
 	mutex_enter(&vd->vdev_initialize_io_lock);
-	while (vd->vdev_initialize_inflight >= zfs_initialize_limit) {
+	while (vd->vdev_initialize_inflight >=
+	    MAX(zfs_initialize_limit, 1)) {
 		cv_wait(&vd->vdev_initialize_io_cv,
 		    &vd->vdev_initialize_io_lock);
 	}
@@ -309,14 +317,29 @@ vdev_initialize_block_fill(void *buf, size_t len, void *unused)
 	return (0);
 }
 
+/*
+ * The size of the writes for one pass of vdev_initialize_thread().  It is
+ * sampled once, so the filler ABD always matches the writes issued from it
+ * even if zfs_initialize_chunk_size is changed while initializing.
+ */
+static uint64_t
+vdev_initialize_chunk_size(vdev_t *vd)
+{
+	uint64_t ashift_size = 1ULL << vd->vdev_top->vdev_ashift;
+	uint64_t chunk_size = MIN(zfs_initialize_chunk_size, SPA_MAXBLOCKSIZE);
+
+	return (MAX(P2ALIGN_TYPED(chunk_size, ashift_size, uint64_t),
+	    ashift_size));
+}
+
 static abd_t *
-vdev_initialize_block_alloc(void)
+vdev_initialize_block_alloc(uint64_t chunk_size)
 {
 	/* Allocate ABD for filler data */
-	abd_t *data = abd_alloc_for_io(zfs_initialize_chunk_size, B_FALSE);
+	abd_t *data = abd_alloc_for_io(chunk_size, B_FALSE);
 
-	ASSERT0(zfs_initialize_chunk_size % sizeof (uint64_t));
-	(void) abd_iterate_func(data, 0, zfs_initialize_chunk_size,
+	ASSERT0(chunk_size % sizeof (uint64_t));
+	(void) abd_iterate_func(data, 0, chunk_size,
 	    vdev_initialize_block_fill, NULL);
 
 	return (data);
@@ -329,7 +352,7 @@ vdev_initialize_block_free(abd_t *data)
 }
 
 static int
-vdev_initialize_ranges(vdev_t *vd, abd_t *data)
+vdev_initialize_ranges(vdev_t *vd, abd_t *data, uint64_t chunk_size)
 {
 	zfs_range_tree_t *rt = vd->vdev_initialize_tree;
 	zfs_btree_t *bt = &rt->rt_root;
@@ -341,17 +364,15 @@ vdev_initialize_ranges(vdev_t *vd, abd_t *data)
 		    zfs_rs_get_start(rs, rt);
 
 		/* Split range into legally-sized physical chunks */
-		uint64_t writes_required =
-		    ((size - 1) / zfs_initialize_chunk_size) + 1;
+		uint64_t writes_required = ((size - 1) / chunk_size) + 1;
 
 		for (uint64_t w = 0; w < writes_required; w++) {
 			int error;
 
 			error = vdev_initialize_write(vd,
 			    VDEV_LABEL_START_SIZE + zfs_rs_get_start(rs, rt) +
-			    (w * zfs_initialize_chunk_size),
-			    MIN(size - (w * zfs_initialize_chunk_size),
-			    zfs_initialize_chunk_size), data);
+			    (w * chunk_size),
+			    MIN(size - (w * chunk_size), chunk_size), data);
 			if (error != 0)
 				return (error);
 		}
@@ -539,7 +560,8 @@ vdev_initialize_thread(void *arg)
 	vd->vdev_initialize_last_offset = 0;
 	VERIFY0(vdev_initialize_load(vd));
 
-	abd_t *deadbeef = vdev_initialize_block_alloc();
+	uint64_t chunk_size = vdev_initialize_chunk_size(vd);
+	abd_t *deadbeef = vdev_initialize_block_alloc(chunk_size);
 
 	vd->vdev_initialize_tree = zfs_range_tree_create_flags(
 	    NULL, ZFS_RANGE_SEG64, NULL, 0, 0,
@@ -570,7 +592,7 @@ vdev_initialize_thread(void *arg)
 		    vdev_initialize_range_add, vd);
 		mutex_exit(&msp->ms_lock);
 
-		error = vdev_initialize_ranges(vd, deadbeef);
+		error = vdev_initialize_ranges(vd, deadbeef, chunk_size);
 		metaslab_enable(msp, B_TRUE, unload_when_done);
 		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
 
@@ -833,3 +855,6 @@ ZFS_MODULE_PARAM(zfs, zfs_, initialize_value, U64, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs, zfs_, initialize_chunk_size, U64, ZMOD_RW,
 	"Size in bytes of writes by zpool initialize");
+
+ZFS_MODULE_PARAM(zfs, zfs_, initialize_limit, UINT, ZMOD_RW,
+	"Max queued zpool initialize writes per leaf vdev");
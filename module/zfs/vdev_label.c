@@ -283,6 +283,28 @@ vdev_config_generate_stats(vdev_t *vd, nvlist_t *nv)
 	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_REBUILD_PEND_QUEUE,
 	    vsx->vsx_pend_queue[ZIO_PRIORITY_REBUILD]);
 
+	/* ZIOs allowed to be active */
+	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_SYNC_R_MAX_ACTIVE,
+	    vsx->vsx_max_active[ZIO_PRIORITY_SYNC_READ]);
+
+	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_SYNC_W_MAX_ACTIVE,
+	    vsx->vsx_max_active[ZIO_PRIORITY_SYNC_WRITE]);
+
+	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_ASYNC_R_MAX_ACTIVE,
+	    vsx->vsx_max_active[ZIO_PRIORITY_ASYNC_READ]);
+
+	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_ASYNC_W_MAX_ACTIVE,
+	    vsx->vsx_max_active[ZIO_PRIORITY_ASYNC_WRITE]);
+
+	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_SCRUB_MAX_ACTIVE,
+	    vsx->vsx_max_active[ZIO_PRIORITY_SCRUB]);
+
+	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_TRIM_MAX_ACTIVE,
+	    vsx->vsx_max_active[ZIO_PRIORITY_TRIM]);
+
+	fnvlist_add_uint64(nvx, ZPOOL_CONFIG_VDEV_REBUILD_MAX_ACTIVE,
+	    vsx->vsx_max_active[ZIO_PRIORITY_REBUILD]);
+
 	/* Histograms */
 	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_TOT_R_LAT_HISTO,
 	    vsx->vsx_total_histo[ZIO_TYPE_READ],
@@ -328,6 +350,36 @@ vdev_config_generate_stats(vdev_t *vd, nvlist_t *nv)
 	    vsx->vsx_queue_histo[ZIO_PRIORITY_REBUILD],
 	    ARRAY_SIZE(vsx->vsx_queue_histo[ZIO_PRIORITY_REBUILD]));
 
+	/* zio pipeline stages */
+	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_COMPRESS_STAGE_HISTO,
+	    vsx->vsx_stage_histo[ZIO_SH_COMPRESS],
+	    ARRAY_SIZE(vsx->vsx_stage_histo[ZIO_SH_COMPRESS]));
+
+	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_CKSUM_GEN_STAGE_HISTO,
+	    vsx->vsx_stage_histo[ZIO_SH_CHECKSUM_GENERATE],
+	    ARRAY_SIZE(vsx->vsx_stage_histo[ZIO_SH_CHECKSUM_GENERATE]));
+
+	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_ALLOC_STAGE_HISTO,
+	    vsx->vsx_stage_histo[ZIO_SH_DVA_ALLOCATE],
+	    ARRAY_SIZE(vsx->vsx_stage_histo[ZIO_SH_DVA_ALLOCATE]));
+
+	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_QUEUE_STAGE_HISTO,
+	    vsx->vsx_stage_histo[ZIO_SH_QUEUE],
+	    ARRAY_SIZE(vsx->vsx_stage_histo[ZIO_SH_QUEUE]));
+
+	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_DISK_STAGE_HISTO,
+	    vsx->vsx_stage_histo[ZIO_SH_DISK],
+	    ARRAY_SIZE(vsx->vsx_stage_histo[ZIO_SH_DISK]));
+
+	fnvlist_add_uint64_array(nvx,
+	    ZPOOL_CONFIG_VDEV_CKSUM_VERIFY_STAGE_HISTO,
+	    vsx->vsx_stage_histo[ZIO_SH_CHECKSUM_VERIFY],
+	    ARRAY_SIZE(vsx->vsx_stage_histo[ZIO_SH_CHECKSUM_VERIFY]));
+
+	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_DECOMPRESS_STAGE_HISTO,
+	    vsx->vsx_stage_histo[ZIO_SH_DECOMPRESS],
+	    ARRAY_SIZE(vsx->vsx_stage_histo[ZIO_SH_DECOMPRESS]));
+
 	/* Request sizes */
 	fnvlist_add_uint64_array(nvx, ZPOOL_CONFIG_VDEV_SYNC_IND_R_HISTO,
 	    vsx->vsx_ind_histo[ZIO_PRIORITY_SYNC_READ],
@@ -1898,7 +1950,7 @@ vdev_label_sync_ignore_done(zio_t *zio)
  */
 static void
 vdev_label_sync(zio_t *zio, uint64_t *good_writes,
-    vdev_t *vd, int l, uint64_t txg, int flags)
+    vdev_t *vd, int l, uint64_t txg, int flags, nvlist_t **top_label)
 {
 	nvlist_t *label;
 	vdev_phys_t *vp;
@@ -1910,7 +1962,7 @@ vdev_label_sync(zio_t *zio, uint64_t *good_writes,
 
 	for (int c = 0; c < vd->vdev_children; c++) {
 		vdev_label_sync(zio, good_writes,
-		    vd->vdev_child[c], l, txg, flags);
+		    vd->vdev_child[c], l, txg, flags, top_label);
 	}
 
 	if (!vd->vdev_ops->vdev_op_leaf)
@@ -1932,11 +1984,30 @@ vdev_label_sync(zio_t *zio, uint64_t *good_writes,
 
 	/*
 	 * Generate a label describing the top-level config to which we belong.
+	 * The labels of all leaves of a top-level vdev differ only in their
+	 * own guid and spare/log flags, so the config is generated once per
+	 * top-level vdev and then adjusted for each leaf.  On wide top-level
+	 * vdevs this avoids regenerating the whole vdev tree for every leaf.
 	 */
 	if ((vd->vdev_isspare && !spare_in_use) || vd->vdev_isl2cache) {
 		label = vdev_aux_label_generate(vd, vd->vdev_isspare);
-	} else {
+	} else if (top_label == NULL) {
 		label = spa_config_generate(vd->vdev_spa, vd, txg, B_FALSE);
+	} else {
+		if (*top_label == NULL) {
+			*top_label = spa_config_generate(vd->vdev_spa, vd,
+			    txg, B_FALSE);
+		}
+		label = *top_label;
+		fnvlist_add_uint64(label, ZPOOL_CONFIG_GUID, vd->vdev_guid);
+		if (vd->vdev_isspare)
+			fnvlist_add_uint64(label, ZPOOL_CONFIG_IS_SPARE, 1ULL);
+		else
+			(void) nvlist_remove_all(label, ZPOOL_CONFIG_IS_SPARE);
+		if (vd->vdev_islog)
+			fnvlist_add_uint64(label, ZPOOL_CONFIG_IS_LOG, 1ULL);
+		else
+			(void) nvlist_remove_all(label, ZPOOL_CONFIG_IS_LOG);
 	}
 
 	vp_abd = abd_alloc_linear(sizeof (vdev_phys_t), B_TRUE);
@@ -1957,7 +2028,8 @@ vdev_label_sync(zio_t *zio, uint64_t *good_writes,
 	}
 
 	abd_free(vp_abd);
-	nvlist_free(label);
+	if (top_label == NULL || label != *top_label)
+		nvlist_free(label);
 }
 
 static int
@@ -1983,8 +2055,12 @@ vdev_label_sync_list(spa_t *spa, int l, uint64_t txg, int flags)
 		    (vd->vdev_islog || vd->vdev_aux != NULL) ?
 		    vdev_label_sync_ignore_done : vdev_label_sync_top_done,
 		    good_writes, flags);
-		vdev_label_sync(vio, good_writes, vd, l, txg, flags);
+		nvlist_t *top_label = NULL;
+		vdev_label_sync(vio, good_writes, vd, l, txg, flags,
+		    vd->vdev_ops == &vdev_root_ops ? NULL : &top_label);
 		zio_nowait(vio);
+		if (top_label != NULL)
+			nvlist_free(top_label);
 	}
 
 	/*
@@ -2000,7 +2076,7 @@ vdev_label_sync_list(spa_t *spa, int l, uint64_t txg, int flags)
 			zio_t *vio = zio_null(zio, spa, NULL,
 			    vdev_label_sync_ignore_done, good_writes, flags);
 			vdev_label_sync(vio, good_writes, sav[i]->sav_vdevs[v],
-			    l, txg, flags);
+			    l, txg, flags, NULL);
 			zio_nowait(vio);
 		}
 	}
@@ -54,6 +54,7 @@ typedef struct mirror_stats {
 
 	kstat_named_t vdev_mirror_stat_preferred_found;
 	kstat_named_t vdev_mirror_stat_preferred_not_found;
+	kstat_named_t vdev_mirror_stat_latency_penalized;
 } mirror_stats_t;
 
 static mirror_stats_t mirror_stats = {
@@ -71,6 +72,8 @@ static mirror_stats_t mirror_stats = {
 	{ "preferred_found",			KSTAT_DATA_UINT64 },
 	/* Preferred child vdev not found or equal load  */
 	{ "preferred_not_found",		KSTAT_DATA_UINT64 },
+	/* Load increased because of the child's read latency */
+	{ "latency_penalized",			KSTAT_DATA_UINT64 },
 
 };
 
@@ -145,6 +148,15 @@ static int zfs_vdev_mirror_rotating_seek_offset = 1 * 1024 * 1024;
 static int zfs_vdev_mirror_non_rotating_inc = 0;
 static int zfs_vdev_mirror_non_rotating_seek_inc = 1;
 
+/*
+ * Observed latency load calculation configuration.  Every full multiple of
+ * this many microseconds in the average read latency of a child adds one to
+ * its load, as if one more I/O was pending on it.  This steers reads away
+ * from a child which is slow to complete them, e.g. a failing disk or the
+ * slower side of a mirror of mixed devices.  Zero disables it.
+ */
+static uint_t zfs_vdev_mirror_latency_us = 1000;
+
 static inline size_t
 vdev_mirror_map_size(int children)
 {
@@ -204,6 +216,17 @@ vdev_mirror_load(mirror_map_t *mm, vdev_t *vd, uint64_t zio_offset)
 	load = vdev_queue_length(vd);
 	last_offset = vdev_queue_last_offset(vd);
 
+	/* Load based on the observed read latency of the child. */
+	if (zfs_vdev_mirror_latency_us != 0) {
+		hrtime_t lat = vdev_queue_read_latency(vd) /
+		    USEC2NSEC(zfs_vdev_mirror_latency_us);
+
+		if (lat > 0) {
+			MIRROR_BUMP(vdev_mirror_stat_latency_penalized);
+			load += (int)MIN(lat, INT_MAX / 2);
+		}
+	}
+
 	if (vd->vdev_nonrot) {
 		/* Non-rotating media. */
 		if (last_offset == zio_offset) {
@@ -1061,3 +1084,6 @@ ZFS_MODULE_PARAM(zfs_vdev_mirror, zfs_vdev_mirror_, non_rotating_inc, INT,
 
 ZFS_MODULE_PARAM(zfs_vdev_mirror, zfs_vdev_mirror_, non_rotating_seek_inc, INT,
 	ZMOD_RW, "Non-rotating media load increment for seeking I/Os");
+
+ZFS_MODULE_PARAM(zfs_vdev_mirror, zfs_vdev_mirror_, latency_us, UINT,
+	ZMOD_RW, "Read latency in microseconds worth one load increment");
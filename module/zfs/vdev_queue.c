@@ -116,6 +116,54 @@
  * maximum percentage, this indicates that the rate of incoming data is
  * greater than the rate that the backend storage can handle. In this case, we
  * must further throttle incoming writes (see dmu_tx_delay() for details).
+ *
+ * Latency Target
+ *
+ * The right max_active for a class depends on the device: an HDD queues
+ * internally long before an NVMe drive does.  When zfs_vdev_target_latency_us
+ * is set, each leaf vdev instead chooses the max_active of its sync read, sync
+ * write, async read and async write classes itself.  Every
+ * zfs_vdev_target_interval_ms, the fastest completion seen for a class during
+ * the interval is compared with the target, in the manner of CoDel.  If even
+ * that I/O took longer than the target, the device has a standing queue and
+ * the depth is cut by a quarter, but not below the class *_min_active.
+ * Otherwise, if the class had its full depth outstanding during the interval,
+ * the depth grows by one, up to zfs_vdev_max_active.  For async writes the
+ * adaptive depth replaces zfs_vdev_async_write_max_active in the curve above.
+ *
+ * Deadlines
+ *
+ * Within a class, LBA-ordered queues are issued in elevator order and the
+ * class is picked by the rules above, so on a busy HDD a sync read far from
+ * the head can wait behind a long run of scrub or resilver I/O.  An I/O may
+ * therefore carry a deadline: zfs_vdev_sync_read_deadline_ms,
+ * zfs_vdev_sync_write_deadline_ms and zfs_vdev_async_read_deadline_ms after it
+ * was queued, or an earlier io_deadline set by the caller on the logical zio.
+ * Once the deadline of a queued I/O has passed, it is issued ahead of the
+ * normal class selection and elevator order, earliest deadline first, as
+ * long as the vdev is below zfs_vdev_max_active.
+ *
+ * Fast Path
+ *
+ * On a fast non-rotational vdev vq_lock itself becomes the bottleneck long
+ * before the device does.  When zfs_vdev_queue_fastpath is set, an
+ * interactive I/O to such a vdev which would be issued at once anyway -- no
+ * I/O is queued on the vdev, so there is nothing to sort or aggregate it
+ * with, and its class is below max_active -- is issued without taking
+ * vq_lock.  vq_active, vq_cactive and vq_ia_active are kept with atomics so
+ * that both paths see each other's I/Os when applying the limits above.
+ * Everything else, including all I/O to rotational vdevs and all scrub,
+ * resilver, removal, initialize and TRIM I/O, takes the sorted path.  The
+ * fast path is not used while the latency target is enabled, since that
+ * needs every completion under vq_lock.
+ *
+ * Scan Latency
+ *
+ * Each leaf vdev keeps two moving averages of its sync read and sync write
+ * completion latency: one over I/Os which completed while scrub or resilver
+ * I/O was active on the vdev, and one over those which did not.  The
+ * difference is the latency that scanning adds to foreground I/O, which the
+ * scan issue throttle in dsl_scan.c compares against its budget.
  */
 
 /*
@@ -193,6 +241,28 @@ static uint_t zfs_vdev_nia_delay = 5;
  */
 static uint_t zfs_vdev_nia_credit = 5;
 
+/*
+ * Completion latency targeted by the adaptive queue depth, in microseconds,
+ * and how often the depth is adjusted.  A target of zero keeps the static
+ * *_max_active values.
+ */
+static uint_t zfs_vdev_target_latency_us = 0;
+static uint_t zfs_vdev_target_interval_ms = 100;
+
+/*
+ * Issue I/O that needs no sorting or aggregation to non-rotational vdevs
+ * without taking vq_lock.
+ */
+static int zfs_vdev_queue_fastpath = 0;
+
+/*
+ * Time after which a queued I/O of the class is issued earliest deadline
+ * first, in milliseconds.  Zero means the class has no deadline.
+ */
+static uint_t zfs_vdev_sync_read_deadline_ms = 0;
+static uint_t zfs_vdev_sync_write_deadline_ms = 0;
+static uint_t zfs_vdev_async_read_deadline_ms = 0;
+
 /*
  * To reduce IOPs, we aggregate small adjacent I/Os into one large I/O.
  * For read I/Os, we also aggregate across small adjacency gaps; for writes
@@ -307,8 +377,16 @@ vdev_queue_class_min_active(vdev_queue_t *vq, zio_priority_t p)
 	}
 }
 
+static inline boolean_t
+vdev_queue_class_adaptive(zio_priority_t p)
+{
+	return (zfs_vdev_target_latency_us != 0 &&
+	    (p == ZIO_PRIORITY_SYNC_READ || p == ZIO_PRIORITY_SYNC_WRITE ||
+	    p == ZIO_PRIORITY_ASYNC_READ || p == ZIO_PRIORITY_ASYNC_WRITE));
+}
+
 static uint_t
-vdev_queue_max_async_writes(spa_t *spa)
+vdev_queue_max_async_writes(spa_t *spa, uint_t max_active)
 {
 	uint_t writes;
 	uint64_t dirty = 0;
@@ -318,13 +396,15 @@ vdev_queue_max_async_writes(spa_t *spa)
 	uint64_t max_bytes = zfs_dirty_data_max *
 	    zfs_vdev_async_write_active_max_dirty_percent / 100;
 
+	max_active = MAX(max_active, zfs_vdev_async_write_min_active);
+
 	/*
 	 * Async writes may occur before the assignment of the spa's
 	 * dsl_pool_t if a self-healing zio is issued prior to the
 	 * completion of dmu_objset_open_impl().
 	 */
 	if (dp == NULL)
-		return (zfs_vdev_async_write_max_active);
+		return (max_active);
 
 	/*
 	 * Sync tasks correspond to interactive user actions. To reduce the
@@ -332,7 +412,7 @@ vdev_queue_max_async_writes(spa_t *spa)
 	 */
 	dirty = dp->dp_dirty_total;
 	if (dirty > max_bytes || spa_has_pending_synctask(spa))
-		return (zfs_vdev_async_write_max_active);
+		return (max_active);
 
 	if (dirty < min_bytes)
 		return (zfs_vdev_async_write_min_active);
@@ -344,18 +424,20 @@ vdev_queue_max_async_writes(spa_t *spa)
 	 * move up by min_writes
 	 */
 	writes = (dirty - min_bytes) *
-	    (zfs_vdev_async_write_max_active -
-	    zfs_vdev_async_write_min_active) /
+	    (max_active - zfs_vdev_async_write_min_active) /
 	    (max_bytes - min_bytes) +
 	    zfs_vdev_async_write_min_active;
 	ASSERT3U(writes, >=, zfs_vdev_async_write_min_active);
-	ASSERT3U(writes, <=, zfs_vdev_async_write_max_active);
+	ASSERT3U(writes, <=, max_active);
 	return (writes);
 }
 
 static uint_t
 vdev_queue_class_max_active(vdev_queue_t *vq, zio_priority_t p)
 {
+	if (vdev_queue_class_adaptive(p) && p != ZIO_PRIORITY_ASYNC_WRITE)
+		return (vq->vq_adapt[p].vqa_max_active);
+
 	switch (p) {
 	case ZIO_PRIORITY_SYNC_READ:
 		return (zfs_vdev_sync_read_max_active);
@@ -364,7 +446,10 @@ vdev_queue_class_max_active(vdev_queue_t *vq, zio_priority_t p)
 	case ZIO_PRIORITY_ASYNC_READ:
 		return (zfs_vdev_async_read_max_active);
 	case ZIO_PRIORITY_ASYNC_WRITE:
-		return (vdev_queue_max_async_writes(vq->vq_vdev->vdev_spa));
+		return (vdev_queue_max_async_writes(vq->vq_vdev->vdev_spa,
+		    vdev_queue_class_adaptive(p) ?
+		    vq->vq_adapt[p].vqa_max_active :
+		    zfs_vdev_async_write_max_active));
 	case ZIO_PRIORITY_SCRUB:
 		if (vq->vq_ia_active > 0) {
 			return (MIN(vq->vq_nia_credit,
@@ -474,6 +559,15 @@ vdev_queue_init(vdev_t *vd)
 	    vdev_queue_offset_compare, sizeof (zio_t),
 	    offsetof(struct zio, io_offset_node));
 
+	vq->vq_adapt[ZIO_PRIORITY_SYNC_READ].vqa_max_active =
+	    zfs_vdev_sync_read_max_active;
+	vq->vq_adapt[ZIO_PRIORITY_SYNC_WRITE].vqa_max_active =
+	    zfs_vdev_sync_write_max_active;
+	vq->vq_adapt[ZIO_PRIORITY_ASYNC_READ].vqa_max_active =
+	    zfs_vdev_async_read_max_active;
+	vq->vq_adapt[ZIO_PRIORITY_ASYNC_WRITE].vqa_max_active =
+	    zfs_vdev_async_write_max_active;
+
 	vq->vq_last_offset = 0;
 	list_create(&vq->vq_active_list, sizeof (struct zio),
 	    offsetof(struct zio, io_queue_node.l));
@@ -503,6 +597,8 @@ vdev_queue_io_add(vdev_queue_t *vq, zio_t *zio)
 {
 	zio->io_queue_state = ZIO_QS_QUEUED;
 	vdev_queue_class_add(vq, zio);
+	if (zio->io_deadline != 0)
+		vq->vq_ndeadline++;
 	if (zio->io_type == ZIO_TYPE_READ)
 		avl_add(&vq->vq_read_offset_tree, zio);
 	else if (zio->io_type == ZIO_TYPE_WRITE)
@@ -513,6 +609,8 @@ static void
 vdev_queue_io_remove(vdev_queue_t *vq, zio_t *zio)
 {
 	vdev_queue_class_remove(vq, zio);
+	if (zio->io_deadline != 0)
+		vq->vq_ndeadline--;
 	if (zio->io_type == ZIO_TYPE_READ)
 		avl_remove(&vq->vq_read_offset_tree, zio);
 	else if (zio->io_type == ZIO_TYPE_WRITE)
@@ -539,10 +637,10 @@ vdev_queue_pending_add(vdev_queue_t *vq, zio_t *zio)
 {
 	ASSERT(MUTEX_HELD(&vq->vq_lock));
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
-	vq->vq_cactive[zio->io_priority]++;
-	vq->vq_active++;
+	atomic_inc_32(&vq->vq_cactive[zio->io_priority]);
+	atomic_inc_32(&vq->vq_active);
 	if (vdev_queue_is_interactive(zio->io_priority)) {
-		if (++vq->vq_ia_active == 1)
+		if (atomic_inc_32_nv(&vq->vq_ia_active) == 1)
 			vq->vq_nia_credit = 1;
 	} else if (vq->vq_ia_active > 0) {
 		vq->vq_nia_credit--;
@@ -556,10 +654,10 @@ vdev_queue_pending_remove(vdev_queue_t *vq, zio_t *zio)
 {
 	ASSERT(MUTEX_HELD(&vq->vq_lock));
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
-	vq->vq_cactive[zio->io_priority]--;
-	vq->vq_active--;
+	atomic_dec_32(&vq->vq_cactive[zio->io_priority]);
+	atomic_dec_32(&vq->vq_active);
 	if (vdev_queue_is_interactive(zio->io_priority)) {
-		if (--vq->vq_ia_active == 0)
+		if (atomic_dec_32_nv(&vq->vq_ia_active) == 0)
 			vq->vq_nia_credit = 0;
 		else
 			vq->vq_nia_credit = zfs_vdev_nia_credit;
@@ -589,8 +687,8 @@ vdev_queue_agg_io_done(zio_t *aio)
  * by creating a gang ABD from the adjacent ZIOs io_abd's. By using
  * a gang ABD we avoid doing memory copies to and from the parent,
  * child ZIOs. The gang ABD also accounts for gaps between adjacent
- * io_offsets by simply getting the zero ABD for writes or allocating
- * a new ABD for reads and placing them in the gang ABD as well.
+ * io_offsets by simply getting the zero ABD for writes or the sink ABD
+ * for reads and placing them in the gang ABD as well.
  */
 static zio_t *
 vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
@@ -763,11 +861,14 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 		vdev_queue_io_remove(vq, dio);
 
 		if (dio->io_offset != next_offset) {
-			/* allocate a buffer for a read gap */
+			/*
+			 * Read the gap into the shared sink buffer.  The
+			 * device still transfers it, but we neither allocate
+			 * nor touch memory for data nobody asked for.
+			 */
 			ASSERT3U(dio->io_type, ==, ZIO_TYPE_READ);
 			ASSERT3U(dio->io_offset, >, next_offset);
-			abd = abd_alloc_for_io(
-			    dio->io_offset - next_offset, B_TRUE);
+			abd = abd_get_sink(dio->io_offset - next_offset);
 			abd_gang_add(aio->io_abd, abd, B_TRUE);
 		}
 		if (dio->io_abd &&
@@ -808,6 +909,53 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	return (aio);
 }
 
+static uint_t
+vdev_queue_class_deadline_ms(zio_priority_t p)
+{
+	switch (p) {
+	case ZIO_PRIORITY_SYNC_READ:
+		return (zfs_vdev_sync_read_deadline_ms);
+	case ZIO_PRIORITY_SYNC_WRITE:
+		return (zfs_vdev_sync_write_deadline_ms);
+	case ZIO_PRIORITY_ASYNC_READ:
+		return (zfs_vdev_async_read_deadline_ms);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Return the queued I/O with the earliest deadline, if that deadline has
+ * passed.  Only the head of each class is looked at: FIFO classes are in
+ * submission order, and LBA-ordered classes sort by submission time bucket
+ * first, so the head is the oldest I/O to within one VDQ_T_SHIFT bucket.
+ */
+static zio_t *
+vdev_queue_io_expired(vdev_queue_t *vq)
+{
+	uint32_t cq = vq->vq_cqueued;
+	zio_t *zio, *dzio = NULL;
+	hrtime_t now;
+
+	if (vq->vq_ndeadline == 0 || vq->vq_active >= zfs_vdev_max_active)
+		return (NULL);
+
+	now = gethrtime();
+	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
+		if ((cq & (1U << p)) == 0)
+			continue;
+		if (vdev_queue_class_fifo(p))
+			zio = list_head(&vq->vq_class[p].vqc_list);
+		else
+			zio = avl_first(&vq->vq_class[p].vqc_tree);
+		if (zio->io_deadline == 0 || zio->io_deadline > now)
+			continue;
+		if (dzio == NULL || zio->io_deadline < dzio->io_deadline)
+			dzio = zio;
+	}
+	return (dzio);
+}
+
 static zio_t *
 vdev_queue_io_to_issue(vdev_queue_t *vq)
 {
@@ -819,6 +967,12 @@ vdev_queue_io_to_issue(vdev_queue_t *vq)
 again:
 	ASSERT(MUTEX_HELD(&vq->vq_lock));
 
+	zio = vdev_queue_io_expired(vq);
+	if (zio != NULL) {
+		p = zio->io_priority;
+		goto issue;
+	}
+
 	p = vdev_queue_class_to_issue(vq);
 
 	if (p == ZIO_PRIORITY_NUM_QUEUEABLE) {
@@ -850,6 +1004,7 @@ again:
 			}
 		}
 	}
+issue:
 	ASSERT3U(zio->io_priority, ==, p);
 
 	aio = vdev_queue_aggregate(vq, zio);
@@ -879,6 +1034,70 @@ again:
 	return (zio);
 }
 
+/*
+ * Try to issue zio without vq_lock, see "Fast Path" above.  The counters are
+ * raised first and the checks made against the new values, so that racing
+ * submitters cannot together exceed a limit.  The 0 -> 1 transition of
+ * vq_ia_active is left to the locked path, which resets vq_nia_credit.
+ */
+static boolean_t
+vdev_queue_io_fast(vdev_queue_t *vq, zio_t *zio)
+{
+	zio_priority_t p = zio->io_priority;
+
+	if (!zfs_vdev_queue_fastpath || !vq->vq_vdev->vdev_nonrot ||
+	    zfs_vdev_target_latency_us != 0 || p == ZIO_PRIORITY_TRIM ||
+	    !vdev_queue_is_interactive(p) || vq->vq_cqueued != 0)
+		return (B_FALSE);
+
+	if (atomic_inc_32_nv(&vq->vq_ia_active) == 1)
+		goto out_ia;
+	if (atomic_inc_32_nv(&vq->vq_active) > zfs_vdev_max_active)
+		goto out_active;
+	if (atomic_inc_32_nv(&vq->vq_cactive[p]) >
+	    vdev_queue_class_max_active(vq, p))
+		goto out_cactive;
+
+	zio->io_queue_state = ZIO_QS_FAST;
+	return (B_TRUE);
+
+out_cactive:
+	atomic_dec_32(&vq->vq_cactive[p]);
+out_active:
+	atomic_dec_32(&vq->vq_active);
+out_ia:
+	atomic_dec_32(&vq->vq_ia_active);
+	return (B_FALSE);
+}
+
+/*
+ * Complete a zio issued by vdev_queue_io_fast().  Returns B_TRUE with vq_lock
+ * held if I/Os are queued that this completion may allow to be issued, or if
+ * it was the last interactive I/O.
+ */
+static boolean_t
+vdev_queue_io_fast_done(vdev_queue_t *vq, zio_t *zio)
+{
+	boolean_t last;
+
+	atomic_dec_32(&vq->vq_cactive[zio->io_priority]);
+	atomic_dec_32(&vq->vq_active);
+	last = (atomic_dec_32_nv(&vq->vq_ia_active) == 0);
+	zio->io_queue_state = ZIO_QS_NONE;
+
+	/* Pairs with the barrier in vdev_queue_io(). */
+	membar_sync();
+	if (!last && vq->vq_cqueued == 0)
+		return (B_FALSE);
+
+	mutex_enter(&vq->vq_lock);
+	if (vq->vq_ia_active == 0)
+		vq->vq_nia_credit = 0;
+	else
+		vq->vq_nia_credit = zfs_vdev_nia_credit;
+	return (B_TRUE);
+}
+
 zio_t *
 vdev_queue_io(zio_t *zio)
 {
@@ -922,8 +1141,24 @@ vdev_queue_io(zio_t *zio)
 	zio->io_flags |= ZIO_FLAG_DONT_QUEUE;
 	zio->io_timestamp = gethrtime();
 
+	uint_t deadline_ms = vdev_queue_class_deadline_ms(zio->io_priority);
+	if (deadline_ms != 0) {
+		hrtime_t deadline = zio->io_timestamp + MSEC2NSEC(deadline_ms);
+		if (zio->io_deadline == 0 || deadline < zio->io_deadline)
+			zio->io_deadline = deadline;
+	}
+
+	if (vdev_queue_io_fast(vq, zio))
+		return (zio);
+
 	mutex_enter(&vq->vq_lock);
 	vdev_queue_io_add(vq, zio);
+	/*
+	 * Make the queued I/O visible to fast path completions before
+	 * looking at the active counts they lower.
+	 */
+	if (zfs_vdev_queue_fastpath)
+		membar_sync();
 	nio = vdev_queue_io_to_issue(vq);
 	mutex_exit(&vq->vq_lock);
 
@@ -943,6 +1178,84 @@ vdev_queue_io(zio_t *zio)
 	return (nio);
 }
 
+/*
+ * Account a completed I/O towards the adaptive depth of its class, and at the
+ * end of each interval move the depth towards the latency target.
+ */
+static void
+vdev_queue_adapt(vdev_queue_t *vq, zio_t *zio, hrtime_t now)
+{
+	zio_priority_t p = zio->io_priority;
+	vdev_queue_adapt_t *vqa = &vq->vq_adapt[p];
+	uint_t min_active, max_active;
+
+	ASSERT(MUTEX_HELD(&vq->vq_lock));
+
+	if (!vdev_queue_class_adaptive(p))
+		return;
+
+	if (vq->vq_cactive[p] >= vdev_queue_class_max_active(vq, p))
+		vqa->vqa_saturated = B_TRUE;
+	if (vqa->vqa_min_lat == 0 || zio->io_delta < vqa->vqa_min_lat)
+		vqa->vqa_min_lat = zio->io_delta;
+
+	if (now - vqa->vqa_start < MSEC2NSEC(zfs_vdev_target_interval_ms))
+		return;
+
+	min_active = MAX(vdev_queue_class_min_active(vq, p), 1);
+	max_active = vqa->vqa_max_active;
+	if (vqa->vqa_min_lat > USEC2NSEC(zfs_vdev_target_latency_us))
+		max_active -= MIN(MAX(max_active / 4, 1), max_active);
+	else if (vqa->vqa_saturated)
+		max_active++;
+
+	vqa->vqa_max_active = MIN(MAX(max_active, min_active),
+	    MAX(zfs_vdev_max_active, min_active));
+	vqa->vqa_saturated = B_FALSE;
+	vqa->vqa_min_lat = 0;
+	vqa->vqa_start = now;
+}
+
+/*
+ * Fold a sync I/O completion into the foreground latency average matching
+ * whether scan I/O is active.  These are only statistics, so they are
+ * updated without vq_lock and may be updated from the fast path.
+ */
+static void
+vdev_queue_fg_latency(vdev_queue_t *vq, zio_t *zio)
+{
+	hrtime_t *lat;
+
+	if (zio->io_priority != ZIO_PRIORITY_SYNC_READ &&
+	    zio->io_priority != ZIO_PRIORITY_SYNC_WRITE)
+		return;
+
+	lat = (vq->vq_cactive[ZIO_PRIORITY_SCRUB] > 0) ?
+	    &vq->vq_fg_lat_scan : &vq->vq_fg_lat_idle;
+	if (*lat == 0)
+		*lat = zio->io_delta;
+	else
+		*lat += (zio->io_delta - *lat) / 8;
+}
+
+/*
+ * Fold a read completion into the average read latency used by the mirror
+ * code to steer reads away from slow children.  Like the above this is
+ * updated without vq_lock.
+ */
+static void
+vdev_queue_read_latency_update(vdev_queue_t *vq, zio_t *zio, hrtime_t now)
+{
+	if (zio->io_type != ZIO_TYPE_READ)
+		return;
+
+	if (vq->vq_read_lat == 0)
+		vq->vq_read_lat = zio->io_delta;
+	else
+		vq->vq_read_lat += (zio->io_delta - vq->vq_read_lat) / 8;
+	vq->vq_read_lat_ts = now;
+}
+
 void
 vdev_queue_io_done(zio_t *zio)
 {
@@ -953,9 +1266,17 @@ vdev_queue_io_done(zio_t *zio)
 	hrtime_t now = gethrtime();
 	vq->vq_io_complete_ts = now;
 	vq->vq_io_delta_ts = zio->io_delta = now - zio->io_timestamp;
+	vdev_queue_fg_latency(vq, zio);
+	vdev_queue_read_latency_update(vq, zio, now);
 
-	mutex_enter(&vq->vq_lock);
-	vdev_queue_pending_remove(vq, zio);
+	if (zio->io_queue_state == ZIO_QS_FAST) {
+		if (!vdev_queue_io_fast_done(vq, zio))
+			return;
+	} else {
+		mutex_enter(&vq->vq_lock);
+		vdev_queue_adapt(vq, zio, now);
+		vdev_queue_pending_remove(vq, zio);
+	}
 
 	while ((nio = vdev_queue_io_to_issue(vq)) != NULL) {
 		mutex_exit(&vq->vq_lock);
@@ -1063,6 +1384,66 @@ vdev_queue_class_length(vdev_t *vd, zio_priority_t p)
 		return (avl_numnodes(&vq->vq_class[p].vqc_tree));
 }
 
+/*
+ * Current max_active of a class, as chosen by the adaptive queue depth or
+ * the static tunables.
+ */
+uint64_t
+vdev_queue_class_depth(vdev_t *vd, zio_priority_t p)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+	return (vdev_queue_class_max_active(vq, p));
+}
+
+/*
+ * Returns the foreground latency added by scan I/O on the worst leaf vdev
+ * below vd.  Like the above this is a lock free load calculation.
+ */
+hrtime_t
+vdev_queue_scan_latency(vdev_t *vd)
+{
+	hrtime_t added = 0;
+
+	if (vd->vdev_ops->vdev_op_leaf) {
+		vdev_queue_t *vq = &vd->vdev_queue;
+		hrtime_t scan = vq->vq_fg_lat_scan;
+		hrtime_t idle = vq->vq_fg_lat_idle;
+
+		return (scan > idle ? scan - idle : 0);
+	}
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++)
+		added = MAX(added, vdev_queue_scan_latency(vd->vdev_child[c]));
+
+	return (added);
+}
+
+/*
+ * Returns the average read latency of the slowest leaf vdev below vd.  An
+ * average which has not been refreshed by a read for a second is ignored,
+ * so that a child which was avoided because it was slow is eventually
+ * read from again and its average updated.
+ */
+hrtime_t
+vdev_queue_read_latency(vdev_t *vd)
+{
+	hrtime_t lat = 0;
+
+	if (vd->vdev_ops->vdev_op_leaf) {
+		vdev_queue_t *vq = &vd->vdev_queue;
+		hrtime_t ts = vq->vq_read_lat_ts;
+
+		if (ts == 0 || gethrtime() - ts > SEC2NSEC(1))
+			return (0);
+		return (vq->vq_read_lat);
+	}
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++)
+		lat = MAX(lat, vdev_queue_read_latency(vd->vdev_child[c]));
+
+	return (lat);
+}
+
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, aggregation_limit, UINT, ZMOD_RW,
 	"Max vdev I/O aggregation size");
 
@@ -1143,3 +1524,21 @@ ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, nia_credit, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, nia_delay, UINT, ZMOD_RW,
 	"Number of non-interactive I/Os before _max_active");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, target_latency_us, UINT, ZMOD_RW,
+	"Completion latency targeted by adaptive queue depth (0 to disable)");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, target_interval_ms, UINT, ZMOD_RW,
+	"Interval between adaptive queue depth adjustments");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, queue_fastpath, INT, ZMOD_RW,
+	"Issue unqueued I/O to non-rotational vdevs without the queue lock");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, sync_read_deadline_ms, UINT, ZMOD_RW,
+	"Queued time after which sync reads are issued by deadline");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, sync_write_deadline_ms, UINT, ZMOD_RW,
+	"Queued time after which sync writes are issued by deadline");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, async_read_deadline_ms, UINT, ZMOD_RW,
+	"Queued time after which async reads are issued by deadline");
@@ -364,12 +364,36 @@ static unsigned long raidz_expand_max_copy_bytes = SPA_MAXBLOCKSIZE;
 static unsigned long raidz_expand_max_copy_bytes = 10 * SPA_MAXBLOCKSIZE;
 #endif
 
+/*
+ * Amount of copy io's outstanding at once per child of the expanding vdev.
+ * The effective limit is the larger of this times the vdev width and
+ * raidz_expand_max_copy_bytes, so that wide vdevs keep every disk busy.
+ */
+#ifdef _ILP32
+static unsigned long raidz_expand_max_child_copy_bytes = 0;
+#else
+static unsigned long raidz_expand_max_child_copy_bytes = SPA_MAXBLOCKSIZE;
+#endif
+
+/*
+ * Number of metaslabs after the one being reflowed that are loaded in the
+ * background, so that copying does not stall on loading the next metaslab.
+ */
+static uint_t raidz_expand_ms_preload = 4;
+
 /*
  * Apply raidz map abds aggregation if the number of rows in the map is equal
  * or greater than the value below.
  */
 static unsigned long raidz_io_aggregate_rows = 4;
 
+/*
+ * Reconstruct the column of a child whose average read latency exceeds
+ * this many microseconds from parity, instead of waiting for the child.
+ * Zero (the default) disables it.
+ */
+static uint_t raidz_slow_read_us = 0;
+
 /*
  * Automatically start a pool scrub when a RAIDZ expansion completes in
  * order to verify the checksums of all blocks which have been copied
@@ -2322,6 +2346,29 @@ vdev_raidz_child_done(zio_t *zio)
 	rc->rc_skipped = 0;
 }
 
+/*
+ * Returns B_TRUE if a normal read should skip the column on cvd and have it
+ * reconstructed from parity, because cvd is slow to complete reads.  This
+ * bounds the read latency of a vdev with a slow but not failed child, such
+ * as a dying disk or a SMR disk doing garbage collection.  The column is
+ * treated like one which is missing from the DTL, so if reconstruction
+ * fails it is read after all.  At most one column per row is skipped, and
+ * only when the block checksum can verify the reconstruction.
+ */
+boolean_t
+vdev_raidz_child_slow(zio_t *zio, raidz_row_t *rr, vdev_t *cvd)
+{
+	if (raidz_slow_read_us == 0 || zio->io_bp == NULL ||
+	    (zio->io_flags & (ZIO_FLAG_SCRUB | ZIO_FLAG_RESILVER)))
+		return (B_FALSE);
+
+	if (rr->rr_firstdatacol == 0 ||
+	    rr->rr_missingdata + rr->rr_missingparity > 0)
+		return (B_FALSE);
+
+	return (vdev_queue_read_latency(cvd) > USEC2NSEC(raidz_slow_read_us));
+}
+
 static void
 vdev_raidz_shadow_child_done(zio_t *zio)
 {
@@ -2475,6 +2522,15 @@ vdev_raidz_io_start_read_row(zio_t *zio, raidz_row_t *rr, boolean_t forceparity)
 			rc->rc_skipped = 1;
 			continue;
 		}
+		if (vdev_raidz_child_slow(zio, rr, cvd)) {
+			if (c >= rr->rr_firstdatacol)
+				rr->rr_missingdata++;
+			else
+				rr->rr_missingparity++;
+			rc->rc_error = SET_ERROR(ESTALE);
+			rc->rc_skipped = 1;
+			continue;
+		}
 		if (forceparity ||
 		    c >= rr->rr_firstdatacol || rr->rr_missingdata > 0 ||
 		    (zio->io_flags & (ZIO_FLAG_SCRUB | ZIO_FLAG_RESILVER))) {
@@ -2626,9 +2682,21 @@ vdev_raidz_io_start(zio_t *zio)
 	zio->io_vsd = rm;
 	zio->io_vsd_ops = &vdev_raidz_vsd_ops;
 	if (zio->io_type == ZIO_TYPE_WRITE) {
+		uint64_t data = 0, parity = 0;
+
 		for (int i = 0; i < rm->rm_nrows; i++) {
-			vdev_raidz_io_start_write(zio, rm->rm_row[i]);
+			raidz_row_t *rr = rm->rm_row[i];
+
+			vdev_raidz_io_start_write(zio, rr);
+			for (int c = 0; c < rr->rr_cols; c++) {
+				if (c < rr->rr_firstdatacol)
+					parity += rr->rr_col[c].rc_size;
+				else
+					data += rr->rr_col[c].rc_size;
+			}
 		}
+		zio_stats_raidz_write(data, parity,
+		    (uint64_t)rm->rm_nskip << tvd->vdev_ashift);
 
 		if (logical_width == vdrz->vd_physical_width) {
 			raidz_start_skip_writes(zio);
@@ -3896,10 +3964,16 @@ raidz_reflow_write_done(zio_t *zio)
 	}
 	cv_signal(&vre->vre_cv);
 	boolean_t done = (--rra->rra_tbd == 0);
+	boolean_t copied = (rra->rra_lr->lr_offset + rra->rra_lr->lr_length <
+	    vre->vre_failed_offset);
 	mutex_exit(&vre->vre_lock);
 
 	if (!done)
 		return;
+	if (copied) {
+		spa_iostats_raidz_expand_add(zio->io_spa, 1,
+		    rra->rra_lr->lr_length, 0);
+	}
 	spa_config_exit(zio->io_spa, SCL_STATE, zio->io_spa);
 	zfs_rangelock_exit(rra->rra_lr);
 	kmem_free(rra, sizeof (*rra) + sizeof (zio_t *) * rra->rra_writes);
@@ -4508,6 +4582,35 @@ vdev_raidz_reflow_copy_scratch(spa_t *spa)
 	spa_config_exit(spa, SCL_STATE, FTAG);
 }
 
+/*
+ * Limit on the amount of copy i/o outstanding at once for this vdev.
+ */
+static uint64_t
+raidz_expand_copy_limit(vdev_t *vd)
+{
+	return (MAX(raidz_expand_max_copy_bytes,
+	    raidz_expand_max_child_copy_bytes * vd->vdev_children));
+}
+
+/*
+ * Load an upcoming metaslab ahead of the reflow, see raidz_expand_ms_preload.
+ */
+static void
+raidz_expand_ms_preload_cb(void *arg)
+{
+	metaslab_t *msp = arg;
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+	fstrans_cookie_t cookie = spl_fstrans_mark();
+
+	mutex_enter(&msp->ms_lock);
+	if (!msp->ms_new && !msp->ms_loaded) {
+		(void) metaslab_load(msp);
+		metaslab_set_selected_txg(msp, spa_syncing_txg(spa));
+	}
+	mutex_exit(&msp->ms_lock);
+	spl_fstrans_unmark(cookie);
+}
+
 static boolean_t
 spa_raidz_expand_thread_check(void *arg, zthr_t *zthr)
 {
@@ -4554,6 +4657,21 @@ spa_raidz_expand_thread(void *arg, zthr_t *zthr)
 
 	uint64_t guid = raidvd->vdev_guid;
 
+	/*
+	 * Copies are issued in offset order, since the on-disk progress is a
+	 * single offset, but there is no need to wait for one metaslab's
+	 * copies to finish before starting on the next.  Load the following
+	 * metaslabs in the background so that the copy pipeline stays full.
+	 */
+	taskq_t *preload_tq = NULL;
+	uint64_t preloaded = vre->vre_offset >> raidvd->vdev_ms_shift;
+	if (raidz_expand_ms_preload != 0) {
+		preload_tq = taskq_create("z_raidz_expand_preload",
+		    raidz_expand_ms_preload, defclsyspri, 1, INT_MAX,
+		    TASKQ_DYNAMIC);
+	}
+	hrtime_t copy_start = gethrtime();
+
 	/* Iterate over all the remaining metaslabs */
 	for (uint64_t i = vre->vre_offset >> raidvd->vdev_ms_shift;
 	    i < raidvd->vdev_ms_count &&
@@ -4561,6 +4679,17 @@ spa_raidz_expand_thread(void *arg, zthr_t *zthr)
 	    vre->vre_failed_offset == UINT64_MAX; i++) {
 		metaslab_t *msp = raidvd->vdev_ms[i];
 
+		if (preload_tq != NULL) {
+			uint64_t end = MIN(i + 1 + raidz_expand_ms_preload,
+			    raidvd->vdev_ms_count);
+			for (preloaded = MAX(preloaded, i + 1);
+			    preloaded < end; preloaded++) {
+				(void) taskq_dispatch(preload_tq,
+				    raidz_expand_ms_preload_cb,
+				    raidvd->vdev_ms[preloaded], TQ_SLEEP);
+			}
+		}
+
 		metaslab_disable(msp);
 		mutex_enter(&msp->ms_lock);
 
@@ -4632,6 +4761,7 @@ spa_raidz_expand_thread(void *arg, zthr_t *zthr)
 			 * lock for reader).  So we can't hold the config lock
 			 * while calling dmu_tx_assign().
 			 */
+			uint64_t copy_limit = raidz_expand_copy_limit(raidvd);
 			spa_config_exit(spa, SCL_CONFIG, FTAG);
 
 			/*
@@ -4647,8 +4777,7 @@ spa_raidz_expand_thread(void *arg, zthr_t *zthr)
 			}
 
 			mutex_enter(&vre->vre_lock);
-			while (vre->vre_outstanding_bytes >
-			    raidz_expand_max_copy_bytes) {
+			while (vre->vre_outstanding_bytes > copy_limit) {
 				cv_wait(&vre->vre_cv, &vre->vre_lock);
 			}
 			mutex_exit(&vre->vre_lock);
@@ -4686,12 +4815,21 @@ spa_raidz_expand_thread(void *arg, zthr_t *zthr)
 		zfs_range_tree_vacate(rt, NULL, NULL);
 		zfs_range_tree_destroy(rt);
 
+		hrtime_t now = gethrtime();
+		spa_iostats_raidz_expand_add(spa, 0, 0, now - copy_start);
+		copy_start = now;
+
 		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
 		raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
 	}
 
 	spa_config_exit(spa, SCL_CONFIG, FTAG);
 
+	if (preload_tq != NULL) {
+		taskq_wait(preload_tq);
+		taskq_destroy(preload_tq);
+	}
+
 	/*
 	 * The txg_wait_synced() here ensures that all reflow zio's have
 	 * completed, and vre_failed_offset has been set if necessary.  It
@@ -5150,8 +5288,14 @@ ZFS_MODULE_PARAM(zfs_vdev, raidz_, expand_max_reflow_bytes, ULONG, ZMOD_RW,
 	"For testing, pause RAIDZ expansion after reflowing this many bytes");
 ZFS_MODULE_PARAM(zfs_vdev, raidz_, expand_max_copy_bytes, ULONG, ZMOD_RW,
 	"Max amount of concurrent i/o for RAIDZ expansion");
+ZFS_MODULE_PARAM(zfs_vdev, raidz_, expand_max_child_copy_bytes, ULONG, ZMOD_RW,
+	"Max amount of concurrent i/o per child for RAIDZ expansion");
+ZFS_MODULE_PARAM(zfs_vdev, raidz_, expand_ms_preload, UINT, ZMOD_RW,
+	"Number of metaslabs to load ahead of RAIDZ expansion");
 ZFS_MODULE_PARAM(zfs_vdev, raidz_, io_aggregate_rows, ULONG, ZMOD_RW,
 	"For expanded RAIDZ, aggregate reads that have more rows than this");
+ZFS_MODULE_PARAM(zfs_vdev, raidz_, slow_read_us, UINT, ZMOD_RW,
+	"Read latency above which a RAIDZ column is reconstructed from parity");
 ZFS_MODULE_PARAM(zfs, zfs_, scrub_after_expand, INT, ZMOD_RW,
 	"For expanded RAIDZ, automatically start a pool scrub when expansion "
 	"completes");
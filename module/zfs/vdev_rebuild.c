@@ -133,6 +133,15 @@ static uint64_t zfs_rebuild_vdev_limit = 64 << 20;
  */
 static int zfs_rebuild_scrub_enabled = 1;
 
+/*
+ * Number of metaslab cursors used to rebuild each top-level vdev.  Every
+ * cursor disables the metaslab it is scanning, claiming the next unscanned
+ * metaslab when it completes, so several metaslabs are read and rebuilt
+ * concurrently.  The zfs_rebuild_vdev_limit in flight limit is shared by
+ * all cursors of a top-level vdev.
+ */
+static uint_t zfs_rebuild_cursors = 2;
+
 /*
  * For vdev_rebuild_initiate_sync() and vdev_rebuild_reset_sync().
  */
@@ -499,8 +508,11 @@ vdev_rebuild_cb(zio_t *zio)
 		 * (This works because spa_sync waits on spa_txg_zio before
 		 * it runs sync tasks.)
 		 */
-		uint64_t *off = &vr->vr_scan_offset[zio->io_txg & TXG_MASK];
-		*off = MIN(*off, zio->io_offset);
+		for (int t = 0; t < TXG_SIZE; t++) {
+			uint64_t *off = &vr->vr_scan_offset[t];
+			if (*off != 0)
+				*off = MIN(*off, zio->io_offset);
+		}
 	} else if (zio->io_error) {
 		vrp->vrp_errors++;
 	}
@@ -549,15 +561,41 @@ vdev_rebuild_blkptr_init(blkptr_t *bp, vdev_t *vd, uint64_t start,
 	BP_SET_BYTEORDER(bp, ZFS_HOST_BYTEORDER);
 }
 
+/*
+ * Returns the offset below which all rebuild I/O has been issued by every
+ * cursor.  Ranges in metaslabs which are yet to be claimed, or which are
+ * still being scanned by a cursor, are at or above this offset.  Must be
+ * called with the vdev_rebuild_lock held.
+ */
+static uint64_t
+vdev_rebuild_safe_offset(vdev_rebuild_t *vr)
+{
+	vdev_t *vd = vr->vr_top_vdev;
+	uint64_t offset;
+
+	ASSERT(MUTEX_HELD(&vd->vdev_rebuild_lock));
+
+	if (vr->vr_scan_next_ms < vd->vdev_ms_count)
+		offset = vr->vr_scan_next_ms << vd->vdev_ms_shift;
+	else
+		offset = UINT64_MAX;
+
+	for (uint_t c = 0; c < vr->vr_ncursors; c++)
+		offset = MIN(offset, vr->vr_cursors[c].vrc_offset);
+
+	return (MAX(offset, vr->vr_rebuild_phys.vrp_last_offset));
+}
+
 /*
  * Issues a rebuild I/O and takes care of rate limiting the number of queued
  * rebuild I/Os.  The provided start and size must be properly aligned for the
  * top-level vdev type being rebuilt.
  */
 static int
-vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
+vdev_rebuild_range(vdev_rebuild_cursor_t *vrc, uint64_t start, uint64_t size)
 {
-	uint64_t ms_id __maybe_unused = vr->vr_scan_msp->ms_id;
+	uint64_t ms_id __maybe_unused = vrc->vrc_msp->ms_id;
+	vdev_rebuild_t *vr = vrc->vrc_rebuild;
 	vdev_t *vd = vr->vr_top_vdev;
 	spa_t *spa = vd->vdev_spa;
 	blkptr_t blk;
@@ -565,8 +603,8 @@ vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
 	ASSERT3U(ms_id, ==, start >> vd->vdev_ms_shift);
 	ASSERT3U(ms_id, ==, (start + size - 1) >> vd->vdev_ms_shift);
 
-	vr->vr_pass_bytes_scanned += size;
-	vr->vr_rebuild_phys.vrp_bytes_scanned += size;
+	atomic_add_64(&vr->vr_pass_bytes_scanned, size);
+	atomic_add_64(&vr->vr_rebuild_phys.vrp_bytes_scanned, size);
 
 	/*
 	 * Rebuild the data in this range by constructing a special block
@@ -578,7 +616,7 @@ vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
 	uint64_t psize = BP_GET_PSIZE(&blk);
 
 	if (!vdev_dtl_need_resilver(vd, &blk.blk_dva[0], psize, TXG_UNKNOWN)) {
-		vr->vr_pass_bytes_skipped += size;
+		atomic_add_64(&vr->vr_pass_bytes_skipped, size);
 		return (0);
 	}
 
@@ -599,8 +637,10 @@ vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
 	mutex_enter(&vd->vdev_rebuild_lock);
 
 	/* This is the first I/O for this txg. */
-	if (vr->vr_scan_offset[txg & TXG_MASK] == 0) {
-		vr->vr_scan_offset[txg & TXG_MASK] = start;
+	if (vr->vr_scan_txg[txg & TXG_MASK] != txg) {
+		vr->vr_scan_txg[txg & TXG_MASK] = txg;
+		vr->vr_scan_offset[txg & TXG_MASK] =
+		    vdev_rebuild_safe_offset(vr);
 		dsl_sync_task_nowait(spa_get_dsl(spa),
 		    vdev_rebuild_update_sync,
 		    (void *)(uintptr_t)vd->vdev_id, tx);
@@ -616,12 +656,23 @@ vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
 		dmu_tx_commit(tx);
 		return (SET_ERROR(EINTR));
 	}
+
+	/*
+	 * Advance this cursor and record the offset below which all I/O
+	 * has been issued.  Once any cursor has issued I/O in a later txg
+	 * the offset is recorded for that txg instead, since I/O assigned
+	 * to it may lie below the offset and not yet be complete when the
+	 * earlier txg syncs.
+	 */
+	uint64_t scan_txg = MAX(txg, vr->vr_scan_max_txg);
+	vr->vr_scan_max_txg = scan_txg;
+	vrc->vrc_offset = start + size;
+	vr->vr_scan_offset[scan_txg & TXG_MASK] = vdev_rebuild_safe_offset(vr);
 	mutex_exit(&vd->vdev_rebuild_lock);
 	dmu_tx_commit(tx);
 
-	vr->vr_scan_offset[txg & TXG_MASK] = start + size;
-	vr->vr_pass_bytes_issued += size;
-	vr->vr_rebuild_phys.vrp_bytes_issued += size;
+	atomic_add_64(&vr->vr_pass_bytes_issued, size);
+	atomic_add_64(&vr->vr_rebuild_phys.vrp_bytes_issued, size);
 
 	zio_nowait(zio_read(spa->spa_txg_zio[txg & TXG_MASK], spa, &blk,
 	    abd_alloc(psize, B_FALSE), psize, vdev_rebuild_cb, vr,
@@ -632,20 +683,20 @@ vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
 }
 
 /*
- * Issues rebuild I/Os for all ranges in the provided vr->vr_tree range tree.
+ * Issues rebuild I/Os for all ranges in the cursor's vrc_tree range tree.
  */
 static int
-vdev_rebuild_ranges(vdev_rebuild_t *vr)
+vdev_rebuild_ranges(vdev_rebuild_cursor_t *vrc)
 {
-	vdev_t *vd = vr->vr_top_vdev;
-	zfs_btree_t *t = &vr->vr_scan_tree->rt_root;
+	vdev_t *vd = vrc->vrc_rebuild->vr_top_vdev;
+	zfs_btree_t *t = &vrc->vrc_tree->rt_root;
 	zfs_btree_index_t idx;
 	int error;
 
 	for (zfs_range_seg_t *rs = zfs_btree_first(t, &idx); rs != NULL;
 	    rs = zfs_btree_next(t, &idx, &idx)) {
-		uint64_t start = zfs_rs_get_start(rs, vr->vr_scan_tree);
-		uint64_t size = zfs_rs_get_end(rs, vr->vr_scan_tree) - start;
+		uint64_t start = zfs_rs_get_start(rs, vrc->vrc_tree);
+		uint64_t size = zfs_rs_get_end(rs, vrc->vrc_tree) - start;
 
 		/*
 		 * zfs_scan_suspend_progress can be set to disable rebuild
@@ -668,7 +719,7 @@ vdev_rebuild_ranges(vdev_rebuild_t *vr)
 			chunk_size = vd->vdev_ops->vdev_op_rebuild_asize(vd,
 			    start, size, zfs_rebuild_max_segment);
 
-			error = vdev_rebuild_range(vr, start, chunk_size);
+			error = vdev_rebuild_range(vrc, start, chunk_size);
 			if (error != 0)
 				return (error);
 
@@ -754,65 +805,50 @@ vdev_rebuild_load(vdev_t *vd)
 }
 
 /*
- * Each scan thread is responsible for rebuilding a top-level vdev.  The
- * rebuild progress in tracked on-disk in VDEV_TOP_ZAP_VDEV_REBUILD_PHYS.
+ * Claims the next unscanned metaslab for the cursor.  Returns NULL when all
+ * metaslabs have been claimed or another cursor has failed.
  */
-static __attribute__((noreturn)) void
-vdev_rebuild_thread(void *arg)
+static metaslab_t *
+vdev_rebuild_claim_ms(vdev_rebuild_cursor_t *vrc)
 {
-	vdev_t *vd = arg;
-	spa_t *spa = vd->vdev_spa;
-	vdev_t *rvd = spa->spa_root_vdev;
-	int error = 0;
-
-	/*
-	 * If there's a scrub in process request that it be stopped.  This
-	 * is not required for a correct rebuild, but we do want rebuilds to
-	 * emulate the resilver behavior as much as possible.
-	 */
-	dsl_pool_t *dsl = spa_get_dsl(spa);
-	if (dsl_scan_scrubbing(dsl))
-		dsl_scan_cancel(dsl);
+	vdev_rebuild_t *vr = vrc->vrc_rebuild;
+	vdev_t *vd = vr->vr_top_vdev;
+	metaslab_t *msp = NULL;
 
-	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
 	mutex_enter(&vd->vdev_rebuild_lock);
+	if (vr->vr_scan_error == 0 && vr->vr_scan_next_ms < vd->vdev_ms_count) {
+		msp = vd->vdev_ms[vr->vr_scan_next_ms++];
+		vrc->vrc_offset = msp->ms_start;
+	} else {
+		vrc->vrc_offset = UINT64_MAX;
+	}
+	vrc->vrc_msp = msp;
+	mutex_exit(&vd->vdev_rebuild_lock);
 
-	ASSERT3P(vd->vdev_top, ==, vd);
-	ASSERT3P(vd->vdev_rebuild_thread, !=, NULL);
-	ASSERT(vd->vdev_rebuilding);
-	ASSERT(spa_feature_is_active(spa, SPA_FEATURE_DEVICE_REBUILD));
-	ASSERT3B(vd->vdev_rebuild_cancel_wanted, ==, B_FALSE);
+	return (msp);
+}
 
-	vdev_rebuild_t *vr = &vd->vdev_rebuild_config;
+/*
+ * Each rebuild cursor repeatedly claims the next unscanned metaslab and
+ * issues rebuild I/Os for all ranges in its allocated space map.
+ */
+static void
+vdev_rebuild_cursor_scan(void *arg)
+{
+	vdev_rebuild_cursor_t *vrc = arg;
+	vdev_rebuild_t *vr = vrc->vrc_rebuild;
 	vdev_rebuild_phys_t *vrp = &vr->vr_rebuild_phys;
-	vr->vr_top_vdev = vd;
-	vr->vr_scan_msp = NULL;
-	vr->vr_scan_tree = zfs_range_tree_create_flags(
-	    NULL, ZFS_RANGE_SEG64, NULL, 0, 0,
-	    ZFS_RT_F_DYN_NAME, vdev_rt_name(vd, "vr_scan_tree"));
-	mutex_init(&vr->vr_io_lock, NULL, MUTEX_DEFAULT, NULL);
-	cv_init(&vr->vr_io_cv, NULL, CV_DEFAULT, NULL);
-
-	vr->vr_pass_start_time = gethrtime();
-	vr->vr_pass_bytes_scanned = 0;
-	vr->vr_pass_bytes_issued = 0;
-	vr->vr_pass_bytes_skipped = 0;
-
+	vdev_t *vd = vr->vr_top_vdev;
+	spa_t *spa = vd->vdev_spa;
+	vdev_t *rvd = spa->spa_root_vdev;
+	dsl_pool_t *dsl = spa_get_dsl(spa);
 	uint64_t update_est_time = gethrtime();
-	vdev_rebuild_update_bytes_est(vd, 0);
-
-	clear_rebuild_bytes(vr->vr_top_vdev);
-
-	mutex_exit(&vd->vdev_rebuild_lock);
+	metaslab_t *msp;
+	int error = 0;
 
-	/*
-	 * Systematically walk the metaslabs and issue rebuild I/Os for
-	 * all ranges in the allocated space map.
-	 */
-	for (uint64_t i = 0; i < vd->vdev_ms_count; i++) {
-		metaslab_t *msp = vd->vdev_ms[i];
-		vr->vr_scan_msp = msp;
+	spa_config_enter(spa, SCL_CONFIG, vrc, RW_READER);
 
+	while ((msp = vdev_rebuild_claim_ms(vrc)) != NULL) {
 		/*
 		 * Calculate the max number of in-flight bytes for top-level
 		 * vdev scanning operations (minimum 1MB, maximum 1/2 of
@@ -836,10 +872,10 @@ vdev_rebuild_thread(void *arg)
 			break;
 		}
 
-		ASSERT0(zfs_range_tree_space(vr->vr_scan_tree));
+		ASSERT0(zfs_range_tree_space(vrc->vrc_tree));
 
 		/* Disable any new allocations to this metaslab */
-		spa_config_exit(spa, SCL_CONFIG, FTAG);
+		spa_config_exit(spa, SCL_CONFIG, vrc);
 		metaslab_disable(msp);
 
 		mutex_enter(&msp->ms_sync_lock);
@@ -863,13 +899,13 @@ vdev_rebuild_thread(void *arg)
 
 		/*
 		 * When a metaslab has been allocated from read its allocated
-		 * ranges from the space map object into the vr_scan_tree.
+		 * ranges from the space map object into the vrc_tree.
 		 * Then add inflight / unflushed ranges and remove inflight /
 		 * unflushed frees.  This is the minimum range to be rebuilt.
 		 */
 		if (msp->ms_sm != NULL) {
 			VERIFY0(space_map_load(msp->ms_sm,
-			    vr->vr_scan_tree, SM_ALLOC));
+			    vrc->vrc_tree, SM_ALLOC));
 
 			for (int i = 0; i < TXG_SIZE; i++) {
 				ASSERT0(zfs_range_tree_space(
@@ -877,16 +913,16 @@ vdev_rebuild_thread(void *arg)
 			}
 
 			zfs_range_tree_walk(msp->ms_unflushed_allocs,
-			    zfs_range_tree_add, vr->vr_scan_tree);
+			    zfs_range_tree_add, vrc->vrc_tree);
 			zfs_range_tree_walk(msp->ms_unflushed_frees,
-			    zfs_range_tree_remove, vr->vr_scan_tree);
+			    zfs_range_tree_remove, vrc->vrc_tree);
 
 			/*
 			 * Remove ranges which have already been rebuilt based
 			 * on the last offset.  This can happen when restarting
 			 * a scan after exporting and re-importing the pool.
 			 */
-			zfs_range_tree_clear(vr->vr_scan_tree, 0,
+			zfs_range_tree_clear(vrc->vrc_tree, 0,
 			    vrp->vrp_last_offset);
 		}
 
@@ -897,28 +933,141 @@ vdev_rebuild_thread(void *arg)
 		 * To provide an accurate estimate re-calculate the estimated
 		 * size every 5 minutes to account for recent allocations and
 		 * frees made to space maps which have not yet been rebuilt.
+		 * This is only done by the first cursor.
 		 */
-		if (gethrtime() > update_est_time + SEC2NSEC(300)) {
+		if (vrc == &vr->vr_cursors[0] &&
+		    gethrtime() > update_est_time + SEC2NSEC(300)) {
 			update_est_time = gethrtime();
-			vdev_rebuild_update_bytes_est(vd, i);
+			vdev_rebuild_update_bytes_est(vd, msp->ms_id);
 		}
 
 		/*
 		 * Walk the allocated space map and issue the rebuild I/O.
 		 */
-		error = vdev_rebuild_ranges(vr);
-		zfs_range_tree_vacate(vr->vr_scan_tree, NULL, NULL);
+		error = vdev_rebuild_ranges(vrc);
+		zfs_range_tree_vacate(vrc->vrc_tree, NULL, NULL);
 
-		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+		spa_config_enter(spa, SCL_CONFIG, vrc, RW_READER);
 		metaslab_enable(msp, B_FALSE, B_FALSE);
 
 		if (error != 0)
 			break;
 	}
 
-	zfs_range_tree_destroy(vr->vr_scan_tree);
+	spa_config_exit(spa, SCL_CONFIG, vrc);
+
+	/*
+	 * Record the first error and stop the remaining cursors from
+	 * claiming further metaslabs.  A failed cursor keeps its offset
+	 * so the recorded rebuild progress never passes it.
+	 */
+	if (error != 0) {
+		mutex_enter(&vd->vdev_rebuild_lock);
+		if (vr->vr_scan_error == 0)
+			vr->vr_scan_error = error;
+		mutex_exit(&vd->vdev_rebuild_lock);
+	}
+}
+
+/*
+ * Each scan thread is responsible for rebuilding a top-level vdev.  The
+ * rebuild progress in tracked on-disk in VDEV_TOP_ZAP_VDEV_REBUILD_PHYS.
+ * The metaslabs are scanned concurrently by zfs_rebuild_cursors cursors,
+ * the first of which runs in this thread.
+ */
+static __attribute__((noreturn)) void
+vdev_rebuild_thread(void *arg)
+{
+	vdev_t *vd = arg;
+	spa_t *spa = vd->vdev_spa;
+	int error = 0;
+
+	/*
+	 * If there's a scrub in process request that it be stopped.  This
+	 * is not required for a correct rebuild, but we do want rebuilds to
+	 * emulate the resilver behavior as much as possible.
+	 */
+	dsl_pool_t *dsl = spa_get_dsl(spa);
+	if (dsl_scan_scrubbing(dsl))
+		dsl_scan_cancel(dsl);
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	mutex_enter(&vd->vdev_rebuild_lock);
+
+	ASSERT3P(vd->vdev_top, ==, vd);
+	ASSERT3P(vd->vdev_rebuild_thread, !=, NULL);
+	ASSERT(vd->vdev_rebuilding);
+	ASSERT(spa_feature_is_active(spa, SPA_FEATURE_DEVICE_REBUILD));
+	ASSERT3B(vd->vdev_rebuild_cancel_wanted, ==, B_FALSE);
+
+	vdev_rebuild_t *vr = &vd->vdev_rebuild_config;
+	vdev_rebuild_phys_t *vrp = &vr->vr_rebuild_phys;
+	vr->vr_top_vdev = vd;
+	vr->vr_ncursors = MAX(MIN(zfs_rebuild_cursors, vd->vdev_ms_count), 1);
+	vr->vr_cursors = kmem_zalloc(vr->vr_ncursors *
+	    sizeof (vdev_rebuild_cursor_t), KM_SLEEP);
+	for (uint_t c = 0; c < vr->vr_ncursors; c++) {
+		vdev_rebuild_cursor_t *vrc = &vr->vr_cursors[c];
+
+		vrc->vrc_rebuild = vr;
+		vrc->vrc_msp = NULL;
+		vrc->vrc_tree = zfs_range_tree_create_flags(
+		    NULL, ZFS_RANGE_SEG64, NULL, 0, 0,
+		    ZFS_RT_F_DYN_NAME, vdev_rt_name(vd, "vrc_tree"));
+		vrc->vrc_offset = 0;
+	}
+	vr->vr_scan_next_ms = 0;
+	vr->vr_scan_error = 0;
+	vr->vr_scan_max_txg = 0;
+	memset(vr->vr_scan_offset, 0, sizeof (vr->vr_scan_offset));
+	memset(vr->vr_scan_txg, 0, sizeof (vr->vr_scan_txg));
+	mutex_init(&vr->vr_io_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vr->vr_io_cv, NULL, CV_DEFAULT, NULL);
+
+	vr->vr_pass_start_time = gethrtime();
+	vr->vr_pass_bytes_scanned = 0;
+	vr->vr_pass_bytes_issued = 0;
+	vr->vr_pass_bytes_skipped = 0;
+
+	vdev_rebuild_update_bytes_est(vd, 0);
+
+	clear_rebuild_bytes(vr->vr_top_vdev);
+
+	mutex_exit(&vd->vdev_rebuild_lock);
 	spa_config_exit(spa, SCL_CONFIG, FTAG);
 
+	/*
+	 * Systematically walk the metaslabs and issue rebuild I/Os for
+	 * all ranges in the allocated space map.  Additional cursors are
+	 * dispatched to a taskq and the first cursor runs in this thread.
+	 */
+	taskq_t *tq = NULL;
+	if (vr->vr_ncursors > 1) {
+		tq = taskq_create("z_rebuild", vr->vr_ncursors - 1,
+		    defclsyspri, 1, INT_MAX, TASKQ_DYNAMIC);
+		for (uint_t c = 1; c < vr->vr_ncursors; c++) {
+			VERIFY3U(taskq_dispatch(tq, vdev_rebuild_cursor_scan,
+			    &vr->vr_cursors[c], TQ_SLEEP), !=, TASKQID_INVALID);
+		}
+	}
+
+	vdev_rebuild_cursor_scan(&vr->vr_cursors[0]);
+
+	if (tq != NULL) {
+		taskq_wait(tq);
+		taskq_destroy(tq);
+	}
+
+	mutex_enter(&vd->vdev_rebuild_lock);
+	error = vr->vr_scan_error;
+	for (uint_t c = 0; c < vr->vr_ncursors; c++)
+		zfs_range_tree_destroy(vr->vr_cursors[c].vrc_tree);
+	kmem_free(vr->vr_cursors,
+	    vr->vr_ncursors * sizeof (vdev_rebuild_cursor_t));
+	vr->vr_cursors = NULL;
+	vr->vr_ncursors = 0;
+	mutex_exit(&vd->vdev_rebuild_lock);
+
 	/* Wait for any remaining rebuild I/O to complete */
 	mutex_enter(&vr->vr_io_lock);
 	while (vr->vr_bytes_inflight > 0)
@@ -1181,3 +1330,6 @@ ZFS_MODULE_PARAM(zfs, zfs_, rebuild_vdev_limit, U64, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs, zfs_, rebuild_scrub_enabled, INT, ZMOD_RW,
 	"Automatically scrub after sequential resilver completes");
+
+ZFS_MODULE_PARAM(zfs, zfs_, rebuild_cursors, UINT, ZMOD_RW,
+	"Number of concurrent metaslab cursors per sequential resilver");
@@ -69,7 +69,10 @@
  *    the removing vdev to a different vdev.  The copy happens in open
  *    context (spa_vdev_copy_impl) and issues a sync task
  *    (vdev_mapping_sync) so the sync thread can update the partial
- *    indirect mappings in core and on disk.
+ *    indirect mappings in core and on disk.  The allocations and I/O
+ *    for each chunk are issued by a pool of copy threads
+ *    (spa_vdev_copy_task), while the chunks themselves are handed out
+ *    in order by the removal thread.
  *
  *  - If a free happens during a removal, it is freed from the
  *    removing vdev, and if it has already been copied, from the new
@@ -86,10 +89,29 @@ typedef struct vdev_copy_arg {
 	uint64_t	vca_outstanding_bytes;
 	uint64_t	vca_read_error_bytes;
 	uint64_t	vca_write_error_bytes;
+	uint64_t	vca_max_alloc;
+	uint64_t	vca_tasks;
+	uint64_t	vca_next_allocator;
+	taskq_t		*vca_taskq;
 	kcondvar_t	vca_cv;
 	kmutex_t	vca_lock;
 } vdev_copy_arg_t;
 
+/*
+ * One chunk of the removing vdev, no larger than vca_max_alloc, for which
+ * a copy thread allocates new space and issues the copy I/O.  The task
+ * holds the chunk's tx open until it has created all of its mappings.
+ */
+typedef struct vdev_copy_task {
+	list_node_t	vct_node;
+	spa_t		*vct_spa;
+	vdev_copy_arg_t	*vct_vca;
+	dmu_tx_t	*vct_tx;
+	zfs_range_tree_t	*vct_segs;
+	list_t		vct_new_segments;
+	int		vct_allocator;
+} vdev_copy_task_t;
+
 /*
  * The maximum amount of memory we can use for outstanding i/o while
  * doing a device removal.  This determines how much i/o we can have
@@ -115,6 +137,14 @@ uint_t zfs_remove_max_segment = SPA_MAXBLOCKSIZE;
  */
 static int zfs_removal_ignore_errors = 0;
 
+/*
+ * Number of threads allocating space for, and issuing the I/O of, the
+ * chunks copied off a removing vdev.  Each thread uses its own metaslab
+ * allocator, so concurrent chunks are usually placed on different
+ * destination vdevs.  A value of 1 copies from the removal thread itself.
+ */
+static uint_t zfs_removal_copy_threads = 4;
+
 /*
  * Allow a remap segment to span free chunks of at most this size. The main
  * impact of a larger span is that we will read and write larger, more
@@ -376,6 +406,9 @@ spa_vdev_removal_create(vdev_t *vd)
 		list_create(&svr->svr_new_segments[i],
 		    sizeof (vdev_indirect_mapping_entry_t),
 		    offsetof(vdev_indirect_mapping_entry_t, vime_node));
+		list_create(&svr->svr_copy_tasks[i],
+		    sizeof (vdev_copy_task_t),
+		    offsetof(vdev_copy_task_t, vct_node));
 	}
 
 	return (svr);
@@ -389,6 +422,7 @@ spa_vdev_removal_destroy(spa_vdev_removal_t *svr)
 		ASSERT0(svr->svr_max_offset_to_sync[i]);
 		zfs_range_tree_destroy(svr->svr_frees[i]);
 		list_destroy(&svr->svr_new_segments[i]);
+		list_destroy(&svr->svr_copy_tasks[i]);
 	}
 
 	zfs_range_tree_destroy(svr->svr_allocd_segs);
@@ -904,6 +938,19 @@ vdev_mapping_sync(void *arg, dmu_tx_t *tx)
 	ASSERT(vic->vic_mapping_object != 0);
 	ASSERT3U(txg, ==, spa_syncing_txg(spa));
 
+	/*
+	 * All copy tasks of this txg have committed their tx, so their
+	 * mappings are complete.  Gather them in source offset order.
+	 */
+	vdev_copy_task_t *vct;
+	while ((vct = list_remove_head(
+	    &svr->svr_copy_tasks[txg & TXG_MASK])) != NULL) {
+		list_move_tail(&svr->svr_new_segments[txg & TXG_MASK],
+		    &vct->vct_new_segments);
+		list_destroy(&vct->vct_new_segments);
+		kmem_free(vct, sizeof (*vct));
+	}
+
 	vdev_indirect_mapping_add_entries(vim,
 	    &svr->svr_new_segments[txg & TXG_MASK], tx);
 	vdev_indirect_births_add_entry(vd->vdev_indirect_births,
@@ -1119,12 +1166,11 @@ spa_vdev_copy_one_child(vdev_copy_arg_t *vca, zio_t *nzio,
  */
 static int
 spa_vdev_copy_segment(vdev_t *vd, zfs_range_tree_t *segs,
-    uint64_t maxalloc, uint64_t txg,
-    vdev_copy_arg_t *vca, zio_alloc_list_t *zal)
+    uint64_t maxalloc, uint64_t txg, vdev_copy_arg_t *vca,
+    zio_alloc_list_t *zal, list_t *new_segments, int allocator)
 {
 	metaslab_group_t *mg = vd->vdev_mg;
 	spa_t *spa = vd->vdev_spa;
-	spa_vdev_removal_t *svr = spa->spa_vdev_removal;
 	vdev_indirect_mapping_entry_t *entry;
 	dva_t dst = {{ 0 }};
 	uint64_t start = zfs_range_tree_min(segs);
@@ -1168,10 +1214,10 @@ spa_vdev_copy_segment(vdev_t *vd, zfs_range_tree_t *segs,
 	if (mc->mc_groups == 0)
 		mc = spa_normal_class(spa);
 	int error = metaslab_alloc_dva(spa, mc, size, &dst, 0, NULL, txg,
-	    0, zal, 0);
+	    0, zal, allocator);
 	if (error == ENOSPC && mc != spa_normal_class(spa)) {
 		error = metaslab_alloc_dva(spa, spa_normal_class(spa), size,
-		    &dst, 0, NULL, txg, 0, zal, 0);
+		    &dst, 0, NULL, txg, 0, zal, allocator);
 	}
 	if (error != 0)
 		return (error);
@@ -1245,7 +1291,7 @@ spa_vdev_copy_segment(vdev_t *vd, zfs_range_tree_t *segs,
 	}
 	zio_nowait(nzio);
 
-	list_insert_tail(&svr->svr_new_segments[txg & TXG_MASK], entry);
+	list_insert_tail(new_segments, entry);
 	ASSERT3U(start + size, <=, vd->vdev_ms_count << vd->vdev_ms_shift);
 	vdev_dirty(vd, 0, NULL, txg);
 
@@ -1435,13 +1481,108 @@ vdev_remove_complete(spa_t *spa)
  * large size, so decrease max_alloc so that the caller will not try
  * this size again this txg.
  */
+/*
+ * Allocate new space for, and issue the copy of, all of the segments of a
+ * copy task.
+ */
+static void
+spa_vdev_copy_task_impl(vdev_copy_task_t *vct, vdev_t *vd)
+{
+	spa_t *spa = vct->vct_spa;
+	vdev_copy_arg_t *vca = vct->vct_vca;
+	zfs_range_tree_t *segs = vct->vct_segs;
+	uint64_t txg = dmu_tx_get_txg(vct->vct_tx);
+
+	zio_alloc_list_t zal;
+	metaslab_trace_init(&zal);
+	uint64_t thismax = SPA_MAXBLOCKSIZE;
+	while (!zfs_range_tree_is_empty(segs)) {
+		int error = spa_vdev_copy_segment(vd, segs, thismax, txg,
+		    vca, &zal, &vct->vct_new_segments, vct->vct_allocator);
+
+		if (error == ENOSPC) {
+			/*
+			 * Cut our segment in half, and don't try this
+			 * segment size again this txg.  Note that the
+			 * allocation size must be aligned to the highest
+			 * ashift in the pool, so that the allocation will
+			 * not be padded out to a multiple of the ashift,
+			 * which could cause us to think that this mapping
+			 * is larger than we intended.
+			 */
+			ASSERT3U(spa->spa_max_ashift, >=, SPA_MINBLOCKSHIFT);
+			ASSERT3U(spa->spa_max_ashift, ==, spa->spa_min_ashift);
+			uint64_t attempted =
+			    MIN(zfs_range_tree_span(segs), thismax);
+			thismax = P2ROUNDUP(attempted / 2,
+			    1 << spa->spa_max_ashift);
+			/*
+			 * The minimum-size allocation can not fail.
+			 */
+			ASSERT3U(attempted, >, 1 << spa->spa_max_ashift);
+			mutex_enter(&vca->vca_lock);
+			vca->vca_max_alloc = MIN(vca->vca_max_alloc,
+			    attempted - (1 << spa->spa_max_ashift));
+			mutex_exit(&vca->vca_lock);
+		} else {
+			ASSERT0(error);
+
+			/*
+			 * We've performed an allocation, so reset the
+			 * alloc trace list.
+			 */
+			metaslab_trace_fini(&zal);
+			metaslab_trace_init(&zal);
+		}
+	}
+	metaslab_trace_fini(&zal);
+	zfs_range_tree_destroy(segs);
+	vct->vct_segs = NULL;
+}
+
+/*
+ * Copy task run by the copy threads.  The vdev is looked up again since
+ * the removal thread may have dropped the config lock since dispatching
+ * the task.  Once the tx is committed the task belongs to
+ * vdev_mapping_sync() and must not be touched.
+ */
+static void
+spa_vdev_copy_task(void *arg)
+{
+	vdev_copy_task_t *vct = arg;
+	spa_t *spa = vct->vct_spa;
+	vdev_copy_arg_t *vca = vct->vct_vca;
+	dmu_tx_t *tx = vct->vct_tx;
+
+	spa_config_enter(spa, SCL_CONFIG, vct, RW_READER);
+	spa_vdev_copy_task_impl(vct,
+	    vdev_lookup_top(spa, spa->spa_vdev_removal->svr_vdev_id));
+	spa_config_exit(spa, SCL_CONFIG, vct);
+
+	mutex_enter(&vca->vca_lock);
+	ASSERT3U(vca->vca_tasks, >, 0);
+	vca->vca_tasks--;
+	cv_broadcast(&vca->vca_cv);
+	mutex_exit(&vca->vca_lock);
+
+	dmu_tx_commit(tx);
+}
+
+/*
+ * Takes ownership of the tx, which is committed once the chunk's
+ * mappings have been created.
+ */
 static void
 spa_vdev_copy_impl(vdev_t *vd, spa_vdev_removal_t *svr, vdev_copy_arg_t *vca,
-    uint64_t *max_alloc, dmu_tx_t *tx)
+    dmu_tx_t *tx)
 {
 	uint64_t txg = dmu_tx_get_txg(tx);
 	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
 
+	mutex_enter(&vca->vca_lock);
+	uint64_t max_alloc = vca->vca_max_alloc;
+	mutex_exit(&vca->vca_lock);
+
 	mutex_enter(&svr->svr_lock);
 
 	/*
@@ -1466,7 +1607,7 @@ spa_vdev_copy_impl(vdev_t *vd, spa_vdev_removal_t *svr, vdev_copy_arg_t *vca,
 		if (zfs_range_tree_is_empty(segs)) {
 			/* need to truncate the first seg based on max_alloc */
 			seg_length = MIN(zfs_rs_get_end(rs, rt) -
-			    zfs_rs_get_start(rs, rt), *max_alloc);
+			    zfs_rs_get_start(rs, rt), max_alloc);
 		} else {
 			if (zfs_rs_get_start(rs, rt) - zfs_range_tree_max(segs)
 			    > vdev_removal_max_span) {
@@ -1476,7 +1617,7 @@ spa_vdev_copy_impl(vdev_t *vd, spa_vdev_removal_t *svr, vdev_copy_arg_t *vca,
 				 */
 				break;
 			} else if (zfs_rs_get_end(rs, rt) -
-			    zfs_range_tree_min(segs) > *max_alloc) {
+			    zfs_range_tree_min(segs) > max_alloc) {
 				/*
 				 * This additional segment would extend past
 				 * max_alloc. Rather than splitting this
@@ -1497,6 +1638,7 @@ spa_vdev_copy_impl(vdev_t *vd, spa_vdev_removal_t *svr, vdev_copy_arg_t *vca,
 	if (zfs_range_tree_is_empty(segs)) {
 		mutex_exit(&svr->svr_lock);
 		zfs_range_tree_destroy(segs);
+		dmu_tx_commit(tx);
 		return;
 	}
 
@@ -1513,49 +1655,34 @@ spa_vdev_copy_impl(vdev_t *vd, spa_vdev_removal_t *svr, vdev_copy_arg_t *vca,
 	 */
 	svr->svr_bytes_done[txg & TXG_MASK] += zfs_range_tree_space(segs);
 
-	mutex_exit(&svr->svr_lock);
-
-	zio_alloc_list_t zal;
-	metaslab_trace_init(&zal);
-	uint64_t thismax = SPA_MAXBLOCKSIZE;
-	while (!zfs_range_tree_is_empty(segs)) {
-		int error = spa_vdev_copy_segment(vd,
-		    segs, thismax, txg, vca, &zal);
+	/*
+	 * Queue the task while still holding svr_lock, so tasks are listed
+	 * in the order their chunks were taken from svr_allocd_segs.
+	 */
+	vdev_copy_task_t *vct = kmem_zalloc(sizeof (*vct), KM_SLEEP);
+	vct->vct_spa = spa;
+	vct->vct_vca = vca;
+	vct->vct_tx = tx;
+	vct->vct_segs = segs;
+	vct->vct_allocator = vca->vca_next_allocator++ % spa->spa_alloc_count;
+	list_create(&vct->vct_new_segments,
+	    sizeof (vdev_indirect_mapping_entry_t),
+	    offsetof(vdev_indirect_mapping_entry_t, vime_node));
+	list_insert_tail(&svr->svr_copy_tasks[txg & TXG_MASK], vct);
 
-		if (error == ENOSPC) {
-			/*
-			 * Cut our segment in half, and don't try this
-			 * segment size again this txg.  Note that the
-			 * allocation size must be aligned to the highest
-			 * ashift in the pool, so that the allocation will
-			 * not be padded out to a multiple of the ashift,
-			 * which could cause us to think that this mapping
-			 * is larger than we intended.
-			 */
-			ASSERT3U(spa->spa_max_ashift, >=, SPA_MINBLOCKSHIFT);
-			ASSERT3U(spa->spa_max_ashift, ==, spa->spa_min_ashift);
-			uint64_t attempted =
-			    MIN(zfs_range_tree_span(segs), thismax);
-			thismax = P2ROUNDUP(attempted / 2,
-			    1 << spa->spa_max_ashift);
-			/*
-			 * The minimum-size allocation can not fail.
-			 */
-			ASSERT3U(attempted, >, 1 << spa->spa_max_ashift);
-			*max_alloc = attempted - (1 << spa->spa_max_ashift);
-		} else {
-			ASSERT0(error);
+	mutex_exit(&svr->svr_lock);
 
-			/*
-			 * We've performed an allocation, so reset the
-			 * alloc trace list.
-			 */
-			metaslab_trace_fini(&zal);
-			metaslab_trace_init(&zal);
-		}
+	if (vca->vca_taskq == NULL) {
+		spa_vdev_copy_task_impl(vct, vd);
+		dmu_tx_commit(tx);
+		return;
 	}
-	metaslab_trace_fini(&zal);
-	zfs_range_tree_destroy(segs);
+
+	mutex_enter(&vca->vca_lock);
+	vca->vca_tasks++;
+	mutex_exit(&vca->vca_lock);
+	VERIFY3U(taskq_dispatch(vca->vca_taskq, spa_vdev_copy_task, vct,
+	    TQ_SLEEP), !=, TASKQID_INVALID);
 }
 
 /*
@@ -1594,7 +1721,6 @@ spa_vdev_remove_thread(void *arg)
 	spa_t *spa = arg;
 	spa_vdev_removal_t *svr = spa->spa_vdev_removal;
 	vdev_copy_arg_t vca;
-	uint64_t max_alloc = spa_remove_max_segment(spa);
 	uint64_t last_txg = 0;
 
 	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
@@ -1613,6 +1739,15 @@ spa_vdev_remove_thread(void *arg)
 	vca.vca_outstanding_bytes = 0;
 	vca.vca_read_error_bytes = 0;
 	vca.vca_write_error_bytes = 0;
+	vca.vca_max_alloc = spa_remove_max_segment(spa);
+	vca.vca_tasks = 0;
+	vca.vca_next_allocator = 0;
+	vca.vca_taskq = NULL;
+	if (zfs_removal_copy_threads > 1) {
+		vca.vca_taskq = taskq_create("z_vdev_removal",
+		    zfs_removal_copy_threads, minclsyspri,
+		    zfs_removal_copy_threads, INT_MAX, TASKQ_PREPOPULATE);
+	}
 
 	zfs_range_tree_t *segs = zfs_range_tree_create_flags(
 	    NULL, ZFS_RANGE_SEG64, NULL, 0, 0,
@@ -1719,9 +1854,16 @@ again:
 			    !svr->svr_thread_exit)
 				delay(hz);
 
+			/*
+			 * Keep at most one chunk queued per copy thread, so
+			 * that chunks are not taken from svr_allocd_segs
+			 * faster than they can be copied.
+			 */
 			mutex_enter(&vca.vca_lock);
 			while (vca.vca_outstanding_bytes >
-			    zfs_remove_max_copy_bytes) {
+			    zfs_remove_max_copy_bytes ||
+			    (vca.vca_taskq != NULL &&
+			    vca.vca_tasks >= zfs_removal_copy_threads)) {
 				cv_wait(&vca.vca_cv, &vca.vca_lock);
 			}
 			mutex_exit(&vca.vca_lock);
@@ -1741,13 +1883,14 @@ again:
 			spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
 			vd = vdev_lookup_top(spa, svr->svr_vdev_id);
 
-			if (txg != last_txg)
-				max_alloc = spa_remove_max_segment(spa);
+			if (txg != last_txg) {
+				mutex_enter(&vca.vca_lock);
+				vca.vca_max_alloc = spa_remove_max_segment(spa);
+				mutex_exit(&vca.vca_lock);
+			}
 			last_txg = txg;
 
-			spa_vdev_copy_impl(vd, svr, &vca, &max_alloc, tx);
-
-			dmu_tx_commit(tx);
+			spa_vdev_copy_impl(vd, svr, &vca, tx);
 			mutex_enter(&svr->svr_lock);
 		}
 
@@ -1767,8 +1910,16 @@ again:
 	zfs_range_tree_destroy(segs);
 
 	/*
-	 * Wait for all copies to finish before cleaning up the vca.
+	 * Wait for all copies to finish before cleaning up the vca.  The
+	 * copy tasks must be done before waiting for the txg to sync, as
+	 * they hold it open.
 	 */
+	if (vca.vca_taskq != NULL) {
+		taskq_wait(vca.vca_taskq);
+		taskq_destroy(vca.vca_taskq);
+		vca.vca_taskq = NULL;
+	}
+	ASSERT0(vca.vca_tasks);
 	txg_wait_synced(spa->spa_dsl_pool, 0);
 	ASSERT0(vca.vca_outstanding_bytes);
 
@@ -1896,6 +2047,7 @@ spa_vdev_remove_cancel_sync(void *arg, dmu_tx_t *tx)
 	}
 	for (int i = 0; i < TXG_SIZE; i++) {
 		ASSERT(list_is_empty(&svr->svr_new_segments[i]));
+		ASSERT(list_is_empty(&svr->svr_copy_tasks[i]));
 		ASSERT3U(svr->svr_max_offset_to_sync[i], <=,
 		    vdev_indirect_mapping_max_offset(vim));
 	}
@@ -2560,6 +2712,9 @@ spa_removal_get_stats(spa_t *spa, pool_removal_stat_t *prs)
 ZFS_MODULE_PARAM(zfs_vdev, zfs_, removal_ignore_errors, INT, ZMOD_RW,
 	"Ignore hard IO errors when removing device");
 
+ZFS_MODULE_PARAM(zfs_vdev, zfs_, removal_copy_threads, UINT, ZMOD_RW,
+	"Number of threads issuing copies when removing device");
+
 ZFS_MODULE_PARAM(zfs_vdev, zfs_, remove_max_segment, UINT, ZMOD_RW,
 	"Largest contiguous segment to allocate when removing device");
 
@@ -138,6 +138,24 @@ static unsigned int zfs_trim_queue_limit = 10;
  */
 static unsigned int zfs_trim_txg_batch = 32;
 
+/*
+ * Maximum rate in bytes/sec at which automatic TRIM issues TRIM I/Os to
+ * each leaf vdev while trimming a metaslab (0 = unlimited).  This bounds
+ * the TRIM bandwidth spent on any one device independently of the size
+ * of the ranges being trimmed.
+ */
+static uint64_t zfs_trim_auto_rate_max = 0;
+
+/*
+ * Target device latency in milliseconds for automatic TRIM I/Os (0 = no
+ * target).  Each leaf vdev tracks a decaying average of the time its
+ * autotrim I/Os take to complete.  While this average is above the target
+ * only a single autotrim I/O is kept in flight to the device, so devices
+ * which stall on TRIM are not flooded while devices which handle TRIM
+ * well are still trimmed at full queue depth.
+ */
+static unsigned int zfs_trim_auto_latency_ms = 0;
+
 /*
  * The trim_args are a control structure which describe how a leaf vdev
  * should be trimmed.  The core elements are the vdev, the metaslab being
@@ -442,6 +460,8 @@ vdev_autotrim_cb(zio_t *zio)
 	} else {
 		spa_iostats_trim_add(vd->vdev_spa, TRIM_TYPE_AUTO,
 		    1, zio->io_orig_size, 0, 0, 0, 0);
+		vd->vdev_autotrim_latency = (vd->vdev_autotrim_latency * 7 +
+		    zio->io_delay) / 8;
 	}
 
 	ASSERT3U(vd->vdev_trim_inflight[TRIM_TYPE_AUTO], >, 0);
@@ -505,8 +525,9 @@ vdev_trim_range(trim_args_t *ta, uint64_t start, uint64_t size)
 	mutex_enter(&vd->vdev_trim_io_lock);
 
 	/*
-	 * Limit manual TRIM I/Os to the requested rate.  This does not
-	 * apply to automatic TRIM since no per vdev rate can be specified.
+	 * Limit manual TRIM I/Os to the requested rate, and automatic TRIM
+	 * I/Os to the zfs_trim_auto_rate_max and zfs_trim_auto_latency_ms
+	 * budgets.
 	 */
 	if (ta->trim_type == TRIM_TYPE_MANUAL) {
 		while (vd->vdev_trim_rate != 0 && !vdev_trim_should_stop(vd) &&
@@ -515,6 +536,20 @@ vdev_trim_range(trim_args_t *ta, uint64_t start, uint64_t size)
 			    &vd->vdev_trim_io_lock, ddi_get_lbolt() +
 			    MSEC_TO_TICK(10));
 		}
+	} else if (ta->trim_type == TRIM_TYPE_AUTO) {
+		while (zfs_trim_auto_rate_max != 0 &&
+		    !vdev_autotrim_should_stop(vd->vdev_top) &&
+		    vdev_trim_calculate_rate(ta) > zfs_trim_auto_rate_max) {
+			cv_timedwait_idle(&vd->vdev_trim_io_cv,
+			    &vd->vdev_trim_io_lock, ddi_get_lbolt() +
+			    MSEC_TO_TICK(10));
+		}
+		while (zfs_trim_auto_latency_ms != 0 &&
+		    vd->vdev_trim_inflight[TRIM_TYPE_AUTO] > 0 &&
+		    vd->vdev_autotrim_latency >
+		    MSEC2NSEC(zfs_trim_auto_latency_ms)) {
+			cv_wait(&vd->vdev_trim_io_cv, &vd->vdev_trim_io_lock);
+		}
 	}
 	ta->trim_bytes_done += size;
 
@@ -1800,3 +1835,9 @@ ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, txg_batch, UINT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, queue_limit, UINT, ZMOD_RW,
 	"Max queued TRIMs outstanding per leaf vdev");
+
+ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, auto_rate_max, U64, ZMOD_RW,
+	"Max autotrim rate (bytes/sec) per leaf vdev");
+
+ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, auto_latency_ms, UINT, ZMOD_RW,
+	"Target autotrim I/O latency per leaf vdev");
@@ -1287,6 +1287,89 @@ zap_increment(objset_t *os, uint64_t obj, const char *name, int64_t delta,
 	return (err);
 }
 
+typedef struct zap_increment_ent {
+	zap_name_t	*zie_zn;
+	int64_t		zie_delta;
+} zap_increment_ent_t;
+
+static int
+zap_increment_ent_compare(const void *a, const void *b)
+{
+	const zap_increment_ent_t *zie1 = a;
+	const zap_increment_ent_t *zie2 = b;
+
+	return (TREE_CMP(zie1->zie_zn->zn_hash, zie2->zie_zn->zn_hash));
+}
+
+int
+zap_increment_batch(objset_t *os, uint64_t obj, const char *const *names,
+    const int64_t *deltas, uint64_t n, dmu_tx_t *tx)
+{
+	zap_increment_ent_t *zies;
+	zap_t *zap;
+	uint64_t nzies = 0;
+	int err;
+
+	if (n == 0)
+		return (0);
+
+	err = zap_lockdir(os, obj, tx, RW_WRITER, TRUE, TRUE, FTAG, &zap);
+	if (err != 0)
+		return (err);
+
+	/*
+	 * A microzap is small and may need to be upgraded while adding,
+	 * which zap_increment() already handles.
+	 */
+	if (zap->zap_ismicro) {
+		zap_unlockdir(zap, FTAG);
+		for (uint64_t i = 0; i < n && err == 0; i++)
+			err = zap_increment(os, obj, names[i], deltas[i], tx);
+		return (err);
+	}
+
+	zies = vmem_alloc(n * sizeof (*zies), KM_SLEEP);
+	for (uint64_t i = 0; i < n; i++) {
+		if (deltas[i] == 0)
+			continue;
+		zap_name_t *zn = zap_name_alloc_str(zap, names[i], 0);
+		if (zn == NULL) {
+			err = SET_ERROR(ENOTSUP);
+			break;
+		}
+		zies[nzies].zie_zn = zn;
+		zies[nzies].zie_delta = deltas[i];
+		nzies++;
+	}
+	if (err == 0)
+		qsort(zies, nzies, sizeof (*zies), zap_increment_ent_compare);
+
+	for (uint64_t i = 0; i < nzies && err == 0; i++) {
+		zap_name_t *zn = zies[i].zie_zn;
+		uint64_t value = 0;
+
+		zn->zn_zap = zap;
+		err = fzap_lookup(zn, 8, 1, &value, NULL, 0, NULL);
+		if (err != 0 && err != ENOENT)
+			break;
+		value += zies[i].zie_delta;
+		if (value == 0) {
+			err = fzap_remove(zn, tx);
+		} else {
+			/* fzap_update() may change zap */
+			err = fzap_update(zn, 8, 1, &value, FTAG, tx);
+			zap = zn->zn_zap;
+		}
+	}
+
+	for (uint64_t i = 0; i < nzies; i++)
+		zap_name_free(zies[i].zie_zn);
+	vmem_free(zies, n * sizeof (*zies));
+	if (zap != NULL)	/* may be NULL if fzap_upgrade() failed */
+		zap_unlockdir(zap, FTAG);
+	return (err);
+}
+
 int
 zap_increment_int(objset_t *os, uint64_t obj, uint64_t key, int64_t delta,
     dmu_tx_t *tx)
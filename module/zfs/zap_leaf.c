@@ -374,16 +374,36 @@ zap_leaf_array_match(zap_leaf_t *l, zap_name_t *zn,
 	int bseen = 0;
 
 	if (zap_getflags(zn->zn_zap) & ZAP_FLAG_UINT64_KEY) {
-		uint64_t *thiskey =
-		    kmem_alloc(array_numints * sizeof (*thiskey), KM_SLEEP);
-		ASSERT(zn->zn_key_intlen == sizeof (*thiskey));
-
-		zap_leaf_array_read(l, chunk, sizeof (*thiskey), array_numints,
-		    sizeof (*thiskey), array_numints, thiskey);
-		boolean_t match = memcmp(thiskey, zn->zn_key_orig,
-		    array_numints * sizeof (*thiskey)) == 0;
-		kmem_free(thiskey, array_numints * sizeof (*thiskey));
-		return (match);
+		const uint64_t *key = zn->zn_key_orig;
+		uint64_t value = 0;
+		int byten = 0, i = 0;
+		ASSERT(zn->zn_key_intlen == sizeof (*key));
+
+		/*
+		 * Decode and compare the key integers straight out of the
+		 * chunks, so that a mismatch (usually in the first integer)
+		 * costs neither an allocation nor a copy of the whole key.
+		 */
+		if (array_numints != zn->zn_key_orig_numints)
+			return (B_FALSE);
+		while (i < array_numints) {
+			struct zap_leaf_array *la =
+			    &ZAP_LEAF_CHUNK(l, chunk).l_array;
+			ASSERT3U(chunk, <, ZAP_LEAF_NUMCHUNKS(l));
+			for (int b = 0; b < ZAP_LEAF_ARRAY_BYTES &&
+			    i < array_numints; b++) {
+				value = (value << 8) | la->la_array[b];
+				if (++byten == sizeof (*key)) {
+					if (value != key[i])
+						return (B_FALSE);
+					value = 0;
+					byten = 0;
+					i++;
+				}
+			}
+			chunk = la->la_next;
+		}
+		return (B_TRUE);
 	}
 
 	ASSERT(zn->zn_key_intlen == 1);
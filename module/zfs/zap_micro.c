@@ -562,23 +562,43 @@ mzap_open(dmu_buf_t *db)
 
 		/*
 		 * Reduce B-tree leaf from 4KB to 512 bytes to reduce memmove()
-		 * overhead on massive inserts below.  It still allows to store
-		 * 62 entries before we have to add 2KB B-tree core node.
+		 * overhead on later inserts.  It still allows to store 62
+		 * entries before we have to add 2KB B-tree core node.
 		 */
 		zfs_btree_create_custom(&zap->zap_m.zap_tree, mze_compare,
 		    mze_find_in_buf, sizeof (mzap_ent_t), 512);
 
+		/*
+		 * Hash all the entries first and add them to the B-tree in
+		 * sorted order.  That keeps the tree in bulk-load mode, where
+		 * each add is an append to the last leaf and the leaves are
+		 * filled completely, instead of inserting at random places
+		 * and splitting half-full leaves for every block of entries.
+		 */
+		size_t mzes_size = zap->zap_m.zap_num_chunks *
+		    sizeof (mzap_ent_t);
+		mzap_ent_t *mzes = vmem_alloc(mzes_size, KM_SLEEP);
+		uint16_t nmzes = 0;
 		zap_name_t *zn = zap_name_alloc(zap, B_FALSE);
 		for (uint16_t i = 0; i < zap->zap_m.zap_num_chunks; i++) {
 			mzap_ent_phys_t *mze =
 			    &zap_m_phys(zap)->mz_chunk[i];
 			if (mze->mze_name[0]) {
-				zap->zap_m.zap_num_entries++;
 				zap_name_init_str(zn, mze->mze_name, 0);
-				mze_insert(zap, i, zn->zn_hash);
+				ASSERT0(zn->zn_hash & 0xffffffff);
+				ASSERT3U(mze->mze_cd, <=, 0xffff);
+				mzes[nmzes].mze_hash = zn->zn_hash >> 32;
+				mzes[nmzes].mze_cd = (uint16_t)mze->mze_cd;
+				mzes[nmzes].mze_chunkid = i;
+				nmzes++;
 			}
 		}
 		zap_name_free(zn);
+		qsort(mzes, nmzes, sizeof (mzap_ent_t), mze_compare);
+		for (uint16_t i = 0; i < nmzes; i++)
+			zfs_btree_add(&zap->zap_m.zap_tree, &mzes[i]);
+		zap->zap_m.zap_num_entries = nmzes;
+		vmem_free(mzes, mzes_size);
 	} else {
 		zap->zap_salt = zap_f_phys(zap)->zap_salt;
 		zap->zap_normflags = zap_f_phys(zap)->zap_normflags;
@@ -1666,6 +1686,89 @@ zap_update_uint64_by_dnode(dnode_t *dn, const uint64_t *key, int key_numints,
 	return (err);
 }
 
+static int
+zap_name_hash_compare(const void *a, const void *b)
+{
+	const zap_name_t *zn1 = *(zap_name_t * const *)a;
+	const zap_name_t *zn2 = *(zap_name_t * const *)b;
+
+	return (TREE_CMP(zn1->zn_hash, zn2->zn_hash));
+}
+
+static int
+zap_update_uint64_batch_impl(zap_t *zap, const uint64_t *keys,
+    int key_numints, uint64_t nkeys, int integer_size, uint64_t num_integers,
+    const void *vals, dmu_tx_t *tx, const void *tag)
+{
+	size_t valsize = integer_size * num_integers;
+	int err = 0;
+
+	zap_name_t **zns = vmem_alloc(nkeys * sizeof (*zns), KM_SLEEP);
+	for (uint64_t i = 0; i < nkeys; i++) {
+		zns[i] = zap_name_alloc_uint64(zap, &keys[i * key_numints],
+		    key_numints);
+	}
+	qsort(zns, nkeys, sizeof (*zns), zap_name_hash_compare);
+
+	for (uint64_t i = 0; i < nkeys; i++) {
+		zap_name_t *zn = zns[i];
+		uint64_t idx = ((const uint64_t *)zn->zn_key_orig - keys) /
+		    key_numints;
+
+		zn->zn_zap = zap;
+		err = fzap_update(zn, integer_size, num_integers,
+		    (const char *)vals + idx * valsize, tag, tx);
+		zap = zn->zn_zap;	/* fzap_update() may change zap */
+		if (err != 0)
+			break;
+	}
+
+	for (uint64_t i = 0; i < nkeys; i++)
+		zap_name_free(zns[i]);
+	vmem_free(zns, nkeys * sizeof (*zns));
+	if (zap != NULL)	/* may be NULL if fzap_upgrade() failed */
+		zap_unlockdir(zap, tag);
+	return (err);
+}
+
+int
+zap_update_uint64_batch(objset_t *os, uint64_t zapobj, const uint64_t *keys,
+    int key_numints, uint64_t nkeys, int integer_size, uint64_t num_integers,
+    const void *vals, dmu_tx_t *tx)
+{
+	zap_t *zap;
+
+	if (nkeys == 0)
+		return (0);
+	int err =
+	    zap_lockdir(os, zapobj, tx, RW_WRITER, TRUE, TRUE, FTAG, &zap);
+	if (err != 0)
+		return (err);
+	err = zap_update_uint64_batch_impl(zap, keys, key_numints, nkeys,
+	    integer_size, num_integers, vals, tx, FTAG);
+	/* zap_update_uint64_batch_impl() calls zap_unlockdir() */
+	return (err);
+}
+
+int
+zap_update_uint64_batch_by_dnode(dnode_t *dn, const uint64_t *keys,
+    int key_numints, uint64_t nkeys, int integer_size, uint64_t num_integers,
+    const void *vals, dmu_tx_t *tx)
+{
+	zap_t *zap;
+
+	if (nkeys == 0)
+		return (0);
+	int err =
+	    zap_lockdir_by_dnode(dn, tx, RW_WRITER, TRUE, TRUE, FTAG, &zap);
+	if (err != 0)
+		return (err);
+	err = zap_update_uint64_batch_impl(zap, keys, key_numints, nkeys,
+	    integer_size, num_integers, vals, tx, FTAG);
+	/* zap_update_uint64_batch_impl() calls zap_unlockdir() */
+	return (err);
+}
+
 int
 zap_remove(objset_t *os, uint64_t zapobj, const char *name, dmu_tx_t *tx)
 {
@@ -1891,6 +1994,33 @@ zap_cursor_serialize(zap_cursor_t *zc)
 	    ((uint64_t)zc->zc_cd << zap_hashbits(zc->zc_zap)));
 }
 
+/*
+ * Return in *serialized the cursor position at which a walk of zapobj
+ * would find the entry "name", without looking the entry up.  When
+ * several names share a hash value this is the position of the first of
+ * them.
+ */
+int
+zap_cursor_serialize_name(objset_t *os, uint64_t zapobj, const char *name,
+    uint64_t *serialized)
+{
+	zap_t *zap;
+
+	int err =
+	    zap_lockdir(os, zapobj, NULL, RW_READER, TRUE, FALSE, FTAG, &zap);
+	if (err != 0)
+		return (err);
+	zap_name_t *zn = zap_name_alloc_str(zap, name, 0);
+	if (zn == NULL) {
+		zap_unlockdir(zap, FTAG);
+		return (SET_ERROR(ENOTSUP));
+	}
+	*serialized = zn->zn_hash >> (64 - zap_hashbits(zap));
+	zap_name_free(zn);
+	zap_unlockdir(zap, FTAG);
+	return (0);
+}
+
 int
 zap_cursor_retrieve(zap_cursor_t *zc, zap_attribute_t *za)
 {
@@ -2016,6 +2146,8 @@ EXPORT_SYMBOL(zap_add_uint64_by_dnode);
 EXPORT_SYMBOL(zap_update);
 EXPORT_SYMBOL(zap_update_uint64);
 EXPORT_SYMBOL(zap_update_uint64_by_dnode);
+EXPORT_SYMBOL(zap_update_uint64_batch);
+EXPORT_SYMBOL(zap_update_uint64_batch_by_dnode);
 EXPORT_SYMBOL(zap_length);
 EXPORT_SYMBOL(zap_length_uint64);
 EXPORT_SYMBOL(zap_remove);
@@ -2039,6 +2171,7 @@ EXPORT_SYMBOL(zap_cursor_fini);
 EXPORT_SYMBOL(zap_cursor_retrieve);
 EXPORT_SYMBOL(zap_cursor_advance);
 EXPORT_SYMBOL(zap_cursor_serialize);
+EXPORT_SYMBOL(zap_cursor_serialize_name);
 EXPORT_SYMBOL(zap_cursor_init_serialized);
 EXPORT_SYMBOL(zap_get_stats);
 
@@ -547,6 +547,32 @@ prop_valid_for_ds(dsl_dataset_t *ds, zfs_prop_t zfs_prop)
 	return (zfs_prop_valid_for_type(zfs_prop, zfs_type, B_FALSE));
 }
 
+/*
+ * Look up a property of a dataset which is already held, e.g. by one of the
+ * zfs.list iterators, without looking the dataset up by name again. On
+ * success push the property value and source onto the lua stack and return
+ * 0. Otherwise push nothing and return ENOENT if the property is not set or
+ * not valid for the dataset, or another non-zero error value on failure.
+ */
+int
+zcp_get_system_prop_ds(lua_State *state, dsl_dataset_t *ds,
+    const char *dataset_name, zfs_prop_t zfs_prop)
+{
+	int error;
+
+	/* Check that the property is valid for the given dataset */
+	if (!prop_valid_for_ds(ds, zfs_prop))
+		return (SET_ERROR(ENOENT));
+
+	/* Check if the property can be accessed directly */
+	error = get_special_prop(state, ds, dataset_name, zfs_prop);
+	if (error != ENOENT)
+		return (error);
+
+	/* If we were unable to find it, look in the zap object */
+	return (get_zap_prop(state, ds, zfs_prop));
+}
+
 /*
  * Look up a given dataset property. On success return 2, the number of
  * values pushed to the lua stack (property value and source). On a fatal
@@ -556,7 +582,6 @@ static int
 zcp_get_system_prop(lua_State *state, dsl_pool_t *dp, const char *dataset_name,
     zfs_prop_t zfs_prop)
 {
-	int error;
 	/*
 	 * zcp_dataset_hold will either successfully return the requested
 	 * dataset or throw a lua error and longjmp out of the zfs.get_prop call
@@ -566,34 +591,13 @@ zcp_get_system_prop(lua_State *state, dsl_pool_t *dp, const char *dataset_name,
 	if (ds == NULL)
 		return (1); /* not reached; zcp_dataset_hold() longjmp'd */
 
-	/* Check that the property is valid for the given dataset */
-	const char *prop_name = zfs_prop_to_name(zfs_prop);
-	if (!prop_valid_for_ds(ds, zfs_prop)) {
-		dsl_dataset_rele(ds, FTAG);
-		return (0);
-	}
-
-	/* Check if the property can be accessed directly */
-	error = get_special_prop(state, ds, dataset_name, zfs_prop);
-	if (error == 0) {
-		dsl_dataset_rele(ds, FTAG);
-		/* The value and source have been pushed by get_special_prop */
-		return (2);
-	}
-	if (error != ENOENT) {
-		dsl_dataset_rele(ds, FTAG);
-		return (zcp_handle_error(state, dataset_name,
-		    prop_name, error));
-	}
-
-	/* If we were unable to find it, look in the zap object */
-	error = get_zap_prop(state, ds, zfs_prop);
+	int error = zcp_get_system_prop_ds(state, ds, dataset_name, zfs_prop);
 	dsl_dataset_rele(ds, FTAG);
 	if (error != 0) {
 		return (zcp_handle_error(state, dataset_name,
-		    prop_name, error));
+		    zfs_prop_to_name(zfs_prop), error));
 	}
-	/* The value and source have been pushed by get_zap_prop */
+	/* The value and source have been pushed */
 	return (2);
 }
 
@@ -154,6 +154,51 @@ zcp_clones_list(lua_State *state)
 	return (1);
 }
 
+/*
+ * Push a table holding the requested properties of a snapshot, keyed by
+ * property name. The snapshot is held by object number, so none of the
+ * lookups by name done by zfs.get_prop() are needed. Properties which are
+ * not set or not valid for the snapshot are left out of the table.
+ */
+static void
+zcp_snapshot_props_push(lua_State *state, dsl_pool_t *dp, uint64_t snapobj,
+    const char *snapname, int props)
+{
+	dsl_dataset_t *snap;
+	int err;
+
+	err = dsl_dataset_hold_obj(dp, snapobj, FTAG, &snap);
+	if (err != 0) {
+		(void) luaL_error(state,
+		    "unexpected error %d from dsl_dataset_hold_obj(snapobj)",
+		    err);
+		return;
+	}
+
+	lua_newtable(state);
+	for (int i = 1; i <= lua_rawlen(state, props); i++) {
+		lua_rawgeti(state, props, i);
+		zfs_prop_t prop = lua_tointeger(state, -1);
+		lua_pop(state, 1);
+
+		err = zcp_get_system_prop_ds(state, snap, snapname, prop);
+		if (err == ENOENT)
+			continue;
+		if (err != 0) {
+			dsl_dataset_rele(snap, FTAG);
+			(void) luaL_error(state, "unexpected error %d while "
+			    "retrieving property '%s' on dataset '%s'",
+			    err, zfs_prop_to_name(prop), snapname);
+			return;
+		}
+
+		/* Drop the source, keeping only the value */
+		lua_pop(state, 1);
+		lua_setfield(state, -2, zfs_prop_to_name(prop));
+	}
+	dsl_dataset_rele(snap, FTAG);
+}
+
 static int
 zcp_snapshots_iter(lua_State *state)
 {
@@ -161,8 +206,10 @@ zcp_snapshots_iter(lua_State *state)
 	char snapname[ZFS_MAX_DATASET_NAME_LEN];
 	uint64_t dsobj = lua_tonumber(state, lua_upvalueindex(1));
 	uint64_t cursor = lua_tonumber(state, lua_upvalueindex(2));
+	boolean_t withprops = !lua_isnil(state, lua_upvalueindex(3));
 	dsl_pool_t *dp = zcp_run_info(state)->zri_pool;
 	dsl_dataset_t *ds;
+	uint64_t snapobj;
 	objset_t *os;
 	char *p;
 
@@ -180,7 +227,7 @@ zcp_snapshots_iter(lua_State *state)
 	p = strchr(snapname, '\0');
 	VERIFY0(dmu_objset_from_ds(ds, &os));
 	err = dmu_snapshot_list_next(os,
-	    sizeof (snapname) - (p - snapname), p, NULL, &cursor, NULL);
+	    sizeof (snapname) - (p - snapname), p, &snapobj, &cursor, NULL);
 	dsl_dataset_rele(ds, FTAG);
 
 	if (err == ENOENT) {
@@ -194,7 +241,12 @@ zcp_snapshots_iter(lua_State *state)
 	lua_replace(state, lua_upvalueindex(2));
 
 	(void) lua_pushstring(state, snapname);
-	return (1);
+	if (!withprops)
+		return (1);
+
+	zcp_snapshot_props_push(state, dp, snapobj, snapname,
+	    lua_upvalueindex(3));
+	return (2);
 }
 
 static int zcp_snapshots_list(lua_State *);
@@ -207,10 +259,38 @@ static const zcp_list_info_t zcp_snapshots_list_info = {
 	    {NULL, 0}
 	},
 	.kwargs = {
+	    { .za_name = "props", .za_lua_type = LUA_TTABLE },
 	    {NULL, 0}
 	}
 };
 
+/*
+ * Translate the list of property names passed to zfs.list.snapshots() into
+ * a table of property numbers, so that the names are resolved only once
+ * rather than for every snapshot. Only native properties are supported.
+ */
+static void
+zcp_snapshots_list_props(lua_State *state, int names)
+{
+	lua_newtable(state);
+	for (int i = 1; i <= lua_rawlen(state, names); i++) {
+		lua_rawgeti(state, names, i);
+		const char *name = lua_tostring(state, -1);
+		zfs_prop_t prop = (name == NULL) ? ZPROP_INVAL :
+		    zfs_name_to_prop(name);
+		if (prop == ZPROP_INVAL) {
+			(void) zcp_argerror(state, 2,
+			    "'%s' is not a valid native property",
+			    name != NULL ? name : "(not a string)");
+			return;
+		}
+		lua_pop(state, 1);
+
+		lua_pushinteger(state, prop);
+		lua_rawseti(state, -2, i);
+	}
+}
+
 static int
 zcp_snapshots_list(lua_State *state)
 {
@@ -233,7 +313,11 @@ zcp_snapshots_list(lua_State *state)
 
 	lua_pushnumber(state, dsobj);
 	lua_pushnumber(state, 0);
-	lua_pushcclosure(state, &zcp_snapshots_iter, 2);
+	if (lua_isnil(state, 2))
+		lua_pushnil(state);
+	else
+		zcp_snapshots_list_props(state, 2);
+	lua_pushcclosure(state, &zcp_snapshots_iter, 3);
 	return (1);
 }
 
@@ -43,6 +43,7 @@ typedef struct {
 	uint64_t bs1m;
 	uint64_t bs4m;
 	uint64_t bs16m;
+	uint32_t fastest;	/* size buckets this impl was picked for */
 	zio_cksum_salt_t salt;
 	zio_checksum_t *(func);
 	zio_checksum_tmpl_init_t *(init);
@@ -80,6 +81,9 @@ static void chksum_benchmark(void);
  * blake3-sse41    453    1554    1658    1703    1689    1669    1622    1630
  * blake3-avx2     452    2013    3225    3351    3356    3261    3076    3101
  * blake3-avx512   498    2869    5269    5926    5872    5643    5014    5005
+ *
+ * A final column lists the buffer size buckets (4k, 16k, large) for which
+ * the "fastest" selector uses each implementation.
  */
 static int
 chksum_kstat_headers(char *buf, size_t size)
@@ -94,7 +98,8 @@ chksum_kstat_headers(char *buf, size_t size)
 	off += kmem_scnprintf(buf + off, size - off, "%8s", "256k");
 	off += kmem_scnprintf(buf + off, size - off, "%8s", "1m");
 	off += kmem_scnprintf(buf + off, size - off, "%8s", "4m");
-	(void) kmem_scnprintf(buf + off, size - off, "%8s\n", "16m");
+	off += kmem_scnprintf(buf + off, size - off, "%8s", "16m");
+	(void) kmem_scnprintf(buf + off, size - off, "  %s\n", "fastest");
 
 	return (0);
 }
@@ -123,8 +128,14 @@ chksum_kstat_data(char *buf, size_t size, void *data)
 	    (u_longlong_t)cs->bs1m);
 	off += kmem_scnprintf(buf + off, size - off, "%8llu",
 	    (u_longlong_t)cs->bs4m);
-	(void) kmem_scnprintf(buf + off, size - off, "%8llu\n",
+	off += kmem_scnprintf(buf + off, size - off, "%8llu",
 	    (u_longlong_t)cs->bs16m);
+	off += kmem_scnprintf(buf + off, size - off, "  %s%s%s%s",
+	    (cs->fastest & (1 << ZFS_IMPL_BUCKET_4K)) ? "4k " : "",
+	    (cs->fastest & (1 << ZFS_IMPL_BUCKET_16K)) ? "16k " : "",
+	    (cs->fastest & (1 << ZFS_IMPL_BUCKET_LARGE)) ? "large " : "",
+	    cs->fastest == 0 ? "-" : "");
+	(void) kmem_scnprintf(buf + off, size - off, "\n");
 
 	return (0);
 }
@@ -197,9 +208,11 @@ chksum_benchit(chksum_stat_t *cs)
 	if (cs->init)
 		ctx = cs->init(&cs->salt);
 
-	/* benchmarks in startup mode */
+	/* benchmarks in startup mode, one size per zfs_impl_bucket_t */
 	if (chksum_stat_limit == AT_STARTUP) {
 		abd = abd_alloc_linear(1<<18, B_FALSE);
+		chksum_run(cs, abd, ctx, 2, &cs->bs4k);
+		chksum_run(cs, abd, ctx, 3, &cs->bs16k);
 		chksum_run(cs, abd, ctx, 5, &cs->bs256k);
 		goto done;
 	}
@@ -212,6 +225,7 @@ chksum_benchit(chksum_stat_t *cs)
 	chksum_run(cs, abd, ctx, 2, &cs->bs4k);
 	chksum_run(cs, abd, ctx, 3, &cs->bs16k);
 	chksum_run(cs, abd, ctx, 4, &cs->bs64k);
+	chksum_run(cs, abd, ctx, 5, &cs->bs256k);
 	chksum_run(cs, abd, ctx, 6, &cs->bs1m);
 	abd_free(abd);
 
@@ -228,6 +242,43 @@ done:
 		cs->free(ctx);
 }
 
+static uint64_t
+chksum_bucket_bw(const chksum_stat_t *cs, zfs_impl_bucket_t bucket)
+{
+	switch (bucket) {
+	case ZFS_IMPL_BUCKET_4K:
+		return (cs->bs4k);
+	case ZFS_IMPL_BUCKET_16K:
+		return (cs->bs16k);
+	default:
+		return (cs->bs256k);
+	}
+}
+
+/*
+ * Pick the fastest of the cnt implementations benchmarked into cs[] for
+ * each buffer size bucket.
+ */
+static void
+chksum_set_fastest(const zfs_impl_t *impl, chksum_stat_t *cs, uint32_t cnt)
+{
+	for (zfs_impl_bucket_t b = 0; b < ZFS_IMPL_BUCKETS; b++) {
+		uint64_t max = 0;
+		uint32_t id, fastest = UINT32_MAX;
+
+		for (id = 0; id < cnt; id++) {
+			if (chksum_bucket_bw(&cs[id], b) > max) {
+				max = chksum_bucket_bw(&cs[id], b);
+				fastest = id;
+			}
+		}
+		if (fastest != UINT32_MAX) {
+			impl->set_fastest(fastest, b);
+			cs[fastest].fastest |= 1 << b;
+		}
+	}
+}
+
 /*
  * Initialize and benchmark all supported implementations.
  */
@@ -239,8 +290,7 @@ chksum_benchmark(void)
 	return;
 #endif
 	chksum_stat_t *cs;
-	uint64_t max;
-	uint32_t id, cbid = 0, id_save;
+	uint32_t id, cbid = 0, first, id_save;
 	const zfs_impl_t *blake3 = zfs_impl_get_ops("blake3");
 	const zfs_impl_t *sha256 = zfs_impl_get_ops("sha256");
 	const zfs_impl_t *sha512 = zfs_impl_get_ops("sha512");
@@ -281,7 +331,8 @@ chksum_benchmark(void)
 
 	/* sha256 */
 	id_save = sha256->getid();
-	for (max = 0, id = 0; id < sha256->getcnt(); id++) {
+	first = cbid;
+	for (id = 0; id < sha256->getcnt(); id++) {
 		sha256->setid(id);
 		cs = &chksum_stat_data[cbid++];
 		cs->init = 0;
@@ -290,16 +341,14 @@ chksum_benchmark(void)
 		cs->name = sha256->name;
 		cs->impl = sha256->getname();
 		chksum_benchit(cs);
-		if (cs->bs256k > max) {
-			max = cs->bs256k;
-			sha256->set_fastest(id);
-		}
 	}
 	sha256->setid(id_save);
+	chksum_set_fastest(sha256, &chksum_stat_data[first], cbid - first);
 
 	/* sha512 */
 	id_save = sha512->getid();
-	for (max = 0, id = 0; id < sha512->getcnt(); id++) {
+	first = cbid;
+	for (id = 0; id < sha512->getcnt(); id++) {
 		sha512->setid(id);
 		cs = &chksum_stat_data[cbid++];
 		cs->init = 0;
@@ -308,16 +357,14 @@ chksum_benchmark(void)
 		cs->name = sha512->name;
 		cs->impl = sha512->getname();
 		chksum_benchit(cs);
-		if (cs->bs256k > max) {
-			max = cs->bs256k;
-			sha512->set_fastest(id);
-		}
 	}
 	sha512->setid(id_save);
+	chksum_set_fastest(sha512, &chksum_stat_data[first], cbid - first);
 
 	/* blake3 */
 	id_save = blake3->getid();
-	for (max = 0, id = 0; id < blake3->getcnt(); id++) {
+	first = cbid;
+	for (id = 0; id < blake3->getcnt(); id++) {
 		blake3->setid(id);
 		cs = &chksum_stat_data[cbid++];
 		cs->init = abd_checksum_blake3_tmpl_init;
@@ -326,12 +373,9 @@ chksum_benchmark(void)
 		cs->name = blake3->name;
 		cs->impl = blake3->getname();
 		chksum_benchit(cs);
-		if (cs->bs256k > max) {
-			max = cs->bs256k;
-			blake3->set_fastest(id);
-		}
 	}
 	blake3->setid(id_save);
+	chksum_set_fastest(blake3, &chksum_stat_data[first], cbid - first);
 
 	switch (chksum_stat_limit) {
 	case AT_STARTUP:
@@ -162,41 +162,40 @@ dbrrd_add(dbrrd_t *db, hrtime_t time, uint64_t txg)
 	daydiff = time - rrd_tail(&db->dbr_days);
 	monthdiff = time - rrd_tail(&db->dbr_months);
 
-	if (monthdiff >= 0 && monthdiff >= SEC2NSEC(30 * 24 * 60 * 60))
+	/* Times are stored in seconds, see spa_sync_time_logger(). */
+	if (monthdiff >= 0 && monthdiff >= 30 * 24 * 60 * 60)
 		rrd_add(&db->dbr_months, time, txg);
-	else if (daydiff >= 0 && daydiff >= SEC2NSEC(24 * 60 * 60))
+	else if (daydiff >= 0 && daydiff >= 24 * 60 * 60)
 		rrd_add(&db->dbr_days, time, txg);
 	else if (minutedif >= 0)
 		rrd_add(&db->dbr_minutes, time, txg);
 }
 
 /*
- * We could do a binary search here, but the routine isn't frequently
- * called and the data is small so we stick to a simple loop.
+ * Entries are only ever appended with increasing times, so each database
+ * is sorted and can be binary searched.  Return the last entry at or before
+ * tv (DBRRD_FLOOR) or the first entry at or after it (DBRRD_CEILING).
  */
 static const rrd_data_t *
 rrd_query(rrd_t *rrd, hrtime_t tv, dbrrd_rounding_t rounding)
 {
-	const rrd_data_t *data = NULL;
-
-	for (size_t i = 0; i < rrd_len(rrd); i++) {
-		const rrd_data_t *cur = rrd_entry(rrd, i);
-
-		if (rounding == DBRRD_FLOOR) {
-			if (tv < cur->rrdd_time) {
-				break;
-			}
-			data = cur;
-		} else {
-			/* DBRRD_CEILING */
-			if (tv <= cur->rrdd_time) {
-				data = cur;
-				break;
-			}
-		}
+	size_t lo = 0, hi = rrd_len(rrd);
+
+	/* Find the first entry which is later than tv, or at it if ceiling. */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const rrd_data_t *cur = rrd_entry(rrd, mid);
+
+		if (rounding == DBRRD_FLOOR ? tv < cur->rrdd_time :
+		    tv <= cur->rrdd_time)
+			hi = mid;
+		else
+			lo = mid + 1;
 	}
 
-	return (data);
+	if (rounding == DBRRD_FLOOR)
+		return (lo == 0 ? NULL : rrd_entry(rrd, lo - 1));
+	return (rrd_entry(rrd, lo));
 }
 
 static const rrd_data_t *
@@ -1355,11 +1355,18 @@ put_nvlist(zfs_cmd_t *zc, nvlist_t *nvl)
 	if (size > zc->zc_nvlist_dst_size) {
 		error = SET_ERROR(ENOMEM);
 	} else {
-		packed = fnvlist_pack(nvl, &size);
+		/*
+		 * Pack into a buffer of the size computed above, rather than
+		 * having nvlist_pack() walk the whole nvlist again to size it.
+		 */
+		size_t packed_size = size;
+		packed = vmem_zalloc(packed_size, KM_SLEEP);
+		VERIFY0(nvlist_pack(nvl, &packed, &size, NV_ENCODE_NATIVE,
+		    KM_SLEEP));
 		if (ddi_copyout(packed, (void *)(uintptr_t)zc->zc_nvlist_dst,
 		    size, zc->zc_iflags) != 0)
 			error = SET_ERROR(EFAULT);
-		fnvlist_pack_free(packed, size);
+		vmem_free(packed, packed_size);
 	}
 
 	zc->zc_nvlist_dst_size = size;
@@ -1706,6 +1713,8 @@ static const zfs_ioc_key_t zfs_keys_pool_scrub[] = {
 	{"scan_command",	DATA_TYPE_UINT64,	0},
 	{"scan_date_start",	DATA_TYPE_UINT64,	ZK_OPTIONAL},
 	{"scan_date_end",	DATA_TYPE_UINT64,	ZK_OPTIONAL},
+	{"scan_rate",		DATA_TYPE_UINT64,	ZK_OPTIONAL},
+	{"scan_latency",	DATA_TYPE_UINT64,	ZK_OPTIONAL},
 };
 
 static int
@@ -1732,7 +1741,15 @@ zfs_ioc_pool_scrub(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
 	if ((error = spa_open(poolname, &spa, FTAG)) != 0)
 		return (error);
 
-	if (scan_cmd == POOL_SCRUB_PAUSE) {
+	if (scan_cmd == POOL_SCRUB_THROTTLE) {
+		uint64_t rate, latency;
+
+		if (nvlist_lookup_uint64(innvl, "scan_rate", &rate) != 0)
+			rate = UINT64_MAX;
+		if (nvlist_lookup_uint64(innvl, "scan_latency", &latency) != 0)
+			latency = UINT64_MAX;
+		error = spa_scan_set_throttle(spa, rate, latency);
+	} else if (scan_cmd == POOL_SCRUB_PAUSE) {
 		error = spa_scrub_pause_resume(spa, POOL_SCRUB_PAUSE);
 	} else if (scan_type == POOL_SCAN_NONE) {
 		error = spa_scan_stop(spa);
@@ -1743,19 +1760,10 @@ zfs_ioc_pool_scrub(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
 		uint64_t txg_start, txg_end;
 
 		txg_start = txg_end = 0;
-		if (date_start != 0 || date_end != 0) {
-			mutex_enter(&spa->spa_txg_log_time_lock);
-			if (date_start != 0) {
-				txg_start = dbrrd_query(&spa->spa_txg_log_time,
-				    date_start, DBRRD_FLOOR);
-			}
-
-			if (date_end != 0) {
-				txg_end = dbrrd_query(&spa->spa_txg_log_time,
-				    date_end, DBRRD_CEILING);
-			}
-			mutex_exit(&spa->spa_txg_log_time_lock);
-		}
+		if (date_start != 0)
+			txg_start = spa_txg_from_time(spa, date_start, B_FALSE);
+		if (date_end != 0)
+			txg_end = spa_txg_from_time(spa, date_end, B_TRUE);
 
 		error = spa_scan_range(spa, scan_type, txg_start, txg_end);
 	}
@@ -4552,6 +4560,127 @@ zfs_ioc_ddt_prune(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
 	return (error);
 }
 
+/*
+ * Fetch a chosen set of properties for many datasets at once, without
+ * gathering (and copying out) every property of every dataset the way
+ * ZFS_IOC_OBJSET_STATS does.  All of the datasets must be in the named pool.
+ *
+ * innvl: {
+ *     "dataset_props_datasets" -> [ "dataset1", ..., "datasetN" ]
+ *     "dataset_props_names" -> [ "prop1", ..., "propN" ]
+ * }
+ *
+ * outnvl: {
+ *     "dataset_props_values" -> { dataset -> { prop -> { value, source } } }
+ *     "dataset_props_errors" -> { dataset -> int32 errno }
+ * }
+ */
+static const zfs_ioc_key_t zfs_keys_get_dataset_props[] = {
+	{ZFS_DATASET_PROPS_DATASETS,	DATA_TYPE_STRING_ARRAY,	0},
+	{ZFS_DATASET_PROPS_NAMES,	DATA_TYPE_STRING_ARRAY,	0},
+};
+
+static int
+zfs_get_dataset_props_one(const char *dsname, const char *const *names,
+    uint_t nnames, nvlist_t *wanted, nvlist_t **nvp)
+{
+	objset_t *os;
+	nvlist_t *nv;
+	int error;
+
+	if (!INGLOBALZONE(curproc) && !zone_dataset_visible(dsname, NULL))
+		return (SET_ERROR(ENOENT));
+
+	if ((error = dmu_objset_hold(dsname, FTAG, &os)) != 0)
+		return (error);
+
+	if ((error = dsl_prop_get_list(os, names, nnames, &nv)) != 0) {
+		dmu_objset_rele(os, FTAG);
+		return (error);
+	}
+	dmu_objset_stats(os, nv);
+	/* See the comment in zfs_ioc_objset_stats_impl(). */
+	if (dmu_objset_type(os) == DMU_OST_ZVOL &&
+	    !dsl_get_inconsistent(os->os_dsl_dataset) &&
+	    (nvlist_exists(wanted, zfs_prop_to_name(ZFS_PROP_VOLSIZE)) ||
+	    nvlist_exists(wanted, zfs_prop_to_name(ZFS_PROP_VOLBLOCKSIZE)))) {
+		error = zvol_get_stats(os, nv);
+		if (error == EIO) {
+			nvlist_free(nv);
+			dmu_objset_rele(os, FTAG);
+			return (error);
+		}
+		VERIFY0(error);
+	}
+	dmu_objset_rele(os, FTAG);
+
+	/* Drop the stats that weren't asked for. */
+	nvpair_t *pair = nvlist_next_nvpair(nv, NULL);
+	while (pair != NULL) {
+		nvpair_t *next = nvlist_next_nvpair(nv, pair);
+		if (!nvlist_exists(wanted, nvpair_name(pair)))
+			fnvlist_remove_nvpair(nv, pair);
+		pair = next;
+	}
+
+	*nvp = nv;
+	return (0);
+}
+
+static int
+zfs_ioc_get_dataset_props(const char *pool, nvlist_t *innvl,
+    nvlist_t *outnvl)
+{
+	char **datasets, **names;
+	uint_t ndatasets, nnames;
+	size_t poollen = strlen(pool);
+
+	if (nvlist_lookup_string_array(innvl, ZFS_DATASET_PROPS_DATASETS,
+	    &datasets, &ndatasets) != 0 ||
+	    nvlist_lookup_string_array(innvl, ZFS_DATASET_PROPS_NAMES,
+	    &names, &nnames) != 0)
+		return (SET_ERROR(EINVAL));
+
+	nvlist_t *wanted = fnvlist_alloc();
+	for (uint_t i = 0; i < nnames; i++)
+		fnvlist_add_boolean(wanted, names[i]);
+
+	nvlist_t *values = fnvlist_alloc();
+	nvlist_t *errors = fnvlist_alloc();
+	for (uint_t i = 0; i < ndatasets; i++) {
+		const char *dsname = datasets[i];
+		nvlist_t *nv = NULL;
+		int error;
+
+		if (nvlist_exists(values, dsname) ||
+		    nvlist_exists(errors, dsname))
+			continue;
+
+		if (strncmp(dsname, pool, poollen) != 0 ||
+		    (dsname[poollen] != '\0' && dsname[poollen] != '/' &&
+		    dsname[poollen] != '@')) {
+			error = SET_ERROR(EXDEV);
+		} else {
+			error = zfs_get_dataset_props_one(dsname,
+			    (const char *const *)names, nnames, wanted, &nv);
+		}
+
+		if (error == 0) {
+			fnvlist_add_nvlist(values, dsname, nv);
+			nvlist_free(nv);
+		} else {
+			fnvlist_add_int32(errors, dsname, error);
+		}
+	}
+
+	fnvlist_add_nvlist(outnvl, ZFS_DATASET_PROPS_VALUES, values);
+	fnvlist_add_nvlist(outnvl, ZFS_DATASET_PROPS_ERRORS, errors);
+	fnvlist_free(values);
+	fnvlist_free(errors);
+	fnvlist_free(wanted);
+	return (0);
+}
+
 /*
  * This ioctl waits for activity of a particular type to complete. If there is
  * no activity of that type in progress, it returns immediately, and the
@@ -6903,6 +7032,9 @@ zfs_ioc_space_snaps(const char *lastsnap, nvlist_t *innvl, nvlist_t *outnvl)
  *         presence indicates we should send a partially received snapshot
  *     (optional) "resume_object" and "resume_offset" -> (uint64)
  *         if present, resume send stream from specified object and offset.
+ *     (optional) "part" and "nparts" -> (uint64)
+ *         if present, split the objects of the snapshot into "nparts" ranges
+ *         and send only the range numbered "part", counting from zero.
  *     (optional) "redactbook" -> (string)
  *         if present, use this bookmark's redaction list to generate a redacted
  *         send stream
@@ -6920,6 +7052,8 @@ static const zfs_ioc_key_t zfs_keys_send_new[] = {
 	{"savedok",		DATA_TYPE_BOOLEAN,	ZK_OPTIONAL},
 	{"resume_object",	DATA_TYPE_UINT64,	ZK_OPTIONAL},
 	{"resume_offset",	DATA_TYPE_UINT64,	ZK_OPTIONAL},
+	{"part",		DATA_TYPE_UINT64,	ZK_OPTIONAL},
+	{"nparts",		DATA_TYPE_UINT64,	ZK_OPTIONAL},
 	{"redactbook",		DATA_TYPE_STRING,	ZK_OPTIONAL},
 };
 
@@ -6938,6 +7072,8 @@ zfs_ioc_send_new(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 	boolean_t savedok;
 	uint64_t resumeobj = 0;
 	uint64_t resumeoff = 0;
+	uint64_t part = 0;
+	uint64_t nparts = 0;
 	const char *redactbook = NULL;
 
 	fd = fnvlist_lookup_int32(innvl, "fd");
@@ -6953,6 +7089,9 @@ zfs_ioc_send_new(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 	(void) nvlist_lookup_uint64(innvl, "resume_object", &resumeobj);
 	(void) nvlist_lookup_uint64(innvl, "resume_offset", &resumeoff);
 
+	(void) nvlist_lookup_uint64(innvl, "part", &part);
+	(void) nvlist_lookup_uint64(innvl, "nparts", &nparts);
+
 	(void) nvlist_lookup_string(innvl, "redactbook", &redactbook);
 
 	dump_bytes_arg_t dba;
@@ -6963,7 +7102,7 @@ zfs_ioc_send_new(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 
 	off = zfs_file_off(dba.dba_fp);
 	error = dmu_send(snapname, fromname, embedok, largeblockok,
-	    compressok, rawok, savedok, resumeobj, resumeoff,
+	    compressok, rawok, savedok, resumeobj, resumeoff, part, nparts,
 	    redactbook, fd, &off, &out);
 
 	dump_bytes_fini(&dba);
@@ -7132,7 +7271,7 @@ zfs_ioc_send_space(const char *snapname, nvlist_t *innvl, nvlist_t *outnvl)
 		dsl_dataset_rele(tosnap, FTAG);
 		dsl_pool_rele(dp, FTAG);
 		error = dmu_send(snapname, fromname, embedok, largeblockok,
-		    compressok, rawok, savedok, resumeobj, resumeoff,
+		    compressok, rawok, savedok, resumeobj, resumeoff, 0, 0,
 		    redactlist_book, fd, &off, &out);
 	} else {
 		error = dmu_send_estimate_fast(tosnap, fromsnap,
@@ -7632,6 +7771,11 @@ zfs_ioctl_init(void)
 	    POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY, B_TRUE, B_TRUE,
 	    zfs_keys_ddt_prune, ARRAY_SIZE(zfs_keys_ddt_prune));
 
+	zfs_ioctl_register("get_dataset_props", ZFS_IOC_GET_DATASET_PROPS,
+	    zfs_ioc_get_dataset_props, zfs_secpolicy_read, POOL_NAME,
+	    POOL_CHECK_SUSPENDED, B_FALSE, B_FALSE, zfs_keys_get_dataset_props,
+	    ARRAY_SIZE(zfs_keys_get_dataset_props));
+
 	/* IOCTLS that use the legacy function signature */
 
 	zfs_ioctl_register_legacy(ZFS_IOC_POOL_FREEZE, zfs_ioc_pool_freeze,
@@ -109,11 +109,61 @@
  * So if the block size needs to be grown then the whole file is
  * exclusively locked, then later the caller will reduce the lock
  * range to just the range to be written using rangelock_reduce().
+ *
+ * Reader fast path
+ * ----------------
+ * Most files see only readers, or readers and writers at different times,
+ * and taking rl_lock for every read makes the mutex the bottleneck for
+ * many threads reading one file.  So while no writer holds or is waiting
+ * for any range, a reader just bumps the count in rl_fast and doesn't go
+ * near the mutex or the tree.  The top half of rl_fast counts the writers
+ * holding or waiting for a range, and while it's non-zero new readers take
+ * the slow path; a writer waits for the fast readers that came in before
+ * it to drain, then locks its range as usual.  As fast readers' ranges are
+ * not recorded, a writer waits for all of them, whatever their range.  A
+ * thread that holds a reader lock while taking a writer lock on the same
+ * rangelock must therefore take the reader with
+ * zfs_rangelock_enter_nofast(), or it would wait on itself.
+ *
+ * Stripes
+ * -------
+ * Many threads writing different parts of one large file would otherwise
+ * all serialize on rl_lock.  Once a lock is taken beyond the first
+ * 2^zfs_rangelock_stripe_shift bytes, the rangelock grows an array of
+ * RL_STRIPES stripes, each with its own mutex and tree, and offset region
+ * N (of 2^rl_stripe_shift bytes) maps to stripe N % RL_STRIPES.  A lock
+ * that fits in one region goes in that region's stripe, and only deals
+ * with the locks there.  Anything else (a range spanning regions, an
+ * append, or a writer whose range the callback changes, e.g. to the whole
+ * file) goes in rl_tree as before, and also waits for any conflicting
+ * range in each stripe its range touches.
+ *
+ * rl_nmain counts the locks held in or waiting for rl_tree.  While it's
+ * non-zero, new locks skip the stripes and go in rl_tree too, so rl_tree
+ * ranges never have to be checked for by stripe users.  The count is
+ * raised before a rl_tree user looks at any stripe and checked by stripe
+ * users under the stripe's mutex, so either the rl_tree user sees the
+ * stripe lock or the stripe user sees the count.
  */
 
 #include <sys/zfs_context.h>
 #include <sys/zfs_rlock.h>
 
+/*
+ * Let readers bypass the range tree while there are no writers.
+ */
+static int zfs_rangelock_fast_readers = 1;
+
+/*
+ * Size of the offset region mapped to each stripe, as a power of 2, or 0 to
+ * keep every lock in the one tree.
+ */
+static uint_t zfs_rangelock_stripe_shift = 30;
+
+#define	RL_FAST_READERS	0xffffffffULL
+#define	RL_FAST_WRITER	(1ULL << 32)
+
+#define	RL_STRIPES	8
 
 /*
  * AVL comparison function used to order range locks
@@ -141,31 +191,250 @@ zfs_rangelock_init(zfs_rangelock_t *rl, zfs_rangelock_cb_t *cb, void *arg)
 	    sizeof (zfs_locked_range_t), offsetof(zfs_locked_range_t, lr_node));
 	rl->rl_cb = cb;
 	rl->rl_arg = arg;
+	rl->rl_fast = 0;
+	cv_init(&rl->rl_fast_cv, NULL, CV_DEFAULT, NULL);
+	rl->rl_nmain = 0;
+	rl->rl_stripe_shift = 0;
+	rl->rl_stripes = NULL;
 }
 
 void
 zfs_rangelock_fini(zfs_rangelock_t *rl)
 {
+	zfs_rangelock_stripe_t *stripes = rl->rl_stripes;
+
+	ASSERT0(rl->rl_fast);
+	ASSERT0(rl->rl_nmain);
+	if (stripes != NULL) {
+		for (int i = 0; i < RL_STRIPES; i++) {
+			mutex_destroy(&stripes[i].rls_lock);
+			avl_destroy(&stripes[i].rls_tree);
+		}
+		kmem_free(stripes, sizeof (zfs_rangelock_stripe_t) *
+		    RL_STRIPES);
+	}
+	cv_destroy(&rl->rl_fast_cv);
 	mutex_destroy(&rl->rl_lock);
 	avl_destroy(&rl->rl_tree);
 }
 
 /*
- * Check if a write lock can be grabbed.  If not, fail immediately or sleep and
- * recheck until available, depending on the value of the "nonblock" parameter.
+ * Try to take a reader lock without the mutex, which only works while
+ * there are no writers.
+ */
+static boolean_t
+zfs_rangelock_fast_enter_reader(zfs_rangelock_t *rl)
+{
+	uint64_t fast = atomic_load_64(&rl->rl_fast);
+
+	while ((fast & ~RL_FAST_READERS) == 0) {
+		uint64_t old = atomic_cas_64(&rl->rl_fast, fast, fast + 1);
+		if (old == fast)
+			return (B_TRUE);
+		fast = old;
+	}
+	return (B_FALSE);
+}
+
+static void
+zfs_rangelock_fast_exit_reader(zfs_rangelock_t *rl)
+{
+	/*
+	 * The last fast reader out wakes any waiting writers.  They hold
+	 * the rangelock's owner, so it's safe to touch rl after our count
+	 * is dropped.
+	 */
+	uint64_t fast = atomic_dec_64_nv(&rl->rl_fast);
+
+	if ((fast & RL_FAST_READERS) == 0 && fast != 0) {
+		mutex_enter(&rl->rl_lock);
+		cv_broadcast(&rl->rl_fast_cv);
+		mutex_exit(&rl->rl_lock);
+	}
+}
+
+static void
+zfs_rangelock_fast_exit_writer(zfs_rangelock_t *rl)
+{
+	atomic_add_64(&rl->rl_fast, -RL_FAST_WRITER);
+}
+
+/*
+ * Shut off the reader fast path and wait for the fast readers to drain.
+ * Called with no locks held before a writer looks at the trees.
  */
 static boolean_t
-zfs_rangelock_enter_writer(zfs_rangelock_t *rl, zfs_locked_range_t *new,
+zfs_rangelock_fast_enter_writer(zfs_rangelock_t *rl, boolean_t nonblock)
+{
+	if ((atomic_add_64_nv(&rl->rl_fast, RL_FAST_WRITER) &
+	    RL_FAST_READERS) == 0)
+		return (B_TRUE);
+	if (nonblock) {
+		zfs_rangelock_fast_exit_writer(rl);
+		return (B_FALSE);
+	}
+	mutex_enter(&rl->rl_lock);
+	while (atomic_load_64(&rl->rl_fast) & RL_FAST_READERS)
+		cv_wait(&rl->rl_fast_cv, &rl->rl_lock);
+	mutex_exit(&rl->rl_lock);
+	return (B_TRUE);
+}
+
+/*
+ * Pick the stripe for a lock that fits in one offset region, if the
+ * rangelock has stripes.
+ */
+static zfs_rangelock_stripe_t *
+zfs_rangelock_stripe(zfs_rangelock_t *rl, zfs_locked_range_t *new)
+{
+	zfs_rangelock_stripe_t *stripes = atomic_load_ptr(&rl->rl_stripes);
+
+	if (stripes == NULL || new->lr_type == RL_APPEND ||
+	    new->lr_length == 0)
+		return (NULL);
+	membar_consumer();
+
+	uint_t shift = rl->rl_stripe_shift;
+	uint64_t region = new->lr_offset >> shift;
+	if ((new->lr_offset + new->lr_length - 1) >> shift != region)
+		return (NULL);
+	return (&stripes[region % RL_STRIPES]);
+}
+
+/*
+ * Give the rangelock stripes once a lock reaches past the first region.
+ * Called with rl_lock held.
+ */
+static void
+zfs_rangelock_alloc_stripes(zfs_rangelock_t *rl, zfs_locked_range_t *new)
+{
+	uint_t shift = zfs_rangelock_stripe_shift;
+
+	ASSERT(MUTEX_HELD(&rl->rl_lock));
+
+	if (rl->rl_stripes != NULL || shift == 0 || shift >= 64 ||
+	    (new->lr_offset >> shift) == 0)
+		return;
+
+	zfs_rangelock_stripe_t *stripes = kmem_alloc(
+	    sizeof (zfs_rangelock_stripe_t) * RL_STRIPES, KM_SLEEP);
+	for (int i = 0; i < RL_STRIPES; i++) {
+		mutex_init(&stripes[i].rls_lock, NULL, MUTEX_DEFAULT, NULL);
+		avl_create(&stripes[i].rls_tree, zfs_rangelock_compare,
+		    sizeof (zfs_locked_range_t),
+		    offsetof(zfs_locked_range_t, lr_node));
+	}
+	rl->rl_stripe_shift = shift;
+	membar_producer();
+	rl->rl_stripes = stripes;
+}
+
+/*
+ * Find a range in the tree that keeps new from being locked.
+ */
+static zfs_locked_range_t *
+zfs_rangelock_find_conflict(avl_tree_t *tree, zfs_locked_range_t *new)
+{
+	zfs_locked_range_t *lr;
+	avl_index_t where;
+	uint64_t off = new->lr_offset;
+	uint64_t end = off + new->lr_length;
+
+	lr = avl_find(tree, new, &where);
+	if (lr == NULL) {
+		lr = avl_nearest(tree, where, AVL_BEFORE);
+		if (lr == NULL || lr->lr_offset + lr->lr_length <= off)
+			lr = avl_nearest(tree, where, AVL_AFTER);
+	}
+	for (; lr != NULL && lr->lr_offset < end; lr = AVL_NEXT(tree, lr)) {
+		if (new->lr_type == RL_WRITER || lr->lr_type == RL_WRITER ||
+		    lr->lr_write_wanted)
+			return (lr);
+	}
+	return (NULL);
+}
+
+/*
+ * Check the stripes that a lock going in rl_tree overlaps for conflicting
+ * ranges.  Returns 0 if there are none, EBUSY if there are and nonblock is
+ * set, or EAGAIN after waiting for one to go away, in which case rl_lock
+ * was dropped meanwhile and the caller must start over.
+ */
+static int
+zfs_rangelock_check_stripes(zfs_rangelock_t *rl, zfs_locked_range_t *new,
     boolean_t nonblock)
 {
-	avl_tree_t *tree = &rl->rl_tree;
+	zfs_rangelock_stripe_t *stripes = rl->rl_stripes;
+	uint_t shift = rl->rl_stripe_shift;
+
+	ASSERT(MUTEX_HELD(&rl->rl_lock));
+
+	if (stripes == NULL || new->lr_length == 0)
+		return (0);
+
+	uint64_t first = new->lr_offset >> shift;
+	uint64_t last = (new->lr_offset + new->lr_length - 1) >> shift;
+	uint64_t n = MIN(last - first + 1, RL_STRIPES);
+
+	for (uint64_t i = 0; i < n; i++) {
+		zfs_rangelock_stripe_t *rls = &stripes[(first + i) % RL_STRIPES];
+		zfs_locked_range_t *lr;
+
+		mutex_enter(&rls->rls_lock);
+		lr = zfs_rangelock_find_conflict(&rls->rls_tree, new);
+		if (lr == NULL) {
+			mutex_exit(&rls->rls_lock);
+			continue;
+		}
+		if (nonblock) {
+			mutex_exit(&rls->rls_lock);
+			return (SET_ERROR(EBUSY));
+		}
+		mutex_exit(&rl->rl_lock);
+		if (new->lr_type == RL_WRITER) {
+			if (!lr->lr_write_wanted) {
+				cv_init(&lr->lr_write_cv,
+				    NULL, CV_DEFAULT, NULL);
+				lr->lr_write_wanted = B_TRUE;
+			}
+			cv_wait(&lr->lr_write_cv, &rls->rls_lock);
+		} else {
+			if (!lr->lr_read_wanted) {
+				cv_init(&lr->lr_read_cv,
+				    NULL, CV_DEFAULT, NULL);
+				lr->lr_read_wanted = B_TRUE;
+			}
+			cv_wait(&lr->lr_read_cv, &rls->rls_lock);
+		}
+		mutex_exit(&rls->rls_lock);
+		mutex_enter(&rl->rl_lock);
+		return (SET_ERROR(EAGAIN));
+	}
+	return (0);
+}
+
+/*
+ * Check if a write lock can be grabbed.  If not, fail immediately or sleep and
+ * recheck until available, depending on the value of the "nonblock" parameter.
+ * With a stripe, returns ENOENT if the lock has to go in rl_tree instead.
+ */
+static int
+zfs_rangelock_enter_writer(zfs_rangelock_t *rl, zfs_rangelock_stripe_t *rls,
+    zfs_locked_range_t *new, boolean_t nonblock)
+{
+	avl_tree_t *tree = rls != NULL ? &rls->rls_tree : &rl->rl_tree;
+	kmutex_t *lock = rls != NULL ? &rls->rls_lock : &rl->rl_lock;
 	zfs_locked_range_t *lr;
 	avl_index_t where;
 	uint64_t orig_off = new->lr_offset;
 	uint64_t orig_len = new->lr_length;
 	zfs_rangelock_type_t orig_type = new->lr_type;
+	int err;
 
 	for (;;) {
+		if (rls != NULL && atomic_load_32(&rl->rl_nmain) != 0)
+			return (SET_ERROR(ENOENT));
+
 		/*
 		 * Call callback which can modify new->r_off,len,type.
 		 * Note, the callback is used by the ZPL to handle appending
@@ -182,11 +451,14 @@ zfs_rangelock_enter_writer(zfs_rangelock_t *rl, zfs_locked_range_t *new,
 		ASSERT3U(new->lr_type, ==, RL_WRITER);
 
 		/*
-		 * First check for the usual case of no locks
+		 * A range the callback changed may not fit in the stripe.
 		 */
-		if (avl_numnodes(tree) == 0) {
-			avl_add(tree, new);
-			return (B_TRUE);
+		if (rls != NULL && (new->lr_offset != orig_off ||
+		    new->lr_length != orig_len)) {
+			new->lr_offset = orig_off;
+			new->lr_length = orig_len;
+			new->lr_type = orig_type;
+			return (SET_ERROR(ENOENT));
 		}
 
 		/*
@@ -206,17 +478,25 @@ zfs_rangelock_enter_writer(zfs_rangelock_t *rl, zfs_locked_range_t *new,
 		    lr->lr_offset + lr->lr_length > new->lr_offset)
 			goto wait;
 
+		if (rls == NULL) {
+			err = zfs_rangelock_check_stripes(rl, new, nonblock);
+			if (err == EAGAIN)
+				goto reset;
+			if (err != 0)
+				return (err);
+		}
+
 		avl_insert(tree, new, where);
-		return (B_TRUE);
+		return (0);
 wait:
 		if (nonblock)
-			return (B_FALSE);
+			return (SET_ERROR(EBUSY));
 		if (!lr->lr_write_wanted) {
 			cv_init(&lr->lr_write_cv, NULL, CV_DEFAULT, NULL);
 			lr->lr_write_wanted = B_TRUE;
 		}
-		cv_wait(&lr->lr_write_cv, &rl->rl_lock);
-
+		cv_wait(&lr->lr_write_cv, lock);
+reset:
 		/* reset to original */
 		new->lr_offset = orig_off;
 		new->lr_length = orig_len;
@@ -398,21 +678,27 @@ zfs_rangelock_add_reader(avl_tree_t *tree, zfs_locked_range_t *new,
 /*
  * Check if a reader lock can be grabbed.  If not, fail immediately or sleep and
  * recheck until available, depending on the value of the "nonblock" parameter.
+ * With a stripe, returns ENOENT if the lock has to go in rl_tree instead.
  */
-static boolean_t
-zfs_rangelock_enter_reader(zfs_rangelock_t *rl, zfs_locked_range_t *new,
-    boolean_t nonblock)
+static int
+zfs_rangelock_enter_reader(zfs_rangelock_t *rl, zfs_rangelock_stripe_t *rls,
+    zfs_locked_range_t *new, boolean_t nonblock)
 {
-	avl_tree_t *tree = &rl->rl_tree;
+	avl_tree_t *tree = rls != NULL ? &rls->rls_tree : &rl->rl_tree;
+	kmutex_t *lock = rls != NULL ? &rls->rls_lock : &rl->rl_lock;
 	zfs_locked_range_t *prev, *next;
 	avl_index_t where;
 	uint64_t off = new->lr_offset;
 	uint64_t len = new->lr_length;
+	int err;
 
 	/*
 	 * Look for any writer locks in the range.
 	 */
 retry:
+	if (rls != NULL && atomic_load_32(&rl->rl_nmain) != 0)
+		return (SET_ERROR(ENOENT));
+
 	prev = avl_find(tree, new, &where);
 	if (prev == NULL)
 		prev = avl_nearest(tree, where, AVL_BEFORE);
@@ -423,13 +709,13 @@ retry:
 	if (prev && (off < prev->lr_offset + prev->lr_length)) {
 		if ((prev->lr_type == RL_WRITER) || (prev->lr_write_wanted)) {
 			if (nonblock)
-				return (B_FALSE);
+				return (SET_ERROR(EBUSY));
 			if (!prev->lr_read_wanted) {
 				cv_init(&prev->lr_read_cv,
 				    NULL, CV_DEFAULT, NULL);
 				prev->lr_read_wanted = B_TRUE;
 			}
-			cv_wait(&prev->lr_read_cv, &rl->rl_lock);
+			cv_wait(&prev->lr_read_cv, lock);
 			goto retry;
 		}
 		if (off + len < prev->lr_offset + prev->lr_length)
@@ -449,13 +735,13 @@ retry:
 			goto got_lock;
 		if ((next->lr_type == RL_WRITER) || (next->lr_write_wanted)) {
 			if (nonblock)
-				return (B_FALSE);
+				return (SET_ERROR(EBUSY));
 			if (!next->lr_read_wanted) {
 				cv_init(&next->lr_read_cv,
 				    NULL, CV_DEFAULT, NULL);
 				next->lr_read_wanted = B_TRUE;
 			}
-			cv_wait(&next->lr_read_cv, &rl->rl_lock);
+			cv_wait(&next->lr_read_cv, lock);
 			goto retry;
 		}
 		if (off + len <= next->lr_offset + next->lr_length)
@@ -463,12 +749,20 @@ retry:
 	}
 
 got_lock:
+	if (rls == NULL) {
+		err = zfs_rangelock_check_stripes(rl, new, nonblock);
+		if (err == EAGAIN)
+			goto retry;
+		if (err != 0)
+			return (err);
+	}
+
 	/*
 	 * Add the read lock, which may involve splitting existing
 	 * locks and bumping ref counts (r_count).
 	 */
 	zfs_rangelock_add_reader(tree, new, prev, where);
-	return (B_TRUE);
+	return (0);
 }
 
 /*
@@ -481,7 +775,7 @@ got_lock:
  */
 static zfs_locked_range_t *
 zfs_rangelock_enter_impl(zfs_rangelock_t *rl, uint64_t off, uint64_t len,
-    zfs_rangelock_type_t type, boolean_t nonblock)
+    zfs_rangelock_type_t type, boolean_t nonblock, boolean_t fast)
 {
 	zfs_locked_range_t *new;
 
@@ -498,23 +792,58 @@ zfs_rangelock_enter_impl(zfs_rangelock_t *rl, uint64_t off, uint64_t len,
 	new->lr_proxy = B_FALSE;
 	new->lr_write_wanted = B_FALSE;
 	new->lr_read_wanted = B_FALSE;
+	new->lr_fast = B_FALSE;
+	new->lr_stripe = NULL;
 
-	mutex_enter(&rl->rl_lock);
-	if (type == RL_READER) {
-		/*
-		 * First check for the usual case of no locks
-		 */
-		if (avl_numnodes(&rl->rl_tree) == 0) {
-			avl_add(&rl->rl_tree, new);
-		} else if (!zfs_rangelock_enter_reader(rl, new, nonblock)) {
-			kmem_free(new, sizeof (*new));
-			new = NULL;
+	if (type == RL_READER && fast && zfs_rangelock_fast_readers &&
+	    zfs_rangelock_fast_enter_reader(rl)) {
+		new->lr_fast = B_TRUE;
+		return (new);
+	}
+
+	if (type != RL_READER && !zfs_rangelock_fast_enter_writer(rl,
+	    nonblock)) {
+		kmem_free(new, sizeof (*new));
+		return (NULL);
+	}
+
+	/*
+	 * Try the lock's stripe first, if it has one, and fall back to
+	 * rl_tree.
+	 */
+	int err = SET_ERROR(ENOENT);
+	zfs_rangelock_stripe_t *rls = zfs_rangelock_stripe(rl, new);
+	if (rls != NULL) {
+		mutex_enter(&rls->rls_lock);
+		if (type == RL_READER)
+			err = zfs_rangelock_enter_reader(rl, rls, new, nonblock);
+		else
+			err = zfs_rangelock_enter_writer(rl, rls, new, nonblock);
+		mutex_exit(&rls->rls_lock);
+		if (err == 0)
+			new->lr_stripe = rls;
+	}
+	if (err == ENOENT) {
+		atomic_inc_32(&rl->rl_nmain);
+		mutex_enter(&rl->rl_lock);
+		zfs_rangelock_alloc_stripes(rl, new);
+		if (type == RL_READER) {
+			err = zfs_rangelock_enter_reader(rl, NULL, new,
+			    nonblock);
+		} else {
+			err = zfs_rangelock_enter_writer(rl, NULL, new,
+			    nonblock);
 		}
-	} else if (!zfs_rangelock_enter_writer(rl, new, nonblock)) {
+		mutex_exit(&rl->rl_lock);
+		if (err != 0)
+			atomic_dec_32(&rl->rl_nmain);
+	}
+	if (err != 0) {
+		if (type != RL_READER)
+			zfs_rangelock_fast_exit_writer(rl);
 		kmem_free(new, sizeof (*new));
-		new = NULL;
+		return (NULL);
 	}
-	mutex_exit(&rl->rl_lock);
 	return (new);
 }
 
@@ -522,14 +851,26 @@ zfs_locked_range_t *
 zfs_rangelock_enter(zfs_rangelock_t *rl, uint64_t off, uint64_t len,
     zfs_rangelock_type_t type)
 {
-	return (zfs_rangelock_enter_impl(rl, off, len, type, B_FALSE));
+	return (zfs_rangelock_enter_impl(rl, off, len, type, B_FALSE, B_TRUE));
 }
 
 zfs_locked_range_t *
 zfs_rangelock_tryenter(zfs_rangelock_t *rl, uint64_t off, uint64_t len,
     zfs_rangelock_type_t type)
 {
-	return (zfs_rangelock_enter_impl(rl, off, len, type, B_TRUE));
+	return (zfs_rangelock_enter_impl(rl, off, len, type, B_TRUE, B_TRUE));
+}
+
+/*
+ * Like zfs_rangelock_enter(), but a reader lock always goes into the tree,
+ * for callers that go on to take a writer lock on the same rangelock.
+ */
+zfs_locked_range_t *
+zfs_rangelock_enter_nofast(zfs_rangelock_t *rl, uint64_t off, uint64_t len,
+    zfs_rangelock_type_t type)
+{
+	return (zfs_rangelock_enter_impl(rl, off, len, type, B_FALSE,
+	    B_FALSE));
 }
 
 /*
@@ -551,10 +892,9 @@ zfs_rangelock_free(zfs_locked_range_t *lr)
  * Unlock a reader lock
  */
 static void
-zfs_rangelock_exit_reader(zfs_rangelock_t *rl, zfs_locked_range_t *remove,
+zfs_rangelock_exit_reader(avl_tree_t *tree, zfs_locked_range_t *remove,
     list_t *free_list)
 {
-	avl_tree_t *tree = &rl->rl_tree;
 	uint64_t len;
 
 	/*
@@ -616,6 +956,10 @@ void
 zfs_rangelock_exit(zfs_locked_range_t *lr)
 {
 	zfs_rangelock_t *rl = lr->lr_rangelock;
+	zfs_rangelock_stripe_t *rls = lr->lr_stripe;
+	avl_tree_t *tree = rls != NULL ? &rls->rls_tree : &rl->rl_tree;
+	kmutex_t *lock = rls != NULL ? &rls->rls_lock : &rl->rl_lock;
+	zfs_rangelock_type_t type = lr->lr_type;
 	list_t free_list;
 	zfs_locked_range_t *free_lr;
 
@@ -623,6 +967,13 @@ zfs_rangelock_exit(zfs_locked_range_t *lr)
 	ASSERT(lr->lr_count == 1 || lr->lr_count == 0);
 	ASSERT(!lr->lr_proxy);
 
+	if (lr->lr_fast) {
+		ASSERT3U(lr->lr_type, ==, RL_READER);
+		zfs_rangelock_fast_exit_reader(rl);
+		kmem_free(lr, sizeof (zfs_locked_range_t));
+		return;
+	}
+
 	/*
 	 * The free list is used to defer the cv_destroy() and
 	 * subsequent kmem_free until after the mutex is dropped.
@@ -630,10 +981,10 @@ zfs_rangelock_exit(zfs_locked_range_t *lr)
 	list_create(&free_list, sizeof (zfs_locked_range_t),
 	    offsetof(zfs_locked_range_t, lr_node));
 
-	mutex_enter(&rl->rl_lock);
-	if (lr->lr_type == RL_WRITER) {
+	mutex_enter(lock);
+	if (type == RL_WRITER) {
 		/* writer locks can't be shared or split */
-		avl_remove(&rl->rl_tree, lr);
+		avl_remove(tree, lr);
 		if (lr->lr_write_wanted)
 			cv_broadcast(&lr->lr_write_cv);
 		if (lr->lr_read_wanted)
@@ -644,9 +995,13 @@ zfs_rangelock_exit(zfs_locked_range_t *lr)
 		 * lock may be shared, let rangelock_exit_reader()
 		 * release the lock and free the zfs_locked_range_t.
 		 */
-		zfs_rangelock_exit_reader(rl, lr, &free_list);
+		zfs_rangelock_exit_reader(tree, lr, &free_list);
 	}
-	mutex_exit(&rl->rl_lock);
+	mutex_exit(lock);
+	if (rls == NULL)
+		atomic_dec_32(&rl->rl_nmain);
+	if (type == RL_WRITER)
+		zfs_rangelock_fast_exit_writer(rl);
 
 	while ((free_lr = list_remove_head(&free_list)) != NULL)
 		zfs_rangelock_free(free_lr);
@@ -669,6 +1024,7 @@ zfs_rangelock_reduce(zfs_locked_range_t *lr, uint64_t off, uint64_t len)
 	ASSERT0(lr->lr_offset);
 	ASSERT3U(lr->lr_type, ==, RL_WRITER);
 	ASSERT(!lr->lr_proxy);
+	ASSERT3P(lr->lr_stripe, ==, NULL);
 	ASSERT3U(lr->lr_length, ==, UINT64_MAX);
 	ASSERT3U(lr->lr_count, ==, 1);
 
@@ -687,6 +1043,13 @@ EXPORT_SYMBOL(zfs_rangelock_init);
 EXPORT_SYMBOL(zfs_rangelock_fini);
 EXPORT_SYMBOL(zfs_rangelock_enter);
 EXPORT_SYMBOL(zfs_rangelock_tryenter);
+EXPORT_SYMBOL(zfs_rangelock_enter_nofast);
 EXPORT_SYMBOL(zfs_rangelock_exit);
 EXPORT_SYMBOL(zfs_rangelock_reduce);
 #endif
+
+ZFS_MODULE_PARAM(zfs, zfs_, rangelock_fast_readers, INT, ZMOD_RW,
+	"Let readers skip the range tree while there are no writers");
+
+ZFS_MODULE_PARAM(zfs, zfs_, rangelock_stripe_shift, UINT, ZMOD_RW,
+	"Log2 of the file offset region per rangelock stripe, 0 to disable");
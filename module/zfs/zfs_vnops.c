@@ -56,6 +56,7 @@
 #include <sys/dbuf.h>
 #include <sys/policy.h>
 #include <sys/zfeature.h>
+#include <sys/zap.h>
 #include <sys/zfs_vnops.h>
 #include <sys/zfs_quota.h>
 #include <sys/zfs_vfsops.h>
@@ -98,6 +99,20 @@ static int zfs_dio_enabled = 1;
  */
 static int zfs_dio_strict = 0;
 
+/*
+ * Complete eligible Direct I/O reads submitted from an asynchronous context
+ * (e.g. io_uring or AIO) from the zio done callback rather than blocking
+ * the submitting thread.
+ */
+static int zfs_dio_async = 0;
+
+/*
+ * Let Direct I/O writes which are page aligned, but not block aligned,
+ * rewrite the partial blocks at either end of the request directly
+ * through a bounce buffer instead of sending them through the ARC.
+ */
+static int zfs_dio_write_rmw = 1;
+
 
 /*
  * Maximum bytes to read per chunk in zfs_read().
@@ -108,6 +123,22 @@ static uint64_t zfs_vnops_read_chunk_size = 1024 * 1024;
 static uint64_t zfs_vnops_read_chunk_size = DMU_MAX_ACCESS / 2;
 #endif
 
+/*
+ * Number of directory entries to prefetch ahead of lookups that walk a
+ * directory in its on-disk order, as find(1) or tar(1) do.  0 disables.
+ */
+static uint_t zfs_dir_prefetch_entries = 0;
+
+/*
+ * Number of small overwrites of its first block after which a new file
+ * is considered to be updated in place, like a database file, rather than
+ * written sequentially.  When such a file outgrows its first block, the
+ * block size stops growing at the size of those overwrites instead of at
+ * the recordsize, avoiding read-modify-write of large blocks on every
+ * later update.  0 disables.
+ */
+static uint_t zfs_blksz_adaptive_writes = 0;
+
 int
 zfs_fsync(znode_t *zp, int syncflag, cred_t *cr)
 {
@@ -117,7 +148,10 @@ zfs_fsync(znode_t *zp, int syncflag, cred_t *cr)
 	if (zfsvfs->z_os->os_sync != ZFS_SYNC_DISABLED) {
 		if ((error = zfs_enter_verify_zp(zfsvfs, zp, FTAG)) != 0)
 			return (error);
+		hrtime_t start = gethrtime();
 		error = zil_commit(zfsvfs->z_log, zp->z_id);
+		dataset_kstats_update_io_histo(&zfsvfs->z_kstat,
+		    DATASET_IO_FLUSH, 0, gethrtime() - start);
 		zfs_exit(zfsvfs, FTAG);
 	}
 	return (error);
@@ -332,6 +366,7 @@ zfs_read(struct znode *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	int error = 0;
 	boolean_t frsync = B_FALSE;
 	boolean_t dio_checksum_failure = B_FALSE;
+	hrtime_t start = gethrtime();
 
 	zfsvfs_t *zfsvfs = ZTOZSB(zp);
 	if ((error = zfs_enter_verify_zp(zfsvfs, zp, FTAG)) != 0)
@@ -531,6 +566,8 @@ zfs_read(struct znode *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	int64_t nread = start_resid - n;
 
 	dataset_kstats_update_read_kstats(&zfsvfs->z_kstat, nread);
+	dataset_kstats_update_io_histo(&zfsvfs->z_kstat, DATASET_IO_READ,
+	    nread, gethrtime() - start);
 out:
 	zfs_rangelock_exit(lr);
 
@@ -548,6 +585,156 @@ out:
 	return (error);
 }
 
+typedef struct zfs_read_async {
+	znode_t			*zra_zp;
+	zfs_locked_range_t	*zra_lr;
+	zfs_uio_t		zra_uio;	/* owns the mapped pages */
+	abd_t			*zra_abd;
+	uint64_t		zra_offset;
+	uint64_t		zra_len;
+	hrtime_t		zra_start;
+	int			zra_error;
+	zfs_read_done_func_t	*zra_done;
+	void			*zra_arg;
+	taskq_ent_t		zra_tqent;
+} zfs_read_async_t;
+
+static void
+zfs_read_async_fini(zfs_read_async_t *zra)
+{
+	zfsvfs_t *zfsvfs = ZTOZSB(zra->zra_zp);
+	int error = zra->zra_error;
+	ssize_t nread = 0;
+
+	if (error == 0) {
+		nread = zra->zra_len;
+		dataset_kstats_update_read_kstats(&zfsvfs->z_kstat, nread);
+		dataset_kstats_update_io_histo(&zfsvfs->z_kstat,
+		    DATASET_IO_READ, nread, gethrtime() - zra->zra_start);
+	}
+
+	zfs_rangelock_exit(zra->zra_lr);
+	abd_free(zra->zra_abd);
+	zfs_uio_free_dio_pages(&zra->zra_uio, UIO_READ);
+
+	/* The znode may be released once the caller is notified. */
+	zra->zra_done(zra->zra_arg, error, nread);
+	kmem_free(zra, sizeof (zfs_read_async_t));
+}
+
+/*
+ * As in zfs_read(), a checksum failure on a Direct I/O read may only mean
+ * that the buffer was modified while in flight, so the read is reissued
+ * through the ARC.  This blocks, so it runs from a taskq.
+ */
+static void
+zfs_read_async_retry(void *arg)
+{
+	zfs_read_async_t *zra = arg;
+	znode_t *zp = zra->zra_zp;
+	zfsvfs_t *zfsvfs = ZTOZSB(zp);
+	int error;
+
+	if ((error = zfs_enter_verify_zp(zfsvfs, zp, FTAG)) == 0) {
+		void *buf = vmem_alloc(zra->zra_len, KM_SLEEP);
+
+		error = dmu_read(zfsvfs->z_os, zp->z_id, zra->zra_offset,
+		    zra->zra_len, buf, DMU_READ_PREFETCH | DMU_UNCACHEDIO);
+		if (error == 0)
+			abd_copy_from_buf(zra->zra_abd, buf, zra->zra_len);
+		else if (error == ECKSUM)
+			error = SET_ERROR(EIO);
+
+		vmem_free(buf, zra->zra_len);
+		zfs_exit(zfsvfs, FTAG);
+	}
+
+	zra->zra_error = error;
+	zfs_read_async_fini(zra);
+}
+
+static void
+zfs_read_async_done(void *arg, int error)
+{
+	zfs_read_async_t *zra = arg;
+
+	if (error == ECKSUM) {
+		taskq_dispatch_ent(system_taskq, zfs_read_async_retry, zra, 0,
+		    &zra->zra_tqent);
+		return;
+	}
+
+	zra->zra_error = error;
+	zfs_read_async_fini(zra);
+}
+
+/*
+ * Start a Direct I/O read that completes asynchronously.  Only page
+ * aligned requests wholly within the file, on datasets where they would
+ * be served by Direct I/O, are eligible.  Returns B_FALSE without side
+ * effects if the request must instead be passed to zfs_read().  Otherwise
+ * done(arg, error, nread) is called exactly once when the read completes,
+ * possibly before this function returns.
+ */
+boolean_t
+zfs_read_async(znode_t *zp, zfs_uio_t *uio, int ioflag,
+    zfs_read_done_func_t *done, void *arg)
+{
+	zfsvfs_t *zfsvfs = ZTOZSB(zp);
+	offset_t offset = zfs_uio_offset(uio);
+	ssize_t n = zfs_uio_resid(uio);
+	hrtime_t start = gethrtime();
+
+	if (!zfs_dio_async || n <= 0 || n > DMU_MAX_ACCESS / 2 || offset < 0)
+		return (B_FALSE);
+
+	if (zfs_enter_verify_zp(zfsvfs, zp, FTAG) != 0)
+		return (B_FALSE);
+
+	if ((zp->z_pflags & ZFS_AV_QUARANTINED) || Z_ISDIR(ZTOTYPE(zp)) ||
+	    (zfsvfs->z_log && zfsvfs->z_os->os_sync == ZFS_SYNC_ALWAYS)) {
+		zfs_exit(zfsvfs, FTAG);
+		return (B_FALSE);
+	}
+
+	zfs_locked_range_t *lr = zfs_rangelock_enter(&zp->z_rangelock,
+	    offset, n, RL_READER);
+
+	if (offset + n > zp->z_size ||
+	    zfs_setup_direct(zp, uio, UIO_READ, &ioflag) != 0 ||
+	    !(uio->uio_extflg & UIO_DIRECT)) {
+		zfs_rangelock_exit(lr);
+		zfs_exit(zfsvfs, FTAG);
+		return (B_FALSE);
+	}
+
+	zfs_read_async_t *zra = kmem_zalloc(sizeof (zfs_read_async_t),
+	    KM_SLEEP);
+	zra->zra_zp = zp;
+	zra->zra_lr = lr;
+	zra->zra_uio = *uio;
+	zra->zra_abd = abd_alloc_from_pages(uio->uio_dio.pages,
+	    offset & (PAGESIZE - 1), n);
+	zra->zra_offset = offset;
+	zra->zra_len = n;
+	zra->zra_start = start;
+	zra->zra_done = done;
+	zra->zra_arg = arg;
+	taskq_init_ent(&zra->zra_tqent);
+
+	/* The pages now belong to the asynchronous request. */
+	uio->uio_extflg &= ~UIO_DIRECT;
+
+	ZFS_ACCESSTIME_STAMP(zfsvfs, zp);
+
+	dmu_read_direct_async(sa_get_db(zp->z_sa_hdl), offset, n,
+	    zra->zra_abd, DMU_READ_PREFETCH | DMU_UNCACHEDIO | DMU_DIRECTIO,
+	    zfs_read_async_done, zra);
+
+	zfs_exit(zfsvfs, FTAG);
+	return (B_TRUE);
+}
+
 static void
 zfs_clear_setid_bits_if_necessary(zfsvfs_t *zfsvfs, znode_t *zp, cred_t *cr,
     uint64_t *clear_setid_bits_txgp, dmu_tx_t *tx)
@@ -628,6 +815,8 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	ssize_t start_resid = zfs_uio_resid(uio);
 	uint64_t clear_setid_bits_txg = 0;
 	boolean_t o_direct_defer = B_FALSE;
+	boolean_t dio_rmw = B_FALSE;
+	hrtime_t start = gethrtime();
 
 	/*
 	 * Fasttrack empty write
@@ -730,8 +919,20 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		 * Note that if the file block size will change as a result of
 		 * this write, then this range lock will lock the entire file
 		 * so that we can re-write the block safely.
+		 *
+		 * Direct I/O writes may rewrite the partial blocks at either
+		 * end of the request, so those blocks are locked in full.
 		 */
-		lr = zfs_rangelock_enter(&zp->z_rangelock, woff, n, RL_WRITER);
+		uint64_t lock_off = woff, lock_len = n;
+		if (zfs_dio_write_rmw && (uio->uio_extflg & UIO_DIRECT)) {
+			uint64_t blksz = zp->z_blksz;
+
+			lock_off = woff - woff % blksz;
+			lock_len = roundup(woff + n, blksz) - lock_off;
+			dio_rmw = B_TRUE;
+		}
+		lr = zfs_rangelock_enter(&zp->z_rangelock, lock_off, lock_len,
+		    RL_WRITER);
 	}
 
 	if (zn_rlimit_fsize_uio(zp, uio)) {
@@ -751,6 +952,17 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	if (n > limit - woff)
 		n = limit - woff;
 
+	/*
+	 * While the file is still a single block, count the small writes
+	 * over its existing data.  Concurrent writers may race on these,
+	 * but they are only a hint.
+	 */
+	if (zfs_blksz_adaptive_writes != 0 && zp->z_size <= zp->z_blksz &&
+	    woff + n <= zp->z_size && n < zp->z_blksz) {
+		zp->z_wr_inplace++;
+		zp->z_wr_maxsz = MAX(zp->z_wr_maxsz, n);
+	}
+
 	uint64_t end_size = MAX(zp->z_size, woff + n);
 	zilog_t *zilog = zfsvfs->z_log;
 	boolean_t commit = (ioflag & (O_SYNC | O_DSYNC)) ||
@@ -785,6 +997,7 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	if (uio->uio_extflg & UIO_DIRECT && lr->lr_length == UINT64_MAX) {
 		uio->uio_extflg &= ~UIO_DIRECT;
 		o_direct_defer = B_TRUE;
+		dio_rmw = B_FALSE;
 	}
 
 	/*
@@ -817,6 +1030,22 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 			} else {
 				blksz = zfsvfs->z_max_blksz;
 			}
+			if (zfs_blksz_adaptive_writes != 0 &&
+			    zp->z_wr_inplace >= zfs_blksz_adaptive_writes) {
+				/*
+				 * Updated in place: if the file outgrows its
+				 * block, use the smallest power of 2 which
+				 * fits both the overwrites and the block.
+				 */
+				uint64_t cap = MAX(MAX(zp->z_wr_maxsz,
+				    zp->z_blksz), SPA_MINBLOCKSIZE);
+				cap = 1ULL << highbit64(cap - 1);
+				if (cap < blksz && end_size > cap) {
+					blksz = cap;
+					dataset_kstats_update_blksz_kstat(
+					    &zfsvfs->z_kstat, cap);
+				}
+			}
 			blksz = MIN(blksz, P2ROUNDUP(end_size,
 			    SPA_MINBLOCKSIZE));
 			blksz = MAX(blksz, zp->z_blksz);
@@ -869,7 +1098,10 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		dmu_tx_hold_write_by_dnode(tx, DB_DNODE(db), woff, nbytes);
 		DB_DNODE_EXIT(db);
 		zfs_sa_upgrade_txholds(tx, zp);
+		hrtime_t wait = gethrtime();
 		error = dmu_tx_assign(tx, DMU_TX_WAIT);
+		dataset_kstats_update_io_histo(&zfsvfs->z_kstat,
+		    DATASET_IO_TX_WAIT, 0, gethrtime() - wait);
 		if (error) {
 			dmu_tx_abort(tx);
 			if (abuf != NULL)
@@ -898,6 +1130,8 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 			dflags |= DMU_UNCACHEDIO;
 		if (uio->uio_extflg & UIO_DIRECT)
 			dflags |= DMU_DIRECTIO;
+		if (dio_rmw)
+			dflags |= DMU_DIRECTIO_RMW;
 
 		ssize_t tx_bytes;
 		if (abuf == NULL) {
@@ -1015,11 +1249,11 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		}
 		/*
 		 * If we are replaying and eof is non zero then force
-		 * the file size to the specified eof. Note, there's no
-		 * concurrency during replay.
+		 * the file size to the specified eof. Note, replay of a
+		 * single object is never concurrent.
 		 */
-		if (zfsvfs->z_replay && zfsvfs->z_replay_eof != 0)
-			zp->z_size = zfsvfs->z_replay_eof;
+		if (zfsvfs->z_replay && zp->z_replay_eof != 0)
+			zp->z_size = zp->z_replay_eof;
 
 		error1 = sa_bulk_update(zp->z_sa_hdl, bulk, count, tx);
 		if (error1 != 0)
@@ -1090,11 +1324,33 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 
 	int64_t nwritten = start_resid - zfs_uio_resid(uio);
 	dataset_kstats_update_write_kstats(&zfsvfs->z_kstat, nwritten);
+	dataset_kstats_update_io_histo(&zfsvfs->z_kstat,
+	    commit ? DATASET_IO_SYNC_WRITE : DATASET_IO_WRITE, nwritten,
+	    gethrtime() - start);
 
 	zfs_exit(zfsvfs, FTAG);
 	return (0);
 }
 
+/*
+ * Return whether the file block is frequently read, i.e. cached in the MFU
+ * state of the ARC.  Looking the block up does not count as an access to
+ * it, so it does not make the block look any hotter than it is.
+ */
+static boolean_t
+zfs_rewrite_is_hot(dnode_t *dn, uint64_t blkid)
+{
+	blkptr_t bp;
+	int error;
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	error = dbuf_dnode_findbp(dn, 0, blkid, &bp, NULL, NULL);
+	rw_exit(&dn->dn_struct_rwlock);
+
+	return (error == 0 && !BP_IS_HOLE(&bp) &&
+	    (arc_cached(dn->dn_objset->os_spa, &bp) & ARC_CACHED_IN_MFU));
+}
+
 /*
  * Rewrite a range of file as-is without modification.
  *
@@ -1102,7 +1358,11 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
  *		off	- Offset of the range to rewrite.
  *		len	- Length of the range to rewrite.
  *		flags	- Random rewrite parameters.
- *		arg	- flags-specific argument.
+ *		arg	- Rate limit in bytes per second, or zero.
+ *
+ * With ZFS_REWRITE_HOT, only the blocks which are frequently read are
+ * rewritten, and they are moved to the special allocation class if it
+ * has room.
  *
  *	RETURN:	0 if success
  *		error code if failure
@@ -1113,7 +1373,7 @@ zfs_rewrite(znode_t *zp, uint64_t off, uint64_t len, uint64_t flags,
 {
 	int error;
 
-	if ((flags & ~ZFS_REWRITE_PHYSICAL) != 0 || arg != 0)
+	if ((flags & ~(ZFS_REWRITE_PHYSICAL | ZFS_REWRITE_HOT)) != 0)
 		return (SET_ERROR(EINVAL));
 
 	zfsvfs_t *zfsvfs = ZTOZSB(zp);
@@ -1156,6 +1416,7 @@ zfs_rewrite(znode_t *zp, uint64_t off, uint64_t len, uint64_t flags,
 	dnode_t *dn = DB_DNODE(db);
 
 	uint64_t n, noff = off, nr = 0, nw = 0;
+	hrtime_t start = gethrtime();
 	while (len > 0) {
 		/*
 		 * Rewrite only actual data, skipping any holes.  This might
@@ -1202,25 +1463,61 @@ zfs_rewrite(znode_t *zp, uint64_t off, uint64_t len, uint64_t flags,
 		}
 
 		/* Mark all dbufs within range as dirty to trigger rewrite. */
-		dmu_buf_t **dbp;
-		int numbufs;
-		error = dmu_buf_hold_array_by_dnode(dn, off, n, TRUE, FTAG,
-		    &numbufs, &dbp, DMU_READ_PREFETCH | DMU_UNCACHEDIO);
-		if (error) {
-			dmu_tx_commit(tx);
-			break;
-		}
-		for (int i = 0; i < numbufs; i++) {
-			nr += dbp[i]->db_size;
-			if (dmu_buf_is_dirty(dbp[i], tx))
-				continue;
-			nw += dbp[i]->db_size;
-			if (flags & ZFS_REWRITE_PHYSICAL)
-				dmu_buf_will_rewrite(dbp[i], tx);
-			else
-				dmu_buf_will_dirty(dbp[i], tx);
+		if (flags & ZFS_REWRITE_HOT) {
+			/*
+			 * Check and hold the blocks one at a time, so that
+			 * neither cold blocks get read, nor reading one block
+			 * makes the next one look hot.
+			 */
+			uint64_t blkid = dbuf_whichblock(dn, 0, off);
+			uint64_t end = dbuf_whichblock(dn, 0, off + n - 1);
+			for (; blkid <= end; blkid++) {
+				dmu_buf_t *dbuf;
+
+				if (!zfs_rewrite_is_hot(dn, blkid))
+					continue;
+				error = dmu_buf_hold_by_dnode(dn,
+				    blkid * dn->dn_datablksz, FTAG, &dbuf,
+				    DMU_READ_NO_PREFETCH);
+				if (error)
+					break;
+				nr += dbuf->db_size;
+				if (!dmu_buf_is_dirty(dbuf, tx)) {
+					nw += dbuf->db_size;
+					if (flags & ZFS_REWRITE_PHYSICAL)
+						dmu_buf_will_rewrite(dbuf, tx);
+					else
+						dmu_buf_will_dirty(dbuf, tx);
+					dmu_buf_will_promote(dbuf, tx);
+				}
+				dmu_buf_rele(dbuf, FTAG);
+			}
+			if (error) {
+				dmu_tx_commit(tx);
+				break;
+			}
+		} else {
+			dmu_buf_t **dbp;
+			int numbufs;
+			error = dmu_buf_hold_array_by_dnode(dn, off, n, TRUE,
+			    FTAG, &numbufs, &dbp,
+			    DMU_READ_PREFETCH | DMU_UNCACHEDIO);
+			if (error) {
+				dmu_tx_commit(tx);
+				break;
+			}
+			for (int i = 0; i < numbufs; i++) {
+				nr += dbp[i]->db_size;
+				if (dmu_buf_is_dirty(dbp[i], tx))
+					continue;
+				nw += dbp[i]->db_size;
+				if (flags & ZFS_REWRITE_PHYSICAL)
+					dmu_buf_will_rewrite(dbp[i], tx);
+				else
+					dmu_buf_will_dirty(dbp[i], tx);
+			}
+			dmu_buf_rele_array(dbp, numbufs, FTAG);
 		}
-		dmu_buf_rele_array(dbp, numbufs, FTAG);
 
 		dmu_tx_commit(tx);
 
@@ -1231,6 +1528,16 @@ zfs_rewrite(znode_t *zp, uint64_t off, uint64_t len, uint64_t flags,
 			error = SET_ERROR(EINTR);
 			break;
 		}
+
+		/*
+		 * Stay within the requested bandwidth by sleeping until the
+		 * time by which the data rewritten so far was due.
+		 */
+		if (arg != 0) {
+			hrtime_t due = start + MSEC2NSEC(nw * MILLISEC / arg);
+			if (gethrtime() < due)
+				zfs_sleep_until(due);
+		}
 	}
 
 	DB_DNODE_EXIT(db);
@@ -1708,8 +2015,8 @@ zfs_clone_range(znode_t *inzp, uint64_t *inoffp, znode_t *outzp,
 	 * Maintain predictable lock order.
 	 */
 	if (inzp < outzp || (inzp == outzp && inoff < outoff)) {
-		inlr = zfs_rangelock_enter(&inzp->z_rangelock, inoff, len,
-		    RL_READER);
+		inlr = zfs_rangelock_enter_nofast(&inzp->z_rangelock, inoff,
+		    len, RL_READER);
 		outlr = zfs_rangelock_enter(&outzp->z_rangelock, outoff, len,
 		    RL_WRITER);
 	} else {
@@ -2063,15 +2370,101 @@ zfs_clone_range_replay(znode_t *zp, uint64_t off, uint64_t len, uint64_t blksz,
 	return (error);
 }
 
+/*
+ * Walk up to n entries of directory dzp from cursor position pos, issuing
+ * dnode prefetches or, if head is set, first block prefetches for regular
+ * files.  Returns the position following the last entry visited.
+ */
+static uint64_t
+zfs_dir_prefetch_run(znode_t *dzp, uint64_t pos, uint_t n, boolean_t head)
+{
+	objset_t *os = ZTOZSB(dzp)->z_os;
+	zap_attribute_t *za = zap_attribute_long_alloc();
+	zap_cursor_t zc;
+
+	zap_cursor_init_serialized(&zc, os, dzp->z_id, pos);
+	for (; n > 0; n--) {
+		if (zap_cursor_retrieve(&zc, za) != 0)
+			break;
+		if (za->za_integer_length == 8 && za->za_num_integers > 0) {
+			uint64_t de = za->za_first_integer;
+
+			if (!head) {
+				dmu_prefetch_dnode(os, ZFS_DIRENT_OBJ(de),
+				    ZIO_PRIORITY_ASYNC_READ);
+			} else if (ZFS_DIRENT_TYPE(de) == IFTODT(S_IFREG)) {
+				dmu_prefetch_head(os, ZFS_DIRENT_OBJ(de),
+				    ZIO_PRIORITY_ASYNC_READ);
+			}
+		}
+		zap_cursor_advance(&zc);
+	}
+	pos = zap_cursor_serialize(&zc);
+	zap_cursor_fini(&zc);
+	zap_attribute_free(za);
+
+	return (pos);
+}
+
+/*
+ * Called after a successful lookup of name in dzp.  Once several lookups
+ * in a row have moved forward through the directory's cursor order, keep
+ * the dnodes of the next 2 * zfs_dir_prefetch_entries entries and the
+ * first blocks of the next zfs_dir_prefetch_entries regular files in
+ * flight.  Dnodes run further ahead so that they have arrived by the time
+ * dmu_prefetch_head() needs them to locate the data.
+ *
+ * The walk state is updated without locking; racing lookups can only
+ * make the heuristic misjudge the walk.
+ */
+void
+zfs_dir_prefetch(znode_t *dzp, const char *name)
+{
+	zfs_dir_walk_t *zw = &dzp->z_walk;
+	uint_t n = zfs_dir_prefetch_entries;
+	uint64_t pos;
+
+	if (n == 0 || zap_cursor_serialize_name(ZTOZSB(dzp)->z_os,
+	    dzp->z_id, name, &pos) != 0)
+		return;
+
+	if (pos <= zw->zw_pos ||
+	    (zw->zw_dnode != 0 && pos > zw->zw_dnode)) {
+		/* Not a walk, or one that skipped past the window. */
+		zw->zw_pos = pos;
+		zw->zw_dnode = zw->zw_data = 0;
+		zw->zw_seq = 0;
+		return;
+	}
+	zw->zw_pos = pos;
+	if (zw->zw_seq < 4) {
+		zw->zw_seq++;
+		return;
+	}
+
+	if (zw->zw_dnode <= pos)
+		zw->zw_dnode = zfs_dir_prefetch_run(dzp, pos, 2 * n, B_FALSE);
+	else if (zw->zw_dnode != -1ULL)
+		zw->zw_dnode = zfs_dir_prefetch_run(dzp, zw->zw_dnode, 1,
+		    B_FALSE);
+
+	if (zw->zw_data <= pos)
+		zw->zw_data = zfs_dir_prefetch_run(dzp, pos, n, B_TRUE);
+	else if (zw->zw_data != -1ULL)
+		zw->zw_data = zfs_dir_prefetch_run(dzp, zw->zw_data, 1, B_TRUE);
+}
+
 EXPORT_SYMBOL(zfs_access);
 EXPORT_SYMBOL(zfs_fsync);
 EXPORT_SYMBOL(zfs_holey);
 EXPORT_SYMBOL(zfs_read);
+EXPORT_SYMBOL(zfs_read_async);
 EXPORT_SYMBOL(zfs_write);
 EXPORT_SYMBOL(zfs_getsecattr);
 EXPORT_SYMBOL(zfs_setsecattr);
 EXPORT_SYMBOL(zfs_clone_range);
 EXPORT_SYMBOL(zfs_clone_range_replay);
+EXPORT_SYMBOL(zfs_dir_prefetch);
 
 ZFS_MODULE_PARAM(zfs_vnops, zfs_vnops_, read_chunk_size, U64, ZMOD_RW,
 	"Bytes to read per chunk");
@@ -2087,3 +2480,15 @@ ZFS_MODULE_PARAM(zfs, zfs_, dio_enabled, INT, ZMOD_RW,
 
 ZFS_MODULE_PARAM(zfs, zfs_, dio_strict, INT, ZMOD_RW,
 	"Return errors on misaligned Direct I/O");
+
+ZFS_MODULE_PARAM(zfs, zfs_, dio_write_rmw, INT, ZMOD_RW,
+	"Rewrite partial blocks of unaligned Direct I/O writes directly");
+
+ZFS_MODULE_PARAM(zfs, zfs_, dio_async, INT, ZMOD_RW,
+	"Complete asynchronously submitted Direct I/O reads asynchronously");
+
+ZFS_MODULE_PARAM(zfs, zfs_, dir_prefetch_entries, UINT, ZMOD_RW,
+	"Directory entries to prefetch ahead of a lookup walk");
+
+ZFS_MODULE_PARAM(zfs, zfs_, blksz_adaptive_writes, UINT, ZMOD_RW,
+	"Small overwrites after which a new file keeps a small block size");
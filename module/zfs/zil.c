@@ -105,6 +105,7 @@ static zil_kstat_values_t zil_stats = {
 	{ "zil_commit_stall_count",		KSTAT_DATA_UINT64 },
 	{ "zil_commit_suspend_count",		KSTAT_DATA_UINT64 },
 	{ "zil_commit_crash_count",		KSTAT_DATA_UINT64 },
+	{ "zil_commit_time",			KSTAT_DATA_UINT64 },
 	{ "zil_itx_count",			KSTAT_DATA_UINT64 },
 	{ "zil_itx_indirect_count",		KSTAT_DATA_UINT64 },
 	{ "zil_itx_indirect_bytes",		KSTAT_DATA_UINT64 },
@@ -130,6 +131,20 @@ static kstat_t *zil_kstats_global;
  */
 int zil_replay_disable = 0;
 
+/*
+ * Number of taskqs zil_replay_parallel() spreads the TX_WRITE and
+ * TX_TRUNCATE records of different objects over.  Records of one object
+ * always go to the same single-threaded taskq, so they stay in order.
+ * 0 or 1 replays everything in order in the calling thread.
+ */
+static uint_t zil_replay_taskqs = 4;
+
+/*
+ * Bytes of queued records after which replay waits for the taskqs to
+ * drain, to bound the memory used by queued records.
+ */
+#define	ZIL_REPLAY_QUEUE_MAX	(64 << 20)
+
 /*
  * Disable the flush commands that are normally sent to the disk(s) by the ZIL
  * after an LWB write has completed. Setting this will cause ZIL corruption on
@@ -144,9 +159,48 @@ static int zil_nocacheflush = 0;
  */
 static uint64_t zil_slog_bulk = 64 * 1024 * 1024;
 
+/*
+ * Allocate each log block on the log device following the one holding the
+ * previous block of the chain, so that the lwbs of a single busy ZIL that
+ * are in flight together are spread across all slog devices.
+ */
+static int zil_slog_stripe = 1;
+
+/*
+ * Commit the records of the file being fsync'ed ahead of the unrelated
+ * synchronous records of other files queued before it (see
+ * zil_sync_list_hoist()), so that its commit does not have to wait for
+ * those to be written out.
+ */
+static int zil_commit_per_object = 1;
+
+/*
+ * On log devices that complete writes in a few microseconds (persistent
+ * memory, NVDIMM), sleeping on the commit waiter's condition variable and
+ * being woken up again can take longer than the write itself.  If the
+ * recent lwb latency is below this many microseconds, zil_commit_waiter()
+ * polls for completion for up to that long before going to sleep.
+ */
+static uint_t zil_commit_spin_us = 0;
+
 static kmem_cache_t *zil_lwb_cache;
 static kmem_cache_t *zil_zcw_cache;
 
+/*
+ * Most itxs carry no data, or only a few hundred bytes of it, so they are
+ * allocated from their own caches in ZIL_ITX_CACHE_STEP byte size classes
+ * rather than from the zio data buffer caches, the smallest of which is
+ * SPA_MINBLOCKSIZE.  This keeps the sync write path from wasting most of
+ * every buffer, and lets freed itxs be reused straight from the per-CPU
+ * magazines of their cache.  Larger itxs, with copied write data, still
+ * come from the zio data buffer caches.
+ */
+#define	ZIL_ITX_CACHE_SHIFT	6
+#define	ZIL_ITX_CACHE_STEP	(1 << ZIL_ITX_CACHE_SHIFT)
+#define	ZIL_ITX_CACHE_MAX	1024
+#define	ZIL_ITX_CACHES		(ZIL_ITX_CACHE_MAX >> ZIL_ITX_CACHE_SHIFT)
+static kmem_cache_t *zil_itx_cache[ZIL_ITX_CACHES];
+
 static int zil_lwb_commit(zilog_t *zilog, lwb_t *lwb, itx_t *itx);
 static itx_t *zil_itx_clone(itx_t *oitx);
 static uint64_t zil_max_waste_space(zilog_t *zilog);
@@ -370,6 +424,7 @@ zil_sums_init(zil_sums_t *zs)
 	wmsum_init(&zs->zil_commit_stall_count, 0);
 	wmsum_init(&zs->zil_commit_suspend_count, 0);
 	wmsum_init(&zs->zil_commit_crash_count, 0);
+	wmsum_init(&zs->zil_commit_time, 0);
 	wmsum_init(&zs->zil_itx_count, 0);
 	wmsum_init(&zs->zil_itx_indirect_count, 0);
 	wmsum_init(&zs->zil_itx_indirect_bytes, 0);
@@ -385,6 +440,11 @@ zil_sums_init(zil_sums_t *zs)
 	wmsum_init(&zs->zil_itx_metaslab_slog_bytes, 0);
 	wmsum_init(&zs->zil_itx_metaslab_slog_write, 0);
 	wmsum_init(&zs->zil_itx_metaslab_slog_alloc, 0);
+	for (int i = 0; i < ZIL_LAT_BUCKETS; i++) {
+		wmsum_init(&zs->zil_commit_lat[i], 0);
+		wmsum_init(&zs->zil_lwb_write_lat[i], 0);
+		wmsum_init(&zs->zil_lwb_flush_lat[i], 0);
+	}
 }
 
 void
@@ -396,6 +456,7 @@ zil_sums_fini(zil_sums_t *zs)
 	wmsum_fini(&zs->zil_commit_stall_count);
 	wmsum_fini(&zs->zil_commit_suspend_count);
 	wmsum_fini(&zs->zil_commit_crash_count);
+	wmsum_fini(&zs->zil_commit_time);
 	wmsum_fini(&zs->zil_itx_count);
 	wmsum_fini(&zs->zil_itx_indirect_count);
 	wmsum_fini(&zs->zil_itx_indirect_bytes);
@@ -411,8 +472,49 @@ zil_sums_fini(zil_sums_t *zs)
 	wmsum_fini(&zs->zil_itx_metaslab_slog_bytes);
 	wmsum_fini(&zs->zil_itx_metaslab_slog_write);
 	wmsum_fini(&zs->zil_itx_metaslab_slog_alloc);
+	for (int i = 0; i < ZIL_LAT_BUCKETS; i++) {
+		wmsum_fini(&zs->zil_commit_lat[i]);
+		wmsum_fini(&zs->zil_lwb_write_lat[i]);
+		wmsum_fini(&zs->zil_lwb_flush_lat[i]);
+	}
+}
+
+/*
+ * Name the latency histogram buckets after their lower bound, e.g.
+ * "zil_commit_lat_64us" counts commits that took [64, 128) us.
+ */
+static void
+zil_kstat_lat_init(kstat_named_t *ks, const char *prefix)
+{
+	for (int i = 0; i < ZIL_LAT_BUCKETS; i++) {
+		(void) snprintf(ks[i].name, KSTAT_STRLEN, "%s_%lluus", prefix,
+		    i == 0 ? 0ULL : 1ULL << (i - 1));
+		ks[i].data_type = KSTAT_DATA_UINT64;
+	}
 }
 
+void
+zil_kstat_values_init(zil_kstat_values_t *zs)
+{
+	zil_kstat_lat_init(zs->zil_commit_lat, "zil_commit_lat");
+	zil_kstat_lat_init(zs->zil_lwb_write_lat, "zil_lwb_write_lat");
+	zil_kstat_lat_init(zs->zil_lwb_flush_lat, "zil_lwb_flush_lat");
+}
+
+/*
+ * Bucket of the zil latency histograms a delay of ns nanoseconds goes to.
+ */
+static inline int
+zil_lat_bucket(hrtime_t ns)
+{
+	uint64_t us = ns > 0 ? NSEC2USEC(ns) : 0;
+
+	return (MIN(highbit64(us), ZIL_LAT_BUCKETS - 1));
+}
+
+#define	ZIL_STAT_LAT(zil, stat, ns) \
+	ZIL_STAT_BUMP(zil, stat[zil_lat_bucket(ns)])
+
 void
 zil_kstat_values_update(zil_kstat_values_t *zs, zil_sums_t *zil_sums)
 {
@@ -428,6 +530,8 @@ zil_kstat_values_update(zil_kstat_values_t *zs, zil_sums_t *zil_sums)
 	    wmsum_value(&zil_sums->zil_commit_suspend_count);
 	zs->zil_commit_crash_count.value.ui64 =
 	    wmsum_value(&zil_sums->zil_commit_crash_count);
+	zs->zil_commit_time.value.ui64 =
+	    wmsum_value(&zil_sums->zil_commit_time);
 	zs->zil_itx_count.value.ui64 =
 	    wmsum_value(&zil_sums->zil_itx_count);
 	zs->zil_itx_indirect_count.value.ui64 =
@@ -458,6 +562,14 @@ zil_kstat_values_update(zil_kstat_values_t *zs, zil_sums_t *zil_sums)
 	    wmsum_value(&zil_sums->zil_itx_metaslab_slog_write);
 	zs->zil_itx_metaslab_slog_alloc.value.ui64 =
 	    wmsum_value(&zil_sums->zil_itx_metaslab_slog_alloc);
+	for (int i = 0; i < ZIL_LAT_BUCKETS; i++) {
+		zs->zil_commit_lat[i].value.ui64 =
+		    wmsum_value(&zil_sums->zil_commit_lat[i]);
+		zs->zil_lwb_write_lat[i].value.ui64 =
+		    wmsum_value(&zil_sums->zil_lwb_write_lat[i]);
+		zs->zil_lwb_flush_lat[i].value.ui64 =
+		    wmsum_value(&zil_sums->zil_lwb_flush_lat[i]);
+	}
 }
 
 /*
@@ -854,6 +966,7 @@ zil_alloc_lwb(zilog_t *zilog, blkptr_t *bp, int min_sz, int sz,
 	lwb->lwb_write_zio = NULL;
 	lwb->lwb_root_zio = NULL;
 	lwb->lwb_issued_timestamp = 0;
+	lwb->lwb_write_done_timestamp = 0;
 	lwb->lwb_issued_txg = 0;
 	lwb->lwb_alloc_txg = txg;
 	lwb->lwb_max_txg = 0;
@@ -1020,7 +1133,7 @@ zil_create(zilog_t *zilog)
 		}
 
 		error = zio_alloc_zil(zilog->zl_spa, zilog->zl_os, txg, &blk,
-		    ZIL_MIN_BLKSZ, ZIL_MIN_BLKSZ, &slog, B_TRUE);
+		    NULL, ZIL_MIN_BLKSZ, ZIL_MIN_BLKSZ, &slog, B_TRUE);
 		if (error == 0)
 			zil_init_log_chain(zilog, &blk);
 	}
@@ -1469,7 +1582,10 @@ zil_lwb_flush_vdevs_done(zio_t *zio)
 
 	spa_config_exit(zilog->zl_spa, SCL_STATE, lwb);
 
-	hrtime_t t = gethrtime() - lwb->lwb_issued_timestamp;
+	hrtime_t now = gethrtime();
+	hrtime_t t = now - lwb->lwb_issued_timestamp;
+	ZIL_STAT_LAT(zilog, zil_lwb_flush_lat,
+	    now - lwb->lwb_write_done_timestamp);
 
 	mutex_enter(&zilog->zl_lock);
 
@@ -1584,6 +1700,10 @@ zil_lwb_write_done(zio_t *zio)
 
 	ASSERT3S(spa_config_held(spa, SCL_STATE, RW_READER), !=, 0);
 
+	lwb->lwb_write_done_timestamp = gethrtime();
+	ZIL_STAT_LAT(zilog, zil_lwb_write_lat,
+	    lwb->lwb_write_done_timestamp - lwb->lwb_issued_timestamp);
+
 	abd_free(zio->io_abd);
 	zio_buf_free(lwb->lwb_buf, lwb->lwb_sz);
 	lwb->lwb_buf = NULL;
@@ -1987,7 +2107,13 @@ next_lwb:
 		zil_lwb_add_block(lwb, &lwb->lwb_blk);
 
 		if (lwb->lwb_flags & LWB_FLAG_SLIM) {
-			/* For Slim ZIL only write what is used. */
+			/*
+			 * For Slim ZIL only write what is used. This is the
+			 * only size reduction lwbs get: they are written
+			 * uncompressed, since the embedded checksum and
+			 * zc_nused in the zil_chain_t header must be readable
+			 * at a fixed place in the raw block.
+			 */
 			wsz = P2ROUNDUP_TYPED(lwb->lwb_nused, ZIL_MIN_BLKSZ,
 			    int);
 			ASSERT3S(wsz, <=, alloc_size);
@@ -2059,7 +2185,8 @@ next_lwb:
 		}
 
 		error = zio_alloc_zil(spa, zilog->zl_os, txg, bp,
-		    min_size, max_size, &slog, flexible);
+		    zil_slog_stripe ? &lwb->lwb_blk : NULL, min_size, max_size,
+		    &slog, flexible);
 		if (error == 0) {
 			if (closed_slim)
 				ASSERT3U(BP_GET_LSIZE(bp), ==, max_size);
@@ -2530,6 +2657,27 @@ zil_lwb_commit(zilog_t *zilog, lwb_t *lwb, itx_t *itx)
 	return (0);
 }
 
+static itx_t *
+zil_itx_alloc(size_t size)
+{
+	size_t c = (size - 1) >> ZIL_ITX_CACHE_SHIFT;
+
+	if (c < ZIL_ITX_CACHES)
+		return (kmem_cache_alloc(zil_itx_cache[c], KM_SLEEP));
+	return (zio_data_buf_alloc(size));
+}
+
+static void
+zil_itx_free(itx_t *itx, size_t size)
+{
+	size_t c = (size - 1) >> ZIL_ITX_CACHE_SHIFT;
+
+	if (c < ZIL_ITX_CACHES)
+		kmem_cache_free(zil_itx_cache[c], itx);
+	else
+		zio_data_buf_free(itx, size);
+}
+
 itx_t *
 zil_itx_create(uint64_t txtype, size_t olrsize)
 {
@@ -2541,7 +2689,7 @@ zil_itx_create(uint64_t txtype, size_t olrsize)
 	ASSERT3U(lrsize, >=, olrsize);
 	itxsize = offsetof(itx_t, itx_lr) + lrsize;
 
-	itx = zio_data_buf_alloc(itxsize);
+	itx = zil_itx_alloc(itxsize);
 	itx->itx_lr.lrc_txtype = txtype;
 	itx->itx_lr.lrc_reclen = lrsize;
 	itx->itx_lr.lrc_seq = 0;	/* defensive */
@@ -2561,7 +2709,7 @@ zil_itx_clone(itx_t *oitx)
 	ASSERT3U(oitx->itx_size, ==,
 	    offsetof(itx_t, itx_lr) + oitx->itx_lr.lrc_reclen);
 
-	itx_t *itx = zio_data_buf_alloc(oitx->itx_size);
+	itx_t *itx = zil_itx_alloc(oitx->itx_size);
 	memcpy(itx, oitx, oitx->itx_size);
 	itx->itx_callback = NULL;
 	itx->itx_callback_data = NULL;
@@ -2580,7 +2728,7 @@ zil_itx_destroy(itx_t *itx, int err)
 	if (itx->itx_callback != NULL)
 		itx->itx_callback(itx->itx_callback_data, err);
 
-	zio_data_buf_free(itx, itx->itx_size);
+	zil_itx_free(itx, itx->itx_size);
 }
 
 /*
@@ -2888,6 +3036,96 @@ zil_clean(zilog_t *zilog, uint64_t synced_txg)
 		zil_itxg_clean(clean_me);
 }
 
+/*
+ * Return the object an itx applies to if it only touches that one object,
+ * or 0 for namespace operations, which have to stay ordered against all
+ * the records around them.
+ */
+static uint64_t
+zil_itx_object(itx_t *itx)
+{
+	switch (itx->itx_lr.lrc_txtype) {
+	case TX_WRITE:
+	case TX_WRITE2:
+	case TX_TRUNCATE:
+	case TX_SETATTR:
+	case TX_ACL_V0:
+	case TX_ACL:
+	case TX_SETSAXATTR:
+	case TX_CLONE_RANGE:
+		return (LR_FOID_GET_OBJ(((lr_ooo_t *)&itx->itx_lr)->lr_foid));
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Reorder a sync list so that each commit itx of a zil_commit() for a
+ * single object is preceded only by the records it depends on: those of
+ * its own object, and everything up to the last namespace operation (or
+ * whole-objset commit) queued before it.  Records of different objects
+ * between two namespace operations are independent and replay the same
+ * in any order, so moving the committing object's records and its commit
+ * itx ahead of them lets the commit waiter complete with an earlier lwb,
+ * instead of behind a large stream of another file's sync writes.
+ */
+static void
+zil_sync_list_hoist(list_t *sync_list)
+{
+	itx_t *barrier = NULL;	/* last itx nothing can be moved across */
+	itx_t *itx, *next;
+
+	for (itx = list_head(sync_list); itx != NULL; itx = next) {
+		next = list_next(sync_list, itx);
+
+		if (itx->itx_lr.lrc_txtype != TX_COMMIT) {
+			if (zil_itx_object(itx) == 0)
+				barrier = itx;
+			continue;
+		}
+		uint64_t foid = itx->itx_oid;
+		if (foid == 0) {
+			barrier = itx;
+			continue;
+		}
+
+		/*
+		 * Move this object's records found since the barrier, then
+		 * the commit itx itself, to right after the barrier.  The
+		 * commit itx becomes the new barrier, so the next hoisted
+		 * commit goes after it and commit order is preserved.
+		 */
+		itx_t *pos = barrier;
+		itx_t *cur = (barrier == NULL) ? list_head(sync_list) :
+		    list_next(sync_list, barrier);
+		while (cur != itx) {
+			itx_t *cnext = list_next(sync_list, cur);
+			if (zil_itx_object(cur) == foid) {
+				if (pos == NULL ||
+				    list_next(sync_list, pos) != cur) {
+					list_remove(sync_list, cur);
+					if (pos == NULL)
+						list_insert_head(sync_list,
+						    cur);
+					else
+						list_insert_after(sync_list,
+						    pos, cur);
+				}
+				pos = cur;
+			}
+			cur = cnext;
+		}
+		if (pos == NULL || list_next(sync_list, pos) != itx) {
+			list_remove(sync_list, itx);
+			if (pos == NULL)
+				list_insert_head(sync_list, itx);
+			else
+				list_insert_after(sync_list, pos, itx);
+		}
+		barrier = itx;
+	}
+}
+
 /*
  * This function will traverse the queue of itxs that need to be
  * committed, and move them onto the ZIL's zl_itx_commit_list.
@@ -2940,6 +3178,8 @@ zil_get_commit_list(zilog_t *zilog)
 			if (!list_is_empty(sync_list))
 				wtxg = MAX(wtxg, txg);
 		} else {
+			if (zil_commit_per_object)
+				zil_sync_list_hoist(sync_list);
 			itx = list_head(sync_list);
 			list_move_tail(commit_list, sync_list);
 		}
@@ -3602,6 +3842,7 @@ zil_commit_waiter(zilog_t *zilog, zil_commit_waiter_t *zcw)
 	hrtime_t sleep = (zilog->zl_last_lwb_latency * pct) / 100;
 	hrtime_t wakeup = gethrtime() + sleep;
 	boolean_t timedout = B_FALSE;
+	boolean_t spun = B_FALSE;
 
 	while (!zcw->zcw_done) {
 		ASSERT(MUTEX_HELD(&zcw->zcw_lock));
@@ -3679,6 +3920,27 @@ zil_commit_waiter(zilog_t *zilog, zil_commit_waiter_t *zcw)
 			    lwb->lwb_state == LWB_STATE_ISSUED ||
 			    lwb->lwb_state == LWB_STATE_WRITE_DONE ||
 			    lwb->lwb_state == LWB_STATE_FLUSH_DONE);
+
+			/*
+			 * On a log fast enough for the lwb to be done within
+			 * zil_commit_spin_us, poll for it once instead of
+			 * paying for a sleep and wakeup.  The lwb may be freed
+			 * as soon as the waiter is done, so only look at the
+			 * waiter while spinning.
+			 */
+			hrtime_t spin = USEC2NSEC(zil_commit_spin_us);
+			if (lwb != NULL && !spun && spin != 0 &&
+			    zilog->zl_last_lwb_latency <= spin) {
+				hrtime_t end = gethrtime() + spin;
+
+				spun = B_TRUE;
+				mutex_exit(&zcw->zcw_lock);
+				while (!*(volatile boolean_t *)&zcw->zcw_done &&
+				    gethrtime() < end)
+					;
+				mutex_enter(&zcw->zcw_lock);
+				continue;
+			}
 			cv_wait(&zcw->zcw_cv, &zcw->zcw_lock);
 		}
 	}
@@ -3719,7 +3981,7 @@ zil_free_commit_waiter(zil_commit_waiter_t *zcw)
  * zil_process_commit_list() is called.
  */
 static void
-zil_commit_itx_assign(zilog_t *zilog, zil_commit_waiter_t *zcw)
+zil_commit_itx_assign(zilog_t *zilog, zil_commit_waiter_t *zcw, uint64_t foid)
 {
 	dmu_tx_t *tx = dmu_tx_create(zilog->zl_os);
 
@@ -3735,6 +3997,7 @@ zil_commit_itx_assign(zilog_t *zilog, zil_commit_waiter_t *zcw)
 	itx_t *itx = zil_itx_create(TX_COMMIT, sizeof (lr_t));
 	itx->itx_sync = B_TRUE;
 	itx->itx_private = zcw;
+	itx->itx_oid = foid;
 
 	zil_itx_assign(zilog, itx, tx);
 
@@ -4054,6 +4317,8 @@ out:
 static int
 zil_commit_impl(zilog_t *zilog, uint64_t foid)
 {
+	hrtime_t start = gethrtime();
+
 	ZIL_STAT_BUMP(zilog, zil_commit_count);
 
 	/*
@@ -4083,7 +4348,7 @@ zil_commit_impl(zilog_t *zilog, uint64_t foid)
 	 * zil_commit_waiter().
 	 */
 	zil_commit_waiter_t *zcw = zil_alloc_commit_waiter();
-	zil_commit_itx_assign(zilog, zcw);
+	zil_commit_itx_assign(zilog, zcw, foid);
 
 	uint64_t wtxg = zil_commit_writer(zilog, zcw);
 	zil_commit_waiter(zilog, zcw);
@@ -4111,6 +4376,10 @@ zil_commit_impl(zilog_t *zilog, uint64_t foid)
 
 	zil_free_commit_waiter(zcw);
 
+	hrtime_t delta = gethrtime() - start;
+	ZIL_STAT_INCR(zilog, zil_commit_time, delta);
+	ZIL_STAT_LAT(zilog, zil_commit_lat, delta);
+
 	if (err == 0)
 		return (0);
 
@@ -4248,7 +4517,18 @@ zil_init(void)
 	zil_zcw_cache = kmem_cache_create("zil_zcw_cache",
 	    sizeof (zil_commit_waiter_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 
+	for (int c = 0; c < ZIL_ITX_CACHES; c++) {
+		char name[32];
+
+		(void) snprintf(name, sizeof (name), "zil_itx_%u",
+		    (c + 1) * ZIL_ITX_CACHE_STEP);
+		zil_itx_cache[c] = kmem_cache_create(name,
+		    (c + 1) * ZIL_ITX_CACHE_STEP, sizeof (uint64_t),
+		    NULL, NULL, NULL, NULL, NULL, KMC_NODEBUG);
+	}
+
 	zil_sums_init(&zil_sums_global);
+	zil_kstat_values_init(&zil_stats);
 	zil_kstats_global = kstat_create("zfs", 0, "zil", "misc",
 	    KSTAT_TYPE_NAMED, sizeof (zil_stats) / sizeof (kstat_named_t),
 	    KSTAT_FLAG_VIRTUAL);
@@ -4264,6 +4544,8 @@ zil_init(void)
 void
 zil_fini(void)
 {
+	for (int c = 0; c < ZIL_ITX_CACHES; c++)
+		kmem_cache_destroy(zil_itx_cache[c]);
 	kmem_cache_destroy(zil_zcw_cache);
 	kmem_cache_destroy(zil_lwb_cache);
 
@@ -4661,15 +4943,26 @@ typedef struct zil_replay_arg {
 	void		*zr_arg;
 	boolean_t	zr_byteswap;
 	char		*zr_lr;
+	taskq_t		**zr_taskqs;	/* per-object taskqs, or NULL */
+	uint_t		zr_ntaskqs;
+	uint64_t	zr_queued;	/* bytes queued since last drain */
+	kmutex_t	zr_lock;	/* protects zr_error */
+	int		zr_error;	/* first error of a queued record */
 } zil_replay_arg_t;
 
-static int
-zil_replay_error(zilog_t *zilog, const lr_t *lr, int error)
+typedef struct zil_replay_task {
+	zilog_t		*zrt_zilog;
+	zil_replay_arg_t *zrt_zr;
+	size_t		zrt_size;
+	char		*zrt_lr;	/* copy of the record */
+	char		*zrt_buf;	/* scratch copy for the replay vector */
+} zil_replay_task_t;
+
+static void
+zil_replay_warn(zilog_t *zilog, const lr_t *lr, int error)
 {
 	char name[ZFS_MAX_DATASET_NAME_LEN];
 
-	zilog->zl_replaying_seq--;	/* didn't actually replay this one */
-
 	dmu_objset_name(zilog->zl_os, name);
 
 	cmn_err(CE_WARN, "ZFS replay transaction error %d, "
@@ -4677,34 +4970,29 @@ zil_replay_error(zilog_t *zilog, const lr_t *lr, int error)
 	    (u_longlong_t)lr->lrc_seq,
 	    (u_longlong_t)(lr->lrc_txtype & ~TX_CI),
 	    (lr->lrc_txtype & TX_CI) ? "CI" : "");
+}
 
+static int
+zil_replay_error(zilog_t *zilog, const lr_t *lr, int error)
+{
+	zilog->zl_replaying_seq--;	/* didn't actually replay this one */
+	zil_replay_warn(zilog, lr, error);
 	return (error);
 }
 
+/*
+ * Replay one log record, using buf (large enough for the record and its
+ * data) as the scratch copy handed to the replay vector.  Returns 0 if the
+ * record was replayed or legitimately skipped.
+ */
 static int
-zil_replay_log_record(zilog_t *zilog, const lr_t *lr, void *zra,
-    uint64_t claim_txg)
+zil_replay_record(zilog_t *zilog, zil_replay_arg_t *zr, const lr_t *lr,
+    char *buf)
 {
-	zil_replay_arg_t *zr = zra;
-	const zil_header_t *zh = zilog->zl_header;
 	uint64_t reclen = lr->lrc_reclen;
-	uint64_t txtype = lr->lrc_txtype;
+	uint64_t txtype = lr->lrc_txtype & ~TX_CI;
 	int error = 0;
 
-	zilog->zl_replaying_seq = lr->lrc_seq;
-
-	if (lr->lrc_seq <= zh->zh_replay_seq)	/* already replayed */
-		return (0);
-
-	if (lr->lrc_txg < claim_txg)		/* already committed */
-		return (0);
-
-	/* Strip case-insensitive bit, still present in log record */
-	txtype &= ~TX_CI;
-
-	if (txtype == 0 || txtype >= TX_MAX_TYPE)
-		return (zil_replay_error(zilog, lr, EINVAL));
-
 	/*
 	 * If this record type can be logged out of order, the object
 	 * (lr_foid) may no longer exist.  That's legitimate, not an error.
@@ -4719,16 +5007,16 @@ zil_replay_log_record(zilog_t *zilog, const lr_t *lr, void *zra,
 	/*
 	 * Make a copy of the data so we can revise and extend it.
 	 */
-	memcpy(zr->zr_lr, lr, reclen);
+	memcpy(buf, lr, reclen);
 
 	/*
 	 * If this is a TX_WRITE with a blkptr, suck in the data.
 	 */
 	if (txtype == TX_WRITE && reclen == sizeof (lr_write_t)) {
 		error = zil_read_log_data(zilog, (lr_write_t *)lr,
-		    zr->zr_lr + reclen);
+		    buf + reclen);
 		if (error != 0)
-			return (zil_replay_error(zilog, lr, error));
+			return (error);
 	}
 
 	/*
@@ -4739,7 +5027,7 @@ zil_replay_log_record(zilog_t *zilog, const lr_t *lr, void *zra,
 	 * the lr was byteswapped, undo it before invoking the replay vector.
 	 */
 	if (zr->zr_byteswap)
-		byteswap_uint64_array(zr->zr_lr, reclen);
+		byteswap_uint64_array(buf, reclen);
 
 	/*
 	 * We must now do two things atomically: replay this log record,
@@ -4747,7 +5035,7 @@ zil_replay_log_record(zilog_t *zilog, const lr_t *lr, void *zra,
 	 * we did so. At the end of each replay function the sequence number
 	 * is updated if we are in replay mode.
 	 */
-	error = zr->zr_replay[txtype](zr->zr_arg, zr->zr_lr, zr->zr_byteswap);
+	error = zr->zr_replay[txtype](zr->zr_arg, buf, zr->zr_byteswap);
 	if (error != 0) {
 		/*
 		 * The DMU's dnode layer doesn't see removes until the txg
@@ -4757,10 +5045,138 @@ zil_replay_log_record(zilog_t *zilog, const lr_t *lr, void *zra,
 		 * specify B_FALSE for byteswap now, so we don't do it twice.
 		 */
 		txg_wait_synced(spa_get_dsl(zilog->zl_spa), 0);
-		error = zr->zr_replay[txtype](zr->zr_arg, zr->zr_lr, B_FALSE);
+		error = zr->zr_replay[txtype](zr->zr_arg, buf, B_FALSE);
+	}
+	return (error);
+}
+
+static void
+zil_replay_task(void *arg)
+{
+	zil_replay_task_t *zrt = arg;
+	zil_replay_arg_t *zr = zrt->zrt_zr;
+	const lr_t *lr = (const lr_t *)zrt->zrt_lr;
+
+	mutex_enter(&zr->zr_lock);
+	int error = zr->zr_error;
+	mutex_exit(&zr->zr_lock);
+
+	/* Once a record failed, replay stops; don't apply any more. */
+	if (error == 0) {
+		error = zil_replay_record(zrt->zrt_zilog, zr, lr,
+		    zrt->zrt_buf);
+		if (error != 0) {
+			zil_replay_warn(zrt->zrt_zilog, lr, error);
+			mutex_enter(&zr->zr_lock);
+			if (zr->zr_error == 0)
+				zr->zr_error = error;
+			mutex_exit(&zr->zr_lock);
+		}
+	}
+
+	vmem_free(zrt, zrt->zrt_size);
+}
+
+/*
+ * Wait for all queued records to be replayed.  Returns the error of the
+ * first one that failed, if any.
+ */
+static int
+zil_replay_drain(zil_replay_arg_t *zr)
+{
+	for (uint_t i = 0; i < zr->zr_ntaskqs; i++)
+		taskq_wait(zr->zr_taskqs[i]);
+	zr->zr_queued = 0;
+	return (zr->zr_error);
+}
+
+/*
+ * Only these record types are replayed concurrently: each one touches a
+ * single object, their ZPL replay vectors only use per-object state, and
+ * replaying them again after a crash in the middle of replay is harmless.
+ * Everything else (namespace operations, setattr, ACLs, clones) is a
+ * barrier and is replayed in log order once all queued records are done.
+ */
+static boolean_t
+zil_replay_can_queue(uint64_t txtype)
+{
+	return (txtype == TX_WRITE || txtype == TX_WRITE2 ||
+	    txtype == TX_TRUNCATE);
+}
+
+static int
+zil_replay_queue(zilog_t *zilog, zil_replay_arg_t *zr, const lr_t *lr)
+{
+	uint64_t reclen = lr->lrc_reclen;
+	uint64_t datalen = 0;
+
+	if ((lr->lrc_txtype & ~TX_CI) == TX_WRITE &&
+	    reclen == sizeof (lr_write_t)) {
+		const lr_write_t *lrw = (const lr_write_t *)lr;
+		datalen = MAX(BP_GET_LSIZE(&lrw->lr_blkptr), lrw->lr_length);
+	}
+
+	size_t size = sizeof (zil_replay_task_t) + 2 * reclen + datalen;
+	zil_replay_task_t *zrt = vmem_alloc(size, KM_SLEEP);
+	zrt->zrt_zilog = zilog;
+	zrt->zrt_zr = zr;
+	zrt->zrt_size = size;
+	zrt->zrt_lr = (char *)(zrt + 1);
+	zrt->zrt_buf = zrt->zrt_lr + reclen;
+	memcpy(zrt->zrt_lr, lr, reclen);
+
+	uint64_t foid = LR_FOID_GET_OBJ(((lr_ooo_t *)lr)->lr_foid);
+	VERIFY3U(taskq_dispatch(zr->zr_taskqs[foid % zr->zr_ntaskqs],
+	    zil_replay_task, zrt, TQ_SLEEP), !=, TASKQID_INVALID);
+
+	zr->zr_queued += size;
+	if (zr->zr_queued >= ZIL_REPLAY_QUEUE_MAX)
+		return (zil_replay_drain(zr));
+	return (0);
+}
+
+static int
+zil_replay_log_record(zilog_t *zilog, const lr_t *lr, void *zra,
+    uint64_t claim_txg)
+{
+	zil_replay_arg_t *zr = zra;
+	const zil_header_t *zh = zilog->zl_header;
+	uint64_t txtype = lr->lrc_txtype;
+	int error = 0;
+
+	/* Strip case-insensitive bit, still present in log record */
+	txtype &= ~TX_CI;
+
+	/*
+	 * With parallel replay, zl_replaying_seq only moves past records
+	 * once everything before them is known to be replayed, so that
+	 * zh_replay_seq never covers a record still sitting in a taskq.
+	 */
+	if (zr->zr_taskqs != NULL) {
+		if (lr->lrc_seq <= zh->zh_replay_seq ||
+		    lr->lrc_txg < claim_txg)
+			return (0);
+		if (zil_replay_can_queue(txtype))
+			return (zil_replay_queue(zilog, zr, lr));
+		error = zil_replay_drain(zr);
 		if (error != 0)
-			return (zil_replay_error(zilog, lr, error));
+			return (error);
 	}
+
+	zilog->zl_replaying_seq = lr->lrc_seq;
+
+	if (lr->lrc_seq <= zh->zh_replay_seq)	/* already replayed */
+		return (0);
+
+	if (lr->lrc_txg < claim_txg)		/* already committed */
+		return (0);
+
+	if (txtype == 0 || txtype >= TX_MAX_TYPE)
+		return (zil_replay_error(zilog, lr, EINVAL));
+
+	error = zil_replay_record(zilog, zr, lr, zr->zr_lr);
+	if (error != 0)
+		return (zil_replay_error(zilog, lr, error));
 	return (0);
 }
 
@@ -4774,17 +5190,13 @@ zil_incr_blks(zilog_t *zilog, const blkptr_t *bp, void *arg, uint64_t claim_txg)
 	return (0);
 }
 
-/*
- * If this dataset has a non-empty intent log, replay it and destroy it.
- * Return B_TRUE if there were any entries to replay.
- */
-boolean_t
-zil_replay(objset_t *os, void *arg,
-    zil_replay_func_t *const replay_func[TX_MAX_TYPE])
+static boolean_t
+zil_replay_impl(objset_t *os, void *arg,
+    zil_replay_func_t *const replay_func[TX_MAX_TYPE], boolean_t parallel)
 {
 	zilog_t *zilog = dmu_objset_zil(os);
 	const zil_header_t *zh = zilog->zl_header;
-	zil_replay_arg_t zr;
+	zil_replay_arg_t zr = { 0 };
 
 	if ((zh->zh_flags & ZIL_REPLAY_NEEDED) == 0) {
 		return (zil_destroy(zilog, B_TRUE));
@@ -4794,6 +5206,16 @@ zil_replay(objset_t *os, void *arg,
 	zr.zr_arg = arg;
 	zr.zr_byteswap = BP_SHOULD_BYTESWAP(&zh->zh_log);
 	zr.zr_lr = vmem_alloc(2 * SPA_MAXBLOCKSIZE, KM_SLEEP);
+	mutex_init(&zr.zr_lock, NULL, MUTEX_DEFAULT, NULL);
+	if (parallel && zil_replay_taskqs > 1) {
+		zr.zr_ntaskqs = zil_replay_taskqs;
+		zr.zr_taskqs = kmem_alloc(zr.zr_ntaskqs * sizeof (taskq_t *),
+		    KM_SLEEP);
+		for (uint_t i = 0; i < zr.zr_ntaskqs; i++) {
+			zr.zr_taskqs[i] = taskq_create("z_zil_replay", 1,
+			    defclsyspri, 1, INT_MAX, 0);
+		}
+	}
 
 	/*
 	 * Wait for in-progress removes to sync before starting replay.
@@ -4802,9 +5224,17 @@ zil_replay(objset_t *os, void *arg,
 
 	zilog->zl_replay = B_TRUE;
 	zilog->zl_replay_time = ddi_get_lbolt();
+	zilog->zl_replaying_seq = zh->zh_replay_seq;
 	ASSERT0(zilog->zl_replay_blks);
 	(void) zil_parse(zilog, zil_incr_blks, zil_replay_log_record, &zr,
 	    zh->zh_claim_txg, B_TRUE);
+	if (zr.zr_taskqs != NULL) {
+		(void) zil_replay_drain(&zr);
+		for (uint_t i = 0; i < zr.zr_ntaskqs; i++)
+			taskq_destroy(zr.zr_taskqs[i]);
+		kmem_free(zr.zr_taskqs, zr.zr_ntaskqs * sizeof (taskq_t *));
+	}
+	mutex_destroy(&zr.zr_lock);
 	vmem_free(zr.zr_lr, 2 * SPA_MAXBLOCKSIZE);
 
 	zil_destroy(zilog, B_FALSE);
@@ -4814,6 +5244,30 @@ zil_replay(objset_t *os, void *arg,
 	return (B_TRUE);
 }
 
+/*
+ * If this dataset has a non-empty intent log, replay it and destroy it.
+ * Return B_TRUE if there were any entries to replay.
+ */
+boolean_t
+zil_replay(objset_t *os, void *arg,
+    zil_replay_func_t *const replay_func[TX_MAX_TYPE])
+{
+	return (zil_replay_impl(os, arg, replay_func, B_FALSE));
+}
+
+/*
+ * Same as zil_replay(), but the TX_WRITE, TX_WRITE2 and TX_TRUNCATE records
+ * of different objects between two other records may be replayed at the
+ * same time (see zil_replay_can_queue()).  The caller's replay vectors for
+ * those types must be safe to run concurrently for different objects.
+ */
+boolean_t
+zil_replay_parallel(objset_t *os, void *arg,
+    zil_replay_func_t *const replay_func[TX_MAX_TYPE])
+{
+	return (zil_replay_impl(os, arg, replay_func, B_TRUE));
+}
+
 boolean_t
 zil_replaying(zilog_t *zilog, dmu_tx_t *tx)
 {
@@ -4873,6 +5327,9 @@ EXPORT_SYMBOL(zil_kstat_values_update);
 ZFS_MODULE_PARAM(zfs, zfs_, commit_timeout_pct, UINT, ZMOD_RW,
 	"ZIL block open timeout percentage");
 
+ZFS_MODULE_PARAM(zfs_zil, zil_, replay_taskqs, UINT, ZMOD_RW,
+	"Taskqs used to replay independent objects' ZIL writes in parallel");
+
 ZFS_MODULE_PARAM(zfs_zil, zil_, replay_disable, INT, ZMOD_RW,
 	"Disable intent logging replay");
 
@@ -4882,6 +5339,15 @@ ZFS_MODULE_PARAM(zfs_zil, zil_, nocacheflush, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_zil, zil_, slog_bulk, U64, ZMOD_RW,
 	"Limit in bytes slog sync writes per commit");
 
+ZFS_MODULE_PARAM(zfs_zil, zil_, slog_stripe, INT, ZMOD_RW,
+	"Stripe consecutive log blocks of a ZIL across slog devices");
+
+ZFS_MODULE_PARAM(zfs_zil, zil_, commit_per_object, INT, ZMOD_RW,
+	"Commit a file's records ahead of unrelated queued sync records");
+
+ZFS_MODULE_PARAM(zfs_zil, zil_, commit_spin_us, UINT, ZMOD_RW,
+	"Poll for lwb completion this long on logs faster than it");
+
 ZFS_MODULE_PARAM(zfs_zil, zil_, maxblocksize, UINT, ZMOD_RW,
 	"Limit in bytes of ZIL log block size");
 
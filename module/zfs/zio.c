@@ -88,6 +88,25 @@ static uint64_t zio_buf_cache_frees[SPA_MAXBLOCKSIZE >> SPA_MINBLOCKSHIFT];
 /* Mark IOs as "slow" if they take longer than 30 seconds */
 static uint_t zio_slow_io_ms = (30 * MILLISEC);
 
+/*
+ * Record per-stage latency histograms for the zio pipeline, reported by
+ * 'zpool iostat -s'.
+ */
+int zio_stage_histo = 0;
+
+/*
+ * Trace every Nth zio into its pool's zio_trace kstat, or none if 0.  The
+ * count is kept per CPU, so that deciding not to trace is cheap.
+ */
+static uint_t zio_trace_sample = 0;
+
+typedef struct zio_trace_cpu {
+	uint64_t	ztc_count;
+} ____cacheline_aligned zio_trace_cpu_t;
+
+static kmem_cache_t *zio_trace_cache;
+static zio_trace_cpu_t *zio_trace_cpu;
+
 #define	BP_SPANB(indblkshift, level) \
 	(((uint64_t)1) << ((level) * ((indblkshift) - SPA_BLKPTRSHIFT)))
 #define	COMPARE_META_LEVEL	0x80000000ul
@@ -140,6 +159,15 @@ static uint_t zfs_sync_pass_rewrite = 2;
 int zio_exclude_metadata = 0;
 static int zio_requeue_io_start_cut_in_line = 1;
 
+/*
+ * Completions of synchronous reads up to this size cut ahead of other work
+ * queued on the read interrupt taskq.  These are mostly indirect and dnode
+ * blocks some thread is blocked on, whose checksum is verified inline by
+ * the interrupt thread, so their latency is dominated by the time spent
+ * waiting behind the completions of large prefetch and scrub reads.
+ */
+static uint_t zio_read_cut_in_line_max = 16384;
+
 #ifdef ZFS_DEBUG
 static const int zio_buf_debug_limit = 16384;
 #else
@@ -151,6 +179,9 @@ typedef struct zio_stats {
 	kstat_named_t ziostat_alloc_class_fallbacks;
 	kstat_named_t ziostat_gang_writes;
 	kstat_named_t ziostat_gang_multilevel;
+	kstat_named_t ziostat_raidz_data_bytes;
+	kstat_named_t ziostat_raidz_parity_bytes;
+	kstat_named_t ziostat_raidz_skip_bytes;
 } zio_stats_t;
 
 static zio_stats_t zio_stats = {
@@ -158,6 +189,9 @@ static zio_stats_t zio_stats = {
 	{ "alloc_class_fallbacks",	KSTAT_DATA_UINT64 },
 	{ "gang_writes",	KSTAT_DATA_UINT64 },
 	{ "gang_multilevel",	KSTAT_DATA_UINT64 },
+	{ "raidz_data_bytes",	KSTAT_DATA_UINT64 },
+	{ "raidz_parity_bytes",	KSTAT_DATA_UINT64 },
+	{ "raidz_skip_bytes",	KSTAT_DATA_UINT64 },
 };
 
 struct {
@@ -165,6 +199,9 @@ struct {
 	wmsum_t ziostat_alloc_class_fallbacks;
 	wmsum_t ziostat_gang_writes;
 	wmsum_t ziostat_gang_multilevel;
+	wmsum_t ziostat_raidz_data_bytes;
+	wmsum_t ziostat_raidz_parity_bytes;
+	wmsum_t ziostat_raidz_skip_bytes;
 } ziostat_sums;
 
 #define	ZIOSTAT_BUMP(stat)	wmsum_add(&ziostat_sums.stat, 1);
@@ -190,9 +227,30 @@ zio_kstats_update(kstat_t *ksp, int rw)
 	    wmsum_value(&ziostat_sums.ziostat_gang_writes);
 	zs->ziostat_gang_multilevel.value.ui64 =
 	    wmsum_value(&ziostat_sums.ziostat_gang_multilevel);
+	zs->ziostat_raidz_data_bytes.value.ui64 =
+	    wmsum_value(&ziostat_sums.ziostat_raidz_data_bytes);
+	zs->ziostat_raidz_parity_bytes.value.ui64 =
+	    wmsum_value(&ziostat_sums.ziostat_raidz_parity_bytes);
+	zs->ziostat_raidz_skip_bytes.value.ui64 =
+	    wmsum_value(&ziostat_sums.ziostat_raidz_skip_bytes);
 	return (0);
 }
 
+/*
+ * Account for a block written to a RAID-Z vdev: its data, the parity
+ * written for it, and the skip sectors allocated to pad it to a multiple
+ * of nparity + 1 sectors.  Small blocks can spend more on parity and
+ * padding than on data; comparing these shows how much, e.g. to decide
+ * whether small blocks belong on a special vdev.
+ */
+void
+zio_stats_raidz_write(uint64_t data, uint64_t parity, uint64_t skip)
+{
+	wmsum_add(&ziostat_sums.ziostat_raidz_data_bytes, data);
+	wmsum_add(&ziostat_sums.ziostat_raidz_parity_bytes, parity);
+	wmsum_add(&ziostat_sums.ziostat_raidz_skip_bytes, skip);
+}
+
 void
 zio_init(void)
 {
@@ -202,11 +260,18 @@ zio_init(void)
 	    sizeof (zio_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 	zio_link_cache = kmem_cache_create("zio_link_cache",
 	    sizeof (zio_link_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	zio_trace_cache = kmem_cache_create("zio_trace_cache",
+	    sizeof (zio_trace_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	zio_trace_cpu = kmem_zalloc(boot_ncpus * sizeof (zio_trace_cpu_t),
+	    KM_SLEEP);
 
 	wmsum_init(&ziostat_sums.ziostat_total_allocations, 0);
 	wmsum_init(&ziostat_sums.ziostat_alloc_class_fallbacks, 0);
 	wmsum_init(&ziostat_sums.ziostat_gang_writes, 0);
 	wmsum_init(&ziostat_sums.ziostat_gang_multilevel, 0);
+	wmsum_init(&ziostat_sums.ziostat_raidz_data_bytes, 0);
+	wmsum_init(&ziostat_sums.ziostat_raidz_parity_bytes, 0);
+	wmsum_init(&ziostat_sums.ziostat_raidz_skip_bytes, 0);
 	zio_ksp = kstat_create("zfs", 0, "zio_stats",
 	    "misc", KSTAT_TYPE_NAMED, sizeof (zio_stats) /
 	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
@@ -352,7 +417,12 @@ zio_fini(void)
 	wmsum_fini(&ziostat_sums.ziostat_alloc_class_fallbacks);
 	wmsum_fini(&ziostat_sums.ziostat_gang_writes);
 	wmsum_fini(&ziostat_sums.ziostat_gang_multilevel);
+	wmsum_fini(&ziostat_sums.ziostat_raidz_data_bytes);
+	wmsum_fini(&ziostat_sums.ziostat_raidz_parity_bytes);
+	wmsum_fini(&ziostat_sums.ziostat_raidz_skip_bytes);
 
+	kmem_free(zio_trace_cpu, boot_ncpus * sizeof (zio_trace_cpu_t));
+	kmem_cache_destroy(zio_trace_cache);
 	kmem_cache_destroy(zio_link_cache);
 	kmem_cache_destroy(zio_cache);
 
@@ -939,6 +1009,77 @@ zio_bookmark_compare(const void *x1, const void *x2)
 	return (0);
 }
 
+/*
+ * ==========================================================================
+ * Sampled zio traces
+ * ==========================================================================
+ */
+static void
+zio_trace_init(zio_t *zio)
+{
+	uint_t sample = zio_trace_sample;
+
+	if (sample == 0)
+		return;
+
+	zio_trace_cpu_t *ztc = &zio_trace_cpu[CPU_SEQID_UNSTABLE % boot_ncpus];
+	if (atomic_inc_64_nv(&ztc->ztc_count) % sample != 0)
+		return;
+
+	zio_trace_t *zt = kmem_cache_alloc(zio_trace_cache, KM_NOSLEEP);
+	if (zt == NULL)
+		return;
+	memset(zt, 0, sizeof (zio_trace_t));
+	zt->zt_start = gethrtime();
+	zio->io_trace = zt;
+}
+
+static void
+zio_trace_stage(zio_t *zio, enum zio_stage stage)
+{
+	zio_trace_t *zt = zio->io_trace;
+
+	zt->zt_stage[highbit64(stage) - 1] = gethrtime() - zt->zt_start;
+	if (stage == ZIO_STAGE_VDEV_IO_START && zio->io_vd != NULL &&
+	    zio->io_vd->vdev_ops->vdev_op_leaf)
+		zt->zt_guid = zio->io_vd->vdev_guid;
+}
+
+/*
+ * Hand the trace of a completed zio over to its pool.  The trace is
+ * dropped if the zio never got to the DONE stage.
+ */
+static void
+zio_trace_done(zio_t *zio)
+{
+	zio_trace_t *zt = zio->io_trace;
+
+	zio->io_trace = NULL;
+	if (zt->zt_stage[ZIO_STAGES - 1] == 0) {
+		zio_trace_free(zt);
+		return;
+	}
+
+	zt->zt_txg = zio->io_txg;
+	zt->zt_objset = zio->io_bookmark.zb_objset;
+	zt->zt_object = zio->io_bookmark.zb_object;
+	zt->zt_size = zio->io_size;
+	if (zio->io_delta != 0 && zio->io_delay != 0) {
+		zt->zt_queued = zio->io_delta - zio->io_delay;
+		zt->zt_device = zio->io_delay;
+	}
+	zt->zt_type = zio->io_type;
+	zt->zt_priority = zio->io_priority;
+	zt->zt_error = zio->io_error;
+	spa_zio_trace_add(zio->io_spa, zt);
+}
+
+void
+zio_trace_free(zio_trace_t *zt)
+{
+	kmem_cache_free(zio_trace_cache, zt);
+}
+
 /*
  * ==========================================================================
  * Create the various types of I/O (read, write, free, etc)
@@ -1030,6 +1171,7 @@ zio_create(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 
 	if (pio != NULL) {
 		zio->io_metaslab_class = pio->io_metaslab_class;
+		zio->io_deadline = pio->io_deadline;
 		if (zio->io_logical == NULL)
 			zio->io_logical = pio->io_logical;
 		if (zio->io_child_type == ZIO_CHILD_GANG)
@@ -1038,6 +1180,7 @@ zio_create(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	}
 
 	taskq_init_ent(&zio->io_tqent);
+	zio_trace_init(zio);
 
 	return (zio);
 }
@@ -1045,6 +1188,8 @@ zio_create(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 void
 zio_destroy(zio_t *zio)
 {
+	if (zio->io_trace != NULL)
+		zio_trace_done(zio);
 	metaslab_trace_fini(&zio->io_alloc_list);
 	list_destroy(&zio->io_parent_list);
 	list_destroy(&zio->io_child_list);
@@ -1481,7 +1626,10 @@ zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 		 * GANG, DEDUP and BRT blocks can induce a read (for the gang
 		 * block header, the DDT or the BRT), so issue them
 		 * asynchronously so that this thread is not tied up.
+		 * Start the BRT read now so it is in flight by the time
+		 * zio_brt_free() needs it.
 		 */
+		brt_prefetch_free(spa, bp);
 		enum zio_stage stage =
 		    ZIO_FREE_PIPELINE | ZIO_STAGE_ISSUE_ASYNC;
 
@@ -1982,6 +2130,10 @@ zio_write_compress(zio_t *zio)
 			    zio_get_compression_max_size(compress,
 			    spa->spa_gcd_alloc, spa->spa_min_alloc, lsize),
 			    zp->zp_complevel);
+		if (zp->zp_complevel_auto && psize != 0) {
+			spa_zstd_auto_add(spa, zp->zp_complevel, lsize,
+			    MIN(psize, lsize));
+		}
 		if (psize == 0) {
 			compress = ZIO_COMPRESS_OFF;
 		} else if (psize >= lsize) {
@@ -2180,6 +2332,11 @@ zio_taskq_dispatch(zio_t *zio, zio_taskq_type_t q, boolean_t cutinline)
 			cutinline = B_TRUE;
 	}
 
+	if (q == ZIO_TASKQ_INTERRUPT && t == ZIO_TYPE_READ &&
+	    zio->io_priority == ZIO_PRIORITY_SYNC_READ &&
+	    zio->io_size <= zio_read_cut_in_line_max)
+		cutinline = B_TRUE;
+
 	ASSERT3U(q, <, ZIO_TASKQ_TYPES);
 
 	spa_taskq_dispatch(spa, t, q, zio_execute, zio, cutinline);
@@ -2319,7 +2476,8 @@ zio_deadman_impl(zio_t *pio, int ziodepth)
 	    list_is_empty(&pio->io_child_list) &&
 	    failmode == ZIO_FAILURE_MODE_CONTINUE &&
 	    taskq_empty_ent(&pio->io_tqent) &&
-	    pio->io_queue_state == ZIO_QS_ACTIVE) {
+	    (pio->io_queue_state == ZIO_QS_ACTIVE ||
+	    pio->io_queue_state == ZIO_QS_FAST)) {
 		pio->io_error = EINTR;
 		zio_interrupt(pio);
 	}
@@ -2422,6 +2580,40 @@ zio_execute_stack_check(zio_t *zio)
 	return (B_FALSE);
 }
 
+/*
+ * Charge "delta" nanoseconds spent in pipeline stage "sh" to the leaf vdev
+ * which performed it, or to the pool as a whole for logical I/O.
+ */
+void
+zio_stage_histo_add(spa_t *spa, vdev_t *vd, zio_stage_histo_t sh,
+    hrtime_t delta)
+{
+	uint64_t *histo;
+
+	if (vd != NULL && vd->vdev_ops->vdev_op_leaf)
+		histo = vd->vdev_stat_ex.vsx_stage_histo[sh];
+	else
+		histo = spa->spa_stage_histo[sh];
+
+	atomic_inc_64(&histo[L_HISTO(delta)]);
+}
+
+static zio_stage_histo_t
+zio_stage_to_histo(enum zio_stage stage)
+{
+	switch (stage) {
+	case ZIO_STAGE_WRITE_COMPRESS:
+		return (ZIO_SH_COMPRESS);
+	case ZIO_STAGE_CHECKSUM_GENERATE:
+		return (ZIO_SH_CHECKSUM_GENERATE);
+	case ZIO_STAGE_DVA_ALLOCATE:
+		return (ZIO_SH_DVA_ALLOCATE);
+	default:
+		ASSERT3U(stage, ==, ZIO_STAGE_CHECKSUM_VERIFY);
+		return (ZIO_SH_CHECKSUM_VERIFY);
+	}
+}
+
 __attribute__((always_inline))
 static inline void
 __zio_execute(zio_t *zio)
@@ -2474,13 +2666,29 @@ __zio_execute(zio_t *zio)
 
 		zio->io_stage = stage;
 		zio->io_pipeline_trace |= zio->io_stage;
+		if (zio->io_trace != NULL)
+			zio_trace_stage(zio, stage);
 
 		/*
 		 * The zio pipeline stage returns the next zio to execute
 		 * (typically the same as this one), or NULL if we should
 		 * stop.
 		 */
-		zio = zio_pipeline[highbit64(stage) - 1](zio);
+		if (zio_stage_histo && (stage & ZIO_TIMED_STAGES)) {
+			/*
+			 * The zio may already be gone once a stage returns,
+			 * so take what we need to charge the time up front.
+			 */
+			spa_t *spa = zio->io_spa;
+			vdev_t *vd = zio->io_vd;
+			hrtime_t start = gethrtime();
+
+			zio = zio_pipeline[highbit64(stage) - 1](zio);
+			zio_stage_histo_add(spa, vd, zio_stage_to_histo(stage),
+			    gethrtime() - start);
+		} else {
+			zio = zio_pipeline[highbit64(stage) - 1](zio);
+		}
 
 		if (zio == NULL)
 			return;
@@ -3254,6 +3462,8 @@ zio_write_gang_block(zio_t *pio, metaslab_class_t *mc)
 		zp.zp_encrypt = gio->io_prop.zp_encrypt;
 		zp.zp_byteorder = gio->io_prop.zp_byteorder;
 		zp.zp_direct_write = B_FALSE;
+		zp.zp_complevel_auto = B_FALSE;
+		zp.zp_fused_cksum = B_FALSE;
 		memset(zp.zp_salt, 0, ZIO_DATA_SALT_LEN);
 		memset(zp.zp_iv, 0, ZIO_DATA_IV_LEN);
 		memset(zp.zp_mac, 0, ZIO_DATA_MAC_LEN);
@@ -3789,7 +3999,14 @@ zio_ddt_write(zio_t *zio)
 	 */
 	ASSERT3B(zio->io_prop.zp_direct_write, ==, B_FALSE);
 
+	/*
+	 * Writes that pile up behind the DDT lock have their entries
+	 * prefetched together by the first one through.
+	 */
+	ddt_prefetch_queue(ddt, bp);
 	ddt_enter(ddt);
+	ddt_prefetch_issue(ddt, bp);
+
 	/*
 	 * Search DDT for matching entry.  Skip DVAs verification here, since
 	 * they can go only from override, and once we get here the override
@@ -4434,8 +4651,8 @@ zio_dva_unallocate(zio_t *zio, zio_gang_node_t *gn, blkptr_t *bp)
  */
 int
 zio_alloc_zil(spa_t *spa, objset_t *os, uint64_t txg, blkptr_t *new_bp,
-    uint64_t min_size, uint64_t max_size, boolean_t *slog,
-    boolean_t allow_larger)
+    const blkptr_t *prev_bp, uint64_t min_size, uint64_t max_size,
+    boolean_t *slog, boolean_t allow_larger)
 {
 	int error;
 	zio_alloc_list_t io_alloc_list;
@@ -4458,17 +4675,31 @@ zio_alloc_zil(spa_t *spa, objset_t *os, uint64_t txg, blkptr_t *new_bp,
 	 * When allocating a zil block, we don't have information about
 	 * the final destination of the block except the objset it's part
 	 * of, so we just hash the objset ID to pick the allocator to get
-	 * some parallelism.
+	 * some parallelism.  With allocator affinity the allocator of the
+	 * issuing CPU is used instead.
 	 */
 	int flags = METASLAB_ZIL;
-	int allocator = (uint_t)cityhash1(os->os_dsl_dataset->ds_object)
-	    % spa->spa_alloc_count;
+	int allocator = spa_affinity_allocator(spa);
+	if (allocator < 0) {
+		allocator = (uint_t)cityhash1(os->os_dsl_dataset->ds_object)
+		    % spa->spa_alloc_count;
+	}
 	ZIOSTAT_BUMP(ziostat_total_allocations);
 
-	/* Try log class (dedicated slog devices) first */
-	error = metaslab_alloc_range(spa, spa_log_class(spa), min_size,
-	    max_size, new_bp, 1, txg, NULL, flags, &io_alloc_list, allocator,
-	    NULL, &alloc_size);
+	/*
+	 * Try log class (dedicated slog devices) first.  If the caller passed
+	 * the previous block of the log chain, start on the log device after
+	 * it, so that the blocks of a chain in flight stripe across all slogs.
+	 */
+	if (prev_bp != NULL && !BP_IS_HOLE(prev_bp) && !BP_IS_EMBEDDED(prev_bp))
+		error = metaslab_alloc_range(spa, spa_log_class(spa), min_size,
+		    max_size, new_bp, 1, txg, prev_bp,
+		    flags | METASLAB_HINT_NEXT, &io_alloc_list, allocator,
+		    NULL, &alloc_size);
+	else
+		error = metaslab_alloc_range(spa, spa_log_class(spa), min_size,
+		    max_size, new_bp, 1, txg, NULL, flags, &io_alloc_list,
+		    allocator, NULL, &alloc_size);
 	*slog = (error == 0);
 
 	/* Try special_embedded_log class (reserved on special vdevs) */
@@ -5095,6 +5326,100 @@ zio_encrypt(zio_t *zio)
 	return (zio);
 }
 
+/*
+ * ==========================================================================
+ * Offload pipeline work to an accelerator
+ * ==========================================================================
+ */
+static const zio_offload_ops_t *zio_offload_ops = NULL;
+
+void
+zio_offload_register(const zio_offload_ops_t *ops)
+{
+	ASSERT0P(zio_offload_ops);
+	zio_offload_ops = ops;
+}
+
+void
+zio_offload_unregister(const zio_offload_ops_t *ops)
+{
+	ASSERT3P(zio_offload_ops, ==, ops);
+	zio_offload_ops = NULL;
+}
+
+/*
+ * Called by the provider once an offloaded request has completed.  This
+ * only requeues the zio, so it is safe from interrupt context.
+ */
+void
+zio_offload_done(zio_offload_req_t *zor)
+{
+	zio_taskq_dispatch(zor->zor_zio, ZIO_TASKQ_ISSUE, B_FALSE);
+}
+
+/*
+ * Try to hand the checksum of a regular block to the offload provider.
+ * Returns B_TRUE if the provider took it; the zio must then stop until
+ * zio_offload_done() requeues it, after which this stage runs again.
+ * Embedded, salted and encrypted checksums are always computed here.
+ */
+static boolean_t
+zio_checksum_offload_start(zio_t *zio, enum zio_checksum checksum)
+{
+	const zio_offload_ops_t *ops = zio_offload_ops;
+	zio_checksum_info_t *ci = &zio_checksum_table[checksum];
+	blkptr_t *bp = zio->io_bp;
+	zio_offload_req_t *zor;
+
+	if (ops == NULL || bp == NULL || BP_USES_CRYPT(bp) ||
+	    (ci->ci_flags & ZCHECKSUM_FLAG_EMBEDDED) ||
+	    ci->ci_tmpl_init != NULL)
+		return (B_FALSE);
+
+	zor = kmem_zalloc(sizeof (zio_offload_req_t), KM_SLEEP);
+	zor->zor_zio = zio;
+	zor->zor_ops = ops;
+	zio->io_offload = zor;
+
+	/*
+	 * The request may complete and requeue the zio before the start
+	 * function even returns, so set up re-execution of this stage first.
+	 */
+	zio->io_stage >>= 1;
+	if (ops->zoo_checksum_start(zor, checksum, zio->io_abd,
+	    zio->io_size) != 0) {
+		zio->io_stage <<= 1;
+		zio->io_offload = NULL;
+		kmem_free(zor, sizeof (zio_offload_req_t));
+		return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Collect the result of an offloaded checksum.  Returns B_FALSE if the
+ * provider failed, in which case the checksum must be computed here.
+ */
+static boolean_t
+zio_checksum_offload_fini(zio_t *zio)
+{
+	zio_offload_req_t *zor = zio->io_offload;
+	zio_cksum_t cksum;
+	int error;
+
+	error = zor->zor_ops->zoo_checksum_fini(zor, zio->io_abd,
+	    zio->io_size, &cksum);
+	zio->io_offload = NULL;
+	kmem_free(zor, sizeof (zio_offload_req_t));
+
+	if (error != 0)
+		return (B_FALSE);
+
+	zio->io_bp->blk_cksum = cksum;
+	return (B_TRUE);
+}
+
 /*
  * ==========================================================================
  * Generate and verify checksums
@@ -5105,6 +5430,14 @@ zio_checksum_generate(zio_t *zio)
 {
 	blkptr_t *bp = zio->io_bp;
 	enum zio_checksum checksum;
+	boolean_t offload = B_TRUE;
+
+	/* We're back from zio_checksum_offload_start(). */
+	if (zio->io_offload != NULL) {
+		if (zio_checksum_offload_fini(zio))
+			return (zio);
+		offload = B_FALSE;
+	}
 
 	if (bp == NULL) {
 		/*
@@ -5124,8 +5457,24 @@ zio_checksum_generate(zio_t *zio)
 		} else {
 			checksum = BP_GET_CHECKSUM(bp);
 		}
+
+		/*
+		 * The data was checksummed as it was copied into the dbuf;
+		 * use that if the block is being written out unchanged.
+		 */
+		if (zio->io_prop.zp_fused_cksum &&
+		    checksum == ZIO_CHECKSUM_FLETCHER_4 && !BP_USES_CRYPT(bp) &&
+		    zio->io_child_type == ZIO_CHILD_LOGICAL &&
+		    zio->io_transform_stack == NULL &&
+		    zio->io_size == zio->io_lsize) {
+			bp->blk_cksum = zio->io_prop.zp_cksum;
+			return (zio);
+		}
 	}
 
+	if (offload && zio_checksum_offload_start(zio, checksum))
+		return (NULL);
+
 	zio_checksum_compute(zio, checksum, zio->io_abd, zio->io_size);
 
 	return (zio);
@@ -5983,6 +6332,15 @@ ZFS_MODULE_PARAM(zfs_zio, zio_, slow_io_ms, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_zio, zio_, requeue_io_start_cut_in_line, INT, ZMOD_RW,
 	"Prioritize requeued I/O");
 
+ZFS_MODULE_PARAM(zfs_zio, zio_, read_cut_in_line_max, UINT, ZMOD_RW,
+	"Max size of sync reads whose completion cuts in line");
+
+ZFS_MODULE_PARAM(zfs_zio, zio_, stage_histo, INT, ZMOD_RW,
+	"Record per-stage zio pipeline latency histograms");
+
+ZFS_MODULE_PARAM(zfs_zio, zio_, trace_sample, UINT, ZMOD_RW,
+	"Trace the pipeline stages of every Nth zio, 0 to disable");
+
 ZFS_MODULE_PARAM(zfs, zfs_, sync_pass_deferred_free,  UINT, ZMOD_RW,
 	"Defer frees starting in this pass");
 
@@ -32,11 +32,22 @@
 
 #include <sys/zfs_context.h>
 #include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/dsl_pool.h>
+#include <sys/txg.h>
 #include <sys/zfeature.h>
 #include <sys/zio.h>
 #include <sys/zio_compress.h>
 #include <sys/zstd/zstd.h>
 
+/*
+ * Bounds for the level chosen by compression=zstd-auto.  The highest level
+ * is used while the pool has write headroom, backing off towards the lowest
+ * level as dirty data accumulates.
+ */
+static uint_t zfs_zstd_auto_min = ZIO_ZSTD_LEVEL_1;
+static uint_t zfs_zstd_auto_max = ZIO_ZSTD_LEVEL_9;
+
 /*
  * Compression vectors.
  */
@@ -77,7 +88,6 @@ uint8_t
 zio_complevel_select(spa_t *spa, enum zio_compress compress, uint8_t child,
     uint8_t parent)
 {
-	(void) spa;
 	uint8_t result;
 
 	if (!ZIO_COMPRESS_HASLEVEL(compress))
@@ -87,9 +97,54 @@ zio_complevel_select(spa_t *spa, enum zio_compress compress, uint8_t child,
 	if (result == ZIO_COMPLEVEL_INHERIT)
 		result = parent;
 
+	if (compress == ZIO_COMPRESS_ZSTD && result == ZIO_ZSTD_LEVEL_AUTO)
+		result = spa->spa_zstd_auto_level;
+
 	return (result);
 }
 
+/*
+ * Pick the zstd level used by compression=zstd-auto for the txg about to be
+ * synced.  The level scales linearly with the amount of dirty data, using the
+ * same thresholds that ramp up the async write queue depth (see the comment
+ * in vdev_queue.c): below zfs_vdev_async_write_active_min_dirty_percent the
+ * pool has headroom and zfs_zstd_auto_max is used, above
+ * zfs_vdev_async_write_active_max_dirty_percent writers are about to be
+ * throttled and zfs_zstd_auto_min is used.  If the previous txg took longer
+ * than zfs_txg_timeout to sync, compression is already holding up the sync
+ * pipeline, so fall back to the minimum level regardless of dirty data.
+ */
+void
+zio_complevel_auto_update(spa_t *spa)
+{
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	uint64_t min_level, max_level, min_bytes, max_bytes, dirty;
+	uint8_t level;
+
+	min_level = MIN(MAX(zfs_zstd_auto_min, ZIO_ZSTD_LEVEL_MIN),
+	    ZIO_ZSTD_LEVEL_MAX);
+	max_level = MIN(MAX(zfs_zstd_auto_max, min_level), ZIO_ZSTD_LEVEL_MAX);
+
+	min_bytes = zfs_dirty_data_max *
+	    zfs_vdev_async_write_active_min_dirty_percent / 100;
+	max_bytes = zfs_dirty_data_max *
+	    zfs_vdev_async_write_active_max_dirty_percent / 100;
+	dirty = dp->dp_dirty_total;
+
+	if (spa->spa_sync_lasttime > SEC2NSEC(zfs_txg_timeout) ||
+	    dirty > max_bytes) {
+		level = min_level;
+	} else if (dirty < min_bytes || max_bytes <= min_bytes) {
+		level = max_level;
+	} else {
+		level = max_level - (dirty - min_bytes) *
+		    (max_level - min_level) / (max_bytes - min_bytes);
+	}
+
+	spa->spa_zstd_auto_level = level;
+	spa_zstd_auto_set_level(spa, level);
+}
+
 enum zio_compress
 zio_compress_select(spa_t *spa, enum zio_compress child,
     enum zio_compress parent)
@@ -179,3 +234,295 @@ zio_compress_to_feature(enum zio_compress comp)
 	}
 	return (SPA_FEATURE_NONE);
 }
+
+/*
+ * Compression benchmark, published as the "compress_bench" kstat.
+ *
+ * Every algorithm in zio_compress_table, plus a spread of zstd levels, is
+ * timed compressing and decompressing a ZIO_COMPRESS_BENCH_SIZE buffer of
+ * semi-compressible data: dictionary words interleaved with runs of random
+ * bytes, which lands at a ratio typical of text and binary file mixes rather
+ * than the extremes of all-zeroes or incompressible data.  The results are
+ * host specific, and the full run takes a noticeable fraction of a second,
+ * so it happens on the first read of the kstat or an explicit
+ * zio_compress_bench_run() rather than at module load.
+ *
+ * Each row lists compression and decompression throughput in MiB/s and the
+ * ratio of uncompressed to compressed size.  Decompression is reported as 0
+ * when the data did not compress.
+ */
+#define	ZIO_COMPRESS_BENCH_SIZE		SPA_OLD_MAXBLOCKSIZE
+#define	ZIO_COMPRESS_BENCH_MIN_NS	MSEC2NSEC(5)
+
+typedef struct zio_compress_bench_stat {
+	const char		*zcs_name;
+	enum zio_compress	zcs_compress;
+	uint8_t			zcs_level;
+	zio_compress_bench_t	zcs_bench;
+} zio_compress_bench_stat_t;
+
+static const struct {
+	uint8_t		level;
+	const char	*name;
+} zio_compress_bench_zstd_levels[] = {
+	{ ZIO_ZSTD_LEVEL_FAST_10,	"zstd-fast-10" },
+	{ ZIO_ZSTD_LEVEL_FAST_1,	"zstd-fast-1" },
+	{ ZIO_ZSTD_LEVEL_1,		"zstd-1" },
+	{ ZIO_ZSTD_LEVEL_3,		"zstd-3" },
+	{ ZIO_ZSTD_LEVEL_6,		"zstd-6" },
+	{ ZIO_ZSTD_LEVEL_9,		"zstd-9" },
+	{ ZIO_ZSTD_LEVEL_12,		"zstd-12" },
+	{ ZIO_ZSTD_LEVEL_15,		"zstd-15" },
+	{ ZIO_ZSTD_LEVEL_19,		"zstd-19" },
+};
+
+static kmutex_t zio_compress_bench_lock;
+static zio_compress_bench_stat_t *zio_compress_bench_data = NULL;
+static int zio_compress_bench_cnt = 0;
+static boolean_t zio_compress_bench_done = B_FALSE;
+static kstat_t *zio_compress_bench_kstat = NULL;
+
+/*
+ * Fill the buffer with a deterministic mix of short words and random bytes.
+ */
+static void
+zio_compress_bench_fill(uint8_t *buf, size_t size)
+{
+	static const char *const words[] = {
+		"zfs", "pool", "dataset", "snapshot", "block", "the", "of",
+		"and", "0000", "ffff", "\n", "\t", "error", "return", "value",
+		"size", "offset", "{", "}", "=", "struct", "uint64_t",
+	};
+	uint64_t x = 0x9e3779b97f4a7c15ULL;
+	size_t off = 0;
+
+	while (off < size) {
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		if ((x >> 61) == 0) {
+			for (int i = 0; i < 8 && off < size; i++)
+				buf[off++] = (uint8_t)(x >> (8 * i));
+		} else {
+			const char *w = words[(x >> 32) % ARRAY_SIZE(words)];
+			while (*w != '\0' && off < size)
+				buf[off++] = *w++;
+			if (off < size)
+				buf[off++] = ' ';
+		}
+	}
+}
+
+static void
+zio_compress_bench_one(zio_compress_bench_stat_t *zcs, abd_t *src,
+    abd_t *dst, abd_t *out)
+{
+	zio_compress_bench_t *zcb = &zcs->zcs_bench;
+	const size_t size = ZIO_COMPRESS_BENCH_SIZE;
+	uint64_t count;
+	hrtime_t start, ns;
+	size_t c_len = size;
+
+	count = 0;
+	start = gethrtime();
+	do {
+		c_len = zio_compress_data(zcs->zcs_compress, src, &dst, size,
+		    size, zcs->zcs_level);
+		count++;
+		ns = gethrtime() - start;
+	} while (ns < ZIO_COMPRESS_BENCH_MIN_NS);
+	zcb->zcb_compress_bw = size * count * NANOSEC / MAX(ns, 1) /
+	    1024 / 1024;
+	zcb->zcb_ratio = size * 100 / c_len;
+
+	/* Incompressible data is stored as is, so there is nothing to time. */
+	if (c_len >= size) {
+		zcb->zcb_decompress_bw = 0;
+		return;
+	}
+
+	count = 0;
+	start = gethrtime();
+	do {
+		if (zio_decompress_data(zcs->zcs_compress, dst, out, c_len,
+		    size, NULL) != 0) {
+			zcb->zcb_decompress_bw = 0;
+			return;
+		}
+		count++;
+		ns = gethrtime() - start;
+	} while (ns < ZIO_COMPRESS_BENCH_MIN_NS);
+	zcb->zcb_decompress_bw = size * count * NANOSEC / MAX(ns, 1) /
+	    1024 / 1024;
+}
+
+/*
+ * Run the benchmark, unless it has already been run.
+ */
+void
+zio_compress_bench_run(void)
+{
+	const size_t size = ZIO_COMPRESS_BENCH_SIZE;
+
+	mutex_enter(&zio_compress_bench_lock);
+	if (zio_compress_bench_done) {
+		mutex_exit(&zio_compress_bench_lock);
+		return;
+	}
+
+	abd_t *src = abd_alloc_linear(size, B_FALSE);
+	abd_t *dst = abd_alloc_linear(size, B_FALSE);
+	abd_t *out = abd_alloc_linear(size, B_FALSE);
+	zio_compress_bench_fill(abd_to_buf(src), size);
+
+	for (int i = 0; i < zio_compress_bench_cnt; i++) {
+		zio_compress_bench_one(&zio_compress_bench_data[i], src, dst,
+		    out);
+	}
+
+	abd_free(out);
+	abd_free(dst);
+	abd_free(src);
+
+	zio_compress_bench_done = B_TRUE;
+	mutex_exit(&zio_compress_bench_lock);
+}
+
+/*
+ * Look up the benchmark results for an algorithm.  The level is only used for
+ * zstd, and must be one of the levels that were measured.  Returns ENOENT if
+ * the benchmark has not been run yet or the algorithm was not measured; call
+ * zio_compress_bench_run() first (not from the I/O path, it takes a while).
+ */
+int
+zio_compress_bench_get(enum zio_compress c, uint8_t level,
+    zio_compress_bench_t *zcb)
+{
+	int error = SET_ERROR(ENOENT);
+
+	mutex_enter(&zio_compress_bench_lock);
+	for (int i = 0; zio_compress_bench_done &&
+	    i < zio_compress_bench_cnt; i++) {
+		zio_compress_bench_stat_t *zcs = &zio_compress_bench_data[i];
+
+		if (zcs->zcs_compress == c && (c != ZIO_COMPRESS_ZSTD ||
+		    zcs->zcs_level == level)) {
+			*zcb = zcs->zcs_bench;
+			error = 0;
+			break;
+		}
+	}
+	mutex_exit(&zio_compress_bench_lock);
+
+	return (error);
+}
+
+static int
+zio_compress_bench_kstat_headers(char *buf, size_t size)
+{
+	(void) kmem_scnprintf(buf, size, "%-16s%10s%12s%8s\n",
+	    "algorithm", "compress", "decompress", "ratio");
+
+	return (0);
+}
+
+static int
+zio_compress_bench_kstat_data(char *buf, size_t size, void *data)
+{
+	zio_compress_bench_stat_t *zcs = data;
+	zio_compress_bench_t *zcb = &zcs->zcs_bench;
+
+	(void) kmem_scnprintf(buf, size, "%-16s%10llu%12llu%5llu.%02llu\n",
+	    zcs->zcs_name, (u_longlong_t)zcb->zcb_compress_bw,
+	    (u_longlong_t)zcb->zcb_decompress_bw,
+	    (u_longlong_t)zcb->zcb_ratio / 100,
+	    (u_longlong_t)zcb->zcb_ratio % 100);
+
+	return (0);
+}
+
+static void *
+zio_compress_bench_kstat_addr(kstat_t *ksp, loff_t n)
+{
+	zio_compress_bench_run();
+
+	if (n < zio_compress_bench_cnt)
+		ksp->ks_private = (void *)(zio_compress_bench_data + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+void
+zio_compress_bench_init(void)
+{
+	int cnt = ARRAY_SIZE(zio_compress_bench_zstd_levels);
+	int n = 0;
+
+	mutex_init(&zio_compress_bench_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	for (int c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		if (zio_compress_table[c].ci_compress != NULL &&
+		    c != ZIO_COMPRESS_ZSTD)
+			cnt++;
+	}
+
+	zio_compress_bench_data = kmem_zalloc(
+	    sizeof (zio_compress_bench_stat_t) * cnt, KM_SLEEP);
+	for (int c = 0; c < ZIO_COMPRESS_FUNCTIONS; c++) {
+		if (zio_compress_table[c].ci_compress == NULL)
+			continue;
+		if (c != ZIO_COMPRESS_ZSTD) {
+			zio_compress_bench_data[n].zcs_name =
+			    zio_compress_table[c].ci_name;
+			zio_compress_bench_data[n++].zcs_compress = c;
+			continue;
+		}
+		for (int l = 0;
+		    l < ARRAY_SIZE(zio_compress_bench_zstd_levels); l++) {
+			zio_compress_bench_stat_t *zcs =
+			    &zio_compress_bench_data[n++];
+
+			zcs->zcs_name = zio_compress_bench_zstd_levels[l].name;
+			zcs->zcs_compress = c;
+			zcs->zcs_level = zio_compress_bench_zstd_levels[l].level;
+		}
+	}
+	ASSERT3S(n, ==, cnt);
+	zio_compress_bench_cnt = cnt;
+
+	zio_compress_bench_kstat = kstat_create("zfs", 0, "compress_bench",
+	    "misc", KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+
+	if (zio_compress_bench_kstat != NULL) {
+		zio_compress_bench_kstat->ks_data = NULL;
+		zio_compress_bench_kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(zio_compress_bench_kstat,
+		    zio_compress_bench_kstat_headers,
+		    zio_compress_bench_kstat_data,
+		    zio_compress_bench_kstat_addr);
+		kstat_install(zio_compress_bench_kstat);
+	}
+}
+
+void
+zio_compress_bench_fini(void)
+{
+	if (zio_compress_bench_kstat != NULL) {
+		kstat_delete(zio_compress_bench_kstat);
+		zio_compress_bench_kstat = NULL;
+	}
+
+	kmem_free(zio_compress_bench_data,
+	    sizeof (zio_compress_bench_stat_t) * zio_compress_bench_cnt);
+	zio_compress_bench_data = NULL;
+	zio_compress_bench_cnt = 0;
+	zio_compress_bench_done = B_FALSE;
+
+	mutex_destroy(&zio_compress_bench_lock);
+}
+
+ZFS_MODULE_PARAM(zfs, zfs_, zstd_auto_min, UINT, ZMOD_RW,
+	"Lowest zstd level used by compression=zstd-auto");
+
+ZFS_MODULE_PARAM(zfs, zfs_, zstd_auto_max, UINT, ZMOD_RW,
+	"Highest zstd level used by compression=zstd-auto");
@@ -138,6 +138,7 @@ zv_request_task_create(zv_request_t zvr)
 	task = kmem_alloc(sizeof (zv_request_task_t), KM_SLEEP);
 	taskq_init_ent(&task->ent);
 	task->zvr = zvr;
+	task->wq_queued = B_FALSE;
 	return (task);
 }
 
@@ -719,8 +720,8 @@ zvol_clone_range(zvol_state_t *zv_src, uint64_t inoff, zvol_state_t *zv_dst,
 	 * Maintain predictable lock order.
 	 */
 	if (zv_src < zv_dst || (zv_src == zv_dst && inoff < outoff)) {
-		inlr = zfs_rangelock_enter(&zv_src->zv_rangelock, inoff, len,
-		    RL_READER);
+		inlr = zfs_rangelock_enter_nofast(&zv_src->zv_rangelock, inoff,
+		    len, RL_READER);
 		outlr = zfs_rangelock_enter(&zv_dst->zv_rangelock, outoff, len,
 		    RL_WRITER);
 	} else {
@@ -876,7 +877,7 @@ zil_replay_func_t *const zvol_replay_vector[TX_MAX_TYPE] = {
  */
 void
 zvol_log_write(zvol_state_t *zv, dmu_tx_t *tx, uint64_t offset,
-    uint64_t size, boolean_t commit)
+    uint64_t size, boolean_t o_direct, boolean_t commit)
 {
 	uint32_t blocksize = zv->zv_volblocksize;
 	zilog_t *zilog = zv->zv_zilog;
@@ -886,7 +887,7 @@ zvol_log_write(zvol_state_t *zv, dmu_tx_t *tx, uint64_t offset,
 	if (zil_replaying(zilog, tx))
 		return;
 
-	write_state = zil_write_state(zilog, size, blocksize, B_FALSE, commit);
+	write_state = zil_write_state(zilog, size, blocksize, o_direct, commit);
 
 	while (size) {
 		itx_t *itx;
@@ -1015,9 +1016,28 @@ zvol_get_data(void *arg, uint64_t arg2, lr_write_t *lr, char *buf,
 		error = dmu_buf_hold_noread_by_dnode(zv->zv_dn, offset, zgd,
 		    &db);
 		if (error == 0) {
-			blkptr_t *bp = &lr->lr_blkptr;
-
 			zgd->zgd_db = db;
+			dmu_buf_impl_t *dbi = (dmu_buf_impl_t *)db;
+			boolean_t direct_write = B_FALSE;
+			mutex_enter(&dbi->db_mtx);
+			dbuf_dirty_record_t *dr =
+			    dbuf_find_dirty_eq(dbi, lr->lr_common.lrc_txg);
+			if (dr != NULL && dr->dt.dl.dr_diowrite)
+				direct_write = B_TRUE;
+			mutex_exit(&dbi->db_mtx);
+
+			/*
+			 * Direct I/O writes (see zvol_direct) have already
+			 * completed, so the block pointer can be stored in the
+			 * log record right away.
+			 */
+			if (direct_write) {
+				lr->lr_blkptr = dr->dt.dl.dr_overridden_by;
+				zvol_get_done(zgd, 0);
+				return (0);
+			}
+
+			blkptr_t *bp = &lr->lr_blkptr;
 			zgd->zgd_bp = bp;
 
 			ASSERT(db != NULL);
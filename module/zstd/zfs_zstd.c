@@ -55,6 +55,21 @@ static uint_t zstd_earlyabort_pass = 1;
 static int zstd_cutoff_level = ZIO_ZSTD_LEVEL_3;
 static unsigned int zstd_abort_size = (128 * 1024);
 
+/*
+ * Blocks of at least two zstd_chunk_size chunks are compressed as
+ * independent zstd frames, in parallel on zstd_chunk_taskq.  The frames
+ * are preceded by a skippable frame holding the chunk size and the
+ * compressed length of every frame, which lets reads decompress them in
+ * parallel too.  Decoders which don't know about this skip the table and
+ * decompress the concatenated frames one after another, so no feature
+ * flag is needed.
+ */
+static uint_t zstd_chunk_size = 0;
+static taskq_t *zstd_chunk_taskq = NULL;
+
+/* Most frames in one block; larger blocks get larger chunks */
+#define	ZSTD_CHUNK_MAX	256
+
 static kstat_t *zstd_ksp = NULL;
 
 typedef struct zstd_stats {
@@ -84,6 +99,11 @@ typedef struct zstd_stats {
 	kstat_named_t	zstd_stat_passignored_size;
 	kstat_named_t	zstd_stat_buffers;
 	kstat_named_t	zstd_stat_size;
+	/*
+	 * Blocks compressed and decompressed as parallel chunks
+	 */
+	kstat_named_t	zstd_stat_com_chunked;
+	kstat_named_t	zstd_stat_dec_chunked;
 } zstd_stats_t;
 
 static zstd_stats_t zstd_stats = {
@@ -104,6 +124,8 @@ static zstd_stats_t zstd_stats = {
 	{ "passignored_size",		KSTAT_DATA_UINT64 },
 	{ "buffers",			KSTAT_DATA_UINT64 },
 	{ "size",			KSTAT_DATA_UINT64 },
+	{ "compress_chunked",		KSTAT_DATA_UINT64 },
+	{ "decompress_chunked",		KSTAT_DATA_UINT64 },
 };
 
 #ifdef _KERNEL
@@ -128,6 +150,8 @@ kstat_zstd_update(kstat_t *ksp, int rw)
 		ZSTDSTAT_ZERO(zstd_stat_zstdpass_rejected);
 		ZSTDSTAT_ZERO(zstd_stat_passignored);
 		ZSTDSTAT_ZERO(zstd_stat_passignored_size);
+		ZSTDSTAT_ZERO(zstd_stat_com_chunked);
+		ZSTDSTAT_ZERO(zstd_stat_dec_chunked);
 	}
 
 	return (0);
@@ -183,6 +207,7 @@ struct zstd_levelmap {
  */
 static void *zstd_alloc(void *opaque, size_t size);
 static void *zstd_dctx_alloc(void *opaque, size_t size);
+static void *zstd_dict_alloc(void *opaque, size_t size);
 static void zstd_free(void *opaque, void *ptr);
 
 /* Compression memory handler */
@@ -199,6 +224,13 @@ static const ZSTD_customMem zstd_dctx_malloc = {
 	NULL,
 };
 
+/* Dictionary memory handler, for long-lived CDicts and DDicts */
+static const ZSTD_customMem zstd_dict_malloc = {
+	zstd_dict_alloc,
+	zstd_free,
+	NULL,
+};
+
 /* Level map for converting ZFS internal levels to ZSTD levels and vice versa */
 static struct zstd_levelmap zstd_levels[] = {
 	{ZIO_ZSTD_LEVEL_1, ZIO_ZSTD_LEVEL_1},
@@ -243,6 +275,22 @@ static struct zstd_levelmap zstd_levels[] = {
 	{-1000, ZIO_ZSTD_LEVEL_FAST_1000},
 };
 
+/*
+ * A zstd dictionary shared by all the blocks compressed against it.  The
+ * digested forms zstd actually works with are built on first use and cached
+ * for the life of the dictionary: one CDict per compression level, since the
+ * level is baked into a CDict, and a single DDict.
+ */
+struct zfs_zstd_dict {
+	void		*zd_buf;
+	size_t		zd_len;
+	uint32_t	zd_id;
+	uint64_t	zd_refcnt;
+	kmutex_t	zd_lock;
+	ZSTD_DDict	*zd_ddict;
+	ZSTD_CDict	*zd_cdict[ARRAY_SIZE(zstd_levels)];
+};
+
 /*
  * This variable represents the maximum count of the pool based on the number
  * of CPUs plus some buffer. We default to cpu count * 4, see init_zstd.
@@ -412,46 +460,44 @@ zstd_mempool_free(struct zstd_kmem *z)
 }
 
 /* Convert ZFS internal enum to ZSTD level */
+/* Index of a zfs compression enum in zstd_levels, or -1 if it is invalid */
 static int
-zstd_enum_to_level(enum zio_zstd_levels level, int16_t *zstd_level)
+zstd_enum_to_index(enum zio_zstd_levels level)
 {
-	if (level > 0 && level <= ZIO_ZSTD_LEVEL_19) {
-		*zstd_level = zstd_levels[level - 1].zstd_level;
-		return (0);
-	}
+	if (level > 0 && level <= ZIO_ZSTD_LEVEL_19)
+		return (level - 1);
 	if (level >= ZIO_ZSTD_LEVEL_FAST_1 &&
-	    level <= ZIO_ZSTD_LEVEL_FAST_1000) {
-		*zstd_level = zstd_levels[level - ZIO_ZSTD_LEVEL_FAST_1
-		    + ZIO_ZSTD_LEVEL_19].zstd_level;
-		return (0);
-	}
+	    level <= ZIO_ZSTD_LEVEL_FAST_1000)
+		return (level - ZIO_ZSTD_LEVEL_FAST_1 + ZIO_ZSTD_LEVEL_19);
+
+	return (-1);
+}
+
+static int
+zstd_enum_to_level(enum zio_zstd_levels level, int16_t *zstd_level)
+{
+	int idx = zstd_enum_to_index(level);
 
 	/* Invalid/unknown zfs compression enum - this should never happen. */
-	return (1);
+	if (idx < 0)
+		return (1);
+
+	*zstd_level = zstd_levels[idx].zstd_level;
+	return (0);
 }
 
-/* Compress block using zstd */
+/*
+ * Compress a buffer into a single zstd frame, against a dictionary if cdict
+ * is given.  Returns the frame length, or 0 if it could not be compressed
+ * into d_len bytes.
+ */
 static size_t
-zfs_zstd_compress_impl(void *s_start, void *d_start, size_t s_len, size_t d_len,
-    int level)
+zfs_zstd_compress_frame(void *d_start, size_t d_len, const void *s_start,
+    size_t s_len, int16_t zstd_level, const ZSTD_CDict *cdict)
 {
 	size_t c_len;
-	int16_t zstd_level;
-	zfs_zstdhdr_t *hdr;
 	ZSTD_CCtx *cctx;
 
-	hdr = (zfs_zstdhdr_t *)d_start;
-
-	/* Skip compression if the specified level is invalid */
-	if (zstd_enum_to_level(level, &zstd_level)) {
-		ZSTDSTAT_BUMP(zstd_stat_com_inval);
-		return (s_len);
-	}
-
-	ASSERT3U(d_len, >=, sizeof (*hdr));
-	ASSERT3U(d_len, <=, s_len);
-	ASSERT3U(zstd_level, !=, 0);
-
 	cctx = ZSTD_createCCtx_advanced(zstd_malloc);
 
 	/*
@@ -460,11 +506,15 @@ zfs_zstd_compress_impl(void *s_start, void *d_start, size_t s_len, size_t d_len,
 	 */
 	if (!cctx) {
 		ZSTDSTAT_BUMP(zstd_stat_com_alloc_fail);
-		return (s_len);
+		return (0);
 	}
 
-	/* Set the compression level */
-	ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, zstd_level);
+	/* Set the compression level, which a dictionary carries itself */
+	if (cdict != NULL)
+		ZSTD_CCtx_refCDict(cctx, cdict);
+	else
+		ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+		    zstd_level);
 
 	/* Use the "magicless" zstd header which saves us 4 header bytes */
 	ZSTD_CCtx_setParameter(cctx, ZSTD_c_format, ZSTD_f_zstd1_magicless);
@@ -476,10 +526,7 @@ zfs_zstd_compress_impl(void *s_start, void *d_start, size_t s_len, size_t d_len,
 	ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 0);
 	ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 0);
 
-	c_len = ZSTD_compress2(cctx,
-	    hdr->data,
-	    d_len - sizeof (*hdr),
-	    s_start, s_len);
+	c_len = ZSTD_compress2(cctx, d_start, d_len, s_start, s_len);
 
 	ZSTD_freeCCtx(cctx);
 
@@ -495,9 +542,335 @@ zfs_zstd_compress_impl(void *s_start, void *d_start, size_t s_len, size_t d_len,
 			ZSTDSTAT_BUMP(zstd_stat_com_fail);
 			dprintf("Error: %s", ZSTD_getErrorString(err));
 		}
+		return (0);
+	}
+
+	return (c_len);
+}
+
+/* One chunk of a block compressed or decompressed on zstd_chunk_taskq */
+typedef struct zstd_chunk {
+	const void	*zc_src;
+	size_t		zc_s_len;
+	void		*zc_dst;
+	size_t		zc_d_len;
+	int16_t		zc_level;
+	size_t		zc_result;	/* output length, 0 on failure */
+	struct zstd_chunk_set *zc_set;
+	taskq_ent_t	zc_ent;
+} zstd_chunk_t;
+
+typedef struct zstd_chunk_set {
+	kmutex_t	zcs_lock;
+	kcondvar_t	zcs_cv;
+	uint_t		zcs_pending;
+} zstd_chunk_set_t;
+
+static inline uint32_t
+zstd_chunk_get32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof (v));
+	return (LE_32(v));
+}
+
+static inline void
+zstd_chunk_put32(uint8_t *p, uint32_t v)
+{
+	v = LE_32(v);
+	memcpy(p, &v, sizeof (v));
+}
+
+static void
+zstd_chunk_done(zstd_chunk_t *zc)
+{
+	zstd_chunk_set_t *zcs = zc->zc_set;
+
+	if (zcs == NULL)
+		return;
+
+	mutex_enter(&zcs->zcs_lock);
+	if (--zcs->zcs_pending == 0)
+		cv_broadcast(&zcs->zcs_cv);
+	mutex_exit(&zcs->zcs_lock);
+}
+
+static void
+zstd_compress_chunk_task(void *arg)
+{
+	zstd_chunk_t *zc = arg;
+
+	zc->zc_result = zfs_zstd_compress_frame(zc->zc_dst, zc->zc_d_len,
+	    zc->zc_src, zc->zc_s_len, zc->zc_level, NULL);
+	zstd_chunk_done(zc);
+}
+
+static void
+zstd_decompress_chunk_task(void *arg)
+{
+	zstd_chunk_t *zc = arg;
+	ZSTD_DCtx *dctx;
+	size_t result;
+
+	zc->zc_result = 0;
+	dctx = ZSTD_createDCtx_advanced(zstd_dctx_malloc);
+	if (dctx != NULL) {
+		ZSTD_DCtx_setParameter(dctx, ZSTD_d_format,
+		    ZSTD_f_zstd1_magicless);
+		result = ZSTD_decompressDCtx(dctx, zc->zc_dst, zc->zc_d_len,
+		    zc->zc_src, zc->zc_s_len);
+		ZSTD_freeDCtx(dctx);
+		if (!ZSTD_isError(result))
+			zc->zc_result = result;
+	}
+	zstd_chunk_done(zc);
+}
+
+/*
+ * Run func on every chunk, handing all but the first to zstd_chunk_taskq
+ * and doing the first one in the calling thread.
+ */
+static void
+zstd_chunks_run(zstd_chunk_t *zc, uint_t n, task_func_t *func)
+{
+	zstd_chunk_set_t zcs;
+
+	mutex_init(&zcs.zcs_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zcs.zcs_cv, NULL, CV_DEFAULT, NULL);
+	zcs.zcs_pending = n - 1;
+
+	for (uint_t i = 1; i < n; i++) {
+		zc[i].zc_set = &zcs;
+		taskq_init_ent(&zc[i].zc_ent);
+		taskq_dispatch_ent(zstd_chunk_taskq, func, &zc[i], 0,
+		    &zc[i].zc_ent);
+	}
+
+	zc[0].zc_set = NULL;
+	func(&zc[0]);
+
+	mutex_enter(&zcs.zcs_lock);
+	while (zcs.zcs_pending > 0)
+		cv_wait(&zcs.zcs_cv, &zcs.zcs_lock);
+	mutex_exit(&zcs.zcs_lock);
+
+	cv_destroy(&zcs.zcs_cv);
+	mutex_destroy(&zcs.zcs_lock);
+}
+
+/*
+ * Compress a block as independent chunks.  The output is a skippable frame
+ * containing the chunk size and the length of each chunk's frame, followed
+ * by the frames themselves.  Returns the total length or 0 on failure.
+ */
+static size_t
+zfs_zstd_compress_chunked(void *d_start, size_t d_len, const void *s_start,
+    size_t s_len, int16_t zstd_level)
+{
+	size_t chunk = zstd_chunk_size;
+	uint_t n = DIV_ROUND_UP(s_len, chunk);
+
+	if (n > ZSTD_CHUNK_MAX) {
+		chunk = DIV_ROUND_UP(s_len, ZSTD_CHUNK_MAX);
+		n = DIV_ROUND_UP(s_len, chunk);
+	}
+
+	size_t tbl = ZSTD_SKIPPABLEHEADERSIZE + sizeof (uint32_t) * (n + 1);
+	if (tbl >= d_len)
+		return (0);
+
+	uint8_t *dst = d_start;
+	uint8_t *scratch = vmem_alloc(s_len, KM_SLEEP);
+	zstd_chunk_t *zc = kmem_zalloc(n * sizeof (zstd_chunk_t), KM_SLEEP);
+
+	for (uint_t i = 0; i < n; i++) {
+		size_t off = i * chunk;
+
+		zc[i].zc_src = (const uint8_t *)s_start + off;
+		zc[i].zc_s_len = MIN(chunk, s_len - off);
+		zc[i].zc_dst = scratch + off;
+		zc[i].zc_d_len = zc[i].zc_s_len;
+		zc[i].zc_level = zstd_level;
+	}
+
+	zstd_chunks_run(zc, n, zstd_compress_chunk_task);
+
+	size_t c_len = tbl;
+	for (uint_t i = 0; i < n; i++) {
+		if (zc[i].zc_result == 0 || zc[i].zc_result > d_len - c_len) {
+			c_len = 0;
+			break;
+		}
+		memcpy(dst + c_len, zc[i].zc_dst, zc[i].zc_result);
+		zstd_chunk_put32(dst + ZSTD_SKIPPABLEHEADERSIZE +
+		    sizeof (uint32_t) * (i + 1), zc[i].zc_result);
+		c_len += zc[i].zc_result;
+	}
+
+	if (c_len != 0) {
+		zstd_chunk_put32(dst, ZSTD_MAGIC_SKIPPABLE_START);
+		zstd_chunk_put32(dst + 4, tbl - ZSTD_SKIPPABLEHEADERSIZE);
+		zstd_chunk_put32(dst + ZSTD_SKIPPABLEHEADERSIZE, chunk);
+		ZSTDSTAT_BUMP(zstd_stat_com_chunked);
+	}
+
+	kmem_free(zc, n * sizeof (zstd_chunk_t));
+	vmem_free(scratch, s_len);
+
+	return (c_len);
+}
+
+/*
+ * Decompress a block written by zfs_zstd_compress_chunked() in parallel.
+ * Returns non-zero if the block is not chunked or anything about it looks
+ * wrong; the caller then decompresses it serially, which also works for
+ * chunked blocks and reports errors properly.
+ */
+static int
+zfs_zstd_decompress_chunked(void *d_start, size_t d_len, const void *s_start,
+    size_t s_len)
+{
+	const uint8_t *src = s_start;
+
+	if (zstd_chunk_taskq == NULL ||
+	    s_len < ZSTD_SKIPPABLEHEADERSIZE + 3 * sizeof (uint32_t) ||
+	    zstd_chunk_get32(src) != ZSTD_MAGIC_SKIPPABLE_START)
+		return (1);
+
+	size_t tsize = zstd_chunk_get32(src + 4);
+	if (tsize % sizeof (uint32_t) != 0 ||
+	    tsize < 3 * sizeof (uint32_t) ||
+	    tsize > s_len - ZSTD_SKIPPABLEHEADERSIZE)
+		return (1);
+
+	const uint8_t *tbl = src + ZSTD_SKIPPABLEHEADERSIZE;
+	uint_t n = tsize / sizeof (uint32_t) - 1;
+	size_t chunk = zstd_chunk_get32(tbl);
+	if (n > ZSTD_CHUNK_MAX || chunk == 0 || chunk * (n - 1) >= d_len)
+		return (1);
+
+	zstd_chunk_t *zc = kmem_zalloc(n * sizeof (zstd_chunk_t), KM_SLEEP);
+	size_t off = ZSTD_SKIPPABLEHEADERSIZE + tsize;
+	int err = 0;
+
+	for (uint_t i = 0; i < n; i++) {
+		size_t len = zstd_chunk_get32(tbl + sizeof (uint32_t) * (i + 1));
+
+		if (len == 0 || len > s_len - off) {
+			err = 1;
+			break;
+		}
+		zc[i].zc_src = src + off;
+		zc[i].zc_s_len = len;
+		zc[i].zc_dst = (uint8_t *)d_start + i * chunk;
+		zc[i].zc_d_len = MIN(chunk, d_len - i * chunk);
+		off += len;
+	}
+
+	if (err == 0) {
+		zstd_chunks_run(zc, n, zstd_decompress_chunk_task);
+		for (uint_t i = 0; i < n; i++) {
+			if (zc[i].zc_result != zc[i].zc_d_len) {
+				err = 1;
+				break;
+			}
+		}
+	}
+
+	kmem_free(zc, n * sizeof (zstd_chunk_t));
+	if (err == 0)
+		ZSTDSTAT_BUMP(zstd_stat_dec_chunked);
+
+	return (err);
+}
+
+/*
+ * Get the dictionary's CDict for a compression level, creating it on first
+ * use.  Returns NULL if zstd could not build it.
+ */
+static const ZSTD_CDict *
+zfs_zstd_dict_cdict(zfs_zstd_dict_t *zd, enum zio_zstd_levels level,
+    int16_t zstd_level)
+{
+	int idx = zstd_enum_to_index(level);
+	ZSTD_CDict *cdict;
+
+	ASSERT3S(idx, >=, 0);
+
+	mutex_enter(&zd->zd_lock);
+	if ((cdict = zd->zd_cdict[idx]) == NULL) {
+		cdict = ZSTD_createCDict_advanced(zd->zd_buf, zd->zd_len,
+		    ZSTD_dlm_byRef, ZSTD_dct_auto,
+		    ZSTD_getCParams(zstd_level, 0, zd->zd_len),
+		    zstd_dict_malloc);
+		zd->zd_cdict[idx] = cdict;
+	}
+	mutex_exit(&zd->zd_lock);
+
+	return (cdict);
+}
+
+/* Get the dictionary's DDict, creating it on first use */
+static const ZSTD_DDict *
+zfs_zstd_dict_ddict(zfs_zstd_dict_t *zd)
+{
+	ZSTD_DDict *ddict;
+
+	mutex_enter(&zd->zd_lock);
+	if ((ddict = zd->zd_ddict) == NULL) {
+		ddict = ZSTD_createDDict_advanced(zd->zd_buf, zd->zd_len,
+		    ZSTD_dlm_byRef, ZSTD_dct_auto, zstd_dict_malloc);
+		zd->zd_ddict = ddict;
+	}
+	mutex_exit(&zd->zd_lock);
+
+	return (ddict);
+}
+
+/* Compress block using zstd, against a dictionary if zd is given */
+static size_t
+zfs_zstd_compress_impl(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level, zfs_zstd_dict_t *zd)
+{
+	size_t c_len;
+	int16_t zstd_level;
+	zfs_zstdhdr_t *hdr;
+	uint_t chunk = zstd_chunk_size;
+
+	hdr = (zfs_zstdhdr_t *)d_start;
+
+	/* Skip compression if the specified level is invalid */
+	if (zstd_enum_to_level(level, &zstd_level)) {
+		ZSTDSTAT_BUMP(zstd_stat_com_inval);
 		return (s_len);
 	}
 
+	ASSERT3U(d_len, >=, sizeof (*hdr));
+	ASSERT3U(d_len, <=, s_len);
+	ASSERT3U(zstd_level, !=, 0);
+
+	if (zd != NULL) {
+		const ZSTD_CDict *cdict = zfs_zstd_dict_cdict(zd, level,
+		    zstd_level);
+		if (cdict == NULL) {
+			ZSTDSTAT_BUMP(zstd_stat_com_alloc_fail);
+			return (s_len);
+		}
+		c_len = zfs_zstd_compress_frame(hdr->data,
+		    d_len - sizeof (*hdr), s_start, s_len, zstd_level, cdict);
+	} else if (zstd_chunk_taskq != NULL && chunk != 0 &&
+	    s_len / 2 >= chunk) {
+		c_len = zfs_zstd_compress_chunked(hdr->data,
+		    d_len - sizeof (*hdr), s_start, s_len, zstd_level);
+	} else {
+		c_len = zfs_zstd_compress_frame(hdr->data,
+		    d_len - sizeof (*hdr), s_start, s_len, zstd_level, NULL);
+	}
+
+	if (c_len == 0)
+		return (s_len);
+
 	/*
 	 * Encode the compressed buffer size at the start. We'll need this in
 	 * decompression to counter the effects of padding which might be added
@@ -582,7 +955,7 @@ zfs_zstd_compress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len,
 		ZSTDSTAT_BUMP(zstd_stat_lz4pass_rejected);
 
 		pass_len = zfs_zstd_compress_impl(s_start, d_start, s_len,
-		    d_len, ZIO_ZSTD_LEVEL_1);
+		    d_len, ZIO_ZSTD_LEVEL_1, NULL);
 		if (pass_len == s_len || pass_len <= 0 || pass_len > d_len) {
 			ZSTDSTAT_BUMP(zstd_stat_zstdpass_rejected);
 			return (s_len);
@@ -595,14 +968,18 @@ zfs_zstd_compress_buf(void *s_start, void *d_start, size_t s_len, size_t d_len,
 		}
 	}
 keep_trying:
-	return (zfs_zstd_compress_impl(s_start, d_start, s_len, d_len, level));
+	return (zfs_zstd_compress_impl(s_start, d_start, s_len, d_len, level,
+	    NULL));
 
 }
 
-/* Decompress block using zstd and return its stored level */
+/*
+ * Decompress block using zstd, against a dictionary if zd is given, and
+ * return its stored level
+ */
 static int
-zfs_zstd_decompress_level_buf(void *s_start, void *d_start, size_t s_len,
-    size_t d_len, uint8_t *level)
+zfs_zstd_decompress_impl(void *s_start, void *d_start, size_t s_len,
+    size_t d_len, uint8_t *level, zfs_zstd_dict_t *zd)
 {
 	ZSTD_DCtx *dctx;
 	size_t result;
@@ -646,6 +1023,11 @@ zfs_zstd_decompress_level_buf(void *s_start, void *d_start, size_t s_len,
 		return (1);
 	}
 
+	/* Blocks compressed in chunks can also be decompressed in parallel */
+	if (zd == NULL &&
+	    zfs_zstd_decompress_chunked(d_start, d_len, hdr->data, c_len) == 0)
+		goto done;
+
 	dctx = ZSTD_createDCtx_advanced(zstd_dctx_malloc);
 	if (!dctx) {
 		ZSTDSTAT_BUMP(zstd_stat_dec_alloc_fail);
@@ -655,6 +1037,9 @@ zfs_zstd_decompress_level_buf(void *s_start, void *d_start, size_t s_len,
 	/* Set header type to "magicless" */
 	ZSTD_DCtx_setParameter(dctx, ZSTD_d_format, ZSTD_f_zstd1_magicless);
 
+	if (zd != NULL)
+		ZSTD_DCtx_refDDict(dctx, zfs_zstd_dict_ddict(zd));
+
 	/* Decompress the data and release the context */
 	result = ZSTD_decompressDCtx(dctx, d_start, d_len, hdr->data, c_len);
 	ZSTD_freeDCtx(dctx);
@@ -668,6 +1053,7 @@ zfs_zstd_decompress_level_buf(void *s_start, void *d_start, size_t s_len,
 		return (1);
 	}
 
+done:
 	if (level) {
 		*level = curlevel;
 	}
@@ -675,6 +1061,15 @@ zfs_zstd_decompress_level_buf(void *s_start, void *d_start, size_t s_len,
 	return (0);
 }
 
+/* Decompress block using zstd and return its stored level */
+static int
+zfs_zstd_decompress_level_buf(void *s_start, void *d_start, size_t s_len,
+    size_t d_len, uint8_t *level)
+{
+	return (zfs_zstd_decompress_impl(s_start, d_start, s_len, d_len,
+	    level, NULL));
+}
+
 /* Decompress datablock using zstd */
 static int
 zfs_zstd_decompress_buf(void *s_start, void *d_start, size_t s_len,
@@ -689,6 +1084,89 @@ ZFS_COMPRESS_WRAP_DECL(zfs_zstd_compress)
 ZFS_DECOMPRESS_WRAP_DECL(zfs_zstd_decompress)
 ZFS_DECOMPRESS_LEVEL_WRAP_DECL(zfs_zstd_decompress_level)
 
+/*
+ * Create a dictionary from a buffer, which is copied.  Dictionaries trained
+ * with "zstd --train" are loaded with their entropy tables; anything else,
+ * such as a concatenation of sample blocks from a dataset, is used as raw
+ * content, which already gives small records of similar data something to
+ * match against.  The dictionary is returned with one reference held.
+ */
+zfs_zstd_dict_t *
+zfs_zstd_dict_create(const void *buf, size_t len)
+{
+	zfs_zstd_dict_t *zd = kmem_zalloc(sizeof (*zd), KM_SLEEP);
+
+	zd->zd_buf = vmem_alloc(len, KM_SLEEP);
+	memcpy(zd->zd_buf, buf, len);
+	zd->zd_len = len;
+	zd->zd_id = ZSTD_getDictID_fromDict(buf, len);
+	zd->zd_refcnt = 1;
+	mutex_init(&zd->zd_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	return (zd);
+}
+
+void
+zfs_zstd_dict_hold(zfs_zstd_dict_t *zd)
+{
+	atomic_inc_64(&zd->zd_refcnt);
+}
+
+void
+zfs_zstd_dict_rele(zfs_zstd_dict_t *zd)
+{
+	if (atomic_dec_64_nv(&zd->zd_refcnt) != 0)
+		return;
+
+	for (int i = 0; i < ARRAY_SIZE(zd->zd_cdict); i++) {
+		if (zd->zd_cdict[i] != NULL)
+			ZSTD_freeCDict(zd->zd_cdict[i]);
+	}
+	if (zd->zd_ddict != NULL)
+		ZSTD_freeDDict(zd->zd_ddict);
+	mutex_destroy(&zd->zd_lock);
+	vmem_free(zd->zd_buf, zd->zd_len);
+	kmem_free(zd, sizeof (*zd));
+}
+
+/* The dictionary ID, or 0 for a raw content dictionary */
+uint32_t
+zfs_zstd_dict_id(const zfs_zstd_dict_t *zd)
+{
+	return (zd->zd_id);
+}
+
+/*
+ * Compress and decompress against a dictionary.  The block format is the same
+ * as zfs_zstd_compress() produces, but a block compressed against a
+ * dictionary can only be decompressed with that same dictionary.
+ */
+size_t
+zfs_zstd_compress_dict(abd_t *src, abd_t *dst, size_t s_len, size_t d_len,
+    int level, zfs_zstd_dict_t *zd)
+{
+	void *s_buf = abd_borrow_buf_copy(src, s_len);
+	void *d_buf = abd_borrow_buf(dst, d_len);
+	size_t c_len = zfs_zstd_compress_impl(s_buf, d_buf, s_len, d_len,
+	    level, zd);
+	abd_return_buf(src, s_buf, s_len);
+	abd_return_buf_copy(dst, d_buf, d_len);
+	return (c_len);
+}
+
+int
+zfs_zstd_decompress_dict(abd_t *src, abd_t *dst, size_t s_len, size_t d_len,
+    uint8_t *level, zfs_zstd_dict_t *zd)
+{
+	void *s_buf = abd_borrow_buf_copy(src, s_len);
+	void *d_buf = abd_borrow_buf(dst, d_len);
+	int err = zfs_zstd_decompress_impl(s_buf, d_buf, s_len, d_len,
+	    level, zd);
+	abd_return_buf(src, s_buf, s_len);
+	abd_return_buf_copy(dst, d_buf, d_len);
+	return (err);
+}
+
 
 /* Allocator for zstd compression context using mempool_allocator */
 static void *
@@ -755,6 +1233,23 @@ zstd_dctx_alloc(void *opaque __maybe_unused, size_t size)
 	return ((void*)z + (sizeof (struct zstd_kmem)));
 }
 
+/*
+ * Allocator for dictionaries, which live as long as their dataset and so are
+ * kept out of the mempools
+ */
+static void *
+zstd_dict_alloc(void *opaque __maybe_unused, size_t size)
+{
+	size_t nbytes = sizeof (struct zstd_kmem) + size;
+	struct zstd_kmem *z = vmem_alloc(nbytes, KM_SLEEP);
+
+	z->kmem_type = ZSTD_KMEM_DEFAULT;
+	z->kmem_size = nbytes;
+	z->pool = NULL;
+
+	return ((void*)z + (sizeof (struct zstd_kmem)));
+}
+
 /* Free allocated memory by its specific type */
 static void
 zstd_free(void *opaque __maybe_unused, void *ptr)
@@ -876,6 +1371,9 @@ zstd_init(void)
 	pool_count = (boot_ncpus * 4);
 	zstd_meminit();
 
+	zstd_chunk_taskq = taskq_create("zstd_chunk", 75, maxclsyspri,
+	    boot_ncpus, INT_MAX, TASKQ_DYNAMIC | TASKQ_THREADS_CPU_PCT);
+
 	/* Initialize kstat */
 	zstd_ksp = kstat_create("zfs", 0, "zstd", "misc",
 	    KSTAT_TYPE_NAMED, sizeof (zstd_stats) / sizeof (kstat_named_t),
@@ -900,6 +1398,11 @@ zstd_fini(void)
 		zstd_ksp = NULL;
 	}
 
+	if (zstd_chunk_taskq != NULL) {
+		taskq_destroy(zstd_chunk_taskq);
+		zstd_chunk_taskq = NULL;
+	}
+
 	/* Release fallback memory */
 	vmem_free(zstd_dctx_fallback.mem, zstd_dctx_fallback.mem_size);
 	mutex_destroy(&zstd_dctx_fallback.barrier);
@@ -918,4 +1421,6 @@ ZFS_MODULE_PARAM(zfs, zstd_, earlyabort_pass, UINT, ZMOD_RW,
 	"Enable early abort attempts when using zstd");
 ZFS_MODULE_PARAM(zfs, zstd_, abort_size, UINT, ZMOD_RW,
 	"Minimal size of block to attempt early abort");
+ZFS_MODULE_PARAM(zfs, zstd_, chunk_size, UINT, ZMOD_RW,
+	"Compress blocks of at least twice this size as parallel chunks");
 #endif
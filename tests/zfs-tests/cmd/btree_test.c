@@ -29,6 +29,9 @@ static int stress_timeout = 180;
 static int contents_frequency = 100;
 static int tree_limit = 64 * 1024;
 static boolean_t stress_only = B_FALSE;
+static boolean_t bench_only = B_FALSE;
+static int bench_segs = 1024 * 1024;
+static int bench_finds = 4 * 1024 * 1024;
 
 static void
 usage(int exit_value)
@@ -38,13 +41,17 @@ usage(int exit_value)
 	    "[-t timeout>] [-c check_contents]\n");
 	(void) fprintf(stderr, "\tbtree_test [-r <seed>] [-l <limit>] "
 	    "[-t timeout>] [-c check_contents]\n");
+	(void) fprintf(stderr, "\tbtree_test -b [-r <seed>] [-S <segments>] "
+	    "[-f <finds>]\n");
 	(void) fprintf(stderr, "\n    With the -n option, run the named "
 	    "negative test. With the -s option,\n");
 	(void) fprintf(stderr, "    run the stress test according to the "
 	    "other options passed. With\n");
 	(void) fprintf(stderr, "    neither, run all the positive tests, "
 	    "including the stress test with\n");
-	(void) fprintf(stderr, "    the default options.\n");
+	(void) fprintf(stderr, "    the default options. With the -b option, "
+	    "run the range segment\n");
+	(void) fprintf(stderr, "    search benchmark.\n");
 	(void) fprintf(stderr, "\n    Options that control the stress test\n");
 	(void) fprintf(stderr, "\t-c stress iterations after which to compare "
 	    "tree contents [default: 100]\n");
@@ -54,6 +61,12 @@ usage(int exit_value)
 	    "gettimeofday()]\n");
 	(void) fprintf(stderr, "\t-t seconds to let the stress test run "
 	    "[default: 180]\n");
+	(void) fprintf(stderr, "\n    Options that control the search "
+	    "benchmark\n");
+	(void) fprintf(stderr, "\t-f number of timed finds per search "
+	    "function [default: 4M]\n");
+	(void) fprintf(stderr, "\t-S number of segments in the trees "
+	    "[default: 1M]\n");
 	exit(exit_value);
 }
 
@@ -153,6 +166,130 @@ verify_node(avl_tree_t *avl, zfs_btree_t *bt, int_node_t *node)
 	}
 }
 
+/*
+ * Range segments, laid out and compared like the ones of a range tree, for
+ * exercising the specialized in-buffer search functions.
+ */
+typedef struct bench_seg {
+	uint64_t	rs_start;
+	uint64_t	rs_end;
+} bench_seg_t;
+
+__attribute__((always_inline)) inline
+static int
+bench_seg_compare(const void *x1, const void *x2)
+{
+	const bench_seg_t *r1 = x1;
+	const bench_seg_t *r2 = x2;
+
+	return ((r1->rs_start >= r2->rs_end) - (r1->rs_end <= r2->rs_start));
+}
+
+__attribute__((always_inline)) inline
+static int
+bench_seg_before(const void *x1, const void *x2)
+{
+	const bench_seg_t *r1 = x1;
+	const bench_seg_t *r2 = x2;
+
+	return (r1->rs_end <= r2->rs_start);
+}
+
+ZFS_BTREE_FIND_IN_BUF_FUNC(bench_seg_find_in_buf, bench_seg_t,
+    bench_seg_compare)
+
+ZFS_BTREE_FIND_IN_BUF_SORTED_FUNC(bench_seg_find_in_buf_sorted, bench_seg_t,
+    bench_seg_before, bench_seg_compare)
+
+static const struct {
+	const char		*name;
+	bt_find_in_buf_f	find;
+} bench_funcs[] = {
+	{ "generic",	NULL				},
+	{ "inlined",	bench_seg_find_in_buf		},
+	{ "sorted",	bench_seg_find_in_buf_sorted	},
+};
+
+#define	BENCH_NFUNCS	(sizeof (bench_funcs) / sizeof (bench_funcs[0]))
+
+/*
+ * Fill one tree per search function with the same random, disjoint
+ * segments and look up the same random ranges in all of them, timing
+ * the lookups if 'timed' is set.  Fails if the search functions disagree
+ * on any lookup.
+ */
+static int
+search_segs(int nsegs, int nfinds, boolean_t timed, char *why)
+{
+	zfs_btree_t trees[BENCH_NFUNCS];
+	uint64_t sums[BENCH_NFUNCS];
+	bench_seg_t *finds;
+	uint64_t end = 0;
+
+	for (int f = 0; f < BENCH_NFUNCS; f++) {
+		zfs_btree_create(&trees[f], bench_seg_compare,
+		    bench_funcs[f].find, sizeof (bench_seg_t));
+	}
+
+	for (int i = 0; i < nsegs; i++) {
+		bench_seg_t seg;
+
+		seg.rs_start = end + 512 * (1 + random() % 16);
+		seg.rs_end = seg.rs_start + 512 * (1 + random() % 16);
+		end = seg.rs_end;
+		for (int f = 0; f < BENCH_NFUNCS; f++)
+			zfs_btree_add(&trees[f], &seg);
+	}
+
+	finds = malloc(nfinds * sizeof (bench_seg_t));
+	if (finds == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < nfinds; i++) {
+		finds[i].rs_start = ((uint64_t)random() << 16 ^ random()) %
+		    (end + 8192);
+		finds[i].rs_end = finds[i].rs_start + 512;
+	}
+
+	for (int f = 0; f < BENCH_NFUNCS; f++) {
+		hrtime_t start = gethrtime();
+
+		sums[f] = 0;
+		for (int i = 0; i < nfinds; i++) {
+			zfs_btree_index_t idx;
+			bench_seg_t *seg =
+			    zfs_btree_find(&trees[f], &finds[i], &idx);
+
+			sums[f] += (seg != NULL) ? seg->rs_start :
+			    idx.bti_offset + 1;
+		}
+
+		hrtime_t delta = MAX(gethrtime() - start, 1);
+		if (timed) {
+			(void) fprintf(stdout, "%-10s %12llu finds/s\n",
+			    bench_funcs[f].name, (u_longlong_t)
+			    ((uint64_t)nfinds * NANOSEC / delta));
+		}
+
+		zfs_btree_index_t *cookie = NULL;
+		while (zfs_btree_destroy_nodes(&trees[f], &cookie) != NULL)
+			;
+		zfs_btree_destroy(&trees[f]);
+	}
+	free(finds);
+
+	for (int f = 1; f < BENCH_NFUNCS; f++) {
+		if (sums[f] != sums[0]) {
+			(void) snprintf(why, BUFSIZE, "%s search disagrees "
+			    "with %s search\n", bench_funcs[f].name,
+			    bench_funcs[0].name);
+			return (1);
+		}
+	}
+	return (0);
+}
+
 /*
  * Tests
  */
@@ -377,6 +514,17 @@ stress_tree(zfs_btree_t *bt, char *why)
 	return (0);
 }
 
+/*
+ * Verify that the specialized in-buffer search functions agree with the
+ * generic one on trees of range segments.
+ */
+static int
+search_range_segs(zfs_btree_t *bt, char *why)
+{
+	(void) bt;
+	return (search_segs(64 * 1024, 256 * 1024, B_FALSE, why));
+}
+
 /*
  * Verify inserting a duplicate value will cause a crash.
  * Note: negative test; return of 0 is a failure.
@@ -455,6 +603,7 @@ static btree_test_t test_table[] = {
 	{ "insert_find_remove",		insert_find_remove	},
 	{ "find_without_index",		find_without_index	},
 	{ "drain_tree",			drain_tree		},
+	{ "search_range_segs",		search_range_segs	},
 	{ "stress_tree",		stress_tree		},
 	{ NULL,				NULL			}
 };
@@ -468,11 +617,17 @@ main(int argc, char *argv[])
 	zfs_btree_t bt;
 	int c;
 
-	while ((c = getopt(argc, argv, "c:l:n:r:st:")) != -1) {
+	while ((c = getopt(argc, argv, "bc:f:l:n:r:sS:t:")) != -1) {
 		switch (c) {
+		case 'b':
+			bench_only = B_TRUE;
+			break;
 		case 'c':
 			contents_frequency = atoi(optarg);
 			break;
+		case 'f':
+			bench_finds = atoi(optarg);
+			break;
 		case 'l':
 			tree_limit = atoi(optarg);
 			break;
@@ -485,6 +640,9 @@ main(int argc, char *argv[])
 		case 's':
 			stress_only = B_TRUE;
 			break;
+		case 'S':
+			bench_segs = atoi(optarg);
+			break;
 		case 't':
 			stress_timeout = atoi(optarg);
 			break;
@@ -514,6 +672,18 @@ main(int argc, char *argv[])
 
 	fprintf(stderr, "Seed: %u\n", seed);
 
+	/*
+	 * This times lookups in trees of range segments with each of the
+	 * in-buffer search functions.
+	 */
+	if (bench_only) {
+		char why[BUFSIZE] = {0};
+		int retval = search_segs(bench_segs, bench_finds, B_TRUE, why);
+		if (retval != 0)
+			(void) fprintf(stdout, "%s", why);
+		return (retval);
+	}
+
 	/*
 	 * This is a stress test that does operations on a btree over the
 	 * requested timeout period, verifying them against identical
@@ -30,6 +30,7 @@
 #include <sys/vdev_draid.h>
 #include <sys/nvpair.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 /*
  * The number of rows to generate for new permutation maps.
@@ -58,7 +59,9 @@ draid_usage(void)
 	    "\tdraid verify [-rv] FILE\n"
 	    "\tdraid dump [-v] [-m min] [-n max] FILE\n"
 	    "\tdraid table FILE\n"
-	    "\tdraid merge FILE SRC SRC...\n");
+	    "\tdraid merge FILE SRC SRC...\n"
+	    "\tdraid bench [-v] [-p parity] [-d data] [-c children] "
+	    "[-s spares] [-i passes]\n");
 	exit(1);
 }
 
@@ -1253,6 +1256,151 @@ draid_table(int argc, char *argv[])
 	return (0);
 }
 
+/*
+ * Reference child mapping for a group, computed with a division per column
+ * exactly as the on-disk format defines it.
+ */
+static void
+bench_ref_children(const vdev_draid_config_t *vdc, uint64_t group,
+    uint8_t *ids)
+{
+	uint64_t children = vdc->vdc_children;
+	uint64_t groupstart = (group * vdc->vdc_groupwidth) % vdc->vdc_ndisks;
+	uint64_t poff = (group / vdc->vdc_ngroups) %
+	    (vdc->vdc_nperms * children);
+	uint8_t *base = vdc->vdc_perms + (poff / children) * children;
+	uint64_t iter = poff % children;
+
+	for (uint64_t i = 0; i < vdc->vdc_groupwidth; i++) {
+		uint64_t c = (groupstart + i) % vdc->vdc_ndisks;
+		ids[i] = (base[c] + iter) % children;
+	}
+}
+
+/*
+ * Benchmark the logical group to child vdev mapping used for every dRAID
+ * I/O, after verifying it against the reference mapping for a full cycle
+ * of permutations.
+ */
+static int
+draid_bench(int argc, char *argv[])
+{
+	uint64_t nparity = 2, ndata = 16, children = 96, nspares = 0;
+	uint64_t passes = 4;
+	int c, verbose = 0;
+
+	while ((c = getopt(argc, argv, ":vp:d:c:s:i:")) != -1) {
+		switch (c) {
+		case 'p':
+			nparity = MIN(strtoull(optarg, NULL, 0),
+			    VDEV_DRAID_MAXPARITY);
+			break;
+		case 'd':
+			ndata = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			children = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			nspares = strtoull(optarg, NULL, 0);
+			break;
+		case 'i':
+			passes = MAX(strtoull(optarg, NULL, 0), 1);
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case ':':
+			(void) fprintf(stderr,
+			    "missing argument for '%c' option\n", optopt);
+			draid_usage();
+			break;
+		case '?':
+			(void) fprintf(stderr, "invalid option '%c'\n",
+			    optopt);
+			draid_usage();
+			break;
+		}
+	}
+
+	if (nparity == 0 || ndata == 0 ||
+	    children < ndata + nparity + nspares) {
+		(void) fprintf(stderr, "Invalid dRAID layout\n");
+		return (1);
+	}
+
+	draid_map_t *map;
+	int error = alloc_fixed_map(children, &map);
+	if (error) {
+		printf("Error alloc_fixed_map() failed: %s\n",
+		    error == ECKSUM ? "Invalid checksum" : strerror(error));
+		return (1);
+	}
+
+	vdev_draid_config_t vdc = {
+		.vdc_ndata = ndata,
+		.vdc_nparity = nparity,
+		.vdc_nspares = nspares,
+		.vdc_children = children,
+		.vdc_perms = map->dm_perms,
+		.vdc_nperms = map->dm_nperms,
+		.vdc_groupwidth = ndata + nparity,
+		.vdc_ndisks = children - nspares,
+	};
+
+	/* As in zpool create, the smallest ngroups which evenly divides. */
+	vdc.vdc_ngroups = 1;
+	while ((vdc.vdc_ngroups * vdc.vdc_groupwidth) % vdc.vdc_ndisks != 0)
+		vdc.vdc_ngroups++;
+
+	uint64_t ngroups = vdc.vdc_nperms * children * vdc.vdc_ngroups;
+	uint8_t ids[VDEV_DRAID_MAX_CHILDREN], ref[VDEV_DRAID_MAX_CHILDREN];
+
+	for (uint64_t group = 0; group < ngroups; group++) {
+		vdev_draid_group_children(&vdc, group, ids);
+		bench_ref_children(&vdc, group, ref);
+		if (memcmp(ids, ref, vdc.vdc_groupwidth) != 0) {
+			printf("Error mapping mismatch for group %llu\n",
+			    (u_longlong_t)group);
+			free_map(map);
+			return (1);
+		}
+	}
+
+	uint64_t sum = 0;
+	hrtime_t start = gethrtime();
+	for (uint64_t p = 0; p < passes; p++) {
+		for (uint64_t group = 0; group < ngroups; group++) {
+			bench_ref_children(&vdc, group, ref);
+			sum += ref[group % vdc.vdc_groupwidth];
+		}
+	}
+	hrtime_t ref_ns = gethrtime() - start;
+
+	start = gethrtime();
+	for (uint64_t p = 0; p < passes; p++) {
+		for (uint64_t group = 0; group < ngroups; group++) {
+			vdev_draid_group_children(&vdc, group, ids);
+			sum += ids[group % vdc.vdc_groupwidth];
+		}
+	}
+	hrtime_t ns = gethrtime() - start;
+
+	double n = (double)ngroups * passes;
+	printf("draid%llu:%llud:%lluc:%llus ngroups=%llu groups=%llu\n",
+	    (u_longlong_t)nparity, (u_longlong_t)ndata,
+	    (u_longlong_t)children, (u_longlong_t)nspares,
+	    (u_longlong_t)vdc.vdc_ngroups, (u_longlong_t)ngroups);
+	printf("  reference: %8.2f ns/group\n", (double)ref_ns / n);
+	printf("  mapping:   %8.2f ns/group\n", (double)ns / n);
+	if (verbose)
+		printf("  checksum:  %llu\n", (u_longlong_t)sum);
+
+	free_map(map);
+
+	return (0);
+}
+
 static int
 draid_merge_impl(nvlist_t *allcfgs, const char *srcfilename, int *mergedp)
 {
@@ -1403,6 +1551,8 @@ main(int argc, char *argv[])
 		return (draid_table(argc - 1, argv + 1));
 	} else if (strcmp(subcommand, "merge") == 0) {
 		return (draid_merge(argc - 1, argv + 1));
+	} else if (strcmp(subcommand, "bench") == 0) {
+		return (draid_bench(argc - 1, argv + 1));
 	} else {
 		draid_usage();
 	}
@@ -512,6 +512,8 @@ test_send_new(const char *snapshot, int fd)
 	fnvlist_add_uint64(optional, "resume_object", resumeobj);
 	fnvlist_add_uint64(optional, "resume_offset", offset);
 	fnvlist_add_boolean(optional, "savedok");
+	fnvlist_add_uint64(optional, "part", part);
+	fnvlist_add_uint64(optional, "nparts", nparts);
 #endif
 	IOC_INPUT_TEST(ZFS_IOC_SEND_NEW, snapshot, required, optional, 0);
 
@@ -745,6 +747,23 @@ test_get_bookmark_props(const char *bookmark)
 	IOC_INPUT_TEST(ZFS_IOC_GET_BOOKMARK_PROPS, bookmark, NULL, NULL, 0);
 }
 
+static void
+test_get_dataset_props(const char *pool, const char *dataset)
+{
+	nvlist_t *required = fnvlist_alloc();
+	const char *datasets[] = { dataset };
+	const char *names[] = { "used", "compression" };
+
+	fnvlist_add_string_array(required, ZFS_DATASET_PROPS_DATASETS,
+	    datasets, ARRAY_SIZE(datasets));
+	fnvlist_add_string_array(required, ZFS_DATASET_PROPS_NAMES,
+	    names, ARRAY_SIZE(names));
+
+	IOC_INPUT_TEST(ZFS_IOC_GET_DATASET_PROPS, pool, required, NULL, 0);
+
+	nvlist_free(required);
+}
+
 static void
 test_wait(const char *pool)
 {
@@ -851,6 +870,7 @@ zfs_ioc_input_tests(const char *pool)
 	test_bookmark(pool, snapshot, bookmark);
 	test_get_bookmarks(dataset);
 	test_get_bookmark_props(bookmark);
+	test_get_dataset_props(pool, dataset);
 	test_destroy_bookmarks(pool, bookmark);
 
 	test_hold(pool, snapshot);
@@ -1040,6 +1060,7 @@ validate_ioc_values(void)
 	CHECK(ZFS_IOC_BASE + 83 == ZFS_IOC_WAIT);
 	CHECK(ZFS_IOC_BASE + 84 == ZFS_IOC_WAIT_FS);
 	CHECK(ZFS_IOC_BASE + 87 == ZFS_IOC_POOL_SCRUB);
+	CHECK(ZFS_IOC_BASE + 90 == ZFS_IOC_GET_DATASET_PROPS);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 1 == ZFS_IOC_EVENTS_NEXT);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 2 == ZFS_IOC_EVENTS_CLEAR);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 3 == ZFS_IOC_EVENTS_SEEK);
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: CDDL-1.0
+
+#
+# This file and its contents are supplied under the terms of the
+# Common Development and Distribution License ("CDDL"), version 1.0.
+# You may only use this file in accordance with the terms of version
+# 1.0 of the CDDL.
+#
+# A full copy of the text of the CDDL should have accompanied this
+# source.  A copy of the CDDL is also available via the Internet at
+# http://www.illumos.org/license/CDDL.
+#
+
+#
+# Compare the JSON results of two performance runs. Usage:
+#
+#   compare_results.py <baseline dir> <current dir> <threshold %> [prefix]
+#
+# Every fio (json output) and timed result in the current directory which
+# has a counterpart of the same name in the baseline directory is compared.
+# Exits non-zero if any result regressed by more than the threshold.
+#
+
+import json
+import os
+import sys
+
+
+def metric(path):
+    try:
+        with open(path) as f:
+            data = json.load(f)
+    except (OSError, ValueError):
+        return None
+
+    if 'rate' in data:
+        return float(data['rate'])
+
+    if 'jobs' in data:
+        iops = 0.0
+        for job in data['jobs']:
+            for op in ('read', 'write', 'trim'):
+                iops += job.get(op, {}).get('iops', 0.0)
+        return iops
+
+    return None
+
+
+def main():
+    if len(sys.argv) < 4:
+        sys.exit('usage: %s <baseline> <current> <threshold> [prefix]' %
+                 sys.argv[0])
+
+    baseline, current = sys.argv[1], sys.argv[2]
+    threshold = float(sys.argv[3])
+    prefix = sys.argv[4] if len(sys.argv) > 4 else ''
+
+    regressed = 0
+    for name in sorted(os.listdir(current)):
+        if not name.startswith(prefix):
+            continue
+        if '.fio.' not in name and '.timed.' not in name:
+            continue
+
+        base = os.path.join(baseline, name)
+        if not os.path.exists(base):
+            continue
+
+        old = metric(base)
+        new = metric(os.path.join(current, name))
+        if old is None or new is None or old == 0:
+            continue
+
+        change = (new - old) * 100.0 / old
+        status = 'ok'
+        if change < -threshold:
+            status = 'REGRESSED'
+            regressed += 1
+        print('%-64s %14.2f %14.2f %+7.1f%% %s' %
+              (name, old, new, change, status))
+
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == '__main__':
+    main()